@@ -1,5 +1,7 @@
 LIBARCH_SOURCES := \
         simd_vector.cc \
+	simd_vector_avx2.cc \
+	simd_vector_avx512.cc \
         demangle.cc \
 	tick_counter.cc \
 	cpuid.cc \
@@ -26,6 +28,11 @@ endif
 $(eval $(call library,arch,$(LIBARCH_SOURCES),$(LIBARCH_LINK)))
 $(eval $(call set_single_compile_option,simd_vector.cc,-funsafe-loop-optimizations -Wunsafe-loop-optimizations))
 
+# The kernels are only called when cpuid says the CPU has the extension.  No
+# contraction into FMAs, so that they round like the SSE2 code.
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -ffp-contract=off))
+$(eval $(call set_single_compile_option,simd_vector_avx512.cc,-mavx512f -ffp-contract=off))
+
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
 $(eval $(call library,node_exception_tracing,node_exception_tracing.cc,exception_hook arch dl))
@@ -0,0 +1,175 @@
+/* bitfield_ops.h                                                  -*- C++ -*-
+   Copyright (c) 2013 Datacratic.  All rights reserved.
+
+   Vectorized bulk operations over arrays of 64 bit words.  These are the
+   kernels behind the bitfield sets used in the filtering code; they process
+   16 bytes (32 with AVX2) per iteration and fall back to scalar code for the
+   tail.  Loads and stores are unaligned so any word array can be used.
+*/
+
+#pragma once
+
+#include "jml/compiler/compiler.h"
+#include "jml/arch/bitops.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <emmintrin.h>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE4_1__)
+#  include <smmintrin.h>
+#endif
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* BITFIELD BINARY OPS                                                       */
+/*****************************************************************************/
+
+/** Each of the following defines two functions:
+
+    - bitfield_OP(dst, src, n): dst[i] = dst[i] OP src[i] for i in [0, n)
+    - bitfield_OP_word(dst, word, n): dst[i] = dst[i] OP word for i in [0, n)
+
+    The second form is used when one operand is shorter than the other and its
+    missing words are implicitly filled with a constant.
+ */
+
+#if defined(__AVX2__)
+
+#define JML_BITFIELD_OP_AVX2(_name_)                                    \
+    for (; i + 4 <= n; i += 4) {                                        \
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));     \
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));     \
+        _mm256_storeu_si256((__m256i *)(dst + i),                       \
+                            _mm256_##_name_##_si256(a, b));             \
+    }
+
+#define JML_BITFIELD_OP_WORD_AVX2(_name_)                               \
+    __m256i wv = _mm256_set1_epi64x(word);                              \
+    for (; i + 4 <= n; i += 4) {                                        \
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));     \
+        _mm256_storeu_si256((__m256i *)(dst + i),                       \
+                            _mm256_##_name_##_si256(a, wv));            \
+    }
+
+#else
+
+#define JML_BITFIELD_OP_AVX2(_name_)
+#define JML_BITFIELD_OP_WORD_AVX2(_name_)
+
+#endif
+
+#define JML_BITFIELD_OP(_name_, _op_)                                   \
+    JML_ALWAYS_INLINE void                                              \
+    bitfield_##_name_(uint64_t * dst, const uint64_t * src, size_t n)   \
+    {                                                                   \
+        size_t i = 0;                                                   \
+        JML_BITFIELD_OP_AVX2(_name_)                                    \
+        for (; i + 2 <= n; i += 2) {                                    \
+            __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));    \
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + i));    \
+            _mm_storeu_si128((__m128i *)(dst + i),                      \
+                             _mm_##_name_##_si128(a, b));               \
+        }                                                               \
+        if (i < n) dst[i] _op_ src[i];                                  \
+    }                                                                   \
+                                                                        \
+    JML_ALWAYS_INLINE void                                              \
+    bitfield_##_name_##_word(uint64_t * dst, uint64_t word, size_t n)   \
+    {                                                                   \
+        size_t i = 0;                                                   \
+        JML_BITFIELD_OP_WORD_AVX2(_name_)                               \
+        __m128i w = _mm_set1_epi64x(word);                              \
+        for (; i + 2 <= n; i += 2) {                                    \
+            __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));    \
+            _mm_storeu_si128((__m128i *)(dst + i),                      \
+                             _mm_##_name_##_si128(a, w));               \
+        }                                                               \
+        if (i < n) dst[i] _op_ word;                                    \
+    }
+
+JML_BITFIELD_OP(and, &=)
+JML_BITFIELD_OP(or,  |=)
+JML_BITFIELD_OP(xor, ^=)
+
+#undef JML_BITFIELD_OP
+#undef JML_BITFIELD_OP_AVX2
+#undef JML_BITFIELD_OP_WORD_AVX2
+
+
+/*****************************************************************************/
+/* BITFIELD UNARY OPS                                                        */
+/*****************************************************************************/
+
+/** dst[i] = ~dst[i] for i in [0, n). */
+JML_ALWAYS_INLINE void
+bitfield_not(uint64_t * dst, size_t n)
+{
+    size_t i = 0;
+    __m128i ones = _mm_set1_epi32(-1);
+    for (; i + 2 <= n; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, ones));
+    }
+    if (i < n) dst[i] = ~dst[i];
+}
+
+/** Returns true if any bit is set in the n words starting at src.  The words
+    are OR-reduced 8 at a time so that only one test is needed per block.
+*/
+JML_ALWAYS_INLINE JML_PURE_FN bool
+bitfield_any(const uint64_t * src, size_t n)
+{
+    size_t i = 0;
+    __m128i acc = _mm_setzero_si128();
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 2));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 6));
+        acc = _mm_or_si128(acc, _mm_or_si128(_mm_or_si128(a, b),
+                                             _mm_or_si128(c, d)));
+    }
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(src + i)));
+
+#if defined(__SSE4_1__)
+    bool any = !_mm_testz_si128(acc, acc);
+#else
+    bool any = _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128()))
+        != 0xFFFF;
+#endif
+
+    if (i < n) any = any || src[i];
+    return any;
+}
+
+/** Returns the number of bits set in the n words starting at src.  There's no
+    vector popcount in SSE so this uses four independent accumulators to keep
+    the popcnt units busy instead of serializing on a single sum.
+*/
+JML_ALWAYS_INLINE JML_PURE_FN size_t
+bitfield_count(const uint64_t * src, size_t n)
+{
+    size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        c0 += num_bits_set(src[i]);
+        c1 += num_bits_set(src[i + 1]);
+        c2 += num_bits_set(src[i + 2]);
+        c3 += num_bits_set(src[i + 3]);
+    }
+    for (; i < n; ++i)
+        c0 += num_bits_set(src[i]);
+
+    return c0 + c1 + c2 + c3;
+}
+
+} // namespace ML
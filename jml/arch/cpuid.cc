@@ -83,6 +83,15 @@ cpuid(uint32_t request, uint32_t ecx = 0)
     return result;
 }
 
+/** Extended control register 0, which says which register sets the OS
+    saves on context switches.  Only valid when cpuid says osxsave. */
+uint64_t xgetbv0()
+{
+    uint32_t eax, edx;
+    asm volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((uint64_t)edx << 32) | eax;
+}
+
 } // file scope
 
 uint32_t cpuid_flags()
@@ -139,6 +148,7 @@ std::string model_id()
 CPU_Info::CPU_Info()
 {
     cpuid_level = cpuid_extlevel = standard1 = standard2 = extended = amd = 0;
+    avx = avx2 = avx512f = invariant_tsc = false;
 
     cpuid_level = cpuid(CPUID_LEVEL).eax;
     cpuid_extlevel = cpuid(CPUID_EXT_LEVEL).eax;
@@ -162,6 +172,21 @@ CPU_Info::CPU_Info()
         amd = r.ecx;
     }
 
+    // The ymm registers need bits 1-2 of xcr0 and the zmm and mask registers
+    // bits 5-7 as well
+    bool osxsave = standard2 & (1 << 27);
+    uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    avx = (standard2 & (1 << 28)) && (xcr0 & 0x06) == 0x06;
+
+    if (avx && cpuid_level >= 7) {
+        r = cpuid(7, 0);
+        avx2 = r.ebx & (1 << 5);
+        avx512f = (r.ebx & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+    }
+
+    if (cpuid_extlevel >= CPUID_EXT_APM_INFO)
+        invariant_tsc = cpuid(CPUID_EXT_APM_INFO).edx & (1 << 8);
+
 #if 0
     if (fpu) cerr << "fpu ";
 
@@ -141,6 +141,16 @@ struct CPU_Info {
         uint32_t amd;
     };
 
+    // Vector extensions whose registers the OS also saves, so that they can
+    // actually be used.  avx512f is the AVX-512 foundation.
+    bool avx;
+    bool avx2;
+    bool avx512f;
+
+    // The tick counter runs at a constant rate in all power states, so that
+    // it can be used as a clock.
+    bool invariant_tsc;
+
     std::string print_flags();
 };
 
@@ -25,5 +25,15 @@ bool makeThreadRealTime(unsigned long long handle,
     return true;
 }
 
+bool pinThreadToCpu(unsigned long long handle, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int res = pthread_setaffinity_np(handle, sizeof(set), &set);
+    return res == 0;
+}
+
 } // namespace ML
 
@@ -30,6 +30,18 @@ inline bool makeThreadRealTime(boost::thread & thread, int priority)
     return makeThreadRealTime(thread.native_handle(), priority);
 }
 
+bool pinThreadToCpu(unsigned long long handle, int cpu);
+
+/** Restrict the given boost::thread to run on the given cpu only.
+
+    Returns whether or not the call succeeded.
+*/
+
+inline bool pinThreadToCpu(boost::thread & thread, int cpu)
+{
+    return pinThreadToCpu(thread.native_handle(), cpu);
+}
+
 } // namespace ML
 
 #endif /* __jml__arch__rt_h__ */
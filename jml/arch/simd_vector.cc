@@ -22,7 +22,10 @@
 
 #include "exception.h"
 #include "simd_vector.h"
+#include "simd_vector_kernels.h"
+#include "cpuid.h"
 #include "jml/compiler/compiler.h"
+#include <atomic>
 #include <iostream>
 #include <cmath>
 #include "sse2.h"
@@ -34,6 +37,78 @@ using namespace std;
 
 namespace ML {
 namespace SIMD {
+
+
+/*****************************************************************************/
+/* DISPATCH                                                                  */
+/*****************************************************************************/
+
+namespace {
+
+// No wide kernels; the functions use their own code.
+const Kernels sse2_kernels = { "sse2" };
+
+std::atomic<const Kernels *> current_kernels(nullptr);
+
+const Kernels * best_kernels()
+{
+#if defined __amd64__
+    const CPU_Info & info = cpu_info();
+    if (info.avx512f) return &AVX512::kernels;
+    if (info.avx2) return &AVX2::kernels;
+#endif
+    return &sse2_kernels;
+}
+
+JML_ALWAYS_INLINE const Kernels & kernels()
+{
+    const Kernels * result = current_kernels.load(std::memory_order_relaxed);
+    if (JML_UNLIKELY(!result)) {
+        const Kernels * expected = nullptr;
+        current_kernels.compare_exchange_strong(expected, best_kernels());
+        result = current_kernels.load();
+    }
+    return *result;
+}
+
+/** Hand the call over to the kernel of the selected extension, if it has
+    one, when there are enough elements to fill its vectors.  Expects the
+    number of elements to be called n.
+*/
+#define JML_SIMD_DISPATCH(kernel, ...)                           \
+    do {                                                         \
+        if (n >= 8) {                                            \
+            auto fn = kernels().kernel;                          \
+            if (fn) return fn(__VA_ARGS__);                      \
+        }                                                        \
+    } while (false)
+
+} // file scope
+
+const char * vec_isa()
+{
+    return kernels().isa;
+}
+
+bool vec_use_isa(const std::string & isa)
+{
+    const Kernels * result = nullptr;
+
+    if (isa == "sse2") result = &sse2_kernels;
+#if defined __amd64__
+    else if (isa == "avx2" && cpu_info().avx2)
+        result = &AVX2::kernels;
+    else if (isa == "avx512" && cpu_info().avx512f)
+        result = &AVX512::kernels;
+#endif
+    else if (isa == "best") result = best_kernels();
+
+    if (!result) return false;
+    current_kernels = result;
+    return true;
+}
+
+
 namespace Generic {
 
 template<typename X>
@@ -45,6 +120,8 @@ int ptr_align(const X * p)
 
 void vec_scale(const float * x, float k, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(scale_f, x, k, r, n);
+
     v4sf kkkk = vec_splat(k);
     unsigned i = 0;
 
@@ -77,6 +154,8 @@ void vec_scale(const float * x, float k, float * r, size_t n)
 
 void vec_add(const float * x, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(add_f, x, y, r, n);
+
     unsigned i = 0;
 
     if (false) ;
@@ -115,6 +194,8 @@ void vec_add(const float * x, const float * y, float * r, size_t n)
 
 void vec_prod(const float * x, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(prod_f, x, y, r, n);
+
     unsigned i = 0;
 
     if (false) ;
@@ -205,6 +286,8 @@ void vec_prod(const double * x, const double * y, float * r, size_t n)
 
 void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(add_k_f, x, k, y, r, n);
+
     v4sf kkkk = vec_splat(k);
     unsigned i = 0;
 
@@ -297,6 +380,8 @@ void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 void vec_add(const float * x, const float * k, const float * y, float * r,
              size_t n)
 {
+    JML_SIMD_DISPATCH(add_kv_f, x, k, y, r, n);
+
     unsigned i = 0;
 
     if (true) {
@@ -347,6 +432,8 @@ void vec_add(const float * x, float k, const double * y, float * r, size_t n)
 
 float vec_dotprod(const float * x, const float * y, size_t n)
 {
+    JML_SIMD_DISPATCH(dotprod_f, x, y, n);
+
     double res = 0.0;
     for (unsigned i = 0;  i < n;  ++i) res += x[i] * y[i];
     return res;
@@ -354,6 +441,8 @@ float vec_dotprod(const float * x, const float * y, size_t n)
 
 void vec_scale(const double * x, double k, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(scale_d, x, k, r, n);
+
     v2df kk = vec_splat(k);
     unsigned i = 0;
 
@@ -387,6 +476,8 @@ void vec_scale(const double * x, double k, double * r, size_t n)
 void vec_add(const double * x, double k, const double * y, double * r,
              size_t n)
 {
+    JML_SIMD_DISPATCH(add_k_d, x, k, y, r, n);
+
     v2df kk = vec_splat(k);
     unsigned i = 0;
 
@@ -433,6 +524,8 @@ void vec_add(const double * x, double k, const double * y, double * r,
 void vec_add(const double * x, const double * k, const double * y,
              double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(add_kv_d, x, k, y, r, n);
+
     unsigned i = 0;
     if (true) {
         for (; i + 8 <= n;  i += 8) {
@@ -480,6 +573,8 @@ void vec_add(const double * x, const double * k, const double * y,
 
 double vec_dotprod(const double * x, const double * y, size_t n)
 {
+    JML_SIMD_DISPATCH(dotprod_d, x, y, n);
+
     unsigned i = 0;
     double result = 0.0;
 
@@ -528,12 +623,16 @@ double vec_dotprod(const double * x, const double * y, size_t n)
 
 void vec_minus(const float * x, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(minus_f, x, y, r, n);
+
     for (unsigned i = 0;  i < n;  ++i) r[i] = x[i] - y[i];
 }
 
 double vec_accum_prod3(const float * x, const float * y, const float * z,
                        size_t n)
 {
+    JML_SIMD_DISPATCH(accum_prod3_f, x, y, z, n);
+
     double res = 0.0;
     unsigned i = 0;
 
@@ -613,6 +712,8 @@ double vec_accum_prod3(const float * x, const float * y, const float * z,
 double vec_accum_prod3(const float * x, const float * y, const double * z,
                        size_t n)
 {
+    JML_SIMD_DISPATCH(accum_prod3_ffd, x, y, z, n);
+
     double res = 0.0;
     unsigned i = 0;
 
@@ -650,12 +751,16 @@ double vec_accum_prod3(const float * x, const float * y, const double * z,
 
 void vec_minus(const double * x, const double * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(minus_d, x, y, r, n);
+
     for (unsigned i = 0;  i < n;  ++i) r[i] = x[i] - y[i];
 }
 
 double vec_accum_prod3(const double * x, const double * y, const double * z,
                       size_t n)
 {
+    JML_SIMD_DISPATCH(accum_prod3_d, x, y, z, n);
+
     unsigned i = 0;
     double result = 0.0;
 
@@ -754,6 +859,8 @@ double vec_accum_prod3(const double * x, const double * y, const float * z,
 
 double vec_sum(const double * x, size_t n)
 {
+    JML_SIMD_DISPATCH(sum_d, x, n);
+
     double res = 0.0;
     for (unsigned i = 0;  i < n;  ++i)
         res += x[i];
@@ -762,6 +869,8 @@ double vec_sum(const double * x, size_t n)
 
 double vec_dotprod_dp(const float * x, const float * y, size_t n)
 {
+    JML_SIMD_DISPATCH(dotprod_dp_f, x, y, n);
+
     double res = 0.0;
     unsigned i = 0;
 
@@ -831,6 +940,8 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
 
 double vec_dotprod_dp(const double * x, const float * y, size_t n)
 {
+    JML_SIMD_DISPATCH(dotprod_dp_df, x, y, n);
+
     double res = 0.0;
 
     unsigned i = 0;
@@ -890,6 +1001,8 @@ double vec_dotprod_dp(const double * x, const float * y, size_t n)
 
 double vec_sum_dp(const float * x, size_t n)
 {
+    JML_SIMD_DISPATCH(sum_dp_f, x, n);
+
     double res = 0.0;
     for (unsigned i = 0;  i < n;  ++i)
         res += x[i];
@@ -898,6 +1011,8 @@ double vec_sum_dp(const float * x, size_t n)
 
 void vec_add(const double * x, const double * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(add_d, x, y, r, n);
+
     unsigned i = 0;
     if (true) {
         for (; i + 8 <= n;  i += 8) {
@@ -935,6 +1050,8 @@ void vec_add(const double * x, const double * y, double * r, size_t n)
 
 void vec_add(const double * x, double k, const float * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(add_k_df, x, k, y, r, n);
+
     unsigned i = 0;
 
     v2df kk = vec_splat(k);
@@ -1000,6 +1117,8 @@ void vec_add(const double * x, const float * y, double * r, size_t n)
 
 void vec_prod(const double * x, const double * y, double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(prod_d, x, y, r, n);
+
     unsigned i = 0;
     if (true) {
         for (; i + 8 <= n;  i += 8) {
@@ -1091,6 +1210,8 @@ void vec_k1_x_plus_k2_y_z(double k1, const double * x,
                           double k2, const double * y, const double * z,
                           double * r, size_t n)
 {
+    JML_SIMD_DISPATCH(k1_x_plus_k2_y_z_d, k1, x, k2, y, z, r, n);
+
     unsigned i = 0;
 
     v2df kk1 = vec_splat(k1);
@@ -1154,6 +1275,8 @@ void vec_k1_x_plus_k2_y_z(float k1, const float * x,
                           float k2, const float * y, const float * z,
                           float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(k1_x_plus_k2_y_z_f, k1, x, k2, y, z, r, n);
+
     unsigned i = 0;
 
     v4sf kkkk1 = vec_splat(k1);
@@ -1215,6 +1338,8 @@ void vec_k1_x_plus_k2_y_z(float k1, const float * x,
 
 void vec_add_sqr(const float * x, float k, const float * y, float * r, size_t n)
 {
+    JML_SIMD_DISPATCH(add_sqr_f, x, k, y, r, n);
+
     unsigned i = 0;
 
     if (true) {
@@ -1264,6 +1389,8 @@ void vec_add_sqr(const float * x, float k, const float * y, float * r, size_t n)
 void vec_add_sqr(const double * x, double k, const double * y, double * r,
                  size_t n)
 {
+    JML_SIMD_DISPATCH(add_sqr_d, x, k, y, r, n);
+
     v2df kk = vec_splat(k);
     unsigned i = 0;
 
@@ -1625,6 +1752,8 @@ double vec_kl(const float * p, const float * q, size_t n)
 
 void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n)
 {
+    JML_SIMD_DISPATCH(min_max_el_f, x, mins, maxs, n);
+
     unsigned i = 0;
 
     if (false) ;
@@ -25,10 +25,24 @@
 
 #include "simd.h"
 #include "jml/arch/arch.h"
+#include <string>
 
 namespace ML {
 
 namespace SIMD {
+
+/** Vector extension that the functions below use for long enough vectors:
+    "sse2", "avx2" or "avx512".  The widest one the CPU supports is selected
+    on first use.
+*/
+const char * vec_isa();
+
+/** Use the given vector extension, or the widest supported one for "best".
+    Returns false, and changes nothing, if the CPU doesn't support it.  Only
+    the order of the additions in the reductions depends on the extension.
+*/
+bool vec_use_isa(const std::string & isa);
+
 namespace Generic {
 
 /* Float versions */
@@ -0,0 +1,56 @@
+/* simd_vector_avx2.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   AVX2 versions of the simd_vector functions.  This file is compiled with
+   -mavx2 and its functions must only be called once the CPU is known to
+   support it (see vec_use_isa()).
+*/
+
+#include "simd_vector_kernels.h"
+#include <immintrin.h>
+
+
+namespace ML {
+namespace SIMD {
+namespace AVX2 {
+
+namespace {
+
+struct Isa {
+    static constexpr const char * name = "avx2";
+
+    typedef __m256 vf;
+    typedef __m256d vd;
+
+    enum { NF = 8, ND = 4 };
+
+    static vf loadf(const float * p) { return _mm256_loadu_ps(p); }
+    static void storef(float * p, vf v) { _mm256_storeu_ps(p, v); }
+    static vd loadd(const double * p) { return _mm256_loadu_pd(p); }
+    static void stored(double * p, vd v) { _mm256_storeu_pd(p, v); }
+
+    static vf splatf(float x) { return _mm256_set1_ps(x); }
+    static vd splatd(double x) { return _mm256_set1_pd(x); }
+
+    static void widen(vf v, vd & lo, vd & hi)
+    {
+        lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+        hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+    }
+
+    static vd loadfd(const float * p)
+    {
+        return _mm256_cvtps_pd(_mm_loadu_ps(p));
+    }
+
+    static vf minf(vf x, vf y) { return _mm256_min_ps(x, y); }
+    static vf maxf(vf x, vf y) { return _mm256_max_ps(x, y); }
+};
+
+} // file scope
+
+constexpr Kernels kernels = VectorKernels<Isa>::table();
+
+} // namespace AVX2
+} // namespace SIMD
+} // namespace ML
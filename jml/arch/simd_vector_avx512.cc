@@ -0,0 +1,58 @@
+/* simd_vector_avx512.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   AVX-512 versions of the simd_vector functions.  This file is compiled
+   with -mavx512f and its functions must only be called once the CPU is
+   known to support it (see vec_use_isa()).
+*/
+
+#include "simd_vector_kernels.h"
+#include <immintrin.h>
+
+
+namespace ML {
+namespace SIMD {
+namespace AVX512 {
+
+namespace {
+
+struct Isa {
+    static constexpr const char * name = "avx512";
+
+    typedef __m512 vf;
+    typedef __m512d vd;
+
+    enum { NF = 16, ND = 8 };
+
+    static vf loadf(const float * p) { return _mm512_loadu_ps(p); }
+    static void storef(float * p, vf v) { _mm512_storeu_ps(p, v); }
+    static vd loadd(const double * p) { return _mm512_loadu_pd(p); }
+    static void stored(double * p, vd v) { _mm512_storeu_pd(p, v); }
+
+    static vf splatf(float x) { return _mm512_set1_ps(x); }
+    static vd splatd(double x) { return _mm512_set1_pd(x); }
+
+    static void widen(vf v, vd & lo, vd & hi)
+    {
+        // AVX-512F only extracts 256 bit halves as doubles
+        __m256d h = _mm512_extractf64x4_pd(_mm512_castps_pd(v), 1);
+        lo = _mm512_cvtps_pd(_mm512_castps512_ps256(v));
+        hi = _mm512_cvtps_pd(_mm256_castpd_ps(h));
+    }
+
+    static vd loadfd(const float * p)
+    {
+        return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+    }
+
+    static vf minf(vf x, vf y) { return _mm512_min_ps(x, y); }
+    static vf maxf(vf x, vf y) { return _mm512_max_ps(x, y); }
+};
+
+} // file scope
+
+constexpr Kernels kernels = VectorKernels<Isa>::table();
+
+} // namespace AVX512
+} // namespace SIMD
+} // namespace ML
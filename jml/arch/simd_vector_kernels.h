@@ -0,0 +1,470 @@
+/* simd_vector_kernels.h                                           -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Wide vector implementations of the simd_vector functions, which are
+   selected at runtime according to what the CPU supports.
+*/
+
+#ifndef __arch__simd_vector_kernels_h__
+#define __arch__simd_vector_kernels_h__
+
+#include <algorithm>
+#include <cstddef>
+#include <string.h>
+
+namespace ML {
+namespace SIMD {
+
+
+/*****************************************************************************/
+/* KERNELS                                                                   */
+/*****************************************************************************/
+
+/** Table of the implementations of the simd_vector functions for one vector
+    extension.  The functions in Generic call through the table of the
+    extension selected by vec_use_isa() when their vectors are long enough
+    to be worth it; they fall back to their own SSE2 code when the table has
+    no entry for them.  The results are the same, except for the order in
+    which the reductions add up.
+*/
+
+struct Kernels {
+    const char * isa;
+
+    void (*scale_f)(const float * x, float k, float * r, size_t n);
+    void (*add_f)(const float * x, const float * y, float * r, size_t n);
+    void (*add_k_f)(const float * x, float k, const float * y, float * r,
+                    size_t n);
+    void (*add_kv_f)(const float * x, const float * k, const float * y,
+                     float * r, size_t n);
+    void (*add_sqr_f)(const float * x, float k, const float * y, float * r,
+                      size_t n);
+    void (*prod_f)(const float * x, const float * y, float * r, size_t n);
+    void (*minus_f)(const float * x, const float * y, float * r, size_t n);
+    void (*k1_x_plus_k2_y_z_f)(float k1, const float * x, float k2,
+                               const float * y, const float * z, float * r,
+                               size_t n);
+    float (*dotprod_f)(const float * x, const float * y, size_t n);
+    double (*dotprod_dp_f)(const float * x, const float * y, size_t n);
+    double (*accum_prod3_f)(const float * x, const float * y,
+                            const float * z, size_t n);
+    double (*accum_prod3_ffd)(const float * x, const float * y,
+                              const double * z, size_t n);
+    double (*sum_dp_f)(const float * x, size_t n);
+    void (*min_max_el_f)(const float * x, float * mins, float * maxs,
+                         size_t n);
+
+    void (*scale_d)(const double * x, double k, double * r, size_t n);
+    void (*add_d)(const double * x, const double * y, double * r, size_t n);
+    void (*add_k_d)(const double * x, double k, const double * y, double * r,
+                    size_t n);
+    void (*add_kv_d)(const double * x, const double * k, const double * y,
+                     double * r, size_t n);
+    void (*add_sqr_d)(const double * x, double k, const double * y,
+                      double * r, size_t n);
+    void (*prod_d)(const double * x, const double * y, double * r, size_t n);
+    void (*minus_d)(const double * x, const double * y, double * r, size_t n);
+    void (*k1_x_plus_k2_y_z_d)(double k1, const double * x, double k2,
+                               const double * y, const double * z,
+                               double * r, size_t n);
+    double (*dotprod_d)(const double * x, const double * y, size_t n);
+    double (*accum_prod3_d)(const double * x, const double * y,
+                            const double * z, size_t n);
+    double (*sum_d)(const double * x, size_t n);
+
+    void (*add_k_df)(const double * x, double k, const float * y, double * r,
+                     size_t n);
+    double (*dotprod_dp_df)(const double * x, const float * y, size_t n);
+};
+
+namespace AVX2 {
+extern const Kernels kernels;
+} // namespace AVX2
+
+namespace AVX512 {
+extern const Kernels kernels;
+} // namespace AVX512
+
+
+/*****************************************************************************/
+/* VECTOR KERNELS                                                            */
+/*****************************************************************************/
+
+/** The kernels written once for any vector width.  Isa provides the float
+    and double vector types vf and vd of NF floats and ND doubles (which
+    support the arithmetic operators), and:
+
+    - loadf, storef, loadd, stored: unaligned loads and stores
+    - splatf, splatd: vector with all elements equal
+    - widen(vf, vd & lo, vd & hi): the floats of a vector as doubles
+    - loadfd(const float *): ND floats as doubles
+    - minf, maxf: element-wise min and max
+
+    Only included by the files that are compiled for each extension.
+*/
+
+template<typename Isa>
+struct VectorKernels {
+
+    typedef typename Isa::vf vf;
+    typedef typename Isa::vd vd;
+
+    enum { NF = Isa::NF, ND = Isa::ND };
+
+    static float hsum(vf v)
+    {
+        float vals[NF];
+        memcpy(vals, &v, sizeof(vals));
+        float result = 0.0;
+        for (unsigned i = 0;  i < NF;  ++i) result += vals[i];
+        return result;
+    }
+
+    static double hsum(vd v)
+    {
+        double vals[ND];
+        memcpy(vals, &v, sizeof(vals));
+        double result = 0.0;
+        for (unsigned i = 0;  i < ND;  ++i) result += vals[i];
+        return result;
+    }
+
+    /* Float versions */
+
+    static void scale_f(const float * x, float k, float * r, size_t n)
+    {
+        vf kk = Isa::splatf(k);
+        size_t i = 0;
+        for (; i + 2 * NF <= n;  i += 2 * NF) {
+            vf x0 = Isa::loadf(x + i), x1 = Isa::loadf(x + i + NF);
+            Isa::storef(r + i, x0 * kk);
+            Isa::storef(r + i + NF, x1 * kk);
+        }
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i) * kk);
+        for (; i < n;  ++i) r[i] = k * x[i];
+    }
+
+    static void add_f(const float * x, const float * y, float * r, size_t n)
+    {
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i) + Isa::loadf(y + i));
+        for (; i < n;  ++i) r[i] = x[i] + y[i];
+    }
+
+    static void add_k_f(const float * x, float k, const float * y, float * r,
+                        size_t n)
+    {
+        vf kk = Isa::splatf(k);
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i) + Isa::loadf(y + i) * kk);
+        for (; i < n;  ++i) r[i] = x[i] + k * y[i];
+    }
+
+    static void add_kv_f(const float * x, const float * k, const float * y,
+                         float * r, size_t n)
+    {
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i)
+                               + Isa::loadf(y + i) * Isa::loadf(k + i));
+        for (; i < n;  ++i) r[i] = x[i] + k[i] * y[i];
+    }
+
+    static void add_sqr_f(const float * x, float k, const float * y,
+                          float * r, size_t n)
+    {
+        vf kk = Isa::splatf(k);
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF) {
+            vf yy = Isa::loadf(y + i);
+            Isa::storef(r + i, Isa::loadf(x + i) + (yy * yy) * kk);
+        }
+        for (; i < n;  ++i) r[i] = x[i] + k * (y[i] * y[i]);
+    }
+
+    static void prod_f(const float * x, const float * y, float * r, size_t n)
+    {
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i) * Isa::loadf(y + i));
+        for (; i < n;  ++i) r[i] = x[i] * y[i];
+    }
+
+    static void minus_f(const float * x, const float * y, float * r,
+                        size_t n)
+    {
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i) - Isa::loadf(y + i));
+        for (; i < n;  ++i) r[i] = x[i] - y[i];
+    }
+
+    static void k1_x_plus_k2_y_z_f(float k1, const float * x, float k2,
+                                   const float * y, const float * z,
+                                   float * r, size_t n)
+    {
+        vf kk1 = Isa::splatf(k1), kk2 = Isa::splatf(k2);
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF)
+            Isa::storef(r + i, Isa::loadf(x + i) * kk1
+                               + Isa::loadf(y + i) * kk2 * Isa::loadf(z + i));
+        for (; i < n;  ++i) r[i] = k1 * x[i] + k2 * y[i] * z[i];
+    }
+
+    /** Sum of the float vectors block(i) for i in [0, n) in steps of NF,
+        accumulated in double precision, and of tail(i) for the rest. */
+    template<typename Block, typename Tail>
+    static double accum_f(size_t n, Block block, Tail tail)
+    {
+        vd r0 = Isa::splatd(0.0), r1 = Isa::splatd(0.0);
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF) {
+            vd lo, hi;
+            Isa::widen(block(i), lo, hi);
+            r0 += lo;
+            r1 += hi;
+        }
+        double result = hsum(r0 + r1);
+        for (; i < n;  ++i) result += tail(i);
+        return result;
+    }
+
+    static float dotprod_f(const float * x, const float * y, size_t n)
+    {
+        return dotprod_dp_f(x, y, n);
+    }
+
+    static double dotprod_dp_f(const float * x, const float * y, size_t n)
+    {
+        return accum_f(n,
+                       [&] (size_t i) { return Isa::loadf(x + i) * Isa::loadf(y + i); },
+                       [&] (size_t i) { return x[i] * y[i]; });
+    }
+
+    static double accum_prod3_f(const float * x, const float * y,
+                                const float * z, size_t n)
+    {
+        return accum_f(n,
+                       [&] (size_t i)
+                       {
+                           return Isa::loadf(x + i) * Isa::loadf(y + i)
+                               * Isa::loadf(z + i);
+                       },
+                       [&] (size_t i) { return x[i] * y[i] * z[i]; });
+    }
+
+    static double accum_prod3_ffd(const float * x, const float * y,
+                                  const double * z, size_t n)
+    {
+        vd r0 = Isa::splatd(0.0), r1 = Isa::splatd(0.0);
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF) {
+            vd lo, hi;
+            Isa::widen(Isa::loadf(x + i) * Isa::loadf(y + i), lo, hi);
+            r0 += lo * Isa::loadd(z + i);
+            r1 += hi * Isa::loadd(z + i + ND);
+        }
+        double result = hsum(r0 + r1);
+        for (; i < n;  ++i) result += x[i] * y[i] * z[i];
+        return result;
+    }
+
+    static double sum_dp_f(const float * x, size_t n)
+    {
+        vd r0 = Isa::splatd(0.0);
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            r0 += Isa::loadfd(x + i);
+        double result = hsum(r0);
+        for (; i < n;  ++i) result += x[i];
+        return result;
+    }
+
+    static void min_max_el_f(const float * x, float * mins, float * maxs,
+                             size_t n)
+    {
+        size_t i = 0;
+        for (; i + NF <= n;  i += NF) {
+            vf xx = Isa::loadf(x + i);
+            Isa::storef(mins + i, Isa::minf(Isa::loadf(mins + i), xx));
+            Isa::storef(maxs + i, Isa::maxf(Isa::loadf(maxs + i), xx));
+        }
+        for (; i < n;  ++i) {
+            mins[i] = std::min(mins[i], x[i]);
+            maxs[i] = std::max(maxs[i], x[i]);
+        }
+    }
+
+    /* Double versions */
+
+    static void scale_d(const double * x, double k, double * r, size_t n)
+    {
+        vd kk = Isa::splatd(k);
+        size_t i = 0;
+        for (; i + 2 * ND <= n;  i += 2 * ND) {
+            vd x0 = Isa::loadd(x + i), x1 = Isa::loadd(x + i + ND);
+            Isa::stored(r + i, x0 * kk);
+            Isa::stored(r + i + ND, x1 * kk);
+        }
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) * kk);
+        for (; i < n;  ++i) r[i] = k * x[i];
+    }
+
+    static void add_d(const double * x, const double * y, double * r,
+                      size_t n)
+    {
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) + Isa::loadd(y + i));
+        for (; i < n;  ++i) r[i] = x[i] + y[i];
+    }
+
+    static void add_k_d(const double * x, double k, const double * y,
+                        double * r, size_t n)
+    {
+        vd kk = Isa::splatd(k);
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) + Isa::loadd(y + i) * kk);
+        for (; i < n;  ++i) r[i] = x[i] + k * y[i];
+    }
+
+    static void add_kv_d(const double * x, const double * k, const double * y,
+                         double * r, size_t n)
+    {
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i)
+                               + Isa::loadd(y + i) * Isa::loadd(k + i));
+        for (; i < n;  ++i) r[i] = x[i] + k[i] * y[i];
+    }
+
+    static void add_sqr_d(const double * x, double k, const double * y,
+                          double * r, size_t n)
+    {
+        vd kk = Isa::splatd(k);
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND) {
+            vd yy = Isa::loadd(y + i);
+            Isa::stored(r + i, Isa::loadd(x + i) + (yy * yy) * kk);
+        }
+        for (; i < n;  ++i) r[i] = x[i] + k * (y[i] * y[i]);
+    }
+
+    static void prod_d(const double * x, const double * y, double * r,
+                       size_t n)
+    {
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) * Isa::loadd(y + i));
+        for (; i < n;  ++i) r[i] = x[i] * y[i];
+    }
+
+    static void minus_d(const double * x, const double * y, double * r,
+                        size_t n)
+    {
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) - Isa::loadd(y + i));
+        for (; i < n;  ++i) r[i] = x[i] - y[i];
+    }
+
+    static void k1_x_plus_k2_y_z_d(double k1, const double * x, double k2,
+                                   const double * y, const double * z,
+                                   double * r, size_t n)
+    {
+        vd kk1 = Isa::splatd(k1), kk2 = Isa::splatd(k2);
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) * kk1
+                               + Isa::loadd(y + i) * kk2 * Isa::loadd(z + i));
+        for (; i < n;  ++i) r[i] = k1 * x[i] + k2 * y[i] * z[i];
+    }
+
+    /** Sum of the double vectors block(i) for i in [0, n) in steps of ND,
+        over two accumulators to hide the latency of the additions, and of
+        tail(i) for the rest. */
+    template<typename Block, typename Tail>
+    static double accum_d(size_t n, Block block, Tail tail)
+    {
+        vd r0 = Isa::splatd(0.0), r1 = Isa::splatd(0.0);
+        size_t i = 0;
+        for (; i + 2 * ND <= n;  i += 2 * ND) {
+            r0 += block(i);
+            r1 += block(i + ND);
+        }
+        for (; i + ND <= n;  i += ND)
+            r0 += block(i);
+        double result = hsum(r0 + r1);
+        for (; i < n;  ++i) result += tail(i);
+        return result;
+    }
+
+    static double dotprod_d(const double * x, const double * y, size_t n)
+    {
+        return accum_d(n,
+                       [&] (size_t i) { return Isa::loadd(x + i) * Isa::loadd(y + i); },
+                       [&] (size_t i) { return x[i] * y[i]; });
+    }
+
+    static double accum_prod3_d(const double * x, const double * y,
+                                const double * z, size_t n)
+    {
+        return accum_d(n,
+                       [&] (size_t i)
+                       {
+                           return Isa::loadd(x + i) * Isa::loadd(y + i)
+                               * Isa::loadd(z + i);
+                       },
+                       [&] (size_t i) { return x[i] * y[i] * z[i]; });
+    }
+
+    static double sum_d(const double * x, size_t n)
+    {
+        return accum_d(n,
+                       [&] (size_t i) { return Isa::loadd(x + i); },
+                       [&] (size_t i) { return x[i]; });
+    }
+
+    /* Mixed versions */
+
+    static void add_k_df(const double * x, double k, const float * y,
+                         double * r, size_t n)
+    {
+        vd kk = Isa::splatd(k);
+        size_t i = 0;
+        for (; i + ND <= n;  i += ND)
+            Isa::stored(r + i, Isa::loadd(x + i) + Isa::loadfd(y + i) * kk);
+        for (; i < n;  ++i) r[i] = x[i] + k * y[i];
+    }
+
+    static double dotprod_dp_df(const double * x, const float * y, size_t n)
+    {
+        return accum_d(n,
+                       [&] (size_t i) { return Isa::loadd(x + i) * Isa::loadfd(y + i); },
+                       [&] (size_t i) { return x[i] * y[i]; });
+    }
+
+    /** Constant so that the tables are initialized before any code runs. */
+    static constexpr Kernels table()
+    {
+        return Kernels {
+            Isa::name,
+            scale_f, add_f, add_k_f, add_kv_f, add_sqr_f, prod_f, minus_f,
+            k1_x_plus_k2_y_z_f, dotprod_f, dotprod_dp_f, accum_prod3_f,
+            accum_prod3_ffd, sum_dp_f, min_max_el_f,
+            scale_d, add_d, add_k_d, add_kv_d, add_sqr_d, prod_d, minus_d,
+            k1_x_plus_k2_y_z_d, dotprod_d, accum_prod3_d, sum_d,
+            add_k_df, dotprod_dp_df
+        };
+    }
+};
+
+} // namespace SIMD
+} // namespace ML
+
+#endif /* __arch__simd_vector_kernels_h__ */
@@ -6,8 +6,10 @@ $(eval $(call test,fslock_test,arch,boost))
 $(eval $(call test,simd_test,arch,boost))
 $(eval $(call test,cmp_xchg_test,arch boost_thread boost_system,boost))
 $(eval $(call test,simd_vector_test,arch,boost))
+$(eval $(call program,simd_vector_bench,arch))
 $(eval $(call test,backtrace_test,arch,boost))
 $(eval $(call test,bit_range_ops_test,arch,boost))
+$(eval $(call test,bitfield_ops_test,arch,boost))
 $(eval $(call test,atomic_ops_test,arch boost_thread,boost))
 $(eval $(call test,sse2_math_test,arch,boost))
 $(eval $(call test,info_test,arch,boost))
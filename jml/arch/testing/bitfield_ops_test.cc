@@ -0,0 +1,105 @@
+/* bitfield_ops_test.cc
+   Copyright (c) 2013 Datacratic.  All rights reserved.
+
+   Tests for the vectorized bitfield kernels against their scalar equivalent.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/arch/bitfield_ops.h"
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <random>
+#include <stdint.h>
+
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+typedef vector<uint64_t> Words;
+
+Words randomWords(mt19937_64& rng, size_t n)
+{
+    Words words(n);
+    for (auto& w : words) w = rng();
+    return words;
+}
+
+} // namespace anonymous
+
+
+BOOST_AUTO_TEST_CASE( test_binary_ops )
+{
+    mt19937_64 rng(0);
+
+    // Cover every tail length for both the SSE and AVX2 loops.
+    for (size_t n = 0; n < 20; ++n) {
+        Words a = randomWords(rng, n);
+        Words b = randomWords(rng, n);
+        uint64_t w = rng();
+
+#define CHECK_OP(_name_, _op_)                                          \
+        {                                                               \
+            Words exp = a, res = a;                                     \
+            for (size_t i = 0; i < n; ++i) exp[i] _op_ b[i];            \
+            bitfield_##_name_(res.data(), b.data(), n);                 \
+            BOOST_CHECK(exp == res);                                    \
+                                                                        \
+            exp = a; res = a;                                           \
+            for (size_t i = 0; i < n; ++i) exp[i] _op_ w;               \
+            bitfield_##_name_##_word(res.data(), w, n);                 \
+            BOOST_CHECK(exp == res);                                    \
+        }
+
+        CHECK_OP(and, &=)
+        CHECK_OP(or,  |=)
+        CHECK_OP(xor, ^=)
+
+#undef CHECK_OP
+
+        Words exp = a, res = a;
+        for (size_t i = 0; i < n; ++i) exp[i] = ~exp[i];
+        bitfield_not(res.data(), n);
+        BOOST_CHECK(exp == res);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_unaligned )
+{
+    mt19937_64 rng(1);
+    Words a = randomWords(rng, 33);
+    Words b = randomWords(rng, 33);
+
+    Words exp = a, res = a;
+    for (size_t i = 1; i < 33; ++i) exp[i] |= b[i - 1];
+    bitfield_or(res.data() + 1, b.data(), 32);
+    BOOST_CHECK(exp == res);
+}
+
+BOOST_AUTO_TEST_CASE( test_any_count )
+{
+    mt19937_64 rng(2);
+
+    for (size_t n = 0; n < 40; ++n) {
+        Words zero(n, 0);
+        BOOST_CHECK(!bitfield_any(zero.data(), n));
+        BOOST_CHECK_EQUAL(bitfield_count(zero.data(), n), 0);
+
+        // A single bit in any position must be picked up.
+        for (size_t i = 0; i < n; ++i) {
+            Words words(n, 0);
+            words[i] = 1ULL << (rng() % 64);
+            BOOST_CHECK(bitfield_any(words.data(), n));
+            BOOST_CHECK_EQUAL(bitfield_count(words.data(), n), 1);
+        }
+
+        Words words = randomWords(rng, n);
+        size_t exp = 0;
+        for (uint64_t w : words) exp += __builtin_popcountll(w);
+        BOOST_CHECK_EQUAL(bitfield_count(words.data(), n), exp);
+    }
+}
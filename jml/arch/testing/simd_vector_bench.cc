@@ -0,0 +1,111 @@
+/** simd_vector_bench.cc                            -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Times the most used simd_vector functions with each of the vector
+    extensions that the CPU supports, over vectors from a few cache lines
+    to well beyond the L2 cache.
+
+*/
+
+#include "jml/arch/simd_vector.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ML;
+
+
+template<typename Fn>
+double bench(size_t n, Fn fn)
+{
+    // Aim for about the same amount of work for each size
+    size_t passes = std::max<size_t>(1, (1 << 26) / n);
+
+    fn();
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t pass = 0; pass < passes; ++pass) fn();
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    double ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+    return ns / (passes * n);
+}
+
+int main(int argc, char** argv)
+{
+    size_t maxSize = argc > 1 ? atoi(argv[1]) : 1 << 20;
+
+    vector<float> x(maxSize), y(maxSize), z(maxSize), r(maxSize);
+    vector<double> xd(maxSize), yd(maxSize), rd(maxSize);
+    for (size_t i = 0; i < maxSize; ++i) {
+        xd[i] = x[i] = random() / 16384.0;
+        yd[i] = y[i] = random() / 16384.0;
+        z[i] = random() / 16384.0;
+    }
+
+    double sink = 0.0;
+
+    typedef std::function<void (size_t)> Kernel;
+    vector<pair<string, Kernel> > kernels = {
+        { "vec_dotprod_dp(float)", [&] (size_t n)
+                                   {
+                                       sink += SIMD::vec_dotprod_dp(&x[0], &y[0], n);
+                                   } },
+        { "vec_dotprod(double)", [&] (size_t n)
+                                 {
+                                     sink += SIMD::vec_dotprod(&xd[0], &yd[0], n);
+                                 } },
+        { "vec_accum_prod3(float)", [&] (size_t n)
+                                    {
+                                        sink += SIMD::vec_accum_prod3(&x[0], &y[0], &z[0], n);
+                                    } },
+        { "vec_add(float, k)", [&] (size_t n)
+                               {
+                                   SIMD::vec_add(&x[0], 0.5f, &y[0], &r[0], n);
+                               } },
+        { "vec_add(double, k)", [&] (size_t n)
+                                {
+                                    SIMD::vec_add(&xd[0], 0.5, &yd[0], &rd[0], n);
+                                } },
+        { "vec_prod(float)", [&] (size_t n)
+                             {
+                                 SIMD::vec_prod(&x[0], &y[0], &r[0], n);
+                             } },
+        { "vec_sum_dp(float)", [&] (size_t n)
+                               {
+                                   sink += SIMD::vec_sum_dp(&x[0], n);
+                               } },
+    };
+
+    vector<string> isas;
+    for (string isa: { "sse2", "avx2", "avx512" })
+        if (SIMD::vec_use_isa(isa))
+            isas.push_back(isa);
+
+    printf("%-24s %8s", "ns/element", "size");
+    for (auto & isa: isas)
+        printf(" %8s", isa.c_str());
+    printf("\n");
+
+    for (auto & kernel: kernels) {
+        for (size_t n = 16; n <= maxSize; n *= 8) {
+            printf("%-24s %8zd", kernel.first.c_str(), n);
+            for (auto & isa: isas) {
+                SIMD::vec_use_isa(isa);
+                printf(" %8.3f", bench(n, [&] { kernel.second(n); }));
+            }
+            printf("\n");
+        }
+    }
+
+    SIMD::vec_use_isa("best");
+
+    return sink == 0.0;
+}
@@ -17,6 +17,7 @@
 #include <set>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 
 using namespace ML;
@@ -820,3 +821,104 @@ BOOST_AUTO_TEST_CASE( vec_min_max_el_test )
     }
 }
 
+
+template<typename T>
+void check_close(const T * x, const T * y, int n, double eps)
+{
+    for (unsigned i = 0;  i < n;  ++i)
+        BOOST_CHECK_CLOSE(x[i], y[i], eps);
+}
+
+void vec_isa_test_case(const std::string & isa, int nvals)
+{
+    cerr << "isa = " << isa << " nvals = " << nvals << endl;
+
+    float x[nvals], y[nvals], z[nvals], r1[nvals], r2[nvals];
+    double xd[nvals], yd[nvals], zd[nvals], rd1[nvals], rd2[nvals];
+    float mins1[nvals], maxs1[nvals], mins2[nvals], maxs2[nvals];
+
+    for (unsigned i = 0;  i < nvals;  ++i) {
+        xd[i] = x[i] = rand() / 16384.0;
+        yd[i] = y[i] = rand() / 16384.0;
+        zd[i] = z[i] = rand() / 16384.0;
+        mins1[i] = mins2[i] = rand() / 16384.0;
+        maxs1[i] = maxs2[i] = rand() / 16384.0;
+    }
+
+    /* Element-wise kernels must give exactly the same results. */
+    auto elementwise = [&] (const std::string & isa,
+                            float * r, double * rd, float * mins, float * maxs)
+        {
+            BOOST_REQUIRE(SIMD::vec_use_isa(isa));
+
+            SIMD::vec_add(x, 1.5f, y, r, nvals);
+            SIMD::vec_add(r, y, r, nvals);
+            SIMD::vec_add(r, z, y, r, nvals);
+            SIMD::vec_minus(r, x, r, nvals);
+            SIMD::vec_prod(r, y, r, nvals);
+            SIMD::vec_scale(r, 0.5f, r, nvals);
+            SIMD::vec_k1_x_plus_k2_y_z(0.25f, x, 2.0f, y, z, r, nvals);
+            SIMD::vec_add_sqr(r, 0.125f, x, r, nvals);
+            SIMD::vec_min_max_el(r, mins, maxs, nvals);
+
+            SIMD::vec_add(xd, 1.5, yd, rd, nvals);
+            SIMD::vec_add(rd, yd, rd, nvals);
+            SIMD::vec_add(rd, zd, yd, rd, nvals);
+            SIMD::vec_minus(rd, xd, rd, nvals);
+            SIMD::vec_prod(rd, yd, rd, nvals);
+            SIMD::vec_scale(rd, 0.5, rd, nvals);
+            SIMD::vec_k1_x_plus_k2_y_z(0.25, xd, 2.0, yd, zd, rd, nvals);
+            SIMD::vec_add_sqr(rd, 0.125, xd, rd, nvals);
+            SIMD::vec_add(rd, 3.0, x, rd, nvals);
+        };
+
+    elementwise("sse2", r1, rd1, mins1, maxs1);
+    elementwise(isa, r2, rd2, mins2, maxs2);
+    BOOST_CHECK_EQUAL(SIMD::vec_isa(), isa);
+
+    BOOST_CHECK(std::equal(r1, r1 + nvals, r2));
+    BOOST_CHECK(std::equal(rd1, rd1 + nvals, rd2));
+    BOOST_CHECK(std::equal(mins1, mins1 + nvals, mins2));
+    BOOST_CHECK(std::equal(maxs1, maxs1 + nvals, maxs2));
+
+    /* Reductions only differ in the order of the additions. */
+    auto reductions = [&] (const std::string & isa, double * res)
+        {
+            BOOST_REQUIRE(SIMD::vec_use_isa(isa));
+            int i = 0;
+            res[i++] = SIMD::vec_dotprod(x, y, nvals);
+            res[i++] = SIMD::vec_dotprod_dp(x, y, nvals);
+            res[i++] = SIMD::vec_dotprod(xd, yd, nvals);
+            res[i++] = SIMD::vec_dotprod_dp(xd, y, nvals);
+            res[i++] = SIMD::vec_accum_prod3(x, y, z, nvals);
+            res[i++] = SIMD::vec_accum_prod3(x, y, zd, nvals);
+            res[i++] = SIMD::vec_accum_prod3(xd, yd, zd, nvals);
+            res[i++] = SIMD::vec_sum_dp(x, nvals);
+            res[i++] = SIMD::vec_sum(xd, nvals);
+        };
+
+    double res1[9], res2[9];
+    reductions("sse2", res1);
+    reductions(isa, res2);
+    check_close(res1, res2, 9, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE( vec_isa_test )
+{
+    BOOST_CHECK(SIMD::vec_use_isa("sse2"));
+    BOOST_CHECK_EQUAL(SIMD::vec_isa(), std::string("sse2"));
+    BOOST_CHECK(!SIMD::vec_use_isa("mmx"));
+    BOOST_CHECK_EQUAL(SIMD::vec_isa(), std::string("sse2"));
+
+    for (std::string isa: { "avx2", "avx512" }) {
+        if (!SIMD::vec_use_isa(isa)) {
+            cerr << "no " << isa << " on this CPU" << endl;
+            continue;
+        }
+
+        for (int n: { 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 64, 123, 1000 })
+            vec_isa_test_case(isa, n);
+    }
+
+    BOOST_CHECK(SIMD::vec_use_isa("best"));
+}
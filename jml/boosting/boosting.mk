@@ -45,6 +45,8 @@ LIBBOOSTING_SOURCES := \
         feature_transform.cc \
         transform_list.cc \
         committee.cc \
+        compiled_classifier.cc \
+        columnar_training_data.cc \
         boosting_training.cc \
         null_classifier_generator.cc \
 	tree.cc \
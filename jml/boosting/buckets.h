@@ -10,6 +10,7 @@
 
 #include "jml/stats/sparse_distribution.h"
 #include "jml/utils/sorted_vector.h"
+#include "jml/db/frozen_array.h"
 #include <stdint.h>
 
 namespace ML {
@@ -27,7 +28,7 @@ typedef sparse_distribution<float, float,
 /** Structure describing the set of buckets for one value. */
 struct Bucket_Info {
     bool initialized;
-    std::vector<uint16_t> buckets; ///< Bucket numbers, sorted by example
+    DB::Frozen_Array<uint16_t> buckets; ///< Bucket numbers, sorted by example
     std::vector<float> splits;     ///< Split points between the buckets
 };
     
@@ -0,0 +1,166 @@
+/* columnar_training_data.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Training data that is stored column by column in a file and used in place.
+*/
+
+#include "columnar_training_data.h"
+#include "dense_features.h"
+#include "jml/db/persistent.h"
+#include "jml/arch/exception.h"
+#include <climits>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+namespace {
+
+/** Starts the files written by Columnar_Training_Data::write(). */
+const std::string COLUMNAR_MAGIC = "Columnar_Training_Data";
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMNAR_TRAINING_DATA                                                    */
+/*****************************************************************************/
+
+Columnar_Training_Data::
+Columnar_Training_Data()
+{
+}
+
+Columnar_Training_Data::
+Columnar_Training_Data(const std::string & filename)
+{
+    init(filename);
+}
+
+Columnar_Training_Data::
+~Columnar_Training_Data()
+{
+}
+
+void
+Columnar_Training_Data::
+write(const std::string & filename, const Training_Data & data,
+      const Feature & label, const std::vector<size_t> & num_buckets)
+{
+    std::shared_ptr<const Dense_Feature_Space> fs
+        = std::dynamic_pointer_cast<const Dense_Feature_Space>
+            (data.feature_space());
+    if (!fs)
+        throw Exception("Columnar_Training_Data::write(): "
+                        "needs a dense feature space");
+
+    const vector<Feature> & features = fs->features();
+    size_t nx = data.example_count(), nf = features.size();
+
+    map<Feature, size_t> columns_of;
+    for (unsigned j = 0;  j < nf;  ++j)
+        columns_of[features[j]] = j;
+
+    /* Missing values are NaN, as for the other dense datasets. */
+    vector<float> columns(nx * nf, NAN);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        const Feature_Set & fset = data[x];
+        for (Feature_Set::const_iterator it = fset.begin(), end = fset.end();
+             it != end;  ++it) {
+            map<Feature, size_t>::const_iterator col
+                = columns_of.find(it.feature());
+            if (col == columns_of.end())
+                throw Exception("Columnar_Training_Data::write(): "
+                                "feature not in feature space");
+            columns[col->second * nx + x] = it.value();
+        }
+    }
+
+    DB::Store_Writer store(filename);
+
+    char version = 1;
+    store << COLUMNAR_MAGIC << version;
+    fs->serialize(store);
+    store << DB::compact_size_t(nx) << DB::compact_size_t(nf)
+          << label.type() << label.arg1() << label.arg2();
+
+    DB::Frozen_Array<float>(std::move(columns)).serialize(store);
+    data.index().serialize(store, label, num_buckets);
+}
+
+void
+Columnar_Training_Data::
+init(const std::string & filename)
+{
+    DB::Store_Reader store(filename);
+
+    std::string magic;
+    char version;
+    store >> magic >> version;
+    if (magic != COLUMNAR_MAGIC)
+        throw Exception("Columnar_Training_Data: " + filename
+                        + " is not a columnar dataset");
+    if (version != 1)
+        throw Exception("Columnar_Training_Data: unknown version %d",
+                        version);
+
+    std::shared_ptr<Dense_Feature_Space> fs(new Dense_Feature_Space());
+    fs->reconstitute(store);
+
+    DB::compact_size_t nx(store), nf(store);
+    Feature::id_type type, arg1, arg2;
+    store >> type >> arg1 >> arg2;
+
+    std::shared_ptr<DB::Frozen_Array<float> > loaded
+        (new DB::Frozen_Array<float>());
+    loaded->reconstitute(store);
+
+    /* Only ever read through a const pointer; writing would copy it out. */
+    std::shared_ptr<const DB::Frozen_Array<float> > columns = loaded;
+
+    if (columns->size() != nx * nf || fs->features().size() != nf)
+        throw Exception("Columnar_Training_Data: " + filename
+                        + " has inconsistent sizes");
+    if (nx * sizeof(float) > INT_MAX)
+        throw Exception("Columnar_Training_Data: too many examples");
+
+    std::shared_ptr<Dataset_Index> index(new Dataset_Index());
+    index->reconstitute(store, fs);
+
+    Training_Data::clear();
+    Training_Data::init(fs);
+
+    /* Each row reads its values across the columns. */
+    std::shared_ptr<const vector<Feature> >
+        feature_vec(new vector<Feature>(fs->features()));
+    int stride = nx * sizeof(float);
+
+    for (unsigned x = 0;  x < nx;  ++x)
+        add_example(std::make_shared<Dense_Feature_Set>
+                    (feature_vec, columns->data() + x, stride));
+
+    columns_ = columns;
+    label_ = Feature(type, arg1, arg2);
+    index_ = index;
+    dirty_ = false;
+}
+
+Columnar_Training_Data *
+Columnar_Training_Data::
+make_copy() const
+{
+    return new Columnar_Training_Data(*this);
+}
+
+Training_Data *
+Columnar_Training_Data::
+make_type() const
+{
+    return new Training_Data();
+}
+
+} // namespace ML
@@ -0,0 +1,85 @@
+/* columnar_training_data.h                                        -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Training data that is stored column by column in a file and used in place.
+*/
+
+#ifndef __boosting__columnar_training_data_h__
+#define __boosting__columnar_training_data_h__
+
+
+#include "config.h"
+#include "training_data.h"
+#include "training_index.h"
+#include "jml/db/frozen_array.h"
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COLUMNAR_TRAINING_DATA                                                    */
+/*****************************************************************************/
+
+/** Dense training data that is loaded from a columnar file.  The file holds
+    the values feature by feature, followed by the index of the dataset with
+    everything that training against the label needs already calculated: the
+    columns sorted by value, the example counts, the buckets and the labels
+    mapped onto each feature.
+
+    The file is memory mapped and nothing is copied out of it when it is
+    loaded, so a dataset that is bigger than memory can be trained on.  As
+    the generators work one feature at a time and each of a feature's
+    columns is contiguous, only the pages of the feature being trained on
+    need to be resident, and the page cache streams them in.
+*/
+
+class Columnar_Training_Data : public Training_Data {
+public:
+    /** Default do-nothing constructor. */
+    Columnar_Training_Data();
+
+    /** Initialise from a file saved with write(). */
+    Columnar_Training_Data(const std::string & filename);
+
+    virtual ~Columnar_Training_Data();
+
+    /** Initialise from a file saved with write(). */
+    void init(const std::string & filename);
+
+    /** Save the given data in the columnar format, along with the index to
+        train to predict label, with the buckets for each of the given bucket
+        counts.  The data must have a dense feature space.
+    */
+    static void
+    write(const std::string & filename, const Training_Data & data,
+          const Feature & label,
+          const std::vector<size_t> & num_buckets
+              = std::vector<size_t>(1, DEFAULT_NUM_BUCKETS));
+
+    /** Polymorphic copy. */
+    virtual Columnar_Training_Data * make_copy() const;
+
+    /** Polymorphic construct.  The copy is an ordinary Training_Data, since
+        there is no file behind it. */
+    virtual Training_Data * make_type() const;
+
+    /** The feature that the index was calculated to predict. */
+    const Feature & label() const { return label_; }
+
+    /** Are the values used from the pages of the file? */
+    bool mapped() const { return columns_ && columns_->mapped(); }
+
+private:
+    /** The values, feature by feature.  Shared between the copies, since the
+        rows point into it. */
+    std::shared_ptr<const DB::Frozen_Array<float> > columns_;
+
+    Feature label_;
+};
+
+
+} // namespace ML
+
+
+#endif /* __boosting__columnar_training_data_h__ */
@@ -0,0 +1,601 @@
+/* compiled_classifier.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Classifier flattened into contiguous arrays for fast scoring.
+*/
+
+#include "compiled_classifier.h"
+#include "decision_tree.h"
+#include "boosted_stumps.h"
+#include "glz_classifier.h"
+#include "committee.h"
+#include "jml/arch/simd_vector.h"
+#include "jml/utils/floating_point.h"
+#include "jml/arch/exception.h"
+#include "jml/db/persistent.h"
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+namespace {
+
+JML_ALWAYS_INLINE int apply_split(int op, float split_val, float val)
+{
+    if (isnanf(val)) return MISSING;
+
+    switch (op) {
+    case Split::LESS:   return val < split_val;
+    case Split::EQUAL:  return val == split_val;
+    default:            return true;
+    }
+}
+
+/** Same as GLZ_Classifier::decode_value(). */
+JML_ALWAYS_INLINE float decode_glz_value(float val, int type)
+{
+    if (JML_UNLIKELY(isnanf(val)))
+        return 0.0;
+    if (JML_UNLIKELY(type == GLZ_Classifier::Feature_Spec::PRESENCE))
+        return 1.0;
+    if (JML_UNLIKELY(!isfinite(val)))
+        throw Exception("Compiled_Classifier: GLZ feature is not finite");
+    return val;
+}
+
+/** Same as the output transformation in Boosted_Stumps::predict(). */
+void apply_stumps_output(int output, float * result, int nl)
+{
+    for (unsigned i = 0;  i < nl;  ++i) {
+        if (!finite(result[i]))
+            throw Exception("Compiled_Classifier: non-finite result");
+    }
+
+    if (output == Boosted_Stumps::RAW)
+        return;
+
+    double total = 0.0;
+    for (unsigned i = 0;  i < nl;  ++i) {
+        /* Avoid an overflow from the exp. */
+        float val = std::min(result[i], fp_traits<float>::max_exp_arg * 0.9f);
+        double e = exp(val);
+        double x = e / (e + (1.0 / e));
+        total += x;
+        result[i] = x;
+    }
+
+    if (output == Boosted_Stumps::LOGIT_NORM) {
+        if ((float)total == 0.0F)
+            std::fill(result, result + nl, 1.0f / nl);
+        else for (unsigned i = 0;  i < nl;  ++i)
+            result[i] /= total;
+    }
+}
+
+/** Examples of a batch for which the decoded GLZ inputs are kept at once. */
+enum { GLZ_BATCH_SIZE = 256 };
+
+/** Starts the files written by Compiled_Classifier::save(). */
+const std::string SAVED_MAGIC = "Compiled_Classifier";
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPILED_CLASSIFIER                                                       */
+/*****************************************************************************/
+
+Compiled_Classifier::
+Compiled_Classifier()
+    : label_count_(0)
+{
+}
+
+Compiled_Classifier::
+Compiled_Classifier(const Classifier_Impl & classifier)
+    : label_count_(0)
+{
+    compile(classifier, classifier.all_features());
+}
+
+Compiled_Classifier::
+Compiled_Classifier(const Classifier_Impl & classifier,
+                    const std::vector<Feature> & features)
+    : label_count_(0)
+{
+    compile(classifier, features);
+}
+
+void
+Compiled_Classifier::
+compile(const Classifier_Impl & classifier,
+        const std::vector<Feature> & features)
+{
+    if (!supported(classifier))
+        throw Exception("Compiled_Classifier: can't compile classifier of "
+                        "type " + classifier.class_id());
+
+    features_ = features;
+    feature_index_.clear();
+    for (unsigned i = 0;  i < features.size();  ++i)
+        feature_index_.insert(make_pair(features[i], i));
+
+    label_count_ = classifier.label_count();
+    models_.clear();
+    nodes_.clear();
+    glz_inputs_.clear();
+    values_.clear();
+    bias_ = distribution<float>(label_count_, 0.0);
+
+    compile_recursive(classifier, 1.0);
+}
+
+bool
+Compiled_Classifier::
+supported(const Classifier_Impl & classifier)
+{
+    if (dynamic_cast<const Decision_Tree *>(&classifier)
+        || dynamic_cast<const Boosted_Stumps *>(&classifier)
+        || dynamic_cast<const GLZ_Classifier *>(&classifier))
+        return true;
+
+    if (const Committee * committee
+            = dynamic_cast<const Committee *>(&classifier)) {
+        for (unsigned i = 0;  i < committee->classifiers.size();  ++i)
+            if (!supported(*committee->classifiers[i]))
+                return false;
+        return true;
+    }
+
+    return false;
+}
+
+void
+Compiled_Classifier::
+compile_recursive(const Classifier_Impl & classifier, float weight)
+{
+    if (classifier.label_count() != label_count_)
+        throw Exception("Compiled_Classifier: classifiers have different "
+                        "label counts");
+
+    if (const Decision_Tree * tree
+            = dynamic_cast<const Decision_Tree *>(&classifier))
+        compile_tree(*tree, weight);
+    else if (const Boosted_Stumps * stumps
+             = dynamic_cast<const Boosted_Stumps *>(&classifier))
+        compile_stumps(*stumps, weight);
+    else if (const GLZ_Classifier * glz
+             = dynamic_cast<const GLZ_Classifier *>(&classifier))
+        compile_glz(*glz, weight);
+    else if (const Committee * committee
+             = dynamic_cast<const Committee *>(&classifier)) {
+        for (unsigned i = 0;  i < committee->bias.size()
+                 && i < label_count_;  ++i)
+            bias_[i] += weight * committee->bias[i];
+
+        for (unsigned i = 0;  i < committee->classifiers.size();  ++i) {
+            if (committee->weights[i] == 0.0) continue;
+            compile_recursive(*committee->classifiers[i],
+                              weight * committee->weights[i]);
+        }
+    }
+    else throw Exception("Compiled_Classifier: can't compile classifier of "
+                         "type " + classifier.class_id());
+}
+
+void
+Compiled_Classifier::
+compile_tree(const Decision_Tree & tree, float weight)
+{
+    Model model;
+    model.kind = TREE;
+    model.output = 0;
+    model.weight = weight;
+    model.values = -1;
+    model.first = nodes_.size();
+    compile_tree_node(tree.tree.root);
+    model.last = nodes_.size();
+
+    models_.push_back(model);
+}
+
+int
+Compiled_Classifier::
+compile_tree_node(const Tree::Ptr & ptr)
+{
+    if (!ptr) return -1;
+
+    int index = nodes_.size();
+    nodes_.push_back(Node());
+
+    if (!ptr.node()) {
+        int values = add_values(ptr.leaf()->pred);
+        Node & leaf = nodes_[index];
+        leaf.feature = -1;
+        leaf.split_val = 0.0;
+        leaf.op = 0;
+        leaf.child[0] = values;
+        leaf.child[1] = leaf.child[2] = -1;
+        return index;
+    }
+
+    const Tree::Node & node = *ptr.node();
+
+    // The children are depth first after their parent, so that the common
+    // paths down the tree are close together in memory
+    int child_false = compile_tree_node(node.child_false);
+    int child_true = compile_tree_node(node.child_true);
+    int child_missing = compile_tree_node(node.child_missing);
+
+    Node & result = nodes_[index];
+    result.feature = feature_index(node.split.feature());
+    result.split_val = node.split.split_val();
+    result.op = node.split.op();
+    result.child[false] = child_false;
+    result.child[true] = child_true;
+    result.child[MISSING] = child_missing;
+
+    return index;
+}
+
+void
+Compiled_Classifier::
+compile_stumps(const Boosted_Stumps & stumps, float weight)
+{
+    Model model;
+    model.kind = STUMPS;
+    model.output = stumps.output;
+    model.weight = weight;
+    model.values = stumps.bias.size() ? add_values(stumps.bias) : -1;
+    model.first = nodes_.size();
+
+    for (Boosted_Stumps::const_iterator it = stumps.begin(),
+             end = stumps.end();
+         it != end;  ++it) {
+        const Stump & stump = *it;
+        Node node;
+        node.feature = feature_index(stump.split.feature());
+        node.split_val = stump.split.split_val();
+        node.op = stump.split.op();
+        node.child[false] = add_values(stump.action.pred_false);
+        node.child[true] = add_values(stump.action.pred_true);
+        node.child[MISSING] = add_values(stump.action.pred_missing);
+        nodes_.push_back(node);
+    }
+
+    model.last = nodes_.size();
+    models_.push_back(model);
+}
+
+void
+Compiled_Classifier::
+compile_glz(const GLZ_Classifier & glz, float weight)
+{
+    Model model;
+    model.kind = GLZ;
+    model.output = glz.link;
+    model.weight = weight;
+    model.first = glz_inputs_.size();
+
+    for (unsigned i = 0;  i < glz.features.size();  ++i) {
+        GLZ_Input input;
+        input.feature = feature_index(glz.features[i].feature);
+        input.type = glz.features[i].type;
+        glz_inputs_.push_back(input);
+    }
+
+    model.last = glz_inputs_.size();
+
+    // One row per label of the weight for each input followed by the bias
+    size_t ni = glz.features.size();
+    model.values = values_.size();
+    for (unsigned l = 0;  l < label_count_;  ++l) {
+        const distribution<float> & weights = glz.weights.at(l);
+        if (weights.size() < ni + glz.add_bias)
+            throw Exception("Compiled_Classifier: GLZ has wrong number "
+                            "of weights");
+        values_.insert(values_.end(), weights.begin(), weights.begin() + ni);
+        values_.push_back(glz.add_bias ? weights[ni] : 0.0f);
+    }
+
+    models_.push_back(model);
+}
+
+int
+Compiled_Classifier::
+feature_index(const Feature & feature) const
+{
+    std::map<Feature, int>::const_iterator it = feature_index_.find(feature);
+    if (it == feature_index_.end())
+        throw Exception("Compiled_Classifier: classifier uses a feature "
+                        "that isn't in the feature layout");
+    return it->second;
+}
+
+int
+Compiled_Classifier::
+add_values(const distribution<float> & values)
+{
+    int result = values_.size();
+    for (unsigned i = 0;  i < label_count_;  ++i)
+        values_.push_back(i < values.size() ? values[i] : 0.0f);
+    return result;
+}
+
+void
+Compiled_Classifier::
+predict_model(const Model & model, const float * features,
+              float * output) const
+{
+    int nl = label_count_;
+    std::fill(output, output + nl, 0.0f);
+
+    switch (model.kind) {
+
+    case TREE: {
+        int i = (model.first == model.last ? -1 : model.first);
+        while (i != -1) {
+            const Node & node = nodes_[i];
+            if (node.feature == -1) {
+                SIMD::vec_add(output, &values_[node.child[0]], output, nl);
+                break;
+            }
+            i = node.child[apply_split(node.op, node.split_val,
+                                       features[node.feature])];
+        }
+        return;
+    }
+
+    case STUMPS: {
+        if (model.values != -1)
+            SIMD::vec_add(output, &values_[model.values], output, nl);
+
+        for (const Node * it = nodes_.data() + model.first,
+                 * end = nodes_.data() + model.last;  it != end;  ++it) {
+            int branch = apply_split(it->op, it->split_val,
+                                     features[it->feature]);
+            SIMD::vec_add(output, &values_[it->child[branch]], output, nl);
+        }
+
+        apply_stumps_output(model.output, output, nl);
+        return;
+    }
+
+    case GLZ: {
+        int ni = model.last - model.first;
+        float decoded[ni];
+        const GLZ_Input * inputs = glz_inputs_.data() + model.first;
+        for (unsigned i = 0;  i < ni;  ++i)
+            decoded[i] = decode_glz_value(features[inputs[i].feature],
+                                          inputs[i].type);
+
+        for (unsigned l = 0;  l < nl;  ++l) {
+            const float * weights = &values_[model.values + l * (ni + 1)];
+            double accum = SIMD::vec_dotprod_dp(weights, decoded, ni)
+                + weights[ni];
+            output[l] = apply_link_inverse(accum, (Link_Function)model.output);
+        }
+        return;
+    }
+
+    default:
+        throw Exception("Compiled_Classifier: invalid model kind");
+    }
+}
+
+void
+Compiled_Classifier::
+predict_glz_batch(const Model & model, const float * features,
+                  size_t n, float * output) const
+{
+    int nl = label_count_;
+    int nf = features_.size();
+    int ni = model.last - model.first;
+    const GLZ_Input * inputs = glz_inputs_.data() + model.first;
+
+    // Decode a block of examples into a dense matrix first, so that the
+    // dot products run over contiguous memory
+    vector<float> decoded(std::min<size_t>(n, GLZ_BATCH_SIZE) * ni);
+
+    for (size_t start = 0;  start < n;  start += GLZ_BATCH_SIZE) {
+        size_t end = std::min<size_t>(n, start + GLZ_BATCH_SIZE);
+
+        for (size_t x = start;  x < end;  ++x) {
+            const float * row = features + x * nf;
+            float * out = decoded.data() + (x - start) * ni;
+            for (unsigned i = 0;  i < ni;  ++i)
+                out[i] = decode_glz_value(row[inputs[i].feature],
+                                          inputs[i].type);
+        }
+
+        for (unsigned l = 0;  l < nl;  ++l) {
+            const float * weights = &values_[model.values + l * (ni + 1)];
+            for (size_t x = start;  x < end;  ++x) {
+                double accum
+                    = SIMD::vec_dotprod_dp(weights,
+                                           decoded.data() + (x - start) * ni,
+                                           ni)
+                    + weights[ni];
+                output[x * nl + l] += model.weight
+                    * apply_link_inverse(accum, (Link_Function)model.output);
+            }
+        }
+    }
+}
+
+Label_Dist
+Compiled_Classifier::
+predict(const float * features) const
+{
+    Label_Dist result(label_count_);
+    predict(features, &result[0]);
+    return result;
+}
+
+void
+Compiled_Classifier::
+predict(const float * features, float * output) const
+{
+    int nl = label_count_;
+    std::copy(bias_.begin(), bias_.end(), output);
+
+    float model_output[nl];
+    for (unsigned i = 0;  i < models_.size();  ++i) {
+        const Model & model = models_[i];
+        predict_model(model, features, model_output);
+        SIMD::vec_add(output, model.weight, model_output, output, nl);
+    }
+}
+
+float
+Compiled_Classifier::
+predict(int label, const float * features) const
+{
+    if (label < 0 || label >= label_count_)
+        throw Exception("Compiled_Classifier::predict(): invalid label");
+
+    float output[label_count_];
+    predict(features, output);
+    return output[label];
+}
+
+void
+Compiled_Classifier::
+predict(const float * features, size_t n, float * output) const
+{
+    int nl = label_count_;
+    int nf = features_.size();
+
+    for (size_t x = 0;  x < n;  ++x)
+        std::copy(bias_.begin(), bias_.end(), output + x * nl);
+
+    // Model by model rather than example by example, so that each model's
+    // nodes stay in the cache for the whole batch
+    float model_output[nl];
+    for (unsigned i = 0;  i < models_.size();  ++i) {
+        const Model & model = models_[i];
+
+        if (model.kind == GLZ) {
+            predict_glz_batch(model, features, n, output);
+            continue;
+        }
+
+        for (size_t x = 0;  x < n;  ++x) {
+            predict_model(model, features + x * nf, model_output);
+            SIMD::vec_add(output + x * nl, model.weight, model_output,
+                          output + x * nl, nl);
+        }
+    }
+}
+
+size_t
+Compiled_Classifier::
+memusage() const
+{
+    return sizeof(*this)
+        + models_.capacity() * sizeof(Model)
+        + nodes_.capacity() * sizeof(Node)
+        + glz_inputs_.capacity() * sizeof(GLZ_Input)
+        + values_.capacity() * sizeof(float)
+        + bias_.capacity() * sizeof(float);
+}
+
+void
+Compiled_Classifier::
+serialize(DB::Store_Writer & store) const
+{
+    char version = 1;
+    store << SAVED_MAGIC << version;
+
+    store << DB::compact_size_t(features_.size());
+    for (const Feature & feature: features_)
+        store << feature.type() << feature.arg1() << feature.arg2();
+
+    store << DB::compact_size_t(label_count_)
+          << static_cast<const std::vector<float> &>(bias_);
+
+    models_.serialize(store);
+    nodes_.serialize(store);
+    glz_inputs_.serialize(store);
+    values_.serialize(store);
+}
+
+void
+Compiled_Classifier::
+reconstitute(DB::Store_Reader & store)
+{
+    std::string magic;
+    char version;
+    store >> magic >> version;
+    if (magic != SAVED_MAGIC)
+        throw Exception("Compiled_Classifier: not a compiled classifier");
+    if (version != 1)
+        throw Exception("Compiled_Classifier: unknown version %d", version);
+
+    DB::compact_size_t nf(store);
+    features_.resize(nf);
+    feature_index_.clear();
+    for (unsigned i = 0;  i < nf;  ++i) {
+        Feature::id_type type, arg1, arg2;
+        store >> type >> arg1 >> arg2;
+        features_[i] = Feature(type, arg1, arg2);
+        feature_index_.insert(make_pair(features_[i], i));
+    }
+
+    DB::compact_size_t nl(store);
+    label_count_ = nl;
+
+    std::vector<float> bias;
+    store >> bias;
+    bias_ = distribution<float>(bias.begin(), bias.end());
+
+    models_.reconstitute(store);
+    nodes_.reconstitute(store);
+    glz_inputs_.reconstitute(store);
+    values_.reconstitute(store);
+}
+
+void
+Compiled_Classifier::
+save(const std::string & filename) const
+{
+    DB::Store_Writer store(filename);
+    serialize(store);
+}
+
+void
+Compiled_Classifier::
+load(const std::string & filename)
+{
+    DB::Store_Reader store(filename);
+    reconstitute(store);
+}
+
+bool
+Compiled_Classifier::
+is_saved(const std::string & filename)
+{
+    try {
+        DB::Store_Reader store(filename);
+        DB::compact_size_t size(store);
+        if (size != SAVED_MAGIC.size() || store.try_to_have(size) < size)
+            return false;
+        return std::equal(SAVED_MAGIC.begin(), SAVED_MAGIC.end(),
+                          store.pos());
+    } catch (const std::exception & exc) {
+        return false;
+    }
+}
+
+bool
+Compiled_Classifier::
+mapped() const
+{
+    return nodes_.mapped() || values_.mapped();
+}
+
+} // namespace ML
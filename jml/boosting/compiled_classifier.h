@@ -0,0 +1,176 @@
+/* compiled_classifier.h                                           -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Classifier flattened into contiguous arrays for fast scoring.
+*/
+
+#ifndef __boosting__compiled_classifier_h__
+#define __boosting__compiled_classifier_h__
+
+#include "classifier.h"
+#include "tree.h"
+#include "jml/db/frozen_array.h"
+#include <map>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+class Decision_Tree;
+class Boosted_Stumps;
+class GLZ_Classifier;
+class Committee;
+
+
+/*****************************************************************************/
+/* COMPILED_CLASSIFIER                                                       */
+/*****************************************************************************/
+
+/** A classifier that has been compiled down to flat arrays indexed by dense
+    feature number, so that scoring doesn't need to chase pointers, look up
+    features in a Feature_Set or make virtual calls.
+
+    Supports Decision_Tree, Boosted_Stumps and GLZ_Classifier, as well as
+    Committees of those (which may be nested).  The output is the same as
+    that of the original classifier's predict() given a feature set
+    containing each of the features whose value isn't NaN; a NaN value is a
+    missing feature.
+
+    The features are laid out in the order given to compile(); a feature
+    vector must contain exactly feature_count() values in that order.
+
+    Once compiled, the object is immutable and can be used concurrently
+    from multiple threads.
+
+    A compiled classifier can be saved and loaded again without the original
+    classifier or its feature space.  When it's loaded from a file the
+    arrays are used from the mapped pages of the file, so a large model
+    loads instantly and the processes of a host that load it all share the
+    same copy.
+*/
+
+class Compiled_Classifier {
+public:
+    Compiled_Classifier();
+
+    /** Compile the classifier for the features that it uses, in the order
+        returned by all_features(). */
+    Compiled_Classifier(const Classifier_Impl & classifier);
+
+    /** Compile the classifier for the given feature layout.  Features that
+        the classifier doesn't use are ignored; it is an error for a
+        feature that it uses to not be present. */
+    Compiled_Classifier(const Classifier_Impl & classifier,
+                        const std::vector<Feature> & features);
+
+    void compile(const Classifier_Impl & classifier,
+                 const std::vector<Feature> & features);
+
+    /** Can the given classifier be compiled? */
+    static bool supported(const Classifier_Impl & classifier);
+
+    const std::vector<Feature> & features() const { return features_; }
+    size_t feature_count() const { return features_.size(); }
+    size_t label_count() const { return label_count_; }
+
+    /** Predict all labels for the given feature vector. */
+    Label_Dist predict(const float * features) const;
+
+    /** Predict all labels into output, which has label_count() entries. */
+    void predict(const float * features, float * output) const;
+
+    /** Predict a single label. */
+    float predict(int label, const float * features) const;
+
+    /** Predict a batch of n examples.  The features are row major with
+        feature_count() values per example and the output is row major with
+        label_count() values per example.  This is much faster per example
+        than predicting them one at a time, as each model is only brought
+        into the cache once and the linear models are evaluated with vector
+        instructions.
+    */
+    void predict(const float * features, size_t n, float * output) const;
+
+    /** Approximate memory used by the compiled arrays.  Arrays that are
+        used from a mapped file don't count. */
+    size_t memusage() const;
+
+    void serialize(DB::Store_Writer & store) const;
+    void reconstitute(DB::Store_Reader & store);
+
+    void save(const std::string & filename) const;
+    void load(const std::string & filename);
+
+    /** Was the file written by save()? */
+    static bool is_saved(const std::string & filename);
+
+    /** Are the arrays used from the pages of a mapped file? */
+    bool mapped() const;
+
+private:
+    enum Kind {
+        TREE,
+        STUMPS,
+        GLZ
+    };
+
+    /** One of the models that make up the classifier.  Its output is
+        multiplied by weight and added to the result. */
+    struct Model {
+        Kind kind;
+        int output;         ///< Boosted_Stumps::Output or Link_Function
+        float weight;       ///< Product of the enclosing committee weights
+        uint32_t first;     ///< First node or GLZ input
+        uint32_t last;      ///< One past the last node or GLZ input
+        int32_t values;     ///< Bias or GLZ weights in values_; -1 if none
+    };
+
+    /** A node of a tree or a stump.  The children are indexed by the result
+        of the split (false, true or MISSING).  For a tree they are indexes
+        of nodes; for a stump and a leaf they are offsets of the prediction
+        in values_.  -1 means there is nothing there.
+    */
+    struct Node {
+        int32_t feature;    ///< Dense feature index; -1 for a leaf
+        float split_val;
+        int32_t op;         ///< Split::Op
+        int32_t child[3];
+    };
+
+    /** An input to a linear model. */
+    struct GLZ_Input {
+        int32_t feature;    ///< Dense feature index
+        int32_t type;       ///< GLZ_Classifier::Feature_Spec::Type
+    };
+
+    std::vector<Feature> features_;
+    std::map<Feature, int> feature_index_;
+    size_t label_count_;
+
+    DB::Frozen_Array<Model> models_;
+    DB::Frozen_Array<Node> nodes_;
+    DB::Frozen_Array<GLZ_Input> glz_inputs_;
+    DB::Frozen_Array<float> values_;
+    distribution<float> bias_;
+
+    void compile_recursive(const Classifier_Impl & classifier, float weight);
+    void compile_tree(const Decision_Tree & tree, float weight);
+    int compile_tree_node(const Tree::Ptr & ptr);
+    void compile_stumps(const Boosted_Stumps & stumps, float weight);
+    void compile_glz(const GLZ_Classifier & glz, float weight);
+
+    int feature_index(const Feature & feature) const;
+    int add_values(const distribution<float> & values);
+
+    /** Raw output of one model for one example, into nl values. */
+    void predict_model(const Model & model, const float * features,
+                       float * output) const;
+    void predict_glz_batch(const Model & model, const float * features,
+                           size_t n, float * output) const;
+};
+
+} // namespace ML
+
+
+#endif /* __boosting__compiled_classifier_h__ */
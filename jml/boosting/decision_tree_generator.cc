@@ -53,6 +53,7 @@ configure(const Configuration & config)
     config.find(max_depth, "max_depth");
     config.find(update_alg, "update_alg");
     config.find(random_feature_propn, "random_feature_propn");
+    config.find(histograms, "histograms");
 }
 
 void
@@ -64,6 +65,7 @@ defaults()
     max_depth = -1;
     update_alg = Stump::PROB;
     random_feature_propn = 1.0;
+    histograms = false;
 }
 
 Config_Options
@@ -79,7 +81,10 @@ options() const
         .add("update_alg", update_alg,
              "select the type of output that the tree gives")
         .add("random_feature_propn", random_feature_propn, "0.0-1.0",
-             "proportion of the features to enable (for random forests)");
+             "proportion of the features to enable (for random forests)")
+        .add("histograms", histograms,
+             "test the dense real features from per-node histograms; "
+             "gives the same tree faster");
     
     return result;
 }
@@ -608,8 +613,45 @@ void split_dataset(const Training_Data & data,
     }
 }
 
+/** Fill in the histograms of the three children of a node from those of
+    the node.  Only the two smallest children are accumulated from their
+    examples; the largest gets what is left over.
+*/
+template<class Trainer, class Weights>
+void split_histograms(Thread_Context & context,
+                      const Trainer & trainer,
+                      typename Trainer::Histograms * children[3],
+                      const typename Trainer::Histograms & parent,
+                      const distribution<float> * classes[3],
+                      const double totals[3],
+                      const vector<Feature> & features,
+                      const Training_Data & data,
+                      const Feature & predicted,
+                      const Weights & weights,
+                      int advance)
+{
+    int largest = std::max_element(totals, totals + 3) - totals;
+
+    for (int i = 0;  i < 3;  ++i) {
+        if (i == largest) continue;
+        trainer.fill_histograms(context, *children[i], features, data,
+                                predicted, weights, *classes[i], advance);
+    }
+
+    trainer.subtract_histograms(*children[largest], parent,
+                                *children[(largest + 1) % 3],
+                                *children[(largest + 2) % 3]);
+}
+
 } // file scope
 
+/** Histograms of the features over the examples of a node, for the W that
+    the tree is being trained with. */
+struct Decision_Tree_Generator::Tree_Histograms {
+    Stump_Trainer<W_binsym, Z_binsym>::Histograms binsym;
+    Stump_Trainer<W_normal, Z_normal>::Histograms normal;
+};
+
 struct Decision_Tree_Generator::Train_Recursive_Job {
 
     Tree::Ptr & ptr;
@@ -623,6 +665,7 @@ struct Decision_Tree_Generator::Train_Recursive_Job {
     int depth;
     int max_depth;
     Tree & tree;
+    const Tree_Histograms * node_histograms;
 
     Train_Recursive_Job(Tree::Ptr & ptr,
                         const Decision_Tree_Generator * generator,
@@ -633,11 +676,12 @@ struct Decision_Tree_Generator::Train_Recursive_Job {
                         const vector<Feature> & features,
                         const distribution<float> & in_class,
                         int depth, int max_depth,
-                        Tree & tree)
+                        Tree & tree,
+                        const Tree_Histograms * node_histograms)
         : ptr(ptr), generator(generator), context(context), data(data),
           weights(weights), advance(advance), features(features),
           in_class(in_class), depth(depth), max_depth(max_depth),
-          tree(tree)
+          tree(tree), node_histograms(node_histograms)
     {
     }
 
@@ -645,7 +689,7 @@ struct Decision_Tree_Generator::Train_Recursive_Job {
     {
         ptr = generator->train_recursive(context, data, weights, advance,
                                          features, in_class, depth,
-                                         max_depth, tree);
+                                         max_depth, tree, node_histograms);
     }
 };
 
@@ -661,7 +705,8 @@ do_branch(Tree::Ptr & ptr,
           const distribution<float> & new_in_class,
           double total_in_class,
           int new_depth, int max_depth,
-          Tree & tree) const
+          Tree & tree,
+          const Tree_Histograms * node_histograms) const
 {
     if (total_in_class > 1024) {
         // Worth multithreading... do it
@@ -676,14 +721,15 @@ do_branch(Tree::Ptr & ptr,
         Train_Recursive_Job job(ptr, this, child_context, data, weights,
                                 advance,
                                 features, new_in_class, new_depth, max_depth,
-                                tree);
+                                tree, node_histograms);
 
         context.worker().add(job, "train decision tree branch",
                              child_context.group());
     }
     else if (total_in_class > 0.0)
         ptr = train_recursive(context, data, weights, advance, features,
-                              new_in_class, new_depth, max_depth, tree);
+                              new_in_class, new_depth, max_depth, tree,
+                              node_histograms);
     else {
         // Leaf only
         ptr = tree.new_leaf();
@@ -701,7 +747,8 @@ train_recursive(Thread_Context & context,
                 const vector<Feature> & features,
                 const distribution<float> & in_class,
                 int depth, int max_depth,
-                Tree & tree) const
+                Tree & tree,
+                const Tree_Histograms * node_histograms) const
 {
     bool debug = false;
     
@@ -821,7 +868,8 @@ train_recursive(Thread_Context & context,
                         new_data, new_in_class, new_weights,
                         features, model.predicted());
 
-        /* Restart, with the new training data. */
+        /* Restart, with the new training data.  The histograms are of the
+           buckets of the old data, so they have to be started again too. */
         return train_recursive(context, new_data, new_weights, advance,
                                features,
                                new_in_class, depth, max_depth, tree);
@@ -838,6 +886,11 @@ train_recursive(Thread_Context & context,
     typedef No_Trace TrainerTracer;
     //typedef Stream_Tracer TrainerTracer;  // for debugging
 
+    /* Histograms of the node, if we weren't given them. */
+    Tree_Histograms own_histograms;
+    if (histograms && !node_histograms)
+        node_histograms = &own_histograms;
+
     if (advance == 0) {
         typedef W_binsym W;
         typedef Z_binsym Z;
@@ -847,8 +900,18 @@ train_recursive(Thread_Context & context,
         
         Accum accum(*model.feature_space(), nl, trace);
         Trainer trainer;
-    
-        trainer.test_all
+
+        if (histograms) {
+            if (node_histograms == &own_histograms)
+                trainer.fill_histograms
+                    (context, own_histograms.binsym, features, data,
+                     model.predicted(), weights, in_class, advance);
+
+            trainer.test_all
+                (context, features, node_histograms->binsym, data,
+                 model.predicted(), weights, in_class, accum, -1);
+        }
+        else trainer.test_all
             (context, features, data, model.predicted(),
              weights, in_class, accum, -1);
 
@@ -865,7 +928,17 @@ train_recursive(Thread_Context & context,
         Accum accum(*model.feature_space(), nl, trace);
         Trainer trainer;
     
-        trainer.test_all
+        if (histograms) {
+            if (node_histograms == &own_histograms)
+                trainer.fill_histograms
+                    (context, own_histograms.normal, features, data,
+                     model.predicted(), weights, in_class, advance);
+
+            trainer.test_all
+                (context, features, node_histograms->normal, data,
+                 model.predicted(), weights, in_class, accum, -1);
+        }
+        else trainer.test_all
             (context, features, data, model.predicted(),
              weights, in_class, accum, -1);
 
@@ -934,6 +1007,40 @@ train_recursive(Thread_Context & context,
              << " missing " << class_missing.total() << endl;
     }
 
+    /* Histograms of the children, unless they can't split any further. */
+    Tree_Histograms children[3];
+    const Tree_Histograms * child_histograms[3] = { 0, 0, 0 };
+
+    if (histograms && depth + 1 < max_depth) {
+        const distribution<float> * classes[3]
+            = { &class_true, &class_false, &class_missing };
+        double totals[3] = { total_true, total_false, total_missing };
+
+        if (advance == 0) {
+            typedef Stump_Trainer<W_binsym, Z_binsym> Trainer;
+            Trainer::Histograms * child_binsym[3]
+                = { &children[0].binsym, &children[1].binsym,
+                    &children[2].binsym };
+            split_histograms(context, Trainer(), child_binsym,
+                             node_histograms->binsym, classes, totals,
+                             features, data, model.predicted(), weights,
+                             advance);
+        }
+        else {
+            typedef Stump_Trainer<W_normal, Z_normal> Trainer;
+            Trainer::Histograms * child_normal[3]
+                = { &children[0].normal, &children[1].normal,
+                    &children[2].normal };
+            split_histograms(context, Trainer(), child_normal,
+                             node_histograms->normal, classes, totals,
+                             features, data, model.predicted(), weights,
+                             advance);
+        }
+
+        for (unsigned i = 0;  i < 3;  ++i)
+            child_histograms[i] = &children[i];
+    }
+
     Tree::Node * node = tree.new_node();
     node->split = split;
     node->z = best_z;
@@ -945,17 +1052,17 @@ train_recursive(Thread_Context & context,
     do_branch(node->child_true, group_to_wait_for,
               context, data, weights, advance, features,
               class_true, total_true, depth + 1, max_depth,
-              tree);
+              tree, child_histograms[0]);
 
     do_branch(node->child_false, group_to_wait_for,
               context, data, weights, advance, features,
               class_false, total_false, depth + 1, max_depth,
-              tree);
+              tree, child_histograms[1]);
     
     do_branch(node->child_missing, group_to_wait_for,
               context, data, weights, advance, features,
               class_missing, total_missing, depth + 1, max_depth,
-              tree);
+              tree, child_histograms[2]);
 
     if (group_to_wait_for != -1) {
         context.worker().unlock_group(group_to_wait_for);
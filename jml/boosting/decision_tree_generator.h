@@ -70,6 +70,7 @@ public:
     int trace;
     Stump::Update update_alg;
     float random_feature_propn;
+    bool histograms;
 
     /* Once init has been called, we clone our potential models from this
        one. */
@@ -82,6 +83,11 @@ public:
                    const std::vector<Feature> & features,
                    int max_depth) const;
     
+    struct Tree_Histograms;
+
+    /** Train the subtree for the examples in in_class.  If node_histograms
+        is given, it holds the histograms of the features over those
+        examples (only used when histograms is set). */
     Tree::Ptr
     train_recursive(Thread_Context & context,
                     const Training_Data & data,
@@ -89,7 +95,8 @@ public:
                     int advance,
                     const std::vector<Feature> & features,
                     const distribution<float> & in_class,
-                    int depth, int max_depth, Tree & tree) const;
+                    int depth, int max_depth, Tree & tree,
+                    const Tree_Histograms * node_histograms = 0) const;
 
     Tree::Ptr
     train_recursive_regression(Thread_Context & context,
@@ -109,7 +116,8 @@ public:
                    const distribution<float> & new_in_class,
                    double total_in_class,
                    int new_depth, int max_depth,
-                   Tree & tree) const;
+                   Tree & tree,
+                   const Tree_Histograms * node_histograms = 0) const;
     
     struct Train_Recursive_Job;
 };
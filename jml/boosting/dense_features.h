@@ -366,14 +366,15 @@ protected:
 /*****************************************************************************/
 
 /** This is a specialization of a feature set that stores itself as a dense
-    array.
+    array.  The values are stride bytes apart, which allows a row to be read
+    straight out of a column-major matrix.
 */
 
 class Dense_Feature_Set : public Feature_Set {
 public:
     Dense_Feature_Set(std::shared_ptr<const std::vector<Feature> > features,
-                      const float * values)
-    : features(features), values(values)
+                      const float * values, int stride = sizeof(float))
+    : features(features), values(values), stride(stride)
     {
     }
 
@@ -383,7 +384,7 @@ public:
     get_data(bool need_sorted = false) const
     {
         return boost::make_tuple
-            (&(*features)[0], values, sizeof(Feature), sizeof(float), 
+            (&(*features)[0], values, sizeof(Feature), stride,
              features->size());
     }
 
@@ -393,6 +394,7 @@ public:
 
     std::shared_ptr<const std::vector<Feature> > features;
     const float * values;
+    int stride;
 
     virtual Dense_Feature_Set * make_copy() const;
 };
@@ -190,6 +190,28 @@ struct W_normalT {
         }
     }
 
+    /** Add all of the weight in other to ours, bucket by bucket. */
+    void add(const W_normalT & other)
+    {
+        for (unsigned cat = 0;  cat <= MISSING;  ++cat) {
+            for (unsigned l = 0;  l < nl();  ++l) {
+                (*this)(l, cat, true)  += other(l, cat, true);
+                (*this)(l, cat, false) += other(l, cat, false);
+            }
+        }
+    }
+
+    /** Remove all of the weight in other from ours, bucket by bucket. */
+    void subtract(const W_normalT & other)
+    {
+        for (unsigned cat = 0;  cat <= MISSING;  ++cat) {
+            for (unsigned l = 0;  l < nl();  ++l) {
+                (*this)(l, cat, true)  -= other(l, cat, true);
+                (*this)(l, cat, false) -= other(l, cat, false);
+            }
+        }
+    }
+
     /** This function ensures that the values in the MISSING bucket are all
         greater than zero.  They can get less than zero due to rounding errors
         when accumulating. */
@@ -163,6 +163,26 @@ struct W_binsymT {
         data[false][false] += amount_false;
     }
 
+    /** Add all of the weight in other to ours, bucket by bucket. */
+    JML_COMPUTE_METHOD
+    void add(const W_binsymT & other)
+    {
+        for (unsigned cat = 0;  cat <= MISSING;  ++cat) {
+            data[cat][true]  += other.data[cat][true];
+            data[cat][false] += other.data[cat][false];
+        }
+    }
+
+    /** Remove all of the weight in other from ours, bucket by bucket. */
+    JML_COMPUTE_METHOD
+    void subtract(const W_binsymT & other)
+    {
+        for (unsigned cat = 0;  cat <= MISSING;  ++cat) {
+            data[cat][true]  -= other.data[cat][true];
+            data[cat][false] -= other.data[cat][false];
+        }
+    }
+
     /** This function ensures that the values in the MISSING bucket are all
         greater than zero.  They can get less than zero due to rounding errors
         when accumulating. */
@@ -175,6 +175,10 @@ struct Stump_Trainer {
 
     mutable Tracer tracer;  ///< Object to which we trace
 
+    /** Number of buckets that dense real features are tested over.  Every
+        value is a split point for features with fewer distinct values. */
+    enum { REAL_BUCKETS = 255 };
+
     /** This is an object used for example weights which acts as a vector
         of all 1s.  It specifies that each example counts for the same
         amount, without needing to use any memory.
@@ -285,6 +289,7 @@ struct Stump_Trainer {
         Results & results;
         int advance;
         const W & default_w;
+        const std::vector<W> * histogram;
 
         Test_Feature_Job(const Stump_Trainer * parent,
                          const Feature & feature,
@@ -294,18 +299,22 @@ struct Stump_Trainer {
                          const distribution<float> & in_class,
                          const W & default_w,
                          Results & results,
-                         int advance)
+                         int advance,
+                         const std::vector<W> * histogram = 0)
             : parent(parent), feature(feature), data(data),
               predicted(predicted),
               weights(weights), in_class(in_class), results(results),
-              advance(advance), default_w(default_w)
+              advance(advance), default_w(default_w), histogram(histogram)
         {
         }
 
         void operator () ()
         {
-            parent->test(feature, data, predicted, weights, in_class,
-                         default_w, results, advance);
+            if (histogram)
+                parent->test_histogram(feature, data, predicted, *histogram,
+                                       default_w, results);
+            else parent->test(feature, data, predicted, weights, in_class,
+                              default_w, results, advance);
         }
     };
 
@@ -357,6 +366,269 @@ struct Stump_Trainer {
         worker.run_until_finished(group);
     }
 
+    /** \name Histograms
+
+        The weight of the examples of a dense real feature, accumulated
+        over the buckets that test_real() would split it into.  The splits
+        of the feature can be tested from the histogram alone, without
+        going back to the examples.
+
+        As the accumulators are exact, the histogram of a set of examples
+        can also be obtained by subtracting the histograms of the other
+        examples from that of a superset.  That way a decision tree only
+        goes over the examples of two of the three children of a node.
+        @{
+    */
+
+    /** Weight of the examples in each bucket, in the true bucket of each W. */
+    typedef std::vector<W> Histogram;
+
+    /** Histograms of a list of features; the ones that are not tested by
+        buckets have an empty histogram. */
+    typedef std::vector<Histogram> Histograms;
+
+    /** Is the feature tested by buckets, and so from a histogram? */
+    bool histogram_feature(const Feature & feature,
+                           const Training_Data & data,
+                           const Feature & predicted) const
+    {
+        return feature != predicted
+            && data.feature_space()->info(feature).type() == REAL
+            && data.index().density(feature) > 0.2;
+    }
+
+    /** Accumulate the histogram of a feature over the examples with a non
+        zero weight in ex_weights.  Those examples are listed in examples,
+        which lets a feature that occurs exactly once in each example be
+        done without looking at the others.
+    */
+    template<class Weights>
+    void fill_histogram(Histogram & histogram,
+                        const Feature & feature,
+                        const Training_Data & data,
+                        const Feature & predicted,
+                        const Weights & weights,
+                        const distribution<float> & ex_weights,
+                        const std::vector<unsigned> & examples,
+                        int advance) const
+    {
+        Joint_Index index
+            = data.index().joint(predicted, feature, BY_EXAMPLE,
+                                 IC_LABEL | IC_EXAMPLE | IC_BUCKET | IC_DIVISOR,
+                                 REAL_BUCKETS);
+
+        histogram.assign(index.bucket_count(),
+                         W(data.label_count(predicted)));
+
+        if (!index.examples() && index.size() == data.example_count()) {
+            /* Entry x is for example x. */
+            for (unsigned i = 0;  i < examples.size();  ++i) {
+                int example = examples[i];
+                double divisor = ex_weights[example] * index[example].divisor();
+                histogram[index[example].bucket()]
+                    .add(index[example].label(), true, divisor,
+                         &weights[example][0], advance);
+            }
+            return;
+        }
+
+        for (unsigned i = 0;  i < index.size();  ++i) {
+            int example = index[i].example();
+            if (ex_weights[example] == 0.0) continue;
+            double divisor = ex_weights[example] * index[i].divisor();
+            histogram[index[i].bucket()]
+                .add(index[i].label(), true, divisor, &weights[example][0],
+                     advance);
+        }
+    }
+
+    template<class Weights>
+    struct Fill_Histogram_Job {
+        const Stump_Trainer * parent;
+        Histogram & histogram;
+        Feature feature;
+        const Training_Data & data;
+        const Feature & predicted;
+        const Weights & weights;
+        const distribution<float> & ex_weights;
+        const std::vector<unsigned> & examples;
+        int advance;
+
+        Fill_Histogram_Job(const Stump_Trainer * parent,
+                           Histogram & histogram,
+                           const Feature & feature,
+                           const Training_Data & data,
+                           const Feature & predicted,
+                           const Weights & weights,
+                           const distribution<float> & ex_weights,
+                           const std::vector<unsigned> & examples,
+                           int advance)
+            : parent(parent), histogram(histogram), feature(feature),
+              data(data), predicted(predicted), weights(weights),
+              ex_weights(ex_weights), examples(examples), advance(advance)
+        {
+        }
+
+        void operator () ()
+        {
+            parent->fill_histogram(histogram, feature, data, predicted,
+                                   weights, ex_weights, examples, advance);
+        }
+    };
+
+    /** Accumulate the histograms of all of the given features over the
+        examples with a non zero weight in ex_weights, in parallel using the
+        worker task. */
+    template<class Weights>
+    void fill_histograms(Thread_Context & context,
+                         Histograms & histograms,
+                         const std::vector<Feature> & features,
+                         const Training_Data & data,
+                         const Feature & predicted,
+                         const Weights & weights,
+                         const distribution<float> & ex_weights,
+                         int advance = -1) const
+    {
+        if (advance == -1) advance = get_advance(weights);
+
+        std::vector<unsigned> examples;
+        for (unsigned x = 0;  x < data.example_count();  ++x)
+            if (ex_weights[x] != 0.0) examples.push_back(x);
+
+        histograms.clear();
+        histograms.resize(features.size());
+
+        Worker_Task & worker = context.worker();
+
+        int group = worker.get_group(NO_JOB,
+                                     "fill histograms group",
+                                     context.group());
+        {
+            Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                         boost::ref(worker),
+                                         group));
+            
+            for (unsigned i = 0;  i < features.size();  ++i) {
+                if (!histogram_feature(features[i], data, predicted))
+                    continue;
+                worker.add(Fill_Histogram_Job<Weights>
+                           (this, histograms[i], features[i], data,
+                            predicted, weights, ex_weights, examples,
+                            advance),
+                           "fill histogram job",
+                           group);
+            }
+        }
+
+        worker.run_until_finished(group);
+    }
+
+    /** Set result to the histograms of the examples that are in all but
+        those of minus1 and minus2. */
+    static void subtract_histograms(Histograms & result,
+                                    const Histograms & all,
+                                    const Histograms & minus1,
+                                    const Histograms & minus2)
+    {
+        result = all;
+        for (unsigned i = 0;  i < result.size();  ++i) {
+            for (unsigned b = 0;  b < result[i].size();  ++b) {
+                result[i][b].subtract(minus1[i][b]);
+                result[i][b].subtract(minus2[i][b]);
+            }
+        }
+    }
+
+    /** Test a feature from its histogram.  Gives exactly the same results as
+        test() over the examples that the histogram was accumulated from. */
+    template<class Results>
+    float test_histogram(const Feature & feature,
+                         const Training_Data & data,
+                         const Feature & predicted,
+                         const Histogram & histogram,
+                         const W & default_w,
+                         Results & results) const
+    {
+        ++num_bucketed;
+
+        Joint_Index index
+            = data.index().joint(predicted, feature, BY_EXAMPLE,
+                                 IC_BUCKET, REAL_BUCKETS);
+
+        /* Move the weight of the examples with the feature from the
+           MISSING bucket to the true bucket. */
+        W present(default_w.nl());
+        for (unsigned i = 0;  i < histogram.size();  ++i)
+            present.add(histogram[i]);
+
+        W w = default_w;
+        w.add(present);
+        present.swap_buckets(true, MISSING);
+        w.subtract(present);
+
+        /* Compensate for any accumulated rounding errors. */
+        w.clip(MISSING);
+
+        return test_bucket_splits(feature, w, histogram, index.bucket_vals(),
+                                  results, false /* categorical */);
+    }
+
+    /** Like the parallel test_all, but with the features that have a
+        histogram tested from it. */
+    template<class Results, class Weights>
+    void test_all(Thread_Context & context,
+                  const std::vector<Feature> & features,
+                  const Histograms & histograms,
+                  const Training_Data & data,
+                  const Feature & predicted,
+                  const Weights & weights,
+                  const distribution<float> & in_class,
+                  Results & results,
+                  int advance = -1) const
+    {
+        using namespace std;
+
+        if (advance == -1) advance = get_advance(weights);
+
+        W default_w = calc_default_w(data, predicted, in_class, weights,
+                                     advance);
+
+        if (tracer) {
+            tracer("stump training", 1)
+                << "test all from histograms: " << features.size()
+                << " features" << endl;
+            tracer("stump training", 2)
+                << "default w: " << endl
+                << default_w.print() << endl;
+        }
+
+        Worker_Task & worker = context.worker();
+
+        int group = worker.get_group(NO_JOB,
+                                     "test all histograms group",
+                                     context.group());
+        {
+            Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                         boost::ref(worker),
+                                         group));
+            
+            for (unsigned i = 0;  i < features.size();  ++i) {
+                const Histogram * histogram
+                    = histograms[i].empty() ? 0 : &histograms[i];
+                worker.add(Test_Feature_Job<Results, Weights>
+                           (this, features[i], data, predicted,
+                            weights, in_class, default_w,
+                            results, advance, histogram),
+                           "test feature job",
+                           group);
+            }
+        }
+
+        worker.run_until_finished(group);
+    }
+
+    ///@}
+
     /* Test all of the given features, and return them sorted by their best
        Z score. */
     template<class Results, class Weights>
@@ -901,8 +1173,7 @@ struct Stump_Trainer {
 
         if (data.index().density(feature) > 0.2)
             return test_buckets(feature, data, predicted, weights, ex_weights,
-                                default_w, results,
-                                255 /* num_buckets; TODO: configurable */,
+                                default_w, results, REAL_BUCKETS,
                                 false /* categorical */,
                                 advance);
 
@@ -1089,6 +1360,32 @@ struct Stump_Trainer {
         /* Compensate for any accumulated rounding errors. */
         w.clip(MISSING);
 
+        return test_bucket_splits(feature, w, buckets, index.bucket_vals(),
+                                  results, categorical);
+    }
+
+    /** Test the split points between the buckets of a feature.
+
+        \param w            W value with the weight of the examples that have
+                            the feature in the true bucket and of the others
+                            in the MISSING bucket.
+        \param buckets      Weight of the examples in each bucket, in the true
+                            bucket of each W.
+        \param bucket_vals  Split point above each bucket but the last.
+    */
+    template<class Results>
+    float test_bucket_splits(const Feature & feature,
+                             W w,
+                             const std::vector<W> & buckets,
+                             const std::vector<float> & bucket_vals,
+                             Results & results,
+                             bool categorical) const
+    {
+        using namespace std;
+
+        bool debug = false;
+        int nb = buckets.size();
+
         ++num_bucket_early;
 
         double missing;
@@ -1142,7 +1439,7 @@ struct Stump_Trainer {
             }
 
             /* Add this split point. */
-            float arg = index.bucket_vals()[i];
+            float arg = bucket_vals[i];
             float new_Z = results.add(feature, w, arg, missing);
 
             if (categorical) w = w_start;
@@ -0,0 +1,162 @@
+/* columnar_training_data_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test that columnar datasets load in place and train like the originals.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+
+#include "jml/boosting/columnar_training_data.h"
+#include "jml/boosting/decision_tree_generator.h"
+#include "jml/boosting/boosted_stumps_generator.h"
+#include "jml/boosting/training_data.h"
+#include "jml/boosting/training_index.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/boosting/thread_context.h"
+#include "jml/utils/smart_ptr_utils.h"
+#include "jml/utils/floating_point.h"
+#include <unistd.h>
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+int nfv = 500;
+
+struct Dataset {
+    Dataset()
+        : fsp(make_unowned_sp(fs)),
+          filename(format("/tmp/columnar_training_data_test-%d.dat",
+                          (int)getpid()))
+    {
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        fs.add_feature("feature1", REAL);
+        fs.add_feature("feature2", REAL);
+        fs.add_feature("feature3", REAL);
+
+        data.reset(new Training_Data(fsp));
+
+        float NaN = std::numeric_limits<float>::quiet_NaN();
+
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            distribution<float> features;
+            features.push_back(i % 3 == 0 || i % 7 == 0);
+            features.push_back(i % 3 == 0);
+            features.push_back(i % 11 == 0 ? NaN : (i % 5) * 0.25);
+            features.push_back((i * 37) % 101 * 0.5);
+
+            data->add_example(fs.encode(features));
+        }
+
+        label = fs.features()[0];
+        inputs = fs.features();
+        inputs.erase(inputs.begin());
+
+        Columnar_Training_Data::write(filename, *data, label);
+    }
+
+    ~Dataset()
+    {
+        unlink(filename.c_str());
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    std::shared_ptr<Training_Data> data;
+    Feature label;
+    std::vector<Feature> inputs;
+    std::string filename;
+};
+
+std::string
+train(const Training_Data & data, const Feature & label,
+      const std::vector<Feature> & inputs, Classifier_Generator & generator)
+{
+    generator.init(data.feature_space(), label);
+    Thread_Context context;
+    return generator.generate(context, data, data, inputs)->print();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_columnar_load )
+{
+    Dataset dataset;
+    const Training_Data & data = *dataset.data;
+
+    Columnar_Training_Data columnar(dataset.filename);
+
+    BOOST_CHECK(columnar.mapped());
+    BOOST_CHECK_EQUAL(columnar.label(), dataset.label);
+    BOOST_REQUIRE_EQUAL(columnar.example_count(), data.example_count());
+
+    for (unsigned x = 0;  x < nfv;  ++x) {
+        for (unsigned j = 0;  j < dataset.inputs.size();  ++j) {
+            const Feature & feature = dataset.inputs[j];
+            BOOST_CHECK_EQUAL(columnar[x].count(feature),
+                              data[x].count(feature));
+            if (!data[x].count(feature)) continue;
+            float value = columnar[x][feature], expected = data[x][feature];
+            BOOST_CHECK(value == expected
+                        || (isnan(value) && isnan(expected)));
+        }
+    }
+
+    /* The index comes from the file with everything already calculated. */
+    for (unsigned j = 0;  j < dataset.inputs.size();  ++j) {
+        const Feature & feature = dataset.inputs[j];
+        Joint_Index expected
+            = data.index().joint(dataset.label, feature, BY_VALUE,
+                                 IC_VALUE | IC_LABEL | IC_EXAMPLE,
+                                 DEFAULT_NUM_BUCKETS);
+        Joint_Index result
+            = columnar.index().joint(dataset.label, feature, BY_VALUE,
+                                     IC_VALUE | IC_LABEL | IC_EXAMPLE,
+                                     DEFAULT_NUM_BUCKETS);
+
+        BOOST_REQUIRE_EQUAL(result.size(), expected.size());
+        for (unsigned i = 0;  i < result.size();  ++i) {
+            BOOST_CHECK_EQUAL(result[i].value(), expected[i].value());
+            BOOST_CHECK_EQUAL(result[i].example(), expected[i].example());
+            BOOST_CHECK_EQUAL(result[i].label().label(),
+                              expected[i].label().label());
+            BOOST_CHECK_EQUAL(result[i].bucket(), expected[i].bucket());
+        }
+
+        BOOST_CHECK(columnar.index().values(feature).mapped());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_training )
+{
+    Dataset dataset;
+    Columnar_Training_Data columnar(dataset.filename);
+
+    {
+        Decision_Tree_Generator generator;
+        generator.max_depth = 4;
+        string expected = train(*dataset.data, dataset.label, dataset.inputs,
+                                generator);
+        string result = train(columnar, dataset.label, dataset.inputs,
+                              generator);
+        BOOST_CHECK_EQUAL(result, expected);
+    }
+
+    {
+        Boosted_Stumps_Generator generator;
+        generator.max_iter = 20;
+        string expected = train(*dataset.data, dataset.label, dataset.inputs,
+                                generator);
+        string result = train(columnar, dataset.label, dataset.inputs,
+                              generator);
+        BOOST_CHECK_EQUAL(result, expected);
+    }
+}
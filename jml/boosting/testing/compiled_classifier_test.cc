@@ -0,0 +1,225 @@
+/* compiled_classifier_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test that compiled classifiers give the same output as the originals.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+#include <vector>
+#include <iostream>
+
+#include "jml/boosting/compiled_classifier.h"
+#include "jml/boosting/decision_tree_generator.h"
+#include "jml/boosting/boosted_stumps_generator.h"
+#include "jml/boosting/glz_classifier_generator.h"
+#include "jml/boosting/committee.h"
+#include "jml/boosting/training_data.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/boosting/thread_context.h"
+#include "jml/utils/smart_ptr_utils.h"
+#include "jml/db/persistent.h"
+#include <sstream>
+#include <unistd.h>
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+int nfv = 500;
+
+struct Dataset {
+    Dataset()
+        : fsp(make_unowned_sp(fs))
+    {
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        fs.add_feature("feature1", REAL);
+        fs.add_feature("feature2", REAL);
+        fs.add_feature("feature3", REAL);
+
+        data.reset(new Training_Data(fsp));
+
+        float NaN = std::numeric_limits<float>::quiet_NaN();
+
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            distribution<float> features;
+            features.push_back(i % 3 == 0 || i % 7 == 0);
+            features.push_back(i % 3 == 0);
+            features.push_back(i % 11 == 0 ? NaN : (i % 5) * 0.25);
+            features.push_back(i % 7 == 0);
+
+            data->add_example(fs.encode(features));
+            rows.push_back(distribution<float>(features.begin() + 1,
+                                               features.end()));
+        }
+
+        inputs = fs.features();
+        inputs.erase(inputs.begin());
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    std::shared_ptr<Training_Data> data;
+    std::vector<distribution<float> > rows;
+    std::vector<Feature> inputs;
+
+    /** Check that the compiled classifier gives the same output as the
+        original over the whole dataset, both one by one and batched. */
+    void check(const Classifier_Impl & classifier) const
+    {
+        Compiled_Classifier compiled(classifier, inputs);
+        int nl = compiled.label_count();
+        BOOST_REQUIRE_EQUAL(nl, classifier.label_count());
+
+        vector<float> batch_in;
+        for (unsigned i = 0;  i < nfv;  ++i)
+            batch_in.insert(batch_in.end(), rows[i].begin(), rows[i].end());
+        vector<float> batch_out(nfv * nl);
+        compiled.predict(&batch_in[0], nfv, &batch_out[0]);
+
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            Label_Dist expected = classifier.predict((*data)[i]);
+            Label_Dist result = compiled.predict(&rows[i][0]);
+
+            for (unsigned l = 0;  l < nl;  ++l) {
+                BOOST_CHECK_CLOSE(result[l] + 1.0, expected[l] + 1.0, 0.001);
+                BOOST_CHECK_CLOSE(batch_out[i * nl + l] + 1.0,
+                                  expected[l] + 1.0, 0.001);
+                BOOST_CHECK_CLOSE(compiled.predict(l, &rows[i][0]) + 1.0,
+                                  expected[l] + 1.0, 0.001);
+            }
+        }
+    }
+};
+
+std::shared_ptr<Classifier_Impl>
+train(const Dataset & dataset, Classifier_Generator & generator)
+{
+    generator.init(dataset.fsp, dataset.fs.features()[0]);
+    Thread_Context context;
+    return generator.generate(context, *dataset.data, *dataset.data,
+                              dataset.inputs);
+}
+
+std::shared_ptr<Classifier_Impl> trainTree(const Dataset & dataset)
+{
+    Decision_Tree_Generator generator;
+    generator.max_depth = 4;
+    return train(dataset, generator);
+}
+
+std::shared_ptr<Classifier_Impl> trainStumps(const Dataset & dataset)
+{
+    Boosted_Stumps_Generator generator;
+    generator.max_iter = 20;
+    return train(dataset, generator);
+}
+
+std::shared_ptr<Classifier_Impl> trainGlz(const Dataset & dataset)
+{
+    GLZ_Classifier_Generator generator;
+    return train(dataset, generator);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_compiled_decision_tree )
+{
+    Dataset dataset;
+    dataset.check(*trainTree(dataset));
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_boosted_stumps )
+{
+    Dataset dataset;
+    dataset.check(*trainStumps(dataset));
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_glz_classifier )
+{
+    Dataset dataset;
+    dataset.check(*trainGlz(dataset));
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_committee )
+{
+    Dataset dataset;
+
+    Committee inner(dataset.fsp, dataset.fs.features()[0]);
+    inner.add(trainStumps(dataset), 0.5);
+    inner.add(trainGlz(dataset), 0.25);
+    inner.bias[1] = 0.1;
+
+    Committee committee(dataset.fsp, dataset.fs.features()[0]);
+    committee.add(trainTree(dataset), 0.75);
+    committee.add(make_sp(inner.make_copy()), 2.0);
+    committee.bias[0] = -0.2;
+
+    BOOST_CHECK(Compiled_Classifier::supported(committee));
+    dataset.check(committee);
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_missing_feature )
+{
+    Dataset dataset;
+    auto tree = trainTree(dataset);
+
+    // Layout that doesn't have the features the classifier needs
+    vector<Feature> features;
+    BOOST_CHECK_THROW(Compiled_Classifier(*tree, features), Exception);
+
+    // Extra features are ignored
+    features = dataset.inputs;
+    features.insert(features.begin(), dataset.fs.features()[0]);
+    Compiled_Classifier compiled(*tree, features);
+    BOOST_CHECK_EQUAL(compiled.feature_count(), 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_save_load )
+{
+    Dataset dataset;
+
+    Committee committee(dataset.fsp, dataset.fs.features()[0]);
+    committee.add(trainTree(dataset), 0.75);
+    committee.add(trainStumps(dataset), 0.5);
+    committee.add(trainGlz(dataset), 0.25);
+
+    Compiled_Classifier compiled(committee, dataset.inputs);
+
+    string filename = "build/x86_64/tmp/compiled_classifier_test.cls";
+    compiled.save(filename);
+    BOOST_CHECK(Compiled_Classifier::is_saved(filename));
+
+    Compiled_Classifier loaded;
+    loaded.load(filename);
+    unlink(filename.c_str());
+
+    // Loaded from a stream, it has to be copied
+    std::ostringstream stream;
+    DB::Store_Writer writer(stream);
+    compiled.serialize(writer);
+
+    std::istringstream istream(stream.str());
+    DB::Store_Reader reader(istream);
+    Compiled_Classifier copied;
+    copied.reconstitute(reader);
+
+    BOOST_CHECK(!compiled.mapped());
+    BOOST_CHECK(loaded.mapped());
+    BOOST_CHECK(!copied.mapped());
+
+    BOOST_CHECK_EQUAL(loaded.feature_count(), compiled.feature_count());
+    BOOST_CHECK_EQUAL(loaded.label_count(), compiled.label_count());
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        Label_Dist expected = compiled.predict(&dataset.rows[i][0]);
+        BOOST_CHECK_EQUAL(loaded.predict(&dataset.rows[i][0]), expected);
+        BOOST_CHECK_EQUAL(copied.predict(&dataset.rows[i][0]), expected);
+    }
+}
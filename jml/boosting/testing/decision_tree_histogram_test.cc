@@ -0,0 +1,108 @@
+/* decision_tree_histogram_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test that training a decision tree from histograms gives the same tree.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <vector>
+#include <iostream>
+
+#include "jml/boosting/decision_tree_generator.h"
+#include "jml/boosting/training_data.h"
+#include "jml/boosting/dense_features.h"
+#include "jml/boosting/feature_info.h"
+#include "jml/boosting/thread_context.h"
+#include "jml/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+/** Train a tree on a noisy dataset with nl labels, with and without
+    histograms, and return the printed trees. */
+void train_both(int nl, string & expected, string & result)
+{
+    Dense_Feature_Space fs;
+    if (nl == 2)
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    else fs.add_feature("LABEL",
+                        Feature_Info(std::make_shared<Fixed_Categorical_Info>
+                                         (nl),
+                                     false, true));
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+    fs.add_feature("feature3", REAL);
+    fs.add_feature("feature4", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    boost::mt19937 engine(12345);
+    boost::uniform_01<boost::mt19937> rng(engine);
+
+    float NaN = std::numeric_limits<float>::quiet_NaN();
+
+    int nfv = 5000;
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        float x = rng(), y = rng();
+        int label = (x + 0.3 * y + 0.2 * rng()) * nl / 1.5;
+
+        distribution<float> features;
+        features.push_back(label);
+        features.push_back(x);
+        features.push_back(rng() < 0.1 ? NaN : y);
+        features.push_back(int(rng() * 20));  // lots of repeated values
+        features.push_back(rng());            // noise
+
+        data.add_example(fs.encode(features));
+    }
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin());
+
+    distribution<float> training_weights(nfv, 1);
+
+    Decision_Tree_Generator generator;
+    generator.max_depth = 6;
+    generator.init(fsp, fs.features()[0]);
+
+    {
+        Thread_Context context;
+        expected = generator.generate(context, data, training_weights,
+                                      features)->print();
+    }
+
+    generator.histograms = true;
+
+    {
+        Thread_Context context;
+        result = generator.generate(context, data, training_weights,
+                                    features)->print();
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_histograms_binsym )
+{
+    string expected, result;
+    train_both(2, expected, result);
+    BOOST_CHECK_EQUAL(result, expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_histograms_normal )
+{
+    string expected, result;
+    train_both(3, expected, result);
+    BOOST_CHECK_EQUAL(result, expected);
+}
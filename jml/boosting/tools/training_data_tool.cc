@@ -378,7 +378,10 @@ try
             vector<double> vec;
 
             // TODO: fill in
-            stats[d].calc(data[d]->index().values(feature), label_dists[d], nl);
+            const DB::Frozen_Array<float> & values
+                = data[d]->index().values(feature);
+            stats[d].calc(vector<float>(values.begin(), values.end()),
+                          label_dists[d], nl);
 
             cout << format("  %2d %8zd %8.3f %8.3f %8.3f %8.3f %8.3f "
                            "%7zd %8.6f %8.3g\n",
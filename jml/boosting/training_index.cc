@@ -192,7 +192,7 @@ Dataset_Index::labels(const Feature & feature) const
     return itl->index[feature].get_labels();
 }
 
-const std::vector<float> &
+const DB::Frozen_Array<float> &
 Dataset_Index::values(const Feature & feature) const
 {
     return itl->index[feature].get_values(BY_EXAMPLE);
@@ -235,17 +235,14 @@ joint(const Feature & target, const Feature & independent,
         const vector<Label> & example_labels
             = itl->index[target].get_labels();
         //cerr << "example_labels = " << example_labels << endl;
-        const vector<Label> & mapped_labels
-            = itl->index[independent].get_mapped_labels(example_labels, target,
-                                                        sort_by);
-        //cerr << "mapped_labels = " << mapped_labels << endl;
-        labels = &mapped_labels[0];
+        labels = itl->index[independent].get_mapped_labels(example_labels,
+                                                           target, sort_by);
     }
 
     if (want_buckets) {
         const Bucket_Info & bucket_info
             = itl->index[independent].buckets(num_buckets);
-        buckets = &bucket_info.buckets[0];
+        buckets = bucket_info.buckets.data();
         bucket_splits = &bucket_info.splits;
     }
 
@@ -264,16 +261,14 @@ joint(const Feature & target, const Feature & independent,
     }
 
     if (want_examples) {
-        const vector<unsigned> & examples_vector
+        const DB::Frozen_Array<unsigned> & examples_vector
             = itl->index[independent].get_examples(sort_by);
         if (!examples_vector.empty())
-            examples = &examples_vector[0];
+            examples = examples_vector.data();
     }
 
     if (want_values) {
-        const vector<float> & values_vector
-            = itl->index[independent].get_values(sort_by);
-        values = &values_vector[0];
+        values = itl->index[independent].get_values(sort_by).data();
     }
 
     Joint_Index result(values, buckets, labels, examples, counts, divisors,
@@ -330,7 +325,7 @@ dist(const Feature & feature, Sort_By sort_by, unsigned content,
     if (want_buckets) {
         const Bucket_Info & bucket_info
             = itl->index[feature].buckets(num_buckets);
-        buckets = &bucket_info.buckets[0];
+        buckets = bucket_info.buckets.data();
         bucket_splits = &bucket_info.splits;
     }
 
@@ -349,22 +344,80 @@ dist(const Feature & feature, Sort_By sort_by, unsigned content,
     }
 
     if (want_examples) {
-        const vector<unsigned> & examples_vector
+        const DB::Frozen_Array<unsigned> & examples_vector
             = itl->index[feature].get_examples(sort_by);
         if (!examples_vector.empty())
-            examples = &examples_vector[0];
+            examples = examples_vector.data();
     }
 
     if (want_values) {
-        const vector<float> & values_vector
-            = itl->index[feature].get_values(sort_by);
-        values = &values_vector[0];
+        values = itl->index[feature].get_values(sort_by).data();
     }
 
     return Joint_Index(values, buckets, labels, examples, counts, divisors,
                        itl->index[feature].seen, bucket_splits);
 }
 
+void
+Dataset_Index::
+serialize(DB::Store_Writer & store, const Feature & label,
+          const std::vector<size_t> & num_buckets) const
+{
+    const vector<Label> & labels = itl->index[label].get_labels();
+
+    char version = 1;
+    store << version << label.type() << label.arg1() << label.arg2();
+
+    store << DB::compact_size_t(itl->all_features.size());
+    for (unsigned i = 0;  i < itl->all_features.size();  ++i) {
+        const Feature & feature = itl->all_features[i];
+        Index_Entry & entry = itl->index[feature];
+        store << feature.type() << feature.arg1() << feature.arg2()
+              << entry.used;
+        if (entry.used)
+            entry.serialize(store, label, labels, num_buckets);
+    }
+}
+
+void
+Dataset_Index::
+reconstitute(DB::Store_Reader & store,
+             std::shared_ptr<const Feature_Space> feature_space)
+{
+    char version;
+    store >> version;
+    if (version != 1)
+        throw Exception("Dataset_Index::reconstitute(): unknown version %d",
+                        version);
+
+    Feature::id_type type, arg1, arg2;
+    store >> type >> arg1 >> arg2;
+    Feature label(type, arg1, arg2);
+
+    std::shared_ptr<Itl> new_itl(new Itl());
+    new_itl->feature_space = feature_space;
+
+    DB::compact_size_t nf(store);
+    new_itl->all_features.reserve(nf);
+    for (unsigned i = 0;  i < nf;  ++i) {
+        bool used;
+        store >> type >> arg1 >> arg2 >> used;
+        Feature feature(type, arg1, arg2);
+        new_itl->all_features.push_back(feature);
+
+        Index_Entry & entry = new_itl->index[feature];
+        if (used)
+            entry.reconstitute(store, feature, feature_space, label);
+        else {
+            entry.initialized = true;
+            entry.feature = feature;
+            entry.feature_space = feature_space;
+        }
+    }
+
+    itl = new_itl;
+}
+
 double Dataset_Index::density(const Feature & feat) const
 {
     return itl->index[feat].density();
@@ -94,7 +94,7 @@ public:
     const std::vector<Label> & labels(const Feature & feature) const;
 
     /** Return the values, in example order. */
-    const std::vector<float> & values(const Feature & feature) const;
+    const DB::Frozen_Array<float> & values(const Feature & feature) const;
     
     /** Returns an index of the joint distribution between any two given
         features.
@@ -168,6 +168,20 @@ public:
     /** Return a list of all features found in the dataset. */
     const std::vector<Feature> & all_features() const;
 
+    /** Save the index with everything that training against label needs
+        already calculated, including the buckets for each of the given
+        bucket counts.  Each column of each feature is contiguous.
+    */
+    void serialize(DB::Store_Writer & store, const Feature & label,
+                   const std::vector<size_t> & num_buckets) const;
+
+    /** Reconstitute an index saved with serialize().  When the store was
+        opened on a mapped file, the columns are used from the file's pages,
+        so that only the features that are used get read from disk.
+    */
+    void reconstitute(DB::Store_Reader & store,
+                      std::shared_ptr<const Feature_Space> feature_space);
+
 private:
     struct Itl;
     struct Index_Entry;
@@ -15,6 +15,7 @@
 #include "jml/utils/pair_utils.h"
 #include <boost/timer.hpp>
 #include "jml/utils/exc_assert.h"
+#include "jml/db/persistent.h"
 
 using namespace std;
 
@@ -31,7 +32,7 @@ Index_Entry()
       example_count(0), seen(0), found_in(0), missing_from(0), found_twice(0),
       zeros(0), ones(0),
       non_integral(0), max_value(-INFINITY), min_value(INFINITY),
-      last_example((unsigned)-1), in_this_ex(0),
+      last_example((unsigned)-1), in_this_ex(0), distinct_values(-1),
       has_examples_sorted(false), has_values_sorted(false),
       has_counts(false), has_counts_sorted(false),
       has_divisors(false), has_divisors_sorted(false),
@@ -157,7 +158,8 @@ finalize(unsigned example_count, const Feature & feature,
     this->feature_space = feature_space;
     this->example_count = example_count;
     missing_from = example_count - found_in;
-    if (values.capacity() != values.size()) values = vector<float>(values);
+    if (values.capacity() != values.size())
+        values = vector<float>(values.begin(), values.end());
 
     if (dense() && exactly_one()) {
         ExcAssert(examples.empty());
@@ -188,7 +190,7 @@ finalize(unsigned example_count, const Feature & feature,
 #endif // invalid
 
         if (examples.capacity() != examples.size())
-            examples = vector<unsigned>(examples);
+            examples = vector<unsigned>(examples.begin(), examples.end());
     }
 
 #if 0
@@ -219,7 +221,7 @@ finalize(unsigned example_count, const Feature & feature,
     //     << " took " << t.elapsed() << "s" << endl;
 }
 
-const vector<float> &
+const DB::Frozen_Array<float> &
 Dataset_Index::Index_Entry::
 get_values(Sort_By sort_by)
 {
@@ -227,20 +229,21 @@ get_values(Sort_By sort_by)
     if (sort_by == BY_EXAMPLE) return values;
     else if (sort_by == BY_VALUE) {
         if (has_values_sorted) return values_sorted;
-        vector<float> new_values_sorted = values;
+        const DB::Frozen_Array<float> & vals = values;
+        vector<float> new_values_sorted(vals.begin(), vals.end());
         std::sort(new_values_sorted.begin(), new_values_sorted.end());
         //safe_less<float>());
         
         Guard guard(lock);
         if (has_values_sorted) return values_sorted;
-        values_sorted.swap(new_values_sorted);
+        values_sorted = std::move(new_values_sorted);
         has_values_sorted = true;
         return values_sorted;
     }
     else throw Exception("invalid sort_by");
 }
 
-const vector<unsigned> &
+const DB::Frozen_Array<unsigned> &
 Dataset_Index::Index_Entry::
 get_examples(Sort_By sort_by)
 {
@@ -249,26 +252,21 @@ get_examples(Sort_By sort_by)
 
     else if (sort_by == BY_VALUE) {
         if (has_examples_sorted) return examples_sorted;
-        
-        vector<unsigned> examples2;
-        if (examples.empty()) {
-            /* Construct a vector counting from 0 */
-            examples2 = vector<unsigned>(values.size());
-            std::iota(examples2.begin(), examples2.end(), 0);
-        }
-        const vector<unsigned> & examples3
-            = (examples.size() ? examples : examples2);
 
-        vector<pair<float, unsigned> > pairs
-            (pair_merger(values.begin(), examples3.begin()),
-             pair_merger(values.end(), examples3.end()));
+        /* An empty examples array counts up from 0. */
+        const DB::Frozen_Array<float> & vals = values;
+        const DB::Frozen_Array<unsigned> & exs = examples;
+
+        vector<pair<float, unsigned> > pairs(vals.size());
+        for (unsigned i = 0;  i < vals.size();  ++i)
+            pairs[i] = make_pair(vals[i], exs.empty() ? i : exs[i]);
         sort_on_first_ascending(pairs);
         
-        if (values_sorted.size()) {
+        const DB::Frozen_Array<float> & sorted = values_sorted;
+        if (sorted.size()) {
             /* Should be the same whether pre-calculated or not. */
-            ExcAssert(std::equal(values_sorted.begin(),
-                              values_sorted.end(),
-                              first_extractor(pairs.begin())));
+            ExcAssert(std::equal(sorted.begin(), sorted.end(),
+                                 first_extractor(pairs.begin())));
         }
         else {
             values_sorted = vector<float>(first_extractor(pairs.begin()),
@@ -279,7 +277,7 @@ get_examples(Sort_By sort_by)
                                              second_extractor(pairs.end()));
         Guard guard(lock);
         if (has_examples_sorted) return examples_sorted;
-        examples_sorted.swap(new_examples_sorted);
+        examples_sorted = std::move(new_examples_sorted);
         has_examples_sorted = true;
         return examples_sorted;
     }
@@ -297,16 +295,21 @@ get_counts(Sort_By sort_by)
     //debug = (feature_space->print(feature) == "lemma-try");
 
     if (debug) {
+        const DB::Frozen_Array<unsigned> & examples = get_examples(sort_by);
         cerr << "get_counts(" << sort_by << ")" << endl;
-        cerr << "  get_examples = " << get_examples(sort_by) << endl;
+        cerr << "  get_examples = "
+             << vector<unsigned>(examples.begin(), examples.end()) << endl;
     }
 
     if (sort_by == BY_EXAMPLE) {
         if (has_counts) return counts;
 
+        const DB::Frozen_Array<unsigned> & examples = get_examples(BY_EXAMPLE);
+
         if (debug) {
             cerr << "constructing from examples" << endl;
-            cerr << "examples = " << examples << endl;
+            cerr << "examples = "
+                 << vector<unsigned>(examples.begin(), examples.end()) << endl;
         }
 
         vector<unsigned> new_counts;
@@ -349,7 +352,8 @@ get_counts(Sort_By sort_by)
         if (debug) cerr << "constructing from 3 arrays" << endl;
         hash_map<unsigned, unsigned> examp_counts;
         const vector<unsigned> & ex_counts = get_counts(BY_EXAMPLE);
-        const vector<unsigned> & ex_examples = get_examples(BY_EXAMPLE);
+        const DB::Frozen_Array<unsigned> & ex_examples
+            = get_examples(BY_EXAMPLE);
         
         if (ex_examples.empty())
             for (unsigned i = 0;  i < ex_counts.size();  ++i)
@@ -358,7 +362,8 @@ get_counts(Sort_By sort_by)
             for (unsigned i = 0;  i < examples.size();  ++i)
                 examp_counts[ex_examples[i]] = ex_counts[i];
         
-        const vector<unsigned> & val_examples = get_examples(BY_VALUE);
+        const DB::Frozen_Array<unsigned> & val_examples
+            = get_examples(BY_VALUE);
         
         vector<unsigned> new_counts_sorted;
         new_counts_sorted.reserve(val_examples.size());
@@ -491,7 +496,7 @@ get_freqs()
     if (only_one()) {
         /* Accumulate them; example_count is always one since only_one is
            true. */
-        const vector<float> & vals = get_values(BY_VALUE);
+        const DB::Frozen_Array<float> & vals = get_values(BY_VALUE);
 
         float last = -INFINITY;
         int count = 0;
@@ -518,7 +523,7 @@ get_freqs()
         /* Accumulate them; example count is not always one; we need to
            get hold of the counts. */
         const vector<unsigned> & counts = get_counts(BY_VALUE);
-        const vector<float> & vals = get_values(BY_VALUE);
+        const DB::Frozen_Array<float> & vals = get_values(BY_VALUE);
             
         float last = -INFINITY;
         double count = 0.0;
@@ -623,6 +628,7 @@ get_labels()
     
     Feature_Info info = feature_space->info(feature);
         
+    const DB::Frozen_Array<float> & values = get_values(BY_EXAMPLE);
     ExcAssert(values.size() == example_count);
 
     //cerr << "values = " << values << endl;
@@ -649,7 +655,7 @@ get_labels()
     return labels;
 }
 
-const vector<Label> &
+const Label *
 Dataset_Index::Index_Entry::
 get_mapped_labels(const vector<Label> & labels, const Feature & target,
                   Sort_By sort_by)
@@ -670,25 +676,29 @@ get_mapped_labels(const vector<Label> & labels, const Feature & target,
     }
 
     if (exactly_one() && sort_by == BY_EXAMPLE)
-        return labels;  // don't need to update them...
+        return labels.data();  // don't need to update them...
 
     Guard guard(lock);
-    vector<Label> & result = (sort_by == BY_VALUE ? mapped_labels[target]
-                              : mapped_labels_sorted[target]);
+    Mapped_Labels_Entry & entry = (sort_by == BY_VALUE
+                                   ? mapped_labels[target]
+                                   : mapped_labels_sorted[target]);
+    const DB::Frozen_Array<Label> & result = entry;
     
-    if (result.size()) return result;
+    if (result.size()) return result.data();
 
     /* Get the examples to map. */
-    const vector<unsigned> & examples = get_examples(sort_by);
+    const DB::Frozen_Array<unsigned> & examples = get_examples(sort_by);
     
     ExcAssert(!examples.empty());
 
-    result = vector<Label>(examples.size());
+    vector<Label> new_result(examples.size());
 
     for (unsigned x = 0;  x < examples.size();  ++x)
-        result[x] = labels[examples[x]];
+        new_result[x] = labels[examples[x]];
+
+    DB::Frozen_Array<Label>(std::move(new_result)).swap(entry);
         
-    return result;
+    return result.data();
 }
 
 const Bucket_Info &
@@ -714,7 +724,7 @@ create_buckets(size_t num_buckets)
 
     result.buckets.clear();
 
-    const vector<float> & values = get_values(BY_EXAMPLE);
+    const DB::Frozen_Array<float> & values = get_values(BY_EXAMPLE);
 
     vector<int> bucket_count(result.splits.size() + 1);
         
@@ -750,9 +760,10 @@ buckets(size_t num_buckets)
 
     //cerr << "buckets(" << num_buckets << ")" << endl;
 
-    const Freqs & freqs = get_freqs();
-    if (freqs.size() < num_buckets)
-        num_buckets = freqs.size();
+    if (distinct_values < 0)
+        distinct_values = get_freqs().size();
+    if ((size_t)distinct_values < num_buckets)
+        num_buckets = distinct_values;
     
     Guard guard(lock);
     if (bucket_info.count(num_buckets))
@@ -761,6 +772,120 @@ buckets(size_t num_buckets)
     return create_buckets(num_buckets);
 }
 
+void
+Dataset_Index::Index_Entry::
+serialize(DB::Store_Writer & store,
+          const Feature & target, const vector<Label> & labels,
+          const std::vector<size_t> & num_buckets)
+{
+    check_used();
+
+    /* Calculate everything that joint() will ask for, so that reading the
+       file back never has to go through the values again. */
+    get_values(BY_VALUE);
+    get_examples(BY_VALUE);
+    get_divisors(BY_EXAMPLE);
+    get_divisors(BY_VALUE);
+    const Freqs & freqs = get_freqs();
+    for (unsigned i = 0;  i < num_buckets.size();  ++i)
+        buckets(num_buckets[i]);
+
+    char version = 1;
+    store << version
+          << example_count << seen << found_in << missing_from << found_twice
+          << zeros << ones << non_integral << max_value << min_value
+          << distinct_values;
+
+    examples.serialize(store);
+    examples_sorted.serialize(store);
+    values.serialize(store);
+    values_sorted.serialize(store);
+
+    store << counts << counts_sorted << divisors << divisors_sorted;
+
+    vector<float> freq_values, freq_counts;
+    for (Freqs::const_iterator it = freqs.begin();  it != freqs.end();  ++it) {
+        freq_values.push_back(it->first);
+        freq_counts.push_back(it->second);
+    }
+    store << freq_values << freq_counts;
+
+    /* The labels are only mapped onto the other features. */
+    bool with_labels = (target != feature);
+    store << with_labels;
+    if (with_labels) {
+        get_mapped_labels(labels, target, BY_VALUE);
+        get_mapped_labels(labels, target, BY_EXAMPLE);
+        mapped_labels[target].serialize(store);
+        mapped_labels_sorted[target].serialize(store);
+    }
+
+    store << DB::compact_size_t(bucket_info.size());
+    for (map<unsigned, Bucket_Info>::const_iterator it = bucket_info.begin();
+         it != bucket_info.end();  ++it) {
+        store << it->first << it->second.splits;
+        it->second.buckets.serialize(store);
+    }
+}
+
+void
+Dataset_Index::Index_Entry::
+reconstitute(DB::Store_Reader & store, const Feature & feature,
+             std::shared_ptr<const Feature_Space> feature_space,
+             const Feature & target)
+{
+    char version;
+    store >> version;
+    if (version != 1)
+        throw Exception("Index_Entry::reconstitute(): unknown version %d",
+                        version);
+
+    used = initialized = true;
+    this->feature = feature;
+    this->feature_space = feature_space;
+
+    store >> example_count >> seen >> found_in >> missing_from >> found_twice
+          >> zeros >> ones >> non_integral >> max_value >> min_value
+          >> distinct_values;
+
+    examples.reconstitute(store);
+    examples_sorted.reconstitute(store);
+    values.reconstitute(store);
+    values_sorted.reconstitute(store);
+    has_examples_sorted = has_values_sorted = true;
+
+    store >> counts >> counts_sorted >> divisors >> divisors_sorted;
+    has_counts = has_counts_sorted = has_divisors = has_divisors_sorted = true;
+
+    vector<float> freq_values, freq_counts;
+    store >> freq_values >> freq_counts;
+    if (freq_values.size() != freq_counts.size())
+        throw Exception("Index_Entry::reconstitute(): bad frequencies");
+    vector<pair<float, float> > freqs2(freq_values.size());
+    for (unsigned i = 0;  i < freq_values.size();  ++i)
+        freqs2[i] = make_pair(freq_values[i], freq_counts[i]);
+    freqs = Freqs(freqs2.begin(), freqs2.end());
+    has_freqs = true;
+
+    bool with_labels;
+    store >> with_labels;
+    if (with_labels) {
+        mapped_labels[target].reconstitute(store);
+        mapped_labels_sorted[target].reconstitute(store);
+    }
+
+    DB::compact_size_t nb(store);
+    bucket_info.clear();
+    for (unsigned i = 0;  i < nb;  ++i) {
+        unsigned num_buckets;
+        store >> num_buckets;
+        Bucket_Info & info = bucket_info[num_buckets];
+        info.initialized = true;
+        store >> info.splits;
+        info.buckets.reconstitute(store);
+    }
+}
+
 #if 0 // TODO: potential bug here; this throws sometimes
 if (bucket_splits[bucket] != value) {
     cerr << "buckets.size() = " << buckets.size()
@@ -13,6 +13,7 @@
 #include "config.h"
 #include "training_index.h"
 #include "feature_map.h"
+#include "jml/db/frozen_array.h"
 #include "jml/arch/threads.h"
 #include "jml/math/xdiv.h"
 #include <boost/utility.hpp>
@@ -55,6 +56,9 @@ struct Dataset_Index::Index_Entry {
 
     /** Print a string containing the information above. */
     std::string print_info() const;
+
+    /** Number of distinct values; -1 until it has been calculated. */
+    int distinct_values;
     
     /** Check that this feature is used before we access it. */
     void check_used() const;
@@ -87,19 +91,22 @@ struct Dataset_Index::Index_Entry {
     /** Contains a list of each of the examples that the feature was
         found in.  Will be empty if dense and exactly_one are both true,
         since it can be produced with the iota function.
+
+        This and the other columns are frozen arrays so that an index that
+        was reconstituted from a mapped file can use them in place.
     */
-    std::vector<unsigned> examples;
+    DB::Frozen_Array<unsigned> examples;
 
     /** Ditto, but sorted by value. */
     bool has_examples_sorted;
-    std::vector<unsigned> examples_sorted;
+    DB::Frozen_Array<unsigned> examples_sorted;
     
     /** Contains the value each time it was found.  Sorted by example number. */
-    std::vector<float> values;
+    DB::Frozen_Array<float> values;
     
     /** Contains the same values as values, but sorted by the value itself. */
     bool has_values_sorted;
-    std::vector<float> values_sorted;
+    DB::Frozen_Array<float> values_sorted;
 
     /** Counts per example. */
     bool has_counts;
@@ -134,7 +141,7 @@ struct Dataset_Index::Index_Entry {
     bool has_category_freqs;
     Category_Freqs category_freqs;
 
-    struct Mapped_Labels_Entry : public std::vector<Label> {
+    struct Mapped_Labels_Entry : public DB::Frozen_Array<Label> {
         bool initialized;
     };
 
@@ -169,12 +176,12 @@ struct Dataset_Index::Index_Entry {
     /*************************************************************************/
 
     /** Return the values, sorted as specified. */
-    const vector<float> & get_values(Sort_By sort_by);
+    const DB::Frozen_Array<float> & get_values(Sort_By sort_by);
 
     /** Return the example numbers, sorted as specified.  If the vector is
         empty, then the examples count implicitly from one to the highest
         value. */
-    const vector<unsigned> & get_examples(Sort_By sort_by);
+    const DB::Frozen_Array<unsigned> & get_examples(Sort_By sort_by);
 
     /** Get the example counts.  If the vector is empty, then the counts are
         implicitly one every time. */
@@ -194,11 +201,11 @@ struct Dataset_Index::Index_Entry {
         length as example_count. */
     const vector<Label> & get_labels();
 
-    /** Map the labels from something else onto our examples.  The distribution
-        will have the same length as examples.size().  The labels are sorted in
+    /** Map the labels from something else onto our examples.  The result
+        has one entry per value of this feature.  The labels are sorted in
         the manner specified.
     */
-    const vector<Label> &
+    const Label *
     get_mapped_labels(const vector<Label> & labels, const Feature & feature,
                       Sort_By sort_by);
 
@@ -254,6 +261,28 @@ struct Dataset_Index::Index_Entry {
     const Bucket_Info & create_buckets(size_t num_buckets);
 
     const Bucket_Info & buckets(size_t num_buckets);
+
+
+    /*************************************************************************/
+    /* PERSISTENCE                                                           */
+    /*************************************************************************/
+
+    /** Save the entry with everything that training needs already
+        calculated: the columns sorted by value, the buckets for each of the
+        given bucket counts and the labels of the target feature mapped onto
+        this one.
+    */
+    void serialize(DB::Store_Writer & store,
+                   const Feature & target, const vector<Label> & labels,
+                   const std::vector<size_t> & num_buckets);
+
+    /** Reconstitute an entry saved with serialize() for the same target.
+        If the store was opened on a mapped file, the columns are used in
+        place.
+    */
+    void reconstitute(DB::Store_Reader & store, const Feature & feature,
+                      std::shared_ptr<const Feature_Space> feature_space,
+                      const Feature & target);
 };
 
 } // namespace ML
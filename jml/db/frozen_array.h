@@ -0,0 +1,207 @@
+/* frozen_array.h                                                  -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Read-only array that can be used directly from a memory mapped archive.
+*/
+
+#ifndef __db__frozen_array_h__
+#define __db__frozen_array_h__
+
+#include "persistent.h"
+#include "jml/arch/exception.h"
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+
+namespace ML {
+namespace DB {
+
+
+/*****************************************************************************/
+/* FROZEN_ARRAY                                                              */
+/*****************************************************************************/
+
+/** Array of plain values that is serialized as its raw bytes, aligned for T
+    within the archive.  When it's reconstituted from a Store_Reader that
+    was opened on a file, it points straight into the mapped pages of the
+    file instead of being copied: loading takes no time whatever the size,
+    and all the processes that load the same file share one copy of it in
+    the page cache.  Otherwise (stream, compressed file or misaligned data)
+    it holds its own copy.
+
+    The values are stored in the byte order of the machine, which must be
+    little endian, and T must be trivially copyable and not contain
+    pointers.
+
+    It can be built up like a vector.  Modifying a mapped array makes a
+    private copy of it first.
+*/
+
+template<typename T>
+class Frozen_Array {
+public:
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Frozen_Array needs a trivially copyable type");
+
+    typedef T value_type;
+    typedef const T * const_iterator;
+    typedef T * iterator;
+
+    Frozen_Array()
+        : data_(0), size_(0)
+    {
+    }
+
+    Frozen_Array(std::vector<T> values)
+        : owned_(std::move(values)), data_(0), size_(0)
+    {
+    }
+
+    /** View of size values at data, which must stay valid for as long as
+        keep_alive is held.  Used to share part of a bigger mapped array. */
+    Frozen_Array(const T * data, size_t size,
+                 std::shared_ptr<const void> keep_alive)
+        : mapping_(std::move(keep_alive)), data_(data), size_(size)
+    {
+        if (!mapping_)
+            throw Exception("Frozen_Array: view needs something to keep "
+                            "its data alive");
+    }
+
+    /** Is it used from memory it doesn't own (the pages of a mapped file)? */
+    bool mapped() const { return mapping_ != nullptr; }
+
+    const T * data() const { return mapped() ? data_ : owned_.data(); }
+    size_t size() const { return mapped() ? size_ : owned_.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T & operator [] (size_t i) const { return data()[i]; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size(); }
+
+    /** Memory that belongs to this object; the mapped pages don't count. */
+    size_t capacity() const { return owned_.capacity(); }
+
+    T * data() { return thaw().data(); }
+    T & operator [] (size_t i) { return thaw()[i]; }
+    iterator begin() { return thaw().data(); }
+    iterator end() { return thaw().data() + owned_.size(); }
+
+    void clear()
+    {
+        owned_.clear();
+        mapping_.reset();
+    }
+
+    void reserve(size_t n) { thaw().reserve(n); }
+
+    void resize(size_t n, const T & val = T()) { thaw().resize(n, val); }
+
+    template<typename It>
+    void assign(It first, It last)
+    {
+        std::vector<T> values(first, last);
+        owned_.swap(values);
+        mapping_.reset();
+    }
+
+    void swap(Frozen_Array & other)
+    {
+        owned_.swap(other.owned_);
+        mapping_.swap(other.mapping_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+
+    void push_back(const T & val) { thaw().push_back(val); }
+
+    template<typename It>
+    void insert(iterator pos, It first, It last)
+    {
+        size_t index = pos - static_cast<const Frozen_Array &>(*this).data();
+        thaw();
+        owned_.insert(owned_.begin() + index, first, last);
+    }
+
+    void serialize(Store_Writer & store) const
+    {
+        check_byte_order();
+
+        char version = 1;
+        compact_size_t size(this->size());
+        store << version << size;
+
+        size_t offset = store.offset() + 1;
+        unsigned char padding = (alignof(T) - offset % alignof(T)) % alignof(T);
+        store << padding;
+
+        static const char zeros[alignof(T)] = { 0 };
+        store.save_binary(zeros, padding);
+        store.save_binary(data(), sizeof(T) * size);
+    }
+
+    void reconstitute(Store_Reader & store)
+    {
+        check_byte_order();
+
+        char version;
+        store >> version;
+        if (version != 1)
+            throw Exception("Frozen_Array: unknown version %d", version);
+
+        compact_size_t size(store);
+        unsigned char padding;
+        store >> padding;
+        store.skip(padding);
+
+        size_t bytes = sizeof(T) * size;
+        std::shared_ptr<const void> mapping = store.mapping();
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(store.pos());
+
+        if (mapping && address % alignof(T) == 0) {
+            store.must_have(bytes);
+            owned_.clear();
+            mapping_ = mapping;
+            data_ = reinterpret_cast<const T *>(store.pos());
+            size_ = size;
+            store.skip(bytes);
+        }
+        else {
+            std::vector<T> values(size);
+            store.load_binary(values.data(), bytes);
+            owned_.swap(values);
+            mapping_.reset();
+        }
+    }
+
+private:
+    std::vector<T> owned_;
+    std::shared_ptr<const void> mapping_;   ///< Keeps the mapping alive
+    const T * data_;
+    size_t size_;
+
+    std::vector<T> & thaw()
+    {
+        if (mapped()) {
+            owned_.assign(data_, data_ + size_);
+            mapping_.reset();
+        }
+        return owned_;
+    }
+
+    static void check_byte_order()
+    {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+        throw Exception("Frozen_Array is only supported on little endian "
+                        "machines");
+#endif
+    }
+};
+
+} // namespace DB
+} // namespace ML
+
+#endif /* __db__frozen_array_h__ */
@@ -45,6 +45,11 @@ struct Binary_Input::Source {
     }
 
     virtual size_t more(Binary_Input & input, size_t amount) = 0;
+
+    virtual std::shared_ptr<const void> mapping() const
+    {
+        return nullptr;
+    }
 };
 
 struct Binary_Input::Buffer_Source
@@ -76,6 +81,11 @@ struct Binary_Input::Buffer_Source
         return input.avail();  // we can never get more after this
     }
 
+    virtual std::shared_ptr<const void> mapping() const
+    {
+        return region;
+    }
+
     std::shared_ptr<File_Read_Buffer::Region> region;
 };
 
@@ -292,6 +302,13 @@ try_make_avail(size_t min_avail)
     return source->more(*this, min_avail);
 }
 
+std::shared_ptr<const void>
+Binary_Input::
+mapping() const
+{
+    return source ? source->mapping() : nullptr;
+}
+
 
 /*****************************************************************************/
 /* PORTABLE_BIN_IARCHIVE                                                     */
@@ -53,7 +53,12 @@ namespace DB {
 /* BINARY_INPUT                                                              */
 /*****************************************************************************/
 
-/* This is a class that can get its input from an istream or a buffer. */
+/* This is a class that can get its input from an istream or a buffer.
+
+   When it's opened on a file that isn't compressed, the file is mapped into
+   memory instead of being read, and mapping() gives access to the pages so
+   that what's in them can be used in place (see Frozen_Array).
+*/
 
 struct Binary_Input {
 public:
@@ -106,6 +111,12 @@ public:
 
     size_t offset() const { return offset_; }
 
+    /** Owner of the memory that the input comes from, which stays valid for
+        as long as it's held, or null if the input is read from a stream or
+        from a buffer owned by the caller.  The memory is read only.
+    */
+    std::shared_ptr<const void> mapping() const;
+
 private:
     size_t offset_;       ///< Offset of start from archive start
     const char * pos_;    ///< Position in memory region
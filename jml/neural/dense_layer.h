@@ -97,6 +97,20 @@ struct Dense_Layer : public Layer {
 
     using Layer::apply;
 
+    /** Apply to a batch of examples.  The weight matrix is traversed once
+        per block of examples, with the input rows of the block sharing each
+        weight row while it is in cache.  Each output is accumulated in the
+        same order as apply() does, so the results are identical. */
+    template<typename F>
+    void apply_batch(const F * input, F * output, size_t n) const;
+
+    virtual void apply_batch(const float * input, float * output,
+                             size_t n) const;
+    virtual void apply_batch(const double * input, double * output,
+                             size_t n) const;
+
+    using Layer::apply_batch;
+
 
     /*************************************************************************/
     /* ACTIVATION                                                            */
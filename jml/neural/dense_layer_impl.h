@@ -326,6 +326,98 @@ apply(const double * input,
     transfer_function->transfer(act, output, no);
 }
 
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+apply_batch(const F * inputs, F * outputs, size_t n) const
+{
+    /* Examples are done BLOCK at a time, over OUTPUTS_BLOCK outputs at a
+       time so that the accumulators for the block stay in the L1 cache
+       while the weights stream through. */
+    enum { BLOCK = 16, OUTPUTS_BLOCK = 256 };
+
+    int ni = this->inputs(), no = this->outputs();
+    double accum[BLOCK][OUTPUTS_BLOCK];
+    F act[no];
+
+    for (size_t x0 = 0;  x0 < n;  x0 += BLOCK) {
+        int nx = std::min<size_t>(BLOCK, n - x0);
+        const F * block_inputs = inputs + x0 * ni;
+        F * block_outputs = outputs + x0 * no;
+
+        for (int o0 = 0;  o0 < no;  o0 += OUTPUTS_BLOCK) {
+            int nw = std::min<int>(OUTPUTS_BLOCK, no - o0);
+
+            for (int x = 0;  x < nx;  ++x)
+                std::copy(&bias[o0], &bias[o0] + nw, accum[x]);
+
+            for (unsigned i = 0;  i < ni;  ++i) {
+                for (int x = 0;  x < nx;  ++x) {
+                    F value = block_inputs[x * ni + i];
+                    const Float * w;
+                    double input;
+                    if (!isnan(value)) {
+                        input = value;
+                        w = &weights[i][o0];
+                    }
+                    else {
+                        switch (missing_values) {
+                        case MV_NONE:
+                            throw Exception("missing value with MV_NONE");
+
+                        case MV_ZERO:
+                            continue;  // weight is zero
+
+                        case MV_INPUT:
+                            input = missing_replacements[i];
+                            w = &weights[i][o0];
+                            break;
+
+                        case MV_DENSE:
+                            input = 1.0;  w = &missing_activations[i][o0];
+                            break;
+
+                        default:
+                            throw Exception("unknown missing values");
+                        }
+                    }
+
+                    SIMD::vec_add(accum[x], input, w, accum[x], nw);
+                }
+            }
+
+            for (int x = 0;  x < nx;  ++x)
+                std::copy(accum[x], accum[x] + nw,
+                          block_outputs + x * no + o0);
+        }
+
+        /* The transfer function can depend on all of the outputs (eg,
+           softmax), so it is applied once the example is complete. */
+        for (int x = 0;  x < nx;  ++x) {
+            F * output = block_outputs + x * no;
+            std::copy(output, output + no, act);
+            transfer_function->transfer(act, output, no);
+        }
+    }
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+apply_batch(const float * input, float * output, size_t n) const
+{
+    apply_batch<float>(input, output, n);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+apply_batch(const double * input, double * output, size_t n) const
+{
+    apply_batch<double>(input, output, n);
+}
+
 template<typename Float>
 template<class F>
 void
@@ -189,6 +189,39 @@ apply(const distribution<double> & input,
     apply(&input[0], &output[0]);
 }
 
+void
+Layer::
+apply_batch(const float * input, float * output, size_t n) const
+{
+    int ni = inputs(), no = outputs();
+    for (unsigned x = 0;  x < n;  ++x)
+        apply(input + x * ni, output + x * no);
+}
+
+void
+Layer::
+apply_batch(const double * input, double * output, size_t n) const
+{
+    int ni = inputs(), no = outputs();
+    for (unsigned x = 0;  x < n;  ++x)
+        apply(input + x * ni, output + x * no);
+}
+
+boost::multi_array<float, 2>
+Layer::
+apply_batch(const boost::multi_array<float, 2> & input) const
+{
+    if (input.shape()[1] != inputs())
+        throw Exception("Layer::apply_batch(): invalid number of inputs");
+
+    size_t n = input.shape()[0];
+    boost::multi_array<float, 2> result(boost::extents[n][outputs()]);
+    if (n == 0) return result;
+
+    apply_batch(input.data(), result.data(), n);
+    return result;
+}
+
 #define CHECK_SIZE_OF(element, expected_size) \
     if (element.size() != expected_size) \
         throw Exception(format("%s: Input parameter %s of expected size " \
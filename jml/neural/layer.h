@@ -229,6 +229,30 @@ public:
     /** \copydoc apply */
     virtual void apply(const double * input, double * output) const = 0;
 
+    /** Apply the layer to a batch of examples at once.
+
+        \param input   Array of n rows of inputs() values, one per example
+        \param output  Array of n rows of outputs() values
+        \param n       Number of examples in the batch
+
+        The result is the same as calling apply() on each row, which is what
+        the default implementation does.  Layers override it to make one pass
+        over their parameters per block of examples rather than per example.
+
+        Unlike for apply(), input and output <b>may not overlap</b>. */
+    virtual void apply_batch(const float * input, float * output,
+                             size_t n) const;
+
+    /** \copydoc apply_batch */
+    virtual void apply_batch(const double * input, double * output,
+                             size_t n) const;
+
+    /** Apply the layer to each row of the input matrix, which must have
+        inputs() columns, and return a matrix with the outputs() outputs of
+        each row. */
+    boost::multi_array<float, 2>
+    apply_batch(const boost::multi_array<float, 2> & input) const;
+
     ///@}
 
 
@@ -172,6 +172,18 @@ struct Layer_Stack : public Layer {
 
     using Layer::apply;
 
+    /** Apply to a batch of examples, passing the whole batch through each
+        layer in turn. */
+    template<typename F>
+    void apply_batch(const F * input, F * output, size_t n) const;
+
+    virtual void apply_batch(const float * input, float * output,
+                             size_t n) const;
+    virtual void apply_batch(const double * input, double * output,
+                             size_t n) const;
+
+    using Layer::apply_batch;
+
 
     /*************************************************************************/
     /* FPROP                                                                 */
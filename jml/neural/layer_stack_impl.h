@@ -308,6 +308,44 @@ apply(const double * input, double * output) const
     apply<double>(input, output);
 }
 
+template<class LayerT>
+template<typename F>
+void
+Layer_Stack<LayerT>::
+apply_batch(const F * input, F * output, size_t n) const
+{
+    if (n == 0) return;
+
+    /* Unlike apply(), the layers can't work in place, so alternate between
+       two buffers. */
+    std::vector<F> tmp[2];
+    if (layers_.size() > 1) tmp[0].resize(n * max_internal_width_);
+    if (layers_.size() > 2) tmp[1].resize(n * max_internal_width_);
+
+    for (unsigned l = 0;  l < layers_.size();  ++l) {
+        const F * i = (l == 0 ? input : &tmp[(l - 1) % 2][0]);
+        F * o = (l == layers_.size() - 1 ? output : &tmp[l % 2][0]);
+
+        layers_[l]->apply_batch(i, o, n);
+    }
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+apply_batch(const float * input, float * output, size_t n) const
+{
+    apply_batch<float>(input, output, n);
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+apply_batch(const double * input, double * output, size_t n) const
+{
+    apply_batch<double>(input, output, n);
+}
+
 template<class LayerT>
 size_t
 Layer_Stack<LayerT>::
@@ -127,6 +127,29 @@ predict(const Feature_Set & fs,
     return this->output.decode(output);
 }
 
+std::vector<distribution<float> >
+Perceptron::
+predict_batch(const std::vector<const Feature_Set *> & fsets) const
+{
+    PROFILE_FUNCTION(t_predict);
+
+    size_t nx = fsets.size(), ni = layers.inputs(), no = layers.outputs();
+    if (nx == 0) return std::vector<distribution<float> >();
+
+    vector<float> input(nx * ni), output(nx * no);
+    for (unsigned x = 0;  x < nx;  ++x)
+        extract_features(*fsets[x], &input[x * ni]);
+
+    layers.apply_batch(&input[0], &output[0], nx);
+
+    std::vector<distribution<float> > result(nx);
+    for (unsigned x = 0;  x < nx;  ++x)
+        result[x] = this->output.decode
+            (distribution<float>(&output[x * no], &output[x * no] + no));
+
+    return result;
+}
+
 std::string
 Perceptron::
 print() const
@@ -291,11 +314,16 @@ decorrelate(const Training_Data & data) const
 
     boost::multi_array<float, 2> result(boost::extents[nx][nf]);
     
-    float input[nf];
-
-    for (unsigned x = 0;  x < nx;  ++x) {
-        extract_features(data[x], &input[0]);
-        layers[0].apply(input, &result[x][0]);
+    /* Extract a block of examples at a time and apply the layer to the
+       whole block. */
+    enum { BLOCK = 256 };
+    vector<float> input(BLOCK * nf);
+
+    for (unsigned x0 = 0;  x0 < nx;  x0 += BLOCK) {
+        size_t n = std::min<size_t>(BLOCK, nx - x0);
+        for (unsigned x = 0;  x < n;  ++x)
+            extract_features(data[x0 + x], &input[x * nf]);
+        layers[0].apply_batch(&input[0], &result[x0][0], n);
     }
     
     return result;
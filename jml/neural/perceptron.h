@@ -97,6 +97,14 @@ public:
     predict(const Feature_Set & features,
             PredictionContext * context = 0) const;
 
+    /** Predict the score for all classes of each of a batch of examples,
+        for example the impressions of a single request.  The result is the
+        same as calling predict() on each, but the layers are applied to the
+        whole batch at once, which goes through each weight matrix once
+        per block of examples instead of once per example. */
+    std::vector<distribution<float> >
+    predict_batch(const std::vector<const Feature_Set *> & features) const;
+
     /** Apply the first layer to a dataset to decorrelate it. */
     boost::multi_array<float, 2> decorrelate(const Training_Data & data) const;
         
@@ -445,6 +445,56 @@ BOOST_AUTO_TEST_CASE( test_single_precision_accuracy )
                                   ffinput_errors.end());
 }
 
+template<typename F>
+void check_apply_batch(Missing_Values missing_values, Transfer_Function_Type tf)
+{
+    Thread_Context context;
+
+    // More outputs than are done at once, and a batch that isn't a multiple
+    // of the block size
+    int ni = 20, no = 300, nx = 37;
+    Dense_Layer<F> layer("test", ni, no, tf, missing_values, context);
+
+    boost::multi_array<float, 2> inputs(boost::extents[nx][ni]);
+    for (unsigned x = 0;  x < nx;  ++x)
+        for (unsigned i = 0;  i < ni;  ++i)
+            inputs[x][i]
+                = (missing_values != MV_NONE && context.random01() < 0.2
+                   ? numeric_limits<float>::quiet_NaN()
+                   : 0.5 - context.random01());
+
+    boost::multi_array<float, 2> outputs = layer.apply_batch(inputs);
+    BOOST_REQUIRE_EQUAL(outputs.shape()[0], nx);
+    BOOST_REQUIRE_EQUAL(outputs.shape()[1], no);
+
+    vector<double> inputsd(inputs.data(), inputs.data() + nx * ni);
+    vector<double> outputsd(nx * no);
+    layer.apply_batch(&inputsd[0], &outputsd[0], nx);
+
+    // Must give exactly the same result as one example at a time
+    for (unsigned x = 0;  x < nx;  ++x) {
+        distribution<float> input(&inputs[x][0], &inputs[x][0] + ni);
+        distribution<float> expected = layer.apply(input);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                      &outputs[x][0], &outputs[x][0] + no);
+
+        distribution<double> expectedd
+            = layer.apply(distribution<double>(input.begin(), input.end()));
+        BOOST_CHECK_EQUAL_COLLECTIONS(expectedd.begin(), expectedd.end(),
+                                      &outputsd[x * no],
+                                      &outputsd[x * no] + no);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_apply_batch )
+{
+    check_apply_batch<float>(MV_NONE, TF_TANH);
+    check_apply_batch<double>(MV_NONE, TF_IDENTITY);
+    check_apply_batch<float>(MV_ZERO, TF_TANH);
+    check_apply_batch<float>(MV_INPUT, TF_SOFTMAX);
+    check_apply_batch<double>(MV_DENSE, TF_TANH);
+}
+
 BOOST_AUTO_TEST_CASE( test_bprop_identity_double_none )
 {
     Thread_Context context;
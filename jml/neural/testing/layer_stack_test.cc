@@ -411,3 +411,35 @@ BOOST_AUTO_TEST_CASE( test_bprop_three_nonlinear_layers )
 
     bprop_test<double>(layers, context, 0.1);
 }
+
+BOOST_AUTO_TEST_CASE( test_apply_batch_three_layers )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer1("test1", 5, 10, TF_TANH, MV_DENSE, context);
+    Dense_Layer<float> layer2("test2", 10, 20, TF_TANH, MV_NONE, context);
+    Dense_Layer<float> layer3("test3", 20, 5, TF_SOFTMAX, MV_NONE,  context);
+
+    Layer_Stack<Dense_Layer<float> > layers("test_layers");
+    layers.add(make_unowned_sp(layer1));
+    layers.add(make_unowned_sp(layer2));
+    layers.add(make_unowned_sp(layer3));
+
+    int nx = 37;
+    boost::multi_array<float, 2> inputs(boost::extents[nx][5]);
+    for (unsigned x = 0;  x < nx;  ++x)
+        for (unsigned i = 0;  i < 5;  ++i)
+            inputs[x][i] = (context.random01() < 0.2
+                            ? numeric_limits<float>::quiet_NaN()
+                            : 0.5 - context.random01());
+
+    boost::multi_array<float, 2> outputs = layers.apply_batch(inputs);
+    BOOST_REQUIRE_EQUAL(outputs.shape()[0], nx);
+    BOOST_REQUIRE_EQUAL(outputs.shape()[1], 5);
+
+    for (unsigned x = 0;  x < nx;  ++x) {
+        distribution<float> input(&inputs[x][0], &inputs[x][0] + 5);
+        distribution<float> expected = layers.apply(input);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                      &outputs[x][0], &outputs[x][0] + 5);
+    }
+}
@@ -0,0 +1,121 @@
+/* tsne_bench.cc                                                   -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Compares the exact t-SNE with the Barnes-Hut approximation on clustered
+   data of increasing size, for both the run time and how well the clusters
+   are kept together in the embedding.
+
+   Usage: tsne_bench [max_points [max_exact_points [max_iter]]]
+*/
+
+#include "jml/tsne/tsne.h"
+#include "jml/arch/timers.h"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace ML;
+
+
+boost::multi_array<float, 2>
+make_clusters(int nx, int nd, int nc, vector<int> & labels)
+{
+    boost::mt19937 rng;
+    boost::normal_distribution<float> norm;
+    boost::variate_generator<boost::mt19937,
+                             boost::normal_distribution<float> >
+        randn(rng, norm);
+
+    boost::multi_array<float, 2> centers(boost::extents[nc][nd]);
+    for (unsigned c = 0;  c < nc;  ++c)
+        for (unsigned j = 0;  j < nd;  ++j)
+            centers[c][j] = 3.0 * randn();
+
+    boost::multi_array<float, 2> data(boost::extents[nx][nd]);
+    labels.resize(nx);
+    for (unsigned i = 0;  i < nx;  ++i) {
+        labels[i] = i % nc;
+        for (unsigned j = 0;  j < nd;  ++j)
+            data[i][j] = centers[labels[i]][j] + randn();
+    }
+
+    return data;
+}
+
+/** Proportion of (a sample of) the points whose nearest neighbour in the
+    embedding comes from the same cluster. */
+double nn_accuracy(const boost::multi_array<float, 2> & Y,
+                   const vector<int> & labels)
+{
+    int n = Y.shape()[0];
+    int step = max(1, n / 1000);
+
+    int correct = 0, total = 0;
+    for (unsigned i = 0;  i < n;  i += step, ++total) {
+        float best = INFINITY;
+        int nearest = -1;
+        for (unsigned j = 0;  j < n;  ++j) {
+            if (j == i) continue;
+            float d = 0.0f;
+            for (unsigned k = 0;  k < Y.shape()[1];  ++k)
+                d += (Y[i][k] - Y[j][k]) * (Y[i][k] - Y[j][k]);
+            if (d < best) {
+                best = d;
+                nearest = j;
+            }
+        }
+        correct += labels[i] == labels[nearest];
+    }
+
+    return 1.0 * correct / total;
+}
+
+int main(int argc, char ** argv)
+{
+    int maxPoints = argc > 1 ? atoi(argv[1]) : 20000;
+    int maxExact = argc > 2 ? atoi(argv[2]) : 5000;
+
+    TSNE_Params params;
+    params.max_iter = argc > 3 ? atoi(argv[3]) : 500;
+
+    printf("%8s %-6s %10s %10s %8s\n",
+           "points", "mode", "probs (s)", "tsne (s)", "nn acc");
+
+    for (int n = 1000;  n <= maxPoints;  n *= 2) {
+        vector<int> labels;
+        boost::multi_array<float, 2> data = make_clusters(n, 50, 10, labels);
+
+        if (n <= maxExact) {
+            Timer timer;
+            boost::multi_array<float, 2> distances
+                = vectors_to_distances(data);
+            boost::multi_array<float, 2> probs
+                = distances_to_probabilities(distances);
+            double tProbs = timer.elapsed_wall();
+
+            timer.restart();
+            boost::multi_array<float, 2> Y = tsne(probs, 2, params);
+            double tTsne = timer.elapsed_wall();
+
+            printf("%8d %-6s %10.2f %10.2f %8.3f\n",
+                   n, "exact", tProbs, tTsne, nn_accuracy(Y, labels));
+        }
+
+        Timer timer;
+        TSNE_Sparse_Probs probs = vectors_to_sparse_probabilities(data);
+        double tProbs = timer.elapsed_wall();
+
+        timer.restart();
+        boost::multi_array<float, 2> Y = tsne_approx(probs, 2, params);
+        double tTsne = timer.elapsed_wall();
+
+        printf("%8d %-6s %10.2f %10.2f %8.3f\n",
+               n, "bh", tProbs, tTsne, nn_accuracy(Y, labels));
+    }
+}
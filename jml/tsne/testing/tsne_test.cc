@@ -21,6 +21,10 @@
 #include "jml/utils/parse_context.h"
 #include "jml/utils/filter_streams.h"
 #include "jml/utils/environment.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <set>
 
 using namespace ML;
 using namespace std;
@@ -280,3 +284,100 @@ BOOST_AUTO_TEST_CASE( test_distance_to_probability_big )
     boost::multi_array<float, 2> reduction JML_UNUSED
         = tsne(probabilities, 2);
 }
+
+/** Points in nd dimensions from nc well separated gaussian clusters; the
+    cluster of each point is returned in labels. */
+boost::multi_array<float, 2>
+make_clusters(int nx, int nd, int nc, std::vector<int> & labels)
+{
+    boost::mt19937 rng;
+    boost::normal_distribution<float> norm;
+    boost::variate_generator<boost::mt19937,
+                             boost::normal_distribution<float> >
+        randn(rng, norm);
+
+    boost::multi_array<float, 2> centers(boost::extents[nc][nd]);
+    for (unsigned c = 0;  c < nc;  ++c)
+        for (unsigned j = 0;  j < nd;  ++j)
+            centers[c][j] = 10.0 * randn();
+
+    boost::multi_array<float, 2> data(boost::extents[nx][nd]);
+    labels.resize(nx);
+    for (unsigned i = 0;  i < nx;  ++i) {
+        labels[i] = i % nc;
+        for (unsigned j = 0;  j < nd;  ++j)
+            data[i][j] = centers[labels[i]][j] + randn();
+    }
+
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_probabilities )
+{
+    std::vector<int> labels;
+    boost::multi_array<float, 2> data = make_clusters(500, 20, 5, labels);
+
+    TSNE_Sparse_Probs probs = vectors_to_sparse_probabilities(data, 10.0);
+
+    BOOST_CHECK_EQUAL(probs.n, 500);
+    BOOST_CHECK_EQUAL(probs.nnz(), 500 * 30);
+
+    boost::multi_array<float, 2> distances = vectors_to_distances(data);
+
+    for (unsigned i = 0;  i < 500;  ++i) {
+        // The vantage-point tree should find the same neighbours as a
+        // brute force search
+        std::vector<std::pair<float, int> > row;
+        for (unsigned j = 0;  j < 500;  ++j)
+            if (j != i) row.push_back(make_pair(distances[i][j], j));
+        std::sort(row.begin(), row.end());
+
+        std::set<int> expected, found;
+        for (unsigned j = 0;  j < 30;  ++j)
+            expected.insert(row[j].second);
+
+        double total = 0.0;
+        for (int e = probs.row_start[i];  e < probs.row_start[i + 1];  ++e) {
+            found.insert(probs.cols[e]);
+            total += probs.vals[e];
+        }
+
+        BOOST_CHECK(found == expected);
+        BOOST_CHECK_CLOSE(total, 1.0, 0.01);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_tsne_approx )
+{
+    std::vector<int> labels;
+    boost::multi_array<float, 2> data = make_clusters(600, 20, 4, labels);
+
+    TSNE_Sparse_Probs probs = vectors_to_sparse_probabilities(data, 20.0);
+
+    TSNE_Params params;
+    params.max_iter = 300;
+
+    boost::multi_array<float, 2> reduction = tsne_approx(probs, 2, params);
+
+    BOOST_REQUIRE_EQUAL(reduction.shape()[0], 600);
+    BOOST_REQUIRE_EQUAL(reduction.shape()[1], 2);
+
+    // The clusters should stay together in the embedding
+    int correct = 0;
+    for (unsigned i = 0;  i < 600;  ++i) {
+        float best = INFINITY;
+        int nearest = -1;
+        for (unsigned j = 0;  j < 600;  ++j) {
+            if (j == i) continue;
+            float d = sqr(reduction[i][0] - reduction[j][0])
+                    + sqr(reduction[i][1] - reduction[j][1]);
+            if (d < best) {
+                best = d;
+                nearest = j;
+            }
+        }
+        correct += labels[i] == labels[nearest];
+    }
+
+    BOOST_CHECK_GT(correct, 590);
+}
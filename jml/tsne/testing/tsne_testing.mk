@@ -1,2 +1,3 @@
 $(eval $(call test,tsne_test,tsne utils arch,boost timed manual))
 $(eval $(call python_test,tsne_python_test,tsne,manual))
+$(eval $(call program,tsne_bench,tsne arch))
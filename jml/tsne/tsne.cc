@@ -26,6 +26,7 @@
 #include "jml/utils/guard.h"
 #include <boost/bind.hpp>
 #include "jml/utils/environment.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -1043,9 +1044,9 @@ tsne(const boost::multi_array<float, 2> & probs,
         sumP += 2.0 * SIMD::vec_sum_dp(&P[i][0], i);
     
     // Factor that P should be multiplied by in all calculations
-    // We boost it by 4 in early iterations to force the clusters to be
-    // spread apart
-    float pfactor = 4.0 / sumP;
+    // We boost it (by 4 by default) in early iterations to force the
+    // clusters to be spread apart
+    float pfactor = params.exaggeration / sumP;
 
     // TODO: do we need this?   P = Math.maximum(P, 1e-12);
     for (unsigned i = 0;  i < n;  ++i)
@@ -1126,7 +1127,7 @@ tsne(const boost::multi_array<float, 2> & probs,
         /*********************************************************************/
         // Update
 
-        float momentum = (iter < 20
+        float momentum = (iter < params.momentum_switch_iter
                           ? params.initial_momentum
                           : params.final_momentum);
 
@@ -1163,10 +1164,679 @@ tsne(const boost::multi_array<float, 2> & probs,
         t_cost += t.elapsed();  t.restart();
 
         // Stop lying about P values if we're finished
-        if (iter == 100) {
+        if (iter == params.stop_exaggeration_iter) {
+            float factor = 1.0 / params.exaggeration;
             for (unsigned i = 0;  i < n;  ++i)
                 for (unsigned j = 0;  j < n;  ++j)
-                    P[i][j] *= 0.25f;
+                    P[i][j] *= factor;
+        }
+    }
+
+    return Y;
+}
+
+
+/*****************************************************************************/
+/* APPROXIMATE T-SNE                                                         */
+/*****************************************************************************/
+
+// Implements the tree-based approximations from (Van der Maaten, 2014):
+// Accelerating t-SNE using Tree-Based Algorithms.  Journal of Machine
+// Learning Research 15(Oct):3221-3245.
+
+namespace {
+
+/** Run fn(i0, i1) over chunks of rows [0, n) in the worker task. */
+template<typename Fn>
+void run_in_chunks(int n, int chunk_size, const Fn & fn)
+{
+    Worker_Task & worker = Worker_Task::instance(num_threads() - 1);
+
+    int group;
+    {
+        int parent = -1;  // no parent group
+        group = worker.get_group(NO_JOB, "", parent);
+        Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                     boost::ref(worker),
+                                     group));
+        
+        for (int i = 0;  i < n;  i += chunk_size)
+            worker.add(boost::bind<void>(fn, i, min(n, i + chunk_size)),
+                       "", group);
+    }
+
+    worker.run_until_finished(group);
+}
+
+/** Vantage-point tree over the rows of X, used to find the nearest
+    neighbours of each point in the input space (Yianilos, 1993).  Each
+    node splits the points under it by their distance to its vantage
+    point: the closer half goes left and the further half right.
+*/
+struct VP_Tree {
+
+    struct Node {
+        int item;         ///< The vantage point
+        float radius;     ///< Median distance of the points under it
+        int left, right;  ///< Closer and further children; -1 if none
+    };
+
+    VP_Tree(const boost::multi_array<float, 2> & X)
+        : X(X), n(X.shape()[0]), d(X.shape()[1]), sum_X(n), items(n)
+    {
+        for (unsigned i = 0;  i < n;  ++i) {
+            sum_X[i] = SIMD::vec_dotprod_dp(&X[i][0], &X[i][0], d);
+            items[i] = i;
+        }
+
+        nodes.reserve(n);
+        std::vector<std::pair<float, int> > scratch(n);
+        boost::mt19937 rng;
+        root = build(0, n, scratch, rng);
+    }
+
+    const boost::multi_array<float, 2> & X;
+    int n, d;
+    distribution<double> sum_X;
+    std::vector<int> items;
+    std::vector<Node> nodes;
+    int root;
+
+    // ||x_i - x_j|| = sqrt(||x_i||^2 + ||x_j||^2 - 2 x_i . x_j)
+    float dist(int i, int j) const
+    {
+        double XXT = SIMD::vec_dotprod_dp(&X[i][0], &X[j][0], d);
+        return sqrt(std::max(0.0, sum_X[i] + sum_X[j] - 2.0 * XXT));
+    }
+
+    int build(int begin, int end,
+              std::vector<std::pair<float, int> > & scratch,
+              boost::mt19937 & rng)
+    {
+        if (begin == end) return -1;
+
+        // Pick a random vantage point and move it to the front
+        std::swap(items[begin], items[begin + rng() % (end - begin)]);
+        int vp = items[begin];
+
+        int node = nodes.size();
+        nodes.push_back(Node{ vp, 0.0f, -1, -1 });
+
+        if (end - begin == 1) return node;
+
+        // Partition the rest around the median distance from it
+        for (int i = begin + 1;  i < end;  ++i)
+            scratch[i] = make_pair(dist(vp, items[i]), items[i]);
+
+        int mid = (begin + 1 + end) / 2;
+        std::nth_element(scratch.begin() + begin + 1, scratch.begin() + mid,
+                         scratch.begin() + end);
+
+        for (int i = begin + 1;  i < end;  ++i)
+            items[i] = scratch[i].second;
+
+        nodes[node].radius = scratch[mid].first;
+        int left = build(begin + 1, mid, scratch, rng);
+        int right = build(mid, end, scratch, rng);
+        nodes[node].left = left;
+        nodes[node].right = right;
+
+        return node;
+    }
+
+    /** Return the k nearest neighbours of point i, not including itself,
+        as (distance, point) pairs sorted from the nearest. */
+    std::vector<std::pair<float, int> >
+    nearest(int i, int k) const
+    {
+        std::vector<std::pair<float, int> > heap;
+        heap.reserve(k + 1);
+        float tau = INFINITY;
+        search(root, i, k, heap, tau);
+        std::sort_heap(heap.begin(), heap.end());
+        return heap;
+    }
+
+    void search(int node, int i, int k,
+                std::vector<std::pair<float, int> > & heap,
+                float & tau) const
+    {
+        if (node == -1) return;
+
+        const Node & nd = nodes[node];
+        float di = dist(i, nd.item);
+
+        // heap is a max-heap of the k best so far; tau is the worst of them
+        if (nd.item != i && di < tau) {
+            if (heap.size() == k) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+            heap.push_back(make_pair(di, nd.item));
+            std::push_heap(heap.begin(), heap.end());
+            if (heap.size() == k) tau = heap.front().first;
+        }
+
+        // Search the more likely side first, so that tau shrinks faster
+        if (di < nd.radius) {
+            if (di - tau <= nd.radius) search(nd.left, i, k, heap, tau);
+            if (di + tau >= nd.radius) search(nd.right, i, k, heap, tau);
+        }
+        else {
+            if (di + tau >= nd.radius) search(nd.right, i, k, heap, tau);
+            if (di - tau <= nd.radius) search(nd.left, i, k, heap, tau);
+        }
+    }
+};
+
+/** Space partitioning tree over the points of the embedding (a quadtree
+    for D = 2 and an octree for D = 3), used to summarize the repulsion
+    from the points in far away cells by their centre of mass.
+*/
+template<int D>
+struct BH_Tree {
+
+    enum { NUM_CHILDREN = 1 << D, MAX_DEPTH = 32 };
+
+    struct Node {
+        float center[D];  ///< Centre of the cell
+        float width;      ///< Length of the sides of the cell
+        float com[D];     ///< Centre of mass of the points in the cell
+        int count;        ///< Number of points in the cell
+        int first_child;  ///< Index of the first child; -1 for a leaf
+        int begin, end;   ///< Points of a leaf, as a range of order
+    };
+
+    BH_Tree(const boost::multi_array<float, 2> & Y)
+        : Y(Y), n(Y.shape()[0]), order(n), scratch(n)
+    {
+        float lo[D], hi[D];
+        for (unsigned k = 0;  k < D;  ++k)
+            lo[k] = hi[k] = (n ? Y[0][k] : 0.0f);
+
+        for (unsigned i = 0;  i < n;  ++i) {
+            order[i] = i;
+            for (unsigned k = 0;  k < D;  ++k) {
+                lo[k] = std::min(lo[k], Y[i][k]);
+                hi[k] = std::max(hi[k], Y[i][k]);
+            }
+        }
+
+        Node root;
+        root.width = 0.0f;
+        for (unsigned k = 0;  k < D;  ++k) {
+            root.center[k] = 0.5f * (lo[k] + hi[k]);
+            root.width = std::max(root.width, hi[k] - lo[k]);
+        }
+        // Make sure that the extreme points are strictly inside
+        root.width = root.width * 1.001f + 1e-5f;
+
+        nodes.reserve(2 * n + 1);
+        nodes.push_back(root);
+        build(0, 0, n, 0);
+    }
+
+    const boost::multi_array<float, 2> & Y;
+    int n;
+    std::vector<int> order;
+    std::vector<int> scratch;
+    std::vector<Node> nodes;
+
+    void build(int node, int begin, int end, int depth)
+    {
+        nodes[node].count = end - begin;
+        nodes[node].first_child = -1;
+        nodes[node].begin = begin;
+        nodes[node].end = end;
+
+        if (end - begin <= 1 || depth == MAX_DEPTH) {
+            // Leaf; identical points end up together at the maximum depth
+            double com[D] = { 0.0 };
+            for (int e = begin;  e < end;  ++e)
+                for (unsigned k = 0;  k < D;  ++k)
+                    com[k] += Y[order[e]][k];
+            for (unsigned k = 0;  k < D;  ++k)
+                nodes[node].com[k] = (end > begin ? com[k] / (end - begin) : 0.0);
+            return;
+        }
+
+        // Counting sort the points into the cells of the children
+        float center[D];
+        std::copy(nodes[node].center, nodes[node].center + D, center);
+        float width = nodes[node].width;
+
+        int starts[NUM_CHILDREN + 1] = { 0 };
+        for (int e = begin;  e < end;  ++e)
+            ++starts[child_of(order[e], center) + 1];
+        starts[0] = begin;
+        for (unsigned c = 0;  c < NUM_CHILDREN;  ++c)
+            starts[c + 1] += starts[c];
+
+        int pos[NUM_CHILDREN];
+        std::copy(starts, starts + NUM_CHILDREN, pos);
+        for (int e = begin;  e < end;  ++e)
+            scratch[pos[child_of(order[e], center)]++] = order[e];
+        std::copy(scratch.begin() + begin, scratch.begin() + end,
+                  order.begin() + begin);
+
+        int first_child = nodes.size();
+        nodes[node].first_child = first_child;
+
+        for (unsigned c = 0;  c < NUM_CHILDREN;  ++c) {
+            Node child;
+            child.width = 0.5f * width;
+            for (unsigned k = 0;  k < D;  ++k)
+                child.center[k] = center[k]
+                    + ((c & (1 << k)) ? 0.25f : -0.25f) * width;
+            nodes.push_back(child);
+        }
+
+        double com[D] = { 0.0 };
+        for (unsigned c = 0;  c < NUM_CHILDREN;  ++c) {
+            build(first_child + c, starts[c], starts[c + 1], depth + 1);
+            const Node & child = nodes[first_child + c];
+            for (unsigned k = 0;  k < D;  ++k)
+                com[k] += child.count * child.com[k];
+        }
+
+        for (unsigned k = 0;  k < D;  ++k)
+            nodes[node].com[k] = com[k] / (end - begin);
+    }
+
+    int child_of(int i, const float * center) const
+    {
+        int result = 0;
+        for (unsigned k = 0;  k < D;  ++k)
+            result |= (Y[i][k] >= center[k]) << k;
+        return result;
+    }
+
+    /** Accumulate the repulsion on point i,
+            sum_j q_ij^2 Z^2 (y_i - y_j),
+        into neg, and return its part of the normalization,
+            sum_j q_ij Z = sum_j 1 / (1 + ||y_i - y_j||^2).
+    */
+    double repulsion(int i, float theta2, float * neg) const
+    {
+        float yi[D];
+        for (unsigned k = 0;  k < D;  ++k)
+            yi[k] = Y[i][k];
+
+        double sum_q = 0.0;
+        double forces[D] = { 0.0 };
+
+        int stack[MAX_DEPTH * NUM_CHILDREN + 1];
+        int sp = 0;
+        stack[sp++] = 0;
+
+        while (sp) {
+            const Node & node = nodes[stack[--sp]];
+            if (node.count == 0) continue;
+
+            if (node.first_child == -1) {
+                for (int e = node.begin;  e < node.end;  ++e) {
+                    int j = order[e];
+                    if (j == i) continue;
+
+                    float diff[D], d2 = 0.0f;
+                    for (unsigned k = 0;  k < D;  ++k) {
+                        diff[k] = yi[k] - Y[j][k];
+                        d2 += diff[k] * diff[k];
+                    }
+
+                    float q = 1.0f / (1.0f + d2);
+                    sum_q += q;
+                    for (unsigned k = 0;  k < D;  ++k)
+                        forces[k] += q * q * diff[k];
+                }
+                continue;
+            }
+
+            float diff[D], d2 = 0.0f;
+            for (unsigned k = 0;  k < D;  ++k) {
+                diff[k] = yi[k] - node.com[k];
+                d2 += diff[k] * diff[k];
+            }
+
+            if (node.width * node.width < theta2 * d2) {
+                // Far enough away to be treated as a single point
+                float q = 1.0f / (1.0f + d2);
+                sum_q += node.count * q;
+                float mult = node.count * q * q;
+                for (unsigned k = 0;  k < D;  ++k)
+                    forces[k] += mult * diff[k];
+            }
+            else {
+                for (unsigned c = 0;  c < NUM_CHILDREN;  ++c)
+                    stack[sp++] = node.first_child + c;
+            }
+        }
+
+        for (unsigned k = 0;  k < D;  ++k)
+            neg[k] = forces[k];
+
+        return sum_q;
+    }
+};
+
+/** Turn the conditional probabilities p_j|i into the joint probabilities
+    p_ij = (p_j|i + p_i|j) / 2n, keeping the matrix sparse. */
+TSNE_Sparse_Probs
+symmetrize(const TSNE_Sparse_Probs & probs)
+{
+    int n = probs.n;
+
+    if (probs.row_start.size() != n + 1
+        || probs.cols.size() != probs.row_start[n]
+        || probs.vals.size() != probs.cols.size())
+        throw Exception("sparse probabilities were the wrong shape");
+
+    // Row i of P + P' has the entries of row and column i of P
+    std::vector<int> row_start(n + 1, 0);
+    for (unsigned i = 0;  i < n;  ++i) {
+        for (int e = probs.row_start[i];  e < probs.row_start[i + 1];  ++e) {
+            int j = probs.cols[e];
+            if (j < 0 || j >= n)
+                throw Exception("sparse probabilities: column out of range");
+            ++row_start[i + 1];
+            ++row_start[j + 1];
+        }
+    }
+    for (unsigned i = 0;  i < n;  ++i)
+        row_start[i + 1] += row_start[i];
+
+    std::vector<std::pair<int, float> > entries(row_start[n]);
+    std::vector<int> pos(row_start.begin(), row_start.end() - 1);
+    for (unsigned i = 0;  i < n;  ++i) {
+        for (int e = probs.row_start[i];  e < probs.row_start[i + 1];  ++e) {
+            int j = probs.cols[e];
+            entries[pos[i]++] = make_pair(j, probs.vals[e]);
+            entries[pos[j]++] = make_pair(i, probs.vals[e]);
+        }
+    }
+
+    TSNE_Sparse_Probs result;
+    result.n = n;
+    result.row_start.resize(n + 1);
+    result.cols.reserve(entries.size());
+    result.vals.reserve(entries.size());
+
+    double total = 0.0;
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        result.row_start[i] = result.cols.size();
+        std::sort(entries.begin() + row_start[i],
+                  entries.begin() + row_start[i + 1]);
+
+        for (int e = row_start[i];  e < row_start[i + 1];  ++e) {
+            int j = entries[e].first;
+            if (j == i) continue;
+            if (result.cols.size() > result.row_start[i]
+                && result.cols.back() == j)
+                result.vals.back() += entries[e].second;
+            else {
+                result.cols.push_back(j);
+                result.vals.push_back(entries[e].second);
+            }
+            total += entries[e].second;
+        }
+    }
+    result.row_start[n] = result.cols.size();
+
+    if (total <= 0.0)
+        throw Exception("sparse probabilities have no mass");
+
+    float factor = 1.0 / total;
+    for (unsigned e = 0;  e < result.vals.size();  ++e)
+        result.vals[e] *= factor;
+
+    return result;
+}
+
+/** Calculate the gradient of the cost for the embedding Y into dY, and
+    return the cost if calc_cost is set.  P has been symmetrized and is
+    multiplied by pfactor.
+*/
+template<int D>
+double tsne_approx_gradient(boost::multi_array<float, 2> & dY,
+                            const boost::multi_array<float, 2> & Y,
+                            const TSNE_Sparse_Probs & P,
+                            float pfactor,
+                            float theta,
+                            bool calc_cost)
+{
+    // Implements equation 5 in (Van der Maaten, 2014), split into the
+    // attraction (over the sparse P) and the repulsion (over the tree):
+    // dC/dy_i = 4 * (sum_j p_ij q_ij Z (y_i - y_j)
+    //                - sum_j q_ij^2 Z (y_i - y_j))
+
+    boost::timer t;
+
+    int n = Y.shape()[0];
+
+    BH_Tree<D> tree(Y);
+
+    t_D += t.elapsed();  t.restart();
+
+    float theta2 = theta * theta;
+
+    boost::multi_array<float, 2> neg(boost::extents[n][D]);
+    distribution<double> sum_q(n);
+
+    auto calcRows = [&] (int i0, int i1)
+        {
+            for (int i = i0;  i < i1;  ++i) {
+                sum_q[i] = tree.repulsion(i, theta2, &neg[i][0]);
+
+                float pos[D] = { 0.0f };
+                for (int e = P.row_start[i];  e < P.row_start[i + 1];  ++e) {
+                    int j = P.cols[e];
+                    float diff[D], d2 = 0.0f;
+                    for (unsigned k = 0;  k < D;  ++k) {
+                        diff[k] = Y[i][k] - Y[j][k];
+                        d2 += diff[k] * diff[k];
+                    }
+                    float mult = pfactor * P.vals[e] / (1.0f + d2);
+                    for (unsigned k = 0;  k < D;  ++k)
+                        pos[k] += mult * diff[k];
+                }
+
+                for (unsigned k = 0;  k < D;  ++k)
+                    dY[i][k] = pos[k];
+            }
+        };
+
+    run_in_chunks(n, 256, calcRows);
+
+    double Z = sum_q.total();
+    float zfactor = 1.0 / Z;
+
+    for (unsigned i = 0;  i < n;  ++i)
+        for (unsigned k = 0;  k < D;  ++k)
+            dY[i][k] = 4.0f * (dY[i][k] - zfactor * neg[i][k]);
+
+    t_dY += t.elapsed();  t.restart();
+
+    if (!calc_cost) return 0.0;
+
+    // KL divergence over the non-zero p_ij; q_ij = 1 / (1 + d_ij^2) / Z
+    distribution<double> row_costs(n);
+
+    auto costRows = [&] (int i0, int i1)
+        {
+            for (int i = i0;  i < i1;  ++i) {
+                double cost = 0.0;
+                for (int e = P.row_start[i];  e < P.row_start[i + 1];  ++e) {
+                    float p = pfactor * P.vals[e];
+                    if (p <= 0.0f) continue;
+                    int j = P.cols[e];
+                    float d2 = 0.0f;
+                    for (unsigned k = 0;  k < D;  ++k)
+                        d2 += (Y[i][k] - Y[j][k]) * (Y[i][k] - Y[j][k]);
+                    double q = zfactor / (1.0f + d2);
+                    cost += p * log(p / q);
+                }
+                row_costs[i] = cost;
+            }
+        };
+
+    run_in_chunks(n, 256, costRows);
+
+    t_cost += t.elapsed();
+
+    return row_costs.total();
+}
+
+} // file scope
+
+TSNE_Sparse_Probs
+vectors_to_sparse_probabilities(const boost::multi_array<float, 2> & X,
+                                double perplexity,
+                                double tolerance)
+{
+    int n = X.shape()[0];
+    int k = std::min<int>(n - 1, 3 * perplexity);
+
+    if (k < 1)
+        throw Exception("vectors_to_sparse_probabilities: not enough points");
+
+    VP_Tree tree(X);
+
+    TSNE_Sparse_Probs result;
+    result.n = n;
+    result.row_start.resize(n + 1);
+    for (unsigned i = 0;  i <= n;  ++i)
+        result.row_start[i] = i * k;
+    result.cols.resize(n * k);
+    result.vals.resize(n * k);
+
+    auto calcRows = [&] (int i0, int i1)
+        {
+            for (int i = i0;  i < i1;  ++i) {
+                std::vector<std::pair<float, int> > neighbours
+                    = tree.nearest(i, k);
+
+                // Distances are relative to the nearest neighbour, which
+                // doesn't change the probabilities but keeps exp() from
+                // underflowing for far away points
+                float nearest = neighbours[0].first;
+                distribution<float> D_row(k);
+                for (unsigned j = 0;  j < k;  ++j)
+                    D_row[j] = neighbours[j].first * neighbours[j].first
+                        - nearest * nearest;
+
+                distribution<float> P_row;
+                try {
+                    P_row = binary_search_perplexity(D_row, perplexity, -1,
+                                                     tolerance).first;
+                } catch (const std::exception & exc) {
+                    P_row = distribution<float>(k, 1.0 / k);
+                }
+
+                for (unsigned j = 0;  j < k;  ++j) {
+                    result.cols[i * k + j] = neighbours[j].second;
+                    result.vals[i * k + j] = P_row[j];
+                }
+            }
+        };
+
+    run_in_chunks(n, 64, calcRows);
+
+    return result;
+}
+
+boost::multi_array<float, 2>
+tsne_approx(const TSNE_Sparse_Probs & probs,
+            int num_dims,
+            const TSNE_Params & params,
+            const TSNE_Callback & callback)
+{
+    if (num_dims < 1 || num_dims > 3)
+        throw Exception("tsne_approx: num_dims must be 1, 2 or 3");
+
+    // Symmetrize and probabilize P
+    TSNE_Sparse_Probs P = symmetrize(probs);
+
+    int n = P.n;
+    int d = num_dims;
+
+    boost::mt19937 rng;
+    boost::normal_distribution<float> norm;
+
+    boost::variate_generator<boost::mt19937,
+                             boost::normal_distribution<float> >
+        randn(rng, norm);
+
+    boost::multi_array<float, 2> Y(boost::extents[n][d]);
+    for (unsigned i = 0;  i < n;  ++i)
+        for (unsigned j = 0;  j < d;  ++j)
+            Y[i][j] = 0.01 * randn();
+
+    Timer timer;
+
+    boost::multi_array<float, 2> dY(boost::extents[n][d]);
+    boost::multi_array<float, 2> iY(boost::extents[n][d]);
+    boost::multi_array<float, 2> gains(boost::extents[n][d]);
+    std::fill(gains.data(), gains.data() + gains.num_elements(), 1.0f);
+
+    if (callback
+        && !callback(-1, INFINITY, "init")) return Y;
+
+    for (int iter = 0;  iter < params.max_iter;  ++iter) {
+
+        boost::timer t;
+
+        bool calc_cost = (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
+
+        // Exaggerate P in the early iterations to spread the clusters apart
+        float pfactor = (iter <= params.stop_exaggeration_iter
+                         ? params.exaggeration : 1.0);
+
+        double cost = 0.0;
+        switch (d) {
+        case 1:
+            cost = tsne_approx_gradient<1>(dY, Y, P, pfactor, params.theta,
+                                           calc_cost);
+            break;
+        case 2:
+            cost = tsne_approx_gradient<2>(dY, Y, P, pfactor, params.theta,
+                                           calc_cost);
+            break;
+        case 3:
+            cost = tsne_approx_gradient<3>(dY, Y, P, pfactor, params.theta,
+                                           calc_cost);
+            break;
+        }
+
+        if (callback
+            && !callback(iter, INFINITY, "gradient")) return Y;
+
+        t.restart();
+
+        float momentum = (iter < params.momentum_switch_iter
+                          ? params.initial_momentum
+                          : params.final_momentum);
+
+        tsne_update(Y, dY, iY, gains, iter == 0, momentum, params.eta,
+                    params.min_gain);
+
+        if (callback
+            && !callback(iter, INFINITY, "update")) return Y;
+
+        t_update += t.elapsed();  t.restart();
+
+        recenter_about_origin(Y);
+
+        if (callback
+            && !callback(iter, INFINITY, "recenter")) return Y;
+
+        t_recenter += t.elapsed();  t.restart();
+
+        if (calc_cost) {
+            cerr << format("iteration %4d cost %6.3f  ",
+                           iter + 1, cost)
+                 << timer.elapsed() << endl;
+            timer.restart();
         }
     }
 
@@ -18,6 +18,7 @@
 #include "jml/stats/distribution.h"
 #include <boost/multi_array.hpp>
 #include <boost/function.hpp>
+#include <vector>
 
 namespace ML {
 
@@ -100,7 +101,11 @@ struct TSNE_Params {
           final_momentum(0.8),
           eta(500),
           min_gain(0.01),
-          min_prob(1e-12)
+          min_prob(1e-12),
+          momentum_switch_iter(20),
+          exaggeration(4.0),
+          stop_exaggeration_iter(100),
+          theta(0.5)
     {
     }
 
@@ -110,6 +115,16 @@ struct TSNE_Params {
     double eta;
     double min_gain;
     double min_prob;
+    int momentum_switch_iter;    ///< Iteration that final_momentum starts
+    double exaggeration;         ///< Factor for P in the first iterations
+    int stop_exaggeration_iter;  ///< Last iteration with exaggerated P
+
+    /** Accuracy of the Barnes-Hut approximation in tsne_approx().  A cell
+        of the tree is summarized by its centre of mass when its width
+        divided by its distance from the point is less than theta; zero
+        gives the exact (but O(n^2)) gradient.
+    */
+    double theta;
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -130,6 +145,49 @@ tsne(const boost::multi_array<float, 2> & probs,
      const TSNE_Callback & callback = TSNE_Callback());
 
 
+/** Sparse (n x n) matrix of input probabilities in compressed row format:
+    the entries of row i are at [row_start[i], row_start[i + 1]) in cols
+    and vals.
+*/
+struct TSNE_Sparse_Probs {
+    TSNE_Sparse_Probs()
+        : n(0)
+    {
+    }
+
+    int n;
+    std::vector<int> row_start;
+    std::vector<int> cols;
+    std::vector<float> vals;
+
+    size_t nnz() const { return cols.size(); }
+};
+
+/** Approximate version of vectors_to_distances() followed by
+    distances_to_probabilities() that never builds an (n x n) matrix.  The
+    nearest neighbours of each point are found with a vantage-point tree,
+    and only the 3 * perplexity nearest neighbours of each point get a
+    probability, which is calibrated to the given perplexity.  Takes
+    O(n log n) time.
+*/
+TSNE_Sparse_Probs
+vectors_to_sparse_probabilities(const boost::multi_array<float, 2> & X,
+                                double perplexity = 30.0,
+                                double tolerance = 1e-5);
+
+/** Barnes-Hut version of tsne() that works from sparse input
+    probabilities, such as those from vectors_to_sparse_probabilities().
+    Each iteration takes O(n log n) time and memory is linear in the
+    number of points, which makes it usable on hundreds of thousands of
+    points.  The accuracy is controlled by params.theta; num_dims must be
+    1, 2 or 3.
+*/
+boost::multi_array<float, 2>
+tsne_approx(const TSNE_Sparse_Probs & probs,
+            int num_dims = 2,
+            const TSNE_Params & params = TSNE_Params(),
+            const TSNE_Callback & callback = TSNE_Callback());
+
 } // namespace ML
 
 #endif /* __jml__tsne__tsne_h__ */
@@ -0,0 +1,246 @@
+/* arena.h                                                         -*- C++ -*-
+   Copyright (c) 2013 Datacratic.  All rights reserved.
+
+   Region allocator for groups of objects that all die at the same time.
+
+   Memory is carved out of large blocks with a pointer bump and is only ever
+   given back in one go when the arena is destroyed.  The first block lives
+   inside the arena object itself so that an arena embedded in another object
+   doesn't cost any extra call to malloc until that first block is exhausted.
+*/
+
+#ifndef __jml__utils__arena_h__
+#define __jml__utils__arena_h__
+
+#include "jml/arch/spinlock.h"
+#include "jml/arch/exception.h"
+#include "jml/compiler/compiler.h"
+
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* ARENA                                                                     */
+/*****************************************************************************/
+
+/** Thread-safe bump allocator.  Objects created through create() have their
+    destructor run, in reverse order of creation, when the arena goes away;
+    raw memory from allocate() is simply dropped.
+
+    Individual deallocation is not supported and there is no way to reuse
+    memory before the arena is destroyed so this is only a good fit for
+    short-lived object graphs like the ones attached to a single auction.
+*/
+template<size_t InlineSize = 1024>
+struct ArenaT {
+
+    /// Default alignment; enough for any scalar type including SSE vectors.
+    static constexpr size_t MaxAlign = 16;
+
+    explicit ArenaT(size_t blockSize = 16 * 1024)
+        : blockSize(blockSize), blocks(0), dtors(0),
+          current(inlineBlock), end(inlineBlock + InlineSize),
+          bytesUsed_(0)
+    {
+    }
+
+    ~ArenaT()
+    {
+        for (Dtor * d = dtors;  d;  d = d->next)
+            d->destroy(d->object);
+
+        while (blocks) {
+            Block * next = blocks->next;
+            std::free(blocks);
+            blocks = next;
+        }
+    }
+
+    ArenaT(const ArenaT &) = delete;
+    ArenaT & operator = (const ArenaT &) = delete;
+
+    /** Return size bytes of memory aligned on align, which must be a power of
+        two.  The memory is valid until the arena is destroyed.
+    */
+    void * allocate(size_t size, size_t align = MaxAlign)
+    {
+        std::lock_guard<Spinlock> guard(lock);
+        return allocateUnlocked(size, align);
+    }
+
+    /** Construct a T inside the arena.  Its destructor will be called when
+        the arena is destroyed.
+    */
+    template<typename T, typename... Args>
+    T * create(Args && ... args)
+    {
+        std::lock_guard<Spinlock> guard(lock);
+
+        void * mem = allocateUnlocked(sizeof(T), alignof(T));
+        T * result = new (mem) T(std::forward<Args>(args)...);
+
+        if (!__has_trivial_destructor(T)) {
+            Dtor * d = (Dtor *)allocateUnlocked(sizeof(Dtor), alignof(Dtor));
+            d->object = result;
+            d->destroy = &destroyObject<T>;
+            d->next = dtors;
+            dtors = d;
+        }
+
+        return result;
+    }
+
+    /** Number of bytes handed out so far. */
+    size_t bytesUsed() const { return bytesUsed_; }
+
+private:
+    struct Block {
+        Block * next;
+    };
+
+    struct Dtor {
+        void * object;
+        void (*destroy) (void *);
+        Dtor * next;
+    };
+
+    template<typename T>
+    static void destroyObject(void * object)
+    {
+        static_cast<T *>(object)->~T();
+    }
+
+    void * allocateUnlocked(size_t size, size_t align)
+    {
+        char * p = alignUp(current, align);
+
+        if (JML_UNLIKELY(p + size > end)) {
+            newBlock(size + align);
+            p = alignUp(current, align);
+        }
+
+        current = p + size;
+        bytesUsed_ += size;
+        return p;
+    }
+
+    void newBlock(size_t minSize)
+    {
+        size_t size = std::max(blockSize, minSize + sizeof(Block));
+
+        Block * block = (Block *)std::malloc(size);
+        if (!block) throw Exception("arena: out of memory");
+
+        block->next = blocks;
+        blocks = block;
+
+        current = (char *)(block + 1);
+        end = (char *)block + size;
+    }
+
+    static char * alignUp(char * p, size_t align)
+    {
+        return (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    size_t blockSize;
+    Block * blocks;
+    Dtor * dtors;
+    char * current;
+    char * end;
+    size_t bytesUsed_;
+    Spinlock lock;
+
+    char inlineBlock[InlineSize] JML_ALIGNED(16);
+};
+
+typedef ArenaT<> Arena;
+
+
+/*****************************************************************************/
+/* ARENA ALLOCATOR                                                           */
+/*****************************************************************************/
+
+/** Standard allocator that draws its memory from an arena.  deallocate() is a
+    no-op; the memory is reclaimed when the arena is destroyed, which must
+    therefore outlive every container using this allocator.
+*/
+template<typename T, typename ArenaType = Arena>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef T * pointer;
+    typedef const T * const_pointer;
+    typedef T & reference;
+    typedef const T & const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind {
+        typedef ArenaAllocator<U, ArenaType> other;
+    };
+
+    explicit ArenaAllocator(ArenaType & arena)
+        : arena(&arena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U, ArenaType> & other)
+        : arena(other.arena)
+    {
+    }
+
+    T * allocate(size_t n, const void * = 0)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t)
+    {
+    }
+
+    template<typename U, typename... Args>
+    void construct(U * p, Args && ... args)
+    {
+        new (p) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    void destroy(U * p)
+    {
+        p->~U();
+    }
+
+    size_t max_size() const
+    {
+        return size_t(-1) / sizeof(T);
+    }
+
+    template<typename U>
+    bool operator == (const ArenaAllocator<U, ArenaType> & other) const
+    {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator != (const ArenaAllocator<U, ArenaType> & other) const
+    {
+        return arena != other.arena;
+    }
+
+    ArenaType * arena;
+};
+
+} // namespace ML
+
+#endif /* __jml__utils__arena_h__ */
@@ -0,0 +1,231 @@
+/* compact_map.h                                                   -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Map stored as a sorted compact_vector of pairs.
+*/
+
+#pragma once
+
+#include "jml/utils/compact_vector.h"
+#include "jml/db/persistent_fwd.h"
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPACT MAP                                                               */
+/*****************************************************************************/
+
+/** Map with the interface of std::map that keeps its entries sorted in a
+    compact_vector.  Up to Internal entries are stored inline in the object
+    itself, so that a map with a handful of entries costs no allocation at
+    all and lookups are a binary search over adjacent memory.
+
+    Inserting and erasing are linear in the size of the map; this is only
+    meant for the small maps that hang off every bid request.
+
+    Unlike std::map, inserting or erasing invalidates iterators, pointers
+    and references to the entries.  The keys must not be modified through
+    the iterators.
+*/
+
+template<typename Key, typename Value,
+         size_t Internal = 4,
+         typename Compare = std::less<Key> >
+struct compact_map {
+
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+    typedef compact_vector<value_type, Internal> base_type;
+    typedef typename base_type::iterator iterator;
+    typedef typename base_type::const_iterator const_iterator;
+    typedef size_t size_type;
+
+    compact_map()
+    {
+    }
+
+    template<typename Iterator>
+    compact_map(Iterator first, Iterator last)
+    {
+        insert(first, last);
+    }
+
+    compact_map(std::initializer_list<value_type> list)
+    {
+        insert(list.begin(), list.end());
+    }
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    const_iterator cbegin() const { return entries.begin(); }
+    const_iterator cend() const { return entries.end(); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    void clear() { entries.clear(); }
+    void reserve(size_t capacity) { entries.reserve(capacity); }
+
+    void swap(compact_map & other) { entries.swap(other.entries); }
+
+    iterator lower_bound(const Key & key)
+    {
+        return std::lower_bound(begin(), end(), key, KeyCompare());
+    }
+
+    const_iterator lower_bound(const Key & key) const
+    {
+        return std::lower_bound(begin(), end(), key, KeyCompare());
+    }
+
+    iterator find(const Key & key)
+    {
+        iterator it = lower_bound(key);
+        return it != end() && !Compare()(key, it->first) ? it : end();
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        const_iterator it = lower_bound(key);
+        return it != end() && !Compare()(key, it->first) ? it : end();
+    }
+
+    size_t count(const Key & key) const
+    {
+        return find(key) != end();
+    }
+
+    Value & at(const Key & key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            throw Exception("compact_map::at(): key not found");
+        return it->second;
+    }
+
+    const Value & at(const Key & key) const
+    {
+        const_iterator it = find(key);
+        if (it == end())
+            throw Exception("compact_map::at(): key not found");
+        return it->second;
+    }
+
+    Value & operator [] (const Key & key)
+    {
+        iterator it = lower_bound(key);
+        if (it == end() || Compare()(key, it->first))
+            it = entries.emplace(it, key, Value());
+        return it->second;
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(const Key & key, Args&&... args)
+    {
+        iterator it = lower_bound(key);
+        if (it != end() && !Compare()(key, it->first))
+            return std::make_pair(it, false);
+        it = entries.emplace(it, key, Value(std::forward<Args>(args)...));
+        return std::make_pair(it, true);
+    }
+
+    std::pair<iterator, bool> insert(const value_type & value)
+    {
+        return emplace(value.first, value.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type && value)
+    {
+        return emplace(value.first, std::move(value.second));
+    }
+
+    template<typename Iterator>
+    void insert(Iterator first, Iterator last)
+    {
+        for (;  first != last;  ++first)
+            insert(*first);
+    }
+
+    iterator erase(iterator it)
+    {
+        return entries.erase(it);
+    }
+
+    size_t erase(const Key & key)
+    {
+        iterator it = find(key);
+        if (it == end()) return 0;
+        entries.erase(it);
+        return 1;
+    }
+
+    bool operator == (const compact_map & other) const
+    {
+        return entries == other.entries;
+    }
+
+    bool operator != (const compact_map & other) const
+    {
+        return !operator == (other);
+    }
+
+    /** Same format as the serialization of a std::map, so that the two can
+        be used interchangeably in stored data.
+    */
+    void serialize(DB::Store_Writer & store) const
+    {
+        DB::serialize_compact_size(store, size());
+        for (auto & entry: entries)
+            store << entry.first << entry.second;
+    }
+
+    void reconstitute(DB::Store_Reader & store)
+    {
+        compact_map result;
+        unsigned long long sz = DB::reconstitute_compact_size(store);
+        for (unsigned i = 0;  i < sz;  ++i) {
+            Key key;
+            Value value;
+            store >> key >> value;
+            result.emplace(key, std::move(value));
+        }
+        swap(result);
+    }
+
+private:
+    struct KeyCompare {
+        bool operator () (const value_type & entry, const Key & key) const
+        {
+            return Compare()(entry.first, key);
+        }
+    };
+
+    base_type entries;
+};
+
+template<typename K, typename V, size_t I, typename C>
+inline DB::Store_Writer &
+operator << (DB::Store_Writer & store, const compact_map<K, V, I, C> & m)
+{
+    m.serialize(store);
+    return store;
+}
+
+template<typename K, typename V, size_t I, typename C>
+inline DB::Store_Reader &
+operator >> (DB::Store_Reader & store, compact_map<K, V, I, C> & m)
+{
+    m.reconstitute(store);
+    return store;
+}
+
+} // namespace ML
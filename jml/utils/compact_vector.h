@@ -328,7 +328,7 @@ public:
     {
         iterator result = start_insert(pos, 1);
 
-        *result = Data(std::forward<Data>(args)...);
+        *result = Data(std::forward<Args>(args)...);
 
         return result;
     }
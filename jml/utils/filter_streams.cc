@@ -530,6 +530,34 @@ open(const std::string & uri,
     openFromStreambuf(buf, weOwnBuf, resource, compression);
 }
 
+void
+filter_istream::
+open(const std::string & uri,
+     const std::map<std::string, std::string> & options)
+{
+    exceptions(ios::badbit);
+
+    string scheme, resource;
+    std::tie(scheme, resource) = getScheme(uri);
+
+    std::map<std::string, std::string> handlerOptions = options;
+    handlerOptions["mode"] = "in";
+
+    string compression;
+    auto it = options.find("compression");
+    if (it != options.end())
+        compression = it->second;
+
+    const auto & handler = getUriHandler(scheme);
+    std::streambuf * buf;
+    bool weOwnBuf;
+    auto onException = [&]() { this->deferredFailure = true; };
+    std::tie(buf, weOwnBuf) = handler(scheme, resource, ios_base::in,
+                                      handlerOptions, onException);
+
+    openFromStreambuf(buf, weOwnBuf, resource, compression);
+}
+
 void
 filter_istream::
 openFromStreambuf(std::streambuf * buf,
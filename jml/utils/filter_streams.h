@@ -146,6 +146,14 @@ public:
               std::ios_base::openmode mode = std::ios_base::in,
               const std::string & comparession = "");
 
+    /** Open with the given options, which are passed to the handler of
+        the uri scheme; for example, s3:// takes num-threads, chunk-size,
+        read-ahead and range-retries.  Options understood here:
+        compression = string (gz, bz2, xz, ...)
+    */
+    void open(const std::string & uri,
+              const std::map<std::string, std::string> & options);
+
     void openFromStreambuf(std::streambuf * buf,
                            bool weOwnBuf,
                            const std::string & resource = "",
@@ -0,0 +1,485 @@
+/* flat_hash_map.h                                                 -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Open addressing hash map with SIMD probing of groups of slots.
+*/
+
+#pragma once
+
+#include "jml/arch/exception.h"
+#include "jml/compiler/compiler.h"
+#include "jml/utils/exc_assert.h"
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* FLAT HASH MAP                                                             */
+/*****************************************************************************/
+
+/** Hash map storing its entries inline in a single array of slots, in the
+    style of the "Swiss tables".
+
+    Each slot has a control byte which is either Empty or holds 7 bits of
+    the hash of its key.  A lookup loads the 16 control bytes from the home
+    slot of the key, compares them all at once against the 7 bits of its
+    hash and only looks at the slots that match, which is almost always just
+    the right one.  A lookup thus normally touches one cache line of control
+    bytes and one of slots.
+
+    Collisions are resolved by linear probing, which lets erase shift the
+    following entries back instead of leaving tombstones: the table never
+    degrades with churn and never needs to be rebuilt to clean up.
+
+    Unlike std::unordered_map, inserting or erasing invalidates iterators,
+    pointers and references to the entries.  The keys must not be modified
+    through the iterators.
+*/
+
+template<typename Key, typename Value,
+         typename Hash = std::hash<Key>,
+         typename Equal = std::equal_to<Key> >
+struct Flat_Hash_Map {
+
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+    typedef size_t size_type;
+
+    Flat_Hash_Map()
+        : ctrl_(0), slots_(0), capacity_(0), size_(0)
+    {
+    }
+
+    explicit Flat_Hash_Map(size_t capacity)
+        : Flat_Hash_Map()
+    {
+        reserve(capacity);
+    }
+
+    Flat_Hash_Map(const Flat_Hash_Map & other)
+        : Flat_Hash_Map()
+    {
+        reserve(other.size());
+        for (auto & entry: other)
+            insertUnique(value_type(entry));
+    }
+
+    Flat_Hash_Map(Flat_Hash_Map && other) noexcept
+        : Flat_Hash_Map()
+    {
+        swap(other);
+    }
+
+    Flat_Hash_Map & operator = (Flat_Hash_Map other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~Flat_Hash_Map()
+    {
+        destroy();
+    }
+
+    void swap(Flat_Hash_Map & other) noexcept
+    {
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+    }
+
+
+    /* ITERATORS */
+
+    template<typename MapT, typename V>
+    struct Iterator
+        : public std::iterator<std::forward_iterator_tag, V> {
+
+        Iterator()
+            : map(0), index(0)
+        {
+        }
+
+        Iterator(MapT * map, size_t index)
+            : map(map), index(index)
+        {
+            skip();
+        }
+
+        template<typename M2, typename V2>
+        Iterator(const Iterator<M2, V2> & other)
+            : map(other.map), index(other.index)
+        {
+        }
+
+        V & operator * () const { return map->slots_[index]; }
+        V * operator -> () const { return &map->slots_[index]; }
+
+        Iterator & operator ++ ()
+        {
+            ++index;
+            skip();
+            return *this;
+        }
+
+        Iterator operator ++ (int)
+        {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        template<typename M2, typename V2>
+        bool operator == (const Iterator<M2, V2> & other) const
+        {
+            return index == other.index;
+        }
+
+        template<typename M2, typename V2>
+        bool operator != (const Iterator<M2, V2> & other) const
+        {
+            return index != other.index;
+        }
+
+        MapT * map;
+        size_t index;
+
+    private:
+        void skip()
+        {
+            while (index < map->capacity_ && map->ctrl_[index] == Empty)
+                ++index;
+        }
+    };
+
+    typedef Iterator<Flat_Hash_Map, value_type> iterator;
+    typedef Iterator<const Flat_Hash_Map, const value_type> const_iterator;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, capacity_); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, capacity_); }
+
+
+    /* CAPACITY */
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    /** Make room for the given number of entries without rehashing. */
+    void reserve(size_t entries)
+    {
+        size_t capacity = GroupSize;
+        while (entries > maxLoad(capacity))
+            capacity *= 2;
+        if (capacity > capacity_)
+            rehash(capacity);
+    }
+
+    void clear()
+    {
+        destroy();
+        ctrl_ = 0;
+        slots_ = 0;
+        capacity_ = size_ = 0;
+    }
+
+
+    /* LOOKUP */
+
+    iterator find(const Key & key)
+    {
+        return iterator(this, findIndex(key));
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        return const_iterator(this, findIndex(key));
+    }
+
+    size_t count(const Key & key) const
+    {
+        return findIndex(key) != capacity_;
+    }
+
+    Value & at(const Key & key)
+    {
+        size_t index = findIndex(key);
+        if (index == capacity_)
+            throw Exception("Flat_Hash_Map::at(): key not found");
+        return slots_[index].second;
+    }
+
+    const Value & at(const Key & key) const
+    {
+        size_t index = findIndex(key);
+        if (index == capacity_)
+            throw Exception("Flat_Hash_Map::at(): key not found");
+        return slots_[index].second;
+    }
+
+
+    /* MODIFIERS */
+
+    Value & operator [] (const Key & key)
+    {
+        return emplace(key).first->second;
+    }
+
+    std::pair<iterator, bool> insert(const value_type & entry)
+    {
+        return emplace(entry.first, entry.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type && entry)
+    {
+        return emplace(std::move(entry.first), std::move(entry.second));
+    }
+
+    /** Insert the key with the value unless it's already there.  The value
+        is only constructed if it's inserted. */
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplace(K && key, Args &&... args)
+    {
+        uint64_t hash = hashOf(key);
+        size_t index = findIndex(key, hash);
+        if (index != capacity_)
+            return std::make_pair(iterator(this, index), false);
+
+        if (size_ + 1 > maxLoad(capacity_))
+            rehash(capacity_ ? capacity_ * 2 : GroupSize);
+
+        index = findEmpty(hash);
+        new (&slots_[index])
+            value_type(std::piecewise_construct,
+                       std::forward_as_tuple(std::forward<K>(key)),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+        setCtrl(index, tagOf(hash));
+        ++size_;
+
+        return std::make_pair(iterator(this, index), true);
+    }
+
+    size_t erase(const Key & key)
+    {
+        size_t index = findIndex(key);
+        if (index == capacity_) return 0;
+        eraseIndex(index);
+        return 1;
+    }
+
+    /** Erase the entry.  The entries that follow may be moved, so all
+        iterators are invalidated. */
+    void erase(const_iterator it)
+    {
+        ExcAssert(it.index < capacity_ && ctrl_[it.index] != Empty);
+        eraseIndex(it.index);
+    }
+
+private:
+    enum { GroupSize = 16 };
+
+    /** Control byte of an empty slot.  Full slots hold 7 bits of the hash,
+        so their sign bit is never set. */
+    static constexpr int8_t Empty = -128;
+
+    static size_t maxLoad(size_t capacity)
+    {
+        // Linear probing degrades quickly above this
+        return capacity - capacity / 4;
+    }
+
+    uint64_t hashOf(const Key & key) const
+    {
+        // Spread the bits of weak hashes, such as the identity for integers,
+        // over the whole word; the tag comes from the low 7 bits and the home
+        // slot from the rest.
+        __uint128_t product = (__uint128_t)Hash()(key) * 0x9e3779b97f4a7c15ULL;
+        return uint64_t(product) ^ uint64_t(product >> 64);
+    }
+
+    static int8_t tagOf(uint64_t hash)
+    {
+        return hash & 0x7f;
+    }
+
+    size_t homeOf(uint64_t hash) const
+    {
+        return (hash >> 7) & (capacity_ - 1);
+    }
+
+    /** Bit masks of the slots of the group starting at pos whose control
+        byte matches. */
+    struct Group {
+        Group(const int8_t * ctrl)
+        {
+#if defined(__SSE2__)
+            bytes = _mm_loadu_si128((const __m128i *)ctrl);
+#else
+            memcpy(bytes, ctrl, GroupSize);
+#endif
+        }
+
+        uint32_t match(int8_t tag) const
+        {
+#if defined(__SSE2__)
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag)));
+#else
+            uint32_t result = 0;
+            for (unsigned i = 0;  i < GroupSize;  ++i)
+                result |= uint32_t(bytes[i] == tag) << i;
+            return result;
+#endif
+        }
+
+        uint32_t matchEmpty() const
+        {
+#if defined(__SSE2__)
+            // Empty is the only control byte with the sign bit set
+            return _mm_movemask_epi8(bytes);
+#else
+            return match(Empty);
+#endif
+        }
+
+#if defined(__SSE2__)
+        __m128i bytes;
+#else
+        int8_t bytes[GroupSize];
+#endif
+    };
+
+    size_t findIndex(const Key & key) const
+    {
+        if (!size_) return capacity_;
+        return findIndex(key, hashOf(key));
+    }
+
+    /** Index of the key, or capacity_ if it's not there.  By the linear
+        probing invariant there is no empty slot between the home slot of a
+        key and the key, so the first group with an empty slot is the last
+        one to look at. */
+    size_t findIndex(const Key & key, uint64_t hash) const
+    {
+        if (!capacity_) return capacity_;
+
+        int8_t tag = tagOf(hash);
+        size_t mask = capacity_ - 1;
+
+        for (size_t pos = homeOf(hash); ;  pos = (pos + GroupSize) & mask) {
+            Group group(ctrl_ + pos);
+            for (uint32_t m = group.match(tag);  m;  m &= m - 1) {
+                size_t index = (pos + __builtin_ctz(m)) & mask;
+                if (JML_LIKELY(Equal()(slots_[index].first, key)))
+                    return index;
+            }
+            if (JML_LIKELY(group.matchEmpty()))
+                return capacity_;
+        }
+    }
+
+    /** First empty slot at or after the home slot of the hash. */
+    size_t findEmpty(uint64_t hash) const
+    {
+        size_t mask = capacity_ - 1;
+        for (size_t pos = homeOf(hash); ;  pos = (pos + GroupSize) & mask) {
+            uint32_t empty = Group(ctrl_ + pos).matchEmpty();
+            if (empty)
+                return (pos + __builtin_ctz(empty)) & mask;
+        }
+    }
+
+    /** The control bytes of the first group are repeated after the last
+        slot so that a group can be loaded from any slot. */
+    void setCtrl(size_t index, int8_t value)
+    {
+        ctrl_[index] = value;
+        if (index < GroupSize)
+            ctrl_[capacity_ + index] = value;
+    }
+
+    void eraseIndex(size_t hole)
+    {
+        slots_[hole].~value_type();
+        --size_;
+
+        // Move back the entries of the probe sequence that can now be found
+        // earlier, so that there is never a gap between an entry and its
+        // home slot.
+        size_t mask = capacity_ - 1;
+        for (size_t next = (hole + 1) & mask;  ctrl_[next] != Empty;
+             next = (next + 1) & mask) {
+            size_t home = homeOf(hashOf(slots_[next].first));
+
+            bool movable = hole <= next
+                ? (home <= hole || home > next)
+                : (home <= hole && home > next);
+            if (!movable) continue;
+
+            new (&slots_[hole]) value_type(std::move(slots_[next]));
+            slots_[next].~value_type();
+            setCtrl(hole, ctrl_[next]);
+            hole = next;
+        }
+
+        setCtrl(hole, Empty);
+    }
+
+    /** Insert an entry known not to be there, with enough room. */
+    void insertUnique(value_type && entry)
+    {
+        uint64_t hash = hashOf(entry.first);
+        size_t index = findEmpty(hash);
+        new (&slots_[index]) value_type(std::move(entry));
+        setCtrl(index, tagOf(hash));
+        ++size_;
+    }
+
+    void rehash(size_t capacity)
+    {
+        Flat_Hash_Map old;
+        swap(old);
+
+        ctrl_ = new int8_t[capacity + GroupSize];
+        memset(ctrl_, Empty, capacity + GroupSize);
+        slots_ = std::allocator<value_type>().allocate(capacity);
+        capacity_ = capacity;
+
+        for (size_t i = 0;  i < old.capacity_;  ++i) {
+            if (old.ctrl_[i] == Empty) continue;
+            insertUnique(std::move(old.slots_[i]));
+        }
+    }
+
+    void destroy()
+    {
+        if (!ctrl_) return;
+        for (size_t i = 0;  i < capacity_;  ++i)
+            if (ctrl_[i] != Empty)
+                slots_[i].~value_type();
+        std::allocator<value_type>().deallocate(slots_, capacity_);
+        delete[] ctrl_;
+    }
+
+    int8_t * ctrl_;            ///< capacity_ + GroupSize control bytes
+    value_type * slots_;
+    size_t capacity_;          ///< Power of two, at least GroupSize
+    size_t size_;
+};
+
+} // namespace ML
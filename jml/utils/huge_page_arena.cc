@@ -0,0 +1,359 @@
+/* huge_page_arena.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Size-class allocator backed by huge pages.
+*/
+
+#include "huge_page_arena.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <iostream>
+
+#ifndef MAP_HUGE_SHIFT
+#  define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef MAP_HUGE_1GB
+#  define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HUGE PAGES                                                                */
+/*****************************************************************************/
+
+std::string print(HugePageMode mode)
+{
+    switch (mode) {
+    case HUGE_PAGES_1GB:         return "1gb";
+    case HUGE_PAGES_2MB:         return "2mb";
+    case HUGE_PAGES_TRANSPARENT: return "transparent";
+    case HUGE_PAGES_NONE:        return "none";
+    default:
+        return format("HugePageMode(%d)", mode);
+    }
+}
+
+HugePageMode parseHugePageMode(const std::string & mode)
+{
+    if (mode == "1gb")         return HUGE_PAGES_1GB;
+    if (mode == "2mb")         return HUGE_PAGES_2MB;
+    if (mode == "transparent") return HUGE_PAGES_TRANSPARENT;
+    if (mode == "none")        return HUGE_PAGES_NONE;
+    throw Exception("unknown huge page mode " + mode);
+}
+
+size_t hugePageSize(HugePageMode mode)
+{
+    switch (mode) {
+    case HUGE_PAGES_1GB: return 1024 * 1024 * 1024;
+    case HUGE_PAGES_2MB:
+    case HUGE_PAGES_TRANSPARENT: return 2 * 1024 * 1024;
+    default: return 4096;
+    }
+}
+
+namespace {
+
+size_t roundUp(size_t size, size_t pageSize)
+{
+    return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+void * tryMap(size_t size, HugePageMode mode)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    switch (mode) {
+    case HUGE_PAGES_1GB:
+        flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+        break;
+    case HUGE_PAGES_2MB:
+        flags |= MAP_HUGETLB;
+        break;
+
+    case HUGE_PAGES_TRANSPARENT: {
+        // Over-map so that the region can be trimmed to a 2MB boundary,
+        // which is what lets khugepaged back it with huge pages.
+        size_t align = hugePageSize(mode);
+        char * mem = (char *)mmap(0, size + align, PROT_READ | PROT_WRITE,
+                                  flags, -1, 0);
+        if (mem == MAP_FAILED)
+            return 0;
+
+        char * aligned = (char *)roundUp((uintptr_t)mem, align);
+        if (aligned != mem)
+            munmap(mem, aligned - mem);
+        size_t tail = (mem + size + align) - (aligned + size);
+        if (tail)
+            munmap(aligned + size, tail);
+
+        if (madvise(aligned, size, MADV_HUGEPAGE) == -1) {
+            munmap(aligned, size);
+            return 0;
+        }
+        return aligned;
+    }
+
+    default:
+        break;
+    }
+
+    void * mem = mmap(0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return mem == MAP_FAILED ? 0 : mem;
+}
+
+} // file scope
+
+void * mapHugePages(size_t & size, HugePageMode & mode)
+{
+    for (int m = mode;  m <= HUGE_PAGES_NONE;  ++m) {
+        size_t mappedSize = roundUp(size, hugePageSize((HugePageMode)m));
+        void * mem = tryMap(mappedSize, (HugePageMode)m);
+        if (mem) {
+            size = mappedSize;
+            mode = (HugePageMode)m;
+            return mem;
+        }
+    }
+
+    throw Exception(errno, format("mapping %zd bytes", size));
+}
+
+void unmapHugePages(void * mem, size_t size)
+{
+    if (munmap(mem, size) == -1)
+        throw Exception(errno, "munmap");
+}
+
+
+/*****************************************************************************/
+/* HUGE PAGE ARENA                                                           */
+/*****************************************************************************/
+
+HugePageArena::
+HugePageArena(HugePageMode mode, size_t chunkSize)
+    : mode(mode),
+      chunkSize(roundUp(std::max<size_t>(chunkSize, SlabSize),
+                        hugePageSize(mode))),
+      chunkCurrent(0), chunkEnd(0),
+      mappedBytes(0), hugeMappedBytes(0), fallbacks(0), slabBytes(0),
+      allocatedBytes(0), largeAllocations(0)
+{
+}
+
+HugePageArena::
+~HugePageArena()
+{
+    for (const Chunk & chunk : chunks)
+        munmap(chunk.mem, chunk.size);
+    for (const auto & mapping : largeMappings)
+        munmap(mapping.second.mem, mapping.second.size);
+}
+
+unsigned
+HugePageArena::
+sizeClass(size_t size, size_t align)
+{
+    // Past 16 bytes only the power of two classes are aligned on more than
+    // their largest power of two factor, so big alignments round up to them.
+    if (align > 16) {
+        size = std::max(size, align);
+        size = size_t(1) << (64 - __builtin_clzl(size - 1));
+    }
+
+    if (size <= MinSize)
+        return 0;
+
+    // 2^b < size <= 2^(b + 1); classes are 3 * 2^(b - 1) and 2^(b + 1)
+    unsigned b = 63 - __builtin_clzl(size - 1);
+    if (size <= (size_t(3) << (b - 1)))
+        return 2 * (b - 4) + 1;
+    return 2 * (b - 4) + 2;
+}
+
+size_t
+HugePageArena::
+classSize(unsigned sizeClass)
+{
+    if (sizeClass == 0)
+        return MinSize;
+    unsigned b = (sizeClass - 1) / 2 + 4;
+    return sizeClass % 2 ? size_t(3) << (b - 1) : size_t(2) << b;
+}
+
+void *
+HugePageArena::
+allocate(size_t size, size_t align)
+{
+    unsigned c = sizeClass(size, align);
+
+    if (JML_UNLIKELY(c >= NumClasses)) {
+        // Only use huge pages when the allocation can fill one.
+        HugePageMode largeMode = mode;
+        while (largeMode < HUGE_PAGES_NONE && size < hugePageSize(largeMode))
+            largeMode = (HugePageMode)(largeMode + 1);
+
+        size_t mappedSize = size;
+        HugePageMode actualMode = largeMode;
+        void * mem = mapHugePages(mappedSize, actualMode);
+
+        Chunk mapping { mem, mappedSize, actualMode };
+
+        std::lock_guard<std::mutex> guard(chunkLock);
+        largeMappings[mem] = mapping;
+        recordMapping(mapping, 1);
+        ++largeAllocations;
+        return mem;
+    }
+
+    SizeClass & sc = classes[c];
+    size_t bytes = classSize(c);
+
+    {
+        std::lock_guard<Spinlock> guard(sc.lock);
+
+        if (sc.freeList) {
+            FreeBlock * block = sc.freeList;
+            sc.freeList = block->next;
+            allocatedBytes += bytes;
+            return block;
+        }
+
+        if (sc.current + bytes <= sc.end) {
+            void * result = sc.current;
+            sc.current += bytes;
+            allocatedBytes += bytes;
+            return result;
+        }
+    }
+
+    // Get the slab without holding the class lock, then start on it unless
+    // another thread got there first, in which case it goes to waste.
+    char * slab = newSlab();
+
+    std::lock_guard<Spinlock> guard(sc.lock);
+    if (sc.current + bytes > sc.end) {
+        sc.current = slab;
+        sc.end = slab + SlabSize;
+    }
+
+    void * result = sc.current;
+    sc.current += bytes;
+    allocatedBytes += bytes;
+    return result;
+}
+
+void
+HugePageArena::
+deallocate(void * mem, size_t size, size_t align)
+{
+    if (!mem)
+        return;
+
+    unsigned c = sizeClass(size, align);
+
+    if (JML_UNLIKELY(c >= NumClasses)) {
+        Chunk mapping;
+        {
+            std::lock_guard<std::mutex> guard(chunkLock);
+            auto it = largeMappings.find(mem);
+            if (it == largeMappings.end())
+                throw Exception("HugePageArena: deallocating unknown block");
+            mapping = it->second;
+            largeMappings.erase(it);
+            recordMapping(mapping, -1);
+            --largeAllocations;
+        }
+        unmapHugePages(mapping.mem, mapping.size);
+        return;
+    }
+
+    SizeClass & sc = classes[c];
+    FreeBlock * block = static_cast<FreeBlock *>(mem);
+
+    std::lock_guard<Spinlock> guard(sc.lock);
+    block->next = sc.freeList;
+    sc.freeList = block;
+    allocatedBytes -= classSize(c);
+}
+
+char *
+HugePageArena::
+newSlab()
+{
+    std::lock_guard<std::mutex> guard(chunkLock);
+
+    if (chunkCurrent + SlabSize > chunkEnd) {
+        size_t size = chunkSize;
+        HugePageMode actualMode = mode;
+        void * mem = mapHugePages(size, actualMode);
+
+        chunks.push_back(Chunk { mem, size, actualMode });
+        recordMapping(chunks.back(), 1);
+
+        chunkCurrent = (char *)mem;
+        chunkEnd = chunkCurrent + size;
+    }
+
+    char * result = chunkCurrent;
+    chunkCurrent += SlabSize;
+    slabBytes += SlabSize;
+    return result;
+}
+
+void
+HugePageArena::
+recordMapping(const Chunk & chunk, int direction)
+{
+    mappedBytes += direction * chunk.size;
+    if (chunk.mode != HUGE_PAGES_NONE)
+        hugeMappedBytes += direction * chunk.size;
+
+    // Large allocations too small for the huge pages don't count as fallbacks.
+    if (direction > 0 && chunk.mode != mode
+        && chunk.size >= hugePageSize(mode)) {
+        if (fallbacks++ == 0)
+            cerr << "HugePageArena: " << print(mode)
+                 << " pages unavailable; using " << print(chunk.mode) << endl;
+    }
+}
+
+HugePageArena::Stats
+HugePageArena::
+stats() const
+{
+    Stats result;
+    result.requestedMode = mode;
+    result.mappedBytes = mappedBytes;
+    result.hugeMappedBytes = hugeMappedBytes;
+    result.fallbacks = fallbacks;
+    result.slabBytes = slabBytes;
+    result.allocatedBytes = allocatedBytes;
+    result.largeAllocations = largeAllocations;
+    return result;
+}
+
+HugePageArena & defaultHugePageArena()
+{
+    static HugePageArena * arena = [] () {
+        const char * mode = getenv("HUGE_PAGE_ARENA_MODE");
+        return new HugePageArena(mode ? parseHugePageMode(mode)
+                                      : HUGE_PAGES_TRANSPARENT);
+    } ();
+
+    // Never destroyed, as containers using it may outlive static destruction.
+    return *arena;
+}
+
+} // namespace ML
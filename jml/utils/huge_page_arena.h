@@ -0,0 +1,257 @@
+/* huge_page_arena.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Size-class allocator backed by huge pages, for the large tables that live
+   as long as the process.
+*/
+
+#ifndef __jml__utils__huge_page_arena_h__
+#define __jml__utils__huge_page_arena_h__
+
+#include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HUGE PAGES                                                                */
+/*****************************************************************************/
+
+/** How memory is backed, from the most to the least demanding.  Each mode
+    falls back on the next one when the kernel can't provide it.
+*/
+enum HugePageMode {
+    HUGE_PAGES_1GB,          ///< hugetlbfs 1GB pages (MAP_HUGETLB)
+    HUGE_PAGES_2MB,          ///< hugetlbfs 2MB pages (MAP_HUGETLB)
+    HUGE_PAGES_TRANSPARENT,  ///< 2MB aligned, madvise(MADV_HUGEPAGE)
+    HUGE_PAGES_NONE          ///< Plain 4kB pages
+};
+
+std::string print(HugePageMode mode);
+
+/** Parse "1gb", "2mb", "transparent" or "none". */
+HugePageMode parseHugePageMode(const std::string & mode);
+
+/** Page size for the given mode. */
+size_t hugePageSize(HugePageMode mode);
+
+/** Map size bytes backed with mode if possible, else the first mode after it
+    that works.  size is rounded up to the page size of the mode actually
+    used, and both are returned through the arguments.  Throws if even plain
+    pages can't be mapped.
+*/
+void * mapHugePages(size_t & size, HugePageMode & mode);
+
+void unmapHugePages(void * mem, size_t size);
+
+
+/*****************************************************************************/
+/* HUGE PAGE ARENA                                                           */
+/*****************************************************************************/
+
+/** Thread-safe allocator that carves its memory out of huge page chunks, so
+    that a table of millions of small nodes is spread over a few TLB entries
+    instead of hundreds of thousands.
+
+    Small requests, up to MaxSmallSize, are rounded up to one of the size
+    classes (powers of two and the halfway points between them) and served
+    from per-class slabs.  Freed blocks go back on the free list of their
+    class and are never given back to the kernel before the arena is
+    destroyed, which fits tables that grow, churn and stay around.  Larger
+    requests get a mapping of their own, returned by deallocate().
+
+    deallocate() needs the size that was passed to allocate(), which is what
+    the standard allocators give it.
+*/
+struct HugePageArena {
+
+    enum {
+        MinSize = 16,
+        MaxSmallSize = 64 * 1024,
+        NumClasses = 25,
+        SlabSize = 1024 * 1024
+    };
+
+    /** chunkSize is how much is mapped at once for the slabs; it's rounded
+        up to the page size of the mode.
+    */
+    explicit HugePageArena(HugePageMode mode = HUGE_PAGES_TRANSPARENT,
+                           size_t chunkSize = 64 * 1024 * 1024);
+
+    ~HugePageArena();
+
+    HugePageArena(const HugePageArena &) = delete;
+    HugePageArena & operator = (const HugePageArena &) = delete;
+
+    /** align must be a power of two.  Alignments up to 16 are free; larger
+        ones round small blocks up to a power of two.
+    */
+    void * allocate(size_t size, size_t align = 16);
+
+    void deallocate(void * mem, size_t size, size_t align = 16);
+
+    struct Stats {
+        HugePageMode requestedMode;
+        size_t mappedBytes;         ///< Everything mapped by the arena
+        size_t hugeMappedBytes;     ///< The part of it on huge pages
+        size_t fallbacks;           ///< Mappings that fell back a mode
+        size_t slabBytes;           ///< Given to the size classes
+        size_t allocatedBytes;      ///< Live, rounded to the size classes
+        size_t largeAllocations;    ///< Live, each with its own mapping
+    };
+
+    Stats stats() const;
+
+    /** Size class for the given size and alignment. */
+    static unsigned sizeClass(size_t size, size_t align = 16);
+
+    static size_t classSize(unsigned sizeClass);
+
+private:
+    struct FreeBlock {
+        FreeBlock * next;
+    };
+
+    struct SizeClass {
+        SizeClass() : freeList(0), current(0), end(0) {}
+        Spinlock lock;
+        FreeBlock * freeList;
+        char * current;             ///< Bump pointer into the current slab
+        char * end;
+    };
+
+    struct Chunk {
+        void * mem;
+        size_t size;
+        HugePageMode mode;          ///< How it's actually backed
+    };
+
+    /** Hand out a new slab for a size class, mapping a chunk if needed. */
+    char * newSlab();
+
+    void recordMapping(const Chunk & chunk, int direction);
+
+    HugePageMode mode;
+    size_t chunkSize;
+
+    SizeClass classes[NumClasses];
+
+    std::mutex chunkLock;
+    std::vector<Chunk> chunks;
+    char * chunkCurrent;
+    char * chunkEnd;
+
+    /// Mapping behind each large allocation; under chunkLock
+    std::unordered_map<void *, Chunk> largeMappings;
+
+    std::atomic<size_t> mappedBytes;
+    std::atomic<size_t> hugeMappedBytes;
+    std::atomic<size_t> fallbacks;
+    std::atomic<size_t> slabBytes;
+    std::atomic<size_t> allocatedBytes;
+    std::atomic<size_t> largeAllocations;
+};
+
+/** Arena used by default-constructed HugePageAllocators.  It uses
+    transparent huge pages unless the HUGE_PAGE_ARENA_MODE environment
+    variable says otherwise.
+*/
+HugePageArena & defaultHugePageArena();
+
+
+/*****************************************************************************/
+/* HUGE PAGE ALLOCATOR                                                       */
+/*****************************************************************************/
+
+/** Standard allocator over a HugePageArena, by default the process-wide
+    one, so that a table can opt in with nothing more than its type:
+
+        std::unordered_map<Id, Entry, std::hash<Id>, std::equal_to<Id>,
+                           HugePageAllocator<std::pair<const Id, Entry> > >
+*/
+template<typename T>
+struct HugePageAllocator {
+    typedef T value_type;
+    typedef T * pointer;
+    typedef const T * const_pointer;
+    typedef T & reference;
+    typedef const T & const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind {
+        typedef HugePageAllocator<U> other;
+    };
+
+    HugePageAllocator()
+        : arena(&defaultHugePageArena())
+    {
+    }
+
+    explicit HugePageAllocator(HugePageArena & arena)
+        : arena(&arena)
+    {
+    }
+
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U> & other)
+        : arena(other.arena)
+    {
+    }
+
+    T * allocate(size_t n, const void * = 0)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T * p, size_t n)
+    {
+        arena->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    template<typename U, typename... Args>
+    void construct(U * p, Args && ... args)
+    {
+        new (p) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    void destroy(U * p)
+    {
+        p->~U();
+    }
+
+    size_t max_size() const
+    {
+        return size_t(-1) / sizeof(T);
+    }
+
+    template<typename U>
+    bool operator == (const HugePageAllocator<U> & other) const
+    {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator != (const HugePageAllocator<U> & other) const
+    {
+        return arena != other.arena;
+    }
+
+    HugePageArena * arena;
+};
+
+} // namespace ML
+
+#endif /* __jml__utils__huge_page_arena_h__ */
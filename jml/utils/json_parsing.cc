@@ -409,6 +409,69 @@ std::string expectJsonStringAscii(Parse_Context & context)
     return result;
 }
 
+void skipJsonString(Parse_Context & context)
+{
+    skipJsonWhitespace(context);
+    context.expect_literal('"');
+
+    while (!context.match_literal('"')) {
+        char c = *context++;
+        if (c != '\\') continue;
+
+        c = *context++;
+        switch (c) {
+        case 't': case 'n': case 'r': case 'f': case 'b':
+        case '/': case '\\': case '"':
+            break;
+        case 'u':
+            context.expect_hex4();
+            break;
+        default:
+            context.exception("invalid escaped char");
+        }
+    }
+}
+
+void skipJson(Parse_Context & context)
+{
+    skipJsonWhitespace(context);
+
+    if (*context == '"')
+        skipJsonString(context);
+    else if (context.match_literal("null")
+             || context.match_literal("true")
+             || context.match_literal("false"))
+        return;
+    else if (*context == '[') {
+        context.expect_literal('[');
+        skipJsonWhitespace(context);
+        if (context.match_literal(']')) return;
+
+        do {
+            skipJson(context);
+            skipJsonWhitespace(context);
+        } while (context.match_literal(','));
+
+        context.expect_literal(']');
+    }
+    else if (*context == '{') {
+        context.expect_literal('{');
+        skipJsonWhitespace(context);
+        if (context.match_literal('}')) return;
+
+        do {
+            skipJsonString(context);
+            skipJsonWhitespace(context);
+            context.expect_literal(':');
+            skipJson(context);
+            skipJsonWhitespace(context);
+        } while (context.match_literal(','));
+
+        context.expect_literal('}');
+    }
+    else expectJsonNumber(context);
+}
+
 bool
 matchJsonNull(Parse_Context & context)
 {
@@ -72,6 +72,17 @@ matchJsonObject(Parse_Context & context,
 
 void skipJsonWhitespace(Parse_Context & context);
 
+/** Skip over a JSON string without decoding it.  Escapes are checked but no
+    output is produced and nothing is allocated.
+*/
+void skipJsonString(Parse_Context & context);
+
+/** Skip over any JSON value, including nested arrays and objects.  This is
+    used to pass over fields that nobody is going to look at; unlike
+    expectJson() it doesn't build up a Json::Value only to throw it away.
+*/
+void skipJson(Parse_Context & context);
+
 inline bool expectJsonBool(Parse_Context & context)
 {
     if (context.match_literal("true"))
@@ -17,6 +17,8 @@
 #include "jml/utils/exc_assert.h"
 
 #include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/read.hpp>
+#include <boost/iostreams/write.hpp>
 #include <ios>
 #include <vector>
 #include <cstring>
@@ -118,7 +120,24 @@ struct JML_PACKED Header
     static Header read(Source& src)
     {
         Header head;
-        lz4::read(src, &head, sizeof(head));
+        if (!tryRead(src, head))
+            throw lz4_error("premature end of stream");
+        return std::move(head);
+    }
+
+    /** Same as read() but returns false instead of throwing when the stream
+        ends before the header, which is how concatenated frames end.
+    */
+    template<typename Source>
+    static bool tryRead(Source& src, Header& head)
+    {
+        char* data = (char*) &head;
+
+        std::streamsize res;
+        while ((res = boost::iostreams::read(src, data, 1)) == 0);
+        if (res < 0) return false;
+
+        lz4::read(src, data + 1, sizeof(head) - 1);
 
         if (head.magic != MagicConst)
             throw lz4_error("invalid magic number");
@@ -134,7 +153,7 @@ struct JML_PACKED Header
         if (head.checkBits != head.checksumOptions())
             throw lz4_error("corrupted options");
 
-        return std::move(head);
+        return true;
     }
 
     template<typename Sink>
@@ -268,24 +287,23 @@ private:
 
 struct lz4_decompressor : public boost::iostreams::multichar_input_filter
 {
-    lz4_decompressor() : done(false), toRead(0), pos(0) {}
+    lz4_decompressor() : done(false), frames(0), toRead(0), pos(0) {}
 
     template<typename Source>
     std::streamsize read(Source& src, char* s, std::streamsize n)
     {
         if (done) return -1;
-        if (!head) {
-            head = lz4::Header::read(src);
-            if (head.streamChecksum())
-                streamChecksumState = XXH32_init(lz4::ChecksumSeed);
-        }
 
         size_t written = 0;
         while (written < n) {
-            if (pos == toRead)
+            if (pos == toRead) {
+                if (!head && !readHeader(src)) {
+                    done = true;
+                    break;
+                }
                 fillBuffer(src);
-
-            if (done) break;
+                continue;
+            }
 
             size_t toCopy = std::min(n - written, toRead - pos);
             std::memcpy(s, buffer.data() + pos, toCopy);
@@ -301,6 +319,21 @@ struct lz4_decompressor : public boost::iostreams::multichar_input_filter
 
 private:
 
+    /** Reads the header of the next frame.  Frames can be concatenated, as
+        the lz4 tool allows, so the stream may end after any of them.
+    */
+    template<typename Source>
+    bool readHeader(Source& src)
+    {
+        if (!frames) head = lz4::Header::read(src);
+        else if (!lz4::Header::tryRead(src, head)) return false;
+
+        ++frames;
+        if (head.streamChecksum())
+            streamChecksumState = XXH32_init(lz4::ChecksumSeed);
+        return true;
+    }
+
     template<typename Source>
     void fillBuffer(Source& src)
     {
@@ -317,7 +350,7 @@ private:
                 if (checksum != expected) throw lz4_error("invalid checksum");
             }
 
-            done = true;
+            head = lz4::Header();
             return;
         }
 
@@ -338,6 +371,7 @@ private:
         pos = 0;
 
         if (notCompressed) {
+            if (buffer.size() < compressedSize) buffer.resize(compressedSize);
             std::memcpy(buffer.data(), compressed, compressedSize);
             toRead = compressedSize;
         }
@@ -359,6 +393,7 @@ private:
 
     lz4::Header head;
     bool done;
+    size_t frames;
 
     std::vector<char> buffer;
     size_t toRead;
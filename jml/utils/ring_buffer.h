@@ -3,7 +3,8 @@
    Copyright (c) 2012 Datacratic.  All rights reserved.
 
    Ring buffer for when there are one or more producers and one consumer
-   chasing each other.
+   chasing each other.  Also lock-free versions for a single producer and
+   consumer and for multiple producers and consumers.
 */
 
 #ifndef __jml_utils__ring_buffer_h__
@@ -12,8 +13,14 @@
 #include <vector>
 #include "jml/arch/futex.h"
 #include "jml/arch/spinlock.h"
+#include "jml/arch/exception.h"
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <iterator>
+#include <algorithm>
 
 namespace ML {
 
@@ -396,6 +403,373 @@ struct RingBufferSRMW : public RingBufferBase<Request> {
     }
 };
 
+
+
+/*****************************************************************************/
+/* LOCK-FREE RING BUFFERS                                                    */
+/*****************************************************************************/
+
+/* The ring buffers below never block and never take a lock; when the buffer
+   is full or empty the try* methods return false (or a short count for the
+   batch versions) and it's up to the caller to decide how to wait.
+
+   The buffer size is rounded up to a power of two.  Positions are 64 bit
+   counters that only ever increase, so they never wrap in practice and a
+   full buffer can be told apart from an empty one without wasting an entry.
+   Elements only need to be move constructible, so move-only types such as
+   std::unique_ptr can be passed through.
+
+   The batch operations take iterators.  tryPushBatch() constructs from
+   *first, so pass std::make_move_iterator() to move the elements in rather
+   than copying them; tryPopBatch() always moves the elements out.
+*/
+
+enum {
+    RingBufferCacheLineSize = 64
+};
+
+/** Smallest power of two that is at least n. */
+inline size_t ringBufferCapacity(size_t n)
+{
+    if (n == 0)
+        throw ML::Exception("ring buffer must have at least one entry");
+    size_t result = 1;
+    while (result < n) result *= 2;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* RING BUFFER SINGLE PRODUCER SINGLE CONSUMER                               */
+/*****************************************************************************/
+
+/** Lock-free ring buffer for exactly one producer thread and one consumer
+    thread.  Each side owns its position and keeps a cached copy of the
+    other side's, which it only refreshes when the buffer looks full (or
+    empty).  The two positions are on separate cache lines, so the two sides
+    only share a line when they actually need to synchronize.
+*/
+template<typename Request>
+struct RingBufferSPSC {
+    typedef Request value_type;
+
+    RingBufferSPSC(size_t size)
+        : ring(new Slot[ringBufferCapacity(size)]),
+          mask(ringBufferCapacity(size) - 1),
+          writePosition(0), cachedReadPosition(0),
+          readPosition(0), cachedWritePosition(0)
+    {
+    }
+
+    ~RingBufferSPSC()
+    {
+        for (uint64_t pos = readPosition;  pos != writePosition;  ++pos)
+            element(pos).~Request();
+    }
+
+    RingBufferSPSC(const RingBufferSPSC & other) = delete;
+    RingBufferSPSC & operator = (const RingBufferSPSC & other) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    /** Number of entries in the buffer.  Only a snapshot if the other side
+        is active. */
+    size_t size() const
+    {
+        uint64_t read = readPosition.load(std::memory_order_acquire);
+        return writePosition.load(std::memory_order_acquire) - read;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    /** Producer side. */
+    bool tryPush(const Request & request) { return tryEmplace(request); }
+    bool tryPush(Request && request) { return tryEmplace(std::move(request)); }
+
+    template<typename... Args>
+    bool tryEmplace(Args && ... args)
+    {
+        uint64_t pos = writePosition.load(std::memory_order_relaxed);
+        if (pos - cachedReadPosition > mask) {
+            cachedReadPosition = readPosition.load(std::memory_order_acquire);
+            if (pos - cachedReadPosition > mask)
+                return false;
+        }
+
+        new (&ring[pos & mask]) Request(std::forward<Args>(args)...);
+        writePosition.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Push as many of the elements from [first, last) as there is room
+        for, publishing them all at once.  Returns the number pushed. */
+    template<typename Iterator>
+    size_t tryPushBatch(Iterator first, Iterator last)
+    {
+        uint64_t pos = writePosition.load(std::memory_order_relaxed);
+        size_t n = std::distance(first, last);
+        if (pos + n - cachedReadPosition > capacity()) {
+            cachedReadPosition = readPosition.load(std::memory_order_acquire);
+            n = std::min<size_t>(n, capacity() - (pos - cachedReadPosition));
+        }
+
+        for (size_t i = 0;  i < n;  ++i, ++first)
+            new (&ring[(pos + i) & mask]) Request(*first);
+        if (n)
+            writePosition.store(pos + n, std::memory_order_release);
+        return n;
+    }
+
+    /** Consumer side. */
+    bool tryPop(Request & result)
+    {
+        uint64_t pos = readPosition.load(std::memory_order_relaxed);
+        if (pos == cachedWritePosition) {
+            cachedWritePosition
+                = writePosition.load(std::memory_order_acquire);
+            if (pos == cachedWritePosition)
+                return false;
+        }
+
+        Request & el = element(pos);
+        result = std::move(el);
+        el.~Request();
+        readPosition.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Pop up to maxRequests elements into out, releasing their entries
+        all at once.  Returns the number popped. */
+    template<typename OutputIterator>
+    size_t tryPopBatch(OutputIterator out, size_t maxRequests)
+    {
+        uint64_t pos = readPosition.load(std::memory_order_relaxed);
+        if (pos + maxRequests > cachedWritePosition)
+            cachedWritePosition
+                = writePosition.load(std::memory_order_acquire);
+        size_t n = std::min<size_t>(maxRequests, cachedWritePosition - pos);
+
+        for (size_t i = 0;  i < n;  ++i, ++out) {
+            Request & el = element(pos + i);
+            *out = std::move(el);
+            el.~Request();
+        }
+        if (n)
+            readPosition.store(pos + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    typedef typename std::aligned_storage<sizeof(Request),
+                                          alignof(Request)>::type Slot;
+
+    Request & element(uint64_t pos)
+    {
+        return *reinterpret_cast<Request *>(&ring[pos & mask]);
+    }
+
+    std::unique_ptr<Slot[]> ring;
+    uint64_t mask;
+    char padding0[RingBufferCacheLineSize];
+
+    // Written by the producer
+    std::atomic<uint64_t> writePosition;
+    uint64_t cachedReadPosition;
+    char padding1[RingBufferCacheLineSize - 2 * sizeof(uint64_t)];
+
+    // Written by the consumer
+    std::atomic<uint64_t> readPosition;
+    uint64_t cachedWritePosition;
+    char padding2[RingBufferCacheLineSize - 2 * sizeof(uint64_t)];
+};
+
+
+/*****************************************************************************/
+/* RING BUFFER MULTIPLE PRODUCERS MULTIPLE CONSUMERS                         */
+/*****************************************************************************/
+
+/** Lock-free ring buffer for any number of producer and consumer threads.
+    Each entry carries a sequence number that says whose turn it is: it is
+    equal to the position when the entry is free for the producer that
+    claims that position, and to the position plus one when it holds the
+    element for the consumer that claims it.  Producers and consumers claim
+    positions with a compare and swap on their own counter, which are on
+    separate cache lines; they never wait for each other except through the
+    sequence numbers of the entries involved.
+
+    The batch operations claim a run of consecutive positions with a single
+    compare and swap.
+*/
+template<typename Request>
+struct RingBufferMPMC {
+    typedef Request value_type;
+
+    RingBufferMPMC(size_t size)
+        : ring(new Cell[ringBufferCapacity(size)]),
+          mask(ringBufferCapacity(size) - 1),
+          writePosition(0), readPosition(0)
+    {
+        for (uint64_t i = 0;  i <= mask;  ++i)
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~RingBufferMPMC()
+    {
+        for (uint64_t pos = readPosition;  pos != writePosition;  ++pos)
+            ring[pos & mask].element().~Request();
+    }
+
+    RingBufferMPMC(const RingBufferMPMC & other) = delete;
+    RingBufferMPMC & operator = (const RingBufferMPMC & other) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    /** Approximate number of entries in the buffer. */
+    size_t size() const
+    {
+        uint64_t read = readPosition.load(std::memory_order_acquire);
+        uint64_t write = writePosition.load(std::memory_order_acquire);
+        return write > read ? write - read : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    bool tryPush(const Request & request) { return tryEmplace(request); }
+    bool tryPush(Request && request) { return tryEmplace(std::move(request)); }
+
+    template<typename... Args>
+    bool tryEmplace(Args && ... args)
+    {
+        uint64_t pos = claim(writePosition, 0, 1);
+        if (pos == NONE)
+            return false;
+
+        Cell & cell = ring[pos & mask];
+        new (&cell.storage) Request(std::forward<Args>(args)...);
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Push as many of the elements from [first, last) as can be claimed in
+        one run.  Returns the number pushed, which is only short if the
+        buffer fills up. */
+    template<typename Iterator>
+    size_t tryPushBatch(Iterator first, Iterator last)
+    {
+        size_t n = std::distance(first, last);
+        uint64_t pos = claim(writePosition, 0, n);
+        if (pos == NONE)
+            return 0;
+
+        for (size_t i = 0;  i < n;  ++i, ++first) {
+            Cell & cell = ring[(pos + i) & mask];
+            new (&cell.storage) Request(*first);
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    bool tryPop(Request & result)
+    {
+        uint64_t pos = claim(readPosition, 1, 1);
+        if (pos == NONE)
+            return false;
+
+        release(pos, result);
+        return true;
+    }
+
+    /** Pop up to maxRequests elements into out.  Returns the number
+        popped. */
+    template<typename OutputIterator>
+    size_t tryPopBatch(OutputIterator out, size_t maxRequests)
+    {
+        size_t n = maxRequests;
+        uint64_t pos = claim(readPosition, 1, n);
+        if (pos == NONE)
+            return 0;
+
+        for (size_t i = 0;  i < n;  ++i, ++out)
+            release(pos + i, *out);
+        return n;
+    }
+
+private:
+    static constexpr uint64_t NONE = uint64_t(-1);
+
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        typename std::aligned_storage<sizeof(Request),
+                                      alignof(Request)>::type storage;
+
+        Request & element()
+        {
+            return *reinterpret_cast<Request *>(&storage);
+        }
+    };
+
+    /** Claim up to n consecutive positions from counter, whose entries must
+        have a sequence number of their position plus offset.  On return n
+        holds the number claimed; returns the first position or NONE if
+        none could be claimed. */
+    uint64_t claim(std::atomic<uint64_t> & counter, uint64_t offset,
+                   size_t & n)
+    {
+        uint64_t pos = counter.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t ready = 0;
+            bool raced = false;
+            for (;  ready < n;  ++ready) {
+                uint64_t seq = ring[(pos + ready) & mask].sequence
+                    .load(std::memory_order_acquire);
+                int64_t diff = seq - (pos + ready + offset);
+                if (diff == 0) continue;
+                // Another thread has already claimed this position
+                if (diff > 0 && ready == 0) raced = true;
+                break;
+            }
+
+            if (raced) {
+                pos = counter.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (ready == 0)
+                return NONE;
+
+            if (counter.compare_exchange_weak(pos, pos + ready,
+                                              std::memory_order_relaxed)) {
+                n = ready;
+                return pos;
+            }
+        }
+    }
+
+    uint64_t claim(std::atomic<uint64_t> & counter, uint64_t offset,
+                   size_t && n)
+    {
+        return claim(counter, offset, n);
+    }
+
+    template<typename Output>
+    void release(uint64_t pos, Output & out)
+    {
+        Cell & cell = ring[pos & mask];
+        out = std::move(cell.element());
+        cell.element().~Request();
+        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+    }
+
+    std::unique_ptr<Cell[]> ring;
+    uint64_t mask;
+    char padding0[RingBufferCacheLineSize];
+
+    std::atomic<uint64_t> writePosition;
+    char padding1[RingBufferCacheLineSize - sizeof(uint64_t)];
+
+    std::atomic<uint64_t> readPosition;
+    char padding2[RingBufferCacheLineSize - sizeof(uint64_t)];
+};
+
 } // namespace ML
 
 #endif /* __jml_utils__ring_buffer_h__ */
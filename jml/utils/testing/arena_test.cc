@@ -0,0 +1,114 @@
+/* arena_test.cc
+   Copyright (c) 2013 Datacratic.  All rights reserved.
+
+   Test of the arena allocator.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/utils/arena.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+
+using namespace ML;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_alignment )
+{
+    Arena arena;
+
+    for (size_t align = 1;  align <= 64;  align *= 2) {
+        for (size_t size = 1;  size < 100;  size += 7) {
+            void * p = arena.allocate(size, align);
+            BOOST_CHECK_EQUAL((uintptr_t)p % align, 0);
+        }
+    }
+
+    // Bigger than a block; must get its own.
+    void * big = arena.allocate(1 << 20);
+    memset(big, 0, 1 << 20);
+    BOOST_CHECK_EQUAL((uintptr_t)big % Arena::MaxAlign, 0);
+}
+
+namespace {
+
+struct Tracked {
+    Tracked(vector<int> & order, int id) : order(order), id(id) {}
+    ~Tracked() { order.push_back(id); }
+
+    vector<int> & order;
+    int id;
+};
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_destructors )
+{
+    vector<int> order;
+
+    {
+        Arena arena(256);
+        for (int i = 0;  i < 100;  ++i)
+            BOOST_CHECK_EQUAL(arena.create<Tracked>(order, i)->id, i);
+        BOOST_CHECK(order.empty());
+    }
+
+    BOOST_REQUIRE_EQUAL(order.size(), 100);
+    for (int i = 0;  i < 100;  ++i)
+        BOOST_CHECK_EQUAL(order[i], 99 - i);
+}
+
+BOOST_AUTO_TEST_CASE( test_allocator )
+{
+    Arena arena;
+
+    typedef ArenaAllocator<int> IntAlloc;
+    vector<int, IntAlloc> vec((IntAlloc(arena)));
+    for (int i = 0;  i < 10000;  ++i) vec.push_back(i);
+    for (int i = 0;  i < 10000;  ++i) BOOST_CHECK_EQUAL(vec[i], i);
+
+    typedef pair<const string, int> Entry;
+    typedef ArenaAllocator<Entry> MapAlloc;
+    map<string, int, less<string>, MapAlloc>
+        m((less<string>()), MapAlloc(arena));
+    m["hello"] = 1;
+    m["world"] = 2;
+    BOOST_CHECK_EQUAL(m.size(), 2);
+    BOOST_CHECK_EQUAL(m["world"], 2);
+
+    BOOST_CHECK_GT(arena.bytesUsed(), 10000 * sizeof(int));
+}
+
+BOOST_AUTO_TEST_CASE( test_threads )
+{
+    Arena arena(4096);
+    enum { Threads = 4, Allocs = 10000 };
+
+    vector<uint64_t *> ptrs[Threads];
+
+    auto doThread = [&] (int thread) {
+        for (unsigned i = 0;  i < Allocs;  ++i) {
+            uint64_t * p = (uint64_t *)arena.allocate(sizeof(uint64_t));
+            *p = thread * Allocs + i;
+            ptrs[thread].push_back(p);
+        }
+    };
+
+    vector<std::thread> threads;
+    for (int i = 0;  i < Threads;  ++i)
+        threads.emplace_back(doThread, i);
+    for (auto & th : threads) th.join();
+
+    for (int i = 0;  i < Threads;  ++i)
+        for (unsigned j = 0;  j < Allocs;  ++j)
+            BOOST_CHECK_EQUAL(*ptrs[i][j], i * Allocs + j);
+}
@@ -0,0 +1,105 @@
+/* compact_map_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the compact map.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/utils/compact_map.h"
+#include "jml/db/persistent.h"
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <stdlib.h>
+
+using namespace std;
+using namespace ML;
+
+BOOST_AUTO_TEST_CASE( test_compact_map_basics )
+{
+    compact_map<string, int> map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find("a") == map.end());
+    BOOST_CHECK_EQUAL(map.count("a"), 0);
+    BOOST_CHECK_EQUAL(map.erase("a"), 0);
+
+    BOOST_CHECK(map.insert(make_pair("b", 2)).second);
+    BOOST_CHECK(!map.insert(make_pair("b", 3)).second);
+    BOOST_CHECK(map.emplace("a", 1).second);
+    map["c"] = 3;
+
+    BOOST_CHECK_EQUAL(map.size(), 3);
+    BOOST_CHECK_EQUAL(map.at("b"), 2);
+    BOOST_CHECK_THROW(map.at("d"), std::exception);
+
+    // Iteration is in key order
+    string keys;
+    for (auto & entry: map)
+        keys += entry.first;
+    BOOST_CHECK_EQUAL(keys, "abc");
+
+    map.erase(map.find("a"));
+    BOOST_CHECK_EQUAL(map.count("a"), 0);
+    BOOST_CHECK_EQUAL(map.begin()->first, "b");
+
+    compact_map<string, int> copy = map;
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(copy.size(), 2);
+    compact_map<string, int> expected = { { "c", 3 }, { "b", 2 } };
+    BOOST_CHECK(copy == expected);
+}
+
+/* Random inserts and erases, checked against std::map; the map spills out
+   of its internal storage and back. */
+BOOST_AUTO_TEST_CASE( test_compact_map_random )
+{
+    compact_map<int, int, 2> map;
+    std::map<int, int> ref;
+
+    srandom(1);
+    for (unsigned i = 0;  i < 20000;  ++i) {
+        int key = random() % 20;
+        switch (random() % 3) {
+        case 0:
+            BOOST_REQUIRE_EQUAL(map.insert(make_pair(key, i)).second,
+                                ref.insert(make_pair(key, i)).second);
+            break;
+        case 1:
+            BOOST_REQUIRE_EQUAL(map.erase(key), ref.erase(key));
+            break;
+        case 2:
+            BOOST_REQUIRE_EQUAL(map[key], ref[key]);
+            break;
+        }
+        BOOST_REQUIRE_EQUAL(map.size(), ref.size());
+    }
+
+    compact_map<int, int, 2> expected(ref.begin(), ref.end());
+    BOOST_CHECK(map == expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_map_serialization )
+{
+    compact_map<string, int> map = { { "x", 1 }, { "y", 2 } };
+    std::map<string, int> ref(map.begin(), map.end());
+
+    // Same format as std::map in both directions
+    ostringstream stream1, stream2;
+    {
+        DB::Store_Writer writer1(stream1), writer2(stream2);
+        writer1 << map;
+        writer2 << ref;
+    }
+    BOOST_CHECK_EQUAL(stream1.str(), stream2.str());
+
+    istringstream in(stream2.str());
+    DB::Store_Reader reader(in);
+    compact_map<string, int> map2;
+    reader >> map2;
+    BOOST_CHECK(map == map2);
+}
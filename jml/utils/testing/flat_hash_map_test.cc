@@ -0,0 +1,101 @@
+/* flat_hash_map_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the flat hash map.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/utils/flat_hash_map.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <stdlib.h>
+
+using namespace std;
+using namespace ML;
+
+BOOST_AUTO_TEST_CASE( test_flat_hash_map_basics )
+{
+    Flat_Hash_Map<int, string> map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK_EQUAL(map.count(1), 0);
+    BOOST_CHECK_EQUAL(map.erase(1), 0);
+
+    BOOST_CHECK(map.emplace(1, "one").second);
+    BOOST_CHECK(!map.emplace(1, "uno").second);
+    BOOST_CHECK_EQUAL(map.at(1), "one");
+
+    map[2] = "two";
+    BOOST_CHECK_EQUAL(map.size(), 2);
+    BOOST_CHECK_EQUAL(map.find(2)->second, "two");
+    BOOST_CHECK_THROW(map.at(3), std::exception);
+
+    map.erase(map.find(1));
+    BOOST_CHECK_EQUAL(map.count(1), 0);
+    BOOST_CHECK_EQUAL(map.size(), 1);
+
+    Flat_Hash_Map<int, string> copy = map;
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(copy.size(), 1);
+    BOOST_CHECK_EQUAL(copy[2], "two");
+}
+
+/* Random inserts and erases, checked against std::map.  The small key
+   range makes for long probe sequences and lots of shifting on erase. */
+BOOST_AUTO_TEST_CASE( test_flat_hash_map_random )
+{
+    Flat_Hash_Map<uint64_t, uint64_t> map;
+    std::map<uint64_t, uint64_t> ref;
+
+    srandom(1);
+    for (unsigned i = 0;  i < 200000;  ++i) {
+        uint64_t key = random() % 2000;
+        switch (random() % 3) {
+        case 0:
+            BOOST_REQUIRE_EQUAL(map.emplace(key, i).second,
+                                ref.insert(make_pair(key, i)).second);
+            break;
+        case 1:
+            BOOST_REQUIRE_EQUAL(map.erase(key), ref.erase(key));
+            break;
+        case 2: {
+            auto it = map.find(key);
+            auto it2 = ref.find(key);
+            BOOST_REQUIRE_EQUAL(it == map.end(), it2 == ref.end());
+            if (it2 != ref.end())
+                BOOST_REQUIRE_EQUAL(it->second, it2->second);
+        }
+        }
+        BOOST_REQUIRE_EQUAL(map.size(), ref.size());
+    }
+
+    size_t n = 0;
+    for (auto & entry: map) {
+        BOOST_CHECK_EQUAL(ref.at(entry.first), entry.second);
+        ++n;
+    }
+    BOOST_CHECK_EQUAL(n, ref.size());
+
+    // Churn never makes the table grow beyond what the live entries need
+    BOOST_CHECK_LE(map.capacity(), 4096);
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_hash_map_move_only )
+{
+    Flat_Hash_Map<string, unique_ptr<int> > map;
+    for (int i = 0;  i < 1000;  ++i)
+        map.emplace(to_string(i), unique_ptr<int>(new int(i)));
+
+    for (int i = 0;  i < 1000;  i += 2)
+        map.erase(to_string(i));
+
+    BOOST_CHECK_EQUAL(map.size(), 500);
+    for (int i = 1;  i < 1000;  i += 2)
+        BOOST_CHECK_EQUAL(*map.at(to_string(i)), i);
+}
@@ -0,0 +1,118 @@
+/* huge_page_arena_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the huge page arena.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/utils/huge_page_arena.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <thread>
+#include <stdint.h>
+
+
+using namespace ML;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_size_classes )
+{
+    for (size_t size = 1;  size <= HugePageArena::MaxSmallSize;  ++size) {
+        unsigned c = HugePageArena::sizeClass(size);
+        BOOST_REQUIRE_LT(c, HugePageArena::NumClasses);
+        BOOST_REQUIRE_GE(HugePageArena::classSize(c), size);
+        if (c > 0)
+            BOOST_REQUIRE_LT(HugePageArena::classSize(c - 1), size);
+    }
+
+    BOOST_CHECK_EQUAL(HugePageArena::sizeClass(HugePageArena::MaxSmallSize + 1),
+                      HugePageArena::NumClasses);
+}
+
+BOOST_AUTO_TEST_CASE( test_alignment_and_reuse )
+{
+    HugePageArena arena(HUGE_PAGES_NONE);
+
+    for (size_t align = 1;  align <= 256;  align *= 2) {
+        for (size_t size = 1;  size < 1000;  size += 37) {
+            void * p = arena.allocate(size, align);
+            BOOST_CHECK_EQUAL((uintptr_t)p % std::min<size_t>(align, 16), 0);
+            BOOST_CHECK_EQUAL((uintptr_t)p % align, 0);
+            memset(p, 0xff, size);
+            arena.deallocate(p, size, align);
+
+            // Freed blocks are handed out again first.
+            BOOST_CHECK_EQUAL(arena.allocate(size, align), p);
+            arena.deallocate(p, size, align);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(arena.stats().allocatedBytes, 0);
+
+    // Large blocks get their own mapping and give it back.
+    void * big = arena.allocate(1 << 20);
+    memset(big, 0, 1 << 20);
+    BOOST_CHECK_EQUAL(arena.stats().largeAllocations, 1);
+    arena.deallocate(big, 1 << 20);
+    BOOST_CHECK_EQUAL(arena.stats().largeAllocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_fallback )
+{
+    // Whatever the machine has, asking for 1GB pages must end up with
+    // working memory, and the stats must say how it's backed.
+    HugePageArena arena(HUGE_PAGES_1GB);
+    void * p = arena.allocate(64);
+    memset(p, 0, 64);
+
+    auto stats = arena.stats();
+    BOOST_CHECK_EQUAL(stats.requestedMode, HUGE_PAGES_1GB);
+    BOOST_CHECK_GE(stats.mappedBytes, (size_t)HugePageArena::SlabSize);
+    BOOST_CHECK_EQUAL(stats.allocatedBytes, 64);
+    cerr << "mapped " << stats.mappedBytes << " huge " << stats.hugeMappedBytes
+         << " fallbacks " << stats.fallbacks << endl;
+
+    arena.deallocate(p, 64);
+}
+
+BOOST_AUTO_TEST_CASE( test_std_allocator )
+{
+    HugePageArena arena;
+
+    typedef HugePageAllocator<pair<const int, int> > Allocator;
+    map<int, int, less<int>, Allocator> table((less<int>()), Allocator(arena));
+
+    auto work = [&] (int thread, map<int, int, less<int>, Allocator> & table) {
+        for (int i = 0;  i < 100000;  ++i)
+            table[i] = i * thread;
+        for (int i = 0;  i < 100000;  i += 2)
+            table.erase(i);
+    };
+
+    // Several threads, each with its own table in the same arena.
+    vector<map<int, int, less<int>, Allocator> > tables
+        (4, map<int, int, less<int>, Allocator>(less<int>(), Allocator(arena)));
+    vector<thread> threads;
+    for (unsigned i = 0;  i < tables.size();  ++i)
+        threads.emplace_back([&, i] () { work(i, tables[i]); });
+    for (auto & t : threads)
+        t.join();
+
+    for (unsigned i = 0;  i < tables.size();  ++i) {
+        BOOST_CHECK_EQUAL(tables[i].size(), 50000);
+        BOOST_CHECK_EQUAL(tables[i][99999], 99999 * i);
+    }
+
+    tables.clear();
+    BOOST_CHECK_EQUAL(arena.stats().allocatedBytes, 0);
+
+    // The default arena works the same.
+    vector<int, HugePageAllocator<int> > values(1000, 3);
+    BOOST_CHECK_EQUAL(values[999], 3);
+}
@@ -86,3 +86,34 @@ BOOST_AUTO_TEST_CASE( test1 )
     BOOST_CHECK_THROW(testHex4("002G", 2), std::exception);
     BOOST_CHECK_THROW(testHex4("002.", 2), std::exception);
 }
+
+void testSkip(const std::string & str, const std::string & rest = "")
+{
+    Parse_Context context(str, str.c_str(), str.c_str() + str.size());
+    skipJson(context);
+    std::string remaining(context.get_offset() + str.c_str(),
+                          str.c_str() + str.size());
+    BOOST_CHECK_EQUAL(remaining, rest);
+}
+
+void testSkipFails(const std::string & str)
+{
+    Parse_Context context(str, str.c_str(), str.c_str() + str.size());
+    BOOST_CHECK_THROW(skipJson(context), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_skip_json )
+{
+    testSkip("null");
+    testSkip("true,", ",");
+    testSkip("-12.5e3 ]", " ]");
+    testSkip("\"a\\\"b\\u00e9\\\\\"x", "x");
+    testSkip("[]");
+    testSkip("[ 1, [2, {}], \"3\" ] 4", " 4");
+    testSkip("{ \"a\" : { \"b\" : [ null, false ] }, \"c\":1 }, {}", ", {}");
+
+    testSkipFails("\"abc");
+    testSkipFails("[1, 2");
+    testSkipFails("{ \"a\" 1 }");
+    testSkipFails("\"\\q\"");
+}
@@ -0,0 +1,195 @@
+/* ring_buffer_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test for the lock-free ring buffers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "jml/utils/ring_buffer.h"
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "live_counting_obj.h"
+
+using namespace ML;
+using namespace std;
+
+
+/** Single threaded checks of the semantics, which are the same for both. */
+template<typename Buffer>
+void testSemantics()
+{
+    typedef typename Buffer::value_type Ptr;
+
+    Buffer buffer(5);
+    BOOST_CHECK_EQUAL(buffer.capacity(), 8);
+    BOOST_CHECK(buffer.empty());
+
+    Ptr result;
+    BOOST_CHECK(!buffer.tryPop(result));
+
+    // Move-only elements
+    for (int i = 0;  i < 8;  ++i)
+        BOOST_CHECK(buffer.tryPush(Ptr(new int(i))));
+    BOOST_CHECK_EQUAL(buffer.size(), 8);
+
+    // A failed push leaves the element with the caller
+    Ptr extra(new int(8));
+    BOOST_CHECK(!buffer.tryPush(std::move(extra)));
+    BOOST_CHECK(extra);
+
+    BOOST_CHECK(buffer.tryPop(result));
+    BOOST_CHECK_EQUAL(*result, 0);
+
+    // Only one entry free, so the batch is cut short
+    vector<Ptr> batch;
+    for (int i = 8;  i < 11;  ++i)
+        batch.emplace_back(new int(i));
+    BOOST_CHECK_EQUAL(buffer.tryPushBatch(make_move_iterator(batch.begin()),
+                                          make_move_iterator(batch.end())),
+                      1);
+    BOOST_CHECK(!batch[0]);
+    BOOST_CHECK(batch[1]);
+
+    vector<Ptr> popped;
+    BOOST_CHECK_EQUAL(buffer.tryPopBatch(back_inserter(popped), 5), 5);
+    BOOST_CHECK_EQUAL(buffer.tryPopBatch(back_inserter(popped), 5), 3);
+    BOOST_CHECK_EQUAL(buffer.tryPopBatch(back_inserter(popped), 5), 0);
+    BOOST_REQUIRE_EQUAL(popped.size(), 8);
+    for (int i = 0;  i < 8;  ++i)
+        BOOST_CHECK_EQUAL(*popped[i], i + 1);
+    BOOST_CHECK(buffer.empty());
+
+    // Batches that wrap around the end of the ring
+    BOOST_CHECK_EQUAL(buffer.tryPushBatch
+                          (make_move_iterator(batch.begin() + 1),
+                           make_move_iterator(batch.end())),
+                      2);
+    popped.clear();
+    BOOST_CHECK_EQUAL(buffer.tryPopBatch(back_inserter(popped), 5), 2);
+    BOOST_REQUIRE_EQUAL(popped.size(), 2);
+    BOOST_CHECK_EQUAL(*popped[0], 9);
+    BOOST_CHECK_EQUAL(*popped[1], 10);
+}
+
+BOOST_AUTO_TEST_CASE( test_spsc_semantics )
+{
+    testSemantics<RingBufferSPSC<std::unique_ptr<int> > >();
+}
+
+BOOST_AUTO_TEST_CASE( test_mpmc_semantics )
+{
+    testSemantics<RingBufferMPMC<std::unique_ptr<int> > >();
+}
+
+/** Elements left in the buffer are destroyed with it. */
+template<typename Buffer>
+void testDestruction()
+{
+    constructed = destroyed = 0;
+    {
+        Buffer buffer(16);
+        for (int i = 0;  i < 10;  ++i)
+            buffer.tryPush(Obj(i));
+        Obj obj;
+        for (int i = 0;  i < 4;  ++i)
+            buffer.tryPop(obj);
+    }
+    BOOST_CHECK_EQUAL(constructed, destroyed);
+}
+
+BOOST_AUTO_TEST_CASE( test_destruction )
+{
+    testDestruction<RingBufferSPSC<Obj> >();
+    testDestruction<RingBufferMPMC<Obj> >();
+}
+
+BOOST_AUTO_TEST_CASE( test_spsc_threads )
+{
+    RingBufferSPSC<uint64_t> buffer(64);
+    uint64_t n = 1000000;
+
+    std::thread producer([&] () {
+            vector<uint64_t> batch;
+            for (uint64_t i = 0;  i < n;) {
+                if (i % 3 == 0) {
+                    if (buffer.tryPush(i)) ++i;
+                    else std::this_thread::yield();
+                    continue;
+                }
+                batch.clear();
+                for (uint64_t j = i;  j < n && j < i + 7;  ++j)
+                    batch.push_back(j);
+                size_t pushed = buffer.tryPushBatch(batch.begin(), batch.end());
+                if (!pushed) std::this_thread::yield();
+                i += pushed;
+            }
+        });
+
+    // Everything arrives exactly once and in order
+    uint64_t expected = 0;
+    uint64_t values[10];
+    while (expected < n) {
+        size_t got = buffer.tryPopBatch(values, 10);
+        if (!got) std::this_thread::yield();
+        for (size_t i = 0;  i < got;  ++i)
+            BOOST_REQUIRE_EQUAL(values[i], expected++);
+    }
+
+    producer.join();
+    BOOST_CHECK(buffer.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_mpmc_threads )
+{
+    RingBufferMPMC<uint64_t> buffer(64);
+    int nthreads = 4;
+    uint64_t n = 200000;
+
+    std::atomic<uint64_t> total(0), count(0);
+
+    vector<std::thread> threads;
+    for (int t = 0;  t < nthreads;  ++t) {
+        threads.emplace_back([&, t] () {
+                uint64_t batch[5];
+                for (uint64_t i = 0;  i < n;) {
+                    if (t % 2) {
+                        if (buffer.tryPush(i + 1)) ++i;
+                        else std::this_thread::yield();
+                        continue;
+                    }
+                    size_t todo = std::min<uint64_t>(5, n - i);
+                    for (size_t j = 0;  j < todo;  ++j)
+                        batch[j] = i + j + 1;
+                    size_t pushed = buffer.tryPushBatch(batch, batch + todo);
+                    if (!pushed) std::this_thread::yield();
+                    i += pushed;
+                }
+            });
+        threads.emplace_back([&, t] () {
+                uint64_t values[8];
+                while (count < nthreads * n) {
+                    size_t got = t % 2
+                        ? buffer.tryPop(values[0])
+                        : buffer.tryPopBatch(values, 8);
+                    if (!got) std::this_thread::yield();
+                    uint64_t sum = 0;
+                    for (size_t i = 0;  i < got;  ++i)
+                        sum += values[i];
+                    total += sum;
+                    count += got;
+                }
+            });
+    }
+
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(count, nthreads * n);
+    BOOST_CHECK_EQUAL(total, nthreads * n * (n + 1) / 2);
+    BOOST_CHECK(buffer.empty());
+}
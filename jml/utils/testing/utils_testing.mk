@@ -4,6 +4,8 @@ $(eval $(call test,environment_test,utils arch,boost))
 $(eval $(call test,compact_vector_test,arch,boost))
 $(eval $(call test,circular_buffer_test,arch,boost))
 $(eval $(call test,lightweight_hash_test,arch utils,boost))
+$(eval $(call test,flat_hash_map_test,arch utils,boost))
+$(eval $(call test,compact_map_test,arch utils db,boost))
 $(eval $(call test,string_functions_test,arch utils,boost))
 
 $(eval $(call test,filter_streams_test,arch utils boost_filesystem boost_system,boost))
@@ -13,3 +15,6 @@ $(eval $(call test,csv_parsing_test,arch utils,boost))
 
 $(eval $(call test,worker_task_test,worker_task ACE arch boost_thread pthread,boost))
 $(eval $(call test,json_parsing_test,utils arch,boost))
+$(eval $(call test,arena_test,arch boost_thread,boost))
+$(eval $(call test,ring_buffer_test,arch,boost))
+$(eval $(call test,huge_page_arena_test,utils arch boost_thread,boost))
@@ -15,6 +15,8 @@
 #include <vector>
 #include <stdint.h>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 
 #include "jml/utils/worker_task.h"
 #include "jml/boosting/training_data.h"
@@ -160,3 +162,100 @@ BOOST_AUTO_TEST_CASE( test_exception )
                           std::exception);
     }
 }
+
+/* Each job of the outer group runs its own group of jobs from inside the
+   worker, the way the boosting code does. */
+void test_nested_groups(int nthreads, int nouter, int ninner)
+{
+    Worker_Task worker(nthreads - 1);
+
+    std::atomic<int> innerDone(0), innerFinished(0), outerFinished(0);
+
+    auto outerJob = [&] (int i)
+        {
+            worker.do_group(0, ninner,
+                            [&] (int j) { ++innerDone; });
+        };
+
+    int group;
+    {
+        group = worker.get_group([&] () { ++outerFinished; },
+                                 "outer");
+        Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                     boost::ref(worker),
+                                     group));
+
+        for (int i = 0;  i < nouter;  ++i) {
+            /* A child group whose finish job must run before the parent
+               is finished. */
+            int child = worker.get_group([&] () { ++innerFinished; },
+                                         "child", group);
+            Call_Guard childGuard(boost::bind(&Worker_Task::unlock_group,
+                                              boost::ref(worker),
+                                              child));
+            worker.add(std::bind<void>(outerJob, i), "outer job", child);
+        }
+    }
+
+    worker.run_until_finished(group);
+
+    BOOST_CHECK_EQUAL(innerDone, nouter * ninner);
+    BOOST_CHECK_EQUAL(innerFinished, nouter);
+    BOOST_CHECK_EQUAL(outerFinished, 1);
+    BOOST_CHECK_EQUAL(worker.queued(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_nested )
+{
+    test_nested_groups(1, 10, 100);
+    test_nested_groups(4, 100, 100);
+    test_nested_groups(16, 100, 10);
+}
+
+BOOST_AUTO_TEST_CASE( test_run_in_parallel )
+{
+    Worker_Task worker(3);
+
+    vector<int> done(10000);
+    run_in_parallel(0, 10000, [&] (int i) { done[i] += 1; },
+                    -1, "", "", worker);
+    BOOST_CHECK_EQUAL(std::count(done.begin(), done.end(), 1), 10000);
+
+    run_in_parallel_blocked(0, 10000, [&] (int i) { done[i] += 1; },
+                            -1, "", "", worker);
+    BOOST_CHECK_EQUAL(std::count(done.begin(), done.end(), 2), 10000);
+
+    worker.finish_all();
+    BOOST_CHECK_EQUAL(worker.queued(), 0);
+    BOOST_CHECK_EQUAL(worker.running(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_nested_exception )
+{
+    set_trace_exceptions(false);
+    JML_TRACE_EXCEPTIONS(false);
+
+    Worker_Task worker(3);
+
+    /* An exception in a child group nobody waits for fails the parent. */
+    int group;
+    {
+        group = worker.get_group(NO_JOB, "parent");
+        Call_Guard guard(boost::bind(&Worker_Task::unlock_group,
+                                     boost::ref(worker),
+                                     group));
+        int child = worker.get_group(NO_JOB, "child", group);
+        Call_Guard childGuard(boost::bind(&Worker_Task::unlock_group,
+                                          boost::ref(worker),
+                                          child));
+        for (unsigned i = 0;  i < 100;  ++i)
+            worker.add(i == 50 ? exception_job : null_job, "", child);
+    }
+
+    BOOST_CHECK_THROW(worker.run_until_finished(group), std::exception);
+
+    /* The task is still usable afterwards. */
+    std::atomic<int> done(0);
+    run_in_parallel(0, 100, [&] (int) { ++done; }, -1, "", "", worker);
+    BOOST_CHECK_EQUAL(done, 100);
+}
@@ -19,7 +19,8 @@ LIBUTILS_SOURCES := \
 	json_parsing.cc \
 	rng.cc \
 	hash.cc \
-	abort.cc
+	abort.cc \
+	huge_page_arena.cc
 
 LIBUTILS_LINK :=	ACE arch boost_iostreams lzma boost_thread cryptopp
 
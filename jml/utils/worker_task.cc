@@ -51,6 +51,14 @@ const Job NO_JOB;
 /* WORKER_TASK                                                               */
 /*****************************************************************************/
 
+namespace {
+
+/** Worker_Task and deque index of the current worker thread. */
+__thread const Worker_Task * current_task = 0;
+__thread int current_queue = -1;
+
+} // file scope
+
 Worker_Task &
 Worker_Task::
 instance(int thr)
@@ -61,20 +69,28 @@ instance(int thr)
 
 Worker_Task::
 Worker_Task(int threads)
-    : jobs_sem(0), finished_sem(1), state_change_sem(0), shutdown_sem(0),
-      next_group(0), next_job(0), num_queued(0),
-      num_running(0), force_finished(false)
+    : next_queue(0), next_job(0), num_queued(0), num_running(0),
+      next_group(0), num_sleeping(0), force_finished(false)
 {
     if (threads == -1)
         threads = num_cpus();
 
     threads_ = threads;
+    num_queues = std::max(threads, 1);
+    queues.reset(new Queue[num_queues]);
 
     //cerr << "creating worker task with " << threads << " threads" << endl;
 
     /* Create our threads */
-    for (unsigned i = 0;  i < threads;  ++i)
-        workerThreads_.emplace_back(new std::thread(std::bind(&Worker_Task::runWorkerThread, this)));
+    for (unsigned i = 0;  i < threads;  ++i) {
+        auto runThread = [=] ()
+            {
+                current_task = this;
+                current_queue = i;
+                runWorkerThread();
+            };
+        workerThreads_.emplace_back(new std::thread(runThread));
+    }
 }
 
 Worker_Task::
@@ -83,25 +99,21 @@ Worker_Task::
     log("~Worker_Task: stopping worker task\n");
     force_finished = true;
 
-    // Wake up all tasks by providing jobs
-    for (unsigned i = 0;  i < threads_;  ++i)
-        jobs_sem.release();
-
     /* TODO: finish all tasks */
-    if (jobs.size() || groups.size())
-        cerr << "at the end, there were " << jobs.size()
+    if (num_queued || groups.size())
+        cerr << "at the end, there were " << num_queued
              << " jobs outstanding and "
              << groups.size() << " groups outstanding" << endl;
 
-    for (unsigned i = 0;  i < threads_;  ++i)
-        shutdown_sem.acquire();
+    // Wake up all threads so that they notice that we're finished
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        wakeup.notify_all();
+    }
 
     // Join all worker threads
-    for (auto & t: workerThreads_) {
-        while (!t->joinable())
-            ML::sleep(0.01);
+    for (auto & t: workerThreads_)
         t->join();
-    }
 
     log("~Worker_Task: stopped worker task\n");
 }
@@ -116,30 +128,25 @@ get_group(const Job & group_finish, const std::string & info_str,
     if (!locked) cerr << "warning: creating unlocked group" << endl;
 
     Guard guard(lock);
-    Id id = next_group++;
-    groups[id].finished = group_finish;
-    groups[id].parent_group = parent_group;
-    groups[id].locked = locked;
-    groups[id].info = info_str;
-
-    /* Add a job for the group.  This allows us to keep track of where the child
-       jobs get inserted. */
-    Job_Info info(group_finish, Job(),
-                  format("job for group %lld: ", id) + info_str, -1, id);
-    
-    Jobs::iterator where = jobs.end();
 
-    /* Insert it at the end of its parent's jobs if it has one. */
+    Group_Info * parent = 0;
     if (parent_group != -1) {
-        groups[parent_group].groups_outstanding += 1;
-        where = groups[parent_group].group_job;
+        auto it = groups.find(parent_group);
+        if (it == groups.end())
+            throw Exception("Worker_Task::get_group(): parent group has none");
+        parent = it->second.get();
+        parent->outstanding += 1;
     }
-    
-    Jobs::iterator it = jobs.insert(where, info);
-    groups[id].group_job = it;
-    
-    notify_state_changed();
-    
+
+    Id id = next_group++;
+    std::unique_ptr<Group_Info> group
+        (new Group_Info(id, group_finish, parent, info_str));
+    if (locked) {
+        group->locked = true;
+        group->outstanding = 1;
+    }
+    groups[id] = std::move(group);
+
     return id;
 }
 
@@ -147,51 +154,53 @@ void Worker_Task::unlock_group(int group)
 {
     //cerr << "unlocked group " << group << endl;
     Guard guard(lock);
-    if (!groups.count(group))
+    auto it = groups.find(group);
+    if (it == groups.end())
         throw Exception("Worker_Task::unlock_group(): group info has none");
-    groups[group].locked = false;
-    check_finished_ul(group);
 
-    notify_state_changed();
+    Group_Info * group_info = it->second.get();
+    if (!group_info->locked) return;
+    group_info->locked = false;
+
+    if (group_info->outstanding.fetch_sub(1) == 1)
+        group_done_ul(group_info);
 }
 
 Worker_Task::Id
 Worker_Task::
 add(const Job & job, const Job & error, const std::string & job_info, Id group)
 {
-    /* Wait to manupulate */
-    Guard guard(lock);
-    Job_Info info(job, error, job_info, next_job++, group);
-
-    /* Find where to put it. */
+    Group_Info * group_info = 0;
 
     if (group != -1) {
-        if (!groups.count(group))
+        Guard guard(lock);
+        auto it = groups.find(group);
+        if (it == groups.end() || it->second->done)
             throw Exception("Worker_Task::add(): group info has none");
 
-        Group_Info & group_info = groups[group];
-        if (group_info.exc) {
+        group_info = it->second.get();
+        if (group_info->failed) {
             log("ignoring job addition to an error group\n");
             return -1;
         }
-        ++group_info.jobs_outstanding;
-        
-        /* Jobs::iterator it = */ jobs.insert(group_info.group_job, info);
+        ++group_info->outstanding;
     }
-    else jobs.push_back(info);
-    
-    ++num_queued;
-    
-    jobs_sem.release();  // release one to allow something to run the job
-    
-    /* If this is the first job running, then we are no longer finished so we
-       acquire the finished semaphore. */
-    if (num_queued + num_running == 1)
-        finished_sem.acquire();
 
+    Id id = next_job++;
+
+    /* Worker threads keep the jobs they create for themselves, which is
+       what makes the scheduling depth first.  Other threads spread them
+       around. */
+    int queue = own_queue();
+    if (queue == -1)
+        queue = next_queue++ % num_queues;
+
+    queues[queue].push(Job_Info(job, error, job_info, id, group_info));
+
+    ++num_queued;
     notify_state_changed();
     
-    return info.id;
+    return id;
 }
 
 Worker_Task::Id
@@ -203,11 +212,11 @@ add(const Job & job, const std::string & job_info, Id group)
 
 void Worker_Task::finish_all()
 {
-    /* Wait until we are finished */
-    finished_sem.acquire();
-
-    /* Let something else finish */
-    finished_sem.release();
+    /* Help until we are finished */
+    while (num_queued + num_running > 0) {
+        if (!run_one_job())
+            wait_for_work([&] () { return num_queued + num_running == 0; });
+    }
 }
 
 void Worker_Task::clear_all()
@@ -225,30 +234,102 @@ int Worker_Task::runWorkerThread()
     while (!force_finished) {
         
         log("runWorkerThread: getting job\n");
-        Job_Info info = get_job();
-        log("runWorkerThread: got job: " + to_string(info.id) + "\n");
+        if (run_one_job()) continue;
+
+        /* Before going to sleep, give the other threads a chance to add
+           more work. */
+        bool found = false;
+        for (unsigned i = 0;  i < 100 && !found;  ++i) {
+            if (num_queued > 0) found = true;
+            else sched_yield();
+        }
+        if (found) continue;
 
-        if (force_finished) break;
+        wait_for_work([] () { return false; });
+    }
 
+    return 0;
+}
+
+int
+Worker_Task::
+own_queue() const
+{
+    return current_task == this ? current_queue : -1;
+}
+
+bool
+Worker_Task::Queue::
+pop_back(Job_Info & info)
+{
+    std::lock_guard<Spinlock> guard(lock);
+    if (jobs.empty()) return false;
+    info = std::move(jobs.back());
+    jobs.pop_back();
+    return true;
+}
+
+bool
+Worker_Task::Queue::
+pop_front(Job_Info & info)
+{
+    std::lock_guard<Spinlock> guard(lock);
+    if (jobs.empty()) return false;
+    info = std::move(jobs.front());
+    jobs.pop_front();
+    return true;
+}
+
+bool
+Worker_Task::
+try_get_job(Job_Info & info)
+{
+    int own = own_queue();
+
+    bool found = own != -1 && queues[own].pop_back(info);
+
+    /* Steal the oldest job of another thread, which is the one furthest
+       from what it's working on. */
+    if (!found && num_queued > 0) {
+        unsigned start = own != -1 ? own + 1 : next_queue++;
+        for (unsigned i = 0;  i < num_queues && !found;  ++i)
+            found = queues[(start + i) % num_queues].pop_front(info);
+    }
+
+    if (!found) return false;
+
+    ++num_running;
+    --num_queued;
+    return true;
+}
+
+bool
+Worker_Task::
+run_one_job()
+{
+    Job_Info info;
+    if (!try_get_job(info)) return false;
+
+    log("run_one_job: got job: " + to_string(info.id) + "\n");
+    run_job(info);
+    return true;
+}
+
+void
+Worker_Task::
+run_job(Job_Info & info)
+{
+    if (info.group && info.group->failed) {
+        log("skipping job from invalid group\n");
+    }
+    else {
         try {
-            log("runWorkerThread: running job\n");
             //cerr << "thread " << ACE_OS::thr_self() << " is running job "
             //     << info.id << " (" << info.info << ")" << endl;
-            if (!info.invalidGroup) {
-                info.job();
-            }
-            else {
-                log("skipping job from invalid group\n");
-            }
+            info.job();
         }
         catch (const std::exception & exc) {
-            log("runWorkerThread: job exception: " + string(exc.what())
-                + "\n");
-            // TODO: make this exception go to the calling process
-            //cerr << "thread " << ACE_OS::thr_self() << " running job "
-            //     << info.id << " (" << info.info << "): " << endl;
-            //cerr << "warning: job threw exception: "
-            //     << exc.what() << endl;
+            log("run_job: job exception: " + string(exc.what()) + "\n");
             try {
                 if (info.error) info.error();
             }
@@ -257,190 +338,166 @@ int Worker_Task::runWorkerThread()
                      << exc.what() << endl;
             }
 
-            /* Indicate that the job's group had an error. */
-            if (info.group != -1) {
-                Guard guard(lock);
-                Group_Info & group_info = groups[info.group];
-                if (!group_info.exc) {
-                    /* When a job fails in a group, all remaining jobs from
-                       this group are marked for skipping and the queue is
-                       cleaned up gradually via get_job/finish_job. This
-                       marking is performed by both the worker and control
-                       threads. When it is known that all jobs have been fully
-                       executed or skipped, the group is then removed and the
-                       exception rethrown from the control thread. */
-                    group_info.exc = current_exception();
-                    mark_group_jobs_invalid_ul(group_info, info.group);
-                }
-            }
+            /* Indicate that the job's group had an error.  The remaining
+               jobs of the group are skipped, and the exception is rethrown
+               from run_until_finished() once they are all out of the way. */
+            if (info.group)
+                set_error(*info.group, current_exception());
+            else
+                cerr << "warning: job threw exception: "
+                     << exc.what() << endl;
         }
-        //cerr << "thread " << ACE_OS::thr_self() << " is finished job "
-        //     << info.id << " (" << info.info << ")" << endl;
-        finish_job(info);
     }
 
-    shutdown_sem.release();
-    
-    return 0;
+    finish_job(info);
 }
 
-void Worker_Task::notify_state_changed()
+void
+Worker_Task::
+finish_job(const Job_Info & info)
 {
-    // must be called with the lock held
-    for (set<Semaphore *>::const_iterator it = state_semaphores.begin();
-         it != state_semaphores.end();  ++it)
-        (*it)->release();
+    --num_running;
+
+    /* Finish off the group if we need to.  Once the count is down, the
+       group can go away at any time, so only its id can be used. */
+    if (info.group) {
+        Id group = info.group->id;
+        int before = info.group->outstanding.fetch_sub(1);
+        if (before < 1)
+            throw Exception("Worker_Task::finish_job(): "
+                            "group has negative outstanding count");
+        if (before == 1)
+            group_done(group);
+        else if (before == 2)
+            notify_state_changed();  // maybe only the waiter's lock is left
+    }
+
+    if (num_queued + num_running == 0)
+        notify_state_changed();
 }
 
-void Worker_Task::add_state_semaphore(Semaphore & sem)
+void
+Worker_Task::
+set_error(Group_Info & group, std::exception_ptr exc)
 {
     Guard guard(lock);
-    if (state_semaphores.count(&sem))
-        throw Exception("same state semaphore added twice");
-    state_semaphores.insert(&sem);
+    if (group.failed) return;
+    group.exc = exc;
+    group.failed = true;
 }
 
-void Worker_Task::remove_state_semaphore(Semaphore & sem)
+void
+Worker_Task::
+group_done(Id group)
 {
     Guard guard(lock);
-    if (!state_semaphores.count(&sem))
-        throw Exception("state semaphore was lost");
-    state_semaphores.erase(&sem);
+    auto it = groups.find(group);
+    if (it == groups.end()) return;
+    group_done_ul(it->second.get());
 }
 
-void Worker_Task::run_until_released(Semaphore & sem, int group)
+void
+Worker_Task::
+group_done_ul(Group_Info * group_info)
 {
-    /* We check at every change in state for either a) the semaphore
-       being free or b) a job being available. */
-
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
-
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                 this, boost::ref(state_semaphore)));
-    
-    while (sem.tryacquire() == -1) {
-
-        /* Run a job, if there is one old job to finish. */
-        
-        Job_Info info;
-        if (try_get_job(info, group)) {
-            // release lock here
-
-            try {
-                if (!info.invalidGroup) {
-                    info.job();
-                }
-                else {
-                    log("skipping job from invalid group\n");
-                }
-            }
-            catch (const std::exception & exc) {
-                // TODO: make this exception go to the calling process
-                cerr << "warning: job threw exception: "
-                     << exc.what() << endl;
+    /* Go through the list of parents and notify everywhere of what is
+       finished.  Another thread may have locked the group again since its
+       count dropped to zero, in which case it will finish it. */
+    while (group_info && group_info->outstanding == 0 && !group_info->done) {
+        //cerr << "  *** yes, group " << group_info->id << " is finished"
+        //     << endl;
+
+        Group_Info * parent = group_info->parent;
+
+        if (group_info->exc && !parent) {
+            /* A group with an exception must stay in memory until the
+               control thread handles it. */
+            group_info->done = true;
+        }
+        else {
+            if (!group_info->failed) {
                 try {
-                    if (info.error) info.error();
+                    if (group_info->finished)
+                        group_info->finished();
                 }
                 catch (const std::exception & exc) {
-                    cerr << "warning: job error function throw exception: "
-                         << exc.what() << endl;
+                    cerr << "Worker_Task::check_finished(): " << exc.what()
+                         << endl;
                 }
             }
+            else if (group_info->exc && !parent->exc) {
+                /* Nobody rethrew it, so it's up to the parent to do it. */
+                parent->exc = group_info->exc;
+                parent->failed = true;
+            }
 
-            finish_job(info);
-
-            continue;
+            groups.erase(group_info->id);
         }
 
-        /* Wait for a state change. */
-        state_semaphore.acquire();
+        if (parent && parent->outstanding.fetch_sub(1) != 1)
+            parent = 0;
+        group_info = parent;
     }
-    
-    sem.release();
+
+    notify_state_changed();
 }
 
 void
 Worker_Task::
-cancel_group(Group_Info & group_info, int group)
+rethrow_error(Id group)
 {
-    Guard guard(lock);
-    cancel_group_ul(group_info, group);
+    exception_ptr exc;
+    {
+        Guard guard(lock);
+        auto it = groups.find(group);
+        if (it == groups.end()) return;
+        exc = it->second->exc;
+        groups.erase(it);
+    }
+
+    if (exc)
+        rethrow_exception(exc);
 }
 
-void
-Worker_Task::
-cancel_group_ul(Group_Info & group_info, int group)
+void Worker_Task::notify_state_changed()
 {
-    log("cancel_group_ul\n");
-    //cerr << "thread " << ACE_OS::thr_self() << " cancel_group() "
-    //     << group_info.info << endl;
-    
-    /* We clean up the group by scanning through its list of tasks, removing
-       those that haven't run yet, and calling all of the handlers. */
-    Jobs::iterator it = jobs.begin();
-        
-    /* Iterate through this group's jobs. */
-        
-    while (it != group_info.group_job) {
-        while (it != group_info.group_job
-               && (it->id == -1 || !in_group(*it, group))) ++it;
-            
-        if (it == group_info.group_job) break;
-            
-        /* Remove this job. */
-        //cerr << "removing job " << it->id << " (" << it->info
-        //     << ")" << endl;
-
-            
-        Jobs::iterator next = it;
-        ++next;
-        remove_job_ul(it);
-        it = next;
-    }
-    
-    log("finished clearning jobs for group " + to_string(group) + "\n");
+    if (num_sleeping == 0) return;
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    wakeup.notify_all();
 }
 
+template<typename Pred>
 void
 Worker_Task::
-mark_group_jobs_invalid_ul(Group_Info & group_info, int group)
+wait_for_work(Pred pred)
 {
-    log("mark_group_jobs_invalid_ul\n");
-
-    if (group == -1) {
-        throw ML::Exception("cannot mark group -1 as invalid");
-    }
-
-    for (Jobs::iterator it = jobs.begin(); it != group_info.group_job; it++) {
-        if (it->group == group) {
-            it->invalidGroup = true;
-        }
-    }
-
-    log("mark_group_jobs_invalid_ul done\n");
+    /* num_sleeping is incremented before the conditions are checked, and
+       notify_state_changed() reads it after changing them, so one of the
+       two always sees the other. */
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    ++num_sleeping;
+    while (!force_finished && num_queued == 0 && !pred())
+        wakeup.wait(guard);
+    --num_sleeping;
 }
 
-void
-Worker_Task::
-wait_group_finished(Group_Info & group_info, int group)
+void Worker_Task::run_until_released(Semaphore & sem, int group)
 {
-    // cancel_group(group_info, group);
-    /* Wait until everything has stopped running in this group. */
+    /* We check every so often for either a) the semaphore being free or b)
+       a job being available.  Releasing the semaphore doesn't tell us, so
+       we can't sleep for long. */
 
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
+    while (sem.tryacquire() == -1) {
+        if (run_one_job()) continue;
 
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                 this, boost::ref(state_semaphore)));
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        ++num_sleeping;
+        if (!force_finished && num_queued == 0)
+            wakeup.wait_for(guard, std::chrono::milliseconds(1));
+        --num_sleeping;
+    }
     
-    while (group_info.jobs_running > 0)
-        state_semaphore.acquire();
-
-    /* Group should be finished. */
-    log("group finished\n");
+    sem.release();
 }
 
 void
@@ -451,21 +508,31 @@ run_until_finished(int group, bool unlock)
        finished or b) an error from the group or c) a job being available.
     */
 
-    map<Id, Group_Info>::iterator group_it;
+    Group_Info * group_info;
     
     /* Lock the group so that it doesn't get removed. */
     {
         Guard guard(lock);
-        group_it = groups.find(group);
+        auto group_it = groups.find(group);
         if (group_it == groups.end()) {
             if (!unlock) return;  // group must have finished
             throw Exception("Worker_Task::run_until_finished(): "
                             "group doesn't exist but should be locked");
         }
-        if (group_it->second.locked && !unlock)
+        group_info = group_it->second.get();
+        if (group_info->done) {
+            /* Finished already, with an error. */
+            guard.unlock();
+            rethrow_error(group);
+            return;
+        }
+        if (group_info->locked && !unlock)
             throw Exception("Worker_Task::run_until_finished(): "
                             "group is locked; it won't ever finish");
-        group_it->second.locked = true;
+        if (!group_info->locked) {
+            group_info->locked = true;
+            ++group_info->outstanding;
+        }
     }
 
     /* The group is locked for now; make sure it will be unlocked at the
@@ -473,433 +540,54 @@ run_until_finished(int group, bool unlock)
     Call_Guard unlock_guard(boost::bind(&Worker_Task::unlock_group,
                                         this, group));
     
-    /* Since the group is locked, this object must remain in memory here
-       and so we don't need to lock to access it.  (A map's iterators
-       aren't invalidated unless the actual object itself is removed).
-    */
-    Group_Info & group_info = group_it->second;
+    /* Since the group is locked, this object must remain in memory here.
+       Once only our lock is left, all of its jobs and children are done. */
+    auto isFinished = [&] () { return group_info->outstanding == 1; };
 
-    /* Create a semaphore so that we get notified of state changes. */
-    Semaphore state_semaphore(0);
-    add_state_semaphore(state_semaphore);
-    
-    /* Make sure we remove this semaphore at the end. */
-    Call_Guard state_guard(boost::bind(&Worker_Task::remove_state_semaphore,
-                                       this, boost::ref(state_semaphore)));
-    
-    for (;;) {
+    while (!isFinished()) {
         //cerr << "thread " << ACE_OS::thr_self() << " is waiting for group "
         //     << group << " to finish" << endl;
 
-        /* Is the group finished?  If so, we can get out of here. */
-        {
-            if (group_info.jobs_outstanding
-                + group_info.jobs_running
-                + group_info.groups_outstanding == 0) {
-                /* We're finished */
-
-                /* If the group had an error, clean up the group structures,
-                 * then rethrow the exception that occurred. */
-                if (group_info.exc) {
-                    //cerr << "thread " << ACE_OS::thr_self()
-                    //     << " had a group error" << endl;
-
-                    /* Save and replace the exception ptr, as we're about to
-                       remove the group. */
-                    exception_ptr exc = group_info.exc;
-                    group_info.exc = exception_ptr();
-
-                    /* Unlock the group to allow everything to finish. */
-                    unlock_guard.clear();
-                    unlock_group(group);
-
-                    /* Done; throw the exception. */
-                    if (exc)
-                        rethrow_exception(exc);
-                }
-                else
-                    return;
-            }
-        }
-
-        /* Run a job if we can */
-        Job_Info info;
-        log("run_until_finished: try to get job\n");
-        if (try_get_job(info, group)) {
-            log("run_until_finished: got job: " + to_string(info.id) + "\n");
-            try {
-                //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-                //     << info.id << " (" << info.info << ")" << endl;
-                log("run_until_finished: running job\n");
-                if (!info.invalidGroup) {
-                    info.job();
-                }
-                else {
-                    log("skipping job from invalid group\n");
-                }
-
-                //cerr << "thread " << ACE_OS::thr_self() << " finished job "
-                //     << info.id << " (" << info.info << ")" << endl;
-            }
-            catch (const std::exception & exc) {
-                log("run_until_finished: job exception\n");
-                // TODO: make this exception go to the calling process
-                //cerr << "thread " << ACE_OS::thr_self() << " running job "
-                //     << info.id << " (" << info.info << "):" << endl;
-                // cerr << "run_until_finished: warning: job threw exception: "
-                //      << exc.what() << endl;
-                try {
-                    if (info.error) info.error();
-                }
-                catch (const std::exception & exc) {
-                    cerr << "warning: job error function throw exception: "
-                         << exc.what() << endl;
-                }
+        /* Run a job if we can.  It doesn't need to be one of ours; the
+           jobs of our group may be running elsewhere, and the more
+           progress is made the sooner they finish. */
+        if (run_one_job())
+            continue;
 
-                /* Indicate that the job's group had an error. */
-                if (info.group != -1) {
-                    Guard guard(lock);
-                    Group_Info & group_info = groups[info.group];
-                    if (!group_info.exc) {
-                        group_info.exc = current_exception();
-                        mark_group_jobs_invalid_ul(group_info, info.group);
-                    }
-                }
-            }
-            finish_job(info);
-            
-            continue;  // no state change needed
-        }
-        
         /* Wait for a state change. */
-        state_semaphore.acquire();
+        wait_for_work(isFinished);
     }
-}
 
-void
-Worker_Task::
-lend_thread(int group)
-{
-    /* Run a job if we can */
-    Job_Info info;
-    if (try_get_job(info, group)) {
-        try {
-            //cerr << "thread " << ACE_OS::thr_self() << " is running job "
-            //     << info.id << " (" << info.info << ")" << endl;
-            if (!info.invalidGroup) {
-                info.job();
-            }
-            else {
-                log("skipping job from invalid group\n");
-            }
-        }
-        catch (const std::exception & exc) {
-            // TODO: make this exception go to the calling process
-            //cerr << "thread " << ACE_OS::thr_self() << " running job "
-            //     << info.id << " (" << info.info << "):" << endl;
-            cerr << "warning: job threw exception: "
-                 << exc.what() << endl;
-            try {
-                if (info.error) info.error();
-            }
-            catch (const std::exception & exc) {
-                cerr << "warning: job error function throw exception: "
-                     << exc.what() << endl;
-            }
-
-            /* Indicate that the job's group had an error. */
-            if (info.group != -1) {
-                Guard guard(lock);
-                Group_Info & group_info = groups[info.group];
-                if (!group_info.exc) {
-                    group_info.exc = current_exception();
-                    cancel_group_ul(group_info, info.group);
-                }
-            }
-        }
-        //cerr << "thread " << ACE_OS::thr_self() << " finished job "
-        //     << info.id << " (" << info.info << ")" << endl;
-        finish_job(info);
-    }
-}
-
-bool Worker_Task::in_group(const Job_Info & info, int group)
-{
-    if (group == -1) return true;
-    
-    /* Check all parents. */
-    if (info.group == group) return true;
-    else if (info.group == -1) return false;
-    else {
-        Group_Info * group_info = &groups[info.group];
-        
-        while (group_info) {
-            Id parent = group_info->parent_group;
-
-            if (parent == -1) group_info = 0;
-            else {
-                if (!groups.count(parent))
-                    throw Exception("Worker_Task::in_group(): invalid "
-                                    "group number");
-                group_info = &groups[parent];
-            }
-        }
-    }
-
-    return false;
-}
-
-Worker_Task::Job_Info
-Worker_Task::get_job(int group)
-{
-    /* Block until we can acquire a semaphore to have jobs. */
-    for (unsigned i = 0;  i < 100;  ++i) {
-        if (jobs_sem.tryacquire() == 0) {
-            return get_job_impl(group);
-        }
-        sched_yield();
-    }
-    jobs_sem.acquire();
-
-    return get_job_impl(group);
-}
-
-bool Worker_Task::try_get_job(Worker_Task::Job_Info & job, int group)
-{
-    if (jobs_sem.tryacquire() == -1) return false;
-    
-    job = get_job_impl(group);
-    return true;
-}
-
-Worker_Task::Job_Info Worker_Task::get_job_impl(int group)
-{
-    //cerr << "thread " << ACE_OS::thr_self()
-    //     << " is getting a job in group " << group
-    //     << endl;
-    if (force_finished) return Job_Info();
-
-    for (unsigned i = 0;  i < 100;  ++i) {
-        Guard guard(lock, std::try_to_lock);
-        if (guard)
-            return get_job_impl_ul(group);
-        sched_yield();
-    }
-
-    Guard guard(lock);
-
-    //static int numJobs = 0;
-    //cerr << "getting job " << ++numJobs << endl;
-
-    return get_job_impl_ul(group);
-}
-
-Worker_Task::Job_Info
-Worker_Task::
-get_job_impl_ul(int group)
-{
-    //cerr << "thread " << ACE_OS::thr_self()
-    //     << " is getting a job in group " << group
-    //     << endl;
-    if (force_finished) return Job_Info();
-
-    Jobs::iterator it;
-
-    if (group == -1) {
-        it = jobs.begin();
-
-        /* Try to find one whose id isn't -1 but which is in the group
-           anyway. */
-        while (it != jobs.end() && it->id == -1) ++it;
-        
-        if (it == jobs.end())
-            throw Exception("get_job(): internal error: "
-                            "semaphore acquired with zero jobs");
-    }
-    else {
-        map<Id, Group_Info>::const_iterator group_it
-            = groups.find(group);
-        if (group_it == groups.end()) {
-            //throw Exception("iterator not found in group");
-            cerr << "couldn't find group " << group << " in  list"
-                 << endl;
-            return get_job_impl_ul(-1);
-        }
-        else if (group_it->second.exc)
-            return get_job_impl_ul(-1);  // group has an error; we don't do it
-        else it = jobs.begin();
-        
-        /* Try to find one whose id isn't -1 but which is in the group
-           anyway. */
-        while (it != group_it->second.group_job
-               && (it->id == -1 || !in_group(*it, group)))
-            ++it;
-        
-        /* If we didn't find one in our group, we select any job at all
-           so that we make some progress. */
-        if (it == group_it->second.group_job || !in_group(*it, group))
-            return get_job_impl_ul(-1);
-    }
-    
-    Job_Info result = *it;
-    ++num_running;
-
-    if (result.group != -1) ++groups[result.group].jobs_running;
-    
-    --num_queued;
-    jobs.erase(it);
-
-    notify_state_changed();
-
-    return result;
-}
-
-void
-Worker_Task::
-finish_job(const Job_Info & info)
-{
-    Guard guard(lock, std::defer_lock);
-
-    for (unsigned i = 0;  i < 100;  ++i) {
-        guard.try_lock();
-        if (guard) break;
+    /* If the group had an error, we take the exception so that it's not
+       passed on to the parent group as well. */
+    exception_ptr exc;
+    {
+        Guard guard(lock);
+        std::swap(exc, group_info->exc);
     }
 
-    if (!guard)
-        guard.lock();
-
-    --num_running;
-    
-    /* Finish off the group if we need to. */
-    Id group = info.group;
-    if (group != -1) {
-
-        if (!groups.count(group))
-            throw Exception("Worker_Task::finish_job(): invalid group number");
-
-        Group_Info * group_info = &groups[group];
-
-        --group_info->jobs_outstanding;
-        --group_info->jobs_running;
-
-        if (group_info->jobs_outstanding < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative outstanding count");
-
-        if (group_info->jobs_running < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative running count");
-        
-        check_finished_ul(group);
-    }
-    
-    if (num_queued + num_running == 0) finished_sem.release();
+    unlock_guard.clear();
+    unlock_group(group);
 
-    notify_state_changed();
+    if (exc)
+        rethrow_exception(exc);
 }
 
 void
 Worker_Task::
-remove_job_ul(const Jobs::iterator & it)
+lend_thread(int group)
 {
-    --num_queued;
-    
-    if (jobs_sem.tryacquire() == -1) {
-        log(string("remove_job_ul error:\n")
-            + "errno = " + to_string(errno) + "\n"
-            + "error = " + strerror(errno) + "\n"
-            + "Worker_Task::remove_job_ul(): couldn't acquire the job "
-            + "semaphore\n"
-            + "force_finished = " + to_string(force_finished) + "\n");
-        dump();
-        abort();
-    }
-
-    /* Finish off the group if we need to. */
-    Id group = it->group;
-    if (group != -1) {
-
-        if (!groups.count(group))
-            throw Exception("Worker_Task::finish_job(): invalid group number");
-
-        Group_Info * group_info = &groups[group];
-
-        --group_info->jobs_outstanding;
-
-        if (group_info->jobs_outstanding < 0)
-            throw Exception("Worker_Task::finish_job(): "
-                            "group has negative outstanding count");
-        
-        check_finished_ul(group);
-    }
-
-    jobs.erase(it);
-    
-    if (num_queued + num_running == 0) finished_sem.release();
-    
-    notify_state_changed();
+    run_one_job();
 }
 
 bool Worker_Task::check_finished(Id group)
 {
     Guard guard(lock);
-    return check_finished_ul(group);
-}
-
-bool Worker_Task::check_finished_ul(Id group)
-{
-    if (!groups.count(group))
-        throw Exception("Worker_Task::finish_job(): invalid group number");
-    
-    Group_Info * group_info = &groups[group];
-
-    /* Go through the list of parents and notify everywhere of what is
-       finished. */
-    while (group_info && group_info->jobs_outstanding == 0
-           && group_info->groups_outstanding == 0) {
-        //cerr << "  *** yes, group " << group << " is finished" << endl;
-
-        /* If group has an exception attached to it, it must stay in memory
-           until the control thread handles it. */
-        if (group_info->exc || group_info->locked) return false;
-
-        //cerr << "finished group " << group << endl;
-
-        try {
-            if (group_info->finished && !group_info->exc)
-                group_info->finished();
-        }
-        catch (const std::exception & exc) {
-            cerr << "Worker_Task::check_finished(): " << exc.what() << endl;
-        }
-        
-        /* Get rid of the job for the group. */
-        jobs.erase(group_info->group_job);
-
-        Id parent = group_info->parent_group;
-
-        if (parent == -1) group_info = 0;
-        else {
-            if (!groups.count(parent))
-                throw Exception("Worker_Task::finish_job(): invalid "
-                                "group number");
-            group_info = &groups[parent];
-            --group_info->groups_outstanding;
-
-            if (group_info->groups_outstanding < 0) {
-                dump();
-                cerr << "check_finished(" << group << "): "
-                     << "groups_outstainding < 0" << endl;
-                cerr << "parent = " << parent << endl;
-            }
-        }
-        groups.erase(group);
-        group = parent;
-
-        notify_state_changed();
-    }
-    
-    return false;
+    auto it = groups.find(group);
+    if (it == groups.end())
+        throw Exception("Worker_Task::check_finished(): invalid group number");
+    group_done_ul(it->second.get());
+    return !groups.count(group) || groups[group]->done;
 }
 
 int Worker_Task::queued() const
@@ -924,7 +612,7 @@ dump(std::ostream & stream, int indent) const
     string i(indent, ' ');
     stream << i << "Job_Info @ " << this << endl;
     stream << i << "  id         = " << id << endl;
-    stream << i << "  group      = " << group << endl;
+    stream << i << "  group      = " << (group ? group->id : -1) << endl;
     stream << i << "  info       = " << info << endl;
     stream << i << "  job set    = " << (bool)job << endl;
     stream << i << "  error set  = " << (bool)error << endl;
@@ -937,12 +625,11 @@ dump(std::ostream & stream, int indent) const
     string i(indent, ' ');
     stream << i << "Group_Info @ " << this << endl;
     stream << i << "  info               = " << info << endl;
-    stream << i << "  jobs outstanding   = " << jobs_outstanding << endl;
-    stream << i << "  jobs running       = " << jobs_running << endl;
-    stream << i << "  groups outstanding = " << groups_outstanding << endl;
-    stream << i << "  parent group       = " << parent_group << endl;
-    stream << i << "  group job          = " << &(*group_job) << endl;
+    stream << i << "  outstanding        = " << outstanding << endl;
+    stream << i << "  parent group       = " << (parent ? parent->id : -1)
+           << endl;
     stream << i << "  locked             = " << locked << endl;
+    stream << i << "  done               = " << done << endl;
     stream << i << "  exc              = "   << (bool)exc << endl;
     stream << i << "  finished set       = " << (bool)finished << endl;
 }
@@ -954,26 +641,22 @@ dump() const
     std::ostream & stream = cerr;
 
     stream << "Worker_Task @ " << this << endl;
-    stream << "  number of jobs   = " << jobs.size() << endl;
     stream << "  next group       = " << next_group << endl;
     stream << "  next job         = " << next_job << endl;
     stream << "  num queued       = " << num_queued << endl;
     stream << "  num running      = " << num_running << endl;
     stream << "  number of groups = " << groups.size() << endl;
-    stream << "  state semaphores = " << state_semaphores.size() << endl;
-    stream << "  force finishned  = " << force_finished << endl;
+    stream << "  num sleeping     = " << num_sleeping << endl;
+    stream << "  force finished   = " << force_finished << endl;
     stream << endl;
-    stream << "  jobs:" << endl;
-    int i = 0;
-    for (Jobs::const_iterator it = jobs.begin();  it != jobs.end();  ++it, ++i) {
-        stream << "   " << i << ":" << endl;
-        it->dump(cerr, 4);
-    }
+    stream << "  queues:" << endl;
+    for (unsigned i = 0;  i < num_queues;  ++i)
+        stream << "   " << i << ": " << queues[i].jobs.size() << " jobs"
+               << endl;
     stream << "  groups:" << endl;
-    for (map<Id, Group_Info>::const_iterator it = groups.begin();
-         it != groups.end();  ++it) {
+    for (auto it = groups.begin();  it != groups.end();  ++it) {
         stream << "   group with ID " << it->first << ":" << endl;
-        it->second.dump(cerr, 4);
+        it->second->dump(cerr, 4);
     }
     stream << endl;
 }
@@ -12,12 +12,17 @@
 #include "jml/arch/format.h"
 #include "jml/arch/spinlock.h"
 #include "jml/arch/semaphore.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
+#include <vector>
 
 
 namespace ML {
@@ -46,12 +51,17 @@ int num_threads();
    The jobs can be arranged in groups, with a job that gets run once the
    group is finished, and the groups can be arranged in a hierarchy.
 
-   The jobs are scheduled such that with any group, jobs belonging to an
-   earlier subgroup are all scheduled before any belonging to a later
-   subgroup, regardless of the order in which they are scheduled.  (This
-   corresponds to a depth first search through the group tree).  The effect
-   is to guarantee that the average number of groups outstanding will be
-   as small as possible.
+   Each worker thread has its own deque of jobs.  Jobs added from a worker
+   thread (for example the jobs of a subgroup created from within a job)
+   go on that thread's deque, which it works through from the most recent
+   end; this keeps the scheduling depth first, so that the number of groups
+   outstanding stays small.  Idle threads steal the oldest jobs from the
+   other deques.  Jobs added from other threads are spread over the
+   deques.
+
+   Only the creation and removal of groups takes the lock of the group
+   table; getting, running and finishing jobs only ever touch the deque
+   they come from and the counters of their group.
 
    It works multithreaded, and deals with all locking and unlocking.
 */
@@ -75,9 +85,9 @@ public:
         is finished.  Note that if nothing is ever added to the group, it won't
         be finished automatically unless check_finished() is called.
 
-        It will be inserted into the jobs list just after the last job with
-        the same parent group, so that the children of parent groups will be
-        completed in preference to their sisters.
+        The parent group, if there is one, won't finish before this group
+        does.  If this group fails, its exception is also passed on to the
+        parent.
 
         If lock is set to true, then it will not ever be automatically removed
         until it is unlocked.  This stops a newly-created group from being
@@ -177,111 +187,123 @@ private:
 
     std::vector<std::unique_ptr<std::thread> > workerThreads_;
     
-    struct Job_Info;
+    struct Group_Info;
 
-    typedef std::list<Job_Info> Jobs;
-    
     struct Job_Info {
-        Job_Info() : id(-1), group(-1) {}
+        Job_Info() : id(-1), group(0) {}
         Job_Info(const Job & job, const Job & error,
-                 const std::string & info, Id id, Id group = -1)
-            : job(job), error(error), id(id), group(group),
-              invalidGroup(false), info(info) {}
+                 const std::string & info, Id id, Group_Info * group = 0)
+            : job(job), error(error), id(id), group(group), info(info) {}
         Job job;
         Job error;
-        Id id;    // if -1, this is a group end marker
-        Id group;
-        bool invalidGroup; // true is group has error set
+        Id id;
+        Group_Info * group;    // null if the job has no group
         std::string info;
         void dump(std::ostream & stream, int indent = 0) const;
     };
 
     struct Group_Info {
-        Group_Info()
-            : jobs_outstanding(0), jobs_running(0),
-              groups_outstanding(0), parent_group(0),
-              locked(false)
+        Group_Info(Id id, const Job & finished, Group_Info * parent,
+                   const std::string & info)
+            : id(id), finished(finished), parent(parent), outstanding(0),
+              locked(false), failed(false), done(false), info(info)
         {
         }
 
+        Id id;
         Job finished;
-        int jobs_outstanding;      ///< Number of jobs waiting for
-        int jobs_running;          ///< Number of jobs that are running
-        int groups_outstanding;    ///< Number of groups waiting for
-        Id parent_group;           ///< Group to notify when finished
-        Jobs::iterator group_job;  ///< Job for the group; always last
+        Group_Info * parent;         ///< Group to notify when finished
+
+        /** Number of jobs queued or running, plus the number of unfinished
+            child groups, plus one while the group is locked.  The group
+            is finished when this drops to zero.
+        */
+        std::atomic<int> outstanding;
+
+        /* The rest is protected by the lock of the group table, except for
+           reading failed. */
         bool locked;
-        std::exception_ptr exc;    ///< Exception to rethrow
+        std::atomic<bool> failed;    ///< Set with exc; jobs are skipped
+        bool done;                   ///< Finished with an error to rethrow
+        std::exception_ptr exc;      ///< Exception to rethrow, unless taken
         std::string info;
 
         void dump(std::ostream & stream, int indent = 0) const;
     };
 
-    /** Get a job. */
-    Job_Info get_job(int group = -1);
+    /** Deque of the jobs of one worker thread.  Padded so that the
+        deques don't share cache lines.
+    */
+    struct Queue {
+        Spinlock lock;
+        std::deque<Job_Info> jobs;
+        char padding[64];
 
-    /** Tries to get a job, but doesn't fail if there isn't one. */
-    bool try_get_job(Job_Info & info, int group = -1);
+        void push(Job_Info && info)
+        {
+            std::lock_guard<Spinlock> guard(lock);
+            jobs.emplace_back(std::move(info));
+        }
 
-    /** Implementation of the get_job methods.  Requires that the jobs_sem
-        be acquired. */
-    Job_Info get_job_impl(int group);
-    
-    /** Unlocked implementation of the get_job methods.  Requires that the
-        jobs_sem be acquired and that the lock already be held. */
-    Job_Info get_job_impl_ul(int group);
-    
-    void finish_job(const Job_Info & info);
+        bool pop_back(Job_Info & info);
+        bool pop_front(Job_Info & info);
+    };
 
-    void remove_job_ul(const Jobs::iterator & it);
+    /** Index of the deque of the calling thread, or -1 if it's not one of
+        our worker threads. */
+    int own_queue() const;
 
-    void add_state_semaphore(Semaphore & sem);
+    /** Take a job from our own deque or steal one from another. */
+    bool try_get_job(Job_Info & info);
 
-    void remove_state_semaphore(Semaphore & sem);
+    /** Take a job and run it.  Returns false if there were none. */
+    bool run_one_job();
 
-    void notify_state_changed();
+    void run_job(Job_Info & info);
 
-    // Check_finished, bit without the lock held
-    bool check_finished_ul(Id group);
+    void finish_job(const Job_Info & info);
 
-    /** Is the given job in the group?  Searches up the parent hierarchy. */
-    bool in_group(const Job_Info & info, int group);
+    /** Record an exception from one of the jobs of the group. */
+    void set_error(Group_Info & group, std::exception_ptr exc);
 
-    /** Removes all queued jobs in the group.  Running jobs are left alone. */
-    void cancel_group(Group_Info & group_info, int group);
+    /** Finish the group and then its parents if nothing is outstanding. */
+    void group_done(Id group);
+    void group_done_ul(Group_Info * group);
 
-    /** Removes all queued jobs in the group.  Running jobs are left alone. 
-        Lock must already be held. */
-    void cancel_group_ul(Group_Info & group_info, int group);
+    /** Rethrow the exception of a group which finished with an error, after
+        removing it. */
+    void rethrow_error(Id group);
 
-    /** Marks invalid all the jobs belonging to a group, so that the worker threads can
-     * skip those jobs easily and in a lockless manner */
-    void mark_group_jobs_invalid_ul(Group_Info & group_info, int group);
+    /** Wake up the threads that are waiting for a job or a group. */
+    void notify_state_changed();
 
-    /** Waits for running jobs to finish. */
-    void wait_group_finished(Group_Info & group_info, int group);
+    /** Sleep until there is a job to run or the predicate is true. */
+    template<typename Pred>
+    void wait_for_work(Pred pred);
 
     typedef std::mutex Lock;
-    //typedef Spinlock Lock;
     typedef std::unique_lock<Lock> Guard;
 
-    Semaphore jobs_sem, finished_sem, state_change_sem, shutdown_sem;
+    /** Per-thread deques; the extra one is for a task without threads. */
+    std::unique_ptr<Queue[]> queues;
+    int num_queues;
+    std::atomic<unsigned> next_queue;   ///< Round robin for other threads
 
-    /** Jobs we are running. */
-    Jobs jobs;
-    Id next_group;
-    Id next_job;
-    int num_queued;
-    int num_running;
-    Lock lock;
+    std::atomic<Id> next_job;
+    std::atomic<int> num_queued;
+    std::atomic<int> num_running;
 
-    /** Groups that are currently running. */
-    std::map<Id, Group_Info> groups;
+    /** Groups that are currently running, and their lock. */
+    Lock lock;
+    Id next_group;
+    std::map<Id, std::unique_ptr<Group_Info> > groups;
 
-    /** Semaphores that get released on each state change. */
-    std::set<Semaphore *> state_semaphores;
+    /** Idle threads sleep here until a job is added or a group finishes. */
+    std::mutex sleep_lock;
+    std::condition_variable wakeup;
+    std::atomic<int> num_sleeping;
 
-    volatile bool force_finished;
+    std::atomic<bool> force_finished;
 
     /* Dump everything to cerr; for debugging */
     void dump() const;
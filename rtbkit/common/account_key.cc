@@ -7,6 +7,11 @@
 
 #include "rtbkit/common/account_key.h"
 #include "jml/db/persistent.h"
+#include "jml/arch/spinlock.h"
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 using namespace std;
 using namespace ML;
@@ -50,4 +55,131 @@ reconstitute(ML::DB::Store_Reader & store)
     store.load(static_cast<AccountKeyBase &>(*this));
 }
 
+
+/*****************************************************************************/
+/* ACCOUNT KEY TABLE                                                         */
+/*****************************************************************************/
+
+/** Entries live in fixed size chunks that are never moved or freed, so that
+    an id can be turned back into its key without taking a lock.  Id 0 is
+    the null id and refers to the empty key.
+*/
+struct AccountKeyTable {
+
+    enum {
+        ChunkBits = 12,
+        ChunkSize = 1 << ChunkBits,
+        MaxChunks = 1 << 12,
+        NumShards = 16
+    };
+
+    struct Entry {
+        AccountKey key;
+        uint64_t hash;
+    };
+
+    AccountKeyTable()
+        : next(1)
+    {
+        for (auto & chunk: chunks)
+            chunk = nullptr;
+        entry(0).hash = AccountKey().hash();
+    }
+
+    static AccountKeyTable & instance()
+    {
+        static AccountKeyTable table;
+        return table;
+    }
+
+    Entry & entry(uint32_t id)
+    {
+        std::atomic<Entry *> & chunk = chunks[id >> ChunkBits];
+        Entry * entries = chunk.load(std::memory_order_acquire);
+
+        if (!entries) {
+            std::unique_ptr<Entry[]> newEntries(new Entry[ChunkSize]);
+            if (chunk.compare_exchange_strong(entries, newEntries.get()))
+                entries = newEntries.release();
+        }
+
+        return entries[id & (ChunkSize - 1)];
+    }
+
+    const Entry & get(uint32_t id) const
+    {
+        if (id >= next)
+            throw ML::Exception("unknown account key id %u", id);
+        return chunks[id >> ChunkBits].load(std::memory_order_acquire)
+            [id & (ChunkSize - 1)];
+    }
+
+    AccountKeyId find(const AccountKey & key, uint64_t hash, bool create)
+    {
+        if (key.empty()) return AccountKeyId();
+
+        Shard & shard = shards[hash % NumShards];
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+        auto it = shard.ids.find(key);
+        if (it != shard.ids.end())
+            return AccountKeyId(it->second);
+        if (!create)
+            return AccountKeyId();
+
+        uint32_t id = next.fetch_add(1);
+        if (id >= uint32_t(MaxChunks) * ChunkSize)
+            throw ML::Exception("too many account keys");
+
+        Entry & e = entry(id);
+        e.key = key;
+        e.hash = hash;
+
+        shard.ids.insert(std::make_pair(key, id));
+        return AccountKeyId(id);
+    }
+
+    struct Shard {
+        ML::Spinlock lock;
+        std::unordered_map<AccountKey, uint32_t> ids;
+    };
+
+    std::atomic<Entry *> chunks[MaxChunks];
+    std::atomic<uint32_t> next;
+    Shard shards[NumShards];
+};
+
+
+/*****************************************************************************/
+/* ACCOUNT KEY ID                                                            */
+/*****************************************************************************/
+
+AccountKeyId
+AccountKeyId::
+intern(const AccountKey & key)
+{
+    return AccountKeyTable::instance().find(key, key.hash(), true);
+}
+
+AccountKeyId
+AccountKeyId::
+find(const AccountKey & key)
+{
+    return AccountKeyTable::instance().find(key, key.hash(), false);
+}
+
+const AccountKey &
+AccountKeyId::
+key() const
+{
+    return AccountKeyTable::instance().get(id).key;
+}
+
+uint64_t
+AccountKeyId::
+hash() const
+{
+    return AccountKeyTable::instance().get(id).hash;
+}
+
 } // namespace RTBKIT
@@ -117,7 +117,7 @@ struct AccountKey : public AccountKeyBase {
     uint64_t hash() const
     {
         uint64_t res = 1232134;
-        for (auto s: *this)
+        for (const auto & s: *this)
             res = CityHash64WithSeed(s.c_str(), s.size(), res);
         return res;
     }
@@ -148,6 +148,62 @@ operator << (std::ostream & stream, const AccountKey & key)
     return stream << key.toString();
 }
 
+
+/*****************************************************************************/
+/* ACCOUNT KEY ID                                                            */
+/*****************************************************************************/
+
+/** Interned handle on an AccountKey.  Every distinct key gets a stable 32
+    bit id from a process wide table, along with its precomputed hash, so
+    that the maps on the bid path can be keyed by an integer instead of a
+    vector of strings.  Keys are never removed from the table; there is one
+    entry per account the process has ever seen.
+
+    The default constructed id is null and refers to the empty key.  Going
+    from a key to its id hashes the key and takes a lock on one of the
+    table's shards; going from an id back to its key or hash is lock free.
+*/
+struct AccountKeyId {
+    AccountKeyId() : id(0) {}
+
+    /** Return the id of the key, adding it to the table if needed. */
+    static AccountKeyId intern(const AccountKey & key);
+
+    /** Return the id of the key or a null id if it was never interned. */
+    static AccountKeyId find(const AccountKey & key);
+
+    const AccountKey & key() const;
+    uint64_t hash() const;
+
+    uint32_t index() const { return id; }
+
+    bool isNull() const { return id == 0; }
+    explicit operator bool () const { return id != 0; }
+
+    std::string toString(char delimiter = ':') const
+    {
+        return key().toString(delimiter);
+    }
+
+    /* Ids are ordered by the time they were interned and not by key. */
+
+    bool operator == (const AccountKeyId & other) const { return id == other.id; }
+    bool operator != (const AccountKeyId & other) const { return id != other.id; }
+    bool operator < (const AccountKeyId & other) const { return id < other.id; }
+
+private:
+    explicit AccountKeyId(uint32_t id) : id(id) {}
+
+    friend struct AccountKeyTable;
+    uint32_t id;
+};
+
+inline std::ostream &
+operator << (std::ostream & stream, const AccountKeyId & id)
+{
+    return stream << id.key();
+}
+
 } // namespace RTBKIT
 
 namespace std {
@@ -160,6 +216,14 @@ struct hash<RTBKIT::AccountKey> {
     }
 };
 
+template<>
+struct hash<RTBKIT::AccountKeyId> {
+    uint64_t operator () (const RTBKIT::AccountKeyId & id) const
+    {
+        return id.hash();
+    }
+};
+
 } // namespace std
 
 namespace Datacratic {
@@ -6,11 +6,14 @@
 */
 
 #include <iostream>
+#include <cstdlib>
 #include <functional>
 
 #include "analytics_publisher.h"
 #include "soa/jsoncpp/value.h"
 #include "soa/jsoncpp/reader.h"
+#include "jml/arch/exception.h"
+#include <boost/lexical_cast.hpp>
 
 using namespace std;
 using namespace Datacratic;
@@ -38,6 +41,11 @@ init(const string & baseUrl, const int numConnections)
     };
     addPeriodic("analytics::syncFilters", 10.0, syncFilters);
 
+    auto flushBatches = [&] (uint64_t wakeups) {
+        flush();
+    };
+    addPeriodic("analytics::flush", 0.1, flushBatches);
+
     initialized = true;
 }
 
@@ -52,36 +60,125 @@ void
 AnalyticsPublisher::
 shutdown()
 {
+    if (initialized) flush();
     MessageLoop::shutdown();
 }
 
 void
 AnalyticsPublisher::
-sendEvent(const string & channel, const string & event)
+appendEvent(string & body, const string & event)
 {
-    auto onResponse = [] (const HttpRequest & rq,
+    char length[24];
+    int n = snprintf(length, sizeof(length), "%zu ", event.size());
+    body.append(length, n);
+    body += event;
+    body += '\n';
+}
+
+void
+AnalyticsPublisher::
+forEachEvent(const string & body, const function<void (string)> & onEvent)
+{
+    const char * p = body.c_str();
+    const char * end = p + body.size();
+
+    while (p < end) {
+        char * afterLength;
+        unsigned long long length = strtoull(p, &afterLength, 10);
+        if (afterLength == p || afterLength >= end || *afterLength != ' ')
+            throw ML::Exception("analytics batch has a bad event length");
+
+        p = afterLength + 1;
+        if (length >= (unsigned long long)(end - p) || p[length] != '\n')
+            throw ML::Exception("analytics batch has a truncated event");
+
+        onEvent(string(p, length));
+        p += length + 1;
+    }
+}
+
+bool
+AnalyticsPublisher::
+takeBatch(Batch & batch, Batch & taken)
+{
+    if (!batch.events || inFlight >= MaxInFlight) return false;
+
+    pendingEvents -= batch.events;
+    ++inFlight;
+
+    // Keep the capacity of the body for the next batch.
+    taken.body.reserve(batch.body.capacity());
+    taken.body.swap(batch.body);
+    taken.events = batch.events;
+    taken.rate = batch.rate;
+    batch.events = 0;
+
+    return true;
+}
+
+void
+AnalyticsPublisher::
+sendBatch(const string & channel, Batch & batch)
+{
+    size_t events = batch.events;
+
+    auto onResponse = [=] (const HttpRequest & rq,
             HttpClientError error,
             int status,
             string && headers,
             string && body)
     {
+        --inFlight;
         if (status != 200) {
+            dropped += events;
             cout << "status: " << status << endl
                  << "error: " << error << endl;
         }
     };
-    string ressource("/v1/event");
+    string ressource("/v1/events");
     auto const & cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::objectValue);
-    payload["channel"] = channel;
-    payload["event"] = event;
-    client->post(ressource, cbs, payload);
+    HttpRequest::Content content(std::move(batch.body), "text/plain");
+
+    RestParams params { { "channel", channel } };
+    if (batch.rate < 1.0)
+        params.push_back({ "rate", boost::lexical_cast<string>(batch.rate) });
+
+    if (!client->post(ressource, cbs, content, params)) {
+        --inFlight;
+        dropped += events;
+    }
+}
+
+void
+AnalyticsPublisher::
+flush()
+{
+    vector<pair<string, Batch> > toSend;
+
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        for (auto & entry : batches) {
+            Batch taken;
+            if (!takeBatch(entry.second, taken)) continue;
+            toSend.emplace_back(entry.first, std::move(taken));
+        }
+    }
+
+    for (auto & entry : toSend)
+        sendBatch(entry.first, entry.second);
 }
 
 void
 AnalyticsPublisher::
 checkHeartbeat()
 {
+    uint64_t numDropped = dropped;
+    if (numDropped != reportedDropped) {
+        cerr << "analytics publisher dropped " << numDropped - reportedDropped
+             << " events that the endpoint couldn't keep up with" << endl;
+        reportedDropped = numDropped;
+    }
+
     auto onResponse = [&] (const HttpRequest & rq,
                           HttpClientError error,
                           int status,
@@ -124,5 +221,24 @@ syncChannelFilters()
     string ressource("/v1/channels");
     auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
     client->get(ressource, cbs);
+
+    // Channels that aren't listed are fully sent.
+    auto onRates = [&] (const HttpRequest & rq,
+                        HttpClientError error,
+                        int status,
+                        string && headers,
+                        string && body)
+    {
+        if (status != 200) return;
+        Json::Value rates = Json::parse(body);
+        if (rates.isObject()) {
+            std::lock_guard<std::mutex> lock(mu);
+            samplingRates.clear();
+            for (auto it = rates.begin(); it != rates.end(); ++it)
+                samplingRates[it.memberName()] = (*it).asDouble();
+        }
+    };
+    auto rateCbs = make_shared<HttpClientSimpleCallbacks>(onRates);
+    client->get("/v1/sampling", rateCbs);
 }
 
@@ -6,6 +6,9 @@
 */
 #pragma once
 
+#include <atomic>
+#include <cstdio>
+#include <functional>
 #include <string>
 #include <sstream>
 #include <unordered_map>
@@ -14,6 +17,7 @@
 #include "soa/service/message_loop.h"
 #include "soa/service/http_client.h"
 #include "soa/service/service_utils.h"
+#include "soa/types/id.h"
 
 typedef std::unordered_map< std::string, bool > ChannelFilter;
 
@@ -21,15 +25,39 @@ typedef std::unordered_map< std::string, bool > ChannelFilter;
 /* ANALYTICS PUBLISHER                                                          */
 /********************************************************************************/
 
+/** Events published on a channel are batched together and sent in a single
+    request to /v1/events every 0.1 seconds, or as soon as a batch holds
+    MaxBatchEvents.  When the endpoint can't keep up, at most MaxInFlight
+    batches are sent at once and the events that come in while there are
+    MaxPendingEvents waiting are dropped.
+
+    The endpoint can also ask for only a fraction of the events of a channel
+    to be sent, in which case one in every 1 / rate events is kept and the
+    rate goes along with the batch so that the endpoint can weigh them.
+*/
+
 struct AnalyticsPublisher : public Datacratic::MessageLoop {
 
-    AnalyticsPublisher() : initialized(false) {}
+    AnalyticsPublisher()
+        : initialized(false), live(false), pendingEvents(0),
+          inFlight(0), dropped(0), reportedDropped(0)
+    {
+    }
+
+    enum {
+        MaxBatchEvents = 1000,    ///< Batch size at which it's sent right away
+        MaxPendingEvents = 100000,///< Unsent events past which we drop
+        MaxInFlight = 16          ///< Batches sent but not yet answered
+    };
 
     void init(const std::string & baseUrl, const int numConnections);
     bool initialized;
 
     void start();
 
+    /** Sends what's been batched (without waiting for the answers) and
+        stops.
+    */
     void shutdown();
 
     void syncChannelFilters();
@@ -39,36 +67,157 @@ struct AnalyticsPublisher : public Datacratic::MessageLoop {
     {
         if (!live) return;
 
-        std::lock_guard<std::mutex> lock(mu);
+        std::unique_lock<std::mutex> lock(mu);
         auto it = channelFilter.find(channel);
         if (it == channelFilter.end() || !it->second) return;
 
-        std::stringstream ss;
-        make_message(ss, args...);
-        sendEvent(channel, ss.str());
+        Batch & batch = batches[channel];
+        if (!batch.events) batch.rate = getSamplingRate(channel);
+        if (batch.rate < 1.0) {
+            batch.credit += batch.rate;
+            if (batch.credit < 1.0) return;
+            batch.credit -= 1.0;
+        }
+
+        if (pendingEvents >= MaxPendingEvents) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        scratch.clear();
+        make_message(scratch, args...);
+
+        appendEvent(batch.body, scratch);
+        ++pendingEvents;
+
+        if (++batch.events < MaxBatchEvents) return;
+
+        Batch full;
+        if (!takeBatch(batch, full)) return;
+
+        lock.unlock();
+        sendBatch(channel, full);
     }
 
+    /// Number of events dropped because the endpoint couldn't keep up
+    uint64_t numDropped() const { return dropped; }
+
+    /** Appends an event to the body of a batch.  Each event is its length
+        in decimal, a space, the event itself and a newline so that events
+        can contain anything.
+    */
+    static void appendEvent(std::string & body, const std::string & event);
+
+    /** Calls onEvent for each event of the body of a batch.  Throws if the
+        body isn't properly formed.
+    */
+    static void forEachEvent(const std::string & body,
+                             const std::function<void (std::string)> & onEvent);
+
 private:
+    struct Batch {
+        Batch() : events(0), rate(1.0), credit(0.0) {}
+
+        std::string body;
+        size_t events;
+        double rate;     ///< Sampling rate of the events in the batch
+        double credit;   ///< Fraction of an event owed by the sampling
+    };
+
     std::mutex mu;
     std::shared_ptr<Datacratic::HttpClient> client;
     bool live;
     ChannelFilter channelFilter;
 
-    void sendEvent(const std::string & channel, const std::string & event);
+    /// Sampling rate of the channels that aren't fully sent; guarded by mu
+    std::unordered_map<std::string, double> samplingRates;
+
+    double getSamplingRate(const std::string & channel) const
+    {
+        auto it = samplingRates.find(channel);
+        return it == samplingRates.end() ? 1.0 : it->second;
+    }
+
+    /// Batches being filled per channel; guarded by mu
+    std::unordered_map<std::string, Batch> batches;
+    size_t pendingEvents;
+    std::string scratch;
+
+    std::atomic<size_t> inFlight;
+    std::atomic<uint64_t> dropped;
+    uint64_t reportedDropped;
+
+    /** Moves the events of the batch to taken unless there's nothing to
+        send or too many batches are in flight already.  Called with mu
+        held.
+    */
+    bool takeBatch(Batch & batch, Batch & taken);
+
+    /** Sends a batch that was taken.  Called without mu held. */
+    void sendBatch(const std::string & channel, Batch & batch);
+
+    /** Sends every batch that has events. */
+    void flush();
 
     void checkHeartbeat();
 
+    static void appendValue(std::string & out, const std::string & value)
+    {
+        out += value;
+    }
+
+    static void appendValue(std::string & out, const char * value)
+    {
+        out += value;
+    }
+
+    static void appendValue(std::string & out, const Datacratic::Id & value)
+    {
+        value.appendTo(out);
+    }
+
+    static void appendValue(std::string & out, int value) { appendFormatted(out, "%d", value); }
+    static void appendValue(std::string & out, unsigned value) { appendFormatted(out, "%u", value); }
+    static void appendValue(std::string & out, long value) { appendFormatted(out, "%ld", value); }
+    static void appendValue(std::string & out, unsigned long value) { appendFormatted(out, "%lu", value); }
+    static void appendValue(std::string & out, long long value) { appendFormatted(out, "%lld", value); }
+    static void appendValue(std::string & out, unsigned long long value) { appendFormatted(out, "%llu", value); }
+
+    static void appendValue(std::string & out, double value)
+    {
+        // Same as the default precision of a stream
+        appendFormatted(out, "%g", value);
+    }
+
+    template<typename T>
+    static void appendFormatted(std::string & out, const char * format, T value)
+    {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), format, value);
+        out.append(buf, n);
+    }
+
+    /** Anything else goes through its operator <<. */
+    template<typename T>
+    static void appendValue(std::string & out, const T & value)
+    {
+        std::ostringstream stream;
+        stream << value;
+        out += stream.str();
+    }
+
     template<typename Head>
-    void make_message(std::stringstream & ss, const Head & head)
+    void make_message(std::string & out, const Head & head)
     {
-        ss << head;
+        appendValue(out, head);
     }
 
     template<typename Head, typename... Tail>
-    void make_message(std::stringstream & ss, const Head & head, const Tail & ... tail)
+    void make_message(std::string & out, const Head & head, const Tail & ... tail)
     {
-        ss << head << " ";
-        make_message(ss, tail...);
+        appendValue(out, head);
+        out += ' ';
+        make_message(out, tail...);
     }
 
 };
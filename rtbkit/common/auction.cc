@@ -216,9 +216,40 @@ createDescription(AuctionResponseDescription & d) {
     d.addField("wcm", &Response::wcm, "");
 }
 
+#ifndef NDEBUG
+
+namespace {
+__thread uint64_t responseCopies = 0;
+} // file scope
+
+void
+Auction::Response::CopyCounter::
+increment()
+{
+    ++responseCopies;
+}
+
+uint64_t
+Auction::Response::
+copiesOnThisThread()
+{
+    return responseCopies;
+}
+
+#else
+
+uint64_t
+Auction::Response::
+copiesOnThisThread()
+{
+    return 0;
+}
+
+#endif
+
 Auction::
 Auction()
-    : isZombie(false), exchangeConnector(nullptr), data(new Data())
+    : isZombie(false), exchangeConnector(nullptr), data(arena.create<Data>())
 {
 }
 
@@ -236,25 +267,20 @@ Auction(ExchangeConnector * exchangeConnector,
       requestStrFormat(requestStrFormat),
       exchangeConnector(exchangeConnector),
       handleAuction(handleAuction),
-      data(new Data(numSpots()))
+      data(arena.create<Data>(numSpots()))
 {
     ML::atomic_add(created, 1);
 
     this->id = request->auctionId;
     this->requestSerialized = request->serializeToString();
+
+    budget.reset(start, expiry);
 }
 
 Auction::
 ~Auction()
 {
-    // Clean up the chain of data pointers
-    Data * d = data;
-    while (d) {
-        Data * d2 = d->oldData;
-        delete d;
-        d = d2;
-    }
-
+    // The chain of data pointers is owned by the arena.
     ML::atomic_add(destroyed, 1);
 }
 
@@ -275,9 +301,18 @@ timeUsed(Date now) const
     return start.secondsUntil(now);
 }
 
+const std::string &
+Auction::
+requestNormalized() const
+{
+    std::call_once(normalizedOnce,
+                   [&] () { normalized = request->toJsonStr(); });
+    return normalized;
+}
+
 Auction::WinLoss
 Auction::
-setResponse(int spotNum, Response newResponse)
+setResponse(int spotNum, Response && newResponse)
 {
     Data * current = this->data;
 
@@ -295,7 +330,7 @@ setResponse(int spotNum, Response newResponse)
 
     WinLoss result;
 
-    auto_ptr<Data> newData(new Data());
+    Data * newData = arena.create<Data>();
 
     for (;;) {
         if (current->tooLate)
@@ -305,23 +340,27 @@ setResponse(int spotNum, Response newResponse)
 
         bool hasExisting = current->hasValidResponse(spotNum);
 
+        auto & spot = newData->responses[spotNum];
+        size_t index = spot.size();
+
         result = newResponse.localStatus = WinLoss::PENDING;
-        newData->responses[spotNum].push_back(newResponse);
+        Auction::Price price = newResponse.price;
+        spot.push_back(std::move(newResponse));
 
         if (hasExisting) {
-            auto & spot = newData->responses[spotNum];
-            
             // Filter on priority first.
-            if (newResponse.price.priority >
+            if (price.priority >
                 current->winningResponse(spotNum).price.priority) {
                 std::swap(spot.front(), spot.back());
+                index = 0;
             }
             // If not filter on price
-            else if(newResponse.price.priority ==
+            else if(price.priority ==
                     current->winningResponse(spotNum).price.priority &&
-                    newResponse.price.maxPrice >
+                    price.maxPrice >
                     current->winningResponse(spotNum).price.maxPrice) {
                  std::swap(spot.front(), spot.back());
+                 index = 0;
             }
             else {
                 // Do nothing, whichever bid came first wins.
@@ -332,8 +371,11 @@ setResponse(int spotNum, Response newResponse)
 
         newData->oldData = current;
 
-        if (!ML::cmp_xchg(this->data, current, newData.get())) continue;
-        newData.release();
+        if (!ML::cmp_xchg(this->data, current, newData)) {
+            // Take the response back before newData is overwritten
+            newResponse = std::move(spot[index]);
+            continue;
+        }
         return result;
     }
 }
@@ -353,7 +395,7 @@ addDataSources(const std::set<std::string> & sources)
     if (sources.empty()) return;
 
     Data * current = this->data;
-    unique_ptr<Data> newData(new Data);
+    Data * newData = nullptr;
 
     for (;;) {
 
@@ -363,12 +405,12 @@ addDataSources(const std::set<std::string> & sources)
         // Nothing new was added, just bail.
         if (newSources.size() == current->dataSources.size()) return;
 
-        if (!newData) newData.reset(new Data);
+        if (!newData) newData = arena.create<Data>();
         *newData = *current;
         std::swap(newData->dataSources, newSources);
+        newData->oldData = current;
 
-        if (!ML::cmp_xchg(this->data, current, newData.get())) continue;
-        newData.release();
+        if (!ML::cmp_xchg(this->data, current, newData)) continue;
         return;
     }
 }
@@ -391,7 +433,7 @@ finish()
         if (current->tooLate)
             return false;
 
-        auto_ptr<Data> newData(new Data(*current));
+        Data * newData = arena.create<Data>(*current);
 
         for (unsigned spotNum = 0;  spotNum < numSpots(); ++spotNum) {
             if (newData->hasValidResponse(spotNum))
@@ -401,8 +443,7 @@ finish()
         newData->oldData = current;
         newData->tooLate = true;
 
-        if (!ML::cmp_xchg(this->data, current, newData.get())) continue;
-        newData.release();
+        if (!ML::cmp_xchg(this->data, current, newData)) continue;
         break;
     }
 
@@ -421,7 +462,7 @@ setError(const std::string & error, const std::string & details)
         if (current->tooLate)
             return false;
 
-        auto_ptr<Data> newData(new Data(*current));
+        Data * newData = arena.create<Data>(*current);
         
         newData->error = error;
         newData->details = details;
@@ -434,8 +475,7 @@ setError(const std::string & error, const std::string & details)
         newData->oldData = current;
         newData->tooLate = true;
 
-        if (!ML::cmp_xchg(this->data, current, newData.get())) continue;
-        newData.release();
+        if (!ML::cmp_xchg(this->data, current, newData)) continue;
         break;
     }
 
@@ -14,13 +14,17 @@
 #include "rtbkit/common/account_key.h"
 #include "rtbkit/common/augmentation.h"
 #include "rtbkit/common/win_cost_model.h"
+#include "rtbkit/common/latency_budget.h"
+#include "rtbkit/common/auction_usage.h"
 #include <boost/function.hpp>
+#include <mutex>
 #include <boost/enable_shared_from_this.hpp>
 #include "soa/jsoncpp/json.h"
 #include "soa/types/date.h"
 #include "jml/arch/atomic_ops.h"
 #include "jml/arch/exception.h"
 #include "jml/utils/compact_vector.h"
+#include "jml/utils/arena.h"
 #include "jml/db/persistent_fwd.h"
 
 namespace RTBKIT {
@@ -68,6 +72,14 @@ struct Auction : public std::enable_shared_from_this<Auction> {
     Date doneAugmenting;
     Date inStartBidding;
 
+    /** Time left to answer, charged by each stage of the pipeline. */
+    LatencyBudget budget;
+
+    /** Resources used by each stage, or null if the auction wasn't sampled
+        (see ExchangeConnector::usageSampling).
+    */
+    std::shared_ptr<AuctionUsage> usage;
+
     Id id;
     std::shared_ptr<BidRequest>  request;
     std::string requestStr;  ///< Stringified version of request
@@ -75,6 +87,12 @@ struct Auction : public std::enable_shared_from_this<Auction> {
     std::string requestSerialized; ///< Serialized bid request (canonical)
     std::string requestOriginal;
 
+    /** Canonical JSON version of the request.  Only agents that asked for
+        normalized bid requests need it so it's built on first use and then
+        shared by every one of them.
+    */
+    const std::string & requestNormalized() const;
+
     ///< AugmentationList for each augmentors.
     std::unordered_map<std::string, AugmentationList> augmentations;
     AgentAugmentations agentAugmentations; ///< per agent augmentations.
@@ -137,17 +155,17 @@ struct Auction : public std::enable_shared_from_this<Auction> {
                      = std::shared_ptr<const AgentConfig>(),
                  const SegmentList& visitChannels = SegmentList(),
                  int agentCreativeIndex = -1,
-                 const WinCostModel & wcm = WinCostModel())
+                 WinCostModel wcm = WinCostModel())
             : price(price),
               account(account),
-              test(test), agent(agent),
-              bidData(bids),
+              test(test), agent(std::move(agent)),
+              bidData(std::move(bids)),
               meta(meta),
               creativeId(creativeId),
-              agentConfig(agentConfig),
+              agentConfig(std::move(agentConfig)),
               visitChannels(visitChannels),
               agentCreativeIndex(agentCreativeIndex),
-              wcm(wcm)
+              wcm(std::move(wcm))
         {
         }
 
@@ -197,17 +215,42 @@ struct Auction : public std::enable_shared_from_this<Auction> {
         bool valid() const;
 
         static void createDescription(AuctionResponseDescription&);
+
+        /** Number of responses copied (as opposed to moved) by this thread.
+            Responses should only be moved between the router receiving a
+            bid and the post auction loop; this is how the router checks it.
+            Only counted in debug builds; always 0 otherwise.
+        */
+        static uint64_t copiesOnThisThread();
+
+#ifndef NDEBUG
+        struct CopyCounter {
+            CopyCounter() {}
+            CopyCounter(const CopyCounter &) { increment(); }
+            CopyCounter(CopyCounter &&) {}
+            CopyCounter & operator = (const CopyCounter &)
+            {
+                increment();
+                return *this;
+            }
+            CopyCounter & operator = (CopyCounter &&) { return *this; }
+            static void increment();
+        };
+
+        CopyCounter copyCounter;
+#endif
     };
 
     /** Modify the given response.  The boolean return code says whether or
         not this response was accepted (due to it being the maximum-priority
         response).
 
-        Returns the (local) status of the response.
+        Returns the (local) status of the response.  The response is moved
+        into the auction, as it's rarely small.
 
         Thread safe.
     */
-    WinLoss setResponse(int spotNum, Response newResponse);
+    WinLoss setResponse(int spotNum, Response && newResponse);
 
     /** Merges the given data sources used to make the bidding decision with the
         ones already already present in the auction.
@@ -297,6 +340,15 @@ struct Auction : public std::enable_shared_from_this<Auction> {
     }
 
 private:
+    /** Backing store for every Data object created over the life of the
+        auction, including the GC chain. Everything goes away in one shot when
+        the auction is destroyed.
+    */
+    ML::Arena arena;
+
+    mutable std::once_flag normalizedOnce;
+    mutable std::string normalized;
+
     Data * data;
 
 public:
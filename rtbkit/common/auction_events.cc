@@ -25,8 +25,14 @@ std::shared_ptr<BidRequest>
 SubmittedAuctionEvent::
 bidRequest() const
 {
-    if (!bidRequest_)
-        bidRequest_.reset(BidRequest::parse(bidRequestStrFormat, bidRequestStr));
+    if (!bidRequest_) {
+        if (!bidRequestBin_.empty()) {
+            bidRequest_ = std::make_shared<BidRequest>(
+                    BidRequest::createFromString(bidRequestBin_));
+            bidRequestBin_ = std::string();
+        }
+        else bidRequest_.reset(BidRequest::parse(bidRequestStrFormat, bidRequestStr));
+    }
     return bidRequest_;
 }
 
@@ -35,15 +41,22 @@ SubmittedAuctionEvent::
 bidRequest(std::shared_ptr<BidRequest> event)
 {
     bidRequest_ = std::move(event);
+    bidRequestBin_ = std::string();
 }
 
+/** Version 0 carried bidRequestStr; version 1 carries the canonical binary
+    bid request instead, which is both smaller and cheaper to decode.
+*/
 void
 SubmittedAuctionEvent::
 serialize(ML::DB::Store_Writer & store) const
 {
-    store << (unsigned char)0
+    store << (unsigned char)1
           << auctionId << adSpotId << lossTimeout << augmentations
-          << bidRequestStr << bidResponse << bidRequestStrFormat;
+          << bidResponse << bidRequestStrFormat;
+
+    if (!bidRequestBin_.empty()) store << bidRequestBin_;
+    else store << bidRequest()->serializeToString();
 }
 
 void
@@ -52,12 +65,20 @@ reconstitute(ML::DB::Store_Reader & store)
 {
     unsigned char version;
     store >> version;
-    if (version != 0)
-        throw ML::Exception("unknown SubmittedAuctionEvent type");
 
-    store >> auctionId >> adSpotId >> lossTimeout >> augmentations
-          >> bidRequestStr >> bidResponse >> bidRequestStrFormat;
+    bidRequest_.reset();
+    bidRequestBin_ = std::string();
 
+    if (version == 0) {
+        store >> auctionId >> adSpotId >> lossTimeout >> augmentations
+              >> bidRequestStr >> bidResponse >> bidRequestStrFormat;
+    }
+    else if (version == 1) {
+        store >> auctionId >> adSpotId >> lossTimeout >> augmentations
+              >> bidResponse >> bidRequestStrFormat >> bidRequestBin_;
+        bidRequestStr = Datacratic::UnicodeString();
+    }
+    else throw ML::Exception("unknown SubmittedAuctionEvent type");
 }
 
 SubmittedAuctionEventDescription::
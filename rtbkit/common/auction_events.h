@@ -30,6 +30,11 @@ namespace RTBKIT {
 
 /** When a submitted bid is transferred from the router to the post auction
     loop, it looks like this.
+
+    The binary form carries the bid request in its canonical binary
+    serialization rather than as the exchange's JSON, and reconstitute()
+    keeps it encoded until bidRequest() is first called.  bidRequestStr is
+    therefore empty on events reconstituted from the binary form.
 */
 
 struct SubmittedAuctionEvent {
@@ -41,6 +46,12 @@ struct SubmittedAuctionEvent {
     std::shared_ptr<BidRequest> bidRequest() const;
     void bidRequest(std::shared_ptr<BidRequest> event);
 
+    /** Whether a bid request was set or received with the event. */
+    bool hasBidRequest() const
+    {
+        return bidRequest_ || !bidRequestBin_.empty() || !bidRequestStr.empty();
+    }
+
     Datacratic::UnicodeString bidRequestStr;     ///< Bid request as string on the wire
     Auction::Response bidResponse; ///< Bid response that was sent
     std::string bidRequestStrFormat;  ///< Format of stringified request(i.e "datacratic")
@@ -50,6 +61,9 @@ struct SubmittedAuctionEvent {
 
 private:
     mutable std::shared_ptr<BidRequest> bidRequest_;  ///< Bid request
+
+    /// BidRequest::serializeToString() of the bid request, until decoded
+    mutable std::string bidRequestBin_;
 };
 
 CREATE_STRUCTURE_DESCRIPTION(SubmittedAuctionEvent)
@@ -0,0 +1,267 @@
+/* auction_tracer.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Sampled tracing of auctions through the stack.
+*/
+
+#include "auction_tracer.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+namespace {
+
+template<size_t N>
+void copyString(char (&dest)[N], const std::string & str)
+{
+    size_t size = std::min(str.size(), N - 1);
+    memcpy(dest, str.c_str(), size);
+    dest[size] = 0;
+}
+
+/** Small integer identifying the current thread. */
+unsigned threadIndex()
+{
+    static std::atomic<unsigned> nextIndex(0);
+    static __thread int index = -1;
+
+    if (index == -1)
+        index = nextIndex.fetch_add(1);
+    return index;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* AUCTION TRACE EVENT                                                       */
+/*****************************************************************************/
+
+AuctionTraceEvent::
+AuctionTraceEvent()
+    : type(""), value(0.0)
+{
+    auction[0] = spot[0] = actor[0] = 0;
+}
+
+Json::Value
+AuctionTraceEvent::
+toJson() const
+{
+    Json::Value result;
+    result["timestamp"] = timestamp.secondsSinceEpoch();
+    result["type"] = type;
+    result["auction"] = auction;
+    if (spot[0])
+        result["spot"] = spot;
+    if (actor[0])
+        result["actor"] = actor;
+    if (value != 0.0)
+        result["value"] = value;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* AUCTION TRACER                                                            */
+/*****************************************************************************/
+
+struct AuctionTracer::Buffer {
+    Buffer(size_t size)
+        : events(size), head(0), drained(0)
+    {
+    }
+
+    std::vector<AuctionTraceEvent> events;
+
+    /// Number of events ever written; the next goes at head % size
+    std::atomic<uint64_t> head;
+
+    /// Events up to here were passed to drain()
+    uint64_t drained;
+};
+
+AuctionTracer::
+AuctionTracer(size_t eventsPerThread)
+    : eventsPerThread(eventsPerThread), threshold(0), numDropped(0)
+{
+    if (eventsPerThread == 0)
+        throw ML::Exception("auction tracer needs room for events");
+    for (auto & buffer : buffers)
+        buffer = nullptr;
+}
+
+AuctionTracer::
+~AuctionTracer()
+{
+    for (auto & buffer : buffers)
+        delete buffer.load();
+}
+
+void
+AuctionTracer::
+setSampleRate(double rate)
+{
+    if (rate < 0.0 || rate > 1.0)
+        throw ML::Exception("invalid auction trace sample rate %f", rate);
+
+    uint64_t limit;
+    if (rate == 0.0)
+        limit = 0;
+    else if (rate == 1.0)
+        limit = std::numeric_limits<uint64_t>::max();
+    else limit = rate * std::numeric_limits<uint64_t>::max();
+
+    threshold.store(limit, std::memory_order_relaxed);
+}
+
+double
+AuctionTracer::
+sampleRate() const
+{
+    return 1.0 * threshold.load() / std::numeric_limits<uint64_t>::max();
+}
+
+AuctionTracer::Buffer *
+AuctionTracer::
+threadBuffer()
+{
+    unsigned index = threadIndex();
+    if (index >= MaxThreads)
+        return nullptr;
+
+    Buffer * buffer = buffers[index].load(std::memory_order_acquire);
+    if (!buffer) {
+        // Only this thread ever sets its slot
+        buffer = new Buffer(eventsPerThread);
+        buffers[index].store(buffer, std::memory_order_release);
+    }
+    return buffer;
+}
+
+void
+AuctionTracer::
+recordImpl(const Id & auction, const Id & spot, const char * type,
+           const std::string & actor, double value)
+{
+    Buffer * buffer = threadBuffer();
+    if (!buffer) {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    AuctionTraceEvent & event = buffer->events[head % buffer->events.size()];
+
+    event.timestamp = Date::now();
+    event.type = type;
+    copyString(event.auction, auction.toString());
+    copyString(event.spot, spot ? spot.toString() : std::string());
+    copyString(event.actor, actor);
+    event.value = value;
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+uint64_t
+AuctionTracer::
+copyEvents(const Buffer & buffer, uint64_t begin,
+           std::vector<AuctionTraceEvent> & events) const
+{
+    uint64_t size = buffer.events.size();
+    uint64_t end = buffer.head.load(std::memory_order_acquire);
+    begin = std::max(begin, end > size ? end - size : 0);
+
+    size_t first = events.size();
+    for (uint64_t i = begin;  i < end;  ++i)
+        events.push_back(buffer.events[i % size]);
+
+    // Anything that the writer may have reached while we were copying,
+    // including the slot it's writing now, is unreliable; drop it.
+    uint64_t after = buffer.head.load(std::memory_order_acquire) + 1;
+    if (after > begin + size) {
+        uint64_t overwritten = std::min(after - size - begin, end - begin);
+        events.erase(events.begin() + first,
+                     events.begin() + first + overwritten);
+    }
+
+    return end;
+}
+
+std::vector<AuctionTraceEvent>
+AuctionTracer::
+collect(const Id & auction) const
+{
+    std::string id = auction.toString();
+
+    std::vector<AuctionTraceEvent> events;
+    for (const auto & slot : buffers) {
+        const Buffer * buffer = slot.load(std::memory_order_acquire);
+        if (!buffer) continue;
+
+        std::vector<AuctionTraceEvent> all;
+        copyEvents(*buffer, 0, all);
+        for (const auto & event : all)
+            if (!strncmp(event.auction, id.c_str(), sizeof event.auction - 1))
+                events.push_back(event);
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [] (const AuctionTraceEvent & e1,
+                         const AuctionTraceEvent & e2)
+                     {
+                         return e1.timestamp < e2.timestamp;
+                     });
+    return events;
+}
+
+uint64_t
+AuctionTracer::
+drain(const std::function<void (const AuctionTraceEvent &)> & onEvent)
+{
+    uint64_t lost = numDropped.exchange(0);
+
+    std::vector<AuctionTraceEvent> events;
+    for (auto & slot : buffers) {
+        Buffer * buffer = slot.load(std::memory_order_acquire);
+        if (!buffer) continue;
+
+        events.clear();
+        uint64_t begin = buffer->drained;
+        uint64_t end = copyEvents(*buffer, begin, events);
+        lost += (end - begin) - events.size();
+        buffer->drained = end;
+
+        for (const auto & event : events)
+            onEvent(event);
+    }
+
+    return lost;
+}
+
+Json::Value
+AuctionTracer::
+timeline(const Id & auction) const
+{
+    Json::Value result(Json::arrayValue);
+    for (const auto & event : collect(auction))
+        result.append(event.toJson());
+    return result;
+}
+
+AuctionTracer &
+AuctionTracer::
+instance()
+{
+    static AuctionTracer tracer;
+    return tracer;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,142 @@
+/* auction_tracer.h                                                -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Sampled tracing of auctions through the stack.
+*/
+
+#pragma once
+
+#include "soa/types/id.h"
+#include "soa/types/date.h"
+#include "soa/jsoncpp/value.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RTBKIT {
+
+using Datacratic::Id;
+using Datacratic::Date;
+
+
+/*****************************************************************************/
+/* AUCTION TRACE EVENT                                                       */
+/*****************************************************************************/
+
+/** Something that happened to a traced auction.  It's a fixed size record
+    without pointers to the heap, so it can be copied out of a buffer that's
+    being written to and discarded if it was overwritten in the meantime.
+*/
+struct AuctionTraceEvent {
+    AuctionTraceEvent();
+
+    Date timestamp;
+    const char * type;          ///< Must be a string literal
+    char auction[48];           ///< Auction id, truncated if needed
+    char spot[24];              ///< Spot id, empty for auction events
+    char actor[48];             ///< Agent or augmentor involved, if any
+    double value;               ///< Meaning depends on the type
+
+    Json::Value toJson() const;
+};
+
+
+/*****************************************************************************/
+/* AUCTION TRACER                                                            */
+/*****************************************************************************/
+
+/** Records what happens to a sample of auctions.
+
+    Sampling is decided on the hash of the auction id so that each service
+    traces the same auctions without having to agree on anything but the
+    rate, and the timelines recorded by the router, augmentors, agents and
+    post auction loop can be merged afterwards on the auction id.
+
+    Each thread records into its own fixed size ring buffer; when it wraps
+    the oldest events are lost.  Nothing is locked on the recording path.
+*/
+struct AuctionTracer {
+
+    /** Threads of the process beyond this number don't get a buffer and
+        their events are counted as lost.
+    */
+    enum { MaxThreads = 256 };
+
+    AuctionTracer(size_t eventsPerThread = 4096);
+    ~AuctionTracer();
+
+    AuctionTracer(const AuctionTracer &) = delete;
+    AuctionTracer & operator = (const AuctionTracer &) = delete;
+
+    /** Fraction of the auctions to trace, between 0 and 1. */
+    void setSampleRate(double rate);
+    double sampleRate() const;
+
+    bool enabled() const
+    {
+        return threshold.load(std::memory_order_relaxed) != 0;
+    }
+
+    bool sampled(const Id & auction) const
+    {
+        uint64_t limit = threshold.load(std::memory_order_relaxed);
+        return limit && auction.hash() <= limit;
+    }
+
+    /** Record an event if the auction is sampled. */
+    void record(const Id & auction, const char * type,
+                const std::string & actor = "", double value = 0.0)
+    {
+        if (sampled(auction))
+            recordImpl(auction, Id(), type, actor, value);
+    }
+
+    void recordSpot(const Id & auction, const Id & spot, const char * type,
+                    const std::string & actor = "", double value = 0.0)
+    {
+        if (sampled(auction))
+            recordImpl(auction, spot, type, actor, value);
+    }
+
+    /** Events of the given auction that are still in the buffers, in
+        chronological order.
+    */
+    std::vector<AuctionTraceEvent> collect(const Id & auction) const;
+
+    /** Call onEvent for each event recorded since the previous call to
+        drain(), for exporting.  Must not be called concurrently with
+        itself.  Returns the number of events lost to buffers wrapping.
+    */
+    uint64_t drain(const std::function<void (const AuctionTraceEvent &)>
+                       & onEvent);
+
+    /** Json array with the timeline of the given auction. */
+    Json::Value timeline(const Id & auction) const;
+
+    /** Tracer shared by the components of the process. */
+    static AuctionTracer & instance();
+
+private:
+    struct Buffer;
+
+    void recordImpl(const Id & auction, const Id & spot, const char * type,
+                    const std::string & actor, double value);
+
+    Buffer * threadBuffer();
+
+    /** Copy out the events of the buffer in [begin, end), skipping those
+        that were overwritten while copying.  Returns the new begin.
+    */
+    uint64_t copyEvents(const Buffer & buffer, uint64_t begin,
+                        std::vector<AuctionTraceEvent> & events) const;
+
+    size_t eventsPerThread;
+    std::atomic<uint64_t> threshold;
+    std::atomic<uint64_t> numDropped;
+    std::atomic<Buffer *> buffers[MaxThreads];
+};
+
+} // namespace RTBKIT
@@ -0,0 +1,203 @@
+/* auction_usage.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   CPU time and allocations used by each stage of an auction.
+*/
+
+#include "auction_usage.h"
+#include "jml/arch/exception.h"
+#include "soa/utils/allocation_counts.h"
+
+#include <time.h>
+
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AUCTION USAGE                                                             */
+/*****************************************************************************/
+
+AuctionUsage::
+AuctionUsage()
+{
+    for (int stage = 0;  stage < NUM_STAGES;  ++stage) {
+        cpuNs[stage] = 0;
+        allocations[stage] = 0;
+        bytes[stage] = 0;
+    }
+}
+
+AuctionUsage::Counts
+AuctionUsage::Counts::
+operator - (const Counts & other) const
+{
+    Counts result;
+    result.cpuNs = cpuNs - other.cpuNs;
+    result.allocations = allocations - other.allocations;
+    result.bytes = bytes - other.bytes;
+    return result;
+}
+
+Json::Value
+AuctionUsage::Counts::
+toJson() const
+{
+    Json::Value result;
+    result["cpuUs"] = cpuNs / 1000.0;
+    result["allocations"] = allocations;
+    result["bytes"] = bytes;
+    return result;
+}
+
+AuctionUsage::Counts
+AuctionUsage::
+threadCounts()
+{
+    Counts result;
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        result.cpuNs = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    AllocationCounts allocs = AllocationCounts::currentThread();
+    result.allocations = allocs.allocations;
+    result.bytes = allocs.bytes;
+
+    return result;
+}
+
+AuctionUsage::Counts
+AuctionUsage::Meter::
+stop()
+{
+    if (!usage)
+        return Counts();
+
+    Counts used = threadCounts() - before;
+    usage->charge(stage, used);
+    usage = nullptr;
+    return used;
+}
+
+void
+AuctionUsage::
+charge(Stage stage, const Counts & counts)
+{
+    cpuNs[stage].fetch_add(counts.cpuNs, std::memory_order_relaxed);
+    allocations[stage].fetch_add(counts.allocations,
+                                 std::memory_order_relaxed);
+    bytes[stage].fetch_add(counts.bytes, std::memory_order_relaxed);
+}
+
+AuctionUsage::Counts
+AuctionUsage::
+charged(Stage stage) const
+{
+    Counts result;
+    result.cpuNs = cpuNs[stage].load(std::memory_order_relaxed);
+    result.allocations = allocations[stage].load(std::memory_order_relaxed);
+    result.bytes = bytes[stage].load(std::memory_order_relaxed);
+    return result;
+}
+
+AuctionUsage::Counts
+AuctionUsage::
+total() const
+{
+    Counts result;
+    for (int stage = 0;  stage < NUM_STAGES;  ++stage)
+        result += charged(Stage(stage));
+    return result;
+}
+
+const char *
+AuctionUsage::
+stageName(Stage stage)
+{
+    switch (stage) {
+    case PARSE:      return "parse";
+    case FILTER:     return "filter";
+    case AUGMENT:    return "augment";
+    case AGENT_SEND: return "agentSend";
+    case BID:        return "bid";
+    case SUBMIT:     return "submit";
+    default:
+        throw ML::Exception("unknown auction usage stage %d", stage);
+    }
+}
+
+Json::Value
+AuctionUsage::
+toJson() const
+{
+    Json::Value result;
+    for (int stage = 0;  stage < NUM_STAGES;  ++stage)
+        result[stageName(Stage(stage))] = charged(Stage(stage)).toJson();
+    result["total"] = total().toJson();
+    return result;
+}
+
+
+/*****************************************************************************/
+/* AUCTION USAGE TOTALS                                                      */
+/*****************************************************************************/
+
+void
+AuctionUsageTotals::
+add(const std::string & key, const AuctionUsage & usage)
+{
+    Guard guard(lock);
+    Entry & entry = entries[key];
+    entry.auctions += 1;
+    for (int stage = 0;  stage < AuctionUsage::NUM_STAGES;  ++stage)
+        entry.stages[stage] += usage.charged(AuctionUsage::Stage(stage));
+}
+
+void
+AuctionUsageTotals::
+clear()
+{
+    Guard guard(lock);
+    entries.clear();
+}
+
+Json::Value
+AuctionUsageTotals::
+toJson() const
+{
+    Guard guard(lock);
+
+    Json::Value result(Json::objectValue);
+    for (const auto & item : entries) {
+        const Entry & entry = item.second;
+        Json::Value & json = result[item.first];
+        json["auctions"] = entry.auctions;
+
+        AuctionUsage::Counts total;
+        for (int stage = 0;  stage < AuctionUsage::NUM_STAGES;  ++stage) {
+            const AuctionUsage::Counts & counts = entry.stages[stage];
+            total += counts;
+
+            Json::Value & stageJson
+                = json["stages"][AuctionUsage::stageName
+                                 (AuctionUsage::Stage(stage))];
+            stageJson["cpuUsPerAuction"]
+                = counts.cpuNs / 1000.0 / entry.auctions;
+            stageJson["allocationsPerAuction"]
+                = double(counts.allocations) / entry.auctions;
+            stageJson["bytesPerAuction"]
+                = double(counts.bytes) / entry.auctions;
+        }
+
+        json["cpuUsPerAuction"] = total.cpuNs / 1000.0 / entry.auctions;
+        json["allocationsPerAuction"]
+            = double(total.allocations) / entry.auctions;
+        json["bytesPerAuction"] = double(total.bytes) / entry.auctions;
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,155 @@
+/* auction_usage.h                                                 -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   CPU time and allocations used by each stage of an auction.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/value.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AUCTION USAGE                                                             */
+/*****************************************************************************/
+
+/** Resources used by each stage of an auction: the CPU time of the threads
+    that worked on it, and the number and size of the allocations that they
+    made.  Allocations are only counted in programs that include
+    "soa/utils/count_allocations.h"; elsewhere they read as zero.
+
+    Measuring costs two clock_gettime() calls per stage, so it's only done
+    for a sample of the auctions (see ExchangeConnector::usageSampling);
+    the others have no AuctionUsage and their Meters do nothing.
+*/
+struct AuctionUsage {
+
+    AuctionUsage();
+
+    enum Stage {
+        PARSE,           ///< parsing by the exchange connector
+        FILTER,          ///< filters and the rest of preprocessAuction
+        AUGMENT,         ///< sending to and receiving from the augmentors
+        AGENT_SEND,      ///< dynamic filters and sending to the agents
+        BID,             ///< processing of the bids of the agents
+        SUBMIT,          ///< submission of the auction once it's finished
+
+        NUM_STAGES
+    };
+
+    struct Counts {
+        Counts()
+            : cpuNs(0), allocations(0), bytes(0)
+        {
+        }
+
+        Counts & operator += (const Counts & other)
+        {
+            cpuNs += other.cpuNs;
+            allocations += other.allocations;
+            bytes += other.bytes;
+            return *this;
+        }
+
+        Counts operator - (const Counts & other) const;
+
+        Json::Value toJson() const;
+
+        uint64_t cpuNs;          ///< CPU time in nanoseconds
+        uint64_t allocations;    ///< Number of operator new calls
+        uint64_t bytes;          ///< Bytes allocated by them
+    };
+
+    /** What the calling thread has used since it started. */
+    static Counts threadCounts();
+
+    /** Charges what the calling thread uses whilst it's in scope to the
+        given stage of the usage.  Does nothing if the usage is null, so
+        that it can be used unconditionally.
+    */
+    struct Meter {
+        Meter(AuctionUsage * usage, Stage stage)
+            : usage(usage), stage(stage)
+        {
+            if (usage)
+                before = threadCounts();
+        }
+
+        ~Meter()
+        {
+            stop();
+        }
+
+        /** Charge what was used so far and stop measuring.  Returns what
+            was charged.
+        */
+        Counts stop();
+
+        AuctionUsage * usage;
+        Stage stage;
+        Counts before;
+    };
+
+    void charge(Stage stage, const Counts & counts);
+
+    Counts charged(Stage stage) const;
+
+    /** Sum over all of the stages. */
+    Counts total() const;
+
+    static const char * stageName(Stage stage);
+
+    Json::Value toJson() const;
+
+private:
+    std::atomic<uint64_t> cpuNs[NUM_STAGES];
+    std::atomic<uint64_t> allocations[NUM_STAGES];
+    std::atomic<uint64_t> bytes[NUM_STAGES];
+};
+
+
+/*****************************************************************************/
+/* AUCTION USAGE TOTALS                                                      */
+/*****************************************************************************/
+
+/** Usage of the sampled auctions added up by a key such as the exchange or
+    the agent.  Thread safe.
+*/
+struct AuctionUsageTotals {
+
+    void add(const std::string & key, const AuctionUsage & usage);
+
+    void clear();
+
+    /** For each key, the number of auctions and the usage per auction of
+        each stage.
+    */
+    Json::Value toJson() const;
+
+private:
+    struct Entry {
+        Entry()
+            : auctions(0)
+        {
+        }
+
+        uint64_t auctions;
+        AuctionUsage::Counts stages[AuctionUsage::NUM_STAGES];
+    };
+
+    typedef std::mutex Lock;
+    typedef std::unique_lock<Lock> Guard;
+
+    mutable Lock lock;
+    std::map<std::string, Entry> entries;
+};
+
+} // namespace RTBKIT
@@ -185,4 +185,109 @@ fromJson(const Json::Value& json)
     return list;
 }
 
+
+/******************************************************************************/
+/* AUGMENTATION INDEX                                                         */
+/******************************************************************************/
+
+AugmentationIndex::
+AugmentationIndex(
+        const unordered_map<string, AugmentationList>& augmentations)
+{
+    augmentors.reserve(augmentations.size());
+
+    for (const auto& entry : augmentations) {
+        const AugmentationList& list = entry.second;
+
+        Augmentor augmentor;
+        augmentor.name = entry.first;
+
+        string prefix = Json::Value(entry.first).toStringNoNewLine() + ":";
+
+        auto makeFragment = [&] (const AccountKey& key, Fragment& fragment)
+            {
+                fragment.key = key;
+                fragment.tags = list.tagsForAccount(key);
+                try {
+                    Augmentation aug = list.filterForAccount(key);
+                    fragment.str = prefix + aug.toJson().toStringNoNewLine();
+                }
+                catch (...) {
+                    fragment.error = std::current_exception();
+                }
+            };
+
+        augmentor.none.str = prefix + Augmentation().toJson().toStringNoNewLine();
+        augmentor.fragments.resize(list.size());
+        size_t i = 0;
+        for (const auto& aug : list)
+            makeFragment(aug.first, augmentor.fragments[i++]);
+
+        augmentors.emplace_back(std::move(augmentor));
+    }
+
+    sort(augmentors.begin(), augmentors.end(),
+            [] (const Augmentor& lhs, const Augmentor& rhs)
+            {
+                return lhs.name < rhs.name;
+            });
+}
+
+const AugmentationIndex::Fragment&
+AugmentationIndex::Augmentor::
+forAccount(const AccountKey& account) const
+{
+    const Fragment* result = &none;
+    size_t longest = 0;
+
+    for (const Fragment& fragment : fragments) {
+        const AccountKey& key = fragment.key;
+        if (key.size() > account.size()) continue;
+        if (result != &none && key.size() <= longest) continue;
+        if (!std::equal(key.begin(), key.end(), account.begin())) continue;
+
+        result = &fragment;
+        longest = key.size();
+    }
+
+    return *result;
+}
+
+const vector<string>*
+AugmentationIndex::
+tagsForAccount(const string& augmentor, const AccountKey& account) const
+{
+    auto it = lower_bound(augmentors.begin(), augmentors.end(), augmentor,
+            [] (const Augmentor& lhs, const string& name)
+            {
+                return lhs.name < name;
+            });
+
+    if (it == augmentors.end() || it->name != augmentor) return nullptr;
+    return &it->forAccount(account).tags;
+}
+
+string
+AugmentationIndex::
+serializeForAccount(
+        const AccountKey& account,
+        const function<bool (const string&)>& include) const
+{
+    string result;
+
+    for (const Augmentor& augmentor : augmentors) {
+        if (!include(augmentor.name)) continue;
+
+        const Fragment& fragment = augmentor.forAccount(account);
+        if (fragment.error) std::rethrow_exception(fragment.error);
+
+        result += result.empty() ? '{' : ',';
+        result += fragment.str;
+    }
+
+    if (result.empty()) return "null";
+    result += '}';
+    return result;
+}
+
 } // namespace RTBKIT
@@ -14,6 +14,10 @@
 
 #include <set>
 #include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <exception>
 
 namespace RTBKIT {
 
@@ -87,6 +91,65 @@ struct AugmentationList : public AugmentationListBase
 };
 
 
+
+/******************************************************************************/
+/* AUGMENTATION INDEX                                                         */
+/******************************************************************************/
+
+/** Immutable view of the augmentations of an auction that serializes each
+    agent's filtered augmentations by concatenating pre-serialized fragments.
+
+    What filterForAccount() returns only depends on the longest key of the
+    list that is a prefix of the account, so the index serializes, for every
+    augmentor, the result for each key of its list up front.  Serializing the
+    augmentations of an account is then a matter of picking the fragment of
+    each augmentor and joining them, without merging any Json or building
+    any AccountKey.  The output is the same as the one of the Json::Value
+    that maps each augmentor to filterForAccount(account).toJson().
+ */
+struct AugmentationIndex
+{
+    AugmentationIndex() {}
+
+    explicit AugmentationIndex(
+            const std::unordered_map<std::string, AugmentationList>& augmentations);
+
+    /** Serialized augmentations of the given account restricted to the
+        augmentors for which include returns true.
+     */
+    std::string serializeForAccount(
+            const AccountKey& account,
+            const std::function<bool (const std::string&)>& include) const;
+
+    /** Same as tagsForAccount() on the augmentor's list, or null if the
+        auction has no augmentation from that augmentor.
+     */
+    const std::vector<std::string>* tagsForAccount(
+            const std::string& augmentor, const AccountKey& account) const;
+
+private:
+
+    struct Fragment
+    {
+        AccountKey key;
+        std::string str;             ///< "augmentor":{...}
+        std::vector<std::string> tags;
+        std::exception_ptr error;    ///< Thrown when the data can't merge
+    };
+
+    struct Augmentor
+    {
+        std::string name;
+        std::vector<Fragment> fragments;
+        Fragment none;               ///< When no key is a prefix of the account
+
+        const Fragment& forAccount(const AccountKey& account) const;
+    };
+
+    std::vector<Augmentor> augmentors;  ///< Sorted by name like a Json object
+};
+
+
 } // namespace RTBKIT
 
 #endif // __rtb__augmentation_h__
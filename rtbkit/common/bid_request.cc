@@ -836,7 +836,7 @@ UserIds::
 serialize(ML::DB::Store_Writer & store) const
 {
     unsigned char version = 0;
-    store << version << (map<std::string, Id> &)(*this);
+    store << version << (const ML::compact_map<std::string, Id> &)(*this);
 }
 
 void
@@ -847,7 +847,7 @@ reconstitute(ML::DB::Store_Reader & store)
     store >> version;
     if (version != 0)
         throw ML::Exception("invalid UserIds version");
-    store >> (map<std::string, Id> &)*this;
+    store >> (ML::compact_map<std::string, Id> &)*this;
 }
 
 struct UserIdsDescription
@@ -1130,9 +1130,21 @@ struct CanonicalParser {
     }
 };
 
+/** Parser for the binary encoding produced by serializeToString(), as sent
+    by the router to agents configured with the "binaryV1" format.
+*/
+struct BinaryParser {
+
+    static BidRequest * parse(const std::string & str)
+    {
+        return new BidRequest(BidRequest::createFromString(str));
+    }
+};
+
 struct AtInit {
     AtInit()
     {
+        PluginInterface<BidRequest>::registerPlugin("rtbkit-binary-v1", BinaryParser::parse);
         PluginInterface<BidRequest>::registerPlugin("recoset", CanonicalParser::parse);
         PluginInterface<BidRequest>::registerPlugin("datacratic", CanonicalParser::parse);
         PluginInterface<BidRequest>::registerPlugin("rtbkit", CanonicalParser::parse);
@@ -1254,17 +1266,54 @@ operator >> (ML::DB::Store_Reader & store, Json::Value & val)
 }
 
 
+/** The OpenRTB sub-objects are sparse and deeply nested, so rather than
+    hand-maintain a binary layout for each of them they are stored as a
+    length-prefixed JSON string produced by their value description.
+*/
+template<typename T>
+void serializeDescribed(ML::DB::Store_Writer & store, const T & val)
+{
+    static DefaultDescription<T> desc;
+    std::ostringstream stream;
+    StreamJsonPrintingContext context(stream);
+    desc.printJson(&val, context);
+    store << stream.str();
+}
+
+template<typename T>
+void reconstituteDescribed(ML::DB::Store_Reader & store, T & val)
+{
+    static DefaultDescription<T> desc;
+    string s;
+    store >> s;
+    StreamingJsonParsingContext context;
+    context.init("bid request", s.c_str(), s.size());
+    desc.parseJson(&val, context);
+}
+
 void
 BidRequest::
 serialize(ML::DB::Store_Writer & store) const
 {
     using namespace ML::DB;
-    unsigned char version = 2;
+    unsigned char version = 3;
     store << version << auctionId << language << protocolVersion
           << exchange << provider << timestamp << isTest
           << location << userIds << imp << url << ipAddress << userAgent
           << restrictions << segments << meta
           << winSurcharges;
+
+    // Version 3: everything else, so that the binary form is lossless
+    store << auctionType.val << timeAvailableMs << userAgentIPHash
+          << unparseable << ext;
+    serializeDescribed(store, site);
+    serializeDescribed(store, app);
+    serializeDescribed(store, device);
+    serializeDescribed(store, user);
+    serializeDescribed(store, regs);
+    serializeDescribed(store, bidCurrency);
+    serializeDescribed(store, blockedCategories);
+    serializeDescribed(store, badv);
 }
 
 void
@@ -1277,7 +1326,7 @@ reconstitute(ML::DB::Store_Reader & store)
 
     store >> version;
 
-    if (version != 2)
+    if (version != 2 && version != 3)
         throw ML::Exception("problem reconstituting BidRequest: "
                             "invalid version");
 
@@ -1285,6 +1334,20 @@ reconstitute(ML::DB::Store_Reader & store)
           >> exchange >> provider >> timestamp >> isTest
           >> location >> userIds >> imp >> url >> ipAddress >> userAgent
           >> restrictions >> segments >> meta >> winSurcharges;
+
+    if (version < 3)
+        return;
+
+    store >> auctionType.val >> timeAvailableMs >> userAgentIPHash
+          >> unparseable >> ext;
+    reconstituteDescribed(store, site);
+    reconstituteDescribed(store, app);
+    reconstituteDescribed(store, device);
+    reconstituteDescribed(store, user);
+    reconstituteDescribed(store, regs);
+    reconstituteDescribed(store, bidCurrency);
+    reconstituteDescribed(store, blockedCategories);
+    reconstituteDescribed(store, badv);
 }
 
 } // namespace RTBKIT
@@ -13,6 +13,7 @@
 #include "soa/types/string.h"
 #include "jml/arch/exception.h"
 #include "jml/utils/compact_vector.h"
+#include "jml/utils/compact_map.h"
 #include "jml/utils/less.h"
 #include <boost/function.hpp>
 #include "soa/types/id.h"
@@ -175,7 +176,10 @@ enum IdDomain {
 
 /** Information known about a user and passed in as part of the bid */
 
-struct UserIds : public std::map<std::string, Id> {
+/** User ids by domain.  A request rarely carries more than a handful, so they
+    are kept inline in a sorted vector rather than in a node-based map.
+*/
+struct UserIds : public ML::compact_map<std::string, Id> {
 
     void add(const Id & id, IdDomain domain);
     void add(const Id & id, const std::string & domain);
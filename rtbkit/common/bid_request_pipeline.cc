@@ -30,4 +30,32 @@ BidRequestPipeline::create(
     return std::shared_ptr<BidRequestPipeline>(factory(std::move(serviceName), std::move(proxies), json));
 }
 
+namespace {
+
+std::future<PipelineStatus> readyFuture(PipelineStatus status)
+{
+    std::promise<PipelineStatus> promise;
+    promise.set_value(status);
+    return promise.get_future();
+}
+
+} // file scope
+
+std::future<PipelineStatus>
+BidRequestPipeline::preBidRequestAsync(
+        const ExchangeConnector* exchange,
+        const Datacratic::HttpHeader& header,
+        const std::string& payload)
+{
+    return readyFuture(preBidRequest(exchange, header, payload));
+}
+
+std::future<PipelineStatus>
+BidRequestPipeline::postBidRequestAsync(
+        const ExchangeConnector* exchange,
+        const std::shared_ptr<Auction>& auction)
+{
+    return readyFuture(postBidRequest(exchange, auction));
+}
+
 } // namespace RTBKIT
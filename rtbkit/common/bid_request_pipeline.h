@@ -12,6 +12,7 @@
 #include "soa/jsoncpp/json.h"
 #include "rtbkit/common/exchange_connector.h"
 #include "rtbkit/common/bid_request.h"
+#include <future>
 #include <string>
 #include <memory>
 
@@ -52,6 +53,27 @@ public:
             const ExchangeConnector* exchange,
             const std::shared_ptr<Auction>& auction) = 0;
 
+    /** Asynchronous versions of the above, for the stages that wait on
+        something else (a cookie sync or fraud score lookup for example) and
+        are run by a MultiBidRequestPipeline.  The default runs the
+        synchronous version and returns a ready future.
+
+        The header and payload are only valid until the call returns so they
+        have to be copied if they're needed later.  The future should come
+        from a std::promise rather than std::async, whose future blocks on
+        destruction, so that a stage that times out can be left behind.
+    */
+    virtual std::future<PipelineStatus>
+    preBidRequestAsync(
+            const ExchangeConnector* exchange,
+            const Datacratic::HttpHeader& header,
+            const std::string& payload);
+
+    virtual std::future<PipelineStatus>
+    postBidRequestAsync(
+            const ExchangeConnector* exchange,
+            const std::shared_ptr<Auction>& auction);
+
 };
 
 } // namespace RTBKIT
@@ -106,6 +106,17 @@ struct BidderInterface : public ServiceBase
 
     virtual void registerLoopMonitor(LoopMonitor *monitor) const { }
 
+    /** An agent offered to receive its messages through the shared memory
+        ring at the given path (see ShmMessageRing), which is only there if
+        the agent is on this host.  Returns true if the interface is going to
+        use it.  The default sticks to the regular transport.
+    */
+    virtual bool acceptSharedMemory(std::string const & agent,
+                                    std::string const & path)
+    {
+        return false;
+    }
+
     //
     // factory
     //
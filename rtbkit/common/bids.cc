@@ -11,6 +11,9 @@
 #include "jml/utils/exc_check.h"
 #include "jml/utils/json_parsing.h"
 
+#include <cerrno>
+#include <cstring>
+
 using namespace std;
 using namespace ML;
 
@@ -74,6 +77,29 @@ BidStatus bidStatusFromString(const std::string& str)
 /* BID                                                                        */
 /******************************************************************************/
 
+namespace {
+
+/** Parses an amount straight out of the JSON string without allocating. */
+Amount expectJsonAmount(ML::Parse_Context& context)
+{
+    char buf[64];
+    ssize_t len = expectJsonStringAscii(context, buf, sizeof buf);
+    ExcCheck(len > 0, "invalid bid price");
+
+    if (len == 1 && buf[0] == '0')
+        return Amount();
+
+    char * ep = 0;
+    errno = 0;
+    long long value = strtoll(buf, &ep, 10);
+    ExcCheck(errno == 0 && ep != buf, "invalid bid price");
+    ExcCheck(*ep, "no currency on bid price");
+
+    return Amount(Amount::parseCurrency(ep), value);
+}
+
+} // file scope
+
 void
 Bid::
 bid(int creativeIndex, Amount price, double priority)
@@ -123,52 +149,52 @@ fromJson(ML::Parse_Context& context)
     if (context.match_literal("null") || context.match_literal("{}"))
         return bid;  // null bid
 
-    auto onBidField = [&] (
-            const std::string& fieldName, ML::Parse_Context& context)
+    auto onBidField = [&] (const char * fieldName, ML::Parse_Context& context)
         {
-            ExcCheck(!fieldName.empty(), "invalid empty field name");
+            ExcCheck(*fieldName, "invalid empty field name");
 
             bool foundField = true;
             switch(fieldName[0]) {
 
             case 'a':
-                if (fieldName == "account")
+                if (!strcmp(fieldName, "account"))
                     bid.account = AccountKey(expectJsonStringAscii(context));
 
                 else foundField = false;
                 break;
 
             case 'c':
-                if (fieldName == "creative")
+                if (!strcmp(fieldName, "creative"))
                     bid.creativeIndex = context.expect_int();
 
                 else foundField = false;
                 break;
 
-	    case 'e':
-	      if (fieldName == "ext"){
-		  bid.ext = expectJson(context);
-	      }
-		else
-		  foundField = false;
-		break;
+            case 'e':
+                if (!strcmp(fieldName, "ext")) {
+                    if (!matchJsonNull(context))
+                        bid.ext = expectJson(context);
+                }
+
+                else foundField = false;
+                break;
 
             case 'p':
-                if (fieldName == "price")
-                    bid.price = Amount::parse(expectJsonStringAscii(context));
+                if (!strcmp(fieldName, "price"))
+                    bid.price = expectJsonAmount(context);
 
-                else if (fieldName == "priority")
+                else if (!strcmp(fieldName, "priority"))
                     bid.priority = context.expect_double();
 
                 else foundField = false;
                 break;
 
             case 's':
-                if (fieldName == "spotIndex")
+                if (!strcmp(fieldName, "spotIndex"))
                     bid.spotIndex = context.expect_int();
 
                 // Legacy name for priority
-                else if (fieldName == "surplus")
+                else if (!strcmp(fieldName, "surplus"))
                     bid.priority = context.expect_double();
 
                 else foundField = false;
@@ -177,10 +203,10 @@ fromJson(ML::Parse_Context& context)
             default: foundField = false;
             }
 
-            ExcCheck(foundField, "unknown bid field " + fieldName);
+            ExcCheck(foundField, "unknown bid field " + std::string(fieldName));
         };
 
-    expectJsonObject(context, onBidField);
+    expectJsonObjectAscii(context, onBidField);
 
     return bid;
 }
@@ -246,21 +272,21 @@ fromJson(const std::string& raw)
             result.dataSources.insert(expectJsonStringAscii(context));
         };
 
-    auto onBidsEntry = [&] (const string& fieldName, ML::Parse_Context& context)
+    auto onBidsEntry = [&] (const char * fieldName, ML::Parse_Context& context)
         {
-            ExcCheck(!fieldName.empty(), "invalid empty field name");
+            ExcCheck(*fieldName, "invalid empty field name");
 
             bool foundField = true;
             switch (fieldName[0]) {
             case 'b':
-                if (fieldName == "bids")
+                if (!strcmp(fieldName, "bids"))
                     expectJsonArray(context, onDataSourceEntry);
 
                 else foundField = false;
                 break;
 
             case 's':
-                if (fieldName == "sources")
+                if (!strcmp(fieldName, "sources"))
                     expectJsonArray(context, onBidEntry);
 
                 else foundField = false;
@@ -269,15 +295,149 @@ fromJson(const std::string& raw)
             default: foundField = false;
             }
 
-            ExcCheck(foundField, "unknown bids field " + fieldName);
+            ExcCheck(foundField, "unknown bids field " + std::string(fieldName));
         };
 
     ML::Parse_Context context(raw, raw.c_str(), raw.c_str() + raw.length());
-    expectJsonObject(context, onBidsEntry);
+    expectJsonObjectAscii(context, onBidsEntry);
 
     return result;
 }
 
+namespace {
+
+const char BinaryMagic[] = { '\0', 'B', 'I', 'D', 1 };
+
+template<typename T>
+void writeBinary(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+void writeBinary(std::string& out, const std::string& value)
+{
+    writeBinary<uint32_t>(out, value.size());
+    out.append(value);
+}
+
+struct BinaryReader
+{
+    BinaryReader(const std::string& raw)
+        : pos(raw.c_str()), end(raw.c_str() + raw.size())
+    {
+    }
+
+    template<typename T>
+    T read()
+    {
+        ExcCheckLessEqual(sizeof(T), size_t(end - pos), "truncated binary bids");
+        T value;
+        memcpy(&value, pos, sizeof value);
+        pos += sizeof value;
+        return value;
+    }
+
+    std::string readString()
+    {
+        uint32_t size = read<uint32_t>();
+        ExcCheckLessEqual(size, size_t(end - pos), "truncated binary bids");
+        std::string value(pos, size);
+        pos += size;
+        return value;
+    }
+
+    const char * pos;
+    const char * end;
+};
+
+} // file scope
+
+bool
+Bids::
+isBinary(const std::string& raw)
+{
+    return raw.size() >= sizeof BinaryMagic
+        && !memcmp(raw.c_str(), BinaryMagic, sizeof BinaryMagic);
+}
+
+std::string
+Bids::
+toBinary() const
+{
+    std::string result(BinaryMagic, sizeof BinaryMagic);
+    result.reserve(64 * size());
+
+    writeBinary<uint32_t>(result, size());
+    for (const Bid& bid : *this) {
+        writeBinary<int32_t>(result, bid.spotIndex);
+        writeBinary<int32_t>(result, bid.creativeIndex);
+        writeBinary<int64_t>(result, bid.price.value);
+        writeBinary<uint32_t>(result, uint32_t(bid.price.currencyCode));
+        writeBinary<double>(result, bid.priority);
+        writeBinary(result, bid.account.toString());
+        writeBinary(result, bid.ext.isNull()
+                ? std::string() : bid.ext.toStringNoNewLine());
+    }
+
+    writeBinary<uint32_t>(result, dataSources.size());
+    for (const string& dataSource : dataSources)
+        writeBinary(result, dataSource);
+
+    return result;
+}
+
+Bids
+Bids::
+fromBinary(const std::string& raw)
+{
+    ExcCheck(isBinary(raw), "not a binary bids message");
+
+    Bids result;
+    BinaryReader reader(raw);
+    reader.pos += sizeof BinaryMagic;
+
+    uint32_t numBids = reader.read<uint32_t>();
+    ExcCheckLessEqual(numBids, raw.size(), "invalid binary bids count");
+    result.reserve(numBids);
+
+    for (uint32_t i = 0;  i < numBids;  ++i) {
+        Bid bid;
+        bid.spotIndex = reader.read<int32_t>();
+        bid.creativeIndex = reader.read<int32_t>();
+
+        int64_t value = reader.read<int64_t>();
+        auto currency = CurrencyCode(reader.read<uint32_t>());
+        bid.price = Amount(currency, value);
+
+        bid.priority = reader.read<double>();
+
+        std::string account = reader.readString();
+        if (!account.empty())
+            bid.account = AccountKey(account);
+
+        std::string ext = reader.readString();
+        if (!ext.empty())
+            bid.ext = Json::parse(ext);
+
+        result.emplace_back(std::move(bid));
+    }
+
+    uint32_t numSources = reader.read<uint32_t>();
+    for (uint32_t i = 0;  i < numSources;  ++i)
+        result.dataSources.insert(reader.readString());
+
+    ExcCheck(reader.pos == reader.end, "trailing data in binary bids");
+
+    return result;
+}
+
+Bids
+Bids::
+parse(const std::string& raw)
+{
+    return isBinary(raw) ? fromBinary(raw) : fromJson(raw);
+}
+
 /******************************************************************************/
 /* BID RESULT                                                                 */
 /******************************************************************************/
@@ -115,6 +115,18 @@ struct Bids : public ML::compact_vector<Bid, 4>
     Json::Value toJson() const;
     std::string toJsonStr() const;
     static Bids fromJson(const std::string& raw);
+
+    /** Compact binary form of the bids which the router can decode without
+        going through a JSON parser.  Binary messages start with a magic
+        sequence that can't start a JSON document so both forms can be sent
+        on the same channel.
+     */
+    std::string toBinary() const;
+    static Bids fromBinary(const std::string& raw);
+    static bool isBinary(const std::string& raw);
+
+    /** Parses bids in either the JSON or the binary form. */
+    static Bids parse(const std::string& raw);
 };
 
 
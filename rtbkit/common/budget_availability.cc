@@ -0,0 +1,61 @@
+/** budget_availability.cc
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Implementation of the budget availability table.
+
+*/
+
+#include "rtbkit/common/budget_availability.h"
+#include <memory>
+
+using namespace std;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* BUDGET AVAILABILITY                                                        */
+/******************************************************************************/
+
+BudgetAvailability::
+BudgetAvailability()
+    : exhausted(0)
+{
+    for (auto & chunk: chunks)
+        chunk = nullptr;
+}
+
+BudgetAvailability::
+~BudgetAvailability()
+{
+    for (auto & chunk: chunks)
+        delete[] chunk.load();
+}
+
+void
+BudgetAvailability::
+setAvailable(AccountKeyId account, bool available)
+{
+    std::atomic<Flag *> & chunk = chunks[account.index() >> ChunkBits];
+    Flag * flags = chunk.load(std::memory_order_acquire);
+
+    if (!flags) {
+        // Nothing to clear in a chunk that was never written
+        if (available) return;
+
+        std::unique_ptr<Flag[]> newFlags(new Flag[ChunkSize]);
+        for (unsigned i = 0;  i < ChunkSize;  ++i)
+            newFlags[i] = 0;
+        if (chunk.compare_exchange_strong(flags, newFlags.get()))
+            flags = newFlags.release();
+    }
+
+    uint8_t old = flags[account.index() & (ChunkSize - 1)]
+        .exchange(!available, std::memory_order_relaxed);
+    if (old == !available) return;
+
+    if (available) --exhausted;
+    else ++exhausted;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,74 @@
+/** budget_availability.h                                          -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Lock free table of which accounts have budget left to bid with.
+
+*/
+
+#pragma once
+
+#include "rtbkit/common/account_key.h"
+#include <atomic>
+#include <stdint.h>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* BUDGET AVAILABILITY                                                        */
+/******************************************************************************/
+
+/** One flag per account, indexed by the AccountKeyId, telling whether the
+    account is worth bidding with.  The banker that holds the budgets writes
+    it when it learns about them, ie when it syncs with the master or when it
+    fails to authorize a bid, and the router reads it to drop the configs of
+    exhausted accounts before they get a bid request.
+
+    It is a hint that lags the banker's accounts: an exhausted account stays
+    marked until the next sync brings it more budget, and a bid on an account
+    that looks available can still fail to be authorized.  Accounts that
+    were never marked are available.
+
+    Reads and writes are lock free and can come from any thread.
+*/
+struct BudgetAvailability {
+
+    BudgetAvailability();
+    ~BudgetAvailability();
+
+    BudgetAvailability(const BudgetAvailability &) = delete;
+    BudgetAvailability & operator = (const BudgetAvailability &) = delete;
+
+    /** Whether the account has budget left as far as we know. */
+    bool available(AccountKeyId account) const
+    {
+        const Flag * flags
+            = chunks[account.index() >> ChunkBits].load(std::memory_order_acquire);
+        if (!flags) return true;
+        return !flags[account.index() & (ChunkSize - 1)]
+            .load(std::memory_order_relaxed);
+    }
+
+    /** Mark the account as having budget left or not. */
+    void setAvailable(AccountKeyId account, bool available);
+
+    /** Number of accounts currently marked as exhausted. */
+    size_t numExhausted() const { return exhausted.load(); }
+
+private:
+    enum {
+        ChunkBits = 12,
+        ChunkSize = 1 << ChunkBits,
+        MaxChunks = 1 << 12       ///< Same capacity as the AccountKeyId table
+    };
+
+    /** Set when the account is exhausted so that zeroed chunks are all
+        available.
+    */
+    typedef std::atomic<uint8_t> Flag;
+
+    std::atomic<Flag *> chunks[MaxChunks];
+    std::atomic<size_t> exhausted;
+};
+
+} // namespace RTBKIT
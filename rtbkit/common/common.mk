@@ -4,8 +4,10 @@ LIBBIDREQUEST_SOURCES := \
 	bid_request.cc \
 	segments.cc \
 	json_holder.cc \
+	lazy_bid_request.cc \
 	currency.cc \
-	expand_variable.cc 
+	expand_variable.cc \
+	tags.cc
 
 LIBBIDREQUEST_LINK := \
 	types boost_regex db openrtb value_description
@@ -16,21 +18,29 @@ LIBRTB_SOURCES := \
 	auction.cc \
 	augmentation.cc \
 	account_key.cc \
+	budget_availability.cc \
 	bids.cc \
 	auction_events.cc \
 	exchange_connector.cc \
 	bidder_interface.cc \
 	win_cost_model.cc \
 	post_auction_proxy.cc \
+	consistent_hash_ring.cc \
 	analytics_publisher.cc \
 	extension.cc \
-	bid_request_pipeline.cc
+	bid_request_pipeline.cc \
+	in_process_augmentor.cc \
+	latency_budget.cc \
+	latency_histogram.cc \
+	auction_usage.cc \
+	auction_tracer.cc
 
 LIBRTB_LINK := \
-	ACE arch utils jsoncpp boost_thread endpoint boost_regex zmq opstats bid_request
+	ACE arch utils jsoncpp boost_thread endpoint boost_regex zmq opstats bid_request \
+	allocation_counts
 
 $(eval $(call library,rtb,$(LIBRTB_SOURCES),$(LIBRTB_LINK)))
 
-$(eval $(call library,filter_registry,filter.cc,arch utils rtb))
+$(eval $(call library,filter_registry,filter.cc string_dictionary.cc,arch utils rtb gc))
 
 $(eval $(call include_sub_make,testing,,common_testing.mk))
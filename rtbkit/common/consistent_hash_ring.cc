@@ -0,0 +1,64 @@
+/* consistent_hash_ring.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Consistent hashing of keys onto a changing set of shards.
+*/
+
+#include "consistent_hash_ring.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/exc_assert.h"
+#include "city.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* CONSISTENT HASH RING                                                      */
+/*****************************************************************************/
+
+ConsistentHashRing::
+ConsistentHashRing(const std::vector<size_t> & shards,
+                   unsigned pointsPerShard)
+    : shards_(shards)
+{
+    if (!pointsPerShard)
+        throw ML::Exception("consistent hash ring needs at least one point "
+                            "per shard");
+
+    std::sort(shards_.begin(), shards_.end());
+    shards_.erase(std::unique(shards_.begin(), shards_.end()), shards_.end());
+
+    points.reserve(shards_.size() * pointsPerShard);
+    for (size_t shard: shards_) {
+        for (unsigned i = 0;  i < pointsPerShard;  ++i)
+            points.emplace_back(Hash128to64(make_pair(uint64_t(shard),
+                                                      uint64_t(i))),
+                                shard);
+    }
+    std::sort(points.begin(), points.end());
+}
+
+bool
+ConsistentHashRing::
+contains(size_t shard) const
+{
+    return std::binary_search(shards_.begin(), shards_.end(), shard);
+}
+
+size_t
+ConsistentHashRing::
+shardFor(uint64_t hash) const
+{
+    ExcAssert(!points.empty());
+
+    auto it = std::lower_bound(points.begin(), points.end(),
+                               make_pair(hash, size_t(0)));
+    if (it == points.end())
+        it = points.begin();
+    return it->second;
+}
+
+} // namespace RTBKIT
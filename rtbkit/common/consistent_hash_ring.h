@@ -0,0 +1,54 @@
+/* consistent_hash_ring.h                                          -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Consistent hashing of keys onto a changing set of shards.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* CONSISTENT HASH RING                                                      */
+/*****************************************************************************/
+
+/** Maps hashes onto a set of shards so that adding or removing a shard only
+    moves the keys that it gains or loses, instead of nearly all of them as
+    with a modulo.
+
+    Each shard is placed at a number of pseudo-random points on a ring of
+    64 bit hashes, and a key belongs to the shard of the first point at or
+    after its hash.  Points only depend on the shard number, so every process
+    that sees the same set of shards builds the same ring.
+
+    Immutable once built, so it can be shared between threads.
+*/
+struct ConsistentHashRing {
+
+    /** Build a ring over the given shard numbers, with the given number of
+        points per shard.  More points spread the keys more evenly. */
+    ConsistentHashRing(const std::vector<size_t> & shards = {},
+                       unsigned pointsPerShard = 128);
+
+    bool empty() const { return points.empty(); }
+
+    /** Shard numbers in the ring, in increasing order. */
+    const std::vector<size_t> & shards() const { return shards_; }
+
+    bool contains(size_t shard) const;
+
+    /** Shard that owns the given hash.  The ring must not be empty. */
+    size_t shardFor(uint64_t hash) const;
+
+private:
+    std::vector<size_t> shards_;
+    std::vector<std::pair<uint64_t, size_t> > points;   ///< Sorted by hash
+};
+
+} // namespace RTBKIT
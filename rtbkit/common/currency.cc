@@ -277,6 +277,35 @@ reconstitute(ML::DB::Store_Reader & store)
     //cerr << "reconstituted = " << *this << endl;
 }
 
+/*****************************************************************************/
+/* CURRENCY AMOUNTS                                                          */
+/*****************************************************************************/
+
+// Same format as the compact_vector<Amount> this replaced
+
+ML::DB::Store_Writer &
+operator << (ML::DB::Store_Writer & store, const CurrencyAmounts & amounts)
+{
+    DB::serialize_compact_size(store, amounts.size());
+    for (auto amount: amounts)
+        store << amount;
+    return store;
+}
+
+ML::DB::Store_Reader &
+operator >> (ML::DB::Store_Reader & store, CurrencyAmounts & amounts)
+{
+    amounts.clear();
+    unsigned long long size = DB::reconstitute_compact_size(store);
+    for (unsigned i = 0;  i < size;  ++i) {
+        Amount amount;
+        store >> amount;
+        amounts.push_back(amount);
+    }
+    return store;
+}
+
+
 /*****************************************************************************/
 /* CURRENCY POOL                                                             */
 /*****************************************************************************/
@@ -299,19 +328,6 @@ operator == (const CurrencyPool & other) const
     return checkContains(*this, other) && checkContains(other, *this);
 }
 
-Amount
-CurrencyPool::
-getAvailable(const CurrencyCode & currency) const
-{
-    for (auto & am: currencyAmounts) {
-        if (am.currencyCode == currency) {
-            return am;
-        }
-    }
-
-    return Amount(currency, 0);
-}
-
 bool
 CurrencyPool::
 hasAvailable(const Amount & amount) const
@@ -7,7 +7,10 @@
 #ifndef __types__currency_h__
 #define __types__currency_h__
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <ratio>
 #include <type_traits>
 
@@ -354,6 +357,143 @@ Amount createAmount(Integer amount, CurrencyCode currency)
     };
 }
 
+/*****************************************************************************/
+/* CURRENCY AMOUNTS                                                          */
+/*****************************************************************************/
+
+/** The amounts held by a CurrencyPool.  There is one fixed slot for each
+    currency code, so that adding to a pool never searches, sorts or
+    allocates and copying one is a plain copy of a few words.
+
+    It behaves like a container of the Amounts that have been set, sorted
+    by currency code.  An amount that goes back to zero stays in it.
+*/
+struct CurrencyAmounts {
+
+    enum { NUM_SLOTS = 5 };
+
+    CurrencyAmounts()
+    {
+        clear();
+    }
+
+    /** Slot that holds the given currency.  The slots are in the same
+        order as the currency codes, and the first letter of a code is
+        enough to tell which it is.
+    */
+    static int slotOf(CurrencyCode code)
+    {
+        static const int8_t slots[32] = {
+            -1, -1, -1,  0, -1,  1, -1, -1, -1,  2, -1, -1, -1, -1,  3, -1,
+            -1, -1, -1, -1, -1,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+        };
+        int slot = slots[((uint32_t)code >> 24) & 31];
+        if (JML_UNLIKELY(slot == -1 || codeOf(slot) != code))
+            throw ML::Exception("unknown currency code");
+        return slot;
+    }
+
+    static CurrencyCode codeOf(int slot)
+    {
+        static const CurrencyCode codes[NUM_SLOTS] = {
+            CurrencyCode::CC_CLK, CurrencyCode::CC_EUR, CurrencyCode::CC_IMP,
+            CurrencyCode::CC_NONE, CurrencyCode::CC_USD
+        };
+        return codes[slot];
+    }
+
+    struct const_iterator
+        : public std::iterator<std::forward_iterator_tag, Amount,
+                               std::ptrdiff_t, const Amount *, Amount> {
+        const_iterator(const CurrencyAmounts * amounts = 0, unsigned mask = 0)
+            : amounts(amounts), mask(mask)
+        {
+        }
+
+        Amount operator * () const
+        {
+            int slot = __builtin_ctz(mask);
+            return Amount(codeOf(slot), amounts->values[slot]);
+        }
+
+        const_iterator & operator ++ ()
+        {
+            mask &= mask - 1;
+            return *this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            const_iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return mask == other.mask;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return mask != other.mask;
+        }
+
+    private:
+        const CurrencyAmounts * amounts;
+        unsigned mask;  ///< Slots that are still to come
+    };
+
+    const_iterator begin() const { return const_iterator(this, present); }
+    const_iterator end() const { return const_iterator(this, 0); }
+
+    size_t size() const { return __builtin_popcount(present); }
+    bool empty() const { return present == 0; }
+
+    void clear()
+    {
+        for (unsigned i = 0;  i < NUM_SLOTS;  ++i)
+            values[i] = 0;
+        present = 0;
+    }
+
+    /** The nth amount in currency code order. */
+    Amount operator [] (size_t n) const
+    {
+        auto it = begin();
+        while (n--) ++it;
+        return *it;
+    }
+
+    /** Add the amount to its slot and mark it as present, even if it's
+        zero. */
+    void push_back(const Amount & amount)
+    {
+        int slot = slotOf(amount.currencyCode);
+        values[slot] += amount.value;
+        present |= 1 << slot;
+    }
+
+    /** Slots of the non-zero values. */
+    unsigned nonZero() const
+    {
+        unsigned result = 0;
+        for (unsigned i = 0;  i < NUM_SLOTS;  ++i)
+            result |= (values[i] != 0) << i;
+        return result;
+    }
+
+    int64_t values[NUM_SLOTS];  ///< Value in each slot; 0 if not present
+    uint8_t present;            ///< Bit set for each slot that's present
+};
+
+ML::DB::Store_Writer &
+operator << (ML::DB::Store_Writer & store, const CurrencyAmounts & amounts);
+
+ML::DB::Store_Reader &
+operator >> (ML::DB::Store_Reader & store, CurrencyAmounts & amounts);
+
+
 /*****************************************************************************/
 /* CURRENCY POOL                                                             */
 /*****************************************************************************/
@@ -379,28 +519,15 @@ struct CurrencyPool {
     }
 
     CurrencyPool(const Amount & amount)
-        : currencyAmounts(1, amount)
     {
-        if (!amount)
-            currencyAmounts.clear();
+        if (amount)
+            currencyAmounts.push_back(amount);
     }
 
     CurrencyPool & operator += (const Amount & amount)
     {
         if (!amount) return *this;
-
-        for (auto & am: currencyAmounts) {
-            if (am.currencyCode == amount.currencyCode) {
-                am += amount;
-                return *this;
-            }
-        }
-
         currencyAmounts.push_back(amount);
-        std::sort(currencyAmounts.begin(), currencyAmounts.end(),
-                  [] (Amount am1, Amount am2)
-                  { return am1.currencyCode < am2.currencyCode; });
-
         return *this;
     }
 
@@ -425,21 +552,26 @@ struct CurrencyPool {
 
     CurrencyPool & operator += (const CurrencyPool & other)
     {
-        for (auto & am: other.currencyAmounts)
-            operator += (am);
+        for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i)
+            currencyAmounts.values[i] += other.currencyAmounts.values[i];
+        currencyAmounts.present |= other.currencyAmounts.nonZero();
         return *this;
     }
 
     CurrencyPool & operator -= (const CurrencyPool & other)
     {
-        for (auto & am: other.currencyAmounts)
-            operator -= (am);
+        for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i)
+            currencyAmounts.values[i] -= other.currencyAmounts.values[i];
+        currencyAmounts.present |= other.currencyAmounts.nonZero();
         return *this;
     }
 
     CurrencyPool operator *= (double factor)
     {
-        for (auto & am: currencyAmounts) am = am * factor;
+        for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i) {
+            int64_t & value = currencyAmounts.values[i];
+            value = static_cast<int64_t>(static_cast<double>(value) * factor);
+        }
         return *this;
     }
 
@@ -471,10 +603,13 @@ struct CurrencyPool {
     {
         CurrencyPool result;
 
-        for (auto & am: other.currencyAmounts) {
-            Amount a = getAvailable(am.currencyCode).limit(am);
-            if (a)
-                result.currencyAmounts.push_back(a);
+        for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i) {
+            int64_t value = std::min(currencyAmounts.values[i],
+                                     other.currencyAmounts.values[i]);
+            bool keep = value != 0
+                && (other.currencyAmounts.present & (1 << i));
+            result.currencyAmounts.values[i] = keep ? value : 0;
+            result.currencyAmounts.present |= keep << i;
         }
 
         return result;
@@ -485,9 +620,11 @@ struct CurrencyPool {
     {
         CurrencyPool result;
 
-        for (auto & am: currencyAmounts) {
-            if (am.isNonNegative())
-                result.currencyAmounts.push_back(am);
+        for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i) {
+            int64_t value = currencyAmounts.values[i];
+            bool keep = value >= 0 && (currencyAmounts.present & (1 << i));
+            result.currencyAmounts.values[i] = keep ? value : 0;
+            result.currencyAmounts.present |= keep << i;
         }
 
         return result;
@@ -514,28 +651,29 @@ struct CurrencyPool {
     bool hasAvailable(const Amount & amount) const;
 
     /** Return the amount available in the given currency code. */
-    Amount getAvailable(const CurrencyCode & currency) const;
+    Amount getAvailable(const CurrencyCode & currency) const
+    {
+        return Amount(currency,
+                      currencyAmounts.values[CurrencyAmounts::slotOf(currency)]);
+    }
 
     bool isNonNegative() const
     {
-        for (auto & am: currencyAmounts)
-            if (!am.isNonNegative())
-                return false;
-        return true;
+        bool result = true;
+        for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i)
+            result &= currencyAmounts.values[i] >= 0;
+        return result;
     }
 
     bool isZero() const
     {
-        for (auto & am: currencyAmounts)
-            if (!am.isZero())
-                return false;
-        return true;
+        return currencyAmounts.nonZero() == 0;
     }
 
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
 
-    ML::compact_vector<Amount, 1> currencyAmounts;  /// Amounts per currency
+    CurrencyAmounts currencyAmounts;  /// Amounts per currency
 
     Json::Value toJson() const;
     std::string toString() const;
@@ -6,6 +6,7 @@
 */
 
 #include "exchange_connector.h"
+#include "rtbkit/common/filter.h"
 
 using namespace std;
 
@@ -26,6 +27,7 @@ ExchangeConnector::
 ExchangeConnector(const std::string & name,
                   ServiceBase & parent)
 : ServiceBase(name, parent)
+, numBiddableAgents(-1)
 , hasCurrencyConfigured_(false)
 , currency_("USD")
 , currencyCode_(CurrencyCode::CC_USD)
@@ -41,12 +43,16 @@ ExchangeConnector(const std::string & name,
     numRequests = 0;
     numAuctions = 0;
     acceptAuctionProbability = 1.0;
+    usageSampling = 0;
+    usageSampleCounter = 0;
+    compatibilityGeneration = 0;
 }
 
 ExchangeConnector::
 ExchangeConnector(const std::string & name,
                   std::shared_ptr<ServiceProxies> proxies)
 : ServiceBase(name, proxies)
+, numBiddableAgents(-1)
 , hasCurrencyConfigured_(false)
 , currency_("USD")
 , currencyCode_(CurrencyCode::CC_USD)
@@ -62,6 +68,9 @@ ExchangeConnector(const std::string & name,
     numRequests = 0;
     numAuctions = 0;
     acceptAuctionProbability = 1.0;
+    usageSampling = 0;
+    usageSampleCounter = 0;
+    compatibilityGeneration = 0;
 }
 
 ExchangeConnector::
@@ -198,6 +207,48 @@ bidRequestCreativeFilter(const BidRequest & request,
     return true;
 }
 
+void
+ExchangeConnector::
+bidRequestPreFilterAll(const BidRequest & request,
+                       const std::vector<std::shared_ptr<AgentConfig> > & configs,
+                       const std::vector<const void *> & infos,
+                       ConfigSet & matches) const
+{
+    for (size_t i = matches.next();  i < matches.size();  i = matches.next(i + 1)) {
+        if (!bidRequestPreFilter(request, *configs[i], infos[i]))
+            matches.reset(i);
+    }
+}
+
+void
+ExchangeConnector::
+bidRequestPostFilterAll(const BidRequest & request,
+                        const std::vector<std::shared_ptr<AgentConfig> > & configs,
+                        const std::vector<const void *> & infos,
+                        ConfigSet & matches) const
+{
+    for (size_t i = matches.next();  i < matches.size();  i = matches.next(i + 1)) {
+        if (!bidRequestPostFilter(request, *configs[i], infos[i]))
+            matches.reset(i);
+    }
+}
+
+void
+ExchangeConnector::
+bidRequestCreativeFilterAll(const BidRequest & request,
+                            const std::vector<std::shared_ptr<AgentConfig> > & configs,
+                            const std::vector<std::vector<const void *> > & infos,
+                            CreativeMatrix & matches) const
+{
+    for (size_t cr = 0;  cr < matches.size();  ++cr) {
+        const ConfigSet & row = matches[cr];
+        for (size_t i = row.next();  i < row.size();  i = row.next(i + 1)) {
+            if (!bidRequestCreativeFilter(request, *configs[i], infos[i][cr]))
+                matches.reset(cr, i);
+        }
+    }
+}
+
 std::unique_ptr<ExchangeConnector>
 ExchangeConnector::
 create(const std::string & exchange, ServiceBase & owner, const std::string & name)
@@ -18,6 +18,8 @@ namespace RTBKIT {
 class AgentConfig;
 class Creative;
 class BidSource;
+struct ConfigSet;
+struct CreativeMatrix;
 
 /*****************************************************************************/
 /* EXCHANGE CONNECTOR                                                        */
@@ -60,6 +62,27 @@ struct ExchangeConnector: public ServiceBase {
     /** Probability that we will accept a given auction. */
     double acceptAuctionProbability;
 
+    /** Measure the resources used by one auction in this many (see
+        AuctionUsage), or none if it's zero.  Set by the router.
+    */
+    std::atomic<unsigned> usageSampling;
+
+    /** Incremented by the router once it has checked the compatibility of
+        every agent with the exchange, so that the filters know when the
+        providerData of the configs is complete and can be indexed.  Zero
+        until then.
+    */
+    std::atomic<unsigned> compatibilityGeneration;
+
+    /** Whether the next auction should have its usage measured. */
+    bool sampleUsage()
+    {
+        unsigned every = usageSampling.load(std::memory_order_relaxed);
+        return every
+            && usageSampleCounter.fetch_add(1, std::memory_order_relaxed)
+               % every == 0;
+    }
+
     typedef boost::function<void (const std::string & channel,
                                   std::shared_ptr<Auction> auction,
                                   const std::string & message)> OnAuctionError;
@@ -77,6 +100,18 @@ struct ExchangeConnector: public ServiceBase {
     virtual void stopRequestLogging() {
     }
 
+    /** Change the sampled capture of the incoming requests while running.
+        The JSON is interpreted by the exchange connector; connectors that
+        can't capture requests ignore it.
+    */
+    virtual void configureRequestCapture(const Json::Value & config) {
+    }
+
+    /** Return the state of the request capture, or null if unsupported. */
+    virtual Json::Value getRequestCaptureStatus() const {
+        return Json::Value();
+    }
+
     /** Configure the exchange connector.  The JSON provided is entirely
         interpreted by the exchange connector itself.
     */
@@ -106,6 +141,21 @@ struct ExchangeConnector: public ServiceBase {
         this->acceptAuctionProbability = prob;
     }
 
+    /** Set how many bidding agents are currently configured to bid on this
+        exchange's traffic.  The router calls this every time the agent
+        configurations change; while it's zero, bid requests can be
+        dropped before being parsed.  -1 (the default) means unknown.
+    */
+    void setNumBiddableAgents(int numAgents)
+    {
+        this->numBiddableAgents = numAgents;
+    }
+
+    int getNumBiddableAgents() const
+    {
+        return numBiddableAgents;
+    }
+
     /** Returns a function that can be used to sample the load of the exchange
         connector. See LoopMonitor documentation for more details.
      */
@@ -348,6 +398,34 @@ struct ExchangeConnector: public ServiceBase {
                                           const AgentConfig & config,
                                           const void * info) const;
 
+    /** Versions of the three filters above that the router calls once per
+        bid request for all the configs still in the running, rather than
+        once per config.  configs and infos are indexed like matches (and
+        for the creatives, like the rows of the matrix), and the configs or
+        creatives that can't bid must be cleared from matches.
+
+        The default implementations call the per-config versions for each
+        of them.  Exchanges can override these to do the work that only
+        depends on the request once for all the configs.
+    */
+    virtual void
+    bidRequestPreFilterAll(const BidRequest & request,
+                           const std::vector<std::shared_ptr<AgentConfig> > & configs,
+                           const std::vector<const void *> & infos,
+                           ConfigSet & matches) const;
+
+    virtual void
+    bidRequestPostFilterAll(const BidRequest & request,
+                            const std::vector<std::shared_ptr<AgentConfig> > & configs,
+                            const std::vector<const void *> & infos,
+                            ConfigSet & matches) const;
+
+    virtual void
+    bidRequestCreativeFilterAll(const BidRequest & request,
+                                const std::vector<std::shared_ptr<AgentConfig> > & configs,
+                                const std::vector<std::vector<const void *> > & infos,
+                                CreativeMatrix & matches) const;
+
 
 
     /*************************************************************************/
@@ -400,9 +478,13 @@ struct ExchangeConnector: public ServiceBase {
     }
 
 private:
+    int numBiddableAgents;
     bool hasCurrencyConfigured_;
     std::string currency_;
     RTBKIT::CurrencyCode currencyCode_;
+
+    /// Auctions considered for usage sampling
+    std::atomic<unsigned> usageSampleCounter;
 };
 
 
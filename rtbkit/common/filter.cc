@@ -26,37 +26,62 @@ namespace RTBKIT {
 /* FILTER STATE                                                               */
 /******************************************************************************/
 
-std::unordered_map<unsigned, BiddableSpots>
+std::vector<BiddableSpots>
 FilterState::
 biddableSpots()
 {
     // Used to remove creatives for configs that have been filtered out.
     narrowAllCreatives(CreativeMatrix(configs_));
 
-    std::unordered_map<unsigned, BiddableSpots> biddable;
+    std::vector<BiddableSpots> biddable(configs_.size());
 
+    // Walks the set bits of each (impression, creative) row once. Since
+    // impressions and creatives are visited in order, each config's spots
+    // and creatives come out sorted by appending to its last spot.
     for (size_t impId = 0; impId < creatives_.size(); ++impId) {
-        // \todo Would be nice if we could remove this temp map.
-        std::unordered_map<unsigned, SmallIntVector> biddableCreatives;
+        const CreativeMatrix& matrix = creatives_[impId];
 
-        for (unsigned crId = 0; crId < creatives_[impId].size(); ++crId) {
-            const auto& configs = creatives_[impId][crId];
+        for (unsigned crId = 0; crId < matrix.size(); ++crId) {
+            const auto& configs = matrix[crId];
 
             for (size_t config = configs.next();
                  config < configs.size();
                  config = configs.next(config + 1))
             {
-                biddableCreatives[config].push_back(crId);
+                if (config >= biddable.size())
+                    biddable.resize(config + 1);
+
+                BiddableSpots& spots = biddable[config];
+                if (spots.empty() || spots.back().first != int(impId))
+                    spots.emplace_back(impId, SmallIntVector());
+                spots.back().second.push_back(crId);
             }
         }
-
-        for (const auto& entry : biddableCreatives)
-            biddable[entry.first].emplace_back(impId, entry.second);
     }
 
     return biddable;
 }
 
+StringDictionary::Id
+FilterState::
+exchangeId() const
+{
+    if (exchangeId_ == Unresolved)
+        exchangeId_ = StringDictionary::global().find(request.exchange);
+    return exchangeId_;
+}
+
+StringDictionary::Id
+FilterState::
+languageId() const
+{
+    if (languageId_ == Unresolved) {
+        languageId_ = StringDictionary::global().find(
+                request.language.utf8String());
+    }
+    return languageId_;
+}
+
 FilterState::FilterReasons&
 FilterState::getFilterReasons(){
     return this->filterReasons_;
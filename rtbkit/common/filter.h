@@ -8,9 +8,12 @@
 #pragma once
 
 #include "rtbkit/core/router/router_types.h"
+#include "rtbkit/common/string_dictionary.h"
 #include "jml/utils/compact_vector.h"
 #include "jml/arch/bitops.h"
+#include "jml/arch/bitfield_ops.h"
 
+#include <city.h>
 #include <vector>
 #include <string>
 #include <memory>
@@ -40,6 +43,10 @@ struct AgentConfig;
 
     Note that this class is easier reflects more a bitfield then it does a
     set. In other words, it uses bitfield nomenclature to manipulate the set.
+
+    The first 512 config ids are stored inline so the common case never hits
+    the allocator and all the bulk operations are done with the vectorized
+    kernels in jml/arch/bitfield_ops.h.
  */
 struct ConfigSet
 {
@@ -94,43 +101,32 @@ struct ConfigSet
 
     size_t count() const
     {
-        size_t total = 0;
-
-        for (size_t i = 0; i < bitfield.size(); ++i) {
-            if (!bitfield[i]) continue;
-            total += ML::num_bits_set(bitfield[i]);
-        }
-
-        return total;
+        return ML::bitfield_count(bitfield.unsafe_raw_data(), bitfield.size());
     }
 
     size_t empty() const
     {
         if (bitfield.empty()) return !defaultValue;
-
-        for (size_t i = 0; i < bitfield.size(); ++i) {
-            if (bitfield[i]) return false;
-        }
-        return true;
+        return !ML::bitfield_any(bitfield.unsafe_raw_data(), bitfield.size());
     }
 
-#define RTBKIT_CONFIG_SET_OP(_op_)                                      \
+#define RTBKIT_CONFIG_SET_OP(_op_, _name_)                              \
     ConfigSet& operator _op_ (const ConfigSet& other)                   \
     {                                                                   \
         expand(other.size());                                           \
                                                                         \
-        for (size_t i = 0; i < other.bitfield.size(); ++i)              \
-            bitfield[i] _op_ other.bitfield[i];                         \
-                                                                        \
-        for (size_t i = other.bitfield.size(); i < bitfield.size(); ++i) \
-            bitfield[i] _op_ other.defaultValue;                        \
+        Word* dst = bitfield.unsafe_raw_data();                         \
+        size_t n = other.bitfield.size();                               \
+        ML::bitfield_##_name_(dst, other.bitfield.unsafe_raw_data(), n); \
+        ML::bitfield_##_name_##_word(                                   \
+                dst + n, other.defaultValue, bitfield.size() - n);      \
                                                                         \
         return *this;                                                   \
     }
 
-    RTBKIT_CONFIG_SET_OP(&=)
-    RTBKIT_CONFIG_SET_OP(|=)
-    RTBKIT_CONFIG_SET_OP(^=)
+    RTBKIT_CONFIG_SET_OP(&=, and)
+    RTBKIT_CONFIG_SET_OP(|=, or)
+    RTBKIT_CONFIG_SET_OP(^=, xor)
 
 #undef RTBKIT_CONFIG_SET_OP
 
@@ -155,8 +151,7 @@ struct ConfigSet
     ConfigSet& negate()
     {
         defaultValue = ~defaultValue;
-        for (size_t i = 0; i < bitfield.size(); ++i)
-            bitfield[i] = ~bitfield[i];
+        ML::bitfield_not(bitfield.unsafe_raw_data(), bitfield.size());
         return *this;
     }
 
@@ -330,6 +325,14 @@ struct CreativeMatrix
     ConfigSet aggregate() const
     {
         ConfigSet configs;
+        if (matrix.empty()) return configs;
+
+        // Size the result once up front so that every row is a single pass of
+        // the vectorized or kernel with no reallocation in between.
+        size_t maxSize = 0;
+        for (const ConfigSet& set : matrix)
+            maxSize = std::max(maxSize, set.size());
+        configs.expand(maxSize);
 
         for (const ConfigSet& set : matrix)
             configs |= set;
@@ -375,7 +378,9 @@ struct FilterState
             const ExchangeConnector* ex,
             const CreativeMatrix& activeConfigs) :
         request(br),
-        exchange(ex)
+        exchange(ex),
+        exchangeId_(Unresolved),
+        languageId_(Unresolved)
     {
         if (activeConfigs.size())
             configs_ = activeConfigs[0];
@@ -420,9 +425,10 @@ struct FilterState
     }
 
 
-    // Returns a map of configIndex to BiddableSpots object based on the
-    // creative matrix. This is the format ingested by the router.
-    std::unordered_map<unsigned, BiddableSpots> biddableSpots();
+    // Returns the BiddableSpots of each config, indexed by configIndex, based
+    // on the creative matrix. This is the format ingested by the router.
+    // Configs past the end of the vector have no biddable spots.
+    std::vector<BiddableSpots> biddableSpots();
 
     /*
      * This map is keyed by filtered reasons and contains a ConfigSet.
@@ -435,7 +441,15 @@ struct FilterState
 
     void resetFilterReasons();
 
+    // Ids of the request's exchange and language in the global
+    // StringDictionary. Looked up on first use so that each filter keyed on
+    // them indexes a vector instead of hashing the string again.
+    StringDictionary::Id exchangeId() const;
+    StringDictionary::Id languageId() const;
+
 private:
+    enum { Unresolved = StringDictionary::Id(-2) };
+
     void updateConfigs()
     {
         CreativeMatrix mask;
@@ -446,6 +460,9 @@ private:
     ConfigSet configs_;
     ML::compact_vector<CreativeMatrix, 8> creatives_;
     FilterReasons filterReasons_;
+
+    mutable StringDictionary::Id exchangeId_;
+    mutable StringDictionary::Id languageId_;
 };
 
 
@@ -486,6 +503,21 @@ struct FilterBase
     virtual void filter(FilterState& state) const = 0;
 
 
+    /** Filters whose result only depends on fields of the request which are
+        shared by many users (exchange, site, language, ad formats, etc.) can
+        mix those fields into hash with hashField and return true. FilterPool
+        may then cache the combined result of all such filters keyed on their
+        hashes and skip them when a later request has the same hashes.
+
+        The hash must cover everything that filter() reads from the state
+        other than the configs and creatives. The default never caches.
+     */
+    virtual bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        return false;
+    }
+
+
     /** Indicates that a new config is available and that it is associated with
         the given index. The configIndex should be used to manipulate the
         FilterState object during filtering.
@@ -537,4 +569,20 @@ struct FilterBase
 
 };
 
+/** Mixes a field of the request into the hash of FilterBase::hashRequest. */
+inline uint64_t hashField(uint64_t hash, uint64_t value)
+{
+    return Hash128to64(uint128(hash, value));
+}
+
+inline uint64_t hashField(uint64_t hash, const char* data, size_t size)
+{
+    return CityHash64WithSeed(data, size, hash);
+}
+
+inline uint64_t hashField(uint64_t hash, const std::string& str)
+{
+    return hashField(hash, str.data(), str.size());
+}
+
 } // namespace RTBKIT
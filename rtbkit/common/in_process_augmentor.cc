@@ -0,0 +1,22 @@
+/* in_process_augmentor.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Augmentors that are loaded into the router.
+*/
+
+#include "in_process_augmentor.h"
+
+namespace RTBKIT {
+
+std::shared_ptr<InProcessAugmentor>
+InProcessAugmentor::
+create(const std::string & type,
+       Datacratic::ServiceBase & owner,
+       const std::string & name,
+       const Json::Value & config)
+{
+    auto factory = PluginInterface<InProcessAugmentor>::getPlugin(type);
+    return std::shared_ptr<InProcessAugmentor>(factory(owner, name, config));
+}
+
+} // namespace RTBKIT
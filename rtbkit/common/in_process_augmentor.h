@@ -0,0 +1,75 @@
+/* in_process_augmentor.h                                          -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Augmentors that are loaded into the router.
+*/
+
+#pragma once
+
+#include "rtbkit/common/augmentation.h"
+#include "rtbkit/common/plugin_interface.h"
+#include "soa/service/service_base.h"
+#include "soa/jsoncpp/value.h"
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+
+namespace RTBKIT {
+
+struct Auction;
+
+
+/*****************************************************************************/
+/* IN PROCESS AUGMENTOR                                                      */
+/*****************************************************************************/
+
+/** Augmentor that runs inside the router and is handed the auction directly
+    by the AugmentationLoop instead of going through a zmq round trip, so
+    the bid request is neither serialized nor reparsed.
+
+    augment() is called from the augmentation loop thread and must not
+    block: an augmentor that needs to wait on something should return and
+    call sendResponse later, from any thread.  Calling it from within
+    augment() is the cheapest path as the response is merged right away.
+*/
+struct InProcessAugmentor {
+
+    virtual ~InProcessAugmentor() {}
+
+    typedef std::function<void (const AugmentationList &)> SendResponse;
+
+    virtual void augment(const Auction & auction,
+                         const std::set<std::string> & agents,
+                         double timeAvailableMs,
+                         const SendResponse & sendResponse) = 0;
+
+
+    /*************************************************************************/
+    /* FACTORY INTERFACE                                                     */
+    /*************************************************************************/
+
+    /** Type of a callback which is registered as an augmentor factory. */
+    typedef std::function<InProcessAugmentor * (
+            Datacratic::ServiceBase & owner,
+            const std::string & name,
+            const Json::Value & config)> Factory;
+
+    /** plugin interface needs to be able to request the root name of the plugin library */
+    static const std::string libNameSufix() { return "augmentor"; }
+
+    static void registerFactory(const std::string & type, Factory factory)
+    {
+        PluginInterface<InProcessAugmentor>::registerPlugin(type, factory);
+    }
+
+    /** Create a new augmentor from a factory. */
+    static std::shared_ptr<InProcessAugmentor>
+    create(const std::string & type,
+           Datacratic::ServiceBase & owner,
+           const std::string & name,
+           const Json::Value & config);
+};
+
+} // namespace RTBKIT
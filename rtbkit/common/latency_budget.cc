@@ -0,0 +1,90 @@
+/* latency_budget.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Time left to answer an auction and where the time went.
+*/
+
+#include "latency_budget.h"
+#include "jml/arch/exception.h"
+
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* LATENCY BUDGET                                                            */
+/*****************************************************************************/
+
+namespace {
+
+int64_t toMicros(Date date)
+{
+    return date.secondsSinceEpoch() * 1000000.0;
+}
+
+} // file scope
+
+LatencyBudget::
+LatencyBudget()
+    : networkMs_(0), lastMark(0)
+{
+    for (auto & stage : charged)
+        stage = 0;
+}
+
+void
+LatencyBudget::
+reset(Date start, Date deadline, double networkMs)
+{
+    start_ = start;
+    deadline_ = deadline;
+    networkMs_ = networkMs;
+
+    lastMark = toMicros(start);
+    for (auto & stage : charged)
+        stage = 0;
+}
+
+double
+LatencyBudget::
+endStage(Stage stage, Date now)
+{
+    int64_t mark = toMicros(now);
+    int64_t previous = lastMark.exchange(mark);
+
+    int64_t elapsed = std::max<int64_t>(mark - previous, 0);
+    charged[stage].fetch_add(elapsed, std::memory_order_relaxed);
+    return elapsed / 1000.0;
+}
+
+const char *
+LatencyBudget::
+stageName(Stage stage)
+{
+    switch (stage) {
+    case PARSE:    return "parse";
+    case FILTER:   return "filter";
+    case AUGMENT:  return "augment";
+    case BID:      return "bid";
+    case RESPONSE: return "response";
+    default:
+        throw ML::Exception("unknown latency budget stage %d", stage);
+    }
+}
+
+Json::Value
+LatencyBudget::
+toJson() const
+{
+    Json::Value result;
+    result["deadlineMs"] = start_.secondsUntil(deadline_) * 1000.0;
+    result["networkMs"] = networkMs_;
+
+    for (int stage = 0;  stage < NUM_STAGES;  ++stage)
+        result["stagesMs"][stageName(Stage(stage))] = chargedMs(Stage(stage));
+
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,95 @@
+/* latency_budget.h                                                -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Time left to answer an auction and where the time went.
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+#include "soa/jsoncpp/value.h"
+
+#include <atomic>
+
+namespace RTBKIT {
+
+using Datacratic::Date;
+
+
+/*****************************************************************************/
+/* LATENCY BUDGET                                                            */
+/*****************************************************************************/
+
+/** Latency budget of an auction.  It starts when the first byte of the
+    request is received and ends at the deadline of the auction, which the
+    exchange connector already moved back by the round trip time to the
+    exchange (see pingTimesByHostMs).
+
+    Each stage of the pipeline calls endStage() when it's done with the
+    auction, which charges the time since the previous stage ended to it,
+    and checks remainingMs() before starting work that can't finish in
+    time.  Stages run one after the other but can end on different threads.
+*/
+struct LatencyBudget {
+
+    enum Stage {
+        PARSE,
+        FILTER,
+        AUGMENT,
+        BID,
+        RESPONSE,
+
+        NUM_STAGES
+    };
+
+    LatencyBudget();
+
+    /** Start the budget for a request received at start that must be
+        answered by deadline.
+    */
+    void reset(Date start, Date deadline, double networkMs = 0);
+
+    Date start() const { return start_; }
+    Date deadline() const { return deadline_; }
+
+    /** Round trip time to the exchange taken out of the budget. */
+    double networkMs() const { return networkMs_; }
+
+    double remainingMs(Date now = Date::now()) const
+    {
+        return now.secondsUntil(deadline_) * 1000.0;
+    }
+
+    /** Whether work taking the given time finishes before the deadline. */
+    bool canFit(double ms, Date now = Date::now()) const
+    {
+        return remainingMs(now) >= ms;
+    }
+
+    /** Charge the time since the previous stage ended to the given stage
+        and return it in milliseconds.
+    */
+    double endStage(Stage stage, Date now = Date::now());
+
+    double chargedMs(Stage stage) const
+    {
+        return charged[stage].load(std::memory_order_relaxed) / 1000.0;
+    }
+
+    static const char * stageName(Stage stage);
+
+    Json::Value toJson() const;
+
+private:
+    Date start_;
+    Date deadline_;
+    double networkMs_;
+
+    /// When the last stage ended, in microseconds since the epoch
+    std::atomic<int64_t> lastMark;
+
+    /// Microseconds charged to each stage
+    std::atomic<int64_t> charged[NUM_STAGES];
+};
+
+} // namespace RTBKIT
@@ -0,0 +1,140 @@
+/* latency_histogram.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Lock-free latency histogram.
+*/
+
+#include "latency_histogram.h"
+
+#include <atomic>
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+LatencyHistogram::
+LatencyHistogram()
+{
+    for (auto & shard : shards)
+        for (auto & count : shard.counts)
+            count = 0;
+}
+
+unsigned
+LatencyHistogram::
+bucketFor(uint64_t micros)
+{
+    if (micros < 2 * SubBuckets)
+        return micros;
+
+    unsigned bits = 64 - __builtin_clzll(micros);
+    unsigned shift = bits - SubBucketBits - 1;
+    if (shift > MaxShift)
+        return NumBuckets - 1;
+
+    return shift * SubBuckets + (micros >> shift);
+}
+
+uint64_t
+LatencyHistogram::
+bucketValue(unsigned bucket)
+{
+    if (bucket < 2 * SubBuckets)
+        return bucket;
+
+    unsigned shift = bucket / SubBuckets - 1;
+    uint64_t sub = bucket % SubBuckets + SubBuckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+unsigned
+LatencyHistogram::
+shardIndex()
+{
+    static std::atomic<unsigned> nextIndex(0);
+    static __thread int index = -1;
+
+    if (index == -1)
+        index = nextIndex.fetch_add(1) % NumShards;
+    return index;
+}
+
+LatencyHistogram::Snapshot
+LatencyHistogram::
+snapshot() const
+{
+    Snapshot result;
+    for (const auto & shard : shards)
+        for (unsigned i = 0;  i < NumBuckets;  ++i)
+            result.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM SNAPSHOT                                                */
+/*****************************************************************************/
+
+LatencyHistogram::Snapshot::
+Snapshot()
+{
+    for (auto & count : counts)
+        count = 0;
+}
+
+uint64_t
+LatencyHistogram::Snapshot::
+count() const
+{
+    uint64_t result = 0;
+    for (auto count : counts)
+        result += count;
+    return result;
+}
+
+uint64_t
+LatencyHistogram::Snapshot::
+percentile(double fraction) const
+{
+    uint64_t total = count();
+    if (!total)
+        return 0;
+
+    uint64_t rank = fraction * total;
+    uint64_t seen = 0;
+    for (unsigned i = 0;  i < NumBuckets;  ++i) {
+        seen += counts[i];
+        if (seen > rank)
+            return bucketValue(i);
+    }
+
+    return bucketValue(NumBuckets - 1);
+}
+
+LatencyHistogram::Snapshot
+LatencyHistogram::Snapshot::
+operator - (const Snapshot & earlier) const
+{
+    Snapshot result;
+    for (unsigned i = 0;  i < NumBuckets;  ++i)
+        result.counts[i] = counts[i] - earlier.counts[i];
+    return result;
+}
+
+Json::Value
+LatencyHistogram::Snapshot::
+toJson() const
+{
+    Json::Value result;
+    result["count"] = Json::UInt(count());
+    result["p50Ms"] = percentile(0.5) / 1000.0;
+    result["p90Ms"] = percentile(0.9) / 1000.0;
+    result["p99Ms"] = percentile(0.99) / 1000.0;
+    result["p999Ms"] = percentile(0.999) / 1000.0;
+    return result;
+}
+
+} // namespace RTBKIT
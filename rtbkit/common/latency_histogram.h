@@ -0,0 +1,89 @@
+/* latency_histogram.h                                             -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Lock-free latency histogram.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/value.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+/** Histogram of latencies in microseconds with log-linear buckets in the
+    style of HdrHistogram: values under 32us are exact and larger values
+    are split into 16 buckets per power of two, so any percentile is
+    within 1/16th of the real value.
+
+    Recording is a relaxed increment into a set of counters owned by the
+    calling thread (threads are spread over a fixed number of shards) so
+    that the hot paths never share a cache line.  The shards are merged
+    when a snapshot is taken.
+*/
+struct LatencyHistogram {
+
+    enum {
+        SubBucketBits = 4,
+        SubBuckets = 1 << SubBucketBits,
+        MaxShift = 32,                              ///< About 38 hours
+        NumBuckets = (MaxShift + 2) * SubBuckets,
+        NumShards = 16
+    };
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram & operator = (const LatencyHistogram &) = delete;
+
+    void record(uint64_t micros)
+    {
+        auto & shard = shards[shardIndex()];
+        shard.counts[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static unsigned bucketFor(uint64_t micros);
+
+    /** Largest value that falls into the given bucket. */
+    static uint64_t bucketValue(unsigned bucket);
+
+    /** Merged counts of all the shards at some point in time. */
+    struct Snapshot {
+        Snapshot();
+
+        uint64_t count() const;
+
+        /** Value under which the given fraction (between 0 and 1) of the
+            recorded latencies fall.
+        */
+        uint64_t percentile(double fraction) const;
+
+        /** Counts recorded since the given earlier snapshot. */
+        Snapshot operator - (const Snapshot & earlier) const;
+
+        /** Count along with the p50, p90, p99 and p999 in milliseconds. */
+        Json::Value toJson() const;
+
+        uint64_t counts[NumBuckets];
+    };
+
+    Snapshot snapshot() const;
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> counts[NumBuckets];
+    } __attribute__((__aligned__(64)));
+
+    static unsigned shardIndex();
+
+    Shard shards[NumShards];
+};
+
+} // namespace RTBKIT
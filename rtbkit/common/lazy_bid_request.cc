@@ -0,0 +1,315 @@
+/* lazy_bid_request.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Bid requests and augmentations that are decoded as they're accessed.
+*/
+
+#include "lazy_bid_request.h"
+#include "soa/types/json_parsing.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <cctype>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace RTBKIT {
+
+
+namespace {
+
+size_t skipSpace(const string & str, size_t i)
+{
+    while (i < str.size() && isspace(str[i]))
+        ++i;
+    return i;
+}
+
+/** Returns the position just after the string that starts at i. */
+size_t skipString(const string & str, size_t i)
+{
+    for (++i;  i < str.size();  ++i) {
+        if (str[i] == '\\')
+            ++i;
+        else if (str[i] == '"')
+            return i + 1;
+    }
+    throw ML::Exception("unterminated JSON string");
+}
+
+/** Returns the position just after the value that starts at i. */
+size_t skipValue(const string & str, size_t i)
+{
+    if (i >= str.size())
+        throw ML::Exception("missing JSON value");
+
+    char c = str[i];
+    if (c == '"')
+        return skipString(str, i);
+
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (i < str.size()) {
+            c = str[i];
+            if (c == '"') {
+                i = skipString(str, i);
+                continue;
+            }
+            if (c == '{' || c == '[')
+                ++depth;
+            else if (c == '}' || c == ']') {
+                if (--depth == 0)
+                    return i + 1;
+            }
+            ++i;
+        }
+        throw ML::Exception("unterminated JSON value");
+    }
+
+    // Number, true, false or null
+    size_t start = i;
+    while (i < str.size() && !isspace(str[i])
+           && str[i] != ',' && str[i] != '}' && str[i] != ']')
+        ++i;
+    if (i == start)
+        throw ML::Exception("missing JSON value");
+    return i;
+}
+
+static const DefaultDescription<BidRequest> BidRequestDesc;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* LAZY JSON OBJECT                                                          */
+/*****************************************************************************/
+
+LazyJsonObject::
+LazyJsonObject(std::string str)
+    : str_(std::move(str))
+{
+    scan();
+}
+
+void
+LazyJsonObject::
+scan()
+{
+    size_t i = skipSpace(str_, 0);
+    if (i == str_.size())
+        return;
+
+    if (str_[i] != '{')
+        throw ML::Exception("expected a JSON object");
+    i = skipSpace(str_, i + 1);
+
+    if (i < str_.size() && str_[i] == '}')
+        return;
+
+    for (;;) {
+        if (i >= str_.size() || str_[i] != '"')
+            throw ML::Exception("expected a JSON member name");
+
+        size_t nameEnd = skipString(str_, i);
+        Member member;
+        member.name = str_.substr(i + 1, nameEnd - i - 2);
+
+        i = skipSpace(str_, nameEnd);
+        if (i >= str_.size() || str_[i] != ':')
+            throw ML::Exception("expected ':' after JSON member name");
+
+        member.start = skipSpace(str_, i + 1);
+        member.end = skipValue(str_, member.start);
+        members.emplace_back(std::move(member));
+
+        i = skipSpace(str_, members.back().end);
+        if (i < str_.size() && str_[i] == ',') {
+            i = skipSpace(str_, i + 1);
+            continue;
+        }
+        if (i < str_.size() && str_[i] == '}')
+            return;
+        throw ML::Exception("expected ',' or '}' in JSON object");
+    }
+}
+
+std::vector<std::string>
+LazyJsonObject::
+memberNames() const
+{
+    vector<string> result;
+    for (auto & member: members)
+        result.push_back(member.name);
+    return result;
+}
+
+bool
+LazyJsonObject::
+isMember(const std::string & name) const
+{
+    for (auto & member: members) {
+        if (member.name == name)
+            return true;
+    }
+    return false;
+}
+
+const Json::Value &
+LazyJsonObject::
+get(const std::string & name)
+{
+    static const Json::Value null;
+
+    for (auto & member: members) {
+        if (member.name != name)
+            continue;
+
+        if (!member.parsed) {
+            member.parsed.reset(new Json::Value(
+                    Json::parse(str_.substr(member.start,
+                                            member.end - member.start))));
+        }
+        return *member.parsed;
+    }
+
+    return null;
+}
+
+std::string
+LazyJsonObject::
+raw(const std::string & name) const
+{
+    for (auto & member: members) {
+        if (member.name == name)
+            return str_.substr(member.start, member.end - member.start);
+    }
+    return "";
+}
+
+Json::Value
+LazyJsonObject::
+toJson() const
+{
+    if (members.empty())
+        return Json::Value();
+    return Json::parse(str_);
+}
+
+
+/*****************************************************************************/
+/* LAZY BID REQUEST                                                          */
+/*****************************************************************************/
+
+LazyBidRequest::
+LazyBidRequest(std::string source, std::string str)
+    : source_(std::move(source)), complete(false)
+{
+    // The same test as BidRequest::parse() for its own JSON format
+    bool canonical = source_ == "datacratic" || source_ == "recoset"
+        || source_ == "rtbkit"
+        || str.compare(0, 8, "{\"!!CV\":") == 0;
+
+    if (canonical) {
+        members.reset(new LazyJsonObject(std::move(str)));
+        decoded.resize(members->members.size());
+        request = std::make_shared<BidRequest>();
+    }
+    else str_ = std::move(str);
+}
+
+bool
+LazyBidRequest::
+has(const std::string & field)
+{
+    return !members || members->isMember(field);
+}
+
+const BidRequest &
+LazyBidRequest::
+decode(const std::string & field)
+{
+    return decode(vector<string>({ field }));
+}
+
+const BidRequest &
+LazyBidRequest::
+decode(const std::vector<std::string> & fields)
+{
+    if (complete)
+        return *request;
+    if (!members)
+        return *full();
+
+    vector<size_t> indexes;
+    for (size_t i = 0;  i < members->members.size();  ++i) {
+        if (decoded[i])
+            continue;
+        const string & name = members->members[i].name;
+        if (std::find(fields.begin(), fields.end(), name) != fields.end())
+            indexes.push_back(i);
+    }
+
+    decodeMembers(indexes);
+    return *request;
+}
+
+std::shared_ptr<BidRequest>
+LazyBidRequest::
+full()
+{
+    if (complete)
+        return request;
+
+    if (!members) {
+        request.reset(BidRequest::parse(source_, str_));
+    }
+    else {
+        vector<size_t> indexes;
+        for (size_t i = 0;  i < decoded.size();  ++i) {
+            if (!decoded[i])
+                indexes.push_back(i);
+        }
+        decodeMembers(indexes);
+    }
+
+    complete = true;
+    return request;
+}
+
+void
+LazyBidRequest::
+decodeMembers(const std::vector<size_t> & indexes)
+{
+    if (indexes.empty())
+        return;
+
+    // The members make up an object of their own, which is decoded on top
+    // of what was decoded before.  Each member of a bid request is decoded
+    // independently of the others, so this gives the same result as
+    // decoding them all at once.
+    const string & str = members->str();
+    string json = "{";
+    for (size_t i: indexes) {
+        auto & member = members->members[i];
+        if (json.size() > 1)
+            json += ',';
+        json += '"';
+        json += member.name;
+        json += "\":";
+        json.append(str, member.start, member.end - member.start);
+    }
+    json += '}';
+
+    StreamingJsonParsingContext context;
+    context.init("bid request", json.c_str(), json.size());
+    BidRequestDesc.parseJsonTyped(request.get(), context);
+
+    for (size_t i: indexes)
+        decoded[i] = true;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,154 @@
+/* lazy_bid_request.h                                              -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Bid requests and augmentations that are decoded as they're accessed.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request.h"
+#include "soa/jsoncpp/json.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* LAZY JSON OBJECT                                                          */
+/*****************************************************************************/
+
+/** JSON object whose members are only parsed when they're asked for.  The
+    text is scanned once to find where each top level member starts and
+    ends, which is much cheaper than parsing it.
+
+    Not thread-safe.
+*/
+
+struct LazyJsonObject {
+
+    /** Throws if str isn't an object.  An empty string is an empty
+        object.
+    */
+    LazyJsonObject(std::string str);
+
+    const std::string & str() const { return str_; }
+
+    std::vector<std::string> memberNames() const;
+
+    bool isMember(const std::string & name) const;
+
+    /** The member parsed, or null if there is no such member. */
+    const Json::Value & get(const std::string & name);
+
+    /** Text of the member, or an empty string if there is no such member. */
+    std::string raw(const std::string & name) const;
+
+    /** The whole object parsed. */
+    Json::Value toJson() const;
+
+private:
+    friend struct LazyBidRequest;
+
+    struct Member {
+        std::string name;
+        size_t start;
+        size_t end;
+        std::unique_ptr<Json::Value> parsed;
+    };
+
+    std::string str_;
+    std::vector<Member> members;
+
+    void scan();
+};
+
+
+/*****************************************************************************/
+/* LAZY BID REQUEST                                                          */
+/*****************************************************************************/
+
+/** Bid request in which each top level field is decoded the first time it's
+    accessed, for agents that look at a few fields of most requests.
+
+    This only works for the JSON formats (see BidRequest::parse()); for the
+    others the first access decodes the whole request.
+
+    Not thread-safe.
+*/
+
+struct LazyBidRequest {
+
+    LazyBidRequest(std::string source, std::string str);
+
+    const std::string & source() const { return source_; }
+    const std::string & str() const
+    {
+        return members ? members->str() : str_;
+    }
+
+    /** Whether fields can be decoded one at a time. */
+    bool isLazy() const { return !!members; }
+
+    /** Whether the request has the given top level field.  Always true
+        for a request that isn't lazy.
+    */
+    bool has(const std::string & field);
+
+    /** Request in which at least the given top level field has been
+        decoded.  The other fields may or may not be.
+    */
+    const BidRequest & decode(const std::string & field);
+
+    /** Same with each of the given fields decoded. */
+    const BidRequest & decode(const std::vector<std::string> & fields);
+
+    /** Request with every field decoded. */
+    std::shared_ptr<BidRequest> full();
+
+    const Id & auctionId() { return decode("id").auctionId; }
+    Date timestamp() { return decode("timestamp").timestamp; }
+    const std::string & exchange() { return decode("exchange").exchange; }
+
+    const std::vector<AdSpot> & imp()
+    {
+        return decode(std::vector<std::string>({ "imp", "spots" })).imp;
+    }
+
+    const OpenRTB::Optional<OpenRTB::User> & user()
+    {
+        return decode("user").user;
+    }
+
+    const OpenRTB::Optional<OpenRTB::Device> & device()
+    {
+        return decode("device").device;
+    }
+
+    const SegmentsBySource & segments()
+    {
+        return decode("segments").segments;
+    }
+
+    const UserIds & userIds() { return decode("userIds").userIds; }
+
+private:
+    std::string source_;
+    std::string str_;  ///< Only when the request isn't lazy
+
+    /// Where the fields are, or null when the request can't be decoded
+    /// one field at a time.
+    std::unique_ptr<LazyJsonObject> members;
+    std::vector<bool> decoded;
+
+    std::shared_ptr<BidRequest> request;
+    bool complete;
+
+    /** Decodes the given members into the request. */
+    void decodeMembers(const std::vector<size_t> & indexes);
+};
+
+} // namespace RTBKIT
@@ -11,6 +11,8 @@
 #include "rtbkit/core/post_auction/event_forwarder.h"
 #include "post_auction_proxy.h"
 
+#include <mutex>
+
 using namespace std;
 using namespace Datacratic;
 
@@ -23,19 +25,31 @@ namespace RTBKIT {
 PostAuctionProxy::
 PostAuctionProxy(ServiceBase& parent) :
     parent(&parent),
-    proxies(parent.getServices())
+    proxies(parent.getServices()),
+    shards(1), consistentHashing(false), handoffWindow(60.0)
 {}
 
 PostAuctionProxy::
 PostAuctionProxy(std::shared_ptr<Datacratic::ServiceProxies> proxies) :
     parent(nullptr),
-    proxies(proxies)
+    proxies(proxies),
+    shards(1), consistentHashing(false), handoffWindow(60.0)
 {}
 
 void
 PostAuctionProxy::
 init()
 {
+    const auto& params = proxies->params;
+
+    string hashing = params.get("postAuctionHashing", "modulo").asString();
+    if (hashing != "modulo" && hashing != "consistent")
+        throw ML::Exception("unknown postAuctionHashing '%s'", hashing.c_str());
+    consistentHashing = hashing == "consistent";
+    handoffWindow = params.get("postAuctionHandoffWindow", 60.0).asDouble();
+
+    rings.assign(1, Ring(Date::now(), make_shared<ConsistentHashRing>()));
+
     if (proxies->params.isMember("postAuctionURIs"))
         initHTTP();
     else initZMQ();
@@ -49,7 +63,17 @@ initZMQ()
 
     zmq.reset(new Datacratic::ZmqMultipleNamedClientBusProxy);
     zmq->init(proxies->config);
+
+    // Shards join and leave the ring as we connect to them
+    if (consistentHashing) {
+        zmq->connectHandler = [=] (std::string) { this->updateRing(); };
+        zmq->disconnectHandler = [=] (std::string) { this->updateRing(); };
+    }
+
     zmq->connectAllServiceProviders("rtbPostAuctionService", "events");
+
+    if (consistentHashing)
+        updateRing();
 }
 
 void
@@ -70,6 +94,70 @@ initHTTP()
         else
             http[i] = std::make_shared<EventForwarder>(proxies, uris[i].asString(), name);
     }
+
+    // The forwarders retry on their own, so every shard is always a member
+    if (consistentHashing) {
+        vector<size_t> members;
+        for (size_t i = 0; i < shards; ++i) members.push_back(i);
+        rings.back().second = make_shared<ConsistentHashRing>(members);
+    }
+}
+
+void
+PostAuctionProxy::
+updateRing()
+{
+    vector<size_t> members;
+    for (size_t shard = 0; shard < shards; ++shard) {
+        if (zmq->isConnectedToShard(shard))
+            members.push_back(shard);
+    }
+
+    Date now = Date::now();
+
+    std::lock_guard<ML::Spinlock> guard(ringsLock);
+    if (rings.back().second->shards() == members) return;
+
+    rings.emplace_back(now, make_shared<ConsistentHashRing>(members));
+
+    // A ring is needed until the one that replaced it is out of the window
+    Date cutoff = now.plusSeconds(-handoffWindow);
+    size_t expired = 0;
+    while (expired + 1 < rings.size() && rings[expired + 1].first <= cutoff)
+        ++expired;
+    rings.erase(rings.begin(), rings.begin() + expired);
+}
+
+size_t
+PostAuctionProxy::
+shardFor(const Id & auctionId, Date bidTime) const
+{
+    uint64_t hash = auctionId.hash();
+    if (!consistentHashing) return hash % shards;
+
+    std::shared_ptr<const ConsistentHashRing> current, owner;
+    {
+        std::lock_guard<ML::Spinlock> guard(ringsLock);
+        current = rings.back().second;
+
+        if (bidTime.isADate()) {
+            for (auto it = rings.rbegin(), end = rings.rend(); it != end; ++it) {
+                if (it->first > bidTime) continue;
+                owner = it->second;
+                break;
+            }
+        }
+    }
+
+    // Nothing connected yet; the send fails either way
+    if (current->empty()) return hash % shards;
+
+    if (owner && owner != current && !owner->empty()) {
+        size_t shard = owner->shardFor(hash);
+        if (current->contains(shard)) return shard;
+    }
+
+    return current->shardFor(hash);
 }
 
 bool
@@ -78,6 +166,12 @@ isConnected() const
 {
     if (!zmq) return true;
 
+    // Missing shards are out of the ring so any one of them will do
+    if (consistentHashing) {
+        std::lock_guard<ML::Spinlock> guard(ringsLock);
+        return !rings.back().second->empty();
+    }
+
     for (size_t shard = 0; shard < shards; ++shard) {
         if (!zmq->isConnectedToShard(shard)) return false;
     }
@@ -89,12 +183,19 @@ void
 PostAuctionProxy::
 sendAuction(std::shared_ptr<SubmittedAuctionEvent> event)
 {
-    size_t shard = event->auctionId.hash() % shards;
+    size_t shard = shardFor(event->auctionId, Date());
 
     if (!zmq) http[shard]->forwardAuction(event);
     else {
         string str = ML::DB::serializeToString(*event);
-        (void) zmq->sendMessageToShard(shard, "AUCTION", move(str));
+        if (zmq->sendMessageToShard(shard, "AUCTION", str)) return;
+
+        // The shard went away without us noticing
+        if (consistentHashing) {
+            updateRing();
+            shard = shardFor(event->auctionId, Date());
+            (void) zmq->sendMessageToShard(shard, "AUCTION", move(str));
+        }
     }
 }
 
@@ -102,14 +203,41 @@ void
 PostAuctionProxy::
 sendEvent(std::shared_ptr<PostAuctionEvent> event)
 {
-    size_t shard = event->auctionId.hash() % shards;
+    size_t shard = shardFor(event->auctionId, event->bidTimestamp);
 
     if (!zmq) http[shard]->forwardEvent(event);
     else {
         string str = ML::DB::serializeToString(*event);
-        (void) zmq->sendMessageToShard(shard, print(event->type), str);
+        if (zmq->sendMessageToShard(shard, print(event->type), str)) return;
+
+        if (consistentHashing) {
+            updateRing();
+            shard = shardFor(event->auctionId, event->bidTimestamp);
+            (void) zmq->sendMessageToShard(shard, print(event->type), str);
+        }
     }
 }
 
+void
+PostAuctionProxy::
+sendEvents(const std::vector< std::shared_ptr<PostAuctionEvent> >& events)
+{
+    if (!zmq) {
+        for (const auto& event : events)
+            http[shardFor(event->auctionId, event->bidTimestamp)]->forwardEvent(event);
+        return;
+    }
+
+    std::vector< std::vector<string> > perShard(shards);
+    for (const auto& event : events) {
+        size_t shard = shardFor(event->auctionId, event->bidTimestamp);
+        perShard[shard].push_back(ML::DB::serializeToString(*event));
+    }
+
+    for (size_t shard = 0; shard < shards; ++shard) {
+        if (perShard[shard].empty()) continue;
+        (void) zmq->sendMessageToShard(shard, "EVENTS", perShard[shard]);
+    }
+}
 
 } // namepsace RTBKIT
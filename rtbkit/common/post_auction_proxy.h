@@ -9,6 +9,8 @@
 #pragma once
 
 #include "rtbkit/common/auction_events.h"
+#include "rtbkit/common/consistent_hash_ring.h"
+#include "jml/arch/spinlock.h"
 
 namespace Datacratic {
 
@@ -31,6 +33,19 @@ struct EventForwarder;
     Requires that the postAuctionShard configuration parameter be provided in
     the bootstrap.json to determine the number of active post auction shards. If
     not present, assumes that there's only one active post auction shard.
+
+    By default an auction goes to the shard given by its id modulo the number
+    of shards.  Setting postAuctionHashing to "consistent" in the bootstrap
+    instead hashes the auction ids onto a ring of the shards that are
+    currently connected, as discovered through the configuration service
+    among the first postAuctionShards shard indexes, so that shards can come
+    and go without their load being lost or every auction moving.  The router and the adserver connectors must use the same
+    hashing for the wins to reach the shard that has the auction.
+
+    Rather than moving the in-flight auctions between shards when the ring
+    changes, the rings of the last postAuctionHandoffWindow seconds (60 by
+    default) are kept and an event is sent to the shard that owned its
+    auction at its bidTimestamp, as long as that shard is still connected.
  */
 struct PostAuctionProxy
 {
@@ -39,7 +54,8 @@ struct PostAuctionProxy
 
     void init();
 
-    // Returns true only the proxy is connected to all shards.
+    // Returns true only the proxy is connected to all shards, or to any
+    // shard with consistent hashing.
     bool isConnected() const;
 
     // Sends an auction to the post auction loop.
@@ -48,14 +64,36 @@ struct PostAuctionProxy
     // Sends an event to the post auction loop.
     void sendEvent(std::shared_ptr<PostAuctionEvent> event);
 
+    /** Sends a batch of events, with a single EVENTS message per post
+        auction shard.  Requires post auction services that understand EVENTS
+        messages.
+     */
+    void sendEvents(const std::vector< std::shared_ptr<PostAuctionEvent> >& events);
+
 private:
     void initZMQ();
     void initHTTP();
 
+    /** Shard of the auction with the given id that was bid on at the given
+        time, which is not a date for a new auction. */
+    size_t shardFor(const Datacratic::Id & auctionId, Date bidTime) const;
+
+    /** Rebuild the ring from the shards that are currently connected. */
+    void updateRing();
+
     Datacratic::ServiceBase* parent;
     std::shared_ptr<Datacratic::ServiceProxies> proxies;
 
     size_t shards;
+
+    bool consistentHashing;
+    double handoffWindow;
+
+    /** Rings that were current in the handoff window, with the time they
+        took over, from oldest to newest.  Never empty once initialized. */
+    typedef std::pair<Date, std::shared_ptr<const ConsistentHashRing> > Ring;
+    std::vector<Ring> rings;
+    mutable ML::Spinlock ringsLock;
     std::unique_ptr<Datacratic::ZmqMultipleNamedClientBusProxy> zmq;
     std::vector< std::shared_ptr<EventForwarder> > http;
 };
@@ -15,6 +15,11 @@
 #include "jml/db/persistent.h"
 #include <boost/make_shared.hpp>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <string.h>
 
 using namespace std;
 using namespace ML;
@@ -430,8 +435,21 @@ void
 SegmentList::
 serialize(ML::DB::Store_Writer & store) const
 {
-    unsigned char version = 0;
-    store << version << ints << strings << weights;
+    if (!std::is_sorted(ints.begin(), ints.end())) {
+        unsigned char version = 0;
+        store << version << ints << strings << weights;
+        return;
+    }
+
+    // Version 1: the first int then the (positive) deltas as varints
+    unsigned char version = 1;
+    store << version << compact_size_t(ints.size());
+    for (unsigned i = 0;  i < ints.size();  ++i) {
+        if (i == 0)
+            store << compact_int_t(ints[0]);
+        else store << compact_size_t((int64_t)ints[i] - ints[i - 1]);
+    }
+    store << strings << weights;
 }
 
 void
@@ -440,9 +458,22 @@ reconstitute(ML::DB::Store_Reader & store)
 {
     unsigned char version;
     store >> version;
-    if (version > 0)
-        throw ML::Exception("unknown SegmentList version");
-    store >> ints >> strings >> weights;
+    if (version == 0)
+        store >> ints;
+    else if (version == 1) {
+        compact_size_t n(store);
+        ints.clear();
+        ints.reserve(n);
+        int64_t last = 0;
+        for (unsigned i = 0;  i < n;  ++i) {
+            if (i == 0)
+                last = compact_int_t(store);
+            else last += compact_size_t(store);
+            ints.push_back(last);
+        }
+    }
+    else throw ML::Exception("unknown SegmentList version");
+    store >> strings >> weights;
 }
 
 std::string
@@ -459,6 +490,37 @@ reconstituteFromString(const std::string & str)
     return ML::DB::reconstituteFromString<SegmentList>(str);
 }
 
+uint64_t
+SegmentList::
+hash() const
+{
+    auto mix = [] (uint64_t h, uint64_t v)
+        {
+            return (h ^ v) * 0x100000001b3ULL + (h >> 29);
+        };
+
+    uint64_t result = mix(ints.size(), strings.size());
+    for (int i: ints)
+        result = mix(result, i);
+    for (const string & str: strings)
+        result = mix(result, std::hash<string>()(str));
+    for (float w: weights) {
+        uint32_t bits;
+        memcpy(&bits, &w, sizeof(bits));
+        result = mix(result, bits);
+    }
+    return result;
+}
+
+bool
+SegmentList::
+operator == (const SegmentList & other) const
+{
+    return ints == other.ints
+        && strings == other.strings
+        && weights == other.weights;
+}
+
 void
 SegmentList::
 forEach(const std::function<void (int, string, float)> & onSegment) const
@@ -472,10 +534,162 @@ forEach(const std::function<void (int, string, float)> & onSegment) const
 }
 
 
+/*****************************************************************************/
+/* SEGMENT LIST CACHE                                                        */
+/*****************************************************************************/
+
+namespace {
+
+std::atomic<bool> cacheEnabled(true);
+
+/** Intern in the global cache if it's enabled. */
+std::shared_ptr<SegmentList>
+internSegments(const std::shared_ptr<SegmentList> & segs)
+{
+    if (!cacheEnabled)
+        return segs;
+    return SegmentListCache::global().intern(segs);
+}
+
+} // file scope
+
+struct SegmentListCache::Shard {
+    Shard()
+        : hits(0), misses(0), evictions(0)
+    {
+    }
+
+    mutable std::mutex lock;
+    std::unordered_multimap<uint64_t, std::shared_ptr<SegmentList> > entries;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+SegmentListCache::
+SegmentListCache(size_t capacity, size_t minSize)
+    : shardCapacity(std::max<size_t>(capacity / NumShards, 1)),
+      minSize(minSize),
+      shards(new Shard[NumShards])
+{
+}
+
+SegmentListCache::
+~SegmentListCache()
+{
+}
+
+std::shared_ptr<SegmentList>
+SegmentListCache::
+intern(const std::shared_ptr<SegmentList> & segs)
+{
+    if (!segs || segs->size() < minSize)
+        return segs;
+
+    uint64_t hash = segs->hash();
+    Shard & shard = shards[hash % NumShards];
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto range = shard.entries.equal_range(hash);
+    for (auto it = range.first;  it != range.second;  ++it) {
+        if (*it->second == *segs) {
+            ++shard.hits;
+            return it->second;
+        }
+    }
+
+    ++shard.misses;
+
+    if (shard.entries.size() >= shardCapacity) {
+        // First drop what only the cache still holds on to
+        for (auto it = shard.entries.begin();  it != shard.entries.end();) {
+            if (it->second.unique()) {
+                it = shard.entries.erase(it);
+                ++shard.evictions;
+            }
+            else ++it;
+        }
+
+        if (shard.entries.size() >= shardCapacity) {
+            shard.evictions += shard.entries.size();
+            shard.entries.clear();
+        }
+    }
+
+    shard.entries.emplace(hash, segs);
+    return segs;
+}
+
+SegmentListCache::Stats
+SegmentListCache::
+stats() const
+{
+    Stats result = { 0, 0, 0, 0 };
+    for (unsigned i = 0;  i < NumShards;  ++i) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        result.hits += shards[i].hits;
+        result.misses += shards[i].misses;
+        result.evictions += shards[i].evictions;
+        result.size += shards[i].entries.size();
+    }
+    return result;
+}
+
+void
+SegmentListCache::
+clear()
+{
+    for (unsigned i = 0;  i < NumShards;  ++i) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].entries.clear();
+    }
+}
+
+SegmentListCache &
+SegmentListCache::
+global()
+{
+    static SegmentListCache result;
+    return result;
+}
+
+void
+SegmentListCache::
+setEnabled(bool enabled)
+{
+    cacheEnabled = enabled;
+    if (!enabled)
+        global().clear();
+}
+
+bool
+SegmentListCache::
+enabled()
+{
+    return cacheEnabled;
+}
+
+
 /*****************************************************************************/
 /* SEGMENTS BY SOURCE                                                        */
 /*****************************************************************************/
 
+namespace {
+
+/** Make the list for the given entry safe to modify: it may be shared with
+    other requests through the cache.
+*/
+void makeUnique(std::shared_ptr<SegmentList> & entry)
+{
+    if (!entry)
+        entry.reset(new SegmentList());
+    else if (!entry.unique())
+        entry = std::make_shared<SegmentList>(*entry);
+}
+
+} // file scope
+
 SegmentsBySource::
 SegmentsBySource()
 {
@@ -498,8 +712,14 @@ SegmentsBySource::
 sortAll()
 {
     for (auto it = begin(), end = this->end();
-         it != end;  ++it)
+         it != end;  ++it) {
+        const SegmentList & segs = *it->second;
+        if (std::is_sorted(segs.ints.begin(), segs.ints.end())
+            && std::is_sorted(segs.strings.begin(), segs.strings.end()))
+            continue;
+        makeUnique(it->second);
         it->second->sort();
+    }
 }
 
 const SegmentList &
@@ -556,7 +776,7 @@ SegmentsBySource::
 add(const std::string & source, const std::string & segment, float weight)
 {
     auto & entry = (*this)[source];
-    if (!entry) entry.reset(new SegmentList());
+    makeUnique(entry);
     entry->add(segment, weight);
 }
 
@@ -565,7 +785,7 @@ SegmentsBySource::
 add(const std::string & source, int segment, float weight)
 {
     auto & entry = (*this)[source];
-    if (!entry) entry.reset(new SegmentList());
+    makeUnique(entry);
     entry->add(segment, weight);
 }
 
@@ -589,7 +809,7 @@ createFromJson(const Json::Value & json)
         if (it->isNull()) continue;
         auto segs = std::make_shared<SegmentList>();
         *segs = SegmentList::createFromJson(*it);
-        result.addSegment(it.memberName(), segs);
+        result.addSegment(it.memberName(), internSegments(segs));
     }
     
     return result;
@@ -625,7 +845,7 @@ reconstitute(ML::DB::Store_Reader & store)
         store >> k;
         auto l = std::make_shared<SegmentList>();
         store >> *l;
-        newMe[k] = l;
+        newMe[k] = internSegments(l);
     }
     
     swap(newMe);
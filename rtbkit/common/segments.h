@@ -4,13 +4,14 @@
 
 #pragma once
 
-#include "jml/utils/compact_vector.h"
+#include "jml/utils/compact_map.h"
 #include "jml/db/persistent_fwd.h"
 #include "soa/jsoncpp/json.h"
 #include "soa/types/value_description.h"
 #include "soa/types/value_description_fwd.h"
 #include <boost/shared_ptr.hpp>
 #include <map>
+#include <memory>
 
 
 namespace RTBKIT {
@@ -79,10 +80,23 @@ struct SegmentList {
     std::vector<std::string> strings;         ///< Those that aren't an integer
     ML::compact_vector<float, 5> weights;     ///< Weights over ints and strings
     
+    /** Serialization.  When the ints are sorted, as they are after sort(),
+        they are written as varint deltas, which for the typical list of
+        segment ids takes one or two bytes per segment instead of four.
+    */
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
     std::string serializeToString() const;
     static SegmentList reconstituteFromString(const std::string & str);
+
+    /** Hash of the contents, for SegmentListCache. */
+    uint64_t hash() const;
+
+    bool operator == (const SegmentList & other) const;
+    bool operator != (const SegmentList & other) const
+    {
+        return !operator == (other);
+    }
 };
 
 IMPL_SERIALIZE_RECONSTITUTE(SegmentList);
@@ -94,14 +108,77 @@ operator << (std::ostream & stream, const SegmentList & segs)
 }
 
 
+/*****************************************************************************/
+/* SEGMENT LIST CACHE                                                        */
+/*****************************************************************************/
+
+/** Hash-consing of segment lists.  The same user's segments come in with
+    each of their requests, often seconds apart; interning them makes all of
+    those auctions share a single copy.
+
+    Interned lists are shared and must not be modified; SegmentsBySource
+    copies them before it modifies them.  The cache is sharded, each shard
+    with its own lock, and bounded: when a shard is full the lists that
+    nothing but the cache refers to are dropped, and if that doesn't free
+    enough the shard is emptied.
+*/
+
+struct SegmentListCache {
+
+    /** Lists with fewer than minSize segments aren't worth interning. */
+    SegmentListCache(size_t capacity = 1 << 16, size_t minSize = 8);
+    ~SegmentListCache();
+
+    /** Return the cached list with the same contents as segs, or cache segs
+        and return it if there is none.
+    */
+    std::shared_ptr<SegmentList>
+    intern(const std::shared_ptr<SegmentList> & segs);
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t size;
+    };
+
+    Stats stats() const;
+
+    void clear();
+
+    /** Cache used when parsing and reconstituting segments.  Disabled
+        (returning its argument) after setEnabled(false).
+    */
+    static SegmentListCache & global();
+
+    static void setEnabled(bool enabled);
+    static bool enabled();
+
+private:
+    struct Shard;
+    enum { NumShards = 16 };
+
+    size_t shardCapacity;
+    size_t minSize;
+    std::unique_ptr<Shard[]> shards;
+};
+
+
 /*****************************************************************************/
 /* SEGMENTS BY SOURCE                                                        */
 /*****************************************************************************/
 
-typedef std::map<std::string, std::shared_ptr<SegmentList> >
+typedef ML::compact_map<std::string, std::shared_ptr<SegmentList> >
 SegmentsBySourceBase;
 
-/** A set of segments per segment provider. */
+/** A set of segments per segment provider.  There are only a few sources per
+    request, so they are kept inline in a sorted vector rather than in a
+    node-based map.
+
+    The lists parsed from JSON or reconstituted are interned in
+    SegmentListCache::global(), so the add() and sortAll() methods copy a
+    list that is shared before they modify it.
+*/
 
 struct SegmentsBySource
     : public SegmentsBySourceBase {
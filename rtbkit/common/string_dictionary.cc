@@ -0,0 +1,81 @@
+/* string_dictionary.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Process wide dictionary which maps strings to dense ids.
+*/
+
+#include "string_dictionary.h"
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* STRING DICTIONARY                                                         */
+/*****************************************************************************/
+
+StringDictionary::
+StringDictionary()
+    : table(new Table())
+{
+}
+
+StringDictionary::
+~StringDictionary()
+{
+    gc.deferBarrier();
+    delete table.load();
+}
+
+StringDictionary::Id
+StringDictionary::
+intern(const string & str)
+{
+    lock_guard<mutex> guard(writeLock);
+
+    const Table * current = table.load();
+
+    auto it = current->find(str);
+    if (it != current->end()) return it->second;
+
+    Id id = current->size();
+
+    Table * next = new Table(*current);
+    next->insert(make_pair(str, id));
+    table = next;
+
+    gc.defer([=] { delete current; });
+    return id;
+}
+
+StringDictionary::Id
+StringDictionary::
+find(const string & str) const
+{
+    GcLockBase::SharedGuard guard(gc);
+
+    const Table * current = table.load();
+
+    auto it = current->find(str);
+    return it == current->end() ? Id(NoId) : it->second;
+}
+
+size_t
+StringDictionary::
+size() const
+{
+    GcLockBase::SharedGuard guard(gc);
+    return table.load()->size();
+}
+
+StringDictionary &
+StringDictionary::
+global()
+{
+    static StringDictionary dictionary;
+    return dictionary;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,59 @@
+/* string_dictionary.h                                             -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Process wide dictionary which maps strings to dense ids.
+*/
+
+#pragma once
+
+#include "soa/gc/gc_lock.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* STRING DICTIONARY                                                         */
+/*****************************************************************************/
+
+/** Maps strings to small dense ids so that filters can index the values of
+    their configurations with a vector instead of hashing the value of every
+    request.
+
+    Ids are handed out by intern() as configurations are added and are never
+    recycled.  find() doesn't take any lock and returns NoId for strings that
+    were never interned, which no filter can match anyway.
+*/
+struct StringDictionary {
+
+    typedef unsigned Id;
+    enum { NoId = Id(-1) };
+
+    StringDictionary();
+    ~StringDictionary();
+
+    /** Returns the id of the string, assigning it a new one if needed. */
+    Id intern(const std::string & str);
+
+    Id find(const std::string & str) const;
+
+    size_t size() const;
+
+    /** Dictionary shared by the filters and the FilterState. */
+    static StringDictionary & global();
+
+private:
+    typedef std::unordered_map<std::string, Id> Table;
+
+    /** Replaced by a new copy whenever a string is interned. */
+    std::atomic<const Table *> table;
+
+    std::mutex writeLock;
+    mutable Datacratic::GcLock gc;
+};
+
+} // namespace RTBKIT
@@ -0,0 +1,99 @@
+/* tags.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Dictionary of the tags used for creative and campaign filtering.
+*/
+
+#include "tags.h"
+#include "jml/arch/exception.h"
+
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+namespace RTBKIT {
+
+namespace {
+
+struct Dictionary {
+    std::mutex lock;
+    std::unordered_map<std::string, unsigned> bits;
+    std::vector<Tag> tags;
+};
+
+Dictionary & dictionary()
+{
+    static Dictionary result;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* TAG                                                                       */
+/*****************************************************************************/
+
+std::string
+Tag::
+toString() const
+{
+    return scope + ":" + key + ":" + value;
+}
+
+
+/*****************************************************************************/
+/* TAG DICTIONARY                                                            */
+/*****************************************************************************/
+
+unsigned
+TagDictionary::
+intern(const Tag & tag)
+{
+    auto & dict = dictionary();
+    std::lock_guard<std::mutex> guard(dict.lock);
+
+    auto res = dict.bits.insert(make_pair(tag.toString(), dict.tags.size()));
+    if (res.second)
+        dict.tags.push_back(tag);
+    return res.first->second;
+}
+
+Tag
+TagDictionary::
+get(unsigned bit)
+{
+    auto & dict = dictionary();
+    std::lock_guard<std::mutex> guard(dict.lock);
+
+    if (bit >= dict.tags.size())
+        throw ML::Exception("unknown tag bit %d", bit);
+    return dict.tags[bit];
+}
+
+size_t
+TagDictionary::
+size()
+{
+    auto & dict = dictionary();
+    std::lock_guard<std::mutex> guard(dict.lock);
+    return dict.tags.size();
+}
+
+
+/*****************************************************************************/
+/* TAGS                                                                      */
+/*****************************************************************************/
+
+std::vector<Tag>
+Tags::
+toTags() const
+{
+    std::vector<Tag> result;
+    for (unsigned bit = 0;  bit < active.size() * 64;  ++bit)
+        if (test(bit)) result.push_back(TagDictionary::get(bit));
+    return result;
+}
+
+} // namespace RTBKIT
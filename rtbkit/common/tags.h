@@ -1,15 +1,20 @@
 /* tags.h                                                          -*- C++ -*-
    Jeremy Barnes, 26 February 2013
-   
+
    Copyright (c) 2013 Datacratic Inc.  All rights reserved.
 
    Definitions of the "tags" class used for creative and campaign filtering.
-   
+
    This file is part of RTBkit.
 */
 
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
 
 namespace RTBKIT {
 
@@ -21,48 +26,110 @@ namespace RTBKIT {
 /** This is how an individual tag is set up. */
 
 struct Tag {
+    Tag()
+    {
+    }
+
+    Tag(std::string scope, std::string key, std::string value)
+        : scope(std::move(scope)), key(std::move(key)), value(std::move(value))
+    {
+    }
+
     std::string scope;
     std::string key;
     std::string value;
+
+    /** Returns scope:key:value. */
+    std::string toString() const;
+
+    bool operator == (const Tag & other) const
+    {
+        return scope == other.scope && key == other.key && value == other.value;
+    }
 };
 
 
 /*****************************************************************************/
-/* TAGS                                                                      */
+/* TAG DICTIONARY                                                            */
 /*****************************************************************************/
 
-struct Tags {
+/** Process wide dictionary which gives every tag a bit in Tags::active.
 
-    
+    Tags are interned as configurations are loaded, never per request, and
+    their bits are never recycled.
+*/
 
-    /// List of active tags
-    std::vector<uint64_t> active;
-};
+struct TagDictionary {
+
+    /** Returns the bit of the tag, assigning it a new one if needed. */
+    static unsigned intern(const Tag & tag);
+
+    /** Returns the tag that was given the bit. */
+    static Tag get(unsigned bit);
 
-#if 0
-struct TagsContext {
-    BidRequest * breq;
+    static size_t size();
 };
 
-struct Predicate {
-    virtual ~Predicate()
+
+/*****************************************************************************/
+/* TAGS                                                                      */
+/*****************************************************************************/
+
+/** Set of tags, as a bitset indexed by the bits of the TagDictionary. */
+
+struct Tags {
+
+    /** Adds the tag, interning it if needed. */
+    void add(const Tag & tag)
     {
+        set(TagDictionary::intern(tag));
     }
 
-    bool evaluate(const Tags & tags, TagsContext & context) const = 0;
-};
+    void set(unsigned bit)
+    {
+        if (bit / 64 >= active.size())
+            active.resize(bit / 64 + 1);
+        active[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
 
-struct OrPredicate: public Predicate {
-    
-    std::vector<std::unique_ptr<Predicate> > subexpr;
-};
+    bool test(unsigned bit) const
+    {
+        return bit / 64 < active.size()
+            && (active[bit / 64] & (uint64_t(1) << (bit % 64)));
+    }
 
-struct AndPredicate: public Predicate {
+    bool empty() const
+    {
+        for (uint64_t word: active)
+            if (word) return false;
+        return true;
+    }
+
+    /** Is any of the tags of other in this set? */
+    bool intersects(const Tags & other) const
+    {
+        size_t n = std::min(active.size(), other.active.size());
+        for (size_t i = 0;  i < n;  ++i)
+            if (active[i] & other.active[i]) return true;
+        return false;
+    }
+
+    /** Are all the tags of other in this set? */
+    bool includes(const Tags & other) const
+    {
+        for (size_t i = 0;  i < other.active.size();  ++i) {
+            uint64_t word = i < active.size() ? active[i] : 0;
+            if (other.active[i] & ~word) return false;
+        }
+        return true;
+    }
 
+    std::vector<Tag> toTags() const;
 
-    std::vector<std::unique_ptr<Predicate> > subexpr;
+    /// List of active tags
+    std::vector<uint64_t> active;
 };
-#endif
+
 
 /*****************************************************************************/
 /* TAG FILTER                                                                */
@@ -70,7 +137,10 @@ struct AndPredicate: public Predicate {
 
 /** Tag filter.  Represents
 
-    All in mustInclude are set and none in mustNotInclude are set.
+    One in mustIncludeOneOf is set (if it isn't empty), all in
+    mustIncludeAllOf are set and none in mustNotIncludeAnyOf are set.
+
+    Each of these is a mask test over the bitsets.
 */
 
 struct TagFilter {
@@ -79,7 +149,13 @@ struct TagFilter {
     Tags mustNotIncludeAnyOf;
 
     /** Does this filter match the given set of tags? */
-    bool matches(const Tags & tagsToMatch) const;
+    bool matches(const Tags & tagsToMatch) const
+    {
+        return (mustIncludeOneOf.empty()
+                || tagsToMatch.intersects(mustIncludeOneOf))
+            && tagsToMatch.includes(mustIncludeAllOf)
+            && !tagsToMatch.intersects(mustNotIncludeAnyOf);
+    }
 };
 
 
@@ -87,12 +163,23 @@ struct TagFilter {
 /* TAG FILTER EXPRESSION                                                     */
 /*****************************************************************************/
 
-/** Class to deal with evaluating a filter expression. */
+/** Class to deal with evaluating a filter expression.
+
+    The expression is the disjunction of its filters: it matches if any of
+    them does, and an empty expression matches everything.  Any and/or
+    combination of tag tests can be flattened into this form, which
+    evaluates as a short sequence of mask tests.
+*/
 
 struct TagFilterExpression : public std::vector<TagFilter> {
-    
+
+    bool matches(const Tags & tagsToMatch) const
+    {
+        if (empty()) return true;
+        for (const TagFilter & filter: *this)
+            if (filter.matches(tagsToMatch)) return true;
+        return false;
+    }
 };
 
 } // namespace RTBKIT
-
-
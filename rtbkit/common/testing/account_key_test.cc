@@ -0,0 +1,81 @@
+/** account_key_test.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tests for account keys and their interned ids.
+
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/common/account_key.h"
+
+#include <boost/test/unit_test.hpp>
+#include <unordered_map>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_account_key_id )
+{
+    AccountKey key("campaign:strategy");
+
+    BOOST_CHECK(!AccountKeyId::find(key));
+
+    AccountKeyId id = AccountKeyId::intern(key);
+    BOOST_CHECK(id);
+    BOOST_CHECK_EQUAL(id.key(), key);
+    BOOST_CHECK_EQUAL(id.hash(), key.hash());
+    BOOST_CHECK_EQUAL(id.toString(), "campaign:strategy");
+
+    BOOST_CHECK_EQUAL(AccountKeyId::find(key), id);
+    BOOST_CHECK_EQUAL(AccountKeyId::intern(AccountKey("campaign:strategy")), id);
+
+    AccountKeyId child = AccountKeyId::intern(key.childKey("spend"));
+    BOOST_CHECK_NE(child, id);
+    BOOST_CHECK_EQUAL(child.key().parent(), key);
+
+    // The null id stands for the empty key.
+    AccountKeyId null;
+    BOOST_CHECK(null.isNull());
+    BOOST_CHECK(null.key().empty());
+    BOOST_CHECK_EQUAL(AccountKeyId::intern(AccountKey()), null);
+
+    std::unordered_map<AccountKeyId, int> map;
+    map[id] = 1;
+    map[child] = 2;
+    BOOST_CHECK_EQUAL(map[AccountKeyId::find(key)], 1);
+    BOOST_CHECK_EQUAL(map[AccountKeyId::find(key.childKey("spend"))], 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_account_key_id_threads )
+{
+    // Threads interning the same keys concurrently must agree on their ids.
+    int nThreads = 8, nKeys = 10000;
+    vector<vector<AccountKeyId> > ids(nThreads);
+
+    vector<std::thread> threads;
+    for (int i = 0;  i < nThreads;  ++i) {
+        threads.emplace_back([&, i] ()
+            {
+                for (int j = 0;  j < nKeys;  ++j) {
+                    int k = (j * 7 + i) % nKeys;
+                    AccountKey key{"threads", "key" + to_string(k)};
+                    ids[i].push_back(AccountKeyId::intern(key));
+                }
+            });
+    }
+    for (auto & th: threads)
+        th.join();
+
+    for (int i = 0;  i < nThreads;  ++i) {
+        for (int j = 0;  j < nKeys;  ++j) {
+            int k = (j * 7 + i) % nKeys;
+            AccountKey key{"threads", "key" + to_string(k)};
+            BOOST_REQUIRE_EQUAL(ids[i][j], AccountKeyId::find(key));
+            BOOST_REQUIRE_EQUAL(ids[i][j].key(), key);
+        }
+    }
+}
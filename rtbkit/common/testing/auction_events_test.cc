@@ -0,0 +1,108 @@
+/* auction_events_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the serialization of the auction events.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/common/auction_events.h"
+#include "jml/db/persistent.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+std::shared_ptr<BidRequest> makeBidRequest(const Id & auctionId)
+{
+    auto bidRequest = std::make_shared<BidRequest>();
+
+    AdSpot spot;
+    spot.id = Id(1);
+    spot.formats.push_back(Format(160, 600));
+    bidRequest->imp.push_back(spot);
+
+    spot.id = Id(2);
+    spot.formats[0] = Format(300, 250);
+    bidRequest->imp.push_back(spot);
+
+    bidRequest->auctionId = auctionId;
+    bidRequest->exchange = "mock";
+    bidRequest->language = "en";
+    bidRequest->url = Url("http://datacratic.com");
+    bidRequest->timestamp = Date::fromSecondsSinceEpoch(1000);
+    bidRequest->userIds.add(Id("user"), ID_EXCHANGE);
+
+    return bidRequest;
+}
+
+SubmittedAuctionEvent makeEvent()
+{
+    SubmittedAuctionEvent event;
+    event.auctionId = Id("auction");
+    event.adSpotId = Id(2);
+    event.lossTimeout = Date::fromSecondsSinceEpoch(1015);
+    event.augmentations = JsonHolder(string("{\"aug\":1}"));
+    event.bidRequest(makeBidRequest(event.auctionId));
+    event.bidRequestStr = event.bidRequest()->toJsonStr();
+    event.bidRequestStrFormat = "datacratic";
+    event.bidResponse = Auction::Response(USD_CPM(2), 1, AccountKey("a.b.c"));
+
+    return event;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_submitted_auction_binary )
+{
+    SubmittedAuctionEvent event = makeEvent();
+
+    string str = DB::serializeToString(event);
+    BOOST_CHECK_EQUAL(str[0], 1);
+
+    auto result = DB::reconstituteFromString<SubmittedAuctionEvent>(str);
+    BOOST_CHECK_EQUAL(result.auctionId, event.auctionId);
+    BOOST_CHECK_EQUAL(result.adSpotId, event.adSpotId);
+    BOOST_CHECK_EQUAL(result.lossTimeout, event.lossTimeout);
+    BOOST_CHECK_EQUAL(result.augmentations.toString(),
+                      event.augmentations.toString());
+    BOOST_CHECK_EQUAL(result.bidRequestStrFormat, "datacratic");
+    BOOST_CHECK_EQUAL(result.bidResponse.account, event.bidResponse.account);
+
+    // The bid request is only decoded on demand.
+    BOOST_CHECK(result.hasBidRequest());
+    BOOST_CHECK(result.bidRequestStr.empty());
+    BOOST_CHECK_EQUAL(result.bidRequest()->toJsonStr(),
+                      event.bidRequest()->toJsonStr());
+
+    // Forwarding an event that was never decoded sends the same bytes.
+    auto forwarded = DB::reconstituteFromString<SubmittedAuctionEvent>(str);
+    BOOST_CHECK_EQUAL(DB::serializeToString(forwarded), str);
+}
+
+BOOST_AUTO_TEST_CASE( test_submitted_auction_version_0 )
+{
+    SubmittedAuctionEvent event = makeEvent();
+
+    ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        store << (unsigned char)0
+              << event.auctionId << event.adSpotId << event.lossTimeout
+              << event.augmentations << event.bidRequestStr
+              << event.bidResponse << event.bidRequestStrFormat;
+    }
+
+    auto result =
+        DB::reconstituteFromString<SubmittedAuctionEvent>(stream.str());
+    BOOST_CHECK_EQUAL(result.auctionId, event.auctionId);
+    BOOST_CHECK_EQUAL(result.bidRequestStr, event.bidRequestStr);
+    BOOST_CHECK_EQUAL(result.bidRequest()->toJsonStr(),
+                      event.bidRequest()->toJsonStr());
+}
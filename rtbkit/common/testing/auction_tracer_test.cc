@@ -0,0 +1,100 @@
+/* auction_tracer_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the sampled auction tracer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/common/auction_tracer.h"
+
+#include <thread>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_sampling )
+{
+    AuctionTracer tracer(16);
+
+    Id auction("auction1");
+    tracer.record(auction, "AUCTION");
+    BOOST_CHECK(tracer.collect(auction).empty());
+
+    tracer.setSampleRate(1.0);
+    BOOST_CHECK(tracer.sampled(auction));
+
+    // Sampling only depends on the id, so every service agrees
+    tracer.setSampleRate(0.5);
+    int numSampled = 0;
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        Id id("auction" + to_string(i));
+        BOOST_CHECK_EQUAL(tracer.sampled(id), tracer.sampled(id));
+        numSampled += tracer.sampled(id);
+    }
+    BOOST_CHECK_GT(numSampled, 400);
+    BOOST_CHECK_LT(numSampled, 600);
+
+    BOOST_CHECK_THROW(tracer.setSampleRate(1.5), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_timeline )
+{
+    AuctionTracer tracer(16);
+    tracer.setSampleRate(1.0);
+
+    Id auction("auction1");
+    Id other("auction2");
+
+    tracer.record(auction, "AUCTION");
+    std::thread([&] {
+            tracer.recordSpot(auction, Id("spot1"), "BID", "agent1", 1000);
+            tracer.record(other, "AUCTION");
+        }).join();
+    tracer.record(auction, "SUBMITTED", "", 1);
+
+    auto events = tracer.collect(auction);
+    BOOST_REQUIRE_EQUAL(events.size(), 3);
+    BOOST_CHECK_EQUAL(events[0].type, string("AUCTION"));
+    BOOST_CHECK_EQUAL(events[1].type, string("BID"));
+    BOOST_CHECK_EQUAL(events[1].spot, string("spot1"));
+    BOOST_CHECK_EQUAL(events[1].actor, string("agent1"));
+    BOOST_CHECK_EQUAL(events[1].value, 1000);
+    BOOST_CHECK_EQUAL(events[2].type, string("SUBMITTED"));
+
+    auto json = tracer.timeline(auction);
+    BOOST_CHECK_EQUAL(json.size(), 3);
+    BOOST_CHECK_EQUAL(json[1]["actor"].asString(), "agent1");
+
+    // Everything is drained once
+    int numDrained = 0;
+    auto onEvent = [&] (const AuctionTraceEvent &) { ++numDrained; };
+    BOOST_CHECK_EQUAL(tracer.drain(onEvent), 0);
+    BOOST_CHECK_EQUAL(numDrained, 4);
+    BOOST_CHECK_EQUAL(tracer.drain(onEvent), 0);
+    BOOST_CHECK_EQUAL(numDrained, 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_wrap )
+{
+    AuctionTracer tracer(16);
+    tracer.setSampleRate(1.0);
+
+    Id auction("auction1");
+    for (unsigned i = 0;  i < 20;  ++i)
+        tracer.record(auction, "EVENT", "", i);
+
+    // Only the most recent events are kept
+    auto events = tracer.collect(auction);
+    BOOST_REQUIRE(!events.empty());
+    BOOST_CHECK_LE(events.size(), 16);
+    BOOST_CHECK_EQUAL(events.back().value, 19);
+
+    int numDrained = 0;
+    uint64_t lost = tracer.drain([&] (const AuctionTraceEvent &) { ++numDrained; });
+    BOOST_CHECK_EQUAL(lost + numDrained, 20);
+}
@@ -0,0 +1,125 @@
+/* auction_usage_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the per-auction usage accounting.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "rtbkit/common/auction_usage.h"
+#include "soa/utils/allocation_counts.h"
+#include "soa/utils/count_allocations.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+/** Burn some CPU and make n allocations of 100 bytes. */
+void work(int n)
+{
+    volatile double x = 0;
+    for (int i = 0;  i < 1000000;  ++i)
+        x = x + i;
+
+    for (int i = 0;  i < n;  ++i)
+        delete[] new char[100];
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_allocation_counts )
+{
+    BOOST_CHECK(AllocationCounts::enabled());
+
+    AllocationCounts before = AllocationCounts::currentThread();
+    AllocationCounts beforeAll = AllocationCounts::current();
+
+    work(10);
+
+    AllocationCounts used = AllocationCounts::currentThread() - before;
+    BOOST_CHECK_EQUAL(used.allocations, 10);
+    BOOST_CHECK_EQUAL(used.bytes, 1000);
+
+    // Another thread's allocations only show up in the total, even once
+    // it has exited
+    std::thread([] () { work(5); }).join();
+
+    AllocationCounts usedAll = AllocationCounts::current() - beforeAll;
+    BOOST_CHECK_GE(usedAll.allocations, 15);
+    BOOST_CHECK_GE(usedAll.bytes, 1500);
+}
+
+BOOST_AUTO_TEST_CASE( test_auction_usage_meter )
+{
+    AuctionUsage usage;
+    {
+        AuctionUsage::Meter meter(&usage, AuctionUsage::FILTER);
+        work(3);
+    }
+    {
+        AuctionUsage::Meter meter(&usage, AuctionUsage::BID);
+        work(2);
+        AuctionUsage::Counts charged = meter.stop();
+        BOOST_CHECK_EQUAL(charged.allocations, 2);
+
+        // Stopped meters don't charge again
+        work(2);
+    }
+
+    // Meters of auctions that aren't sampled do nothing
+    {
+        AuctionUsage::Meter meter(nullptr, AuctionUsage::BID);
+        work(1);
+    }
+
+    auto filter = usage.charged(AuctionUsage::FILTER);
+    BOOST_CHECK_EQUAL(filter.allocations, 3);
+    BOOST_CHECK_EQUAL(filter.bytes, 300);
+    BOOST_CHECK_GT(filter.cpuNs, 0);
+
+    auto bid = usage.charged(AuctionUsage::BID);
+    BOOST_CHECK_EQUAL(bid.allocations, 2);
+    BOOST_CHECK_EQUAL(usage.charged(AuctionUsage::PARSE).allocations, 0);
+    BOOST_CHECK_EQUAL(usage.total().allocations, 5);
+
+    Json::Value json = usage.toJson();
+    BOOST_CHECK_EQUAL(json["filter"]["allocations"].asInt(), 3);
+    BOOST_CHECK_EQUAL(json["total"]["bytes"].asInt(), 500);
+}
+
+BOOST_AUTO_TEST_CASE( test_auction_usage_totals )
+{
+    AuctionUsage first, second;
+    AuctionUsage::Counts counts;
+    counts.cpuNs = 4000;
+    counts.allocations = 2;
+    counts.bytes = 64;
+    first.charge(AuctionUsage::PARSE, counts);
+    second.charge(AuctionUsage::PARSE, counts);
+    second.charge(AuctionUsage::BID, counts);
+
+    AuctionUsageTotals totals;
+    totals.add("adx", first);
+    totals.add("adx", second);
+    totals.add("rubicon", second);
+
+    Json::Value json = totals.toJson();
+    BOOST_CHECK_EQUAL(json["adx"]["auctions"].asInt(), 2);
+    BOOST_CHECK_EQUAL(json["adx"]["stages"]["parse"]["cpuUsPerAuction"]
+                      .asDouble(), 4.0);
+    BOOST_CHECK_EQUAL(json["adx"]["stages"]["bid"]["allocationsPerAuction"]
+                      .asDouble(), 1.0);
+    BOOST_CHECK_EQUAL(json["adx"]["bytesPerAuction"].asDouble(), 96.0);
+    BOOST_CHECK_EQUAL(json["rubicon"]["auctions"].asInt(), 1);
+
+    totals.clear();
+    BOOST_CHECK_EQUAL(totals.toJson().size(), 0);
+}
@@ -0,0 +1,189 @@
+/* bid_request_corpus.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Generates arbitrarily large corpora of realistic bid requests for scale
+   testing, from a model of the field distributions learned on a captured
+   corpus.
+
+   Learn a model from captured requests, one JSON request per line:
+
+       bid_request_corpus --learn capture.json.gz --save-model openrtb.model
+
+   Generate ten million requests with a churning population of users:
+
+       bid_request_corpus --model openrtb.model --count 10000000 \
+           --users 1000000 --churn 0.01 --seed 1 --output corpus.json.gz
+
+   The defaults match OpenRTB. For AppNexus requests the ids live elsewhere:
+
+       --request-id bid_request.auction_id_64 \
+       --user-id bid_request.bid_info.user_id_64 --numeric-ids
+*/
+
+#include "bid_request_synth.h"
+#include "soa/jsoncpp/value.h"
+#include "soa/jsoncpp/reader.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/utils/rng.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace boost::program_options;
+using namespace RTBKIT;
+
+
+/** Turns "imp.*.id" into the path of the synth, where * is any array index. */
+Synth::NodePath parsePath(const string & str)
+{
+    Synth::NodePath path;
+    boost::split(path, str, boost::is_any_of("."));
+
+    for (string & key : path)
+        if (key == "*") key = Synth::ArrayIndex;
+
+    return path;
+}
+
+vector<Synth::NodePath> parsePaths(const vector<string> & strs)
+{
+    vector<Synth::NodePath> paths;
+    for (const string & str : strs)
+        paths.push_back(parsePath(str));
+    return paths;
+}
+
+bool contains(const vector<Synth::NodePath> & paths,
+              const Synth::NodePath & path)
+{
+    return find(paths.begin(), paths.end(), path) != paths.end();
+}
+
+
+int main(int argc, char ** argv)
+{
+    vector<string> learnFiles;
+    string modelFile;
+    string saveModelFile;
+    string outputFile = "-";
+    size_t count = 1000;
+    uint32_t seed = 0;
+    size_t users = 100000;
+    double churn = 0.01;
+    bool numericIds = false;
+    vector<string> requestIds = { "id" };
+    vector<string> userIds = { "user.id" };
+    vector<string> cutoffs;
+
+    options_description options("Options");
+    options.add_options()
+        ("learn,l", value(&learnFiles),
+         "captured requests to learn from, one JSON request per line")
+        ("model,m", value(&modelFile),
+         "model to generate from, as saved by --save-model")
+        ("save-model,s", value(&saveModelFile),
+         "file to save the learned model to")
+        ("output,o", value(&outputFile),
+         "file to write the generated requests to")
+        ("count,n", value(&count),
+         "number of requests to generate")
+        ("seed", value(&seed),
+         "seed of the generator; the same seed gives the same corpus")
+        ("users,u", value(&users),
+         "size of the population of user ids")
+        ("churn,c", value(&churn),
+         "probability that each request replaces a user by a new one")
+        ("request-id", value(&requestIds)->composing(),
+         "path of a field that gets a fresh id in each request")
+        ("user-id", value(&userIds)->composing(),
+         "path of a field that gets an id from the user population")
+        ("numeric-ids", bool_switch(&numericIds),
+         "generate ids as integers rather than strings")
+        ("cutoff", value(&cutoffs)->composing(),
+         "path of a field to record as a whole rather than field by field")
+        ("help,h", "print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(options).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << options << endl;
+        return 1;
+    }
+
+    if (learnFiles.empty() == modelFile.empty()) {
+        cerr << "exactly one of --learn or --model is required" << endl
+             << options << endl;
+        return 1;
+    }
+
+    auto requestIdPaths = parsePaths(requestIds);
+    auto userIdPaths = parsePaths(userIds);
+    auto cutoffPaths = parsePaths(cutoffs);
+
+    BidRequestSynth synth;
+
+    synth.isGeneratedFn = [&] (const Synth::NodePath & path) {
+        return contains(requestIdPaths, path) || contains(userIdPaths, path);
+    };
+    synth.isCutoffFn = [&] (const Synth::NodePath & path) {
+        return contains(cutoffPaths, path);
+    };
+
+    if (!modelFile.empty()) {
+        ML::filter_istream stream(modelFile);
+        synth.load(stream);
+    }
+
+    size_t learned = 0;
+    for (const string & file : learnFiles) {
+        ML::filter_istream stream(file);
+
+        string line;
+        while (getline(stream, line)) {
+            if (line.empty()) continue;
+            synth.record(Json::parse(line));
+            ++learned;
+        }
+    }
+    if (!learnFiles.empty())
+        cerr << "learned from " << learned << " requests" << endl;
+
+    if (!saveModelFile.empty()) {
+        ML::filter_ostream stream(saveModelFile);
+        synth.dump(stream);
+    }
+
+    if (!vm.count("count") && !saveModelFile.empty())
+        return 0;
+
+    // Each source of randomness gets its own seed so that changing the
+    // population doesn't change the rest of the requests.
+    Synth::IdPool requestPool(0, 0.0, seed + 1);
+    Synth::IdPool userPool(users, churn, seed + 2);
+
+    synth.generatorFn = [&] (const Synth::NodePath & path) {
+        Synth::IdPool & pool =
+            contains(userIdPaths, path) ? userPool : requestPool;
+        uint64_t id = pool.next();
+
+        if (numericIds) return Json::Value(Json::UInt(id));
+        return Json::Value(to_string(id));
+    };
+
+    ML::RNG rng(seed);
+    ML::filter_ostream output(outputFile);
+
+    for (size_t i = 0; i < count; ++i)
+        output << synth.generate(rng).toStringNoNewLine() << '\n';
+
+    return 0;
+}
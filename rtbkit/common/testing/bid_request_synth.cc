@@ -569,6 +569,48 @@ void dumpNode(Node* node, ostream& stream)
     stream << "}";
 }
 
+
+/******************************************************************************/
+/* ID POOL                                                                    */
+/******************************************************************************/
+
+IdPool::
+IdPool(size_t size, double churn, uint32_t seed) :
+    churn(churn), rng(new RNG(seed))
+{
+    ExcCheck(size <= uint32_t(-1), "id population is too large");
+
+    ids.reserve(size);
+    for (size_t i = 0; i < size; ++i)
+        ids.push_back(fresh());
+}
+
+IdPool::
+~IdPool()
+{}
+
+uint64_t
+IdPool::
+fresh()
+{
+    uint64_t id = uint64_t(rng->random()) << 32 | rng->random();
+
+    // Exchanges tend to treat 0 as a missing id.
+    return id ? id : fresh();
+}
+
+uint64_t
+IdPool::
+next()
+{
+    if (ids.empty()) return fresh();
+
+    if (churn > 0.0 && rng->random01() < churn)
+        ids[rng->random(ids.size())] = fresh();
+
+    return ids[rng->random(ids.size())];
+}
+
 } // namepsace Synth
 
 
@@ -54,6 +54,36 @@ typedef std::function<Json::Value(const NodePath&)> GeneratorFn;
 typedef std::function<bool(const NodePath&)> TestPathFn;
 
 static constexpr const char* ArrayIndex = "_i_";
+
+
+/******************************************************************************/
+/* ID POOL                                                                    */
+/******************************************************************************/
+
+/** Source of values for identifier fields (user ids, request ids) which can't
+    be replayed from the recorded distribution without skewing the caches and
+    frequency caps that the synthetic requests are meant to exercise.
+
+    Ids are drawn from a population of a fixed size. Each draw first replaces a
+    random member of the population by a fresh id with a probability of
+    churn. A population of 0 makes every id fresh, which is what request ids
+    need. The sequence only depends on the seed.
+*/
+struct IdPool
+{
+    IdPool(size_t size = 0, double churn = 0.0, uint32_t seed = 0);
+    ~IdPool();
+
+    uint64_t next();
+
+private:
+    uint64_t fresh();
+
+    std::vector<uint64_t> ids;
+    double churn;
+    std::unique_ptr<ML::RNG> rng;
+};
+
 }
 
 /******************************************************************************/
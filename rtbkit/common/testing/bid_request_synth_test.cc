@@ -237,3 +237,44 @@ BOOST_AUTO_TEST_CASE( recordGenerated )
     cerr << synth.generate().toString() << endl;
     check(synth);
 }
+
+BOOST_AUTO_TEST_CASE( idPool )
+{
+    cerr << "\n=== ID POOL\n";
+
+    // No population means a fresh id every time.
+    {
+        Synth::IdPool pool;
+        set<uint64_t> ids;
+        for (size_t i = 0; i < 1000; ++i)
+            ids.insert(pool.next());
+        BOOST_CHECK_EQUAL(ids.size(), 1000);
+    }
+
+    // Without churn, only the initial population is ever drawn.
+    {
+        Synth::IdPool pool(10, 0.0, 1);
+        set<uint64_t> ids;
+        for (size_t i = 0; i < 1000; ++i)
+            ids.insert(pool.next());
+        BOOST_CHECK_LE(ids.size(), 10);
+    }
+
+    // Churn brings in new ids while keeping some of the old ones around.
+    {
+        Synth::IdPool pool(100, 0.5, 1);
+        set<uint64_t> ids;
+        size_t seen = 0;
+        for (size_t i = 0; i < 1000; ++i)
+            seen += !ids.insert(pool.next()).second;
+        BOOST_CHECK_GT(ids.size(), 100);
+        BOOST_CHECK_GT(seen, 0);
+    }
+
+    // Same seed, same ids.
+    {
+        Synth::IdPool a(100, 0.1, 42), b(100, 0.1, 42);
+        for (size_t i = 0; i < 1000; ++i)
+            BOOST_CHECK_EQUAL(a.next(), b.next());
+    }
+}
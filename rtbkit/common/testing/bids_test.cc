@@ -19,3 +19,50 @@ BOOST_AUTO_TEST_CASE(creativeMatrixTest)
   BOOST_CHECK_EQUAL(bidObj[0].spotIndex, 0);
   BOOST_CHECK_EQUAL(bidObj[0].ext.toStringNoNewLine(), "[\"test1\",\"test2\"]");
 }
+
+BOOST_AUTO_TEST_CASE(parseBidsTest)
+{
+  std::string testStr =
+      "{\"bids\":[{\"creative\":1,\"price\":\"1500USD/1M\",\"priority\":0.5,"
+      "\"spotIndex\":1,\"account\":\"a:b\",\"ext\":null},"
+      "{\"spotIndex\":0,\"price\":\"0\"}],"
+      "\"sources\":[\"src1\"]}";
+  Bids bids = Bids::parse(testStr);
+
+  BOOST_CHECK(!Bids::isBinary(testStr));
+  BOOST_REQUIRE_EQUAL(bids.size(), 2);
+  BOOST_CHECK_EQUAL(bids[0].creativeIndex, 1);
+  BOOST_CHECK_EQUAL(bids[0].price, USD_CPM(1.5));
+  BOOST_CHECK_EQUAL(bids[0].priority, 0.5);
+  BOOST_CHECK_EQUAL(bids[0].spotIndex, 1);
+  BOOST_CHECK_EQUAL(bids[0].account.toString(), "a:b");
+  BOOST_CHECK(bids[0].ext.isNull());
+  BOOST_CHECK(bids[1].isNullBid());
+  BOOST_CHECK_EQUAL(bids.dataSources.count("src1"), 1);
+
+  BOOST_CHECK_THROW(Bids::parse("{\"bids\":[{\"price\":\"1500\"}]}"),
+                    std::exception);
+  BOOST_CHECK_THROW(Bids::parse("{\"bids\":[{\"bogus\":1}]}"),
+                    std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(binaryBidsTest)
+{
+  std::string testStr =
+      "{\"bids\":[{\"creative\":1,\"price\":\"1500USD/1M\",\"priority\":0.5,"
+      "\"spotIndex\":1,\"account\":\"a:b\",\"ext\":{\"k\":\"v\"}},"
+      "{\"spotIndex\":0}],"
+      "\"sources\":[\"src1\",\"src2\"]}";
+  Bids bids = Bids::fromJson(testStr);
+
+  std::string binary = bids.toBinary();
+  BOOST_CHECK(Bids::isBinary(binary));
+
+  Bids decoded = Bids::parse(binary);
+  BOOST_CHECK_EQUAL(decoded.toJsonStr(), bids.toJsonStr());
+  BOOST_CHECK_EQUAL(decoded[0].account.toString(), "a:b");
+  BOOST_CHECK_EQUAL(decoded[0].ext["k"].asString(), "v");
+
+  BOOST_CHECK_THROW(Bids::parse(binary.substr(0, binary.size() - 1)),
+                    std::exception);
+}
@@ -2,9 +2,19 @@ $(eval $(call library,bid_test_utils,exchange_source.cc,bid_request rtb))
 
 $(eval $(call library,bid_request_synth,bid_request_synth.cc,arch utils jsoncpp))
 $(eval $(call test,bid_request_synth_test,bid_request_synth,boost))
+$(eval $(call program,bid_request_corpus,bid_request_synth boost_program_options utils))
 $(eval $(call test,currency_test,bid_request,boost))
+$(eval $(call test,lazy_bid_request_test,bid_request,boost))
+$(eval $(call test,segments_test,bid_request,boost))
 $(eval $(call test,filter_test,filter_registry,boost))
 $(eval $(call test,bids_test,rtb,boost))
+$(eval $(call test,account_key_test,rtb,boost))
+$(eval $(call test,latency_budget_test,rtb,boost))
+$(eval $(call test,latency_histogram_test,rtb,boost))
+$(eval $(call test,auction_usage_test,rtb allocation_counts,boost))
+$(eval $(call test,auction_tracer_test,rtb,boost))
+$(eval $(call test,auction_events_test,rtb,boost))
+$(eval $(call test,consistent_hash_ring_test,rtb,boost))
 
 $(eval $(call library,custom_1_plugin,custom_1_plugin.cc,))
 $(eval $(call test,plugin_table_test,utils,boost))
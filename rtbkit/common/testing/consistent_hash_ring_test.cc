@@ -0,0 +1,69 @@
+/* consistent_hash_ring_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the consistent hash ring of the post auction shards.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/consistent_hash_ring.h"
+#include "city.h"
+
+#include <vector>
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+uint64_t keyHash(uint64_t key)
+{
+    return Hash128to64(make_pair(key, uint64_t(0x1234)));
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_balance )
+{
+    ConsistentHashRing ring({ 0, 1, 2, 3 });
+    BOOST_CHECK_EQUAL(ring.shards().size(), 4);
+
+    enum { NumKeys = 100000 };
+    vector<size_t> counts(4);
+    for (uint64_t key = 0;  key < NumKeys;  ++key)
+        counts.at(ring.shardFor(keyHash(key)))++;
+
+    // Within 25% of an even split
+    for (size_t count: counts) {
+        BOOST_CHECK_GT(count, NumKeys / 4 * 3 / 4);
+        BOOST_CHECK_LT(count, NumKeys / 4 * 5 / 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_membership_change )
+{
+    ConsistentHashRing all({ 0, 1, 2, 3 });
+    ConsistentHashRing without2({ 3, 1, 0, 1 });
+
+    BOOST_CHECK(all.contains(2));
+    BOOST_CHECK(!without2.contains(2));
+    BOOST_CHECK_EQUAL(without2.shards().size(), 3);
+
+    // Only the keys of the shard that left move
+    for (uint64_t key = 0;  key < 10000;  ++key) {
+        uint64_t hash = keyHash(key);
+        size_t before = all.shardFor(hash);
+        size_t after = without2.shardFor(hash);
+        if (before != 2)
+            BOOST_CHECK_EQUAL(before, after);
+        else BOOST_CHECK_NE(after, 2);
+    }
+
+    // The same members always give the same ring
+    ConsistentHashRing again({ 2, 3, 0, 1 });
+    for (uint64_t key = 0;  key < 1000;  ++key)
+        BOOST_CHECK_EQUAL(all.shardFor(keyHash(key)),
+                          again.shardFor(keyHash(key)));
+}
@@ -95,3 +95,52 @@ BOOST_AUTO_TEST_CASE( currencyConversion)
         test2(price);
     }
 }
+
+BOOST_AUTO_TEST_CASE( currencyPool )
+{
+    CurrencyPool pool;
+    BOOST_CHECK(pool.empty());
+
+    pool += MicroUSD(100);
+    pool += Amount(CurrencyCode::CC_IMP, 5);
+    pool -= MicroUSD(100);
+
+    // Entries that go back to zero stay, sorted by currency code
+    BOOST_CHECK_EQUAL(pool.currencyAmounts.size(), 2);
+    BOOST_CHECK_EQUAL(pool.currencyAmounts[0], Amount(CurrencyCode::CC_IMP, 5));
+    BOOST_CHECK_EQUAL(pool.currencyAmounts[1].currencyCode,
+                      CurrencyCode::CC_USD);
+    BOOST_CHECK_EQUAL(pool.getAvailable(CurrencyCode::CC_EUR),
+                      Amount(CurrencyCode::CC_EUR, 0));
+
+    CurrencyPool other = CurrencyPool(MicroUSD(100)) + MicroEUR(-3);
+    BOOST_CHECK_EQUAL(other.nonNegative(), MicroUSD(100));
+    BOOST_CHECK_EQUAL(other.limit(CurrencyPool(MicroUSD(50))
+                                  + Amount(CurrencyCode::CC_CLK, 7)),
+                      MicroUSD(50));
+    BOOST_CHECK_EQUAL((other + other) * 0.5, other);
+    BOOST_CHECK(!other.isNonNegative());
+    BOOST_CHECK(!(other - other).empty());
+    BOOST_CHECK((other - other).isZero());
+
+    BOOST_CHECK_THROW(pool += Amount((CurrencyCode)12345, 1), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( currencyPoolSerialization )
+{
+    CurrencyPool pool = CurrencyPool(MicroUSD(100)) + MicroEUR(-3);
+    string str = ML::DB::serializeToString(pool);
+    BOOST_CHECK_EQUAL(ML::DB::reconstituteFromString<CurrencyPool>(str), pool);
+
+    // Same format as when the amounts were kept in a compact_vector
+    ML::compact_vector<Amount, 1> amounts;
+    amounts.push_back(MicroEUR(-3));
+    amounts.push_back(MicroUSD(100));
+
+    ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        store << (unsigned char)0 << amounts;
+    }
+    BOOST_CHECK_EQUAL(stream.str(), str);
+}
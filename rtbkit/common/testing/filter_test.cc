@@ -183,17 +183,17 @@ BOOST_AUTO_TEST_CASE(creativeMatrixTest)
 }
 
 vector<CreativeMatrix>
-toMatrix(const unordered_map<unsigned, BiddableSpots>& spots)
+toMatrix(const vector<BiddableSpots>& spots)
 {
     vector<CreativeMatrix> creatives;
 
-    for (const auto& configs : spots) {
-        for (const auto& spot : configs.second) {
+    for (size_t config = 0; config < spots.size(); ++config) {
+        for (const auto& spot : spots[config]) {
             if (spot.first >= creatives.size())
                 creatives.resize(spot.first + 1);
 
             for (const auto& creative : spot.second)
-                creatives[spot.first].set(creative, configs.first);
+                creatives[spot.first].set(creative, config);
         }
     }
 
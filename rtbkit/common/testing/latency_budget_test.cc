@@ -0,0 +1,49 @@
+/* latency_budget_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the per-auction latency budget.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/common/latency_budget.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_latency_budget_stages )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000);
+
+    LatencyBudget budget;
+    budget.reset(start, start.plusSeconds(0.080), 20);
+
+    BOOST_CHECK_CLOSE(budget.remainingMs(start), 80.0, 0.01);
+    BOOST_CHECK_CLOSE(budget.remainingMs(start.plusSeconds(0.030)), 50.0, 0.01);
+    BOOST_CHECK(budget.canFit(50.0, start.plusSeconds(0.030)));
+    BOOST_CHECK(!budget.canFit(51.0, start.plusSeconds(0.030)));
+
+    // Each stage is charged the time since the previous one ended
+    BOOST_CHECK_CLOSE(budget.endStage(LatencyBudget::PARSE,
+                                      start.plusSeconds(0.002)), 2.0, 0.01);
+    budget.endStage(LatencyBudget::FILTER, start.plusSeconds(0.005));
+    budget.endStage(LatencyBudget::AUGMENT, start.plusSeconds(0.015));
+
+    BOOST_CHECK_CLOSE(budget.chargedMs(LatencyBudget::PARSE), 2.0, 0.01);
+    BOOST_CHECK_CLOSE(budget.chargedMs(LatencyBudget::FILTER), 3.0, 0.01);
+    BOOST_CHECK_CLOSE(budget.chargedMs(LatencyBudget::AUGMENT), 10.0, 0.01);
+    BOOST_CHECK_EQUAL(budget.chargedMs(LatencyBudget::BID), 0.0);
+
+    // A stage ending out of order is never charged negative time
+    BOOST_CHECK_EQUAL(budget.endStage(LatencyBudget::BID,
+                                      start.plusSeconds(0.010)), 0.0);
+
+    auto json = budget.toJson();
+    BOOST_CHECK_CLOSE(json["deadlineMs"].asDouble(), 80.0, 0.01);
+    BOOST_CHECK_EQUAL(json["networkMs"].asDouble(), 20.0);
+    BOOST_CHECK_CLOSE(json["stagesMs"]["augment"].asDouble(), 10.0, 0.01);
+}
@@ -0,0 +1,72 @@
+/* latency_histogram_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the router's latency histograms.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/latency_histogram.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_buckets )
+{
+    // Every value falls in a bucket whose value is within 1/16th of it
+    for (uint64_t value = 0;  value < 10000000;  value = value * 1.1 + 1) {
+        unsigned bucket = LatencyHistogram::bucketFor(value);
+        BOOST_REQUIRE_LT(bucket, LatencyHistogram::NumBuckets);
+        uint64_t upper = LatencyHistogram::bucketValue(bucket);
+        BOOST_CHECK_GE(upper, value);
+        BOOST_CHECK_LE(upper - value, value / 16);
+        if (bucket > 0)
+            BOOST_CHECK_LT(LatencyHistogram::bucketValue(bucket - 1), value);
+    }
+
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(uint64_t(-1)),
+                      LatencyHistogram::NumBuckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_percentiles )
+{
+    LatencyHistogram histogram;
+
+    // 1000 samples per thread: 1ms to 1000ms
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i) {
+        threads.emplace_back([&] {
+                for (uint64_t ms = 1;  ms <= 1000;  ++ms)
+                    histogram.record(ms * 1000);
+            });
+    }
+    for (auto & thread : threads)
+        thread.join();
+
+    auto snapshot = histogram.snapshot();
+    BOOST_CHECK_EQUAL(snapshot.count(), 4000);
+
+    auto checkNear = [] (uint64_t value, uint64_t expected)
+        {
+            BOOST_CHECK_GE(value, expected);
+            BOOST_CHECK_LE(value, expected + expected / 16);
+        };
+
+    checkNear(snapshot.percentile(0.5), 501000);
+    checkNear(snapshot.percentile(0.99), 991000);
+    checkNear(snapshot.percentile(0.999), 1000000);
+
+    histogram.record(5);
+    auto delta = histogram.snapshot() - snapshot;
+    BOOST_CHECK_EQUAL(delta.count(), 1);
+    BOOST_CHECK_EQUAL(delta.percentile(0.999), 5);
+
+    auto json = delta.toJson();
+    BOOST_CHECK_EQUAL(json["count"].asInt(), 1);
+    BOOST_CHECK_EQUAL(json["p50Ms"].asDouble(), 0.005);
+}
@@ -0,0 +1,101 @@
+/* lazy_bid_request_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the lazily decoded bid requests and augmentations.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/common/lazy_bid_request.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace RTBKIT;
+using namespace Datacratic;
+
+
+namespace {
+
+std::string makeRequest()
+{
+    BidRequest request;
+    request.auctionId = Id("auction-1");
+    request.exchange = "mock";
+    request.timestamp = Date::fromSecondsSinceEpoch(1400000000);
+    request.url = Url("http://example.com/page");
+
+    AdSpot spot;
+    spot.id = Id(1);
+    spot.formats.push_back(Format(300, 250));
+    request.imp.push_back(spot);
+
+    request.segments.addStrings("source", { "a", "b" });
+    request.userIds.add(Id("user-1"), ID_PROVIDER);
+
+    return request.toJsonStr();
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_lazy_json_object )
+{
+    LazyJsonObject object(" { \"a\" : {\"x\": [1, \"}\"]}, \"b\":\"s\\\"t\" ,"
+                          "\"c\":12.5, \"d\":null } ");
+
+    BOOST_CHECK(object.memberNames() == vector<string>({ "a", "b", "c", "d" }));
+    BOOST_CHECK_EQUAL(object.raw("a"), "{\"x\": [1, \"}\"]}");
+    BOOST_CHECK_EQUAL(object.get("a")["x"][1].asString(), "}");
+    BOOST_CHECK_EQUAL(object.get("b").asString(), "s\"t");
+    BOOST_CHECK_EQUAL(object.get("c").asDouble(), 12.5);
+    BOOST_CHECK(object.get("d").isNull());
+    BOOST_CHECK(object.get("e").isNull());
+    BOOST_CHECK(!object.isMember("e"));
+
+    BOOST_CHECK(LazyJsonObject("").memberNames().empty());
+    BOOST_CHECK(LazyJsonObject("{}").memberNames().empty());
+    BOOST_CHECK_THROW(LazyJsonObject("[1]"), ML::Exception);
+    BOOST_CHECK_THROW(LazyJsonObject("{\"a\":1"), ML::Exception);
+    BOOST_CHECK_THROW(LazyJsonObject("{\"a\":}"), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_bid_request )
+{
+    string str = makeRequest();
+    std::unique_ptr<BidRequest> expected(BidRequest::parse("datacratic", str));
+
+    LazyBidRequest request("datacratic", str);
+    BOOST_CHECK(request.isLazy());
+    BOOST_CHECK(request.has("imp"));
+    BOOST_CHECK(!request.has("device"));
+
+    // Only what's asked for is decoded
+    BOOST_CHECK_EQUAL(request.imp().size(), 1);
+    BOOST_CHECK_EQUAL(request.imp()[0].formats[0].width, 300);
+    BOOST_CHECK_EQUAL(request.decode("imp").exchange, "");
+
+    BOOST_CHECK_EQUAL(request.exchange(), "mock");
+    BOOST_CHECK_EQUAL(request.auctionId(), Id("auction-1"));
+    BOOST_CHECK(request.segments().count("source"));
+
+    // Decoding the rest gives the same request as decoding it whole
+    auto full = request.full();
+    BOOST_CHECK_EQUAL(full->toJsonStr(), expected->toJsonStr());
+    BOOST_CHECK_EQUAL(full->url.toString(), "http://example.com/page");
+    BOOST_CHECK_EQUAL(request.str(), str);
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_bid_request_other_format )
+{
+    BidRequest request;
+    request.auctionId = Id("auction-2");
+    request.exchange = "mock";
+    string str = request.serializeToString();
+
+    LazyBidRequest lazy("rtbkit-binary-v1", str);
+    BOOST_CHECK(!lazy.isLazy());
+    BOOST_CHECK(lazy.has("anything"));
+    BOOST_CHECK_EQUAL(lazy.exchange(), "mock");
+    BOOST_CHECK_EQUAL(lazy.full()->auctionId, Id("auction-2"));
+}
@@ -0,0 +1,84 @@
+/* segments_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the serialization and interning of segment lists.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/common/segments.h"
+#include "jml/db/persistent.h"
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_serialize_round_trip )
+{
+    vector<int> ids;
+    for (int i = 0;  i < 200;  ++i)
+        ids.push_back(100000 + i * 37);
+
+    SegmentList sorted(ids);
+    sorted.add("user-segment");
+    sorted.sort();
+
+    SegmentList unsorted(vector<int>{ 5, -3, 2000000000, -2000000000 });
+    SegmentList negative(vector<int>{ -2000000000, -1, 0, 2000000000 });
+    SegmentList weighted(vector<pair<int, float> >{ { 1, 0.5 }, { 7, 2.0 } });
+
+    for (const SegmentList & segs: { sorted, unsorted, negative, weighted,
+                                     SegmentList() }) {
+        string str = segs.serializeToString();
+        SegmentList segs2 = SegmentList::reconstituteFromString(str);
+        BOOST_CHECK_EQUAL(segs2, segs);
+        BOOST_CHECK_EQUAL(segs2.hash(), segs.hash());
+    }
+
+    // The deltas fit in a byte or two instead of four bytes for each int
+    BOOST_CHECK_LT(sorted.serializeToString().size(), ids.size() * 2 + 32);
+}
+
+BOOST_AUTO_TEST_CASE( test_interning )
+{
+    SegmentListCache cache(64, 4);
+
+    vector<int> ids = { 1, 2, 3, 4, 5, 6 };
+    auto segs1 = std::make_shared<SegmentList>(ids);
+    auto segs2 = std::make_shared<SegmentList>(ids);
+    auto small = std::make_shared<SegmentList>(vector<int>{ 1, 2 });
+
+    BOOST_CHECK_EQUAL(cache.intern(segs1), segs1);
+    BOOST_CHECK_EQUAL(cache.intern(segs2), segs1);
+    BOOST_CHECK_EQUAL(cache.intern(small), small);
+
+    auto stats = cache.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+    BOOST_CHECK_EQUAL(stats.misses, 1);
+    BOOST_CHECK_EQUAL(stats.size, 1);
+
+    // The cache stays bounded
+    for (int i = 0;  i < 10000;  ++i)
+        cache.intern(std::make_shared<SegmentList>(vector<int>{ i, i + 1, i + 2, i + 3 }));
+    stats = cache.stats();
+    BOOST_CHECK_LE(stats.size, 64);
+    BOOST_CHECK_GT(stats.evictions, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_shared_segments_are_copied_on_write )
+{
+    Json::Value json;
+    for (int i = 0;  i < 20;  ++i)
+        json["src"].append(i);
+
+    SegmentsBySource segs1 = SegmentsBySource::createFromJson(json);
+    SegmentsBySource segs2 = SegmentsBySource::createFromJson(json);
+    BOOST_CHECK_EQUAL(segs1["src"], segs2["src"]);
+
+    segs1.add("src", 1000);
+    BOOST_CHECK(segs1.get("src").contains(1000));
+    BOOST_CHECK(!segs2.get("src").contains(1000));
+    BOOST_CHECK_EQUAL(segs2.get("src").size(), 20);
+}
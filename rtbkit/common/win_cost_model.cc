@@ -25,14 +25,76 @@ struct NoWinCostModel {
     }
 };
 
+struct CompiledNoWinCostModel : public WinCostModel::Compiled {
+
+    Amount evaluate(Bid const & bid,
+                    Amount const & price,
+                    Json::Value const & win) const
+    {
+        return price;
+    }
+};
+
+/// Adapts a model registered with registerModel, which reads its
+/// parameters from the WinCostModel on every evaluation.
+struct FunctionWinCostModel : public WinCostModel::Compiled {
+
+    FunctionWinCostModel(WinCostModel model, WinCostModel::Model function) :
+        model(std::move(model)),
+        function(std::move(function))
+    {
+    }
+
+    Amount evaluate(Bid const & bid,
+                    Amount const & price,
+                    Json::Value const & win) const
+    {
+        if (win.isNull())
+            return function(model, bid, price);
+
+        WinCostModel withWin = model;
+        withWin.data["win"] = win;
+        return function(withWin, bid, price);
+    }
+
+    WinCostModel model;
+    WinCostModel::Model function;
+};
+
+bool hasCompiledModel(std::string const & name)
+{
+    std::string plugName = name.substr(name.find('.') + 1);
+    for (auto const & registered : PluginInterface<WinCostModel::Compiled>::getNames()) {
+        if (registered == plugName) return true;
+    }
+    return false;
+}
+
 struct AtInit {
     AtInit()
     {
       PluginInterface<WinCostModel>::registerPlugin("none", NoWinCostModel::evaluate);
+      PluginInterface<WinCostModel::Compiled>::registerPlugin(
+              "none",
+              [] (Json::Value const &) {
+                  return std::make_shared<CompiledNoWinCostModel>();
+              });
     }
 } atInit;
 } // file scope
 
+void
+WinCostModel::Compiled::
+evaluate(Evaluation * evaluations, size_t n) const
+{
+    static const Json::Value noWin;
+
+    for (size_t i = 0; i < n; ++i) {
+        Evaluation & e = evaluations[i];
+        e.cost = evaluate(*e.bid, e.price, e.win ? *e.win : noWin);
+    }
+}
+
 WinCostModel::
 WinCostModel()
 {
@@ -53,12 +115,76 @@ evaluate(Bid const & bid, Amount const & price) const
         return NoWinCostModel::evaluate(*this, bid, price);
     }
 
-    auto model = PluginInterface<WinCostModel>::getPlugin(name);
+    return compile()->evaluate(bid, price, Json::Value());
+}
+
+Amount
+WinCostModel::
+evaluate(Bid const & bid, Amount const & price, Json::Value const & win) const
+{
+    if(name.empty()) {
+        return price;
+    }
+
+    return compile()->evaluate(bid, price, win);
+}
+
+void
+WinCostModel::
+evaluate(std::vector<Compiled::Evaluation> & evaluations) const
+{
+    if(evaluations.empty()) {
+        return;
+    }
+
+    compile()->evaluate(evaluations.data(), evaluations.size());
+}
+
+std::shared_ptr<const WinCostModel::Compiled>
+WinCostModel::
+compile() const
+{
+    if(compiled) {
+        return compiled;
+    }
+
+    if(name.empty()) {
+        return std::make_shared<CompiledNoWinCostModel>();
+    }
+
+    // Looking up the function model loads the model's library if it's not
+    // already there, which may register either kind of model.
+    Model model;
+    if(!hasCompiledModel(name)) {
+        try {
+            model = PluginInterface<WinCostModel>::getPlugin(name);
+        } catch (const ML::Exception &) {
+        }
+    }
+
+    if(hasCompiledModel(name)) {
+        auto factory = PluginInterface<Compiled>::getPlugin(name);
+        auto result = factory(data);
+        if(!result) {
+            throw ML::Exception("win cost model '%s' failed to compile",
+                                name.c_str());
+        }
+        return result;
+    }
+
     if(!model) {
         throw ML::Exception("win cost model '%s' not found", name.c_str());
     }
 
-    return model(*this, bid, price);
+    return std::make_shared<FunctionWinCostModel>(*this, model);
+}
+
+void
+WinCostModel::
+precompile()
+{
+    compiled.reset();
+    compiled = compile();
 }
 
 Json::Value
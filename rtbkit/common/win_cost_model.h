@@ -28,9 +28,59 @@ struct WinCostModel {
     WinCostModel();
     WinCostModel(std::string name, Json::Value data);
 
+    /** Model with its parameters already parsed out of data, which can be
+        evaluated many times without looking it up or going through the
+        json again.
+    */
+    struct Compiled {
+        virtual ~Compiled() {}
+
+        /// Get the win cost of a bid given the win metadata, which is null
+        /// when the bid hasn't won yet.
+        virtual Amount evaluate(Bid const & bid,
+                                Amount const & price,
+                                Json::Value const & win) const = 0;
+
+        /// One win to price in a batch
+        struct Evaluation {
+            Bid const * bid;
+            Amount price;
+            Json::Value const * win;    ///< Null if there's no win metadata
+            Amount cost;                ///< Set by evaluate
+        };
+
+        /// Prices a batch of wins.  The default calls evaluate on each.
+        virtual void evaluate(Evaluation * evaluations, size_t n) const;
+
+        /// Signature of the function that compiles a model from its data
+        typedef std::function<std::shared_ptr<const Compiled>
+                              (Json::Value const & data)> Factory;
+
+        static const std::string libNameSufix() {return "win_cost_model";};
+    };
+
     /// Get the win cost from the model
     Amount evaluate(Bid const & bid, Amount const & price) const;
 
+    /// Get the win cost from the model for a win with the given metadata
+    Amount evaluate(Bid const & bid,
+                    Amount const & price,
+                    Json::Value const & win) const;
+
+    /// Get the win cost of each of a batch of wins
+    void evaluate(std::vector<Compiled::Evaluation> & evaluations) const;
+
+    /** Compiled version of the model.  This is the one attached by
+        precompile() if there's one, otherwise the model is looked up and
+        compiled from scratch.  Throws if there's no such model.
+    */
+    std::shared_ptr<const Compiled> compile() const;
+
+    /** Compile the model once and attach the result so that evaluate
+        doesn't have to.  Must be called again if name or data change.
+    */
+    void precompile();
+
     Json::Value toJson() const;
     static WinCostModel fromJson(Json::Value const & json);
 
@@ -51,6 +101,15 @@ struct WinCostModel {
     {
         PluginInterface<WinCostModel>::registerPlugin(name, model);
     }
+
+    /** Register a model that parses its data once into a Compiled model.
+        Preferred over registerModel for models that are evaluated often.
+    */
+    static void registerCompiledModel(const std::string & name,
+                                      Compiled::Factory factory)
+    {
+        PluginInterface<Compiled>::registerPlugin(name, factory);
+    }
   
     // --- plugin interface init
     // plugin interface expects this type to be called Factory
@@ -64,6 +123,9 @@ struct WinCostModel {
 public:
     std::string name;
     Json::Value data;
+
+    /// Set by precompile(); not serialized.
+    std::shared_ptr<const Compiled> compiled;
 };
 
 IMPL_SERIALIZE_RECONSTITUTE(WinCostModel);
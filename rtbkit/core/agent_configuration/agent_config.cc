@@ -8,6 +8,8 @@
 #include "jml/arch/exception.h"
 #include "jml/utils/string_functions.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include "rtbkit/common/auction.h"
 #include "rtbkit/core/router/router_types.h"
 #include "rtbkit/common/exchange_connector.h"
@@ -430,6 +432,113 @@ createFromJson(const Json::Value& json, const std::string& name)
 
 
 
+/*****************************************************************************/
+/* BID REQUEST PROJECTION                                                    */
+/*****************************************************************************/
+
+namespace {
+
+/** Copy what's at path[depth] onwards in from into to. */
+void projectPath(const Json::Value & from, Json::Value & to,
+                 const std::vector<std::string> & path, size_t depth)
+{
+    if (from.isArray()) {
+        if (!to.isArray())
+            to = Json::Value(Json::arrayValue);
+        for (unsigned i = 0;  i < from.size();  ++i) {
+            Json::Value & element = to[i];
+            projectPath(from[i], element, path, depth);
+        }
+        return;
+    }
+
+    if (depth == path.size()) {
+        to = from;
+        return;
+    }
+
+    if (!from.isObject() || !from.isMember(path[depth]))
+        return;
+
+    projectPath(from[path[depth]], to[path[depth]], path, depth + 1);
+}
+
+} // file scope
+
+bool
+BidRequestProjection::
+includesAugmentor(const std::string & augmentor) const
+{
+    return augmentors.empty()
+        || std::find(augmentors.begin(), augmentors.end(), augmentor)
+           != augmentors.end();
+}
+
+Json::Value
+BidRequestProjection::
+apply(const Json::Value & request) const
+{
+    if (paths.empty())
+        return request;
+
+    Json::Value result(Json::objectValue);
+    for (const auto & path: paths)
+        projectPath(request, result, path, 0);
+    return result;
+}
+
+void
+BidRequestProjection::
+fromJson(const Json::Value & json)
+{
+    fields.clear();
+    augmentors.clear();
+
+    for (auto it = json.begin(), end = json.end();  it != end;  ++it) {
+        if (it.memberName() == "fields") {
+            for (const auto & field: *it)
+                fields.push_back(field.asString());
+        }
+        else if (it.memberName() == "augmentors") {
+            for (const auto & augmentor: *it)
+                augmentors.push_back(augmentor.asString());
+        }
+        else throw Exception("unknown bidRequestProjection field "
+                             + it.memberName());
+    }
+
+    // Sorted so that the same fields in another order share a projection
+    std::vector<std::string> sorted = fields;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    paths.clear();
+    fieldsKey_.clear();
+    for (const string & field: sorted) {
+        std::vector<std::string> path;
+        boost::split(path, field, boost::is_any_of("."));
+        if (field.empty()
+            || std::find(path.begin(), path.end(), "") != path.end())
+            throw Exception("invalid bidRequestProjection field '%s'",
+                            field.c_str());
+        paths.push_back(path);
+        fieldsKey_ += field + ",";
+    }
+}
+
+Json::Value
+BidRequestProjection::
+toJson() const
+{
+    Json::Value result;
+    for (const string & field: fields)
+        result["fields"].append(field);
+    for (const string & augmentor: augmentors)
+        result["augmentors"].append(augmentor);
+    return result;
+}
+
+
 /*****************************************************************************/
 /* AGENT CONFIG                                                             */
 /*****************************************************************************/
@@ -442,6 +551,10 @@ AgentConfig(std::string name)
       roundRobinWeight(0),
       bidProbability(1.0), minTimeAvailableMs(5.0),
       maxInFlight(100),
+      bidRequestFormat("jsonRaw"),
+      batchResults(false),
+      frequencyCap(0.0),
+      bidPredictionThreshold(0.0), bidPredictionExploration(0.05),
       blacklistType(BL_OFF),
       blacklistScope(BL_ACCOUNT), blacklistTime(15.0),
       bidControlType(BC_RELAY), fixedBidCpmInMicros(0),
@@ -580,9 +693,13 @@ fromJson(const Json::Value & json)
     *this = createFromJson(json);
 }
 
+namespace {
+
+/** Parse the configuration.  If previous is given, its creatives are used
+    instead of those in the JSON.
+*/
 AgentConfig
-AgentConfig::
-createFromJson(const Json::Value & json)
+parseAgentConfig(const Json::Value & json, const AgentConfig * previous)
 {
     AgentConfig newConfig;
     newConfig.augmentations.clear();
@@ -592,6 +709,7 @@ createFromJson(const Json::Value & json)
 
         if (it.memberName() == "account") {
             newConfig.account = AccountKey::fromJson(*it);
+            newConfig.accountId = AccountKeyId::intern(newConfig.account);
         }
         else if (it.memberName() == "name") {
             newConfig.name = it->asString();
@@ -625,6 +743,11 @@ createFromJson(const Json::Value & json)
             }
         }
         else if (it.memberName() == "creatives") {
+            if (previous) {
+                newConfig.creatives = previous->creatives;
+                continue;
+            }
+
             //cerr << "doing " << it->size() << " creatives" << endl;
 
             newConfig.creatives.resize(it->size());
@@ -661,9 +784,47 @@ createFromJson(const Json::Value & json)
         }
         else if (it.memberName() == "bidderInterface")
             newConfig.bidderInterface = it->asString();
+        else if (it.memberName() == "bidRequestFormat") {
+            newConfig.bidRequestFormat = it->asString();
+            if (newConfig.bidRequestFormat != "jsonRaw"
+                && newConfig.bidRequestFormat != "jsonNormalized"
+                && newConfig.bidRequestFormat != "binaryV1")
+                throw Exception("unknown bidRequestFormat "
+                                + newConfig.bidRequestFormat);
+        }
+        else if (it.memberName() == "bidRequestProjection")
+            newConfig.bidRequestProjection.fromJson(*it);
+        else if (it.memberName() == "batchResults")
+            newConfig.batchResults = it->asBool();
         else if (it.memberName() == "userPartition") {
             newConfig.userPartition.fromJson(*it);
         }
+        else if (it.memberName() == "bidPrediction") {
+            for (auto jt = it->begin(), jend = it->end();
+                 jt != jend;  ++jt) {
+                const Json::Value & val = *jt;
+                if (jt.memberName() == "threshold")
+                    newConfig.bidPredictionThreshold = val.asDouble();
+                else if (jt.memberName() == "exploration")
+                    newConfig.bidPredictionExploration = val.asDouble();
+                else throw Exception("bidPrediction has invalid key: %s",
+                                     jt.memberName().c_str());
+            }
+            if (newConfig.bidPredictionThreshold < 0.0
+                || newConfig.bidPredictionThreshold > 1.0)
+                throw Exception("bidPrediction threshold %f not between 0 "
+                                "and 1", newConfig.bidPredictionThreshold);
+            if (newConfig.bidPredictionExploration <= 0.0
+                || newConfig.bidPredictionExploration > 1.0)
+                throw Exception("bidPrediction exploration %f must be above "
+                                "0 and at most 1",
+                                newConfig.bidPredictionExploration);
+        }
+        else if (it.memberName() == "frequencyCap") {
+            newConfig.frequencyCap = it->asDouble();
+            if (newConfig.frequencyCap < 0.0)
+                throw Exception("frequencyCap must not be negative");
+        }
         else if (it.memberName() == "urlFilter")
             newConfig.urlFilter.fromJson(*it, "urlFilter");
         else if (it.memberName() == "hostFilter")
@@ -795,9 +956,73 @@ createFromJson(const Json::Value & json)
     if (newConfig.creatives.empty())
         throw Exception("can't configure a agent with no creatives");
 
+    if (!newConfig.bidRequestProjection.fields.empty()
+        && newConfig.bidRequestFormat == "binaryV1")
+        throw Exception("bidRequestProjection fields need a JSON "
+                        "bidRequestFormat");
+
     return newConfig;
 }
 
+} // file scope
+
+AgentConfig
+AgentConfig::
+createFromJson(const Json::Value & json)
+{
+    return parseAgentConfig(json, nullptr);
+}
+
+AgentConfig
+AgentConfig::
+createFromJson(const Json::Value & json, const AgentConfig & previous)
+{
+    return parseAgentConfig(json, &previous);
+}
+
+AgentConfig::Section
+AgentConfig::
+sectionOf(const std::string & member)
+{
+    if (member == "creatives")
+        return CREATIVES;
+    if (member == "bidProbability" || member == "minTimeAvailableMs"
+        || member == "maxInFlight" || member == "bidControl")
+        return BID_CONTROL;
+    return TARGETING;
+}
+
+int
+AgentConfig::
+changedSections(const Json::Value & oldJson, const Json::Value & newJson)
+{
+    int result = 0;
+
+    for (auto it = newJson.begin(), end = newJson.end(); it != end;  ++it) {
+        const string & member = it.memberName();
+        if (!oldJson.isMember(member) || oldJson[member] != *it)
+            result |= sectionOf(member);
+    }
+
+    for (auto it = oldJson.begin(), end = oldJson.end(); it != end;  ++it) {
+        if (!newJson.isMember(it.memberName()))
+            result |= sectionOf(it.memberName());
+    }
+
+    return result;
+}
+
+void
+AgentConfig::
+copyBidControl(const AgentConfig & other)
+{
+    bidProbability = other.bidProbability;
+    minTimeAvailableMs = other.minTimeAvailableMs;
+    maxInFlight = other.maxInFlight;
+    bidControlType = other.bidControlType;
+    fixedBidCpmInMicros = other.fixedBidCpmInMicros;
+}
+
 Json::Value
 AgentConfig::SegmentInfo::
 toJson() const
@@ -836,6 +1061,12 @@ toJson(bool includeCreatives) const
 
     if (!bidderInterface.empty())
         result["bidderInterface"] = bidderInterface;
+    if (bidRequestFormat != "jsonRaw")
+        result["bidRequestFormat"] = bidRequestFormat;
+    if (!bidRequestProjection.empty())
+        result["bidRequestProjection"] = bidRequestProjection.toJson();
+    if (batchResults)
+        result["batchResults"] = batchResults;
 
     if (!urlFilter.empty())
         result["urlFilter"] = urlFilter.toJson();
@@ -855,6 +1086,12 @@ toJson(bool includeCreatives) const
     }
     if (!userPartition.empty())
         result["userPartition"] = userPartition.toJson();
+    if (frequencyCap > 0.0)
+        result["frequencyCap"] = frequencyCap;
+    if (bidPredictionThreshold > 0.0) {
+        result["bidPrediction"]["threshold"] = bidPredictionThreshold;
+        result["bidPrediction"]["exploration"] = bidPredictionExploration;
+    }
     if (!creatives.empty() && includeCreatives)
         result["creatives"] = collectionToJson(creatives, JsonPrint());
     else if (!creatives.empty()) {
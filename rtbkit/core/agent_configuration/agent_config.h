@@ -240,6 +240,53 @@ struct AugmentationConfig
 
 
 
+/*****************************************************************************/
+/* BID REQUEST PROJECTION                                                    */
+/*****************************************************************************/
+
+/** The parts of the bid request and of the augmentations that are sent to an
+    agent, for agents that only look at a few fields.  Configured as
+
+        "bidRequestProjection": {
+            "fields": [ "id", "imp.banner", "site.domain", "device.geo" ],
+            "augmentors": [ "frequency-cap-ex" ]
+        }
+
+    Each field is a dotted path into the JSON bid request; going through an
+    array projects each of its elements.  An empty list of fields sends the
+    whole request, and an empty list of augmentors all of them.  Only
+    applies to the JSON bid request formats.
+*/
+
+struct BidRequestProjection {
+    std::vector<std::string> fields;
+    std::vector<std::string> augmentors;
+
+    bool empty() const
+    {
+        return fields.empty() && augmentors.empty();
+    }
+
+    /** Whether the augmentation from the given augmentor is sent. */
+    bool includesAugmentor(const std::string & augmentor) const;
+
+    /** Identifies the projection of the request, so that the agents with
+        the same one share it.  Empty if the whole request is sent.
+    */
+    const std::string & fieldsKey() const { return fieldsKey_; }
+
+    /** Project the given JSON bid request. */
+    Json::Value apply(const Json::Value & request) const;
+
+    void fromJson(const Json::Value & json);
+    Json::Value toJson() const;
+
+private:
+    std::vector<std::vector<std::string> > paths;
+    std::string fieldsKey_;
+};
+
+
 /*****************************************************************************/
 /* BLACKLIST CONTROL                                                         */
 /*****************************************************************************/
@@ -292,6 +339,40 @@ struct AgentConfig {
 
     static AgentConfig createFromJson(const Json::Value & json);
 
+    /** Same as createFromJson(json), but takes the creatives from the
+        previous configuration instead of parsing them again.  Only valid
+        if the creatives section of the two configurations is the same.
+    */
+    static AgentConfig createFromJson(const Json::Value & json,
+                                      const AgentConfig & previous);
+
+    /** The top level members of a configuration are split into sections
+        which change independently and cost very different amounts to apply:
+        the creatives need to be parsed and checked against every exchange,
+        the targeting is indexed by the router's filters, whereas bid control
+        (bidProbability, minTimeAvailableMs, maxInFlight and bidControl) is
+        just read at bid time.
+    */
+    enum Section {
+        CREATIVES = 1 << 0,
+        TARGETING = 1 << 1,
+        BID_CONTROL = 1 << 2,
+
+        ALL_SECTIONS = CREATIVES | TARGETING | BID_CONTROL
+    };
+
+    /** Section that the given top level member belongs to. */
+    static Section sectionOf(const std::string & member);
+
+    /** Mask of the sections which differ between the two JSON
+        configurations.
+    */
+    static int changedSections(const Json::Value & oldJson,
+                               const Json::Value & newJson);
+
+    /** Copy the bid control section from the other configuration. */
+    void copyBidControl(const AgentConfig & other);
+
     void parse(const std::string & jsonStr);
     void fromJson(const Json::Value & json);
 
@@ -299,6 +380,19 @@ struct AgentConfig {
 
     AccountKey account;   ///< Who to bill this to
 
+    /** Interned id of account, set when the configuration is parsed.  Code
+        that changes account afterwards needs to reset it.
+    */
+    AccountKeyId accountId;
+
+    /** Interned id of the account, interning it if the configuration
+        wasn't built by createFromJson().
+    */
+    AccountKeyId accountKeyId() const
+    {
+        return accountId ? accountId : AccountKeyId::intern(account);
+    }
+
     uint64_t externalId;  ///< Simplifies id reconciliation with external systems
 
     bool external;        ///< Forward bid request that have this configuration
@@ -314,8 +408,38 @@ struct AgentConfig {
 
     std::string bidderInterface;
 
+    /** Wire format in which the router sends bid requests to the agent.  One
+        of "jsonRaw" (the exchange's own JSON; the default), "jsonNormalized"
+        (canonical RTBkit JSON) or "binaryV1" (canonical binary encoding, which
+        is serialized once per auction and is the cheapest for both sides).
+    */
+    std::string bidRequestFormat;
+
+    /** Parts of the bid request and augmentations to send to the agent. */
+    BidRequestProjection bidRequestProjection;
+
+    /** Ask the router to coalesce this agent's wins and losses into RESULTS
+        messages instead of sending one message per event.
+    */
+    bool batchResults;
+
     std::vector<std::string> requiredIds;
 
+    /** Maximum number of recent wins on the same user for the account, as
+        counted by the router (see FrequencyCapStore).  0 means no cap.
+    */
+    double frequencyCap;
+
+    /** The router learns which requests the agent bids on (see
+        BidPredictor) and doesn't send it those that it predicts a bid on
+        with less than bidPredictionThreshold probability, except for a
+        bidPredictionExploration proportion of them that keep the model
+        honest.  Configured as "bidPrediction": { "threshold": 0.02,
+        "exploration": 0.05 }; a threshold of 0, the default, is off.
+    */
+    double bidPredictionThreshold;
+    double bidPredictionExploration;
+
     IncludeExclude<DomainMatcher> hostFilter;
     IncludeExclude<CachedRegex<boost::regex, std::string> > urlFilter;
     IncludeExclude<CachedRegex<boost::regex, std::string> > languageFilter;
@@ -3,6 +3,7 @@
 LIBAGENT_CONFIGURATION_SOURCES := \
 	agent_config.cc \
 	blacklist.cc \
+	frequency_cap.cc \
 	include_exclude.cc \
 	agent_configuration_listener.cc \
 	agent_configuration_service.cc \
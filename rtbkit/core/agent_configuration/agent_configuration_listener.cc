@@ -7,6 +7,7 @@
 
 #include "agent_configuration_listener.h"
 #include "agent_config.h"
+#include "soa/utils/fnv_hash.h"
 
 namespace RTBKIT {
 
@@ -36,7 +37,7 @@ forEachAccountAgent(const AccountKey & account,
     const AllAgentConfig * ac = allAgents;
     if (!ac) return;
 
-    auto it = ac->accountIndex.find(account);
+    auto it = ac->accountIndex.find(AccountKeyId::find(account));
     if (it == ac->accountIndex.end())
         return;
 
@@ -66,11 +67,20 @@ onMessage(const std::vector<std::string> & message)
     using namespace std;
 
     const std::string & topic = message.at(0);
-    if (topic != "CONFIG") {
+    if (topic == "CONFIG")
+        onConfigMessage(message);
+    else if (topic == "CONFIGDELTA")
+        onDeltaMessage(message);
+    else {
         cerr << "unknown message for agent configuration listener" << endl;
         cerr << message;
-        return;
     }
+}
+
+void
+AgentConfigurationListener::
+onConfigMessage(const std::vector<std::string> & message)
+{
     const std::string & agent = message.at(1);
     const std::string & configStr = message.at(2);
 
@@ -79,8 +89,87 @@ onMessage(const std::vector<std::string> & message)
     if (!configStr.empty()) {
         Json::Value j = Json::parse(configStr);
         config.reset(new AgentConfig(AgentConfig::createFromJson(j)));
+
+        // Older services don't version their configurations
+        KnownConfig & known = knownConfigs[agent];
+        known.json = std::move(j);
+        known.version = message.size() > 3 ? std::stoull(message[3]) : 0;
+        known.config = config;
+    }
+    else knownConfigs.erase(agent);
+
+    setAgentConfig(agent, config, AgentConfig::ALL_SECTIONS);
+}
+
+void
+AgentConfigurationListener::
+onDeltaMessage(const std::vector<std::string> & message)
+{
+    using namespace std;
+
+    const std::string & agent = message.at(1);
+    uint64_t baseVersion = std::stoull(message.at(2));
+    uint64_t version = std::stoull(message.at(3));
+    uint64_t hash = std::stoull(message.at(4));
+    const Json::Value delta = Json::parse(message.at(5));
+
+    auto it = knownConfigs.find(agent);
+    if (it == knownConfigs.end() || it->second.version != baseVersion) {
+        cerr << "configuration delta for agent " << agent
+             << " doesn't apply to the version we have" << endl;
+        resync(agent);
+        return;
     }
 
+    KnownConfig & known = it->second;
+    Json::Value json = known.json;
+    int changed = 0;
+
+    const Json::Value & set = delta["set"];
+    for (auto jt = set.begin(), end = set.end(); jt != end;  ++jt) {
+        json[jt.memberName()] = *jt;
+        changed |= AgentConfig::sectionOf(jt.memberName());
+    }
+    for (const Json::Value & member: delta["removed"]) {
+        json.removeMember(member.asString());
+        changed |= AgentConfig::sectionOf(member.asString());
+    }
+
+    if (Datacratic::fnv_hash64a(json.toString()) != hash) {
+        cerr << "configuration delta for agent " << agent
+             << " doesn't match the service's hash" << endl;
+        resync(agent);
+        return;
+    }
+
+    std::shared_ptr<AgentConfig> config;
+    if (changed & AgentConfig::CREATIVES)
+        config.reset(new AgentConfig(AgentConfig::createFromJson(json)));
+    else config.reset(new AgentConfig(
+                AgentConfig::createFromJson(json, *known.config)));
+
+    known.json = std::move(json);
+    known.version = version;
+    known.config = config;
+
+    setAgentConfig(agent, config, changed);
+}
+
+void
+AgentConfigurationListener::
+resync(const std::string & agent)
+{
+    // Whatever we have is stale; wait for the full configuration
+    knownConfigs.erase(agent);
+    configEndpoint.sendMessage("RESYNC", agent);
+}
+
+void
+AgentConfigurationListener::
+setAgentConfig(const std::string & agent,
+               std::shared_ptr<const AgentConfig> config,
+               int changedSections)
+{
     /* Now, update the current configuration list */
 
     GcLock::SharedGuard guard(allAgentsGc);
@@ -103,7 +192,7 @@ onMessage(const std::vector<std::string> & message)
 
         int i = newConfig->size() - 1;
         newConfig->agentIndex[c.name] = i;
-        newConfig->accountIndex[newConfig->back().config->account].push_back(i);
+        newConfig->accountIndex[newConfig->back().config->accountKeyId()].push_back(i);
     }
     if (!found && config) {
         AgentConfigEntry ce;
@@ -113,7 +202,7 @@ onMessage(const std::vector<std::string> & message)
 
         int i = newConfig->size() - 1;
         newConfig->agentIndex[agent] = i;
-        newConfig->accountIndex[newConfig->back().config->account].push_back(i);
+        newConfig->accountIndex[newConfig->back().config->accountKeyId()].push_back(i);
     }
 
     if (ML::cmp_xchg(allAgents, ac, (AllAgentConfig *)newConfig.get())) {
@@ -126,6 +215,8 @@ onMessage(const std::vector<std::string> & message)
         throw ML::Exception("cmp_exch failed for AgentConfigurationListener");
     }
 
+    if (onConfigDelta)
+        onConfigDelta(agent, config, changedSections);
     if (onConfigChange)
         onConfigChange(agent, config);
 }
@@ -37,7 +37,7 @@ struct AgentConfigEntry {
 */
 struct AllAgentConfig : public std::vector<AgentConfigEntry> {
     std::unordered_map<std::string, int> agentIndex;
-    std::unordered_map<AccountKey, std::vector<int> > accountIndex;
+    std::unordered_map<AccountKeyId, std::vector<int> > accountIndex;
 };
 
 
@@ -66,6 +66,19 @@ struct AgentConfigurationListener: public MessageLoop {
 
     OnConfigChange onConfigChange;
 
+    /** Type of function to be called on a configuration change with the
+        mask of AgentConfig::Section that changed, so that the receiver can
+        keep whatever it derived from the other sections.  New and removed
+        agents have all sections changed.
+    */
+    typedef std::function<void (std::string,
+                                std::shared_ptr<const AgentConfig>,
+                                int changedSections)>
+    OnConfigDelta;
+
+    /** Called before onConfigChange; either or both can be set. */
+    OnConfigDelta onConfigDelta;
+
     void init(std::shared_ptr<ConfigurationService> config)
     {
         configEndpoint.init(config);
@@ -115,6 +128,36 @@ struct AgentConfigurationListener: public MessageLoop {
 
 private:
     void onMessage(const std::vector<std::string> & message);
+    void onConfigMessage(const std::vector<std::string> & message);
+    void onDeltaMessage(const std::vector<std::string> & message);
+
+    /** Ask the configuration service for the full configuration of the
+        agent, as a delta couldn't be applied.
+    */
+    void resync(const std::string & agent);
+
+    /** Publish the new configuration of the agent and tell the callbacks
+        about it.
+    */
+    void setAgentConfig(const std::string & agent,
+                        std::shared_ptr<const AgentConfig> config,
+                        int changedSections);
+
+    /** Last configuration received for an agent, which the next delta for
+        it applies to.
+    */
+    struct KnownConfig {
+        KnownConfig()
+            : version(0)
+        {
+        }
+
+        Json::Value json;
+        uint64_t version;
+        std::shared_ptr<const AgentConfig> config;
+    };
+
+    std::unordered_map<std::string, KnownConfig> knownConfigs;
 
     AllAgentConfig * allAgents;
     mutable GcLock allAgentsGc;
@@ -139,10 +182,9 @@ struct AgentBridge {
     void sendAgentMessage(const std::string & agent,
                           const std::string & messageType,
                           const Date & date,
-                          Args... args)
+                          const Args &... args)
     {
-        agents.sendMessage(agent, messageType, date,
-                           std::forward<Args>(args)...);
+        agents.sendMessage(agent, messageType, date, args...);
     }
 
     /** Send the given message to the given bidding agent. */
@@ -151,10 +193,21 @@ struct AgentBridge {
                           const std::string & eventType,
                           const std::string & messageType,
                           const Date & date,
-                          Args... args)
+                          const Args &... args)
+    {
+        agents.sendMessage(agent, eventType, messageType, date, args...);
+    }
+
+    /** Send a message made of pre-built frames to the given bidding agent.
+        The frames are not consumed, so frames shared between several agents
+        (see sharedMessage()) only need to be built once.
+    */
+    template<typename... Frames>
+    void sendAgentFrames(const std::string & agent,
+                         const std::string & messageType,
+                         const Frames &... frames)
     {
-        agents.sendMessage(agent, eventType, messageType, date,
-                           std::forward<Args>(args)...);
+        agents.sendMessage(agent, messageType, frames...);
     }
 };
 
@@ -8,6 +8,7 @@
 #include "jml/utils/string_functions.h"
 #include "agent_configuration_service.h"
 #include "soa/service/rest_request_binding.h"
+#include "soa/utils/fnv_hash.h"
 
 using namespace std;
 using namespace ML;
@@ -26,6 +27,8 @@ AgentConfigurationService(std::shared_ptr<ServiceProxies> services,
       ServiceBase(serviceName, services),
       agents(services->zmqContext),
       listeners(services->zmqContext),
+      nextVersion(1),
+      sendDeltas(true),
       monitorProviderClient(services->zmqContext)
 {
     monitorProviderClient.addProvider(this);
@@ -67,8 +70,7 @@ init()
             // we got a new listener...
             for (auto & a: agentInfo) {
                 if (!a.second.config.isNull())
-                    listeners.sendMessage(listener, "CONFIG", a.first,
-                                          a.second.config.toString());
+                    sendConfig(listener, a.first, a.second);
             }
         };
 
@@ -81,12 +83,14 @@ init()
 
     listeners.clientMessageHandler = [=] (const std::vector<std::string> & message)
         {
+            const std::string & topic = message.at(1);
+            if (topic == "RESYNC") {
+                handleResync(message.at(0), message.at(2));
+                return;
+            }
+
             cerr << "listeners got client message " << message << endl;
             throw ML::Exception("unexpected listener message");
-            //const std::string & agent = message.at(2);
-            //Json::Value j = Json::parse(message.at(3));
-
-            //handleAgentConfig(agent, j);
         };
 
     agents.clientMessageHandler = [=] (const std::vector<std::string> & message)
@@ -237,11 +241,63 @@ handleAgentConfig(const std::string & agent,
     if (info.config == config)
         return;
 
+    // Only the members which changed need to be sent if the listeners
+    // already have the previous version
+    Json::Value delta;
+    if (sendDeltas && info.version != 0) {
+        for (auto it = config.begin(), end = config.end(); it != end;  ++it) {
+            const string & member = it.memberName();
+            if (!info.config.isMember(member) || info.config[member] != *it)
+                delta["set"][member] = *it;
+        }
+        for (auto it = info.config.begin(), end = info.config.end();
+             it != end;  ++it) {
+            if (!config.isMember(it.memberName()))
+                delta["removed"].append(it.memberName());
+        }
+    }
+
+    uint64_t baseVersion = info.version;
+
     info.config = config;
+    info.configStr = config.toString();
+    info.version = nextVersion++;
+    info.hash = fnv_hash64a(info.configStr);
+
+    if (delta.isNull()) {
+        // Broadcast the configuration to all listeners
+        for (auto & l: listenerInfo)
+            sendConfig(l.first, agent, info);
+        return;
+    }
 
-    // Broadcast the configuration to all listeners
+    string deltaStr = delta.toString();
     for (auto & l: listenerInfo)
-        listeners.sendMessage(l.first, "CONFIG", agent, config.toString());
+        listeners.sendMessage(l.first, "CONFIGDELTA", agent,
+                              to_string(baseVersion), to_string(info.version),
+                              to_string(info.hash), deltaStr);
+}
+
+void
+AgentConfigurationService::
+sendConfig(const std::string & listener, const std::string & agent,
+           const AgentInfo & info)
+{
+    listeners.sendMessage(listener, "CONFIG", agent, info.configStr,
+                          to_string(info.version), to_string(info.hash));
+}
+
+void
+AgentConfigurationService::
+handleResync(const std::string & listener, const std::string & agent)
+{
+    cerr << "listener " << hexify_string(listener) << " resyncing agent "
+         << agent << endl;
+
+    auto it = agentInfo.find(agent);
+    if (it == agentInfo.end() || it->second.config.isNull())
+        listeners.sendMessage(listener, "CONFIG", agent, "");
+    else sendConfig(listener, agent, it->second);
 }
 
 void
@@ -30,6 +30,14 @@ using namespace Datacratic;
     how the agents are configured) connect via zeromq.  They will be
     sent all configurations on connection, and will be sent any changed
     configurations once they are changed.
+
+    Each configuration that is broadcast gets a new version number and a
+    hash of its content.  Once a listener has a configuration, changes to
+    it are sent as a CONFIGDELTA message containing only the top level
+    members that changed, which the listener applies to the version it has;
+    a listener that finds it doesn't have the base version (or whose result
+    doesn't match the hash) asks for the full configuration with a RESYNC
+    message.
 */
 
 struct AgentConfigurationService : public RestServiceEndpoint,
@@ -104,13 +112,36 @@ struct AgentConfigurationService : public RestServiceEndpoint,
     std::unordered_map<std::string, ListenerInfo> listenerInfo;
 
     struct AgentInfo {
+        AgentInfo()
+            : version(0), hash(0)
+        {
+        }
+
         Json::Value config;
         std::string configStr;
+        uint64_t version;   ///< Version of config that was broadcast
+        uint64_t hash;      ///< Hash of configStr
         Date lastHeartbeat;
     };
 
     std::unordered_map<std::string, AgentInfo> agentInfo;
 
+    /// Version given to the next configuration that's broadcast
+    uint64_t nextVersion;
+
+    /** Broadcast changes as deltas rather than full configurations.  On by
+        default; turning it off goes back to sending full configurations
+        which every listener has to parse again.
+    */
+    bool sendDeltas;
+
+    /// Send the full configuration of the agent to the given listener
+    void sendConfig(const std::string & listener, const std::string & agent,
+                    const AgentInfo & info);
+
+    /// Handler for a listener's RESYNC message
+    void handleResync(const std::string & listener, const std::string & agent);
+
     /* Reponds to Monitor requests */
     MonitorProviderClient monitorProviderClient;
 
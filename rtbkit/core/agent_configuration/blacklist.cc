@@ -7,9 +7,13 @@
 
 #include "blacklist.h"
 #include "agent_config.h"
+#include "jml/utils/exc_assert.h"
+
+#include <cmath>
 
 namespace RTBKIT {
 
+
 Date
 BlacklistInfo::
 add(const BidRequest & bidRequest,
@@ -85,7 +89,7 @@ matches(const BidRequest & bidRequest,
         for (unsigned i = 0;  i < entries.size();  ++i) {
             const Entry & entry = entries[i];
             if (!matchesEntry(entry)) continue;
-            if (entry.site != "" && entry.site == bidRequest.url.toString())
+            if (entry.site != "" && entry.site == bidRequest.url.spec())
                 return true;
         }
         return false;
@@ -95,12 +99,170 @@ matches(const BidRequest & bidRequest,
     }
 }
 
+
+/*****************************************************************************/
+/* BLACKLIST FILTER                                                          */
+/*****************************************************************************/
+
+namespace {
+
+/** Picks the block of the key and derives the bits to set in it from the
+    rest of the hash.
+*/
+struct BloomKey {
+    BloomKey(const Id & id, size_t numBlocks)
+    {
+        uint64_t hash = id.hash();
+        block = hash % numBlocks;
+
+        uint64_t bits = (hash >> 32 | hash << 32) * 0x9E3779B97F4A7C15ULL;
+        for (unsigned i = 0;  i < 4;  ++i) {
+            unsigned bit = (bits >> (i * 9)) & 511;
+            word[i] = bit / 64;
+            mask[i] = 1ULL << (bit % 64);
+        }
+    }
+
+    size_t block;
+    unsigned word[4];
+    uint64_t mask[4];
+};
+
+} // file scope
+
+BlacklistFilter::
+BlacklistFilter(double slotSeconds, size_t numSlots, size_t bitsPerSlot)
+    : slotSeconds(slotSeconds),
+      numSlots(numSlots),
+      blocksPerSlot(std::max<size_t>(bitsPerSlot / (WordsPerBlock * 64), 1)),
+      slots(new Slot[numSlots]),
+      overflowUntil(0)
+{
+    static_assert(BitsPerKey == 4, "BloomKey sets 4 bits per key");
+    ExcAssertGreater(slotSeconds, 0);
+    ExcAssertGreater(numSlots, 1);
+
+    for (size_t i = 0;  i < numSlots;  ++i) {
+        Slot & slot = slots[i];
+        slot.window = Empty;
+        slot.words.reset(new std::atomic<uint64_t>[blocksPerSlot * WordsPerBlock]);
+        clear(slot);
+    }
+}
+
+int64_t
+BlacklistFilter::
+windowOf(Date date) const
+{
+    return std::floor(date.secondsSinceEpoch() / slotSeconds);
+}
+
+void
+BlacklistFilter::
+clear(Slot & slot)
+{
+    slot.window = Empty;
+    for (size_t i = 0;  i < blocksPerSlot * WordsPerBlock;  ++i)
+        slot.words[i].store(0, std::memory_order_relaxed);
+}
+
+void
+BlacklistFilter::
+add(const Id & id, Date expiry, Date now)
+{
+    if (!id) return;
+
+    // Entries are only removed from the blacklist by doExpiries() so one
+    // that has already expired still has to be found until then.
+    int64_t current = windowOf(now);
+    int64_t window = std::max(windowOf(expiry), current);
+
+    Slot & slot = slots[window % numSlots];
+    int64_t slotWindow = slot.window.load();
+
+    // A slot can only be reused once its window is over which is always the
+    // case unless the expiry is past the end of the ring or the clock went
+    // back.
+    bool fits = window < current + int64_t(numSlots)
+        && (slotWindow == window || slotWindow == Empty || slotWindow < current);
+
+    if (!fits) {
+        double until = expiry.secondsSinceEpoch();
+        if (until > overflowUntil.load()) overflowUntil = until;
+        return;
+    }
+
+    if (slotWindow != window) {
+        if (slotWindow != Empty) clear(slot);
+        slot.window = window;
+    }
+
+    BloomKey key(id, blocksPerSlot);
+    std::atomic<uint64_t> * block = &slot.words[key.block * WordsPerBlock];
+    for (unsigned i = 0;  i < BitsPerKey;  ++i)
+        block[key.word[i]].fetch_or(key.mask[i], std::memory_order_relaxed);
+}
+
+bool
+BlacklistFilter::
+mayContain(const Id & id, Date now) const
+{
+    if (!id) return false;
+    if (now.secondsSinceEpoch() < overflowUntil.load()) return true;
+
+    BloomKey key(id, blocksPerSlot);
+
+    for (size_t i = 0;  i < numSlots;  ++i) {
+        const Slot & slot = slots[i];
+        if (slot.window.load(std::memory_order_relaxed) == Empty) continue;
+
+        const std::atomic<uint64_t> * block
+            = &slot.words[key.block * WordsPerBlock];
+
+        bool found = true;
+        for (unsigned j = 0;  found && j < BitsPerKey;  ++j) {
+            uint64_t word = block[key.word[j]].load(std::memory_order_relaxed);
+            found = word & key.mask[j];
+        }
+        if (found) return true;
+    }
+
+    return false;
+}
+
+void
+BlacklistFilter::
+expire(Date now)
+{
+    int64_t current = windowOf(now);
+
+    for (size_t i = 0;  i < numSlots;  ++i) {
+        Slot & slot = slots[i];
+        int64_t window = slot.window.load();
+        if (window != Empty && window < current) clear(slot);
+    }
+}
+
+size_t
+BlacklistFilter::
+memoryUsage() const
+{
+    return numSlots * (sizeof(Slot) + blocksPerSlot * WordsPerBlock * 8);
+}
+
+
+/*****************************************************************************/
+/* BLACKLIST                                                                 */
+/*****************************************************************************/
+
 void
 Blacklist::
 doExpiries()
 {
     Date start = Date::now();
 
+    Guard guard(lock);
+
     auto onBlacklistFinished = [&] (const Id & userId,
                                     BlacklistInfo & info)
         {
@@ -108,17 +270,26 @@ doExpiries()
         };
 
     entries.expire(onBlacklistFinished, start);
+    filter.expire(start);
 }
 
 bool
 Blacklist::
 matches(const BidRequest & bidRequest, const std::string & agentName,
         const AgentConfig & config) const
-{  
-    bool blocked = false;
+{
     const Id & exchangeId = bidRequest.userIds.exchangeId;
+    const Id & providerId = bidRequest.userIds.providerId;
+
+    Date now = Date::now();
+    if (!filter.mayContain(exchangeId, now)
+            && !filter.mayContain(providerId, now))
+        return false;
+
+    Guard guard(lock);
+
+    bool blocked = false;
     if (!blocked && exchangeId) {
-        // TODO: read lock
         auto bit = entries.find(exchangeId);
         if (bit != entries.end()) {
             const BlacklistInfo & binfo = bit->second;
@@ -126,9 +297,7 @@ matches(const BidRequest & bidRequest, const std::string & agentName,
                 blocked = true;
         }
     }
-    const Id & providerId = bidRequest.userIds.providerId;
     if (!blocked && providerId) {
-        // TODO: read lock
         auto bit = entries.find(providerId);
         if (bit != entries.end()) {
             const BlacklistInfo & binfo = bit->second;
@@ -161,8 +330,12 @@ add(const BidRequest & bidRequest, const std::string & agent,
                 Date timeout = binfo.add(bidRequest, agent, agentConfig);
                 this->entries.insert(id, binfo, timeout);
             }
+
+            // Taken after the entry's own expiry so that it's never earlier.
+            this->filter.add(id, Date::now().plusSeconds(agentConfig.blacklistTime));
         };
     
+    Guard guard(lock);
     addToBlacklist(bidRequest.userIds.exchangeId);
     addToBlacklist(bidRequest.userIds.providerId);
 }
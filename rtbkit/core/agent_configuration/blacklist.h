@@ -13,6 +13,10 @@
 #include "rtbkit/common/bid_request.h"
 #include "rtbkit/core/router/router_types.h"
 #include "soa/service/timeout_map.h"
+#include "jml/arch/spinlock.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 
 namespace RTBKIT {
@@ -57,15 +61,81 @@ struct BlacklistInfo {
 };
 
 
+/*****************************************************************************/
+/* BLACKLIST FILTER                                                          */
+/*****************************************************************************/
+
+/** Bloom filter of the users that are in the blacklist, used to clear most
+    users without taking the blacklist's lock.
+
+    Users are filed in a ring of slots according to the time at which their
+    entry expires, each slot covering slotSeconds.  Once all the entries of a
+    slot have expired, it's cleared and reused for a later window so the
+    filter never needs to be rebuilt and its memory is fixed.  Entries that
+    expire beyond the end of the ring turn the filter off until they expire.
+
+    Each user sets a few bits in a single 512 bit block of a slot so a lookup
+    touches one cache line per slot in use.
+
+    add() and expire() must be serialized by the caller; mayContain() can be
+    called concurrently with them.
+*/
+struct BlacklistFilter {
+    BlacklistFilter(double slotSeconds = 60.0,
+                    size_t numSlots = 16,
+                    size_t bitsPerSlot = 1 << 22);
+
+    void add(const Id & id, Date expiry, Date now = Date::now());
+
+    /** Returns false if the user is definitely not in the blacklist. */
+    bool mayContain(const Id & id, Date now = Date::now()) const;
+
+    /** Clears the slots whose entries have all expired. */
+    void expire(Date now);
+
+    /** Bytes used by the filter which don't depend on its content. */
+    size_t memoryUsage() const;
+
+private:
+    enum {
+        WordsPerBlock = 8,
+        BitsPerKey = 4,
+        Empty = -1
+    };
+
+    struct Slot {
+        /// Window of expiries covered by the slot or Empty
+        std::atomic<int64_t> window;
+        std::unique_ptr<std::atomic<uint64_t>[]> words;
+    };
+
+    int64_t windowOf(Date date) const;
+    void clear(Slot & slot);
+
+    double slotSeconds;
+    size_t numSlots;
+    size_t blocksPerSlot;
+    std::unique_ptr<Slot[]> slots;
+
+    /// Latest expiry, in seconds since the epoch, of an entry that didn't
+    /// fit in the ring
+    std::atomic<double> overflowUntil;
+};
+
+
 /*****************************************************************************/
 /* BLACKLIST                                                                 */
 /*****************************************************************************/
 
-/** Indexed on user ID */
+/** Indexed on user ID.  Safe to use from several router shards at once. */
 struct Blacklist {
     void doExpiries();
 
-    size_t size() const { return entries.size(); }
+    size_t size() const
+    {
+        Guard guard(lock);
+        return entries.size();
+    }
     
     bool matches(const BidRequest & request,
                  const std::string & agentName,
@@ -75,8 +145,15 @@ struct Blacklist {
              const std::string & agent,
              const AgentConfig & agentConfig);
     
-    typedef TimeoutMap<Id, BlacklistInfo> Entries;
+    typedef Datacratic::TimeoutMap<Id, BlacklistInfo> Entries;
     Entries entries;
+
+    /// Checked before taking the lock on the entries
+    BlacklistFilter filter;
+
+    typedef ML::Spinlock Lock;
+    typedef std::unique_lock<Lock> Guard;
+    mutable Lock lock;
 };
 
 } // namespace RTBKIT
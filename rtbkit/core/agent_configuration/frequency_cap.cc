@@ -0,0 +1,247 @@
+/* frequency_cap.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Counts of the wins of each user for each campaign.
+*/
+
+#include "frequency_cap.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/exc_check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace RTBKIT {
+
+
+namespace {
+
+/// Counts below this are dropped when a shard runs out of room
+const double MinCount = 0.01;
+
+uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* FREQUENCY CAP STORE                                                       */
+/*****************************************************************************/
+
+FrequencyCapStore::
+FrequencyCapStore(double halfLife, size_t capacity, unsigned numShards,
+                  size_t sketchWidth, unsigned sketchDepth)
+    : halfLife_(halfLife),
+      numShards(numShards),
+      sketchDepth(sketchDepth)
+{
+    ExcCheckGreater(halfLife, 0.0, "frequency cap half-life must be positive");
+    ExcCheckGreater(numShards, 0, "frequency cap store needs shards");
+    ExcCheckGreater(sketchDepth, 0, "frequency cap sketch needs rows");
+
+    shardCapacity = std::max<size_t>(1, capacity / numShards);
+    shardWidth = std::max<size_t>(64, sketchWidth / numShards);
+
+    shards.reset(new Shard[numShards]);
+    for (unsigned i = 0;  i < numShards;  ++i) {
+        Shard & shard = shards[i];
+        shard.entries.reserve(shardCapacity);
+        shard.sketch.resize(shardWidth * sketchDepth, Cell{ 0.0f, 0.0 });
+        shard.sketched = 0;
+        shard.lastSweep = 0.0;
+    }
+}
+
+FrequencyCapStore::
+FrequencyCapStore(const Json::Value & config)
+    : FrequencyCapStore(config.get("halfLife", 86400.0).asDouble(),
+                        config.get("capacity", 1 << 20).asUInt(),
+                        config.get("shards", 64).asUInt(),
+                        config.get("sketchWidth", 1 << 18).asUInt(),
+                        config.get("sketchDepth", 4).asUInt())
+{
+}
+
+const Id &
+FrequencyCapStore::
+userOf(const UserIds & ids)
+{
+    return ids.exchangeId ? ids.exchangeId : ids.providerId;
+}
+
+uint64_t
+FrequencyCapStore::
+keyOf(const UserIds & ids, const std::string & scope)
+{
+    return keyOf(userOf(ids), scope);
+}
+
+uint64_t
+FrequencyCapStore::
+keyOf(const Id & user, const std::string & scope)
+{
+    if (!user) return 0;
+    uint64_t key = mix(user.hash() ^ mix(std::hash<std::string>()(scope)));
+    return key ? key : 1;
+}
+
+double
+FrequencyCapStore::
+decay(double count, double from, double to) const
+{
+    if (to <= from) return count;
+    return count * std::exp2((from - to) / halfLife_);
+}
+
+void
+FrequencyCapStore::
+record(uint64_t key, Date now, double weight)
+{
+    if (!key) return;
+
+    double t = now.secondsSinceEpoch();
+    Shard & shard = shardFor(key);
+    Shard::Guard guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        Entry & entry = it->second;
+        entry.count = decay(entry.count, entry.time, t) + weight;
+        entry.time = std::max(entry.time, t);
+        return;
+    }
+
+    if (shard.entries.size() < shardCapacity || sweep(shard, t)) {
+        // The key may have been sketched while the shard was full
+        double count = shard.sketched ? sketchCount(shard, key, t) : 0.0;
+        shard.entries[key] = Entry{ float(count + weight), t };
+        return;
+    }
+
+    sketchAdd(shard, key, t, weight);
+    ++shard.sketched;
+}
+
+double
+FrequencyCapStore::
+count(uint64_t key, Date now) const
+{
+    if (!key) return 0.0;
+
+    double t = now.secondsSinceEpoch();
+    Shard & shard = shardFor(key);
+    Shard::Guard guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end())
+        return decay(it->second.count, it->second.time, t);
+
+    return shard.sketched ? sketchCount(shard, key, t) : 0.0;
+}
+
+bool
+FrequencyCapStore::
+sweep(Shard & shard, double now)
+{
+    // A full shard of live keys would otherwise be swept on every win
+    if (now - shard.lastSweep < halfLife_ / 16)
+        return false;
+    shard.lastSweep = now;
+
+    for (auto it = shard.entries.begin();  it != shard.entries.end();) {
+        if (decay(it->second.count, it->second.time, now) < MinCount)
+            it = shard.entries.erase(it);
+        else ++it;
+    }
+
+    return shard.entries.size() < shardCapacity;
+}
+
+double
+FrequencyCapStore::
+sketchCount(const Shard & shard, uint64_t key, double now) const
+{
+    double result = INFINITY;
+    for (unsigned row = 0;  row < sketchDepth;  ++row) {
+        size_t col = mix(key + row * 0x9e3779b97f4a7c15ULL) % shardWidth;
+        const Cell & cell = shard.sketch[row * shardWidth + col];
+        result = std::min(result, decay(cell.count, cell.time, now));
+    }
+    return result;
+}
+
+void
+FrequencyCapStore::
+sketchAdd(Shard & shard, uint64_t key, double now, double weight)
+{
+    Cell * cells[sketchDepth];
+    double counts[sketchDepth];
+    double current = INFINITY;
+
+    for (unsigned row = 0;  row < sketchDepth;  ++row) {
+        size_t col = mix(key + row * 0x9e3779b97f4a7c15ULL) % shardWidth;
+        cells[row] = &shard.sketch[row * shardWidth + col];
+        counts[row] = decay(cells[row]->count, cells[row]->time, now);
+        current = std::min(current, counts[row]);
+    }
+
+    // Conservative update: only raise the cells to the new estimate, which
+    // keeps the collisions of the other rows from adding up.
+    double updated = current + weight;
+    for (unsigned row = 0;  row < sketchDepth;  ++row) {
+        cells[row]->count = std::max(counts[row], updated);
+        cells[row]->time = std::max(cells[row]->time, now);
+    }
+}
+
+size_t
+FrequencyCapStore::
+size() const
+{
+    size_t result = 0;
+    for (unsigned i = 0;  i < numShards;  ++i) {
+        Shard::Guard guard(shards[i].lock);
+        result += shards[i].entries.size();
+    }
+    return result;
+}
+
+size_t
+FrequencyCapStore::
+sketched() const
+{
+    size_t result = 0;
+    for (unsigned i = 0;  i < numShards;  ++i) {
+        Shard::Guard guard(shards[i].lock);
+        result += shards[i].sketched;
+    }
+    return result;
+}
+
+Json::Value
+FrequencyCapStore::
+stats() const
+{
+    Json::Value result;
+    result["halfLife"] = halfLife_;
+    result["capacity"] = Json::UInt(shardCapacity * numShards);
+    result["entries"] = Json::UInt(size());
+    result["sketched"] = Json::UInt(sketched());
+    return result;
+}
+
+} // namespace RTBKIT
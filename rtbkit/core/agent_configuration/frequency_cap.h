@@ -0,0 +1,126 @@
+/* frequency_cap.h                                                 -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Counts of the wins of each user for each campaign, kept in the router so
+   that frequency caps don't need an augmentor.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request.h"
+#include "jml/arch/spinlock.h"
+#include "soa/types/date.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* FREQUENCY CAP STORE                                                       */
+/*****************************************************************************/
+
+/** Time-decaying count of the wins of each (user, scope) pair, where the
+    scope is the agent or the account that a cap applies to.  Each win counts
+    for 1 and its weight halves every halfLife seconds, so a cap of n wins
+    behaves like n wins within about one half-life.
+
+    The keys are spread over shards which each have their own lock.  A shard
+    keeps an exact count for up to capacity / numShards keys; once it's full,
+    keys whose count decayed to almost nothing are dropped and the remaining
+    ones go to a count-min sketch of the shard.  The sketchWidth cells of
+    each of the sketchDepth rows are split between the shards.  The sketch only ever
+    overestimates, so the long tail of users is capped early rather than
+    late, and the memory of the store is fixed.
+
+    Safe to use from any number of threads.
+*/
+
+struct FrequencyCapStore {
+
+    FrequencyCapStore(double halfLife = 86400.0,
+                      size_t capacity = 1 << 20,
+                      unsigned numShards = 64,
+                      size_t sketchWidth = 1 << 18,
+                      unsigned sketchDepth = 4);
+
+    FrequencyCapStore(const Json::Value & config);
+
+    /** Id of the user that the counts are kept for: the exchange's id, or
+        the provider's when the exchange didn't give one.
+    */
+    static const Id & userOf(const UserIds & ids);
+
+    /** Key of the given user for the given scope.  Returns 0 when there's no
+        user id, which is never counted.
+    */
+    static uint64_t keyOf(const UserIds & ids, const std::string & scope);
+    static uint64_t keyOf(const Id & user, const std::string & scope);
+
+    /** Add weight to the count of the key. */
+    void record(uint64_t key, Date now = Date::now(), double weight = 1.0);
+
+    /** Decayed count of the key. */
+    double count(uint64_t key, Date now = Date::now()) const;
+
+    /** Number of keys that have an exact count. */
+    size_t size() const;
+
+    /** Number of wins that went to the sketches. */
+    size_t sketched() const;
+
+    double halfLife() const { return halfLife_; }
+
+    Json::Value stats() const;
+
+private:
+
+    struct Entry {
+        float count;
+        double time;
+    };
+
+    struct Cell {
+        float count;
+        double time;
+    };
+
+    struct Shard {
+        typedef ML::Spinlock Lock;
+        typedef std::unique_lock<Lock> Guard;
+        mutable Lock lock;
+
+        std::unordered_map<uint64_t, Entry> entries;
+        std::vector<Cell> sketch;   // sketchDepth rows of sketchWidth cells
+        size_t sketched;
+        double lastSweep;
+    };
+
+    double decay(double count, double from, double to) const;
+
+    /** Drop the entries of the shard whose count is negligible.  Returns
+        whether there is now room for another one.
+    */
+    bool sweep(Shard & shard, double now);
+
+    double sketchCount(const Shard & shard, uint64_t key, double now) const;
+    void sketchAdd(Shard & shard, uint64_t key, double now, double weight);
+
+    Shard & shardFor(uint64_t key) const
+    {
+        return shards[(key >> 32) % numShards];
+    }
+
+    double halfLife_;
+    size_t shardCapacity;
+    unsigned numShards;
+    size_t shardWidth;   // cells per row of the sketch of a shard
+    unsigned sketchDepth;
+    std::unique_ptr<Shard[]> shards;
+};
+
+} // namespace RTBKIT
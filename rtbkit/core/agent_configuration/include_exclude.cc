@@ -6,6 +6,8 @@
 
 #include "include_exclude.h"
 #include "rtbkit/common/segments.h"
+#include <unordered_map>
+#include <mutex>
 
 namespace RTBKIT {
 
@@ -14,14 +16,89 @@ std::string jsonToString(const Json::Value & value)
     return value.asString();
 }
 
+namespace {
+
+/** Compiled regexes by pattern.  Once it holds MaxEntries patterns it's
+    emptied; the regexes that were handed out stay valid as they share
+    their state with the configs that hold them.
+*/
+template<typename Regex>
+struct RegexCache {
+    enum { MaxEntries = 100000 };
+
+    template<typename Compile>
+    Regex get(const std::string & pattern, const Compile & compile)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = entries.find(pattern);
+            if (it != entries.end())
+                return it->second;
+        }
+
+        // Compiled without the lock held; a regex compiled by two threads
+        // at once is kept once.
+        Regex regex = compile(pattern);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (entries.size() >= MaxEntries)
+            entries.clear();
+        return entries.insert(std::make_pair(pattern, regex)).first->second;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return entries.size();
+    }
+
+    mutable std::mutex lock;
+    std::unordered_map<std::string, Regex> entries;
+};
+
+RegexCache<boost::regex> & regexCache()
+{
+    static RegexCache<boost::regex> cache;
+    return cache;
+}
+
+RegexCache<boost::u32regex> & u32RegexCache()
+{
+    static RegexCache<boost::u32regex> cache;
+    return cache;
+}
+
+} // file scope
+
+boost::regex compileRegex(const std::string & pattern)
+{
+    return regexCache().get(pattern, [] (const std::string & str)
+                          {
+                              return boost::regex(str);
+                          });
+}
+
+boost::u32regex compileU32Regex(const std::string & pattern)
+{
+    return u32RegexCache().get(pattern, [] (const std::string & str)
+                             {
+                                 return boost::make_u32regex(str);
+                             });
+}
+
+size_t regexCacheSize()
+{
+    return regexCache().size() + u32RegexCache().size();
+}
+
 void jsonParse(const Json::Value & value, boost::u32regex & rex)
 {
-    rex = boost::make_u32regex(value.asString());
+    rex = compileU32Regex(value.asString());
 }
 
 void jsonParse(const Json::Value & value, boost::regex & rex)
 {
-    rex = value.asString();
+    rex = compileRegex(value.asString());
 }
 
 void jsonParse(const Json::Value & value, std::string & str)
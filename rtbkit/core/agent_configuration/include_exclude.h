@@ -67,6 +67,18 @@ inline bool matches(int i, int j)
 }
 #endif
 
+/** Compiled regexes are shared by every configuration of the process that
+    uses the same pattern, so that parsing a configuration again (which
+    every router does on every change of an agent's targeting) doesn't
+    recompile its regexes.  Compiled regexes are immutable and share their
+    state on copy.  Invalid patterns throw like the regex constructors.
+*/
+boost::regex compileRegex(const std::string & pattern);
+boost::u32regex compileU32Regex(const std::string & pattern);
+
+/** Number of patterns currently held by the regex caches. */
+size_t regexCacheSize();
+
 void jsonParse(const Json::Value & value, boost::regex & reg);
 void jsonParse(const Json::Value & value, boost::u32regex & reg);
 void jsonParse(const Json::Value & value, std::string & str);
@@ -269,7 +281,9 @@ struct DomainMatcher {
     {
         if (isLiteral)
             return url.domainMatches(str);
-        else return RTBKIT::matches(rex, url.host());
+
+        auto host = url.hostRange();
+        return boost::regex_search(host.first, host.first + host.second, rex);
     }
 
     bool matches(const Url & url, uint64_t urlHash,
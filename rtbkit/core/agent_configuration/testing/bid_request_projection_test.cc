@@ -0,0 +1,77 @@
+/* bid_request_projection_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the projection of bid requests sent to agents.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/agent_config.h"
+
+using namespace std;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_projection )
+{
+    Json::Value request = Json::parse(R"JSON({
+        "id": "1234",
+        "imp": [ { "id": "1", "banner": { "w": 300, "h": 250 }, "bidfloor": 1 },
+                 { "id": "2", "video": { "w": 640 } } ],
+        "site": { "domain": "example.com", "page": "http://example.com/x" },
+        "device": { "ua": "Mozilla", "geo": { "country": "CA" } }
+    })JSON");
+
+    BidRequestProjection projection;
+    projection.fromJson(Json::parse(R"JSON({
+        "fields": [ "site.domain", "imp.banner", "id", "device.geo.country",
+                    "user.id" ],
+        "augmentors": [ "frequency-cap-ex" ]
+    })JSON"));
+
+    Json::Value projected = projection.apply(request);
+    BOOST_CHECK_EQUAL(projected["id"].asString(), "1234");
+    BOOST_CHECK_EQUAL(projected["site"]["domain"].asString(), "example.com");
+    BOOST_CHECK(!projected["site"].isMember("page"));
+    BOOST_CHECK_EQUAL(projected["device"]["geo"]["country"].asString(), "CA");
+    BOOST_CHECK(!projected["device"].isMember("ua"));
+    BOOST_CHECK(!projected.isMember("user"));
+
+    // Arrays keep their elements, each one projected
+    BOOST_REQUIRE_EQUAL(projected["imp"].size(), 2);
+    BOOST_CHECK_EQUAL(projected["imp"][0u]["banner"]["w"].asInt(), 300);
+    BOOST_CHECK(!projected["imp"][0u].isMember("bidfloor"));
+    BOOST_CHECK(!projected["imp"][1u].isMember("video"));
+
+    BOOST_CHECK(projection.includesAugmentor("frequency-cap-ex"));
+    BOOST_CHECK(!projection.includesAugmentor("random"));
+
+    // The same fields in another order share the projection
+    BidRequestProjection other;
+    other.fromJson(Json::parse(R"JSON({
+        "fields": [ "id", "imp.banner", "site.domain", "user.id",
+                    "device.geo.country", "id" ]
+    })JSON"));
+    BOOST_CHECK_EQUAL(other.fieldsKey(), projection.fieldsKey());
+    BOOST_CHECK(other.includesAugmentor("random"));
+
+    // Round trip through the agent configuration
+    AgentConfig config;
+    config.parse(R"JSON({
+        "account": [ "hello", "world" ],
+        "creatives": [ { "name": "c", "width": 300, "height": 250, "id": 1 } ],
+        "bidRequestProjection": { "fields": [ "id" ] }
+    })JSON");
+    BOOST_CHECK_EQUAL(config.bidRequestProjection.fieldsKey(), "id,");
+    BOOST_CHECK_EQUAL(config.toJson()["bidRequestProjection"]["fields"][0u]
+                      .asString(), "id");
+
+    BOOST_CHECK_THROW(config.parse(R"JSON({
+        "account": [ "hello", "world" ],
+        "creatives": [ { "name": "c", "width": 300, "height": 250, "id": 1 } ],
+        "bidRequestFormat": "binaryV1",
+        "bidRequestProjection": { "fields": [ "id" ] }
+    })JSON"), ML::Exception);
+}
@@ -0,0 +1,77 @@
+/* blacklist_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the blacklist and its bloom filter.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/blacklist.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_blacklist_filter )
+{
+    BlacklistFilter filter(10.0, 4, 1 << 16);
+    Date now = Date::fromSecondsSinceEpoch(1000);
+
+    BOOST_CHECK(!filter.mayContain(Id(1), now));
+    BOOST_CHECK(!filter.mayContain(Id(), now));
+
+    filter.add(Id(1), now.plusSeconds(5), now);
+    filter.add(Id(2), now.plusSeconds(25), now);
+
+    BOOST_CHECK(filter.mayContain(Id(1), now));
+    BOOST_CHECK(filter.mayContain(Id(2), now));
+
+    size_t falsePositives = 0;
+    for (size_t i = 100;  i < 10100;  ++i)
+        falsePositives += filter.mayContain(Id(i), now);
+    BOOST_CHECK_LT(falsePositives, 100);
+
+    // The first window is over but not the one of the second user.
+    now = now.plusSeconds(10);
+    filter.expire(now);
+    BOOST_CHECK(!filter.mayContain(Id(1), now));
+    BOOST_CHECK(filter.mayContain(Id(2), now));
+
+    now = now.plusSeconds(20);
+    filter.expire(now);
+    BOOST_CHECK(!filter.mayContain(Id(2), now));
+
+    // Past the end of the ring, every user has to be checked until it
+    // expires.
+    filter.add(Id(3), now.plusSeconds(100), now);
+    BOOST_CHECK(filter.mayContain(Id(4), now));
+    BOOST_CHECK(filter.mayContain(Id(4), now.plusSeconds(99)));
+    BOOST_CHECK(!filter.mayContain(Id(4), now.plusSeconds(101)));
+}
+
+BOOST_AUTO_TEST_CASE( test_blacklist )
+{
+    AgentConfig config;
+    config.blacklistType = BL_USER;
+    config.blacklistScope = BL_AGENT;
+    config.blacklistTime = 60.0;
+
+    BidRequest blocked;
+    blocked.userIds.add(Id(1), ID_EXCHANGE);
+
+    BidRequest other;
+    other.userIds.add(Id(2), ID_EXCHANGE);
+
+    Blacklist blacklist;
+    BOOST_CHECK(!blacklist.matches(blocked, "agent", config));
+
+    blacklist.add(blocked, "agent", config);
+    BOOST_CHECK_EQUAL(blacklist.size(), 1);
+
+    BOOST_CHECK(blacklist.matches(blocked, "agent", config));
+    BOOST_CHECK(!blacklist.matches(blocked, "other-agent", config));
+    BOOST_CHECK(!blacklist.matches(other, "agent", config));
+}
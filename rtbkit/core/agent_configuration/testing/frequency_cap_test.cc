@@ -0,0 +1,114 @@
+/* frequency_cap_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the frequency cap store.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/agent_configuration/frequency_cap.h"
+
+#include <thread>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_frequency_cap_keys )
+{
+    UserIds ids;
+    BOOST_CHECK_EQUAL(FrequencyCapStore::keyOf(ids, "a:b"), 0);
+
+    ids.add(Id(1), ID_PROVIDER);
+    BOOST_CHECK_EQUAL(FrequencyCapStore::userOf(ids), Id(1));
+    uint64_t provider = FrequencyCapStore::keyOf(ids, "a:b");
+    BOOST_CHECK_NE(provider, 0);
+
+    ids.add(Id(2), ID_EXCHANGE);
+    BOOST_CHECK_EQUAL(FrequencyCapStore::userOf(ids), Id(2));
+    BOOST_CHECK_NE(FrequencyCapStore::keyOf(ids, "a:b"), provider);
+    BOOST_CHECK_NE(FrequencyCapStore::keyOf(ids, "a:b"),
+                   FrequencyCapStore::keyOf(ids, "a:c"));
+}
+
+BOOST_AUTO_TEST_CASE( test_frequency_cap_decay )
+{
+    FrequencyCapStore store(100.0 /* halfLife */, 1024, 4);
+    Date now = Date::fromSecondsSinceEpoch(1000);
+
+    uint64_t key = FrequencyCapStore::keyOf(Id(1), "campaign");
+    BOOST_CHECK_EQUAL(store.count(key, now), 0.0);
+
+    store.record(key, now);
+    store.record(key, now);
+    BOOST_CHECK_CLOSE(store.count(key, now), 2.0, 0.01);
+    BOOST_CHECK_CLOSE(store.count(key, now.plusSeconds(100)), 1.0, 0.01);
+    BOOST_CHECK_CLOSE(store.count(key, now.plusSeconds(200)), 0.5, 0.01);
+
+    store.record(key, now.plusSeconds(100));
+    BOOST_CHECK_CLOSE(store.count(key, now.plusSeconds(100)), 2.0, 0.01);
+
+    // Nothing is recorded without a user
+    store.record(0, now);
+    BOOST_CHECK_EQUAL(store.count(0, now), 0.0);
+    BOOST_CHECK_EQUAL(store.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_frequency_cap_sketch )
+{
+    // Room for 64 exact counts; the rest of the users go to the sketch.
+    FrequencyCapStore store(3600.0, 64, 4, 4096, 4);
+    Date now = Date::fromSecondsSinceEpoch(1000);
+
+    for (unsigned i = 1;  i <= 1000;  ++i) {
+        uint64_t key = FrequencyCapStore::keyOf(Id(i), "campaign");
+        for (unsigned j = 0;  j < i % 3 + 1;  ++j)
+            store.record(key, now);
+    }
+
+    BOOST_CHECK_LE(store.size(), 64);
+    BOOST_CHECK_GT(store.sketched(), 0);
+
+    // The sketch never underestimates and is mostly exact at this load.
+    size_t exact = 0;
+    for (unsigned i = 1;  i <= 1000;  ++i) {
+        uint64_t key = FrequencyCapStore::keyOf(Id(i), "campaign");
+        double count = store.count(key, now);
+        BOOST_CHECK_GE(count + 1e-3, i % 3 + 1);
+        exact += count < i % 3 + 1.5;
+    }
+    BOOST_CHECK_GT(exact, 900);
+
+    // Once the counts decayed, the exact map makes room for new users again
+    Date later = now.plusSeconds(3600 * 10);
+    uint64_t key = FrequencyCapStore::keyOf(Id(5000), "campaign");
+    store.record(key, later);
+    BOOST_CHECK_CLOSE(store.count(key, later), 1.0, 1.0);
+    BOOST_CHECK_LE(store.size(), 64);
+}
+
+BOOST_AUTO_TEST_CASE( test_frequency_cap_threads )
+{
+    FrequencyCapStore store(86400.0, 1 << 16, 16);
+    Date now = Date::now();
+
+    auto doThread = [&] ()
+        {
+            for (unsigned i = 0;  i < 10000;  ++i)
+                store.record(FrequencyCapStore::keyOf(Id(i % 100 + 1), "c"),
+                             now);
+        };
+
+    vector<thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i)
+        threads.emplace_back(doThread);
+    for (auto & th : threads)
+        th.join();
+
+    for (unsigned i = 1;  i <= 100;  ++i) {
+        uint64_t key = FrequencyCapStore::keyOf(Id(i), "c");
+        BOOST_CHECK_CLOSE(store.count(key, now), 400.0, 0.01);
+    }
+}
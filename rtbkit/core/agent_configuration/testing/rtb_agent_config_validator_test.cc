@@ -235,3 +235,31 @@ BOOST_AUTO_TEST_CASE( test_agent_config_language_filter )
 
     BOOST_CHECK_THROW(config.parse(payload),ML::Exception);
 }
+
+BOOST_AUTO_TEST_CASE( test_agent_config_regexes_are_shared )
+{
+    std::string payload = R"JSON( {
+            "account" : ["hello", "worlds"],
+            "urlFilter": { "include": [ "^http://shared-pattern\\.com/" ] },
+            "creatives": [
+            {
+                "name": "MaCreative",
+                "height": 250,
+                "width": 300,
+                "id": 5
+            }]}
+        )JSON";
+
+    AgentConfig config1, config2;
+    config1.parse(payload);
+    size_t size = regexCacheSize();
+    config2.parse(payload);
+    BOOST_CHECK_EQUAL(regexCacheSize(), size);
+
+    std::string url = "http://shared-pattern.com/page";
+    BOOST_CHECK(config2.urlFilter.include.at(0).matches(url));
+    BOOST_CHECK(!config2.urlFilter.include.at(0).matches("http://other.com/"));
+
+    BOOST_CHECK_THROW(compileRegex("(unbalanced"), std::exception);
+    BOOST_CHECK_EQUAL(regexCacheSize(), size);
+}
@@ -3,3 +3,6 @@
 
 $(eval $(call test,rtb_agent_config_validator_test,agent_configuration,boost))
 $(eval $(call test,rtb_fees_test,agent_configuration,boost))
+$(eval $(call test,blacklist_test,agent_configuration,boost))
+$(eval $(call test,frequency_cap_test,agent_configuration,boost))
+$(eval $(call test,bid_request_projection_test,agent_configuration,boost))
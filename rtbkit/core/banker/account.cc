@@ -353,17 +353,20 @@ void
 ShadowAccounts::
 logBidEvents(const Datacratic::EventRecorder & eventRecorder)
 {
-    Guard guard(lock);
-
     uint32_t attachedBids(0), detachedBids(0), commitments(0), expired(0);
 
-    for (auto & it: accounts) {
-        ShadowAccount & account = it.second;
-        attachedBids += account.attachedBids;
-        detachedBids += account.detachedBids;
-        commitments += account.commitments.size();
-        account.logBidEvents(eventRecorder, it.first.toString('.'));
-        expired += account.lastExpiredCommitments;
+    for (auto & shard: shards) {
+        Guard guard1(shard.lock);
+
+        for (auto & it: shard.accounts) {
+            ShadowAccount & account = *it.second;
+            Guard guard2(it.second->lock);
+            attachedBids += account.attachedBids;
+            detachedBids += account.detachedBids;
+            commitments += account.commitments.size();
+            account.logBidEvents(eventRecorder, it.first.toString('.'));
+            expired += account.lastExpiredCommitments;
+        }
     }
 
     eventRecorder.recordLevel(attachedBids,
@@ -13,10 +13,12 @@
 #include <unordered_set>
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/account_key.h"
+#include "rtbkit/common/budget_availability.h"
 #include "soa/types/date.h"
 #include "jml/utils/string_functions.h"
 #include <mutex>
 #include <thread>
+#include <algorithm>
 #include "jml/arch/spinlock.h"
 
 namespace Datacratic {
@@ -672,15 +674,25 @@ struct ShadowAccount {
 
     void syncFromMaster(const Account & masterAccount)
     {
-        checkInvariants();
         masterAccount.checkInvariants();
 
         // net budget: balance assuming spent, commitments are zero
-        netBudget = masterAccount.getNetBudget();
+        syncFromMaster(masterAccount.getNetBudget(), masterAccount.status);
+    }
+
+    /** The net budget and status are all a shadow account takes from its
+        master account, so the master can send just those.
+    */
+    void syncFromMaster(const CurrencyPool & masterNetBudget,
+                        Account::Status masterStatus)
+    {
+        checkInvariants();
+
+        netBudget = masterNetBudget;
         balance = netBudget + commitmentsRetired
             - commitmentsMade - spent;
 
-        status = masterAccount.status;
+        status = masterStatus;
         checkInvariants();
     }
 
@@ -832,7 +844,8 @@ operator << (std::ostream & stream, const AccountSummary & summary)
 
 struct Accounts {
     Accounts()
-        : sessionStart(Datacratic::Date::now())
+        : sessionStart(Datacratic::Date::now()),
+          generation(0)
     {
     }
 
@@ -843,6 +856,22 @@ struct Accounts {
 
         /* spend tracking across sessions */
         CurrencyPool initialSpent;
+
+        /* generation of the last time the account was handed out for
+           modification; see getGeneration() */
+        uint64_t generation = 0;
+
+        /* totals over the account and all of its sub-accounts, used by the
+           summaries.  They are recomputed lazily when totalsValid is false;
+           see invalidateTotals(). */
+        struct Totals {
+            CurrencyPool effectiveBudget;
+            CurrencyPool inFlight;
+            CurrencyPool spent;
+            CurrencyPool adjustments;
+        };
+        mutable Totals totals;
+        mutable bool totalsValid = false;
     };
 
     const Account createAccount(const AccountKey & account,
@@ -1113,6 +1142,26 @@ struct Accounts {
         outOfSyncAccounts.insert(account);
     }
 
+    /** Return the accounts that may have changed since the last call and
+        start tracking changes afresh.  Persistence uses this to write only
+        those accounts; if the write fails, markAccountsDirty() puts them
+        back for the next attempt.
+    */
+    std::vector<AccountKey> takeDirtyAccounts()
+    {
+        Guard guard(lock);
+        std::vector<AccountKey> result(dirtyAccounts.begin(),
+                                       dirtyAccounts.end());
+        dirtyAccounts.clear();
+        return result;
+    }
+
+    void markAccountsDirty(const std::vector<AccountKey> & keys)
+    {
+        Guard guard(lock);
+        dirtyAccounts.insert(keys.begin(), keys.end());
+    }
+
     bool isAccountOutOfSync(const AccountKey & account) const
     {
         Guard guard(lock);
@@ -1162,6 +1211,15 @@ private:
     AccountSet outOfSyncAccounts;
     AccountSet inconsistentAccounts;
 
+    /** Accounts that were handed out for modification since the last call
+        to takeDirtyAccounts().  Anything that goes through ensureAccount()
+        or the non-const getAccountImpl() is counted as modified.
+    */
+    AccountSet dirtyAccounts;
+
+    /** Bumped every time an account is marked dirty. */
+    uint64_t generation;
+
 public:
     std::vector<AccountKey>
     getAccountKeys(const AccountKey & prefix = AccountKey(),
@@ -1179,6 +1237,84 @@ public:
         return result;
     }
 
+    /** Generation of the accounts.  It is bumped every time an account is
+        handed out for modification and the account records it, which lets
+        forEachAccountBatch() skip the accounts that didn't change since a
+        previous call.  Generations start from zero in every session.
+    */
+    uint64_t getGeneration() const
+    {
+        Guard guard(lock);
+        return generation;
+    }
+
+    typedef std::vector<std::pair<AccountKey, Account> > AccountBatch;
+
+    /** Call onBatch with copies of the accounts under the given prefix that
+        changed after the given generation, in key order and in batches
+        taken from at most batchSize accounts at a time.
+
+        The lock is only held while a batch is copied so that dumping a
+        large number of accounts doesn't hold up the operations on them.
+        The accounts of a batch are consistent with each other but not with
+        those of the other batches.
+
+        Returns the generation at the start of the call, which can be
+        passed back as since to get the accounts that changed in the
+        meantime.  A since from a previous session, which is greater than
+        the current generation, returns all the accounts.
+    */
+    uint64_t
+    forEachAccountBatch(const AccountKey & prefix,
+                        uint64_t since,
+                        size_t batchSize,
+                        const std::function<void (AccountBatch &)> & onBatch)
+        const
+    {
+        ExcAssertGreater(batchSize, 0);
+
+        uint64_t start;
+        AccountBatch batch;
+        batch.reserve(batchSize);
+        AccountKey last;
+
+        {
+            Guard guard(lock);
+            start = generation;
+        }
+        if (since > start)
+            since = 0;
+
+        for (bool first = true, done = false;  !done;  first = false) {
+            batch.clear();
+            {
+                Guard guard(lock);
+
+                auto it = first
+                    ? accounts.lower_bound(prefix)
+                    : accounts.upper_bound(last);
+
+                // Bound the accounts visited rather than copied so that the
+                // lock isn't held over a long run of unchanged accounts.
+                for (size_t n = 0;
+                     it != accounts.end() && n < batchSize;  ++it, ++n) {
+                    if (!it->first.hasPrefix(prefix))
+                        break;
+                    last = it->first;
+                    if (it->second.generation > since)
+                        batch.emplace_back(it->first, it->second);
+                }
+
+                done = it == accounts.end() || !it->first.hasPrefix(prefix);
+            }
+
+            if (!batch.empty())
+                onBatch(batch);
+        }
+
+        return start;
+    }
+
     void
     forEachAccount(const std::function<void (const AccountKey &,
                                              const Account &)>
@@ -1215,7 +1351,10 @@ public:
                 auto it = accounts.find(key);
                 if (it == accounts.end())
                     return;
-                result.ensureAccount(it->first, it->second.type) = it->second;
+                auto & info = result.ensureAccount(it->first, it->second.type);
+                info = it->second;
+                // The totals cover children that may not be copied
+                info.totalsValid = false;
 
                 if (depth >= maxDepth)
                     return;
@@ -1236,9 +1375,13 @@ private:
     {
         ExcAssertGreaterEqual(accountKey.size(), 1);
 
+        dirtyAccounts.insert(accountKey);
+
         auto it = accounts.find(accountKey);
         if (it != accounts.end()) {
             ExcAssertEqual(it->second.type, type);
+            it->second.generation = ++generation;
+            invalidateTotals(accountKey);
             return it->second;
         }
         else {
@@ -1253,6 +1396,7 @@ private:
 
             auto & result = accounts[accountKey];
             result.type = type;
+            result.generation = ++generation;
             return result;
         }
     }
@@ -1262,9 +1406,60 @@ private:
         auto it = accounts.find(account);
         if (it == accounts.end())
             throw ML::Exception("couldn't get account: " + account.toString());
+        dirtyAccounts.insert(account);
+        it->second.generation = ++generation;
+        invalidateTotals(account);
         return it->second;
     }
 
+    /** Mark the totals of the account and of its parents as needing to be
+        recomputed.  An account whose totals are valid only has children with
+        valid totals, so the walk stops at the first invalid account and
+        repeated modifications of the same account are O(1).
+    */
+    void invalidateTotals(AccountKey accountKey)
+    {
+        for (;;) {
+            auto it = accounts.find(accountKey);
+            if (it == accounts.end() || !it->second.totalsValid)
+                return;
+            it->second.totalsValid = false;
+            if (accountKey.size() == 1)
+                return;
+            accountKey.pop_back();
+        }
+    }
+
+    /** Return the totals over the account and its sub-accounts, recomputing
+        those that were invalidated.  Only the modified accounts and their
+        parents are visited.
+    */
+    const AccountInfo::Totals &
+    getTotalsImpl(const AccountInfo & info) const
+    {
+        if (!info.totalsValid) {
+            AccountInfo::Totals & totals = info.totals;
+            totals.effectiveBudget
+                = info.budgetIncreases - info.budgetDecreases
+                + info.recycledIn - info.recycledOut
+                + info.allocatedIn - info.allocatedOut;
+            totals.inFlight = info.commitmentsMade - info.commitmentsRetired;
+            totals.spent = info.spent;
+            totals.adjustments = info.adjustmentsIn - info.adjustmentsOut;
+
+            for (const AccountKey & ch: info.children) {
+                auto & childTotals = getTotalsImpl(getAccountImpl(ch));
+                totals.effectiveBudget += childTotals.effectiveBudget;
+                totals.inFlight += childTotals.inFlight;
+                totals.spent += childTotals.spent;
+                totals.adjustments += childTotals.adjustments;
+            }
+
+            info.totalsValid = true;
+        }
+        return info.totals;
+    }
+
     std::pair<bool, bool> accountPresentAndActiveImpl(const AccountKey & account) const
     {
         auto it = accounts.find(account);
@@ -1339,25 +1534,26 @@ private:
     {
         AccountSummary result;
 
-        const Account & a = getAccountImpl(account);
+        const AccountInfo & a = getAccountImpl(account);
+        const AccountInfo::Totals & totals = getTotalsImpl(a);
 
         result.account = a;
-        result.spent = a.spent;
         result.budget = a.budgetIncreases - a.budgetDecreases;
-        result.effectiveBudget = a.budgetIncreases - a.budgetDecreases 
-                        + a.recycledIn - a.recycledOut
-                        + a.allocatedIn - a.allocatedOut;
-        result.inFlight = a.commitmentsMade - a.commitmentsRetired;
-        result.adjustments = a.adjustmentsIn - a.adjustmentsOut;
-
-        auto doChildAccount = [&] (const AccountKey & key) {
-            auto childSummary = getAccountSummaryImpl(key, depth + 1,
-                                                      maxDepth);
-            result.addChild(key.back(), childSummary,
-                            maxDepth == -1 || depth < maxDepth);
-        };
-        forEachChildAccount(account, doChildAccount);
-        
+        result.effectiveBudget = totals.effectiveBudget;
+        result.inFlight = totals.inFlight;
+        result.spent = totals.spent;
+        result.adjustments = totals.adjustments;
+
+        // The totals already cover the whole subtree; children are only
+        // visited for the sub-account summaries that were asked for.
+        if (maxDepth == -1 || depth < maxDepth) {
+            auto doChildAccount = [&] (const AccountKey & key) {
+                result.subAccounts[key.back()]
+                    = getAccountSummaryImpl(key, depth + 1, maxDepth);
+            };
+            forEachChildAccount(account, doChildAccount);
+        }
+
         result.adjustedSpent = result.spent - result.adjustments;
 
         result.available = (result.effectiveBudget - result.adjustedSpent - result.inFlight);
@@ -1374,29 +1570,72 @@ private:
 /* SHADOW ACCOUNTS                                                           */
 /*****************************************************************************/
 
+/** The shadow accounts are hit by every router and post auction thread for
+    each bid, so they are split into shards by interned account id (see
+    AccountKeyId) and each account has its own lock.  The shard lock only protects the shard's map and is
+    held just long enough to find the account; the bid operations run under
+    the account's lock alone.  Accounts are never removed, so references to
+    them remain valid once the shard lock is released.
+
+    Operations over all the accounts lock one shard at a time and then each
+    account in turn; they see a consistent view of each account but not of
+    the whole set.
+*/
+
 struct ShadowAccounts {
+    ShadowAccounts()
+        : availability(std::make_shared<BudgetAvailability>())
+    {
+    }
+
     /** Callback called whenever a new account is created.  This can be
         assigned to in order to add functionality that must be present
         whenever a new account is created.
     */
     std::function<void (AccountKey)> onNewAccount;
+
+    /** Which accounts have budget left.  Kept up to date as the accounts
+        are synced from the master and as bids fail to be authorized, so
+        that whoever is about to bid can skip the exhausted accounts without
+        taking their lock.
+    */
+    std::shared_ptr<const BudgetAvailability> budgetAvailability() const
+    {
+        return availability;
+    }
     
     const ShadowAccount activateAccount(const AccountKey & account)
     {
-        Guard guard(lock);
-        return getAccountImpl(account);
+        AccountEntry & a = getAccountImpl(account);
+        Guard guard(a.lock);
+        return a;
     }
 
     const ShadowAccount syncFromMaster(const AccountKey & account,
                                        const Account & master)
     {
-        Guard guard(lock);
-        auto & a = getAccountImpl(account);
+        AccountEntry & a = getAccountImpl(account);
+        Guard guard(a.lock);
         ExcAssert(!a.uninitialized);
         a.syncFromMaster(master);
+        updateAvailability(AccountKeyId::intern(account), a);
         return a;
     }
 
+    /** Same as above with only the parts of the master account that the
+        shadow account needs; see ShadowAccount::syncFromMaster().
+    */
+    void syncFromMaster(const AccountKey & account,
+                        const CurrencyPool & netBudget,
+                        Account::Status status)
+    {
+        AccountEntry & a = getAccountImpl(account);
+        Guard guard(a.lock);
+        ExcAssert(!a.uninitialized);
+        a.syncFromMaster(netBudget, status);
+        updateAvailability(AccountKeyId::intern(account), a);
+    }
+
     /** Initialize an account by merging with the initial state as
         received from the master banker.
     */
@@ -1404,39 +1643,45 @@ struct ShadowAccounts {
     initializeAndMergeState(const AccountKey & account,
                             const Account & master)
     {
-        Guard guard(lock);
-        auto & a = getAccountImpl(account);
+        AccountEntry & a = getAccountImpl(account);
+        Guard guard(a.lock);
         ExcAssert(a.uninitialized);
         a.initializeAndMergeState(master);
         a.uninitialized = false;
+        a.changed = true;
+        updateAvailability(AccountKeyId::intern(account), a);
         return a;
     }
 
     void checkInvariants() const
     {
-        Guard guard(lock);
-        for (auto & a: accounts) {
-            a.second.checkInvariants();
-        }
+        forEachEntry([&] (const AccountKey &, const AccountEntry & a)
+                     {
+                         a.checkInvariants();
+                     });
     }
 
     const ShadowAccount getAccount(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey);
+        const AccountEntry & a = getAccountImpl(accountKey);
+        Guard guard(a.lock);
+        return a;
     }
 
     bool accountExists(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
-        return accounts.count(accountKey);
+        AccountKeyId id = AccountKeyId::find(accountKey);
+        if (!id) return false;
+
+        const Shard & shard = getShard(id);
+        Guard guard(shard.lock);
+        return shard.accounts.count(id);
     }
 
     bool createAccountAtomic(const AccountKey & accountKey)
     {
-    	Guard guard(lock);
-
     	AccountEntry & account = getAccountImpl(accountKey, false /* call onCreate */);
+    	Guard guard(account.lock);
     	bool result = account.first;
 
     	// record that this account creation is requested for the first time
@@ -1451,94 +1696,194 @@ struct ShadowAccounts {
 
     void syncTo(Accounts & master) const
     {
-        Guard guard1(lock);
-        Guard guard2(master.lock);
+        for (auto & shard: shards) {
+            Guard guard1(shard.lock);
+            Guard guard2(master.lock);
 
-        for (auto & a: accounts)
-            a.second.syncToMaster(master.getAccountImpl(a.first));
+            for (auto & a: shard.accounts) {
+                Guard guard3(a.second->lock);
+                a.second->syncToMaster(master.getAccountImpl(a.first.key()));
+            }
+        }
     }
 
     void syncFrom(const Accounts & master)
     {
-        Guard guard1(lock);
-        Guard guard2(master.lock);
+        for (auto & shard: shards) {
+            Guard guard1(shard.lock);
+            Guard guard2(master.lock);
+
+            for (auto & a: shard.accounts) {
+                Guard guard3(a.second->lock);
+                a.second->syncFromMaster(master.getAccountImpl(a.first.key()));
+                if (master.outOfSyncAccounts.count(a.first.key()) > 0) {
+                    a.second->outOfSync = true;
+                }
+                updateAvailability(a.first, *a.second);
+            }
+        }
+    }
 
-        for (auto & a: accounts) {
-            a.second.syncFromMaster(master.getAccountImpl(a.first));
-            if (master.outOfSyncAccounts.count(a.first) > 0) {
-                outOfSyncAccounts.insert(a.first);
+    /** Call onAccount for each initialized account whose spend changed
+        since the last call and clear its changed flag.  If the changes
+        can't be delivered, markChanged() puts the account back in the next
+        round.
+    */
+    void forEachChangedAccount(
+            const std::function<void (const AccountKey &,
+                                      const ShadowAccount &)> & onAccount)
+    {
+        for (auto & shard: shards) {
+            Guard guard1(shard.lock);
+            for (auto & a: shard.accounts) {
+                AccountEntry & account = *a.second;
+                Guard guard2(account.lock);
+                if (account.uninitialized || !account.changed)
+                    continue;
+                account.changed = false;
+                onAccount(a.first.key(), account);
             }
         }
     }
 
+    void markChanged(const AccountKey & accountKey)
+    {
+        AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
+        account.changed = true;
+    }
+
     void sync(Accounts & master)
     {
-        Guard guard1(lock);
-        Guard guard2(master.lock);
+        for (auto & shard: shards) {
+            Guard guard1(shard.lock);
+            Guard guard2(master.lock);
 
-        for (auto & a: accounts) {
-            a.second.syncToMaster(master.getAccountImpl(a.first));
-            a.second.syncFromMaster(master.getAccountImpl(a.first));
+            for (auto & a: shard.accounts) {
+                Guard guard3(a.second->lock);
+                a.second->syncToMaster(master.getAccountImpl(a.first.key()));
+                a.second->syncFromMaster(master.getAccountImpl(a.first.key()));
+                updateAvailability(a.first, *a.second);
+            }
         }
     }
 
     bool isInitialized(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
-        return !getAccountImpl(accountKey).uninitialized;
+        const AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
+        return !account.uninitialized;
     }
 
     bool isStalled(const AccountKey & accountKey) const
     {
-        Guard guard(lock);
-        auto & account = getAccountImpl(accountKey);
+        const AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
         return account.uninitialized && account.requested.minutesUntil(Date::now()) >= 1.0;
     }
 
     void reinitializeStalledAccount(const AccountKey & accountKey)
     {
         ExcAssert(isStalled(accountKey));
-        Guard guard(lock);
-        auto & account = getAccountImpl(accountKey);
+        AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
         account.first = true;
         account.requested = Date::now();
     }
 
+    /** Give an account that hasn't heard from the master banker yet a
+        provisional budget, typically what it had left before a restart, so
+        that it can authorize bids straight away.  The account stays
+        uninitialized: its initialization replaces the provisional budget
+        with the master's and merges in what was done in the meantime like
+        for any other uninitialized account.
+
+        Returns false if the account was already initialized.
+    */
+    bool setProvisionalBudget(const AccountKey & accountKey,
+                              const CurrencyPool & netBudget,
+                              Account::Status status)
+    {
+        AccountEntry & account = getAccountImpl(accountKey, false /* call onCreate */);
+        Guard guard(account.lock);
+        if (!account.uninitialized)
+            return false;
+        account.syncFromMaster(netBudget, status);
+        updateAvailability(AccountKeyId::intern(accountKey), account);
+        return true;
+    }
+
     /*************************************************************************/
     /* BID OPERATIONS                                                        */
     /*************************************************************************/
 
-    bool authorizeBid(const AccountKey & accountKey,
+    /* The bid operations which are on the hot path of every bid take the
+       interned id of the account; the AccountKey versions intern the key
+       first.
+    */
+
+    bool authorizeBid(AccountKeyId accountId,
                       const std::string & item,
                       Amount amount)
     {
-        Guard guard(lock);
-        return (outOfSyncAccounts.count(accountKey) == 0
-                && getAccountImpl(accountKey).authorizeBid(item, amount));
+        AccountEntry & account = getAccountImpl(accountId);
+        Guard guard(account.lock);
+        account.changed = true;
+        if (!account.outOfSync && account.authorizeBid(item, amount))
+            return true;
+        availability->setAvailable(accountId, false);
+        return false;
     }
     
+    bool authorizeBid(const AccountKey & accountKey,
+                      const std::string & item,
+                      Amount amount)
+    {
+        return authorizeBid(AccountKeyId::intern(accountKey), item, amount);
+    }
+
+    void commitBid(AccountKeyId accountId,
+                   const std::string & item,
+                   Amount amountPaid,
+                   const LineItems & lineItems)
+    {
+        AccountEntry & account = getAccountImpl(accountId);
+        Guard guard(account.lock);
+        account.changed = true;
+        return account.commitBid(item, amountPaid, lineItems);
+    }
+
     void commitBid(const AccountKey & accountKey,
                    const std::string & item,
                    Amount amountPaid,
                    const LineItems & lineItems)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).commitBid(item, amountPaid, lineItems);
+        commitBid(AccountKeyId::intern(accountKey), item, amountPaid, lineItems);
+    }
+
+    void cancelBid(AccountKeyId accountId,
+                   const std::string & item)
+    {
+        AccountEntry & account = getAccountImpl(accountId);
+        Guard guard(account.lock);
+        account.changed = true;
+        return account.cancelBid(item);
     }
 
     void cancelBid(const AccountKey & accountKey,
                    const std::string & item)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).cancelBid(item);
+        cancelBid(AccountKeyId::intern(accountKey), item);
     }
     
     void forceWinBid(const AccountKey & accountKey,
                      Amount amountPaid,
                      const LineItems & lineItems)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).forceWinBid(amountPaid, lineItems);
+        AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
+        account.changed = true;
+        return account.forceWinBid(amountPaid, lineItems);
     }
 
     /// Commit a bid that has been detached from its tracking
@@ -1547,43 +1892,70 @@ struct ShadowAccounts {
                            Amount amountPaid,
                            const LineItems & lineItems)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey)
-            .commitDetachedBid(amountAuthorized, amountPaid, lineItems);
+        AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
+        account.changed = true;
+        return account.commitDetachedBid(amountAuthorized, amountPaid, lineItems);
     }
 
     /// Commit a specific currency (amountToCommit)
     void commitEvent(const AccountKey & accountKey, const Amount & amountToCommit)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).commitEvent(amountToCommit);
+        AccountEntry & account = getAccountImpl(accountKey);
+        Guard guard(account.lock);
+        account.changed = true;
+        return account.commitEvent(amountToCommit);
+    }
+
+    Amount detachBid(AccountKeyId accountId,
+                     const std::string & item)
+    {
+        AccountEntry & account = getAccountImpl(accountId);
+        Guard guard(account.lock);
+        account.changed = true;
+        return account.detachBid(item);
     }
 
     Amount detachBid(const AccountKey & accountKey,
                      const std::string & item)
     {
-        Guard guard(lock);
-        return getAccountImpl(accountKey).detachBid(item);
+        return detachBid(AccountKeyId::intern(accountKey), item);
+    }
+
+    void attachBid(AccountKeyId accountId,
+                   const std::string & item,
+                   Amount amountAuthorized)
+    {
+        AccountEntry & account = getAccountImpl(accountId);
+        Guard guard(account.lock);
+        account.changed = true;
+        account.attachBid(item, amountAuthorized);
     }
 
     void attachBid(const AccountKey & accountKey,
                    const std::string & item,
                    Amount amountAuthorized)
     {
-        Guard guard(lock);
-        getAccountImpl(accountKey).attachBid(item, amountAuthorized);
+        attachBid(AccountKeyId::intern(accountKey), item, amountAuthorized);
     }
 
     void logBidEvents(const Datacratic::EventRecorder & eventRecorder);
 
 private:
 
+    typedef ML::Spinlock Lock;
+    typedef std::unique_lock<Lock> Guard;
+
     struct AccountEntry : public ShadowAccount {
         AccountEntry(bool uninitialized = true, bool first = true)
-            : requested(Date::now()), uninitialized(uninitialized), first(first)
+            : requested(Date::now()), uninitialized(uninitialized), first(first),
+              outOfSync(false), changed(true)
         {
         }
 
+        /** Protects the account and the flags below. */
+        mutable Lock lock;
+
         /** This flag marks that the shadow account has been created, but
             it has never had its state read from the master banker.  In this
             case we will need to merge anything that was done to the current
@@ -1598,51 +1970,147 @@ private:
         Date requested;
         bool uninitialized;
         bool first;
+
+        /** The master banker reported this account as out of sync; no more
+            bids will be authorized against it.
+        */
+        bool outOfSync;
+
+        /** The spend side of the account changed since it was last handed
+            out by forEachChangedAccount().
+        */
+        bool changed;
     };
 
-    AccountEntry & getAccountImpl(const AccountKey & account,
+    typedef std::unordered_map<AccountKeyId, std::unique_ptr<AccountEntry> >
+        AccountMap;
+
+    std::shared_ptr<BudgetAvailability> availability;
+
+    /** Record whether the account has any budget left to bid with after its
+        budget changed.  Called with the account's lock held.
+    */
+    void updateAvailability(AccountKeyId id, const AccountEntry & account)
+    {
+        bool available = false;
+        if (!account.outOfSync) {
+            const CurrencyAmounts & amounts = account.balance.currencyAmounts;
+            for (unsigned i = 0;  i < CurrencyAmounts::NUM_SLOTS;  ++i)
+                available |= amounts.values[i] > 0;
+        }
+        availability->setAvailable(id, available);
+    }
+
+    enum { NumShards = 32 };
+
+    struct Shard {
+        mutable Lock lock;
+        AccountMap accounts;
+    } JML_ALIGNED(64);
+
+    Shard shards[NumShards];
+
+    Shard & getShard(AccountKeyId account)
+    {
+        return shards[account.hash() % NumShards];
+    }
+
+    const Shard & getShard(AccountKeyId account) const
+    {
+        return shards[account.hash() % NumShards];
+    }
+
+    AccountEntry & getAccountImpl(AccountKeyId account,
                                   bool callOnNewAccount = true)
     {
-        auto it = accounts.find(account);
-        if (it == accounts.end()) {
+        Shard & shard = getShard(account);
+        Guard guard(shard.lock);
+
+        auto it = shard.accounts.find(account);
+        if (it == shard.accounts.end()) {
             if (callOnNewAccount && onNewAccount)
-                onNewAccount(account);
-            it = accounts.insert(std::make_pair(account, AccountEntry()))
+                onNewAccount(account.key());
+            std::unique_ptr<AccountEntry> entry(new AccountEntry());
+            it = shard.accounts.insert(std::make_pair(account, std::move(entry)))
                 .first;
         }
-        return it->second;
+        return *it->second;
     }
 
-    const AccountEntry & getAccountImpl(const AccountKey & account) const
+    AccountEntry & getAccountImpl(const AccountKey & account,
+                                  bool callOnNewAccount = true)
     {
-        auto it = accounts.find(account);
-        if (it == accounts.end())
-            throw ML::Exception("getting unknown account " + account.toString());
-        return it->second;
+        return getAccountImpl(AccountKeyId::intern(account), callOnNewAccount);
     }
 
-    typedef ML::Spinlock Lock;
-    typedef std::unique_lock<Lock> Guard;
-    mutable Lock lock;
+    const AccountEntry & getAccountImpl(AccountKeyId account) const
+    {
+        const Shard & shard = getShard(account);
+        Guard guard(shard.lock);
 
-    typedef std::map<AccountKey, AccountEntry> AccountMap;
-    AccountMap accounts;
+        auto it = shard.accounts.find(account);
+        if (it == shard.accounts.end())
+            throw ML::Exception("getting unknown account " + account.toString());
+        return *it->second;
+    }
 
-    typedef std::unordered_set<AccountKey> AccountSet;
-    AccountSet outOfSyncAccounts;
+    const AccountEntry & getAccountImpl(const AccountKey & account) const
+    {
+        AccountKeyId id = AccountKeyId::find(account);
+        if (!id)
+            throw ML::Exception("getting unknown account " + account.toString());
+        return getAccountImpl(id);
+    }
+
+    /** Call onEntry for every account with that account's lock held. */
+    template<typename Fn>
+    void forEachEntry(const Fn & onEntry) const
+    {
+        for (auto & shard: shards) {
+            Guard guard1(shard.lock);
+            for (auto & a: shard.accounts) {
+                Guard guard2(a.second->lock);
+                onEntry(a.first.key(), *a.second);
+            }
+        }
+    }
 
 public:
     std::vector<AccountKey>
     getAccountKeys(const AccountKey & prefix = AccountKey()) const
     {
-        Guard guard(lock);
-
         std::vector<AccountKey> result;
 
-        for (auto it = accounts.lower_bound(prefix), end = accounts.end();
-             it != accounts.end() && it->first.hasPrefix(prefix);  ++it) {
-            result.push_back(it->first);
+        for (auto & shard: shards) {
+            Guard guard(shard.lock);
+            for (auto & a: shard.accounts) {
+                const AccountKey & key = a.first.key();
+                if (key.hasPrefix(prefix))
+                    result.push_back(key);
+            }
         }
+
+        // Callers expect the keys in order.
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    /** Estimate of the bytes held by the accounts and their maps, not
+        counting what the currency pools of each account allocate.  Takes
+        the shard locks in turn so it can be called from any thread.
+    */
+    size_t memoryUsage() const
+    {
+        size_t result = sizeof(*this);
+
+        for (auto & shard: shards) {
+            Guard guard(shard.lock);
+            result += shard.accounts.bucket_count() * sizeof(void *)
+                + shard.accounts.size()
+                * (sizeof(AccountMap::value_type) + sizeof(void *)
+                   + sizeof(AccountEntry));
+        }
+
         return result;
     }
 
@@ -1651,36 +2119,34 @@ public:
                                              const ShadowAccount &)> &
                    onAccount) const
     {
-        Guard guard(lock);
-        
-        for (auto & a: accounts) {
-            onAccount(a.first, a.second);
-        }
+        forEachEntry(onAccount);
     }
 
     void
     forEachInitializedAndActiveAccount(const std::function<void (const AccountKey &,
-                                                        const ShadowAccount &)> & onAccount)
+                                                        const ShadowAccount &)> & onAccount) const
     {
-        Guard guard(lock);
-        
-        for (auto & a: accounts) {
-            if (a.second.uninitialized || a.second.status == Account::CLOSED)
-                continue;
-            onAccount(a.first, a.second);
-        }
+        forEachEntry([&] (const AccountKey & key, const AccountEntry & a)
+                     {
+                         if (a.uninitialized || a.status == Account::CLOSED)
+                             return;
+                         onAccount(key, a);
+                     });
     }
 
     size_t size() const
     {
-        Guard guard(lock);
-        return accounts.size();
+        size_t result = 0;
+        for (auto & shard: shards) {
+            Guard guard(shard.lock);
+            result += shard.accounts.size();
+        }
+        return result;
     }
 
     bool empty() const
     {
-        Guard guard(lock);
-        return accounts.empty();
+        return size() == 0;
     }
 };
 
@@ -310,6 +310,24 @@ public:
         return commitBid(account, item, Amount(), LineItems());
     }
 
+    /** Versions of authorizeBid() and cancelBid() for callers that hold the
+        interned id of the account, which saves bankers that key their
+        accounts by id from hashing the key of every bid.  By default they
+        forward to the AccountKey versions.
+    */
+    virtual bool authorizeBid(AccountKeyId account,
+                              const std::string & item,
+                              Amount amount)
+    {
+        return authorizeBid(account.key(), item, amount);
+    }
+
+    virtual void cancelBid(AccountKeyId account,
+                           const std::string & item)
+    {
+        return cancelBid(account.key(), item);
+    }
+
     virtual void winBid(const AccountKey & account,
                         const std::string & item,
                         Amount amountPaid,
@@ -349,6 +367,16 @@ public:
     /** Synchronize all state with underlying storage. */
     virtual void sync() {}
 
+    /** Table of which accounts have budget left, for callers that want to
+        skip exhausted accounts before they even try to authorize a bid.
+        Bankers that don't track it return null, in which case every account
+        should be assumed to have budget.
+    */
+    virtual std::shared_ptr<const BudgetAvailability> budgetAvailability() const
+    {
+        return nullptr;
+    }
+
 
     /*************************************************************************/
     /* LOGGING                                                               */
@@ -5,7 +5,9 @@ LIBBANKER_SOURCES := \
 	banker.cc \
 	null_banker.cc \
 	slave_banker.cc \
+	sharded_banker.cc \
 	master_banker.cc \
+	shadow_sync.cc \
 	application_layer.cc
 
 LIBBANKER_LINK := \
@@ -15,7 +17,7 @@ $(eval $(call library,banker,$(LIBBANKER_SOURCES),$(LIBBANKER_LINK)))
 
 $(eval $(call program,banker_service_runner,banker boost_program_options))
 
-$(eval $(call library,gobanker,go_account.cc local_banker.cc))
+$(eval $(call library,gobanker,go_account.cc local_banker.cc,types gc))
 
 $(eval $(call python_program,banker_backup,banker_backup.py))
 $(eval $(call python_program,banker_restore,banker_restore.py))
@@ -48,6 +48,9 @@ int main(int argc, char ** argv)
 
     bool debug = false;
 
+    int shard = 0;
+    int numShards = 1;
+
     std::vector<std::string> fixedHttpBindAddresses;
 
     configuration_options.add_options()
@@ -64,7 +67,11 @@ int main(int argc, char ** argv)
         ("fixed-http-bind-address,a", value(&fixedHttpBindAddresses),
          "Fixed address (host:port or *:port) at which we will always listen")
         ("debug", bool_switch(&debug),
-         "Debug mode enabled");
+         "Debug mode enabled")
+        ("shard", value<int>(&shard),
+         "Index of this banker among the banker shards")
+        ("num-shards", value<int>(&numShards),
+         "Number of banker shards that the top-level accounts are spread over");
 
     options_description all_opt;
     all_opt
@@ -95,6 +102,8 @@ int main(int argc, char ** argv)
     if (debug)
         banker.debug.activate();
 
+    banker.setShard(shard, numShards);
+
     if (redisUri != "nopersistence") {
         std::cout << " redisUri=" << redisUri << std::endl;
         auto address = Redis::Address(redisUri);
@@ -7,6 +7,8 @@
 
 #include "go_account.h"
 
+#include <algorithm>
+
 using namespace std;
 
 namespace RTBKIT {
@@ -74,59 +76,94 @@ GoAccount::toJson()
     return account;
 }
 
+void
+GoAccount::printJson(Datacratic::JsonPrintingContext &context)
+{
+    context.startObject();
+    switch (type) {
+    case ROUTER:
+        context.startMember("type");
+        context.writeString("Router");
+        router->printJson(context);
+        break;
+    case POST_AUCTION:
+        context.startMember("type");
+        context.writeString("PostAuction");
+        pal->printJson(context);
+        break;
+    };
+    context.endObject();
+}
+
 // Router Account
 
+namespace {
+
+/** Value of an amount that has to be in micro USD, or that is zero. */
+int64_t microUSD(const Amount & amount)
+{
+    MicroUSD(0).assertCurrencyIsCompatible(amount);
+    return amount.value;
+}
+
+} // file scope
+
 GoRouterAccount::GoRouterAccount(const AccountKey &key)
-    : GoBaseAccount(key)
+    : GoBaseAccount(key),
+      balance(0), maxBalance(0), previousBalance(0), bidsLastPeriod(0)
 {
     rate = MicroUSD(0);
-    balance = MicroUSD(0);
 }
 
 GoRouterAccount::GoRouterAccount(Json::Value &json)
-    : GoBaseAccount(json)
+    : GoBaseAccount(json),
+      balance(0), maxBalance(0), previousBalance(0), bidsLastPeriod(0)
 {
     if (json.isMember("rate")) rate = MicroUSD(json["rate"].asInt());
     else rate = MicroUSD(0);
 
-    if (json.isMember("balance")) balance = MicroUSD(json["balance"].asInt());
-    else balance = MicroUSD(0);
+    if (json.isMember("balance")) balance = json["balance"].asInt();
 }
 
 void
 GoRouterAccount::setMaxBalance(const Amount & newMaxBalance)
 {
-    maxBalance = newMaxBalance;
+    maxBalance = microUSD(newMaxBalance);
 }
 
 Amount
 GoRouterAccount::updateBalance(const Amount & newBalance)
 {
-    Amount spent = previousBalance - balance;
-    balance = newBalance;
-    previousBalance = newBalance;
-    return spent;
+    int64_t value = microUSD(newBalance);
+    int64_t oldBalance = balance.exchange(value);
+    int64_t oldPrevious = previousBalance.exchange(value);
+    return MicroUSD(oldPrevious - oldBalance);
 }
 
 Amount
 GoRouterAccount::accumulateBalance(const Amount & newBalance)
 {
-    Amount spent = previousBalance - balance;
-    balance += newBalance;
-    if (balance > maxBalance) {
-        balance = maxBalance;
-    }
-    previousBalance = balance;
-    return spent;
+    int64_t value = microUSD(newBalance);
+    int64_t oldBalance = balance.load();
+    int64_t accumulated;
+    do {
+        accumulated = std::min(oldBalance + value, maxBalance.load());
+    } while (!balance.compare_exchange_weak(oldBalance, accumulated));
+
+    int64_t oldPrevious = previousBalance.exchange(accumulated);
+    return MicroUSD(oldPrevious - oldBalance);
 }
 
 bool
 GoRouterAccount::bid(Amount bidPrice)
 {
-    ++bidsLastPeriod;
-    if (balance >= bidPrice) {
-        balance -= bidPrice;
-        return true;
+    bidsLastPeriod.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t price = microUSD(bidPrice);
+    int64_t current = balance.load(std::memory_order_relaxed);
+    while (current >= price) {
+        if (balance.compare_exchange_weak(current, current - price))
+            return true;
     }
     return false;
 }
@@ -135,33 +172,38 @@ void
 GoRouterAccount::toJson(Json::Value &account)
 {
     account["rate"] = rate.value;
-    account["balance"] = balance.value;
+    account["balance"] = int64_t(balance);
     GoBaseAccount::toJson(account);
 }
 
+void
+GoRouterAccount::printJson(Datacratic::JsonPrintingContext &context)
+{
+    context.startMember("rate");
+    context.writeLongLong(rate.value);
+    context.startMember("balance");
+    context.writeLongLong(balance);
+    GoBaseAccount::printJson(context);
+}
+
 // Post Auction Account
 GoPostAuctionAccount::GoPostAuctionAccount(const AccountKey &key)
-    : GoBaseAccount(key)
+    : GoBaseAccount(key), imp(0), spend(0)
 {
-    imp = 0;
-    spend = MicroUSD(0);
 }
 
 GoPostAuctionAccount::GoPostAuctionAccount(Json::Value &json)
-    : GoBaseAccount(json)
+    : GoBaseAccount(json), imp(0), spend(0)
 {
     if (json.isMember("imp")) imp = json["imp"].asInt();
-    else imp = 0;
-
-    if (json.isMember("spend")) spend = MicroUSD(json["spend"].asInt());
-    else spend = MicroUSD(0);
+    if (json.isMember("spend")) spend = json["spend"].asInt();
 }
 
 bool
 GoPostAuctionAccount::win(Amount winPrice)
 {
-    spend += winPrice;
-    imp += 1;
+    spend.fetch_add(microUSD(winPrice), std::memory_order_relaxed);
+    imp.fetch_add(1, std::memory_order_relaxed);
     return true;
 }
 
@@ -169,10 +211,20 @@ void
 GoPostAuctionAccount::toJson(Json::Value &account)
 {
     account["imp"] = int64_t(imp);
-    account["spend"] = spend.value;
+    account["spend"] = int64_t(spend);
     GoBaseAccount::toJson(account);
 }
 
+void
+GoPostAuctionAccount::printJson(Datacratic::JsonPrintingContext &context)
+{
+    context.startMember("imp");
+    context.writeLongLong(imp);
+    context.startMember("spend");
+    context.writeLongLong(spend);
+    GoBaseAccount::printJson(context);
+}
+
 //Account Base
 
 GoBaseAccount::GoBaseAccount(const AccountKey &key)
@@ -196,27 +248,62 @@ GoBaseAccount::toJson(Json::Value &account)
     account["parent"] = parent;
 }
 
+void
+GoBaseAccount::printJson(Datacratic::JsonPrintingContext &context)
+{
+    context.startMember("name");
+    context.writeString(name);
+    context.startMember("parent");
+    context.writeString(parent);
+}
+
 // Accounts
 
-GoAccounts::GoAccounts() : accounts{}
+GoAccounts::GoAccounts()
+    : accounts(gcLock)
+{
+}
+
+void
+GoAccounts::update(const std::function<void (AccountMap &)> & fn)
+{
+    std::unique_ptr<AccountMap> newAccounts(new AccountMap(*accounts()));
+    fn(*newAccounts);
+    accounts.replace(newAccounts.release());
+}
+
+size_t
+GoAccounts::size() const
+{
+    return accounts()->size();
+}
+
+void
+GoAccounts::forEach(const std::function<void (const AccountKey &, GoAccount &)>
+                    & onAccount) const
 {
+    auto current = accounts();
+    for (auto & it : *current)
+        onAccount(it.first, *it.second);
 }
 
 void
 GoAccounts::setMaxBalance(const AccountKey &key, const Amount & maxBalance)
 {
-    if (!exists(key)) return;
-    std::lock_guard<std::mutex> guard(this->mutex);
-    auto account = get(key);
-    account->router->setMaxBalance(maxBalance);
+    auto current = accounts();
+    auto it = current->find(key);
+    if (it == current->end()) return;
+    it->second->router->setMaxBalance(maxBalance);
 }
 
 void
 GoAccounts::add(const AccountKey &key, GoAccountType type)
 {
     if (exists(key)) return;
-    std::lock_guard<std::mutex> guard(this->mutex);
-    accounts.insert( pair<AccountKey, GoAccount>(key, GoAccount(key, type)) );
+    std::lock_guard<std::mutex> guard(this->writeMutex);
+    update([&] (AccountMap & newAccounts) {
+            newAccounts.insert(make_pair(key, make_shared<GoAccount>(key, type)));
+        });
 }
 
 bool
@@ -235,10 +322,11 @@ GoAccounts::addFromJsonString(std::string jsonAccount)
         const AccountKey key(name);
         if (exists(key)) return true;
 
-        std::lock_guard<std::mutex> guard(this->mutex);
-        GoAccount account(json);
-        accounts.insert( pair<AccountKey, GoAccount>(key, account) );
-        //cout << "account in map: " << accounts[key].toJson() << endl;
+        auto account = make_shared<GoAccount>(json);
+        std::lock_guard<std::mutex> guard(this->writeMutex);
+        update([&] (AccountMap & newAccounts) {
+                newAccounts.insert(make_pair(key, account));
+            });
         return true;
     } else {
         cout << "error: type or name not parsed" << endl;
@@ -261,13 +349,20 @@ GoAccounts::replaceFromJsonString(std::string jsonAccount)
         string name = json["name"].asString();
         const AccountKey key(name);
 
-        std::lock_guard<std::mutex> guard(this->mutex);
-        GoAccount account(json);
-        if (account.type == POST_AUCTION &&
-                (account.pal->imp > accounts[key].pal->imp ||
-                account.pal->spend > accounts[key].pal->spend)) {
-            accounts[key] = account;
-        }
+        auto account = make_shared<GoAccount>(json);
+        if (account->type != POST_AUCTION) return true;
+
+        // Wins recorded on the old account between the copy of the map and
+        // its publication are lost, as they would be if they had arrived
+        // just before the go banker answered.
+        std::lock_guard<std::mutex> guard(this->writeMutex);
+        update([&] (AccountMap & newAccounts) {
+                auto & current = newAccounts[key];
+                if (!current || !current->pal
+                    || account->pal->imp > current->pal->imp
+                    || account->pal->spend > current->pal->spend)
+                    current = account;
+            });
         return true;
     } else {
         cout << "error: type or name not parsed" << endl;
@@ -278,79 +373,69 @@ GoAccounts::replaceFromJsonString(std::string jsonAccount)
 Amount
 GoAccounts::updateBalance(const AccountKey &key, const Amount & newBalance)
 {
-    if (!exists(key)) return MicroUSD(0);
-    std::lock_guard<std::mutex> guard(this->mutex);
-    auto account = get(key);
-    return account->router->updateBalance(newBalance);
+    auto current = accounts();
+    auto it = current->find(key);
+    if (it == current->end()) return MicroUSD(0);
+    return it->second->router->updateBalance(newBalance);
 }
 
 Amount
 GoAccounts::accumulateBalance(const AccountKey &key, const Amount & newBalance)
 {
-    if (!exists(key)) return MicroUSD(0);
-    std::lock_guard<std::mutex> guard(this->mutex);
-    auto account = get(key);
-    return account->router->accumulateBalance(newBalance);
+    auto current = accounts();
+    auto it = current->find(key);
+    if (it == current->end()) return MicroUSD(0);
+    return it->second->router->accumulateBalance(newBalance);
 }
 
 Amount
 GoAccounts::getBalance(const AccountKey &key)
 {
-    if (!exists(key)) return MicroUSD(0);
-    std::lock_guard<std::mutex> guard(this->mutex);
-    auto account = get(key);
-    return account->router->balance;
+    auto current = accounts();
+    auto it = current->find(key);
+    if (it == current->end()) return MicroUSD(0);
+    return it->second->router->getBalance();
 }
 
 bool
 GoAccounts::bid(const AccountKey &key, Amount bidPrice)
 {
-    if (!exists(key)) return false;
+    auto current = accounts();
+    auto it = current->find(key);
+    if (it == current->end()) return false;
 
-    std::lock_guard<std::mutex> guard(this->mutex);
-    auto account = get(key);
-    if (account->type != ROUTER) {
+    GoAccount & account = *it->second;
+    if (account.type != ROUTER) {
         throw ML::Exception("GoAccounts::bid: attempt bid on non ROUTER account");
     }
 
-    return account->bid(bidPrice);
+    return account.bid(bidPrice);
 }
 
 bool
 GoAccounts::win(const AccountKey &key, Amount winPrice)
 {
-    if (!exists(key)) {
+    auto current = accounts();
+    auto it = current->find(key);
+    if (it == current->end()) {
         cout << "account not found, unaccounted win: " << key.toString()
              << " " << winPrice.toString() << endl;
         return false;
     }
 
-    std::lock_guard<std::mutex> guard(this->mutex);
-    auto account = get(key);
-    if (account->type != POST_AUCTION) {
+    GoAccount & account = *it->second;
+    if (account.type != POST_AUCTION) {
         throw ML::Exception("GoAccounts::win: attempt win on non POST_AUCTION account");
     }
 
-    return account->win(winPrice);
+    return account.win(winPrice);
 }
 
 bool
 GoAccounts::exists(const AccountKey &key)
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    bool exists = accounts.find(key) != accounts.end();
-    return exists;
-}
-
-GoAccount*
-GoAccounts::get(const AccountKey &key)
-{
-    auto account = accounts.find(key);
-    if (account == accounts.end()) {
-        throw ML::Exception("GoAccounts::get: account '" + key.toString() + "' not found");
-    } else {
-        return &account->second;
-    }
+    auto current = accounts();
+    return current->find(key) != current->end();
 }
 
 } // namspace RTBKIT
@@ -9,10 +9,15 @@
 
 #include <string>
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
+#include "soa/gc/gc_lock.h"
+#include "soa/gc/rcu_protected.h"
 #include "soa/jsoncpp/json.h"
+#include "soa/types/json_printing.h"
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/account_key.h"
 
@@ -25,34 +30,41 @@ struct GoBaseAccount {
     GoBaseAccount(const AccountKey &key);
     GoBaseAccount(Json::Value &jsonAccount);
     virtual void toJson(Json::Value &account);
+    virtual void printJson(Datacratic::JsonPrintingContext &context);
 };
 
+/** The balances are kept in micro USD in atomics so that bids can be taken
+    out of them without any lock.
+*/
 struct GoRouterAccount : public GoBaseAccount {
     Amount rate;
-    Amount balance;
-    Amount maxBalance;
-    Amount previousBalance;
-    int bidsLastPeriod;
+    std::atomic<int64_t> balance;
+    std::atomic<int64_t> maxBalance;
+    std::atomic<int64_t> previousBalance;
+    std::atomic<int> bidsLastPeriod;
 
     GoRouterAccount(const AccountKey &key);
     GoRouterAccount(Json::Value &json);
     void setMaxBalance(const Amount & newMaxBalance);
     Amount updateBalance(const Amount & newBalance);
     Amount accumulateBalance(const Amount & newBalance);
+    Amount getBalance() const { return MicroUSD(balance.load()); }
     bool bid(Amount bidPrice);
     bool win(Amount winPrice) { return false; }
     void toJson(Json::Value &account);
+    void printJson(Datacratic::JsonPrintingContext &context);
 };
 
 struct GoPostAuctionAccount : public GoBaseAccount {
     std::atomic<int64_t> imp;
-    Amount spend;
+    std::atomic<int64_t> spend;  // micro USD
 
     GoPostAuctionAccount(const AccountKey &key);
     GoPostAuctionAccount(Json::Value &jsonAccount);
     bool bid(Amount bidPrice) { return false; }
     bool win(Amount winPrice);
     void toJson(Json::Value &account);
+    void printJson(Datacratic::JsonPrintingContext &context);
 };
 
 enum GoAccountType {
@@ -71,11 +83,21 @@ struct GoAccount {
     bool bid(Amount bidPrice);
     bool win(Amount winPrice);
     Json::Value toJson();
+
+    /** Same as toJson() but written straight to the context, without going
+        through a Json::Value. */
+    void printJson(Datacratic::JsonPrintingContext &context);
 };
 
+/** The accounts are looked up in an RCU protected map, so the bid and win
+    paths never take a lock.  The map is copied and republished only when an
+    account is added or replaced, which is rare; an account is shared by the
+    successive copies of the map so the bids and wins taken out of it carry
+    over from one copy to the next.
+*/
 struct GoAccounts {
-    std::mutex mutex;
-    std::unordered_map<AccountKey, GoAccount> accounts;
+    typedef std::unordered_map<AccountKey, std::shared_ptr<GoAccount> >
+        AccountMap;
 
     GoAccounts();
     void setMaxBalance(const AccountKey &key, const Amount & maxBalance);
@@ -90,9 +112,24 @@ struct GoAccounts {
     bool win(const AccountKey &key, Amount winPrice);
     Json::Value toJson();
 
+    /** Number of accounts in the current version of the map. */
+    size_t size() const;
+
+    /** Call onAccount for every account of the current version of the map.
+        Accounts added meanwhile may or may not be seen. */
+    void forEach(const std::function<void (const AccountKey &, GoAccount &)>
+                 & onAccount) const;
+
 private:
     Amount MaxBalance;
-    GoAccount* get(const AccountKey&);
+
+    std::mutex writeMutex;  ///< Serializes the copies of the map
+    Datacratic::GcLock gcLock;
+    Datacratic::RcuProtected<AccountMap> accounts;
+
+    /** Copy the map, apply fn to the copy and publish it.  Must be called
+        with writeMutex held. */
+    void update(const std::function<void (AccountMap &)> & fn);
 };
 
 } // namespace RTBKIT
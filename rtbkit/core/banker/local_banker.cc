@@ -6,15 +6,41 @@
 */
 
 #include <algorithm>
+#include <cmath>
 #include "local_banker.h"
 #include "soa/service/http_header.h"
 #include "soa/types/date.h"
+#include "soa/types/json_parsing.h"
+#include <sstream>
 
 using namespace std;
 using namespace Datacratic;
 
 namespace RTBKIT {
 
+namespace {
+
+/* Adaptive spend rate tuning; see LocalBanker::setAdaptiveSpendRate(). */
+
+/// Weight of the last period in the smoothed spend of an account
+constexpr double SpendSmoothing = 0.3;
+
+/// How much more than its expected spend an account is given
+constexpr double SpendHeadroom = 1.5;
+
+/// An account with less than this fraction of its rate left at
+/// reauthorization is considered to have run dry
+constexpr double DrainedFraction = 0.05;
+
+/// Relative change of rate below which the go banker isn't updated
+constexpr double RateChangeThreshold = 0.25;
+
+/// Maximum number of accounts in one spendupdate or reauthorize request;
+/// larger syncs are split and the requests sent in parallel
+constexpr size_t BulkChunkSize = 1000;
+
+} // file scope
+
 LocalBanker::LocalBanker(shared_ptr<ServiceProxies> services, GoAccountType type,
         const string & accountSuffix)
         : ServiceBase(accountSuffix + ".localBanker", services),
@@ -30,7 +56,8 @@ LocalBanker::LocalBanker(shared_ptr<ServiceProxies> services, GoAccountType type
           reauthorizeSkipped(0),
           spendUpdateInProgress(false),
           spendUpdateSkipped(0),
-          debug(false)
+          debug(false),
+          adaptive(false)
 {
     replace(accountSuffixNoDot.begin(), accountSuffixNoDot.end(), '.', '_');
 }
@@ -45,6 +72,13 @@ LocalBanker::init(const string & bankerUrl,
     httpClient->sendExpect100Continue(false);
     addSource("LocalBanker:HttpClient", httpClient);
 
+    spendUpdateHead = httpClient->prepareRequest("POST", "/spendupdate", {}, {},
+                                                 "application/json");
+    reauthorizeHead = httpClient->prepareRequest("POST", "/reauthorize/1", {}, {},
+                                                 "application/json");
+    bidCountsHead = httpClient->prepareRequest("POST", "/bidCounts", {}, {},
+                                               "application/json");
+
     lastSync = lastReauth = Date::now();
 
     auto reauthorizePeriodic = [&] (uint64_t wakeups) {
@@ -61,7 +95,7 @@ LocalBanker::init(const string & bankerUrl,
         {
             std::lock_guard<std::mutex> guard(this->mutex);
             swap(uninitializedAccounts, tempUninitialized);
-            this->recordLevel(accounts.accounts.size(), "accounts");
+            this->recordLevel(accounts.size(), "accounts");
         }
         for (auto &key : tempUninitialized) {
             addAccountImpl(key);
@@ -85,6 +119,15 @@ LocalBanker::setSpendRate(Amount newSpendRate)
     spendRate = newSpendRate;
 }
 
+void
+LocalBanker::setAdaptiveSpendRate(Amount minRate, Amount maxRate)
+{
+    ExcAssert(minRate <= maxRate);
+    adaptive = true;
+    minSpendRate = minRate;
+    maxSpendRate = maxRate;
+}
+
 void
 LocalBanker::setDebug(bool debugSetting)
 {
@@ -239,13 +282,22 @@ LocalBanker::spendUpdate()
     const Date sentTime = Date::now();
     this->recordHit("spendUpdate.attempt");
 
-    auto onResponse = [&, sentTime] (const HttpRequest &req,
+    vector<string> payloads
+        = bulkPayloads([] (const AccountKey & key, GoAccount & account,
+                           JsonPrintingContext & context)
+                       {
+                           account.printJson(context);
+                       });
+    auto pending = make_shared<std::atomic<int> >(payloads.size());
+
+    auto onResponse = [&, sentTime, pending] (const HttpRequest &req,
             HttpClientError error,
             int status,
             string && headers,
             string && body)
     {
-        spendUpdateInProgress = false;
+        if (--*pending == 0)
+            spendUpdateInProgress = false;
         const Date recieveTime = Date::now();
         double latencyMs = recieveTime.secondsSince(sentTime) * 1000;
         this->recordLevel(latencyMs, "spendUpdateLatencyMs");
@@ -257,18 +309,23 @@ LocalBanker::spendUpdate()
                  << "body:   " << body << endl;
             this->recordHit("spendUpdate.failure");
         } else {
-            Json::Value result;
+            vector<pair<string, string> > results;
             try {
-                result = Json::parse(body);
+                StreamingJsonParsingContext context(
+                        "spendUpdate", body.c_str(), body.c_str() + body.size());
+                context.forEachMember([&] () {
+                        results.emplace_back(context.fieldName(),
+                                             context.expectStringAscii());
+                    });
             } catch (const std::exception & exc) {
                 cout << "spendUpdate response json parsing error:\n"
                     << body << "\n" << exc.what() << endl;
                 this->recordHit("spendUpdate.jsonParsingError");
                 return;
             }
-            for ( auto it = result.begin(); it != result.end(); it++) {
-                string key = it.key().asString();
-                string value = (*it).asString();
+            for (const auto & result : results) {
+                const string & key = result.first;
+                const string & value = result.second;
                 if (value != "no need" && value != "success") {
                     cout << key << ": " << value << endl;
                     cout << "will reload from redis" << key << endl;
@@ -283,14 +340,11 @@ LocalBanker::spendUpdate()
         }
     };
     auto const &cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::arrayValue);
-    {
-        std::lock_guard<std::mutex> guard(this->mutex);
-        for (auto it : accounts.accounts) {
-            payload.append(it.second.toJson());
-        }
+    Date deadline = sentTime.plusSeconds(1.0);
+    for (auto & payload : payloads) {
+        httpClient->enqueueRequest(spendUpdateHead, cbs, std::move(payload),
+                                   deadline);
     }
-    httpClient->post("/spendupdate", cbs, payload, {}, {}, 1);
 }
 
 void
@@ -310,13 +364,22 @@ LocalBanker::reauthorize()
     const Date sentTime = Date::now();
     this->recordHit("reauthorize.attempt");
 
-    auto onResponse = [&, sentTime] (const HttpRequest &req,
+    vector<string> payloads
+        = bulkPayloads([] (const AccountKey & key, GoAccount & account,
+                           JsonPrintingContext & context)
+                       {
+                           context.writeString(key.toString());
+                       });
+    auto pending = make_shared<std::atomic<int> >(payloads.size());
+
+    auto onResponse = [&, sentTime, pending] (const HttpRequest &req,
             HttpClientError error,
             int status,
             string && headers,
             string && body)
     {
-        reauthorizeInProgress = false;
+        if (--*pending == 0)
+            reauthorizeInProgress = false;
         const Date recieveTime = Date::now();
         double latencyMs = recieveTime.secondsSince(sentTime) * 1000;
         this->recordLevel(latencyMs, "reauthorizeLatencyMs");
@@ -326,45 +389,46 @@ LocalBanker::reauthorize()
                  << "status: " << status << endl
                  << "error:  " << error << endl
                  << "body:   " << body << endl
-                 << "url:    " << req.url_ << endl;
+                 << "url:    " << req.url() << endl;
             this->recordHit("reauthorize.failure");
         } else {
-            Json::Value jsonAccounts;
+            struct Reauthorized {
+                string name;
+                int64_t balance = 0;
+                int64_t maxBalance = 0;
+                int64_t rate = 0;
+            };
+            vector<Reauthorized> results;
             try {
-                jsonAccounts = Json::parse(body);
+                StreamingJsonParsingContext context(
+                        "reauthorize", body.c_str(), body.c_str() + body.size());
+                context.forEachElement([&] () {
+                        Reauthorized result;
+                        context.forEachMember([&] () {
+                                string field = context.fieldName();
+                                if (field == "name")
+                                    result.name = context.expectStringAscii();
+                                else if (field == "balance")
+                                    result.balance = context.expectLongLong();
+                                else if (field == "maxBalance")
+                                    result.maxBalance = context.expectLongLong();
+                                else if (field == "rate")
+                                    result.rate = context.expectLongLong();
+                                else context.skip();
+                            });
+                        results.push_back(std::move(result));
+                    });
             } catch (const std::exception & exc) {
                 cout << "reauthorize response json parsing error:\n"
                     << body << "\n" << exc.what() << endl;
                 this->recordHit("reautorize.jsonParsingError");
                 return;
             }
-            for ( auto jsonAccount : jsonAccounts ) {
-                auto key = AccountKey(jsonAccount["name"].asString());
-                Amount newBalance(MicroUSD(jsonAccount["balance"].asInt()));
-                Amount maxBalance(MicroUSD(jsonAccount["maxBalance"].asInt()));
-
-                string gKey = "account." + key.parent().toString() + ":" + accountSuffixNoDot; 
-                if (debug) {
-                    recordLevel(accounts.getBalance(key.toString()).value,
-                            gKey + ".oldBalance");
-                }
-                if (maxBalance > spendRate) {
-                    maxBalance = spendRate;
-                }
-                accounts.setMaxBalance(key, maxBalance);
-
-                int64_t spend = accounts.accumulateBalance(key, newBalance).value;
-                recordLevel(spend, gKey + ".bidAmountLastPeriod");
-
-                if (debug) {
-                    recordLevel(accounts.getBalance(key.toString()).value,
-                            gKey + ".newBalance");
-                }
-
-                int64_t rate = jsonAccount["rate"].asInt();
-                if (rate > spendRate.value) {
-                    setRate(key);
-                }
+            for (const auto & result : results) {
+                onReauthorized(AccountKey(result.name),
+                               MicroUSD(result.balance),
+                               MicroUSD(result.maxBalance),
+                               result.rate);
             }
             {
                 std::lock_guard<std::mutex> guard(this->syncMtx);
@@ -375,14 +439,107 @@ LocalBanker::reauthorize()
     };
 
     auto const &cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::arrayValue);
-    {
-        std::lock_guard<std::mutex> guard(this->mutex);
-        for (auto it : accounts.accounts) {
-            payload.append(it.first.toString());
+    Date deadline = sentTime.plusSeconds(1.0);
+    for (auto & payload : payloads) {
+        httpClient->enqueueRequest(reauthorizeHead, cbs, std::move(payload),
+                                   deadline);
+    }
+}
+
+void
+LocalBanker::onReauthorized(const AccountKey &key, Amount newBalance,
+                            Amount maxBalance, int64_t rate)
+{
+    string gKey = "account." + key.parent().toString() + ":" + accountSuffixNoDot; 
+    if (debug) {
+        recordLevel(accounts.getBalance(key.toString()).value,
+                gKey + ".oldBalance");
+    }
+
+    if (!adaptive) {
+        if (maxBalance > spendRate) {
+            maxBalance = spendRate;
+        }
+        accounts.setMaxBalance(key, maxBalance);
+
+        int64_t spend = accounts.accumulateBalance(key, newBalance).value;
+        recordLevel(spend, gKey + ".bidAmountLastPeriod");
+
+        if (rate > spendRate.value) {
+            setRate(key, spendRate);
         }
     }
-    httpClient->post("/reauthorize/1", cbs, payload, {}, {}, 1.0);
+    else {
+        // The float is bounded by what we expect the account to
+        // spend until the next reauthorization.
+        auto it = spendEstimates.find(key);
+        Amount target = it == spendEstimates.end()
+            ? spendRate : it->second.rate;
+        if (maxBalance > target) {
+            maxBalance = target;
+        }
+        Amount leftOver = accounts.getBalance(key);
+        accounts.setMaxBalance(key, maxBalance);
+
+        Amount spend = accounts.accumulateBalance(key, newBalance);
+        recordLevel(spend.value, gKey + ".bidAmountLastPeriod");
+
+        bool drained = leftOver < target * DrainedFraction;
+        target = adaptiveRate(key, spend, drained);
+
+        // Only tell the go banker when the rate moved enough, to
+        // keep the number of setRate calls down.
+        double change = std::abs(double(target.value - rate))
+            / std::max<int64_t>(rate, 1);
+        if (change > RateChangeThreshold) {
+            setRate(key, target);
+        }
+    }
+
+    if (debug) {
+        recordLevel(accounts.getBalance(key.toString()).value,
+                gKey + ".newBalance");
+    }
+}
+
+vector<string>
+LocalBanker::bulkPayloads(const std::function<void (const AccountKey &,
+                                                    GoAccount &,
+                                                    JsonPrintingContext &)>
+                          & printAccount)
+{
+    vector<string> result;
+    ostringstream stream;
+    unique_ptr<StreamJsonPrintingContext> context;
+    size_t inChunk = 0;
+
+    auto finishChunk = [&] () {
+        context->endArray();
+        context.reset();
+        result.push_back(stream.str());
+        stream.str("");
+        inChunk = 0;
+    };
+
+    accounts.forEach([&] (const AccountKey & key, GoAccount & account) {
+            if (!context) {
+                context.reset(new StreamJsonPrintingContext(stream));
+                context->startArray();
+            }
+            context->newArrayElement();
+            printAccount(key, account, *context);
+            if (++inChunk == BulkChunkSize)
+                finishChunk();
+        });
+    if (context)
+        finishChunk();
+
+    // The go banker is still told when there's nothing to do, so that the
+    // sync is seen to be alive.
+    if (result.empty())
+        result.push_back("[]");
+
+    return result;
 }
 
 void
@@ -418,7 +575,7 @@ LocalBanker::sendBidCounts()
                  << "status: " << status << endl
                  << "error:  " << error << endl
                  << "body:   " << body << endl
-                 << "url:    " << req.url_ << endl;
+                 << "url:    " << req.url() << endl;
             this->recordHit("bidCounts.failure");
         } else {
             this->recordHit("bidCounts.success");
@@ -426,19 +583,52 @@ LocalBanker::sendBidCounts()
     };
 
     auto const &cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::objectValue);
+    ostringstream payload;
     {
-        std::lock_guard<std::mutex> guard(this->mutex);
-        for (auto it : accounts.accounts) {
-            payload[it.first.toString()] = it.second.router->bidsLastPeriod;
-            it.second.router->bidsLastPeriod = 0;
-        }
+        StreamJsonPrintingContext context(payload);
+        context.startObject();
+        accounts.forEach([&] (const AccountKey & key, GoAccount & account) {
+                context.startMember(key.toString());
+                context.writeInt(account.router->bidsLastPeriod.exchange(0));
+            });
+        context.endObject();
+    }
+    httpClient->enqueueRequest(bidCountsHead, cbs, payload.str(),
+                               sentTime.plusSeconds(1.0));
+}
+
+Amount
+LocalBanker::adaptiveRate(const AccountKey &key, Amount spent, bool drained)
+{
+    SpendEstimate & estimate = spendEstimates[key];
+
+    if (estimate.perPeriod < 0)
+        estimate.perPeriod = spent.value;
+    else estimate.perPeriod = SpendSmoothing * spent.value
+             + (1.0 - SpendSmoothing) * estimate.perPeriod;
+
+    Amount target = MicroUSD(estimate.perPeriod * SpendHeadroom);
+
+    // An account that ran out of money spent less than it wanted to, so its
+    // history underestimates it; grow geometrically until it stops running
+    // dry.
+    if (drained) {
+        Amount current = estimate.rate.isZero() ? spendRate : estimate.rate;
+        if (target < current * 2.0)
+            target = current * 2.0;
     }
-    httpClient->post("/bidCounts", cbs, payload, {}, {}, 1.0);
+
+    if (target < minSpendRate)
+        target = minSpendRate;
+    if (maxSpendRate < target)
+        target = maxSpendRate;
+
+    estimate.rate = target;
+    return target;
 }
 
 void
-LocalBanker::setRate(const AccountKey &key)
+LocalBanker::setRate(const AccountKey &key, Amount rate)
 {
     const Date sentTime = Date::now();
     this->recordHit("setRate.attempt");
@@ -465,7 +655,7 @@ LocalBanker::setRate(const AccountKey &key)
     };
     auto const &cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
     Json::Value payload(Json::objectValue);
-    payload["USD/1M"] = spendRate.value;
+    payload["USD/1M"] = rate.value;
     httpClient->post("/accounts/" + key.toString() + "/rate", cbs, payload, {}, {}, 1.0);
 }
 
@@ -33,6 +33,14 @@ struct LocalBanker : public Banker, Datacratic::MessageLoop, Datacratic::Service
     void setSpendRate(Amount spendRate);
     void setDebug(bool debugSetting);
 
+    /** Instead of giving every account the same spendRate, estimate how
+        much each account spends per reauthorization from its recent
+        history and ask the go banker for that much (plus some headroom),
+        within [minRate, maxRate].  The account's float is bounded by the
+        same amount.  spendRate is used until an account has some history.
+    */
+    void setAdaptiveSpendRate(Amount minRate, Amount maxRate);
+
     void start();
     void shutdown();
 
@@ -107,7 +115,7 @@ struct LocalBanker : public Banker, Datacratic::MessageLoop, Datacratic::Service
 private:
     void addAccount(const AccountKey &account);
 
-    void setRate(const AccountKey &key);
+    void setRate(const AccountKey &key, Amount rate);
 
     void spendUpdate();
 
@@ -123,6 +131,9 @@ private:
     std::string accountSuffix;
     std::string accountSuffixNoDot;
     std::shared_ptr<Datacratic::HttpClient> httpClient;
+    std::shared_ptr<const Datacratic::HttpRequestHead> spendUpdateHead;
+    std::shared_ptr<const Datacratic::HttpRequestHead> reauthorizeHead;
+    std::shared_ptr<const Datacratic::HttpRequestHead> bidCountsHead;
     std::mutex mutex;
     std::unordered_set<AccountKey> uninitializedAccounts;
     Amount spendRate;
@@ -140,6 +151,34 @@ private:
     Datacratic::Date lastReauth;
     bool debug;
 
+    /** Spend velocity of an account in adaptive mode. */
+    struct SpendEstimate {
+        SpendEstimate() : perPeriod(-1.0) {}
+
+        double perPeriod;   ///< Smoothed spend per reauthorization, micros
+        Amount rate;        ///< Rate last requested from the go banker
+    };
+
+    bool adaptive;
+    Amount minSpendRate;
+    Amount maxSpendRate;
+    /// Only touched from the reauthorize response, so not locked
+    std::unordered_map<AccountKey, SpendEstimate> spendEstimates;
+
+    Amount adaptiveRate(const AccountKey &key, Amount spent, bool drained);
+
+    void onReauthorized(const AccountKey &key, Amount newBalance,
+                        Amount maxBalance, int64_t rate);
+
+    /** Print the accounts into JSON arrays of at most BulkChunkSize
+        elements, without going through Json::Value.  Works on a snapshot
+        of the accounts, so no lock is needed. */
+    std::vector<std::string>
+    bulkPayloads(const std::function<void (const AccountKey &,
+                                           GoAccount &,
+                                           Datacratic::JsonPrintingContext &)>
+                 & printAccount);
+
     void addAccountImpl(const AccountKey &account);
     void replaceAccount(const AccountKey &account);
 };
@@ -13,8 +13,10 @@
 #include <jml/arch/futex.h>
 
 #include "master_banker.h"
+#include "sharded_banker.h"
 #include "soa/service/rest_request_binding.h"
 #include "soa/service/redis.h"
+#include "soa/service/sampling_profiler.h"
 
 
 using namespace std;
@@ -50,6 +52,7 @@ struct RedisBankerPersistence::Itl {
     shared_ptr<Redis::AsyncConnection> redis;
 
     int timeout;
+    int batchSize;
 };
 
 RedisBankerPersistence::
@@ -58,6 +61,7 @@ RedisBankerPersistence(const Redis::Address & redis, int timeout)
     itl = make_shared<Itl>();
     itl->redis = make_shared<Redis::AsyncConnection>(redis);
     itl->timeout = timeout;
+    itl->batchSize = Default::RedisSaveBatchSize;
 }
 
 RedisBankerPersistence::
@@ -66,6 +70,7 @@ RedisBankerPersistence(shared_ptr<Redis::AsyncConnection> redis, int timeout)
     itl = make_shared<Itl>();
     itl->redis = redis;
     itl->timeout = timeout;
+    itl->batchSize = Default::RedisSaveBatchSize;
 }
 
 void
@@ -128,6 +133,22 @@ loadAll(const string & topLevelKey, OnLoadedCallback onLoaded)
 void
 RedisBankerPersistence::
 saveAll(const Accounts & toSave, OnSavedCallback onSaved)
+{
+    vector<AccountKey> keys;
+    auto onAccount = [&] (const AccountKey & key,
+                          const Account & account)
+        {
+            keys.push_back(key);
+        };
+    toSave.forEachAccount(onAccount);
+
+    saveAccounts(toSave, keys, onSaved);
+}
+
+void
+RedisBankerPersistence::
+saveAccounts(const Accounts & toSave, const vector<AccountKey> & accountKeys,
+             OnSavedCallback onSaved)
 {
     /* TODO: we need to check the content of the "banker:accounts" set for
      * "extra" account keys */
@@ -145,15 +166,12 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
         return rhs.secondsSince(lhs) * 1000;
     };
 
-    /* fetch all account keys and values from storage */
-    auto onAccount = [&] (const AccountKey & key,
-                          const Account & account)
-        {
-            string keyStr = key.toString();
-            keys.push_back(keyStr);
-            fetchCommand.addArg(PREFIX + keyStr);
-        };
-    toSave.forEachAccount(onAccount);
+    /* fetch the account values from storage */
+    for (const AccountKey & key: accountKeys) {
+        string keyStr = key.toString();
+        keys.push_back(keyStr);
+        fetchCommand.addArg(PREFIX + keyStr);
+    }
 
     const Date beforePhase1Time = Date::now();
     auto onPhase1Result = [=] (const Redis::Result & result)
@@ -174,8 +192,21 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                 return;
             }
 
-            vector<Redis::Command> storeCommands;
-            storeCommands.push_back(MULTI);
+            /* The commands for each account are kept together in a batch
+               so that an account is never half written. */
+            vector<vector<Redis::Command> > batches;
+            int accountsInBatch = 0;
+
+            auto addToBatch = [&] (vector<Redis::Command> && commands) {
+                if (batches.empty() || accountsInBatch == itl->batchSize) {
+                    batches.emplace_back();
+                    batches.back().push_back(MULTI);
+                    accountsInBatch = 0;
+                }
+                auto & batch = batches.back();
+                batch.insert(batch.end(), commands.begin(), commands.end());
+                ++accountsInBatch;
+            };
 
             const Reply & reply = result.reply();
             ExcAssert(reply.type() == ARRAY);
@@ -183,7 +214,7 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
             Json::Value badAccounts(Json::arrayValue);
             Json::Value archivedAccounts(Json::arrayValue);
 
-            /* All accounts known to the banker are fetched.
+            /* All accounts to save are fetched.
                We need to check them and restore them (if needed). */
             for (int i = 0; i < reply.length(); i++) {
                 const string & key = keys[i];
@@ -196,6 +227,7 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                 }
                 Json::Value bankerValue = bankerAccount.toJson();
                 bool saveAccount(false);
+                vector<Redis::Command> storeCommands;
 
                 Redis::Result result = reply[i];
                 Reply accountReply = result.reply();
@@ -253,6 +285,7 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                 if (saveAccount) {
                     Redis::Command command = SET(PREFIX + key, boost::trim_copy(bankerValue.toString()));
                     storeCommands.push_back(command);
+                    addToBatch(std::move(storeCommands));
                 }
             }
 
@@ -267,36 +300,57 @@ saveAll(const Accounts & toSave, OnSavedCallback onSaved)
                         "totalTimeMs", latencyBetween(begin, now));
                 onSaved(saveResult, boost::trim_copy(badAccounts.toString()));
             }
-            else if (storeCommands.size() > 1) {
-                 storeCommands.push_back(EXEC);
-                 
+            else if (!batches.empty()) {
                  const Date beforePhase2Time = Date::now();
 
                  saveResult.recordLatency(
                         "inPhase1TimeMs", latencyBetween(afterPhase1Time, Date::now()));
 
-                 auto onPhase2Result = [=] (const Redis::Results & results) mutable
+                 /* The batches are all queued at once and pipelined on the
+                    connection; the save is done when the last one returns
+                    and fails if any of them failed. */
+                 struct Phase2 {
+                     BankerPersistence::Result saveResult;
+                     string archived;
+                     string error;
+                     size_t pending;
+                 };
+                 auto phase2 = make_shared<Phase2>();
+                 phase2->saveResult = saveResult;
+                 phase2->archived = boost::trim_copy(archivedAccounts.toString());
+                 phase2->pending = batches.size();
+
+                 auto onPhase2Result = [=] (const Redis::Results & results)
                  {
+                     if (!results.ok() && phase2->error.empty())
+                         phase2->error = results.error();
+                     if (--phase2->pending > 0)
+                         return;
+
                      const Date afterPhase2Time = Date::now();
+                     auto & saveResult = phase2->saveResult;
                      saveResult.recordLatency(
                              "redisPhase2TimeMs", latencyBetween(beforePhase2Time, afterPhase2Time));
 
                      saveResult.recordLatency(
                              "totalTimeMs", latencyBetween(begin, Date::now()));
 
-                     if (results.ok()) {
+                     if (phase2->error.empty()) {
                          saveResult.status = SUCCESS;
-                         onSaved(saveResult, boost::trim_copy(archivedAccounts.toString()));
+                         onSaved(saveResult, phase2->archived);
                      }
                      else {
                          LOG(error) << "phase2 save operation failed with error '"
-                                   << results.error() << "'" << std::endl;
+                                   << phase2->error << "'" << std::endl;
                          saveResult.status = PERSISTENCE_ERROR;
-                         onSaved(saveResult, results.error());
+                         onSaved(saveResult, phase2->error);
                      }
                  };
 
-                 itl->redis->queueMulti(storeCommands, onPhase2Result, itl->timeout);
+                 for (auto & batch: batches) {
+                     batch.push_back(EXEC);
+                     itl->redis->queueMulti(batch, onPhase2Result, itl->timeout);
+                 }
             }
             else {
                 saveResult.status = SUCCESS;
@@ -585,7 +639,10 @@ MasterBanker(std::shared_ptr<ServiceProxies> proxies,
              const string & serviceName)
     : ServiceBase(serviceName, proxies),
       RestServiceEndpoint(proxies->zmqContext),
-      saving(false)
+      shard(-1), numShards(1),
+      saving(false),
+      checkpointInterval(Default::SaveCheckpointInterval),
+      savesSinceCheckpoint(0)
 {
     /* Set the Access-Control-Allow-Origins: * header to allow browser-based
        REST calls directly to the endpoint.
@@ -625,7 +682,7 @@ init(const shared_ptr<BankerPersistence> & storage, double saveInterval)
                 }
             });
 
-    registerServiceProvider(serviceName(), { "rtbBanker" });
+    registerServiceProvider(serviceName(), { bankerServiceClass(shard) });
 
     getServices()->config->removePath(serviceName());
     RestServiceEndpoint::init(getServices()->config, serviceName());
@@ -635,6 +692,7 @@ init(const shared_ptr<BankerPersistence> & storage, double saveInterval)
     router.description = "API for the Datacratic Banker Service";
 
     router.addHelpRoute("/", "GET");
+    addProfilerRoutes(router);
 
     RestRequestRouter::OnProcessRequest pingRoute
         = [=] (const RestServiceEndpoint::ConnectionId & connection,
@@ -721,6 +779,52 @@ init(const shared_ptr<BankerPersistence> & storage, double saveInterval)
                        this,
                        JsonParam<Json::Value>("", "list of accounts to sync"));
 
+    RestRequestRouter::OnProcessRequest syncRoute
+        = [=] (const RestServiceEndpoint::ConnectionId & connection,
+              const RestRequest & request,
+              const RestRequestParsingContext & context) {
+        recordHit("syncBinary");
+        try {
+            auto shadows = ShadowSync::decodeRequest(request.payload);
+            auto response = syncFromShadowBinary(shadows);
+            connection.sendResponse(200, ShadowSync::encodeResponse(response),
+                                    "application/octet-stream");
+        } catch (const std::exception & exc) {
+            connection.sendResponse(400, exc.what(), "text/plain");
+        }
+        return RestRequestRouter::MR_YES;
+    };
+    accountsNode.addRoute("/sync", "POST",
+                          "Binary sync of the spend accounts that changed "
+                          "on a slave banker",
+                          syncRoute, Json::Value());
+
+    RestRequestRouter::OnProcessRequest dumpRoute
+        = [=] (const RestServiceEndpoint::ConnectionId & connection,
+              const RestRequest & request,
+              const RestRequestParsingContext & context) {
+        recordHit("dump");
+
+        AccountKey prefix;
+        uint64_t since = 0;
+        try {
+            if (request.params.hasValue("accountPrefix"))
+                prefix = AccountKey(request.params.getValue("accountPrefix"));
+            if (request.params.hasValue("since"))
+                since = std::stoull(request.params.getValue("since"));
+        } catch (const std::exception & exc) {
+            connection.sendResponse(400, exc.what(), "text/plain");
+            return RestRequestRouter::MR_YES;
+        }
+
+        dumpAccounts(connection, prefix, since);
+        return RestRequestRouter::MR_YES;
+    };
+    accountsNode.addRoute("/dump", "GET",
+                          "Stream the accounts under accountPrefix that "
+                          "changed after the generation given in since",
+                          dumpRoute, Json::Value());
+
     auto & account
         = accountsNode.addSubRouter(Rx("/([^/]*)", "/<accountName>"),
                                     "operations on an individual account");
@@ -857,6 +961,29 @@ start()
     RestServiceEndpoint::start();
 }
 
+void
+MasterBanker::
+setShard(int shard, int numShards)
+{
+    if (numShards < 1 || shard < 0 || shard >= numShards)
+        throw ML::Exception("invalid banker shard %d of %d", shard, numShards);
+
+    this->shard = numShards > 1 ? shard : -1;
+    this->numShards = numShards;
+}
+
+void
+MasterBanker::
+checkShard(const AccountKey & key) const
+{
+    if (shard < 0 || key.empty()) return;
+
+    size_t owner = bankerShardFor(key[0], numShards);
+    if ((int)owner != shard)
+        throw ML::Exception("account '%s' belongs to banker shard %d, not %d",
+                            key.toString().c_str(), (int)owner, shard);
+}
+
 pair<string, string>
 MasterBanker::
 bindTcp()
@@ -870,7 +997,7 @@ void
 MasterBanker::
 shutdown()
 {
-    unregisterServiceProvider(serviceName(), { "rtbBanker" });
+    unregisterServiceProvider(serviceName(), { bankerServiceClass(shard) });
     RestServiceEndpoint::shutdown();
 }
 
@@ -878,6 +1005,7 @@ Json::Value
 MasterBanker::
 createAccount(const AccountKey & key, AccountType type)
 {
+    checkShard(key);
     reactivatePresentAccounts(key);
 
     Account account = accounts.createAccount(key, type);
@@ -899,6 +1027,54 @@ getAccountsSimpleSummaries(int depth)
     return accounts.getAccountSummariesJson(true, depth);
 }
 
+void
+MasterBanker::
+dumpAccounts(const RestServiceEndpoint::ConnectionId & connection,
+             const AccountKey & prefix, uint64_t since)
+{
+    enum { BatchSize = 1000 };
+
+    RestServiceEndpoint::ConnectionId conn = connection;
+    bool chunked = !!conn.itl->http;
+    std::string payload;
+
+    if (chunked)
+        conn.sendHttpResponseHeader(
+                200, "application/json",
+                RestServiceEndpoint::ConnectionId::CHUNKED_ENCODING);
+
+    // The generation is only known once all the accounts have been copied
+    // so it goes last.
+    payload = "{\"accounts\":{";
+    bool first = true;
+
+    auto onBatch = [&] (Accounts::AccountBatch & batch) {
+        for (const auto & entry: batch) {
+            if (!first) payload += ',';
+            first = false;
+            payload += Json::Value(entry.first.toString()).toStringNoNewLine();
+            payload += ':';
+            payload += entry.second.toJson().toStringNoNewLine();
+        }
+
+        if (chunked) {
+            conn.sendPayload(payload);
+            payload.clear();
+        }
+    };
+
+    uint64_t generation
+        = accounts.forEachAccountBatch(prefix, since, BatchSize, onBatch);
+
+    payload += "},\"generation\":" + std::to_string(generation) + "}";
+
+    if (chunked) {
+        conn.sendPayload(payload);
+        conn.finishResponse();
+    }
+    else conn.sendResponse(200, payload, "application/json");
+}
+
 void
 MasterBanker::
 onStateSaved(const BankerPersistence::Result& result,
@@ -947,6 +1123,13 @@ onStateSaved(const BankerPersistence::Result& result,
     lastSaveLatency = std::move(result.latencies);
 
     reportLatencies("save state", result.latencies);
+
+    if (result.status != BankerPersistence::SUCCESS) {
+        accounts.markAccountsDirty(savingAccounts);
+        savesSinceCheckpoint = 0;
+    }
+    savingAccounts.clear();
+
     saving = false;
     ML::futex_wake(saving);
 }
@@ -963,9 +1146,23 @@ saveState()
         return;
 
     saving = true;
-    storage_->saveAll(accounts, bind(&MasterBanker::onStateSaved, this,
-                                          placeholders::_1,
-                                          placeholders::_2));
+    savingAccounts = accounts.takeDirtyAccounts();
+
+    auto onSaved = bind(&MasterBanker::onStateSaved, this,
+                        placeholders::_1,
+                        placeholders::_2);
+
+    // The first save, and the first after a failure, is a full checkpoint
+    if (savesSinceCheckpoint == 0 || savesSinceCheckpoint >= checkpointInterval) {
+        recordHit("save.checkpoint");
+        savesSinceCheckpoint = 1;
+        storage_->saveAll(accounts, onSaved);
+    }
+    else {
+        recordLevel(savingAccounts.size(), "save.dirtyAccounts");
+        ++savesSinceCheckpoint;
+        storage_->saveAccounts(accounts, savingAccounts, onSaved);
+    }
 }
 
 void
@@ -1160,6 +1357,7 @@ onCreateAccount(const AccountKey &key, AccountType type)
 {
     Record record(this, "onCreateAccount");
     checkPersistence();
+    checkShard(key);
  
     reactivatePresentAccounts(key);
     return accounts.createAccount(key, type);
@@ -1285,6 +1483,35 @@ syncFromShadowBatched(const Json::Value &transfers)
     return result;
 }
 
+ShadowSync::Response
+MasterBanker::
+syncFromShadowBinary(const ShadowSync::Request & request)
+{
+    Record record(this, "syncFromShadow");
+    checkPersistence();
+
+    ShadowSync::Response result;
+    result.reserve(request.size());
+
+    for (const auto & entry: request) {
+        AccountKey key(entry.first);
+
+        pair<bool, bool> presentActive = accounts.accountPresentAndActive(key);
+
+        Account account;
+        if (presentActive.first && !presentActive.second)
+            account = accounts.getAccount(key);
+        else account = accounts.syncFromShadow(key, entry.second);
+
+        ShadowSync::MasterState state;
+        state.netBudget = account.getNetBudget();
+        state.status = account.status;
+        result.emplace_back(entry.first, state);
+    }
+
+    return result;
+}
+
 void
 MasterBanker::
 reportLatencies(const std::string &category,
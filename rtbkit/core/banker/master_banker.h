@@ -9,6 +9,7 @@
 #define __banker__master_banker_h__
 
 #include "banker.h"
+#include "shadow_sync.h"
 #include "soa/service/named_endpoint.h"
 #include "soa/service/message_loop.h"
 #include "soa/service/redis.h"
@@ -38,6 +39,13 @@ inline std::string restEncode(const AccountKey & val)
 namespace Default {
     static constexpr int RedisTimeout = 10;
     static constexpr double SaveInterval = 10.0;
+
+    /// Maximum number of accounts written in a single MULTI block
+    static constexpr int RedisSaveBatchSize = 1000;
+
+    /// Every this many saves, all the accounts are written instead of
+    /// only those that changed
+    static constexpr int SaveCheckpointInterval = 30;
 }
 
 
@@ -197,6 +205,16 @@ struct BankerPersistence {
                          OnLoadedCallback onLoaded) = 0;
     virtual void saveAll(const Accounts & toSave,
                          OnSavedCallback onDone) = 0;
+
+    /** Save only the given accounts, which are those that changed since the
+        last save.  Backends that can't do better save everything.
+    */
+    virtual void saveAccounts(const Accounts & toSave,
+                              const std::vector<AccountKey> & keys,
+                              OnSavedCallback onDone)
+    {
+        saveAll(toSave, onDone);
+    }
     virtual void restoreFromArchive(const AccountKey & accountName,
                          OnRestoredCallback onRestored) = 0;
 };
@@ -251,6 +269,9 @@ struct RedisBankerPersistence : public BankerPersistence {
 
     void loadAll(const std::string & topLevelKey, OnLoadedCallback onLoaded);
     void saveAll(const Accounts & toSave, OnSavedCallback onDone);
+    void saveAccounts(const Accounts & toSave,
+                      const std::vector<AccountKey> & keys,
+                      OnSavedCallback onDone);
     void restoreFromArchive(const AccountKey & key, OnRestoredCallback onRestored);
 private:
     void moveToActive(const std::vector<AccountKey> & archivedAccountKeys,
@@ -294,6 +315,17 @@ struct MasterBanker
 
     void init(const std::shared_ptr<BankerPersistence> & storage,
               double saveInterval = Default::SaveInterval);
+
+    /** Make this banker the given shard out of numShards master bankers.
+        It then registers under the service class of its shard and refuses
+        the top-level accounts that belong to other shards.  Must be called
+        before init().
+    */
+    void setShard(int shard, int numShards);
+
+    int shard;          ///< -1 when not sharded
+    int numShards;
+
     void start();
     std::pair<std::string, std::string> bindTcp();
 
@@ -321,10 +353,23 @@ struct MasterBanker
     mutable Lock saveLock;
     int saving;
 
+    /** Number of saves between two full checkpoints; the saves in between
+        only write the accounts that changed.
+    */
+    int checkpointInterval;
+    int savesSinceCheckpoint;
+
+    /// Accounts taken from accounts.takeDirtyAccounts() for the save in
+    /// progress, to be marked dirty again if it fails
+    std::vector<AccountKey> savingAccounts;
+
     Json::Value createAccount(const AccountKey & key, AccountType type);
     Json::Value getAccountsSimpleSummaries(int depth);
 
-    /** Save the entire state asynchronously.  Will return straight away. */
+    /** Save the state asynchronously.  Will return straight away.  Most
+        saves only write the accounts that changed since the previous one;
+        see checkpointInterval.
+    */
     void saveState();
 
     /** Load the entire state sychronously.  Will return once the state has
@@ -357,6 +402,18 @@ private:
     const Account addAdjustment(const AccountKey &key, CurrencyPool amount);
     const Account syncFromShadow(const AccountKey &key, const ShadowAccount &shadow);
     std::map<std::string, Account> syncFromShadowBatched(const Json::Value &transfers);
+    ShadowSync::Response syncFromShadowBinary(const ShadowSync::Request &request);
+
+    /** Write the accounts under prefix that changed after the generation
+        since as a JSON object of the form
+
+            { "accounts": { "<key>": <account>, ... }, "generation": <g> }
+
+        where <g> is to be passed as since to get the next changes.  HTTP
+        responses are sent in chunks as the accounts are copied.
+    */
+    void dumpAccounts(const RestServiceEndpoint::ConnectionId & connection,
+                      const AccountKey & prefix, uint64_t since);
 
     void reportLatencies(const std::string& category,
                          const BankerPersistence::LatencyMap& latencies) const;
@@ -367,6 +424,9 @@ private:
     void reactivatePresentAccounts(const AccountKey & key);
 
     void checkPersistence();
+
+    /** Throw if the account belongs to another master banker shard. */
+    void checkShard(const AccountKey & key) const;
 };
 
 } // namespace RTBKIT
@@ -0,0 +1,142 @@
+/* shadow_sync.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Binary encoding of the slave to master banker synchronization.
+*/
+
+#include "shadow_sync.h"
+#include "jml/db/persistent.h"
+#include "jml/db/compact_size_types.h"
+#include <sstream>
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+namespace {
+
+enum {
+    RequestMagic = 'S',
+    ResponseMagic = 'M',
+    Version = 1
+};
+
+void writeHeader(DB::Store_Writer & store, unsigned char magic, size_t count)
+{
+    store << magic << (unsigned char)Version << DB::compact_size_t(count);
+}
+
+size_t readHeader(DB::Store_Reader & store, unsigned char magic)
+{
+    unsigned char m, version;
+    store >> m >> version;
+    if (m != magic)
+        throw ML::Exception("invalid shadow sync message");
+    if (version != Version)
+        throw ML::Exception("unknown shadow sync version %d", (int)version);
+
+    DB::compact_size_t count(store);
+    return count;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SHADOW SYNC                                                               */
+/*****************************************************************************/
+
+std::string
+ShadowSync::
+encodeRequest(const Request & request)
+{
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        writeHeader(store, RequestMagic, request.size());
+
+        for (auto & entry: request) {
+            const ShadowAccount & account = entry.second;
+            account.checkInvariants();
+
+            // The balance is derived from the rest and isn't sent.
+            store << entry.first
+                  << account.netBudget
+                  << account.commitmentsRetired
+                  << account.commitmentsMade
+                  << account.spent
+                  << account.lineItems;
+        }
+    }
+    return stream.str();
+}
+
+ShadowSync::Request
+ShadowSync::
+decodeRequest(const std::string & data)
+{
+    std::istringstream stream(data);
+    DB::Store_Reader store(stream);
+
+    Request result(readHeader(store, RequestMagic));
+
+    for (auto & entry: result) {
+        ShadowAccount & account = entry.second;
+
+        store >> entry.first
+              >> account.netBudget
+              >> account.commitmentsRetired
+              >> account.commitmentsMade
+              >> account.spent
+              >> account.lineItems;
+
+        account.balance = account.netBudget + account.commitmentsRetired
+            - account.commitmentsMade - account.spent;
+        account.checkInvariants();
+    }
+
+    return result;
+}
+
+std::string
+ShadowSync::
+encodeResponse(const Response & response)
+{
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        writeHeader(store, ResponseMagic, response.size());
+
+        for (auto & entry: response) {
+            store << entry.first
+                  << entry.second.netBudget
+                  << (unsigned char)entry.second.status;
+        }
+    }
+    return stream.str();
+}
+
+ShadowSync::Response
+ShadowSync::
+decodeResponse(const std::string & data)
+{
+    std::istringstream stream(data);
+    DB::Store_Reader store(stream);
+
+    Response result(readHeader(store, ResponseMagic));
+
+    for (auto & entry: result) {
+        unsigned char status;
+        store >> entry.first >> entry.second.netBudget >> status;
+
+        if (status != Account::ACTIVE && status != Account::CLOSED)
+            throw ML::Exception("invalid account status %d in shadow sync",
+                                (int)status);
+        entry.second.status = (Account::Status)status;
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,57 @@
+/* shadow_sync.h                                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Binary encoding of the slave to master banker synchronization.
+*/
+
+#pragma once
+
+#include "account.h"
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* SHADOW SYNC                                                               */
+/*****************************************************************************/
+
+/** A slave banker reports the spend of all the shadow accounts that changed
+    since its last sync in a single message, instead of one JSON request per
+    account.  Amounts are written with the binary serialization of
+    CurrencyPool, which stores a varint per currency.
+
+    The totals in a shadow account are cumulative and the master takes them
+    as they are, so sending an account twice is harmless; the slave only
+    needs to send an account again if a sync fails.
+
+    The master answers with the net budget and status of each account,
+    which is all that ShadowAccount::syncFromMaster() needs.
+*/
+
+struct ShadowSync {
+    /// Shadow accounts by spend account name (x:y:suffix)
+    typedef std::vector<std::pair<std::string, ShadowAccount> > Request;
+
+    struct MasterState {
+        MasterState()
+            : status(Account::ACTIVE)
+        {
+        }
+
+        CurrencyPool netBudget;
+        Account::Status status;
+    };
+
+    /// Master state by spend account name, in the order of the request
+    typedef std::vector<std::pair<std::string, MasterState> > Response;
+
+    static std::string encodeRequest(const Request & request);
+    static Request decodeRequest(const std::string & data);
+
+    static std::string encodeResponse(const Response & response);
+    static Response decodeResponse(const std::string & data);
+};
+
+} // namespace RTBKIT
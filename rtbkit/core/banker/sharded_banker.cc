@@ -0,0 +1,163 @@
+/* sharded_banker.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Banker that spreads the top-level accounts over several master bankers.
+*/
+
+#include "sharded_banker.h"
+#include "jml/arch/exception.h"
+#include "city.h"
+
+using namespace std;
+
+namespace RTBKIT {
+
+size_t
+bankerShardFor(const std::string & topLevelAccount, size_t numShards)
+{
+    if (numShards <= 1) return 0;
+    return CityHash64(topLevelAccount.c_str(), topLevelAccount.length())
+        % numShards;
+}
+
+std::string
+bankerServiceClass(int shard)
+{
+    if (shard < 0) return "rtbBanker";
+    return "rtbBanker.shard" + to_string(shard);
+}
+
+
+/*****************************************************************************/
+/* SHARDED BANKER                                                            */
+/*****************************************************************************/
+
+ShardedBanker::
+ShardedBanker(std::vector<std::shared_ptr<Banker> > shards)
+    : shards(std::move(shards))
+{
+    if (this->shards.empty())
+        throw ML::Exception("sharded banker needs at least one shard");
+    for (const auto & shard: this->shards)
+        if (!shard)
+            throw ML::Exception("sharded banker can't have a null shard");
+}
+
+ShadowAccount
+ShardedBanker::
+addSpendAccountSync(const AccountKey & account, CurrencyPool accountFloat)
+{
+    return shardFor(account).addSpendAccountSync(account, accountFloat);
+}
+
+void
+ShardedBanker::
+addSpendAccount(const AccountKey & account, CurrencyPool accountFloat,
+                std::function<void (std::exception_ptr, ShadowAccount&&)> onDone)
+{
+    shardFor(account).addSpendAccount(account, accountFloat, onDone);
+}
+
+bool
+ShardedBanker::
+authorizeBid(const AccountKey & account, const std::string & item,
+             Amount amount)
+{
+    return shardFor(account).authorizeBid(account, item, amount);
+}
+
+void
+ShardedBanker::
+cancelBid(const AccountKey & account, const std::string & item)
+{
+    shardFor(account).cancelBid(account, item);
+}
+
+bool
+ShardedBanker::
+authorizeBid(AccountKeyId account, const std::string & item, Amount amount)
+{
+    return shardFor(account.key()).authorizeBid(account, item, amount);
+}
+
+void
+ShardedBanker::
+cancelBid(AccountKeyId account, const std::string & item)
+{
+    shardFor(account.key()).cancelBid(account, item);
+}
+
+void
+ShardedBanker::
+winBid(const AccountKey & account, const std::string & item,
+       Amount amountPaid, const LineItems & lineItems)
+{
+    shardFor(account).winBid(account, item, amountPaid, lineItems);
+}
+
+void
+ShardedBanker::
+attachBid(const AccountKey & account, const std::string & item,
+          Amount amountAuthorized)
+{
+    shardFor(account).attachBid(account, item, amountAuthorized);
+}
+
+Amount
+ShardedBanker::
+detachBid(const AccountKey & account, const std::string & item)
+{
+    return shardFor(account).detachBid(account, item);
+}
+
+void
+ShardedBanker::
+commitBid(const AccountKey & account, const std::string & item,
+          Amount amountPaid, const LineItems & lineItems)
+{
+    shardFor(account).commitBid(account, item, amountPaid, lineItems);
+}
+
+void
+ShardedBanker::
+forceWinBid(const AccountKey & account, Amount amountPaid,
+            const LineItems & lineItems)
+{
+    shardFor(account).forceWinBid(account, amountPaid, lineItems);
+}
+
+void
+ShardedBanker::
+sync()
+{
+    for (auto & shard: shards)
+        shard->sync();
+}
+
+void
+ShardedBanker::
+logBidEvents(const Datacratic::EventRecorder & eventRecorder)
+{
+    for (auto & shard: shards)
+        shard->logBidEvents(eventRecorder);
+}
+
+MonitorIndicator
+ShardedBanker::
+getProviderIndicators() const
+{
+    MonitorIndicator result;
+    result.status = true;
+
+    for (size_t i = 0;  i < shards.size();  ++i) {
+        MonitorIndicator ind = shards[i]->getProviderIndicators();
+        if (i == 0) result.serviceName = ind.serviceName;
+        result.status = result.status && ind.status;
+        if (!result.message.empty()) result.message += "; ";
+        result.message += "shard " + to_string(i) + ": " + ind.message;
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,110 @@
+/* sharded_banker.h                                                -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Banker that spreads the top-level accounts over several master bankers.
+*/
+
+#pragma once
+
+#include "banker.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RTBKIT {
+
+/** Master banker shard that holds the given top-level account. */
+size_t bankerShardFor(const std::string & topLevelAccount, size_t numShards);
+
+/** Service class under which a master banker shard registers, or the plain
+    rtbBanker class when the master banker isn't sharded (shard -1). */
+std::string bankerServiceClass(int shard = -1);
+
+
+/*****************************************************************************/
+/* SHARDED BANKER                                                            */
+/*****************************************************************************/
+
+/** Banker in front of one banker per master banker shard, normally a
+    SlaveBanker that syncs with that shard.  Each top-level account lives on
+    a single shard, chosen by a hash of its name, so every operation on an
+    account goes to one shard and the shards never talk to each other.
+
+    Reports that span several top-level accounts have to query each shard.
+*/
+struct ShardedBanker : public Banker {
+
+    ShardedBanker(std::vector<std::shared_ptr<Banker> > shards);
+
+    std::vector<std::shared_ptr<Banker> > shards;
+
+    Banker & shardFor(const AccountKey & account) const
+    {
+        return *shards[bankerShardFor(account[0], shards.size())];
+    }
+
+    virtual ShadowAccount
+    addSpendAccountSync(const AccountKey & account,
+                        CurrencyPool accountFloat = CurrencyPool());
+
+    virtual void
+    addSpendAccount(const AccountKey & account,
+                    CurrencyPool accountFloat,
+                    std::function<void (std::exception_ptr, ShadowAccount&&)> onDone);
+
+    virtual bool authorizeBid(const AccountKey & account,
+                              const std::string & item,
+                              Amount amount);
+
+    virtual void cancelBid(const AccountKey & account,
+                           const std::string & item);
+
+    virtual bool authorizeBid(AccountKeyId account,
+                              const std::string & item,
+                              Amount amount);
+
+    virtual void cancelBid(AccountKeyId account,
+                           const std::string & item);
+
+    virtual void winBid(const AccountKey & account,
+                        const std::string & item,
+                        Amount amountPaid,
+                        const LineItems & lineItems = LineItems());
+
+    virtual void attachBid(const AccountKey & account,
+                           const std::string & item,
+                           Amount amountAuthorized);
+
+    virtual Amount detachBid(const AccountKey & account,
+                             const std::string & item);
+
+    virtual void commitBid(const AccountKey & account,
+                           const std::string & item,
+                           Amount amountPaid,
+                           const LineItems & lineItems);
+
+    virtual void forceWinBid(const AccountKey & account,
+                             Amount amountPaid,
+                             const LineItems & lineItems);
+
+    virtual void sync();
+
+    virtual void logBidEvents(const Datacratic::EventRecorder & eventRecorder);
+
+    /** Healthy only if every shard is. */
+    virtual MonitorIndicator getProviderIndicators() const;
+};
+
+/** The banker of the only shard, or a ShardedBanker in front of all of
+    them. */
+template<typename ShardBanker>
+std::shared_ptr<Banker>
+makeShardedBanker(const std::vector<std::shared_ptr<ShardBanker> > & shards)
+{
+    if (shards.size() == 1) return shards[0];
+    return std::make_shared<ShardedBanker>(
+            std::vector<std::shared_ptr<Banker> >(shards.begin(), shards.end()));
+}
+
+} // namespace RTBKIT
@@ -6,7 +6,13 @@
 */
 
 #include "slave_banker.h"
+#include "shadow_sync.h"
+#include "sharded_banker.h"
 #include "jml/utils/vector_utils.h"
+#include "jml/utils/filter_streams.h"
+
+#include <cstdio>
+#include <cstring>
 
 using namespace std;
 using namespace Datacratic;
@@ -119,7 +125,9 @@ Logging::Category SlaveBanker::error("SlaveBanker Error", SlaveBanker::print);
 Logging::Category SlaveBanker::trace("SlaveBanker Trace", SlaveBanker::print);
 
 SlaveBanker::SlaveBanker()
-    : createdAccounts(128), reauthorizing(false), numReauthorized(0)
+    : accountsMemory("banker.shadowAccounts",
+                     [&] () { return accounts.memoryUsage(); }),
+      createdAccounts(128), reauthorizing(false), numReauthorized(0)
 {
 }
 
@@ -129,7 +137,9 @@ SlaveBanker(
         CurrencyPool spendRate,
         double syncRate,
         bool batchedUpdates)
-    : createdAccounts(128), reauthorizing(false), numReauthorized(0)
+    : accountsMemory("banker.shadowAccounts",
+                     [&] () { return accounts.memoryUsage(); }),
+      createdAccounts(128), reauthorizing(false), numReauthorized(0)
 {
     init(accountSuffix, spendRate, syncRate, batchedUpdates);
 }
@@ -193,8 +203,12 @@ init(const std::string & accountSuffix,
 
     lastSync = lastReauthorize = Date::now();
     
+    auto reportPtr = batchedUpdates ?
+        &SlaveBanker::reportSpendBatched :
+        &SlaveBanker::reportSpend;
+
     addPeriodic("SlaveBanker::reportSpend", syncRate,
-                std::bind(&SlaveBanker::reportSpend,
+                std::bind(reportPtr,
                           this,
                           std::placeholders::_1),
                 true /* single threaded */);
@@ -464,6 +478,102 @@ reportSpend(uint64_t numTimeoutsExpired)
     syncAll(onDone);
 }
 
+void
+SlaveBanker::
+reportSpendBatched(uint64_t numTimeoutsExpired)
+{
+    if (numTimeoutsExpired > 1) {
+        cerr << "warning: slave banker missed " << numTimeoutsExpired
+             << " timeouts" << endl;
+    }
+
+    if (reportSpendSent != Date()) {
+        // Accounts are only marked as unchanged once they've been handed
+        // out, so there's nothing lost by waiting for the next period.
+        cerr << "warning: report spend still in progress" << endl;
+        return;
+    }
+
+    for (auto & key: accounts.getAccountKeys()) {
+        if (!accounts.isInitialized(key) && accounts.isStalled(key)) {
+            LOG(bankerDebug) << "CRITICAL:" << key << std::endl;
+            accounts.reinitializeStalledAccount(key);
+            createdAccounts.push(key);
+        }
+    }
+
+    ShadowSync::Request request;
+    std::vector<AccountKey> sent;
+    auto onAccount = [&] (const AccountKey & key, const ShadowAccount & account) {
+        request.emplace_back(getShadowAccountStr(key), account);
+        sent.push_back(key);
+    };
+    accounts.forEachChangedAccount(onAccount);
+
+    if (request.empty()) {
+        std::lock_guard<Lock> guard(syncLock);
+        lastSync = Date::now();
+        return;
+    }
+
+    reportSpendSent = Date::now();
+
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::placeholders::_3;
+    applicationLayer->request("POST", "/v1/accounts/sync", {},
+                              ShadowSync::encodeRequest(request),
+                              std::bind(&SlaveBanker::onReportSpendBatchedResponse,
+                                        this, std::move(sent), _1, _2, _3));
+}
+
+void
+SlaveBanker::
+onReportSpendBatchedResponse(
+        const std::vector<AccountKey> & sent,
+        std::exception_ptr exc, int code, const std::string & payload)
+{
+    reportSpendSent = Date();
+
+    auto resend = [&] () {
+        for (auto & key: sent)
+            accounts.markChanged(key);
+    };
+
+    if (exc) {
+        resend();
+        logException(exc, "Exception when reporting spend", error);
+        return;
+    }
+
+    if (code != Default::ExpectedMasterHttpCode) {
+        resend();
+        LOG(error) << "Error when reporting spend: expected HTTP "
+                   << Default::ExpectedMasterHttpCode << ", got " << code
+                   << ": " << payload << std::endl;
+        return;
+    }
+
+    ShadowSync::Response response;
+    try {
+        response = ShadowSync::decodeResponse(payload);
+    } catch (...) {
+        resend();
+        logException(std::current_exception(),
+                     "Exception when decoding spend report", error);
+        return;
+    }
+
+    for (auto & entry: response) {
+        accounts.syncFromMaster(AccountKey(entry.first).parent(),
+                                entry.second.netBudget,
+                                entry.second.status);
+    }
+
+    std::lock_guard<Lock> guard(syncLock);
+    lastSync = Date::now();
+}
+
 void
 SlaveBanker::
 reauthorizeBudgetBatched(uint64_t numTimeoutsExpired)
@@ -605,6 +715,109 @@ waitReauthorized()
     }
 }
 
+size_t
+SlaveBanker::
+initWarmStart(const std::string & filename,
+              double maxAge,
+              double saveInterval)
+{
+    if (accountSuffix.empty())
+        throw ML::Exception("initWarmStart called before init");
+
+    warmStartFile = filename;
+
+    size_t numLoaded = 0;
+    try {
+        numLoaded = loadWarmStart(maxAge);
+    } catch (const std::exception & exc) {
+        LOG(error) << "ignoring warm-start cache " << filename << ": "
+                   << exc.what() << std::endl;
+    }
+
+    addPeriodic("SlaveBanker::saveWarmStart", saveInterval,
+                [=] (uint64_t) { this->saveWarmStart(); },
+                true /* single threaded */);
+
+    return numLoaded;
+}
+
+size_t
+SlaveBanker::
+loadWarmStart(double maxAge)
+{
+    ML::filter_istream stream;
+    try {
+        stream.open(warmStartFile);
+    } catch (const std::exception & exc) {
+        LOG(print) << "no warm-start cache at " << warmStartFile << std::endl;
+        return 0;
+    }
+
+    std::string contents((std::istreambuf_iterator<char>(stream)),
+                         std::istreambuf_iterator<char>());
+    Json::Value cache = Json::parse(contents);
+
+    if (cache["accountSuffix"].asString() != accountSuffix)
+        throw ML::Exception("cache was written for the accounts of '%s'",
+                            cache["accountSuffix"].asString().c_str());
+
+    Date saved = Date::parseIso8601DateTime(cache["saved"].asString());
+    if (saved.plusSeconds(maxAge) < Date::now()) {
+        LOG(print) << "warm-start cache from " << saved.print()
+                   << " is too old" << std::endl;
+        return 0;
+    }
+
+    size_t numLoaded = 0;
+    const Json::Value & budgets = cache["budgets"];
+    for (auto it = budgets.begin(), end = budgets.end();  it != end;  ++it) {
+        AccountKey key(it.memberName());
+        if (accounts.setProvisionalBudget(key, CurrencyPool::fromJson(*it),
+                                          Account::ACTIVE))
+            ++numLoaded;
+    }
+
+    LOG(print) << "loaded " << numLoaded << " accounts from warm-start cache "
+               << warmStartFile << std::endl;
+    return numLoaded;
+}
+
+void
+SlaveBanker::
+saveWarmStart() const
+{
+    if (warmStartFile.empty())
+        throw ML::Exception("no warm-start cache to save");
+
+    // What the master will give back to an account after a restart is what
+    // hadn't been committed or spent of its budget, ie its balance.
+    Json::Value budgets(Json::objectValue);
+    accounts.forEachInitializedAndActiveAccount(
+            [&] (const AccountKey & key, const ShadowAccount & account)
+            {
+                if (!account.balance.isZero()
+                    && account.balance.isNonNegative())
+                    budgets[key.toString()] = account.balance.toJson();
+            });
+
+    Json::Value cache;
+    cache["accountSuffix"] = accountSuffix;
+    cache["saved"] = Date::now().printIso8601();
+    cache["budgets"] = budgets;
+
+    // Written aside and renamed so that a crash never leaves half a cache
+    std::string tmpFile = warmStartFile + ".tmp";
+    {
+        ML::filter_ostream stream(tmpFile);
+        stream << cache.toString();
+        stream.close();
+    }
+
+    if (std::rename(tmpFile.c_str(), warmStartFile.c_str()) == -1)
+        LOG(error) << "couldn't rename " << tmpFile << ": "
+                   << strerror(errno) << std::endl;
+}
+
 MonitorIndicator
 SlaveBanker::
 getProviderIndicators() const
@@ -638,6 +851,7 @@ SlaveBankerArguments::SlaveBankerArguments()
     : spendRateStr(Defaults::SpendRate)
     , syncRate(Defaults::SyncRate)
     , batched(Defaults::Batched)
+    , bankerShards(1)
     , useHttp(Defaults::UseHttp)
     , httpTimeout(Defaults::HttpTimeout)
     , httpConnections(Defaults::HttpConnections)
@@ -664,6 +878,8 @@ SlaveBankerArguments::makeProgramOptions(std::string title)
          "frequency at which the slave banker syncs itself with the master banker.")
         ("banker-batched", po::bool_switch(&batched),
          "slave banker now uses batched communication to sync with the master banker.")
+        ("banker-shards", po::value<int>(&bankerShards),
+         "Number of master banker shards that the top-level accounts are spread over")
         ("use-http-banker", po::bool_switch(&useHttp),
          "Communicate with the MasterBanker over http")
         ("banker-http-timeouts", po::value<double>(&httpTimeout),
@@ -693,17 +909,44 @@ makeBanker(std::shared_ptr<ServiceProxies> proxies, const std::string& accountSu
     return banker;
 }
 
+std::vector<std::shared_ptr<SlaveBanker> >
+SlaveBankerArguments::
+makeBankers(std::shared_ptr<ServiceProxies> proxies, const std::string& accountSuffix) const
+{
+    ExcCheck(bankerShards > 0, "The number of banker shards must be > 0");
+
+    if (bankerShards == 1)
+        return { makeBanker(std::move(proxies), accountSuffix) };
+
+    auto spendRate = CurrencyPool(Amount::parse(spendRateStr));
+
+    std::vector<std::shared_ptr<SlaveBanker> > result;
+    for (int shard = 0; shard < bankerShards; ++shard) {
+        auto banker = std::make_shared<SlaveBanker>(accountSuffix, spendRate, syncRate, batched);
+        banker->setApplicationLayer(makeApplicationLayer(proxies, shard));
+        result.push_back(banker);
+    }
+
+    return result;
+}
+
 std::shared_ptr<SlaveBanker>
 SlaveBankerArguments::makeBankerDefault(std::shared_ptr<ServiceProxies> proxies) const {
     return makeBanker(std::move(proxies), "");
 }
 
 std::shared_ptr<ApplicationLayer>
-SlaveBankerArguments::makeApplicationLayer(std::shared_ptr<ServiceProxies> proxies) const
+SlaveBankerArguments::makeApplicationLayer(std::shared_ptr<ServiceProxies> proxies, int shard) const
 {
     std::shared_ptr<ApplicationLayer> layer;
     if (useHttp) {
         auto bankerUri = proxies->bankerUri;
+        if (shard >= 0) {
+            const auto& uris = proxies->params["banker-shard-uris"];
+            ExcCheck(uris.isArray() && uris.size() > unsigned(shard),
+                    "the banker-shard-uris must list every banker shard in the bootstrap.json");
+            bankerUri = uris[shard].asString();
+        }
 
         ExcCheck(!bankerUri.empty(),
                 "the banker-uri must be specified in the bootstrap.json");
@@ -723,8 +966,9 @@ SlaveBankerArguments::makeApplicationLayer(std::shared_ptr<ServiceProxies> proxi
         layer = make_application_layer<HttpLayer>(bankerUri, httpTimeout, httpConnections, tcpNoDelay);
     }
     else {
-        layer = make_application_layer<ZmqLayer>(proxies);
-        LOG(print) << "using zmq interface for the MasterBanker" << std::endl;
+        layer = make_application_layer<ZmqLayer>(proxies, bankerServiceClass(shard));
+        LOG(print) << "using zmq interface for the MasterBanker "
+                   << bankerServiceClass(shard) << std::endl;
     }
 
     return layer;
@@ -13,6 +13,7 @@
 #include "application_layer.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
+#include "soa/service/process_stats.h"
 #include "soa/service/logs.h"
 #include "jml/arch/spinlock.h"
 #include <thread>
@@ -144,6 +145,25 @@ struct SlaveBanker : public Banker, public MessageLoop {
         return accounts.authorizeBid(account, item, amount);
     }
 
+    virtual bool authorizeBid(AccountKeyId account,
+                              const std::string & item,
+                              Amount amount)
+    {
+        return accounts.authorizeBid(account, item, amount);
+    }
+
+    virtual void cancelBid(const AccountKey & account,
+                           const std::string & item)
+    {
+        accounts.cancelBid(account, item);
+    }
+
+    virtual void cancelBid(AccountKeyId account,
+                           const std::string & item)
+    {
+        accounts.cancelBid(account, item);
+    }
+
     virtual void commitBid(const AccountKey & account,
                            const std::string & item,
                            Amount amountPaid,
@@ -193,6 +213,11 @@ struct SlaveBanker : public Banker, public MessageLoop {
         return accounts.forceWinBid(account, amountPaid, lineItems);
     }
 
+    virtual std::shared_ptr<const BudgetAvailability> budgetAvailability() const
+    {
+        return accounts.budgetAvailability();
+    }
+
     /** Sync the given account synchronously, returning the new status of
         the account.
     */
@@ -231,6 +256,24 @@ struct SlaveBanker : public Banker, public MessageLoop {
 
     void waitReauthorized() const;
 
+    /** Keep a warm-start cache of the budget left in each account in the
+        given file, so that a restart doesn't have to wait for every
+        account to be initialized by the master banker before bidding.
+
+        The accounts of a cache that is less than maxAge seconds old get
+        their budget back as a provisional budget until they're initialized
+        (see ShadowAccounts::setProvisionalBudget()), and the cache is then
+        rewritten every saveInterval seconds.  Must be called after init()
+        and before the banker is started.  Returns the number of accounts
+        that were loaded.
+    */
+    size_t initWarmStart(const std::string & filename,
+                         double maxAge = 600.0,
+                         double saveInterval = 10.0);
+
+    /** Write the warm-start cache now. */
+    void saveWarmStart() const;
+
     size_t getNumReauthorized()
         const
     {
@@ -259,6 +302,7 @@ struct SlaveBanker : public Banker, public MessageLoop {
 
 private:    
     ShadowAccounts accounts;
+    Datacratic::MemoryGauge accountsMemory;
 
     /// Channel to asynchronously keep track of which accounts have been
     /// created and must therefore be synchronized
@@ -276,6 +320,14 @@ private:
     void reportSpend(uint64_t numTimeoutsExpired);
     Date reportSpendSent;
 
+    /** Batched version of reportSpend: only the accounts that changed since
+        the last successful report are sent, in a single binary message.
+    */
+    void reportSpendBatched(uint64_t numTimeoutsExpired);
+    void onReportSpendBatchedResponse(
+            const std::vector<AccountKey> & sent,
+            std::exception_ptr exc, int code, const std::string & payload);
+
     /** Periodically we ask the banker to re-authorize our budget. */
     void reauthorizeBudget(uint64_t numTimeoutsExpired);
     CurrencyPool spendRate;
@@ -314,6 +366,11 @@ private:
     void onReauthorizeBudgetBatchedResponse(
             std::exception_ptr exc, int code, const std::string& payload);
 
+    /** Loads the warm-start cache and returns the number of accounts. */
+    size_t loadWarmStart(double maxAge);
+
+    std::string warmStartFile;
+
     std::atomic<bool> shutdown_;
     std::atomic<bool> reauthorizing;
     Date reauthorizeDate;
@@ -358,8 +415,21 @@ public:
     std::shared_ptr<SlaveBanker> makeBanker(
             std::shared_ptr<ServiceProxies> proxies, const std::string& accountSuffix) const;
 
+    /** Create one SlaveBanker per master banker shard, or a single one
+        when the master banker isn't sharded.  Put them behind a
+        ShardedBanker when there is more than one.
+    */
+    std::vector<std::shared_ptr<SlaveBanker> > makeBankers(
+            std::shared_ptr<ServiceProxies> proxies, const std::string& accountSuffix) const;
+
+    /** Application layer to the given master banker shard, or to the only
+        master banker if shard is -1.  Over http, the shards are reached
+        through the banker-shard-uris array of the bootstrap.
+    */
     std::shared_ptr<ApplicationLayer> makeApplicationLayer(
-            std::shared_ptr<ServiceProxies> proxies) const;
+            std::shared_ptr<ServiceProxies> proxies, int shard = -1) const;
+
+    int numShards() const { return bankerShards; }
 
     Amount spendRate() const;
 
@@ -372,6 +442,8 @@ private:
     double syncRate;
     bool batched;
 
+    int bankerShards;
+
     bool useHttp;
     double httpTimeout;
     int httpConnections;
@@ -14,6 +14,7 @@
 #include "jml/utils/guard.h"
 #include "rtbkit/common/account_key.h"
 #include "rtbkit/core/banker/account.h"
+#include "rtbkit/core/banker/shadow_sync.h"
 #include "jml/utils/environment.h"
 #include <boost/thread/thread.hpp>
 #include "jml/arch/atomic_ops.h"
@@ -933,3 +934,296 @@ BOOST_AUTO_TEST_CASE( test_account_summary_values )
     BOOST_CHECK_EQUAL(simpleValue, expected);
 }
 
+BOOST_AUTO_TEST_CASE( test_account_summary_cached_totals )
+{
+    Accounts accounts;
+
+    AccountKey campaign("campaign");
+    AccountKey strategy("campaign:strategy");
+    AccountKey spend1("campaign:strategy:spend1");
+    AccountKey spend2("campaign:strategy:spend2");
+
+    accounts.createBudgetAccount(strategy);
+    accounts.createSpendAccount(spend1);
+    accounts.createSpendAccount(spend2);
+
+    accounts.setBudget(campaign, USD(10));
+    accounts.setBalance(strategy, USD(5), AT_NONE);
+    accounts.setBalance(spend1, USD(2), AT_NONE);
+
+    AccountSummary summary = accounts.getAccountSummary(campaign, 0);
+    BOOST_CHECK_EQUAL(summary.spent, CurrencyPool());
+    BOOST_CHECK_EQUAL(summary.effectiveBudget, USD(10));
+    BOOST_CHECK(summary.subAccounts.empty());
+
+    // Modifying a leaf must be reflected in all of its parents
+    accounts.importSpend(spend1, USD(1));
+    summary = accounts.getAccountSummary(campaign, 0);
+    BOOST_CHECK_EQUAL(summary.spent, USD(1));
+    BOOST_CHECK_EQUAL(summary.available, USD(9));
+    BOOST_CHECK_EQUAL(accounts.getAccountSummary(strategy, 0).spent, USD(1));
+
+    accounts.setBalance(spend2, USD(1), AT_NONE);
+    accounts.importSpend(spend2, USD(1));
+    summary = accounts.getAccountSummary(campaign);
+    BOOST_CHECK_EQUAL(summary.spent, USD(2));
+    BOOST_CHECK_EQUAL(summary.available, USD(8));
+    BOOST_CHECK_EQUAL(summary.subAccounts["strategy"].spent, USD(2));
+    BOOST_CHECK_EQUAL(summary.subAccounts["strategy"]
+                      .subAccounts["spend2"].spent, USD(1));
+
+    // Recycling moves budget within the tree but not out of it
+    accounts.recuperate(spend1);
+    BOOST_CHECK_EQUAL(accounts.getAccountSummary(campaign, 0).effectiveBudget,
+                      USD(10));
+    BOOST_CHECK_EQUAL(accounts.getAccountSummary(spend1, 0).effectiveBudget,
+                      USD(1));
+}
+
+
+BOOST_AUTO_TEST_CASE( test_shadow_sync_delta )
+{
+    Accounts accounts;
+
+    AccountKey campaign("campaign");
+    AccountKey strategy("campaign:strategy");
+    AccountKey spend1("campaign:strategy:spend1");
+    AccountKey spend2("campaign:strategy:spend2");
+
+    accounts.createBudgetAccount(campaign);
+    accounts.createBudgetAccount(strategy);
+    accounts.createSpendAccount(spend1);
+    accounts.createSpendAccount(spend2);
+
+    accounts.setBudget(campaign, USD(10));
+    accounts.setBalance(strategy, USD(4), AT_NONE);
+    accounts.setBalance(spend1, USD(2), AT_NONE);
+    accounts.setBalance(spend2, USD(2), AT_NONE);
+
+    ShadowAccounts shadow;
+    shadow.initializeAndMergeState(spend1, accounts.getAccount(spend1));
+    shadow.initializeAndMergeState(spend2, accounts.getAccount(spend2));
+
+    auto collect = [&] () {
+        ShadowSync::Request request;
+        shadow.forEachChangedAccount([&] (const AccountKey & key,
+                                          const ShadowAccount & account)
+            {
+                request.emplace_back(key.toString(), account);
+            });
+        return request;
+    };
+
+    // Both accounts are new and so both are sent the first time only
+    BOOST_CHECK_EQUAL(collect().size(), 2);
+    BOOST_CHECK_EQUAL(collect().size(), 0);
+
+    BOOST_CHECK(shadow.authorizeBid(spend1, "ad1", USD(1)));
+    shadow.commitBid(spend1, "ad1", MicroUSD(500000), LineItems());
+
+    auto request = collect();
+    BOOST_REQUIRE_EQUAL(request.size(), 1);
+    BOOST_CHECK_EQUAL(request[0].first, spend1.toString());
+
+    // A failed delivery puts the account back in the next round
+    shadow.markChanged(spend1);
+    request = collect();
+    BOOST_REQUIRE_EQUAL(request.size(), 1);
+
+    auto decoded = ShadowSync::decodeRequest(ShadowSync::encodeRequest(request));
+    BOOST_REQUIRE_EQUAL(decoded.size(), 1);
+    BOOST_CHECK_EQUAL(decoded[0].first, spend1.toString());
+    BOOST_CHECK_EQUAL(decoded[0].second.toJson(), request[0].second.toJson());
+
+    ShadowSync::Response response;
+    for (auto & entry: decoded) {
+        Account master
+            = accounts.syncFromShadow(AccountKey(entry.first), entry.second);
+        ShadowSync::MasterState state;
+        state.netBudget = master.getNetBudget();
+        state.status = master.status;
+        response.emplace_back(entry.first, state);
+    }
+
+    BOOST_CHECK_EQUAL(accounts.getAccount(spend1).spent, MicroUSD(500000));
+
+    auto decodedResponse
+        = ShadowSync::decodeResponse(ShadowSync::encodeResponse(response));
+    BOOST_REQUIRE_EQUAL(decodedResponse.size(), 1);
+    BOOST_CHECK_EQUAL(decodedResponse[0].second.netBudget,
+                      response[0].second.netBudget);
+    BOOST_CHECK_EQUAL(decodedResponse[0].second.status, Account::ACTIVE);
+
+    // Same result as syncing from the full master account
+    ShadowAccount expected = shadow.getAccount(spend1);
+    expected.syncFromMaster(accounts.getAccount(spend1));
+
+    shadow.syncFromMaster(spend1, decodedResponse[0].second.netBudget,
+                          decodedResponse[0].second.status);
+    BOOST_CHECK_EQUAL(shadow.getAccount(spend1).toJson(), expected.toJson());
+
+    // Taking the budget from the master doesn't count as a change
+    BOOST_CHECK_EQUAL(collect().size(), 0);
+
+    BOOST_CHECK_THROW(ShadowSync::decodeResponse(ShadowSync::encodeRequest(request)),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_accounts_dirty_tracking )
+{
+    Accounts accounts;
+
+    AccountKey campaign("campaign");
+    AccountKey strategy("campaign:strategy");
+    AccountKey other("other");
+
+    accounts.createBudgetAccount(strategy);
+    accounts.createBudgetAccount(other);
+
+    auto sorted = [] (vector<AccountKey> keys) {
+        std::sort(keys.begin(), keys.end());
+        return keys;
+    };
+
+    BOOST_CHECK(sorted(accounts.takeDirtyAccounts())
+                == sorted({ campaign, strategy, other }));
+    BOOST_CHECK(accounts.takeDirtyAccounts().empty());
+
+    // Reading doesn't dirty an account
+    accounts.getAccount(campaign);
+    accounts.getBalance(other);
+    BOOST_CHECK(accounts.takeDirtyAccounts().empty());
+
+    accounts.setBudget(other, USD(10));
+    auto dirty = accounts.takeDirtyAccounts();
+    BOOST_CHECK(dirty == vector<AccountKey>({ other }));
+
+    // A failed save puts them back
+    accounts.markAccountsDirty(dirty);
+    BOOST_CHECK(accounts.takeDirtyAccounts() == dirty);
+}
+
+BOOST_AUTO_TEST_CASE( test_accounts_batches )
+{
+    Accounts accounts;
+
+    for (unsigned i = 0;  i < 10;  ++i)
+        accounts.createBudgetAccount(AccountKey(ML::format("a:b%d", i)));
+    accounts.createBudgetAccount(AccountKey("c"));
+
+    auto dump = [&] (const AccountKey & prefix, uint64_t since,
+                     size_t batchSize, vector<AccountKey> & keys)
+        {
+            keys.clear();
+            return accounts.forEachAccountBatch(
+                    prefix, since, batchSize,
+                    [&] (Accounts::AccountBatch & batch)
+                    {
+                        BOOST_CHECK_LE(batch.size(), batchSize);
+                        for (auto & entry: batch)
+                            keys.push_back(entry.first);
+                    });
+        };
+
+    vector<AccountKey> keys;
+    uint64_t generation = dump(AccountKey(), 0, 3, keys);
+    BOOST_CHECK_EQUAL(generation, accounts.getGeneration());
+    BOOST_CHECK_EQUAL(keys.size(), 12);
+    BOOST_CHECK(std::is_sorted(keys.begin(), keys.end()));
+
+    dump(AccountKey("a"), 0, 4, keys);
+    BOOST_CHECK_EQUAL(keys.size(), 11);
+    dump(AccountKey("c"), 0, 1, keys);
+    BOOST_CHECK(keys == vector<AccountKey>({ AccountKey("c") }));
+
+    // Only the accounts modified since the previous dump
+    dump(AccountKey(), generation, 2, keys);
+    BOOST_CHECK(keys.empty());
+
+    accounts.getAccount(AccountKey("c"));
+    dump(AccountKey(), generation, 2, keys);
+    BOOST_CHECK(keys.empty());
+
+    accounts.setBudget(AccountKey("c"), USD(10));
+    generation = dump(AccountKey(), generation, 2, keys);
+    BOOST_CHECK(keys == vector<AccountKey>({ AccountKey("c") }));
+
+    dump(AccountKey(), generation, 2, keys);
+    BOOST_CHECK(keys.empty());
+
+    // A generation from another session dumps everything
+    dump(AccountKey(), generation + 100, 5, keys);
+    BOOST_CHECK_EQUAL(keys.size(), 12);
+}
+
+BOOST_AUTO_TEST_CASE( test_shadow_provisional_budget )
+{
+    Accounts accounts;
+
+    AccountKey campaign("campaign");
+    AccountKey spend("campaign:router");
+
+    accounts.createBudgetAccount(campaign);
+    accounts.createSpendAccount(spend);
+    accounts.setBudget(campaign, USD(10));
+    accounts.setBalance(spend, USD(3), AT_SPEND);
+
+    ShadowAccounts shadow;
+
+    // What was left before a restart can be bid straight away
+    BOOST_CHECK(shadow.setProvisionalBudget(spend, CurrencyPool(USD(2)),
+                                            Account::ACTIVE));
+    BOOST_CHECK(!shadow.isInitialized(spend));
+
+    BOOST_CHECK(shadow.authorizeBid(spend, "ad1", USD(1)));
+    BOOST_CHECK(shadow.authorizeBid(spend, "ad2", USD(1)));
+    BOOST_CHECK(!shadow.authorizeBid(spend, "ad3", USD(1)));
+    shadow.commitBid(spend, "ad1", USD(0.50), LineItems());
+    shadow.checkInvariants();
+
+    // The master's budget replaces it and what was done meanwhile is kept
+    ShadowAccount account
+        = shadow.initializeAndMergeState(spend, accounts.getAccount(spend));
+    BOOST_CHECK_EQUAL(account.netBudget, CurrencyPool(USD(3)));
+    BOOST_CHECK_EQUAL(account.spent, CurrencyPool(USD(0.50)));
+    BOOST_CHECK_EQUAL(account.balance, CurrencyPool(USD(1.50)));
+
+    BOOST_CHECK(!shadow.setProvisionalBudget(spend, CurrencyPool(USD(2)),
+                                             Account::ACTIVE));
+}
+
+BOOST_AUTO_TEST_CASE( test_shadow_budget_availability )
+{
+    Accounts accounts;
+
+    AccountKey campaign("availability");
+    AccountKey spend("availability:router");
+
+    accounts.createBudgetAccount(campaign);
+    accounts.createSpendAccount(spend);
+    accounts.setBudget(campaign, USD(10));
+    accounts.setBalance(spend, USD(2), AT_SPEND);
+
+    ShadowAccounts shadow;
+    auto availability = shadow.budgetAvailability();
+    AccountKeyId id = AccountKeyId::intern(spend);
+
+    // Unknown accounts are assumed to have budget
+    BOOST_CHECK(availability->available(id));
+
+    shadow.initializeAndMergeState(spend, accounts.getAccount(spend));
+    BOOST_CHECK(availability->available(id));
+
+    // Failing to authorize a bid marks the account as exhausted...
+    BOOST_CHECK(shadow.authorizeBid(id, "ad1", USD(2)));
+    BOOST_CHECK(availability->available(id));
+    BOOST_CHECK(!shadow.authorizeBid(id, "ad2", USD(1)));
+    BOOST_CHECK(!availability->available(id));
+    BOOST_CHECK_EQUAL(availability->numExhausted(), 1);
+
+    // ... until a sync brings it more budget
+    accounts.setBalance(spend, USD(5), AT_SPEND);
+    shadow.syncFromMaster(spend, accounts.getAccount(spend));
+    BOOST_CHECK(availability->available(id));
+    BOOST_CHECK_EQUAL(availability->numExhausted(), 0);
+}
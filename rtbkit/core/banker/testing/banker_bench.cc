@@ -0,0 +1,642 @@
+/** banker_bench.cc                                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Throughput and latency bench for the bankers.
+
+    Drives one of the banker implementations from a number of bidder
+    threads and reports the ops/sec and latency percentiles of each kind of
+    operation:
+
+    - slave: a SlaveBanker talking to an in-process MasterBanker over zmq,
+      which is what the router and post auction loop use;
+    - master: the MasterBanker accounts directly; each operation is applied
+      to a shadow account and synced to the master straight away, which is
+      the worst case of a slave syncing on every bid;
+    - local: a pair of LocalBanker (router and post auction side) talking
+      to the go banker at --local-uri.
+
+    Operations are either generated (each bid is authorized then either
+    committed or cancelled according to --win-ratio) or replayed from a
+    spend log given with --replay.  The log has one operation per line:
+
+        authorize <account> <item> <amount in micro USD>
+        commit <account> <item> <amount in micro USD>
+        cancel <account> <item>
+        win <account> <amount in micro USD>
+
+    Blank lines and lines starting with # are ignored.  The lines are split
+    between the threads by item so that the operations on a bid stay in
+    order.
+
+*/
+
+#include "rtbkit/core/banker/master_banker.h"
+#include "rtbkit/core/banker/slave_banker.h"
+#include "rtbkit/core/banker/local_banker.h"
+#include "soa/service/zmq_endpoint.h"
+#include "soa/utils/print_utils.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/filter_streams.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        banker("slave"), accounts(100), threads(4), durationSec(10),
+        winRatio(0.1), bidPriceMicros(2000), localUri("http://localhost:27000")
+    {}
+
+    string banker;
+    size_t accounts;
+    size_t threads;
+    size_t durationSec;
+    double winRatio;
+    int64_t bidPriceMicros;
+    string replay;
+    string localUri;
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt;
+    opt.add_options()
+        ("banker,b", value<string>(&config.banker),
+         "banker to bench: slave, master or local")
+        ("accounts,a", value<size_t>(&config.accounts),
+         "number of spend accounts")
+        ("threads,t", value<size_t>(&config.threads),
+         "number of bidder threads")
+        ("durationSec,d", value<size_t>(&config.durationSec),
+         "duration of a generated run")
+        ("win-ratio,w", value<double>(&config.winRatio),
+         "fraction of authorized bids that are committed, the rest are cancelled")
+        ("bid-price,p", value<int64_t>(&config.bidPriceMicros),
+         "bid price in micro USD")
+        ("replay,r", value<string>(&config.replay),
+         "spend log to replay instead of generating bids")
+        ("local-uri", value<string>(&config.localUri),
+         "uri of the go banker for the local banker")
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    if (config.threads == 0 || config.accounts == 0)
+        throw ML::Exception("need at least one thread and one account");
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* LATENCY                                                                    */
+/******************************************************************************/
+
+/** Latency histogram with buckets 1% wide, which is precise enough for the
+    percentiles and can be merged across threads.
+*/
+struct Latency
+{
+    Latency() : buckets(NumBuckets, 0), count(0) {}
+
+    void record(uint64_t ns)
+    {
+        size_t bucket = ns < 1 ? 0 : std::log(double(ns)) / LogBase;
+        buckets[std::min<size_t>(bucket, NumBuckets - 1)]++;
+        count++;
+    }
+
+    Latency & operator += (const Latency & other)
+    {
+        for (size_t i = 0; i < NumBuckets; ++i)
+            buckets[i] += other.buckets[i];
+        count += other.count;
+        return *this;
+    }
+
+    /** Upper bound in nanoseconds of the given percentile. */
+    double percentile(double pct) const
+    {
+        uint64_t target = std::ceil(count * pct / 100.0);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < NumBuckets; ++i) {
+            seen += buckets[i];
+            if (seen >= target && seen > 0)
+                return std::exp((i + 1) * LogBase);
+        }
+        return 0.0;
+    }
+
+    static constexpr size_t NumBuckets = 2500;
+    static constexpr double LogBase = 0.00995033; // log(1.01)
+
+    vector<uint64_t> buckets;
+    uint64_t count;
+};
+
+enum Op { AUTHORIZE, COMMIT, CANCEL, WIN, NUM_OPS };
+
+const char * opName(Op op)
+{
+    switch (op) {
+    case AUTHORIZE: return "authorize";
+    case COMMIT: return "commit";
+    case CANCEL: return "cancel";
+    case WIN: return "win";
+    default: ExcAssert(false);
+    }
+}
+
+struct Stats
+{
+    Stats() : latencies(NUM_OPS), noBids(0) {}
+
+    Stats & operator += (const Stats & other)
+    {
+        for (size_t i = 0; i < NUM_OPS; ++i)
+            latencies[i] += other.latencies[i];
+        noBids += other.noBids;
+        return *this;
+    }
+
+    vector<Latency> latencies;
+    uint64_t noBids;
+};
+
+
+/******************************************************************************/
+/* DRIVERS                                                                    */
+/******************************************************************************/
+
+/** Banker under test.  All the calls but init() are made concurrently from
+    the bidder threads.
+*/
+struct Driver
+{
+    virtual ~Driver() {}
+
+    virtual void init(const vector<AccountKey> & accounts,
+                      CurrencyPool budget) = 0;
+
+    virtual bool authorize(const AccountKey & account, const string & item,
+                           Amount amount) = 0;
+    virtual void commit(const AccountKey & account, const string & item,
+                        Amount amount) = 0;
+    virtual void cancel(const AccountKey & account, const string & item) = 0;
+    virtual void win(const AccountKey & account, Amount amount) = 0;
+};
+
+// Note: we want a seperate zmq context to avoid unrealistic zmq fast-paths.
+std::shared_ptr<ServiceProxies>
+makeProxies()
+{
+    static auto configService = std::make_shared<InternalConfigurationService>();
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    proxies->config = configService;
+    return proxies;
+}
+
+struct SlaveDriver : public Driver
+{
+    SlaveDriver() : master(makeProxies(), "rtbBanker") {}
+
+    void init(const vector<AccountKey> & accounts, CurrencyPool budget)
+    {
+        master.init(std::make_shared<NoBankerPersistence>());
+        master.bindTcp();
+        master.start();
+
+        controller.setApplicationLayer(
+                make_application_layer<ZmqLayer>(makeProxies()));
+        controller.start();
+
+        slave.init("bench", budget);
+        slave.setApplicationLayer(
+                make_application_layer<ZmqLayer>(makeProxies()));
+        slave.start();
+
+        for (const auto & account: accounts) {
+            controller.addAccountSync(account);
+            controller.setBudgetSync(account.front(), budget);
+            controller.topupTransferSync(account, budget);
+            slave.addSpendAccountSync(account);
+        }
+
+        slave.waitReauthorized();
+    }
+
+    bool authorize(const AccountKey & account, const string & item,
+                   Amount amount)
+    {
+        return slave.authorizeBid(account, item, amount);
+    }
+
+    void commit(const AccountKey & account, const string & item, Amount amount)
+    {
+        slave.commitBid(account, item, amount, LineItems());
+    }
+
+    void cancel(const AccountKey & account, const string & item)
+    {
+        slave.cancelBid(account, item);
+    }
+
+    void win(const AccountKey & account, Amount amount)
+    {
+        slave.forceWinBid(account, amount, LineItems());
+    }
+
+    MasterBanker master;
+    SlaveBudgetController controller;
+    SlaveBanker slave;
+};
+
+struct MasterDriver : public Driver
+{
+    MasterDriver() : master(makeProxies(), "rtbBanker") {}
+
+    void init(const vector<AccountKey> & accounts, CurrencyPool budget)
+    {
+        master.init(std::make_shared<NoBankerPersistence>());
+
+        for (const auto & account: accounts) {
+            AccountKey spend = spendKey(account);
+            master.accounts.createBudgetAccount(account.front());
+            master.accounts.setBudget(account.front(), budget);
+            master.accounts.setBalance(account, budget, AT_BUDGET);
+            master.accounts.setBalance(spend, budget, AT_SPEND);
+            shadow.initializeAndMergeState(spend,
+                                           master.accounts.getAccount(spend));
+        }
+    }
+
+    bool authorize(const AccountKey & account, const string & item,
+                   Amount amount)
+    {
+        AccountKey spend = spendKey(account);
+        bool result = shadow.authorizeBid(spend, item, amount);
+        sync(spend);
+        return result;
+    }
+
+    void commit(const AccountKey & account, const string & item, Amount amount)
+    {
+        AccountKey spend = spendKey(account);
+        shadow.commitBid(spend, item, amount, LineItems());
+        sync(spend);
+    }
+
+    void cancel(const AccountKey & account, const string & item)
+    {
+        AccountKey spend = spendKey(account);
+        shadow.cancelBid(spend, item);
+        sync(spend);
+    }
+
+    void win(const AccountKey & account, Amount amount)
+    {
+        AccountKey spend = spendKey(account);
+        shadow.forceWinBid(spend, amount, LineItems());
+        sync(spend);
+    }
+
+private:
+    static AccountKey spendKey(const AccountKey & account)
+    {
+        return account.childKey("bench");
+    }
+
+    void sync(const AccountKey & spend)
+    {
+        master.accounts.syncFromShadow(spend, shadow.getAccount(spend));
+    }
+
+    MasterBanker master;
+    ShadowAccounts shadow;
+};
+
+struct LocalDriver : public Driver
+{
+    LocalDriver(const string & uri) :
+        uri(uri),
+        router(makeProxies(), ROUTER, "bench"),
+        postAuction(makeProxies(), POST_AUCTION, "bench")
+    {}
+
+    void init(const vector<AccountKey> & accounts, CurrencyPool budget)
+    {
+        for (auto banker: { &router, &postAuction }) {
+            banker->init(uri);
+            banker->start();
+            for (const auto & account: accounts)
+                banker->addSpendAccount(account, CurrencyPool(), nullptr);
+        }
+
+        // Accounts are created and given their first budget asynchronously
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+    }
+
+    bool authorize(const AccountKey & account, const string & item,
+                   Amount amount)
+    {
+        return router.authorizeBid(account, item, amount);
+    }
+
+    void commit(const AccountKey & account, const string & item, Amount amount)
+    {
+        postAuction.winBid(account, item, amount);
+    }
+
+    void cancel(const AccountKey & account, const string & item)
+    {
+        router.cancelBid(account, item);
+    }
+
+    void win(const AccountKey & account, Amount amount)
+    {
+        postAuction.forceWinBid(account, amount, LineItems());
+    }
+
+    string uri;
+    LocalBanker router;
+    LocalBanker postAuction;
+};
+
+std::unique_ptr<Driver>
+makeDriver(const Config & config)
+{
+    if (config.banker == "slave")
+        return std::unique_ptr<Driver>(new SlaveDriver());
+    if (config.banker == "master")
+        return std::unique_ptr<Driver>(new MasterDriver());
+    if (config.banker == "local")
+        return std::unique_ptr<Driver>(new LocalDriver(config.localUri));
+    throw ML::Exception("unknown banker '%s'", config.banker.c_str());
+}
+
+
+/******************************************************************************/
+/* WORKLOAD                                                                   */
+/******************************************************************************/
+
+struct Operation
+{
+    Op op;
+    AccountKey account;
+    string item;
+    Amount amount;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+template<typename Fn>
+void timed(Stats & stats, Op op, Fn && fn)
+{
+    auto start = Clock::now();
+    fn();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count();
+    stats.latencies[op].record(ns);
+}
+
+void execute(Driver & driver, Stats & stats, const Operation & op)
+{
+    switch (op.op) {
+    case AUTHORIZE:
+        timed(stats, AUTHORIZE, [&] {
+                    if (!driver.authorize(op.account, op.item, op.amount))
+                        stats.noBids++;
+                });
+        break;
+    case COMMIT:
+        timed(stats, COMMIT, [&] {
+                    driver.commit(op.account, op.item, op.amount);
+                });
+        break;
+    case CANCEL:
+        timed(stats, CANCEL, [&] { driver.cancel(op.account, op.item); });
+        break;
+    case WIN:
+        timed(stats, WIN, [&] { driver.win(op.account, op.amount); });
+        break;
+    default:
+        ExcAssert(false);
+    }
+}
+
+void generate(Driver & driver, Stats & stats, const Config & config,
+              const vector<AccountKey> & accounts, size_t thread,
+              const std::atomic<bool> & done)
+{
+    std::mt19937 rng(thread);
+    std::uniform_int_distribution<size_t> pickAccount(0, accounts.size() - 1);
+    std::uniform_real_distribution<double> pickOutcome(0.0, 1.0);
+
+    Amount price = MicroUSD(config.bidPriceMicros);
+    string prefix = "t" + to_string(thread) + "-";
+
+    for (uint64_t i = 0; !done; ++i) {
+        Operation op;
+        op.account = accounts[pickAccount(rng)];
+        op.item = prefix + to_string(i);
+        op.amount = price;
+
+        op.op = AUTHORIZE;
+        execute(driver, stats, op);
+
+        if (pickOutcome(rng) < config.winRatio) {
+            op.op = COMMIT;
+            op.amount = MicroUSD(config.bidPriceMicros / 2);
+        }
+        else op.op = CANCEL;
+        execute(driver, stats, op);
+    }
+}
+
+/** Parse the spend log into one list of operations per thread. */
+vector<vector<Operation> >
+loadReplay(const Config & config, vector<AccountKey> & accounts)
+{
+    vector<vector<Operation> > result(config.threads);
+    std::set<AccountKey> seen;
+
+    filter_istream stream(config.replay);
+    string line;
+    size_t lineNum = 0;
+
+    while (getline(stream, line)) {
+        ++lineNum;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        istringstream fields(line);
+        string op, account, item;
+        int64_t micros = 0;
+        fields >> op >> account;
+
+        Operation operation;
+        if (op == "authorize" || op == "commit") {
+            operation.op = op == "authorize" ? AUTHORIZE : COMMIT;
+            fields >> item >> micros;
+        }
+        else if (op == "cancel") {
+            operation.op = CANCEL;
+            fields >> item;
+        }
+        else if (op == "win") {
+            operation.op = WIN;
+            fields >> micros;
+        }
+        else fields.setstate(ios::failbit);
+
+        if (!fields)
+            throw ML::Exception("%s:%zd: invalid spend log line '%s'",
+                                config.replay.c_str(), lineNum, line.c_str());
+
+        operation.account = AccountKey(account);
+        operation.item = item;
+        operation.amount = MicroUSD(micros);
+
+        if (seen.insert(operation.account).second)
+            accounts.push_back(operation.account);
+
+        size_t thread = std::hash<string>()(item.empty() ? account : item)
+            % config.threads;
+        result[thread].push_back(std::move(operation));
+    }
+
+    return result;
+}
+
+
+/******************************************************************************/
+/* REPORT                                                                     */
+/******************************************************************************/
+
+void report(const Stats & stats, double seconds)
+{
+    uint64_t total = 0;
+    for (const auto & latency: stats.latencies)
+        total += latency.count;
+
+    cerr << "\n"
+        << printValue(seconds) << " Duration (s)\n"
+        << printValue(total / seconds) << " Ops/sec\n"
+        << printValue(stats.noBids) << " Refused authorizations\n"
+        << endl;
+
+    for (size_t i = 0; i < NUM_OPS; ++i) {
+        const Latency & latency = stats.latencies[i];
+        if (!latency.count)
+            continue;
+
+        cerr << opName((Op) i) << ": "
+            << "ops/sec=" << printValue(latency.count / seconds)
+            << ", p50=" << printValue(latency.percentile(50) / 1000.0) << "us"
+            << ", p99=" << printValue(latency.percentile(99) / 1000.0) << "us"
+            << ", p999=" << printValue(latency.percentile(99.9) / 1000.0) << "us"
+            << endl;
+    }
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    ZmqLogs::print.deactivate();
+    MessageLoopLogs::print.deactivate();
+    SlaveBanker::print.deactivate();
+    MasterBanker::print.deactivate();
+
+    auto config = getConfig(argc, argv);
+
+    vector<AccountKey> accounts;
+    vector<vector<Operation> > replay;
+
+    if (!config.replay.empty())
+        replay = loadReplay(config, accounts);
+    else {
+        for (size_t i = 0; i < config.accounts; ++i)
+            accounts.emplace_back(vector<string>{
+                        "bench" + to_string(i), "strategy" });
+    }
+
+    auto driver = makeDriver(config);
+
+    // Enough budget that the bench measures the banker, not the budget.
+    driver->init(accounts, CurrencyPool(MicroUSD(1000000000000)));
+
+    cerr << "bench " << config.banker << " with " << accounts.size()
+         << " accounts and " << config.threads << " threads" << endl;
+
+    vector<Stats> stats(config.threads);
+    vector<std::thread> threads;
+    std::atomic<bool> done(false);
+
+    auto start = Clock::now();
+
+    for (size_t t = 0; t < config.threads; ++t) {
+        threads.emplace_back([&, t] {
+                    if (replay.empty())
+                        generate(*driver, stats[t], config, accounts, t, done);
+                    else {
+                        for (const auto & op: replay[t])
+                            execute(*driver, stats[t], op);
+                    }
+                });
+    }
+
+    if (replay.empty()) {
+        std::this_thread::sleep_for(std::chrono::seconds(config.durationSec));
+        done = true;
+    }
+
+    for (auto & th: threads)
+        th.join();
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Stats total;
+    for (const auto & s: stats)
+        total += s;
+
+    report(total, seconds);
+
+    // No worth trying to figure out the various shutdown issues.
+    _exit(0);
+}
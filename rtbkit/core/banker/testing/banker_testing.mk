@@ -29,8 +29,13 @@ $(eval $(call library,banker_temporary_server, \
 $(eval $(call test,master_banker_test,banker mock_banker_persistence,boost))
 $(eval $(call test,slave_banker_test,banker mock_banker_persistence,boost manual))
 $(eval $(call test,banker_account_test,banker,boost))
+$(eval $(call test,sharded_banker_test,banker,boost))
+$(eval $(call test,shadow_accounts_contention_test,banker,boost))
 $(eval $(call test,banker_behaviour_test,banker banker_temporary_server,boost manual))
 $(eval $(call test,redis_persistence_test,banker,boost))
 $(eval $(call test,local_banker_test,gobanker banker,boost manual))
+$(eval $(call test,go_account_test,gobanker,boost))
 
-banker_tests: master_banker_test slave_banker_test banker_account_test banker_behaviour_test redis_persistence_test
+banker_tests: go_account_test master_banker_test slave_banker_test banker_account_test sharded_banker_test shadow_accounts_contention_test banker_behaviour_test redis_persistence_test
+
+$(eval $(call program,banker_bench,banker gobanker boost_program_options))
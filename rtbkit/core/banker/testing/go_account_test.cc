@@ -0,0 +1,82 @@
+/* go_account_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the lock-free go banker accounts.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/banker/go_account.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_router_balance )
+{
+    GoAccounts accounts;
+    AccountKey key("campaign:strategy:router");
+
+    BOOST_CHECK(!accounts.bid(key, MicroUSD(1)));
+    accounts.add(key, ROUTER);
+    BOOST_CHECK(accounts.exists(key));
+    BOOST_CHECK_EQUAL(accounts.size(), 1);
+
+    accounts.setMaxBalance(key, MicroUSD(100));
+    accounts.accumulateBalance(key, MicroUSD(150));
+    BOOST_CHECK_EQUAL(accounts.getBalance(key), MicroUSD(100));
+
+    BOOST_CHECK(accounts.bid(key, MicroUSD(60)));
+    BOOST_CHECK(!accounts.bid(key, MicroUSD(60)));
+
+    // What was spent since the last update is given back
+    BOOST_CHECK_EQUAL(accounts.updateBalance(key, MicroUSD(10)),
+                      MicroUSD(60));
+    BOOST_CHECK_EQUAL(accounts.getBalance(key), MicroUSD(10));
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_bids )
+{
+    GoAccounts accounts;
+    AccountKey key("campaign:strategy:router");
+    accounts.add(key, ROUTER);
+    accounts.updateBalance(key, MicroUSD(10000));
+
+    enum { NumThreads = 8, BidsPerThread = 10000 };
+    std::atomic<int> won(0);
+
+    vector<thread> threads;
+    for (int i = 0;  i < NumThreads;  ++i) {
+        threads.emplace_back([&, i] () {
+                for (int j = 0;  j < BidsPerThread;  ++j) {
+                    if (accounts.bid(key, MicroUSD(1)))
+                        ++won;
+
+                    // New accounts get published in the middle of the bids
+                    if (j % 1000 == 0)
+                        accounts.add(AccountKey("other" + to_string(i)
+                                                + ":" + to_string(j)),
+                                     ROUTER);
+                }
+            });
+    }
+    for (auto & th: threads)
+        th.join();
+
+    // The balance is never overspent and every bid is counted
+    BOOST_CHECK_EQUAL(won, 10000);
+    BOOST_CHECK_EQUAL(accounts.getBalance(key), MicroUSD(0));
+
+    int bids = 0;
+    accounts.forEach([&] (const AccountKey & account, GoAccount & goAccount) {
+            if (account == key)
+                bids = goAccount.router->bidsLastPeriod;
+        });
+    BOOST_CHECK_EQUAL(bids, NumThreads * BidsPerThread);
+    BOOST_CHECK_EQUAL(accounts.size(), 1 + NumThreads * BidsPerThread / 1000);
+}
@@ -52,10 +52,10 @@ BOOST_AUTO_TEST_CASE( test_local_banker )
     }
     auto end = Date().now();
     auto taken = end - start;
-    while (pBanker.accounts.accounts.size() < 100 || rBanker.accounts.accounts.size() < 100) {
+    while (pBanker.accounts.size() < 100 || rBanker.accounts.size() < 100) {
         ML::sleep(0.01);
-        //cout << "p: " << pBanker.accounts.accounts.size()
-        //     << " r: " << rBanker.accounts.accounts.size() << endl;
+        //cout << "p: " << pBanker.accounts.size()
+        //     << " r: " << rBanker.accounts.size() << endl;
         continue;
     }
     cout << "time taken: " << taken << endl;
@@ -0,0 +1,154 @@
+/* shadow_accounts_contention_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Contention benchmark for the shadow accounts: many bidder threads
+   authorizing and committing bids at the same time, the way the router and
+   post auction loop do.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/common/account_key.h"
+#include "rtbkit/core/banker/account.h"
+#include "jml/arch/timers.h"
+#include <atomic>
+#include <thread>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+/** Run nThreads bidders spread over nAccounts accounts, each doing
+    bidsPerThread authorize/commit pairs, and check that the bank balances.
+*/
+void runContention(int nThreads, int nAccounts, int bidsPerThread)
+{
+    Accounts accounts;
+    ShadowAccounts shadow;
+
+    AccountKey campaign("campaign");
+    accounts.createBudgetAccount(campaign);
+    accounts.setBudget(campaign, MicroUSD(int64_t(nThreads) * bidsPerThread * 2));
+
+    vector<AccountKey> spend;
+    for (int i = 0;  i < nAccounts;  ++i) {
+        AccountKey strategy("campaign:strategy" + to_string(i));
+        spend.push_back(strategy.childKey("spend"));
+        accounts.createBudgetAccount(strategy);
+        accounts.createSpendAccount(spend.back());
+
+        // Enough for every bid that can land on this account.
+        accounts.setBalance(strategy,
+                            MicroUSD(int64_t(nThreads) * bidsPerThread * 2 / nAccounts),
+                            AT_NONE);
+        accounts.setBalance(spend.back(),
+                            MicroUSD(int64_t(nThreads) * bidsPerThread / nAccounts),
+                            AT_NONE);
+
+        shadow.activateAccount(spend.back());
+    }
+    shadow.syncFrom(accounts);
+
+    std::atomic<uint64_t> authorized(0);
+    std::atomic<uint64_t> committed(0);
+
+    auto runBidThread = [&] (int threadNum)
+        {
+            uint64_t auth = 0, comm = 0;
+
+            for (int i = 0;  i < bidsPerThread;  ++i) {
+                const AccountKey & account = spend[(threadNum + i) % nAccounts];
+                string item = to_string(threadNum) + ":" + to_string(i);
+
+                if (!shadow.authorizeBid(account, item, MicroUSD(1)))
+                    continue;
+                ++auth;
+
+                // One bid in two wins.
+                if (i % 2) {
+                    shadow.commitBid(account, item, MicroUSD(1), LineItems());
+                    ++comm;
+                }
+                else shadow.cancelBid(account, item);
+            }
+
+            authorized += auth;
+            committed += comm;
+        };
+
+    Timer timer;
+
+    vector<std::thread> threads;
+    for (int i = 0;  i < nThreads;  ++i)
+        threads.emplace_back(runBidThread, i);
+    for (auto & th: threads)
+        th.join();
+
+    double elapsed = timer.elapsed_wall();
+    uint64_t ops = authorized + committed;
+
+    cerr << nThreads << " threads over " << nAccounts << " accounts: "
+         << ops << " operations in " << elapsed << "s ("
+         << ops / elapsed << " ops/s)" << endl;
+
+    BOOST_CHECK_EQUAL(authorized, uint64_t(nThreads) * bidsPerThread);
+    BOOST_CHECK_EQUAL(committed, uint64_t(nThreads) * bidsPerThread / 2);
+
+    shadow.checkInvariants();
+    shadow.syncTo(accounts);
+
+    Amount spent;
+    for (auto & account: spend) {
+        BOOST_CHECK_EQUAL(shadow.getAccount(account).commitments.size(), 0);
+        spent += accounts.getAccount(account).spent.getAvailable(CurrencyCode::CC_USD);
+    }
+    BOOST_CHECK_EQUAL(spent, MicroUSD(committed.load()));
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_shadow_accounts_one_account )
+{
+    runContention(8, 1, 20000);
+}
+
+BOOST_AUTO_TEST_CASE( test_shadow_accounts_many_accounts )
+{
+    runContention(40, 64, 20000);
+}
+
+BOOST_AUTO_TEST_CASE( test_shadow_accounts_account_creation )
+{
+    // Threads racing to create the same accounts must end up with exactly
+    // one copy of each, and listing them must still be in key order.
+    ShadowAccounts shadow;
+
+    int nThreads = 16;
+    vector<std::thread> threads;
+    for (int i = 0;  i < nThreads;  ++i) {
+        threads.emplace_back([&shadow, i] ()
+            {
+                for (int j = 0;  j < 500;  ++j)
+                    shadow.activateAccount(
+                            AccountKey("campaign" + to_string(j % 100)
+                                       + ":strategy" + to_string(i)));
+            });
+    }
+    for (auto & th: threads)
+        th.join();
+
+    BOOST_CHECK_EQUAL(shadow.size(), 100 * nThreads);
+
+    auto keys = shadow.getAccountKeys();
+    BOOST_CHECK_EQUAL(keys.size(), 100 * nThreads);
+    BOOST_CHECK(std::is_sorted(keys.begin(), keys.end()));
+
+    auto campaign0 = shadow.getAccountKeys(AccountKey("campaign0"));
+    BOOST_CHECK_EQUAL(campaign0.size(), nThreads);
+}
@@ -0,0 +1,86 @@
+/* sharded_banker_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Unit tests for the ShardedBanker class
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/banker/sharded_banker.h"
+#include "rtbkit/core/banker/null_banker.h"
+
+#include <memory>
+#include <set>
+
+using namespace std;
+using namespace RTBKIT;
+
+namespace {
+
+/** Banker that remembers the top-level accounts it was asked about. */
+struct RecordingBanker : public NullBanker {
+    RecordingBanker() : NullBanker(true) {}
+
+    std::set<std::string> seen;
+
+    virtual bool authorizeBid(const AccountKey & account,
+                              const std::string & item,
+                              Amount amount)
+    {
+        seen.insert(account[0]);
+        return true;
+    }
+
+    virtual void commitBid(const AccountKey & account,
+                           const std::string & item,
+                           Amount amountPaid,
+                           const LineItems & lineItems)
+    {
+        seen.insert(account[0]);
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_banker_shard_for )
+{
+    BOOST_CHECK_EQUAL(bankerShardFor("anything", 1), 0);
+    BOOST_CHECK_EQUAL(bankerServiceClass(), "rtbBanker");
+    BOOST_CHECK_EQUAL(bankerServiceClass(2), "rtbBanker.shard2");
+
+    // Every shard gets some of the accounts
+    std::set<size_t> shards;
+    for (int i = 0;  i < 100;  ++i)
+        shards.insert(bankerShardFor("campaign" + to_string(i), 4));
+    BOOST_CHECK_EQUAL(shards.size(), 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_sharded_banker_routing )
+{
+    vector<shared_ptr<RecordingBanker> > shards;
+    for (int i = 0;  i < 3;  ++i)
+        shards.push_back(make_shared<RecordingBanker>());
+
+    auto banker = makeShardedBanker(shards);
+
+    for (int i = 0;  i < 50;  ++i) {
+        AccountKey account{ "campaign" + to_string(i), "strategy" };
+        BOOST_CHECK(banker->authorizeBid(account, "item", MicroUSD(1)));
+        banker->winBid(account, "item", MicroUSD(1));
+    }
+
+    // Each top-level account went to its shard and only to it
+    size_t total = 0;
+    for (size_t shard = 0;  shard < shards.size();  ++shard) {
+        for (const auto & name: shards[shard]->seen)
+            BOOST_CHECK_EQUAL(bankerShardFor(name, shards.size()), shard);
+        total += shards[shard]->seen.size();
+    }
+    BOOST_CHECK_EQUAL(total, 50);
+
+    // A single shard is used as is
+    vector<shared_ptr<RecordingBanker> > one(1, shards[0]);
+    BOOST_CHECK_EQUAL(makeShardedBanker(one).get(), shards[0].get());
+}
@@ -112,6 +112,22 @@ struct EventMatcher : public EventRecorder
 
     virtual void initStatePersistence(const std::string & path) {}
 
+    /** Move won auctions that are older than age seconds out of memory and
+        into a LevelDB store in the given directory, where they're kept until
+        the win timeout.  Must be called before the matcher is started.
+    */
+    virtual void initFinishedSpill(const std::string & path, float age) {}
+
+
+    /************************************************************************/
+    /* THREADING                                                            */
+    /************************************************************************/
+
+    /** Pin the threads owned by the matcher to the given cpus.  Matchers
+        without threads of their own ignore this.
+    */
+    virtual void pinShards(const std::vector<int> & cpus) {}
+
 
 protected:
 
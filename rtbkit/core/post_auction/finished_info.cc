@@ -79,6 +79,43 @@ toJson() const
     return result;
 }
 
+void
+FinishedInfo::
+serialize(DB::Store_Writer & store) const
+{
+    unsigned char version = 1;
+    store << version << auctionTime << auctionId << adSpotId << spotIndex
+          << bidRequestStrFormat << bidRequestStrRef.str()
+          << augmentationsRef.str() << uids << visitChannels
+          << bidTime << bid << winTime << (int)reportedStatus
+          << winPrice << rawWinPrice << winMeta << campaignEvents
+          << visits << retainUntil << fromOldRouter;
+}
+
+void
+FinishedInfo::
+reconstitute(DB::Store_Reader & store, StringBlockStore & strings)
+{
+    unsigned char version;
+    store >> version;
+    if (version != 1)
+        throw ML::Exception("invalid FinishedInfo version");
+
+    std::string bidRequest, augs;
+    int status;
+
+    store >> auctionTime >> auctionId >> adSpotId >> spotIndex
+          >> bidRequestStrFormat >> bidRequest
+          >> augs >> uids >> visitChannels
+          >> bidTime >> bid >> winTime >> status
+          >> winPrice >> rawWinPrice >> winMeta >> campaignEvents
+          >> visits >> retainUntil >> fromOldRouter;
+
+    bidRequestStrRef = strings.add(bidRequest);
+    augmentationsRef = strings.add(augs);
+    reportedStatus = (BidStatus)status;
+}
+
 void
 FinishedInfo::Visit::
 serialize(DB::Store_Writer & store) const
@@ -10,6 +10,7 @@
 
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/auction_events.h"
+#include "rtbkit/core/post_auction/string_block_store.h"
 #include "soa/types/string.h"
 
 #include <memory>
@@ -28,7 +29,7 @@ namespace RTBKIT {
 
 struct FinishedInfo {
     FinishedInfo()
-        : fromOldRouter(false)
+        : spotIndex(-1), reportedStatus(BS_LOSS), fromOldRouter(false)
     {
     }
 
@@ -37,9 +38,25 @@ struct FinishedInfo {
     Id auctionId;       ///< Auction ID from host
     Id adSpotId;          ///< Spot ID from host
     int spotIndex;
-    Datacratic::UnicodeString bidRequestStr;
     std::string bidRequestStrFormat;
-    JsonHolder augmentations;
+
+    /** The bid request and augmentations are only read back when an event
+        is matched so they are kept compressed in the event matcher's string
+        store and expanded on demand.
+    */
+    StringBlockStore::Ref bidRequestStrRef;
+    StringBlockStore::Ref augmentationsRef;
+
+    Datacratic::UnicodeString bidRequestStr() const
+    {
+        return Datacratic::UnicodeString(bidRequestStrRef.str());
+    }
+
+    JsonHolder augmentations() const
+    {
+        return JsonHolder(augmentationsRef.str());
+    }
+
     std::set<Id> uids;                ///< All UIDs for this user
 
     /** The set of channels that are associated with this request.  They
@@ -127,7 +144,18 @@ struct FinishedInfo {
 
     Json::Value toJson() const;
 
+    /** Date past which nothing can be matched against this entry anymore.
+        Used when the entry outlives its in-memory timeout in a spill store.
+    */
+    Date retainUntil;
+
     bool fromOldRouter;
+
+    /** The compressed strings are written out expanded; they are added back
+        into the given store when reconstituted.
+    */
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store, StringBlockStore & strings);
 };
 
 
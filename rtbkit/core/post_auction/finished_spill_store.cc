@@ -0,0 +1,214 @@
+/** finished_spill_store.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Implementation of the finished auction spill store.
+
+*/
+
+#include "finished_spill_store.h"
+#include "jml/db/persistent.h"
+#include "leveldb/db.h"
+#include "leveldb/cache.h"
+#include "leveldb/options.h"
+#include "leveldb/env.h"
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* UTILS                                                                     */
+/*****************************************************************************/
+
+namespace {
+
+/* Entries are stored under 'd' + auctionId + spotId.  Each has a matching
+   'e' + retainUntil + auctionId + spotId key so that expiry is a range scan
+   over the start of the key space.  Serialized ids are self-delimiting so
+   the auction id alone is a valid prefix for the lookups without a spot id.
+*/
+
+std::string idKey(const Id & id)
+{
+    return DB::serializeToString(id);
+}
+
+std::string dataKey(const Id & auctionId, const Id & adSpotId)
+{
+    return 'd' + idKey(auctionId) + idKey(adSpotId);
+}
+
+std::string expiryPrefix(Date date)
+{
+    double ms = std::max(0.0, date.secondsSinceEpoch() * 1000.0);
+    uint64_t val = ms;
+
+    // Big endian so that the keys sort in time order.
+    std::string result(1, 'e');
+    for (int shift = 56;  shift >= 0;  shift -= 8)
+        result += char(val >> shift);
+    return result;
+}
+
+std::string expiryKey(const FinishedInfo & info)
+{
+    return expiryPrefix(info.retainUntil)
+        + idKey(info.auctionId) + idKey(info.adSpotId);
+}
+
+void checkStatus(const leveldb::Status & status, const char * what)
+{
+    if (!status.ok())
+        throw ML::Exception("finished spill store %s: %s",
+                what, status.ToString().c_str());
+}
+
+} // namespace anonymous
+
+
+/*****************************************************************************/
+/* FINISHED SPILL STORE                                                      */
+/*****************************************************************************/
+
+FinishedSpillStore::
+FinishedSpillStore(const std::string & path, size_t cacheSize, bool keep) :
+    path(path),
+    cache(leveldb::NewLRUCache(cacheSize)),
+    batched(0),
+    entries(0)
+{
+    // LevelDB only creates the last directory of the path.
+    for (size_t pos = path.find('/', 1); pos != string::npos;
+         pos = path.find('/', pos + 1))
+    {
+        leveldb::Env::Default()->CreateDir(path.substr(0, pos));
+    }
+
+    leveldb::Options options;
+    if (!keep)
+        checkStatus(leveldb::DestroyDB(path, options), "wipe");
+
+    options.create_if_missing = true;
+    options.block_cache = cache.get();
+
+    leveldb::DB * result;
+    checkStatus(leveldb::DB::Open(options, path, &result), "open");
+    db.reset(result);
+
+    if (!keep) return;
+
+    // Entries kept from a previous run are counted once when opening.
+    std::unique_ptr<leveldb::Iterator> it(
+            db->NewIterator(leveldb::ReadOptions()));
+    for (it->Seek("d"); it->Valid() && it->key().starts_with("d"); it->Next())
+        ++entries;
+    checkStatus(it->status(), "count");
+}
+
+FinishedSpillStore::
+~FinishedSpillStore()
+{
+}
+
+void
+FinishedSpillStore::
+put(const pair<Id, Id> & key, const FinishedInfo & info)
+{
+    if (info.auctionId != key.first || info.adSpotId != key.second)
+        throw ML::Exception("spilled info doesn't match its key");
+
+    batch.Put(dataKey(key.first, key.second), DB::serializeToString(info));
+    batch.Put(expiryKey(info), leveldb::Slice());
+    ++batched;
+}
+
+void
+FinishedSpillStore::
+commit()
+{
+    if (!batched) return;
+
+    checkStatus(db->Write(leveldb::WriteOptions(), &batch), "write");
+    batch.Clear();
+
+    entries += batched;
+    batched = 0;
+}
+
+bool
+FinishedSpillStore::
+take(const Id & auctionId, Id & adSpotId, FinishedInfo & info,
+     StringBlockStore & strings)
+{
+    std::string key;
+    std::string value;
+
+    if (adSpotId) {
+        key = dataKey(auctionId, adSpotId);
+        auto status = db->Get(leveldb::ReadOptions(), key, &value);
+        if (status.IsNotFound()) return false;
+        checkStatus(status, "get");
+    }
+
+    else {
+        std::string prefix = 'd' + idKey(auctionId);
+
+        std::unique_ptr<leveldb::Iterator> it(
+                db->NewIterator(leveldb::ReadOptions()));
+        it->Seek(prefix);
+        checkStatus(it->status(), "seek");
+
+        if (!it->Valid() || !it->key().starts_with(prefix)) return false;
+        key = it->key().ToString();
+        value = it->value().ToString();
+    }
+
+    {
+        std::istringstream stream(value);
+        DB::Store_Reader store(stream);
+        info.reconstitute(store, strings);
+    }
+    adSpotId = info.adSpotId;
+
+    leveldb::WriteBatch erase;
+    erase.Delete(key);
+    erase.Delete(expiryKey(info));
+    checkStatus(db->Write(leveldb::WriteOptions(), &erase), "erase");
+
+    --entries;
+    return true;
+}
+
+size_t
+FinishedSpillStore::
+expire(Date now)
+{
+    std::string end = expiryPrefix(now.plusSeconds(0.001));
+
+    leveldb::WriteBatch erase;
+    size_t expired = 0;
+
+    std::unique_ptr<leveldb::Iterator> it(
+            db->NewIterator(leveldb::ReadOptions()));
+
+    for (it->Seek("e"); it->Valid(); it->Next()) {
+        leveldb::Slice key = it->key();
+        if (key.compare(end) >= 0) break;
+
+        // The data key is the expiry key with its date swapped for a 'd'.
+        erase.Delete(key);
+        erase.Delete('d' + key.ToString().substr(end.size()));
+        ++expired;
+    }
+    checkStatus(it->status(), "expiry scan");
+
+    if (expired) {
+        checkStatus(db->Write(leveldb::WriteOptions(), &erase), "expire");
+        entries -= expired;
+    }
+
+    return expired;
+}
+
+} // namespace RTBKIT
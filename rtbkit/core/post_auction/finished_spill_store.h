@@ -0,0 +1,82 @@
+/** finished_spill_store.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    On-disk tier for finished auctions that are too old to be kept in memory.
+
+*/
+
+#pragma once
+
+#include "finished_info.h"
+#include "leveldb/write_batch.h"
+
+#include <memory>
+#include <utility>
+
+namespace leveldb {
+
+class DB;
+class Cache;
+
+} // namespace leveldb
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* FINISHED SPILL STORE                                                      */
+/*****************************************************************************/
+
+/** LevelDB store of finished auctions keyed by (auctionId, spotId).  Entries
+    are written once their in-memory timeout elapses and are taken back out
+    when an event shows up for them or when their retainUntil date passes.
+
+    On its own this is a cache of the matcher's state and not a persistence
+    layer: the database is wiped when the store is opened unless keep is set,
+    which the matcher does when its state is persisted.
+
+    Not thread-safe; it belongs to the event matcher that fills it.
+*/
+
+struct FinishedSpillStore {
+
+    enum { DefaultCacheSize = 64 * 1024 * 1024 };
+
+    FinishedSpillStore(const std::string & path,
+                       size_t cacheSize = DefaultCacheSize,
+                       bool keep = false);
+    ~FinishedSpillStore();
+
+    /** Queue the entry to be written on the next commit(). It will be dropped
+        from the store once info.retainUntil has passed.
+    */
+    void put(const std::pair<Id, Id> & key, const FinishedInfo & info);
+
+    /** Write all the queued entries in a single batch. */
+    void commit();
+
+    /** Remove the entry from the store and return it.  If adSpotId is null,
+        any spot of the auction will be returned and adSpotId is set to it.
+        The info's strings are added back into the given store.
+    */
+    bool take(const Id & auctionId, Id & adSpotId, FinishedInfo & info,
+              StringBlockStore & strings);
+
+    /** Drop every entry whose retainUntil is before now and return how many
+        were dropped.
+    */
+    size_t expire(Date now);
+
+    /** Number of committed entries in the store. */
+    size_t size() const { return entries; }
+
+private:
+    std::string path;
+    std::unique_ptr<leveldb::Cache> cache;
+    std::unique_ptr<leveldb::DB> db;
+
+    leveldb::WriteBatch batch;
+    size_t batched;
+    size_t entries;
+};
+
+} // namespace RTBKIT
@@ -5,10 +5,14 @@ LIB_POST_AUCTION_SOURCES := \
 	sharded_event_matcher.cc \
 	events.cc \
 	finished_info.cc \
+	submission_info.cc \
+	string_block_store.cc \
+	finished_spill_store.cc \
+	seen_auction_filter.cc \
 	post_auction_service.cc
 
 LIB_POST_AUCTION_LINK := \
-	agent_configuration zeromq boost_thread logger opstats leveldb services banker gobanker rtb
+	agent_configuration zeromq boost_thread logger opstats leveldb services banker gobanker rtb utils boost_filesystem
 
 $(eval $(call library,post_auction,$(LIB_POST_AUCTION_SOURCES),$(LIB_POST_AUCTION_LINK)))
 
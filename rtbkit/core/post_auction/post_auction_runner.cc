@@ -10,11 +10,15 @@
 #include "rtbkit/core/banker/slave_banker.h"
 #include "rtbkit/core/banker/local_banker.h"
 #include "rtbkit/core/banker/split_banker.h"
+#include "rtbkit/core/banker/sharded_banker.h"
 #include "rtbkit/core/banker/null_banker.h"
 #include "soa/service/service_utils.h"
 #include "soa/service/process_stats.h"
 #include "soa/utils/print_utils.h"
 #include "jml/utils/file_functions.h"
+#include "jml/utils/string_functions.h"
+
+#include <boost/lexical_cast.hpp>
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/parsers.hpp>
@@ -41,8 +45,10 @@ static Json::Value loadJsonFromFile(const std::string & filename)
 PostAuctionRunner::
 PostAuctionRunner() :
     shard(0),
+    matcherShards(1),
     auctionTimeout(EventMatcher::DefaultAuctionTimeout),
     winTimeout(EventMatcher::DefaultWinTimeout),
+    finishedSpillAge(5 * 60),
     bidderConfigurationFile("rtbkit/examples/bidder-config.json"),
     analyticsConfigurationFile(""),
     winLossPipeTimeout(PostAuctionService::DefaultWinLossPipeTimeout),
@@ -68,10 +74,20 @@ doOptions(int argc, char ** argv,
          "configuration file for analytics")
         ("shard,s", value<size_t>(&shard),
          "Shard index starting at 0 for this post auction loop")
+        ("matcher-shards", value<size_t>(&matcherShards),
+         "Number of threads used to match events")
+        ("matcher-cpus", value<string>(&matcherCpus),
+         "comma separated list of cpus to pin the matcher threads to")
         ("win-seconds", value<float>(&winTimeout),
          "Timeout for storing win auction")
         ("auction-seconds", value<float>(&auctionTimeout),
          "Timeout to get late win auction")
+        ("state-path", value<string>(&statePath),
+         "directory where the matched auctions are saved across restarts")
+        ("finished-spill-path", value<string>(&finishedSpillPath),
+         "directory where wins older than finished-spill-seconds are kept")
+        ("finished-spill-seconds", value<float>(&finishedSpillAge),
+         "Age at which wins are moved from memory to the spill directory")
         ("winlossPipe-seconds", value<int>(&winLossPipeTimeout),
          "Timeout before sending error on WinLoss pipe")
         ("campaignEventPipe-seconds", value<int>(&campaignEventPipeTimeout),
@@ -127,15 +143,31 @@ init()
     postAuctionLoop = std::make_shared<PostAuctionService>(proxies, serviceName);
     postAuctionLoop->initBidderInterface(bidderConfig);
     postAuctionLoop->initAnalytics(analyticsConfig);
-    postAuctionLoop->init(shard);
+    postAuctionLoop->init(shard, matcherShards);
+
+    if (!matcherCpus.empty()) {
+        vector<int> cpus;
+        for (const string & cpu : ML::split(matcherCpus, ','))
+            cpus.push_back(boost::lexical_cast<int>(cpu));
+        postAuctionLoop->pinMatcherShards(cpus);
+    }
 
     postAuctionLoop->setWinTimeout(winTimeout);
     postAuctionLoop->setAuctionTimeout(auctionTimeout);
+    if (!statePath.empty())
+        postAuctionLoop->initStatePersistence(statePath);
+    if (!finishedSpillPath.empty())
+        postAuctionLoop->initFinishedSpill(finishedSpillPath, finishedSpillAge);
     postAuctionLoop->setWinLossPipeTimeout(winLossPipeTimeout);
     postAuctionLoop->setCampaignEventPipeTimeout(campaignEventPipeTimeout);
 
     LOG(print) << "win timeout is " << winTimeout << std::endl;
     LOG(print) << "auction timeout is " << auctionTimeout << std::endl;
+    if (!statePath.empty())
+        LOG(print) << "state saved in " << statePath << std::endl;
+    if (!finishedSpillPath.empty())
+        LOG(print) << "wins spilled to " << finishedSpillPath
+                   << " after " << finishedSpillAge << "s" << std::endl;
     LOG(print) << "winLoss pipe timeout is " << winLossPipeTimeout << std::endl;
     LOG(print) << "campaignEvent pipe timeout is " << campaignEventPipeTimeout << std::endl;
 
@@ -155,10 +187,14 @@ init()
             }
         }
 
-        slaveBanker = bankerArgs.makeBanker(proxies, postAuctionLoop->serviceName() + ".slaveBanker");
-        banker = make_shared<SplitBanker>(slaveBanker, localBanker, campaignSet);
+        slaveBankers = bankerArgs.makeBankers(proxies, postAuctionLoop->serviceName() + ".slaveBanker");
+        banker = make_shared<SplitBanker>(makeShardedBanker(slaveBankers), localBanker, campaignSet);
         postAuctionLoop->addSource("local-banker", *localBanker);
-        postAuctionLoop->addSource("slave-banker", *slaveBanker);
+        for (size_t i = 0; i < slaveBankers.size(); ++i) {
+            string name = "slave-banker";
+            if (i > 0) name += "-" + to_string(i);
+            postAuctionLoop->addSource(name, *slaveBankers[i]);
+        }
 
     } else if (localBanker && bankerChoice == "local") {
         banker = localBanker;
@@ -168,9 +204,13 @@ init()
         banker = make_shared<NullBanker>(true, postAuctionLoop->serviceName());
 
     } else {
-        slaveBanker = bankerArgs.makeBanker(proxies, postAuctionLoop->serviceName() + ".slaveBanker");
-        banker = slaveBanker;
-        postAuctionLoop->addSource("slave-banker", *slaveBanker);
+        slaveBankers = bankerArgs.makeBankers(proxies, postAuctionLoop->serviceName() + ".slaveBanker");
+        banker = makeShardedBanker(slaveBankers);
+        for (size_t i = 0; i < slaveBankers.size(); ++i) {
+            string name = "slave-banker";
+            if (i > 0) name += "-" + to_string(i);
+            postAuctionLoop->addSource(name, *slaveBankers[i]);
+        }
     }
     postAuctionLoop->setBanker(banker);
 
@@ -201,7 +241,7 @@ PostAuctionRunner::
 shutdown()
 {
     postAuctionLoop->shutdown();
-    if (slaveBanker) slaveBanker->shutdown();
+    for (auto & slaveBanker: slaveBankers) slaveBanker->shutdown();
     if (localBanker) localBanker->shutdown();
 }
 
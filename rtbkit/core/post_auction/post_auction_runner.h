@@ -29,8 +29,13 @@ struct PostAuctionRunner {
     SlaveBankerArguments bankerArgs;
 
     size_t shard;
+    size_t matcherShards;
+    std::string matcherCpus;
     float auctionTimeout;
     float winTimeout;
+    std::string statePath;
+    std::string finishedSpillPath;
+    float finishedSpillAge;
     std::string bidderConfigurationFile;
     std::string analyticsConfigurationFile;
 
@@ -50,7 +55,7 @@ struct PostAuctionRunner {
 
     std::shared_ptr<ServiceProxies> proxies;
     std::shared_ptr<Banker> banker;
-    std::shared_ptr<SlaveBanker> slaveBanker;
+    std::vector<std::shared_ptr<SlaveBanker> > slaveBankers;  ///< One per banker shard
     std::shared_ptr<LocalBanker> localBanker;
     std::shared_ptr<PostAuctionService> postAuctionLoop;
 
@@ -13,6 +13,7 @@
 #include "rtbkit/common/messages.h"
 #include "soa/service/rest_request_params.h"
 #include "soa/service/rest_request_binding.h"
+#include "soa/service/sampling_profiler.h"
 #include "rtbkit/common/analytics.h"
 
 using namespace std;
@@ -217,6 +218,7 @@ initConnections(size_t shard)
     router.bind("WIN", std::bind(&PostAuctionService::doWinMessage, this, _1));
     router.bind("LOSS", std::bind(&PostAuctionService::doLossMessage, this,_1));
     router.bind("EVENT", std::bind(&PostAuctionService::doCampaignEventMessage, this, _1));
+    router.bind("EVENTS", std::bind(&PostAuctionService::doEventsMessage, this, _1));
     router.defaultHandler = [=](const std::vector<std::string> & message) {
         LOG(error) << "unroutable message: " << message[0] << std::endl;
     };
@@ -282,6 +284,7 @@ initRestEndpoint()
     restEndpoint->onHandleRequest = restRouter->requestHandler();
     restRouter->description = "Forwarding API for the RTBKIT post auction loop";
     restRouter->addHelpRoute("/", "GET");
+    addProfilerRoutes(*restRouter);
 
     auto & versionNode = restRouter->addSubRouter("/v1", "version 1 of API");
 
@@ -410,6 +413,22 @@ doCampaignEventMessage(const std::vector<std::string> & message)
     doEvent(event);
 }
 
+void
+PostAuctionService::
+doEventsMessage(const std::vector<std::string> & message)
+{
+    recordHit("messages.EVENTS");
+    recordCount(message.size() - 2, "messages.EVENTS.events");
+
+    // Each event goes straight to the matcher, which queues it on the shard
+    // that owns its auction.
+    for (size_t i = 2; i < message.size(); ++i) {
+        auto event = std::make_shared<PostAuctionEvent>(
+                ML::DB::reconstituteFromString<PostAuctionEvent>(message[i]));
+        doEvent(std::move(event));
+    }
+}
+
 
 void
 PostAuctionService::
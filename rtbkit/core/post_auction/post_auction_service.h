@@ -183,10 +183,34 @@ struct PostAuctionService : public ServiceBase, public MonitorProvider
     /* PERSISTENCE                                                          */
     /************************************************************************/
 
+    /** Restore the matcher's submitted and finished auctions from the given
+        directory and keep saving them there so that a restart doesn't lose
+        them.  Must be called after init() and before initFinishedSpill() and
+        start().
+    */
     void initStatePersistence(const std::string & path)
     {
-        throw ML::Exception(
-                "post auction service persistence is not yet implemented.");
+        ExcCheck(matcher, "initStatePersistence called before init");
+        matcher->initStatePersistence(path);
+    }
+
+    /** Keep the won auctions that are older than age seconds in a LevelDB
+        store under path rather than in memory.  Must be called after init()
+        and before start().
+    */
+    void initFinishedSpill(const std::string & path, float age)
+    {
+        ExcCheck(matcher, "initFinishedSpill called before init");
+        matcher->initFinishedSpill(path, age);
+    }
+
+    /** Pin the matcher's shard threads to the given cpus.  Must be called
+        after init().
+    */
+    void pinMatcherShards(const std::vector<int> & cpus)
+    {
+        ExcCheck(matcher, "pinMatcherShards called before init");
+        matcher->pinShards(cpus);
     }
 
 
@@ -255,6 +279,10 @@ private:
      * in. */
     void doCampaignEventMessage(const std::vector<std::string> & message);
 
+    /** Decode from zeromq and handle a batch of events, one per frame, as
+     * sent by PostAuctionProxy::sendEvents(). */
+    void doEventsMessage(const std::vector<std::string> & message);
+
     void doConfigChange(
             const std::string & agent,
             std::shared_ptr<const AgentConfig> config);
@@ -0,0 +1,125 @@
+/** seen_auction_filter.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Bloom filters of the auction ids that the post auction loop has seen.
+
+*/
+
+#include "seen_auction_filter.h"
+#include "jml/arch/exception.h"
+#include "city.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* SEEN AUCTION FILTER                                                       */
+/*****************************************************************************/
+
+SeenAuctionFilter::Generation::
+Generation(size_t capacity, double falsePositiveRate) :
+    inserted(0)
+{
+    // Optimal number of bits for the capacity, rounded up to a power of two
+    // so that the probes are a mask rather than a modulo.
+    double wanted = -double(capacity) * std::log(falsePositiveRate)
+        / (M_LN2 * M_LN2);
+
+    uint64_t numBits = 64;
+    while (numBits < wanted) numBits *= 2;
+
+    bits.resize(numBits / 64);
+    mask = numBits - 1;
+}
+
+SeenAuctionFilter::
+SeenAuctionFilter(double falsePositiveRate) :
+    falsePositiveRate(falsePositiveRate),
+    started(Date::now()),
+    rotations(0)
+{
+    if (falsePositiveRate <= 0.0 || falsePositiveRate >= 1.0)
+        throw ML::Exception("invalid seen auction filter false positive rate");
+
+    numHashes = std::max<int>(1, std::ceil(-std::log2(falsePositiveRate)));
+    generations.emplace_front(MinCapacity, falsePositiveRate);
+}
+
+pair<uint64_t, uint64_t>
+SeenAuctionFilter::
+hashes(const Id & auctionId)
+{
+    uint64_t h1 = auctionId.hash();
+    uint64_t h2 = Hash128to64(make_pair(h1, uint64_t(0x9e3779b97f4a7c15ULL)));
+    return make_pair(h1, h2 | 1);
+}
+
+void
+SeenAuctionFilter::
+insert(const Id & auctionId)
+{
+    auto h = hashes(auctionId);
+    Generation & gen = generations.front();
+
+    for (unsigned i = 0;  i < numHashes;  ++i) {
+        uint64_t bit = (h.first + i * h.second) & gen.mask;
+        gen.bits[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    ++gen.inserted;
+}
+
+bool
+SeenAuctionFilter::
+mightContain(const Id & auctionId) const
+{
+    if (!complete()) return true;
+
+    auto h = hashes(auctionId);
+
+    for (const Generation & gen : generations) {
+        bool found = true;
+        for (unsigned i = 0;  found && i < numHashes;  ++i) {
+            uint64_t bit = (h.first + i * h.second) & gen.mask;
+            found = gen.bits[bit / 64] & (uint64_t(1) << (bit % 64));
+        }
+        if (found) return true;
+    }
+
+    return false;
+}
+
+bool
+SeenAuctionFilter::
+rotate(Date now, double period)
+{
+    if (now < started.plusSeconds(period)) return false;
+
+    // Leave some headroom in case the traffic picks up.
+    size_t capacity = std::max<size_t>(
+            MinCapacity, generations.front().inserted * 3 / 2);
+
+    generations.emplace_front(capacity, falsePositiveRate);
+    if (generations.size() > Generations)
+        generations.pop_back();
+
+    started = now;
+    ++rotations;
+    return true;
+}
+
+size_t
+SeenAuctionFilter::
+memoryUsage() const
+{
+    size_t result = 0;
+    for (const Generation & gen : generations)
+        result += gen.bits.size() * sizeof(uint64_t);
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,88 @@
+/** seen_auction_filter.h                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Bloom filters of the auction ids that the post auction loop has seen.
+
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+#include "soa/types/id.h"
+
+#include <deque>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* SEEN AUCTION FILTER                                                       */
+/*****************************************************************************/
+
+/** Time-rotated Bloom filters of auction ids, used to drop the events for
+    auctions that were never seen without looking them up anywhere.
+
+    Ids go into the newest of Generations filters and rotate() starts a new
+    one once it is older than the given period, dropping the oldest.  An id
+    is thus remembered for at least (Generations - 1) periods.  Each new
+    filter is sized from the number of ids that went into the previous one so
+    that the false positive rate stays around the requested one.
+
+    Until the first (Generations - 1) rotations the filters can't know about
+    the auctions that came before they were created, eg. the ones spilled to
+    disk by a previous run, so mightContain() always says yes until then.
+
+    Not thread-safe.
+*/
+
+struct SeenAuctionFilter {
+
+    enum {
+        Generations = 3,
+        MinCapacity = 64 * 1024
+    };
+
+    explicit SeenAuctionFilter(double falsePositiveRate = 0.01);
+
+    void insert(const Datacratic::Id & auctionId);
+
+    /** False only if the auction definitely wasn't inserted within the
+        remembered window.
+    */
+    bool mightContain(const Datacratic::Id & auctionId) const;
+
+    /** Start a new generation if the newest one is older than period
+        seconds.  Returns whether it did.
+    */
+    bool rotate(Datacratic::Date now, double period);
+
+    /** Whether mightContain() can answer no yet. */
+    bool complete() const { return rotations >= Generations - 1; }
+
+    size_t memoryUsage() const;
+
+private:
+
+    struct Generation {
+        Generation(size_t capacity, double falsePositiveRate);
+
+        std::vector<uint64_t> bits;
+        uint64_t mask;          ///< Number of bits minus one
+        size_t inserted;
+    };
+
+    /** Bit probes for an id are h1 + i * h2 for i < numHashes. */
+    static std::pair<uint64_t, uint64_t>
+    hashes(const Datacratic::Id & auctionId);
+
+    double falsePositiveRate;
+    unsigned numHashes;
+
+    std::deque<Generation> generations;   ///< Newest first
+    Datacratic::Date started;             ///< Of the newest generation
+    unsigned rotations;
+};
+
+} // namespace RTBKIT
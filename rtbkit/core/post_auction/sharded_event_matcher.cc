@@ -11,11 +11,55 @@
 
 #include "sharded_event_matcher.h"
 
+#include <boost/filesystem.hpp>
+#include <exception>
+#include <fstream>
+#include <thread>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
 using namespace std;
 using namespace ML;
 
 namespace RTBKIT {
 
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+/** The queues are bounded so a producer that outruns a shard has to wait for
+    it, just like it did with the old blocking sinks.
+*/
+template<typename Queue, typename Message>
+void pushWait(Queue& queue, const Message& message)
+{
+    while (!queue.push_back(message))
+        std::this_thread::yield();
+}
+
+/** Some exchanges hand out ids whose hashes aren't well distributed in the
+    low bits and the shard's own hash tables index on those same low bits.
+    Running the hash through a finalizer and picking the shard from the high
+    bits keeps both the shards and their tables balanced.
+*/
+size_t shardIndex(const Id& id, size_t numShards)
+{
+    uint64_t h = id.hash();
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return ((unsigned __int128) h * numShards) >> 64;
+}
+
+} // namespace anonymous
+
+
 
 /******************************************************************************/
 /* SHARDED EVENT MATCHER                                                      */
@@ -29,34 +73,64 @@ Logging::Category ShardedEventMatcher::trace("ShardedEventMatcher Trace", Sharde
 ShardedEventMatcher::
 ShardedEventMatcher(std::string prefix, std::shared_ptr<EventService> events) :
     EventMatcher(std::move(prefix), std::move(events)),
-    matchedWinLossEvents(1 << 10),
-    matchedCampaignEvents(1 << 8),
-    unmatchedEvents(1 << 4),
-    errorEvents(1 << 4)
+    matchedWinLossEvents([=] {
+                for (auto& event : matchedWinLossEvents.pop_front(0))
+                    doMatchedWinLoss(std::move(event));
+            }, QueueSize),
+    matchedCampaignEvents([=] {
+                for (auto& event : matchedCampaignEvents.pop_front(0))
+                    doMatchedCampaignEvent(std::move(event));
+            }, QueueSize),
+    unmatchedEvents([=] {
+                for (auto& event : unmatchedEvents.pop_front(0))
+                    doUnmatchedEvent(std::move(event));
+            }, QueueSize),
+    errorEvents([=] {
+                for (auto& event : errorEvents.pop_front(0))
+                    doError(std::move(event));
+            }, QueueSize)
 {}
 
 
 ShardedEventMatcher::
 ShardedEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
     EventMatcher(std::move(prefix), std::move(proxies)),
-    matchedWinLossEvents(1 << 10),
-    matchedCampaignEvents(1 << 8),
-    unmatchedEvents(1 << 4),
-    errorEvents(1 << 4)
+    matchedWinLossEvents([=] {
+                for (auto& event : matchedWinLossEvents.pop_front(0))
+                    doMatchedWinLoss(std::move(event));
+            }, QueueSize),
+    matchedCampaignEvents([=] {
+                for (auto& event : matchedCampaignEvents.pop_front(0))
+                    doMatchedCampaignEvent(std::move(event));
+            }, QueueSize),
+    unmatchedEvents([=] {
+                for (auto& event : unmatchedEvents.pop_front(0))
+                    doUnmatchedEvent(std::move(event));
+            }, QueueSize),
+    errorEvents([=] {
+                for (auto& event : errorEvents.pop_front(0))
+                    doError(std::move(event));
+            }, QueueSize)
 {}
 
 ShardedEventMatcher::Shard::
 Shard(std::string prefix, std::shared_ptr<EventService> events) :
+    index(0),
+    parent(nullptr),
     matcher(std::move(prefix), std::move(events)),
-    auctions(1 << 8),
-    events(1 << 6)
+    auctions([=] { processAuctions(); }, QueueSize),
+    events([=] { processEvents(); }, QueueSize),
+    lastSleepSeconds(0.0)
 {}
 
 ShardedEventMatcher::Shard::
 Shard(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
+    index(0),
+    parent(nullptr),
     matcher(std::move(prefix), std::move(proxies)),
-    auctions(1 << 8),
-    events(1 << 6)
+    auctions([=] { processAuctions(); }, QueueSize),
+    events([=] { processEvents(); }, QueueSize),
+    lastSleepSeconds(0.0)
 {}
 
 void
@@ -77,71 +151,48 @@ init(size_t numShards)
         shard->init(i, this);
     }
 
-    using std::placeholders::_1;
-
-    matchedWinLossEvents.onEvent =
-        std::bind(&ShardedEventMatcher::doMatchedWinLoss, this, _1);
-    addSource("SahrdedEventMatcher::matchedWinLossEvents", matchedWinLossEvents);
+    addSource("ShardedEventMatcher::matchedWinLossEvents", matchedWinLossEvents);
+    addSource("ShardedEventMatcher::matchedCampaignEvents", matchedCampaignEvents);
+    addSource("ShardedEventMatcher::unmatchedEvents", unmatchedEvents);
+    addSource("ShardedEventMatcher::errorEvents", errorEvents);
 
-    matchedCampaignEvents.onEvent =
-        std::bind(&ShardedEventMatcher::doMatchedCampaignEvent, this, _1);
-    addSource("SahrdedEventMatcher::matchedCampaignEvents", matchedCampaignEvents);
-
-    unmatchedEvents.onEvent =
-        std::bind(&ShardedEventMatcher::doUnmatchedEvent, this, _1);
-    addSource("SahrdedEventMatcher::unmatchedEvents", unmatchedEvents);
-
-    errorEvents.onEvent = [=] (std::shared_ptr<PostAuctionErrorEvent> event) {
-        doError(std::move(event));
-    };
-    addSource("SahrdedEventMatcher::errorEvents", errorEvents);
+    lastShardLoad = Date::now();
+    addPeriodic("ShardedEventMatcher::recordShardLoad", 1.0,
+            std::bind(&ShardedEventMatcher::recordShardLoad, this,
+                    std::placeholders::_1));
 }
 
 void
 ShardedEventMatcher::Shard::
 init(size_t shard, ShardedEventMatcher* parent)
 {
-    using std::placeholders::_1;
-
-    auctions.onEvent = [=] (std::shared_ptr<SubmittedAuctionEvent> event) {
-        parent->recordHit("shards.%d.messages.%s", shard, "AUCTION");
+    this->index = shard;
+    this->parent = parent;
 
-        this->matcher.doAuction(std::move(event));
-    };
     addSource("ShardedEventMatcher::Shard::auctions", auctions);
-
-    events.onEvent = [=] (std::shared_ptr<PostAuctionEvent> event) {
-        parent->recordHit("shards.%d.messages.%s", shard, RTBKIT::print(event->type));
-        if (event->type == PAE_CAMPAIGN_EVENT)
-            parent->recordHit("shards.%d.messages.events.%s", shard, event->label);
-
-        this->matcher.doEvent(std::move(event));
-    };
     addSource("ShardedEventMatcher::Shard::events", events);
 
     addPeriodic("ShardedEventMatcher::checkExpiredAuctions", 0.1,
             std::bind(&SimpleEventMatcher::checkExpiredAuctions, &matcher));
 
-
-
     matcher.onMatchedWinLoss = [=] (std::shared_ptr<MatchedWinLoss> event) {
         parent->recordHit("shards.%d.results.MATCHED%s", shard, event->typeString());
-        parent->matchedWinLossEvents.push(std::move(event));
+        pushWait(parent->matchedWinLossEvents, event);
     };
 
     matcher.onMatchedCampaignEvent = [=] (std::shared_ptr<MatchedCampaignEvent> event) {
         parent->recordHit("shards.%d.results.MATCHED%s", shard, event->label);
-        parent->matchedCampaignEvents.push(std::move(event));
+        pushWait(parent->matchedCampaignEvents, event);
     };
 
     matcher.onUnmatchedEvent = [=] (std::shared_ptr<UnmatchedEvent> event) {
         parent->recordHit("shards.%d.results.%s", shard, "UNMATCHED");
-        parent->unmatchedEvents.push(std::move(event));
+        pushWait(parent->unmatchedEvents, event);
     };
 
     matcher.onError = [=] (std::shared_ptr<PostAuctionErrorEvent> event) {
         parent->recordHit("shards.%d.results.%s", shard, "ERROR");
-        parent->errorEvents.push(std::move(event));
+        pushWait(parent->errorEvents, event);
     };
 }
 
@@ -167,6 +218,79 @@ setAuctionTimeout(float timeout)
     for (auto& shard : shards) shard->matcher.setAuctionTimeout(timeout);
 }
 
+void
+ShardedEventMatcher::
+initStatePersistence(const std::string & path)
+{
+    boost::filesystem::create_directories(path);
+
+    // Auctions would be restored in shards that never see their events.
+    string countFile = path + "/shards";
+    size_t count = shards.size();
+    if (std::ifstream(countFile) >> count && count != shards.size()) {
+        THROW(error) << "state in " << path << " is for " << count
+            << " shards instead of " << shards.size();
+    }
+    std::ofstream(countFile) << shards.size() << endl;
+
+    Date start = Date::now();
+
+    vector<std::thread> threads;
+    vector<std::exception_ptr> errors(shards.size());
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        threads.emplace_back([&, i] {
+                    string shardPath = path + "/shard-" + to_string(i);
+                    try {
+                        shards[i]->matcher.initStatePersistence(shardPath);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+    }
+
+    for (auto& thread : threads) thread.join();
+
+    for (auto& exc : errors)
+        if (exc) std::rethrow_exception(exc);
+
+    LOG(print) << "restored " << shards.size() << " shards in "
+        << Date::now().secondsSince(start) << "s" << endl;
+}
+
+void
+ShardedEventMatcher::
+initFinishedSpill(const std::string & path, float age)
+{
+    for (size_t i = 0; i < shards.size(); ++i) {
+        string shardPath = path + "/shard-" + to_string(i);
+        shards[i]->matcher.initFinishedSpill(shardPath, age);
+    }
+}
+
+void
+ShardedEventMatcher::
+pinShards(const std::vector<int> & cpus)
+{
+    if (cpus.empty()) return;
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        int cpu = cpus[i % cpus.size()];
+
+        shards[i]->runInMessageLoopThread([=] {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpu, &set);
+
+                    int res = pthread_setaffinity_np(
+                            pthread_self(), sizeof(set), &set);
+                    if (res)
+                        LOG(error) << "shard " << i << ": can't pin to cpu "
+                            << cpu << ": " << strerror(res) << endl;
+                });
+    }
+}
+
 
 void
 ShardedEventMatcher::
@@ -189,7 +313,7 @@ ShardedEventMatcher::Shard&
 ShardedEventMatcher::
 shard(const Id& auctionId)
 {
-    return *shards[auctionId.hash() % shards.size()];
+    return *shards[shardIndex(auctionId, shards.size())];
 }
 
 void
@@ -197,7 +321,7 @@ ShardedEventMatcher::
 doAuction(std::shared_ptr<SubmittedAuctionEvent> event)
 {
     auto& s = shard(event->auctionId);
-    s.auctions.push(std::move(event));
+    pushWait(s.auctions, Queued<SubmittedAuctionEvent>{ Date::now(), event });
 }
 
 void
@@ -205,7 +329,64 @@ ShardedEventMatcher::
 doEvent(std::shared_ptr<PostAuctionEvent> event)
 {
     auto& s = shard(event->auctionId);
-    s.events.push(std::move(event));
+    pushWait(s.events, Queued<PostAuctionEvent>{ Date::now(), event });
+}
+
+void
+ShardedEventMatcher::Shard::
+processAuctions()
+{
+    Date now = Date::now();
+
+    for (auto& entry : auctions.pop_front(0)) {
+        parent->recordHit("shards.%d.messages.%s", index, "AUCTION");
+        parent->recordOutcome(now.secondsSince(entry.queued) * 1000.0,
+                "shards.%d.queueLatencyMs.%s", index, "AUCTION");
+
+        matcher.doAuction(std::move(entry.event));
+    }
+}
+
+void
+ShardedEventMatcher::Shard::
+processEvents()
+{
+    Date now = Date::now();
+
+    for (auto& entry : events.pop_front(0)) {
+        auto& event = entry.event;
+        const char * type = RTBKIT::print(event->type);
+
+        parent->recordHit("shards.%d.messages.%s", index, type);
+        if (event->type == PAE_CAMPAIGN_EVENT)
+            parent->recordHit("shards.%d.messages.events.%s", index, event->label);
+
+        parent->recordOutcome(now.secondsSince(entry.queued) * 1000.0,
+                "shards.%d.queueLatencyMs.%s", index, type);
+
+        matcher.doEvent(std::move(event));
+    }
+}
+
+void
+ShardedEventMatcher::
+recordShardLoad(uint64_t)
+{
+    Date now = Date::now();
+    double elapsed = now.secondsSince(lastShardLoad);
+    lastShardLoad = now;
+
+    for (auto& shard : shards) {
+        recordLevel(shard->auctions.size(), "shards.%d.queueDepth.AUCTION", shard->index);
+        recordLevel(shard->events.size(), "shards.%d.queueDepth.EVENT", shard->index);
+
+        double sleep = shard->totalSleepSeconds();
+        if (elapsed > 0.0) {
+            double busy = 1.0 - (sleep - shard->lastSleepSeconds) / elapsed;
+            recordLevel(std::max(0.0, busy), "shards.%d.dutyCycle", shard->index);
+        }
+        shard->lastSleepSeconds = sleep;
+    }
 }
 
 } // namepsace RTBKIT
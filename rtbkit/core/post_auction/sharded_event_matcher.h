@@ -36,6 +36,18 @@ struct ShardedEventMatcher : public EventMatcher, public MessageLoop
     virtual void setWinTimeout(float timeout);
     virtual void setAuctionTimeout(float timeout);
 
+    /** Each shard saves its state in a sub-directory of path and they're all
+        restored in parallel.  The number of shards must stay the same across
+        restarts since it decides which shard an auction lives in.
+    */
+    virtual void initStatePersistence(const std::string & path);
+
+    /** Each shard gets its own store in a sub-directory of path. */
+    virtual void initFinishedSpill(const std::string & path, float age);
+
+    /** Shard i runs on cpus[i % cpus.size()]. */
+    virtual void pinShards(const std::vector<int> & cpus);
+
 
     /************************************************************************/
     /* EVENT MATCHING                                                       */
@@ -52,24 +64,48 @@ struct ShardedEventMatcher : public EventMatcher, public MessageLoop
 
 private:
 
+    /** Events are stamped when queued so that the shards can report how
+        long they waited.
+    */
+    template<typename Event>
+    struct Queued
+    {
+        Date queued;
+        std::shared_ptr<Event> event;
+    };
+
+    enum { QueueSize = 1 << 12 };
+
     struct Shard : public MessageLoop
     {
         Shard(std::string prefix, std::shared_ptr<EventService> events);
         Shard(std::string prefix, std::shared_ptr<ServiceProxies> proxies);
         void init(size_t shard, ShardedEventMatcher* parent);
 
+        void processAuctions();
+        void processEvents();
+
+        size_t index;
+        ShardedEventMatcher* parent;
+
         SimpleEventMatcher matcher;
-        TypedMessageSink<std::shared_ptr<SubmittedAuctionEvent> > auctions;
-        TypedMessageSink<std::shared_ptr<PostAuctionEvent> > events;
+        TypedMpscMessageQueue< Queued<SubmittedAuctionEvent> > auctions;
+        TypedMpscMessageQueue< Queued<PostAuctionEvent> > events;
+
+        double lastSleepSeconds;
     };
 
     std::vector< std::unique_ptr<Shard> > shards;
     Shard& shard(const Id& auctionId);
 
-    TypedMessageSink<std::shared_ptr<MatchedWinLoss> > matchedWinLossEvents;
-    TypedMessageSink<std::shared_ptr<MatchedCampaignEvent> > matchedCampaignEvents;
-    TypedMessageSink<std::shared_ptr<UnmatchedEvent> > unmatchedEvents;
-    TypedMessageSink<std::shared_ptr<PostAuctionErrorEvent> > errorEvents;
+    /** Publishes the queue depth and duty cycle of every shard. */
+    void recordShardLoad(uint64_t ticks);
+    Date lastShardLoad;
+
+    TypedMpscMessageQueue<std::shared_ptr<MatchedWinLoss> > matchedWinLossEvents;
+    TypedMpscMessageQueue<std::shared_ptr<MatchedCampaignEvent> > matchedCampaignEvents;
+    TypedMpscMessageQueue<std::shared_ptr<UnmatchedEvent> > unmatchedEvents;
+    TypedMpscMessageQueue<std::shared_ptr<PostAuctionErrorEvent> > errorEvents;
 
     static Logging::Category print;
     static Logging::Category error;
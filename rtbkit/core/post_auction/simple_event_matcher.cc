@@ -8,8 +8,13 @@
 #include "events.h"
 #include "simple_event_matcher.h"
 #include "jml/utils/guard.h"
+#include "jml/utils/file_functions.h"
+#include "jml/db/persistent.h"
 
+#include <boost/filesystem.hpp>
 #include <iostream>
+#include <sstream>
+#include <cstring>
 
 using namespace std;
 using namespace Datacratic;
@@ -41,8 +46,8 @@ namespace {
 
 template<typename Value>
 bool findAuction(
-        TimeoutMap<pair<Id,Id>, Value> & pending,
-        const std::unordered_map<Id, Id>& spotIdMap,
+        TimeoutMap<pair<Id,Id>, Value, IdHash> & pending,
+        const ML::Flat_Hash_Map<Id, Id, IdHash>& spotIdMap,
         const Id & auctionId, Id & adSpotId, Value & val)
 {
     if (!adSpotId) {
@@ -79,14 +84,36 @@ Logging::Category SimpleEventMatcher::trace("SimpleEventMatcher Trace", SimpleEv
 
 SimpleEventMatcher::
 SimpleEventMatcher(std::string prefix, std::shared_ptr<EventService> events) :
-    EventMatcher(std::move(prefix), std::move(events))
+    EventMatcher(std::move(prefix), std::move(events)),
+    submittedMemory("postAuction.submitted"),
+    finishedMemory("postAuction.finished"),
+    spillAge(0.0),
+    stateGeneration(0), snapshotBytes(0), journalBytes(0)
 {}
 
 SimpleEventMatcher::
 SimpleEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies) :
-    EventMatcher(std::move(prefix), std::move(proxies))
+    EventMatcher(std::move(prefix), std::move(proxies)),
+    submittedMemory("postAuction.submitted"),
+    finishedMemory("postAuction.finished"),
+    spillAge(0.0),
+    stateGeneration(0), snapshotBytes(0), journalBytes(0)
 {}
 
+void
+SimpleEventMatcher::
+initFinishedSpill(const std::string & path, float age)
+{
+    if (age <= 0.0)
+        throw ML::Exception("Invalid age for finished spill");
+
+    // Spilled wins are part of the state when it's persisted.
+    bool keep = journal != nullptr;
+    spill.reset(new FinishedSpillStore(
+                    path, FinishedSpillStore::DefaultCacheSize, keep));
+    spillAge = age;
+}
+
 
 Date
 SimpleEventMatcher::
@@ -97,10 +124,11 @@ expireSubmitted(Date start, const pair<Id, Id> & key, const SubmissionInfo & inf
 
     // Just making sure it doesn't leak if doBidResult throws.
     spotIdMap.erase(key.first);
+    touch(key);
 
     recordHit("submittedAuctionExpiry");
 
-    if (!info.bidRequest) {
+    if (!info.auction) {
         recordHit("submittedAuctionExpiryWithoutBid");
 
         for(const auto& event : info.pendingWinEvents)
@@ -132,14 +160,44 @@ expireSubmitted(Date start, const pair<Id, Id> & key, const SubmissionInfo & inf
 
 Date
 SimpleEventMatcher::
-expireFinished(const pair<Id, Id> & key, const FinishedInfo & info)
+expireFinished(Date start, const pair<Id, Id> & key, const FinishedInfo & info)
 {
     spotIdMap.erase(key.first);
+    touch(key);
+
+    if (spill && info.hasWin() && info.reportedStatus == BS_WIN
+            && info.retainUntil > start)
+    {
+        recordHit("finishedAuctionSpilled");
+        spill->put(key, info);
+        return Date();
+    }
 
     recordHit("finishedAuctionExpiry");
     return Date();
 }
 
+bool
+SimpleEventMatcher::
+unspill(const Id & auctionId, Id adSpotId)
+{
+    if (!spill) return false;
+
+    FinishedInfo info;
+    if (!spill->take(auctionId, adSpotId, info, finishedStrings))
+        return false;
+
+    recordHit("finishedAuctionUnspilled");
+
+    Date timeout = std::min(
+            info.retainUntil, Date::now().plusSeconds(spillAge));
+    finished.emplace(make_pair(auctionId, adSpotId), std::move(info), timeout);
+    spotIdMap[auctionId] = adSpotId;
+    touch(make_pair(auctionId, adSpotId));
+
+    return true;
+}
+
 void
 SimpleEventMatcher::
 checkExpiredAuctions()
@@ -156,9 +214,27 @@ checkExpiredAuctions()
 
     recordLevel(finished.size(), "finishedSize");
     finished.expire(
-            std::bind(&SimpleEventMatcher::expireFinished, this, _1, _2),
+            std::bind(&SimpleEventMatcher::expireFinished, this, now, _1, _2),
             now);
 
+    submittedMemory.set(submitted.memoryUsage());
+    finishedMemory.set(finished.memoryUsage());
+
+    // An auction can be matched for up to auctionTimeout + winTimeout and
+    // the filter remembers it for at least two periods.
+    if (seenAuctions.rotate(now, (auctionTimeout + winTimeout) / 2))
+        recordLevel(seenAuctions.memoryUsage(), "seenAuctionFilterBytes");
+
+    if (spill) {
+        spill->commit();
+        if (size_t expired = spill->expire(now))
+            recordCount(expired, "finishedAuctionExpiry");
+        recordLevel(spill->size(), "finishedSpillSize");
+    }
+
+    // After the spill commit so that wins never go missing from both.
+    saveState();
+
     banker->logBidEvents(*this);
 }
 
@@ -177,6 +253,10 @@ doEvent(std::shared_ptr<PostAuctionEvent> event)
             doWinLoss(std::move(event), false);
             break;
         case PAE_CAMPAIGN_EVENT:
+            if (!seenAuctions.mightContain(event->auctionId)) {
+                recordHit("delivery.orphanDropped");
+                break;
+            }
             doCampaignEvent(std::move(event));
             break;
         default:
@@ -214,13 +294,15 @@ doAuction(std::shared_ptr<SubmittedAuctionEvent> event)
             recordHit("auctionAlreadySubmitted");
         }
 
-        submission.bidRequest = event->bidRequest();
+        submission.auction = event;
         submission.bidRequestStrFormat = std::move(event->bidRequestStrFormat);
         submission.augmentations = std::move(event->augmentations);
         submission.bid = std::move(event->bidResponse);
 
         submitted.emplace(key, submission, lossTimeout);
         spotIdMap[key.first] = key.second;
+        seenAuctions.insert(auctionId);
+        touch(key);
 
         string transId =
             makeBidId(auctionId, event->adSpotId, submission.bid.agent);
@@ -272,6 +354,11 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
 
     auto key = make_pair(auctionId, adSpotId);
 
+    /* Old wins are only looked up on disk when we know of the auction. */
+    if (seenAuctions.mightContain(auctionId)
+            && !finished.count(key) && !submitted.count(key))
+        unspill(auctionId, adSpotId);
+
     /* In this case, the auction is finished which means we've already either:
        a) received a WIN message (and this one is a duplicate);
        b) received no WIN message, timed out, and inferred a loss
@@ -296,9 +383,9 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
         else recordHit("bidResult.%s.auctionAlreadyFinished", typeStr);
 
         if (event->type == PAE_WIN) {
-            info.bid.wcm.data["win"] = meta.toJson();
             Amount price = info.bid.wcm.evaluate(
-                    info.bid.bidData.bidForSpot(info.spotIndex), winPrice);
+                    info.bid.bidData.bidForSpot(info.spotIndex), winPrice,
+                    meta.toJson());
 
             recordOutcome(winPrice.value, "accounts.%s.winPrice.%s",
                     info.bid.account.toString('.'), winPrice.getCurrencyStr());
@@ -313,6 +400,7 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
             info.forceWin(timestamp, price, winPrice, meta.toString());
 
             finished.get(key) = info;
+            touch(key);
 
             doMatchedWinLoss(std::make_shared<MatchedWinLoss>(
                             MatchedWinLoss::LateWin,
@@ -350,14 +438,17 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
         info.pendingWinEvents.push_back(event);
         submitted.emplace(key, info, Date::now().plusSeconds(auctionTimeout));
         spotIdMap[key.first] = key.second;
+        seenAuctions.insert(auctionId);
+        touch(key);
 
         return;
     }
 
     SubmissionInfo info = submitted.pop(key);
     spotIdMap.erase(key.first);
+    touch(key);
 
-    if (!info.bidRequest) {
+    if (!info.auction) {
         // We doubled up on a WIN without having got the auction yet
         info.pendingWinEvents.push_back(event);
         submitted.emplace(key, info, Date::now().plusSeconds(auctionTimeout));
@@ -367,7 +458,7 @@ doWinLoss(std::shared_ptr<PostAuctionEvent> event, bool isReplay)
 
    if(uids.empty()) {
         // If uids is empty in win message, try to get them form BR
-        uids  = info.bidRequest->userIds;
+        uids  = info.bidRequest()->userIds;
     }
 
     auto confidence = status == BS_WIN ?
@@ -439,10 +530,14 @@ doCampaignEvent(std::shared_ptr<PostAuctionEvent> event)
         submissionInfo.earlyCampaignEvents.push_back(event);
         submitted.get(make_pair(auctionId, adSpotId)) = submissionInfo;
         spotIdMap[auctionId] = adSpotId;
+        touch(make_pair(auctionId, adSpotId));
         return;
     }
 
-    else if (findAuction(finished, spotIdMap, auctionId, adSpotId, finishedInfo)) {
+    else if (findAuction(finished, spotIdMap, auctionId, adSpotId, finishedInfo)
+            || (unspill(auctionId, adSpotId)
+                && findAuction(finished, spotIdMap, auctionId, adSpotId, finishedInfo)))
+    {
         // Update the info
         if (finishedInfo.campaignEvents.hasEvent(label)) {
             recordHit("delivery.%s.duplicate", label);
@@ -467,6 +562,7 @@ doCampaignEvent(std::shared_ptr<PostAuctionEvent> event)
         finishedInfo.addUids(uids);
 
         finished.get(key) = finishedInfo;
+        touch(key);
 
         doMatchedCampaignEvent(
                 std::make_shared<MatchedCampaignEvent>(label, finishedInfo));
@@ -518,8 +614,11 @@ doBidResult(
 
     string agent = submission.bid.agent;
 
+    // Decodes the bid request if it's still in its wire format.
+    auto bidRequest = submission.bidRequest();
+
     // Find the adspot ID
-    int adspot_num = submission.bidRequest->findAdSpotIndex(adSpotId);
+    int adspot_num = bidRequest->findAdSpotIndex(adSpotId);
     if (adspot_num == -1) {
         doError("doBidResult.adSpotIdNotFound",
                 "adspot ID " + adSpotId.toString() +
@@ -556,11 +655,9 @@ doBidResult(
     Amount price = winPrice;
 
     if (status == BS_WIN) {
-        WinCostModel wcm = response.wcm;
-        wcm.data["win"] = winLossMeta;
         Bids bids = response.bidData;
         Bid bid = bids.bidForSpot(adspot_num);
-        price = wcm.evaluate(bid, winPrice);
+        price = response.wcm.evaluate(bid, winPrice, Json::Value(winLossMeta));
 
         recordOutcome(bid.price.value, "accounts.%s.bidPrice.%s",
                 account.toString('.'),
@@ -580,21 +677,23 @@ doBidResult(
         auto transId = makeBidId(auctionId, adSpotId, agent);
         banker->winBid(account, transId, price, LineItems());
 
-        auto winLatency = Date::now().secondsSince(submission.bidRequest->timestamp);
+        auto winLatency = Date::now().secondsSince(bidRequest->timestamp);
         recordOutcome(winLatency * 1000.0, "winLatencyMs");
     }
 
     // Finally, place it in the finished queue
     FinishedInfo i;
-    i.auctionTime = submission.bidRequest->timestamp;
+    i.auctionTime = bidRequest->timestamp;
     i.auctionId = auctionId;
     i.adSpotId = adSpotId;
     i.spotIndex = adspot_num;
-    i.bidRequestStr = submission.bidRequestStr();
+    i.bidRequestStrRef = finishedStrings.add(
+            submission.bidRequestStr().rawString());
     i.bidRequestStrFormat = submission.bidRequestStrFormat ;
     i.bid = response;
     i.reportedStatus = status;
-    i.augmentations = submission.augmentations;
+    i.augmentationsRef = finishedStrings.add(
+            submission.augmentations.toString());
     i.setWin(timestamp, status, price, winPrice, winLossMeta);
     i.addUids(uids);
 
@@ -612,183 +711,319 @@ doBidResult(
         expiryInterval = auctionTimeout;
 
     Date expiryTime = Date::now().plusSeconds(expiryInterval);
+    i.retainUntil = expiryTime;
+
+    // Wins that outlive the spill age get moved to disk when they expire.
+    if (spill && status == BS_WIN)
+        expiryTime = std::min(expiryTime, Date::now().plusSeconds(spillAge));
+
     finished.emplace(make_pair(auctionId, adSpotId), i, expiryTime);
     spotIdMap[auctionId] = adSpotId;
+    touch(make_pair(auctionId, adSpotId));
 }
 
 
 
-/******************************************************************************/
 /* PERSISTENCE                                                                */
 /******************************************************************************/
-// Needs to be properly tested before enabling.
+
+/* The state directory holds a snapshot with every submitted and finished
+   entry and a journal of the entries that changed since.  Both are made of
+   records:
+
+       's' key timeout SubmissionInfo   entry in submitted
+       'f' key timeout FinishedInfo     entry in finished
+       'x' key                          entry in neither
+       'e'                              end of the records
+
+   The snapshot is a header (magic and generation) followed by records.  The
+   journal is a list of chunks, each a 64 bit size followed by that many bytes
+   of records: the first one is the header of the snapshot it applies to and
+   every journal write appends one.  A chunk that was cut short by a crash is
+   ignored, as is a journal left over from an older generation.
+*/
 
 namespace {
 
-std::pair<Id, Id>
-unstringifyPair(const std::string & str)
+const std::string StateMagic = "RTBKIT post auction state 1";
+
+enum { MinJournalBytes = 16 * 1024 * 1024 };
+
+void writeChunk(std::ofstream & stream, const std::string & data)
 {
-    istringstream stream(str);
-    DB::Store_Reader store(stream);
-    pair<Id, Id> result;
-    store >> result.first >> result.second;
-    return result;
+    uint64_t size = data.size();
+    stream.write((const char *)&size, sizeof(size));
+    stream.write(data.data(), data.size());
+    stream.flush();
+
+    if (!stream)
+        throw ML::Exception("error writing post auction state journal");
 }
 
-std::string stringifyPair(const std::pair<Id, Id> & vals)
+void writeHeader(DB::Store_Writer & store, uint64_t generation)
 {
-    if (!vals.second || vals.second.type == Id::NULLID)
-        throw ML::Exception("attempt to store null ID");
-
-    ostringstream stream;
-    {
-        DB::Store_Writer store(stream);
-        store << vals.first << vals.second;
-    }
+    store << StateMagic << generation;
+}
 
-    return stream.str();
+uint64_t readHeader(DB::Store_Reader & store, const std::string & filename)
+{
+    std::string magic;
+    uint64_t generation;
+    store >> magic;
+    if (magic != StateMagic)
+        throw ML::Exception("%s is not post auction state", filename.c_str());
+    store >> generation;
+    return generation;
 }
 
 } // file scope
 
+SimpleEventMatcher::
+~SimpleEventMatcher()
+{
+    if (!journal) return;
 
-#if 0 // Persistence layer that needs to be reworked.
+    try {
+        saveState();
+    } catch (const std::exception & exc) {
+        LOG(error) << "error saving state on exit: " << exc.what() << endl;
+    }
+}
 
 void
 SimpleEventMatcher::
 initStatePersistence(const std::string & path)
 {
-    typedef PendingPersistenceT<pair<Id, Id>, SubmissionInfo>
-        SubmittedPending;
+    if (spill)
+        throw ML::Exception("initStatePersistence must come before initFinishedSpill");
+    if (journal)
+        throw ML::Exception("state persistence is already initialized");
 
-    auto submittedDb = std::make_shared<LeveldbPendingPersistence>();
-    submittedDb->open(path + "/submitted");
+    boost::filesystem::create_directories(path);
+    statePath = path;
 
-    auto submittedPersistence
-        = std::make_shared<SubmittedPending>();
-    submittedPersistence->store = submittedDb;
+    restoreState();
 
-    auto stringifySubmissionInfo = [] (const SubmissionInfo & info)
-        {
-            return info.serializeToString();
-        };
+    // Fold whatever was restored into a fresh snapshot of our own.
+    writeSnapshot();
+}
+
+void
+SimpleEventMatcher::
+restoreState()
+{
+    Date start = Date::now();
+    size_t records = 0;
+    stateGeneration = 0;
+
+    string snapshotFile = statePath + "/snapshot";
+    if (boost::filesystem::exists(snapshotFile)) {
+        std::ifstream stream(snapshotFile, ios::in | ios::binary);
+        DB::Store_Reader store(stream);
+        stateGeneration = readHeader(store, snapshotFile);
+        while (restoreRecord(store)) ++records;
+    }
 
-    auto unstringifySubmissionInfo = [] (const std::string & str)
+    string journalFile = statePath + "/journal";
+    if (stateGeneration && boost::filesystem::exists(journalFile)) {
+        ML::File_Read_Buffer buffer(journalFile);
+        const char * p = buffer.start();
+        const char * end = buffer.end();
+
+        for (bool header = true;  end - p >= (ssize_t)sizeof(uint64_t);
+             header = false)
         {
-            SubmissionInfo info;
-            info.reconstituteFromString(str);
-            return info;
-        };
+            uint64_t size;
+            memcpy(&size, p, sizeof(size));
+            p += sizeof(size);
 
-    submittedPersistence->stringifyKey = stringifyPair;
-    submittedPersistence->unstringifyKey = unstringifyPair;
-    submittedPersistence->stringifyValue = stringifySubmissionInfo;
-    submittedPersistence->unstringifyValue = unstringifySubmissionInfo;
+            if (size > uint64_t(end - p)) {
+                LOG(print) << journalFile << ": ignoring truncated chunk" << endl;
+                break;
+            }
 
-    Date newTimeout = Date::now().plusSeconds(15);
+            std::istringstream stream(string(p, size));
+            p += size;
+            DB::Store_Reader store(stream);
 
-    auto acceptSubmitted = [&] (pair<Id, Id> & key,
-                                SubmissionInfo & info,
-                                Date & timeout) -> bool
-        {
-            info.fromOldRouter = true;
-            newTimeout.addSeconds(0.001);
-            timeout = newTimeout;
-            // this->debugSpot(key.first, key.second, "RECONST SUBMITTED");
-            return true;
-        };
+            if (header) {
+                if (readHeader(store, journalFile) != stateGeneration) {
+                    LOG(print) << journalFile << ": ignoring stale journal" << endl;
+                    break;
+                }
+                continue;
+            }
 
-    submitted.initFromStore(submittedPersistence,
-                            acceptSubmitted,
-                            Date::now().plusSeconds(15));
+            while (restoreRecord(store)) ++records;
+        }
+    }
 
-    typedef PendingPersistenceT<pair<Id, Id>, FinishedInfo>
-        FinishedPending;
+    double elapsed = Date::now().secondsSince(start);
+    recordOutcome(elapsed * 1000.0, "state.restoreTimeMs");
+    LOG(print) << "restored " << submitted.size() << " submitted and "
+        << finished.size() << " finished auctions from " << records
+        << " records in " << statePath << " in " << elapsed << "s" << endl;
+}
 
-    auto finishedDb = std::make_shared<LeveldbPendingPersistence>();
-    finishedDb->open(path + "/finished");
+bool
+SimpleEventMatcher::
+restoreRecord(DB::Store_Reader & store)
+{
+    char type;
+    store >> type;
+    if (type == 'e') return false;
+
+    pair<Id, Id> key;
+    store >> key;
+
+    switch (type) {
+    case 'x': {
+        submitted.erase(key);
+        finished.erase(key);
+
+        auto it = spotIdMap.find(key.first);
+        if (it != spotIdMap.end() && it->second == key.second)
+            spotIdMap.erase(it);
+        break;
+    }
 
-    auto finishedPersistence
-        = std::make_shared<FinishedPending>();
-    finishedPersistence->store = finishedDb;
+    case 's': {
+        Date timeout;
+        SubmissionInfo info;
+        store >> timeout;
+        info.reconstitute(store);
+        info.fromOldRouter = true;
 
-    auto stringifyFinishedInfo = [] (const FinishedInfo & info)
-        {
-            return info.serializeToString();
-        };
+        submitted.erase(key);
+        submitted.emplace(key, std::move(info), timeout);
+        spotIdMap[key.first] = key.second;
+        seenAuctions.insert(key.first);
+        break;
+    }
 
-    auto unstringifyFinishedInfo = [] (const std::string & str)
-        {
-            FinishedInfo info;
-            info.reconstituteFromString(str);
-            return info;
-        };
+    case 'f': {
+        Date timeout;
+        FinishedInfo info;
+        store >> timeout;
+        info.reconstitute(store, finishedStrings);
+        info.fromOldRouter = true;
 
-    finishedPersistence->stringifyKey = stringifyPair;
-    finishedPersistence->unstringifyKey = unstringifyPair;
-    finishedPersistence->stringifyValue = stringifyFinishedInfo;
-    finishedPersistence->unstringifyValue = unstringifyFinishedInfo;
+        finished.erase(key);
+        finished.emplace(key, std::move(info), timeout);
+        spotIdMap[key.first] = key.second;
+        seenAuctions.insert(key.first);
+        break;
+    }
 
-    newTimeout = Date::now().plusSeconds(auctionTimeout);
+    default:
+        throw ML::Exception("unknown post auction state record %d", type);
+    }
 
-    auto acceptFinished = [&] (pair<Id, Id> & key,
-                               FinishedInfo & info,
-                               Date & timeout) -> bool
-        {
-            info.fromOldRouter = true;
-            newTimeout.addSeconds(0.001);
-            timeout = newTimeout;
-            // this->debugSpot(key.first, key.second, "RECONST FINISHED");
+    return true;
+}
 
-            return true;
-        };
+void
+SimpleEventMatcher::
+saveState()
+{
+    if (!journal) return;
 
-    finished.initFromStore(finishedPersistence,
-                           acceptFinished,
-                           Date::now().plusSeconds(auctionTimeout));
+    if (journalBytes > 2 * snapshotBytes + MinJournalBytes) {
+        writeSnapshot();
+        return;
+    }
 
-    auto backgroundWork = [=] (volatile int & shutdown, int64_t threadId)
-        {
-            while (!shutdown) {
-                futex_wait(const_cast<int &>(shutdown), 0, 600.0);
-                if (shutdown) break;
-                //continue;
-
-                {
-                    Date start = Date::now();
-                    submittedDb->compact();
-                    Date end = Date::now();
-                    this->recordEvent("persistentData.submitted.compactTimeMs",
-                                  ET_OUTCOME,
-                                  1000.0 * (end.secondsSince(start)));
-                    uint64_t size = submittedDb->getDbSize();
-                    //cerr << "submitted db is " << size / 1024.0 / 1024.0
-                    //     << "MB" << endl;
-                    this->recordEvent("persistentData.submitted.dbSizeMb",
-                                  ET_LEVEL, size / 1024.0 / 1024.0);
-                }
+    if (dirty.empty()) return;
 
-                {
-                    Date start = Date::now();
-                    finishedDb->compact();
-                    Date end = Date::now();
-                    this->recordEvent("persistentData.finished.compactTimeMs",
-                                  ET_OUTCOME,
-                                  1000.0 * (end.secondsSince(start)));
-                    uint64_t size = finishedDb->getDbSize();
-                    //cerr << "finished db is " << size / 1024.0 / 1024.0
-                    //     << "MB" << endl;
-                    this->recordEvent("persistentData.finished.dbSizeMb",
-                                  ET_LEVEL, size / 1024.0 / 1024.0);
-                }
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+
+        for (const auto & key : dirty) {
+            // The entry may have moved from one map to the other.
+            store << 'x' << key;
+
+            if (submitted.count(key)) {
+                store << 's' << key << submitted.getTimeout(key);
+                submitted.get(key).serialize(store);
+            }
+
+            if (finished.count(key)) {
+                store << 'f' << key << finished.getTimeout(key);
+                finished.get(key).serialize(store);
             }
+        }
+
+        store << 'e';
+    }
 
-            cerr << "exiting background work thread" << endl;
-        };
+    string data = stream.str();
+    writeChunk(*journal, data);
+    journalBytes += sizeof(uint64_t) + data.size();
 
-    // loop.startSubordinateThread(backgroundWork);
+    recordCount(dirty.size(), "state.journalEntries");
+    dirty.clear();
 }
 
-#endif
+void
+SimpleEventMatcher::
+writeSnapshot()
+{
+    Date start = Date::now();
+    uint64_t generation = stateGeneration + 1;
+
+    string snapshotFile = statePath + "/snapshot";
+    string tmpFile = snapshotFile + ".tmp";
+
+    {
+        std::ofstream stream(tmpFile, ios::out | ios::trunc | ios::binary);
+        {
+            DB::Store_Writer store(stream);
+            writeHeader(store, generation);
+
+            submitted.forEach([&] (const pair<Id, Id> & key,
+                                   const SubmissionInfo & info, Date timeout)
+                    {
+                        store << 's' << key << timeout;
+                        info.serialize(store);
+                    });
+
+            finished.forEach([&] (const pair<Id, Id> & key,
+                                  const FinishedInfo & info, Date timeout)
+                    {
+                        store << 'f' << key << timeout;
+                        info.serialize(store);
+                    });
+
+            store << 'e';
+        }
+
+        stream.flush();
+        if (!stream)
+            throw ML::Exception("error writing %s", tmpFile.c_str());
+        snapshotBytes = stream.tellp();
+    }
+
+    // The rename is atomic so there's always a complete snapshot around.  A
+    // crash before the journal is reset leaves an old generation journal.
+    boost::filesystem::rename(tmpFile, snapshotFile);
+    stateGeneration = generation;
+
+    std::ostringstream header;
+    {
+        DB::Store_Writer store(header);
+        writeHeader(store, generation);
+    }
+
+    journal.reset(new std::ofstream(
+                    statePath + "/journal", ios::out | ios::trunc | ios::binary));
+    writeChunk(*journal, header.str());
+    journalBytes = sizeof(uint64_t) + header.str().size();
+    dirty.clear();
+
+    recordOutcome(Date::now().secondsSince(start) * 1000.0,
+            "state.snapshotTimeMs");
+    recordLevel(snapshotBytes / 1024.0 / 1024.0, "state.snapshotSizeMb");
+}
 
 } // RTBKIT
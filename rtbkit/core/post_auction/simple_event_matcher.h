@@ -10,11 +10,17 @@
 #include "timeout_map.h"
 #include "event_matcher.h"
 #include "finished_info.h"
+#include "finished_spill_store.h"
+#include "seen_auction_filter.h"
 #include "submission_info.h"
 #include "rtbkit/common/auction.h"
 // #include "soa/service/pending_list.h"
 #include "soa/service/logs.h"
+#include "soa/service/process_stats.h"
+#include "jml/utils/flat_hash_map.h"
 
+#include <fstream>
+#include <unordered_set>
 #include <utility>
 
 
@@ -44,6 +50,9 @@ struct SimpleEventMatcher : public EventMatcher
     SimpleEventMatcher(std::string prefix, std::shared_ptr<EventService> events);
     SimpleEventMatcher(std::string prefix, std::shared_ptr<ServiceProxies> proxies);
 
+    /** Writes whatever state changed since the last journal write. */
+    ~SimpleEventMatcher();
+
 
     /************************************************************************/
     /* EVENT MATCHING                                                       */
@@ -63,7 +72,21 @@ struct SimpleEventMatcher : public EventMatcher
     /* PERSISTENCE                                                          */
     /************************************************************************/
 
-    // virtual void initStatePersistence(const std::string & path);
+    /** Restore the submitted and finished auctions saved in the given
+        directory and keep saving them there: the entries that changed are
+        appended to a journal on every checkExpiredAuctions() and the journal
+        is folded into a full snapshot once it outgrows it.  Must be called
+        before initFinishedSpill() so that the spilled wins are kept too, and
+        before the matcher is started.
+    */
+    virtual void initStatePersistence(const std::string & path);
+
+    /** Append the entries that changed since the last call to the journal,
+        or write a new snapshot if the journal has grown too large.
+    */
+    void saveState();
+
+    virtual void initFinishedSpill(const std::string & path, float age);
 
     static Logging::Category print;
     static Logging::Category error;
@@ -103,7 +126,25 @@ private:
     Date expireSubmitted(
             Date start, const std::pair<Id, Id> & key, const SubmissionInfo & info);
 
-    Date expireFinished(const std::pair<Id, Id> & key, const FinishedInfo & info);
+    Date expireFinished(
+            Date start, const std::pair<Id, Id> & key, const FinishedInfo & info);
+
+    /** Bring a spilled entry back into the finished map.  Returns false if
+        there's no spill store or the entry isn't in it.
+    */
+    bool unspill(const Id & auctionId, Id adSpotId);
+
+    /** Remember that the entry for the key changed so that it makes it into
+        the next journal write.
+    */
+    void touch(const std::pair<Id, Id> & key)
+    {
+        if (journal) dirty.insert(key);
+    }
+
+    void restoreState();
+    bool restoreRecord(ML::DB::Store_Reader & store);
+    void writeSnapshot();
 
 
     /** List of auctions we're currently tracking as submitted.  Note that an
@@ -113,7 +154,7 @@ private:
         The key is the (auction id, spot id) pair since after submission,
         the result from every auction comes back separately.
     */
-    typedef TimeoutMap<std::pair<Id, Id>, SubmissionInfo> Submitted;
+    typedef TimeoutMap<std::pair<Id, Id>, SubmissionInfo, IdHash> Submitted;
     Submitted submitted;
 
     /** List of auctions we've won and we're waiting for a campaign event
@@ -124,9 +165,24 @@ private:
         We keep this list around for 5 minutes for those that were lost,
         and one hour for those that were won.
     */
-    typedef TimeoutMap<std::pair<Id, Id>, FinishedInfo> Finished;
+    typedef TimeoutMap<std::pair<Id, Id>, FinishedInfo, IdHash> Finished;
     Finished finished;
 
+    /** Memory held by submitted and finished, updated whenever they're
+        expired.
+    */
+    Datacratic::MemoryGauge submittedMemory;
+    Datacratic::MemoryGauge finishedMemory;
+
+    /** Compressed bid requests and augmentations of the finished entries. */
+    StringBlockStore finishedStrings;
+
+    /** Won auctions that have been in finished for longer than spillAge
+        seconds.  Only set if initFinishedSpill() was called.
+    */
+    std::unique_ptr<FinishedSpillStore> spill;
+    float spillAge;
+
     /** Maintains a map of auction id with the most recently seen spot id. Used
         to associate an event that doesn't have a spot id with an entry within
         submitted or finished.
@@ -136,7 +192,25 @@ private:
         which entry is the real entry. So instead we keep an arbitrarily chosen
         entry.
      */
-    std::unordered_map<Id, Id> spotIdMap;
+    ML::Flat_Hash_Map<Id, Id, IdHash> spotIdMap;
+
+    /** Every auction id that made it into submitted, remembered for as long
+        as an event for it can still be matched.  Campaign events for the
+        auctions that aren't in it are dropped without any lookup and wins
+        for them don't go looking into the spill store.
+    */
+    SeenAuctionFilter seenAuctions;
+
+    /** Directory where the state is saved and the open journal in it.  Only
+        set if initStatePersistence() was called.
+    */
+    std::string statePath;
+    std::unique_ptr<std::ofstream> journal;
+    std::unordered_set< std::pair<Id, Id> > dirty;
+
+    uint64_t stateGeneration;   ///< Bumped by every snapshot
+    uint64_t snapshotBytes;
+    uint64_t journalBytes;
 };
 
 } // RTBKIT
@@ -0,0 +1,142 @@
+/** string_block_store.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Implementation of the string block store.
+
+*/
+
+#include "string_block_store.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/lz4.h"
+
+#include <mutex>
+#include <algorithm>
+
+using namespace std;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* BLOCK                                                                     */
+/*****************************************************************************/
+
+/** While a block is being filled its strings live uncompressed in data.  Once
+    sealed, data holds the LZ4 compressed block unless compressing didn't
+    save anything, in which case it's left as is.
+*/
+struct StringBlockStore::Block {
+    Block() : rawSize(0), compressed(false) {}
+
+    mutable ML::Spinlock lock;
+    std::string data;
+    uint32_t rawSize;
+    bool compressed;
+};
+
+
+/*****************************************************************************/
+/* STRING BLOCK STORE                                                        */
+/*****************************************************************************/
+
+std::string
+StringBlockStore::Ref::
+str() const
+{
+    if (!block) return std::string();
+
+    std::lock_guard<ML::Spinlock> guard(block->lock);
+
+    if (!block->compressed)
+        return block->data.substr(offset, length);
+
+    // Strings are appended so we only need to decode up to the end of ours.
+    int target = offset + length;
+    std::unique_ptr<char[]> buffer(new char[block->rawSize]);
+
+    int res = LZ4_decompress_safe_partial(
+            block->data.data(), buffer.get(), block->data.size(),
+            target, block->rawSize);
+    if (res < target)
+        throw ML::Exception("corrupt string block: %d < %d", res, target);
+
+    return std::string(buffer.get() + offset, length);
+}
+
+StringBlockStore::
+StringBlockStore(size_t blockSize)
+    : blockSize(blockSize), rawBytes_(0), storedBytes_(0)
+{
+    if (blockSize == 0 || blockSize >= LZ4_MAX_INPUT_SIZE)
+        throw ML::Exception("invalid string block size: %zd", blockSize);
+}
+
+StringBlockStore::Ref
+StringBlockStore::
+add(const std::string & str)
+{
+    Ref ref;
+    if (str.empty()) return ref;
+
+    if (str.size() >= LZ4_MAX_INPUT_SIZE)
+        throw ML::Exception("string too large for string block: %zd",
+                str.size());
+
+    if (current && current->data.size() + str.size() > blockSize)
+        seal();
+
+    if (!current) {
+        current = std::make_shared<Block>();
+        current->data.reserve(std::max(blockSize, str.size()));
+    }
+
+    {
+        std::lock_guard<ML::Spinlock> guard(current->lock);
+        ref.offset = current->data.size();
+        ref.length = str.size();
+        current->data.append(str);
+    }
+
+    ref.block = current;
+
+    if (current->data.size() >= blockSize)
+        seal();
+
+    return ref;
+}
+
+void
+StringBlockStore::
+seal()
+{
+    if (!current) return;
+    seal(*current);
+    current.reset();
+}
+
+void
+StringBlockStore::
+seal(Block & block)
+{
+    std::string & data = block.data;
+
+    std::string compressed;
+    compressed.resize(LZ4_compressBound(data.size()));
+    int size = LZ4_compress(data.data(), &compressed[0], data.size());
+
+    rawBytes_ += data.size();
+
+    std::lock_guard<ML::Spinlock> guard(block.lock);
+
+    block.rawSize = data.size();
+    if (size > 0 && size_t(size) < data.size()) {
+        compressed.resize(size);
+        compressed.shrink_to_fit();
+        data.swap(compressed);
+        block.compressed = true;
+    }
+    else data.shrink_to_fit();
+
+    storedBytes_ += data.size();
+}
+
+} // namespace RTBKIT
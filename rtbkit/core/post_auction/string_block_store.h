@@ -0,0 +1,84 @@
+/** string_block_store.h                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Compressed storage for the large, rarely read strings that the post
+    auction loop keeps around for every finished auction.
+
+*/
+
+#pragma once
+
+#include "jml/arch/spinlock.h"
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* STRING BLOCK STORE                                                        */
+/*****************************************************************************/
+
+/** Appends strings into blocks which are LZ4 compressed as a whole once they
+    fill up.  Consecutive bid requests share most of their structure so
+    compressing them together works much better than compressing each one on
+    its own: each block acts as the dictionary for the strings it contains.
+
+    Strings are handed back as a Ref which keeps its block alive; a block is
+    freed once every Ref into it is gone.  Reading a string from a sealed
+    block decompresses the block up to the end of that string so this is
+    meant for data that is written once and read rarely, if ever.
+
+    Adding strings is not thread-safe but Refs can be read from any thread.
+*/
+
+struct StringBlockStore {
+
+    enum { DefaultBlockSize = 64 * 1024 };
+
+    struct Block;
+
+    struct Ref {
+        Ref() : offset(0), length(0) {}
+
+        bool empty() const { return length == 0; }
+        size_t size() const { return length; }
+
+        /** Expand the string; decompresses its block if it's sealed. */
+        std::string str() const;
+
+    private:
+        friend struct StringBlockStore;
+
+        std::shared_ptr<Block> block;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    explicit StringBlockStore(size_t blockSize = DefaultBlockSize);
+
+    /** Copy the string into the current block, sealing the block first if
+        the string doesn't fit.  Strings larger than a block get a block of
+        their own.
+    */
+    Ref add(const std::string & str);
+
+    /** Compress the block currently being filled. */
+    void seal();
+
+    /** Bytes added and bytes kept for all blocks sealed so far. */
+    uint64_t rawBytes() const { return rawBytes_; }
+    uint64_t storedBytes() const { return storedBytes_; }
+
+private:
+    void seal(Block & block);
+
+    size_t blockSize;
+    std::shared_ptr<Block> current;
+
+    uint64_t rawBytes_;
+    uint64_t storedBytes_;
+};
+
+} // namespace RTBKIT
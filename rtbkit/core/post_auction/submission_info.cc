@@ -0,0 +1,78 @@
+/** submission_info.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Serialization of the submitted auction info.
+
+*/
+
+#include "submission_info.h"
+#include "jml/db/persistent.h"
+#include "jml/db/compact_size_types.h"
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* SUBMISSION INFO                                                           */
+/*****************************************************************************/
+
+namespace {
+
+void serializeEvents(DB::Store_Writer & store,
+                     const vector<shared_ptr<PostAuctionEvent> > & events)
+{
+    store << DB::compact_size_t(events.size());
+    for (auto & event: events)
+        store << event;
+}
+
+void reconstituteEvents(DB::Store_Reader & store,
+                        vector<shared_ptr<PostAuctionEvent> > & events)
+{
+    DB::compact_size_t size(store);
+    events.resize(size);
+    for (auto & event: events)
+        store >> event;
+}
+
+} // namespace anonymous
+
+void
+SubmissionInfo::
+serialize(DB::Store_Writer & store) const
+{
+    unsigned char version = 1;
+    store << version << bool(auction);
+    if (auction)
+        auction->serialize(store);
+
+    store << bidRequestStrFormat << augmentations << bid << fromOldRouter;
+    serializeEvents(store, pendingWinEvents);
+    serializeEvents(store, earlyCampaignEvents);
+}
+
+void
+SubmissionInfo::
+reconstitute(DB::Store_Reader & store)
+{
+    unsigned char version;
+    store >> version;
+    if (version != 1)
+        throw ML::Exception("invalid SubmissionInfo version");
+
+    bool hasAuction;
+    store >> hasAuction;
+    auction.reset();
+    if (hasAuction) {
+        auction = std::make_shared<SubmittedAuctionEvent>();
+        auction->reconstitute(store);
+    }
+
+    store >> bidRequestStrFormat >> augmentations >> bid >> fromOldRouter;
+    reconstituteEvents(store, pendingWinEvents);
+    reconstituteEvents(store, earlyCampaignEvents);
+}
+
+} // namespace RTBKIT
@@ -29,11 +29,18 @@ struct SubmissionInfo {
     {
     }
 
-    std::shared_ptr<BidRequest> bidRequest;
+    /** Auction as it was submitted, null until it's received.  It's kept
+        so that its bid request is only decoded when a result needs it.
+    */
+    std::shared_ptr<SubmittedAuctionEvent> auction;
     std::string bidRequestStrFormat;
 
+    std::shared_ptr<BidRequest> bidRequest() const {
+        return auction->bidRequest();
+    }
+
     Datacratic::UnicodeString bidRequestStr() const {
-        return Datacratic::UnicodeString(bidRequest->toJsonStr());
+        return Datacratic::UnicodeString(bidRequest()->toJsonStr());
     }
 
     JsonHolder augmentations;
@@ -48,6 +55,9 @@ struct SubmissionInfo {
     */
     std::vector<std::shared_ptr<PostAuctionEvent> > pendingWinEvents;
     std::vector<std::shared_ptr<PostAuctionEvent> > earlyCampaignEvents;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
 
@@ -0,0 +1,86 @@
+/* finished_spill_store_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the LevelDB tier of the finished auctions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/finished_spill_store.h"
+
+#include <boost/test/unit_test.hpp>
+#include <unistd.h>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+string tempPath()
+{
+    return "./build/x86_64/tmp/finished_spill_store_test-"
+        + to_string(getpid());
+}
+
+FinishedInfo makeInfo(StringBlockStore & strings,
+                      const Id & auctionId, const Id & adSpotId,
+                      Date retainUntil)
+{
+    FinishedInfo info;
+    info.auctionId = auctionId;
+    info.adSpotId = adSpotId;
+    info.spotIndex = 0;
+    info.bidRequestStrFormat = "datacratic";
+    info.bidRequestStrRef = strings.add("{\"id\":\"" + auctionId.toString() + "\"}");
+    info.augmentationsRef = strings.add("{}");
+    info.setWin(Date::now(), BS_WIN, USD_CPM(1), USD_CPM(2), "meta");
+    info.campaignEvents.setEvent("IMPRESSION", Date::now(), JsonHolder());
+    info.retainUntil = retainUntil;
+    return info;
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_put_take_expire )
+{
+    StringBlockStore strings;
+    FinishedSpillStore store(tempPath());
+
+    Date now = Date::now();
+    Id a1("auction1"), a2("auction2"), s1("spot1"), s2("spot2");
+
+    store.put({ a1, s1 }, makeInfo(strings, a1, s1, now.plusSeconds(10)));
+    store.put({ a1, s2 }, makeInfo(strings, a1, s2, now.plusSeconds(20)));
+    store.put({ a2, s1 }, makeInfo(strings, a2, s1, now.plusSeconds(30)));
+
+    FinishedInfo info;
+    Id spot = s1;
+
+    // Nothing is visible until the batch is committed.
+    BOOST_CHECK(!store.take(a1, spot, info, strings));
+    store.commit();
+    BOOST_CHECK_EQUAL(store.size(), 3);
+
+    BOOST_REQUIRE(store.take(a1, spot, info, strings));
+    BOOST_CHECK_EQUAL(info.auctionId, a1);
+    BOOST_CHECK_EQUAL(info.bidRequestStr().rawString(), "{\"id\":\"auction1\"}");
+    BOOST_CHECK_EQUAL(info.winPrice, USD_CPM(1));
+    BOOST_CHECK(info.campaignEvents.hasEvent("IMPRESSION"));
+    BOOST_CHECK(!store.take(a1, spot, info, strings));
+
+    // Without a spot id, any spot of the auction will do.
+    spot = Id();
+    BOOST_REQUIRE(store.take(a1, spot, info, strings));
+    BOOST_CHECK_EQUAL(spot, s2);
+    BOOST_CHECK_EQUAL(store.size(), 1);
+
+    BOOST_CHECK_EQUAL(store.expire(now.plusSeconds(29)), 0);
+    BOOST_CHECK_EQUAL(store.expire(now.plusSeconds(31)), 1);
+    BOOST_CHECK_EQUAL(store.size(), 0);
+
+    spot = s1;
+    BOOST_CHECK(!store.take(a2, spot, info, strings));
+}
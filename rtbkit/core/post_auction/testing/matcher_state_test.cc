@@ -0,0 +1,167 @@
+/* matcher_state_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests that the event matcher picks up where it left off after a restart.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/simple_event_matcher.h"
+#include "rtbkit/core/post_auction/events.h"
+#include "rtbkit/core/banker/null_banker.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <set>
+#include <unistd.h>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+string tempPath()
+{
+    return "./build/x86_64/tmp/matcher_state_test-" + to_string(getpid());
+}
+
+std::shared_ptr<SubmittedAuctionEvent> makeAuction(size_t i)
+{
+    BidRequest bidRequest;
+    AdSpot spot;
+    spot.id = Id(1);
+    spot.formats.push_back(Format(300, 250));
+    bidRequest.imp.push_back(spot);
+    bidRequest.auctionId = Id(1000 + i);
+    bidRequest.exchange = "mock";
+    bidRequest.timestamp = Date::now();
+
+    auto event = std::make_shared<SubmittedAuctionEvent>();
+    event->auctionId = bidRequest.auctionId;
+    event->adSpotId = Id(1);
+    event->lossTimeout = Date::now().plusSeconds(60);
+    event->bidRequestStr = bidRequest.toJsonStr();
+    event->bidRequestStrFormat = "datacratic";
+    event->bidResponse = Auction::Response(USD_CPM(2), 1, AccountKey("a.b.c"));
+    event->bidResponse.bidData = Bids::fromJson("{\"bids\":[{\"spotIndex\":0}]}");
+    return event;
+}
+
+std::shared_ptr<PostAuctionEvent> makeWin(size_t i)
+{
+    auto event = std::make_shared<PostAuctionEvent>();
+    event->type = PAE_WIN;
+    event->auctionId = Id(1000 + i);
+    event->adSpotId = Id(1);
+    event->winPrice = USD_CPM(1);
+    event->timestamp = Date::now();
+    event->account = AccountKey("a.b.c");
+    event->bidTimestamp = Date::now();
+    return event;
+}
+
+struct Matcher : public SimpleEventMatcher
+{
+    Matcher(const string & path) :
+        SimpleEventMatcher("test", std::make_shared<NullEventService>())
+    {
+        setBanker(std::make_shared<NullBanker>());
+        onMatchedWinLoss = [&] (std::shared_ptr<MatchedWinLoss> event) {
+            if (event->type == MatchedWinLoss::Win)
+                wins.insert(event->auctionId);
+        };
+        initStatePersistence(path);
+    }
+
+    std::set<Id> wins;
+};
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_restore_after_restart )
+{
+    enum { NumAuctions = 100 };
+    string path = tempPath();
+
+    {
+        Matcher matcher(path);
+        for (size_t i = 0; i < NumAuctions; ++i)
+            matcher.doAuction(makeAuction(i));
+
+        // The auctions make it into the journal...
+        matcher.checkExpiredAuctions();
+
+        // ... and the wins are saved when the matcher goes away.
+        for (size_t i = 0; i < NumAuctions / 2; ++i)
+            matcher.doEvent(makeWin(i));
+        BOOST_CHECK_EQUAL(matcher.wins.size(), NumAuctions / 2);
+    }
+
+    // A write cut short by a crash is ignored.
+    {
+        std::ofstream journal(path + "/journal", ios::app | ios::binary);
+        uint64_t size = 1000;
+        journal.write((const char *)&size, sizeof(size));
+        journal.write("abc", 3);
+    }
+
+    {
+        Matcher matcher(path);
+        for (size_t i = 0; i < NumAuctions; ++i)
+            matcher.doEvent(makeWin(i));
+
+        // The first half are duplicates of the wins that were restored as
+        // finished and the others match the restored submitted auctions.
+        BOOST_CHECK_EQUAL(matcher.wins.size(), NumAuctions / 2);
+        for (size_t i = NumAuctions / 2; i < NumAuctions; ++i)
+            BOOST_CHECK(matcher.wins.count(Id(1000 + i)));
+    }
+
+    // The snapshot written on restore carries on to the next restart.
+    {
+        Matcher matcher(path);
+        for (size_t i = 0; i < NumAuctions; ++i)
+            matcher.doEvent(makeWin(i));
+        BOOST_CHECK_EQUAL(matcher.wins.size(), 0);
+    }
+
+    boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE( test_stale_journal )
+{
+    string path = tempPath() + "-stale";
+
+    {
+        Matcher matcher(path);
+        matcher.doAuction(makeAuction(0));
+    }
+
+    // Keep the journal that has the auction as submitted.
+    boost::filesystem::copy_file(path + "/journal", path + "/journal.old");
+
+    {
+        Matcher matcher(path);
+        matcher.doEvent(makeWin(0));
+        BOOST_CHECK_EQUAL(matcher.wins.size(), 1);
+    }
+
+    // Folds the win into a new snapshot.
+    {
+        Matcher matcher(path);
+    }
+
+    // The old journal is what a crash right after writing a snapshot leaves
+    // behind and it mustn't take the auction back to submitted.
+    boost::filesystem::rename(path + "/journal.old", path + "/journal");
+
+    Matcher matcher(path);
+    matcher.doEvent(makeWin(0));
+    BOOST_CHECK_EQUAL(matcher.wins.size(), 0);
+
+    boost::filesystem::remove_all(path);
+}
@@ -0,0 +1,53 @@
+/* seen_auction_filter_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the Bloom filters of the seen auctions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/seen_auction_filter.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_seen_auction_filter )
+{
+    enum { NumIds = 10000 };
+
+    SeenAuctionFilter filter(0.01);
+    Date now = Date::now();
+
+    // Nothing can be ruled out until the filter has seen a full window
+    BOOST_CHECK(!filter.complete());
+    BOOST_CHECK(filter.mightContain(Id(1)));
+
+    for (int i = 0;  i < NumIds;  ++i)
+        filter.insert(Id(i));
+
+    BOOST_CHECK(!filter.rotate(now.plusSeconds(5), 10));
+    BOOST_CHECK(filter.rotate(now.plusSeconds(10), 10));
+    BOOST_CHECK(filter.rotate(now.plusSeconds(20), 10));
+    BOOST_CHECK(filter.complete());
+
+    // No false negatives and few false positives
+    size_t falsePositives = 0;
+    for (int i = 0;  i < NumIds;  ++i) {
+        BOOST_CHECK(filter.mightContain(Id(i)));
+        if (filter.mightContain(Id(NumIds + i)))
+            ++falsePositives;
+    }
+    BOOST_CHECK_LT(falsePositives, NumIds / 20);
+
+    // Ids are forgotten once their generation is rotated out
+    BOOST_CHECK(filter.rotate(now.plusSeconds(30), 10));
+    size_t remembered = 0;
+    for (int i = 0;  i < NumIds;  ++i)
+        if (filter.mightContain(Id(i)))
+            ++remembered;
+    BOOST_CHECK_LT(remembered, NumIds / 20);
+}
@@ -0,0 +1,81 @@
+/* string_block_store_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the compressed string block store.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/string_block_store.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace RTBKIT;
+
+
+namespace {
+
+string makeRequest(mt19937 & rng, unsigned i)
+{
+    return "{\"id\":\"" + to_string(rng()) + "\",\"imp\":[{\"id\":\"" +
+        to_string(i) + "\",\"banner\":{\"w\":300,\"h\":250}}],"
+        "\"site\":{\"domain\":\"example.com\",\"page\":\"http://example.com/"
+        + to_string(rng() % 100) + "\"},\"user\":{\"id\":\"" +
+        to_string(rng()) + "\"}}";
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_round_trip )
+{
+    mt19937 rng(0);
+    StringBlockStore store(4096);
+
+    BOOST_CHECK(store.add("").empty());
+    BOOST_CHECK_EQUAL(StringBlockStore::Ref().str(), "");
+
+    vector<string> strings;
+    vector<StringBlockStore::Ref> refs;
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        strings.push_back(makeRequest(rng, i));
+        refs.push_back(store.add(strings.back()));
+
+        // Readable from the open block before it gets sealed.
+        BOOST_REQUIRE_EQUAL(refs.back().str(), strings.back());
+    }
+
+    // Bigger than a block and incompressible.
+    string big;
+    for (unsigned i = 0;  i < 10000;  ++i) big += char(rng());
+    strings.push_back(big);
+    refs.push_back(store.add(big));
+
+    store.seal();
+
+    for (unsigned i = 0;  i < refs.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(refs[i].size(), strings[i].size());
+        BOOST_REQUIRE_EQUAL(refs[i].str(), strings[i]);
+    }
+
+    BOOST_CHECK_LT(store.storedBytes(), store.rawBytes() / 2 + big.size());
+}
+
+BOOST_AUTO_TEST_CASE( test_block_lifetime )
+{
+    StringBlockStore store(16);
+
+    StringBlockStore::Ref ref = store.add("a string in its own block");
+    store.add("another one");
+    store.seal();
+
+    // The store doesn't hold on to sealed blocks; the refs do.
+    StringBlockStore::Ref copy = ref;
+    ref = StringBlockStore::Ref();
+    BOOST_CHECK_EQUAL(copy.str(), "a string in its own block");
+}
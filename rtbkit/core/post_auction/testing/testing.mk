@@ -1,2 +1,7 @@
 $(eval $(call program,post_auction_redis_bench,post_auction redis))
 $(eval $(call program,post_auction_sharding_bench,post_auction boost_program_options))
+$(eval $(call test,timeout_map_test,types,boost))
+$(eval $(call test,string_block_store_test,post_auction,boost))
+$(eval $(call test,finished_spill_store_test,post_auction,boost))
+$(eval $(call test,seen_auction_filter_test,post_auction,boost))
+$(eval $(call test,matcher_state_test,post_auction banker boost_filesystem,boost))
@@ -0,0 +1,149 @@
+/* timeout_map_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the timer wheel based TimeoutMap.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/post_auction/timeout_map.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <map>
+#include <string>
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_basics )
+{
+    TimeoutMap<int, string> map;
+    Date start = Date::fromSecondsSinceEpoch(1000);
+
+    BOOST_CHECK(map.emplace(1, "one", start.plusSeconds(1)));
+    BOOST_CHECK(map.emplace(2, "two", start.plusSeconds(2)));
+    BOOST_CHECK(!map.emplace(1, "uno", start.plusSeconds(3)));
+    BOOST_CHECK_EQUAL(map.size(), 2);
+    BOOST_CHECK_EQUAL(map.get(1), "one");
+
+    map.get(2) = "deux";
+    BOOST_CHECK_EQUAL(map.get(2), "deux");
+
+    vector<int> expired;
+    auto onExpire = [&] (int key, string value) { expired.push_back(key); };
+
+    // Nothing expires early, not even within the same tick.
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(0.9999)), 0);
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(1)), 1);
+    BOOST_CHECK_EQUAL(expired.at(0), 1);
+    BOOST_CHECK(!map.count(1));
+
+    // Pushing the timeout back must not leave a stale entry behind.
+    map.update(2, start.plusSeconds(10));
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(5)), 0);
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(10)), 1);
+    BOOST_CHECK_EQUAL(map.size(), 0);
+
+    BOOST_CHECK(map.emplace(3, "three", start.plusSeconds(20)));
+    BOOST_CHECK_EQUAL(map.pop(3), "three");
+    BOOST_CHECK(!map.erase(3));
+    BOOST_CHECK_THROW(map.get(3), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_far_and_past_timeouts )
+{
+    TimeoutMap<int, int> map;
+    Date start = Date::fromSecondsSinceEpoch(1000);
+
+    map.emplace(1, 1, start.plusSeconds(100));
+
+    // Earlier than anything scheduled so far, and beyond the wheel's range.
+    map.emplace(2, 2, start.plusSeconds(-100));
+    map.emplace(3, 3, start.plusSeconds(100 * 24 * 3600));
+    map.emplace(4, 4, Date::positiveInfinity());
+
+    size_t n = 0;
+    auto onExpire = [&] (int, int) { ++n; };
+
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start), 1);
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(100)), 1);
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(3600)), 0);
+    BOOST_CHECK_EQUAL(map.expire(onExpire, start.plusSeconds(100 * 24 * 3600)), 1);
+    BOOST_CHECK_EQUAL(map.size(), 1);
+    BOOST_CHECK_EQUAL(n, 3);
+}
+
+/* Random operations checked against a trivially correct model. */
+BOOST_AUTO_TEST_CASE( test_random_against_model )
+{
+    mt19937 rng(0);
+
+    TimeoutMap<int, int> map;
+    std::map<int, pair<int, Date> > model;
+
+    Date now = Date::fromSecondsSinceEpoch(1000);
+
+    for (unsigned i = 0; i < 200000; ++i) {
+        int key = rng() % 5000;
+        Date timeout = now.plusSeconds((rng() % 1000000) / 1000.0 - 1.0);
+
+        switch (rng() % 4) {
+        case 0:
+            BOOST_REQUIRE_EQUAL(map.emplace(key, i, timeout),
+                                model.insert(make_pair(key, make_pair(i, timeout))).second);
+            break;
+
+        case 1:
+            if (model.count(key)) {
+                map.update(key, timeout);
+                model[key].second = timeout;
+            }
+            break;
+
+        case 2:
+            BOOST_REQUIRE_EQUAL(map.erase(key), model.erase(key));
+            break;
+
+        case 3: {
+            now = now.plusSeconds((rng() % 2000) / 1000.0);
+
+            std::map<int, int> expired;
+            map.expire([&] (int key, int value) { expired[key] = value; }, now);
+
+            std::map<int, int> expected;
+            for (auto it = model.begin(); it != model.end(); ) {
+                if (it->second.second <= now) {
+                    expected[it->first] = it->second.first;
+                    it = model.erase(it);
+                }
+                else ++it;
+            }
+
+            BOOST_REQUIRE(expired == expected);
+            break;
+        }
+        }
+
+        BOOST_REQUIRE_EQUAL(map.size(), model.size());
+    }
+
+    for (auto& entry : model) {
+        BOOST_REQUIRE(map.count(entry.first));
+        BOOST_REQUIRE_EQUAL(map.get(entry.first), entry.second.first);
+        BOOST_REQUIRE_EQUAL(map.getTimeout(entry.first), entry.second.second);
+    }
+
+    size_t visited = 0;
+    map.forEach([&] (int key, int value, Date timeout) {
+                auto it = model.find(key);
+                BOOST_REQUIRE(it != model.end());
+                BOOST_REQUIRE_EQUAL(value, it->second.first);
+                BOOST_REQUIRE_EQUAL(timeout, it->second.second);
+                ++visited;
+            });
+    BOOST_REQUIRE_EQUAL(visited, model.size());
+}
@@ -7,14 +7,26 @@
    Simpler version of the soa TimeoutMap which doesn't require linear scans to
    expire elements. Should eventually replace the one in soa.
 
+   Entries live in a pool of fixed size blocks and are indexed by an open
+   addressing hash table of 32 bit entry numbers, so there's no allocation per
+   entry.  The index keeps the hash of each entry next to its number so that
+   probing only ever touches the entry that matches.  Timeouts are kept in a hierarchical timer wheel whose buckets are
+   intrusive lists threaded through the entries: insert, update and erase are
+   O(1) and expiring only ever looks at the buckets that are due.
+
 */
 
 #pragma once
 
 #include "soa/types/date.h"
+#include "jml/utils/exc_check.h"
 
-#include <set>
-#include <queue>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
 
 namespace RTBKIT {
 
@@ -22,121 +34,476 @@ namespace RTBKIT {
 /* TIMEOUT MAP                                                                */
 /******************************************************************************/
 
-template<typename Key, typename Value>
+/** Both Key and Value must be default constructible; a default constructed
+    value is assigned to an entry when it is removed to release whatever it
+    held.
+
+    Timeouts are bucketed by ticks of the given resolution (in seconds) but
+    are always compared exactly, so an entry never expires early.
+*/
+template<typename Key, typename Value, typename Hash = std::hash<Key> >
 struct TimeoutMap
 {
+    TimeoutMap(double resolution = 0.001) :
+        resolution(resolution),
+        entries(0), freeList(Nil), liveEntries(0),
+        indexMask(0),
+        nextTick(0), cascadedTick(-1)
+    {
+        ExcCheckGreater(resolution, 0.0, "invalid timeout map resolution");
+        std::fill(&buckets[0][0], &buckets[0][0] + Levels * Slots, Nil);
+        std::fill(levelSize, levelSize + Levels, 0);
+    }
+
+    TimeoutMap(const TimeoutMap&) = delete;
+    TimeoutMap& operator=(const TimeoutMap&) = delete;
 
     size_t size() const
     {
-        return map.size();
+        return liveEntries;
+    }
+
+    bool empty() const
+    {
+        return !liveEntries;
+    }
+
+    /** Bytes held by the map itself: the entry blocks, the index and the
+        wheel.  Memory that the values point to isn't included.
+    */
+    size_t memoryUsage() const
+    {
+        return sizeof(*this)
+            + blocks.capacity() * sizeof(blocks[0])
+            + blocks.size() * BlockSize * sizeof(Entry)
+            + index.capacity() * sizeof(IndexSlot);
     }
 
     bool count(const Key& key) const
     {
-        return map.count(key);
+        return find(key) != Nil;
     }
 
     Value& get(const Key& key)
     {
-        auto it = map.find(key);
-        ExcCheck(it != map.end(), "key not present in the timeout map.");
-        return it->second.value;
+        uint32_t idx = find(key);
+        ExcCheck(idx != Nil, "key not present in the timeout map.");
+        return entry(idx).value;
     }
 
     const Value& get(const Key& key) const
     {
-        auto it = map.find(key);
-        ExcCheck(it != map.end(), "key not present in the timeout map.");
-        return it->second.value;
+        uint32_t idx = find(key);
+        ExcCheck(idx != Nil, "key not present in the timeout map.");
+        return entry(idx).value;
+    }
+
+    Datacratic::Date getTimeout(const Key& key) const
+    {
+        uint32_t idx = find(key);
+        ExcCheck(idx != Nil, "key not present in the timeout map.");
+        return entry(idx).timeout;
+    }
+
+    /** Calls fn(key, value, timeout) for every entry in no particular order.
+        The map must not be modified from fn.
+    */
+    template<typename Fn>
+    void forEach(const Fn& fn) const
+    {
+        for (const IndexSlot& s : index) {
+            if (s.idx == Nil) continue;
+            const Entry& e = entry(s.idx);
+            fn(e.key, e.value, e.timeout);
+        }
     }
 
     bool emplace(Key key, Value value, Datacratic::Date timeout)
     {
-        auto ret = map.insert(std::make_pair(
-                        std::move(key), Entry(std::move(value), timeout)));
-        if (!ret.second) return false;
+        uint32_t hash = hashOf(key);
+        size_t slot = findSlot(key, hash);
+        if (index.size() && index[slot].idx != Nil) return false;
+
+        if ((liveEntries + 1) * 4 > index.size() * 3) {
+            growIndex();
+            slot = findSlot(key, hash);
+        }
+
+        // Nothing is scheduled so the wheel can restart from the present
+        // instead of having to catch up over an idle period.  Anything
+        // earlier than nextTick gets clamped into its bucket so we never
+        // start past the timeout either.
+        if (!liveEntries) {
+            nextTick = tickOf(std::min(timeout, Datacratic::Date::now()));
+            cascadedTick = -1;
+        }
+
+        uint32_t idx = allocEntry();
+        Entry& e = entry(idx);
+        e.key = std::move(key);
+        e.value = std::move(value);
+        e.timeout = timeout;
+        e.hash = hash;
 
-        queue.emplace(ret.first->first, timeout);
+        index[slot] = IndexSlot{ idx, hash };
+        ++liveEntries;
+
+        schedule(idx, nextTick);
         return true;
     }
 
     void update(const Key& key, Datacratic::Date timeout)
     {
-        auto it = map.find(key);
-        ExcCheck(it != map.end(), "key not present in the timeout map.");
+        uint32_t idx = find(key);
+        ExcCheck(idx != Nil, "key not present in the timeout map.");
 
-        it->second.timeout = timeout;
-        queue.emplace(key, timeout);
+        unlink(idx);
+        entry(idx).timeout = timeout;
+        schedule(idx, nextTick);
     }
 
     Value pop(const Key& key)
     {
-        auto it = map.find(key);
-        ExcCheck(it != map.end(), "key not present in the timeout map.");
+        size_t slot = findSlot(key, hashOf(key));
+        ExcCheck(index.size() && index[slot].idx != Nil,
+                "key not present in the timeout map.");
 
-        Value value = std::move(it->second.value);
-        map.erase(it);
+        uint32_t idx = index[slot].idx;
+        Value value = std::move(entry(idx).value);
+        remove(slot);
         return value;
     }
 
     bool erase(const Key& key)
     {
-        return map.erase(key);
+        if (!liveEntries) return false;
+
+        size_t slot = findSlot(key, hashOf(key));
+        if (index[slot].idx == Nil) return false;
+
+        remove(slot);
+        return true;
     }
 
     template<typename Fn>
     size_t expire(const Fn& fn, Datacratic::Date now = Datacratic::Date::now())
     {
-        std::vector< std::pair<Key, Entry> > toExpire;
+        std::vector< std::pair<Key, Value> > toExpire;
         toExpire.reserve(1 << 4);
 
-        while (!queue.empty() && queue.top().timeout <= now) {
-            TimeoutEntry entry = std::move(queue.top());
-            queue.pop();
+        int64_t target = std::max(tickOf(now), nextTick);
 
-            auto it = map.find(entry.key);
-            if (it == map.end()) continue;
-            if (it->second.timeout > now) continue;
+        for (int64_t tick = nextTick; ; ++tick) {
 
-            toExpire.emplace_back(std::move(*it));
-            map.erase(it);
+            // Skip over ticks with nothing to do.  We can't jump past a
+            // level 0 wrap since that's where the upper levels cascade.
+            if (!liveEntries) tick = target;
+            else if (!levelSize[0] && tick < target && (tick & SlotMask))
+                tick = std::min(target, (tick | SlotMask) + 1);
+
+            if (tick != cascadedTick) {
+                cascade(tick);
+                cascadedTick = tick;
+            }
+
+            drain(tick, tick == target, now, toExpire);
+            if (tick == target) break;
         }
 
+        nextTick = target;
+
         for (auto& entry : toExpire)
-            fn(std::move(entry.first), std::move(entry.second.value));
+            fn(std::move(entry.first), std::move(entry.second));
 
         return toExpire.size();
     }
 
 private:
 
+    enum {
+        SlotBits = 8,
+        Slots = 1 << SlotBits,
+        SlotMask = Slots - 1,
+        Levels = 4,
+
+        BlockBits = 12,
+        BlockSize = 1 << BlockBits
+    };
+
+    static constexpr uint32_t Nil = uint32_t(-1);
+
     struct Entry
     {
+        Entry() :
+            hash(0), prev(Nil), next(Nil), bucket(Nil)
+        {}
+
+        Key key;
         Value value;
         Datacratic::Date timeout;
 
-        Entry(Value value, Datacratic::Date timeout) :
-            value(std::move(value)), timeout(timeout)
-        {}
+        uint32_t hash;
+        uint32_t prev, next;  ///< Links in the wheel bucket or the free list
+        uint32_t bucket;      ///< level * Slots + slot
     };
 
-    struct TimeoutEntry
+
+    /* ENTRY POOL */
+
+    Entry& entry(uint32_t idx)
     {
-        Key key;
-        Datacratic::Date timeout;
+        return blocks[idx >> BlockBits][idx & (BlockSize - 1)];
+    }
 
-        TimeoutEntry(Key key, Datacratic::Date timeout) :
-            key(std::move(key)), timeout(timeout)
-        {}
+    const Entry& entry(uint32_t idx) const
+    {
+        return blocks[idx >> BlockBits][idx & (BlockSize - 1)];
+    }
+
+    uint32_t allocEntry()
+    {
+        if (freeList != Nil) {
+            uint32_t idx = freeList;
+            freeList = entry(idx).next;
+            return idx;
+        }
+
+        if (entries == blocks.size() * BlockSize)
+            blocks.emplace_back(new Entry[BlockSize]);
+        return entries++;
+    }
+
+    void freeEntry(uint32_t idx)
+    {
+        Entry& e = entry(idx);
+        e.key = Key();
+        e.value = Value();
+        e.next = freeList;
+        freeList = idx;
+    }
+
+
+    /* HASH INDEX */
+
+    uint32_t hashOf(const Key& key) const
+    {
+        size_t h = Hash()(key);
+        return uint32_t(h ^ (h >> 32));
+    }
+
+    /** Slot of the key in the index, or of the empty slot where it would be
+        inserted.
+    */
+    size_t findSlot(const Key& key, uint32_t hash) const
+    {
+        if (index.empty()) return 0;
+
+        for (size_t slot = hash & indexMask; ; slot = (slot + 1) & indexMask) {
+            const IndexSlot& s = index[slot];
+            if (s.idx == Nil) return slot;
+            if (s.hash == hash && entry(s.idx).key == key) return slot;
+        }
+    }
 
-        bool operator<(const TimeoutEntry& other) const
+    uint32_t find(const Key& key) const
+    {
+        if (!liveEntries) return Nil;
+        return index[findSlot(key, hashOf(key))].idx;
+    }
+
+    void growIndex()
+    {
+        std::vector<IndexSlot> old(std::max<size_t>(16, index.size() * 2),
+                                   IndexSlot{ Nil, 0 });
+        old.swap(index);
+        indexMask = index.size() - 1;
+
+        for (const IndexSlot& s : old) {
+            if (s.idx == Nil) continue;
+
+            size_t slot = s.hash & indexMask;
+            while (index[slot].idx != Nil) slot = (slot + 1) & indexMask;
+            index[slot] = s;
+        }
+    }
+
+    /** Removes the entry at the given index slot from the map. */
+    void remove(size_t slot)
+    {
+        unlink(index[slot].idx);
+        unindex(slot);
+    }
+
+    /** Frees the entry at the given index slot, which must not be linked in
+        the wheel anymore.  Linear probing lets us shift the following entries
+        back instead of leaving tombstones behind.
+    */
+    void unindex(size_t slot)
+    {
+        freeEntry(index[slot].idx);
+        --liveEntries;
+
+        for (size_t next = (slot + 1) & indexMask; index[next].idx != Nil;
+             next = (next + 1) & indexMask)
         {
-            return timeout > other.timeout;
+            size_t home = index[next].hash & indexMask;
+
+            // Can the entry at next move to the hole at slot?
+            bool movable = slot <= next
+                ? (home <= slot || home > next)
+                : (home <= slot && home > next);
+            if (!movable) continue;
+
+            index[slot] = index[next];
+            slot = next;
         }
+
+        index[slot].idx = Nil;
+    }
+
+
+    /* TIMER WHEEL */
+
+    int64_t tickOf(Datacratic::Date date) const
+    {
+        static constexpr double MaxTick = 1e18;
+
+        double tick = date.secondsSinceEpoch() / resolution;
+        if (!(tick < MaxTick)) return MaxTick;
+        if (!(tick > -MaxTick)) return -MaxTick;
+        return std::floor(tick);
+    }
+
+    /** Links the entry into the wheel relative to the given base tick. An
+        entry in level l is in the slot given by the l-th group of bits of its
+        tick and must be less than Slots^(l+1) ticks away so that it's
+        cascaded down in time.  Anything further than the wheel can represent
+        is parked in the top level and rescheduled when it comes down.
+    */
+    void schedule(uint32_t idx, int64_t base)
+    {
+        Entry& e = entry(idx);
+
+        int64_t tick = std::max(tickOf(e.timeout), base);
+        int64_t delta = tick - base;
+
+        unsigned level = 0;
+        while (level < Levels - 1 && delta >= (int64_t(1) << (SlotBits * (level + 1))))
+            ++level;
+
+        int64_t maxDelta = (int64_t(1) << (SlotBits * Levels)) - 1;
+        if (delta > maxDelta) tick = base + maxDelta;
+
+        unsigned slot = (tick >> (SlotBits * level)) & SlotMask;
+        link(idx, level * Slots + slot);
+    }
+
+    void link(uint32_t idx, uint32_t bucket)
+    {
+        Entry& e = entry(idx);
+        uint32_t& head = buckets[bucket / Slots][bucket % Slots];
+
+        e.bucket = bucket;
+        e.prev = Nil;
+        e.next = head;
+        if (head != Nil) entry(head).prev = idx;
+        head = idx;
+
+        ++levelSize[bucket / Slots];
+    }
+
+    void unlink(uint32_t idx)
+    {
+        Entry& e = entry(idx);
+
+        if (e.prev != Nil) entry(e.prev).next = e.next;
+        else buckets[e.bucket / Slots][e.bucket % Slots] = e.next;
+        if (e.next != Nil) entry(e.next).prev = e.prev;
+
+        --levelSize[e.bucket / Slots];
+        e.prev = e.next = e.bucket = Nil;
+    }
+
+    /** Detaches the whole list of a bucket and returns its head. */
+    uint32_t detach(unsigned level, unsigned slot)
+    {
+        uint32_t head = buckets[level][slot];
+        buckets[level][slot] = Nil;
+
+        for (uint32_t idx = head; idx != Nil; idx = entry(idx).next) {
+            entry(idx).bucket = Nil;
+            --levelSize[level];
+        }
+
+        return head;
+    }
+
+    /** When level 0 wraps around, the bucket of the next level that is now
+        within range gets redistributed over the lower levels, and so on up.
+    */
+    void cascade(int64_t tick)
+    {
+        for (unsigned level = 1; level < Levels; ++level) {
+            if (tick & ((int64_t(1) << (SlotBits * level)) - 1)) break;
+
+            unsigned slot = (tick >> (SlotBits * level)) & SlotMask;
+            for (uint32_t idx = detach(level, slot); idx != Nil; ) {
+                uint32_t next = entry(idx).next;
+                schedule(idx, tick);
+                idx = next;
+            }
+        }
+    }
+
+    /** Expires every due entry in the level 0 bucket for the given tick.  The
+        last tick processed can hold entries that aren't due yet; anything
+        else that isn't due was parked and gets rescheduled.
+    */
+    void drain(int64_t tick, bool last, Datacratic::Date now,
+               std::vector< std::pair<Key, Value> >& toExpire)
+    {
+        for (uint32_t idx = detach(0, tick & SlotMask); idx != Nil; ) {
+            Entry& e = entry(idx);
+            uint32_t next = e.next;
+
+            if (e.timeout <= now) {
+                toExpire.emplace_back(std::move(e.key), std::move(e.value));
+
+                // The key was moved out so look the index slot up by entry.
+                size_t slot = e.hash & indexMask;
+                while (index[slot].idx != idx) slot = (slot + 1) & indexMask;
+                unindex(slot);
+            }
+            else schedule(idx, last ? tick : tick + 1);
+
+            idx = next;
+        }
+    }
+
+    double resolution;
+
+    std::vector< std::unique_ptr<Entry[]> > blocks;
+    uint32_t entries;       ///< Number of entries ever handed out of blocks
+    uint32_t freeList;
+    size_t liveEntries;
+
+    struct IndexSlot
+    {
+        uint32_t idx;
+        uint32_t hash;
     };
 
-    std::unordered_map<Key, Entry> map;
-    std::priority_queue<TimeoutEntry> queue;
+    std::vector<IndexSlot> index;
+    size_t indexMask;
+
+    uint32_t buckets[Levels][Slots];
+    size_t levelSize[Levels];
+
+    int64_t nextTick;       ///< First tick that hasn't been fully drained
+    int64_t cascadedTick;   ///< Last tick for which the cascade was done
 };
 
+template<typename Key, typename Value, typename Hash>
+constexpr uint32_t TimeoutMap<Key, Value, Hash>::Nil;
+
 } // namespace RTBKIT
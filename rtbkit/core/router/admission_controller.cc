@@ -0,0 +1,133 @@
+/** admission_controller.cc
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Implementation of the admission controller.
+
+*/
+
+#include "admission_controller.h"
+#include "rtbkit/common/exchange_connector.h"
+#include <mutex>
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* ADMISSION CONTROLLER                                                       */
+/******************************************************************************/
+
+AdmissionController::
+AdmissionController() :
+    period(0.005),
+    loadThreshold(0.9),
+    maxInFlight(0),
+    minSlackMs(5.0),
+    maxLateRatio(0.01),
+    increaseStep(0.01),
+    decreaseFactor(0.9),
+    minProbability(0.01)
+{}
+
+void
+AdmissionController::
+addExchange(ExchangeConnector * exchange)
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+    auto & state = states[exchange];
+    if (!state) state = std::make_shared<ExchangeState>(exchange);
+}
+
+std::shared_ptr<AdmissionController::ExchangeState>
+AdmissionController::
+getState(const ExchangeConnector * exchange) const
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+    auto it = states.find(exchange);
+    return it == states.end() ? nullptr : it->second;
+}
+
+void
+AdmissionController::
+recordAuction(const Auction & auction, Date now)
+{
+    auto state = getState(auction.exchangeConnector);
+    if (!state) return;
+
+    state->auctions++;
+    if (auction.expiry.secondsSince(now) * 1000.0 < minSlackMs)
+        state->late++;
+
+    const Auction::Data * data = auction.getCurrentData();
+    if (!data) return;
+
+    int64_t value = 0;
+    for (unsigned spotNum = 0; spotNum < data->responses.size(); ++spotNum) {
+        if (!data->hasValidResponse(spotNum)) continue;
+        value += data->winningResponse(spotNum).price.maxPrice.value;
+    }
+    if (value) state->bidValue += value;
+}
+
+void
+AdmissionController::
+update(double loopLoad, size_t numInFlight)
+{
+    bool overloaded = loopLoad > loadThreshold
+        || (maxInFlight && numInFlight > maxInFlight);
+
+    std::vector<std::shared_ptr<ExchangeState> > toUpdate;
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        for (auto & entry: states)
+            toUpdate.push_back(entry.second);
+    }
+
+    // Take this period's samples and fold the bid value into the average
+    std::vector<double> lateRatios;
+    double maxValue = 0.0;
+    for (auto & state: toUpdate) {
+        uint64_t auctions = state->auctions.exchange(0);
+        uint64_t late = state->late.exchange(0);
+        int64_t bidValue = state->bidValue.exchange(0);
+
+        lateRatios.push_back(auctions ? double(late) / auctions : 0.0);
+        if (auctions) {
+            state->valuePerAuction = 0.9 * state->valuePerAuction
+                + 0.1 * double(bidValue) / auctions;
+        }
+        maxValue = std::max(maxValue, state->valuePerAuction);
+    }
+
+    for (unsigned i = 0;  i < toUpdate.size();  ++i) {
+        auto & state = *toUpdate[i];
+
+        if (overloaded || lateRatios[i] > maxLateRatio) {
+            // The exchange bringing in the most value is cut at the
+            // nominal rate, one bringing in nothing twice as fast.
+            double relValue
+                = maxValue > 0.0 ? state.valuePerAuction / maxValue : 1.0;
+            double cut = (1.0 - decreaseFactor) * (2.0 - relValue);
+            state.probability
+                = std::max(minProbability, state.probability * (1.0 - cut));
+        }
+        else {
+            state.probability
+                = std::min(1.0, state.probability + increaseStep);
+        }
+
+        state.exchange->setAcceptBidRequestProbability(state.probability);
+    }
+}
+
+double
+AdmissionController::
+acceptProbability(const ExchangeConnector * exchange) const
+{
+    auto state = getState(exchange);
+    return state ? state->probability : 1.0;
+}
+
+} // namespace RTBKIT
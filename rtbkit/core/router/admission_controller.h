@@ -0,0 +1,87 @@
+/** admission_controller.h                                        -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Closed-loop control of the proportion of bid requests that each exchange
+    accepts, driven by the router's backpressure.
+
+*/
+
+#pragma once
+
+#include "rtbkit/common/auction.h"
+#include "jml/arch/spinlock.h"
+#include <atomic>
+#include <map>
+#include <memory>
+
+namespace RTBKIT {
+
+struct ExchangeConnector;
+
+
+/******************************************************************************/
+/* ADMISSION CONTROLLER                                                       */
+/******************************************************************************/
+
+/** Adjusts the accept probability of each exchange every few milliseconds
+    instead of applying one static probability to all of them.
+
+    The pressure signals are the load of the router's message loops (from
+    the LoopMonitor), the number of auctions in flight and, per exchange,
+    the proportion of auctions finishing with less than minSlackMs left
+    before their deadline.  Under pressure the probability is cut
+    multiplicatively, otherwise it recovers additively.  Exchanges whose
+    auctions bring in less bid value per request are cut faster, so that
+    low-value traffic is the first to go.
+*/
+struct AdmissionController {
+
+    AdmissionController();
+
+    double period;          ///< Seconds between two updates
+    double loadThreshold;   ///< Loop load above which we shed traffic
+    size_t maxInFlight;     ///< In flight auctions above which we shed; 0: off
+    double minSlackMs;      ///< Auctions done with less slack count as late
+    double maxLateRatio;    ///< Late proportion above which an exchange sheds
+    double increaseStep;    ///< Probability added per update when healthy
+    double decreaseFactor;  ///< Probability kept per update under pressure
+    double minProbability;  ///< Never go below this, so that we can recover
+
+    /** Start controlling the given exchange. */
+    void addExchange(ExchangeConnector * exchange);
+
+    /** Record a finished auction.  Thread-safe. */
+    void recordAuction(const Auction & auction, Date now = Date::now());
+
+    /** Recompute and apply the accept probability of every exchange.  Must
+        be called from a single thread.
+    */
+    void update(double loopLoad, size_t numInFlight);
+
+    /** Current accept probability for the exchange, or 1 if unknown. */
+    double acceptProbability(const ExchangeConnector * exchange) const;
+
+private:
+    struct ExchangeState {
+        ExchangeState(ExchangeConnector * exchange)
+            : exchange(exchange), auctions(0), late(0), bidValue(0),
+              valuePerAuction(0.0), probability(1.0)
+        {
+        }
+
+        ExchangeConnector * exchange;
+        std::atomic<uint64_t> auctions;   ///< Since the last update
+        std::atomic<uint64_t> late;       ///< Since the last update
+        std::atomic<int64_t> bidValue;    ///< Since the last update
+        double valuePerAuction;           ///< Moving average
+        double probability;
+    };
+
+    std::shared_ptr<ExchangeState>
+    getState(const ExchangeConnector * exchange) const;
+
+    mutable ML::Spinlock lock;
+    std::map<const ExchangeConnector *, std::shared_ptr<ExchangeState> > states;
+};
+
+} // namespace RTBKIT
@@ -13,8 +13,10 @@
 #include "jml/arch/exception_handler.h"
 #include "soa/service/zmq_utils.h"
 #include <iostream>
+#include <mutex>
 #include <boost/make_shared.hpp>
 #include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/auction_tracer.h"
 
 
 using namespace std;
@@ -25,6 +27,177 @@ using namespace ML;
 namespace RTBKIT {
 
 
+/*****************************************************************************/
+/* AUGMENTOR INSTANCE INFO                                                   */
+/*****************************************************************************/
+
+constexpr double AugmentorInstanceInfo::LatencyWeight;
+constexpr int AugmentorInstanceInfo::TimeoutsBeforeEjection;
+constexpr double AugmentorInstanceInfo::EjectionSeconds;
+constexpr double AugmentorInstanceInfo::MaxEjectionSeconds;
+
+void
+AugmentorInstanceInfo::
+recordResponse(double timeTakenMs)
+{
+    if (latencyMs == 0) latencyMs = timeTakenMs;
+    else latencyMs += LatencyWeight * (timeTakenMs - latencyMs);
+
+    consecutiveTimeouts = 0;
+    numEjections = 0;
+}
+
+bool
+AugmentorInstanceInfo::
+recordTimeout(Date now)
+{
+    // Once ejected, a single timeout is enough to eject the instance again
+    // as the counter is only reset by a response.
+    if (++consecutiveTimeouts < TimeoutsBeforeEjection)
+        return false;
+
+    double seconds = std::min(EjectionSeconds * (1 << std::min(numEjections, 16)),
+                              MaxEjectionSeconds);
+    ejectedUntil = now.plusSeconds(seconds);
+    ++numEjections;
+    return true;
+}
+
+
+/*****************************************************************************/
+/* AUGMENTOR INFO                                                            */
+/*****************************************************************************/
+
+void
+AugmentorInfo::
+addInstance(std::shared_ptr<AugmentorInstanceInfo> instance)
+{
+    auto res = instancesByAddr.insert(make_pair(instance->addr, instance));
+    if (!res.second)
+        throw ML::Exception("augmentor %s already has an instance at %s",
+                            name.c_str(), instance->addr.c_str());
+    instances.push_back(std::move(instance));
+}
+
+bool
+AugmentorInfo::
+removeInstance(const std::string& addr)
+{
+    auto it = instancesByAddr.find(addr);
+    if (it == instancesByAddr.end()) return false;
+
+    auto & instance = it->second;
+    instances.erase(std::find(instances.begin(), instances.end(), instance));
+    instancesByAddr.erase(it);
+    return true;
+}
+
+
+/*****************************************************************************/
+/* AUGMENTATION CACHE                                                        */
+/*****************************************************************************/
+
+AugmentationCache::
+AugmentationCache()
+    : maxSize(100000), hits(0), misses(0), ttl(0)
+{
+}
+
+void
+AugmentationCache::
+setTtl(double seconds)
+{
+    ttl = seconds;
+    if (seconds <= 0) {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        entries.clear();
+    }
+}
+
+bool
+AugmentationCache::
+key(const Auction & auction,
+    const std::set<std::string> & agents,
+    std::string & key)
+{
+    const BidRequest & request = *auction.request;
+
+    const Id & userId = request.userIds.exchangeId
+        ? request.userIds.exchangeId
+        : request.userIds.providerId;
+    if (!userId) return false;
+
+    std::hash<std::string> hashString;
+    size_t agentsHash = 0;
+    for (const auto & agent : agents)
+        agentsHash = agentsHash * 31 + hashString(agent);
+
+    key = request.exchange;
+    key += ':';
+    key += userId.toString();
+    key += ':';
+    key += std::to_string(agentsHash);
+    return true;
+}
+
+std::shared_ptr<const AugmentationList>
+AugmentationCache::
+get(const std::string & key, Date now)
+{
+    std::shared_ptr<const AugmentationList> result;
+
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        auto it = entries.find(key);
+        if (it != entries.end() && now < it->second.expiry)
+            result = it->second.augmentation;
+    }
+
+    if (result) hits.fetch_add(1, std::memory_order_relaxed);
+    else misses.fetch_add(1, std::memory_order_relaxed);
+    return result;
+}
+
+void
+AugmentationCache::
+put(const std::string & key, const AugmentationList & augmentation, Date now)
+{
+    double seconds = ttl.load(std::memory_order_relaxed);
+    if (seconds <= 0) return;
+
+    Entry entry;
+    entry.augmentation = std::make_shared<AugmentationList>(augmentation);
+    entry.expiry = now.plusSeconds(seconds);
+
+    std::lock_guard<ML::Spinlock> guard(lock);
+    auto it = entries.find(key);
+    if (it != entries.end())
+        it->second = std::move(entry);
+    else if (entries.size() < maxSize)
+        entries.emplace(key, std::move(entry));
+}
+
+void
+AugmentationCache::
+expire(Date now)
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.expiry <= now)
+            it = entries.erase(it);
+        else ++it;
+    }
+}
+
+size_t
+AugmentationCache::
+size() const
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+    return entries.size();
+}
+
+
 /*****************************************************************************/
 /* AUGMENTATION LOOP                                                         */
 /*****************************************************************************/
@@ -37,6 +210,7 @@ AugmentationLoop(ServiceBase & parent,
       idle_(1),
       inbox(65536),
       disconnections(1024),
+      inProcessResponses(65536),
       toAugmentors(getZmqContext())
 {
     updateAllAugmentors();
@@ -50,6 +224,7 @@ AugmentationLoop(std::shared_ptr<ServiceProxies> proxies,
       idle_(1),
       inbox(65536),
       disconnections(1024),
+      inProcessResponses(65536),
       toAugmentors(getZmqContext())
 {
     updateAllAugmentors();
@@ -100,8 +275,14 @@ init()
             doAugmentation(std::move(entry));
         };
 
+    inProcessResponses.onEvent = [&] (InProcessResponse && response)
+        {
+            doInProcessResponse(std::move(response));
+        };
+
     addSource("AugmentationLoop::inbox", inbox);
     addSource("AugmentationLoop::disconnections", disconnections);
+    addSource("AugmentationLoop::inProcessResponses", inProcessResponses);
     addSource("AugmentationLoop::toAugmentors", toAugmentors);
 
     addPeriodic("AugmentationLoop::checkExpiries", 0.001,
@@ -135,6 +316,25 @@ shutdown()
     toAugmentors.shutdown();
 }
 
+void
+AugmentationLoop::
+addInProcessAugmentor(const std::string & name,
+                      std::shared_ptr<InProcessAugmentor> augmentor,
+                      double cacheTtl)
+{
+    ExcCheck(!name.empty(), "no augmentor name specified");
+    ExcCheck(augmentor, "no augmentor given for " + name);
+
+    auto& info = augmentors[name];
+    if (!info)
+        info = std::make_shared<AugmentorInfo>(name);
+    info->inProcess = std::move(augmentor);
+    info->cache.setTtl(cacheTtl);
+    recordHit("augmentor.%s.configuredInProcess", name);
+
+    updateAllAugmentors();
+}
+
 size_t
 AugmentationLoop::
 numAugmenting() const
@@ -180,10 +380,22 @@ recordStats()
          it != end;  ++it)
     {
         size_t inFlights = 0;
-        for (const auto& instance : it->second->instances)
+        for (const auto& instance : it->second->instances) {
             inFlights += instance->numInFlight;
+            recordLevel(instance->latencyMs,
+                        "augmentor.%s.instances.%s.latencyMs",
+                        it->first, instance->addr);
+        }
 
         recordLevel(inFlights, "augmentor.%s.numInFlight", it->first);
+
+        auto & cache = it->second->cache;
+        if (!cache.enabled()) continue;
+
+        cache.expire(Date::now());
+        recordCount(cache.hits.exchange(0), "augmentor.%s.cache.hits", it->first);
+        recordCount(cache.misses.exchange(0), "augmentor.%s.cache.misses", it->first);
+        recordLevel(cache.size(), "augmentor.%s.cache.size", it->first);
     }
 }
 
@@ -195,21 +407,20 @@ checkExpiries()
     Date now = Date::now();
 
     auto onExpired = [&] (const Id & id,
-                          const std::shared_ptr<Entry> & entry) -> Date
+                          const std::shared_ptr<Entry> & entry)
         {
             for (auto it = entry->outstanding.begin(),
                      end = entry->outstanding.end();
                  it != end; ++it)
             {
                 recordHit("augmentor.%s.expiredTooLate", *it);
+                AuctionTracer::instance().record(id, "AUGMENT EXPIRED", *it);
             }
                 
             this->augmentationExpired(id, *entry);
-            return Date();
         };
 
-    if (augmenting.earliest <= now)
-        augmenting.expire(onExpired, now);
+    augmenting.expire(onExpired, now);
 
     if (augmenting.empty() && !idle_) {
         idle_ = 1;
@@ -297,6 +508,23 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
 
     while (it1 != end1 && it2 != end2) {
         if (*it1 == it2->name) {
+            auto & cache = it2->info->cache;
+            if (cache.enabled()) {
+                std::string key;
+                std::shared_ptr<const AugmentationList> cached;
+                if (AugmentationCache::key(*info->auction,
+                                           entry->augmentorAgents[*it1], key))
+                    cached = cache.get(key, now);
+
+                if (cached) {
+                    // Answered from the cache; no need to ask the augmentor
+                    info->auction->augmentations[*it1].mergeWith(*cached);
+                    ++it1;
+                    ++it2;
+                    continue;
+                }
+            }
+
             // Augmentor we need to run
             //cerr << "augmenting with " << it2->name << endl;
             recordEvent("augmentation.request");
@@ -345,22 +573,33 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
 
 std::shared_ptr<AugmentorInstanceInfo>
 AugmentationLoop::
-pickInstance(AugmentorInfo& aug)
+pickInstance(AugmentorInfo& aug, Date now)
 {
+    auto & instances = aug.instances;
+    size_t n = instances.size();
+    if (n == 0) return nullptr;
+
     std::shared_ptr<AugmentorInstanceInfo> instance;
-    int minInFlights = std::numeric_limits<int>::max();
 
-    stringstream ss;
+    size_t i = rng() % n;
+    if (instances[i]->available(now))
+        instance = instances[i];
 
-    for (auto it = aug.instances.begin(), end = aug.instances.end();
-         it != end; ++it)
-    {
-        auto & ptr = *it;
-        if (ptr->numInFlight >= minInFlights) continue;
-        if (ptr->numInFlight >= ptr->maxInFlight) continue;
+    if (n > 1) {
+        size_t j = (i + 1 + rng() % (n - 1)) % n;
+        auto & other = instances[j];
+        if (other->available(now)
+                && (!instance || other->cost() < instance->cost()))
+            instance = other;
+    }
 
-        instance = ptr;
-        minInFlights = ptr->numInFlight;
+    // Both choices were full or ejected; take the best of the others
+    if (!instance) {
+        for (auto & ptr : instances) {
+            if (!ptr->available(now)) continue;
+            if (!instance || ptr->cost() < instance->cost())
+                instance = ptr;
+        }
     }
 
     if (instance) instance->numInFlight++;
@@ -384,13 +623,21 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
     }
 
     bool sentToAugmentor = false;
+    std::vector<std::string> answered;
 
     for (auto it = entry->outstanding.begin(), end = entry->outstanding.end();
          it != end;  ++it)
     {
         auto & aug = *augmentors[*it];
 
-        auto instance = pickInstance(aug);
+        if (aug.inProcess) {
+            if (doInProcessAugmentation(*entry, *it, *aug.inProcess, now))
+                answered.push_back(*it);
+            else sentToAugmentor = true;
+            continue;
+        }
+
+        auto instance = pickInstance(aug, now);
         if (!instance) {
             recordHit("augmentor.%s.skippedTooManyInFlight", *it);
             continue;
@@ -415,11 +662,20 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
                 availableAgentsStr.str(),
                 Date::now());
 
+        AuctionTracer::instance().record(
+                entry->info->auction->id, "AUGMENT REQUEST", *it);
+
         sentToAugmentor = true;
     }
 
-    if (sentToAugmentor)
-        augmenting.insert(entry->info->auction->id, std::move(entry), entry->timeout);
+    for (const auto & name : answered)
+        entry->outstanding.erase(name);
+
+    if (sentToAugmentor) {
+        Id id = entry->info->auction->id;
+        Date timeout = entry->timeout;
+        augmenting.emplace(id, std::move(entry), timeout);
+    }
     else entry->onFinished(entry->info);
 
     recordLevel(Date::now().secondsSince(now), "requestTimeMs");
@@ -432,7 +688,7 @@ AugmentationLoop::
 doConfig(const std::vector<std::string> & message)
 {
     ExcCheckGreaterEqual(message.size(), 4, "config message has wrong size");
-    ExcCheckLessEqual(message.size(), 5, "config message has wrong size");
+    ExcCheckLessEqual(message.size(), 6, "config message has wrong size");
 
     const string & addr = message[0];
     const string & version = message[2];
@@ -443,6 +699,10 @@ doConfig(const std::vector<std::string> & message)
         maxInFlight = std::stoi(message[4]);
     if (maxInFlight < 0) maxInFlight = 3000;
 
+    double cacheTtl = 0;
+    if (message.size() >= 6)
+        cacheTtl = std::stod(message[5]);
+
     ExcCheckEqual(version, "1.0", "unknown version for config message");
     ExcCheck(!name.empty(), "no augmentor name specified");
 
@@ -457,7 +717,8 @@ doConfig(const std::vector<std::string> & message)
         recordHit("augmentor.%s.configured", name);
     }
 
-    info->instances.push_back(std::make_shared<AugmentorInstanceInfo>(addr, maxInFlight));
+    info->cache.setTtl(cacheTtl);
+    info->addInstance(std::make_shared<AugmentorInstanceInfo>(addr, maxInFlight));
     recordHit("augmentor.%s.instances.%s.configured", name, addr);
 
 
@@ -483,22 +744,13 @@ doDisconnection(const std::string & addr, const std::string & aug)
         auto& augmentor = *info.second;
         if (!augmentor.name.empty() && augmentor.name != aug) continue;
 
-        for (auto it = augmentor.instances.begin(),
-                 end = augmentor.instances.end();
-             it != end; ++it)
-        {
-            auto & ptr = *it;
-            if (ptr->addr != addr) continue;
-
+        if (augmentor.removeInstance(addr)) {
             recordHit("augmentor.%s.instances.%s.disconnected",
-                    augmentor.name, ptr->addr);
-
-            augmentor.instances.erase(it);
-            break;
+                    augmentor.name, addr);
         }
 
         // Erasing would invalidate our iterator so need to defer it.
-        if (augmentor.instances.empty())
+        if (augmentor.instances.empty() && !augmentor.inProcess)
             toErase.push_back(augmentor.name);
     }
 
@@ -529,9 +781,12 @@ doResponse(const std::vector<std::string> & message)
     const std::string & augmentor = message[5];
     const std::string & augmentation = message[6];
 
+    AuctionTracer::instance().record(id, "AUGMENT RESPONSE", augmentor);
+
     ML::Timer timer;
 
     AugmentationList augmentationList;
+    bool parseError = false;
     if (augmentation != "" && augmentation != "null") {
         try {
             Json::Value augmentationJson;
@@ -543,13 +798,14 @@ doResponse(const std::vector<std::string> & message)
             string eventName = "augmentor." + augmentor
                 + ".responseParsingExceptions";
             recordEvent(eventName.c_str(), ET_COUNT);
+            parseError = true;
         }
     }
 
     recordLevel(timer.elapsed_wall(), "responseParseTimeMs");
 
+    double timeTakenMs = startTime.secondsUntil(Date::now()) * 1000.0;
     {
-        double timeTakenMs = startTime.secondsUntil(Date::now()) * 1000.0;
         string eventName = "augmentor." + augmentor + ".timeTakenMs";
         recordEvent(eventName.c_str(), ET_OUTCOME, timeTakenMs);
     }
@@ -560,47 +816,186 @@ doResponse(const std::vector<std::string> & message)
         recordEvent(eventName.c_str(), ET_OUTCOME, responseLength);
     }
 
+    // Late responses still tell us how slow the instance is, but the
+    // request was already taken out of its in flight count when it expired.
     auto augmentorIt = augmentors.find(augmentor);
     if (augmentorIt != augmentors.end()) {
         auto instance = augmentorIt->second->findInstance(addr);
-        if (instance) instance->numInFlight--;
+        if (instance) {
+            instance->recordResponse(timeTakenMs);
+
+            if (augmenting.count(id)
+                    && augmenting.get(id)->outstanding.count(augmentor))
+                instance->numInFlight--;
+        }
     }
 
-    auto augmentingIt = augmenting.find(id);
-    if (augmentingIt == augmenting.end()) {
+    if (!augmenting.count(id)) {
         recordHit("augmentation.unknown");
         recordHit("augmentor.%s.unknown", augmentor, addr);
         recordHit("augmentor.%s.instances.%s.unknown", augmentor, addr);
         return;
     }
 
-    auto& entry = *augmentingIt;
-
-    const char* eventType =
-        (augmentation == "" || augmentation == "null") ?
-        "nullResponse" : "validResponse";
+    bool nullResponse = augmentation == "" || augmentation == "null";
+    const char* eventType = nullResponse ? "nullResponse" : "validResponse";
     recordHit("augmentor.%s.%s", augmentor, eventType);
     recordHit("augmentor.%s.instances.%s.%s", augmentor, addr, eventType);
 
-    auto& auctionAugs = entry.second->info->auction->augmentations;
-    auctionAugs[augmentor].mergeWith(augmentationList);
+    // A null response is what we get when the augmentor sheds the request
+    // so it says nothing about the user.
+    mergeResponse(id, augmentor, augmentationList,
+                  !nullResponse && !parseError);
+}
+
+void
+AugmentationLoop::
+mergeResponse(const Id & id,
+              const std::string & augmentor,
+              const AugmentationList & augmentation,
+              bool cacheable)
+{
+    auto& entry = augmenting.get(id);
+
+    if (cacheable)
+        cacheResponse(*entry, augmentor, augmentation);
 
-    entry.second->outstanding.erase(augmentor);
-    if (entry.second->outstanding.empty()) {
-        entry.second->onFinished(entry.second->info);
-        augmenting.erase(augmentingIt);
+    auto& auctionAugs = entry->info->auction->augmentations;
+    auctionAugs[augmentor].mergeWith(augmentation);
+
+    entry->outstanding.erase(augmentor);
+    if (entry->outstanding.empty()) {
+        entry->onFinished(entry->info);
+        augmenting.erase(id);
     }
 }
 
+void
+AugmentationLoop::
+cacheResponse(const Entry & entry,
+              const std::string & augmentor,
+              const AugmentationList & augmentation)
+{
+    auto it = augmentors.find(augmentor);
+    if (it == augmentors.end() || !it->second->cache.enabled())
+        return;
+
+    auto agentsIt = entry.augmentorAgents.find(augmentor);
+    if (agentsIt == entry.augmentorAgents.end()) return;
+
+    std::string key;
+    if (AugmentationCache::key(*entry.info->auction, agentsIt->second, key))
+        it->second->cache.put(key, augmentation, Date::now());
+}
+
+bool
+AugmentationLoop::
+doInProcessAugmentation(Entry & entry, const std::string & name,
+                        InProcessAugmentor & augmentor, Date now)
+{
+    recordHit("augmentor.%s.inProcess.request", name);
+
+    // Synchronous augmentors answer from within augment() which lets us
+    // merge the response right away.  Anything answered after augment()
+    // returned goes through inProcessResponses to get back on our thread.
+    struct Call {
+        Call() : returned(false), responded(false) {}
+        ML::Spinlock lock;
+        bool returned;
+        bool responded;
+        AugmentationList response;
+    };
+
+    auto call = std::make_shared<Call>();
+    Id id = entry.info->auction->id;
+
+    auto sendResponse = [=] (const AugmentationList & response)
+        {
+            {
+                std::lock_guard<ML::Spinlock> guard(call->lock);
+                if (!call->returned) {
+                    call->response = response;
+                    call->responded = true;
+                    return;
+                }
+            }
+
+            InProcessResponse message { id, name, response, now };
+            inProcessResponses.push(std::move(message));
+        };
+
+    double timeAvailableMs =
+        std::max(0.0, now.secondsUntil(entry.timeout) * 1000.0);
+
+    bool failed = false;
+    try {
+        augmentor.augment(*entry.info->auction, entry.augmentorAgents[name],
+                          timeAvailableMs, sendResponse);
+    } catch (const std::exception & exc) {
+        cerr << "in-process augmentor " << name << " threw: "
+             << exc.what() << endl;
+        recordHit("augmentor.%s.inProcess.exception", name);
+        failed = true;
+    }
+
+    std::lock_guard<ML::Spinlock> guard(call->lock);
+    call->returned = true;
+
+    if (!call->responded) return failed;
+
+    recordHit("augmentor.%s.inProcess.inlineResponse", name);
+    cacheResponse(entry, name, call->response);
+    entry.info->auction->augmentations[name].mergeWith(call->response);
+    return true;
+}
+
+void
+AugmentationLoop::
+doInProcessResponse(InProcessResponse && response)
+{
+    recordEvent("augmentation.response");
+
+    {
+        double timeTakenMs =
+            response.startTime.secondsUntil(Date::now()) * 1000.0;
+        string eventName = "augmentor." + response.augmentor + ".timeTakenMs";
+        recordEvent(eventName.c_str(), ET_OUTCOME, timeTakenMs);
+    }
+
+    if (!augmenting.count(response.id)) {
+        recordHit("augmentation.unknown");
+        recordHit("augmentor.%s.unknown", response.augmentor);
+        return;
+    }
+
+    recordHit("augmentor.%s.inProcess.response", response.augmentor);
+    mergeResponse(response.id, response.augmentor, response.augmentation,
+                  true);
+}
+
 void
 AugmentationLoop::
 augmentationExpired(const Id & id, const Entry & entry)
 {
+    Date now = Date::now();
+
     for (const auto & instance: entry.instances) {
+        // Instances that answered were already accounted for
+        if (!entry.outstanding.count(instance.first)) continue;
+
         // If the instance still exsits (it is still alive), we decrement
         // the inFlight count
         auto info = instance.second.lock();
-        if (info) info->numInFlight--;
+        if (!info) continue;
+
+        info->numInFlight--;
+        recordHit("augmentor.%s.instances.%s.timeout",
+                  instance.first, info->addr);
+
+        if (info->recordTimeout(now)) {
+            recordHit("augmentor.%s.instances.%s.ejected",
+                      instance.first, info->addr);
+        }
     }
 
     entry.onFinished(entry.info);
@@ -9,7 +9,8 @@
 #define __rtb_router__augmentation_loop_h__
 
 #include "rtbkit/common/augmentation.h"
-#include "soa/service/timeout_map.h"
+#include "rtbkit/common/in_process_augmentor.h"
+#include "rtbkit/core/post_auction/timeout_map.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
 #include "router_types.h"
@@ -21,6 +22,9 @@
 #include "jml/arch/spinlock.h"
 #include <boost/thread/locks.hpp>
 #include "soa/gc/gc_lock.h"
+#include <atomic>
+#include <random>
+#include <unordered_map>
 
 
 namespace RTBKIT {
@@ -31,15 +35,108 @@ namespace RTBKIT {
 /*****************************************************************************/
 
 /** Information about a specific augmentor which belongs to an augmentor class.
+
+    Besides the requests in flight we keep a moving average of the
+    instance's response time, which is what instances are chosen on, and
+    eject instances that keep timing out for a period that doubles each
+    time they're ejected again without having answered in between.
  */
 struct AugmentorInstanceInfo {
     AugmentorInstanceInfo(const std::string& addr = "", int maxInFlight = 0) :
-        addr(addr), numInFlight(0), maxInFlight(maxInFlight)
+        addr(addr), numInFlight(0), maxInFlight(maxInFlight),
+        latencyMs(0), consecutiveTimeouts(0), numEjections(0)
     {}
 
     std::string addr;
     int numInFlight;
     int maxInFlight;
+
+    /// Moving average of the response time; zero until the first response
+    double latencyMs;
+    int consecutiveTimeouts;
+    int numEjections;           ///< Since the last response
+    Date ejectedUntil;
+
+    /// Weight of a new response time in the moving average
+    static constexpr double LatencyWeight = 0.1;
+
+    /// Timeouts in a row after which the instance is ejected
+    static constexpr int TimeoutsBeforeEjection = 3;
+
+    /// Ejection period, doubled for each ejection in a row up to the max
+    static constexpr double EjectionSeconds = 1.0;
+    static constexpr double MaxEjectionSeconds = 60.0;
+
+    /** Whether requests can be sent to the instance. */
+    bool available(Date now) const
+    {
+        return numInFlight < maxInFlight && ejectedUntil <= now;
+    }
+
+    /** Expected time for a new request to be answered, which is what
+        instances are compared on.  Unmeasured instances count as 1ms.
+    */
+    double cost() const
+    {
+        return (numInFlight + 1) * (latencyMs + 1.0);
+    }
+
+    void recordResponse(double timeTakenMs);
+
+    /** Returns true if the instance got ejected. */
+    bool recordTimeout(Date now);
+};
+
+/** Responses of an augmentor, kept for the time-to-live the augmentor
+    declared in its CONFIG message.  Responses are keyed on the exchange,
+    the user id and the set of agents the augmentor was asked about, as
+    augmentors answer per account.
+
+    Read from the threads calling AugmentationLoop::augment() and written
+    from the loop thread.
+*/
+struct AugmentationCache {
+    AugmentationCache();
+
+    /** Zero disables the cache. */
+    void setTtl(double seconds);
+
+    bool enabled() const { return ttl.load(std::memory_order_relaxed) > 0; }
+
+    /** Key of the auction for the given agents.  Returns false if the
+        auction has no user id to cache on.
+    */
+    static bool key(const Auction & auction,
+                    const std::set<std::string> & agents,
+                    std::string & key);
+
+    std::shared_ptr<const AugmentationList>
+    get(const std::string & key, Date now);
+
+    void put(const std::string & key, const AugmentationList & augmentation,
+             Date now);
+
+    /** Drop the expired responses. */
+    void expire(Date now);
+
+    size_t size() const;
+
+    /// Number of entries after which new responses aren't cached
+    size_t maxSize;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+private:
+    struct Entry {
+        std::shared_ptr<const AugmentationList> augmentation;
+        Date expiry;
+    };
+
+    std::atomic<double> ttl;
+
+    mutable ML::Spinlock lock;
+    std::unordered_map<std::string, Entry> entries;
 };
 
 /** Information about a given class of augmentor. */
@@ -49,16 +146,26 @@ struct AugmentorInfo {
     std::string name;                   ///< What the augmentation is called
     std::vector<std::shared_ptr<AugmentorInstanceInfo>> instances;
 
+    /// Set when the augmentor runs in the router; instances are then unused
+    std::shared_ptr<InProcessAugmentor> inProcess;
+
+    AugmentationCache cache;
+
     std::shared_ptr<AugmentorInstanceInfo> findInstance(const std::string& addr)
     {
-        for (auto it = instances.begin(), end = instances.end();
-             it != end; ++it)
-        {
-            auto & info = *it;
-            if (info->addr == addr) return info;
-        }
-        return nullptr;
+        auto it = instancesByAddr.find(addr);
+        if (it == instancesByAddr.end()) return nullptr;
+        return it->second;
     }
+
+    void addInstance(std::shared_ptr<AugmentorInstanceInfo> instance);
+
+    /** Returns false if there was no instance at that address. */
+    bool removeInstance(const std::string& addr);
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<AugmentorInstanceInfo> >
+        instancesByAddr;
 };
 
 // Information about an auction being augmented
@@ -103,6 +210,15 @@ struct AugmentationLoop : public ServiceBase, public MessageLoop {
 
     void bindAugmentors(const std::string & uri);
 
+    /** Run the given augmentor in the router under the given name instead
+        of sending the requests for that name to remote augmentors.  Its
+        responses are cached for cacheTtl seconds.  Must be called before
+        start().
+    */
+    void addInProcessAugmentor(const std::string & name,
+                               std::shared_ptr<InProcessAugmentor> augmentor,
+                               double cacheTtl = 0);
+
     /** Push an auction into the augmentor.  Can be called from any thread. */
     void augment(const std::shared_ptr<AugmentationInfo> & info,
                  Date timeout,
@@ -129,7 +245,7 @@ private:
     /** List of auctions we're currently augmenting.  Once the augmentation
         process is finished the auction will be passed on.
     */
-    typedef TimeoutMap<Id, std::shared_ptr<Entry> > Augmenting;
+    typedef RTBKIT::TimeoutMap<Id, std::shared_ptr<Entry>, IdHash> Augmenting;
     Augmenting augmenting;
 
     /** Currently configured augmentors.  Indexed by the augmentor name. */
@@ -158,6 +274,18 @@ private:
     TypedMessageSink<std::shared_ptr<Entry> > inbox;
     TypedMessageSink<std::string> disconnections;
 
+    /** Response of an in-process augmentor that didn't answer from within
+        its augment() call.
+    */
+    struct InProcessResponse {
+        Id id;
+        std::string augmentor;
+        AugmentationList augmentation;
+        Date startTime;
+    };
+
+    TypedMessageSink<InProcessResponse> inProcessResponses;
+
     /// Connection to all of our augmentors
     ZmqNamedClientBus toAugmentors;
 
@@ -167,7 +295,16 @@ private:
 
     void handleAugmentorMessage(const std::vector<std::string> & message);
 
-    std::shared_ptr<AugmentorInstanceInfo> pickInstance(AugmentorInfo& aug);
+    /** Pick between two random available instances the one expected to
+        answer first, so that a slow instance gets less of the load without
+        all of it going to the fastest one.
+    */
+    std::shared_ptr<AugmentorInstanceInfo> pickInstance(AugmentorInfo& aug,
+                                                        Date now);
+
+    /// Only used from the loop thread, by pickInstance()
+    std::minstd_rand rng;
+
     void doAugmentation(std::shared_ptr<Entry>&& entry);
 
     void recordStats();
@@ -183,6 +320,28 @@ private:
     /** Handle a response from an augmentation. */
     void doResponse(const std::vector<std::string> & message);
 
+    /** Call an in-process augmentor.  Returns true if it answered before
+        returning, in which case the response is already merged.
+    */
+    bool doInProcessAugmentation(Entry & entry, const std::string & name,
+                                 InProcessAugmentor & augmentor, Date now);
+
+    /** Handle a response from an in-process augmentor. */
+    void doInProcessResponse(InProcessResponse && response);
+
+    /** Merge the augmentation into the auction and finish the auction once
+        all the augmentors answered.
+    */
+    void mergeResponse(const Id & id,
+                       const std::string & augmentor,
+                       const AugmentationList & augmentation,
+                       bool cacheable);
+
+    /** Keep the response in the augmentor's cache, if it has one. */
+    void cacheResponse(const Entry & entry,
+                       const std::string & augmentor,
+                       const AugmentationList & augmentation);
+
     /** Handle a message asking for augmentation. */
     void doAugment(const std::vector<std::string> & message);
 
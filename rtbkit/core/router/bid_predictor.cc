@@ -0,0 +1,103 @@
+/** bid_predictor.cc
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Implementation of the bid predictor.
+
+*/
+
+#include "bid_predictor.h"
+#include "rtbkit/common/bid_request.h"
+#include <functional>
+#include <mutex>
+#include <cmath>
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* BID PREDICTOR                                                              */
+/******************************************************************************/
+
+BidPredictor::
+BidPredictor(double learningRate, uint64_t minObservations) :
+    learningRate(learningRate),
+    minObservations(minObservations),
+    weights(NumWeights, 0.0),
+    bias(0.0),
+    observations_(0)
+{
+}
+
+BidPredictor::Features
+BidPredictor::
+extractFeatures(const BidRequest & request)
+{
+    Features result;
+
+    auto add = [&] (const char * kind, const std::string & value)
+        {
+            size_t hash = std::hash<std::string>()(value);
+            hash = hash * 0x9e3779b97f4a7c15ULL
+                + std::hash<std::string>()(kind);
+            result.push_back((hash >> 17) & (NumWeights - 1));
+        };
+
+    add("exchange", request.exchange);
+
+    if (!request.imp.empty())
+        add("format", request.imp[0].firstFormat());
+
+    if (request.site)
+        add("site", request.site->id.toString());
+    else if (request.app)
+        add("app", request.app->id.toString());
+
+    int64_t hour = request.timestamp.secondsSinceEpoch() / 3600;
+    add("hour", std::to_string(hour % 24));
+
+    for (const auto & source: request.segments)
+        add("segments", source.first);
+
+    return result;
+}
+
+double
+BidPredictor::
+score(const Features & features) const
+{
+    double result = bias;
+    for (uint32_t feature: features)
+        result += weights[feature];
+    return 1.0 / (1.0 + std::exp(-result));
+}
+
+double
+BidPredictor::
+predict(const Features & features) const
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+    if (observations_ < minObservations)
+        return 1.0;
+    return score(features);
+}
+
+void
+BidPredictor::
+train(const Features & features, bool bid)
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+
+    double error = (bid ? 1.0 : 0.0) - score(features);
+    float step = learningRate * error;
+
+    bias += step;
+    for (uint32_t feature: features)
+        weights[feature] += step;
+
+    ++observations_;
+}
+
+} // namespace RTBKIT
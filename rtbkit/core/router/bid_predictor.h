@@ -0,0 +1,72 @@
+/** bid_predictor.h                                                -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Online model of whether an agent will bid on a request, so that the
+    router can skip sending it the requests that it will pass on.
+
+*/
+
+#pragma once
+
+#include "jml/arch/spinlock.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace RTBKIT {
+
+struct BidRequest;
+
+
+/******************************************************************************/
+/* BID PREDICTOR                                                              */
+/******************************************************************************/
+
+/** Logistic regression over hashed features of the bid request, trained
+    online from the agent's own bids and no-bids.
+
+    The features are cheap to get out of a parsed request: the exchange, the
+    format of the first spot, the site or app, the hour of the day and which
+    segment sources are present.  They are extracted once per auction and
+    shared by the predictors of all the agents.
+
+    Thread-safe.
+*/
+struct BidPredictor {
+
+    enum {
+        NumBits = 14,                  ///< 16k weights
+        NumWeights = 1 << NumBits
+    };
+
+    typedef std::vector<uint32_t> Features;
+
+    BidPredictor(double learningRate = 0.05, uint64_t minObservations = 1000);
+
+    /** Extract the features of the given request. */
+    static Features extractFeatures(const BidRequest & request);
+
+    /** Probability that the agent bids on a request with these features.
+        Returns 1 until the model has seen minObservations responses, so
+        that nothing is skipped on what it hasn't learnt yet.
+    */
+    double predict(const Features & features) const;
+
+    /** Learn from the agent's response to a request with these features. */
+    void train(const Features & features, bool bid);
+
+    uint64_t observations() const { return observations_; }
+
+private:
+    double score(const Features & features) const;
+
+    double learningRate;
+    uint64_t minObservations;
+
+    mutable ML::Spinlock lock;
+    std::vector<float> weights;
+    float bias;
+    uint64_t observations_;
+};
+
+} // namespace RTBKIT
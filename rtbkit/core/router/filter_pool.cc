@@ -7,6 +7,7 @@
 */
 
 #include "filter_pool.h"
+#include "filters/priority.h"
 #include "rtbkit/common/bid_request.h"
 #include "rtbkit/common/exchange_connector.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
@@ -14,6 +15,10 @@
 #include "jml/utils/exc_check.h"
 #include "jml/arch/tick_counter.h"
 
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
 
 using namespace std;
 using namespace ML;
@@ -114,6 +119,65 @@ recordTime(uint64_t start, const FilterBase* filter)
 }
 
 
+/** Applies the cached result of the filters which hash the request, running
+    them and caching their result on a miss. Returns the bitmask of the filters
+    that were applied which filter() should then skip.
+
+    The cached result doesn't depend on the mask passed to filter() since it's
+    applied before it.
+ */
+uint64_t
+FilterPool::
+applyCache(const Data* data, FilterState& state)
+{
+    if (data->filters.size() > 64) return 0;
+
+    uint64_t cached = 0;
+    uint64_t key = hashField(0, state.request.imp.size());
+
+    for (unsigned index : data->plan) {
+        uint64_t hash = 0;
+        if (!data->filters[index]->hashRequest(state, hash)) continue;
+
+        cached |= 1ULL << index;
+        key = hashField(hashField(key, index), hash);
+    }
+
+    if (!cached) return 0;
+
+    auto entry = data->cache->find(key);
+    if (entry) {
+        state.narrowConfigs(entry->configs);
+        for (size_t imp = 0; imp < entry->creatives.size(); ++imp)
+            state.narrowCreativesForImp(imp, entry->creatives[imp]);
+
+        if (events) events->recordHit("filters.cache.hit");
+        return cached;
+    }
+
+    for (unsigned index : data->plan) {
+        if (!(cached & (1ULL << index))) continue;
+
+        data->filters[index]->filter(state);
+        if (state.configs().empty()) break;
+    }
+
+    // Filter reasons are only recorded on sampled requests which don't go
+    // through the cache.
+    state.resetFilterReasons();
+
+    std::shared_ptr<ResultCache::Entry> result(new ResultCache::Entry);
+    result->configs = state.configs();
+    for (size_t imp = 0; imp < state.request.imp.size(); ++imp)
+        result->creatives.push_back(state.creatives(imp));
+
+    data->cache->insert(key, std::move(result));
+
+    if (events) events->recordHit("filters.cache.miss");
+    return cached;
+}
+
+
 FilterPool::ConfigList
 FilterPool::
 filter(const BidRequest& br, const ExchangeConnector* conn, const ConfigSet& mask)
@@ -124,42 +188,152 @@ filter(const BidRequest& br, const ExchangeConnector* conn, const ConfigSet& mas
     ExcCheck(!current->filters.empty(), "No filters registered");
 
     FilterState state(br, conn, current->activeConfigs);
+
+    bool sampleStats = random() % 10 == 0;
+
+    // Sampled requests run every filter so that neither the stats used to
+    // order the plan nor the events are skewed by the cache.
+    uint64_t cached = 0;
+    if (current->cache && !sampleStats)
+        cached = applyCache(current, state);
+
     state.narrowConfigs(mask);
 
     ConfigSet configs = state.configs();
+    if (configs.empty()) return ConfigList();
 
-    bool sampleStats = events && (random() % 10 == 0);
     uint64_t ticksStart = sampleStats ? ticks() : 0;
+    size_t configsIn = sampleStats ? configs.count() : 0;
 
-    for (FilterBase* filter : current->filters) {
+    for (unsigned index : current->plan) {
+        if (cached & (1ULL << index)) continue;
+
+        const FilterBase* filter = current->filters[index];
         filter->filter(state);
 
         const ConfigSet& filtered = state.configs();
 
         if (sampleStats) {
-            ticksStart = recordTime(ticksStart, filter);
-            recordDiff(current, filter, configs ^ filtered);
-            if (!state.getFilterReasons().empty()) {
-                recordReason(current, filter, state);
+            uint64_t now = events ? recordTime(ticksStart, filter) : ticks();
+            size_t configsOut = filtered.count();
+            current->stats[index].record(now - ticksStart, configsIn, configsOut);
+
+            if (events) {
+                recordDiff(current, filter, configs ^ filtered);
+                if (!state.getFilterReasons().empty()) {
+                    recordReason(current, filter, state);
+                }
             }
+
             configs = filtered;
+            configsIn = configsOut;
+            ticksStart = now;
         }
         state.resetFilterReasons();
 
         if (filtered.empty()) {
-            if (sampleStats) 
+            if (sampleStats && events)
                 events->recordHit("filters.breakLoop.%s", filter->name());
             break;
         }
     }
 
+    return makeConfigList(current, state);
+}
+
+
+/** Sampled requests are handed to filter() so that the stats and events
+    see the same thing no matter how the requests came in. The others are
+    only filtered through the cache and the plan.
+ */
+std::vector<FilterPool::ConfigList>
+FilterPool::
+filterBatch(const std::vector<BatchEntry>& requests, const ConfigSet& mask)
+{
+    GcLockBase::SharedGuard guard(gc, GcLockBase::RD_NO);
+
+    const Data* current = data.load();
+    ExcCheck(!current->filters.empty(), "No filters registered");
+
+    std::vector<ConfigList> results(requests.size());
+
+    // Reserved up front since the pending requests point into it.
+    std::vector<FilterState> states;
+    states.reserve(requests.size());
+
+    // Requests which still have configs left, along with the filters that
+    // were already applied from the cache.
+    struct Pending
+    {
+        size_t request;
+        FilterState* state;
+        uint64_t cached;
+    };
+
+    std::vector<Pending> live;
+    live.reserve(requests.size());
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const BidRequest& br = *requests[i].first;
+        const ExchangeConnector* conn = requests[i].second;
+
+        if (random() % 10 == 0) {
+            results[i] = filter(br, conn, mask);
+            continue;
+        }
+
+        states.emplace_back(br, conn, current->activeConfigs);
+        FilterState& state = states.back();
+
+        uint64_t cached = current->cache ? applyCache(current, state) : 0;
+
+        state.narrowConfigs(mask);
+        if (state.configs().empty()) {
+            states.pop_back();
+            continue;
+        }
+
+        live.push_back(Pending{ i, &state, cached });
+    }
+
+    for (unsigned index : current->plan) {
+        if (live.empty()) break;
+
+        const FilterBase* filter = current->filters[index];
+        size_t kept = 0;
+
+        for (const Pending& pending : live) {
+            if (!(pending.cached & (1ULL << index))) {
+                filter->filter(*pending.state);
+                pending.state->resetFilterReasons();
+                if (pending.state->configs().empty()) continue;
+            }
+
+            live[kept++] = pending;
+        }
+
+        live.resize(kept);
+    }
+
+    for (const Pending& pending : live)
+        results[pending.request] = makeConfigList(current, *pending.state);
+
+    return results;
+}
+
+
+FilterPool::ConfigList
+FilterPool::
+makeConfigList(const Data* data, FilterState& state)
+{
     auto biddableSpots = state.biddableSpots();
-    configs = state.configs();
+    const ConfigSet& configs = state.configs();
 
     ConfigList result;
     for (size_t i = configs.next(); i < configs.size(); i = configs.next(i + 1)) {
-        ConfigEntry entry = current->configs[i];
-        entry.biddableSpots = std::move(biddableSpots[i]);
+        ConfigEntry entry = data->configs[i];
+        if (i < biddableSpots.size())
+            entry.biddableSpots = std::move(biddableSpots[i]);
         result.emplace_back(std::move(entry));
     }
 
@@ -213,6 +387,8 @@ initWithDefaultFilters()
 
     do {
         newData.reset(new Data);
+        newData->resetCache(oldData->cacheSize);
+
         for (const auto& ele: PluginInterface<FilterBase>::getNames()) {
             newData->addFilter(PluginInterface<FilterBase>::getPlugin(ele)());
             if (events) events->recordHit("filters.addFilter.%s", ele);
@@ -237,6 +413,7 @@ initWithFiltersFromJson(const Json::Value & json)
 
     do {
         newData.reset(new Data);
+        newData->resetCache(oldData->cacheSize);
 
         for (unsigned i = 0;  i < json.size();  ++i) {
             const Json::Value & val = json[i];
@@ -247,6 +424,22 @@ initWithFiltersFromJson(const Json::Value & json)
 }
 
 
+void
+FilterPool::
+setCacheSize(size_t entries)
+{
+    GcLockBase::SharedGuard guard(gc);
+
+    Data* oldData = data.load();
+    unique_ptr<Data> newData;
+
+    do {
+        newData.reset(new Data(*oldData));
+        newData->resetCache(entries);
+    } while (!setData(oldData, newData));
+}
+
+
 unsigned
 FilterPool::
 addConfig(const string& name, const AgentInfo& info)
@@ -285,6 +478,59 @@ removeConfig(const string& name)
     if (events) events->recordHit("filters.removeConfig");
 }
 
+std::vector<unsigned>
+FilterPool::
+updateConfigs(
+        const std::vector<std::string>& removed,
+        const std::vector<std::pair<std::string, const AgentInfo*> >& added,
+        const std::vector<std::pair<std::string, const AgentInfo*> >& refreshed)
+{
+    GcLockBase::SharedGuard guard(gc);
+
+    unique_ptr<Data> newData;
+    Data* oldData = data.load();
+    std::vector<unsigned> indexes;
+
+    do {
+        newData.reset(new Data(*oldData));
+
+        for (const auto& name : removed)
+            newData->removeConfig(name);
+
+        indexes.clear();
+        for (const auto& config : added)
+            indexes.push_back(newData->addConfig(config.first, *config.second));
+
+        for (const auto& config : refreshed)
+            newData->refreshConfig(config.first, *config.second);
+
+    } while (!setData(oldData, newData));
+
+    if (events) {
+        events->recordCount(removed.size(), "filters.removeConfig");
+        events->recordCount(added.size(), "filters.addConfig");
+        events->recordCount(refreshed.size(), "filters.refreshConfig");
+    }
+
+    return indexes;
+}
+
+std::vector<string>
+FilterPool::
+getFilterPlan() const
+{
+    GcLockBase::SharedGuard guard(gc, GcLockBase::RD_NO);
+
+    const Data* current = data.load();
+    std::vector<string> filter_names;
+    filter_names.reserve(current->plan.size());
+
+    for (unsigned index : current->plan)
+        filter_names.push_back(current->filters[index]->name());
+
+    return filter_names;
+}
+
 std::vector<string>
 FilterPool::
 getFilterNames() const
@@ -302,19 +548,155 @@ getFilterNames() const
     return filter_names;
 }
 
+size_t
+FilterPool::
+memoryUsage() const
+{
+    GcLockBase::SharedGuard guard(gc, GcLockBase::RD_NO);
+
+    const Data* current = data.load();
+    size_t bytes = sizeof(*current)
+        + current->filters.capacity() * sizeof(FilterBase*)
+        + current->stats.capacity() * sizeof(FilterStats)
+        + current->plan.capacity() * sizeof(unsigned)
+        + current->configs.capacity() * sizeof(ConfigEntry);
+
+    if (current->cache) bytes += current->cache->memoryUsage();
+    return bytes;
+}
+
+
+/******************************************************************************/
+/* FILTER POOL - FILTER STATS                                                 */
+/******************************************************************************/
+
+FilterPool::FilterStats::
+FilterStats(const FilterStats& other) :
+    samples(other.samples.load()),
+    ticks(other.ticks.load()),
+    configsIn(other.configsIn.load()),
+    configsOut(other.configsOut.load())
+{}
+
+FilterPool::FilterStats&
+FilterPool::FilterStats::
+operator=(const FilterStats& other)
+{
+    samples = other.samples.load();
+    ticks = other.ticks.load();
+    configsIn = other.configsIn.load();
+    configsOut = other.configsOut.load();
+    return *this;
+}
+
+void
+FilterPool::FilterStats::
+record(uint64_t elapsed, size_t in, size_t out) const
+{
+    samples.fetch_add(1, std::memory_order_relaxed);
+    ticks.fetch_add(elapsed, std::memory_order_relaxed);
+    configsIn.fetch_add(in, std::memory_order_relaxed);
+    configsOut.fetch_add(out, std::memory_order_relaxed);
+}
+
+double
+FilterPool::FilterStats::
+rank() const
+{
+    double n = samples.load();
+    double in = configsIn.load();
+    if (!n || !in) return std::numeric_limits<double>::max();
+
+    // The classic ordering for a chain of short-circuiting predicates: sort by
+    // cost / (1 - selectivity). The epsilon keeps filters that never remove
+    // anything ordered amongst themselves by cost.
+    double cost = ticks.load() / n;
+    double pass = configsOut.load() / in;
+    return cost / (1.0 - pass + 1e-6);
+}
+
+
+/******************************************************************************/
+/* FILTER POOL - RESULT CACHE                                                 */
+/******************************************************************************/
+
+FilterPool::ResultCache::
+ResultCache(size_t capacity) :
+    shardCapacity(std::max<size_t>(capacity / NumShards, 1))
+{}
+
+std::shared_ptr<const FilterPool::ResultCache::Entry>
+FilterPool::ResultCache::
+find(uint64_t key) const
+{
+    const Shard& shard = shards[key % NumShards];
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) return nullptr;
+    return it->second;
+}
+
+void
+FilterPool::ResultCache::
+insert(uint64_t key, std::shared_ptr<const Entry> entry)
+{
+    Shard& shard = shards[key % NumShards];
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    if (shard.entries.size() >= shardCapacity)
+        shard.entries.clear();
+
+    shard.entries[key] = std::move(entry);
+}
+
+size_t
+FilterPool::ResultCache::
+memoryUsage() const
+{
+    size_t bytes = sizeof(*this);
+
+    for (const Shard& shard : shards) {
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+        // Doesn't walk the entries so as not to hold up the filtering
+        // threads; their creatives aren't counted.
+        bytes += shard.entries.bucket_count() * sizeof(void*)
+            + shard.entries.size()
+            * (sizeof(std::pair<uint64_t, std::shared_ptr<const Entry> >)
+               + sizeof(void*) + sizeof(Entry));
+    }
+
+    return bytes;
+}
+
 
 /******************************************************************************/
 /* FILTER POOL - DATA                                                         */
 /******************************************************************************/
 
+namespace {
+
+// Number of sampled executions before we trust a filter's stats enough to move
+// it away from its static priority.
+enum { MinPlanSamples = 128 };
+
+} // namespace anonymous
+
 FilterPool::Data::
 Data(const Data& other) :
+    stats(other.stats),
     configs(other.configs),
-    activeConfigs(other.activeConfigs)
+    activeConfigs(other.activeConfigs),
+    cacheSize(0)
 {
+    resetCache(other.cacheSize);
+
     filters.reserve(other.filters.size());
     for (FilterBase* filter : other.filters)
         filters.push_back(filter->clone());
+
+    compilePlan();
 }
 
 
@@ -355,6 +737,8 @@ addConfig(const string& name, const AgentInfo& info)
     for (FilterBase* filter : filters)
         filter->addConfig(index, info.config);
 
+    compilePlan();
+
     return index;
 }
 
@@ -371,6 +755,17 @@ removeConfig(const string& name)
         filter->removeConfig(index, configs[index].config);
 
     configs[index].reset();
+
+    compilePlan();
+}
+
+void
+FilterPool::Data::
+refreshConfig(const string& name, const AgentInfo& info)
+{
+    ssize_t index = findConfig(name);
+    ExcCheckGreaterEqual(index, 0, "refreshing unknown config");
+    configs[index] = ConfigEntry(name, info);
 }
 
 
@@ -396,10 +791,17 @@ addFilter(FilterBase* filter)
         filter->addConfig(cfgId, configs[cfgId].config);
     }
 
-    filters.push_back(filter);
-    sort(filters.begin(), filters.end(), [] (FilterBase* lhs, FilterBase* rhs) {
+    auto it = upper_bound(
+            filters.begin(), filters.end(), filter,
+            [] (FilterBase* lhs, FilterBase* rhs) {
                 return lhs->priority() < rhs->priority();
             });
+
+    size_t index = it - filters.begin();
+    filters.insert(it, filter);
+    stats.insert(stats.begin() + index, FilterStats());
+
+    compilePlan();
 }
 
 void
@@ -410,11 +812,54 @@ removeFilter(const string& name)
     if (index < 0) return;
 
     delete filters[index];
+    filters.erase(filters.begin() + index);
+    stats.erase(stats.begin() + index);
+
+    compilePlan();
+}
+
+/** Filters are stored in priority order which is used as-is until every
+    reorderable filter has gathered enough samples. After that, they're ordered
+    by their measured rank so that the filters that empty the config set the
+    fastest run first and the loop in filter() can break out early.
+
+    Filters from Priority::ExchangePre onwards are always kept at the end in
+    priority order: they either depend on the exchange or are expensive enough
+    that we only want to run them on what's left.
 
-    for (size_t i = index; i < filters.size() - 1; ++i)
-        filters[i] = filters[i+1];
+    Since the Data object is rebuilt on every addConfig and removeConfig, this
+    gets recompiled whenever the set of configs changes.
+ */
+void
+FilterPool::Data::
+compilePlan()
+{
+    plan.resize(filters.size());
+    for (unsigned i = 0; i < plan.size(); ++i) plan[i] = i;
 
-    filters.pop_back();
+    auto pinned = find_if(plan.begin(), plan.end(), [&] (unsigned i) {
+                return filters[i]->priority() >= Priority::ExchangePre;
+            });
+
+    bool sampled = all_of(plan.begin(), pinned, [&] (unsigned i) {
+                return stats[i].samples.load() >= MinPlanSamples;
+            });
+    if (!sampled) return;
+
+    vector<double> ranks(filters.size());
+    for (unsigned i = 0; i < ranks.size(); ++i) ranks[i] = stats[i].rank();
+
+    stable_sort(plan.begin(), pinned, [&] (unsigned lhs, unsigned rhs) {
+                return ranks[lhs] < ranks[rhs];
+            });
+}
+
+void
+FilterPool::Data::
+resetCache(size_t size)
+{
+    cacheSize = size;
+    cache.reset(size ? new ResultCache(size) : nullptr);
 }
 
 } // namepsace RTBKit
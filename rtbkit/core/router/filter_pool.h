@@ -11,7 +11,11 @@
 #include "rtbkit/common/filter.h"
 #include "soa/gc/gc_lock.h"
 
+#include "jml/arch/spinlock.h"
+
+#include <array>
 #include <atomic>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <string>
@@ -75,6 +79,16 @@ struct FilterPool
             const ExchangeConnector* conn,
             const ConfigSet& mask = ConfigSet(true));
 
+    typedef std::pair<const BidRequest*, const ExchangeConnector*> BatchEntry;
+
+    /** Same as filter() for a batch of requests, returning their results in
+        the same order. Each filter is run over the whole batch before moving
+        on to the next one so that its index stays in cache.
+    */
+    std::vector<ConfigList> filterBatch(
+            const std::vector<BatchEntry>& requests,
+            const ConfigSet& mask = ConfigSet(true));
+
 
     // \todo Need batch interfaces of these to alleviate overhead.
     void addFilter(const std::string& name);
@@ -82,41 +96,140 @@ struct FilterPool
     void initWithDefaultFilters();
     void initWithFiltersFromJson(const Json::Value & json);
 
+    /** Caches the combined result of the filters which implement
+        FilterBase::hashRequest for up to the given number of distinct
+        requests so that only the other filters run on a hit. 0, the default,
+        disables the cache.
+    */
+    void setCacheSize(size_t entries);
+
 
-    // \todo Need batch interfaces to alleviate overhead.
     unsigned addConfig(const std::string& name, const AgentInfo& info);
     void removeConfig(const std::string& name);
 
+    /** Removes and (re)adds a batch of configs with a single copy of the
+        filters.  Returns the index of each added config.
+
+        The refreshed configs replace existing ones that filter the same way
+        (only their bid control changed), so they keep their index and the
+        filters aren't told about them.
+    */
+    std::vector<unsigned> updateConfigs(
+            const std::vector<std::string>& removed,
+            const std::vector<std::pair<std::string, const AgentInfo*> >& added,
+            const std::vector<std::pair<std::string, const AgentInfo*> >& refreshed = {});
+
     // Added for test purposes
     std::vector<string> getFilterNames() const;
 
+    // Order in which the filters are currently executed.
+    std::vector<string> getFilterPlan() const;
+
+    /** Estimate of the bytes held by the configs, the filter plan and the
+        result cache.  What the filters themselves hold isn't included.  Can
+        be called from any thread.
+    */
+    size_t memoryUsage() const;
+
 private:
 
+    /** Running measurements of a filter gathered on sampled requests. Used to
+        order the filters so that the ones that remove the most configs for the
+        least amount of time are executed first.
+
+        These are updated concurrently by the filtering threads and are carried
+        over when the Data object is copied so that they survive config
+        changes.
+     */
+    struct FilterStats
+    {
+        FilterStats() : samples(0), ticks(0), configsIn(0), configsOut(0) {}
+        FilterStats(const FilterStats& other);
+        FilterStats& operator=(const FilterStats& other);
+
+        void record(uint64_t elapsed, size_t in, size_t out) const;
+
+        // Expected cost per config removed; lower is better.
+        double rank() const;
+
+        mutable std::atomic<uint64_t> samples;
+        mutable std::atomic<uint64_t> ticks;
+        mutable std::atomic<uint64_t> configsIn;
+        mutable std::atomic<uint64_t> configsOut;
+    };
+
+    /** Result of the filters which hashed a request, shared by every request
+        with the same hashes. Lives in the Data object so that it's dropped
+        whenever the filters or the configs change.
+
+        Each shard is simply cleared when it fills up: the entries are cheap
+        to recompute and the popular ones come right back.
+     */
+    struct ResultCache
+    {
+        struct Entry
+        {
+            ConfigSet configs;
+            std::vector<CreativeMatrix> creatives;
+        };
+
+        explicit ResultCache(size_t capacity);
+
+        std::shared_ptr<const Entry> find(uint64_t key) const;
+        void insert(uint64_t key, std::shared_ptr<const Entry> entry);
+        size_t memoryUsage() const;
+
+    private:
+        enum { NumShards = 16 };
+
+        struct Shard
+        {
+            mutable ML::Spinlock lock;
+            std::unordered_map<uint64_t, std::shared_ptr<const Entry> > entries;
+        };
+
+        size_t shardCapacity;
+        std::array<Shard, NumShards> shards;
+    };
+
     struct Data
     {
-        Data() {}
+        Data() : cacheSize(0) {}
         Data(const Data& other);
         ~Data();
 
         ssize_t findConfig(const std::string& name) const;
         unsigned addConfig(const std::string& name, const AgentInfo& info);
         void removeConfig(const std::string& name);
+        void refreshConfig(const std::string& name, const AgentInfo& info);
 
         ssize_t findFilter(const std::string& name) const;
         void addFilter(FilterBase* filter);
         void removeFilter(const std::string& name);
 
+        void compilePlan();
+        void resetCache(size_t size);
+
         // \todo Use unique_ptr when moving to gcc 4.7
         std::vector<FilterBase*> filters;
+        std::vector<FilterStats> stats;
+
+        // Indexes into filters in the order they should be executed.
+        std::vector<unsigned> plan;
 
         std::vector<ConfigEntry> configs;
         CreativeMatrix activeConfigs;
+
+        size_t cacheSize;
+        std::unique_ptr<ResultCache> cache;
     };
 
     bool setData(Data*&, std::unique_ptr<Data>&);
     void recordDiff(const Data* data, const FilterBase* f, const ConfigSet& diff);
     void recordReason(const Data* data, const FilterBase* f, FilterState & state);
     uint64_t recordTime(uint64_t ticks, const FilterBase* filter);
+    uint64_t applyCache(const Data* data, FilterState& state);
+    ConfigList makeConfigList(const Data* data, FilterState& state);
 
     std::atomic<Data*> data;
     std::vector< std::shared_ptr<AgentConfig> > configs;
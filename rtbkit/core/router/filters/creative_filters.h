@@ -10,6 +10,7 @@
 
 #include "generic_creative_filters.h"
 #include "priority.h"
+#include "exchange_info_index.h"
 #include "rtbkit/common/exchange_connector.h"
 
 #include <unordered_map>
@@ -23,23 +24,29 @@ namespace RTBKIT {
 /* CREATIVE FORTMAT FILTER                                                    */
 /******************************************************************************/
 
+/** Each format used by a creative is interned into a small id when the config
+    is added and keeps the matrix of the creatives that have it, so that an
+    impression is matched with one lookup per format and a union of the
+    matrices.  Formats that no creative has are skipped.
+*/
 struct CreativeFormatFilter : public CreativeFilter<CreativeFormatFilter>
 {
     static constexpr const char* name = "CreativeFormat";
     unsigned priority() const { return Priority::CreativeFormat; }
 
+    CreativeFormatFilter() : anyFormat(NoFormat) {}
+
     void addCreative(
             unsigned cfgIndex, unsigned crIndex, const Creative& creative)
     {
-        auto formatKey = makeKey(creative.format);
-        formatFilter[formatKey].set(crIndex, cfgIndex);
+        formats[intern(creative.format)].set(crIndex, cfgIndex);
     }
 
     void removeCreative(
             unsigned cfgIndex, unsigned crIndex, const Creative& creative)
     {
-        auto formatKey = makeKey(creative.format);
-        formatFilter[formatKey].reset(crIndex, cfgIndex);
+        unsigned id = find(creative.format);
+        if (id != NoFormat) formats[id].reset(crIndex, cfgIndex);
     }
 
     void filterImpression(
@@ -48,15 +55,28 @@ struct CreativeFormatFilter : public CreativeFilter<CreativeFormatFilter>
         if(!(imp.formats.empty()))
         {
             // The 0x0 format means: match anything.
-            CreativeMatrix creatives = get(Format(0,0));
+            CreativeMatrix creatives;
+            if (anyFormat != NoFormat) creatives = formats[anyFormat];
 
-            for (const auto& format : imp.formats)
-                creatives |= get(format);
+            for (const auto& format : imp.formats) {
+                unsigned id = find(format);
+                if (id != NoFormat) creatives |= formats[id];
+            }
 
             state.narrowCreativesForImp(impIndex, creatives);
         }
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        for (const auto& imp : state.request.imp) {
+            hash = hashField(hash, imp.formats.size());
+            for (const auto& format : imp.formats)
+                hash = hashField(hash, makeKey(format));
+        }
+        return true;
+    }
+
 
 private:
 
@@ -64,18 +84,33 @@ private:
     static_assert(sizeof(FormatKey) == sizeof(Format),
             "Conversion of FormatKey depends on size of Format");
 
-    FormatKey makeKey(const Format& format) const
+    enum : unsigned { NoFormat = ~0U };
+
+    static FormatKey makeKey(const Format& format)
     {
-        return uint32_t(format.width << 16 | format.height);
+        return FormatKey(uint16_t(format.width)) << 16 | uint16_t(format.height);
     }
 
-    CreativeMatrix get(const Format& format) const
+    unsigned find(const Format& format) const
     {
-        auto it = formatFilter.find(makeKey(format));
-        return it == formatFilter.end() ? CreativeMatrix() : it->second;
+        auto it = formatIds.find(makeKey(format));
+        return it == formatIds.end() ? NoFormat : it->second;
     }
 
-    std::unordered_map<uint32_t, CreativeMatrix> formatFilter;
+    unsigned intern(const Format& format)
+    {
+        auto res = formatIds.insert({ makeKey(format), unsigned(formats.size()) });
+        if (res.second) {
+            formats.emplace_back();
+            if (format.width == 0 && format.height == 0)
+                anyFormat = res.first->second;
+        }
+        return res.first->second;
+    }
+
+    std::unordered_map<FormatKey, unsigned> formatIds;
+    std::vector<CreativeMatrix> formats;    ///< Creatives by format id
+    unsigned anyFormat;                     ///< Id of 0x0
 };
 
 
@@ -102,12 +137,17 @@ struct CreativeLanguageFilter : public CreativeFilter<CreativeLanguageFilter>
 
     void filter(FilterState& state) const
     {
-        state.narrowAllCreatives(
-                impl.filter(state.request.language.utf8String()));
+        state.narrowAllCreatives(impl.filter(state.languageId()));
+    }
+
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        hash = hashField(hash, state.languageId());
+        return true;
     }
 
 private:
-    CreativeIncludeExcludeFilter< CreativeListFilter<std::string> > impl;
+    CreativeIncludeExcludeFilter< CreativeInternedListFilter<> > impl;
 };
 
 
@@ -138,6 +178,13 @@ struct CreativeLocationFilter : public CreativeFilter<CreativeLocationFilter>
                 impl.filter(state.request.location.fullLocationString()));
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        Datacratic::UnicodeString location = state.request.location.fullLocationString();
+        hash = hashField(hash, location.rawData(), location.rawLength());
+        return true;
+    }
+
 private:
     typedef CreativeRegexFilter<boost::u32regex, Datacratic::UnicodeString> BaseFilter;
     CreativeIncludeExcludeFilter<BaseFilter> impl;
@@ -169,11 +216,17 @@ struct CreativeExchangeNameFilter :
 
     void filter(FilterState& state) const
     {
-        state.narrowAllCreatives(impl.filter(state.request.exchange));
+        state.narrowAllCreatives(impl.filter(state.exchangeId()));
+    }
+
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        hash = hashField(hash, state.exchangeId());
+        return true;
     }
 
 private:
-    CreativeIncludeExcludeFilter< CreativeListFilter<std::string> > impl;
+    CreativeIncludeExcludeFilter< CreativeInternedListFilter<> > impl;
 };
 
 
@@ -181,8 +234,8 @@ private:
 /* CREATIVE EXCHANGE FILTER                                                   */
 /******************************************************************************/
 
-/** \todo Find a way to write an efficient version of this. */
-struct CreativeExchangeFilter : public IterativeFilter<CreativeExchangeFilter>
+/** See ExchangePreFilter for how the exchange is queried. */
+struct CreativeExchangeFilter : public ExchangeIndexedFilter<CreativeExchangeFilter>
 {
     static constexpr const char* name = "CreativeExchange";
     unsigned priority() const { return Priority::CreativeExchange; }
@@ -195,6 +248,18 @@ struct CreativeExchangeFilter : public IterativeFilter<CreativeExchangeFilter>
             return;
         }
 
+        // The creatives that the exchange accepted, restricted to the configs
+        // that are still in the running.
+        auto entry = index.get(*state.exchange, configs);
+        if (entry) {
+            CreativeMatrix creatives = entry->creatives;
+            creatives &= CreativeMatrix(state.configs());
+            state.exchange->bidRequestCreativeFilterAll(
+                    state.request, configs, entry->creativeInfos, creatives);
+            state.narrowAllCreatives(creatives);
+            return;
+        }
+
         CreativeMatrix creatives;
 
         for (size_t cfgId = state.configs().next();
@@ -288,37 +353,61 @@ struct CreativePMPFilter : public CreativeFilter<CreativePMPFilter>
     void addCreative(
             unsigned cfgIndex, unsigned crIndex, const Creative& creative)
     {
-        dealFilter[Datacratic::Id(creative.dealId)].set(crIndex, cfgIndex);
+        if (creative.dealId.empty())
+            noDeal.set(crIndex, cfgIndex);
+        else dealFilter[Datacratic::Id(creative.dealId)].set(crIndex, cfgIndex);
     }
 
     void removeCreative(
             unsigned cfgIndex, unsigned crIndex, const Creative& creative)
     {
-        dealFilter[Datacratic::Id(creative.dealId)].reset(crIndex, cfgIndex);
+        if (creative.dealId.empty()) {
+            noDeal.reset(crIndex, cfgIndex);
+            return;
+        }
+
+        auto it = dealFilter.find(Datacratic::Id(creative.dealId));
+        if (it == dealFilter.end()) return;
+
+        it->second.reset(crIndex, cfgIndex);
+        if (it->second.empty()) dealFilter.erase(it);
     }
 
     void filterImpression(
             FilterState& state, unsigned impIndex, const AdSpot& imp) const
     {
+        // Impressions outside of a private auction only go to the creatives
+        // without a deal which saves us the lookups.
+        if (!imp.pmp || imp.pmp->privateAuction.val != 1) {
+            state.narrowCreativesForImp(impIndex, noDeal);
+            return;
+        }
+
         CreativeMatrix creatives;
-        if (imp.pmp && imp.pmp->privateAuction.val == 1){
-            const auto pmp = *imp.pmp;
-            for (const auto& deal : pmp.deals) 
-                creatives |= get(deal.id);
-        }else {
-            creatives |= get(Datacratic::Id("")); //If filter is not set its a No-Deal agent
+        for (const auto& deal : imp.pmp->deals) {
+            const CreativeMatrix* matrix = get(deal.id);
+            if (matrix) creatives |= *matrix;
         }
 
         state.narrowCreativesForImp(impIndex, creatives);
     }
 
 private:
+
+    /** Creatives by deal id. Entries are removed once they no longer hold any
+        creatives so that the lookups of unknown deals stay cheap.
+     */
     std::unordered_map<Datacratic::Id, CreativeMatrix> dealFilter;
 
-    CreativeMatrix get(const Datacratic::Id dealId) const
+    /** Creatives without a deal id. */
+    CreativeMatrix noDeal;
+
+    const CreativeMatrix* get(const Datacratic::Id& dealId) const
     {
+        if (dealId.type == Datacratic::Id::NONE) return &noDeal;
+
         auto it = dealFilter.find(dealId);
-        return it == dealFilter.end() ? CreativeMatrix() : it->second;
+        return it == dealFilter.end() ? nullptr : &it->second;
     }
 };
 
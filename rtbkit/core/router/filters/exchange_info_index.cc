@@ -0,0 +1,85 @@
+/** exchange_info_index.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Per exchange index of the compatible configs and creatives, used by the
+    exchange filters.
+*/
+
+#include "exchange_info_index.h"
+#include "rtbkit/common/exchange_connector.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include <mutex>
+
+using namespace std;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* EXCHANGE INFO INDEX                                                        */
+/******************************************************************************/
+
+std::shared_ptr<const ExchangeInfoIndex::Entry>
+ExchangeInfoIndex::
+get(const ExchangeConnector& exchange,
+    const std::vector< std::shared_ptr<AgentConfig> >& configs) const
+{
+    unsigned generation = exchange.compatibilityGeneration.load();
+    if (!generation) return nullptr;
+
+    {
+        std::lock_guard<ML::Spinlock> guard(lock);
+        auto it = entries.find(&exchange);
+        if (it != entries.end() && it->second->generation == generation)
+            return it->second;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->generation = generation;
+    entry->configInfos.resize(configs.size());
+    entry->creativeInfos.resize(configs.size());
+
+    const string& name = exchange.exchangeName();
+
+    for (size_t cfgId = 0; cfgId < configs.size(); ++cfgId) {
+        if (!configs[cfgId]) continue;
+        const AgentConfig& config = *configs[cfgId];
+
+        {
+            std::lock_guard<ML::Spinlock> guard(config.lock);
+            auto it = config.providerData.find(name);
+            if (it == config.providerData.end()) continue;
+            entry->configs.set(cfgId);
+            entry->configInfos[cfgId] = it->second.get();
+            entry->owners.push_back(it->second);
+        }
+
+        auto& infos = entry->creativeInfos[cfgId];
+        infos.resize(config.creatives.size());
+
+        for (size_t crId = 0; crId < config.creatives.size(); ++crId) {
+            const Creative& creative = config.creatives[crId];
+
+            std::lock_guard<ML::Spinlock> guard(creative.lock);
+            auto it = creative.providerData.find(name);
+            if (it == creative.providerData.end()) continue;
+            entry->creatives.set(crId, cfgId);
+            infos[crId] = it->second.get();
+            entry->owners.push_back(it->second);
+        }
+    }
+
+    std::lock_guard<ML::Spinlock> guard(lock);
+    entries[&exchange] = entry;
+    return entry;
+}
+
+void
+ExchangeInfoIndex::
+clear()
+{
+    std::lock_guard<ML::Spinlock> guard(lock);
+    entries.clear();
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,109 @@
+/** exchange_info_index.h                                         -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Per exchange index of the compatible configs and creatives, used by the
+    exchange filters.
+
+*/
+
+#pragma once
+
+#include "generic_filters.h"
+#include "jml/arch/spinlock.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace RTBKIT {
+
+struct AgentConfig;
+struct ExchangeConnector;
+
+
+/******************************************************************************/
+/* EXCHANGE INFO INDEX                                                        */
+/******************************************************************************/
+
+/** The part of the exchange filters' decision that doesn't depend on the
+    bid request: which configs and creatives the exchange accepted when the
+    router checked their compatibility, and the info that it attached to
+    each of them in their providerData.
+
+    An entry is built the first time an exchange is filtered for once the
+    router has checked every agent against it (its compatibilityGeneration
+    is no longer 0), and is rebuilt when that generation changes.  Filters
+    copied by the FilterPool start with an empty index and clear it when
+    their configs change.
+*/
+struct ExchangeInfoIndex
+{
+    struct Entry
+    {
+        Entry() : generation(0) {}
+
+        unsigned generation;
+        ConfigSet configs;              ///< Configs compatible with the exchange
+        CreativeMatrix creatives;       ///< Creatives compatible with it
+        std::vector<const void*> configInfos;                 ///< By config
+        std::vector< std::vector<const void*> > creativeInfos; ///< By config
+
+        /// Keeps the infos alive if the router replaces them meanwhile
+        std::vector< std::shared_ptr<void> > owners;
+    };
+
+    ExchangeInfoIndex() {}
+    ExchangeInfoIndex(const ExchangeInfoIndex&) {}
+    ExchangeInfoIndex& operator = (const ExchangeInfoIndex&)
+    {
+        clear();
+        return *this;
+    }
+
+    /** Entry of the exchange for the given configs, or null if the router
+        hasn't checked their compatibility with it yet.
+    */
+    std::shared_ptr<const Entry>
+    get(const ExchangeConnector& exchange,
+        const std::vector< std::shared_ptr<AgentConfig> >& configs) const;
+
+    void clear();
+
+private:
+    mutable ML::Spinlock lock;
+    mutable std::unordered_map<const ExchangeConnector*,
+                               std::shared_ptr<const Entry> > entries;
+};
+
+
+
+/******************************************************************************/
+/* EXCHANGE INDEXED FILTER                                                    */
+/******************************************************************************/
+
+/** Base of the filters that ask the exchange connector about each config,
+    which keeps their ExchangeInfoIndex in sync with their configs.
+*/
+template<typename Filter>
+struct ExchangeIndexedFilter : public IterativeFilter<Filter>
+{
+    virtual void addConfig(
+            unsigned cfgIndex,
+            const std::shared_ptr<AgentConfig>& config)
+    {
+        IterativeFilter<Filter>::addConfig(cfgIndex, config);
+        index.clear();
+    }
+
+    virtual void removeConfig(
+            unsigned cfgIndex,
+            const std::shared_ptr<AgentConfig>& config)
+    {
+        IterativeFilter<Filter>::removeConfig(cfgIndex, config);
+        index.clear();
+    }
+
+protected:
+    ExchangeInfoIndex index;
+};
+
+} // namespace RTBKIT
@@ -11,7 +11,9 @@
 
 LIB_FILTERS_SOURCES := \
 	static_filters.cc \
-        creative_filters.cc
+        creative_filters.cc \
+        regex_set.cc \
+	exchange_info_index.cc
 
 LIB_FILTERS_LINK := \
 	arch utils filter_registry agent_configuration rtb
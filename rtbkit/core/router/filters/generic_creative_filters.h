@@ -131,6 +131,8 @@ struct IterativeCreativeFilter : public IterativeFilter<Filter>
 
 /** Generic include filter for regexes.
 
+    Same as RegexFilter but the regexes map to creatives.
+
     \todo We could add a TLS cache of all seen values such that we can avoid the
     regex entirely.
  */
@@ -148,6 +150,7 @@ struct CreativeRegexFilter
     {
         for (const auto& value : list)
             addConfig(cfgIndex, creativeId, value);
+        regexes.compile();
     }
 
     template<typename List>
@@ -155,14 +158,16 @@ struct CreativeRegexFilter
     {
         for (const auto& value : list)
             removeConfig(cfgIndex, creativeId, value);
+        regexes.compile();
     }
 
     CreativeMatrix filter(const Str& str) const
     {
         CreativeMatrix matches;
 
-        for (const auto& entry : data)
-            matches |= entry.second.filter(str);
+        regexes.forEachMatch(str, [&] (const CreativeMatrix& creatives) {
+                    matches |= creatives;
+                });
 
         return matches;
     }
@@ -171,9 +176,7 @@ private:
 
     void addConfig(unsigned cfgIndex, unsigned creativeId, const Regex& regex)
     {
-        auto& entry = data[regex.str()];
-        if (entry.regex.empty()) entry.regex = regex;
-        entry.creatives.set(creativeId, cfgIndex);
+        regexes.insert(regex).set(creativeId, cfgIndex);
     }
 
     void addConfig(
@@ -187,11 +190,11 @@ private:
     void removeConfig(
             unsigned cfgIndex, unsigned creativeId, const Regex& regex)
     {
-        auto it = data.find(regex.str());
-        if (it == data.end()) return;
+        CreativeMatrix* creatives = regexes.find(regex);
+        if (!creatives) return;
 
-        it->second.creatives.reset(creativeId, cfgIndex);
-        if (it->second.creatives.empty()) data.erase(it);
+        creatives->reset(creativeId, cfgIndex);
+        if (creatives->empty()) regexes.erase(regex);
     }
 
     void removeConfig(
@@ -201,26 +204,7 @@ private:
         removeConfig(cfgIndex, creativeId, regex.base);
     }
 
-    struct RegexData
-    {
-        Regex regex;
-        CreativeMatrix creatives;
-
-        CreativeMatrix filter(const Str& str) const
-        {
-            return RTBKIT::matches(regex, str) ? creatives : CreativeMatrix();
-        }
-    };
-
-    typedef std::basic_string<typename Regex::value_type> KeyT;
-
-    /* \todo gcc 4.6 can't hash u32strings so use a map for now.
-
-       The problem is that while gcc does define it in its header, any attempts
-       to use it causes a linking error. This also prevents us from writting our
-       own because, you guessed it, gcc already defines it. Glorious is it not?
-    */
-    std::map<KeyT, RegexData> data;
+    RegexSet<Regex, Str, CreativeMatrix> regexes;
 };
 
 
@@ -281,6 +265,58 @@ private:
 };
 
 
+/******************************************************************************/
+/* CREATIVE INTERNED LIST FILTER                                              */
+/******************************************************************************/
+
+/** Creative version of InternedListFilter. */
+template<typename List = std::vector<std::string> >
+struct CreativeInternedListFilter
+{
+    bool isEmpty(const List& list) const
+    {
+        return list.empty();
+    }
+
+    void addConfig(unsigned cfgIndex, unsigned creativeId, const List& list)
+    {
+        setConfig(cfgIndex, creativeId, list, true);
+    }
+
+    void removeConfig(unsigned cfgIndex, unsigned creativeId, const List& list)
+    {
+        setConfig(cfgIndex, creativeId, list, false);
+    }
+
+    CreativeMatrix filter(StringDictionary::Id id) const
+    {
+        return id < data.size() ? data[id] : CreativeMatrix();
+    }
+
+    CreativeMatrix filter(const std::string& value) const
+    {
+        return filter(StringDictionary::global().find(value));
+    }
+
+private:
+
+    void setConfig(
+            unsigned cfgIndex, unsigned creativeId,
+            const List& list, bool value)
+    {
+        auto& dictionary = StringDictionary::global();
+
+        for (const auto& entry : list) {
+            StringDictionary::Id id = dictionary.intern(entry);
+            if (id >= data.size()) data.resize(id + 1);
+            data[id].set(creativeId, cfgIndex, value);
+        }
+    }
+
+    std::vector<CreativeMatrix> data;
+};
+
+
 /******************************************************************************/
 /* CREATIVE INCLUDE EXCLUDE FILTER                                            */
 /******************************************************************************/
@@ -419,15 +455,17 @@ struct CreativeSegmentListFilter
 
     CreativeMatrix filter(int i, const std::string& str) const
     {
-        return i >= 0 ? get(intSet, i) : get(strSet, str);
+        const CreativeMatrix* creatives =
+            i >= 0 ? index.find(i) : index.find(str);
+        return creatives ? *creatives : CreativeMatrix();
     }
 
     CreativeMatrix filter(const SegmentList& segments) const
     {
         CreativeMatrix configs;
 
-        segments.forEach([&](int i, std::string str, float) {
-                    configs |= filter(i, str);
+        index.forEachMatch(segments, [&](const CreativeMatrix& matched) {
+                    configs |= matched;
                 });
 
         return configs;
@@ -438,22 +476,12 @@ private:
     void setConfig(unsigned cfgIndex, unsigned creativeId,
                      const SegmentList& segments, bool value)
     {
-        segments.forEach([&](int i, std::string str, float) {
-                    if (i >= 0) intSet[i].set(creativeId, cfgIndex, value);
-                    else strSet[str].set(creativeId, cfgIndex, value);
+        index.update(segments, [&](CreativeMatrix& creatives) {
+                    creatives.set(creativeId, cfgIndex, value);
                 });
     }
 
-    template<typename K>
-    CreativeMatrix get(const std::unordered_map<K,
-                       CreativeMatrix>& m, K k) const
-    {
-        auto it = m.find(k);
-        return it != m.end() ? it->second : CreativeMatrix();
-    }
-
-    std::unordered_map<int, CreativeMatrix> intSet;
-    std::unordered_map<std::string, CreativeMatrix> strSet;
+    SegmentIndex<CreativeMatrix> index;
 };
 
 } // namespace RTBKIT
@@ -10,7 +10,13 @@
 
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "rtbkit/core/agent_configuration/include_exclude.h"
+#include "rtbkit/core/router/filters/regex_set.h"
 #include "rtbkit/common/filter.h"
+#include "rtbkit/common/string_dictionary.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 
 namespace RTBKIT {
@@ -239,6 +245,8 @@ private:
 template<typename Str>
 struct DomainFilter
 {
+    DomainFilter() : nodes(1) {}
+
     template<typename List>
     bool isEmpty(const List& list) const
     {
@@ -259,15 +267,25 @@ struct DomainFilter
             removeConfig(cfgIndex, value);
     }
 
-    ConfigSet filter(const Url& host) const
+    /** Walks the host backwards down the trie and picks up the configs of
+        every domain that the host is or is a subdomain of.
+     */
+    ConfigSet filter(const Url& url) const
     {
         ConfigSet matches;
 
-        for (const auto& key : getKeys(host)) {
-            auto it = domainMap.find(key);
-            if (it == domainMap.end()) continue;
+        auto host = url.hostRange();
+        const char* str = host.first;
+        size_t i = host.second;
 
-            matches |= it->second;
+        unsigned node = 0;
+        while (true) {
+            if (i == 0 || str[i - 1] == '.')
+                matches |= nodes[node].configs;
+
+            if (i == 0) break;
+            node = child(node, str[--i]);
+            if (!node) break;
         }
 
         return matches;
@@ -289,31 +307,72 @@ private:
 
     void addConfig(unsigned cfgIndex, const Str& host)
     {
-        domainMap[host].set(cfgIndex);
+        nodes[insert(host)].configs.set(cfgIndex);
     }
 
     void removeConfig(unsigned cfgIndex, const Str& host)
     {
-        domainMap[host].reset(cfgIndex);
+        unsigned node = find(host);
+        if (node != NoNode) nodes[node].configs.reset(cfgIndex);
     }
 
-    std::vector<std::string> getKeys(const Url& host) const
+    enum { NoNode = unsigned(-1) };
+
+    /** Trie of the domains read from their last character to their first. */
+    struct Node
     {
-        std::vector<std::string> keys;
+        /** Sorted by character. */
+        std::vector< std::pair<char, unsigned> > next;
+        ConfigSet configs;
+    };
 
-        std::string domain = host.host();
-        while (true) {
-            keys.push_back(domain);
+    unsigned child(unsigned node, char c) const
+    {
+        const auto& next = nodes[node].next;
+
+        auto it = std::lower_bound(
+                next.begin(), next.end(), std::make_pair(c, 0u));
+        if (it == next.end() || it->first != c) return 0;
+        return it->second;
+    }
+
+    unsigned find(const Str& host) const
+    {
+        unsigned node = 0;
+        for (auto it = host.rbegin(), end = host.rend(); it != end; ++it) {
+            node = child(node, *it);
+            if (!node) return NoNode;
+        }
+        return node;
+    }
+
+    unsigned insert(const Str& host)
+    {
+        unsigned node = 0;
+
+        for (auto it = host.rbegin(), end = host.rend(); it != end; ++it) {
+            unsigned next = child(node, *it);
 
-            size_t pos = domain.find('.');
-            if (pos == std::string::npos) break;
-            domain = domain.substr(pos+1);
+            if (!next) {
+                next = nodes.size();
+
+                auto& children = nodes[node].next;
+                auto pos = std::lower_bound(
+                        children.begin(), children.end(),
+                        std::make_pair(*it, 0u));
+                children.insert(pos, std::make_pair(*it, next));
+
+                nodes.emplace_back();
+            }
+
+            node = next;
         }
 
-        return keys;
+        return node;
     }
 
-    std::unordered_map<std::string, ConfigSet> domainMap;
+    /** Node 0 is the root. */
+    std::vector<Node> nodes;
 };
 
 /******************************************************************************/
@@ -322,6 +381,9 @@ private:
 
 /** Generic include filter for regexes.
 
+    The regexes of all the configs are kept in a RegexSet so that only those
+    which can match a given string are evaluated.
+
     \todo We could add a TLS cache of all seen values such that we can avoid the
     regex entirely.
  */
@@ -339,6 +401,7 @@ struct RegexFilter
     {
         for (const auto& value : list)
             addConfig(cfgIndex, value);
+        regexes.compile();
     }
 
     template<typename List>
@@ -346,14 +409,16 @@ struct RegexFilter
     {
         for (const auto& value : list)
             removeConfig(cfgIndex, value);
+        regexes.compile();
     }
 
     ConfigSet filter(const Str& str) const
     {
         ConfigSet matches;
 
-        for (const auto& entry : data)
-            matches |= entry.second.filter(str);
+        regexes.forEachMatch(str, [&] (const ConfigSet& configs) {
+                    matches |= configs;
+                });
 
         return matches;
     }
@@ -362,9 +427,7 @@ private:
 
     void addConfig(unsigned cfgIndex, const Regex& regex)
     {
-        auto& entry = data[regex.str()];
-        if (entry.regex.empty()) entry.regex = regex;
-        entry.configs.set(cfgIndex);
+        regexes.insert(regex).set(cfgIndex);
     }
 
     void addConfig(unsigned cfgIndex, const CachedRegex<Regex, Str>& regex)
@@ -375,11 +438,11 @@ private:
 
     void removeConfig(unsigned cfgIndex, const Regex& regex)
     {
-        auto it = data.find(regex.str());
-        if (it == data.end()) return;
+        ConfigSet* configs = regexes.find(regex);
+        if (!configs) return;
 
-        it->second.configs.reset(cfgIndex);
-        if (it->second.configs.empty()) data.erase(it);
+        configs->reset(cfgIndex);
+        if (configs->empty()) regexes.erase(regex);
     }
 
     void removeConfig(unsigned cfgIndex, const CachedRegex<Regex, Str>& regex)
@@ -387,26 +450,7 @@ private:
         removeConfig(cfgIndex, regex.base);
     }
 
-    struct RegexData
-    {
-        Regex regex;
-        ConfigSet configs;
-
-        ConfigSet filter(const Str& str) const
-        {
-            return RTBKIT::matches(regex, str) ? configs : ConfigSet();
-        }
-    };
-
-    typedef std::basic_string<typename Regex::value_type> KeyT;
-
-    /* \todo gcc 4.6 can't hash u32strings so use a map for now.
-
-       The problem is that while gcc does define it in its header, any attempts
-       to use it causes a linking error. This also prevents us from writting our
-       own because, you guessed it, gcc already defines it. Glorious is it not?
-    */
-    std::map<KeyT, RegexData> data;
+    RegexSet<Regex, Str, ConfigSet> regexes;
 };
 
 
@@ -465,6 +509,226 @@ private:
 };
 
 
+/******************************************************************************/
+/* INTERNED LIST FILTER                                                       */
+/******************************************************************************/
+
+/** ListFilter for strings which indexes its configs by the id of the strings
+    in the global StringDictionary. Filtering on an id, like the ones cached by
+    FilterState, is then an array lookup.
+ */
+template<typename List = std::vector<std::string> >
+struct InternedListFilter
+{
+    bool isEmpty(const List& list) const
+    {
+        return list.empty();
+    }
+
+    void addConfig(unsigned cfgIndex, const List& list)
+    {
+        setConfig(cfgIndex, list, true);
+    }
+
+    void removeConfig(unsigned cfgIndex, const List& list)
+    {
+        setConfig(cfgIndex, list, false);
+    }
+
+    ConfigSet filter(StringDictionary::Id id) const
+    {
+        return id < data.size() ? data[id] : ConfigSet();
+    }
+
+    ConfigSet filter(const std::string& value) const
+    {
+        return filter(StringDictionary::global().find(value));
+    }
+
+private:
+
+    void setConfig(unsigned cfgIndex, const List& list, bool value)
+    {
+        auto& dictionary = StringDictionary::global();
+
+        for (const auto& entry : list) {
+            StringDictionary::Id id = dictionary.intern(entry);
+            if (id >= data.size()) data.resize(id + 1);
+            data[id].set(cfgIndex, value);
+        }
+    }
+
+    std::vector<ConfigSet> data;
+};
+
+
+/******************************************************************************/
+/* TAG EXPRESSION FILTER                                                      */
+/******************************************************************************/
+
+/** Evaluates the TagFilterExpression of every config at once. The filters of
+    all the expressions are kept in a single flat vector so that filtering a
+    set of tags is a linear scan of mask tests which skips the configs that
+    already matched.
+ */
+struct TagExpressionFilter
+{
+    bool isEmpty(const TagFilterExpression& expr) const
+    {
+        return expr.empty();
+    }
+
+    void addConfig(unsigned cfgIndex, const TagFilterExpression& expr)
+    {
+        if (expr.empty()) {
+            matchAll.set(cfgIndex);
+            return;
+        }
+
+        for (const auto& filter : expr)
+            terms.push_back(Term{cfgIndex, filter});
+    }
+
+    void removeConfig(unsigned cfgIndex, const TagFilterExpression&)
+    {
+        matchAll.reset(cfgIndex);
+
+        auto isConfig = [=] (const Term& term) {
+            return term.cfgIndex == cfgIndex;
+        };
+        terms.erase(
+                std::remove_if(terms.begin(), terms.end(), isConfig),
+                terms.end());
+    }
+
+    ConfigSet filter(const Tags& tags) const
+    {
+        ConfigSet configs = matchAll;
+
+        for (const auto& term : terms) {
+            if (configs.test(term.cfgIndex)) continue;
+            if (term.filter.matches(tags)) configs.set(term.cfgIndex);
+        }
+
+        return configs;
+    }
+
+private:
+
+    struct Term
+    {
+        unsigned cfgIndex;
+        TagFilter filter;
+    };
+
+    ConfigSet matchAll;
+    std::vector<Term> terms;
+};
+
+
+/******************************************************************************/
+/* SEGMENT INDEX                                                              */
+/******************************************************************************/
+
+/** Maps segments to the value of the configs that reference them.
+
+    Int segments are kept in a sorted vector so that they can be intersected
+    with the sorted ints of a SegmentList, looking up the elements of the
+    smaller side in the larger one when the sizes are lopsided. String segments
+    are hashed. Neither goes through SegmentList::forEach which formats every
+    int segment into a string.
+ */
+template<typename Value>
+struct SegmentIndex
+{
+    /** Calls update with the value of every segment of the list. */
+    template<typename Fn>
+    void update(const SegmentList& segments, const Fn& update)
+    {
+        for (int i : segments.ints) {
+            auto it = std::lower_bound(intKeys.begin(), intKeys.end(), i);
+            size_t pos = it - intKeys.begin();
+
+            if (it == intKeys.end() || *it != i) {
+                intKeys.insert(it, i);
+                intValues.insert(intValues.begin() + pos, Value());
+            }
+
+            update(intValues[pos]);
+        }
+
+        for (const auto& str : segments.strings)
+            update(strValues[str]);
+    }
+
+    const Value* find(int i) const
+    {
+        auto it = std::lower_bound(intKeys.begin(), intKeys.end(), i);
+        if (it == intKeys.end() || *it != i) return nullptr;
+        return &intValues[it - intKeys.begin()];
+    }
+
+    const Value* find(const std::string& str) const
+    {
+        auto it = strValues.find(str);
+        return it != strValues.end() ? &it->second : nullptr;
+    }
+
+    /** Calls onMatch with the value of every segment of the list that's in
+        the index.
+     */
+    template<typename Fn>
+    void forEachMatch(const SegmentList& segments, const Fn& onMatch) const
+    {
+        const auto& ints = segments.ints;
+
+        if (ints.empty() || intKeys.empty()) {}
+
+        // Only the request's segments can be looked up if they're not sorted.
+        else if (ints.size() * 5 < intKeys.size()
+                || !std::is_sorted(ints.begin(), ints.end()))
+        {
+            for (int i : ints) {
+                const Value* value = find(i);
+                if (value) onMatch(*value);
+            }
+        }
+
+        else if (intKeys.size() * 5 < ints.size()) {
+            for (size_t k = 0; k < intKeys.size(); ++k) {
+                if (std::binary_search(ints.begin(), ints.end(), intKeys[k]))
+                    onMatch(intValues[k]);
+            }
+        }
+
+        else {
+            auto it = ints.begin(), end = ints.end();
+            size_t k = 0;
+
+            while (it != end && k < intKeys.size()) {
+                if (*it < intKeys[k]) ++it;
+                else if (intKeys[k] < *it) ++k;
+                else {
+                    onMatch(intValues[k]);
+                    ++it;
+                    ++k;
+                }
+            }
+        }
+
+        for (const auto& str : segments.strings) {
+            const Value* value = find(str);
+            if (value) onMatch(*value);
+        }
+    }
+
+private:
+    std::vector<int> intKeys;
+    std::vector<Value> intValues;
+    std::unordered_map<std::string, Value> strValues;
+};
+
+
 /******************************************************************************/
 /* SEGMENT LIST FILTER                                                        */
 /******************************************************************************/
@@ -491,15 +755,16 @@ struct SegmentListFilter
 
     ConfigSet filter(int i, const std::string& str) const
     {
-        return i >= 0 ? get(intSet, i) : get(strSet, str);
+        const ConfigSet* configs = i >= 0 ? index.find(i) : index.find(str);
+        return configs ? *configs : ConfigSet();
     }
 
     ConfigSet filter(const SegmentList& segments) const
     {
         ConfigSet configs;
 
-        segments.forEach([&](int i, std::string str, float) {
-                    configs |= filter(i, str);
+        index.forEachMatch(segments, [&](const ConfigSet& matched) {
+                    configs |= matched;
                 });
 
         return configs;
@@ -509,21 +774,12 @@ private:
 
     void setConfig(unsigned cfgIndex, const SegmentList& segments, bool value)
     {
-        segments.forEach([&](int i, std::string str, float) {
-                    if (i >= 0) intSet[i].set(cfgIndex, value);
-                    else strSet[str].set(cfgIndex, value);
+        index.update(segments, [&](ConfigSet& configs) {
+                    configs.set(cfgIndex, value);
                 });
     }
 
-    template<typename K>
-    ConfigSet get(const std::unordered_map<K, ConfigSet>& m, K k) const
-    {
-        auto it = m.find(k);
-        return it != m.end() ? it->second : ConfigSet();
-    }
-
-    std::unordered_map<int, ConfigSet> intSet;
-    std::unordered_map<std::string, ConfigSet> strSet;
+    SegmentIndex<ConfigSet> index;
 };
 
 
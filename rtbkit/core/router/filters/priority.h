@@ -17,6 +17,9 @@ namespace RTBKIT {
 
 struct Priority
 {
+    // One atomic load per exhausted account and drops whole accounts.
+    static constexpr unsigned Budget               = 0x0100;
+
     static constexpr unsigned ExchangeName         = 0x0200;
 
     static constexpr unsigned Location             = 0x1000;
@@ -38,6 +41,12 @@ struct Priority
 
     static constexpr unsigned CreativeSegments     = 0x3500;
 
+    // Takes the lock of a shard of the frequency cap store per account.
+    static constexpr unsigned FrequencyCap         = 0x3600;
+
+    // Evaluates the expressions of the configs that are still in the running.
+    static constexpr unsigned Expression           = 0x3700;
+
     static constexpr unsigned ExchangePre          = 0xF000;
 
     // Really slow so delay as much as possible.
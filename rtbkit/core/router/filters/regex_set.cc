@@ -0,0 +1,394 @@
+/** regex_set.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Set of regexes that are matched together against a string.
+
+*/
+
+#include "regex_set.h"
+#include "jml/utils/exc_assert.h"
+#include "jml/utils/exc_check.h"
+
+#include <algorithm>
+#include <deque>
+#include <cstring>
+
+using namespace std;
+
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* LITERAL MATCHER                                                            */
+/******************************************************************************/
+
+LiteralMatcher::
+LiteralMatcher() :
+    nodes(1), needsRebuild(false)
+{}
+
+unsigned
+LiteralMatcher::
+child(unsigned node, unsigned char c) const
+{
+    const auto& next = nodes[node].next;
+
+    auto it = lower_bound(next.begin(), next.end(), make_pair(c, 0u));
+    if (it == next.end() || it->first != c) return 0;
+    return it->second;
+}
+
+unsigned
+LiteralMatcher::
+insert(const string& str)
+{
+    unsigned node = 0;
+
+    for (unsigned char c : str) {
+        unsigned next = child(node, c);
+
+        if (!next) {
+            next = nodes.size();
+
+            auto& children = nodes[node].next;
+            auto it = lower_bound(children.begin(), children.end(), make_pair(c, 0u));
+            children.insert(it, make_pair(c, next));
+
+            nodes.emplace_back();
+        }
+
+        node = next;
+    }
+
+    return node;
+}
+
+unsigned
+LiteralMatcher::
+add(const string& literal)
+{
+    ExcCheck(!literal.empty(), "empty literal");
+
+    auto it = literalIds.find(literal);
+    if (it != literalIds.end()) {
+        literals[it->second].refs++;
+        return it->second;
+    }
+
+    unsigned id;
+    if (freeIds.empty()) {
+        id = literals.size();
+        literals.emplace_back();
+    }
+    else {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+
+    Literal& entry = literals[id];
+    entry.str = literal;
+    entry.refs = 1;
+    entry.node = insert(literal);
+    nodes[entry.node].literal = id;
+
+    literalIds[literal] = id;
+    return id;
+}
+
+void
+LiteralMatcher::
+remove(unsigned id)
+{
+    ExcAssertLess(id, literals.size());
+
+    Literal& entry = literals[id];
+    ExcAssertGreater(entry.refs, 0);
+    if (--entry.refs) return;
+
+    nodes[entry.node].literal = NoLiteral;
+    literalIds.erase(entry.str);
+
+    entry = Literal();
+    freeIds.push_back(id);
+
+    // The dead branch of the trie is only dropped when it's rebuilt.
+    needsRebuild = true;
+}
+
+void
+LiteralMatcher::
+compile()
+{
+    if (needsRebuild) {
+        nodes.clear();
+        nodes.emplace_back();
+
+        for (unsigned id = 0; id < literals.size(); ++id) {
+            Literal& entry = literals[id];
+            if (!entry.refs) continue;
+
+            entry.node = insert(entry.str);
+            nodes[entry.node].literal = id;
+        }
+
+        needsRebuild = false;
+    }
+
+    // Breadth first so that the fail link of a node is always computed
+    // before those of its children.
+    deque<unsigned> queue;
+
+    for (const auto& next : nodes[0].next) {
+        Node& node = nodes[next.second];
+        node.fail = 0;
+        node.output = node.literal != NoLiteral ? next.second : 0;
+        queue.push_back(next.second);
+    }
+
+    while (!queue.empty()) {
+        unsigned parent = queue.front();
+        queue.pop_front();
+
+        for (const auto& next : nodes[parent].next) {
+            unsigned fail = nodes[parent].fail;
+            while (fail && !child(fail, next.first))
+                fail = nodes[fail].fail;
+            fail = child(fail, next.first);
+
+            Node& node = nodes[next.second];
+            node.fail = fail;
+            node.output = node.literal != NoLiteral ?
+                next.second : nodes[fail].output;
+
+            queue.push_back(next.second);
+        }
+    }
+}
+
+void
+LiteralMatcher::
+match(const char* str, size_t size, vector<unsigned>& ids) const
+{
+    size_t first = ids.size();
+    unsigned node = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char c = str[i];
+
+        unsigned next;
+        while (!(next = child(node, c)) && node)
+            node = nodes[node].fail;
+        node = next;
+
+        for (unsigned out = nodes[node].output; out; ) {
+            // Literals removed since the last compile() are still linked.
+            if (nodes[out].literal != NoLiteral)
+                ids.push_back(nodes[out].literal);
+            out = nodes[nodes[out].fail].output;
+        }
+    }
+
+    sort(ids.begin() + first, ids.end());
+    ids.erase(unique(ids.begin() + first, ids.end()), ids.end());
+}
+
+
+/******************************************************************************/
+/* REQUIRED LITERAL                                                           */
+/******************************************************************************/
+
+namespace {
+
+/** Escaped characters which stand for themselves; the others are classes,
+    anchors or back references.
+ */
+bool isEscapedLiteral(char c)
+{
+    return c && strchr(".^$|()[]{}*+?\\/-", c);
+}
+
+/** Returns the position after the escape sequence that starts at pos.
+    Escapes such as \x41 or \p{L} take arguments which must not be mistaken
+    for literal characters.
+ */
+size_t skipEscape(const string& pattern, size_t pos)
+{
+    pos += 2;
+    if (pos > pattern.size()) return pattern.size();
+
+    auto skipTo = [&] (char end) {
+        size_t found = pattern.find(end, pos);
+        return found == string::npos ? pattern.size() : found + 1;
+    };
+
+    auto skipWhile = [&] (const char* chars, size_t max) {
+        while (max-- && pos < pattern.size() && strchr(chars, pattern[pos]))
+            ++pos;
+        return pos;
+    };
+
+    switch (pattern[pos - 1]) {
+    case 'x':
+        if (pos < pattern.size() && pattern[pos] == '{') return skipTo('}');
+        return skipWhile("0123456789abcdefABCDEF", 2);
+
+    case '0':
+        return skipWhile("01234567", 2);
+
+    case '1': case '2': case '3': case '4': case '5':
+    case '6': case '7': case '8': case '9':
+        return skipWhile("0123456789", string::npos);
+
+    case 'c':
+        return min(pos + 1, pattern.size());
+
+    case 'p': case 'P': case 'N': case 'g': case 'k':
+        if (pos < pattern.size() && pattern[pos] == '{') return skipTo('}');
+        if (pos < pattern.size() && pattern[pos] == '<') return skipTo('>');
+        if (pos < pattern.size() && pattern[pos] == '\'') return skipTo('\'');
+        return pos;
+
+    default:
+        return pos;
+    }
+}
+
+/** Removes the last character, which a quantifier made optional or
+    repeatable. Works on code points so that a quantified multi-byte
+    character doesn't leave bits of itself behind.
+ */
+void dropLastChar(string& run)
+{
+    while (!run.empty() && (run.back() & 0xC0) == 0x80)
+        run.pop_back();
+    if (!run.empty()) run.pop_back();
+}
+
+/** Returns the position after the character class that starts at pos or
+    npos if it's not terminated.
+ */
+size_t skipClass(const string& pattern, size_t pos)
+{
+    ++pos;
+    if (pos < pattern.size() && pattern[pos] == '^') ++pos;
+    if (pos < pattern.size() && pattern[pos] == ']') ++pos;
+
+    while (pos < pattern.size()) {
+        char c = pattern[pos];
+
+        if (c == '\\') pos = skipEscape(pattern, pos);
+        else if (c == '[' && pos + 1 < pattern.size()
+                && strchr(":.=", pattern[pos + 1]))
+        {
+            size_t end = pattern.find(string(1, pattern[pos + 1]) + "]", pos + 2);
+            if (end == string::npos) return string::npos;
+            pos = end + 2;
+        }
+        else if (c == ']') return pos + 1;
+        else ++pos;
+    }
+
+    return string::npos;
+}
+
+} // namespace anonymous
+
+string
+requiredLiteral(const string& pattern, bool* exact)
+{
+    if (exact) *exact = false;
+    if (pattern.find('|') != string::npos) return "";
+
+    string best;
+    string run;
+    int depth = 0;
+    bool literalOnly = true;
+
+    auto endRun = [&] {
+        literalOnly = false;
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+
+    for (size_t pos = 0; pos < pattern.size();) {
+        char c = pattern[pos];
+
+        switch (c) {
+
+        case '\\': {
+            char escaped = pos + 1 < pattern.size() ? pattern[pos + 1] : 0;
+            if (depth == 0 && isEscapedLiteral(escaped)) {
+                run += escaped;
+                pos += 2;
+            }
+            else {
+                endRun();
+                pos = skipEscape(pattern, pos);
+            }
+            break;
+        }
+
+        case '*':
+        case '?':
+            dropLastChar(run);
+            endRun();
+            ++pos;
+            break;
+
+        case '+':
+            // The character is still required but nothing can follow it.
+            endRun();
+            ++pos;
+            break;
+
+        case '{': {
+            dropLastChar(run);
+            endRun();
+            size_t end = pattern.find('}', pos);
+            if (end == string::npos) return best;
+            pos = end + 1;
+            break;
+        }
+
+        case '[':
+            endRun();
+            pos = skipClass(pattern, pos);
+            if (pos == string::npos) return best;
+            break;
+
+        case '(':
+            // Flags, lookarounds and comments all start with (? and change
+            // what the rest of the pattern means.
+            if (pos + 1 < pattern.size() && pattern[pos + 1] == '?') return "";
+            endRun();
+            ++depth;
+            ++pos;
+            break;
+
+        case ')':
+            endRun();
+            --depth;
+            ++pos;
+            break;
+
+        case '.':
+        case '^':
+        case '$':
+            endRun();
+            ++pos;
+            break;
+
+        default:
+            if (depth == 0) run += c;
+            ++pos;
+            break;
+        }
+    }
+
+    if (exact) *exact = literalOnly && !run.empty();
+    if (run.size() > best.size()) best = run;
+    return best;
+}
+
+} // namespace RTBKIT
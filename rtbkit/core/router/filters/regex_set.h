@@ -0,0 +1,300 @@
+/** regex_set.h                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Set of regexes that are matched together against a string.
+
+*/
+
+#pragma once
+
+#include "rtbkit/core/agent_configuration/include_exclude.h"
+#include "soa/types/string.h"
+#include "soa/utf8cpp/source/utf8.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* LITERAL MATCHER                                                            */
+/******************************************************************************/
+
+/** Aho-Corasick automaton which finds which of a set of literals occur in a
+    string in a single pass over it.
+
+    Literals can be added and removed at any time but the automaton only
+    reflects them once compile() is called. Adding literals extends the trie
+    in place whereas removing them causes the trie to be rebuilt on the next
+    compile().
+ */
+struct LiteralMatcher
+{
+    LiteralMatcher();
+
+    /** Returns the id of the literal which stays valid until every add() of
+        the literal has been matched by a remove().
+     */
+    unsigned add(const std::string& literal);
+    void remove(unsigned id);
+
+    void compile();
+
+    /** Appends the ids of the literals found in the string to ids; each id
+        is only appended once.
+     */
+    void match(const char* str, size_t size, std::vector<unsigned>& ids) const;
+
+    size_t size() const { return literals.size() - freeIds.size(); }
+
+private:
+
+    enum { NoLiteral = unsigned(-1) };
+
+    struct Node
+    {
+        Node() : fail(0), output(0), literal(NoLiteral) {}
+
+        /** Sorted by character. */
+        std::vector< std::pair<unsigned char, unsigned> > next;
+
+        unsigned fail;
+
+        /** Closest node on the fail chain, including this one, which ends a
+            literal or 0 if there are none.
+         */
+        unsigned output;
+
+        unsigned literal;
+    };
+
+    struct Literal
+    {
+        std::string str;
+        unsigned node;
+        unsigned refs;
+    };
+
+    unsigned child(unsigned node, unsigned char c) const;
+    unsigned insert(const std::string& str);
+
+    std::vector<Node> nodes;
+    std::vector<Literal> literals;
+    std::vector<unsigned> freeIds;
+    std::map<std::string, unsigned> literalIds;
+
+    bool needsRebuild;
+};
+
+
+/** Returns a string which is part of every match of the given perl regex or
+    an empty string if one can't be found, typically because the regex
+    contains an alternation.
+
+    This errs on the side of returning less than could be found: it only looks
+    at the top level of the regex and bails on anything it doesn't know about.
+
+    If exact is given, it's set when the regex is nothing but the literal in
+    which case finding the literal is the same as matching the regex.
+ */
+std::string requiredLiteral(const std::string& pattern, bool* exact = nullptr);
+
+
+/******************************************************************************/
+/* REGEX SET                                                                  */
+/******************************************************************************/
+
+inline std::string regexPattern(const boost::regex& regex)
+{
+    return regex.str();
+}
+
+inline std::string regexPattern(const boost::u32regex& regex)
+{
+    auto str = regex.str();
+    std::string result;
+    utf8::utf32to8(str.begin(), str.end(), std::back_inserter(result));
+    return result;
+}
+
+inline std::pair<const char*, size_t> rawBytes(const std::string& str)
+{
+    return std::make_pair(str.data(), str.size());
+}
+
+inline std::pair<const char*, size_t> rawBytes(const Datacratic::Utf8String& str)
+{
+    return std::make_pair(str.rawData(), str.rawLength());
+}
+
+
+/** Maps regexes to a value and calls back with the values of all the regexes
+    that match a given string.
+
+    Instead of evaluating every regex on every string, each regex is indexed
+    on a literal which has to be present for it to match and the literals of
+    all the regexes are looked for in one pass with a LiteralMatcher. Only the
+    regexes whose literal was found, along with those where none could be
+    extracted, are then evaluated. Regexes which are plain substrings are
+    never evaluated since finding their literal is enough.
+
+    The index is updated by insert() and erase() but only takes effect once
+    compile() is called which should be done after a batch of changes.
+ */
+template<typename Regex, typename Str, typename Value>
+struct RegexSet
+{
+    bool empty() const { return index.empty(); }
+
+    /** Returns the value of the regex, default constructed if the regex is
+        new.
+     */
+    Value& insert(const Regex& regex)
+    {
+        auto it = index.find(regex.str());
+        if (it != index.end()) return entries[it->second].value;
+
+        unsigned slot;
+        if (freeSlots.empty()) {
+            slot = entries.size();
+            entries.emplace_back();
+        }
+        else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+
+        Entry& entry = entries[slot];
+        entry.regex = regex;
+        entry.value = Value();
+
+        if (!(regex.flags() & UnsupportedFlags)) {
+            std::string literal =
+                requiredLiteral(regexPattern(regex), &entry.exact);
+            if (!literal.empty()) entry.literal = literals.add(literal);
+        }
+
+        if (entry.literal == NoLiteral)
+            unfiltered.push_back(slot);
+        else {
+            if (entry.literal >= literalSlots.size())
+                literalSlots.resize(entry.literal + 1);
+            literalSlots[entry.literal].push_back(slot);
+        }
+
+        index[regex.str()] = slot;
+        return entry.value;
+    }
+
+    /** Returns the value of the regex or null if it's not in the set. */
+    Value* find(const Regex& regex)
+    {
+        auto it = index.find(regex.str());
+        return it == index.end() ? nullptr : &entries[it->second].value;
+    }
+
+    void erase(const Regex& regex)
+    {
+        auto it = index.find(regex.str());
+        if (it == index.end()) return;
+
+        unsigned slot = it->second;
+        Entry& entry = entries[slot];
+
+        if (entry.literal == NoLiteral)
+            removeSlot(unfiltered, slot);
+        else {
+            removeSlot(literalSlots[entry.literal], slot);
+            literals.remove(entry.literal);
+        }
+
+        entry = Entry();
+        freeSlots.push_back(slot);
+        index.erase(it);
+    }
+
+    void compile() { literals.compile(); }
+
+    /** Calls onMatch with the value of every regex which matches str. */
+    template<typename Fn>
+    void forEachMatch(const Str& str, const Fn& onMatch) const
+    {
+        auto check = [&] (unsigned slot) {
+            const Entry& entry = entries[slot];
+            if (entry.exact || RTBKIT::matches(entry.regex, str))
+                onMatch(entry.value);
+        };
+
+        for (unsigned slot : unfiltered) check(slot);
+
+        if (!literals.size()) return;
+
+        std::vector<unsigned> found;
+        auto bytes = rawBytes(str);
+        literals.match(bytes.first, bytes.second, found);
+
+        for (unsigned id : found) {
+            for (unsigned slot : literalSlots[id]) check(slot);
+        }
+    }
+
+private:
+
+    /** Literals can't be relied on when matching ignores case or whitespace
+        in the pattern.
+     */
+    enum {
+        UnsupportedFlags =
+            boost::regex_constants::icase | boost::regex_constants::mod_x
+    };
+
+    enum { NoLiteral = unsigned(-1) };
+
+    struct Entry
+    {
+        Entry() : literal(NoLiteral), exact(false) {}
+
+        Regex regex;
+        Value value;
+        unsigned literal;
+
+        /** The regex is its literal so it matches whenever it's found. */
+        bool exact;
+    };
+
+    static void removeSlot(std::vector<unsigned>& slots, unsigned slot)
+    {
+        for (auto& other : slots) {
+            if (other != slot) continue;
+            other = slots.back();
+            slots.pop_back();
+            return;
+        }
+    }
+
+    typedef std::basic_string<typename Regex::value_type> KeyT;
+
+    /* \todo gcc 4.6 can't hash u32strings so use a map for now.
+
+       The problem is that while gcc does define it in its header, any attempts
+       to use it causes a linking error. This also prevents us from writting our
+       own because, you guessed it, gcc already defines it. Glorious is it not?
+    */
+    std::map<KeyT, unsigned> index;
+
+    std::vector<Entry> entries;
+    std::vector<unsigned> freeSlots;
+
+    /** Regexes which have no literal and must always be evaluated. */
+    std::vector<unsigned> unfiltered;
+
+    /** Regexes indexed by the id of their literal. */
+    std::vector< std::vector<unsigned> > literalSlots;
+
+    LiteralMatcher literals;
+};
+
+} // namespace RTBKIT
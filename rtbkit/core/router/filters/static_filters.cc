@@ -10,6 +10,7 @@
 #define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
 #include "crypto++/md5.h"
 
+#include <algorithm>
 
 using namespace std;
 using namespace ML;
@@ -65,7 +66,7 @@ applyExchangeFilter(FilterState& state, const ConfigSet& result) const
        that the filter will return all the configs that should not be
        skipped.
     */
-    ConfigSet leftover = affected & exchange.filter(state.request.exchange);
+    ConfigSet leftover = affected & exchange.filter(state.exchangeId());
 
     /* At this point we have a 1 in our leftover bitfield for each configs
        that would be filtered out and is not marked for skipping. We can
@@ -91,11 +92,9 @@ void
 SegmentsFilter::
 filter(FilterState& state) const
 {
-    unordered_set<string> toCheck = excludeIfNotPresent;
-
-    for (const auto& segment : state.request.segments) {
-        toCheck.erase(segment.first);
+    const auto& segments = state.request.segments;
 
+    for (const auto& segment : segments) {
         auto it = data.find(segment.first);
         if (it == data.end()) continue;
 
@@ -110,7 +109,9 @@ filter(FilterState& state) const
         if (state.configs().empty()) return;
     }
 
-    for (const auto& segment : toCheck) {
+    for (const auto& segment : excludeIfNotPresent) {
+        if (segments.count(segment)) continue;
+
         auto it = data.find(segment);
         if (it == data.end()) continue;
 
@@ -128,6 +129,13 @@ filter(FilterState& state) const
 /* USER PARTITION FILTER                                                      */
 /******************************************************************************/
 
+namespace {
+
+// Largest modulus for which the configs of each residue are tabulated.
+enum { MaxTabulatedModulus = 1024 };
+
+} // namespace anonymous
+
 void
 UserPartitionFilter::
 setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
@@ -139,20 +147,22 @@ setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
         return;
     }
 
-    auto uid = config.externalId;
-    auto& entry = data[getKey(part, uid)];
-    entry.uid = uid;
-    if (entry.hashOn == UserPartition::NONE) {
-        entry.modulus = part.modulus;
-        entry.hashOn = part.hashOn;
-    }
-    ExcAssertEqual(entry.modulus, part.modulus);
-    ExcAssertEqual(entry.hashOn, part.hashOn);
+    auto it = find_if(groups.begin(), groups.end(), [&] (const Group& group) {
+                return group.hashOn == part.hashOn
+                    && group.modulus == part.modulus;
+            });
 
-    entry.excludeIfEmpty.set(cfgIndex);
+    if (it == groups.end()) {
+        if (!value) return;
+        groups.emplace_back(part.hashOn, part.modulus);
+        it = groups.end() - 1;
+    }
 
-    if (value) entry.filter.addConfig(cfgIndex, part.includeRanges);
-    else entry.filter.removeConfig(cfgIndex, part.includeRanges);
+    if (value) it->add(cfgIndex, config.externalId, part.includeRanges);
+    else {
+        it->remove(cfgIndex);
+        if (it->configs.empty()) groups.erase(it);
+    }
 }
 
 void
@@ -162,11 +172,21 @@ filter(FilterState& state) const
     ConfigSet matches = defaultSet;
     ConfigSet excludes;
 
-    for (const auto& entry : data) {
-        auto value = getValue(state.request, entry.second);
+    // Each field is hashed at most once no matter how many groups use it.
+    std::array<std::pair<bool, uint64_t>, UserPartition::IPUA + 1> hashes;
+    std::array<bool, UserPartition::IPUA + 1> hashed;
+    hashed.fill(false);
+
+    for (const auto& group : groups) {
+        if (!hashed[group.hashOn]) {
+            hashes[group.hashOn] = partitionHash(state.request, group.hashOn);
+            hashed[group.hashOn] = true;
+        }
+
+        const auto& hash = hashes[group.hashOn];
 
-        if (!value.first) excludes |= entry.second.excludeIfEmpty;
-        else matches |= entry.second.filter.filter(value.second);
+        if (!hash.first) excludes |= group.configs;
+        else matches |= group.filter(hash.second);
     }
 
     matches &= excludes.negate();
@@ -195,14 +215,14 @@ uint64_t calcHash(const std::string& str)
 
 std::pair<bool, uint64_t>
 UserPartitionFilter::
-getValue(const BidRequest& br, const FilterEntry& entry) const
+partitionHash(const BidRequest& br, UserPartition::HashOn hashOn)
 {
-    if (entry.hashOn == UserPartition::RANDOM)
-        return make_pair(true, random() % entry.modulus);
+    // Each config draws its own number in Group::filter.
+    if (hashOn == UserPartition::RANDOM) return make_pair(true, 0);
 
     string str;
 
-    switch (entry.hashOn) {
+    switch (hashOn) {
     case UserPartition::EXCHANGEID:
         str = br.userIds.exchangeId.toString(); break;
 
@@ -217,95 +237,227 @@ getValue(const BidRequest& br, const FilterEntry& entry) const
 
     if (str.empty() || str == "null") return make_pair(false, 0);
 
-    auto h = calcHash(str) + entry.uid;
-    return make_pair(true, h % entry.modulus);
+    return make_pair(true, calcHash(str));
 }
 
 
-LatLongDevFilter::Square
-LatLongDevFilter::squareFromLatLongRadius(float lat, float lon, float radius)
+/******************************************************************************/
+/* USER PARTITION FILTER - GROUP                                              */
+/******************************************************************************/
+
+bool
+UserPartitionFilter::Group::Member::
+matches(uint64_t hash, int modulus) const
 {
-    Square sq;
-    sq.y_max = (lat * LATITUDE_1DEGREE_KMS) + radius;
-    sq.y_min = (lat * LATITUDE_1DEGREE_KMS) - radius;
+    int value = (hash + offset) % modulus;
 
-    sq.x_max = ( lon * LONGITUDE_1DEGREE_KMS * cosInDegrees(lat) ) + radius;
-    sq.x_min = ( lon * LONGITUDE_1DEGREE_KMS * cosInDegrees(lat) ) - radius;
+    for (const auto& range : ranges) {
+        if (range.in(value)) return true;
+    }
+    return false;
+}
 
-    return sq;
+void
+UserPartitionFilter::Group::
+tabulate(const Member& member, bool value)
+{
+    uint64_t shift = member.offset % modulus;
+
+    for (const auto& range : member.ranges) {
+        int first = std::max(range.first, 0);
+        int last = std::min(range.last, modulus);
+
+        for (int v = first; v < last; ++v)
+            residues[(v + modulus - shift) % modulus].set(member.cfgIndex, value);
+    }
 }
 
-void LatLongDevFilter::addConfig(unsigned cfgIndex,
-        const std::shared_ptr<RTBKIT::AgentConfig>& config)
+void
+UserPartitionFilter::Group::
+add(unsigned cfgIndex, int uid,
+        const std::vector<UserPartition::Interval>& ranges)
 {
-    SquareList squares;
-    for ( const RTBKIT::LatLonRad & llr : config->latLongDevFilter.latlonrads){
-        auto sq = squareFromLatLongRadius(llr.lat, llr.lon, llr.radius);
-        squares.push_back(sq);
+    Member member;
+    member.cfgIndex = cfgIndex;
+    member.offset = uid; // Sign extended just like when it was added to the hash.
+    member.ranges = ranges;
+
+    configs.set(cfgIndex);
+    maxOffset = std::max(maxOffset, member.offset);
+
+    if (hashOn != UserPartition::RANDOM
+            && modulus > 0 && modulus <= MaxTabulatedModulus)
+    {
+        residues.resize(modulus);
+        tabulate(member, true);
     }
-    if ( ! squares.empty()){
-        squares_by_confindx[cfgIndex] = squares;
-        configs_with_filt.set(cfgIndex);
+
+    members.push_back(std::move(member));
+}
+
+void
+UserPartitionFilter::Group::
+remove(unsigned cfgIndex)
+{
+    auto it = find_if(members.begin(), members.end(), [&] (const Member& member) {
+                return member.cfgIndex == cfgIndex;
+            });
+    if (it == members.end()) return;
+
+    if (!residues.empty()) tabulate(*it, false);
+
+    members.erase(it);
+    configs.reset(cfgIndex);
+
+    maxOffset = 0;
+    for (const auto& member : members)
+        maxOffset = std::max(maxOffset, member.offset);
+}
+
+ConfigSet
+UserPartitionFilter::Group::
+filter(uint64_t hash) const
+{
+    if (!residues.empty() && hash <= ~uint64_t(0) - maxOffset)
+        return residues[hash % modulus];
+
+    ConfigSet result;
+
+    for (const auto& member : members) {
+        uint64_t value = hashOn == UserPartition::RANDOM ? random() : hash;
+        if (member.matches(value, modulus)) result.set(member.cfgIndex);
     }
+
+    return result;
 }
 
-void LatLongDevFilter::removeConfig(unsigned cfgIndex,
-        const std::shared_ptr<RTBKIT::AgentConfig>& config)
+
+/******************************************************************************/
+/* FREQUENCY CAP FILTER                                                       */
+/******************************************************************************/
+
+namespace {
+
+std::shared_ptr<const FrequencyCapStore> frequencyCapStore;
+
+} // namespace anonymous
+
+void
+FrequencyCapFilter::
+setStore(std::shared_ptr<const FrequencyCapStore> store)
+{
+    std::atomic_store(&frequencyCapStore, std::move(store));
+}
+
+std::shared_ptr<const FrequencyCapStore>
+FrequencyCapFilter::
+getStore()
 {
-    if ( squares_by_confindx.count(cfgIndex) > 0){
-        squares_by_confindx.erase(cfgIndex);
-        configs_with_filt.reset(cfgIndex);
+    return std::atomic_load(&frequencyCapStore);
+}
+
+void
+FrequencyCapFilter::
+setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
+{
+    if (config.frequencyCap <= 0.0) return;
+
+    string scope = config.account.toString();
+    auto& account = accounts[scope];
+    account.configs.set(cfgIndex, value);
+
+    if (value) account.caps[cfgIndex] = config.frequencyCap;
+    else {
+        account.caps.erase(cfgIndex);
+        if (account.caps.empty()) accounts.erase(scope);
     }
 }
 
-void LatLongDevFilter::filter(RTBKIT::FilterState& state) const
- {
-    RTBKIT::ConfigSet matches = state.configs();
-
-    auto it = squares_by_confindx.begin();
-    if ( ! checkLatLongPresent(state.request)){
-        // If there is no geo info the filter, then filter out all the
-        // agent configs that has this filter present.
-        state.narrowConfigs(configs_with_filt.negate());
-    } else {
-        // Filter using the lat long of the request and from the configs
-        // of the agents.
-        for ( ; it != squares_by_confindx.end(); ++it ){
-            if (pointInsideAnySquare(state.request.device->geo->lat.val,
-                    state.request.device->geo->lon.val, it->second)) {
-                continue;
-            }
-            matches.reset(it->first);
+void
+FrequencyCapFilter::
+filter(FilterState& state) const
+{
+    if (accounts.empty()) return;
+
+    auto store = getStore();
+    if (!store) return;
+
+    const Id& user = FrequencyCapStore::userOf(state.request.userIds);
+    if (!user) return;
+
+    Date now = Date::now();
+    ConfigSet mask;
+
+    for (const auto& entry : accounts) {
+        const Account& account = entry.second;
+        if ((state.configs() & account.configs).empty()) continue;
+
+        uint64_t key = FrequencyCapStore::keyOf(user, entry.first);
+        double count = store->count(key, now);
+        if (count < 1.0) continue;
+
+        for (const auto& cap : account.caps) {
+            if (count >= cap.second) mask.set(cap.first);
         }
-        state.narrowConfigs(matches);
     }
 
- }
+    state.narrowConfigs(mask.negate());
+}
+
 
-bool LatLongDevFilter::checkLatLongPresent(
-        const RTBKIT::BidRequest & req) const
+/******************************************************************************/
+/* BUDGET FILTER                                                              */
+/******************************************************************************/
+
+namespace {
+
+std::shared_ptr<const BudgetAvailability> budgetAvailability;
+
+} // namespace anonymous
+
+void
+BudgetFilter::
+setAvailability(std::shared_ptr<const BudgetAvailability> availability)
 {
-    if ( ! req.device) return false;
-    if ( ! req.device->geo) return false;
-    if ( req.device->geo->lat.val == std::numeric_limits<float>::quiet_NaN() ||
-         req.device->geo->lon.val == std::numeric_limits<float>::quiet_NaN() )
-        return false;
-    return true;
+    std::atomic_store(&budgetAvailability, std::move(availability));
 }
 
-bool
-LatLongDevFilter::pointInsideAnySquare(float lat, float lon,
-        const SquareList & squares)
+std::shared_ptr<const BudgetAvailability>
+BudgetFilter::
+getAvailability()
 {
-    const float y = lat * LATITUDE_1DEGREE_KMS;
-    const float x = lon * LONGITUDE_1DEGREE_KMS * cosInDegrees(lat);
-    for ( auto & sq : squares){
-        if (insideSquare(x, y , sq)) return true;
+    return std::atomic_load(&budgetAvailability);
+}
+
+void
+BudgetFilter::
+setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
+{
+    AccountKeyId id = config.accountKeyId();
+    auto& configs = accounts[id];
+    configs.set(cfgIndex, value);
+    if (configs.empty()) accounts.erase(id);
+}
+
+void
+BudgetFilter::
+filter(FilterState& state) const
+{
+    if (accounts.empty()) return;
+
+    auto availability = getAvailability();
+    if (!availability || !availability->numExhausted()) return;
+
+    ConfigSet mask;
+
+    for (const auto& entry : accounts) {
+        if (availability->available(entry.first)) continue;
+        mask |= entry.second;
     }
-    return false;
+
+    state.narrowConfigs(mask.negate());
 }
 
-} // namespace RTBKIT
 
 /******************************************************************************/
 /* INIT FILTERS                                                               */
@@ -328,6 +480,8 @@ struct AtInit {
         RTBKIT::FilterBase::registerFactory<RTBKIT::ExchangeNameFilter>();
         RTBKIT::FilterBase::registerFactory<RTBKIT::FoldPositionFilter>();
         RTBKIT::FilterBase::registerFactory<RTBKIT::RequiredIdsFilter>();
+        RTBKIT::FilterBase::registerFactory<RTBKIT::FrequencyCapFilter>();
+        RTBKIT::FilterBase::registerFactory<RTBKIT::BudgetFilter>();
         RTBKIT::FilterBase::registerFactory<RTBKIT::LatLongDevFilter>();
     }
 
@@ -10,7 +10,10 @@
 
 #include "generic_filters.h"
 #include "priority.h"
+#include "exchange_info_index.h"
 #include "rtbkit/common/exchange_connector.h"
+#include "rtbkit/common/budget_availability.h"
+#include "rtbkit/core/agent_configuration/frequency_cap.h"
 #include "jml/utils/compact_vector.h"
 
 #include <array>
@@ -41,7 +44,7 @@ private:
 
     struct SegmentData
     {
-        typedef ListFilter<std::string> ExchangeFilterT;
+        typedef InternedListFilter<> ExchangeFilterT;
         IncludeExcludeFilter<ExchangeFilterT> exchange;
 
         IncludeExcludeFilter<SegmentListFilter> ie;
@@ -70,28 +73,60 @@ struct UserPartitionFilter : public FilterBaseT<UserPartitionFilter>
 
 private:
 
-    struct FilterEntry
+    /** Configs that hash the same field of the request with the same modulus.
+
+        The partition of a request for a config is (hash + uid) % modulus
+        where only the uid depends on the config. So the hash is computed once
+        per field and, when the modulus is small enough, the configs that
+        include each value of hash % modulus are tabulated which turns the
+        whole group into a single lookup.
+     */
+    struct Group
     {
-        FilterEntry() : hashOn(UserPartition::NONE) {}
+        Group(UserPartition::HashOn hashOn, int modulus) :
+            hashOn(hashOn), modulus(modulus), maxOffset(0)
+        {}
 
-        IntervalFilter<int> filter;
-        ConfigSet excludeIfEmpty;
-        int modulus;
-        int uid;
         UserPartition::HashOn hashOn;
-    };
+        int modulus;
 
-    ConfigSet defaultSet;
-    std::unordered_map<uint64_t, FilterEntry> data;
+        // Configs that are excluded when the hashed field is empty.
+        ConfigSet configs;
 
-    uint64_t getKey(const UserPartition& obj, int uid) const
-    {
-        return uint64_t(uid) << 32 | uint64_t(obj.modulus) << 16 | uint64_t(obj.hashOn);
-    }
+        void add(unsigned cfgIndex, int uid,
+                const std::vector<UserPartition::Interval>& ranges);
+        void remove(unsigned cfgIndex);
+
+        ConfigSet filter(uint64_t hash) const;
+
+    private:
+
+        struct Member
+        {
+            unsigned cfgIndex;
+            uint64_t offset;
+            std::vector<UserPartition::Interval> ranges;
+
+            bool matches(uint64_t hash, int modulus) const;
+        };
+
+        void tabulate(const Member& member, bool value);
+
+        std::vector<Member> members;
 
-    std::pair<bool, uint64_t>
-    getValue(const BidRequest& br, const FilterEntry& entry) const;
+        // Indexed by hash % modulus; empty if the modulus is too large.
+        std::vector<ConfigSet> residues;
 
+        // Hashes above this wrap around when the offsets are added, which
+        // the table doesn't account for.
+        uint64_t maxOffset;
+    };
+
+    static std::pair<bool, uint64_t>
+    partitionHash(const BidRequest& br, UserPartition::HashOn hashOn);
+
+    ConfigSet defaultSet;
+    std::vector<Group> groups;
 };
 
 
@@ -121,6 +156,12 @@ struct HourOfWeekFilter : public FilterBaseT<HourOfWeekFilter>
         state.narrowConfigs(data[state.request.timestamp.hourOfWeek()]);
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        hash = hashField(hash, state.request.timestamp.hourOfWeek());
+        return true;
+    }
+
 private:
 
     std::array<ConfigSet, 24 * 7> data;
@@ -143,7 +184,13 @@ struct UrlFilter : public FilterBaseT<UrlFilter>
 
     void filter(FilterState& state) const
     {
-        state.narrowConfigs(impl.filter(state.request.url.toString()));
+        state.narrowConfigs(impl.filter(state.request.url.spec()));
+    }
+
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        hash = hashField(hash, state.request.url.spec());
+        return true;
     }
 
 private:
@@ -171,6 +218,13 @@ struct HostFilter : public FilterBaseT<HostFilter>
         state.narrowConfigs(impl.filter(state.request.url));
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        auto host = state.request.url.hostRange();
+        hash = hashField(hash, host.first, host.second);
+        return true;
+    }
+
 private:
     IncludeExcludeFilter< DomainFilter<std::string> > impl;
 };
@@ -195,6 +249,13 @@ struct LanguageFilter : public FilterBaseT<LanguageFilter>
         state.narrowConfigs(impl.filter(state.request.language.utf8String()));
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        const auto& language = state.request.language;
+        hash = hashField(hash, language.rawData(), language.rawLength());
+        return true;
+    }
+
 private:
     typedef RegexFilter<boost::regex, std::string> BaseFilter;
     IncludeExcludeFilter<BaseFilter> impl;
@@ -221,6 +282,13 @@ struct LocationFilter : public FilterBaseT<LocationFilter>
         state.narrowConfigs(impl.filter(location));
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        Datacratic::UnicodeString location = state.request.location.fullLocationString();
+        hash = hashField(hash, location.rawData(), location.rawLength());
+        return true;
+    }
+
 private:
     typedef RegexFilter<boost::u32regex, Datacratic::UnicodeString> BaseFilter;
     IncludeExcludeFilter<BaseFilter> impl;
@@ -231,16 +299,39 @@ private:
 /* EXCHANGE PRE/POST FILTER                                                   */
 /******************************************************************************/
 
-/** The lock makes it next to impossible to do any kind of pre-processing. */
-struct ExchangePreFilter : public IterativeFilter<ExchangePreFilter>
+/** The configs that the exchange accepted, along with their infos, are
+    indexed per exchange, and only the checks that depend on the request are
+    left to the exchange, in a single call for all the configs.  Until the
+    router has checked all the agents against the exchange, the exchange is
+    asked about each config separately.
+*/
+struct ExchangePreFilter : public ExchangeIndexedFilter<ExchangePreFilter>
 {
     static constexpr const char* name = "ExchangePre";
     unsigned priority() const { return Priority::ExchangePre; }
 
-    bool filterConfig(FilterState& state, const AgentConfig& config) const
+    void filter(FilterState& state) const
     {
-        if (!state.exchange) return false;
+        if (!state.exchange) {
+            state.narrowConfigs(ConfigSet());
+            return;
+        }
+
+        auto entry = index.get(*state.exchange, configs);
+        if (!entry) {
+            IterativeFilter<ExchangePreFilter>::filter(state);
+            return;
+        }
+
+        ConfigSet matches = state.configs();
+        matches &= entry->configs;
+        state.exchange->bidRequestPreFilterAll(
+                state.request, configs, entry->configInfos, matches);
+        state.narrowConfigs(matches);
+    }
 
+    bool filterConfig(FilterState& state, const AgentConfig& config) const
+    {
         auto it = config.providerData.find(state.exchange->exchangeName());
         if (it == config.providerData.end()) return false;
 
@@ -249,15 +340,33 @@ struct ExchangePreFilter : public IterativeFilter<ExchangePreFilter>
     }
 };
 
-struct ExchangePostFilter : public IterativeFilter<ExchangePostFilter>
+struct ExchangePostFilter : public ExchangeIndexedFilter<ExchangePostFilter>
 {
     static constexpr const char* name = "ExchangePost";
     unsigned priority() const { return Priority::ExchangePost; }
 
-    bool filterConfig(FilterState& state, const AgentConfig& config) const
+    void filter(FilterState& state) const
     {
-        if (!state.exchange) return false;
+        if (!state.exchange) {
+            state.narrowConfigs(ConfigSet());
+            return;
+        }
+
+        auto entry = index.get(*state.exchange, configs);
+        if (!entry) {
+            IterativeFilter<ExchangePostFilter>::filter(state);
+            return;
+        }
 
+        ConfigSet matches = state.configs();
+        matches &= entry->configs;
+        state.exchange->bidRequestPostFilterAll(
+                state.request, configs, entry->configInfos, matches);
+        state.narrowConfigs(matches);
+    }
+
+    bool filterConfig(FilterState& state, const AgentConfig& config) const
+    {
         auto it = config.providerData.find(state.exchange->exchangeName());
         if (it == config.providerData.end()) return false;
 
@@ -284,11 +393,17 @@ struct ExchangeNameFilter : public FilterBaseT<ExchangeNameFilter>
 
     void filter(FilterState& state) const
     {
-        state.narrowConfigs(data.filter(state.request.exchange));
+        state.narrowConfigs(data.filter(state.exchangeId()));
+    }
+
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        hash = hashField(hash, state.exchangeId());
+        return true;
     }
 
 private:
-    IncludeExcludeFilter< ListFilter<std::string> > data;
+    IncludeExcludeFilter< InternedListFilter<> > data;
 };
 
 
@@ -314,6 +429,13 @@ struct FoldPositionFilter : public FilterBaseT<FoldPositionFilter>
         }
     }
 
+    bool hashRequest(const FilterState& state, uint64_t& hash) const
+    {
+        for (const auto& imp : state.request.imp)
+            hash = hashField(hash, imp.position.val);
+        return true;
+    }
+
 private:
     IncludeExcludeFilter< ListFilter<OpenRTB::AdPosition> > impl;
 };
@@ -360,6 +482,67 @@ private:
 };
 
 
+/******************************************************************************/
+/* FREQUENCY CAP FILTER                                                       */
+/******************************************************************************/
+
+/** Filters out the configs whose account already won frequencyCap times on
+    the user of the request, according to the process' FrequencyCapStore.
+    Without a store, which the router only sets up when it's configured to,
+    nothing is filtered.
+ */
+struct FrequencyCapFilter : public FilterBaseT<FrequencyCapFilter>
+{
+    static constexpr const char* name = "FrequencyCap";
+    unsigned priority() const { return Priority::FrequencyCap; }
+
+    /** Store shared by the filters of every pool of the process. */
+    static void setStore(std::shared_ptr<const FrequencyCapStore> store);
+    static std::shared_ptr<const FrequencyCapStore> getStore();
+
+    void setConfig(unsigned cfgIndex, const AgentConfig& config, bool value);
+    void filter(FilterState& state) const;
+
+private:
+
+    struct Account
+    {
+        ConfigSet configs;
+        std::unordered_map<unsigned, double> caps;
+    };
+
+    std::unordered_map<std::string, Account> accounts;
+};
+
+
+/******************************************************************************/
+/* BUDGET FILTER                                                              */
+/******************************************************************************/
+
+/** Filters out the configs whose account is exhausted according to the
+    banker's BudgetAvailability, so that they aren't sent requests whose bids
+    would fail to be authorized.  Without a table, which the router gets from
+    its banker, nothing is filtered.
+ */
+struct BudgetFilter : public FilterBaseT<BudgetFilter>
+{
+    static constexpr const char* name = "Budget";
+    unsigned priority() const { return Priority::Budget; }
+
+    /** Table shared by the filters of every pool of the process. */
+    static void setAvailability(
+            std::shared_ptr<const BudgetAvailability> availability);
+    static std::shared_ptr<const BudgetAvailability> getAvailability();
+
+    void setConfig(unsigned cfgIndex, const AgentConfig& config, bool value);
+    void filter(FilterState& state) const;
+
+private:
+
+    std::unordered_map<AccountKeyId, ConfigSet> accounts;
+};
+
+
 struct LatLongDevFilter : public RTBKIT::FilterBaseT<LatLongDevFilter>
 {
     static constexpr const char* name = "latLongDevFilter";
@@ -380,6 +563,34 @@ struct LatLongDevFilter : public RTBKIT::FilterBaseT<LatLongDevFilter>
     std::unordered_map<unsigned, SquareList> squares_by_confindx;
     ConfigSet configs_with_filt;
 
+    /**
+     * The squares are indexed on a grid of cells of CELL_KMS a side, in the
+     * same coordinates as the squares, so that a request only looks at the
+     * squares around its point. The configs of the squares that cover a cell
+     * entirely are matched without any check, only the squares on the edge
+     * of a cell are checked.
+     */
+    static constexpr float CELL_KMS = 2.0;
+
+    /**
+     * Squares that would span more cells than this aren't put on the grid
+     * and are checked on every request instead.
+     */
+    enum { MAX_CELLS_PER_SQUARE = 4096 };
+
+    struct SquareEntry {
+        unsigned cfgIndex;
+        Square square;
+    };
+
+    struct Cell {
+        ConfigSet covered;
+        std::vector<SquareEntry> edges;
+    };
+
+    std::unordered_map<uint64_t, Cell> grid;
+    std::vector<SquareEntry> large_squares;
+
     unsigned priority() const { return Priority::LatLong; } //low priority
 
     static constexpr float LONGITUDE_1DEGREE_KMS = 111.321;
@@ -427,6 +638,24 @@ struct LatLongDevFilter : public RTBKIT::FilterBaseT<LatLongDevFilter>
     static bool pointInsideAnySquare(float lat, float lon,
             const SquareList & squares);
 
+    /**
+     * Add or remove the square of the given config from the grid.
+     */
+    void indexSquare(unsigned cfgIndex, const Square & sq, bool add);
+
+    /**
+     * Configs with a square that contains the point (x, y).
+     */
+    ConfigSet configsContaining(float x, float y) const;
+
+    /**
+     * Key of the cell of the grid which contains the point (x, y).
+     */
+    static uint64_t cellKey(int64_t cellX, int64_t cellY)
+    {
+        return (uint64_t(uint32_t(cellX)) << 32) | uint32_t(cellY);
+    }
+
     /**
      * Check if the given point defined by (x, y) is inside of the square
      * defined by the two edges (x_max,y_max) and (x_min, y_min).
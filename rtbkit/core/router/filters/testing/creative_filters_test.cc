@@ -307,5 +307,91 @@ BOOST_AUTO_TEST_CASE( testiPMPFilter )
     check(filter, r0, creatives, 1, { {2}, {2} });
     check(filter, r0, creatives, 2, { });
     check(filter, r0, creatives, 3, { {1}, {1} });
+
+    title("PMP-3");
+    addConfig(filter, 0, c0, creatives);
+
+    check(filter, r0, creatives, 2, { {0},    {0},      {0}    });
+    check(filter, r0, creatives, 3, { {0, 1}, {0, 1},   {0}    });
 }
 
+
+
+/******************************************************************************/
+/* CREATIVE EXCHANGE FILTER                                                   */
+/******************************************************************************/
+
+namespace {
+
+// Accepts the creatives whose info is true.
+struct CreativeInfoExchange : public FilterExchangeConnector
+{
+    CreativeInfoExchange() : FilterExchangeConnector("bob") {}
+
+    bool bidRequestCreativeFilter(
+            const BidRequest&, const AgentConfig&, const void* info) const
+    {
+        return *static_cast<const bool*>(info);
+    }
+};
+
+void setInfo(AgentConfig& cfg, size_t crId, bool accept)
+{
+    cfg.creatives[crId].providerData["bob"] = std::make_shared<bool>(accept);
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( testCreativeExchangeFilter )
+{
+    CreativeExchangeFilter filter;
+    CreativeMatrix creatives;
+    CreativeInfoExchange conn;
+
+    AgentConfig c0;
+    c0.creatives.push_back(Creative(100, 100));
+    c0.creatives.push_back(Creative(100, 100));
+    c0.creatives.push_back(Creative(100, 100));
+    setInfo(c0, 0, true);
+    setInfo(c0, 1, false);  // creative 2 isn't compatible with the exchange
+
+    AgentConfig c1;
+    c1.creatives.push_back(Creative(100, 100));
+    c1.creatives.push_back(Creative(100, 100));
+    setInfo(c1, 0, true);
+    setInfo(c1, 1, true);
+
+    AgentConfig c2;
+    c2.creatives.push_back(Creative(100, 100));
+    setInfo(c2, 0, true);
+
+    BidRequest r0;
+    addImp(r0, OpenRTB::AdPosition::ABOVE, { {100, 100} });
+
+    auto doCheck = [&] (const std::vector< std::vector<size_t> >& expected) {
+        FilterState state(r0, &conn, creatives);
+        filter.filter(state);
+        check(state.creatives(0), expected);
+    };
+
+    addConfig(filter, 0, c0, creatives);
+    addConfig(filter, 1, c1, creatives);
+    addConfig(filter, 2, c2, creatives);
+
+    // Until the router checked the agents, each creative is looked up
+    title("exchange-1");
+    doCheck({ {0, 1, 2}, {1} });
+
+    // The same result from the index of the compatible creatives
+    title("exchange-2");
+    conn.compatibilityGeneration = 1;
+    doCheck({ {0, 1, 2}, {1} });
+
+    title("exchange-3");
+    removeConfig(filter, 1, c1, creatives);
+    doCheck({ {0, 2} });
+
+    title("exchange-4");
+    addConfig(filter, 1, c1, creatives);
+    doCheck({ {0, 1, 2}, {1} });
+}
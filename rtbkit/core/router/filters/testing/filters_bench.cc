@@ -0,0 +1,358 @@
+/** filters_bench.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Times FilterPool::filter for each filter on its own, against synthetic
+    agent configs and the bid requests of the router's auction corpus.
+
+    Prints the time and the number of allocations per request so that changes
+    to the filters can be compared against a baseline.
+
+*/
+
+#include "rtbkit/core/router/filter_pool.h"
+#include "rtbkit/core/router/router_types.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/bid_request.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* ALLOCATIONS                                                                */
+/******************************************************************************/
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+} // namespace anonymous
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        auctions("rtbkit/core/router/testing/20000-datacratic-auctions.xz"),
+        requests(2000),
+        passes(5),
+        batch(0)
+    {}
+
+    string auctions;
+    size_t requests;
+    size_t passes;
+    size_t batch;
+    vector<size_t> configs;
+    vector<string> filters;
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt("Bench options");
+    opt.add_options()
+        ("auctions,a", value<string>(&config.auctions),
+         "file of canonical bid requests, one per line")
+        ("requests,r", value<size_t>(&config.requests),
+         "number of bid requests to load from the file")
+        ("passes,p", value<size_t>(&config.passes),
+         "number of times the requests are filtered")
+        ("batch,b", value<size_t>(&config.batch),
+         "filter the requests in batches of this size; 0 filters them one by one")
+        ("configs,c", value< vector<size_t> >(&config.configs)->multitoken(),
+         "number of agent configs; defaults to 100 1000 10000")
+        ("filter,f", value< vector<string> >(&config.filters)->multitoken(),
+         "filters to bench; defaults to all of them")
+        ("help,h", "print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    if (config.configs.empty()) config.configs = { 100, 1000, 10000 };
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* REQUESTS                                                                   */
+/******************************************************************************/
+
+/** The corpus has neither device geo nor deals so those are made up, the
+    same way for every run.
+ */
+vector< shared_ptr<BidRequest> >
+loadRequests(const Config& config, mt19937& rng)
+{
+    vector< shared_ptr<BidRequest> > requests;
+
+    filter_istream stream(config.auctions);
+
+    uniform_real_distribution<float> lat(25.0, 49.0);
+    uniform_real_distribution<float> lon(-124.0, -67.0);
+
+    while (stream && requests.size() < config.requests) {
+        string line;
+        getline(stream, line);
+        if (line.empty()) continue;
+
+        shared_ptr<BidRequest> br(BidRequest::parse("datacratic", line));
+
+        br->device.emplace();
+        br->device->geo.emplace();
+        br->device->geo->lat.val = lat(rng);
+        br->device->geo->lon.val = lon(rng);
+
+        for (auto& imp : br->imp) {
+            if (rng() % 2) continue;
+
+            OpenRTB::PMP pmp;
+            pmp.privateAuction = 1;
+            for (size_t i = 0; i < 2; ++i) {
+                OpenRTB::Deal deal;
+                deal.id = Datacratic::Id("deal" + to_string(rng() % 100));
+                pmp.deals.push_back(deal);
+            }
+            imp.pmp.emplace(pmp);
+        }
+
+        requests.push_back(br);
+    }
+
+    if (requests.empty())
+        throw ML::Exception("no bid requests in %s", config.auctions.c_str());
+
+    return requests;
+}
+
+
+/******************************************************************************/
+/* BENCHES                                                                    */
+/******************************************************************************/
+
+struct Bench
+{
+    string filter;
+    function<void(AgentConfig&, mt19937&)> makeConfig;
+};
+
+vector<Bench>
+makeBenches(const vector< shared_ptr<BidRequest> >& requests)
+{
+    vector<string> hosts;
+    {
+        set<string> uniques;
+        for (const auto& br : requests) {
+            if (br->url.empty()) continue;
+            uniques.insert(br->url.host());
+        }
+        hosts.assign(uniques.begin(), uniques.end());
+    }
+    if (hosts.empty()) hosts.push_back("www.example.com");
+
+    auto host = [=] (mt19937& rng) { return hosts[rng() % hosts.size()]; };
+
+    const vector<Format> formats = {
+        { 300, 250 }, { 728, 90 }, { 160, 600 }, { 320, 50 }, { 300, 600 },
+        { 468, 60 }
+    };
+
+    return {
+        { "Url", [=] (AgentConfig& config, mt19937& rng) {
+                config.urlFilter.include.emplace_back(host(rng) + "/");
+                config.urlFilter.include.emplace_back(
+                        "/(news|sports)/" + to_string(rng() % 1000));
+                config.urlFilter.exclude.emplace_back(
+                        "site" + to_string(rng() % 1000) + "\\.com");
+            }},
+
+        { "Host", [=] (AgentConfig& config, mt19937& rng) {
+                config.hostFilter.include.emplace_back(host(rng));
+                config.hostFilter.include.emplace_back(
+                        "site" + to_string(rng() % 1000) + ".com");
+            }},
+
+        { "Segments", [=] (AgentConfig& config, mt19937& rng) {
+                auto& info = config.segments["adxVerticals"];
+                for (size_t i = 0; i < 5; ++i)
+                    info.include.add(int(rng() % 1000));
+                info.include.sort();
+            }},
+
+        { "LatLongDev", [=] (AgentConfig& config, mt19937& rng) {
+                uniform_real_distribution<float> lat(25.0, 49.0);
+                uniform_real_distribution<float> lon(-124.0, -67.0);
+                uniform_real_distribution<float> radius(1.0, 50.0);
+
+                for (size_t i = 0; i < 3; ++i) {
+                    config.latLongDevFilter.latlonrads.emplace_back(
+                            lat(rng), lon(rng), radius(rng));
+                }
+            }},
+
+        { "HourOfWeek", [=] (AgentConfig& config, mt19937& rng) {
+                auto& bitmap = config.hourOfWeekFilter.hourBitmap;
+                for (size_t i = 0; i < bitmap.size(); ++i)
+                    bitmap[i] = rng() % 2;
+            }},
+
+        { "CreativeFormat", [=] (AgentConfig& config, mt19937& rng) {
+                config.creatives.clear();
+                for (size_t i = rng() % 3; i < 3; ++i) {
+                    const Format& format = formats[rng() % formats.size()];
+                    config.creatives.emplace_back(format.width, format.height);
+                }
+            }},
+
+        { "CreativePMP", [=] (AgentConfig& config, mt19937& rng) {
+                for (auto& creative : config.creatives) {
+                    if (rng() % 3 == 0) continue;
+                    creative.dealId = "deal" + to_string(rng() % 100);
+                }
+            }},
+    };
+}
+
+
+/******************************************************************************/
+/* RUN                                                                        */
+/******************************************************************************/
+
+void run(
+        const Config& config,
+        const Bench& bench,
+        size_t numConfigs,
+        const vector< shared_ptr<BidRequest> >& requests)
+{
+    mt19937 rng(numConfigs);
+
+    FilterPool pool;
+    pool.addFilter(bench.filter);
+
+    vector<AgentInfo> infos(numConfigs);
+    vector< pair<string, const AgentInfo*> > added;
+
+    for (size_t i = 0; i < numConfigs; ++i) {
+        auto agent = make_shared<AgentConfig>();
+        agent->creatives.emplace_back(300, 250);
+        bench.makeConfig(*agent, rng);
+
+        infos[i].config = agent;
+        added.emplace_back("agent" + to_string(i), &infos[i]);
+    }
+
+    pool.updateConfigs({}, added);
+
+    vector< vector<FilterPool::BatchEntry> > batches;
+    if (config.batch) {
+        for (size_t i = 0; i < requests.size(); i += config.batch) {
+            batches.emplace_back();
+            size_t end = min(i + config.batch, requests.size());
+            for (size_t j = i; j < end; ++j)
+                batches.back().emplace_back(requests[j].get(), nullptr);
+        }
+    }
+
+    auto filterAll = [&] {
+        size_t matched = 0;
+
+        if (batches.empty()) {
+            for (const auto& br : requests)
+                matched += pool.filter(*br, nullptr).size();
+        }
+        else {
+            for (const auto& batch : batches) {
+                for (const auto& result : pool.filterBatch(batch))
+                    matched += result.size();
+            }
+        }
+
+        return matched;
+    };
+
+    // Warms up the caches and the allocator.
+    filterAll();
+
+    size_t matched = 0;
+    uint64_t allocStart = allocations.load();
+    auto start = chrono::steady_clock::now();
+
+    for (size_t pass = 0; pass < config.passes; ++pass)
+        matched += filterAll();
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    uint64_t allocs = allocations.load() - allocStart;
+
+    double filtered = config.passes * requests.size();
+    double ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+    printf("%-16s %6zu configs %10.0f ns/req %8.2f allocs/req %8.2f matched/req\n",
+            bench.filter.c_str(), numConfigs,
+            ns / filtered, allocs / filtered, matched / filtered);
+}
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+
+    mt19937 rng(0);
+    auto requests = loadRequests(config, rng);
+    cerr << "loaded " << requests.size() << " bid requests" << endl;
+
+    for (const Bench& bench : makeBenches(requests)) {
+        if (!config.filters.empty()) {
+            auto it = find(config.filters.begin(), config.filters.end(), bench.filter);
+            if (it == config.filters.end()) continue;
+        }
+
+        for (size_t numConfigs : config.configs)
+            run(config, bench, numConfigs, requests);
+    }
+
+    return 0;
+}
@@ -11,3 +11,4 @@ $(eval $(call test,static_filters_test,static_filters,boost))
 $(eval $(call test,creative_filters_test,static_filters,boost))
 
 
+$(eval $(call program,filters_bench,rtb_router static_filters bid_request boost_program_options))
@@ -72,6 +72,89 @@ BOOST_AUTO_TEST_CASE(listFilterTest)
     check(filter.filter(7), {  });
 }
 
+BOOST_AUTO_TEST_CASE(internedListFilterTest)
+{
+    InternedListFilter<> filter;
+    auto& dictionary = StringDictionary::global();
+
+    title("interned-1");
+    filter.addConfig(0, { "a", "b" });
+    filter.addConfig(1, { "b", "c" });
+
+    check(filter.filter("a"), { 0 });
+    check(filter.filter("b"), { 0, 1 });
+    check(filter.filter(dictionary.find("c")), { 1 });
+    check(filter.filter("d"), {  });
+    check(filter.filter(StringDictionary::Id(StringDictionary::NoId)), {  });
+
+    // Strings only make it in the dictionary once a config uses them.
+    BOOST_CHECK_EQUAL(dictionary.find("d"), unsigned(StringDictionary::NoId));
+    BOOST_CHECK_EQUAL(dictionary.intern("b"), dictionary.find("b"));
+
+    title("interned-2");
+    filter.removeConfig(0, { "a", "b" });
+
+    check(filter.filter("a"), {  });
+    check(filter.filter("b"), { 1 });
+
+    // Ids interned by other filters past the end of the vector match nothing.
+    dictionary.intern("interned-list-filter-test");
+    check(filter.filter("interned-list-filter-test"), {  });
+}
+
+BOOST_AUTO_TEST_CASE(tagExpressionFilterTest)
+{
+    auto makeTags = [] (const initializer_list<string>& values) {
+        Tags tags;
+        for (const auto& value : values) tags.add(Tag("test", "k", value));
+        return tags;
+    };
+
+    TagFilter oneOfAB;
+    oneOfAB.mustIncludeOneOf = makeTags({ "a", "b" });
+
+    TagFilter allOfCD;
+    allOfCD.mustIncludeAllOf = makeTags({ "c", "d" });
+    allOfCD.mustNotIncludeAnyOf = makeTags({ "e" });
+
+    TagFilterExpression expr0;
+    expr0.push_back(oneOfAB);
+
+    TagFilterExpression expr1;
+    expr1.push_back(allOfCD);
+    expr1.push_back(oneOfAB);
+
+    TagExpressionFilter filter;
+
+    BOOST_CHECK(filter.isEmpty({ }));
+    BOOST_CHECK(!filter.isEmpty(expr0));
+
+    title("tags-1");
+    filter.addConfig(0, expr0);
+    filter.addConfig(1, expr1);
+    filter.addConfig(2, { });
+
+    check(filter.filter(makeTags({ })), { 2 });
+    check(filter.filter(makeTags({ "a" })), { 0, 1, 2 });
+    check(filter.filter(makeTags({ "c" })), { 2 });
+    check(filter.filter(makeTags({ "c", "d" })), { 1, 2 });
+    check(filter.filter(makeTags({ "c", "d", "e" })), { 2 });
+    check(filter.filter(makeTags({ "b", "c", "d", "e" })), { 0, 1, 2 });
+
+    title("tags-2");
+    filter.removeConfig(1, expr1);
+    filter.removeConfig(2, { });
+
+    check(filter.filter(makeTags({ "c", "d" })), { });
+    check(filter.filter(makeTags({ "b" })), { 0 });
+
+    // Tags are interned once and keep their bit.
+    Tag tag("test", "k", "a");
+    BOOST_CHECK_EQUAL(TagDictionary::intern(tag), TagDictionary::intern(tag));
+    BOOST_CHECK(TagDictionary::get(TagDictionary::intern(tag)) == tag);
+    BOOST_CHECK_EQUAL(makeTags({ "a", "b" }).toTags().size(), 2);
+}
+
 BOOST_AUTO_TEST_CASE(intervalFilterTest)
 {
     auto range = [] (size_t first, size_t last) {
@@ -219,6 +302,80 @@ BOOST_AUTO_TEST_CASE(regexFilterTest)
     check(filter.filter("d"),   { });
 }
 
+BOOST_AUTO_TEST_CASE(requiredLiteralTest)
+{
+    BOOST_CHECK_EQUAL(requiredLiteral("abc"), "abc");
+    BOOST_CHECK_EQUAL(requiredLiteral("^ab+c"), "ab");
+    BOOST_CHECK_EQUAL(requiredLiteral("a.b*cd"), "cd");
+    BOOST_CHECK_EQUAL(requiredLiteral("foo\\.com/"), "foo.com/");
+    BOOST_CHECK_EQUAL(requiredLiteral("x(abc)*yz"), "yz");
+    BOOST_CHECK_EQUAL(requiredLiteral("ab{2,3}cd"), "cd");
+    BOOST_CHECK_EQUAL(requiredLiteral("ab[c-f]+gh"), "ab");
+    BOOST_CHECK_EQUAL(requiredLiteral("\\x41BCD"), "BCD");
+    BOOST_CHECK_EQUAL(requiredLiteral("\\d+abc\\w"), "abc");
+
+    BOOST_CHECK_EQUAL(requiredLiteral("a|bc"), "");
+    BOOST_CHECK_EQUAL(requiredLiteral("(?i)abc"), "");
+    BOOST_CHECK_EQUAL(requiredLiteral(".*"), "");
+
+    bool exact;
+    BOOST_CHECK_EQUAL(requiredLiteral("foo\\.com", &exact), "foo.com");
+    BOOST_CHECK(exact);
+    BOOST_CHECK_EQUAL(requiredLiteral("^foo\\.com", &exact), "foo.com");
+    BOOST_CHECK(!exact);
+    BOOST_CHECK_EQUAL(requiredLiteral("foo\\.co+", &exact), "foo.co");
+    BOOST_CHECK(!exact);
+}
+
+BOOST_AUTO_TEST_CASE(regexFilterManyTest)
+{
+    using boost::regex;
+    RegexFilter<regex, string> filter;
+
+    vector<regex> regexes;
+    for (size_t i = 0; i < 200; ++i) {
+        string n = to_string(i);
+        regexes.emplace_back("site" + n + "\\.com");
+        regexes.emplace_back("^http://[a-z]+\\.page" + n + "/");
+        regexes.emplace_back("(news|blog)" + n);
+    }
+
+    vector<bool> active(regexes.size(), true);
+    for (size_t i = 0; i < regexes.size(); ++i)
+        filter.addConfig(i, makeList({ regexes[i] }));
+
+    // Compares with evaluating every regex.
+    auto checkAll = [&] (const string& str) {
+        ConfigSet expected;
+        for (size_t i = 0; i < regexes.size(); ++i) {
+            if (active[i] && boost::regex_search(str, regexes[i]))
+                expected.set(i);
+        }
+
+        ConfigSet diff = filter.filter(str);
+        diff ^= expected;
+        BOOST_CHECK_MESSAGE(diff.empty(), str + ": " + diff.print());
+    };
+
+    const vector<string> strings = {
+        "http://www.site12.com/",
+        "http://www.page42/site7.com",
+        "http://blog199.org/site199.com",
+        "http://site1.com/news1",
+        "nothing to see here",
+    };
+
+    title("regex-many-1");
+    for (const auto& str : strings) checkAll(str);
+
+    title("regex-many-2");
+    for (size_t i = 0; i < regexes.size(); i += 2) {
+        filter.removeConfig(i, makeList({ regexes[i] }));
+        active[i] = false;
+    }
+    for (const auto& str : strings) checkAll(str);
+}
+
 BOOST_AUTO_TEST_CASE(segmentListTest)
 {
     SegmentListFilter filter;
@@ -258,6 +415,71 @@ BOOST_AUTO_TEST_CASE(segmentListTest)
     check(filter.filter(seg2),     { 0, 1 });
 }
 
+BOOST_AUTO_TEST_CASE(segmentListManyTest)
+{
+    SegmentListFilter filter;
+
+    vector<SegmentList> configs;
+    for (int i = 0; i < 300; ++i) {
+        SegmentList seg;
+        for (int j = 0; j < 5; ++j) seg.add(i * 7 + j * 101);
+        seg.add("s" + to_string(i % 50));
+        seg.sort();
+        configs.push_back(seg);
+    }
+
+    vector<bool> active(configs.size(), true);
+    for (size_t i = 0; i < configs.size(); ++i)
+        filter.addConfig(i, configs[i]);
+
+    // Compares with matching every segment list.
+    auto checkAll = [&] (const SegmentList& segments) {
+        SegmentList sorted = segments;
+        sorted.sort();
+
+        ConfigSet expected;
+        for (size_t i = 0; i < configs.size(); ++i) {
+            if (active[i] && configs[i].match(sorted))
+                expected.set(i);
+        }
+
+        ConfigSet diff = filter.filter(segments);
+        diff ^= expected;
+        BOOST_CHECK_MESSAGE(diff.empty(), segments.toString() + ": " + diff.print());
+    };
+
+    auto makeSegments = [] (int first, int count, int step) {
+        SegmentList seg;
+        for (int i = 0; i < count; ++i) seg.add(first + i * step);
+        seg.sort();
+        return seg;
+    };
+
+    vector<SegmentList> requests = {
+        makeSegments(0, 1, 1),
+        makeSegments(101, 3, 7),
+        makeSegments(0, 100, 13),
+        makeSegments(-50, 5000, 1),
+        segment(707, "s3"),
+        segment("s49", "nope"),
+    };
+
+    // Requests aren't guaranteed to have been sorted.
+    SegmentList unsorted;
+    unsorted.ints = { 2000, 5, 1404, 101, 3 };
+    requests.push_back(unsorted);
+
+    title("segment-many-1");
+    for (const auto& segments : requests) checkAll(segments);
+
+    title("segment-many-2");
+    for (size_t i = 0; i < configs.size(); i += 3) {
+        filter.removeConfig(i, configs[i]);
+        active[i] = false;
+    }
+    for (const auto& segments : requests) checkAll(segments);
+}
+
 BOOST_AUTO_TEST_CASE(includeExcludeFilterTest)
 {
     typedef ListFilter<size_t> BaseFilterT;
@@ -463,6 +463,61 @@ BOOST_AUTO_TEST_CASE( userPartition )
     doCheck(r7, "ex1", { 2 });
 }
 
+/** Small moduli are looked up in a table while large ones are computed for
+    each config. Since (h % 2048) % 16 == h % 16, a config on a modulus of 16
+    must always agree with its twin on a modulus of 2048 whose ranges cover
+    the same residues.
+ */
+BOOST_AUTO_TEST_CASE( userPartitionTabulated )
+{
+    enum { Small = 16, Large = 2048, Pairs = 100 };
+
+    UserPartitionFilter filter;
+    vector<AgentConfig> configs(Pairs * 2);
+
+    for (size_t i = 0; i < Pairs; ++i) {
+        int first = random() % Small;
+        int last = first + 1 + random() % (Small - first);
+
+        AgentConfig& small = configs[i * 2];
+        small.externalId = random() % 100000;
+        small.userPartition.hashOn = UserPartition::EXCHANGEID;
+        small.userPartition.modulus = Small;
+        small.userPartition.includeRanges.clear();
+        small.userPartition.includeRanges.emplace_back(first, last);
+
+        AgentConfig& large = configs[i * 2 + 1];
+        large.externalId = small.externalId;
+        large.userPartition.hashOn = UserPartition::EXCHANGEID;
+        large.userPartition.modulus = Large;
+        large.userPartition.includeRanges.clear();
+        for (int base = 0; base < Large; base += Small)
+            large.userPartition.includeRanges.emplace_back(base + first, base + last);
+
+        addConfig(filter, i * 2, small);
+        addConfig(filter, i * 2 + 1, large);
+    }
+
+    CreativeMatrix active;
+    for (size_t i = 0; i < configs.size(); ++i) active.setConfig(i, 1);
+
+    FilterExchangeConnector conn("ex1");
+
+    for (size_t i = 0; i < 1000; ++i) {
+        BidRequest request;
+        request.exchange = "ex1";
+        request.imp.emplace_back();
+        request.userIds.exchangeId = Id(random());
+
+        FilterState state(request, &conn, active);
+        filter.filter(state);
+
+        ConfigSet result = state.configs();
+        for (size_t j = 0; j < Pairs; ++j)
+            BOOST_CHECK_EQUAL(result[j * 2], result[j * 2 + 1]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE( exchangeName )
 {
     ExchangeNameFilter filter;
@@ -567,6 +622,46 @@ BOOST_AUTO_TEST_CASE( requiredIds )
     doCheck(r5, "ex1", { });
 }
 
+BOOST_AUTO_TEST_CASE( budget )
+{
+    BudgetFilter filter;
+    ConfigSet mask;
+
+    auto doCheck = [&] (
+            BidRequest& request,
+            const initializer_list<size_t>& expected)
+    {
+        check(filter, request, "ex1", mask, expected);
+    };
+
+    AgentConfig c0; c0.account = { "budget", "a" };
+    AgentConfig c1; c1.account = { "budget", "a" };
+    AgentConfig c2; c2.account = { "budget", "b" };
+
+    BidRequest r0;
+
+    addConfig(filter, 0, c0); mask.set(0);
+    addConfig(filter, 1, c1); mask.set(1);
+    addConfig(filter, 2, c2); mask.set(2);
+
+    title("budget-1");
+    doCheck(r0, { 0, 1, 2 });
+
+    auto availability = std::make_shared<BudgetAvailability>();
+    BudgetFilter::setAvailability(availability);
+
+    title("budget-2");
+    availability->setAvailable(c0.accountKeyId(), false);
+    doCheck(r0, { 2 });
+
+    title("budget-3");
+    availability->setAvailable(c2.accountKeyId(), false);
+    availability->setAvailable(c0.accountKeyId(), true);
+    doCheck(r0, { 0, 1 });
+
+    BudgetFilter::setAvailability(nullptr);
+}
+
 /**
  * Check these cases:
  * - No configuration of the filter -> should pass
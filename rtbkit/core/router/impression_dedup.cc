@@ -0,0 +1,197 @@
+/** impression_dedup.cc
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Detection of the same impression reaching the router through several
+    exchanges.
+
+*/
+
+#include "impression_dedup.h"
+#include "jml/arch/exception.h"
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+
+namespace RTBKIT {
+
+namespace {
+
+ImpressionDedup::Field parseField(const std::string & name)
+{
+    if (name == "ip") return ImpressionDedup::IP;
+    if (name == "userAgent") return ImpressionDedup::USER_AGENT;
+    if (name == "ifa") return ImpressionDedup::IFA;
+    if (name == "site") return ImpressionDedup::SITE;
+    if (name == "url") return ImpressionDedup::URL;
+    if (name == "tagId") return ImpressionDedup::TAG_ID;
+    if (name == "sizes") return ImpressionDedup::SIZES;
+    throw ML::Exception("unknown impression dedup field '%s'", name.c_str());
+}
+
+uint64_t combine(uint64_t hash, const std::string & value)
+{
+    return Hash128to64(make_pair(hash, CityHash64(value.c_str(),
+                                                  value.length())));
+}
+
+uint64_t combine(uint64_t hash, uint64_t value)
+{
+    return Hash128to64(make_pair(hash, value));
+}
+
+} // file scope
+
+
+/******************************************************************************/
+/* IMPRESSION DEDUP                                                           */
+/******************************************************************************/
+
+ImpressionDedup::
+ImpressionDedup(const Json::Value & config)
+    : window(0.1),
+      fields({ IP, USER_AGENT, SITE, SIZES })
+{
+    if (config.isMember("window")) {
+        window = config["window"].asDouble();
+        if (window <= 0)
+            throw ML::Exception("impression dedup window must be positive");
+    }
+
+    if (config.isMember("fields")) {
+        const Json::Value & names = config["fields"];
+        if (!names.isArray() || names.empty())
+            throw ML::Exception("impression dedup fields must be an array "
+                                "of field names");
+        fields.clear();
+        for (unsigned i = 0;  i < names.size();  ++i)
+            fields.push_back(parseField(names[i].asString()));
+    }
+
+    if (config.isMember("exchangePriority")) {
+        const Json::Value & priorities = config["exchangePriority"];
+        for (auto it = priorities.begin(), end = priorities.end();
+             it != end;  ++it)
+            exchangePriority[it.memberName()] = (*it).asInt();
+    }
+}
+
+uint64_t
+ImpressionDedup::
+fingerprint(const BidRequest & request) const
+{
+    uint64_t result = 0;
+
+    for (Field field: fields) {
+        switch (field) {
+        case IP:
+            if (request.ipAddress.empty()) return 0;
+            result = combine(result, request.ipAddress);
+            break;
+
+        case USER_AGENT:
+            if (request.userAgent.empty()) return 0;
+            result = combine(result, request.userAgent.rawString());
+            break;
+
+        case IFA:
+            if (!request.device || request.device->ifa.empty()) return 0;
+            result = combine(result, request.device->ifa);
+            break;
+
+        case SITE:
+            if (request.site && !request.site->domain.empty())
+                result = combine(result, request.site->domain.rawString());
+            else if (request.app && !request.app->bundle.empty())
+                result = combine(result, request.app->bundle.rawString());
+            else return 0;
+            break;
+
+        case URL:
+            if (request.url.empty()) return 0;
+            result = combine(result, request.url.spec());
+            break;
+
+        case TAG_ID:
+            for (const auto & spot: request.imp) {
+                if (spot.tagid.empty()) return 0;
+                result = combine(result, spot.tagid.rawString());
+            }
+            break;
+
+        case SIZES:
+            for (const auto & spot: request.imp) {
+                if (spot.formats.empty()) return 0;
+                for (const auto & format: spot.formats)
+                    result = combine(result,
+                                     uint64_t(uint16_t(format.width)) << 16
+                                     | uint16_t(format.height));
+            }
+            break;
+        }
+    }
+
+    // Keep 0 to mean that the request can't be fingerprinted
+    return result ? result : 1;
+}
+
+int
+ImpressionDedup::
+priority(const std::string & exchange) const
+{
+    auto it = exchangePriority.find(exchange);
+    return it == exchangePriority.end() ? 0 : it->second;
+}
+
+bool
+ImpressionDedup::
+admit(const BidRequest & request, Date now)
+{
+    uint64_t print = fingerprint(request);
+    if (!print)
+        return true;
+    return admit(print, priority(request.exchange), now);
+}
+
+bool
+ImpressionDedup::
+admit(uint64_t fingerprint, int priority, Date now)
+{
+    int64_t epoch = std::floor(now.secondsSinceEpoch() / window);
+
+    Shard & shard = shards[(fingerprint >> 32) % NumShards];
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    if (epoch > shard.epoch) {
+        if (epoch == shard.epoch + 1)
+            shard.previous.swap(shard.current);
+        else shard.previous.clear();
+        shard.current.clear();
+        shard.epoch = epoch;
+    }
+
+    // The best priority seen for the fingerprint in either window
+    auto it = shard.current.find(fingerprint);
+    if (it != shard.current.end() && it->second >= priority)
+        return false;
+    auto jt = shard.previous.find(fingerprint);
+    if (jt != shard.previous.end() && jt->second >= priority)
+        return false;
+
+    shard.current[fingerprint] = priority;
+    return true;
+}
+
+size_t
+ImpressionDedup::
+size() const
+{
+    size_t result = 0;
+    for (const Shard & shard: shards) {
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        result += shard.current.size() + shard.previous.size();
+    }
+    return result;
+}
+
+} // namespace RTBKIT
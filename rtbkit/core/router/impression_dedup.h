@@ -0,0 +1,106 @@
+/** impression_dedup.h                                            -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Detection of the same impression reaching the router through several
+    exchanges.
+
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request.h"
+#include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* IMPRESSION DEDUP                                                           */
+/******************************************************************************/
+
+/** Recognizes the copies of an impression that several supply paths send us
+    within a few milliseconds of each other, so that only one of them is
+    augmented and bid on.
+
+    Requests are identified by a fingerprint of the configured fields.  A
+    request that is missing one of them is never considered a duplicate,
+    since its fingerprint would match unrelated requests.  Fingerprints are
+    kept for between one and two windows: each shard holds the ones seen in
+    the current window and in the previous one, and drops the previous ones
+    when a new window starts.
+
+    The first copy seen goes through.  A later copy is dropped unless it
+    comes from an exchange with a higher priority than every copy seen
+    before it, as the earlier ones may already be augmenting and can't be
+    called back.
+
+    Configuration:
+
+        {
+            "window": 0.1,                  // seconds
+            "fields": [ "ip", "userAgent", "site", "sizes" ],
+            "exchangePriority": { "rubicon": 1, "bidswitch": 0 }
+        }
+
+    The fields are "ip", "userAgent", "ifa" (advertising id of the device),
+    "site" (site domain or app bundle), "url", "tagId" and "sizes" (of all
+    the impressions).  Exchanges have priority 0 unless configured.
+*/
+struct ImpressionDedup {
+
+    enum { NumShards = 16 };
+
+    enum Field {
+        IP,
+        USER_AGENT,
+        IFA,
+        SITE,
+        URL,
+        TAG_ID,
+        SIZES
+    };
+
+    ImpressionDedup(const Json::Value & config = Json::Value());
+
+    ImpressionDedup(const ImpressionDedup &) = delete;
+    ImpressionDedup & operator = (const ImpressionDedup &) = delete;
+
+    double window;                      ///< Seconds
+    std::vector<Field> fields;
+    std::map<std::string, int> exchangePriority;
+
+    /** Fingerprint of the request, or 0 if one of the fields is missing. */
+    uint64_t fingerprint(const BidRequest & request) const;
+
+    /** Priority of the exchange that sent the request. */
+    int priority(const std::string & exchange) const;
+
+    /** Return whether the request should be auctioned, and remember it if
+        so.  Thread-safe.
+    */
+    bool admit(const BidRequest & request, Date now = Date::now());
+
+    bool admit(uint64_t fingerprint, int priority, Date now);
+
+    /** Number of fingerprints currently kept. */
+    size_t size() const;
+
+private:
+    struct Shard {
+        Shard() : epoch(0) {}
+
+        mutable ML::Spinlock lock;
+        int64_t epoch;                  ///< Window of current
+        std::unordered_map<uint64_t, int> current;
+        std::unordered_map<uint64_t, int> previous;
+    } JML_ALIGNED(64);
+
+    Shard shards[NumShards];
+};
+
+} // namespace RTBKIT
@@ -9,6 +9,7 @@
 #include "jml/arch/timers.h"
 #include "jml/arch/exception.h"
 #include "jml/arch/atomic_ops.h"
+#include "rtbkit/common/latency_histogram.h"
 
 namespace RTBKIT {
 
@@ -43,21 +44,53 @@ inline int64_t microsecondsBetween(double after, double before)
 }
 
 
+/** Stages of the router whose latency distribution is tracked. */
+enum RouterStage {
+    RS_PREPROCESS,       ///< preprocessAuction, including the filters
+    RS_FILTER,           ///< the filter pool
+    RS_AUGMENT,          ///< from preprocessing to the end of augmentation
+    RS_START_BIDDING,    ///< doStartBidding
+    RS_BID,              ///< doBidImpl
+    RS_SUBMITTED,        ///< doSubmitted
+
+    NUM_ROUTER_STAGES
+};
+
+inline const char * routerStageName(RouterStage stage)
+{
+    switch (stage) {
+    case RS_PREPROCESS:    return "preprocess";
+    case RS_FILTER:        return "filter";
+    case RS_AUGMENT:       return "augment";
+    case RS_START_BIDDING: return "startBidding";
+    case RS_BID:           return "bid";
+    case RS_SUBMITTED:     return "submitted";
+    default:
+        throw ML::Exception("unknown router stage %d", stage);
+    }
+}
+
+/** Adds the time spent in its scope to a duty cycle counter and, if given,
+    records it in a latency histogram.
+*/
 struct RouterProfiler {
 
-    RouterProfiler(uint64_t & counter)
-        : counter(counter)
+    RouterProfiler(uint64_t & counter, LatencyHistogram * histogram = 0)
+        : counter(counter), histogram(histogram)
     {
         startTime = getProfilingTime();
     }
 
     ~RouterProfiler()
     {
-        ML::atomic_add(counter,
-                       microsecondsBetween(getProfilingTime(), startTime));
+        int64_t elapsed = microsecondsBetween(getProfilingTime(), startTime);
+        ML::atomic_add(counter, elapsed);
+        if (histogram)
+            histogram->record(elapsed);
     }
 
     uint64_t & counter;
+    LatencyHistogram * histogram;
     double startTime;
 };
 
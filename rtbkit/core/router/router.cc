@@ -6,8 +6,10 @@
 */
 
 #include <atomic>
+#include <poll.h>
 #include "router.h"
 #include "soa/service/zmq_utils.h"
+#include "soa/service/sampling_profiler.h"
 #include "jml/arch/backtrace.h"
 #include "jml/arch/futex.h"
 #include "jml/arch/exception_handler.h"
@@ -24,6 +26,7 @@
 #include "jml/utils/exc_assert.h"
 #include "jml/db/persistent.h"
 #include "jml/utils/json_parsing.h"
+#include "jml/utils/filter_streams.h"
 #include "profiler.h"
 #include "rtbkit/core/banker/banker.h"
 #include "rtbkit/core/banker/null_banker.h"
@@ -34,6 +37,8 @@
 #include "rtbkit/common/win_cost_model.h"
 #include "rtbkit/common/bidder_interface.h"
 #include "rtbkit/common/analytics.h"
+#include "filters/static_filters.h"
+#include "soa/service/rest_request_binding.h"
 
 using namespace std;
 using namespace ML;
@@ -57,49 +62,128 @@ toJson() const
 }
 
 /*****************************************************************************/
-/* AUCTION DEBUG INFO                                                        */
+/* COMPATIBILITY CACHE                                                       */
 /*****************************************************************************/
 
-void
-AuctionDebugInfo::
-addAuctionEvent(Date timestamp, std::string type,
-                const std::vector<std::string> & args)
+namespace {
+
+uint64_t compatibilityKey(const std::string & exchange,
+                          const Json::Value & json,
+                          bool includeReasons)
 {
-    Message message;
-    message.timestamp = timestamp;
-    message.type = type;
-    //message.args = args;
-    messages.push_back(message);
+    std::string str = json.toStringNoNewLine();
+    uint64_t hash = CityHash64(str.c_str(), str.length());
+    uint64_t name = CityHash64(exchange.c_str(), exchange.length());
+    return Hash128to64(make_pair(hash, name + includeReasons));
 }
 
-void
-AuctionDebugInfo::
-addSpotEvent(const Id & spot, Date timestamp, std::string type,
-             const std::vector<std::string> & args)
+} // file scope
+
+uint64_t
+CompatibilityCache::
+campaignKey(const std::string & exchange,
+            const AgentConfig & config,
+            bool includeReasons)
 {
-    Message message;
-    message.spot = spot;
-    message.timestamp = timestamp;
-    message.type = type;
-    //message.args = args;
-    messages.push_back(message);
+    // The creatives are checked and cached separately
+    return compatibilityKey(exchange, config.toJson(false), includeReasons);
 }
 
-void
-AuctionDebugInfo::
-dumpAuction() const
+uint64_t
+CompatibilityCache::
+creativeKey(const std::string & exchange,
+            const Creative & creative,
+            bool includeReasons)
+{
+    return compatibilityKey(exchange, creative.toJson(), includeReasons);
+}
+
+CompatibilityCache::Result
+CompatibilityCache::
+get(uint64_t key, const std::function<Result ()> & compute)
 {
-    for (unsigned i = 0;  i < messages.size();  ++i) {
-        auto & m = messages[i];
-        cerr << m.timestamp.print(6) << " " << m.spot << " " << m.type << endl;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = current.find(key);
+        if (it != current.end())
+            return it->second;
+
+        it = previous.find(key);
+        if (it != previous.end()) {
+            Result result = it->second;
+            previous.erase(it);
+            current[key] = result;
+            return result;
+        }
+    }
+
+    Result result = compute();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (current.size() >= maxEntries) {
+        previous.swap(current);
+        current.clear();
     }
+    current[key] = result;
+    return result;
 }
 
 void
-AuctionDebugInfo::
-dumpSpot(Id spot) const
+CompatibilityCache::
+clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    current.clear();
+    previous.clear();
+}
+
+size_t
+CompatibilityCache::
+size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return current.size() + previous.size();
+}
+
+
+/*****************************************************************************/
+/* STATUS SNAPSHOT                                                           */
+/*****************************************************************************/
+
+bool
+StatusSnapshot::
+update(const Json::Value & document)
+{
+    std::shared_ptr<Entry> entry(new Entry);
+    entry->body = document.toStringNoNewLine();
+
+    auto old = get();
+    if (old && old->body == entry->body)
+        return false;
+
+    uint64_t hash = CityHash64(entry->body.c_str(), entry->body.length());
+    entry->etag = ML::format("\"%016llx\"", (unsigned long long)hash);
+
+    std::atomic_store(&current, std::shared_ptr<const Entry>(entry));
+    return true;
+}
+
+bool
+StatusSnapshot::
+matches(const std::string & ifNoneMatch, const std::string & etag)
 {
-    dumpAuction();  // TODO
+    vector<string> tags;
+    boost::split(tags, ifNoneMatch, boost::is_any_of(","));
+
+    for (auto & tag : tags) {
+        boost::trim(tag);
+        if (tag == "*") return true;
+        // Weak comparison is fine for a GET
+        if (boost::starts_with(tag, "W/")) tag.erase(0, 2);
+        if (tag == etag) return true;
+    }
+
+    return false;
 }
 
 
@@ -123,14 +207,22 @@ Router(ServiceBase & parent,
       shutdown_(false),
       postAuctionEndpoint(*this),
       configBuffer(1024),
+      configBatchWindow(0.01),
+      statusRefreshInterval(1.0),
+      statusSignal(0),
+      configCacheMaxAge(0.0),
+      configCacheDirty(false),
       exchangeBuffer(64),
-      startBiddingBuffer(65536),
       submittedBuffer(65536),
+      agentMessageBuffer(65536),
       auctionGraveyard(65536),
-      doBidBuffer(65536),
+      filtersMemory("router.filterPool",
+                    [&] () { return filters.memoryUsage(); }),
       augmentationLoop(*this),
       loopMonitor(*this),
       loadStabilizer(loopMonitor),
+      numShards(1),
+      auctionUsageSampling(0),
       secondsUntilLossAssumed_(secondsUntilLossAssumed),
       globalBidProbability(1.0),
       bidsErrorRate(0.0),
@@ -143,8 +235,8 @@ Router(ServiceBase & parent,
       bridge(getZmqContext()),
       logAuctions(logAuctions),
       logBids(logBids),
-      doDebug(false),
       disableAuctionProb(false),
+      admissionControl(false),
       numAuctions(0), numBids(0), numNonEmptyBids(0),
       numAuctionsWithBid(0), numNoPotentialBidders(0),
       numNoBidders(0),
@@ -176,14 +268,22 @@ Router(std::shared_ptr<ServiceProxies> services,
       shutdown_(false),
       postAuctionEndpoint(*this),
       configBuffer(1024),
+      configBatchWindow(0.01),
+      statusRefreshInterval(1.0),
+      statusSignal(0),
+      configCacheMaxAge(0.0),
+      configCacheDirty(false),
       exchangeBuffer(64),
-      startBiddingBuffer(65536),
       submittedBuffer(65536),
+      agentMessageBuffer(65536),
       auctionGraveyard(65536),
-      doBidBuffer(65536),
+      filtersMemory("router.filterPool",
+                    [&] () { return filters.memoryUsage(); }),
       augmentationLoop(*this),
       loopMonitor(*this),
       loadStabilizer(loopMonitor),
+      numShards(1),
+      auctionUsageSampling(0),
       secondsUntilLossAssumed_(secondsUntilLossAssumed),
       globalBidProbability(1.0),
       bidsErrorRate(0.0),
@@ -196,8 +296,8 @@ Router(std::shared_ptr<ServiceProxies> services,
       bridge(getZmqContext()),
       logAuctions(logAuctions),
       logBids(logBids),
-      doDebug(false),
       disableAuctionProb(false),
+      admissionControl(false),
       numAuctions(0), numBids(0), numNonEmptyBids(0),
       numAuctionsWithBid(0), numNoPotentialBidders(0),
       numNoBidders(0),
@@ -260,6 +360,24 @@ initExchange(const Json::Value & exchangeConfig)
     initExchange(exchangeType, exchangeConfig);
 }
 
+void
+Router::
+initAugmentors(const Json::Value & config)
+{
+    if (config.isNull()) return;
+    if (!config.isArray())
+        throw ML::Exception("augmentor config must be an array");
+
+    for (const auto & augmentor : config) {
+        std::string type = augmentor["type"].asString();
+        std::string name = augmentor.get("name", type).asString();
+
+        augmentationLoop.addInProcessAugmentor(
+                name, InProcessAugmentor::create(type, *this, name, augmentor),
+                augmentor.get("cacheTtl", 0.0).asDouble());
+    }
+}
+
 void
 Router::
 initFilters(const Json::Value & config) {
@@ -272,6 +390,7 @@ initFilters(const Json::Value & config) {
         Json::Value extraFilterLibs;
         Json::Value filterDeactivate;
         Json::Value filterActivate;
+        size_t cacheSize = 0;
 
         for (const std::string & field : config.getMemberNames()) {
 
@@ -303,6 +422,15 @@ initFilters(const Json::Value & config) {
                     throw Exception("Filter-activate must be an array");
                 }
             }
+            else if (field == "cache-size") {
+                cacheSize = config[field].asUInt();
+            }
+            else if (field == "frequency-caps") {
+                initFrequencyCaps(config[field]);
+            }
+            else if (field == "impression-dedup") {
+                initImpressionDedup(config[field]);
+            }
             else
                 throw Exception("Unknown field " + field + " in filter config file");
         }
@@ -347,11 +475,67 @@ initFilters(const Json::Value & config) {
             }
         }
 
+        filters.setCacheSize(cacheSize);
+
     } else {
         filters.initWithDefaultFilters();
     }
 }
 
+void
+Router::
+initFrequencyCaps(const Json::Value & config)
+{
+    ExcAssert(!frequencyCaps);
+
+    frequencyCaps = std::make_shared<FrequencyCapStore>(config);
+    FrequencyCapFilter::setStore(frequencyCaps);
+
+    winEvents.reset(new ZmqNamedMultipleSubscriber(getZmqContext()));
+    winEvents->init(getServices()->config);
+    winEvents->messageHandler
+        = std::bind(&Router::recordWinEvent, this, std::placeholders::_1);
+    winEvents->connectAllServiceProviders(
+            "rtbPostAuctionService", "logger", {"MATCHEDWIN"});
+}
+
+void
+Router::
+initImpressionDedup(const Json::Value & config)
+{
+    ExcAssert(!impressionDedup);
+    impressionDedup.reset(new ImpressionDedup(config));
+}
+
+void
+Router::
+recordWinEvent(const std::vector<zmq::message_t> & message)
+{
+    // See ZmqAnalytics::logMatchedWinLoss for the layout of the message
+    if (message.size() < 20) {
+        recordHit("frequencyCaps.invalidWin");
+        return;
+    }
+
+    try {
+        AccountKey account(message[19].toString());
+        UserIds uids = UserIds::createFromJson(
+                Json::parse(message[15].toString()));
+
+        uint64_t key = FrequencyCapStore::keyOf(uids, account.toString());
+        if (!key) {
+            recordHit("frequencyCaps.noUserId");
+            return;
+        }
+
+        frequencyCaps->record(key);
+        recordHit("frequencyCaps.wins");
+    } catch (const std::exception & exc) {
+        cerr << "invalid MATCHEDWIN message: " << exc.what() << endl;
+        recordHit("frequencyCaps.invalidWin");
+    }
+}
+
 void
 Router::
 initAnalytics(const Json::Value & config)
@@ -362,6 +546,103 @@ initAnalytics(const Json::Value & config)
     analytics.reset(factory(serviceName(), getServices()));
 }
 
+void
+Router::
+initConfigCache(const std::string & filename,
+                double maxAge,
+                double reconcileDelay)
+{
+    configCacheFile = filename;
+    configCacheMaxAge = maxAge;
+    reconcileCachedConfigs = Date::now().plusSeconds(reconcileDelay);
+}
+
+size_t
+Router::
+loadConfigCache()
+{
+    Json::Value cache;
+    try {
+        ML::filter_istream stream(configCacheFile);
+        std::string contents((std::istreambuf_iterator<char>(stream)),
+                             std::istreambuf_iterator<char>());
+        cache = Json::parse(contents);
+    } catch (const std::exception & exc) {
+        cerr << "not using config cache " << configCacheFile << ": "
+             << exc.what() << endl;
+        return 0;
+    }
+
+    Date saved = Date::parseIso8601DateTime(cache["saved"].asString());
+    if (saved.plusSeconds(configCacheMaxAge) < Date::now()) {
+        cerr << "config cache from " << saved.print() << " is too old"
+             << endl;
+        return 0;
+    }
+
+    std::map<std::string, std::shared_ptr<const AgentConfig> > configs;
+    const Json::Value & agentConfigs = cache["agents"];
+    for (auto it = agentConfigs.begin(), end = agentConfigs.end();
+         it != end;  ++it) {
+        try {
+            configs[it.memberName()] = std::make_shared<AgentConfig>(
+                    AgentConfig::createFromJson(*it));
+        } catch (const std::exception & exc) {
+            cerr << "ignoring cached config of " << it.memberName() << ": "
+                 << exc.what() << endl;
+        }
+    }
+
+    for (auto & config: configs)
+        unconfirmedAgents.insert(config.first);
+
+    // The banker accounts and filters are set up from these like for
+    // configurations that come from the agent configuration service.
+    if (!configs.empty())
+        doConfigs(configs);
+
+    cerr << "loaded " << configs.size() << " agent configurations from "
+         << configCacheFile << endl;
+    return configs.size();
+}
+
+void
+Router::
+saveConfigCache()
+{
+    Json::Value agentConfigs(Json::objectValue);
+    for (auto & agent: agents)
+        agentConfigs[agent.first] = agent.second.config->toJson();
+
+    Json::Value cache;
+    cache["saved"] = Date::now().printIso8601();
+    cache["agents"] = agentConfigs;
+
+    // Written aside and renamed so that a crash never leaves half a cache
+    std::string tmpFile = configCacheFile + ".tmp";
+    {
+        ML::filter_ostream stream(tmpFile);
+        stream << cache.toString();
+        stream.close();
+    }
+
+    if (std::rename(tmpFile.c_str(), configCacheFile.c_str()) == -1)
+        throw ML::Exception(errno, "rename " + tmpFile);
+
+    lastConfigCacheSave = Date::now();
+    configCacheDirty = false;
+}
+
+void
+Router::
+setNumShards(unsigned newNumShards)
+{
+    ExcAssert(!initialized);
+    if (newNumShards == 0)
+        throw ML::Exception("router needs at least one shard");
+    numShards = newNumShards;
+}
+
 void
 Router::
 init()
@@ -370,9 +651,13 @@ init()
 
     registerServiceProvider(serviceName(), { "rtbRequestRouter" });
 
+    for (unsigned i = 0;  i < numShards;  ++i)
+        shards.emplace_back(new RouterShard(i));
+
     filters.init(this);
 
     banker.reset(new NullBanker());
+    BudgetFilter::setAvailability(nullptr);
 
     if(!bidder) {
         Json::Value json;
@@ -397,15 +682,16 @@ init()
             cerr << "agent " << agent << " disconnected from router" << endl;
         };
 
-    configListener.onConfigChange = [=] (const std::string & agent,
-                                         std::shared_ptr<const AgentConfig> config)
+    configListener.onConfigDelta = [=] (const std::string & agent,
+                                        std::shared_ptr<const AgentConfig> config,
+                                        int changedSections)
         {
-            configBuffer.push(make_pair(agent, config));
+            configBuffer.push(ConfigChange{ agent, config, changedSections });
         };
 
     onSubmittedAuction = [=] (std::shared_ptr<Auction> auction,
                               Id adSpotId,
-                              Auction::Response response)
+                              const Auction::Response & response)
         {
             submitToPostAuctionService(auction, adSpotId, response);
         };
@@ -413,6 +699,8 @@ init()
     monitorClient.init(getServices()->config);
     monitorProviderClient.init(getServices()->config);
 
+    initRestEndpoint();
+
     loopMonitor.init();
     loopMonitor.addMessageLoop("augmentationLoop", &augmentationLoop);
     loopMonitor.addMessageLoop("configListener", &configListener);
@@ -428,7 +716,9 @@ init()
                 keepProb -= loadStabilizer.shedProbability();
             }
 
-            setAcceptAuctionProbability(keepProb);
+            // The admission controller sets the probabilities itself
+            if (!admissionControl)
+                setAcceptAuctionProbability(keepProb);
             recordEvent("auctionKeepPercentage", ET_LEVEL, keepProb * 100.0);
         };
 
@@ -454,6 +744,7 @@ setBanker(const std::shared_ptr<Banker> & newBanker)
 {
     banker = newBanker;
     monitorProviderClient.addProvider(banker.get());
+    BudgetFilter::setAvailability(banker->budgetAvailability());
 }
 
 void
@@ -462,6 +753,108 @@ bindTcp()
 {
     if (analytics) analytics->bindTcp();
     bridge.agents.bindTcp(getServices()->ports->getRange("router"));
+
+    if (restEndpoint) {
+        restEndpoint->bindTcp(
+                getServices()->ports->getRange("routerREST.zmq"),
+                getServices()->ports->getRange("routerREST.http"));
+    }
+}
+
+void
+Router::
+initRestEndpoint()
+{
+    const auto& params = getServices()->params;
+    if (!params.isMember("portRanges") ||
+            !params["portRanges"].isMember("routerREST.zmq") ||
+            !params["portRanges"].isMember("routerREST.http"))
+    {
+        return;
+    }
+
+    restEndpoint.reset(new RestServiceEndpoint(getZmqContext()));
+    restEndpoint->init(getServices()->config, serviceName() + "/rest");
+
+    restRouter.reset(new RestRequestRouter);
+
+    restEndpoint->onHandleRequest = restRouter->requestHandler();
+    restRouter->description = "Control API for the RTBKIT router";
+    restRouter->addHelpRoute("/", "GET");
+    addProfilerRoutes(*restRouter);
+
+    auto & versionNode = restRouter->addSubRouter("/v1", "version 1 of API");
+    auto & exchangesNode
+        = versionNode.addSubRouter("/exchanges",
+                                   "Operations on exchange connectors");
+    auto & exchangeNode
+        = exchangesNode.addSubRouter(Rx("/([^/]*)", "/<exchange>"),
+                                     "operations on an individual exchange");
+
+    RequestParam<std::string> exchangeParam(-2, "<exchange>",
+                                            "exchange to operate on");
+
+    addRouteSyncReturn(exchangeNode,
+                       "/capture",
+                       {"GET"},
+                       "Return the state of the request capture",
+                       "Request capture status",
+                       [] (const Json::Value & status) { return status; },
+                       &Router::getRequestCapture,
+                       this,
+                       exchangeParam);
+
+    addRouteSync(exchangeNode,
+                 "/capture",
+                 {"POST"},
+                 "Change the sampled capture of the exchange's requests",
+                 &Router::setRequestCapture,
+                 this,
+                 exchangeParam,
+                 JsonParam<Json::Value>("", "Request capture configuration"));
+
+    typedef RestRequestRouter::MatchResult MatchResult;
+    typedef RestServiceEndpoint::ConnectionId ConnectionId;
+
+    // Snapshots are served as they were serialized by the status thread
+    auto sendSnapshot = [] (const ConnectionId & connection,
+                            const RestRequest & request,
+                            const StatusSnapshot::Entry & entry)
+        -> MatchResult
+        {
+            RestParams headers = { { "ETag", entry.etag } };
+            string ifNoneMatch = request.header.tryGetHeader("if-none-match");
+            if (StatusSnapshot::matches(ifNoneMatch, entry.etag))
+                connection.sendHttpResponse(304, "", "", headers);
+            else connection.sendHttpResponse(200, entry.body,
+                                             "application/json", headers);
+            return RestRequestRouter::MR_YES;
+        };
+
+    versionNode.addRoute("/status", "GET",
+                         "Status of the router, refreshed periodically",
+                         [=] (const ConnectionId & connection,
+                              const RestRequest & request,
+                              const RestRequestParsingContext & context)
+                         -> MatchResult
+                         {
+                             return sendSnapshot(connection, request,
+                                                 *getServiceStatusSnapshot());
+                         },
+                         Json::Value());
+
+    versionNode.addRoute("/agents", "GET",
+                         "Configuration and stats of all agents, refreshed "
+                         "periodically",
+                         [=] (const ConnectionId & connection,
+                              const RestRequest & request,
+                              const RestRequestParsingContext & context)
+                         -> MatchResult
+                         {
+                             return sendSnapshot(connection, request,
+                                                 *getAllAgentInfoSnapshot());
+                         },
+                         Json::Value());
 }
 
 void
@@ -536,12 +929,24 @@ start(boost::function<void ()> onStop)
         connectExchange(*exchange);
     }
 
+    // Before anything can change the agents behind our back
+    if (!configCacheFile.empty())
+        loadConfigCache();
+
     bidder->start();
     if (analytics) analytics->start();
     analyticsPublisher.start();
     augmentationLoop.start();
     runThread.reset(new boost::thread(runfn));
 
+    // With a single shard, the main loop takes care of it
+    if (shards.size() > 1) {
+        for (auto & shard : shards) {
+            RouterShard * s = shard.get();
+            shard->thread.reset(new std::thread([=] () { this->runShard(*s); }));
+        }
+    }
+
     if (connectPostAuctionLoop) {
         postAuctionEndpoint.init();
     }
@@ -549,6 +954,8 @@ start(boost::function<void ()> onStop)
     configListener.init(getServices()->config);
     configListener.start();
 
+    if (winEvents) winEvents->start();
+
     /* This is an extra thread which sits there deleting auctions
        to take this out of the hands of the main loop (it can easily use
        up nearly 20% of the capacity of the main loop).
@@ -568,10 +975,13 @@ start(boost::function<void ()> onStop)
         };
 
     cleanupThread.reset(new boost::thread(auctionDeleter));
+    statusThread.reset(new boost::thread([=] { this->runStatusThread(); }));
 
     monitorClient.start();
     monitorProviderClient.start();
 
+    if (restEndpoint) restEndpoint->start();
+
     loopMonitor.start();
 }
 
@@ -582,7 +992,7 @@ numNonIdle() const
     size_t numInFlight, numAwaitingAugmentation;
     {
         Guard guard(lock);
-        numInFlight = inFlight.size();
+        numInFlight = this->numInFlight();
         numAwaitingAugmentation = augmentationLoop.numAugmenting();
     }
 
@@ -623,13 +1033,18 @@ run()
 {
     using namespace std;
 
+    // When there is only one shard, it's serviced by this loop
+    RouterShard * inlineShard = (shards.size() == 1 ? shards[0].get() : 0);
+
     zmq_pollitem_t items [] = {
         { bridge.agents.getSocketUnsafe(), 0, ZMQ_POLLIN, 0 },
-        { 0, wakeupMainLoop.fd(), ZMQ_POLLIN, 0 }
+        { 0, wakeupMainLoop.fd(), ZMQ_POLLIN, 0 },
+        { 0, inlineShard ? inlineShard->wakeup.fd() : -1, ZMQ_POLLIN, 0 }
     };
+    int numItems = inlineShard ? 3 : 2;
 
     double last_check = ML::wall_time(), last_check_pace = last_check,
-        lastPings = last_check;
+        lastPings = last_check, lastAdmission = last_check;
 
     //cerr << "server listening" << endl;
 
@@ -690,7 +1105,7 @@ run()
             double atStart = getTime();
 
             for (unsigned i = 0;  i < 20 && rc == 0;  ++i)
-                rc = zmq_poll(items, 2, 0);
+                rc = zmq_poll(items, numItems, 0);
 
             recordTime("spinPoll", atStart);
         }
@@ -721,7 +1136,9 @@ run()
             }
 
             double pollStart = getTime();
-            rc = zmq_poll(items, 2, 50 /* milliseconds */);
+            // Don't sleep past the end of the configuration batch window
+            int timeout = pendingConfigs.empty() ? 50 : 1 /* milliseconds */;
+            rc = zmq_poll(items, numItems, timeout);
             recordTime("sleepPoll", pollStart);
         }
 
@@ -734,25 +1151,29 @@ run()
             cerr << "zeromq error: " << zmq_strerror(zmq_errno()) << endl;
         }
 
-        {
-            double atStart = getTime();
-            std::shared_ptr<AugmentationInfo> info;
-            while (startBiddingBuffer.tryPop(info)) {
-                doStartBidding(info);
+        if (inlineShard) {
+            RouterShard::Guard guard(inlineShard->lock);
+
+            {
+                double atStart = getTime();
+                std::shared_ptr<AugmentationInfo> info;
+                while (inlineShard->startBiddingBuffer.tryPop(info)) {
+                    doStartBidding(*inlineShard, info);
+                }
+
+                recordTime("doStartBidding", atStart);
             }
 
-            recordTime("doStartBidding", atStart);
-        }
+            {
+                double atStart = getTime();
 
-        {
-            double atStart = getTime();
+                RouterShard::QueuedBid bid;
+                while (inlineShard->doBidBuffer.tryPop(bid)) {
+                    doBidImpl(*inlineShard, bid.first, bid.second);
+                }
 
-            BidMessage message;
-            while (doBidBuffer.tryPop(message)) {
-                doBidImpl(message);
+                recordTime("doBid", atStart);
             }
-
-            recordTime("doBid", atStart);
         }
 
         {
@@ -760,11 +1181,16 @@ run()
 
             std::shared_ptr<ExchangeConnector> exchange;
             while (exchangeBuffer.tryPop(exchange)) {
+                // It may replace an exchange of the same name
+                compatibilityCache.clear();
                 for (auto & agent : agents) {
                     configureAgentOnExchange(exchange,
                                              agent.first,
                                              *agent.second.config);
                 };
+
+                // The filters can now index the agents' compatibility
+                exchange->compatibilityGeneration.fetch_add(1);
             }
 
             recordTime("configureAgentOnExchange", atStart);
@@ -773,9 +1199,51 @@ run()
         {
             double atStart = getTime();
 
-            std::pair<std::string, std::shared_ptr<const AgentConfig> > config;
-            while (configBuffer.tryPop(config)) {
-                doConfig(config.first, config.second);
+            // Accumulate configurations for a little while so that a burst
+            // of changes only rebuilds the filters and agents once.
+            ConfigChange change;
+            while (configBuffer.tryPop(change)) {
+                if (pendingConfigs.empty())
+                    firstPendingConfig = Date::now();
+                pendingConfigs[change.agent] = change.config;
+                pendingSections[change.agent] |= change.changedSections;
+                unconfirmedAgents.erase(change.agent);
+            }
+
+            // Cached agents that the configuration service doesn't know
+            // about anymore
+            if (!unconfirmedAgents.empty()
+                && Date::now() >= reconcileCachedConfigs) {
+                if (pendingConfigs.empty())
+                    firstPendingConfig = Date::now();
+                for (auto & agent: unconfirmedAgents) {
+                    cerr << "cached agent " << agent << " wasn't confirmed"
+                         << endl;
+                    pendingConfigs[agent] = nullptr;
+                    pendingSections[agent] = AgentConfig::ALL_SECTIONS;
+                }
+                unconfirmedAgents.clear();
+            }
+
+            if (!pendingConfigs.empty()
+                && firstPendingConfig.secondsUntil(Date::now())
+                   >= configBatchWindow) {
+                doConfigs(pendingConfigs, pendingSections);
+                pendingConfigs.clear();
+                pendingSections.clear();
+                configCacheDirty = !configCacheFile.empty();
+            }
+
+            // Rewritten at most once a second whilst configurations change
+            if (configCacheDirty
+                && lastConfigCacheSave.secondsUntil(Date::now()) >= 1.0) {
+                try {
+                    saveConfigCache();
+                } catch (const std::exception & exc) {
+                    cerr << "error saving config cache: " << exc.what()
+                         << endl;
+                    lastConfigCacheSave = Date::now();
+                }
             }
 
             recordTime("doConfig", atStart);
@@ -791,6 +1259,25 @@ run()
             recordTime("doSubmitted", atStart);
         }
 
+        {
+            // Agent messages that didn't come through the bus
+            vector<string> message;
+            while (agentMessageBuffer.tryPop(message)) {
+                double atStart = getTime();
+                try {
+                    handleAgentMessage(message);
+                } catch (const std::exception & exc) {
+                    cerr << "error handling agent message " << message
+                         << ": " << exc.what() << endl;
+                    logRouterError("handleAgentMessage", exc.what(),
+                                   message);
+                }
+
+                if (message.size() > 1)
+                    recordTime(message[1], atStart);
+            }
+        }
+
         if (items[0].revents & ZMQ_POLLIN) {
             double atStart = getTime();
             // Agent message
@@ -815,6 +1302,10 @@ run()
             wakeupMainLoop.read();
         }
 
+        if (inlineShard && (items[2].revents & ZMQ_POLLIN)) {
+            inlineShard->wakeup.read();
+        }
+
         double now = ML::wall_time();
 
         if (now - lastPings > 1.0) {
@@ -828,6 +1319,17 @@ run()
             recordTime("sendPings", atStart);
         }
 
+        if (admissionControl
+            && now - lastAdmission > admissionController.period) {
+            double atStart = getTime();
+
+            admissionController.update(loopMonitor.sampleLoad().load,
+                                       numInFlight());
+            lastAdmission = now;
+
+            recordTime("admissionControl", atStart);
+        }
+
         double beforeChecks = getTime();
 
         if (now - last_check_pace > 10.0) {
@@ -841,6 +1343,7 @@ run()
 
         if (now - last_check > 10.0) {
             logUsageMetrics(10.0);
+            logStageLatencies();
             if (analytics) analytics->logUsageMessage(*this, 10.0);
             if (analytics) analytics->logMarkMessage(*this,last_check);
             dutyCycleCurrent.ending = Date::now();
@@ -885,6 +1388,7 @@ run()
             double atStart = getTime();
 
             banker->logBidEvents(*this);
+            exportTraces();
             //issueTimestamp();
             lastTimestamp = now;
 
@@ -899,6 +1403,72 @@ run()
     //cerr << "server shutdown" << endl;
 }
 
+void
+Router::
+runShard(RouterShard & shard)
+{
+    pollfd item = { shard.wakeup.fd(), POLLIN, 0 };
+
+    Date lastExpiry = Date::now();
+
+    while (!shutdown_) {
+        int res = ::poll(&item, 1, 1 /* milliseconds */);
+        if (res == -1 && errno != EINTR) {
+            cerr << "shard " << shard.index << " poll error: "
+                 << strerror(errno) << endl;
+        }
+        if (res == 1 && (item.revents & POLLIN))
+            shard.wakeup.read();
+
+        RouterShard::Guard guard(shard.lock);
+
+        processShard(shard);
+
+        Date now = Date::now();
+        if (lastExpiry.secondsUntil(now) >= 0.001) {
+            checkExpiredAuctions(shard);
+            lastExpiry = now;
+        }
+    }
+}
+
+void
+Router::
+processShard(RouterShard & shard)
+{
+    std::shared_ptr<AugmentationInfo> info;
+    while (shard.startBiddingBuffer.tryPop(info))
+        doStartBidding(shard, info);
+
+    RouterShard::QueuedBid bid;
+    while (shard.doBidBuffer.tryPop(bid))
+        doBidImpl(shard, bid.first, bid.second);
+}
+
+bool
+Router::
+tryPushBid(BidMessage && message, std::vector<std::string> && originalMessage)
+{
+    RouterShard & shard = shardFor(message.auctionId);
+    if (!shard.doBidBuffer.tryPush(make_pair(std::move(message),
+                                             std::move(originalMessage))))
+        return false;
+    shard.wakeup.signal();
+    return true;
+}
+
+size_t
+Router::
+numInFlight() const
+{
+    size_t result = 0;
+    for (auto & shard : shards) {
+        RouterShard::Guard guard(shard->lock);
+        result += shard->inFlight.size();
+    }
+    return result;
+}
+
 void
 Router::
 shutdown()
@@ -906,6 +1476,7 @@ shutdown()
     loopMonitor.shutdown();
 
     configListener.shutdown();
+    if (winEvents) winEvents->shutdown();
 
     shutdown_ = true;
     futex_wake(shutdown_);
@@ -916,11 +1487,21 @@ shutdown()
     if (runThread)
         runThread->join();
     runThread.reset();
+    for (auto & shard : shards) {
+        if (shard->thread)
+            shard->thread->join();
+        shard->thread.reset();
+    }
     if (cleanupThread)
         cleanupThread->join();
     cleanupThread.reset();
+    wakeStatusThread();
+    if (statusThread)
+        statusThread->join();
+    statusThread.reset();
 
     if (analytics) analytics->shutdown();
+    if (restEndpoint) restEndpoint->shutdown();
     banker.reset();
 
     monitorClient.shutdown();
@@ -1026,6 +1607,13 @@ handleAgentMessage(const std::vector<std::string> & message)
             return;
         }
 
+        if (request == "SHM") {
+            // Agent on this host offering a shared memory ring
+            if (!bidder->acceptSharedMemory(address, message.at(2)))
+                recordHit("sharedMemory.declined");
+            return;
+        }
+
         if (!agents.count(address)) {
             cerr << "doing NEEDCONFIG for " << address << endl;
             return;
@@ -1061,6 +1649,37 @@ handleAgentMessage(const std::vector<std::string> & message)
     }
 }
 
+void
+Router::
+logStageLatencies()
+{
+    for (unsigned i = 0;  i < NUM_ROUTER_STAGES;  ++i) {
+        auto current = stageLatencies[i].snapshot();
+        auto period = current - lastStageLatencies[i];
+        lastStageLatencies[i] = current;
+
+        if (!period.count())
+            continue;
+
+        const char * stage = routerStageName(RouterStage(i));
+        recordLevel(period.percentile(0.5) / 1000.0, "latency.%s.p50", stage);
+        recordLevel(period.percentile(0.9) / 1000.0, "latency.%s.p90", stage);
+        recordLevel(period.percentile(0.99) / 1000.0, "latency.%s.p99", stage);
+        recordLevel(period.percentile(0.999) / 1000.0, "latency.%s.p999", stage);
+    }
+}
+
+Json::Value
+Router::
+getStageLatencies() const
+{
+    Json::Value result(Json::objectValue);
+    for (unsigned i = 0;  i < NUM_ROUTER_STAGES;  ++i)
+        result[routerStageName(RouterStage(i))]
+            = stageLatencies[i].snapshot().toJson();
+    return result;
+}
+
 void
 Router::
 logUsageMetrics(double period)
@@ -1081,11 +1700,13 @@ logUsageMetrics(double period)
         auto & info = item.second;
         auto & last = lastAgentUsageMetrics[item.first];
 
-        AgentUsageMetrics newMetrics(info.stats->intoFilters,
-                                     info.stats->passedStaticFilters,
-                                     info.stats->passedDynamicFilters,
-                                     info.stats->auctions,
-                                     info.stats->bids);
+        const AgentStats & stats = *info.stats;
+        AgentUsageMetrics newMetrics(
+                stats.get(AgentStats::INTO_FILTERS),
+                stats.get(AgentStats::PASSED_STATIC_FILTERS),
+                stats.get(AgentStats::PASSED_DYNAMIC_FILTERS),
+                stats.get(AgentStats::AUCTIONS),
+                stats.get(AgentStats::BIDS));
         AgentUsageMetrics delta = newMetrics - last;
 
         logMessageToAnalytics("USAGE", "AGENT", p, item.first,
@@ -1142,6 +1763,9 @@ checkDeadAgents()
 
     std::vector<Agents::iterator> deadAgents;
 
+    // We look into the shards' in flight auctions and may remove agents
+    AllShardsGuard guard(shards);
+
     for (auto it = agents.begin(), end = agents.end();  it != end;
          ++it) {
         auto & info = it->second;
@@ -1167,7 +1791,8 @@ checkDeadAgents()
 
                     this->recordHit("accounts.%s.lostBids", account);
 
-                    bidder->sendBidLostMessage(info.config, it->first, inFlight[id].auction);
+                    bidder->sendBidLostMessage(info.config, it->first,
+                                               shardFor(id).inFlight.get(id).auction);
 
                     toExpire.push_back(id);
                 }
@@ -1246,6 +1871,22 @@ checkExpiredAuctions()
 {
     //recentlySubmitted.clear();
 
+    if (shards.size() == 1) {
+        RouterShard::Guard guard(shards[0]->lock);
+        checkExpiredAuctions(*shards[0]);
+    }
+
+    {
+        RouterProfiler profiler(dutyCycleCurrent.nsExpireBlacklist);
+        blacklist.doExpiries();
+    }
+
+}
+
+void
+Router::
+checkExpiredAuctions(RouterShard & shard)
+{
     Date start = Date::now();
 
     {
@@ -1255,7 +1896,7 @@ checkExpiredAuctions()
         auto onExpiredInFlight = [&] (const Id & auctionId,
                                       const AuctionInfo & auctionInfo)
             {
-                this->debugAuction(auctionId, "EXPIRED", {});
+                this->debugAuction(auctionId, "EXPIRED");
 
                 // Tell any remaining bidders that it's too late...
                 for (auto it = auctionInfo.bidders.begin(),
@@ -1264,9 +1905,9 @@ checkExpiredAuctions()
                     string agent = it->first;
                     if (!agents.count(agent)) continue;
 
-                    if (agents[agent].expireBidInFlight(auctionId)) {
+                    if (agents.find(agent)->second.expireBidInFlight(auctionId)) {
                         AgentInfo & info = this->agents[agent];
-                        ++info.stats->tooLate;
+                        info.stats->increment(AgentStats::TOO_LATE);
 
                         this->recordHit("accounts.%s.EXPIRED",
                                         info.config->account.toString('.'));
@@ -1286,7 +1927,7 @@ checkExpiredAuctions()
                      it != end;  ++it)
                     msg += ' ' + it->first + "->" + it->second.bidTime.print(5);
                 cerr << Date::now().print(5) << " " << msg << endl;
-                dumpAuction(auctionId);
+                cerr << traceAuction(auctionId) << endl;
                 this->logRouterError("checkExpiredAuctions.inFlight",
                                      msg);
 
@@ -1298,21 +1939,10 @@ checkExpiredAuctions()
                 this->recordHit("tooLateToFinish");
             }
         }
-
-                return Date();
             };
 
-        inFlight.expire(onExpiredInFlight, start);
-    }
-
-    {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireBlacklist);
-        blacklist.doExpiries();
-    }
-
-    if (doDebug) {
-        RouterProfiler profiler(dutyCycleCurrent.nsExpireDebug);
-        expireDebugInfo();
+        shard.inFlight.expire(onExpiredInFlight, start);
+        shard.inFlightMemory.set(shard.inFlight.memoryUsage());
     }
 }
 
@@ -1326,8 +1956,13 @@ returnErrorResponse(const std::vector<std::string> & message,
     if (analytics) analytics->logErrorMessage(error,message);
     logMessageToAnalytics("ERROR", error, message);
     const auto& agent = message[0];
-    AgentInfo & info = this->agents[agent];
-    bidder->sendErrorMessage(info.config, agent, error, message);
+
+    // Don't insert into agents here; we may be running in a shard
+    std::shared_ptr<const AgentConfig> config;
+    auto it = agents.find(agent);
+    if (it != agents.end())
+        config = it->second.config;
+    bidder->sendErrorMessage(config, agent, error, message);
 }
 
 void
@@ -1346,7 +1981,7 @@ returnInvalidBid(
                     agentConfig->account.toString('.'),
                     reason);
 
-    ++agentInfo.stats->invalid;
+    agentInfo.stats->increment(AgentStats::INVALID);
 
     va_list ap;
     va_start(ap, message);
@@ -1383,7 +2018,7 @@ returnInvalidBid(
                     agentConfig->account.toString('.'),
                     reason);
 
-    ++agentInfo.stats->invalid;
+    agentInfo.stats->increment(AgentStats::INVALID);
 
     va_list ap;
     va_start(ap, message);
@@ -1411,8 +2046,10 @@ doStats(const std::vector<std::string> & message)
     Json::Value result(Json::objectValue);
 
     result["numAugmenting"] = augmentationLoop.numAugmenting();
-    result["numInFlight"] = inFlight.size();
+    result["numInFlight"] = numInFlight();
     result["blacklistUsers"] = blacklist.size();
+    if (frequencyCaps)
+        result["frequencyCaps"] = frequencyCaps->stats();
 
     result["numAgents"] = agents.size();
 
@@ -1454,7 +2091,101 @@ Json::Value
 Router::
 getServiceStatus() const
 {
-    return getStats();
+    Json::Value result = getStats();
+    if (auctionUsageSampling)
+        result["auctionUsage"] = getAuctionUsage();
+    if (impressionDedup)
+        result["impressionDedupSize"] = (unsigned)impressionDedup->size();
+    result["compatibilityCacheSize"] = (unsigned)compatibilityCache.size();
+    for (const auto & gauge : MemoryGauge::sampleAll())
+        result["memory"][gauge.first] = gauge.second;
+    return result;
+}
+
+std::shared_ptr<const StatusSnapshot::Entry>
+Router::
+getServiceStatusSnapshot() const
+{
+    auto entry = serviceStatusSnapshot.get();
+    if (entry) return entry;
+
+    serviceStatusSnapshot.update(getServiceStatus());
+    return serviceStatusSnapshot.get();
+}
+
+std::shared_ptr<const StatusSnapshot::Entry>
+Router::
+getAllAgentInfoSnapshot() const
+{
+    auto entry = agentsSnapshot.get();
+    if (entry) return entry;
+
+    agentsSnapshot.update(getAllAgentInfo());
+    return agentsSnapshot.get();
+}
+
+void
+Router::
+wakeStatusThread()
+{
+    ++statusSignal;
+    futex_wake(statusSignal);
+}
+
+void
+Router::
+runStatusThread()
+{
+    while (!shutdown_) {
+        int signal = statusSignal;
+
+        try {
+            refreshStatusSnapshots();
+        } catch (const std::exception & exc) {
+            cerr << "error refreshing the router status: " << exc.what()
+                 << endl;
+        }
+
+        if (statusSignal == signal && !shutdown_)
+            futex_wait(statusSignal, signal, statusRefreshInterval);
+    }
+}
+
+void
+Router::
+refreshStatusSnapshots()
+{
+    serviceStatusSnapshot.update(getServiceStatus());
+
+    // Configs only change on a config push, so their JSON, which is most of
+    // the document, is kept from one refresh to the next.
+    Json::Value agentsInfo;
+    std::set<std::string> seen;
+
+    auto onAgent = [&] (const AgentInfoEntry & info)
+        {
+            if (!info.valid()) return;
+            seen.insert(info.name);
+
+            auto & config = agentConfigJson[info.name];
+            if (config.first != info.config) {
+                config.first = info.config;
+                config.second = info.config->toJson();
+            }
+
+            Json::Value & result = agentsInfo[info.name];
+            result["config"] = config.second;
+            result["stats"] = info.stats->toJson();
+        };
+
+    forEachAgent(onAgent);
+
+    for (auto it = agentConfigJson.begin(); it != agentConfigJson.end();) {
+        if (seen.count(it->first)) ++it;
+        else it = agentConfigJson.erase(it);
+    }
+
+    agentsSnapshot.update(agentsInfo);
 }
 
 void
@@ -1464,6 +2195,9 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
     if (!info || !info->auction)
         throw ML::Exception("augmentAuction with no auction to augment");
 
+    AuctionUsage::Meter meter(info->auction->usage.get(),
+                              AuctionUsage::AUGMENT);
+
     if (info->auction->tooLate()) {
         recordHit("tooLateBeforeAdd");
         return;
@@ -1471,19 +2205,49 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
 
     auto onDoneAugmenting = [=] (const std::shared_ptr<AugmentationInfo> & info)
         {
+            AuctionUsage::Meter meter(info->auction->usage.get(),
+                                      AuctionUsage::AUGMENT);
+
             info->auction->doneAugmenting = Date::now();
+            info->auction->budget.endStage(LatencyBudget::AUGMENT,
+                                           info->auction->doneAugmenting);
+            this->stageLatencies[RS_AUGMENT].record(
+                    info->auction->doneAugmenting.secondsSince(
+                            info->auction->outOfPrepro) * 1000000.0);
 
             if (info->auction->tooLate()) {
                 this->recordHit("tooLateAfterAugmenting");
                 return;
             }
 
-            // Send it off to be farmed out to the bidders
-            startBiddingBuffer.push(info);
-            wakeupMainLoop.signal();
+            // Send it off to be farmed out to the bidders by the shard
+            // that owns the auction
+            RouterShard & shard = this->shardFor(info->auction->id);
+            shard.startBiddingBuffer.push(info);
+            shard.wakeup.signal();
         };
 
-    augmentationLoop.augment(info, Date::now().plusSeconds(augmentationWindow.count()),
+    // Augmenting can only use the part of the budget that the agents don't
+    // need to bid.
+    double bidReserveMs = std::numeric_limits<double>::max();
+    for (const auto & group : info->potentialGroups)
+        for (const auto & bidder : group)
+            bidReserveMs = std::min<double>(bidReserveMs,
+                                            bidder.config->minTimeAvailableMs);
+
+    Date now = Date::now();
+    double augmentBudgetMs = std::min(
+            info->auction->budget.remainingMs(now) - bidReserveMs,
+            augmentationWindow.count() * 1000.0);
+
+    if (augmentBudgetMs <= 0) {
+        // No time to augment; bid with what we have.
+        recordHit("augmentationSkipped.noBudget");
+        onDoneAugmenting(info);
+        return;
+    }
+
+    augmentationLoop.augment(info, now.plusSeconds(augmentBudgetMs / 1000.0),
                              onDoneAugmenting);
 }
 
@@ -1493,6 +2257,8 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
 {
     ML::atomic_inc(numAuctions);
 
+    AuctionUsage::Meter meter(auction->usage.get(), AuctionUsage::FILTER);
+
     Date now = Date::now();
     auction->inPrepro = now;
 
@@ -1539,13 +2305,16 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
 
     if (traceAuction) {
         forEachAgent([&] (const AgentInfoEntry& info) {
-                    ML::atomic_inc(info.stats->intoFilters);
+                    info.stats->increment(AgentStats::INTO_FILTERS);
                     doFilterStat(*info.config, "intoStaticFilters");
                 });
     }
 
     // Do the actual filtering.
+    double beforeFilters = getProfilingTime();
     auto biddableConfigs = filters.filter(*auction->request, exchangeConnector);
+    stageLatencies[RS_FILTER].record(
+            microsecondsBetween(getProfilingTime(), beforeFilters));
 
     auto checkAgent = [&] (
             const AgentConfig & config,
@@ -1566,7 +2335,7 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
             if (config.minTimeAvailableMs != 0.0
                 && timeLeftMs < config.minTimeAvailableMs)
             {
-                ML::atomic_inc(stats.notEnoughTime);
+                stats.increment(AgentStats::NOT_ENOUGH_TIME);
                 doFilterStat(config, "static.notEnoughTime");
                 return false;
             }
@@ -1574,24 +2343,25 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
             return true;
         };
 
-    for (const auto& entry : biddableConfigs) {
+    for (auto& entry : biddableConfigs) {
         if (entry.biddableSpots.empty()) continue;
         if (!checkAgent(*entry.config, *entry.status, *entry.stats)) continue;
 
-        ML::atomic_inc(entry.stats->passedStaticFilters);
+        entry.stats->increment(AgentStats::PASSED_STATIC_FILTERS);
         doFilterStat(*entry.config, "passedStaticFilters");
 
-        string rrGroup = entry.config->roundRobinGroup;
-        if (rrGroup == "") rrGroup = entry.name;
+        const string & rrGroup = entry.config->roundRobinGroup.empty()
+            ? entry.name : entry.config->roundRobinGroup;
+        GroupPotentialBidders & group = groupAgents[rrGroup];
 
-        PotentialBidder bidder;
+        group.emplace_back();
+        PotentialBidder & bidder = group.back();
         bidder.agent = entry.name;
         bidder.config = entry.config;
         bidder.stats = entry.stats;
         bidder.imp = std::move(entry.biddableSpots);
 
-        groupAgents[rrGroup].push_back(bidder);
-        groupAgents[rrGroup].totalBidProbability += entry.config->bidProbability;
+        group.totalBidProbability += entry.config->bidProbability;
     }
 
 
@@ -1609,7 +2379,8 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
                 float val = (random() % 1000000) / 1000000.0;
                 if (val > bidProbability) {
                     for (unsigned i = 0;  i < it->second.size();  ++i)
-                        ML::atomic_inc(it->second[i].stats->skippedBidProbability);
+                        it->second[i].stats->increment(
+                                AgentStats::SKIPPED_BID_PROBABILITY);
                     continue;
                 }
             }
@@ -1617,7 +2388,7 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
 
         // Group is valid for bidding; next step is to augment the bid
         // request
-        validGroups.push_back(it->second);
+        validGroups.push_back(std::move(it->second));
     }
 
     this->recordLevel(validGroups.size(), "potentialBiddersPerRequest");
@@ -1637,9 +2408,11 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
     info->potentialGroups.swap(validGroups);
 
     auction->outOfPrepro = Date::now();
+    auction->budget.endStage(LatencyBudget::FILTER, auction->outOfPrepro);
 
-    recordOutcome(auction->outOfPrepro.secondsSince(auction->inPrepro) * 1000.0,
-                  "preprocessAuctionTimeMs");
+    double preproTime = auction->outOfPrepro.secondsSince(auction->inPrepro);
+    stageLatencies[RS_PREPROCESS].record(preproTime * 1000000.0);
+    recordOutcome(preproTime * 1000.0, "preprocessAuctionTimeMs");
 
     return info;
 }
@@ -1650,19 +2423,25 @@ doStartBidding(const std::vector<std::string> & message)
 {
     std::shared_ptr<AugmentationInfo> augInfo
         = sharedPtrFromMessage<AugmentationInfo>(message.at(2));
-    doStartBidding(augInfo);
+    RouterShard & shard = shardFor(augInfo->auction->id);
+    shard.startBiddingBuffer.push(augInfo);
+    shard.wakeup.signal();
 }
 
 void
 Router::
-doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
+doStartBidding(RouterShard & shard,
+               const std::shared_ptr<AugmentationInfo> & augInfo)
 {
     //static const char *fName = "Router::doStartBidding:";
-    RouterProfiler profiler(dutyCycleCurrent.nsStartBidding);
+    RouterProfiler profiler(dutyCycleCurrent.nsStartBidding,
+                            &stageLatencies[RS_START_BIDDING]);
+    AuctionUsage::Meter meter(augInfo->auction->usage.get(),
+                              AuctionUsage::AGENT_SEND);
 
     try {
         Id auctionId = augInfo->auction->id;
-        if (inFlight.count(auctionId)) {
+        if (shard.inFlight.count(auctionId)) {
             throwException("doStartBidding.alreadyInFlight",
                            "auction with ID %s already in progress",
                            auctionId.toString().c_str());
@@ -1677,9 +2456,11 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
         //cerr << "doStartBidding " << auctionId << endl;
 
-        auto groupAgents = augInfo->potentialGroups;
+        // We're the last ones to look at the groups so they're modified in
+        // place.
+        auto & groupAgents = augInfo->potentialGroups;
 
-        AuctionInfo & auctionInfo = addAuction(augInfo->auction,
+        AuctionInfo & auctionInfo = addAuction(shard, augInfo->auction,
                                                augInfo->lossTimeout);
         auto auction = augInfo->auction;
 
@@ -1692,7 +2473,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
         bool traceAuction = auction->id.hash() % 10 == 0;
 
-        const auto& augList = augInfo->auction->augmentations;
+        const AugmentationIndex augIndex(augInfo->auction->augmentations);
 
         /* For each round-robin group, send the request off to exactly one
            element. */
@@ -1730,7 +2511,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
                 /* Check if we have too many in flight. */
                 if (info.numBidsInFlight() >= info.config->maxInFlight) {
-                    ++info.stats->tooManyInFlight;
+                    info.stats->increment(AgentStats::TOO_MANY_IN_FLIGHT);
                     bidder.inFlightProp = PotentialBidder::NULL_PROP;
                     doFilterStat("dynamic.tooManyInFlight");
                     continue;
@@ -1773,7 +2554,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                         lock.unlock();
                     }
 
-                    ML::atomic_inc(info.stats->notEnoughTime);
+                    info.stats->increment(AgentStats::NOT_ENOUGH_TIME);
                     bidder.inFlightProp = PotentialBidder::NULL_PROP;
                     doFilterStat("dynamic.notEnoughTime");
                     doFilterMetric("metric.timeUsedBeforeDynamicFilter",
@@ -1795,9 +2576,10 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                 /* Filter on the augmentation tags */
                 bool filteredByAugmentation = false;
                 for (const auto& augConfig : config.augmentations) {
-                    auto it = augList.find(augConfig.name);
+                    auto tags = augIndex.tagsForAccount(augConfig.name,
+                                                        config.account);
 
-                    if (it == augList.end()) {
+                    if (!tags) {
                         if (!augConfig.required) continue;
                         string stat = "dynamic." + augConfig.name + ".missing";
                         doFilterStat(stat.c_str());
@@ -1805,10 +2587,9 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                         break;
                     }
 
-                    vector<string> tags = it->second.tagsForAccount(config.account);
-                    if (augConfig.filters.anyIsIncluded(tags)) continue;
+                    if (augConfig.filters.anyIsIncluded(*tags)) continue;
 
-                    ML::atomic_inc(info.stats->augmentationTagsExcluded);
+                    info.stats->increment(AgentStats::AUGMENTATION_TAGS_EXCLUDED);
                     string stat = "dynamic." + augConfig.name + ".tags";
                     doFilterStat(stat.c_str());
                     filteredByAugmentation = true;
@@ -1821,23 +2602,49 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                 if (config.hasBlacklist()
                     && blacklist.matches(*auction->request, bidder.agent,
                                          config)) {
-                    ML::atomic_inc(info.stats->userBlacklisted);
+                    info.stats->increment(AgentStats::USER_BLACKLISTED);
                     doFilterStat("dynamic.userBlacklisted");
                     continue;
                 }
 
+                /* Skip the agents that are very unlikely to bid on it,
+                   except for some exploration. */
+                if (info.bidPredictor) {
+                    if (auctionInfo.bidFeatures.empty())
+                        auctionInfo.bidFeatures
+                            = BidPredictor::extractFeatures(*auction->request);
+                    double probability
+                        = info.bidPredictor->predict(auctionInfo.bidFeatures);
+                    float val = (random() % 1000000) / 1000000.0;
+                    if (probability < config.bidPredictionThreshold
+                        && val >= config.bidPredictionExploration) {
+                        doFilterStat("dynamic.predictedNoBid");
+                        continue;
+                    }
+                }
+
                 bidder.inFlightProp
                     = info.numBidsInFlight() / max(info.config->maxInFlight, 1);
 
-                ML::atomic_inc(info.stats->passedDynamicFilters);
+                info.stats->increment(AgentStats::PASSED_DYNAMIC_FILTERS);
                 doFilterStat("passedDynamicFilters");
             }
 
-            // Sort the roundrobin infos to find the best one
-            std::sort(bidders.begin(), bidders.end());
+            // Find the round robin infos which are equally the best one,
+            // without moving the bidders around.
+            auto & best = shard.bestBidders;
+            best.clear();
 
-            int numBest = 1;
-            float bestInFlightProp = bidders[0].inFlightProp;
+            float bestInFlightProp = PotentialBidder::NULL_PROP;
+            for (unsigned i = 0;  i < bidders.size();  ++i) {
+                float inFlightProp = bidders[i].inFlightProp;
+                if (inFlightProp > bestInFlightProp) continue;
+                if (inFlightProp < bestInFlightProp) {
+                    best.clear();
+                    bestInFlightProp = inFlightProp;
+                }
+                best.push_back(i);
+            }
 
             if (bestInFlightProp == PotentialBidder::NULL_PROP) {
                 // Excluded because too many in flight
@@ -1845,18 +2652,9 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                 continue;
             }
 
-            for (;  numBest < bidders.size();  ++numBest) {
-                float inFlightProp = bidders[numBest].inFlightProp;
-                if (inFlightProp <= bestInFlightProp) continue;
-                break;
-            }
-
             // Take a random one from all which are equally good
-            int best = random() % numBest;
-
-            // Best one is the first one
-            PotentialBidder & winner = bidders[best];
-            string agent = winner.agent;
+            PotentialBidder & winner = bidders[best[random() % best.size()]];
+            const string & agent = winner.agent;
 
             if (!agents.count(agent)) {
                 //cerr << "!!!AGENT IS GONE" << endl;
@@ -1864,21 +2662,22 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
             }
             AgentInfo & info = agents[agent];
 
-            ++info.stats->auctions;
+            info.stats->increment(AgentStats::AUCTIONS);
 
-            Json::Value aggregatedAug;
-            for (const auto& aug : augList) {
-                aggregatedAug[aug.first] =
-                    aug.second.filterForAccount(winner.config->account).toJson();
-            }
-            auction->agentAugmentations[agent] = chomp(aggregatedAug.toString());
+            const auto & projection = winner.config->bidRequestProjection;
+            auction->agentAugmentations[agent] = augIndex.serializeForAccount(
+                    winner.config->account,
+                    [&] (const string & augmentor)
+                    {
+                        return projection.includesAugmentor(augmentor);
+                    });
 
             //auctionInfo.activities.push_back("sent to " + agent);
 
             BidInfo bidInfo;
             bidInfo.agentConfig = winner.config;
             bidInfo.bidTime = Date::now();
-            bidInfo.imp = winner.imp;
+            bidInfo.imp = std::move(winner.imp);
 
             auctionInfo.bidders.insert(make_pair(agent, std::move(bidInfo)));  // create empty bid response
             if (!info.trackBidInFlight(auctionId, bidInfo.bidTime))
@@ -1907,7 +2706,7 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
         else {
             /* No bidders; don't bother with the bid */
             ML::atomic_inc(numNoBidders);
-            inFlight.erase(auctionId);
+            shard.inFlight.erase(auctionId);
             //cerr << fName << "About to call finish " << endl;
             if (!auction->finish()) {
                 recordHit("tooLateToFinish");
@@ -1925,27 +2724,37 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
 AuctionInfo &
 Router::
-addAuction(std::shared_ptr<Auction> auction, Date lossTimeout)
+addAuction(RouterShard & shard,
+           std::shared_ptr<Auction> auction, Date lossTimeout)
 {
     const Id & id = auction->id;
 
     double bidMemoryWindow = 5.0;  // how many seconds we remember auctions
 
-    try {
-        AuctionInfo & result
-            = inFlight.insert(id, AuctionInfo(auction, lossTimeout),
-                              getCurrentTime().plusSeconds(bidMemoryWindow));
-        return result;
-    } catch (const std::exception & exc) {
-        //cerr << "====================================" << endl;
-        //cerr << exc.what() << endl;
+    if (!shard.inFlight.emplace(id, AuctionInfo(auction, lossTimeout),
+                                getCurrentTime().plusSeconds(bidMemoryWindow)))
+    {
         throwException("addAuction.alreadyInProgress",
-                       "auction with ID %s already in progress: %s",
-                       id.toString().c_str(), exc.what());
+                       "auction with ID %s already in progress",
+                       id.toString().c_str());
     }
+
+    return shard.inFlight.get(id);
 }
 
 
+static const char * localResultTraceType(Auction::WinLoss result)
+{
+    switch (result.val) {
+    case Auction::WinLoss::PENDING: return "LOCAL PENDING";
+    case Auction::WinLoss::WIN:     return "LOCAL WIN";
+    case Auction::WinLoss::LOSS:    return "LOCAL LOSS";
+    case Auction::WinLoss::TOOLATE: return "LOCAL TOOLATE";
+    case Auction::WinLoss::INVALID: return "LOCAL INVALID";
+    default:                        return "LOCAL UNKNOWN";
+    }
+}
+
 static bool failBid(double proportion)
 {
     if (proportion < 0.01)
@@ -1982,30 +2791,50 @@ doBid(const std::vector<std::string> & message)
 
     Bids bids;
     try {
-        bids = Bids::fromJson(biddata);
+        bids = Bids::parse(biddata);
     }
     catch (const std::exception & exc) {
-        auto it = inFlight.find(auctionId);
-        if (it == inFlight.end()) {
+        RouterShard & shard = shardFor(auctionId);
+        RouterShard::Guard guard(shard.lock);
+        if (!shard.inFlight.count(auctionId)) {
             recordHit("bidError.unknownAuction");
             returnErrorResponse(message, "unknown auction");
             return;
         }
         else {
-            returnInvalidBid(agent, biddata, it->second.auction,
+            returnInvalidBid(agent, biddata, shard.inFlight.get(auctionId).auction,
                     "bidParseError",
-                    "couldn't parse bid JSON %s: %s", biddata.c_str(), exc.what());
+                    "couldn't parse bids %s: %s",
+                    Bids::isBinary(biddata) ? "<binary>" : biddata.c_str(),
+                    exc.what());
         }
         return;
     }
     bidMessage.bids = std::move(bids);
 
-    doBidImpl(bidMessage, message);
+    if (!tryPushBid(std::move(bidMessage), std::vector<std::string>(message))) {
+        recordHit("bidError.shardQueueFull");
+        returnErrorResponse(message, "router can't keep up with bids");
+    }
+}
+
+void
+Router::
+recordAccountHit(const AgentInfo & info,
+                 const AgentConfig & config,
+                 StatHandle AccountStatHandles::* handle,
+                 const char * event) const
+{
+    if (auto stats = info.accountStatsFor(config))
+        (stats->*handle).record();
+    else recordHit("accounts.%s.%s", config.account.toString('.'), event);
 }
 
 void
 Router::
-doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMessage)
+doBidImpl(RouterShard & shard,
+          const BidMessage &message,
+          const std::vector<std::string> &originalMessage)
 {
     Date dateGotBid = Date::now();
 
@@ -2017,14 +2846,15 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     ExcAssert(!message.agents.empty());
 
     const auto& auctionId = message.auctionId;
-    auto it = inFlight.find(auctionId);
-    if (it == inFlight.end()) {
+    if (!shard.inFlight.count(auctionId)) {
         recordHit("bidError.unknownAuction");
         returnErrorResponse(originalMessage, "unknown auction");
         return;
     }
 
-    AuctionInfo & auctionInfo = it->second;
+    AuctionInfo & auctionInfo = shard.inFlight.get(auctionId);
+    AuctionUsage::Meter meter(auctionInfo.auction->usage.get(),
+                              AuctionUsage::BID);
 
     for (const auto &agent: message.agents) {
         if (!agents.count(agent)) {
@@ -2048,7 +2878,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             return;
         }
         auto & config = *biddersIt->second.agentConfig;
-        recordHit("accounts.%s.bids", config.account.toString('.'));
+        recordAccountHit(info, config, &AccountStatHandles::bids, "bids");
     }
 
 
@@ -2069,7 +2899,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     BidInfo bidInfo(std::move(biddersIt->second));
 
-    RouterProfiler profiler(dutyCycleCurrent.nsBid);
+    RouterProfiler profiler(dutyCycleCurrent.nsBid, &stageLatencies[RS_BID]);
 
     ML::atomic_inc(numBids);
 
@@ -2082,6 +2912,10 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     this->recordLevel(bids.size(), "bidsPerBidRequest");
 
+    // Compiled on the first real bid so that the model is only looked up
+    // and parsed once per message.
+    std::shared_ptr<const WinCostModel::Compiled> wcm;
+
     for (int i = 0; i < bids.size(); ++i) {
 
         Bid bid = bids[i];
@@ -2172,7 +3006,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             + agent;
 
         // authorize an amount of money computed from the win cost model.
-        Amount price = message.wcm.evaluate(bid, bid.price);
+        if (!wcm) wcm = message.wcm.compile();
+        Amount price = wcm->evaluate(bid, bid.price, Json::Value());
 
         if (!monitorClient.getStatus(slowModeTolerance)) {
             Date now = Date::now();
@@ -2196,7 +3031,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
                     slowModePeriodicSpentReached = true;
                     bidder->sendBidDroppedMessage(agentConfig, agent, auctionInfo.auction);
                     recordHit("slowMode.droppedBid");
-                    recordHit("accounts.%s.IGNORED", config.account.toString('.'));
+                    recordAccountHit(info, config,
+                                     &AccountStatHandles::ignored, "IGNORED");
                 continue;
                 }
             }
@@ -2206,15 +3042,16 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             slowModePeriodicSpentReached = false;
         }
 
-        if (!banker->authorizeBid(config.account, auctionKey, price) || failBid(budgetErrorRate))
+        if (!banker->authorizeBid(config.accountKeyId(), auctionKey, price) || failBid(budgetErrorRate))
         {
-            ++info.stats->noBudget;
+            info.stats->increment(AgentStats::NO_BUDGET);
 
             bidder->sendNoBudgetMessage(agentConfig, agent, auctionInfo.auction);
 
             if (analytics) analytics->logNoBudgetMessage(agent, auctionId, bidsString, message.meta);
             this->logMessageToAnalytics("NOBUDGET", agent, auctionId);
-            recordHit("accounts.%s.NOBUDGET", config.account.toString('.'));
+            recordAccountHit(info, config,
+                             &AccountStatHandles::noBudget, "NOBUDGET");
             continue;
         }
         
@@ -2222,17 +3059,17 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
         recordCount(price.value, "cummulatedAuthorizedPrice");
 
 
-        if (doDebug)
-            this->debugSpot(auctionId, imp[spotIndex].id,
-                    ML::format("BID %s %s %f",
-                            auctionKey.c_str(),
-                            bid.price.toString().c_str(),
-                            (double)bid.priority));
+        this->debugSpot(auctionId, imp[spotIndex].id, "BID", agent,
+                        bid.price.value);
 
         std::string meta;
         if (!bid.ext.isNull()) meta = bid.ext.toStringNoNewLine();
         else meta = message.meta;
 
+#ifndef NDEBUG
+        uint64_t copiesBefore = Auction::Response::copiesOnThisThread();
+#endif
+
         Auction::Response response(
                 Auction::Price(bid.price, bid.priority),
                 creative.id,
@@ -2249,7 +3086,14 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
         response.creativeName = creative.name;
 
         Auction::WinLoss localResult
-            = auctionInfo.auction->setResponse(spotIndex, response);
+            = auctionInfo.auction->setResponse(spotIndex, std::move(response));
+
+#ifndef NDEBUG
+        // The only ones left are those of the other agents' responses when
+        // the auction data is replaced.
+        recordLevel(Auction::Response::copiesOnThisThread() - copiesBefore,
+                    "bid.responseCopies");
+#endif
 
         ++numValidBids;
 
@@ -2261,47 +3105,48 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
         string msg = Auction::Response::print(localResult);
 
-        if (doDebug)
-            this->debugSpot(auctionId, imp[spotIndex].id,
-                    ML::format("BID %s %s",
-                            auctionKey.c_str(), msg.c_str()));
+        this->debugSpot(auctionId, imp[spotIndex].id,
+                        localResultTraceType(localResult), agent);
 
 
         switch (localResult.val) {
         case Auction::WinLoss::PENDING: {
-            ++info.stats->bids;
-            info.stats->totalBid += bid.price;
+            info.stats->increment(AgentStats::BIDS);
+            info.stats->addBid(bid.price);
             break; // response will be sent later once local winning bid known
         }
         case Auction::WinLoss::LOSS:
-            ++info.stats->bids;
-            info.stats->totalBid += bid.price;
+            info.stats->increment(AgentStats::BIDS);
+            info.stats->addBid(bid.price);
             // fall through
         case Auction::WinLoss::TOOLATE:
         case Auction::WinLoss::INVALID: {
             if (localResult.val == Auction::WinLoss::TOOLATE)
-                ++info.stats->tooLate;
+                info.stats->increment(AgentStats::TOO_LATE);
             else if (localResult.val == Auction::WinLoss::INVALID)
-                ++info.stats->invalid;
+                info.stats->increment(AgentStats::INVALID);
 
-            banker->cancelBid(config.account, auctionKey);
+            banker->cancelBid(config.accountKeyId(), auctionKey);
 
             BidStatus status;
             switch (localResult.val) {
             case Auction::WinLoss::LOSS:
                 status = BS_LOSS;
                 bidder->sendLossMessage(agentConfig, agent, auctionId.toString ());
-                recordHit("accounts.%s.LOCAL_LOSS", config.account.toString('.'));
+                recordAccountHit(info, config,
+                                 &AccountStatHandles::localLoss, "LOCAL_LOSS");
                 break;
             case Auction::WinLoss::TOOLATE:
                 status = BS_TOOLATE;
                 bidder->sendTooLateMessage(agentConfig, agent, auctionInfo.auction);
-                recordHit("accounts.%s.TOOLATE", config.account.toString('.'));
+                recordAccountHit(info, config,
+                                 &AccountStatHandles::tooLate, "TOOLATE");
                 continue;
             case Auction::WinLoss::INVALID:
                 status = BS_INVALID;
                 bidder->sendBidInvalidMessage(agentConfig, agent, msg, auctionInfo.auction);
-                recordHit("accounts.%s.INVALID", config.account.toString('.'));
+                recordAccountHit(info, config,
+                                 &AccountStatHandles::invalid, "INVALID");
                 break;
             default:
                 throw ML::Exception("logic error");
@@ -2322,6 +3167,10 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     }
 
+    if (info.bidPredictor && !auctionInfo.bidFeatures.empty())
+        info.bidPredictor->train(auctionInfo.bidFeatures,
+                                 numPassedBids < bids.size());
+
     if (numValidBids > 0) {
         if (logBids) {
             if (analytics) analytics->logBidMessage(agent, auctionId, bidsString, message.meta);
@@ -2354,12 +3203,12 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
 
     if (auctionInfo.bidders.empty()) {
-        debugAuction(auctionId, "FINISH", originalMessage);
+        debugAuction(auctionId, "FINISH");
         if (!auctionInfo.auction->finish()) {
-            debugAuction(auctionId, "FINISH TOO LATE", originalMessage);
+            debugAuction(auctionId, "FINISH TOO LATE");
             recordHit("accounts.%s.FINISH_TOOLATE", agentConfig->account.toString('.'));
         }
-        inFlight.erase(auctionId);
+        shard.inFlight.erase(auctionId);
         //cerr << "couldn't finish auction " << auctionInfo.auction->id
         //<< " after bid " << message << endl;
     }
@@ -2376,7 +3225,9 @@ doSubmitted(std::shared_ptr<Auction> auction)
     // Either a) move it across to the win queue, or b) drop it if we
     // didn't bid anything
 
-    RouterProfiler profiler(dutyCycleCurrent.nsSubmitted);
+    RouterProfiler profiler(dutyCycleCurrent.nsSubmitted,
+                            &stageLatencies[RS_SUBMITTED]);
+    AuctionUsage::Meter meter(auction->usage.get(), AuctionUsage::SUBMIT);
 
     const Id & auctionId = auction->id;
 
@@ -2394,10 +3245,7 @@ doSubmitted(std::shared_ptr<Auction> auction)
     const std::vector<std::vector<Auction::Response> > & allResponses
         = auction->getResponses();
 
-    if (doDebug)
-        debugAuction(auctionId, ML::format("SUBMITTED %d slots",
-                                           (int)allResponses.size()),
-                     {});
+    debugAuction(auctionId, "SUBMITTED", "", allResponses.size());
 
     //ExcAssertEqual(allResponses.size(),
     //               auction->bidRequest->imp.size());
@@ -2411,9 +3259,7 @@ doSubmitted(std::shared_ptr<Auction> auction)
         const std::vector<Auction::Response> & responses
             = allResponses[spotNum];
 
-        if (doDebug)
-            debugSpot(auctionId, spotId,
-                      ML::format("has %zd bids", responses.size()));
+        debugSpot(auctionId, spotId, "SPOT BIDS", "", responses.size());
 
         // For all but the winning bid we tell them what's going on
         for (unsigned i = 0;  i < responses.size();  ++i) {
@@ -2448,7 +3294,7 @@ doSubmitted(std::shared_ptr<Auction> auction)
             ML::Call_Guard guard
                 ([&] ()
                  {
-                     banker->cancelBid(response.agentConfig->account, auctionKey);
+                     banker->cancelBid(response.agentConfig->accountKeyId(), auctionKey);
                  });
 
             // No bid
@@ -2473,28 +3319,27 @@ doSubmitted(std::shared_ptr<Auction> auction)
                                "auction should not be invalid");
             case Auction::WinLoss::LOSS:
                 bidStatus = BS_LOSS;
-                ++info.stats->losses;
+                info.stats->increment(AgentStats::LOSSES);
                 msg = "LOSS";
                 bidder->sendLossMessage(agentConfig, response.agent, auctionId.toString());
-                recordHit("accounts.%s.LOCAL_LOSS", agentConfig->account.toString('.'));
+                recordAccountHit(info, *agentConfig,
+                                 &AccountStatHandles::localLoss, "LOCAL_LOSS");
                 break;
             case Auction::WinLoss::TOOLATE:
                 bidStatus = BS_TOOLATE;
-                ++info.stats->tooLate;
+                info.stats->increment(AgentStats::TOO_LATE);
                 msg = "TOOLATE";
                 bidder->sendTooLateMessage(agentConfig, response.agent, auction);
-                recordHit("accounts.%s.TOOLATE", agentConfig->account.toString('.'));
+                recordAccountHit(info, *agentConfig,
+                                 &AccountStatHandles::tooLate, "TOOLATE");
                 break;
             default:
                 throwException("doSubmitted.unknownStatus",
                                "unknown auction local status");
             };
 
-            if (doDebug)
-                debugSpot(auctionId, spotId,
-                          ML::format("%s %s",
-                                     msg.c_str(),
-                                     auctionKey.c_str()));
+            debugSpot(auctionId, spotId, bidStatusToChar(bidStatus),
+                      response.agent);
         }
 
         // If we didn't actually submit a bid then nothing else to do
@@ -2510,17 +3355,38 @@ doSubmitted(std::shared_ptr<Auction> auction)
 
     //cerr << "auction.use_count() = " << auction.use_count() << endl;
 
+    if (auction->usage) {
+        meter.stop();
+        recordUsage(*auction, allResponses);
+    }
+
     if (auction.unique()) {
         auctionGraveyard.tryPush(auction);
     }
 }
 
+void
+Router::
+recordUsage(const Auction & auction,
+            const std::vector<std::vector<Auction::Response> > & responses)
+{
+    usageByExchange.add(auction.request->exchange, *auction.usage);
+
+    std::set<std::string> auctionAgents;
+    for (const auto & spotResponses : responses)
+        for (const Auction::Response & response : spotResponses)
+            auctionAgents.insert(response.agent);
+
+    for (const std::string & agent : auctionAgents)
+        usageByAgent.add(agent, *auction.usage);
+}
+
 std::string
 reduceUrl(const Url & url)
 {
     static const boost::regex rex(".*://(www.)?([^/]+)");
     boost::match_results<string::const_iterator> mr;
-    string s = url.toString();
+    const string & s = url.spec();
     if (!boost::regex_search(s, mr, rex)) {
         //cerr << "warning: nothing matched in URL " << url << endl;
         return s;
@@ -2555,6 +3421,14 @@ onNewAuction(std::shared_ptr<Auction> auction)
         }
     }
 
+    if (impressionDedup && !impressionDedup->admit(*auction->request)) {
+        recordHit("auctionDropped.duplicateImpression");
+        recordHit("exchange.%s.duplicateImpressions",
+                  auction->request->exchange.c_str());
+        auction->finish();
+        return;
+    }
+
     //cerr << "AUCTION GOT THROUGH" << endl;
 
     if (logAuctions) {
@@ -2594,9 +3468,21 @@ onAuctionDone(std::shared_ptr<Auction> auction)
 #endif
 
     debugAuction(auction->id, "SENT SUBMITTED");
+
+    if (admissionControl)
+        admissionController.recordAuction(*auction);
+
     submittedBuffer.push(auction);
 }
 
+void
+Router::
+injectAgentMessage(std::vector<std::string> message)
+{
+    agentMessageBuffer.push(std::move(message));
+    wakeupMainLoop.signal();
+}
+
 void
 Router::
 onAuctionError(const std::string & channel,
@@ -2613,6 +3499,71 @@ onAuctionError(const std::string & channel,
     }
 }
 
+AllAgentInfo::
+AllAgentInfo()
+    : agentIndex(new AgentIndex()),
+      accountIndex(new AccountIndex()),
+      size_(0)
+{
+}
+
+void
+AllAgentInfo::
+add(AgentInfoEntry entry)
+{
+    int index = size_++;
+    (*agentIndex)[entry.name] = index;
+    (*accountIndex)[entry.config->accountKeyId()].push_back(index);
+
+    if (chunks.empty() || chunks.back()->size() == ChunkSize) {
+        chunks.push_back(std::make_shared<Chunk>());
+        chunks.back()->reserve(ChunkSize);
+    }
+    chunks.back()->push_back(std::move(entry));
+}
+
+void
+AllAgentInfo::
+replace(size_t index, AgentInfoEntry entry)
+{
+    ExcAssertLess(index, size_);
+
+    // Only the router thread creates versions so a chunk that nobody else
+    // holds can't become shared behind our back.
+    auto & chunk = chunks[index / ChunkSize];
+    if (chunk.use_count() > 1)
+        chunk = std::make_shared<Chunk>(*chunk);
+
+    (*chunk)[index % ChunkSize] = std::move(entry);
+}
+
+namespace {
+
+AgentInfoEntry
+makeAgentInfoEntry(const std::string & name, const AgentInfo & info)
+{
+    AgentInfoEntry entry;
+    entry.name = name;
+    entry.filterIndex = info.filterIndex;
+    entry.config = info.config;
+    entry.stats = info.stats;
+    entry.status = info.status;
+    return entry;
+}
+
+} // file scope
+
+bool
+Router::
+isPublished(const AgentInfo & info)
+{
+    return info.configured
+        && info.config
+        && info.stats
+        && info.status
+        && !info.status->dead;
+}
+
 void
 Router::
 updateAllAgents()
@@ -2624,23 +3575,8 @@ updateAllAgents()
         AllAgentInfo * current = allAgents;
 
         for (auto it = agents.begin(), end = agents.end();  it != end;  ++it) {
-            if (!it->second.configured) continue;
-            if (!it->second.config) continue;
-            if (!it->second.stats) continue;
-            if (!it->second.status) continue;
-            if (it->second.status->dead) continue;
-
-            AgentInfoEntry entry;
-            entry.name = it->first;
-            entry.filterIndex = it->second.filterIndex;
-            entry.config = it->second.config;
-            entry.stats = it->second.stats;
-            entry.status = it->second.status;
-            int i = newInfo->size();
-            newInfo->push_back(entry);
-
-            newInfo->agentIndex[it->first] = i;
-            newInfo->accountIndex[it->second.config->account].push_back(i);
+            if (!isPublished(it->second)) continue;
+            newInfo->add(makeAgentInfoEntry(it->first, it->second));
         }
 
         if (ML::cmp_xchg(allAgents, current, newInfo.get())) {
@@ -2651,30 +3587,144 @@ updateAllAgents()
             break;
         }
     }
+
+    updateNumBiddableAgents();
+    wakeStatusThread();
+}
+
+void
+Router::
+updateAllAgents(const std::set<std::string> & changed)
+{
+    for (;;) {
+
+        AllAgentInfo * current = allAgents;
+        if (!current) {
+            updateAllAgents();
+            return;
+        }
+
+        // Shares the chunks and indexes of the current version
+        auto_ptr<AllAgentInfo> newInfo(new AllAgentInfo(*current));
+
+        for (const auto & name : changed) {
+            auto it = agents.find(name);
+            bool published = it != agents.end() && isPublished(it->second);
+
+            auto jt = current->agentIndex->find(name);
+            bool indexed = jt != current->agentIndex->end();
+
+            if (!published && !indexed)
+                continue;
+
+            // The indexes would change; start again from scratch
+            if (published != indexed
+                || current->at(jt->second).config->accountKeyId()
+                   != it->second.config->accountKeyId()) {
+                recordHit("allAgents.fullUpdate");
+                updateAllAgents();
+                return;
+            }
+
+            newInfo->replace(jt->second, makeAgentInfoEntry(name, it->second));
+        }
+
+        if (ML::cmp_xchg(allAgents, current, newInfo.get())) {
+            newInfo.release();
+            ExcAssertNotEqual(current, allAgents);
+            allAgentsGc.defer([=] () { delete current; });
+            break;
+        }
+    }
+
+    recordHit("allAgents.incrementalUpdate");
+    updateNumBiddableAgents();
+    wakeStatusThread();
+}
+
+void
+Router::
+updateNumBiddableAgents()
+{
+    // Let each exchange know how many agents can bid on its traffic, so
+    // that it can drop requests without parsing them when there are none.
+    forAllExchanges([&] (const std::shared_ptr<ExchangeConnector> & exchange) {
+            auto name = exchange->exchangeName();
+            int numAgents = 0;
+            allAgents->forEach([&] (const AgentInfoEntry & entry) {
+                    std::lock_guard<ML::Spinlock> guard(entry.config->lock);
+                    if (entry.config->providerData.count(name))
+                        ++numAgents;
+                });
+            exchange->setNumBiddableAgents(numAgents);
+        });
 }
 
 void
 Router::
 doConfig(const std::string & agent,
          std::shared_ptr<const AgentConfig> config)
+{
+    doConfigs({ { agent, config } });
+}
+
+void
+Router::
+doConfigs(const std::map<std::string,
+                         std::shared_ptr<const AgentConfig> > & configs,
+          const std::map<std::string, int> & changedSections)
 {
     RouterProfiler profiler(dutyCycleCurrent.nsConfig);
 
-    if (!config) {
-        auto it = agents.find(agent);
-        // It might happen that we don't find the agent if for example we received
-        // an empty configuration because the agent crashed prior to sending its initial
-        // configuration to the ACS.
-        if (it != std::end(agents)) {
-            cerr << "agent " << agent << " lost configuration" << endl;
-            filters.removeConfig(agent);
-            agents.erase(it);
+    // The shards read the agents map; keep them out whilst we change it
+    AllShardsGuard guard(shards);
+
+    std::vector<std::string> removed;
+    std::vector<std::pair<std::string, const AgentInfo *> > added;
+    std::vector<std::pair<std::string, const AgentInfo *> > refreshed;
+    std::set<std::string> changed;
+
+    for (const auto & entry : configs) {
+        const std::string & agent = entry.first;
+        const auto & config = entry.second;
+        changed.insert(agent);
+
+        if (!config) {
+            auto it = agents.find(agent);
+            // It might happen that we don't find the agent if for example we received
+            // an empty configuration because the agent crashed prior to sending its initial
+            // configuration to the ACS.
+            if (it != std::end(agents)) {
+                cerr << "agent " << agent << " lost configuration" << endl;
+                removed.push_back(agent);
+                agents.erase(it);
+            }
+            continue;
         }
-    } else {
+
         AgentInfo & info = agents[agent];
         if (analytics) analytics->logConfigMessage(agent, boost::trim_copy(config->toJson().toString()));
         logMessageToAnalytics("CONFIG", agent, boost::trim_copy(config->toJson().toString()));
 
+        // When only the bid control changed, the creatives and targeting
+        // that the exchanges and filters were set up with are still good
+        auto sections = changedSections.find(agent);
+        if (info.configured && sections != changedSections.end()
+            && (sections->second & ~AgentConfig::BID_CONTROL) == 0) {
+            auto newConfig = std::make_shared<AgentConfig>(*info.config);
+            newConfig->copyBidControl(*config);
+            info.config = newConfig;
+
+            auto accountStats
+                = std::make_shared<AccountStatHandles>(*info.accountStats);
+            accountStats->config = newConfig.get();
+            info.accountStats = accountStats;
+
+            bidder->sendMessage(config, agent, "GOTCONFIG");
+            refreshed.emplace_back(agent, &info);
+            continue;
+        }
+
         // TODO: no need for this...
         auto newConfig = std::make_shared<AgentConfig>(*config);
         if (newConfig->roundRobinGroup == "")
@@ -2690,18 +3740,47 @@ doConfig(const std::string & agent,
         //cerr << "configured " << agent << " strategy : " << info.config->strategy << " campaign "
         //     <<  info.config->campaign << endl;
 
-        string bidRequestFormat = "jsonRaw";
-        info.setBidRequestFormat(bidRequestFormat);
+        info.setBidRequestFormat(newConfig->bidRequestFormat);
+
+        // The model is kept across reconfigurations
+        if (newConfig->bidPredictionThreshold <= 0.0)
+            info.bidPredictor.reset();
+        else if (!info.bidPredictor)
+            info.bidPredictor = std::make_shared<BidPredictor>();
+
+        auto accountStats = std::make_shared<AccountStatHandles>();
+        accountStats->config = newConfig.get();
+        std::string account = newConfig->account.toString('.');
+        auto accountHandle = [&] (const char * event)
+            {
+                return getStatHandleFmt(ET_HIT, "accounts.%s.%s",
+                                        account.c_str(), event);
+            };
+        accountStats->bids = accountHandle("bids");
+        accountStats->ignored = accountHandle("IGNORED");
+        accountStats->noBudget = accountHandle("NOBUDGET");
+        accountStats->localLoss = accountHandle("LOCAL_LOSS");
+        accountStats->tooLate = accountHandle("TOOLATE");
+        accountStats->invalid = accountHandle("INVALID");
+        info.accountStats = accountStats;
 
         configure(agent, *newConfig);
         info.configured = true;
         bidder->sendMessage(config, agent, "GOTCONFIG");
 
-        info.filterIndex = filters.addConfig(agent, info);
+        added.emplace_back(agent, &info);
+    }
+
+    if (!removed.empty() || !added.empty() || !refreshed.empty()) {
+        auto indexes = filters.updateConfigs(removed, added, refreshed);
+        for (size_t i = 0;  i < added.size();  ++i)
+            agents[added[i].first].filterIndex = indexes[i];
     }
 
-    // Broadcast that we have a new agent or it has a new configuration
-    updateAllAgents();
+    recordCount(configs.size(), "configsPerBatch");
+
+    // Broadcast that we have new agents or new configurations
+    updateAllAgents(changed);
 }
 
 void
@@ -2719,7 +3798,10 @@ configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
 {
     auto name = exchange->exchangeName();
 
-    auto ecomp = exchange->getCampaignCompatibility(config, includeReasons);
+    auto ecomp = compatibilityCache.get
+        (CompatibilityCache::campaignKey(name, config, includeReasons),
+         [&] () { return exchange->getCampaignCompatibility(config,
+                                                            includeReasons); });
     if(!ecomp.isCompatible) {
         cerr << "campaign not compatible: " << ecomp.reasons << endl;
         this->recordHit("%s.compaignNotCompatible", name);
@@ -2729,7 +3811,10 @@ configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
     int numCompatibleCreatives = 0;
 
     for(auto & c : config.creatives) {
-        auto ccomp = exchange->getCreativeCompatibility(c, includeReasons);
+        auto ccomp = compatibilityCache.get
+            (CompatibilityCache::creativeKey(name, c, includeReasons),
+             [&] () { return exchange->getCreativeCompatibility(c,
+                                                                includeReasons); });
         if(!ccomp.isCompatible) {
             cerr << "creative not compatible: " << ccomp.reasons << endl;
             this->recordHit("%s.creativeNotCompatible", name);
@@ -2792,6 +3877,54 @@ getStats() const
 #endif
 }
 
+void
+Router::
+setAuctionUsageSampling(unsigned everyN)
+{
+    Guard guard(lock);
+
+    auctionUsageSampling = everyN;
+    for (auto & exchange : exchanges)
+        exchange->usageSampling = everyN;
+}
+
+Json::Value
+Router::
+getAuctionUsage() const
+{
+    Json::Value result;
+    result["sampling"] = auctionUsageSampling;
+    result["byExchange"] = usageByExchange.toJson();
+    result["byAgent"] = usageByAgent.toJson();
+    return result;
+}
+
+Json::Value
+Router::
+getRequestCapture(const std::string & exchange) const
+{
+    for (auto & connector : exchanges) {
+        if (connector->exchangeName() == exchange)
+            return connector->getRequestCaptureStatus();
+    }
+    throw ML::Exception("unknown exchange " + exchange);
+}
+
+void
+Router::
+setRequestCapture(const std::string & exchange, const Json::Value & config)
+{
+    bool found = false;
+    for (auto & connector : exchanges) {
+        if (connector->exchangeName() == exchange) {
+            connector->configureRequestCapture(config);
+            found = true;
+        }
+    }
+    if (!found)
+        throw ML::Exception("unknown exchange " + exchange);
+}
+
 Json::Value
 Router::
 getAgentInfo(const std::string & agent) const
@@ -2881,7 +4014,7 @@ forEachAgent(const OnAgentFn & onAgent) const
     const AllAgentInfo * ac = allAgents;
     if (!ac) return;
 
-    std::for_each(ac->begin(), ac->end(), onAgent);
+    ac->forEach(onAgent);
 }
 
 void
@@ -2893,8 +4026,8 @@ forEachAccountAgent(const AccountKey & account,
     const AllAgentInfo * ac = allAgents;
     if (!ac) return;
 
-    auto it = ac->accountIndex.find(account);
-    if (it == ac->accountIndex.end())
+    auto it = ac->accountIndex->find(AccountKeyId::find(account));
+    if (it == ac->accountIndex->end())
         return;
 
     for (auto jt = it->second.begin(), jend = it->second.end();
@@ -2910,8 +4043,8 @@ getAgentEntry(const std::string & agent) const
     const AllAgentInfo * ac = allAgents;
     if (!ac) return AgentInfoEntry();
 
-    auto it = ac->agentIndex.find(agent);
-    if (it == ac->agentIndex.end())
+    auto it = ac->agentIndex->find(agent);
+    if (it == ac->agentIndex->end())
         return AgentInfoEntry();
     return ac->at(it->second);
 }
@@ -2983,64 +4116,30 @@ throwException(const std::string & key, const std::string & fmt, ...)
     throw ML::Exception("Router Exception: " + key + ": " + message);
 }
 
-void
-Router::
-debugAuctionImpl(const Id & auctionId, const std::string & type,
-                 const std::vector<std::string> & args)
-{
-    Date now = Date::now();
-    boost::unique_lock<ML::Spinlock> guard(debugLock);
-    AuctionDebugInfo & entry
-        = debugInfo.access(auctionId, now.plusSeconds(30.0));
-
-    entry.addAuctionEvent(now, type, args);
-}
-
-void
+Json::Value
 Router::
-debugSpotImpl(const Id & auctionId, const Id & spotId, const std::string & type,
-              const std::vector<std::string> & args)
+traceAuction(const Id & auctionId) const
 {
-    Date now = Date::now();
-    boost::unique_lock<ML::Spinlock> guard(debugLock);
-    AuctionDebugInfo & entry
-        = debugInfo.access(auctionId, now.plusSeconds(30.0));
-
-    entry.addSpotEvent(spotId, now, type, args);
+    return AuctionTracer::instance().timeline(auctionId);
 }
 
 void
 Router::
-expireDebugInfo()
+exportTraces()
 {
-    boost::unique_lock<ML::Spinlock> guard(debugLock);
-    debugInfo.expire();
-}
+    auto & tracer = AuctionTracer::instance();
+    if (!tracer.enabled())
+        return;
 
-void
-Router::
-dumpAuction(const Id & auctionId) const
-{
-    boost::unique_lock<ML::Spinlock> guard(debugLock);
-    auto it = debugInfo.find(auctionId);
-    if (it == debugInfo.end()) {
-        //cerr << "*** unknown auction " << auctionId << " in "
-        //     << debugInfo.size() << endl;
-    }
-    else it->second.dumpAuction();
-}
+    auto onEvent = [&] (const AuctionTraceEvent & event)
+        {
+            logMessageToAnalytics("TRACE", serviceName(),
+                                  event.toJson().toStringNoNewLine());
+        };
 
-void
-Router::
-dumpSpot(const Id & auctionId, const Id & spotId) const
-{
-    boost::unique_lock<ML::Spinlock> guard(debugLock);
-    auto it = debugInfo.find(auctionId);
-    if (it == debugInfo.end()) {
-        //cerr << "*** unknown auction " << auctionId << " in "
-        //     << debugInfo.size() << endl;
-    }
-    else it->second.dumpSpot(spotId);
+    uint64_t lost = tracer.drain(onEvent);
+    if (lost)
+        recordCount(lost, "trace.lostEvents");
 }
 
 /** MonitorProvider interface */
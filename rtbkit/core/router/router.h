@@ -17,21 +17,31 @@
 #include "jml/utils/filter_streams.h"
 #include "soa/service/zmq_named_pub_sub.h"
 #include "soa/service/socket_per_thread.h"
-#include "soa/service/timeout_map.h"
+#include "rtbkit/core/post_auction/timeout_map.h"
 #include "soa/service/pending_list.h"
 #include "soa/service/loop_monitor.h"
+#include "soa/service/process_stats.h"
+#include "soa/service/rest_request_router.h"
 #include "augmentation_loop.h"
+#include "profiler.h"
+#include "admission_controller.h"
+#include "impression_dedup.h"
 #include "router_types.h"
 #include "soa/gc/gc_lock.h"
 #include "jml/utils/ring_buffer.h"
 #include "jml/arch/wakeup_fd.h"
 #include "jml/utils/smart_ptr_utils.h"
 #include <unordered_set>
+#include <map>
+#include <set>
 #include <thread>
+#include <mutex>
 #include "rtbkit/common/exchange_connector.h"
+#include "rtbkit/common/auction_tracer.h"
 #include "rtbkit/common/post_auction_proxy.h"
 #include "rtbkit/common/analytics_publisher.h"
 #include "rtbkit/core/agent_configuration/blacklist.h"
+#include "rtbkit/core/agent_configuration/frequency_cap.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "rtbkit/core/monitor/monitor_provider.h"
@@ -67,34 +77,215 @@ struct AgentInfoEntry {
 /** A read-only structure with information about all of the agents so
     that auctions can scan them without worrying about data dependencies.
     Uses RCU.
+
+    The entries are stored in chunks which, like the indexes, are shared
+    between versions: publishing a new configuration for a few agents only
+    copies the chunks that hold them.
+*/
+struct AllAgentInfo {
+    enum { ChunkSize = 64 };
+
+    typedef std::vector<AgentInfoEntry> Chunk;
+    typedef std::unordered_map<std::string, int> AgentIndex;
+    typedef std::unordered_map<AccountKeyId, std::vector<int> > AccountIndex;
+
+    AllAgentInfo();
+
+    size_t size() const { return size_; }
+
+    const AgentInfoEntry & at(size_t index) const
+    {
+        return chunks.at(index / ChunkSize)->at(index % ChunkSize);
+    }
+
+    template<typename Fn>
+    void forEach(Fn && fn) const
+    {
+        for (const auto & chunk : chunks)
+            for (const auto & entry : *chunk)
+                fn(entry);
+    }
+
+    /** Add an entry along with its indexes.  Only used when building a new
+        version from scratch.
+    */
+    void add(AgentInfoEntry entry);
+
+    /** Replace the entry at the given index, copying its chunk first if it
+        belongs to another version.  The name and account must not change
+        as the indexes are kept.
+    */
+    void replace(size_t index, AgentInfoEntry entry);
+
+    std::vector<std::shared_ptr<Chunk> > chunks;
+    std::shared_ptr<AgentIndex> agentIndex;
+    std::shared_ptr<AccountIndex> accountIndex;
+
+private:
+    size_t size_;
+};
+
+/*****************************************************************************/
+/* ROUTER SHARD                                                              */
+/*****************************************************************************/
+
+/** A slice of the router's auction processing.  Auctions are hashed on
+    their id onto a shard, which owns their in-flight entries and the
+    queues that feed doStartBidding and doBidImpl for them.
+
+    With a single shard, the shard is serviced inline by the router's main
+    loop.  With more than one, each shard gets its own thread.
+
+    The shard lock is held whilst the shard is processing; the main loop
+    takes every shard lock (see AllShardsGuard) before it changes the
+    structure of the agents map, so that the shards can read it freely.
+*/
+struct RouterShard {
+    RouterShard(unsigned index)
+        : index(index),
+          inFlightMemory("router.inFlight"),
+          startBiddingBuffer(65536),
+          doBidBuffer(65536)
+    {
+    }
+
+    typedef std::mutex Lock;
+    typedef std::unique_lock<Lock> Guard;
+
+    /** Bid message along with the raw agent message it came from, if
+        any, so that errors can be sent back to the agent. */
+    typedef std::pair<BidMessage, std::vector<std::string> > QueuedBid;
+
+    unsigned index;
+
+    /** List of auctions this shard is currently tracking as active. */
+    typedef RTBKIT::TimeoutMap<Id, AuctionInfo, IdHash> InFlight;
+    InFlight inFlight;
+
+    /** Memory held by inFlight, updated whenever it's expired. */
+    Datacratic::MemoryGauge inFlightMemory;
+
+    ML::RingBufferSRMW<std::shared_ptr<AugmentationInfo> > startBiddingBuffer;
+    ML::RingBufferSRMW<QueuedBid> doBidBuffer;
+
+    /** Scratch space for doStartBidding to pick the winner of each round
+        robin group; reused to avoid allocating per auction.
+    */
+    std::vector<unsigned> bestBidders;
+
+    ML::Wakeup_Fd wakeup;
+
+    mutable Lock lock;
+
+    /** Thread running the shard; null if it's serviced by the main loop. */
+    std::unique_ptr<std::thread> thread;
+};
+
+/** Holds the lock of every shard, always acquired in index order. */
+struct AllShardsGuard {
+    AllShardsGuard(const std::vector<std::unique_ptr<RouterShard> > & shards)
+    {
+        guards.reserve(shards.size());
+        for (auto & shard : shards)
+            guards.emplace_back(shard->lock);
+    }
+
+    std::vector<RouterShard::Guard> guards;
+};
+
+
+/*****************************************************************************/
+/* COMPATIBILITY CACHE                                                       */
+/*****************************************************************************/
+
+/** Results of the exchanges' campaign and creative compatibility checks,
+    keyed on the exchange name and a hash of the JSON of what was checked.
+    A config push then only runs the checks for the campaigns and creatives
+    that changed, and a creative shared by several agents is checked once.
+
+    Entries are kept in two generations: once the current one holds
+    maxEntries, it becomes the previous one and the oldest is dropped.  An
+    entry found in the previous generation moves back to the current one.
 */
-struct AllAgentInfo : public std::vector<AgentInfoEntry> {
-    std::unordered_map<std::string, int> agentIndex;
-    std::unordered_map<AccountKey, std::vector<int> > accountIndex;
+struct CompatibilityCache {
+    typedef ExchangeConnector::ExchangeCompatibility Result;
+
+    CompatibilityCache(size_t maxEntries = 100000)
+        : maxEntries(maxEntries)
+    {
+    }
+
+    /** Key of the campaign of the config on the exchange. */
+    static uint64_t campaignKey(const std::string & exchange,
+                                const AgentConfig & config,
+                                bool includeReasons);
+
+    /** Key of the creative on the exchange. */
+    static uint64_t creativeKey(const std::string & exchange,
+                                const Creative & creative,
+                                bool includeReasons);
+
+    /** Return the result for the key, computing it with compute() if it
+        isn't cached.  Thread-safe; compute() is called without the lock
+        held.
+    */
+    Result get(uint64_t key, const std::function<Result ()> & compute);
+
+    /** Forget every result, eg when an exchange is added or replaced. */
+    void clear();
+
+    size_t size() const;
+
+    size_t maxEntries;
+
+private:
+    mutable std::mutex lock;
+    std::unordered_map<uint64_t, Result> current;
+    std::unordered_map<uint64_t, Result> previous;
 };
 
+
 /*****************************************************************************/
-/* DEBUG INFO                                                                */
+/* STATUS SNAPSHOT                                                           */
 /*****************************************************************************/
 
-struct AuctionDebugInfo {
-    void addAuctionEvent(Date date, std::string type,
-                         const std::vector<std::string> & args);
-    void addSpotEvent(const Id & spot, Date date, std::string type,
-                      const std::vector<std::string> & args);
-    void dumpAuction() const;
-    void dumpSpot(Id spot) const;
-
-    struct Message {
-        Date timestamp;
-        Id spot;
-        std::string type;
-        std::vector<std::string> args;
+/** Serialized version of a status document that is rebuilt from time to
+    time and served as is, so that polling it costs nothing to the router.
+    Each version has an ETag, a hash of its body, which lets clients with
+    a current copy get a 304 instead of the document.
+
+    Thread-safe: readers get the version that was current when they asked
+    and never wait on an update.
+*/
+struct StatusSnapshot {
+
+    struct Entry {
+        std::string body;   ///< Serialized JSON document
+        std::string etag;   ///< Quoted, as it goes in the ETag header
     };
 
-    std::vector<Message> messages;
+    /** Publish a new version of the document.  The current one is kept,
+        with its ETag, if the body didn't change.  Returns whether it did.
+    */
+    bool update(const Json::Value & document);
+
+    /** Current version; null until the first update(). */
+    std::shared_ptr<const Entry> get() const
+    {
+        return std::atomic_load(&current);
+    }
+
+    /** Whether the value of an If-None-Match header designates the
+        version with the given ETag.
+    */
+    static bool matches(const std::string & ifNoneMatch,
+                        const std::string & etag);
+
+private:
+    std::shared_ptr<const Entry> current;
 };
 
+
 /*****************************************************************************/
 /* ROUTER                                                                    */
 /*****************************************************************************/
@@ -151,12 +342,53 @@ struct Router : public ServiceBase,
     /** Initialize exchages from json configuration. */
     void initExchanges(const Json::Value & config);
 
+    /** Initialize the augmentors that run in the router from a json array
+        of { "type": ..., "name": ..., "cacheTtl": ... } objects; the whole
+        object is passed on to the augmentor factory.  Must be called before
+        start().
+    */
+    void initAugmentors(const Json::Value & config);
+
     /** Initialize filters from json configuration. */
     void initFilters(const Json::Value & config = Json::Value::null);
 
+    /** Count the wins of each user for each account from the post auction
+        loop's MATCHEDWIN events so that the FrequencyCap filter can cap
+        them without an augmentor.  The config is passed on to the
+        FrequencyCapStore.  Called by initFilters() when its config has a
+        "frequency-caps" member.  Must be called before start().
+    */
+    void initFrequencyCaps(const Json::Value & config = Json::Value());
+
+    /** Drop the copies of an impression that reach us through several
+        exchanges before they are filtered and augmented.  The config is
+        passed on to the ImpressionDedup.  Called by initFilters() when its
+        config has an "impression-dedup" member.  Must be called before
+        start().
+    */
+    void initImpressionDedup(const Json::Value & config = Json::Value());
+
     /** Initialize analytics from json configuration. */
     void initAnalytics(const Json::Value & config = Json::Value::null);
 
+    /** Keep the last known agent configurations in the given file and,
+        if it's less than maxAge seconds old, start from them instead of
+        waiting for the agent configuration service to push them all.  The
+        filters are built from them like for any other configuration.  The
+        live configurations replace them as they arrive and the cached
+        agents that the service still hasn't confirmed after reconcileDelay
+        seconds are removed.  Must be called before start().
+    */
+    void initConfigCache(const std::string & filename,
+                         double maxAge = 3600.0,
+                         double reconcileDelay = 60.0);
+
+    /** Set the number of shards that auctions are spread over.  Each shard
+        past the first runs on its own thread.  Must be called before
+        init().
+    */
+    void setNumShards(unsigned numShards);
+
     /** Initialize all of the internal data structures and configuration. */
     void init();
 
@@ -219,6 +451,8 @@ struct Router : public ServiceBase,
     */
     void connectExchange(ExchangeConnector & exchange)
     {
+        admissionController.addExchange(&exchange);
+        exchange.usageSampling = auctionUsageSampling;
         exchange.onNewAuction  = [=] (std::shared_ptr<Auction> a) {
                         this->injectAuction(a, secondsUntilLossAssumed_); };
         exchange.onAuctionDone = [=] (std::shared_ptr<Auction> a) {
@@ -358,15 +592,46 @@ struct Router : public ServiceBase,
     /** Return the number of auctions awaiting a win/loss message. */
     int numAuctionsAwaitingResult() const;
 
+    /** Return the number of auctions that are in flight over all shards. */
+    size_t numInFlight() const;
+
     /** Return a stats object that tells us what's going on. */
     Json::Value getStats() const;
 
+    /** Return the latency percentiles of each stage of the router since it
+        started.
+    */
+    Json::Value getStageLatencies() const;
+
+    /** Measure the CPU time and allocations of each stage for one auction
+        in everyN, or stop measuring if it's zero.  Applies to the exchanges
+        owned by the router and those added afterwards.
+    */
+    void setAuctionUsageSampling(unsigned everyN);
+
+    /** Return the usage of each stage per sampled auction, by exchange and
+        by agent (see AuctionUsage).
+    */
+    Json::Value getAuctionUsage() const;
+
+    /** Return the state of the request capture of the given exchange. */
+    Json::Value getRequestCapture(const std::string & exchange) const;
+
+    /** Change the request capture of the given exchange while running.  See
+        RequestCapture for the configuration.
+    */
+    void setRequestCapture(const std::string & exchange,
+                           const Json::Value & config);
+
     /** Return information about a given agent. */
     Json::Value getAgentInfo(const std::string & agent) const;
 
     /** Return information about all agents. */
     Json::Value getAllAgentInfo() const;
 
+    /** Return the events traced for the given auction by this process. */
+    Json::Value traceAuction(const Id & auctionId) const;
+
     /** Return information about all agents bidding on the given
         account. */
     Json::Value getAccountInfo(const AccountKey & account) const;
@@ -384,6 +649,16 @@ struct Router : public ServiceBase,
     */
     void setBudgetErrorRate(double val) { budgetErrorRate = val; }
 
+    /** Replace the load stabilizer's single accept probability with the
+        admission controller, which adapts each exchange's probability to
+        the router's backpressure.  Must be called before start().
+    */
+    void enableAdmissionControl(size_t maxInFlight = 0)
+    {
+        admissionControl = true;
+        admissionController.maxInFlight = maxInFlight;
+    }
+
     /** Auction accept probability */
     void setAcceptAuctionProbability(double val)
     {
@@ -396,10 +671,30 @@ struct Router : public ServiceBase,
     /** Return service status. */
     virtual Json::Value getServiceStatus() const;
 
+    /** Return the latest getServiceStatus() and getAllAgentInfo()
+        documents, as serialized by the status thread.  They are built on
+        the spot if the thread hasn't produced one yet.
+    */
+    std::shared_ptr<const StatusSnapshot::Entry>
+    getServiceStatusSnapshot() const;
+
+    std::shared_ptr<const StatusSnapshot::Entry>
+    getAllAgentInfoSnapshot() const;
+
+    /** Seconds between two refreshes of the status snapshots, which are
+        also refreshed when the agents change.  Must be called before
+        start().
+    */
+    void setStatusRefreshInterval(double seconds)
+    {
+        statusRefreshInterval = seconds;
+    }
+
     /** Function to override if other behaviour than sending a response to
         the post auction loop is desired.
     */
-    std::function<void (std::shared_ptr<Auction>, Id, Auction::Response)>
+    std::function<void (std::shared_ptr<Auction>, Id,
+                        const Auction::Response &)>
         onSubmittedAuction;
 
     /** Function to pass a submitted auction on to the post auction loop.
@@ -417,6 +712,10 @@ protected:
     // don't have to run in the main loop
     boost::scoped_ptr<boost::thread> cleanupThread;
 
+    // This thread rebuilds the status snapshots served to monitoring, so
+    // that polling them doesn't touch the bidding threads
+    boost::scoped_ptr<boost::thread> statusThread;
+
     typedef std::recursive_mutex Lock;
     typedef std::unique_lock<Lock> Guard;
 
@@ -426,48 +725,182 @@ public:
     // Connection to the post auction loop
     PostAuctionProxy postAuctionEndpoint;
 
+    /** Publish a new version of allAgents built from scratch. */
     void updateAllAgents();
 
+    /** Publish a new version of allAgents in which only the given agents
+        changed.  Falls back to a full rebuild when agents appear, disappear
+        or change account.
+    */
+    void updateAllAgents(const std::set<std::string> & changed);
+
+    /** Seconds during which configuration changes are accumulated before
+        being applied together.  Zero applies them as they arrive.
+    */
+    void setConfigBatchWindow(double seconds) { configBatchWindow = seconds; }
+
+    /** Tell each exchange how many agents can bid on its traffic. */
+    void updateNumBiddableAgents();
+
+    /** Queue a message from an agent that came in through another channel
+        than the agents bus, such as a shared memory ring.  It's handled by
+        the main loop like the ones from the bus.  Thread safe.
+    */
+    void injectAgentMessage(std::vector<std::string> message);
+
     /** Map from the configured name of the agent to the agent info. */
     typedef std::map<std::string, AgentInfo> Agents;
     Agents agents;
 
-    ML::RingBufferSRMW<std::pair<std::string, std::shared_ptr<const AgentConfig> > > configBuffer;
+    /// Configuration from the listener, with the AgentConfig::Section mask
+    /// of what changed
+    struct ConfigChange {
+        std::string agent;
+        std::shared_ptr<const AgentConfig> config;
+        int changedSections;
+    };
+
+    ML::RingBufferSRMW<ConfigChange> configBuffer;
+
+    /// Configuration changes waiting for the batch window to close
+    std::map<std::string, std::shared_ptr<const AgentConfig> > pendingConfigs;
+    /// Sections changed by each of the pendingConfigs
+    std::map<std::string, int> pendingSections;
+    Date firstPendingConfig;
+    double configBatchWindow;
+
+    /// See setStatusRefreshInterval()
+    double statusRefreshInterval;
+    /// Futex bumped to have the status thread refresh the snapshots
+    std::atomic<int> statusSignal;
+
+    mutable StatusSnapshot serviceStatusSnapshot;
+    mutable StatusSnapshot agentsSnapshot;
+
+    /// JSON of each agent's config, rebuilt only when the config changes.
+    /// Only used by the status thread.
+    std::map<std::string,
+             std::pair<std::shared_ptr<const AgentConfig>, Json::Value> >
+        agentConfigJson;
+
+    void runStatusThread();
+    void refreshStatusSnapshots();
+    void wakeStatusThread();
+
+    /// See initConfigCache()
+    std::string configCacheFile;
+    double configCacheMaxAge;
+    bool configCacheDirty;
+    Date lastConfigCacheSave;
+
+    /// Agents loaded from the cache that the agent configuration service
+    /// hasn't confirmed yet, and when to give up on them
+    std::set<std::string> unconfirmedAgents;
+    Date reconcileCachedConfigs;
+
+    /** Apply the configurations of the cache; returns how many there were. */
+    size_t loadConfigCache();
+
+    /** Write the current configurations to the cache. */
+    void saveConfigCache();
     ML::RingBufferSRMW<std::shared_ptr<ExchangeConnector> > exchangeBuffer;
-    ML::RingBufferSRMW<std::shared_ptr<AugmentationInfo> > startBiddingBuffer;
     ML::RingBufferSRMW<std::shared_ptr<Auction> > submittedBuffer;
+    ML::RingBufferSRMW<std::vector<std::string> > agentMessageBuffer;
     ML::RingBufferSWMR<std::shared_ptr<Auction> > auctionGraveyard;
-    ML::RingBufferSRMW<BidMessage> doBidBuffer;
 
     ML::Wakeup_Fd wakeupMainLoop;
 
     FilterPool filters;
+    Datacratic::MemoryGauge filtersMemory;
 
     AugmentationLoop augmentationLoop;
     Blacklist blacklist;
 
+    /** Impressions seen lately, if initImpressionDedup() was called. */
+    std::unique_ptr<ImpressionDedup> impressionDedup;
+
+    /** Wins per user and account, if initFrequencyCaps() was called. */
+    std::shared_ptr<FrequencyCapStore> frequencyCaps;
+    std::unique_ptr<ZmqNamedMultipleSubscriber> winEvents;
+
+    /** Record a MATCHEDWIN message of the post auction loop's logger. */
+    void recordWinEvent(const std::vector<zmq::message_t> & message);
+
     LoopMonitor loopMonitor;
     LoadStabilizer loadStabilizer;
 
-    /** List of auctions we're currently tracking as active. */
-    typedef TimeoutMap<Id, AuctionInfo> InFlight;
-    InFlight inFlight;
+    /** Auction shards.  The shard for an auction is given by shardFor(). */
+    unsigned numShards;
+    std::vector<std::unique_ptr<RouterShard> > shards;
+
+    RouterShard & shardFor(const Id & auctionId) const
+    {
+        return *shards[auctionId.hash() % shards.size()];
+    }
 
-    /** Add the given auction to our data structures. */
+    /** Queue a bid for processing by the shard that owns its auction.
+        Returns false if the shard's queue is full.  Can be called from any
+        thread.
+    */
+    bool tryPushBid(BidMessage && message,
+                    std::vector<std::string> && originalMessage
+                        = std::vector<std::string>());
+
+    /** Add the given auction to the shard's data structures. */
     AuctionInfo &
-    addAuction(std::shared_ptr<Auction> auction, Date timeout);
+    addAuction(RouterShard & shard,
+               std::shared_ptr<Auction> auction, Date timeout);
 
     DutyCycleEntry dutyCycleCurrent;
     std::vector<DutyCycleEntry> dutyCycleHistory;
 
+    /// Latency distribution of each stage since the router started
+    LatencyHistogram stageLatencies[NUM_ROUTER_STAGES];
+
+    /// Snapshot of stageLatencies when they were last logged
+    LatencyHistogram::Snapshot lastStageLatencies[NUM_ROUTER_STAGES];
+
+    /** Record the percentiles of each stage's latency since the last call. */
+    void logStageLatencies();
+
+    /// One auction in this many has its usage measured; none if zero
+    unsigned auctionUsageSampling;
+
+    /// Usage of the sampled auctions, added up when they are submitted
+    AuctionUsageTotals usageByExchange;
+    AuctionUsageTotals usageByAgent;
+
+    /** Add the usage of a sampled auction to its exchange and to each of
+        the agents that it was sent to.
+    */
+    void recordUsage(const Auction & auction,
+                     const std::vector<std::vector<Auction::Response> >
+                         & responses);
+
     void run();
 
+    /** Loop for a shard that has its own thread. */
+    void runShard(RouterShard & shard);
+
+    /** Process everything queued up for the given shard.  The shard lock
+        must be held.
+    */
+    void processShard(RouterShard & shard);
+
     void handleAgentMessage(const std::vector<std::string> & message);
 
     void checkDeadAgents();
 
+    /** Expire router-wide structures, as well as the in flight auctions of
+        the shard serviced by the main loop if there is one.
+    */
     void checkExpiredAuctions();
 
+    /** Expire the in flight auctions of the given shard.  The shard lock
+        must be held.
+    */
+    void checkExpiredAuctions(RouterShard & shard);
+
     void returnErrorResponse(const std::vector<std::string> & message,
                              const std::string & error);
 
@@ -498,8 +931,11 @@ public:
     */
     void doStartBidding(const std::vector<std::string> & message);
 
-    /** Ditto but taking the augmented auction directly. */
-    void doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo);
+    /** Ditto but taking the augmented auction directly.  Must be called
+        with the lock of the auction's shard held.
+    */
+    void doStartBidding(RouterShard & shard,
+                        const std::shared_ptr<AugmentationInfo> & augInfo);
 
     /** Auction has been submitted.  Do the final cleanup here and send
         it off to the post auction loop. */
@@ -510,9 +946,22 @@ public:
     /** An agent bid on an auction.  Arrange for this bid to be recorded. */
     void doBid(const std::vector<std::string> & message);
 
-    void doBidImpl(const BidMessage &message,
+    /** Record a bid.  Must be called with the lock of the auction's shard
+        held.
+    */
+    void doBidImpl(RouterShard & shard,
+                   const BidMessage &message,
                    const std::vector<std::string> &originalMessage = std::vector<std::string>());
 
+    /** Record a hit of accounts.<account>.<event> for a bid made with the
+        given configuration, through the agent's handle for it unless the
+        agent was reconfigured since.
+    */
+    void recordAccountHit(const AgentInfo & info,
+                          const AgentConfig & config,
+                          StatHandle AccountStatHandles::* handle,
+                          const char * event) const;
+
     /** An agent responded to a ping message.  Arrange for the ping time
         to be recorded. */
     void doPong(int level, const std::vector<std::string> & message);
@@ -540,6 +989,23 @@ public:
     void doConfig(const std::string & agent,
                   std::shared_ptr<const AgentConfig> config);
 
+    /** Apply a batch of configuration messages at once.  A null config
+        means that the agent lost its configuration.
+
+        An agent whose changedSections are only AgentConfig::BID_CONTROL
+        keeps its creatives, exchange compatibility and filter state; agents
+        that aren't in changedSections are fully reconfigured.
+    */
+    void doConfigs(const std::map<std::string,
+                                  std::shared_ptr<const AgentConfig> > & configs,
+                   const std::map<std::string, int> & changedSections = {});
+
+    /** Whether the agent should be part of allAgents. */
+    static bool isPublished(const AgentInfo & info);
+
+    /** Compatibility of the campaigns and creatives already configured. */
+    CompatibilityCache compatibilityCache;
+
     /* Add a given agent (with the given configuration) to the exchange */
     void configureAgentOnExchange(std::shared_ptr<ExchangeConnector> const & exchange,
                                   std::string const & agent,
@@ -733,50 +1199,47 @@ public:
     /* DEBUGGING                                                             */
     /*************************************************************************/
 
-    void debugAuction(const Id & auctionId, const std::string & type,
-                      const std::vector<std::string> & args
-                      = std::vector<std::string>())
+    /** Record an event in the trace of the auction, if it's sampled (see
+        AuctionTracer).  The type must be a string literal.
+    */
+    void debugAuction(const Id & auctionId, const char * type,
+                      const std::string & actor = "", double value = 0.0)
     {
-        if (JML_LIKELY(!doDebug)) return;
-        debugAuctionImpl(auctionId, type, args);
+        AuctionTracer::instance().record(auctionId, type, actor, value);
     }
 
-    void debugAuctionImpl(const Id & auctionId, const std::string & type,
-                          const std::vector<std::string> & args);
-
     void debugSpot(const Id & auctionId,
                    const Id & spotId,
-                   const std::string & type,
-                   const std::vector<std::string> & args
-                       = std::vector<std::string>())
+                   const char * type,
+                   const std::string & actor = "",
+                   double value = 0.0)
     {
-        if (JML_LIKELY(!doDebug)) return;
-        debugSpotImpl(auctionId, spotId, type, args);
+        AuctionTracer::instance().recordSpot(auctionId, spotId, type,
+                                             actor, value);
     }
 
-    void debugSpotImpl(const Id & auctionId,
-                       const Id & spotId,
-                       const std::string & type,
-                       const std::vector<std::string> & args);
-
-    void expireDebugInfo();
-
-    void dumpAuction(const Id & auctionId) const;
-    void dumpSpot(const Id & auctionId, const Id & spotId) const;
+    /** Publish the events traced since the last call on the TRACE channel
+        of the analytics publisher.
+    */
+    void exportTraces();
 
     Date getCurrentTime() const { return Date::now(); }
 
     std::unique_ptr<Analytics> analytics;
     AnalyticsPublisher analyticsPublisher;
 
-    /** Debug only */
-    bool doDebug;
-
     /* Disable auction probability for testing only : don't drop any BR*/ 
     bool disableAuctionProb;
 
-    mutable ML::Spinlock debugLock;
-    TimeoutMap<Id, AuctionDebugInfo> debugInfo;
+    bool admissionControl;
+    AdmissionController admissionController;
+
+    /** Runtime control of the router, only created when the routerREST
+        port ranges are configured.
+    */
+    void initRestEndpoint();
+    std::unique_ptr<RestServiceEndpoint> restEndpoint;
+    std::unique_ptr<RestRequestRouter> restRouter;
 
     uint64_t numAuctions;
     uint64_t numBids;
@@ -34,8 +34,21 @@ doGet(const std::string& resource)
 {
     if (header.resource == "/stats")
         sendResponse(router->getStats());
+    else if (header.resource == "/latency")
+        sendResponse(router->getStageLatencies());
+    else if (header.resource == "/usage")
+        sendResponse(router->getAuctionUsage());
+    else if (header.resource == "/status") {
+        auto snapshot = router->getServiceStatusSnapshot();
+        sendSnapshot(snapshot->body, snapshot->etag);
+    }
     else if (header.resource == "/agents") {
-        sendResponse(router->getAllAgentInfo());
+        auto snapshot = router->getAllAgentInfoSnapshot();
+        sendSnapshot(snapshot->body, snapshot->etag);
+    }
+    else if (header.resource.find("/trace/") == 0) {
+        string auctionId(header.resource, 7);
+        sendResponse(router->traceAuction(Id(auctionId)));
     }
     else if (header.resource.find("/agent/") == 0) {
         string agentName(header.resource, 7);
@@ -55,6 +68,34 @@ doGet(const std::string& resource)
     }
 }
 
+void
+RouterRestApiConnection::
+sendSnapshot(const std::string & body, const std::string & etag)
+{
+    auto onSendFinished = [=] {
+        this->transport().associateWhenHandlerFinished
+        (std::make_shared<RouterRestApiConnection>(this->name(), this->router),
+         "sendSnapshot");
+    };
+
+    string ifNoneMatch = header.tryGetHeader("if-none-match");
+    bool notModified = StatusSnapshot::matches(ifNoneMatch, etag);
+
+    send(ML::format("HTTP/1.1 %s\r\n"
+                    "Content-Type: application/json\r\n"
+                    "Access-Control-Allow-Origin: *\r\n"
+                    "ETag: %s\r\n"
+                    "Content-Length: %zd\r\n"
+                    "Connection: Keep-Alive\r\n"
+                    "\r\n",
+                    notModified ? "304 Not Modified" : "200 OK",
+                    etag.c_str(),
+                    notModified ? 0 : body.length())
+         + (notModified ? string() : body),
+         NEXT_CONTINUE,
+         onSendFinished);
+}
+
 void
 RouterRestApiConnection::
 doPost(const std::string& resource, const std::string& payload)
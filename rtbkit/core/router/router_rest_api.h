@@ -32,6 +32,11 @@ struct RouterRestApiConnection
 
     virtual void doPost(const std::string& resource,
                         const std::string& payload);
+
+    /** Send a serialized status snapshot, or a 304 if the client already
+        has the version with that ETag.
+    */
+    void sendSnapshot(const std::string & body, const std::string & etag);
 };
 
 typedef HttpMonitor<RouterRestApiConnection, Router*> RouterRestApi;
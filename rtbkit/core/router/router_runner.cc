@@ -20,8 +20,10 @@
 #include "rtbkit/core/banker/slave_banker.h"
 #include "rtbkit/core/banker/local_banker.h"
 #include "rtbkit/core/banker/split_banker.h"
+#include "rtbkit/core/banker/sharded_banker.h"
 #include "rtbkit/core/banker/null_banker.h"
 #include "soa/service/process_stats.h"
+#include "soa/utils/count_allocations.h"
 #include "jml/arch/timers.h"
 #include "jml/utils/file_functions.h"
 
@@ -51,6 +53,7 @@ RouterRunner() :
     bidderConfigurationFile("rtbkit/examples/bidder-config.json"),
     filterConfigurationFile(""),
     analyticsConfigurationFile(""),
+    augmentorConfigurationFile(""),
     lossSeconds(15.0),
     noPostAuctionLoop(false),
     noBidProb(false),
@@ -64,7 +67,12 @@ RouterRunner() :
     analyticsPublisherOn(false),
     analyticsPublisherConnections(1),
     augmentationWindowms(5),
-    dableSlowMode(false)
+    dableSlowMode(false),
+    admissionControl(false),
+    maxInFlight(0),
+    numShards(1),
+    traceSampleRate(0.0),
+    usageSampling(0)
 {
 }
 
@@ -97,6 +105,8 @@ doOptions(int argc, char ** argv,
           "configuration file with enabled filters data")
         ("analytics", value<string>(&analyticsConfigurationFile),
           "configuration file for analytics")
+        ("augmentors-configuration", value<string>(&augmentorConfigurationFile),
+          "configuration file with the augmentors to run in the router")
         ("log-auctions", value<bool>(&logAuctions)->zero_tokens(),
          "log auction requests")
         ("log-bids", value<bool>(&logBids)->zero_tokens(),
@@ -113,12 +123,37 @@ doOptions(int argc, char ** argv,
          "address of where the local banker can be found.")
         ("local-banker-debug", bool_switch(&localBankerDebug),
          "enable local banker debug for more precise tracking by account")
+        ("local-banker-max-spend-rate", value<string>(&localBankerMaxSpendRate),
+         "let the local banker adapt each account's spend rate to its spend, "
+         "between a tenth of the spend rate and this amount")
         ("banker-choice", value<string>(&bankerChoice),
          "split or local banker can be chosen.")
          ("augmenter-timeout",value<int>(&augmentationWindowms),
          "configure the augmenter  timeout (in milliseconds)")
         ("no slow mode", value<bool>(&dableSlowMode)->zero_tokens(),
-         "disable the slow mode.");
+         "disable the slow mode.")
+        ("router-shards", value<unsigned>(&numShards),
+         "number of auction shards, each with its own thread (default 1).")
+        ("admission-control", bool_switch(&admissionControl),
+         "adapt each exchange's accept probability to the router's load, "
+         "in flight auctions and deadline slack")
+        ("max-in-flight", value<size_t>(&maxInFlight),
+         "number of auctions in flight above which the admission control "
+         "sheds traffic (default: no limit)")
+        ("trace-sample-rate", value<double>(&traceSampleRate),
+         "fraction of the auctions whose timeline is traced and published "
+         "on the TRACE analytics channel (default 0)")
+        ("usage-sampling", value<unsigned>(&usageSampling),
+         "measure the CPU time and allocations of each stage for one "
+         "auction in this many, reported in the service status "
+         "(default 0: never)")
+        ("config-cache", value<string>(&configCacheFile),
+         "file in which the agent configurations are kept so that a restart "
+         "can bid before the agent configuration service pushes them")
+        ("banker-cache", value<string>(&bankerCacheFile),
+         "file in which the slave banker keeps the budget left in each "
+         "account so that a restart can bid before the master initializes "
+         "them");
 
     options_description all_opt = opts;
     all_opt
@@ -158,6 +193,9 @@ init()
     Json::Value analyticsConfig;
     if (!analyticsConfigurationFile.empty())
         analyticsConfig = loadJsonFromFile(analyticsConfigurationFile);
+    Json::Value augmentorConfig;
+    if (!augmentorConfigurationFile.empty())
+        augmentorConfig = loadJsonFromFile(augmentorConfigurationFile);
 
 
     const auto amountSlowModeMoneyLimit = Amount::parse(slowModeMoneyLimit);
@@ -197,13 +235,25 @@ init()
     }
 
     router->initAnalytics(analyticsConfig);
+    router->setNumShards(numShards);
+    AuctionTracer::instance().setSampleRate(traceSampleRate);
+    router->setAuctionUsageSampling(usageSampling);
+    if (admissionControl)
+        router->enableAdmissionControl(maxInFlight);
     router->init();
+    if (!configCacheFile.empty())
+        router->initConfigCache(configCacheFile);
 
     if (localBankerUri != "") {
         localBanker = make_shared<LocalBanker>(proxies, ROUTER, router->serviceName());
         localBanker->init(localBankerUri);
         localBanker->setDebug(localBankerDebug);
         localBanker->setSpendRate(bankerArgs.spendRate());
+        if (!localBankerMaxSpendRate.empty()) {
+            localBanker->setAdaptiveSpendRate(
+                    bankerArgs.spendRate() * 0.1,
+                    Amount::parse(localBankerMaxSpendRate));
+        }
     }
     if (localBanker && bankerChoice == "split") {
         unordered_set<string> campaignSet;
@@ -215,20 +265,29 @@ init()
                 }
             }
         }
-        slaveBanker = bankerArgs.makeBanker(proxies, router->serviceName() + ".slaveBanker");
-        banker = make_shared<SplitBanker>(slaveBanker, localBanker, campaignSet);
+        slaveBankers = bankerArgs.makeBankers(proxies, router->serviceName() + ".slaveBanker");
+        banker = make_shared<SplitBanker>(makeShardedBanker(slaveBankers), localBanker, campaignSet);
     } else if (localBanker && bankerChoice == "local") {
         banker = localBanker;
     } else if (bankerChoice == "null") {
         banker = make_shared<NullBanker>(true, router->serviceName());
     } else {
-        slaveBanker = bankerArgs.makeBanker(proxies, router->serviceName() + ".slaveBanker");
-        banker = slaveBanker;
+        slaveBankers = bankerArgs.makeBankers(proxies, router->serviceName() + ".slaveBanker");
+        banker = makeShardedBanker(slaveBankers);
+    }
+
+    if (!bankerCacheFile.empty()) {
+        for (size_t i = 0; i < slaveBankers.size(); ++i) {
+            string file = bankerCacheFile;
+            if (slaveBankers.size() > 1) file += "." + to_string(i);
+            slaveBankers[i]->initWarmStart(file);
+        }
     }
 
     router->setBanker(banker);
     router->initExchanges(exchangeConfig);
     router->initFilters(filterConfig);
+    router->initAugmentors(augmentorConfig);
     router->bindTcp();
 }
 
@@ -236,7 +295,7 @@ void
 RouterRunner::
 start()
 {
-    if (slaveBanker) slaveBanker->start();
+    for (auto & slaveBanker: slaveBankers) slaveBanker->start();
     if (localBanker) localBanker->start();
     router->start();
 }
@@ -246,7 +305,7 @@ RouterRunner::
 shutdown()
 {
     router->shutdown();
-    if (slaveBanker) slaveBanker->shutdown();
+    for (auto & slaveBanker: slaveBankers) slaveBanker->shutdown();
     if (localBanker) localBanker->shutdown();
 }
 
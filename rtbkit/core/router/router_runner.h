@@ -34,6 +34,7 @@ struct RouterRunner {
     std::string bidderConfigurationFile;
     std::string filterConfigurationFile;
     std::string analyticsConfigurationFile;
+    std::string augmentorConfigurationFile;
 
     float lossSeconds;
     bool noPostAuctionLoop;
@@ -46,6 +47,7 @@ struct RouterRunner {
     std::string bankerUri;
     std::string localBankerUri;
     bool localBankerDebug;
+    std::string localBankerMaxSpendRate;
     std::string bankerChoice;
 
     int slowModeTimeout; // Default value =  MonitorClient::DefaultCheckTimeout
@@ -56,6 +58,13 @@ struct RouterRunner {
     int analyticsPublisherConnections;
     int augmentationWindowms;
     bool dableSlowMode;
+    unsigned numShards;
+    bool admissionControl;
+    size_t maxInFlight;
+    double traceSampleRate;
+    unsigned usageSampling;
+    std::string configCacheFile;
+    std::string bankerCacheFile;
 
     void doOptions(int argc, char ** argv,
                    const boost::program_options::options_description & opts
@@ -63,7 +72,7 @@ struct RouterRunner {
 
     std::shared_ptr<ServiceProxies> proxies;
     std::shared_ptr<Banker> banker;
-    std::shared_ptr<SlaveBanker> slaveBanker;
+    std::vector<std::shared_ptr<SlaveBanker> > slaveBankers;  ///< One per banker shard
     std::shared_ptr<LocalBanker> localBanker;
     std::shared_ptr<Router> router;
 
@@ -124,46 +124,131 @@ const std::string &
 AgentInfo::
 encodeBidRequest(const Auction & auction) const
 {
-    return auction.requestStr;
+    switch (bidRequestFormat) {
+    case BRF_JSON_RAW:  return auction.requestStr;
+    case BRF_JSON_NORM: return auction.requestNormalized();
+    case BRF_BINARY_V1: return auction.requestSerialized;
+    default:
+        throw ML::Exception("unknown bid request format");
+    }
 }
 
 const std::string &
 AgentInfo::
 getBidRequestEncoding(const Auction & auction) const
 {
-    return auction.requestStrFormat;
+    static const std::string normalized = "datacratic";
+    static const std::string binary = "rtbkit-binary-v1";
+
+    switch (bidRequestFormat) {
+    case BRF_JSON_RAW:  return auction.requestStrFormat;
+    case BRF_JSON_NORM: return normalized;
+    case BRF_BINARY_V1: return binary;
+    default:
+        throw ML::Exception("unknown bid request format");
+    }
 }
 
 void
 AgentInfo::
 setBidRequestFormat(const std::string & val)
 {
-    // TODO
+    if (val == "jsonRaw")
+        bidRequestFormat = BRF_JSON_RAW;
+    else if (val == "jsonNormalized")
+        bidRequestFormat = BRF_JSON_NORM;
+    else if (val == "binaryV1")
+        bidRequestFormat = BRF_BINARY_V1;
+    else throw ML::Exception("unknown bid request format " + val);
 }
 
 AgentStats::
 AgentStats()
-    : auctions(0), bids(0), wins(0), losses(0), tooLate(0),
-      invalid(0), noBudget(0),
-      tooManyInFlight(0), noSpots(0), skippedBidProbability(0),
-      urlFiltered(0), hourOfWeekFiltered(0),
-      locationFiltered(0), languageFiltered(0),
-      userPartitionFiltered(0),
-      dataProfileFiltered(0),
-      exchangeFiltered(0),
-      segmentsMissing(0), segmentFiltered(0),
-      augmentationTagsExcluded(0), userBlacklisted(0), notEnoughTime(0),
-      requiredIdMissing(0),
-      intoFilters(0), passedStaticFilters(0),
-      passedStaticPhase1(0), passedStaticPhase2(0), passedStaticPhase3(0),
-      passedDynamicFilters(0),
-      bidErrors(0),
-      filter1Excluded(0),
-      filter2Excluded(0),
-      filternExcluded(0),
-      unknownWins(0), unknownLosses(0),
-      requiredAugmentorIsMissing(0), augmentorValueIsNull(0)
 {
+    for (auto & shard : shards)
+        for (auto & counter : shard.counters)
+            counter = 0;
+}
+
+unsigned
+AgentStats::
+shardIndex()
+{
+    static std::atomic<unsigned> nextIndex(0);
+    static __thread int index = -1;
+
+    if (index == -1)
+        index = nextIndex.fetch_add(1) % NumShards;
+    return index;
+}
+
+uint64_t
+AgentStats::
+get(Counter counter) const
+{
+    uint64_t result = 0;
+    for (auto & shard : shards)
+        result += shard.counters[counter].load(std::memory_order_relaxed);
+    return result;
+}
+
+CurrencyPool
+AgentStats::
+totalBid() const
+{
+    CurrencyPool result;
+    for (auto & shard : shards) {
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        result += shard.totalBid;
+    }
+    return result;
+}
+
+const char *
+AgentStats::
+counterName(Counter counter)
+{
+    switch (counter) {
+    case AUCTIONS:                      return "auctions";
+    case BIDS:                          return "bids";
+    case WINS:                          return "wins";
+    case LOSSES:                        return "losses";
+    case TOO_LATE:                      return "tooLate";
+    case INVALID:                       return "invalid";
+    case NO_BUDGET:                     return "noBudget";
+    case TOO_MANY_IN_FLIGHT:            return "tooManyInFlight";
+    case NO_SPOTS:                      return "filter_noSpots";
+    case SKIPPED_BID_PROBABILITY:       return "filter_skippedBidProbability";
+    case URL_FILTERED:                  return "filter_urlFiltered";
+    case HOUR_OF_WEEK_FILTERED:         return "filter_hourOfWeekFiltered";
+    case LOCATION_FILTERED:             return "filter_locationFiltered";
+    case LANGUAGE_FILTERED:             return "filter_languageFiltered";
+    case USER_PARTITION_FILTERED:       return "filter_userPartitionFiltered";
+    case DATA_PROFILE_FILTERED:         return "filter_dataProfileFiltered";
+    case EXCHANGE_FILTERED:             return "filter_exchangeFiltered";
+    case SEGMENTS_MISSING:              return "filter_segmentsMissing";
+    case SEGMENT_FILTERED:              return "filter_segmentFiltered";
+    case AUGMENTATION_TAGS_EXCLUDED:    return "filter_augmentationTagsExcluded";
+    case USER_BLACKLISTED:              return "filter_userBlacklisted";
+    case NOT_ENOUGH_TIME:               return "notEnoughTime";
+    case REQUIRED_ID_MISSING:           return "requiredIdMissing";
+    case INTO_FILTERS:                  return "intoFilters";
+    case PASSED_STATIC_FILTERS:         return "passedStaticFilters";
+    case PASSED_STATIC_PHASE1:          return "passedStaticFiltersPhase1";
+    case PASSED_STATIC_PHASE2:          return "passedStaticFiltersPhase2";
+    case PASSED_STATIC_PHASE3:          return "passedStaticFiltersPhase3";
+    case PASSED_DYNAMIC_FILTERS:        return "passedDynamicFilters";
+    case BID_ERRORS:                    return "bidErrors";
+    case FILTER1_EXCLUDED:              return "filter1Excluded";
+    case FILTER2_EXCLUDED:              return "filter2Excluded";
+    case FILTERN_EXCLUDED:              return "filternExcluded";
+    case UNKNOWN_WINS:                  return "unknownWins";
+    case UNKNOWN_LOSSES:                return "unknownLosses";
+    case REQUIRED_AUGMENTOR_IS_MISSING: return "requiredAugmentorIsMissing";
+    case AUGMENTOR_VALUE_IS_NULL:       return "augmentorValueIsNull";
+    default:
+        throw ML::Exception("unknown agent stats counter %d", counter);
+    }
 }
 
 Json::Value
@@ -171,50 +256,13 @@ AgentStats::
 toJson() const
 {
     Json::Value result;
-    result["auctions"] = auctions;
-    result["bids"] = bids;
-    result["wins"] = wins;
-    result["losses"] = losses;
-    result["tooLate"] = tooLate;
-    result["invalid"] = invalid;
-    result["noBudget"] = noBudget;
-    result["totalBid"] = totalBid.toJson();
+    for (int counter = 0;  counter < NUM_COUNTERS;  ++counter) {
+        result[counterName(Counter(counter))] = get(Counter(counter));
+    }
+
+    result["totalBid"] = totalBid().toJson();
     result["totalBidOnWins"] = totalBidOnWins.toJson();
     result["totalSpent"] = totalSpent.toJson();
-    result["tooManyInFlight"] = tooManyInFlight;
-    result["requiredIdMissing"] = requiredIdMissing;
-    result["notEnoughTime"] = notEnoughTime;
-
-    result["filter_noSpots"] = noSpots;
-    result["filter_skippedBidProbability"] = skippedBidProbability;
-    result["filter_urlFiltered"] = urlFiltered;
-    result["filter_hourOfWeekFiltered"] = hourOfWeekFiltered;
-    result["filter_locationFiltered"] = locationFiltered;
-    result["filter_languageFiltered"] = languageFiltered;
-    result["filter_userPartitionFiltered"] = userPartitionFiltered;
-    result["filter_dataProfileFiltered"] = dataProfileFiltered;
-    result["filter_exchangeFiltered"] = exchangeFiltered;
-    result["filter_augmentationTagsExcluded"] = augmentationTagsExcluded;
-    result["filter_userBlacklisted"] = userBlacklisted;
-    result["filter_segmentsMissing"] = segmentsMissing;
-    result["filter_segmentFiltered"] = segmentFiltered;
-
-    result["bidErrors"] = bidErrors;
-    result["unknownWins"] = unknownWins;
-    result["unknownLosses"] = unknownLosses;
-    result["intoFilters"] = intoFilters;
-    result["passedStaticFilters"] = passedStaticFilters;
-    result["passedStaticFiltersPhase1"] = passedStaticPhase1;
-    result["passedStaticFiltersPhase2"] = passedStaticPhase2;
-    result["passedStaticFiltersPhase3"] = passedStaticPhase3;
-    result["passedDynamicFilters"] = passedDynamicFilters;
-
-    result["filter1Excluded"] = filter1Excluded;
-    result["filter2Excluded"] = filter2Excluded;
-    result["filternExcluded"] = filternExcluded;
-
-    result["requiredAugmentorIsMissing"] = requiredAugmentorIsMissing;
-    result["augmentorValueIsNull"] = augmentorValueIsNull;
 
     return result;
 }
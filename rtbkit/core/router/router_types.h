@@ -14,6 +14,11 @@
 #include <set>
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/bids.h"
+#include "jml/arch/spinlock.h"
+#include "soa/service/stat_aggregator.h"
+#include "rtbkit/core/router/bid_predictor.h"
+#include <atomic>
+#include <mutex>
 
 
 namespace RTBKIT {
@@ -37,58 +42,108 @@ struct BiddableSpots : public BiddableSpotsBase {
     std::string toJsonStr() const;
 };
 
+/** Counters kept for each agent.  They are bumped from every thread of the
+    bid path (exchange threads, router shards, the main loop) so each
+    thread increments its own shard of the counters, padded to a cache
+    line, and reads add all of the shards up.  Nothing here needs the
+    router's lock.
+*/
 struct AgentStats {
 
+    enum Counter {
+        AUCTIONS,
+        BIDS,
+        WINS,
+        LOSSES,
+        TOO_LATE,
+        INVALID,
+        NO_BUDGET,
+
+        TOO_MANY_IN_FLIGHT,
+        NO_SPOTS,
+        SKIPPED_BID_PROBABILITY,
+        URL_FILTERED,
+        HOUR_OF_WEEK_FILTERED,
+        LOCATION_FILTERED,
+        LANGUAGE_FILTERED,
+        USER_PARTITION_FILTERED,
+        DATA_PROFILE_FILTERED,
+        EXCHANGE_FILTERED,
+        SEGMENTS_MISSING,
+        SEGMENT_FILTERED,
+        AUGMENTATION_TAGS_EXCLUDED,
+        USER_BLACKLISTED,
+        NOT_ENOUGH_TIME,
+        REQUIRED_ID_MISSING,
+
+        INTO_FILTERS,
+        PASSED_STATIC_FILTERS,
+        PASSED_STATIC_PHASE1,
+        PASSED_STATIC_PHASE2,
+        PASSED_STATIC_PHASE3,
+        PASSED_DYNAMIC_FILTERS,
+        BID_ERRORS,
+
+        FILTER1_EXCLUDED,
+        FILTER2_EXCLUDED,
+        FILTERN_EXCLUDED,
+
+        UNKNOWN_WINS,
+        UNKNOWN_LOSSES,
+
+        REQUIRED_AUGMENTOR_IS_MISSING,
+        AUGMENTOR_VALUE_IS_NULL,
+
+        NUM_COUNTERS
+    };
+
+    enum { NumShards = 16 };
+
     AgentStats();
 
+    AgentStats(const AgentStats &) = delete;
+    AgentStats & operator = (const AgentStats &) = delete;
+
+    void increment(Counter counter, uint64_t n = 1)
+    {
+        auto & shard = shards[shardIndex()];
+        shard.counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /** Sum of the counter over all threads. */
+    uint64_t get(Counter counter) const;
+
+    /** Account for a bid.  The currency pools can't be updated atomically so
+        this takes the lock of the calling thread's shard, which is only
+        contended when there are more threads than shards.
+    */
+    void addBid(const Amount & price)
+    {
+        auto & shard = shards[shardIndex()];
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        shard.totalBid += price;
+    }
+
+    CurrencyPool totalBid() const;
+
     Json::Value toJson() const;
 
-    uint64_t auctions;
-    uint64_t bids;
-    uint64_t wins;
-    uint64_t losses;
-    uint64_t tooLate;
-    uint64_t invalid;
-    uint64_t noBudget;
+    /** Name of the counter in toJson(). */
+    static const char * counterName(Counter counter);
 
-    CurrencyPool totalBid;
     CurrencyPool totalBidOnWins;
     CurrencyPool totalSpent;
 
-    uint64_t tooManyInFlight;
-    uint64_t noSpots;
-    uint64_t skippedBidProbability;
-    uint64_t urlFiltered;
-    uint64_t hourOfWeekFiltered;
-    uint64_t locationFiltered;
-    uint64_t languageFiltered;
-    uint64_t userPartitionFiltered;
-    uint64_t dataProfileFiltered;
-    uint64_t exchangeFiltered;
-    uint64_t segmentsMissing;
-    uint64_t segmentFiltered;
-    uint64_t augmentationTagsExcluded;
-    uint64_t userBlacklisted;
-    uint64_t notEnoughTime;
-    uint64_t requiredIdMissing;
-
-    uint64_t intoFilters;
-    uint64_t passedStaticFilters;
-    uint64_t passedStaticPhase1;
-    uint64_t passedStaticPhase2;
-    uint64_t passedStaticPhase3;
-    uint64_t passedDynamicFilters;
-    uint64_t bidErrors;
- 
-    uint64_t filter1Excluded;
-    uint64_t filter2Excluded;
-    uint64_t filternExcluded;
-
-    uint64_t unknownWins;
-    uint64_t unknownLosses;
-
-    uint64_t requiredAugmentorIsMissing;
-    uint64_t augmentorValueIsNull;
+private:
+    struct Shard {
+        std::atomic<uint64_t> counters[NUM_COUNTERS];
+        CurrencyPool totalBid;
+        mutable ML::Spinlock lock;
+    } __attribute__((__aligned__(64)));
+
+    static unsigned shardIndex();
+
+    Shard shards[NumShards];
 };
 
 
@@ -102,6 +157,30 @@ struct AgentStatus {
     bool dead;
     Date lastHeartbeat;
     size_t numBidsInFlight;
+
+    /** Protects the agent's in flight bids, which can be touched by more
+        than one router shard at once. */
+    mutable ML::Spinlock inFlightLock;
+};
+
+/** Handles of the per account stats recorded for the bids of an agent,
+    resolved when it's configured so that the account name doesn't need to
+    be formatted for each bid.
+*/
+struct AccountStatHandles {
+    AccountStatHandles()
+        : config(nullptr)
+    {
+    }
+
+    const AgentConfig * config;  ///< Configuration they're for
+
+    StatHandle bids;
+    StatHandle ignored;
+    StatHandle noBudget;
+    StatHandle localLoss;
+    StatHandle tooLate;
+    StatHandle invalid;
 };
 
 /// Information about a agent
@@ -126,8 +205,25 @@ struct AgentInfo {
     std::shared_ptr<AgentConfig> config;
     std::shared_ptr<AgentStatus> status;
     std::shared_ptr<AgentStats> stats;
+    std::shared_ptr<const AccountStatHandles> accountStats;
     double throttleProbability;
 
+    /** Model of the requests the agent bids on, if it's configured with a
+        bidPrediction threshold.
+    */
+    std::shared_ptr<BidPredictor> bidPredictor;
+
+    /** Account stat handles for a bid made with the given configuration,
+        or null if the agent was reconfigured since.
+    */
+    const AccountStatHandles *
+    accountStatsFor(const AgentConfig & config) const
+    {
+        if (accountStats && accountStats->config == &config)
+            return accountStats.get();
+        return nullptr;
+    }
+
     /** Address of the zeromq socket for this agent. */
     std::string address;
     
@@ -198,6 +294,7 @@ struct AgentInfo {
     template<typename Fn>
     void forEachInFlight(const Fn & fn) const
     {
+        std::lock_guard<ML::Spinlock> guard(status->inFlightLock);
         for (auto it = bidsInFlight.begin(), end = bidsInFlight.end();
              it != end;  ++it) {
             fn(it->first, it->second);
@@ -206,6 +303,7 @@ struct AgentInfo {
 
     size_t numBidsInFlight() const
     {
+        std::lock_guard<ML::Spinlock> guard(status->inFlightLock);
         // DEBUG
         if (status->numBidsInFlight != bidsInFlight.size())
             throw ML::Exception("numBidsInFlight is wrong");
@@ -214,6 +312,7 @@ struct AgentInfo {
     
     bool expireBidInFlight(const Id & id)
     {
+        std::lock_guard<ML::Spinlock> guard(status->inFlightLock);
         bool result = bidsInFlight.erase(id);
         status->numBidsInFlight = bidsInFlight.size();
         return result;
@@ -222,6 +321,7 @@ struct AgentInfo {
     // Returns true if it was successfully inserted
     bool trackBidInFlight(const Id & id, Date date = Date::now())
     {
+        std::lock_guard<ML::Spinlock> guard(status->inFlightLock);
         bool result = bidsInFlight.insert(std::make_pair(id, date)).second;
         status->numBidsInFlight = bidsInFlight.size();
         return result;
@@ -296,6 +396,9 @@ struct AuctionInfo : public AuctionInfoBase {
 
     std::map<std::string, BidInfo> bidders;  ///< List of bidders
 
+    /// Features for the agents' BidPredictor, extracted if any has one
+    BidPredictor::Features bidFeatures;
+
 };
 
 struct FormatInfo {
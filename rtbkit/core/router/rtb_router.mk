@@ -6,7 +6,9 @@
 
 LIB_FILTERS_SOURCES := \
 	filters/static_filters.cc \
-        filters/creative_filters.cc
+        filters/creative_filters.cc \
+        filters/regex_set.cc \
+	filters/exchange_info_index.cc
 
 LIB_FILTERS_LINK := \
 	arch utils filter_registry agent_configuration rtb
@@ -17,6 +19,9 @@ LIBRTB_ROUTER_SOURCES := \
 	augmentation_loop.cc \
 	router.cc \
 	router_types.cc \
+	admission_controller.cc \
+	bid_predictor.cc \
+	impression_dedup.cc \
 	router_stack.cc \
 	filter_pool.cc
 
@@ -25,7 +30,7 @@ LIBRTB_ROUTER_LINK := \
 
 $(eval $(call library,rtb_router,$(LIBRTB_ROUTER_SOURCES),$(LIBRTB_ROUTER_LINK)))
 
-$(eval $(call program,router_runner,rtb_router boost_program_options))
+$(eval $(call program,router_runner,rtb_router allocation_counts boost_program_options))
 
 $(eval $(call include_sub_make,rtb_router_testing,testing,rtb_router_testing.mk))
 $(eval $(call include_sub_make,filters_test,filters/testing))
@@ -0,0 +1,90 @@
+/* augmentor_instance_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the bookkeeping of augmentor instances.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/augmentation_loop.h"
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_instance_latency )
+{
+    AugmentorInstanceInfo instance("addr", 10);
+    BOOST_CHECK_EQUAL(instance.latencyMs, 0);
+
+    instance.recordResponse(10);
+    BOOST_CHECK_EQUAL(instance.latencyMs, 10);
+
+    instance.recordResponse(20);
+    BOOST_CHECK_CLOSE(instance.latencyMs, 11, 0.001);
+
+    // The cost grows with the requests in flight
+    double cost = instance.cost();
+    instance.numInFlight = 3;
+    BOOST_CHECK_CLOSE(instance.cost(), cost * 4, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE( test_instance_ejection )
+{
+    AugmentorInstanceInfo instance("addr", 10);
+    Date now = Date::now();
+
+    BOOST_CHECK(!instance.recordTimeout(now));
+    BOOST_CHECK(!instance.recordTimeout(now));
+    BOOST_CHECK(instance.available(now));
+
+    BOOST_CHECK(instance.recordTimeout(now));
+    BOOST_CHECK(!instance.available(now));
+    BOOST_CHECK(!instance.available(now.plusSeconds(0.9)));
+    BOOST_CHECK(instance.available(now.plusSeconds(1.0)));
+
+    // Timing out again right away doubles the ejection
+    now = now.plusSeconds(1.0);
+    BOOST_CHECK(instance.recordTimeout(now));
+    BOOST_CHECK(!instance.available(now.plusSeconds(1.9)));
+    BOOST_CHECK(instance.available(now.plusSeconds(2.0)));
+
+    // Which is capped
+    for (unsigned i = 0;  i < 20;  ++i)
+        instance.recordTimeout(now);
+    BOOST_CHECK(instance.available(now.plusSeconds(60.0)));
+
+    // A response resets the backoff
+    instance.recordResponse(5);
+    now = now.plusSeconds(60.0);
+    BOOST_CHECK(!instance.recordTimeout(now));
+    BOOST_CHECK(instance.available(now));
+
+    // A full instance isn't available either
+    instance.numInFlight = instance.maxInFlight;
+    BOOST_CHECK(!instance.available(now));
+}
+
+BOOST_AUTO_TEST_CASE( test_instance_index )
+{
+    AugmentorInfo info("aug");
+    info.addInstance(std::make_shared<AugmentorInstanceInfo>("a", 10));
+    info.addInstance(std::make_shared<AugmentorInstanceInfo>("b", 10));
+
+    BOOST_CHECK_THROW(
+            info.addInstance(std::make_shared<AugmentorInstanceInfo>("a", 10)),
+            ML::Exception);
+
+    BOOST_REQUIRE(info.findInstance("b"));
+    BOOST_CHECK_EQUAL(info.findInstance("b")->addr, "b");
+    BOOST_CHECK(!info.findInstance("c"));
+
+    BOOST_CHECK(info.removeInstance("a"));
+    BOOST_CHECK(!info.removeInstance("a"));
+    BOOST_CHECK(!info.findInstance("a"));
+    BOOST_CHECK_EQUAL(info.instances.size(), 1);
+}
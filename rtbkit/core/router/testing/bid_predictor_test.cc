@@ -0,0 +1,47 @@
+/* bid_predictor_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the model of which requests an agent bids on.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/bid_predictor.h"
+#include "rtbkit/common/bid_request.h"
+
+using namespace std;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_learns_what_the_agent_bids_on )
+{
+    BidRequest onSite, otherSite;
+    onSite.exchange = otherSite.exchange = "exchange";
+    onSite.site.reset(new OpenRTB::Site);
+    onSite.site->id = Datacratic::Id("good");
+    otherSite.site.reset(new OpenRTB::Site);
+    otherSite.site->id = Datacratic::Id("bad");
+
+    auto good = BidPredictor::extractFeatures(onSite);
+    auto bad = BidPredictor::extractFeatures(otherSite);
+    BOOST_CHECK(good != bad);
+
+    BidPredictor predictor(0.05, 100);
+
+    // Nothing is skipped until it has seen enough
+    BOOST_CHECK_EQUAL(predictor.predict(bad), 1.0);
+
+    // The agent bids on 1 in 4 of the first site and never on the second
+    for (int i = 0;  i < 4000;  ++i) {
+        predictor.train(good, i % 4 == 0);
+        predictor.train(bad, false);
+    }
+
+    BOOST_CHECK_EQUAL(predictor.observations(), 8000);
+    cerr << "good " << predictor.predict(good) << " bad "
+         << predictor.predict(bad) << endl;
+    BOOST_CHECK_CLOSE(predictor.predict(good), 0.25, 20);
+    BOOST_CHECK_LT(predictor.predict(bad), 0.02);
+}
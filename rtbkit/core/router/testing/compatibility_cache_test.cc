@@ -0,0 +1,76 @@
+/* compatibility_cache_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the cache of exchange compatibility results.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/router.h"
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_keys )
+{
+    Creative creative = Creative::sampleLB;
+    uint64_t key = CompatibilityCache::creativeKey("adx", creative, true);
+
+    BOOST_CHECK_EQUAL(key, CompatibilityCache::creativeKey("adx", creative, true));
+    BOOST_CHECK_NE(key, CompatibilityCache::creativeKey("rubicon", creative, true));
+    BOOST_CHECK_NE(key, CompatibilityCache::creativeKey("adx", creative, false));
+
+    creative.providerConfig["adx"]["externalId"] = 1234;
+    BOOST_CHECK_NE(key, CompatibilityCache::creativeKey("adx", creative, true));
+
+    AgentConfig config;
+    uint64_t campaign = CompatibilityCache::campaignKey("adx", config, true);
+
+    // Creatives don't change the key of the campaign
+    config.creatives.push_back(creative);
+    BOOST_CHECK_EQUAL(campaign,
+                      CompatibilityCache::campaignKey("adx", config, true));
+
+    config.providerConfig["adx"]["seat"] = 1;
+    BOOST_CHECK_NE(campaign,
+                   CompatibilityCache::campaignKey("adx", config, true));
+}
+
+BOOST_AUTO_TEST_CASE( test_get )
+{
+    CompatibilityCache cache(4);
+    int numComputed = 0;
+
+    auto compute = [&] ()
+        {
+            ++numComputed;
+            CompatibilityCache::Result result;
+            result.setCompatible();
+            result.info = std::make_shared<int>(numComputed);
+            return result;
+        };
+
+    auto first = cache.get(1, compute);
+    BOOST_CHECK(first.isCompatible);
+    auto again = cache.get(1, compute);
+    BOOST_CHECK_EQUAL(numComputed, 1);
+    BOOST_CHECK_EQUAL(first.info, again.info);
+
+    // Filling the current generation pushes key 1 to the previous one,
+    // from which it is still found
+    for (uint64_t key = 2;  key <= 5;  ++key)
+        cache.get(key, compute);
+    BOOST_CHECK_EQUAL(numComputed, 5);
+    cache.get(1, compute);
+    BOOST_CHECK_EQUAL(numComputed, 5);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    cache.get(1, compute);
+    BOOST_CHECK_EQUAL(numComputed, 6);
+}
@@ -0,0 +1,105 @@
+/* impression_dedup_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the detection of impressions sent through several exchanges.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/impression_dedup.h"
+#include "rtbkit/openrtb/openrtb.h"
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+BidRequest makeRequest(const std::string & exchange,
+                       const std::string & ip = "10.0.0.1")
+{
+    BidRequest request;
+    request.exchange = exchange;
+    request.ipAddress = ip;
+    request.userAgent = Utf8String("Mozilla/5.0");
+    request.site.reset(new OpenRTB::Site);
+    request.site->domain = Utf8String("example.com");
+
+    AdSpot spot;
+    spot.formats.push_back(Format(300, 250));
+    request.imp.push_back(spot);
+    return request;
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_fingerprint )
+{
+    ImpressionDedup dedup;
+
+    BidRequest br1 = makeRequest("bidswitch");
+    BidRequest br2 = makeRequest("rubicon");
+    BOOST_CHECK_NE(dedup.fingerprint(br1), 0);
+    BOOST_CHECK_EQUAL(dedup.fingerprint(br1), dedup.fingerprint(br2));
+
+    BidRequest other = makeRequest("rubicon", "10.0.0.2");
+    BOOST_CHECK_NE(dedup.fingerprint(br1), dedup.fingerprint(other));
+
+    other.imp[0].formats[0] = Format(728, 90);
+    other.ipAddress = br1.ipAddress;
+    BOOST_CHECK_NE(dedup.fingerprint(br1), dedup.fingerprint(other));
+
+    // Requests missing a field are never duplicates
+    BidRequest partial = makeRequest("rubicon");
+    partial.site.reset();
+    BOOST_CHECK_EQUAL(dedup.fingerprint(partial), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_admit )
+{
+    Json::Value config;
+    config["window"] = 0.1;
+    config["exchangePriority"]["rubicon"] = 1;
+    ImpressionDedup dedup(config);
+
+    Date now = Date::fromSecondsSinceEpoch(1000.0);
+
+    BOOST_CHECK(dedup.admit(makeRequest("bidswitch"), now));
+    BOOST_CHECK(!dedup.admit(makeRequest("bidswitch"), now));
+
+    // A copy from an exchange with a higher priority still goes through,
+    // but only once
+    BOOST_CHECK(dedup.admit(makeRequest("rubicon"), now.plusSeconds(0.01)));
+    BOOST_CHECK(!dedup.admit(makeRequest("rubicon"), now.plusSeconds(0.02)));
+    BOOST_CHECK(!dedup.admit(makeRequest("bidswitch"), now.plusSeconds(0.02)));
+
+    // Still remembered in the next window, forgotten in the one after
+    BOOST_CHECK(!dedup.admit(makeRequest("bidswitch"), now.plusSeconds(0.15)));
+    BOOST_CHECK(dedup.admit(makeRequest("bidswitch"), now.plusSeconds(0.35)));
+
+    BidRequest partial = makeRequest("bidswitch");
+    partial.ipAddress.clear();
+    BOOST_CHECK(dedup.admit(partial, now.plusSeconds(0.35)));
+    BOOST_CHECK(dedup.admit(partial, now.plusSeconds(0.35)));
+}
+
+BOOST_AUTO_TEST_CASE( test_config )
+{
+    Json::Value config;
+    config["fields"].append("ifa");
+    ImpressionDedup dedup(config);
+
+    BidRequest request = makeRequest("bidswitch");
+    BOOST_CHECK_EQUAL(dedup.fingerprint(request), 0);
+
+    request.device.reset(new OpenRTB::Device);
+    request.device->ifa = "ABCD-1234";
+    BOOST_CHECK_NE(dedup.fingerprint(request), 0);
+
+    config["fields"].append("unknown");
+    BOOST_CHECK_THROW(ImpressionDedup bad(config), ML::Exception);
+}
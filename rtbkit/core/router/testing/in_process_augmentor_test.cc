@@ -0,0 +1,203 @@
+/* in_process_augmentor_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the augmentors that run in the router.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/utils/testing/watchdog.h"
+#include "rtbkit/core/router/augmentation_loop.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/plugins/augmentor/augmentor_base.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+namespace {
+
+struct TestSyncAugmentor : public SyncAugmentor {
+
+    TestSyncAugmentor(const std::string & name, ServiceBase & parent)
+        : SyncAugmentor(name, name, parent), numRequests(0)
+    {
+    }
+
+    virtual AugmentationList
+    onRequest(const AugmentationRequest & request)
+    {
+        ++numRequests;
+
+        AugmentationList result;
+        result[AccountKey()].tags.insert("sync-" + request.bidRequest->exchange);
+        return result;
+    }
+
+    std::atomic<int> numRequests;
+};
+
+struct TestAsyncAugmentor : public AsyncAugmentor {
+
+    TestAsyncAugmentor(const std::string & name, ServiceBase & parent)
+        : AsyncAugmentor(name, name, parent)
+    {
+    }
+
+    virtual void
+    onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
+    {
+        // Answer from another thread, after augment() returned.
+        std::thread([=] {
+                AugmentationList result;
+                result[AccountKey()].tags.insert("async");
+                sendResponse(result);
+            }).detach();
+    }
+};
+
+std::shared_ptr<AugmentationInfo>
+makeAuction(const std::string & id,
+            const std::vector<std::string> & augmentations,
+            const std::string & userId = "")
+{
+    auto request = std::make_shared<BidRequest>();
+    request->auctionId = Id(id);
+    request->exchange = "test";
+    if (!userId.empty())
+        request->userIds.add(Id(userId), ID_EXCHANGE);
+
+    auto auction = std::make_shared<Auction>();
+    auction->id = request->auctionId;
+    auction->request = request;
+
+    auto agentConfig = std::make_shared<AgentConfig>();
+    for (const auto & name : augmentations) {
+        AgentConfig::AugmentationInfo info;
+        info.name = name;
+        agentConfig->augmentations.push_back(info);
+    }
+
+    PotentialBidder bidder;
+    bidder.agent = "agent";
+    bidder.config = agentConfig;
+
+    auto info = std::make_shared<AugmentationInfo>(auction, Date());
+    info->potentialGroups.resize(1);
+    info->potentialGroups[0].push_back(bidder);
+    return info;
+}
+
+/** Augments the auction and waits for the result. */
+std::shared_ptr<AugmentationInfo>
+augment(AugmentationLoop & loop, const std::shared_ptr<AugmentationInfo> & info)
+{
+    std::promise<std::shared_ptr<AugmentationInfo> > finished;
+    loop.augment(info, Date::now().plusSeconds(1.0),
+                 [&] (const std::shared_ptr<AugmentationInfo> & result)
+                 {
+                     finished.set_value(result);
+                 });
+    return finished.get_future().get();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_in_process_augmentors )
+{
+    Watchdog watchdog(10.0);
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    AugmentationLoop loop(proxies, "augmentation");
+
+    std::shared_ptr<TestSyncAugmentor> syncAugmentor;
+
+    AugmentorPlugin::registerAugmentor(
+            "test-sync",
+            [&] (ServiceBase & owner, const std::string & name,
+                 const Json::Value & config)
+            {
+                syncAugmentor = std::make_shared<TestSyncAugmentor>(name, owner);
+                return syncAugmentor;
+            });
+
+    AugmentorPlugin::registerAugmentor(
+            "test-async",
+            [] (ServiceBase & owner, const std::string & name,
+                const Json::Value & config)
+            {
+                return std::make_shared<TestAsyncAugmentor>(name, owner);
+            });
+
+    loop.addInProcessAugmentor(
+            "sync", InProcessAugmentor::create("test-sync", loop, "sync",
+                                               Json::Value()));
+    loop.addInProcessAugmentor(
+            "async", InProcessAugmentor::create("test-async", loop, "async",
+                                                Json::Value()));
+
+    loop.init();
+    loop.start();
+
+    {
+        auto info = augment(loop, makeAuction("sync", { "sync" }));
+        auto & augmentations = info->auction->augmentations;
+        BOOST_CHECK_EQUAL(syncAugmentor->numRequests, 1);
+        BOOST_CHECK(augmentations["sync"][AccountKey()].tags.count("sync-test"));
+    }
+
+    {
+        auto info = augment(loop, makeAuction("both", { "sync", "async" }));
+        auto & augmentations = info->auction->augmentations;
+        BOOST_CHECK(augmentations["sync"][AccountKey()].tags.count("sync-test"));
+        BOOST_CHECK(augmentations["async"][AccountKey()].tags.count("async"));
+    }
+
+    loop.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_augmentation_cache )
+{
+    Watchdog watchdog(10.0);
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    AugmentationLoop loop(proxies, "augmentation");
+
+    auto augmentor = std::make_shared<TestSyncAugmentor>("sync", loop);
+    loop.addInProcessAugmentor(
+            "sync", std::make_shared<AugmentorPlugin>(augmentor, "sync"), 60.0);
+
+    loop.init();
+    loop.start();
+
+    auto checkAugmented = [&] (const std::shared_ptr<AugmentationInfo> & info)
+        {
+            auto & augmentations = info->auction->augmentations;
+            BOOST_CHECK(augmentations["sync"][AccountKey()].tags.count("sync-test"));
+        };
+
+    checkAugmented(augment(loop, makeAuction("1", { "sync" }, "user1")));
+    BOOST_CHECK_EQUAL(augmentor->numRequests, 1);
+
+    // Same user and agents: answered from the cache
+    checkAugmented(augment(loop, makeAuction("2", { "sync" }, "user1")));
+    BOOST_CHECK_EQUAL(augmentor->numRequests, 1);
+
+    checkAugmented(augment(loop, makeAuction("3", { "sync" }, "user2")));
+    BOOST_CHECK_EQUAL(augmentor->numRequests, 2);
+
+    // Without a user id there's nothing to cache on
+    checkAugmented(augment(loop, makeAuction("4", { "sync" })));
+    checkAugmented(augment(loop, makeAuction("5", { "sync" })));
+    BOOST_CHECK_EQUAL(augmentor->numRequests, 4);
+
+    loop.shutdown();
+}
@@ -13,6 +13,7 @@
 #include "soa/service/pending_list.h"
 #include "soa/types/id.h"
 #include "jml/utils/pair_utils.h"
+#include <unistd.h>
 
 
 using namespace std;
@@ -116,3 +117,45 @@ BOOST_AUTO_TEST_CASE( test_router_init_persistence )
     BOOST_CHECK_EQUAL(pending.completePrefix(o, isPrefix), none);
 }
 
+
+BOOST_AUTO_TEST_CASE( test_leveldb_batched_persistence )
+{
+    string path = "./build/x86_64/tmp/pending_list_test-" + to_string(getpid());
+    system(("rm -rf " + path).c_str());
+
+    auto countEntries = [] (const LeveldbPendingPersistence & store)
+        {
+            int result = 0;
+            store.scan([&] (string, string) { ++result; },
+                       PendingPersistence::OnError());
+            return result;
+        };
+
+    {
+        LeveldbPendingPersistence store;
+        store.open(path);
+        store.startBatching(0.05, 100, true /* sync */);
+
+        for (unsigned i = 0;  i < 1000;  ++i)
+            store.put(format("key%d", i), format("value%d", i));
+
+        // Writes that aren't in the database yet are still seen
+        BOOST_CHECK_EQUAL(store.get("key5"), "value5");
+        store.erase("key5");
+        BOOST_CHECK_THROW(store.get("key5"), ML::Exception);
+        store.put("key6", "other");
+        BOOST_CHECK_EQUAL(store.pop("key6"), "other");
+
+        BOOST_CHECK_EQUAL(countEntries(store), 998);
+
+        // Written when the store goes away
+        store.put("last", "value");
+    }
+
+    LeveldbPendingPersistence store;
+    store.open(path);
+    BOOST_CHECK_EQUAL(countEntries(store), 999);
+    BOOST_CHECK_EQUAL(store.get("last"), "value");
+
+    system(("rm -rf " + path).c_str());
+}
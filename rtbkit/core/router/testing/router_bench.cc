@@ -0,0 +1,497 @@
+/** router_bench.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Cost of an auction in the router on its own: synthetic agents are
+    configured directly into the router, the bid requests of the router's
+    auction corpus are injected through Router::injectAuction as fast as the
+    router takes them, and an in-process bidder interface answers each bid
+    request as soon as the router sends it.  Nothing goes over the network.
+
+    Prints the auctions per second for each number of agents, along with the
+    latency of each stage of the router and the CPU time per stage of a
+    sample of the auctions (see AuctionUsage).  Accepts the options of
+    BenchmarkRunner.
+
+*/
+
+#include "rtbkit/core/router/router.h"
+#include "rtbkit/core/banker/null_banker.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/bidder_interface.h"
+#include "rtbkit/common/exchange_connector.h"
+#include "rtbkit/common/bid_request.h"
+#include "rtbkit/common/plugin_interface.h"
+#include "soa/utils/benchmarks.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        auctions("rtbkit/core/router/testing/20000-datacratic-auctions.xz"),
+        requests(2000),
+        count(20000),
+        window(1000),
+        shards(1),
+        usageSampling(100)
+    {}
+
+    string auctions;
+    size_t requests;
+    size_t count;
+    size_t window;
+    unsigned shards;
+    unsigned usageSampling;
+    vector<size_t> configs;
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt("Bench options");
+    opt.add_options()
+        ("auctions,a", value<string>(&config.auctions),
+         "file of canonical bid requests, one per line")
+        ("requests,r", value<size_t>(&config.requests),
+         "number of bid requests to load from the file")
+        ("count,n", value<size_t>(&config.count),
+         "number of auctions injected by each run")
+        ("window,w", value<size_t>(&config.window),
+         "maximum number of auctions in the router at once")
+        ("shards,s", value<unsigned>(&config.shards),
+         "number of router shards")
+        ("usage-sampling", value<unsigned>(&config.usageSampling),
+         "measure the CPU time of one auction in this many; 0 for none")
+        ("configs,c", value< vector<size_t> >(&config.configs)->multitoken(),
+         "number of agent configs; defaults to 100 1000 5000")
+        ("help,h", "print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    if (config.configs.empty()) config.configs = { 100, 1000, 5000 };
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* REQUESTS                                                                   */
+/******************************************************************************/
+
+struct Request
+{
+    shared_ptr<BidRequest> request;
+    string str;
+};
+
+vector<Request> loadRequests(const Config& config)
+{
+    vector<Request> requests;
+
+    filter_istream stream(config.auctions);
+
+    while (stream && requests.size() < config.requests) {
+        string line;
+        getline(stream, line);
+        if (line.empty()) continue;
+
+        Request request;
+        request.request.reset(BidRequest::parse("datacratic", line));
+        request.str = line;
+        requests.push_back(request);
+    }
+
+    if (requests.empty())
+        throw ML::Exception("no bid requests in %s", config.auctions.c_str());
+
+    return requests;
+}
+
+
+/******************************************************************************/
+/* AGENTS                                                                     */
+/******************************************************************************/
+
+/** Targeting is spread so that each agent sees a few percent of the traffic:
+    most of the agents target a couple of the hosts of the corpus, the rest
+    segments, and all of them have creatives of the usual sizes and some
+    hours of the week off.
+ */
+map<string, shared_ptr<const AgentConfig> >
+makeAgents(size_t numConfigs, const vector<Request>& requests)
+{
+    mt19937 rng(numConfigs);
+
+    vector<string> hosts;
+    {
+        set<string> uniques;
+        for (const auto& request : requests) {
+            if (request.request->url.empty()) continue;
+            uniques.insert(request.request->url.host());
+        }
+        hosts.assign(uniques.begin(), uniques.end());
+    }
+    if (hosts.empty()) hosts.push_back("www.example.com");
+
+    const vector<Format> formats = {
+        { 300, 250 }, { 728, 90 }, { 160, 600 }, { 320, 50 }, { 300, 600 },
+        { 468, 60 }
+    };
+
+    map<string, shared_ptr<const AgentConfig> > agents;
+
+    for (size_t i = 0; i < numConfigs; ++i) {
+        auto config = make_shared<AgentConfig>();
+        config->account = { "bench", "agent" + to_string(i) };
+        config->bidProbability = 1.0;
+        config->maxInFlight = 1 << 20;
+
+        for (size_t j = rng() % 3; j < 3; ++j) {
+            const Format& format = formats[rng() % formats.size()];
+            config->creatives.emplace_back(format.width, format.height);
+        }
+
+        if (rng() % 4) {
+            for (size_t j = 0; j < 2; ++j)
+                config->hostFilter.include.emplace_back(
+                        hosts[rng() % hosts.size()]);
+        }
+        else {
+            auto& info = config->segments["adxVerticals"];
+            for (size_t j = 0; j < 5; ++j)
+                info.include.add(int(rng() % 1000));
+            info.include.sort();
+        }
+
+        auto& bitmap = config->hourOfWeekFilter.hourBitmap;
+        for (size_t j = 0; j < bitmap.size(); ++j)
+            bitmap[j] = rng() % 10 != 0;
+
+        agents["agent" + to_string(i)] = config;
+    }
+
+    return agents;
+}
+
+
+/******************************************************************************/
+/* BENCH EXCHANGE                                                             */
+/******************************************************************************/
+
+/** Exchange that the injected auctions come from, which accepts every
+    campaign and creative.
+ */
+struct BenchExchange : public ExchangeConnector
+{
+    BenchExchange(ServiceBase& owner) :
+        ExchangeConnector("bench", owner)
+    {}
+
+    string exchangeName() const { return "bench"; }
+    void enableUntil(Date) {}
+};
+
+
+/******************************************************************************/
+/* INSTANT BIDDER INTERFACE                                                   */
+/******************************************************************************/
+
+/** Answers every bid request as soon as the router sends it, with a bid on
+    every impression, and answers the pings so that the agents stay alive.
+    The bids are queued to the router's shards like those of the other
+    bidder interfaces.
+ */
+struct InstantBidderInterface : public BidderInterface
+{
+    InstantBidderInterface(
+            string const & serviceName,
+            shared_ptr<ServiceProxies> const & proxies) :
+        BidderInterface(proxies, serviceName),
+        numBids(0), numDropped(0)
+    {}
+
+    void sendAuctionMessage(
+            shared_ptr<Auction> const & auction,
+            double timeLeftMs,
+            map<string, BidInfo> const & bidders)
+    {
+        for (const auto& bidder : bidders) {
+            const AgentConfig& config = *bidder.second.agentConfig;
+
+            BidMessage message;
+            message.agents.push_back(bidder.first);
+            message.auctionId = auction->id;
+            message.wcm = auction->exchangeConnector->getWinCostModel(
+                    *auction, config);
+            message.meta = "null";
+
+            for (const auto& spot : bidder.second.imp) {
+                Bid bid;
+                bid.spotIndex = spot.first;
+                bid.availableCreatives = spot.second;
+                if (!spot.second.empty()) {
+                    int64_t cpm = 1 + auction->id.hash() % 10;
+                    bid.bid(spot.second[0], USD_CPM(cpm));
+                }
+                message.bids.push_back(bid);
+            }
+
+            numBids.fetch_add(1, memory_order_relaxed);
+            if (!router->tryPushBid(std::move(message)))
+                numDropped.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    void sendPingMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const & agent, int ping)
+    {
+        string now = ML::format("%.5f", Date::now().secondsSinceEpoch());
+        router->handleAgentMessage(
+                { agent, ping == 0 ? "PONG0" : "PONG1", now, now });
+    }
+
+    void sendWinLossMessage(
+            const shared_ptr<const AgentConfig>&, MatchedWinLoss const &) {}
+    void sendLossMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, string const &) {}
+    void sendCampaignEventMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, MatchedCampaignEvent const &) {}
+    void sendBidLostMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, shared_ptr<Auction> const &) {}
+    void sendBidDroppedMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, shared_ptr<Auction> const &) {}
+    void sendBidInvalidMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, string const &, shared_ptr<Auction> const &) {}
+    void sendNoBudgetMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, shared_ptr<Auction> const &) {}
+    void sendTooLateMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, shared_ptr<Auction> const &) {}
+    void sendMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, string const &) {}
+    void sendErrorMessage(
+            const shared_ptr<const AgentConfig>&,
+            string const &, string const &, vector<string> const &) {}
+
+    atomic<uint64_t> numBids;
+    atomic<uint64_t> numDropped;    ///< Shard queue full
+};
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+struct Bench
+{
+    Bench(const Config& config, const vector<Request>& requests,
+          size_t numConfigs) :
+        config(config),
+        requests(requests),
+        router(make_shared<ServiceProxies>(), "router_bench", 2.0,
+               false /* connectPostAuctionLoop */),
+        nextId(0),
+        finished(0)
+    {
+        Json::Value bidderConfig;
+        bidderConfig["type"] = "instant";
+        router.initBidderInterface(bidderConfig);
+        router.unsafeDisableMonitor();
+        router.setNumShards(config.shards);
+        router.init();
+        router.setBanker(make_shared<NullBanker>(true));
+
+        exchange = make_shared<BenchExchange>(router);
+        router.addExchange(exchange);
+        router.setAuctionUsageSampling(config.usageSampling);
+        router.initFilters();
+
+        router.doConfigs(makeAgents(numConfigs, requests));
+
+        router.bindTcp();
+        router.start();
+    }
+
+    ~Bench()
+    {
+        router.shutdown();
+    }
+
+    /** Inject count auctions, keeping at most window of them in the router,
+        and wait for all of them to be done.  Auctions that no agent is
+        interested in are dropped by the router without finishing.
+     */
+    uint64_t run()
+    {
+        uint64_t dropped = numNoPotentialBidders();
+        uint64_t done = finished.load();
+
+        auto inRouter = [&] (uint64_t injected) {
+            return injected
+                - (finished.load() - done)
+                - (numNoPotentialBidders() - dropped);
+        };
+
+        for (size_t i = 0; i < config.count; ++i) {
+            while (inRouter(i) >= config.window)
+                this_thread::yield();
+            inject(requests[i % requests.size()]);
+        }
+
+        while (inRouter(config.count) > 0)
+            this_thread::yield();
+
+        return config.count;
+    }
+
+    void inject(const Request& request)
+    {
+        auto br = make_shared<BidRequest>(*request.request);
+        br->auctionId = Id(++nextId);
+
+        auto onFinished = [=] (shared_ptr<Auction> auction) {
+            router.onAuctionDone(auction);
+            finished.fetch_add(1);
+        };
+
+        Date now = Date::now();
+        auto auction = make_shared<Auction>(
+                exchange.get(), onFinished, br, request.str, "datacratic",
+                now, now.plusSeconds(1.0));
+        if (exchange->sampleUsage())
+            auction->usage = make_shared<AuctionUsage>();
+
+        router.injectAuction(auction, router.secondsUntilLossAssumed());
+    }
+
+    uint64_t numNoPotentialBidders() const
+    {
+        return __atomic_load_n(&router.numNoPotentialBidders,
+                               __ATOMIC_RELAXED);
+    }
+
+    void printStages(ostream& stream) const
+    {
+        stream << "stage latencies (us):" << endl;
+        for (int i = 0; i < NUM_ROUTER_STAGES; ++i) {
+            auto snapshot = router.stageLatencies[i].snapshot();
+            stream << ML::format("  %-14s %10lld  p50 %6lld  p90 %6lld"
+                                 "  p99 %6lld\n",
+                                 routerStageName(RouterStage(i)),
+                                 (long long) snapshot.count(),
+                                 (long long) snapshot.percentile(0.5),
+                                 (long long) snapshot.percentile(0.9),
+                                 (long long) snapshot.percentile(0.99));
+        }
+
+        if (config.usageSampling) {
+            stream << "usage per sampled auction:" << endl
+                   << router.getAuctionUsage()["byExchange"].toStyledString();
+        }
+    }
+
+    const Config& config;
+    const vector<Request>& requests;
+
+    Router router;
+    shared_ptr<BenchExchange> exchange;
+
+    uint64_t nextId;
+    atomic<uint64_t> finished;
+};
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    BenchmarkRunner runner;
+    runner.runs = 5;
+    runner.parseCommandLine(argc, argv);
+
+    Config config = getConfig(argc, argv);
+
+    PluginInterface<BidderInterface>::registerPlugin("instant",
+            [] (string const & serviceName,
+                shared_ptr<ServiceProxies> const & proxies,
+                Json::Value const &)
+            {
+                return new InstantBidderInterface(serviceName, proxies);
+            });
+
+    auto requests = loadRequests(config);
+
+    // Copying a request is part of every injection; this is what it costs
+    // on its own.
+    runner.run("copyRequest", [&] {
+                for (size_t i = 0; i < config.count; ++i) {
+                    auto& request = *requests[i % requests.size()].request;
+                    make_shared<BidRequest>(request);
+                }
+                return config.count;
+            });
+
+    for (size_t numConfigs : config.configs) {
+        Bench bench(config, requests, numConfigs);
+
+        auto& bidder = static_cast<InstantBidderInterface&>(*bench.router.bidder);
+
+        string name = ML::format("router/c%zd/s%u", numConfigs, config.shards);
+        const auto& result = runner.run(name, [&] { return bench.run(); });
+
+        cerr << name << ": "
+             << ML::format("%.0f auctions/s",
+                           config.count / result.seconds.median)
+             << ", " << bench.finished.load() << " auctions finished"
+             << ", " << bench.numNoPotentialBidders()
+             << " without potential bidders"
+             << ", " << bidder.numBids.load() << " bids"
+             << ", " << bidder.numDropped.load() << " bids dropped" << endl;
+        bench.printStages(cerr);
+    }
+
+    runner.finish();
+
+    return 0;
+}
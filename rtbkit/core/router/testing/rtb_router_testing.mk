@@ -6,10 +6,18 @@
 $(eval $(call nodejs_test,rtb_router_unit_test,rtb sync))
 $(eval $(call nodejs_test,rtb_new_format_test,bid_request sync_utils))
 #$(eval $(call test,rtb_router_leak_test,rtb_router rtbsim,boost valgrind))
-$(eval $(call test,pending_list_test,types,boost))
+$(eval $(call test,pending_list_test,types leveldb,boost))
 #$(eval $(call test,router_banker_test,rtb_router dataflow bidding_agent,boost))
 #$(eval $(call test,augmentation_test,rtb_router bid_request augmentor_base,boost))
+$(eval $(call test,in_process_augmentor_test,rtb_router bid_request augmentor_base,boost))
+$(eval $(call test,augmentor_instance_test,rtb_router,boost))
+$(eval $(call test,impression_dedup_test,rtb_router,boost))
+$(eval $(call test,bid_predictor_test,rtb_router,boost))
+$(eval $(call test,compatibility_cache_test,rtb_router,boost))
+$(eval $(call test,status_snapshot_test,rtb_router,boost))
 
 $(eval $(call test,router_analytics_test,boost_program_options rtb_router,boost))
 
+$(eval $(call program,router_bench,rtb_router bid_request boost_program_options test_utils))
+
 .PHONY: $(LIB)/libzmq_analytics.so
@@ -0,0 +1,58 @@
+/* status_snapshot_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the serialized status snapshots of the router.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/router.h"
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_update )
+{
+    StatusSnapshot snapshot;
+    BOOST_CHECK(!snapshot.get());
+
+    Json::Value document;
+    document["numAgents"] = 2;
+    BOOST_CHECK(snapshot.update(document));
+
+    auto first = snapshot.get();
+    BOOST_REQUIRE(first);
+    BOOST_CHECK_EQUAL(Json::parse(first->body), document);
+    BOOST_CHECK_EQUAL(first->etag.size(), 18);
+
+    // The same document keeps the same version
+    BOOST_CHECK(!snapshot.update(document));
+    BOOST_CHECK_EQUAL(snapshot.get(), first);
+
+    document["numAgents"] = 3;
+    BOOST_CHECK(snapshot.update(document));
+    auto second = snapshot.get();
+    BOOST_CHECK_NE(second->etag, first->etag);
+
+    // Readers keep the version they got
+    BOOST_CHECK_EQUAL(Json::parse(first->body)["numAgents"].asInt(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_matches )
+{
+    string etag = "\"0123456789abcdef\"";
+
+    BOOST_CHECK(StatusSnapshot::matches(etag, etag));
+    BOOST_CHECK(StatusSnapshot::matches("*", etag));
+    BOOST_CHECK(StatusSnapshot::matches("W/" + etag, etag));
+    BOOST_CHECK(StatusSnapshot::matches("\"other\", " + etag, etag));
+
+    BOOST_CHECK(!StatusSnapshot::matches("", etag));
+    BOOST_CHECK(!StatusSnapshot::matches("\"other\"", etag));
+    BOOST_CHECK(!StatusSnapshot::matches("0123456789abcdef", etag));
+}
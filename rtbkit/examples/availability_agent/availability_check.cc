@@ -8,8 +8,9 @@
 
 #include "availability_check.h"
 #include "jml/arch/timers.h"
-#include "jml/utils/guard.h"
-#include "rtbkit/core/router/router_types.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
 
 using namespace std;
 using namespace ML;
@@ -17,19 +18,67 @@ using namespace RTBKIT;
 
 namespace Datacratic {
 
+/******************************************************************************/
+/* COLUMN                                                                     */
+/******************************************************************************/
+
+uint32_t
+AvailabilityCheck::Column::
+add(uint64_t key, const shared_ptr<const BidRequest>& br)
+{
+    auto it = index.find(key);
+    if (it != index.end()) {
+        values[it->second].samples++;
+        return it->second;
+    }
+
+    uint32_t id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    else {
+        id = values.size();
+        values.emplace_back();
+    }
+
+    values[id] = Value{ key, 1, br };
+    index[key] = id;
+    return id;
+}
+
+void
+AvailabilityCheck::Column::
+remove(uint32_t id)
+{
+    Value& value = values[id];
+    ExcAssertGreater(value.samples, 0);
+    if (--value.samples) return;
+
+    index.erase(value.key);
+    value.request.reset();
+    freeIds.push_back(id);
+}
+
+
 /******************************************************************************/
 /* AVAILABILITY CHECK                                                         */
 /******************************************************************************/
 
 AvailabilityCheck::
-AvailabilityCheck(size_t size) :
-    size(0), pos(0), requests(size)
+AvailabilityCheck(size_t size, double cacheSeconds) :
+    size(0), pos(0), requests(size), cacheSeconds(cacheSeconds)
 {
-    pos = 0;
-    for (size_t i = 0; i < requests.size(); ++i)
-        requests[i] = NULL;
+    for (const auto& name : PluginInterface<FilterBase>::getNames()) {
+        Column column;
+        column.filter.reset(PluginInterface<FilterBase>::getPlugin(name)());
+        columns.push_back(std::move(column));
+    }
 
-    filters.initWithDefaultFilters();
+    std::sort(columns.begin(), columns.end(),
+            [] (const Column& lhs, const Column& rhs) {
+                return lhs.filter->priority() < rhs.filter->priority();
+            });
 }
 
 
@@ -39,12 +88,35 @@ addRequest(const BidRequest& newRequest)
 {
     ML::Timer tm;
 
-    BidRequest* oldRequest = requests[pos];
-    requests[pos] = new BidRequest(newRequest);
-    pos = (pos + 1) % requests.size();
+    unique_lock<mutex> guard(lock, try_to_lock);
+    if (!guard.owns_lock()) {
+        if (onEvent) onEvent("skippedRequests", ET_COUNT, 1);
+        return;
+    }
+
+    auto br = make_shared<const BidRequest>(newRequest);
+
+    if (requests[pos]) {
+        for (Column& column : columns) {
+            if (column.ids.empty() || column.ids[pos] == NoValue) continue;
+            column.remove(column.ids[pos]);
+            column.ids[pos] = NoValue;
+        }
+    }
+
+    FilterState state(*br, nullptr, CreativeMatrix());
+    uint64_t impKey = hashField(0, br->imp.size());
 
-    if (oldRequest)
-        gcLock.defer([=]{ delete oldRequest; });
+    for (Column& column : columns) {
+        uint64_t hash = 0;
+        if (!column.filter->hashRequest(state, hash)) continue;
+
+        if (column.ids.empty()) column.ids.resize(requests.size(), NoValue);
+        column.ids[pos] = column.add(hashField(impKey, hash), br);
+    }
+
+    requests[pos] = std::move(br);
+    pos = (pos + 1) % requests.size();
 
     if (size < requests.size()) size++;
     if (onEvent) {
@@ -62,66 +134,168 @@ checkConfig(const AgentConfig& config)
 {
     ML::Timer tm;
 
-    AgentInfo info;
-    info.config = std::make_shared<AgentConfig>(config);
-    info.stats = std::make_shared<AgentStats>();
-    const auto& stats = *info.stats;
+    uint64_t key = hashField(0, config.toJson().toString());
+    Date now = Date::now();
 
-    filters.addConfig("config", info);
-    ML::Call_Guard guard([&] { filters.removeConfig("config"); });
-
-    uint64_t requestCount = 0;
-    uint64_t biddableCount = 0;
+    Json::Value report;
+    bool cached = false;
 
     {
-        GcLock::SharedGuard guard(gcLock);
-
-        for (size_t i = 0; i < requests.size(); ++i) {
-            BidRequest* br = requests[i];
-            if (br == NULL) continue;
+        lock_guard<mutex> guard(lock);
 
-            requestCount++;
-
-            FilterPool::ConfigList result = filters.filter(*br, nullptr);
-            if (!result.empty()) biddableCount++;
+        auto it = reports.find(key);
+        if (it != reports.end() && it->second.expires > now) {
+            report = it->second.report;
+            cached = true;
+        }
+        else {
+            report = doCheck(config);
+
+            for (auto it = reports.begin(); it != reports.end();) {
+                if (it->second.expires > now) ++it;
+                else it = reports.erase(it);
+            }
+            reports[key] = { now.plusSeconds(cacheSeconds), report };
         }
     }
 
-    auto makeFilter = [](const string& name, uint64_t value) {
-        Json::Value val(Json::arrayValue);
-        val.append(name);
-        val.append(value);
-        return val;
-    };
-
-    // These are in the same order as the filters in isBiddableRequest()
-    Json::Value filters(Json::arrayValue);
-    filters.append(makeFilter("noSpot", stats.noSpots));
-#if 0
-    filters.append(makeFilter("noAgid", stats.noAgid));
-#endif
-    filters.append(makeFilter("hourOfWeek", stats.hourOfWeekFiltered));
-    filters.append(makeFilter("exchangeFiltered", stats.exchangeFiltered));
-    filters.append(makeFilter("locationFiltered", stats.locationFiltered));
-    filters.append(makeFilter("languageFiltered", stats.languageFiltered));
-    filters.append(makeFilter("segmentsMissing", stats.segmentsMissing));
-    filters.append(makeFilter("segmentsFiltered", stats.segmentFiltered));
-    filters.append(makeFilter("userPartitionFiltered", stats.userPartitionFiltered));
-    filters.append(makeFilter("hostFiltered", stats.urlFiltered));
-    filters.append(makeFilter("urlFiltered", stats.urlFiltered));
-
-    Json::Value report(Json::objectValue);
-    report["total"] = requestCount;
-    report["biddable"] = biddableCount;
-    report["filters"] = filters;
-
     if (onEvent) {
         onEvent("checks", ET_COUNT, 1);
+        if (cached) onEvent("cachedChecks", ET_COUNT, 1);
 
         uint64_t elapsedMicros = tm.elapsed_wall() * 1000000.0;
         onEvent("checkConfigMicros", ET_OUTCOME, elapsedMicros);
     }
 
+    return report;
+}
+
+/** The hashed filters are applied before the others as FilterPool does with
+    its cache, so a request is attributed to the first filter in that order
+    which leaves it with no config.
+ */
+Json::Value
+AvailabilityCheck::
+doCheck(const AgentConfig& config)
+{
+    auto configPtr = make_shared<AgentConfig>(config);
+
+    CreativeMatrix active;
+    active.setConfig(0, config.creatives.size());
+
+    vector<unique_ptr<FilterBase> > filters;
+    for (const Column& column : columns) {
+        filters.emplace_back(column.filter->clone());
+        filters.back()->addConfig(0, configPtr);
+    }
+
+    // Run each hashed filter once per distinct value.
+    vector<vector<Outcome> > outcomes(columns.size());
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        const Column& column = columns[i];
+        outcomes[i].resize(column.values.size());
+
+        for (size_t id = 0; id < column.values.size(); ++id) {
+            const Value& value = column.values[id];
+            if (!value.samples) continue;
+
+            FilterState state(*value.request, nullptr, active);
+            filters[i]->filter(state);
+
+            Outcome& outcome = outcomes[i][id];
+            outcome.passes = !state.configs().empty();
+            outcome.narrows = false;
+            if (!outcome.passes) continue;
+
+            for (size_t imp = 0; imp < value.request->imp.size(); ++imp) {
+                outcome.creatives.push_back(state.creatives(imp));
+
+                CreativeMatrix diff = active;
+                diff ^= outcome.creatives.back();
+                if (!diff.empty()) outcome.narrows = true;
+            }
+        }
+    }
+
+    vector<uint64_t> filtered(columns.size(), 0);
+    uint64_t requestCount = 0;
+    uint64_t biddableCount = 0;
+
+    vector<CreativeMatrix> creatives;
+    vector<size_t> unhashed;
+
+    for (size_t slot = 0; slot < requests.size(); ++slot) {
+        const auto& br = requests[slot];
+        if (!br) continue;
+
+        requestCount++;
+
+        bool biddable = true;
+        bool narrowed = false;
+        unhashed.clear();
+
+        for (size_t i = 0; biddable && i < columns.size(); ++i) {
+            const Column& column = columns[i];
+            uint32_t id = column.ids.empty() ? NoValue : column.ids[slot];
+            if (id == NoValue) {
+                unhashed.push_back(i);
+                continue;
+            }
+
+            const Outcome& outcome = outcomes[i][id];
+            if (!outcome.passes) biddable = false;
+
+            else if (outcome.narrows) {
+                if (!narrowed) {
+                    creatives = outcome.creatives;
+                    narrowed = true;
+                }
+                else {
+                    bool empty = true;
+                    for (size_t imp = 0; imp < creatives.size(); ++imp) {
+                        creatives[imp] &= outcome.creatives[imp];
+                        if (!creatives[imp].empty()) empty = false;
+                    }
+                    if (empty) biddable = false;
+                }
+            }
+
+            if (!biddable) filtered[i]++;
+        }
+
+        if (biddable && !unhashed.empty()) {
+            FilterState state(*br, nullptr, active);
+            if (narrowed) {
+                for (size_t imp = 0; imp < creatives.size(); ++imp)
+                    state.narrowCreativesForImp(imp, creatives[imp]);
+            }
+
+            for (size_t i : unhashed) {
+                filters[i]->filter(state);
+                if (!state.configs().empty()) continue;
+
+                filtered[i]++;
+                biddable = false;
+                break;
+            }
+        }
+
+        if (biddable) biddableCount++;
+    }
+
+    Json::Value filterCounts(Json::arrayValue);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        Json::Value val(Json::arrayValue);
+        val.append(columns[i].filter->name());
+        val.append(filtered[i]);
+        filterCounts.append(val);
+    }
+
+    Json::Value report(Json::objectValue);
+    report["total"] = requestCount;
+    report["biddable"] = biddableCount;
+    report["filters"] = filterCounts;
 
     return report;
 }
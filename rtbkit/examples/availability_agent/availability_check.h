@@ -10,13 +10,15 @@
 #define __rtb__availability_check_h__
 
 #include "rtbkit/common/bid_request.h"
+#include "rtbkit/common/filter.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
-#include "rtbkit/core/router/filter_pool.h"
-#include "soa/gc/gc_lock.h"
 #include "soa/jsoncpp/value.h"
 #include "soa/service/stats_events.h"
+#include "soa/types/date.h"
 
-#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace Datacratic {
@@ -30,18 +32,27 @@ namespace Datacratic {
     in the agent config. Note that no QPS adjustments are performed by this
     class.
 
-    SWMR but could easily be expanded to MWMR if pos is atomically incremented
-    before inserting the new element.
+    The requests are stored in a ring buffer along with one column per filter
+    that supports FilterBase::hashRequest. A column holds, for each request,
+    the id of the distinct value that the filter hashed the request to. A
+    check then only runs such a filter once per distinct value and scans the
+    columns to find the requests that passed. The filters that can't hash a
+    request are still run on every request that made it through the columns.
+
+    Reports are cached per config for cacheSeconds.
+
+    addRequest and checkConfig can be called concurrently. A request that
+    comes in while a check is running is dropped from the sample.
 
 */
 struct AvailabilityCheck
 {
     /** size is the total number of BidRequest to keep in the ring buffer. */
-    AvailabilityCheck(size_t size);
+    AvailabilityCheck(size_t size, double cacheSeconds = 10.0);
 
-    /** Atomically adds a bid request to the ring buffer.
+    /** Adds a bid request to the ring buffer and indexes it.
 
-        Thread-safe with concurrent calls to report but not with itself.
+        Thread-safe with concurrent calls to checkConfig but not with itself.
     */
     void addRequest(const RTBKIT::BidRequest& br);
 
@@ -53,12 +64,56 @@ struct AvailabilityCheck
     std::function<void(const std::string&, StatEventType, float)> onEvent;
 
 private:
+    enum { NoValue = uint32_t(-1) };
+
+    /** Distinct value of a filter's hash in the sample. */
+    struct Value
+    {
+        uint64_t key;
+        uint32_t samples;
+        std::shared_ptr<const RTBKIT::BidRequest> request; // representative
+    };
+
+    /** Index of the requests for one of the filters. */
+    struct Column
+    {
+        std::unique_ptr<RTBKIT::FilterBase> filter;
+
+        std::vector<uint32_t> ids; // NoValue if the filter can't hash it.
+        std::vector<Value> values;
+        std::vector<uint32_t> freeIds;
+        std::unordered_map<uint64_t, uint32_t> index;
+
+        uint32_t add(uint64_t key,
+                     const std::shared_ptr<const RTBKIT::BidRequest>& br);
+        void remove(uint32_t id);
+    };
+
+    /** Outcome of a filter for one of its values. */
+    struct Outcome
+    {
+        bool passes;
+        bool narrows;
+        std::vector<RTBKIT::CreativeMatrix> creatives;
+    };
+
+    Json::Value doCheck(const RTBKIT::AgentConfig& config);
+
     size_t size;
     size_t pos;
-    std::vector<RTBKIT::BidRequest*> requests; // ring buffer.
-    GcLock gcLock;
+    std::vector<std::shared_ptr<const RTBKIT::BidRequest> > requests;
+    std::vector<Column> columns; // In filter priority order.
+
+    struct CachedReport
+    {
+        Date expires;
+        Json::Value report;
+    };
+
+    double cacheSeconds;
+    std::unordered_map<uint64_t, CachedReport> reports;
 
-    RTBKIT::FilterPool filters;
+    std::mutex lock;
 };
 
 } // Recoset
@@ -40,6 +40,44 @@ void to_js(JS::JSValue & value, const Format & f)
 }
 
 
+/*****************************************************************************/
+/* CACHED PROPERTIES                                                         */
+/*****************************************************************************/
+
+/* Properties that need a conversion or a new wrapper are converted the first
+   time they're read and kept in a hidden value of the object, so that
+   reading br.imp[0].banner in a loop doesn't build a new object each time.
+   Setting the property through the wrapper drops the cached value.
+*/
+
+template<typename Convert>
+v8::Handle<v8::Value>
+getCachedProperty(v8::Handle<v8::Object> object,
+                  v8::Handle<v8::String> key,
+                  const Convert & convert)
+{
+    v8::Local<v8::Value> cached = object->GetHiddenValue(key);
+    if (!cached.IsEmpty())
+        return cached;
+
+    v8::Handle<v8::Value> result = convert();
+    if (!result.IsEmpty())
+        object->SetHiddenValue(key, result);
+    return result;
+}
+
+void dropCachedProperty(v8::Handle<v8::Object> object,
+                        v8::Handle<v8::String> key)
+{
+    object->DeleteHiddenValue(key);
+}
+
+v8::Handle<v8::String> indexKey(uint32_t index)
+{
+    return v8::String::New(to_string(index).c_str());
+}
+
+
 /*****************************************************************************/
 /* SEGMENT LIST JS                                                           */
 /*****************************************************************************/
@@ -101,6 +139,11 @@ struct SegmentListJS
             ->SetAccessor(String::NewSymbol("length"), lengthGetter,
                           0, v8::Handle<v8::Value>(), DEFAULT,
                           PropertyAttribute(ReadOnly | DontEnum | DontDelete));
+
+        t->InstanceTemplate()
+            ->SetAccessor(String::NewSymbol("ints"), intsGetter,
+                          0, v8::Handle<v8::Value>(), DEFAULT,
+                          PropertyAttribute(ReadOnly | DontEnum | DontDelete));
                           
         t->InstanceTemplate()
             ->SetIndexedPropertyHandler(getIndexed, setIndexed, queryIndexed,
@@ -114,10 +157,47 @@ struct SegmentListJS
             auto segs = getShared(args.This());
             segs->add(getArg<string>(args, 0, "segment"));
             segs->sort();
+
+            // The ints may have moved
+            v8::Local<v8::Value> view
+                = args.This()->GetHiddenValue(String::NewSymbol("ints"));
+            if (!view.IsEmpty())
+                pointIntsView(view->ToObject(), *segs);
+
             return args.This();
         } HANDLE_JS_EXCEPTIONS;
     }
 
+    static void
+    pointIntsView(v8::Handle<v8::Object> view, SegmentList & segs)
+    {
+        static_assert(sizeof(int) == 4, "ints view needs 32 bit ints");
+        view->SetIndexedPropertiesToExternalArrayData
+            (segs.ints.data(), v8::kExternalIntArray, segs.ints.size());
+        view->Set(String::NewSymbol("length"),
+                  v8::Integer::New(segs.ints.size()));
+    }
+
+    /** Int32 array view over the integer segments, without a copy.  It
+        keeps the list alive, and follows the changes made with add() on
+        this object, but not the ones made on the list from elsewhere.
+    */
+    static v8::Handle<v8::Value>
+    intsGetter(v8::Local<v8::String> property,
+               const AccessorInfo & info)
+    {
+        try {
+            v8::Local<v8::Object> This = info.This();
+            return getCachedProperty(This, property, [&] ()
+                {
+                    v8::Local<v8::Object> view = v8::Object::New();
+                    view->SetHiddenValue(String::NewSymbol("list"), This);
+                    pointIntsView(view, *getShared(This));
+                    return view;
+                });
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
     static v8::Handle<v8::Value>
     forEach(const Arguments & args)
     {
@@ -303,15 +383,15 @@ from_js(const JSValue & value, SegmentList *)
 
 void to_js(JS::JSValue & value, const UserIds & uids)
 {
-    to_js(value, static_cast<const std::map<std::string, Id> &>(uids));
+    to_js(value, std::map<std::string, Id>(uids.begin(), uids.end()));
 }
 
 UserIds 
 from_js(const JSValue & value, UserIds *)
 {
     UserIds result;
-    static_cast<std::map<std::string, Id> &>(result)
-        = from_js(value, (std::map<std::string, Id> *)0);
+    auto ids = from_js(value, (std::map<std::string, Id> *)0);
+    result.insert(ids.begin(), ids.end());
     return result;
 }
 
@@ -428,10 +508,15 @@ struct SegmentsBySourceJS
             
             SegmentsBySource * segs = getShared(info.This());
             
-            if (!segs->count(name))
+            auto it = segs->find(name);
+            if (it == segs->end())
                 return NULL_HANDLE;
 
-            return scope.Close(JS::toJS(segs->find(name)->second));
+            return scope.Close(getCachedProperty(info.This(), property,
+                                                 [&] ()
+                {
+                    return JS::toJS(it->second);
+                }));
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -462,6 +547,7 @@ struct SegmentsBySourceJS
                 throw ML::Exception("can't set to null segments");
 
             (*segs)[name] = segs2;
+            dropCachedProperty(info.This(), property);
             
             return v8::Undefined();
         } HANDLE_JS_EXCEPTIONS;
@@ -497,6 +583,7 @@ struct SegmentsBySourceJS
         string name = cstr(property);
 
         SegmentsBySource * segs = getShared(info.This());
+        dropCachedProperty(info.This(), property);
 
         return v8::Boolean::New(segs->erase(name));
     }
@@ -855,10 +942,14 @@ struct WrappedArrayJS: public JSWrappedBase {
             if (index >= size)
                 return v8::Undefined();
 
-            void * element = wrapper->desc->getArrayElement(wrapper->value, index);
-            
-            return scope.Close(getFromJs(element, wrapper->desc->contained(),
-                                         wrapper->owner_));
+            return scope.Close(getCachedProperty(info.This(), indexKey(index),
+                                                 [&] ()
+                {
+                    void * element
+                        = wrapper->desc->getArrayElement(wrapper->value, index);
+                    return getFromJs(element, wrapper->desc->contained(),
+                                     wrapper->owner_);
+                }));
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -978,9 +1069,12 @@ struct WrappedStructureJS: public JSWrappedBase {
             if (!fd)
                 return NULL_HANDLE;
 
-            return getFromJs(addOffset(wrapper->value, fd->offset),
-                             *fd->description,
-                             wrapper->owner_);
+            return getCachedProperty(info.This(), property, [&] ()
+                {
+                    return getFromJs(addOffset(wrapper->value, fd->offset),
+                                     *fd->description,
+                                     wrapper->owner_);
+                });
 
         } HANDLE_JS_EXCEPTIONS;
     }
@@ -997,6 +1091,7 @@ struct WrappedStructureJS: public JSWrappedBase {
             const ValueDescription::FieldDescription & fd
                 = wrapper->desc->getField(name);
             
+            dropCachedProperty(info.This(), property);
             setFromJs(addOffset(wrapper->value, fd.offset), value,
                       *fd.description);
 
@@ -1349,11 +1444,15 @@ struct PropertyAccessViaDescription {
             const ValueDescription * vd
                 = reinterpret_cast<const ValueDescription *>
                 (v8::External::Unwrap(info.Data()));
-            auto p = Base::getSharedPtr(info.This());
-            Obj * o = p.get();
-            const StructureDescriptionBase::FieldDescription & fd
-                = vd->getField(cstr(property));
-            return getFromJs(addOffset(o, fd.offset), *fd.description, p);
+            return getCachedProperty(info.This(), property, [&] ()
+                {
+                    auto p = Base::getSharedPtr(info.This());
+                    Obj * o = p.get();
+                    const StructureDescriptionBase::FieldDescription & fd
+                        = vd->getField(cstr(property));
+                    return getFromJs(addOffset(o, fd.offset), *fd.description,
+                                     p);
+                });
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1369,6 +1468,7 @@ struct PropertyAccessViaDescription {
             Obj * o = Base::getShared(info.This());
             const StructureDescriptionBase::FieldDescription & fd
                 = vd->getField(cstr(property));
+            dropCachedProperty(info.This(), property);
             setFromJs(addOffset(o, fd.offset), value, *fd.description);
         } HANDLE_JS_EXCEPTIONS_SETTER;
     }
@@ -1641,13 +1741,16 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
-            v8::Handle<v8::Value> segs
-                = SegmentsBySourceJS::toJS
-                (ML::make_unowned_std_sp(getShared(info.This())->segments));
-            SegmentsBySourceJS * wrapper
-                = SegmentsBySourceJS::getWrapper(segs);
-            wrapper->owner_ = getSharedPtr(info.This());
-            return segs;
+            return getCachedProperty(info.This(), property, [&] ()
+                {
+                    v8::Handle<v8::Value> segs
+                        = SegmentsBySourceJS::toJS
+                        (ML::make_unowned_std_sp(getShared(info.This())->segments));
+                    SegmentsBySourceJS * wrapper
+                        = SegmentsBySourceJS::getWrapper(segs);
+                    wrapper->owner_ = getSharedPtr(info.This());
+                    return segs;
+                });
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1657,6 +1760,7 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
+            dropCachedProperty(info.This(), property);
             if (SegmentsBySourceJS::tmpl->HasInstance(value)) {
                 getShared(info.This())->segments
                     = *SegmentsBySourceJS::getShared(value);
@@ -1665,7 +1769,7 @@ struct BidRequestJS
             if (value->IsObject()) {
                 map<std::string, std::shared_ptr<SegmentList> > segs;
                 segs = from_js(JSValue(value), &segs);
-                getShared(info.This())->segments = SegmentsBySource(segs);
+                getShared(info.This())->segments = SegmentsBySource(SegmentsBySourceBase(segs.begin(), segs.end()));
                 return;
             }
             throw ML::Exception("can't convert " + cstr(value)
@@ -1678,13 +1782,16 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
-            v8::Handle<v8::Value> segs
-                = SegmentsBySourceJS::toJS
-                (ML::make_unowned_std_sp(getShared(info.This())->restrictions));
-            SegmentsBySourceJS * wrapper
-                = SegmentsBySourceJS::getWrapper(segs);
-            wrapper->owner_ = getSharedPtr(info.This());
-            return segs;
+            return getCachedProperty(info.This(), property, [&] ()
+                {
+                    v8::Handle<v8::Value> segs
+                        = SegmentsBySourceJS::toJS
+                        (ML::make_unowned_std_sp(getShared(info.This())->restrictions));
+                    SegmentsBySourceJS * wrapper
+                        = SegmentsBySourceJS::getWrapper(segs);
+                    wrapper->owner_ = getSharedPtr(info.This());
+                    return segs;
+                });
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1694,6 +1801,7 @@ struct BidRequestJS
                        const v8::AccessorInfo & info)
     {
         try {
+            dropCachedProperty(info.This(), property);
             if (SegmentsBySourceJS::tmpl->HasInstance(value)) {
                 getShared(info.This())->restrictions
                     = *SegmentsBySourceJS::getShared(value);
@@ -1702,7 +1810,7 @@ struct BidRequestJS
             if (value->IsObject()) {
                 map<std::string, std::shared_ptr<SegmentList> > segs;
                 segs = from_js(JSValue(value), &segs);
-                getShared(info.This())->restrictions = SegmentsBySource(segs);
+                getShared(info.This())->restrictions = SegmentsBySource(SegmentsBySourceBase(segs.begin(), segs.end()));
                 return;
             }
             throw ML::Exception("can't convert " + cstr(value)
@@ -1715,8 +1823,11 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
-            auto owner = getSharedPtr(info.This());
-            return UserIdsJS::toJS(owner->userIds, owner);
+            return getCachedProperty(info.This(), property, [&] ()
+                {
+                    auto owner = getSharedPtr(info.This());
+                    return UserIdsJS::toJS(owner->userIds, owner);
+                });
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1726,6 +1837,7 @@ struct BidRequestJS
                        const v8::AccessorInfo & info)
     {
         try {
+            dropCachedProperty(info.This(), property);
             if (UserIdsJS::tmpl->HasInstance(value)) {
                 getShared(info.This())->userIds
                     = *UserIdsJS::getShared(value);
@@ -1750,8 +1862,11 @@ struct BidRequestJS
                   const v8::AccessorInfo & info)
     {
         try {
-            auto owner = getSharedPtr(info.This());
-            return LocationJS::toJS(owner->location, owner);
+            return getCachedProperty(info.This(), property, [&] ()
+                {
+                    auto owner = getSharedPtr(info.This());
+                    return LocationJS::toJS(owner->location, owner);
+                });
         } HANDLE_JS_EXCEPTIONS;
     }
 
@@ -1761,6 +1876,7 @@ struct BidRequestJS
                        const v8::AccessorInfo & info)
     {
         try {
+            dropCachedProperty(info.This(), property);
             if (LocationJS::tmpl->HasInstance(value)) {
                 getShared(info.This())->location
                     = *LocationJS::getShared(value);
@@ -37,6 +37,223 @@ namespace Datacratic {
 namespace JS {
 
 
+/******************************************************************************/
+/* LAZY JSON JS                                                               */
+/******************************************************************************/
+
+const char * LazyJsonName = "LazyJson";
+
+/** Wraps a JSON object, usually the augmentations, so that each member is
+    converted to JS the first time it's read rather than all of them up
+    front.  Agents typically only look at the augmentors they know about.
+*/
+struct LazyJsonJS :
+    public JSWrapped2<Json::Value, LazyJsonJS, LazyJsonName, rtbModule>
+{
+    LazyJsonJS(v8::Handle<v8::Object> This,
+               const std::shared_ptr<Json::Value> & value =
+                   std::shared_ptr<Json::Value>())
+    {
+        HandleScope scope;
+        wrap(This, value);
+    }
+
+    static Handle<v8::Value> New(const Arguments & args)
+    {
+        try {
+            new LazyJsonJS(args.This(), std::make_shared<Json::Value>
+                           (Json::objectValue));
+            return args.This();
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
+    static void Initialize()
+    {
+        Persistent<FunctionTemplate> t = Register(New);
+
+        NODE_SET_PROTOTYPE_METHOD(t, "toJSON", toJSON);
+
+        t->InstanceTemplate()
+            ->SetNamedPropertyHandler(getNamed, setNamed, queryNamed,
+                                      deleteNamed, listNamed);
+    }
+
+    static v8::Handle<v8::Value>
+    toJSON(const Arguments & args)
+    {
+        try {
+            return JS::toJS(*getShared(args.This()));
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
+    static v8::Handle<v8::Value>
+    getNamed(v8::Local<v8::String> property,
+             const v8::AccessorInfo & info)
+    {
+        HandleScope scope;
+        try {
+            const Json::Value & value = *getShared(info.This());
+            string name = cstr(property);
+            if (!value.isObject() || !value.isMember(name))
+                return NULL_HANDLE;
+
+            v8::Local<v8::Value> cached = info.This()->GetHiddenValue(property);
+            if (!cached.IsEmpty())
+                return scope.Close(cached);
+
+            JSValue result = JS::toJS(value[name]);
+            info.This()->SetHiddenValue(property, result);
+            return scope.Close(result);
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
+    static v8::Handle<v8::Value>
+    setNamed(v8::Local<v8::String> property,
+             v8::Local<v8::Value> value,
+             const v8::AccessorInfo & info)
+    {
+        try {
+            Json::Value & json = *getShared(info.This());
+            json[cstr(property)] = JS::fromJS(JSValue(value));
+            info.This()->DeleteHiddenValue(property);
+            return value;
+        } HANDLE_JS_EXCEPTIONS;
+    }
+
+    static v8::Handle<v8::Integer>
+    queryNamed(v8::Local<v8::String> property,
+               const v8::AccessorInfo & info)
+    {
+        const Json::Value & value = *getShared(info.This());
+        if (value.isObject() && value.isMember(cstr(property)))
+            return v8::Integer::New(DontDelete);
+        return NULL_HANDLE;
+    }
+
+    static v8::Handle<v8::Boolean>
+    deleteNamed(v8::Local<v8::String> property,
+                const v8::AccessorInfo & info)
+    {
+        Json::Value & value = *getShared(info.This());
+        if (!value.isObject() || !value.isMember(cstr(property)))
+            return NULL_HANDLE;
+        value.removeMember(cstr(property));
+        info.This()->DeleteHiddenValue(property);
+        return v8::True();
+    }
+
+    static v8::Handle<v8::Array>
+    listNamed(const v8::AccessorInfo & info)
+    {
+        HandleScope scope;
+        try {
+            const Json::Value & value = *getShared(info.This());
+            if (!value.isObject())
+                return scope.Close(v8::Array::New(0));
+
+            v8::Handle<v8::Array> result = v8::Array::New(value.size());
+            unsigned i = 0;
+            for (auto it = value.begin(), end = value.end();
+                 it != end;  ++it, ++i)
+                result->Set(v8::Uint32::New(i), JS::toJS(it.memberName()));
+            return scope.Close(result);
+        } catch (...) {
+            cerr << "got exception in listNamed" << endl;
+            return NULL_HANDLE;
+        }
+    }
+};
+
+/** Augmentations as a LazyJson object. */
+v8::Handle<v8::Value>
+augmentationsToJS(Json::Value augmentations)
+{
+    return LazyJsonJS::toJS
+        (std::make_shared<Json::Value>(std::move(augmentations)));
+}
+
+
+/******************************************************************************/
+/* BID REQUEST CB OPS                                                         */
+/******************************************************************************/
+
+/** Calls JS with the arguments of onBidRequest, passing the augmentations
+    as a LazyJson object rather than converting them all.
+*/
+struct BidRequestCbOps:
+    public JS::JsOpsBase<BidRequestCbOps, RTBKIT::BiddingAgent::BidRequestCb>
+{
+    static v8::Handle<v8::Value>
+    callBoost(const Function & fn,
+              const JS::JSArgs & args)
+    {
+        throw ML::Exception("callBoost for bidRequestCb");
+    }
+
+    struct Forwarder : public calltojsbase {
+
+        Forwarder(v8::Handle<v8::Function> fn,
+                  v8::Handle<v8::Object> This)
+            : calltojsbase(fn, This)
+        {
+        }
+
+        void operator () (double timestamp,
+                          Id id,
+                          std::shared_ptr<RTBKIT::BidRequest> bidRequest,
+                          const RTBKIT::Bids & bids,
+                          double timeLeftMs,
+                          Json::Value augmentations,
+                          RTBKIT::WinCostModel const & wcm)
+        {
+            v8::HandleScope scope;
+            JSValue result;
+            {
+                v8::TryCatch tc;
+                v8::Handle<v8::Value> argv[7];
+                argv[0] = JS::toJS(timestamp);
+                argv[1] = JS::toJS(id);
+                argv[2] = JS::toJS(bidRequest);
+                argv[3] = JS::toJS(bids);
+                argv[4] = JS::toJS(timeLeftMs);
+                argv[5] = augmentationsToJS(std::move(augmentations));
+                argv[6] = JS::toJS(wcm);
+
+                result = params->fn->Call(params->This, 7, argv);
+
+                if (result.IsEmpty()) {
+                    if(tc.HasCaught()) {
+                        // Print JS error and stack trace
+                        char msg[256];
+                        tc.Message()->Get()->WriteAscii(msg, 0, 256);
+                        cout << msg << endl;
+                        char st_msg[2500];
+                        tc.StackTrace()->ToString()->WriteAscii(st_msg, 0, 2500);
+                        cout << st_msg << endl;
+
+                        tc.ReThrow();
+                        throw JSPassException();
+                    }
+                    throw ML::Exception("didn't return anything");
+                }
+            }
+        }
+    };
+
+    static Function
+    asBoost(const v8::Handle<v8::Function> & fn,
+            const v8::Handle<v8::Object> * This)
+    {
+        v8::Handle<v8::Object> This2;
+        if (!This)
+            This2 = v8::Object::New();
+        return Forwarder(fn, This ? *This : This2);
+    }
+};
+
+RegisterJsOps<RTBKIT::BiddingAgent::BidRequestCb>
+reg_bidRequestCb(BidRequestCbOps::op);
+
 
 /******************************************************************************/
 /* RESULT CB OPS                                                              */
@@ -81,7 +298,7 @@ struct ResultCbOps:
                 else argv[5] = v8::Null();
                 argv[6] = JS::toJS(args.ourBid);
                 argv[7] = JS::toJS(args.metadata);
-                argv[8] = JS::toJS(args.augmentations);
+                argv[8] = augmentationsToJS(args.augmentations);
 
                 result = params->fn->Call(params->This, 9, argv);
 
@@ -202,7 +419,6 @@ RegisterJsOps<RTBKIT::BiddingAgent::DeliveryCb> reg_deliveryCb(DeliveryCbOps::op
 
 const char* BiddingAgentName = "BiddingAgent";
 
-RegisterJsOps<RTBKIT::BiddingAgent::BidRequestCb> reg_bidRequestCb;
 RegisterJsOps<RTBKIT::BiddingAgent::PingCb> reg_pingCb;
 RegisterJsOps<RTBKIT::BiddingAgent::ErrorCb> reg_errorCb;
 RegisterJsOps<RTBKIT::BiddingAgent::ByebyeCb> reg_byebyeCb;
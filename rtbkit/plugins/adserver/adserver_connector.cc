@@ -12,6 +12,7 @@
 #include "adserver_connector.h"
 #include "rtbkit/common/auction_events.h"
 #include "rtbkit/common/analytics.h"
+#include "jml/utils/exc_check.h"
 
 using namespace std;
 
@@ -26,7 +27,9 @@ AdServerConnector::
 AdServerConnector(const string & serviceName,
                   const shared_ptr<Datacratic::ServiceProxies> & proxy)
     : ServiceBase(serviceName, proxy),
-      toPostAuctionService_(*this)
+      toPostAuctionService_(*this),
+      maxBatchEvents_(0),
+      maxBatchDelay_(0)
 {
 }
 
@@ -50,6 +53,22 @@ initAnalytics(const Json::Value & config)
     analytics->bindTcp("adServer.logger");
 }
 
+void
+AdServerConnector::
+initEventBatching(size_t maxEvents, double maxDelay)
+{
+    ExcCheck(maxEvents > 0, "maxEvents must be positive");
+    ExcCheck(maxDelay > 0, "maxDelay must be positive");
+    ExcCheck(!maxBatchEvents_, "event batching is already initialized");
+
+    maxBatchEvents_ = maxEvents;
+    maxBatchDelay_ = maxDelay;
+    batch_.reserve(maxEvents);
+
+    batchLoop_.addPeriodic("AdServerConnector::flushEvents", maxDelay,
+                           [=] (uint64_t) { flushEvents(); });
+}
+
 void
 AdServerConnector::
 init(shared_ptr<ConfigurationService> config)
@@ -69,12 +88,25 @@ start()
     startTime_ = Date::now();
     recordHit("up");
     if (analytics) analytics->start();
+    if (maxBatchEvents_) batchLoop_.start();
 }
 
 void
 AdServerConnector::
 shutdown()
 {
+    if (maxBatchEvents_) {
+        batchLoop_.shutdown();
+
+        std::vector< std::shared_ptr<PostAuctionEvent> > events;
+        {
+            std::lock_guard<std::mutex> guard(batchLock_);
+            events.swap(batch_);
+        }
+        if (!events.empty())
+            toPostAuctionService_.sendEvents(events);
+    }
+
     if (analytics) analytics->shutdown();
 }
 
@@ -111,7 +143,7 @@ publishWin(const Id & bidRequestId,
     event->account = account;
     event->bidTimestamp = bidTimestamp;
 
-    toPostAuctionService_.sendEvent(event);
+    sendEvent(std::move(event));
 }
 
 void
@@ -135,7 +167,7 @@ publishLoss(const Id & bidRequestId,
     event->account = account;
     event->bidTimestamp = bidTimestamp;
 
-    toPostAuctionService_.sendEvent(event);
+    sendEvent(std::move(event));
 }
 
 void
@@ -159,7 +191,7 @@ publishCampaignEvent(const string & label,
     event->uids = ids;
     event->metadata = impressionMeta;
 
-    toPostAuctionService_.sendEvent(event);
+    sendEvent(std::move(event));
 }
 
 void
@@ -174,6 +206,51 @@ publishUserEvent(const string & label,
     recordHit("event." + label);
 }
 
+void
+AdServerConnector::
+sendEvent(std::shared_ptr<PostAuctionEvent> event)
+{
+    if (!maxBatchEvents_) {
+        toPostAuctionService_.sendEvent(std::move(event));
+        return;
+    }
+
+    std::vector< std::shared_ptr<PostAuctionEvent> > events;
+    {
+        std::lock_guard<std::mutex> guard(batchLock_);
+        if (batch_.empty())
+            batchStarted_ = Date::now();
+        batch_.push_back(std::move(event));
+        if (batch_.size() < maxBatchEvents_)
+            return;
+
+        events.reserve(maxBatchEvents_);
+        events.swap(batch_);
+    }
+
+    recordCount(events.size(), "eventBatchSize");
+    toPostAuctionService_.sendEvents(events);
+}
+
+void
+AdServerConnector::
+flushEvents()
+{
+    std::vector< std::shared_ptr<PostAuctionEvent> > events;
+    {
+        std::lock_guard<std::mutex> guard(batchLock_);
+        if (batch_.empty()
+            || batchStarted_.plusSeconds(maxBatchDelay_) > Date::now())
+            return;
+
+        events.reserve(maxBatchEvents_);
+        events.swap(batch_);
+    }
+
+    recordCount(events.size(), "eventBatchSize");
+    toPostAuctionService_.sendEvents(events);
+}
+
 std::unique_ptr<AdServerConnector> AdServerConnector::create(
         std::string const & serviceName, 
         std::shared_ptr<ServiceProxies> const & proxies, 
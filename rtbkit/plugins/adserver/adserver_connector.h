@@ -10,6 +10,7 @@
 
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_endpoint.h"
+#include "soa/service/message_loop.h"
 #include "soa/types/id.h"
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/json_holder.h"
@@ -33,7 +34,15 @@ struct AdServerConnector : public Datacratic::ServiceBase
     virtual ~AdServerConnector();
 
     void initAnalytics(const Json::Value & config = Json::Value::null);
-    
+
+    /** Forward events to the post auction service in batches, with one
+        message per post auction shard, rather than one message per event.
+        A batch is sent once it has maxEvents events or when it's been
+        waiting for maxDelay seconds.  Requires post auction services that
+        handle EVENTS messages.  Must be called before start().
+    */
+    void initEventBatching(size_t maxEvents, double maxDelay);
+
     void init(std::shared_ptr<ConfigurationService> config);
 
     virtual void shutdown();
@@ -122,6 +131,17 @@ private:
     // Connection to the post auction loops
     PostAuctionProxy toPostAuctionService_;
 
+    void sendEvent(std::shared_ptr<PostAuctionEvent> event);
+    void flushEvents();
+
+    // Events waiting to be forwarded; see initEventBatching()
+    size_t maxBatchEvents_;
+    double maxBatchDelay_;
+    Date batchStarted_;
+    std::mutex batchLock_;
+    std::vector< std::shared_ptr<PostAuctionEvent> > batch_;
+    MessageLoop batchLoop_;
+
     // later... when we have multiple services
     //ZmqMultipleNamedClientBusProxy toPostAuctionServices;
 };
@@ -6,6 +6,7 @@
 
 #include <memory>
 
+#include "jml/utils/exc_check.h"
 #include "http_adserver_connector.h"
 
 
@@ -35,10 +36,40 @@ handleUnknownHeader(const HttpHeader& header) {
     throw ML::Exception("Unknown resource '" + header.resource + "'");
 }
 
+void
+HttpAdServerConnectionHandler::
+handleHttpPayload(const HttpHeader & header, const string & payload)
+{
+    if (!endpoint_.payloadCb()) {
+        JsonConnectionHandler::handleHttpPayload(header, payload);
+        return;
+    }
+
+    auto handler = [&] () { return endpoint_.payloadCb()(header, payload); };
+    auto message = [&] () -> Json::Value
+        {
+            try {
+                return Json::parse(payload);
+            } catch (const exception & exc) {
+                return Json::Value(payload);
+            }
+        };
+    handleRequest(handler, message);
+}
+
 void
 HttpAdServerConnectionHandler::
 handleJson(const HttpHeader & header, const Json::Value & json,
            const string & jsonStr)
+{
+    handleRequest([&] () { return requestCb_(header, json, jsonStr); },
+                  [&] () { return json; });
+}
+
+void
+HttpAdServerConnectionHandler::
+handleRequest(const std::function<HttpAdServerResponse ()> & handler,
+              const std::function<Json::Value ()> & message)
 {
     string resultMsg;
 
@@ -54,7 +85,7 @@ handleJson(const HttpHeader & header, const Json::Value & json,
     };
 
     try {
-        HttpAdServerResponse returnValue = requestCb_(header, json, jsonStr);
+        HttpAdServerResponse returnValue = handler();
         if(returnValue.valid) {
             resultMsg = ("HTTP/1.1 200 OK\r\n"
                      "Content-Type: none\r\n"
@@ -63,10 +94,11 @@ handleJson(const HttpHeader & header, const Json::Value & json,
         }
         else {
             endpoint_.doEvent("error.rqParsingError");
-            resultMsg = sendErrorResponse(returnValue.error, returnValue.details, json);
+            resultMsg = sendErrorResponse(returnValue.error, returnValue.details, message());
         }
     }
     catch (const exception & exc) {
+        Json::Value json = message();
         cerr << "error parsing adserver request " << json << ": "
              << exc.what() << endl;
         endpoint_.doEvent("error.rqParsingError");
@@ -116,6 +148,7 @@ HttpAdServerHttpEndpoint(HttpAdServerHttpEndpoint && otherEndpoint)
 {
     port_ = otherEndpoint.port_;
     requestCb_ = otherEndpoint.requestCb_;
+    payloadCb_ = otherEndpoint.payloadCb_;
 }
 
 HttpAdServerHttpEndpoint::
@@ -131,6 +164,7 @@ operator = (const HttpAdServerHttpEndpoint& other)
     if (this != &other) {
         port_ = other.port_;
         requestCb_ = other.requestCb_;
+        payloadCb_ = other.payloadCb_;
     }
 
     return *this;
@@ -144,6 +178,13 @@ getPort()
     return port_;
 }
 
+void
+HttpAdServerHttpEndpoint::
+setPayloadCb(const HttpAdServerPayloadCb & payloadCb)
+{
+    payloadCb_ = payloadCb;
+}
+
 shared_ptr<ConnectionHandler>
 HttpAdServerHttpEndpoint::
 makeNewHandler()
@@ -159,7 +200,9 @@ makeNewHandler()
 HttpAdServerConnector::
 HttpAdServerConnector(const string & serviceName,
                       const shared_ptr<Datacratic::ServiceProxies> & proxy)
-    : AdServerConnector(serviceName, proxy)
+    : AdServerConnector(serviceName, proxy),
+      numThreads_(4),
+      numAcceptors_(1)
 {
 }
 
@@ -170,6 +213,23 @@ registerEndpoint(int port, const HttpAdServerRequestCb & requestCb)
     endpoints_.emplace_back(port, requestCb);
 }
 
+void
+HttpAdServerConnector::
+registerPayloadEndpoint(int port, const HttpAdServerPayloadCb & payloadCb)
+{
+    endpoints_.emplace_back(port, HttpAdServerRequestCb());
+    endpoints_.back().setPayloadCb(payloadCb);
+}
+
+void
+HttpAdServerConnector::
+setIngestThreads(int numThreads, int numAcceptors)
+{
+    ExcCheck(numThreads > 0, "numThreads must be positive");
+    numThreads_ = numThreads;
+    numAcceptors_ = numAcceptors;
+}
+
 void
 HttpAdServerConnector::
 init(const shared_ptr<ConfigurationService> & config)
@@ -198,7 +258,8 @@ HttpAdServerConnector::
 bindTcp()
 {
     for (HttpAdServerHttpEndpoint & endpoint: endpoints_) {
-        endpoint.init(endpoint.getPort(), "0.0.0.0", 4);
+        endpoint.setReusePortAcceptors(numAcceptors_);
+        endpoint.init(endpoint.getPort(), "0.0.0.0", numThreads_);
     }
 }
 
@@ -40,6 +40,13 @@ typedef std::function<HttpAdServerResponse (const HttpHeader & header,
                             const std::string & jsonStr)>
     HttpAdServerRequestCb;
 
+/** Callback that gets the raw payload of the request, for handlers that
+    parse it themselves rather than going through a Json::Value.
+*/
+typedef std::function<HttpAdServerResponse (const HttpHeader & header,
+                                            const std::string & payload)>
+    HttpAdServerPayloadCb;
+
 struct HttpAdServerConnectionHandler
     : public Datacratic::JsonConnectionHandler {
     HttpAdServerConnectionHandler(HttpAdServerHttpEndpoint & endpoint,
@@ -47,11 +54,19 @@ struct HttpAdServerConnectionHandler
 
     virtual void handleUnknownHeader(const HttpHeader& header);
 
+    virtual void handleHttpPayload(const HttpHeader & header,
+                                   const std::string & payload);
+
     virtual void handleJson(const HttpHeader & header,
                             const Json::Value & json,
                             const std::string & jsonStr);
 
 private:
+    /** Run the handler and send its response.  message returns the request
+        to echo in error responses. */
+    void handleRequest(const std::function<HttpAdServerResponse ()> & handler,
+                       const std::function<Json::Value ()> & message);
+
     std::string sendErrorResponse(const std::string & error, const std::string & details, const Json::Value & json);
     
     HttpAdServerHttpEndpoint & endpoint_;
@@ -75,6 +90,11 @@ struct HttpAdServerHttpEndpoint : public Datacratic::HttpEndpoint {
 
     int getPort() const;
 
+    /** Hand the raw payload to the given callback instead of parsing it
+        into the Json::Value that the request callback takes. */
+    void setPayloadCb(const HttpAdServerPayloadCb & payloadCb);
+    const HttpAdServerPayloadCb & payloadCb() const { return payloadCb_; }
+
     /* carbon logging */
     typedef std::function<void (const char * eventName,
                                 StatEventType,
@@ -98,6 +118,7 @@ struct HttpAdServerHttpEndpoint : public Datacratic::HttpEndpoint {
 private:
     int port_;
     HttpAdServerRequestCb requestCb_;
+    HttpAdServerPayloadCb payloadCb_;
 };
         
 /****************************************************************************/
@@ -114,6 +135,16 @@ struct HttpAdServerConnector : public AdServerConnector {
 
     void registerEndpoint(int port, const HttpAdServerRequestCb & requestCb);
 
+    /** Register an endpoint whose callback parses the raw payload. */
+    void registerPayloadEndpoint(int port,
+                                 const HttpAdServerPayloadCb & payloadCb);
+
+    /** Serve each endpoint with numThreads threads, accepting connections
+        on numAcceptors SO_REUSEPORT sockets.  Must be called before
+        bindTcp().
+    */
+    void setIngestThreads(int numThreads, int numAcceptors = 1);
+
     void init(const std::shared_ptr<ConfigurationService> & config);
     void shutdown();
 
@@ -125,6 +156,8 @@ struct HttpAdServerConnector : public AdServerConnector {
 
 private:
     std::vector<HttpAdServerHttpEndpoint> endpoints_;
+    int numThreads_;
+    int numAcceptors_;
 };
 
 } //namespace RTBKIT
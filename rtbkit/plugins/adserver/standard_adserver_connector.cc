@@ -11,6 +11,9 @@
 #include "soa/service/service_base.h"
 #include "soa/service/service_utils.h"
 #include "soa/types/date.h"
+#include "soa/types/json_parsing.h"
+
+#include <cstring>
 
 #include "standard_adserver_connector.h"
 
@@ -37,8 +40,21 @@ StandardAdServerConnector(std::string const & serviceName,
     verbose = json.get("verbose", false).asBool();
     bool analytics = json.get("analytics", false).asBool();
     int conns = json.get("analytics-connections", 16).asInt();
+    bool streamingParser = json.get("streamingParser", false).asBool();
+
+    // Bursts of wins are spread over more threads and accept sockets, and
+    // forwarded to the post auction shards in batches
+    setIngestThreads(json.get("ingestThreads", 4).asInt(),
+                     json.get("ingestAcceptors", 1).asInt());
+
+    auto batching = json["eventBatching"];
+    if (!batching.isNull()) {
+        initEventBatching(batching.get("maxEvents", 64).asInt(),
+                          batching.get("maxDelayMs", 1.0).asDouble() / 1000.0);
+    }
+
     initEventType(json);
-    init(winPort, eventsPort, verbose, analytics, conns);
+    init(winPort, eventsPort, verbose, analytics, conns, streamingParser);
 }
 
 void
@@ -63,7 +79,8 @@ initEventType(const Json::Value &json) {
 void
 StandardAdServerConnector::
 init(int winsPort, int eventsPort, bool verbose, 
-     bool analyticsPublisherOn, int analyticsPublisherConnections)
+     bool analyticsPublisherOn, int analyticsPublisherConnections,
+     bool streamingParser)
 {
     if(!verbose) {
         adserverTrace.deactivate();
@@ -71,11 +88,20 @@ init(int winsPort, int eventsPort, bool verbose,
 
     shared_ptr<ServiceProxies> services = getServices();
 
-    auto win = &StandardAdServerConnector::handleWinRq;
-    registerEndpoint(winsPort, bind(win, this, _1, _2, _3));
+    if (streamingParser) {
+        auto win = &StandardAdServerConnector::handleWinPayload;
+        registerPayloadEndpoint(winsPort, bind(win, this, _1, _2));
 
-    auto delivery = &StandardAdServerConnector::handleDeliveryRq;
-    registerEndpoint(eventsPort, bind(delivery, this, _1, _2, _3));
+        auto delivery = &StandardAdServerConnector::handleDeliveryPayload;
+        registerPayloadEndpoint(eventsPort, bind(delivery, this, _1, _2));
+    }
+    else {
+        auto win = &StandardAdServerConnector::handleWinRq;
+        registerEndpoint(winsPort, bind(win, this, _1, _2, _3));
+
+        auto delivery = &StandardAdServerConnector::handleDeliveryRq;
+        registerEndpoint(eventsPort, bind(delivery, this, _1, _2, _3));
+    }
 
     HttpAdServerConnector::init(services->config);
 
@@ -124,37 +150,159 @@ errorResponseHelper(HttpAdServerResponse & resp,
     resp.details = details;
 }
 
+StandardAdServerConnector::Message::
+Message()
+    : hasTimestamp(false), timestamp(0.0),
+      hasBidRequestId(false), hasImpId(false),
+      hasPrice(false), price(0.0),
+      hasType(false)
+{
+}
+
+StandardAdServerConnector::Message
+StandardAdServerConnector::Message::
+fromJson(const Json::Value & json)
+{
+    Message message;
+
+    if (json.isMember("timestamp")) {
+        message.hasTimestamp = true;
+        if(json["timestamp"].isString())
+            message.timestamp = stod(json["timestamp"].asString());
+        else message.timestamp = json["timestamp"].asDouble();
+    }
+
+    if (json.isMember("bidRequestId")) {
+        message.hasBidRequestId = true;
+        message.bidRequestId = json["bidRequestId"].asString();
+    }
+
+    if (json.isMember("impid")) {
+        message.hasImpId = true;
+        message.impId = json["impid"].asString();
+    }
+
+    if (json.isMember("price")) {
+        message.hasPrice = true;
+        message.price = json["price"].asDouble();
+    }
+
+    if (json.isMember("type")) {
+        message.hasType = true;
+        message.type = json["type"].asString();
+    }
+
+    if (json.isMember("passback"))
+        message.passback = json["passback"].asString();
+
+    if (json.isMember("userIds")) {
+        auto item = json["userIds"];
+        if(!item.empty())
+            message.userId = item[0].asString();
+    }
+
+    return message;
+}
+
+StandardAdServerConnector::Message
+StandardAdServerConnector::Message::
+parse(const std::string & payload)
+{
+    Message message;
+
+    StreamingJsonParsingContext context("adserver message",
+                                        payload.c_str(),
+                                        payload.c_str() + payload.size());
+
+    context.forEachMember([&] () {
+            const char * name = context.fieldNamePtr();
+
+            if (!strcmp(name, "timestamp")) {
+                message.hasTimestamp = true;
+                if (context.isString())
+                    message.timestamp = stod(context.expectStringAscii());
+                else message.timestamp = context.expectDouble();
+            }
+            else if (!strcmp(name, "bidRequestId")) {
+                message.hasBidRequestId = true;
+                message.bidRequestId = context.expectStringAscii();
+            }
+            else if (!strcmp(name, "impid")) {
+                message.hasImpId = true;
+                message.impId = context.expectStringAscii();
+            }
+            else if (!strcmp(name, "price")) {
+                message.hasPrice = true;
+                message.price = context.expectDouble();
+            }
+            else if (!strcmp(name, "type")) {
+                message.hasType = true;
+                message.type = context.expectStringAscii();
+            }
+            else if (!strcmp(name, "passback"))
+                message.passback = context.expectStringAscii();
+            else if (!strcmp(name, "userIds")) {
+                context.forEachElement([&] () {
+                        if (message.userId.empty())
+                            message.userId = context.expectStringAscii();
+                        else context.skip();
+                    });
+            }
+            else context.skip();
+        });
+
+    return message;
+}
+
 HttpAdServerResponse
 StandardAdServerConnector::
 handleWinRq(const HttpHeader & header,
             const Json::Value & json, const std::string & jsonStr)
+{
+    return handleWin(Message::fromJson(json));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleWinPayload(const HttpHeader & header, const std::string & payload)
+{
+    return handleWin(Message::parse(payload));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleDeliveryRq(const HttpHeader & header,
+                 const Json::Value & json, const std::string & jsonStr)
+{
+    return handleDelivery(Message::fromJson(json));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleDeliveryPayload(const HttpHeader & header, const std::string & payload)
+{
+    return handleDelivery(Message::parse(payload));
+}
+
+HttpAdServerResponse
+StandardAdServerConnector::
+handleWin(const Message & message)
 {
     HttpAdServerResponse response;
 
     Date timestamp;
-    string bidRequestIdStr;
-    string impIdStr;
-    double winPriceDbl;
-
     Id bidRequestId;
     Id impId;
     USD_CPM winPrice;
 
     UserIds userIds;
-    string userIdStr;
-    string passback;
 
     /*
      *  Timestamp is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("timestamp")) {
-        if(json["timestamp"].isString()) {
-           double tm = stod(json["timestamp"].asString());
-           timestamp = Date::fromSecondsSinceEpoch(tm);
-        } else {
-            timestamp = Date::fromSecondsSinceEpoch(json["timestamp"].asDouble());
-        }
+    if (message.hasTimestamp) {
+        timestamp = Date::fromSecondsSinceEpoch(message.timestamp);
 
         // Check if timestamp is finite when treated as seconds
         if(!timestamp.isADate()) {
@@ -176,9 +324,8 @@ handleWinRq(const HttpHeader & header,
      *  bidRequestId is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("bidRequestId")) {
-        bidRequestIdStr = json["bidRequestId"].asString();
-        bidRequestId = Id(bidRequestIdStr); 
+    if (message.hasBidRequestId) {
+        bidRequestId = Id(message.bidRequestId);
     } else {
         errorResponseHelper(response,
                             "MISSING_BIDREQUESTID",
@@ -191,9 +338,8 @@ handleWinRq(const HttpHeader & header,
      *  impid is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("impid")) {
-        impIdStr = json["impid"].asString();
-        impId = Id(impIdStr);
+    if (message.hasImpId) {
+        impId = Id(message.impId);
     } else {
         errorResponseHelper(response,
                             "MISSING_IMPID",
@@ -206,9 +352,8 @@ handleWinRq(const HttpHeader & header,
      *  price is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("price")) {
-        winPriceDbl = json["price"].asDouble();
-        winPrice = USD_CPM(winPriceDbl);
+    if (message.hasPrice) {
+        winPrice = USD_CPM(message.price);
     } else {
         errorResponseHelper(response,
                             "MISSING_WINPRICE",
@@ -216,30 +361,12 @@ handleWinRq(const HttpHeader & header,
         publishError(response);
         return response;
     }
-    
-    /*
-     *  UserIds is an optional field.
-     *  If null, we just put an empty array.
-     */
-    if (json.isMember("userIds")) {
-        auto item =  json["userIds"];
-        if(!item.empty())
-            userIds.add(Id(item[0].asString()), ID_PROVIDER);
-    }
-    else {
-        // UserIds is optional
-    }
 
     /*
-     *  Passback is an optional field.
-     *  If null, we just put an empty string.
+     *  UserIds and passback are optional fields.
      */
-    if (json.isMember("passback")) {
-        passback =  json["passback"].asString();
-    }
-    else {
-        // Passback is optional
-    }
+    if (!message.userId.empty())
+        userIds.add(Id(message.userId), ID_PROVIDER);
 
     LOG(adserverTrace) << "{\"timestamp\":\"" << timestamp.print(3) << "\"," <<
         "\"bidRequestId\":\"" << bidRequestId << "\"," <<
@@ -248,13 +375,13 @@ handleWinRq(const HttpHeader & header,
 
     if(response.valid) {
         publishWin(bidRequestId, impId, winPrice, timestamp, Json::Value(), userIds,
-                   AccountKey(passback), Date());
+                   AccountKey(message.passback), Date());
         if (analytics) analytics->logStandardWinMessage(timestamp.print(3),
-                                                        bidRequestIdStr,
-                                                        impIdStr,
+                                                        message.bidRequestId,
+                                                        message.impId,
                                                         winPrice.toString());
-        analyticsPublisher_.publish("WIN", timestamp.print(3), bidRequestIdStr,
-                           impIdStr, winPrice.toString());
+        analyticsPublisher_.publish("WIN", timestamp.print(3), message.bidRequestId,
+                           message.impId, winPrice.toString());
     }
 
     return response;
@@ -262,12 +389,10 @@ handleWinRq(const HttpHeader & header,
 
 HttpAdServerResponse
 StandardAdServerConnector::
-handleDeliveryRq(const HttpHeader & header,
-                 const Json::Value & json, const std::string & jsonStr)
+handleDelivery(const Message & message)
 {    
     HttpAdServerResponse response;
-    string bidRequestIdStr, impIdStr, userIdStr, event;
-    Id bidRequestId, impId, userId;
+    Id bidRequestId, impId;
     UserIds userIds;
     Date timestamp;
     
@@ -275,13 +400,8 @@ handleDeliveryRq(const HttpHeader & header,
      *  Timestamp is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("timestamp")) {
-        if(json["timestamp"].isString()) {
-           double tm = stod(json["timestamp"].asString());
-           timestamp = Date::fromSecondsSinceEpoch(tm);
-        } else {
-            timestamp = Date::fromSecondsSinceEpoch(json["timestamp"].asDouble());
-        }
+    if (message.hasTimestamp) {
+        timestamp = Date::fromSecondsSinceEpoch(message.timestamp);
         
         // Check if timestamp is finite when treated as seconds
         if(!timestamp.isADate()) {
@@ -303,10 +423,8 @@ handleDeliveryRq(const HttpHeader & header,
      *  type is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("type")) {
-
-        event = (json["type"].asString());
-        
+    const string & event = message.type;
+    if (message.hasType) {
         if(eventType.find(event) == eventType.end()) {
             errorResponseHelper(response,
                                 "UNSUPPORTED_TYPE",
@@ -328,9 +446,7 @@ handleDeliveryRq(const HttpHeader & header,
      *  impid is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("impid")) {
-
-    } else {
+    if (!message.hasImpId) {
         errorResponseHelper(response,
                             "MISSING_IMPID",
                             "A campaign event requires the impId field.");
@@ -342,9 +458,7 @@ handleDeliveryRq(const HttpHeader & header,
      *  bidRequestId is an required field.
      *  If null, we return an error response.
      */
-    if (json.isMember("bidRequestId")) {
-
-    } else {
+    if (!message.hasBidRequestId) {
         errorResponseHelper(response,
                             "MISSING_BIDREQUESTID",
                             "A campaign event requires the bidRequestId field.");
@@ -354,39 +468,30 @@ handleDeliveryRq(const HttpHeader & header,
 
     /*
      *  UserIds is an optional field.
-     *  If null, we just put an empty array.
      */
-    if (json.isMember("userIds")) {
-        auto item =  json["userIds"];
-
-        if(!item.empty())
-            userIds.add(Id(item[0].asString()), ID_PROVIDER);
-    }
-    else {
-        // UserIds is optional
-    }
+    if (!message.userId.empty())
+        userIds.add(Id(message.userId), ID_PROVIDER);
 
-    bidRequestIdStr = json["bidRequestId"].asString();
-    impIdStr = json["impid"].asString();
-    bidRequestId = Id(bidRequestIdStr);
-    impId = Id(impIdStr);
+    bidRequestId = Id(message.bidRequestId);
+    impId = Id(message.impId);
     
     LOG(adserverTrace) << "{\"timestamp\":\"" << timestamp.print(3) << "\"," <<
-        "\"bidRequestId\":\"" << bidRequestIdStr << "\"," <<
-        "\"impId\":\"" << impIdStr << "\"," <<
+        "\"bidRequestId\":\"" << message.bidRequestId << "\"," <<
+        "\"impId\":\"" << message.impId << "\"," <<
         "\"event\":\"" << event << 
         "\"userIds\":" << userIds.toString() << "\"}";
 
     if(response.valid) {
-        publishCampaignEvent(eventType[event], bidRequestId, impId, timestamp,
+        const string & label = eventType[event];
+        publishCampaignEvent(label, bidRequestId, impId, timestamp,
                                  Json::Value(), userIds);
-        if (analytics) analytics->logStandardEventMessage(eventType[event],
+        if (analytics) analytics->logStandardEventMessage(label,
                                                           timestamp.print(3),
-                                                          bidRequestIdStr,
-                                                          impIdStr,
+                                                          message.bidRequestId,
+                                                          message.impId,
                                                           userIds.toString());
-        analyticsPublisher_.publish(eventType[event], timestamp.print(3), bidRequestIdStr,
-                                impIdStr, userIds.toString());
+        analyticsPublisher_.publish(label, timestamp.print(3), message.bidRequestId,
+                                message.impId, userIds.toString());
     }
     return response;
 }
@@ -39,6 +39,39 @@ struct StandardAdServerConnector : public HttpAdServerConnector
                                           const Json::Value & json,
                                           const std::string & jsonStr);
 
+    /** Same as handleWinRq() and handleDeliveryRq(), but parse the payload
+        with a streaming parser instead of building a Json::Value.  Used
+        when the connector is configured with "streamingParser".
+    */
+    HttpAdServerResponse handleWinPayload(const HttpHeader & header,
+                                          const std::string & payload);
+    HttpAdServerResponse handleDeliveryPayload(const HttpHeader & header,
+                                               const std::string & payload);
+
+    /** Fields of a win or delivery message. */
+    struct Message {
+        Message();
+
+        static Message fromJson(const Json::Value & json);
+        static Message parse(const std::string & payload);
+
+        bool hasTimestamp;
+        double timestamp;           ///< Seconds since the epoch
+        bool hasBidRequestId;
+        std::string bidRequestId;
+        bool hasImpId;
+        std::string impId;
+        bool hasPrice;
+        double price;
+        bool hasType;
+        std::string type;
+        std::string passback;
+        std::string userId;         ///< First of the userIds
+    };
+
+    HttpAdServerResponse handleWin(const Message & message);
+    HttpAdServerResponse handleDelivery(const Message & message);
+
     void publishError(HttpAdServerResponse & resp);
 
     /** */
@@ -47,7 +80,8 @@ struct StandardAdServerConnector : public HttpAdServerConnector
 private :
 
     void init(int winsPort, int eventsPort, bool verbose,
-                    bool analyticsPublisherOn = false, int analyticsPublisherConnections = 1);
+                    bool analyticsPublisherOn = false, int analyticsPublisherConnections = 1,
+                    bool streamingParser = false);
     virtual void initEventType(const Json::Value &json);
 
     std::map<std::string, std::string> eventType;
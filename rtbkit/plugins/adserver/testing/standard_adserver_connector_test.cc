@@ -187,3 +187,32 @@ BOOST_AUTO_TEST_CASE( test_standard_adserver_conversion )
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE( test_standard_adserver_streaming_parser )
+{
+    typedef StandardAdServerConnector::Message Message;
+
+    std::vector<string> samples = loadMultilineFile(conversion_sample_filename);
+    samples.push_back(loadFile(win_sample_filename));
+    samples.push_back("{\"timestamp\":1397065534,\"userIds\":[\"a\",\"b\"],"
+                      "\"passback\":\"x:y\",\"other\":{\"z\":[1,2]}}");
+
+    // The streaming parser must read the same fields as going through JSON
+    for (auto const& sample : samples) {
+        Message expected = Message::fromJson(Json::parse(sample));
+        Message parsed = Message::parse(sample);
+
+        BOOST_CHECK_EQUAL(parsed.hasTimestamp, expected.hasTimestamp);
+        BOOST_CHECK_EQUAL(parsed.timestamp, expected.timestamp);
+        BOOST_CHECK_EQUAL(parsed.hasBidRequestId, expected.hasBidRequestId);
+        BOOST_CHECK_EQUAL(parsed.bidRequestId, expected.bidRequestId);
+        BOOST_CHECK_EQUAL(parsed.hasImpId, expected.hasImpId);
+        BOOST_CHECK_EQUAL(parsed.impId, expected.impId);
+        BOOST_CHECK_EQUAL(parsed.hasPrice, expected.hasPrice);
+        BOOST_CHECK_EQUAL(parsed.price, expected.price);
+        BOOST_CHECK_EQUAL(parsed.hasType, expected.hasType);
+        BOOST_CHECK_EQUAL(parsed.type, expected.type);
+        BOOST_CHECK_EQUAL(parsed.passback, expected.passback);
+        BOOST_CHECK_EQUAL(parsed.userId, expected.userId);
+    }
+}
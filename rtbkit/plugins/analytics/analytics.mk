@@ -1,6 +1,6 @@
 # analytics makefile
 
-$(eval $(call library,analytics_endpoint,analytics_endpoint.cc,services))
+$(eval $(call library,analytics_endpoint,analytics_endpoint.cc analytics_aggregator.cc,services))
 $(eval $(call program,analytics_runner,analytics_endpoint boost_program_options))
 
 $(eval $(call library,zmq_analytics,zmq_analytics.cc,zmq services rtb_router))
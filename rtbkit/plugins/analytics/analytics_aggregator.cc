@@ -0,0 +1,270 @@
+/** analytics_aggregator.cc
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Implementation of the analytics aggregator.
+
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+#include "analytics_aggregator.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+/********************************************************************************/
+/* QUANTILE SKETCH                                                              */
+/********************************************************************************/
+
+QuantileSketch::
+QuantileSketch(double relativeAccuracy)
+    : gamma((1 + relativeAccuracy) / (1 - relativeAccuracy)),
+      logGamma(std::log(gamma)),
+      zeros(0), total(0)
+{
+}
+
+int
+QuantileSketch::
+bucket(double magnitude) const
+{
+    return (int)std::ceil(std::log(magnitude) / logGamma);
+}
+
+double
+QuantileSketch::
+bucketValue(int bucket) const
+{
+    return 2 * std::pow(gamma, bucket) / (gamma + 1);
+}
+
+void
+QuantileSketch::
+add(double value, double weight)
+{
+    // Values too close to 0 for a bucket are counted as 0.
+    if (value > 1e-9)
+        positive[bucket(value)] += weight;
+    else if (value < -1e-9)
+        negative[bucket(-value)] += weight;
+    else zeros += weight;
+
+    total += weight;
+}
+
+double
+QuantileSketch::
+quantile(double q) const
+{
+    if (total <= 0) return 0;
+
+    double rank = q * total;
+    double seen = 0;
+
+    for (auto it = negative.rbegin(); it != negative.rend(); ++it) {
+        seen += it->second;
+        if (seen > rank) return -bucketValue(it->first);
+    }
+
+    seen += zeros;
+    if (seen > rank) return 0;
+
+    for (const auto & entry : positive) {
+        seen += entry.second;
+        if (seen > rank) return bucketValue(entry.first);
+    }
+
+    // q == 1 lands past the last bucket.
+    if (!positive.empty()) return bucketValue(positive.rbegin()->first);
+    if (zeros > 0) return 0;
+    return -bucketValue(negative.begin()->first);
+}
+
+
+/********************************************************************************/
+/* AGGREGATION CONFIG                                                           */
+/********************************************************************************/
+
+Json::Value
+AggregationConfig::
+toJson() const
+{
+    Json::Value result(Json::objectValue);
+    result["window"] = window;
+    result["keyFields"] = Json::Value(Json::arrayValue);
+    for (int field : keyFields)
+        result["keyFields"].append(field);
+    result["valueField"] = valueField;
+    return result;
+}
+
+
+/********************************************************************************/
+/* ANALYTICS AGGREGATOR                                                         */
+/********************************************************************************/
+
+namespace {
+
+/** Returns the given field of an event, or an empty string if the event
+    doesn't have that many fields.
+*/
+std::pair<const char *, size_t>
+getField(const string & event, int index)
+{
+    const char * p = event.c_str();
+    const char * end = p + event.size();
+
+    for (;;) {
+        const char * fieldEnd = (const char *)memchr(p, ' ', end - p);
+        if (!fieldEnd) fieldEnd = end;
+        if (index-- == 0) return { p, fieldEnd - p };
+        if (fieldEnd == end) return { end, 0 };
+        p = fieldEnd + 1;
+    }
+}
+
+} // file scope
+
+void
+AnalyticsAggregator::
+configure(const string & channel, const AggregationConfig & config)
+{
+    if (!(config.window > 0))
+        throw ML::Exception("aggregation window must be positive");
+
+    std::lock_guard<std::mutex> guard(lock);
+    Channel & entry = channels[channel];
+    entry.config = config;
+    entry.stats.clear();
+}
+
+void
+AnalyticsAggregator::
+remove(const string & channel)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    channels.erase(channel);
+}
+
+bool
+AnalyticsAggregator::
+isAggregated(const string & channel) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return channels.count(channel);
+}
+
+Json::Value
+AnalyticsAggregator::
+getConfig() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Json::Value result(Json::objectValue);
+    for (const auto & channel : channels)
+        result[channel.first] = channel.second.config.toJson();
+    return result;
+}
+
+bool
+AnalyticsAggregator::
+add(const string & channel, const string & event, double weight, Date now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto it = channels.find(channel);
+    if (it == channels.end()) return false;
+    Channel & entry = it->second;
+
+    if (now >= entry.start.plusSeconds(entry.config.window))
+        closeWindow(channel, entry, now);
+
+    string key;
+    const auto & keyFields = entry.config.keyFields;
+    for (size_t i = 0; i < keyFields.size(); ++i) {
+        auto value = getField(event, keyFields[i]);
+        if (i) key += ' ';
+        key.append(value.first, value.second);
+    }
+
+    Stats & stats = entry.stats[key];
+    stats.count += weight;
+
+    if (entry.config.valueField >= 0) {
+        auto field = getField(event, entry.config.valueField);
+        string text(field.first, field.second);
+        char * end;
+        double value = strtod(text.c_str(), &end);
+        if (!text.empty() && *end == 0) {
+            stats.sum += weight * value;
+            stats.sketch.add(value, weight);
+        }
+    }
+
+    return true;
+}
+
+Json::Value
+AnalyticsAggregator::
+closeWindows(Date now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (auto & channel : channels) {
+        Channel & entry = channel.second;
+        if (now >= entry.start.plusSeconds(entry.config.window))
+            closeWindow(channel.first, entry, now);
+    }
+
+    Json::Value result(Json::arrayValue);
+    result.swap(closed);
+    return result;
+}
+
+void
+AnalyticsAggregator::
+closeWindow(const string & name, Channel & channel, Date now)
+{
+    const AggregationConfig & config = channel.config;
+    Date end = channel.start.plusSeconds(config.window);
+
+    for (const auto & entry : channel.stats) {
+        const Stats & stats = entry.second;
+
+        Json::Value summary(Json::objectValue);
+        summary["channel"] = name;
+        summary["start"] = channel.start.print(3);
+        summary["end"] = end.print(3);
+
+        summary["key"] = Json::Value(Json::arrayValue);
+        if (!config.keyFields.empty()) {
+            size_t p = 0;
+            for (size_t i = 0; i < config.keyFields.size(); ++i) {
+                size_t next = (i + 1 == config.keyFields.size())
+                    ? string::npos : entry.first.find(' ', p);
+                summary["key"].append(entry.first.substr(p, next - p));
+                p = next + 1;
+            }
+        }
+
+        summary["count"] = stats.count;
+        if (config.valueField >= 0) {
+            summary["sum"] = stats.sum;
+            summary["p50"] = stats.sketch.quantile(0.5);
+            summary["p90"] = stats.sketch.quantile(0.9);
+            summary["p99"] = stats.sketch.quantile(0.99);
+        }
+
+        if (closed.isNull()) closed = Json::Value(Json::arrayValue);
+        closed.append(summary);
+    }
+
+    channel.stats.clear();
+
+    double window = config.window;
+    channel.start = Date::fromSecondsSinceEpoch(
+            std::floor(now.secondsSinceEpoch() / window) * window);
+}
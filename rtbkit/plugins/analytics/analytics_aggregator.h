@@ -0,0 +1,133 @@
+/** analytics_aggregator.h                                          -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Server-side aggregation of the events of the analytics endpoint.
+
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "soa/jsoncpp/value.h"
+#include "soa/types/date.h"
+
+
+/********************************************************************************/
+/* QUANTILE SKETCH                                                              */
+/********************************************************************************/
+
+/** Approximate quantiles of a stream of values in constant space per order
+    of magnitude.  Values go into logarithmic buckets so that the quantiles
+    that come out are within relativeAccuracy of a value of the stream.
+*/
+struct QuantileSketch {
+
+    QuantileSketch(double relativeAccuracy = 0.01);
+
+    void add(double value, double weight = 1.0);
+
+    /** Value under which the given fraction of the weight falls.  Returns 0
+        when nothing was added.
+    */
+    double quantile(double q) const;
+
+    double count() const { return total; }
+
+private:
+    int bucket(double magnitude) const;
+    double bucketValue(int bucket) const;
+
+    double gamma;
+    double logGamma;
+
+    std::map<int, double> positive;
+    std::map<int, double> negative;   ///< Indexed by the magnitude
+    double zeros;
+    double total;
+};
+
+
+/********************************************************************************/
+/* AGGREGATION CONFIG                                                           */
+/********************************************************************************/
+
+/** How the events of a channel are aggregated.  The fields of an event are
+    the values that were separated by spaces when it was published, so field
+    0 is usually the timestamp.
+*/
+struct AggregationConfig {
+
+    AggregationConfig()
+        : window(10.0), valueField(-1)
+    {
+    }
+
+    double window;                ///< Length of the tumbling windows in seconds
+    std::vector<int> keyFields;   ///< Fields whose values make the key
+    int valueField;               ///< Field summed and sketched, -1 for none
+
+    Json::Value toJson() const;
+};
+
+
+/********************************************************************************/
+/* ANALYTICS AGGREGATOR                                                         */
+/********************************************************************************/
+
+/** Counts, sums and quantiles of the events of the aggregated channels, per
+    channel and key, over tumbling windows of time.  Events are put in the
+    window of the time at which they arrive, and can carry a weight to make
+    up for those that the publisher didn't send when it samples.
+
+    Thread-safe.
+*/
+struct AnalyticsAggregator {
+
+    void configure(const std::string & channel, const AggregationConfig & config);
+
+    /** Stop aggregating the channel.  Its current window is dropped. */
+    void remove(const std::string & channel);
+
+    bool isAggregated(const std::string & channel) const;
+
+    Json::Value getConfig() const;
+
+    /** Adds an event of an aggregated channel.  Returns false if the channel
+        isn't aggregated.
+    */
+    bool add(const std::string & channel, const std::string & event,
+             double weight, Datacratic::Date now);
+
+    /** Summaries of the windows that ended before now, one per channel, key
+        and window, as objects with channel, start, end, key, count and, when
+        there is a value field, sum, p50, p90 and p99.
+    */
+    Json::Value closeWindows(Datacratic::Date now);
+
+private:
+    struct Stats {
+        Stats() : count(0), sum(0) {}
+
+        double count;
+        double sum;
+        QuantileSketch sketch;
+    };
+
+    struct Channel {
+        AggregationConfig config;
+        Datacratic::Date start;
+        std::unordered_map<std::string, Stats> stats;
+    };
+
+    void closeWindow(const std::string & name, Channel & channel,
+                     Datacratic::Date now);
+
+    mutable std::mutex lock;
+    std::unordered_map<std::string, Channel> channels;
+    Json::Value closed;
+};
@@ -14,6 +14,8 @@
 #include "soa/service/rest_request_binding.h"
 #include "soa/jsoncpp/reader.h"
 #include "jml/arch/timers.h"
+#include "jml/utils/string_functions.h"
+#include "jml/arch/exception.h"
 
 using namespace std;
 using namespace Datacratic;
@@ -80,6 +82,32 @@ init()
                     JsonParam<string>("event", "event to publish")
             );
 
+    RestRequestRouter::OnProcessRequest eventsRoute
+        = [=] (const RestServiceEndpoint::ConnectionId & connection,
+                const RestRequest & request,
+                const RestRequestParsingContext & context) {
+            if (!request.params.hasValue("channel")) {
+                connection.sendErrorResponse(400, "channel parameter is missing");
+                return RestRequestRouter::MR_YES;
+            }
+
+            string channel = request.params.getValue("channel");
+            try {
+                double rate = 1.0;
+                if (request.params.hasValue("rate"))
+                    rate = boost::lexical_cast<double>(request.params.getValue("rate"));
+                connection.sendResponse(200, addEvents(channel, request.payload, rate),
+                                        "text/plain");
+            } catch (const std::exception & exc) {
+                connection.sendErrorResponse(400, exc.what());
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    versionNode.addRoute("/events", { "POST", "PUT" },
+                         "Add a batch of events published by an AnalyticsPublisher.",
+                         eventsRoute, Json::Value());
+
     addRouteSyncReturn(versionNode,
                     "/channels",
                     {"GET"},
@@ -142,6 +170,75 @@ init()
                     this
             ); 
 
+    addRouteSyncReturn(versionNode,
+                    "/aggregate",
+                    {"POST", "PUT"},
+                    "Aggregate the events of a channel over windows of time.",
+                    "Returns the aggregation of every channel.",
+                    [] (const Json::Value & lst) {
+                        return lst;
+                    },
+                    &AnalyticsRestEndpoint::aggregateChannel,
+                    this,
+                    RestParamDefault<string>("channel", "event channel to aggregate", ""),
+                    RestParamDefault<double>("window", "length of the windows in seconds", 10.0),
+                    RestParamDefault<string>("keys", "comma separated fields that make the key", ""),
+                    RestParamDefault<int>("value", "field to sum and sketch", -1)
+            );
+
+    addRouteSyncReturn(versionNode,
+                    "/unaggregate",
+                    {"POST", "PUT"},
+                    "Go back to logging every event of a channel.",
+                    "Returns the aggregation of every channel.",
+                    [] (const Json::Value & lst) {
+                        return lst;
+                    },
+                    &AnalyticsRestEndpoint::stopAggregatingChannel,
+                    this,
+                    RestParamDefault<string>("channel", "event channel to stop aggregating", "")
+            );
+
+    addRouteSyncReturn(versionNode,
+                    "/aggregations",
+                    {"GET"},
+                    "Gets how the channels are aggregated",
+                    "Returns the aggregation of every channel.",
+                    [] (const Json::Value & lst) {
+                        return lst;
+                    },
+                    &AnalyticsRestEndpoint::listAggregations,
+                    this
+            );
+
+    addRouteSyncReturn(versionNode,
+                    "/sample",
+                    {"POST", "PUT"},
+                    "Set the fraction of the events of a channel that get sent.",
+                    "Returns the sampling rate of every channel.",
+                    [] (const Json::Value & lst) {
+                        return lst;
+                    },
+                    &AnalyticsRestEndpoint::setSamplingRate,
+                    this,
+                    RestParamDefault<string>("channel", "event channel to sample", ""),
+                    RestParamDefault<double>("rate", "fraction of the events to send", 1.0)
+            );
+
+    addRouteSyncReturn(versionNode,
+                    "/sampling",
+                    {"GET"},
+                    "Gets the sampling rates that the publishers use",
+                    "Returns the sampling rate of every sampled channel.",
+                    [] (const Json::Value & lst) {
+                        return lst;
+                    },
+                    &AnalyticsRestEndpoint::listSamplingRates,
+                    this
+            );
+
+    addPeriodic("AnalyticsRestEndpoint::closeWindows", 1.0,
+                [=] (uint64_t) { closeWindows(); });
 }
 
 string
@@ -162,9 +259,111 @@ addEvent(const string & channel, const string & event) const
     if (it == channelFilter.end() ||  !it->second) 
         return "channel not found or not enabled";
  
+    if (aggregator.add(channel, event, 1.0, Date::now())) {
+        recordHit("channel." + channel);
+        return "success";
+    }
     return print(channel, event);
 }
 
+string
+AnalyticsRestEndpoint::
+addEvents(const string & channel, const string & events, double rate) const
+{
+    if (!(rate > 0 && rate <= 1))
+        throw ML::Exception("sampling rate must be in (0, 1]");
+
+    boost::shared_lock<boost::shared_mutex> lock(access);
+    auto it = channelFilter.find(channel);
+    if (it == channelFilter.end() ||  !it->second) 
+        return "channel not found or not enabled";
+
+    if (aggregator.isAggregated(channel)) {
+        Date now = Date::now();
+        double weight = 1.0 / rate;
+        AnalyticsPublisher::forEachEvent(events, [&] (string event) {
+                recordHit("channel." + channel);
+                aggregator.add(channel, event, weight, now);
+            });
+        return "success";
+    }
+
+    AnalyticsPublisher::forEachEvent(events, [&] (string event) {
+            print(channel, event);
+        });
+    return "success";
+}
+
+Json::Value
+AnalyticsRestEndpoint::
+aggregateChannel(const string & channel, double window,
+                 const string & keys, int value)
+{
+    if (!channel.empty()) {
+        AggregationConfig config;
+        config.window = window;
+        for (const string & field : ML::split(keys, ','))
+            if (!field.empty())
+                config.keyFields.push_back(boost::lexical_cast<int>(field));
+        config.valueField = value;
+        aggregator.configure(channel, config);
+    }
+    return listAggregations();
+}
+
+Json::Value
+AnalyticsRestEndpoint::
+stopAggregatingChannel(const string & channel)
+{
+    aggregator.remove(channel);
+    return listAggregations();
+}
+
+Json::Value
+AnalyticsRestEndpoint::
+listAggregations() const
+{
+    return aggregator.getConfig();
+}
+
+Json::Value
+AnalyticsRestEndpoint::
+setSamplingRate(const string & channel, double rate)
+{
+    if (!(rate > 0 && rate <= 1))
+        throw ML::Exception("sampling rate must be in (0, 1]");
+
+    {
+        boost::lock_guard<boost::shared_mutex> guard(access);
+        if (!channel.empty()) {
+            if (rate == 1.0) samplingRates.erase(channel);
+            else samplingRates[channel] = rate;
+        }
+    }
+    return listSamplingRates();
+}
+
+Json::Value
+AnalyticsRestEndpoint::
+listSamplingRates() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(access);
+    Json::Value response(Json::objectValue);
+    for (const auto & channel : samplingRates)
+        response[channel.first] = channel.second;
+    return response;
+}
+
+void
+AnalyticsRestEndpoint::
+closeWindows(Date now)
+{
+    Json::Value summaries = aggregator.closeWindows(now);
+    for (const auto & summary : summaries)
+        cout << summary["channel"].asString() << " AGGREGATE "
+             << summary.toStringNoNewLine() << endl;
+}
+
 Json::Value
 AnalyticsRestEndpoint::
 listChannels() const
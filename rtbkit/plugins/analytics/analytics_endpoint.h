@@ -12,6 +12,7 @@
 #include <utility>
 
 #include "rtbkit/common/analytics_publisher.h"
+#include "rtbkit/plugins/analytics/analytics_aggregator.h"
 #include "soa/service/rest_service_endpoint.h"
 #include "soa/service/message_loop.h"
 #include "soa/service/http_client.h"
@@ -50,16 +51,49 @@ struct AnalyticsRestEndpoint : public Datacratic::ServiceBase,
     Json::Value enableAllChannels();
     Json::Value disableAllChannels();
 
+    /** Aggregate the events of the channel over tumbling windows of the
+        given number of seconds instead of printing them one by one.  keys
+        is a comma separated list of the fields that make the key and value
+        is the field that gets summed and sketched, or -1 for none.
+    */
+    Json::Value aggregateChannel(const std::string & channel, double window,
+                                 const std::string & keys, int value);
+
+    /** Go back to printing every event of the channel. */
+    Json::Value stopAggregatingChannel(const std::string & channel);
+
+    Json::Value listAggregations() const;
+
+    /** Fraction of the events of the channel that the publishers send.  The
+        events that are received count for 1 / rate when aggregated.
+    */
+    Json::Value setSamplingRate(const std::string & channel, double rate);
+
+    Json::Value listSamplingRates() const;
+
+    /** Prints the aggregates of the windows that ended before now. */
+    void closeWindows(Datacratic::Date now = Datacratic::Date::now());
+
 private:
     std::string addEvent(const std::string & channel,
                          const std::string & event) const;
 
+    /** Adds every event of a batch sent by an AnalyticsPublisher, which
+        were sampled at the given rate.
+    */
+    std::string addEvents(const std::string & channel,
+                          const std::string & events,
+                          double rate = 1.0) const;
+
     std::string print(const std::string & channel,
                       const std::string & event) const;
 
     Datacratic::RestRequestRouter router;
 
     ChannelFilter channelFilter;
+    std::unordered_map<std::string, double> samplingRates;
     mutable boost::shared_mutex access;
+
+    mutable AnalyticsAggregator aggregator;
 };
 
@@ -0,0 +1,86 @@
+/* analytics_aggregator_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the aggregation of analytics events.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/analytics/analytics_aggregator.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_quantile_sketch )
+{
+    QuantileSketch sketch(0.01);
+    BOOST_CHECK_EQUAL(sketch.quantile(0.5), 0);
+
+    for (int i = 1; i <= 1000; ++i)
+        sketch.add(i);
+
+    BOOST_CHECK_EQUAL(sketch.count(), 1000);
+    BOOST_CHECK_CLOSE(sketch.quantile(0.5), 500, 1.5);
+    BOOST_CHECK_CLOSE(sketch.quantile(0.9), 900, 1.5);
+    BOOST_CHECK_CLOSE(sketch.quantile(0.99), 990, 1.5);
+    BOOST_CHECK_CLOSE(sketch.quantile(1.0), 1000, 1.5);
+
+    sketch.add(-5, 2000);
+    BOOST_CHECK_CLOSE(sketch.quantile(0.5), -5, 1.5);
+}
+
+BOOST_AUTO_TEST_CASE( test_tumbling_windows )
+{
+    AnalyticsAggregator aggregator;
+
+    AggregationConfig config;
+    config.window = 10;
+    config.keyFields = { 1 };
+    config.valueField = 3;
+    aggregator.configure("BID", config);
+
+    BOOST_CHECK(aggregator.isAggregated("BID"));
+    BOOST_CHECK(!aggregator.isAggregated("WIN"));
+    BOOST_CHECK(!aggregator.add("WIN", "t agent auction 1", 1, Date()));
+
+    Date start = Date::fromSecondsSinceEpoch(1000);
+
+    // Sampled at 1/2, so each event counts for 2
+    BOOST_CHECK(aggregator.add("BID", "t a1 x 1.5", 2, start.plusSeconds(1)));
+    BOOST_CHECK(aggregator.add("BID", "t a1 x 2.5", 2, start.plusSeconds(2)));
+    BOOST_CHECK(aggregator.add("BID", "t a2 x nan?", 2, start.plusSeconds(3)));
+
+    // Nothing is closed until the window is over
+    BOOST_CHECK_EQUAL(aggregator.closeWindows(start.plusSeconds(9)).size(), 0);
+
+    // Starts the next window, closing the first one
+    BOOST_CHECK(aggregator.add("BID", "t a1 x 10", 1, start.plusSeconds(11)));
+
+    Json::Value summaries = aggregator.closeWindows(start.plusSeconds(12));
+    BOOST_REQUIRE_EQUAL(summaries.size(), 2);
+
+    map<string, Json::Value> byKey;
+    for (const auto & summary : summaries) {
+        BOOST_CHECK_EQUAL(summary["channel"].asString(), "BID");
+        BOOST_CHECK_EQUAL(summary["start"].asString(), start.print(3));
+        BOOST_CHECK_EQUAL(summary["end"].asString(), start.plusSeconds(10).print(3));
+        BOOST_REQUIRE_EQUAL(summary["key"].size(), 1);
+        byKey[summary["key"][0].asString()] = summary;
+    }
+
+    BOOST_CHECK_EQUAL(byKey["a1"]["count"].asDouble(), 4);
+    BOOST_CHECK_EQUAL(byKey["a1"]["sum"].asDouble(), 8);
+    BOOST_CHECK_CLOSE(byKey["a1"]["p99"].asDouble(), 2.5, 1.5);
+    BOOST_CHECK_EQUAL(byKey["a2"]["count"].asDouble(), 2);
+    BOOST_CHECK_EQUAL(byKey["a2"]["sum"].asDouble(), 0);
+
+    summaries = aggregator.closeWindows(start.plusSeconds(20));
+    BOOST_REQUIRE_EQUAL(summaries.size(), 1);
+    BOOST_CHECK_EQUAL(summaries[0]["count"].asDouble(), 1);
+
+    aggregator.remove("BID");
+    BOOST_CHECK(!aggregator.isAggregated("BID"));
+}
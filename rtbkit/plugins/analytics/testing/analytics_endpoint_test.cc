@@ -109,3 +109,23 @@ BOOST_AUTO_TEST_CASE( analytics_filter_sync_test )
     analyticsEndpoint->shutdown();
 
 }
+
+BOOST_AUTO_TEST_CASE( analytics_batch_format_test )
+{
+    vector<string> events = { "2014-10-22 message", "", "multi\nline 12 \n" };
+
+    string body;
+    for (auto & event : events)
+        AnalyticsPublisher::appendEvent(body, event);
+
+    vector<string> parsed;
+    AnalyticsPublisher::forEachEvent(body, [&] (string event) {
+            parsed.push_back(event);
+        });
+    BOOST_CHECK(parsed == events);
+
+    auto noop = [] (string) {};
+    BOOST_CHECK_THROW(AnalyticsPublisher::forEachEvent("3 ab", noop), ML::Exception);
+    BOOST_CHECK_THROW(AnalyticsPublisher::forEachEvent("x", noop), ML::Exception);
+    BOOST_CHECK_THROW(AnalyticsPublisher::forEachEvent("2 ab\n1", noop), ML::Exception);
+}
@@ -1,3 +1,4 @@
 # analytics_testing.mk
 
 $(eval $(call test,analytics_endpoint_test,analytics_endpoint rtb,boost manual))
+$(eval $(call test,analytics_aggregator_test,analytics_endpoint,boost))
@@ -61,7 +61,7 @@ void ZmqAnalytics::logMarkMessage(const Router & router,
                            ML::format("active: %zd augmenting, %zd inFlight, "
                                       "%zd agents",
                                       router.augmentationLoop.numAugmenting(),
-                                      router.inFlight.size(),                                             
+                                      router.numInFlight(),                                             
                                       router.agents.size())
                            );
 }
@@ -149,11 +149,13 @@ void ZmqAnalytics::logUsageMessage(Router & router,
         auto & info = item.second;
         auto & last = router.lastAgentUsageMetrics[item.first];
 
-        Router::AgentUsageMetrics newMetrics(info.stats->intoFilters,
-                                     info.stats->passedStaticFilters,
-                                     info.stats->passedDynamicFilters,
-                                     info.stats->auctions,
-                                     info.stats->bids);
+        const AgentStats & stats = *info.stats;
+        Router::AgentUsageMetrics newMetrics(
+                stats.get(AgentStats::INTO_FILTERS),
+                stats.get(AgentStats::PASSED_STATIC_FILTERS),
+                stats.get(AgentStats::PASSED_DYNAMIC_FILTERS),
+                stats.get(AgentStats::AUCTIONS),
+                stats.get(AgentStats::BIDS));
         Router::AgentUsageMetrics delta = newMetrics - last;
 
         zmq_publisher_.publish("USAGE",
@@ -11,6 +11,7 @@
 #include "jml/arch/timers.h"
 #include "jml/utils/vector_utils.h"
 #include "jml/arch/futex.h"
+#include "jml/arch/rt.h"
 #include <memory>
 
 
@@ -30,15 +31,19 @@ namespace RTBKIT {
 // of requests.
 enum { QueueSize = 65536 };
 
+// Requests a worker takes off its queue at once
+enum { WorkerBatchSize = 32 };
+
 Augmentor::
 Augmentor(const std::string & augmentorName,
           const std::string & serviceName,
           std::shared_ptr<ServiceProxies> proxies)
     : ServiceBase(serviceName, proxies),
       augmentorName(augmentorName),
+      cacheTtl(0),
       toRouters(getZmqContext()),
-      responseQueue(QueueSize),
-      requestQueue(QueueSize),
+      responseQueue([=] { this->sendResponses(); }, QueueSize),
+      nextWorker(0),
       loopMonitor(*this),
       loadStabilizer(loopMonitor)
 {
@@ -50,9 +55,10 @@ Augmentor(const std::string & augmentorName,
           ServiceBase& parent)
     : ServiceBase(serviceName, parent),
       augmentorName(augmentorName),
+      cacheTtl(0),
       toRouters(getZmqContext()),
-      responseQueue(QueueSize),
-      requestQueue(QueueSize),
+      responseQueue([=] { this->sendResponses(); }, QueueSize),
+      nextWorker(0),
       loopMonitor(*this),
       loadStabilizer(loopMonitor)
 {
@@ -68,22 +74,7 @@ void
 Augmentor::
 init(int numThreads)
 {
-    responseQueue.onEvent = [=] (const Response& resp)
-        {
-            const AugmentationRequest& request = resp.first;
-            const AugmentationList& response = resp.second;
-
-            toRouters.sendMessage(
-                    request.router,
-                    "RESPONSE",
-                    "1.0",
-                    request.startTime,
-                    request.id.toString(),
-                    request.augmentor,
-                    chomp(response.toJson().toString()));
-
-            recordHit("messages.RESPONSE");
-        };
+    ExcCheck(numThreads > 0, "augmentor needs at least one worker");
 
     addSource("Augmentor::responseQueue", responseQueue);
 
@@ -91,7 +82,12 @@ init(int numThreads)
 
     toRouters.connectHandler = [=] (const std::string & newRouter)
         {
-            toRouters.sendMessage(newRouter, "CONFIG", "1.0", augmentorName);
+            if (cacheTtl > 0) {
+                // -1 leaves maxInFlight to the router's default.
+                toRouters.sendMessage(newRouter, "CONFIG", "1.0", augmentorName,
+                                      "-1", to_string(cacheTtl));
+            }
+            else toRouters.sendMessage(newRouter, "CONFIG", "1.0", augmentorName);
             recordHit("messages.CONFIG");
         };
 
@@ -113,8 +109,19 @@ init(int numThreads)
 
 
     stopWorkers = false;
-    for (size_t i = 0; i < numThreads; ++i)
-        workers.create_thread([=] { this->runWorker(); });
+    size_t workerQueueSize = std::max<size_t>(QueueSize / numThreads, 1024);
+    for (int i = 0; i < numThreads; ++i) {
+        workerQueues.emplace_back(new Worker(workerQueueSize));
+        Worker * worker = workerQueues.back().get();
+        boost::thread * thread
+            = workers.create_thread([=] { this->runWorker(*worker); });
+
+        if (workerCpus.empty()) continue;
+        int cpu = workerCpus[i % workerCpus.size()];
+        if (!ML::pinThreadToCpu(*thread, cpu))
+            cerr << "augmentor worker " << i << ": can't pin to cpu "
+                 << cpu << endl;
+    }
 
     loopMonitor.init();
     loopMonitor.addMessageLoop("augmentor", this);
@@ -136,16 +143,27 @@ Augmentor::
 shutdown()
 {
     stopWorkers = true;
+    for (auto & worker : workerQueues)
+        wakeWorker(*worker);
     workers.join_all();
     MessageLoop::shutdown();
     toRouters.shutdown();
 }
 
+void
+Augmentor::
+handleInProcess(const AugmentationRequest & request,
+                const InProcessAugmentor::SendResponse & sendResponse)
+{
+    throw ML::Exception("augmentor %s can't be loaded in the router",
+                        augmentorName.c_str());
+}
+
 void
 Augmentor::
 respond(const AugmentationRequest & request, const AugmentationList & response)
 {
-    if (responseQueue.tryPush(make_pair(request, response)))
+    if (responseQueue.push_back(make_pair(request, response)))
         return;
 
     cerr << "Dropping augmentation response: response queue is full" << endl;
@@ -188,14 +206,11 @@ handleRouterMessage(const std::string & router, std::vector<std::string> & messa
 
     else if (type == "AUGMENT") {
 
-        bool shedMessage = loadStabilizer.shedMessage();
-
-        if (!shedMessage) {
-            Message value = make_pair(router, std::move(message));
-            shedMessage = !requestQueue.tryPush(std::move(value));
-        }
+        Message value = make_pair(router, std::move(message));
+        bool shedMessage = loadStabilizer.shedMessage() || !dispatch(value);
 
         if (shedMessage) {
+            message = std::move(value.second);
             toRouters.sendMessage(
                     router,
                     "RESPONSE",
@@ -211,27 +226,142 @@ handleRouterMessage(const std::string & router, std::vector<std::string> & messa
     else cerr << "unknown router message type: " << type << endl;
 }
 
+bool
+Augmentor::
+dispatch(Message & message)
+{
+    for (size_t i = 0; i < workerQueues.size(); ++i) {
+        Worker & worker = *workerQueues[nextWorker++ % workerQueues.size()];
+        if (!worker.requests.tryPush(std::move(message))) continue;
+
+        wakeWorker(worker);
+        return true;
+    }
+
+    return false;
+}
+
 void
 Augmentor::
-runWorker()
+wakeWorker(Worker & worker)
+{
+    // Pairs with the fence in waitForRequests: either the worker sees what
+    // was pushed before it sleeps or we see that it's sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!worker.sleeping) return;
+
+    ++worker.signal;
+    ML::futex_wake(worker.signal);
+}
+
+void
+Augmentor::
+waitForRequests(Worker & worker)
+{
+    int signal = worker.signal;
+    worker.sleeping = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (worker.requests.empty() && !stopWorkers)
+        ML::futex_wait(worker.signal, signal, 1.0);
+
+    worker.sleeping = false;
+}
+
+void
+Augmentor::
+sendResponses()
+{
+    for (const Response & resp : responseQueue.pop_front(0)) {
+        const AugmentationRequest& request = resp.first;
+        const AugmentationList& response = resp.second;
+
+        toRouters.sendMessage(
+                request.router,
+                "RESPONSE",
+                "1.0",
+                request.startTime,
+                request.id.toString(),
+                request.augmentor,
+                chomp(response.toJson().toString()));
+
+        recordHit("messages.RESPONSE");
+    }
+}
+
+void
+Augmentor::
+runWorker(Worker & worker)
 {
     AugmentationRequest request;
-    Message message;
+    vector<Message> batch(WorkerBatchSize);
 
     while(!stopWorkers) {
-        if (!requestQueue.tryPop(message, 1.0)) continue;
-
-        try { parseMessage(request, message); }
-        catch (const std::exception& ex) {
-            cerr << "error while parsing message: "
-                << message << " -> " << ex.what()
-                << endl;
+        size_t n = worker.requests.tryPopBatch(batch.begin(), batch.size());
+        if (!n) {
+            waitForRequests(worker);
             continue;
         }
 
-        handleRequest(request);
+        for (size_t i = 0; i < n; ++i) {
+            Message & message = batch[i];
+
+            try { parseMessage(request, message); }
+            catch (const std::exception& ex) {
+                cerr << "error while parsing message: "
+                    << message << " -> " << ex.what()
+                    << endl;
+                continue;
+            }
+
+            handleRequest(request);
+        }
     }
 }
 
+
+/*****************************************************************************/
+/* AUGMENTOR PLUGIN                                                          */
+/*****************************************************************************/
+
+AugmentorPlugin::
+AugmentorPlugin(std::shared_ptr<Augmentor> augmentor,
+                const std::string & name)
+    : augmentor(std::move(augmentor)), name(name)
+{
+}
+
+void
+AugmentorPlugin::
+augment(const Auction & auction,
+        const std::set<std::string> & agents,
+        double timeAvailableMs,
+        const SendResponse & sendResponse)
+{
+    AugmentationRequest request;
+    request.augmentor = name;
+    request.id = auction.id;
+    request.bidRequest = auction.request;
+    request.agents.assign(agents.begin(), agents.end());
+    request.timeAvailableMs = timeAvailableMs;
+    request.startTime = Date::now();
+
+    augmentor->handleInProcess(request, sendResponse);
+}
+
+void
+AugmentorPlugin::
+registerAugmentor(const std::string & type, AugmentorFactory factory)
+{
+    InProcessAugmentor::registerFactory(
+            type,
+            [=] (ServiceBase & owner,
+                 const std::string & name,
+                 const Json::Value & config) -> InProcessAugmentor *
+            {
+                return new AugmentorPlugin(factory(owner, name, config), name);
+            });
+}
+
 } // namespace RTBKIT
 
@@ -15,6 +15,7 @@
 #include "soa/types/id.h"
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/augmentation.h"
+#include "rtbkit/common/in_process_augmentor.h"
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_utils.h"
 #include "soa/service/socket_per_thread.h"
@@ -76,10 +77,28 @@ struct Augmentor : public ServiceBase, public MessageLoop {
     void start();
     void shutdown();
 
+    /** Lets the routers reuse a response to the same user and agents for
+        the given number of seconds instead of asking again.  Must be called
+        before init().
+    */
+    void setCacheTtl(double seconds) { cacheTtl = seconds; }
+
+    /** Pins the worker threads to the given cpus, worker i going to
+        cpus[i % cpus.size()].  Must be called before init().
+    */
+    void setWorkerCpus(std::vector<int> cpus) { workerCpus = std::move(cpus); }
+
     /** Function to be called to respond to an augmentation request. */
     void respond(const AugmentationRequest & request,
                  const AugmentationList & response);
 
+    /** Handles a request made by the router this augmentor was loaded in,
+        see AugmentorPlugin.  The response goes to sendResponse instead of
+        being sent back over zmq.
+    */
+    virtual void handleInProcess(const AugmentationRequest & request,
+                                 const InProcessAugmentor::SendResponse & sendResponse);
+
     double sampleLoad() { return loopMonitor.sampleLoad().load; }
     double shedProbability() { return loadStabilizer.shedProbability(); }
 
@@ -91,14 +110,35 @@ protected:
 
 private:
     std::string augmentorName; // This can differ from the servicenName!
+    double cacheTtl;
 
     ZmqMultipleNamedClientBusProxy toRouters;
 
+    /** Responses can come from any thread and are sent in batches by the
+        message loop.
+    */
     typedef std::pair<AugmentationRequest, AugmentationList> Response;
-    TypedMessageSink<Response> responseQueue;
+    TypedMpscMessageQueue<Response> responseQueue;
 
+    /** Requests are handed out by the message loop to the workers in turn,
+        each through its own queue, and parsed by the worker.
+    */
     typedef std::pair<std::string, std::vector<std::string> > Message;
-    ML::RingBufferSWMR<Message> requestQueue;
+
+    struct Worker {
+        Worker(size_t queueSize)
+            : requests(queueSize), signal(0), sleeping(false)
+        {
+        }
+
+        ML::RingBufferSPSC<Message> requests;
+        std::atomic<int> signal;      ///< Futex to wake the worker up
+        std::atomic<bool> sleeping;   ///< Whether it's waiting on signal
+    };
+
+    std::vector<std::unique_ptr<Worker> > workerQueues;
+    size_t nextWorker;
+    std::vector<int> workerCpus;
 
     boost::thread_group workers;
     std::atomic<bool> stopWorkers;
@@ -106,7 +146,17 @@ private:
     LoopMonitor loopMonitor;
     LoadStabilizer loadStabilizer;
 
-    void runWorker();
+    void runWorker(Worker & worker);
+    void waitForRequests(Worker & worker);
+    void wakeWorker(Worker & worker);
+
+    /** Queues the request to the next worker with room for it.  Returns
+        false if they are all full.
+    */
+    bool dispatch(Message & message);
+
+    void sendResponses();
+
     void handleRouterMessage(const std::string & router,
                              std::vector<std::string> & message);
 
@@ -154,6 +204,13 @@ struct SyncAugmentor : public Augmentor
         throw ML::Exception("onRequest or doRequest must be overridden");
     }
 
+    virtual void
+    handleInProcess(const AugmentationRequest & request,
+                    const InProcessAugmentor::SendResponse & sendResponse)
+    {
+        sendResponse(doRequest(request));
+    }
+
 private:
 
     void setup()
@@ -211,6 +268,13 @@ struct AsyncAugmentor : public Augmentor
         throw ML::Exception("onRequest or doRequest must be overridden");
     };
 
+    virtual void
+    handleInProcess(const AugmentationRequest & request,
+                    const InProcessAugmentor::SendResponse & sendResponse)
+    {
+        doRequest(request, sendResponse);
+    }
+
 private:
 
     void setup()
@@ -227,6 +291,50 @@ private:
 
 };
 
+
+/******************************************************************************/
+/* AUGMENTOR PLUGIN                                                           */
+/******************************************************************************/
+
+/** Runs a SyncAugmentor or an AsyncAugmentor inside the router.  The
+    augmentor gets the bid request already parsed by the exchange connector
+    and its response is merged without going through zmq.
+
+    The augmentor is created as a child of the router and must not be
+    init()ed or start()ed: it's only used through handleInProcess().  To
+    make an augmentor loadable in the router, register it from the plugin
+    library (lib<type>_augmentor.so) with:
+
+        AugmentorPlugin::registerAugmentor("frequency-cap",
+            [] (ServiceBase & owner, const std::string & name,
+                const Json::Value & config)
+            {
+                return std::make_shared<MyAugmentor>(name, name, owner);
+            });
+ */
+struct AugmentorPlugin : public InProcessAugmentor
+{
+    AugmentorPlugin(std::shared_ptr<Augmentor> augmentor,
+                    const std::string & name);
+
+    virtual void augment(const Auction & auction,
+                         const std::set<std::string> & agents,
+                         double timeAvailableMs,
+                         const SendResponse & sendResponse);
+
+    typedef std::function<std::shared_ptr<Augmentor> (
+            ServiceBase & owner,
+            const std::string & name,
+            const Json::Value & config)> AugmentorFactory;
+
+    static void registerAugmentor(const std::string & type,
+                                  AugmentorFactory factory);
+
+private:
+    std::shared_ptr<Augmentor> augmentor;
+    std::string name;
+};
+
 } // namespace RTBKIT
 
 
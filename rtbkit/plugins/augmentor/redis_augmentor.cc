@@ -16,11 +16,86 @@ using namespace std;
 namespace RTBKIT {
 
 
+/*****************************************************************************/
+/* CACHE                                                                     */
+/*****************************************************************************/
+
+void
+RedisAugmentor::Cache::
+setOptions(size_t capacity, double ttl, double negativeTtl)
+{
+    lock_guard<mutex> guard(lock);
+    this->capacity = capacity;
+    this->ttl = ttl;
+    this->negativeTtl = negativeTtl;
+}
+
+bool
+RedisAugmentor::Cache::
+get(const std::string & key, Date now, std::string & value)
+{
+    lock_guard<mutex> guard(lock);
+    if (!capacity) return false;
+
+    auto it = index.find(key);
+    if (it == index.end()) return false;
+
+    if (it->second->expiry < now) {
+        entries.erase(it->second);
+        index.erase(it);
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    value = it->second->value;
+    return true;
+}
+
+void
+RedisAugmentor::Cache::
+put(const std::string & key, const std::string & value, Date now)
+{
+    lock_guard<mutex> guard(lock);
+    if (!capacity) return;
+
+    Date expiry = now.plusSeconds(value.empty() ? negativeTtl : ttl);
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        it->second->value = value;
+        it->second->expiry = expiry;
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+
+    entries.push_front(Entry{ key, value, expiry });
+    index[key] = entries.begin();
+}
+
+
+/*****************************************************************************/
+/* REDIS AUGMENTOR                                                           */
+/*****************************************************************************/
+
 RedisAugmentor::
 ~RedisAugmentor()
 {
 }
 
+void
+RedisAugmentor::
+setOptions(const Options & options)
+{
+    options_ = options;
+    cache_.setOptions(options.cacheSize, options.cacheTtl,
+                      options.negativeCacheTtl);
+}
+
 /** Sets up the internal components of the augmentor.
 
     Note that AsyncAugmentorBase is a MessageLoop so we can attach all our
@@ -35,6 +110,11 @@ init(int nthreads)
     /* Manages all the communications with the AgentConfigurationService. */
     agent_config_.init(getServices()->config);
     addSource("RedisAugmentor::agentConfig", agent_config_);
+
+    if (options_.batchWindow > 0) {
+        addPeriodic("RedisAugmentor::flushBatch", options_.batchWindow,
+                    [=] (uint64_t) { flushBatch(); });
+    }
 }
 
 
@@ -99,37 +179,142 @@ onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
         return;
     }
 
-    auto doResponse = [=](const Redis::Results& results) {
-        ExcAssertEqual (results.size(), jobs.size());
-        AugmentationList auglret;
-        if (results)
+    Date now = Date::now();
+
+    Values cached;
+    vector<string> misses;
+    for (const auto& ii: jobs)
+    {
+        string value;
+        if (cache_.get(ii.first, now, value))
         {
-            auto i=0;
-            for (const auto& ii: jobs)
-            {
-                const auto& res = results.at(i).reply().asString();
-                if (!res.empty())
-                    for (const auto& jj: ii.second)
-                        auglret[jj].data.atStr(ii.first) = res;
-                ++i;
-            }
+            recordHit("cacheHit");
+            if (!value.empty()) cached[ii.first] = value;
         }
-        else
+        else misses.push_back(ii.first);
+    }
+
+    auto doResponse = [=](const Values& values) {
+        AugmentationList auglret;
+        for (const auto& ii: jobs)
         {
-            cerr << "RedisAugmentor::onRequest::lambda(doResponse) error: " << results.error() << endl ;
-            recordHit("redisError."+results.error());
+            auto it = values.find(ii.first);
+            if (it == values.end()) continue;
+            for (const auto& jj: ii.second)
+                auglret[jj].data.atStr(ii.first) = it->second;
         }
-        recordOutcome(tm.elapsed_wall() * 1000.0, "redisResponseMs");
         sendResponse(auglret);
     };
 
-    // build a vector of commands
-    vector<Redis::Command> cmds;
-    for (auto& ii: jobs)
-        cmds.emplace_back (Redis::GET(ii.first));
+    if (misses.empty())
+    {
+        doResponse(cached);
+        return;
+    }
 
-    // and post it
-    redis_->queueMulti(cmds, doResponse, 0.004);
+    recordCount(misses.size(), "cacheMiss");
 
+    lookup(misses, [=](const Values& values, const string& error) {
+        if (!error.empty())
+        {
+            cerr << "RedisAugmentor::onRequest::lambda(doResponse) error: " << error << endl ;
+            recordHit("redisError."+error);
+        }
+        recordOutcome(tm.elapsed_wall() * 1000.0, "redisResponseMs");
+
+        Values merged(cached);
+        merged.insert(values.begin(), values.end());
+        doResponse(merged);
+    });
+}
+
+void
+RedisAugmentor::
+lookup(const vector<string> & keys, OnValues onValues)
+{
+    Batch toSend;
+
+    {
+        lock_guard<mutex> guard(batchLock_);
+
+        vector<size_t> indexes;
+        for (const auto& key: keys)
+        {
+            auto res = batch_.index.insert(make_pair(key, batch_.keys.size()));
+            if (res.second) batch_.keys.push_back(key);
+            indexes.push_back(res.first->second);
+        }
+        batch_.lookups.emplace_back(std::move(indexes), std::move(onValues));
+
+        if (options_.batchWindow <= 0
+            || batch_.keys.size() >= options_.maxBatchSize)
+            std::swap(toSend, batch_);
+    }
+
+    if (!toSend.keys.empty())
+        sendBatch(std::move(toSend));
+}
+
+void
+RedisAugmentor::
+flushBatch()
+{
+    Batch toSend;
+    {
+        lock_guard<mutex> guard(batchLock_);
+        std::swap(toSend, batch_);
+    }
+
+    if (!toSend.keys.empty())
+        sendBatch(std::move(toSend));
 }
+
+void
+RedisAugmentor::
+sendBatch(Batch && batch)
+{
+    recordLevel(batch.lookups.size(), "batchRequests");
+    recordLevel(batch.keys.size(), "batchKeys");
+
+    Redis::Command mget(Redis::MGET);
+    for (const auto& key: batch.keys)
+        mget.addArg(key);
+
+    auto toAnswer = std::make_shared<Batch>(std::move(batch));
+
+    auto onResult = [=](const Redis::Result& result) {
+        Date now = Date::now();
+
+        vector<string> values;
+        string error;
+        if (result)
+        {
+            const auto& reply = result.reply();
+            ExcAssertEqual((size_t) reply.length(), toAnswer->keys.size());
+
+            values.reserve(toAnswer->keys.size());
+            for (size_t i = 0; i < toAnswer->keys.size(); ++i)
+            {
+                values.push_back(reply[i].asString());
+                cache_.put(toAnswer->keys[i], values.back(), now);
+            }
+        }
+        else error = result.error();
+
+        for (const auto& lookup: toAnswer->lookups)
+        {
+            Values found;
+            if (error.empty())
+            {
+                for (size_t i: lookup.first)
+                    if (!values[i].empty())
+                        found[toAnswer->keys[i]] = values[i];
+            }
+            lookup.second(found, error);
+        }
+    };
+
+    redis_->queue(mget, onResult, options_.timeout);
+}
+
 } /* namespace RTBKIT */
@@ -9,6 +9,10 @@
 #define REDIS_AUGMENTOR_H_
 
 #include <string>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include "augmentor_base.h"
 #include "soa/service/redis.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
@@ -17,9 +21,30 @@ namespace RTBKIT {
 
 /**
  *     Redis Augmentor.
+ *
+ *     The keys looked up for the requests received within batchWindow are
+ *     fetched with a single MGET, and the values are kept in a local LRU
+ *     cache for cacheTtl seconds (negativeCacheTtl for the keys that aren't
+ *     in Redis) so that the users we see several times in a row don't cost
+ *     a round trip each.  Both are off by default.
  */
 class RedisAugmentor: public RTBKIT::AsyncAugmentor {
 public:
+    struct Options {
+        Options()
+            : timeout(0.004), batchWindow(0), maxBatchSize(256),
+              cacheSize(0), cacheTtl(5.0), negativeCacheTtl(1.0)
+        {
+        }
+
+        double timeout;          ///< Redis timeout in seconds
+        double batchWindow;      ///< Seconds to wait for requests to batch
+        size_t maxBatchSize;     ///< Keys after which a batch is sent early
+        size_t cacheSize;        ///< Keys in the local cache, 0 to disable
+        double cacheTtl;         ///< Seconds a value stays in the cache
+        double negativeCacheTtl; ///< Seconds a missing key stays cached
+    };
+
     RedisAugmentor(const std::string& augmentorName,
                    const std::string& serviceName,
                    std::shared_ptr<ServiceProxies> proxies,
@@ -60,12 +85,68 @@ public:
     {
     }
 
+    /** Must be called before init(). */
+    void setOptions(const Options & options);
+
     void init(int nthreads);
     virtual ~RedisAugmentor() ;
 private:
+    typedef std::map<std::string, std::string> Values;
+    typedef std::function<void (const Values & values,
+                                const std::string & error)> OnValues;
+
+    /** Bounded LRU cache of the values read from Redis. */
+    struct Cache {
+        Cache() : capacity(0), ttl(0), negativeTtl(0) {}
+
+        void setOptions(size_t capacity, double ttl, double negativeTtl);
+
+        /** Returns false on a miss.  An empty value means the key isn't in
+            Redis.
+        */
+        bool get(const std::string & key, Date now, std::string & value);
+        void put(const std::string & key, const std::string & value, Date now);
+
+    private:
+        struct Entry {
+            std::string key;
+            std::string value;
+            Date expiry;
+        };
+
+        size_t capacity;
+        double ttl;
+        double negativeTtl;
+
+        std::mutex lock;
+        std::list<Entry> entries;  ///< Most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    /** Lookups waiting for the next MGET. */
+    struct Batch {
+        std::vector<std::string> keys;
+        std::unordered_map<std::string, size_t> index;
+        std::vector<std::pair<std::vector<size_t>, OnValues> > lookups;
+    };
+
     void onRequest(const AugmentationRequest & request, SendResponseCB sendResponse);
+
+    /** Fetch the given keys from Redis, batched with the other lookups if
+        batching is enabled.  Only the keys that were found are in the
+        values given to onValues.
+    */
+    void lookup(const std::vector<std::string> & keys, OnValues onValues);
+    void flushBatch();
+    void sendBatch(Batch && batch);
+
     RTBKIT::AgentConfigurationListener agent_config_;
     std::shared_ptr<Redis::AsyncConnection> redis_ ;
+    Options options_;
+    Cache cache_;
+
+    std::mutex batchLock_;
+    Batch batch_;
 };
 
 } /* namespace RTBKIT */
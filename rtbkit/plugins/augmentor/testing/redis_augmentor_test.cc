@@ -109,8 +109,13 @@ struct MockAugmentationLoop : public ServiceBase, public MessageLoop
 
 
 
-BOOST_AUTO_TEST_CASE( redisAugmentorTest )
+void runRedisAugmentorTest(const RedisAugmentor::Options & options)
 {
+    {
+        lock_guard<mutex> l(aug_mtx);
+        aug_vec.clear();
+    }
+
     enum {
         FeederThreads = 1,
         TestLength = 5,
@@ -193,6 +198,7 @@ BOOST_AUTO_TEST_CASE( redisAugmentorTest )
     cerr << "init aug\n";
 
     RedisAugmentor aug("redis-augmentation", "redis-augmentation", proxies, redis);
+    aug.setOptions(options);
     aug.init(RedisThreads);
     aug.start();
 
@@ -230,3 +236,18 @@ BOOST_AUTO_TEST_CASE( redisAugmentorTest )
 
     proxies->events->dump(cerr);
 }
+
+BOOST_AUTO_TEST_CASE( redisAugmentorTest )
+{
+    runRedisAugmentorTest(RedisAugmentor::Options());
+}
+
+BOOST_AUTO_TEST_CASE( redisAugmentorBatchedCachedTest )
+{
+    // Batching and caching must not change the augmentations.
+    RedisAugmentor::Options options;
+    options.batchWindow = 0.001;
+    options.cacheSize = 1000;
+    options.cacheTtl = 2.0;
+    runRedisAugmentorTest(options);
+}
@@ -12,6 +12,8 @@
 #include "appnexus_bid_request.h"
 #include "soa/jsoncpp/value.h"
 #include "jml/utils/exc_assert.h"
+#include "soa/types/json_parsing.h"
+#include <cstring>
 
 
 using namespace std;
@@ -41,6 +43,358 @@ convertAdPosition(AppNexus::AdPosition pos)
 
     return ret;
 }
+
+int currentYear()
+{
+    static struct current_year_st_ {
+    	current_year_st_ () {
+    		using namespace std;
+    		using namespace std::chrono;
+    		auto tt = system_clock::to_time_t(system_clock::now());
+    		auto utc_tm = *gmtime(&tt);
+    		val_ = utc_tm.tm_year + 1900;
+    	}
+    	int val_;
+    } current_year ;
+    return current_year.val_;
+}
+
+/** AN sends the location as "lat,lon". */
+void setLocation(OpenRTB::Geo & geo, const std::string & loc)
+{
+    auto ix = loc.find(',');
+    if (string::npos!=ix)
+    {
+    	geo.lat.val = boost::lexical_cast<float>(loc.data(), ix);
+    	geo.lon.val = boost::lexical_cast<float>(loc.data() + ix + 1,
+    	                                         loc.size() - ix - 1);
+    }
+}
+
+/** AN sends the sizes as "WxH". */
+void addSize(OpenRTB::Banner & banner, const std::string & size)
+{
+    auto ix = size.find('x');
+    if (string::npos!=ix)
+    {
+        banner.w.push_back(boost::lexical_cast<int>(size.data(), ix));
+        banner.h.push_back(boost::lexical_cast<int>(size.data() + ix + 1,
+                                                    size.size() - ix - 1));
+    }
+}
+
+/** Parse the value with the default description of its type, so that it
+    accepts the same JSON as when it's parsed as part of the AN structures.
+*/
+template<typename T>
+void parseValue(T & val, JsonParsingContext & context)
+{
+    static const auto desc = getDefaultDescriptionShared((T *)0);
+    desc->parseJson(&val, context);
+}
+
+std::string flashVersion(const TaggedBoolDef<true> & noFlash)
+{
+    return noFlash.val == -1 ? "Flash not available"
+        : "Flash available - version unknown";
+}
+
+/** Fields of the AN bid_info object that go into the request, read straight
+    from the JSON.  Those that don't end up in the request are skipped.
+*/
+void parseBidInfo(JsonParsingContext & context, RTBKIT::BidRequest & rv,
+                  std::string & appId, TaggedInt & publisherId)
+{
+    auto & device = *rv.device;
+    auto & geo = *device.geo;
+
+    context.forEachMember([&] () {
+            const char * name = context.fieldNamePtr();
+
+            if (!strcmp(name, "user_id_64")) {
+                TaggedInt64 userId64;
+                parseValue(userId64, context);
+                rv.user->id = Id(userId64.val);
+            }
+            else if (!strcmp(name, "user_agent"))
+                parseValue(device.ua, context);
+            else if (!strcmp(name, "operating_system")) {
+                TaggedIntDef<0> operatingSystem;
+                parseValue(operatingSystem, context);
+                device.os = AppNexus::deviceOs.at(operatingSystem.val);
+            }
+            else if (!strcmp(name, "accepted_languages")) {
+                std::string languages;
+                parseValue(languages, context);
+                device.language = languages;
+            }
+            else if (!strcmp(name, "no_flash")) {
+                TaggedBoolDef<true> noFlash;
+                parseValue(noFlash, context);
+                device.flashver = flashVersion(noFlash);
+            }
+            else if (!strcmp(name, "gender"))
+                parseValue(rv.user->gender, context);
+            else if (!strcmp(name, "age")) {
+                TaggedInt age;
+                parseValue(age, context);
+                rv.user->yob.val = currentYear() - (age.val<=0?0:age.val);
+            }
+            else if (!strcmp(name, "ip_address"))
+                parseValue(device.ip, context);
+            else if (!strcmp(name, "country")) {
+                Datacratic::UnicodeString country;
+                parseValue(country, context);
+                geo.country = country.utf8String();
+            }
+            else if (!strcmp(name, "region")) {
+                Datacratic::UnicodeString region;
+                parseValue(region, context);
+                geo.region = region.utf8String();
+            }
+            else if (!strcmp(name, "city"))
+                parseValue(geo.city, context);
+            else if (!strcmp(name, "postal_code")) {
+                std::string postalCode;
+                parseValue(postalCode, context);
+                geo.zip = postalCode;
+            }
+            else if (!strcmp(name, "dma")) {
+                TaggedInt dma;
+                parseValue(dma, context);
+                geo.dma = to_string(dma.val);
+            }
+            else if (!strcmp(name, "url")) {
+                Datacratic::UnicodeString url;
+                parseValue(url, context);
+                if (!url.empty())
+                    rv.url = Url(url);
+            }
+            else if (!strcmp(name, "publisher_id"))
+                parseValue(publisherId, context);
+            else if (!strcmp(name, "app_id"))
+                parseValue(appId, context);
+            else if (!strcmp(name, "loc")) {
+                std::string loc;
+                parseValue(loc, context);
+                setLocation(geo, loc);
+            }
+            else if (!strcmp(name, "carrier")) {
+                TaggedInt carrier;
+                parseValue(carrier, context);
+                device.carrier = to_string(carrier.val);
+            }
+            else if (!strcmp(name, "make")) {
+                TaggedInt make;
+                parseValue(make, context);
+                device.make = to_string(make.val);
+            }
+            else if (!strcmp(name, "model")) {
+                TaggedInt model;
+                parseValue(model, context);
+                device.model = to_string(model.val);
+            }
+            else context.skip();
+        });
+}
+
+/** Fields of an AN tag object that go into the impression. */
+void parseTag(JsonParsingContext & context, RTBKIT::BidRequest & rv)
+{
+    auto & impression = rv.imp[0];
+
+    context.forEachMember([&] () {
+            const char * name = context.fieldNamePtr();
+
+            if (!strcmp(name, "auction_id_64")) {
+                TaggedInt64 auctionId64;
+                parseValue(auctionId64, context);
+                impression.id = Id(auctionId64.val);
+                rv.auctionId = impression.id;
+            }
+            else if (!strcmp(name, "inventory_source_id"))
+                parseValue(rv.site->id, context);
+            else if (!strcmp(name, "sizes")) {
+                context.forEachElement([&] () {
+                        std::string size;
+                        parseValue(size, context);
+                        addSize(*impression.banner, size);
+                    });
+            }
+            else if (!strcmp(name, "position")) {
+                AppNexus::AdPosition position;
+                parseValue(position, context);
+                impression.banner->pos.val = convertAdPosition(position).val;
+            }
+            else if (!strcmp(name, "reserve_price")) {
+                TaggedFloatDef<0> reservePrice;
+                parseValue(reservePrice, context);
+                impression.bidfloor.val = reservePrice.val;
+            }
+            else context.skip();
+        });
+}
+
+/** Fields of the AN bid_request object, or false if it has a field that we
+    don't know about, in which case the request is ignored.
+*/
+bool parseBidRequestMsg(JsonParsingContext & context, RTBKIT::BidRequest & rv,
+                        Json::Value & unparseable)
+{
+    std::string appId;
+    TaggedInt publisherId;
+    vector<int> members;
+    vector<int> excludedAttributes;
+    int numTags = 0;
+
+    context.forEachMember([&] () {
+            const char * name = context.fieldNamePtr();
+
+            if (!strcmp(name, "timestamp")) {
+                std::string timestamp;
+                parseValue(timestamp, context);
+                rv.timestamp = Datacratic::Date::parse(timestamp.c_str(),
+                                                       "%Y-%m-%d %H:%M:%S");
+            }
+            else if (!strcmp(name, "bidder_timeout_ms")) {
+                TaggedInt bidderTimeoutMs;
+                parseValue(bidderTimeoutMs, context);
+                rv.timeAvailableMs = bidderTimeoutMs.val;
+            }
+            else if (!strcmp(name, "bid_info"))
+                parseBidInfo(context, rv, appId, publisherId);
+            else if (!strcmp(name, "members")) {
+                context.forEachElement([&] () {
+                        Id id;
+                        context.forEachMember([&] () {
+                                if (!strcmp(context.fieldNamePtr(), "id"))
+                                    parseValue(id, context);
+                                else context.skip();
+                            });
+                        members.push_back(id.toInt());
+                    });
+            }
+            else if (!strcmp(name, "tags")) {
+                context.forEachElement([&] () {
+                        if (numTags++ == 0)
+                            parseTag(context, rv);
+                        else context.skip();
+                    });
+            }
+            else if (!strcmp(name, "test")) {
+                TaggedBoolDef<false> test;
+                parseValue(test, context);
+                rv.isTest = test.val ? true : false;
+            }
+            else if (!strcmp(name, "excluded_attributes")) {
+                context.forEachElement([&] () {
+                        TaggedInt attribute;
+                        parseValue(attribute, context);
+                        excludedAttributes.push_back(attribute.val);
+                    });
+            }
+            else if (!strcmp(name, "member_ad_profile_id")
+                     || !strcmp(name, "allow_exclusive")
+                     || !strcmp(name, "debug_requested")
+                     || !strcmp(name, "debug_member_id")
+                     || !strcmp(name, "single_phase"))
+                context.skip();
+            else if (!strcmp(name, "unparseable")) {
+                Json::Value value = context.expectJson();
+                if (!value.isNull())
+                    unparseable[name] = value;
+            }
+            else unparseable[name] = context.expectJson();
+        });
+
+    if (!unparseable.isNull())
+        return false;
+
+    ExcAssertEqual (numTags, 1);
+
+    // BUSINESS RULE - This is a weak test for "is this an app or a site"
+    //  Can't see a better way to do this in AN, so we see if the Bid has an appId
+    if (appId == "")  // It's a 'site' and not an 'app'
+        rv.site->publisher->id = Id(publisherId.val);
+    else  // It's an 'app' and not a 'site'
+        rv.app->publisher->id = Id(publisherId.val);
+    // But always just statelessy assign appId. If it's empty, no harm
+    rv.app->id = Id(appId);
+
+    if (!members.empty())
+       rv.restrictions.addInts("members", members);
+    if (!excludedAttributes.empty())
+    	rv.restrictions.addInts("excluded_attributes", excludedAttributes);
+
+    return true;
+}
+
+/** Parses an AN bid request straight into a BidRequest, in one pass over
+    the JSON and without building the AN structures or any Json::Value.
+    Returns null if the request has a field that we don't know about, like
+    fromAppNexus() after parsing the AN structures does.
+*/
+shared_ptr<RTBKIT::BidRequest>
+parseAppNexus(JsonParsingContext & context,
+              const std::string & provider,
+              const std::string & exchange)
+{
+    shared_ptr<RTBKIT::BidRequest> rv (new RTBKIT::BidRequest);
+
+    // Same defaults as fromAppNexus() for the fields that aren't sent
+    rv->user.reset(new OpenRTB::User);
+    rv->user->id = Id(TaggedInt64().val);
+    rv->user->yob.val = currentYear() - 0;
+    rv->device.reset (new OpenRTB::Device);
+    rv->device->geo.reset(new OpenRTB::Geo);
+    rv->device->os = AppNexus::deviceOs.at(TaggedIntDef<0>().val);
+    rv->device->osv = "N/A";
+    rv->device->flashver = flashVersion(TaggedBoolDef<true>());
+    rv->device->carrier = to_string(TaggedInt().val);
+    rv->device->make = to_string(TaggedInt().val);
+    rv->device->model = to_string(TaggedInt().val);
+    rv->device->geo->dma = to_string(TaggedInt().val);
+
+    rv->imp.emplace_back (RTBKIT::AdSpot());
+    auto& impression = rv->imp[0];
+    impression.banner.reset(new OpenRTB::Banner);
+    impression.bidfloor.val = TaggedFloatDef<0>().val;
+    impression.id = Id(TaggedInt64().val);
+    impression.banner->pos.val
+        = convertAdPosition(AppNexus::AdPosition()).val;
+    rv->auctionId = impression.id;
+
+    rv->site.reset (new OpenRTB::Site);
+    rv->site->publisher.reset(new OpenRTB::Publisher);
+    rv->app.reset (new OpenRTB::App);
+    rv->app->publisher.reset(new OpenRTB::Publisher);
+
+    rv->timeAvailableMs = TaggedInt().val;
+    rv->auctionType = RTBKIT::AuctionType::SECOND_PRICE;
+    rv->isTest = false;
+
+    Json::Value unparseable;
+    bool parsed = true;
+
+    context.forEachMember([&] () {
+            if (!strcmp(context.fieldNamePtr(), "bid_request"))
+                parsed = parseBidRequestMsg(context, *rv, unparseable);
+            else unparseable[context.fieldName()] = context.expectJson();
+        });
+
+    if (!parsed || !unparseable.isNull())
+    {
+        cerr << "\n\n\n/*** WARNING!!! coudln't parse the following element: "
+             << unparseable.toString()
+             << " INPUT IGNORED!!! ***/\n\n\n";
+        return shared_ptr<RTBKIT::BidRequest>();
+    }
+
+    rv->provider = provider;
+    rv->exchange = (exchange.empty() ? provider : exchange);
+    return rv;
+}
+
 }  // anonym
 
 namespace RTBKIT {
@@ -66,17 +420,7 @@ fromAppNexus(const AppNexus::BidRequest & req_b,
     rv->user.reset(new OpenRTB::User);
     rv->user->id = Id(req.bidInfo.userId64.val);
     rv->user->gender = req.bidInfo.gender;
-    static struct current_year_st_ {
-    	current_year_st_ () {
-    		using namespace std;
-    		using namespace std::chrono;
-    		auto tt = system_clock::to_time_t(system_clock::now());
-    		auto utc_tm = *gmtime(&tt);
-    		val_ = utc_tm.tm_year + 1900;
-    	}
-    	int val_;
-    } current_year ;
-    rv->user->yob.val = current_year.val_ - (req.bidInfo.age.val<=0?0:req.bidInfo.age.val);
+    rv->user->yob.val = currentYear() - (req.bidInfo.age.val<=0?0:req.bidInfo.age.val);
     rv->device.reset (new OpenRTB::Device);
     rv->device->geo.reset(new OpenRTB::Geo);
     rv->device->ua = req.bidInfo.userAgent.utf8String();
@@ -84,8 +428,7 @@ fromAppNexus(const AppNexus::BidRequest & req_b,
     rv->device->os = req.bidInfo.getANDeviceOsStringForCode(osCode);
     rv->device->osv = "N/A";
     rv->device->language = req.bidInfo.acceptedLanguages;
-    rv->device->flashver = req.bidInfo.noFlash.val == -1 ? "Flash not available"
-    		: "Flash available - version unknown";
+    rv->device->flashver = flashVersion(req.bidInfo.noFlash);
     rv->device->ip = req.bidInfo.ipAddress;
     rv->device->carrier = to_string(req.bidInfo.carrier.val);
     rv->device->make = to_string(req.bidInfo.make.val);
@@ -98,12 +441,7 @@ fromAppNexus(const AppNexus::BidRequest & req_b,
     rv->device->geo->zip = req.bidInfo.postalCode;
     rv->device->geo->dma = to_string(req.bidInfo.dma.val);
 
-    auto ix = req.bidInfo.loc.find(',');
-    if (string::npos!=ix)
-    {
-    	rv->device->geo->lat.val = boost::lexical_cast<float>(req.bidInfo.loc.substr(0, ix));
-    	rv->device->geo->lon.val = boost::lexical_cast<float>(req.bidInfo.loc.substr(ix + 1));
-    }
+    setLocation(*rv->device->geo, req.bidInfo.loc);
 
     if (!req.bidInfo.url.empty())
     	rv->url = std::move(Url(req.bidInfo.url));
@@ -143,14 +481,7 @@ fromAppNexus(const AppNexus::BidRequest & req_b,
     impression.id = Id(reqTag.auctionId64.val);
 
     for (const string& s : reqTag.sizes)
-    {
-        ix = s.find('x');
-        if (string::npos!=ix)
-        {
-            impression.banner->w.push_back(boost::lexical_cast<int>(s.substr(0, ix)));
-            impression.banner->h.push_back(boost::lexical_cast<int>(s.substr(ix + 1)));
-        }
-    }
+        addSize(*impression.banner, s);
 
     OpenRTB::AdPosition position = convertAdPosition(reqTag.position);
     impression.banner->pos.val = position.val;
@@ -203,21 +534,10 @@ parseBidRequest(const std::string & jsonValue,
                 const std::string & provider,
                 const std::string & exchange)
 {
-    StructuredJsonParsingContext jsonContext(jsonValue);
-    AppNexus::BidRequest req;
-    Datacratic::DefaultDescription<AppNexus::BidRequest> desc;
-    desc.parseJson(&req, jsonContext);
-    if (!(req.unparseable.isNull() && req.bidRequest.unparseable.isNull()))
-    {
-        auto str = req.unparseable.isNull() ?
-                   req.bidRequest.unparseable.toString() :
-                   req.unparseable.toString();
-        cerr << "\n\n\n/*** WARNING!!! coudln't parse the following element: "
-             << str
-             << " INPUT IGNORED!!! ***/\n\n\n";
-        return shared_ptr<BidRequest>();
-    }
-    return fromAppNexus(req, provider, exchange);
+    StreamingJsonParsingContext jsonContext("AppNexus bid request",
+                                            jsonValue.c_str(),
+                                            jsonValue.c_str() + jsonValue.size());
+    return parseAppNexus(jsonContext, provider, exchange);
 }
 
 shared_ptr<BidRequest>
@@ -227,20 +547,7 @@ parseBidRequest(ML::Parse_Context & context,
                 const std::string & exchange)
 {
     StreamingJsonParsingContext jsonContext(context);
-    AppNexus::BidRequest req;
-    Datacratic::DefaultDescription<AppNexus::BidRequest> desc;
-    desc.parseJson(&req, jsonContext);
-    if (!(req.unparseable.isNull() && req.bidRequest.unparseable.isNull()))
-    {
-        auto str = req.unparseable.isNull() ?
-                   req.bidRequest.unparseable.toString() :
-                   req.unparseable.toString();
-        cerr << "\n\n\n/*** WARNING!!! coudln't parse the following element: "
-             << str
-             << " INPUT IGNORED!!! ***/\n\n\n";
-        return shared_ptr<BidRequest>();
-    }
-    return fromAppNexus(req, provider, exchange);
+    return parseAppNexus(jsonContext, provider, exchange);
 }
 
 } // namespace RTBKIT
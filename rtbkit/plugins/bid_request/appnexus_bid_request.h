@@ -24,6 +24,10 @@ fromAppNexus(const AppNexus::BidRequest & req,
 /*****************************************************************************/
 
 /** Parser for the AppNexus bid request format.
+
+    The requests are parsed straight into a BidRequest in a single pass, with
+    the same result as parsing the AppNexus structures and converting them
+    with fromAppNexus().
  */
 
 struct AppNexusBidRequestParser {
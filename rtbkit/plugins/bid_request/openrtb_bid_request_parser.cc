@@ -247,7 +247,7 @@ onBidRequest(OpenRTB::BidRequest & br) {
 
     // Currencies allowed to bid
     if (!br.cur.empty()) {
-        for(auto curr : br.cur)
+        for(const auto & curr : br.cur)
             ctx.br->bidCurrency.push_back(parseCurrencyCode(curr));
     } else {
         // Assume USD
@@ -256,7 +256,8 @@ onBidRequest(OpenRTB::BidRequest & br) {
 
     // Blocked cats if any, put into restriction segment
     std::vector<string> bcats;
-    for(auto b : br.bcat)
+    bcats.reserve(br.bcat.size());
+    for(const auto & b : br.bcat)
         bcats.push_back(b.val);
 
     ctx.br->restrictions.addStrings("bcat", bcats);
@@ -264,7 +265,8 @@ onBidRequest(OpenRTB::BidRequest & br) {
 
     // Blocked advertisers, put into restrictions segment
     std::vector<string> badvs;
-    for(auto b : br.badv)
+    badvs.reserve(br.badv.size());
+    for(const auto & b : br.badv)
         badvs.push_back(b.utf8String());
 
     ctx.br->restrictions.addStrings("badv", badvs);
@@ -207,3 +207,33 @@ BOOST_AUTO_TEST_CASE( test_openrtb_from_appnexus )
     cerr << "\n\nWOOT\n\n" << endl;
 }
 
+
+BOOST_AUTO_TEST_CASE( test_single_pass_parser_matches_conversion )
+{
+    printTestHeader("test_single_pass_parser_matches_conversion");
+
+    BID_REQUEST_CONVERSION_TEST_BOILERPLATE("rtbkit/plugins/bid_request/testing/appnexus_parent_bid_request.json", AppNexus::BidRequest)
+
+    auto converted = fromAppNexus(req, "DummyProvider", "AppNexus");
+    BOOST_REQUIRE (converted);
+
+    string payload = loadFile(filename);
+    auto parsed = AppNexusBidRequestParser::parseBidRequest(payload, "DummyProvider", "AppNexus");
+    BOOST_REQUIRE (parsed);
+    BOOST_CHECK_EQUAL(parsed->toJsonStr(), converted->toJsonStr());
+
+    // Unknown fields in the bid request are rejected like before, but not
+    // those deeper down that were never rejected.
+    Json::Value json = Json::parse(payload);
+    Json::Value unknown = json;
+    unknown["bid_request"]["no_such_field"] = 1;
+    BOOST_CHECK(!AppNexusBidRequestParser::parseBidRequest(unknown.toString(), "DummyProvider"));
+    unknown = json;
+    unknown["no_such_field"] = 1;
+    BOOST_CHECK(!AppNexusBidRequestParser::parseBidRequest(unknown.toString(), "DummyProvider"));
+    unknown = json;
+    unknown["bid_request"]["bid_info"]["no_such_field"] = 1;
+    BOOST_CHECK(AppNexusBidRequestParser::parseBidRequest(unknown.toString(), "DummyProvider"));
+
+    printTestFooter();
+}
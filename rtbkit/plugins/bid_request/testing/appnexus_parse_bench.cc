@@ -0,0 +1,136 @@
+/** appnexus_parse_bench.cc                                         -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Bid request parsing bench for the AppNexus bid request parser.
+
+    Parses the same AppNexus bid request over and over from a number of
+    threads and reports the requests/sec of:
+
+    - convert: the AppNexus structures are parsed and then converted with
+      fromAppNexus();
+    - parser: the single pass AppNexusBidRequestParser::parseBidRequest().
+
+*/
+
+#include "rtbkit/plugins/bid_request/appnexus_bid_request.h"
+#include "soa/types/json_parsing.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        file("rtbkit/plugins/bid_request/testing/appnexus_parent_bid_request.json"),
+        threads(1), iterations(100000)
+    {}
+
+    string file;
+    size_t threads;
+    size_t iterations;
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt("Bench options");
+    opt.add_options()
+        ("file,f", value<string>(&config.file),
+         "AppNexus bid request")
+        ("threads,t", value<size_t>(&config.threads),
+         "number of parsing threads")
+        ("iterations,i", value<size_t>(&config.iterations),
+         "requests parsed by each thread")
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+template<typename Fn>
+void bench(const string & name, const Config & config,
+           const string & request, Fn fn)
+{
+    atomic<size_t> failures(0);
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for (size_t th = 0; th < config.threads; ++th) {
+        threads.emplace_back([&] {
+                    for (size_t i = 0; i < config.iterations; ++i)
+                        if (!fn(request)) failures++;
+                });
+    }
+    for (auto & th : threads) th.join();
+
+    double elapsed = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+    double total = config.threads * config.iterations;
+
+    printf("%-10s %12.0f req/s %8.3f us/req %6zu failures\n",
+            name.c_str(), total / elapsed,
+            elapsed * 1e6 / config.iterations, failures.load());
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+
+    ML::filter_istream stream(config.file);
+    string request((istreambuf_iterator<char>(stream)),
+                   istreambuf_iterator<char>());
+    if (request.empty())
+        throw ML::Exception("no request in " + config.file);
+
+    bench("convert", config, request, [] (const string & request) {
+                StreamingJsonParsingContext context(
+                        "bench", request.c_str(),
+                        request.c_str() + request.size());
+                AppNexus::BidRequest req;
+                static DefaultDescription<AppNexus::BidRequest> desc;
+                desc.parseJson(&req, context);
+                return !!fromAppNexus(req, "bench", "appnexus");
+            });
+
+    bench("parser", config, request, [] (const string & request) {
+                return !!AppNexusBidRequestParser::parseBidRequest(
+                        request, "bench", "appnexus");
+            });
+}
@@ -3,3 +3,4 @@
 $(eval $(call test,openrtb_bid_request_test,openrtb_bid_request,boost))
 $(eval $(call test,appnexus_bid_request_test,appnexus_bid_request,boost))
 $(eval $(call test,fbx_bid_request_test,fbx_bid_request,boost))
+$(eval $(call program,appnexus_parse_bench,appnexus_bid_request boost_program_options))
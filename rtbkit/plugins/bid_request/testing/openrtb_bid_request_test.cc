@@ -444,6 +444,48 @@ BOOST_AUTO_TEST_CASE( benchmark_canonical_parsing )
          << done / elapsed << "/s" << endl;
 }
 
+BOOST_AUTO_TEST_CASE( test_binary_round_trip )
+{
+    cerr << "binary round trip of OpenRTB-derived bid requests" << endl;
+
+    std::shared_ptr<OpenRTBBidRequestParser> p = OpenRTBBidRequestParser::openRTBBidRequestParserFactory("2.1");
+
+    for (auto s: samples) {
+        StreamingJsonParsingContext context;
+        context.init(s);
+        std::unique_ptr<BidRequest> br(p->parseBidRequest(*context.context, "openrtb", "openrtb"));
+
+        // This is the format that the router sends to "binaryV1" agents
+        string binary = br->serializeToString();
+        std::unique_ptr<BidRequest> br2(BidRequest::parse("rtbkit-binary-v1", binary));
+
+        BOOST_CHECK_EQUAL(br->toJsonStr(), br2->toJsonStr());
+        BOOST_CHECK_EQUAL(br2->serializeToString(), binary);
+    }
+
+    int done = 0;
+    Date before = Date::now();
+
+    std::vector<string> reqs;
+    for (auto s: samples) {
+        StreamingJsonParsingContext context;
+        context.init(s);
+        std::unique_ptr<BidRequest> br(p->parseBidRequest(*context.context, "openrtb", "openrtb"));
+        reqs.push_back(br->serializeToString());
+    }
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        for (unsigned i = 0;  i < reqs.size();  ++i, ++done) {
+            std::unique_ptr<BidRequest> br2(BidRequest::parse("rtbkit-binary-v1", reqs[i]));
+        }
+    }
+
+    double elapsed = Date::now().secondsSince(before);
+
+    cerr << "did " << done << " in " << elapsed << "s at "
+         << done / elapsed << "/s" << endl;
+}
+
 BOOST_AUTO_TEST_CASE( id_provider ) {
 
     cerr << "id provider test : making sure we parse it correctly and always set it" << endl;
@@ -7,39 +7,224 @@
 #include "rtbkit/core/router/router.h"
 #include "agents_bidder_interface.h"
 
+#include <algorithm>
+#include <map>
+
 using namespace Datacratic;
 using namespace RTBKIT;
 
 AgentsBidderInterface::AgentsBidderInterface(std::string const &serviceName,
                                              std::shared_ptr<ServiceProxies> proxies,
                                              Json::Value const & config)
-    : BidderInterface(proxies, serviceName) {
+    : BidderInterface(proxies, serviceName),
+      maxBatchEvents(64),
+      maxBatchDelay(0.001),
+      sharedMemoryDirectory("/dev/shm"),
+      sharedMemoryRingSize(16 * 1024 * 1024) {
+
+    auto batching = config["resultBatching"];
+    if (!batching.isNull()) {
+        if (batching.isMember("maxEvents"))
+            maxBatchEvents = batching["maxEvents"].asInt();
+        if (batching.isMember("maxDelayMs"))
+            maxBatchDelay = batching["maxDelayMs"].asDouble() / 1000.0;
+
+        ExcCheck(maxBatchEvents > 0, "resultBatching.maxEvents must be positive");
+        ExcCheck(maxBatchDelay > 0, "resultBatching.maxDelayMs must be positive");
+    }
+
+    auto shm = config["sharedMemory"];
+    if (!shm.isNull()) {
+        for (auto & agent : shm["agents"])
+            sharedMemoryAgents.push_back(agent.asString());
+        if (shm.isMember("directory"))
+            sharedMemoryDirectory = shm["directory"].asString();
+        if (shm.isMember("ringSize"))
+            sharedMemoryRingSize = shm["ringSize"].asInt();
+
+        ExcCheck(!sharedMemoryAgents.empty(), "sharedMemory.agents is empty");
+    }
+
+    loop.addPeriodic("AgentsBidderInterface::flushResults", maxBatchDelay,
+                     [=](uint64_t) { flushResults(); });
 }
 
 AgentsBidderInterface::~AgentsBidderInterface() {
     this->shutdown();
 }
 
+void AgentsBidderInterface::start() {
+    loop.start();
+}
+
+void AgentsBidderInterface::shutdown() {
+    loop.shutdown();
+
+    std::lock_guard<std::mutex> guard(sharedMemoryLock);
+    sharedMemory.clear();
+}
+
+bool AgentsBidderInterface::acceptSharedMemory(std::string const & agent,
+                                               std::string const & path) {
+    auto matches = [&] (std::string const & pattern) {
+        if (!pattern.empty() && pattern.back() == '*')
+            return agent.compare(0, pattern.size() - 1,
+                                 pattern, 0, pattern.size() - 1) == 0;
+        return agent == pattern;
+    };
+
+    if (std::none_of(sharedMemoryAgents.begin(), sharedMemoryAgents.end(),
+                     matches))
+        return false;
+
+    auto shm = std::make_shared<SharedMemoryAgent>();
+    if (!shm->toAgent.open(path)) {
+        // Not on this host
+        recordHit("sharedMemory.remote");
+        return false;
+    }
+
+    std::string routerName = router ? router->serviceName() : serviceName();
+    std::replace(routerName.begin(), routerName.end(), '/', '_');
+    std::string fromPath = sharedMemoryDirectory + "/rtbkit-" + routerName
+        + "-" + agent;
+
+    shm->fromAgent = std::make_shared<ShmMessageSource>(
+            fromPath, sharedMemoryRingSize,
+            [=] (std::vector<std::string> && message) {
+                router->injectAgentMessage(std::move(message));
+            });
+
+    std::shared_ptr<SharedMemoryAgent> old;
+    {
+        std::lock_guard<std::mutex> guard(sharedMemoryLock);
+        old = std::move(sharedMemory[agent]);
+        sharedMemory[agent] = shm;
+    }
+    if (old) loop.removeSource(old->fromAgent.get());
+
+    loop.addSource("AgentsBidderInterface::shm::" + agent, shm->fromAgent);
+
+    // The agent opens its end as soon as it knows where it is
+    bridge->sendAgentMessage(agent, "SHM", Date::now(), fromPath);
+
+    recordHit("sharedMemory.accepted");
+    return true;
+}
+
+std::shared_ptr<AgentsBidderInterface::SharedMemoryAgent>
+AgentsBidderInterface::sharedMemoryFor(std::string const & agent) {
+    if (sharedMemoryAgents.empty()) return nullptr;
+
+    std::lock_guard<std::mutex> guard(sharedMemoryLock);
+    auto it = sharedMemory.find(agent);
+    return it == sharedMemory.end() ? nullptr : it->second;
+}
+
+void AgentsBidderInterface::sharedMemoryFailed(
+        std::string const & agent,
+        std::shared_ptr<SharedMemoryAgent> const & shm) {
+    if (shm->toAgent.isConnected()) {
+        recordHit("sharedMemory.full");
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(sharedMemoryLock);
+        auto it = sharedMemory.find(agent);
+        if (it == sharedMemory.end() || it->second != shm) return;
+        sharedMemory.erase(it);
+    }
+
+    loop.removeSource(shm->fromAgent.get());
+    recordHit("sharedMemory.closed");
+}
+
+void AgentsBidderInterface::flushResults() {
+    Date now = Date::now();
+
+    std::lock_guard<std::mutex> guard(batchLock);
+    for (auto & item : batches) {
+        ResultBatch & batch = item.second;
+        if (!batch.events) continue;
+        if (batch.started.plusSeconds(maxBatchDelay) <= now)
+            sendResults(item.first, batch);
+    }
+}
+
+void AgentsBidderInterface::sendResults(std::string const & agent,
+                                        ResultBatch & batch) {
+    sendToAgent(agent,
+                "RESULTS",
+                Date::now(),
+                std::to_string(batch.events),
+                batch.frames);
+
+    batch.events = 0;
+    batch.frames.clear();
+}
+
 void AgentsBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                                double timeLeftMs,
                                                std::map<std::string, BidInfo> const & bidders) {
 
+    // Popular auctions go out to dozens of agents.  Everything that doesn't
+    // depend on the agent is encoded once into shared frames; sending one of
+    // them again only bumps its reference count.
+    zmq::message_t date = encodeMessage(auction->start);
+    zmq::message_t id = encodeMessage(auction->id);
+    zmq::message_t timeLeft = encodeMessage(std::to_string(timeLeftMs));
+
+    // The bid request depends on the agent's configured format, of which
+    // there are only a handful, and on its projection, which the agents
+    // with the same one share.
+    struct Request {
+        Request() : encoded(false) {}
+        bool encoded;
+        zmq::message_t encoding;
+        zmq::message_t request;
+    };
+    Request requests[AgentInfo::BRF_BINARY_V1 + 1];
+    std::map<std::pair<int, std::string>, Request> projected;
+    Json::Value parsed[AgentInfo::BRF_BINARY_V1 + 1];
+
     for(auto & item : bidders) {
         auto & agent = item.first;
         auto & spots = item.second.imp;
         auto & info = router->agents[agent];
         WinCostModel wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.config);
 
-        bridge->sendAgentMessage(agent,
-                                 "AUCTION",
-                                 auction->start,
-                                 auction->id,
-                                 info.getBidRequestEncoding(*auction),
-                                 info.encodeBidRequest(*auction),
-                                 spots.toJsonStr(),
-                                 std::to_string(timeLeftMs),
-                                 auction->agentAugmentations[agent],
-                                 wcm.toJson());
+        const BidRequestProjection & projection
+            = info.config->bidRequestProjection;
+        int format = info.bidRequestFormat;
+
+        Request & request = projection.fieldsKey().empty()
+            ? requests[format]
+            : projected[std::make_pair(format, projection.fieldsKey())];
+        if (!request.encoded) {
+            request.encoding = encodeMessage(info.getBidRequestEncoding(*auction));
+            if (projection.fieldsKey().empty())
+                request.request = sharedMessage(info.encodeBidRequest(*auction));
+            else {
+                Json::Value & json = parsed[format];
+                if (json.isNull())
+                    json = Json::parse(info.encodeBidRequest(*auction));
+                request.request = sharedMessage(
+                        projection.apply(json).toStringNoNewLine());
+            }
+            request.encoded = true;
+        }
+
+        sendToAgent(agent,
+                    "AUCTION",
+                    date,
+                    id,
+                    request.encoding,
+                    request.request,
+                    spots.toJsonStr(),
+                    timeLeft,
+                    auction->agentAugmentations[agent],
+                    wcm.toJson());
     }
 }
 
@@ -49,68 +234,96 @@ void AgentsBidderInterface::sendWinLossMessage(
     std::string channel =
         event.type == MatchedWinLoss::LateWin ? "LATEWIN" : event.typeString();
 
-    bridge->sendAgentMessage(event.response.agent,
-                              channel,
-                              event.timestamp,
-                              event.confidenceString(),
+    // Same frames as the unbatched message, with the channel in front.
+    if (agentConfig && agentConfig->batchResults) {
+        std::lock_guard<std::mutex> guard(batchLock);
+
+        ResultBatch & batch = batches[event.response.agent];
+        if (!batch.events) batch.started = Date::now();
+
+        batch.frames.insert(batch.frames.end(), {
+                    channel,
+                    ML::format("%.5f", event.timestamp.secondsSinceEpoch()),
+                    event.confidenceString(),
+
+                    event.auctionId.toString(),
+                    std::to_string(event.impIndex),
+                    event.winPrice.toString(),
+
+                    event.requestStrFormat,
+                    event.requestStr.rawString(),
+                    event.response.bidData.toJsonStr(),
+                    event.response.meta.rawString(),
+                    chomp(event.augmentations.toString())
+                });
+
+        if (++batch.events >= maxBatchEvents)
+            sendResults(event.response.agent, batch);
+        return;
+    }
+
+    sendToAgent(event.response.agent,
+                channel,
+                event.timestamp,
+                event.confidenceString(),
 
-                              event.auctionId.toString(),
-                              std::to_string(event.impIndex),
-                              event.winPrice.toString(),
+                event.auctionId.toString(),
+                std::to_string(event.impIndex),
+                event.winPrice.toString(),
 
-                              event.requestStrFormat,
-                              event.requestStr,
-                              event.response.bidData.toJsonStr(),
-                              event.response.meta,
-                              event.augmentations.toJson());
+                event.requestStrFormat,
+                event.requestStr,
+                event.response.bidData.toJsonStr(),
+                event.response.meta,
+                event.augmentations.toJson());
 
 }
 
 void AgentsBidderInterface::sendLossMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::string const & id) {
-    bridge->sendAgentMessage(agent,
-                             "LOSS",
-                             Date::now(),
-                             "guaranteed",
-                             id,
-                             0,
-                             Amount().toString());
+    sendToAgent(agent,
+                "LOSS",
+                Date::now(),
+                "guaranteed",
+                id,
+                0,
+                Amount().toString());
 }
 
 void AgentsBidderInterface::sendCampaignEventMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, MatchedCampaignEvent const & event) {
-    bridge->sendAgentMessage(agent,
-                             "CAMPAIGN_EVENT",
-                             event.label,
-                             Date::now(),
+    sendToAgent(agent,
+                "CAMPAIGN_EVENT",
+                event.label,
+                Date::now(),
 
-                             event.auctionId.toString(),
-                             event.impId.toString(),
-                             std::to_string(event.impIndex),
+                event.auctionId.toString(),
+                event.impId.toString(),
+                std::to_string(event.impIndex),
 
-                             event.requestStrFormat,
-                             event.requestStr,
-                             event.augmentations.toJson(),
+                event.requestStrFormat,
+                event.requestStr,
+                event.augmentations.toJson(),
 
-                             event.bid,
-                             event.win,
-                             event.campaignEvents,
-                             event.visits);
+                event.bid,
+                event.win,
+                event.campaignEvents,
+                event.visits);
 
 }
 
 void AgentsBidderInterface::sendBidLostMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "LOST",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendToAgent(agent,
+                "LOST",
+                Date::now(),
+                "guaranteed",
+                auction->id,
+                0,
+                Amount().toString());
 /*
 -                    this->sendBidResponse(it->first,
 -                                          info,
@@ -125,13 +338,13 @@ void AgentsBidderInterface::sendBidLostMessage(
 void AgentsBidderInterface::sendBidDroppedMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "DROPPEDBID",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendToAgent(agent,
+                "DROPPEDBID",
+                Date::now(),
+                "guaranteed",
+                auction->id,
+                0,
+                Amount().toString());
 /*
 -                        this->sendBidResponse(agent,
 -                                              info,
@@ -149,13 +362,13 @@ void AgentsBidderInterface::sendBidInvalidMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::string const & reason,
         std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "INVALID",
-                             Date::now(),
-                             reason,
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendToAgent(agent,
+                "INVALID",
+                Date::now(),
+                reason,
+                auction->id,
+                0,
+                Amount().toString());
 /*
 -            this->sendBidResponse
 -                (agent, info, BS_INVALID, this->getCurrentTime(),
@@ -171,13 +384,13 @@ void AgentsBidderInterface::sendBidInvalidMessage(
 void AgentsBidderInterface::sendNoBudgetMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "NOBUDGET",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendToAgent(agent,
+                "NOBUDGET",
+                Date::now(),
+                "guaranteed",
+                auction->id,
+                0,
+                Amount().toString());
 /*
 -            this->sendBidResponse(agent, info, BS_NOBUDGET,
 -                    this->getCurrentTime(),
@@ -191,13 +404,13 @@ void AgentsBidderInterface::sendNoBudgetMessage(
 void AgentsBidderInterface::sendTooLateMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::shared_ptr<Auction> const & auction) {
-    bridge->sendAgentMessage(agent,
-                             "TOOLATE",
-                             Date::now(),
-                             "guaranteed",
-                             auction->id,
-                             0,
-                             Amount().toString());
+    sendToAgent(agent,
+                "TOOLATE",
+                Date::now(),
+                "guaranteed",
+                auction->id,
+                0,
+                Amount().toString());
 
 /*
 -            case Auction::WinLoss::LOSS:    status = BS_LOSS;     break;
@@ -232,36 +445,36 @@ void AgentsBidderInterface::sendTooLateMessage(
 void AgentsBidderInterface::sendMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::string const & message) {
-    bridge->sendAgentMessage(agent,
-                             message,
-                             Date::now());
+    sendToAgent(agent,
+                message,
+                Date::now());
 }
 
 void AgentsBidderInterface::sendErrorMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, std::string const & error,
         std::vector<std::string> const & payload) {
-    bridge->sendAgentMessage(agent,
-                             "ERROR",
-                             Date::now(),
-                             error,
-                             payload);
+    sendToAgent(agent,
+                "ERROR",
+                Date::now(),
+                error,
+                payload);
 }
 
 void AgentsBidderInterface::sendPingMessage(
         const std::shared_ptr<const AgentConfig>& agentConfig,
         std::string const & agent, int ping) {
     if(ping == 0) {
-        bridge->sendAgentMessage(agent,
-                                 "PING0",
-                                 Date::now(),
-                                 "null");
+        sendToAgent(agent,
+                    "PING0",
+                    Date::now(),
+                    "null");
     }
     else {
-        bridge->sendAgentMessage(agent,
-                                 "PING1",
-                                 Date::now(),
-                                 "null");
+        sendToAgent(agent,
+                    "PING1",
+                    Date::now(),
+                    "null");
     }
 }
 
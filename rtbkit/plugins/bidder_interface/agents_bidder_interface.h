@@ -7,7 +7,12 @@
 
 #include "rtbkit/common/bidder_interface.h"
 #include "soa/jsoncpp/json.h"
+#include "soa/service/message_loop.h"
+#include "soa/service/shm_message_ring.h"
+#include "jml/arch/spinlock.h"
+#include <unordered_map>
 #include <iostream>
+#include <mutex>
 
 namespace RTBKIT {
 
@@ -19,6 +24,9 @@ struct AgentsBidderInterface : public BidderInterface
 
     ~AgentsBidderInterface();
 
+    void start();
+    void shutdown();
+
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
                             std::map<std::string, BidInfo> const & bidders);
@@ -68,6 +76,96 @@ struct AgentsBidderInterface : public BidderInterface
                          std::string const & agent,
                          int ping);
 
+    /** Results for agents with batchResults set are held for up to
+        maxDelayMs or maxEvents, whichever comes first, and then go out as a
+        single RESULTS message.  Configured with
+
+            "resultBatching": { "maxEvents": 64, "maxDelayMs": 1 }
+    */
+    size_t maxBatchEvents;
+    double maxBatchDelay;
+
+    /** Agents on the same host as the router can exchange their messages
+        with it through a pair of shared memory rings instead of zmq.  The
+        agent offers a ring (see BiddingAgent::useSharedMemory) and it's
+        used if the agent matches one of the patterns (exact names, or
+        prefixes ending in '*').  Messages that don't fit in the ring, and
+        all the messages of the other agents, go through zmq.  Configured
+        with
+
+            "sharedMemory": { "agents": [ "*" ],
+                              "directory": "/dev/shm",
+                              "ringSize": 16777216 }
+    */
+    bool acceptSharedMemory(std::string const & agent,
+                            std::string const & path);
+
+    std::vector<std::string> sharedMemoryAgents;
+    std::string sharedMemoryDirectory;
+    size_t sharedMemoryRingSize;
+
+private:
+    /// Rings to and from an agent that accepted shared memory
+    struct SharedMemoryAgent {
+        ML::Spinlock lock;                  // one producer at a time
+        ShmMessageRing toAgent;
+        std::shared_ptr<ShmMessageSource> fromAgent;
+    };
+
+    std::shared_ptr<SharedMemoryAgent> sharedMemoryFor(std::string const & agent);
+
+    /** Push the message into the agent's ring, if it has one.  Returns
+        false when it has to go through zmq instead.
+    */
+    template<typename... Args>
+    bool sendSharedMemory(std::string const & agent, Args const &... args)
+    {
+        auto shm = sharedMemoryFor(agent);
+        if (!shm) return false;
+
+        bool pushed;
+        {
+            std::lock_guard<ML::Spinlock> guard(shm->lock);
+            pushed = shm->toAgent.tryPushMessage(args...);
+        }
+
+        if (!pushed) sharedMemoryFailed(agent, shm);
+        return pushed;
+    }
+
+    /** Forget the agent's rings if it closed them. */
+    void sharedMemoryFailed(std::string const & agent,
+                            std::shared_ptr<SharedMemoryAgent> const & shm);
+
+    /** Send a message to the agent through shared memory if possible and
+        through zmq otherwise.
+    */
+    template<typename... Args>
+    void sendToAgent(std::string const & agent, Args const &... args)
+    {
+        if (!sendSharedMemory(agent, args...))
+            bridge->agents.sendMessage(agent, args...);
+    }
+
+    std::mutex sharedMemoryLock;
+    std::unordered_map<std::string, std::shared_ptr<SharedMemoryAgent> >
+        sharedMemory;
+
+    struct ResultBatch {
+        ResultBatch() : events(0) {}
+
+        Date started;
+        size_t events;
+        std::vector<std::string> frames;
+    };
+
+    void flushResults();
+    void sendResults(const std::string & agent, ResultBatch & batch);
+
+    MessageLoop loop;
+
+    std::mutex batchLock;
+    std::unordered_map<std::string, ResultBatch> batches;
 };
 
 }
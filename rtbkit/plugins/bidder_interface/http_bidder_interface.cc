@@ -49,9 +49,11 @@ Logging::Category HttpBidderInterface::trace("HttpBidderInterface Trace", HttpBi
 HttpBidderInterface::HttpBidderInterface(std::string serviceName,
                                          std::shared_ptr<ServiceProxies> proxies,
                                          Json::Value const & json)
-        : BidderInterface(proxies, serviceName) {
+        : BidderInterface(proxies, serviceName),
+          hedgeMinDelayMs(1.0), hedgeDelayMs(-1.0) {
 
     int routerHttpActiveConnections = 0;
+    int routerHttpMaxConnections = 0;
     int adserverHttpActiveConnections = 0;
 
     try {
@@ -61,6 +63,10 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
         routerHost = router["host"].asString();
         routerPath = router["path"].asString();
         routerHttpActiveConnections = router.get("httpActiveConnections", 1024).asInt();
+        routerHttpMaxConnections = router.get("httpMaxConnections",
+                                              4 * routerHttpActiveConnections).asInt();
+        hedgeHost = router.get("hedgeHost", "").asString();
+        hedgeMinDelayMs = router.get("hedgeMinDelayMs", 1.0).asDouble();
 
         adserverHost = adserver["host"].asString();
 
@@ -83,6 +89,12 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
                    << "\t\t\"format\" : <string : message format>" << std::endl
                    << "\t\t\"httpActiveConnections\" : <int : concurrent connections>"
                    << std::endl
+                   << "\t\t\"httpMaxConnections\" : <int : connections opened under load>"
+                   << std::endl
+                   << "\t\t\"hedgeHost\" : <string : host to resend slow requests to>"
+                   << std::endl
+                   << "\t\t\"hedgeMinDelayMs\" : <double : minimum wait before resending>"
+                   << std::endl
                    << "\t\t"
                    << "\t}" << std::endl << "\t{" << std::endl 
                    << "\t{" << std::endl << "\t\"adserver\" : {" << std::endl
@@ -108,8 +120,18 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
      * header
      */
     httpClientRouter->sendExpect100Continue(false);
+    httpClientRouter->setMaxParallel(routerHttpMaxConnections);
     loop.addSource("HttpBidderInterface::httpClientRouter", httpClientRouter);
 
+    if (!hedgeHost.empty()) {
+        httpClientHedge.reset(new HttpClient(hedgeHost, routerHttpActiveConnections, 0, 2));
+        httpClientHedge->sendExpect100Continue(false);
+        httpClientHedge->setMaxParallel(routerHttpMaxConnections);
+        loop.addSource("HttpBidderInterface::httpClientHedge", httpClientHedge);
+        loop.addPeriodic("HttpBidderInterface::sendHedges", 0.001,
+                         [=](uint64_t) { sendHedges(); });
+    }
+
     std::string winHost = adserverHost + ':' + std::to_string(adserverWinPort);
     httpClientAdserverWins.reset(new HttpClient(winHost, adserverHttpActiveConnections));
     httpClientAdserverWins->sendExpect100Continue(false);
@@ -127,6 +149,8 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
 
     loop.addPeriodic("HttpBidderInterface::reportQueues", 1.0, [=](uint64_t) {
         recordLevel(httpClientRouter->queuedRequests(), "queuedRequests");
+        if (httpClientHedge)
+            updateHedgeDelay();
     });
 
 }
@@ -167,13 +191,9 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
     /* We need to capture by copy inside the lambda otherwise we might get
        a dangling reference if we go out of scope before receiving the http response
     */
-    auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(
-            [=](const HttpRequest &, HttpClientError errorCode,
-                int statusCode, const std::string &, std::string &&body)
+    auto handleResponse =
+            [=](HttpClientError errorCode, int statusCode, std::string &&body)
             {
-                Date responseReceivedTime = Date::now();
-                const double responseTime = responseReceivedTime.secondsSince(sentResponseTime);
-                recordOutcome(1000.0 * responseTime, "httpResponseTimeMs");
                // cerr << "Response: " << "HTTP " << statusCode << std::endl << body << endl;
 
                  /* We need to make sure that we re-inject bids into the router for each
@@ -207,7 +227,11 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                  // Make sure to submit the bids no matter what
                  ML::Call_Guard submitGuard([&] { submitBids(bidsToSubmit); });
 
-                 if (errorCode != HttpClientError::None) {
+                 if (errorCode == HttpClientError::Timeout) {
+                     recordError("timeout");
+                     return;
+                 }
+                 else if (errorCode != HttpClientError::None) {
                      LOG(error) << "Error requesting " << routerHost << " ("
                          << httpErrorString(errorCode) << ")" << std::endl;
                      recordError("network");
@@ -287,17 +311,136 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                      return;
                  }
 
-            }
-    );
+            };
 
-    HttpRequest::Content reqContent { requestStr, "application/json" };
+    auto exchange = std::make_shared<RouterExchange>();
+
+    auto onResponse = [=](bool hedge, Date sent, HttpClientError errorCode,
+                          int statusCode, std::string &&body)
+            {
+                const double responseTimeMs = 1000.0 * Date::now().secondsSince(sent);
+                if (hedge) {
+                    recordOutcome(responseTimeMs, "hedge.httpResponseTimeMs");
+                }
+                else {
+                    recordOutcome(responseTimeMs, "httpResponseTimeMs");
+                    routerLatency_.record(responseTimeMs * 1000.0);
+                }
+
+                int pending = --exchange->pending;
+
+                // A failed request leaves the auction to the other one
+                if (errorCode != HttpClientError::None && pending > 0)
+                    return;
+
+                if (exchange->done.exchange(true)) {
+                    recordHit(hedge ? "hedge.lost" : "hedge.won");
+                    return;
+                }
+
+                handleResponse(errorCode, statusCode, std::move(body));
+            };
+
+    auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(
+            [=](const HttpRequest &, HttpClientError errorCode,
+                int statusCode, const std::string &, std::string &&body)
+            {
+                onResponse(false, sentResponseTime, errorCode, statusCode,
+                           std::move(body));
+            });
 
-    RestParams headers { { "x-openrtb-version", openRtbVersion } };
    // std::cerr << "Sending HTTP POST to: " << routerHost << " " << routerPath << std::endl;
-   // std::cerr << "Content " << reqContent.str << std::endl;
+   // std::cerr << "Content " << requestStr << std::endl;
+
+    /* A response received after the auction expired would be dropped, so
+       the request gives up at that point, even when it is still waiting
+       for a connection, and the agents are told they did not bid. */
+    Date deadline = sentResponseTime.plusSeconds(timeLeftMs / 1000.0);
+
+    double hedgeDelay = hedgeDelayMs.load(std::memory_order_relaxed);
+    Date hedgeAt = sentResponseTime.plusSeconds(hedgeDelay / 1000.0);
+    if (httpClientHedge && hedgeDelay >= 0 && hedgeAt < deadline) {
+        PendingHedge hedge;
+        hedge.sendAt = hedgeAt;
+        hedge.deadline = deadline;
+        hedge.exchange = exchange;
+        hedge.head = routerRequestHead(openRtbVersion, true /* hedge */);
+        hedge.body = requestStr;
+        hedge.callbacks = std::make_shared<HttpClientSimpleCallbacks>(
+                [=](const HttpRequest &, HttpClientError errorCode,
+                    int statusCode, const std::string &, std::string &&body)
+                {
+                    onResponse(true, hedgeAt, errorCode, statusCode,
+                               std::move(body));
+                });
+
+        std::lock_guard<std::mutex> guard(pendingHedgesLock);
+        pendingHedges.push_back(std::move(hedge));
+    }
+
+    httpClientRouter->enqueueRequest(routerRequestHead(openRtbVersion),
+                                     callbacks, std::move(requestStr),
+                                     deadline);
+}
+
+std::shared_ptr<const HttpRequestHead>
+HttpBidderInterface::routerRequestHead(const std::string & openRtbVersion,
+                                       bool hedge)
+{
+    std::lock_guard<std::mutex> guard(routerHeadsLock);
+
+    auto & head = (hedge ? hedgeHeads : routerHeads)[openRtbVersion];
+    if (!head) {
+        RestParams headers { { "x-openrtb-version", openRtbVersion } };
+        auto & client = hedge ? httpClientHedge : httpClientRouter;
+        head = client->prepareRequest("POST", routerPath,
+                                      { } /* queryParams */,
+                                      headers, "application/json");
+    }
+
+    return head;
+}
+
+void HttpBidderInterface::sendHedges()
+{
+    Date now = Date::now();
+
+    std::vector<PendingHedge> due;
+    {
+        std::lock_guard<std::mutex> guard(pendingHedgesLock);
+        while (!pendingHedges.empty() && pendingHedges.front().sendAt <= now) {
+            due.push_back(std::move(pendingHedges.front()));
+            pendingHedges.pop_front();
+        }
+    }
+
+    for (auto & hedge: due) {
+        if (hedge.exchange->done.load() || hedge.deadline <= now) {
+            recordHit("hedge.cancelled");
+            continue;
+        }
+
+        ++hedge.exchange->pending;
+        recordHit("hedge.sent");
+        httpClientHedge->enqueueRequest(hedge.head, hedge.callbacks,
+                                        std::move(hedge.body),
+                                        hedge.deadline);
+    }
+}
+
+void HttpBidderInterface::updateHedgeDelay()
+{
+    auto latency = routerLatency_.snapshot();
+    auto period = latency - lastRouterLatency;
+    lastRouterLatency = latency;
+
+    // Too few responses to say what's slow; keep the previous delay
+    if (period.count() < 100)
+        return;
 
-    httpClientRouter->post(routerPath, callbacks, reqContent,
-                     { } /* queryParams */, headers);
+    double delayMs = std::max(hedgeMinDelayMs, period.percentile(0.95) / 1000.0);
+    hedgeDelayMs = delayMs;
+    recordLevel(delayMs, "hedge.delayMs");
 }
 
 void HttpBidderInterface::parseFormat (BidRequest & originalRequest,
@@ -651,13 +794,12 @@ void HttpBidderInterface::injectBids(const std::string &agent, Id auctionId,
      // calling doBid from the context of an other thread (the MessageLoop worker thread).
      // Since the object that handles in flight BidRequests for an agent is not
      // thread-safe, we can not call the doBid function from an other thread.
-     // Instead, we use a queue to communicate with the router thread. We then avoid
-     // an evil race condition.
+     // Instead, we use a queue to communicate with the router thread (or the
+     // shard thread that owns the auction). We then avoid an evil race condition.
 
-     if (!router->doBidBuffer.tryPush(std::move(message))) {
+     if (!router->tryPushBid(std::move(message))) {
          throw ML::Exception("Main router loop can not keep up with HttpBidderInterface");
      }
-     router->wakeupMainLoop.signal();
 }
 
 void HttpBidderInterface::submitBids(AgentBids &info) {
@@ -6,9 +6,14 @@
 #pragma once
 
 #include "rtbkit/common/bidder_interface.h"
+#include "rtbkit/common/latency_histogram.h"
 #include "soa/service/http_client.h"
 #include "soa/service/logs.h"
 
+#include <atomic>
+#include <deque>
+#include <mutex>
+
 namespace RTBKIT {
 
 struct Bids;
@@ -86,6 +91,12 @@ struct HttpBidderInterface : public BidderInterface
     virtual void tagRequest(OpenRTB::BidRequest &request,
                             const std::map<std::string, BidInfo> &bidders) const;
 
+    /** Response times of the bid requests sent to the router host. */
+    const LatencyHistogram & routerLatency() const
+    {
+        return routerLatency_;
+    }
+
     static Logging::Category print;
     static Logging::Category error;
     static Logging::Category trace;
@@ -112,6 +123,57 @@ protected:
     std::string routerHost;
     std::string routerPath;
 
+    /// Request line and headers of the bid requests, by OpenRTB version
+    std::map<std::string, std::shared_ptr<const HttpRequestHead> > routerHeads;
+    std::map<std::string, std::shared_ptr<const HttpRequestHead> > hedgeHeads;
+    std::mutex routerHeadsLock;
+
+    std::shared_ptr<const HttpRequestHead>
+    routerRequestHead(const std::string & openRtbVersion, bool hedge = false);
+
+    /* Hedging: when "hedgeHost" is configured, a bid request that the router
+       host didn't answer within its 95th percentile response time is sent
+       again to the hedge host.  The first response is the one used.  The
+       hedge isn't sent when the first request was answered in the meantime;
+       HttpClient can't abort a request, so a losing response is ignored.
+    */
+    std::string hedgeHost;
+    std::shared_ptr<HttpClient> httpClientHedge;
+    double hedgeMinDelayMs;
+
+    /// Delay after which to hedge; negative until enough were measured
+    std::atomic<double> hedgeDelayMs;
+
+    LatencyHistogram routerLatency_;
+    LatencyHistogram::Snapshot lastRouterLatency;
+
+    /** State shared by a bid request and its hedge. */
+    struct RouterExchange {
+        RouterExchange() : done(false), pending(1) {}
+
+        std::atomic<bool> done;     ///< Set by the response that's used
+        std::atomic<int> pending;   ///< Requests sent and not answered
+    };
+
+    struct PendingHedge {
+        Date sendAt;
+        Date deadline;
+        std::shared_ptr<RouterExchange> exchange;
+        std::shared_ptr<const HttpRequestHead> head;
+        std::shared_ptr<HttpClientCallbacks> callbacks;
+        std::string body;
+    };
+
+    /// Hedges to send, in the order they were queued
+    std::deque<PendingHedge> pendingHedges;
+    std::mutex pendingHedgesLock;
+
+    /** Send the hedges that are due and still needed. */
+    void sendHedges();
+
+    /** Update the hedging delay from the latencies of the last period. */
+    void updateHedgeDelay();
+
     std::string adserverHost;
 
     uint16_t adserverWinPort;
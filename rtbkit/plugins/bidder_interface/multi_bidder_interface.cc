@@ -38,6 +38,14 @@ MultiBidderInterface::MultiBidderInterface(
 
         bidderInterfaces.insert(
                 std::make_pair(name, bidder));
+
+        InterfaceDispatch dispatch;
+        dispatch.budget.fraction = config.get("timeFraction", 1.0).asDouble();
+        dispatch.budget.maxTimeMs = config.get("maxTimeMs", 0).asDouble();
+        ExcCheck(dispatch.budget.fraction > 0 && dispatch.budget.fraction <= 1,
+                 "timeFraction must be in ]0, 1]");
+        dispatch.latency = std::make_shared<LatencyHistogram>();
+        dispatches[bidder.get()] = dispatch;
     }
 }
 
@@ -82,9 +90,26 @@ void MultiBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & a
         aggregate[iface].insert(bidder);
     }
 
+    /* The interfaces send asynchronously, so this only takes the time to
+       build the requests.  The agents interface's sockets belong to this
+       thread, which is why the interfaces aren't called from a pool. */
     for (const auto &iface: aggregate) {
-        iface.first->sendAuctionMessage(auction, timeLeftMs, iface.second);
+        const auto & dispatch = dispatches.at(iface.first.get());
+
+        Date start = Date::now();
+        iface.first->sendAuctionMessage(
+                auction, dispatch.budget.timeLeftMs(timeLeftMs), iface.second);
+        dispatch.latency->record(Date::now().secondsSince(start) * 1000000.0);
+    }
+}
+
+Json::Value MultiBidderInterface::dispatchLatencies() const {
+    Json::Value result(Json::objectValue);
+    for (const auto &iface: bidderInterfaces) {
+        const auto & dispatch = dispatches.at(iface.second.get());
+        result[iface.first] = dispatch.latency->snapshot().toJson();
     }
+    return result;
 }
 
 void MultiBidderInterface::sendLossMessage(
@@ -195,6 +220,15 @@ void MultiBidderInterface::registerLoopMonitor(LoopMonitor *monitor) const {
     }
 }
 
+bool MultiBidderInterface::acceptSharedMemory(
+        std::string const & agent, std::string const & path) {
+    for (const auto& iface: bidderInterfaces) {
+        if (iface.second->acceptSharedMemory(agent, path))
+            return true;
+    }
+    return false;
+}
+
 
 //
 // factory
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "rtbkit/common/bidder_interface.h"
+#include "rtbkit/common/latency_histogram.h"
 #include "rtbkit/core/router/router.h"
 
 namespace RTBKIT {
@@ -149,13 +150,46 @@ struct MultiBidderInterface : public BidderInterface {
 
     void registerLoopMonitor(LoopMonitor *monitor) const;
 
+    bool acceptSharedMemory(std::string const & agent,
+                            std::string const & path);
+
     Stats stats() const {
         return stats_;
     }
 
+    /** Time taken to hand the auctions to each interface, by interface
+        name.
+    */
+    Json::Value dispatchLatencies() const;
+
 
 private:
     std::map<std::string, std::shared_ptr<BidderInterface>> bidderInterfaces;
+
+    /** Share of the time left to bid that an interface is given, from the
+        "timeFraction" and "maxTimeMs" of its configuration.  Slow external
+        bidders can then be cut off before the auction as a whole expires.
+    */
+    struct TimeBudget {
+        TimeBudget() : fraction(1.0), maxTimeMs(0) {}
+
+        double fraction;
+        double maxTimeMs;           ///< Zero for no limit
+
+        double timeLeftMs(double auctionTimeLeftMs) const
+        {
+            double result = auctionTimeLeftMs * fraction;
+            if (maxTimeMs > 0) result = std::min(result, maxTimeMs);
+            return result;
+        }
+    };
+
+    struct InterfaceDispatch {
+        TimeBudget budget;
+        std::shared_ptr<LatencyHistogram> latency;
+    };
+
+    std::map<BidderInterface *, InterfaceDispatch> dispatches;
     std::shared_ptr<BidderInterface> findInterface(
                 const std::string &name,
                 const std::string &agent) {
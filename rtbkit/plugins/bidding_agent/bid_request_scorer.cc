@@ -0,0 +1,251 @@
+/* bid_request_scorer.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Scores bid requests with a jml classifier from within a bidding agent.
+*/
+
+#include "bid_request_scorer.h"
+#include "jml/boosting/feature_space.h"
+#include "jml/arch/exception.h"
+
+#include <limits>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace RTBKIT {
+
+
+namespace {
+
+const float NaN = std::numeric_limits<float>::quiet_NaN();
+
+float orNaN(int val)
+{
+    return val == -1 ? NaN : val;
+}
+
+const Format * firstFormat(const BidRequest & request, int spotNum)
+{
+    const AdSpot & spot = request.imp.at(spotNum);
+    if (spot.formats.empty() || !spot.formats[0].valid())
+        return nullptr;
+    return &spot.formats[0];
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* BID REQUEST FEATURES                                                      */
+/*****************************************************************************/
+
+BidRequestFeatures::
+BidRequestFeatures()
+{
+}
+
+BidRequestFeatures::
+BidRequestFeatures(const Json::Value & names)
+{
+    if (!names.isArray())
+        throw ML::Exception("bid request features must be an array of names");
+
+    for (auto & name: names)
+        add(name.asString());
+}
+
+void
+BidRequestFeatures::
+add(const std::string & name)
+{
+    Extractor extractor;
+
+    if (name == "spot.width") {
+        extractor = [] (const BidRequest & request, int spotNum) -> float
+            {
+                auto format = firstFormat(request, spotNum);
+                return format ? format->width : NaN;
+            };
+    }
+    else if (name == "spot.height") {
+        extractor = [] (const BidRequest & request, int spotNum) -> float
+            {
+                auto format = firstFormat(request, spotNum);
+                return format ? format->height : NaN;
+            };
+    }
+    else if (name == "spot.position") {
+        extractor = [] (const BidRequest & request, int spotNum)
+            {
+                return orNaN(request.imp.at(spotNum).position.val);
+            };
+    }
+    else if (name == "hour") {
+        extractor = [] (const BidRequest & request, int spotNum)
+            {
+                return request.timestamp == Date()
+                    ? NaN : (float)request.timestamp.hour();
+            };
+    }
+    else if (name == "weekday") {
+        extractor = [] (const BidRequest & request, int spotNum)
+            {
+                return request.timestamp == Date()
+                    ? NaN : (float)request.timestamp.weekday();
+            };
+    }
+    else if (name == "device.devicetype") {
+        extractor = [] (const BidRequest & request, int spotNum)
+            {
+                return request.device
+                    ? orNaN(request.device->devicetype.val) : NaN;
+            };
+    }
+    else if (name.compare(0, 9, "exchange:") == 0) {
+        string exchange = name.substr(9);
+        extractor = [=] (const BidRequest & request, int spotNum)
+            {
+                return request.exchange == exchange ? 1.0f : NaN;
+            };
+    }
+    else if (name.compare(0, 8, "segment:") == 0) {
+        // The source can't have a ':' but the segment can
+        size_t pos = name.find(':', 8);
+        if (pos == string::npos)
+            throw ML::Exception("segment feature '%s' should be "
+                                "segment:<source>:<segment>", name.c_str());
+        string source = name.substr(8, pos - 8);
+        string segment = name.substr(pos + 1);
+        extractor = [=] (const BidRequest & request, int spotNum)
+            {
+                return request.segments.get(source).contains(segment)
+                    ? 1.0f : NaN;
+            };
+    }
+    else if (name.compare(0, 7, "userId:") == 0) {
+        string domain = name.substr(7);
+        extractor = [=] (const BidRequest & request, int spotNum)
+            {
+                return request.userIds.count(domain) ? 1.0f : NaN;
+            };
+    }
+    else throw ML::Exception("unknown bid request feature '%s'",
+                             name.c_str());
+
+    add(name, extractor);
+}
+
+void
+BidRequestFeatures::
+add(const std::string & name, const Extractor & extractor)
+{
+    ExcAssert(extractor);
+    names_.push_back(name);
+    extractors.push_back(extractor);
+}
+
+void
+BidRequestFeatures::
+extract(const BidRequest & request, int spotNum, float * features) const
+{
+    for (size_t i = 0;  i < extractors.size();  ++i)
+        features[i] = extractors[i](request, spotNum);
+}
+
+std::vector<float>
+BidRequestFeatures::
+extract(const BidRequest & request, int spotNum) const
+{
+    vector<float> result(size());
+    extract(request, spotNum, result.data());
+    return result;
+}
+
+std::vector<float>
+BidRequestFeatures::
+extractSpots(const BidRequest & request) const
+{
+    vector<float> result(request.imp.size() * size());
+    for (size_t i = 0;  i < request.imp.size();  ++i)
+        extract(request, i, result.data() + i * size());
+    return result;
+}
+
+std::vector<ML::Feature>
+BidRequestFeatures::
+mlFeatures(const ML::Feature_Space & featureSpace) const
+{
+    vector<ML::Feature> result(size());
+    for (size_t i = 0;  i < size();  ++i)
+        featureSpace.parse(names_[i], result[i]);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* BID REQUEST SCORER                                                        */
+/*****************************************************************************/
+
+BidRequestScorer::
+BidRequestScorer(const ML::Classifier_Impl & classifier,
+                 BidRequestFeatures features)
+    : features_(std::move(features)),
+      classifier_(classifier,
+                  features_.mlFeatures(*classifier.feature_space()))
+{
+}
+
+BidRequestScorer::
+BidRequestScorer(const std::string & classifierFile,
+                 BidRequestFeatures features)
+    : features_(std::move(features))
+{
+    if (ML::Compiled_Classifier::is_saved(classifierFile)) {
+        classifier_.load(classifierFile);
+        if (classifier_.feature_count() != features_.size())
+            throw ML::Exception("compiled classifier %s has %zd features "
+                                "instead of %zd",
+                                classifierFile.c_str(),
+                                classifier_.feature_count(),
+                                features_.size());
+        return;
+    }
+
+    ML::Classifier classifier;
+    classifier.load(classifierFile);
+    classifier_.compile(*classifier.impl,
+                        features_.mlFeatures(*classifier.feature_space()));
+}
+
+ML::Label_Dist
+BidRequestScorer::
+score(const BidRequest & request, int spotNum) const
+{
+    float features[features_.size()];
+    features_.extract(request, spotNum, features);
+    return classifier_.predict(features);
+}
+
+std::vector<float>
+BidRequestScorer::
+scoreSpots(const BidRequest & request, int label) const
+{
+    size_t nl = classifier_.label_count();
+    if (label < 0 || label >= nl)
+        throw ML::Exception("invalid label %d", label);
+
+    size_t n = request.imp.size();
+    vector<float> features = features_.extractSpots(request);
+    vector<float> output(n * nl);
+    classifier_.predict(features.data(), n, output.data());
+
+    vector<float> result(n);
+    for (size_t i = 0;  i < n;  ++i)
+        result[i] = output[i * nl + label];
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,121 @@
+/* bid_request_scorer.h                                            -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Scores bid requests with a jml classifier from within a bidding agent.
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request.h"
+#include "jml/boosting/compiled_classifier.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* BID REQUEST FEATURES                                                      */
+/*****************************************************************************/
+
+/** Maps the fields of a bid request to a dense vector of features for one of
+    its spots.  Each feature has a name, which is the name of the feature in
+    the feature space the model was trained with.
+
+    The built-in features are:
+    - spot.width, spot.height: size of the first format of the spot
+    - spot.position: fold position of the spot
+    - hour, weekday: UTC hour of the day and day of the week of the request
+    - device.devicetype: OpenRTB device type
+    - exchange:<exchange>: 1 if the request comes from the exchange
+    - segment:<source>:<segment>: 1 if the request has the segment
+    - userId:<domain>: 1 if the request has a user id for the domain
+
+    A field that isn't in the request is NaN, which the models treat as a
+    missing feature.
+*/
+
+struct BidRequestFeatures {
+
+    typedef std::function<float (const BidRequest & request, int spotNum)>
+        Extractor;
+
+    BidRequestFeatures();
+
+    /** Features from a JSON array of built-in feature names. */
+    BidRequestFeatures(const Json::Value & names);
+
+    /** Add a built-in feature.  Throws if there is no such feature. */
+    void add(const std::string & name);
+
+    /** Add a feature that's extracted by the given function. */
+    void add(const std::string & name, const Extractor & extractor);
+
+    size_t size() const { return names_.size(); }
+    const std::vector<std::string> & names() const { return names_; }
+
+    /** Write the size() features for the given spot into features. */
+    void extract(const BidRequest & request, int spotNum,
+                 float * features) const;
+
+    std::vector<float> extract(const BidRequest & request, int spotNum) const;
+
+    /** Features of every spot of the request, row major with one row of
+        size() features per spot. */
+    std::vector<float> extractSpots(const BidRequest & request) const;
+
+    /** Feature of the feature space that corresponds to each feature, in
+        the same order.  Throws if one isn't in the feature space. */
+    std::vector<ML::Feature>
+    mlFeatures(const ML::Feature_Space & featureSpace) const;
+
+private:
+    std::vector<std::string> names_;
+    std::vector<Extractor> extractors;
+};
+
+
+/*****************************************************************************/
+/* BID REQUEST SCORER                                                        */
+/*****************************************************************************/
+
+/** Scores the spots of bid requests with a classifier that has been compiled
+    (see ML::Compiled_Classifier) for the given features, so that it can be
+    called for every bid request an agent sees.
+
+    Thread-safe once constructed.
+*/
+
+struct BidRequestScorer {
+
+    BidRequestScorer(const ML::Classifier_Impl & classifier,
+                     BidRequestFeatures features);
+
+    /** Load the classifier from a file saved by jml, or a compiled
+        classifier saved with ML::Compiled_Classifier::save() for the same
+        features.  The latter loads instantly and is shared between all the
+        agents of the host that load it.
+    */
+    BidRequestScorer(const std::string & classifierFile,
+                     BidRequestFeatures features);
+
+    const BidRequestFeatures & features() const { return features_; }
+    const ML::Compiled_Classifier & classifier() const { return classifier_; }
+
+    /** Score of each label for the given spot. */
+    ML::Label_Dist score(const BidRequest & request, int spotNum) const;
+
+    /** Score of the given label for each spot of the request, all scored in
+        one batch. */
+    std::vector<float> scoreSpots(const BidRequest & request,
+                                  int label) const;
+
+private:
+    BidRequestFeatures features_;
+    ML::Compiled_Classifier classifier_;
+};
+
+} // namespace RTBKIT
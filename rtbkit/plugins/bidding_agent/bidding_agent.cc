@@ -18,6 +18,7 @@
 #include "soa/service/process_stats.h"
 
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <iostream>
 
@@ -96,7 +97,11 @@ BiddingAgent(std::shared_ptr<ServiceProxies> proxies,
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      sharedMemoryRingSize(0),
+      requiresAllCB(true),
+      sendBinaryBids(false),
+      nextWorker(0),
+      shutdownWorkers(false)
 {
 }
 
@@ -111,7 +116,11 @@ BiddingAgent(ServiceBase& parent,
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      sharedMemoryRingSize(0),
+      requiresAllCB(true),
+      sendBinaryBids(false),
+      nextWorker(0),
+      shutdownWorkers(false)
 {
 }
 
@@ -152,6 +161,29 @@ init()
             sendConfig();
         };
 
+    auto offerSharedMemory = [=] (const std::string & router)
+        {
+            string routerName = router;
+            std::replace(routerName.begin(), routerName.end(), '/', '_');
+            string path = sharedMemoryDirectory + "/rtbkit-" + agentName
+                + "-" + routerName;
+
+            auto source = std::make_shared<ShmMessageSource>(
+                    path, sharedMemoryRingSize,
+                    [=] (vector<string> && msg)
+                    {
+                        messageHandler(router, msg);
+                    });
+
+            auto & old = fromRouterRings[router];
+            if (old) removeSource(old.get());
+            old = source;
+            toRouterRings.erase(router);
+
+            addSource("BiddingAgent::shm::" + router, source);
+            toRouters.sendMessage(router, "SHM", path);
+        };
+
     toRouters.init(getServices()->config, agentName);
     toRouters.connectHandler = [=] (const std::string & connectedTo)
         {
@@ -160,11 +192,15 @@ init()
                  << connectedTo << endl;
             cerr << ss.str() ;
             toRouters.sendMessage(connectedTo, "CONFIG", agentName);
+
+            if (!sharedMemoryDirectory.empty())
+                offerSharedMemory(connectedTo);
         };
     toRouters.connectAllServiceProviders("rtbRequestRouter", "agents");
     toRouterChannel.onEvent = [=] (const RouterMessage & msg)
         {
-            toRouters.sendMessage(msg.toRouter, msg.type, msg.payload);
+            if (!sendSharedMemory(msg))
+                toRouters.sendMessage(msg.toRouter, msg.type, msg.payload);
         };
     toPostAuctionServices.init(getServices()->config, agentName);
     toPostAuctionServices.connectHandler = [=] (const std::string & connectedTo)
@@ -181,6 +217,8 @@ init()
     addSource("BiddingAgent::toConfigurationAgent", toConfigurationAgent);
     addSource("BiddingAgent::toRouterChannel", toRouterChannel);
 
+    startWorkers();
+
     // No need to init() message loop; it was done in the constructor
 }
 
@@ -189,12 +227,134 @@ BiddingAgent::
 shutdown()
 {
     MessageLoop::shutdown();
+    stopWorkers();
 
     toConfigurationAgent.shutdown();
     toRouters.shutdown();
     //toPostAuctionService.shutdown();
 }
 
+void
+BiddingAgent::
+useSharedMemory(const std::string & directory, size_t ringSize)
+{
+    sharedMemoryDirectory = directory;
+    sharedMemoryRingSize = ringSize;
+}
+
+bool
+BiddingAgent::
+sendSharedMemory(const RouterMessage & msg)
+{
+    auto it = toRouterRings.find(msg.toRouter);
+    if (it == toRouterRings.end()) return false;
+
+    ShmMessageRing & ring = *it->second;
+    if (ring.tryPushMessage(agentName, msg.type, msg.payload))
+        return true;
+
+    if (ring.isConnected())
+        recordHit("sharedMemory.full");
+    else {
+        recordHit("sharedMemory.closed");
+        toRouterRings.erase(it);
+    }
+    return false;
+}
+
+void
+BiddingAgent::
+setNumWorkers(unsigned numWorkers)
+{
+    ExcCheck(workers.empty(), "workers already started");
+
+    workers.clear();
+    for (unsigned i = 0;  i < numWorkers;  ++i)
+        workers.emplace_back(new Worker());
+}
+
+void
+BiddingAgent::
+startWorkers()
+{
+    for (auto & worker: workers) {
+        Worker * w = worker.get();
+        w->thread = std::thread([=] () { this->runWorker(*w); });
+    }
+}
+
+void
+BiddingAgent::
+stopWorkers()
+{
+    shutdownWorkers = true;
+    for (auto & worker: workers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+void
+BiddingAgent::
+runWorker(Worker & worker)
+{
+    std::shared_ptr<BidRequestTask> task;
+
+    while (!shutdownWorkers) {
+        if (!worker.queue.tryPop(task, 0.05))
+            continue;
+
+        // The time spent in the queue comes out of the time to bid
+        double queuedMs = (Date::now() - task->queued) * 1000.0;
+        recordLevel(queuedMs, "workerQueueMs");
+
+        try {
+            callBidRequest(*task, task->timeLeftMs - queuedMs);
+        }
+        catch (const std::exception& ex) {
+            recordHit("error");
+            cerr << "Error handling bid request " << task->id << ": "
+                 << ex.what() << endl;
+        }
+
+        task.reset();
+    }
+}
+
+void
+BiddingAgent::
+callBidRequest(BidRequestTask & task, double timeLeftMs)
+{
+    if (task.lazyBidRequest) {
+        onLazyBidRequest(task.timestamp, task.id, task.lazyBidRequest,
+                         task.bids, timeLeftMs, task.lazyAugmentations,
+                         task.wcm);
+    }
+    else {
+        onBidRequest(task.timestamp, task.id, task.bidRequest, task.bids,
+                     timeLeftMs, task.augmentations, task.wcm);
+    }
+}
+
+void
+BiddingAgent::
+dispatchBidRequest(std::shared_ptr<BidRequestTask> task)
+{
+    // Round robin, skipping the workers that have a full queue.  When they
+    // all do, we wait for the next one rather than drop the request.
+    unsigned first = nextWorker;
+    nextWorker = (nextWorker + 1) % workers.size();
+
+    for (unsigned i = 0;  i < workers.size();  ++i) {
+        Worker & worker = *workers[(first + i) % workers.size()];
+        if (worker.queue.tryPush(task))
+            return;
+    }
+
+    recordHit("workerQueuesFull");
+    workers[first]->queue.push(std::move(task));
+}
+
 void
 BiddingAgent::
 handleRouterMessage(const std::string & fromRouter,
@@ -225,6 +385,7 @@ handleRouterMessage(const std::string & fromRouter,
         case hash_compile_time("LOSS") :    handleResult(message, onLoss); break;
         case hash_compile_time("LATEWIN") : handleResult(message, onLateWin ); break;
         case hash_compile_time("NOBUDGET") : handleResult(message, onNoBudget); break;
+        case hash_compile_time("RESULTS") : handleResultBatch(message); break;
         case hash_compile_time("NEEDCONFIG") : sendConfig(); break;
         case hash_compile_time("TOOLATE") : handleResult(message, onTooLate); break;
         case hash_compile_time("INVALID") : handleResult(message, onInvalidBid); break;
@@ -261,6 +422,14 @@ handleRouterMessage(const std::string & fromRouter,
         }
         case hash_compile_time("DROPPEDBID") : handleResult(message, onDroppedBid); break;
         case hash_compile_time("GOTCONFIG") : /* no-op */ ; break;
+        case hash_compile_time("SHM") : {
+            // Router accepted our ring and offers one for the way back
+            std::unique_ptr<ShmMessageRing> ring(new ShmMessageRing());
+            if (ring->open(message.at(2)))
+                toRouterRings[fromRouter] = std::move(ring);
+            else recordHit("sharedMemory.unavailable");
+            break;
+        }
         case hash_compile_time("ERROR") : handleError(message, onError) ; break;
         case hash_compile_time("BYEBYE"): {
              if (onByebye) {
@@ -366,25 +535,33 @@ BiddingAgent::
 handleBidRequest(const std::string & fromRouter,
                  const std::vector<std::string>& msg, BidRequestCbFn& callback)
 {
-    ExcCheck(!requiresAllCB || callback, "Null callback for " + msg[0]);
-    if (!callback) return;
+    bool lazy = !!onLazyBidRequest;
+    ExcCheck(!requiresAllCB || callback || lazy, "Null callback for " + msg[0]);
+    if (!callback && !lazy) return;
 
     checkMessageSize(msg, 9);
 
-    double timestamp = boost::lexical_cast<double>(msg[1]);
-    Id id(msg[2]);
+    auto task = std::make_shared<BidRequestTask>();
+    task->timestamp = boost::lexical_cast<double>(msg[1]);
+    task->id = Id(msg[2]);
 
     string bidRequestSource = msg[3];
 
-    std::shared_ptr<BidRequest> br(
-            BidRequest::parse(bidRequestSource, msg[4]));
+    if (lazy) {
+        task->lazyBidRequest
+            = std::make_shared<LazyBidRequest>(bidRequestSource, msg[4]);
+        task->lazyAugmentations = std::make_shared<LazyJsonObject>(msg[7]);
+    }
+    else {
+        task->bidRequest.reset(BidRequest::parse(bidRequestSource, msg[4]));
+        task->augmentations = jsonParse(msg[7]);
+    }
 
     Json::Value imp = jsonParse(msg[5]);
-    double timeLeftMs = boost::lexical_cast<double>(msg[6]);
-    Json::Value augmentations = jsonParse(msg[7]);
-    WinCostModel wcm = WinCostModel::fromJson(jsonParse(msg[8]));
+    task->timeLeftMs = boost::lexical_cast<double>(msg[6]);
+    task->wcm = WinCostModel::fromJson(jsonParse(msg[8]));
 
-    Bids bids;
+    Bids & bids = task->bids;
     bids.reserve(imp.size());
 
     for (size_t i = 0; i < imp.size(); ++i) {
@@ -400,14 +577,53 @@ handleBidRequest(const std::string & fromRouter,
     recordHit("requests");
 
     {
-        lock_guard<mutex> guard (requestsLock);
-        ExcCheck(!requests.count(id), "seen multiple requests with same ID");
+        const Id & id = task->id;
+        RequestShard & shard = requestShard(id);
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        ExcCheck(!shard.requests.count(id),
+                 "seen multiple requests with same ID");
+
+        RequestStatus & status = shard.requests[id];
+        status.timestamp = Date::now();
+        status.fromRouter = fromRouter;
+    }
 
-        requests[id].timestamp = Date::now();
-        requests[id].fromRouter = fromRouter;
+    if (workers.empty()) {
+        callBidRequest(*task, task->timeLeftMs);
+        return;
     }
 
-    callback(timestamp, id, br, bids, timeLeftMs, augmentations, wcm);
+    task->queued = Date::now();
+    dispatchBidRequest(std::move(task));
+}
+
+void
+BiddingAgent::
+handleResultBatch(const std::vector<std::string>& msg)
+{
+    // Each result is sent as the 11 frames of its unbatched message.
+    enum { ResultFrames = 11 };
+
+    checkMessageSize(msg, 3);
+
+    size_t count = boost::lexical_cast<size_t>(msg[2]);
+    ExcCheckEqual(msg.size(), 3 + count * ResultFrames,
+            "Invalid result batch message size");
+
+    recordLevel(count, "resultBatchSize");
+
+    for (size_t i = 0; i < count; ++i) {
+        auto first = msg.begin() + 3 + i * ResultFrames;
+        std::vector<std::string> result(first, first + ResultFrames);
+
+        switch (hash(result[0])) {
+            case hash_compile_time("WIN") :     handleResult(result, onWin); break;
+            case hash_compile_time("LOSS") :    handleResult(result, onLoss); break;
+            case hash_compile_time("LATEWIN") : handleResult(result, onLateWin); break;
+            default:
+                throw ML::Exception("unknown batched result type: " + result[0]);
+        }
+    }
 }
 
 void
@@ -432,8 +648,10 @@ handleResult(const std::vector<std::string>& msg, ResultCbFn& callback)
     callback(result);
 
     if (result.result == BS_DROPPEDBID) {
-        lock_guard<mutex> guard (requestsLock);
-        requests.erase(Id(msg[3]));
+        Id id(msg[3]);
+        RequestShard & shard = requestShard(id);
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        shard.requests.erase(id);
     }
 }
 
@@ -473,20 +691,29 @@ void
 BiddingAgent::
 doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
 {
+    auto agentConfig = std::atomic_load(&agent_config);
+
     for (Bid& bid : bids) {
         if (bid.creativeIndex >= 0) {
             if (!bid.isNullBid()) {
                 recordLevel(bid.price.value, "bidPrice." + bid.price.getCurrencyStr());
             }
 
-            bid.price = agent_config.creatives[bid.creativeIndex].fees->applyFees(bid.price);
+            ExcCheck(agentConfig, "bid placed before the agent was configured");
+            bid.price = agentConfig->creatives.at(bid.creativeIndex)
+                .fees->applyFees(bid.price);
         }
     }
 
     Json::FastWriter jsonWriter;
 
-    string response = jsonWriter.write(bids.toJson());
-    boost::trim(response);
+    string response;
+    if (sendBinaryBids)
+        response = bids.toBinary();
+    else {
+        response = jsonWriter.write(bids.toJson());
+        boost::trim(response);
+    }
 
     string meta = jsonWriter.write(jsonMeta);
     boost::trim(meta);
@@ -499,21 +726,22 @@ doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
     string fromRouter;
 
     {
-        lock_guard<mutex> guard (requestsLock);
+        RequestShard & shard = requestShard(id);
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
 
-        auto it = requests.find(id);
+        auto it = shard.requests.find(id);
 
         /** If the auction id isn't in the map then we previously received a
             DROPBID message we should simply forget this bid.
          */
-        if (it == requests.end()) {
+        if (it == shard.requests.end()) {
             cerr << "Ignoring bid (dropped auction id): " << id << endl;
             return;
         }
 
         beforeSend = it->second.timestamp;
-        fromRouter = it->second.fromRouter;
-        requests.erase(it);
+        fromRouter = std::move(it->second.fromRouter);
+        shard.requests.erase(it);
     }
     if (fromRouter.empty()) return;
 
@@ -584,7 +812,9 @@ doConfigJson(Json::Value jsonConfig)
 
     sendConfig(newConfig);
 
-    agent_config = AgentConfig::createFromJson(jsonConfig);
+    std::shared_ptr<const AgentConfig> parsedConfig
+        = std::make_shared<AgentConfig>(AgentConfig::createFromJson(jsonConfig));
+    std::atomic_store(&agent_config, parsedConfig);
 
 }
 
@@ -12,6 +12,7 @@
 
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/bids.h"
+#include "rtbkit/common/lazy_bid_request.h"
 #include "rtbkit/common/auction_events.h"
 #include "rtbkit/common/win_cost_model.h"
 #include "soa/service/zmq.hpp"
@@ -21,6 +22,9 @@
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
+#include "soa/service/shm_message_ring.h"
+#include "jml/utils/ring_buffer.h"
+#include "jml/arch/spinlock.h"
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
@@ -30,7 +34,8 @@
 #include <string>
 #include <vector>
 #include <thread>
-#include <map>
+#include <atomic>
+#include <unordered_map>
 
 
 namespace RTBKIT {
@@ -72,6 +77,30 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
     */
     void strictMode(bool strict) { requiresAllCB = strict; }
 
+    /** If set to true then bids are sent to the router in their binary form
+        (see Bids::toBinary()) which is cheaper for it to decode.  Defaults
+        to false.
+    */
+    void binaryBids(bool binary) { sendBinaryBids = binary; }
+
+    /** Number of threads on which onBidRequest is called.  With zero, the
+        default, it's called on the agent's message loop like every other
+        callback.  Otherwise the bid requests are still parsed on the message
+        loop but are handed over to the worker threads, so onBidRequest must
+        be thread-safe.  The other callbacks stay on the message loop.  Must
+        be called before init().
+    */
+    void setNumWorkers(unsigned numWorkers);
+
+    /** Offer each router a shared memory ring in the given directory, which
+        routers on the same host that are configured to use shared memory
+        (see AgentsBidderInterface) send their messages through.  Such a
+        router then offers a ring of its own which the bids go back through.
+        Everything else stays on zmq.  Must be called before init().
+    */
+    void useSharedMemory(const std::string & directory = "/dev/shm",
+                         size_t ringSize = 16 * 1024 * 1024);
+
     void init();
     void shutdown();
 
@@ -81,6 +110,7 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
     /**************************************************************************/
 
     /** Send a bid response to the router in answer to a received auction.
+        This can be called from any thread.
 
         \param id auction id given in the auction callback.
         \param response a Bids struct converted to json.
@@ -158,6 +188,24 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
      */
     BidRequestCbFn onBidRequest;
 
+    typedef void (LazyBidRequestCb) (
+            double timestamp,
+            Id id,
+            std::shared_ptr<LazyBidRequest> bidRequest,
+            const Bids& bids,
+            double timeLeftMs,
+            std::shared_ptr<LazyJsonObject> augmentations,
+            WinCostModel const & wcm);
+    typedef boost::function<LazyBidRequestCb> LazyBidRequestCbFn;
+
+    /** Same as onBidRequest but the bid request is decoded one top level
+        field at a time as they're accessed, and the augmentations one
+        augmentor at a time, which is much cheaper for agents that only look
+        at a few fields before not bidding.  When set, it's called instead of
+        onBidRequest.
+     */
+    LazyBidRequestCbFn onLazyBidRequest;
+
 
     typedef void (ResultCb) (const BidResult & args);
     typedef boost::function<ResultCb> ResultCbFn;
@@ -268,15 +316,80 @@ private:
     ZmqNamedClientBusProxy toConfigurationAgent;
     TypedMessageSink<RouterMessage> toRouterChannel;
 
+    /** Shared memory rings from and to each router, which are only touched
+        from the message loop.
+    */
+    std::string sharedMemoryDirectory;
+    size_t sharedMemoryRingSize;
+    std::unordered_map<std::string, std::shared_ptr<ShmMessageSource> >
+        fromRouterRings;
+    std::unordered_map<std::string, std::unique_ptr<ShmMessageRing> >
+        toRouterRings;
+
+    /** Push the message into the router's ring if there is one.  Returns
+        false if it has to go through zmq.
+    */
+    bool sendSharedMemory(const RouterMessage & msg);
+
     struct RequestStatus {
         Date timestamp;
         std::string fromRouter;
     };
 
-    std::map<Id, RequestStatus> requests;
-    std::mutex requestsLock; // Protects concurrent writes to requests
+    /** The requests awaiting a bid are spread over shards so that workers
+        calling doBid() only contend for the shard of their auction.
+    */
+    struct RequestShard {
+        ML::Spinlock lock;
+        std::unordered_map<Id, RequestStatus> requests;
+    } JML_ALIGNED(64);
+
+    enum { NumRequestShards = 32 };
+    RequestShard requestShards[NumRequestShards];
+
+    RequestShard & requestShard(const Id & id)
+    {
+        return requestShards[id.hash() % NumRequestShards];
+    }
+
+    /** A parsed bid request on its way to a worker. */
+    struct BidRequestTask {
+        double timestamp;
+        Id id;
+        std::shared_ptr<BidRequest> bidRequest;
+        std::shared_ptr<LazyBidRequest> lazyBidRequest;
+        Bids bids;
+        double timeLeftMs;
+        Json::Value augmentations;
+        std::shared_ptr<LazyJsonObject> lazyAugmentations;
+        WinCostModel wcm;
+        Date queued;
+    };
+
+    /** Calls onBidRequest or onLazyBidRequest for the task. */
+    void callBidRequest(BidRequestTask & task, double timeLeftMs);
+
+    /** Each worker has its own queue, which only the message loop writes to
+        and only the worker reads from.
+    */
+    struct Worker {
+        Worker() : queue(4096) {}
+
+        ML::RingBufferSWMR<std::shared_ptr<BidRequestTask> > queue;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    unsigned nextWorker;
+    std::atomic<bool> shutdownWorkers;
+
+    void startWorkers();
+    void stopWorkers();
+    void runWorker(Worker & worker);
+    void dispatchBidRequest(std::shared_ptr<BidRequestTask> task);
 
     bool requiresAllCB;
+    bool sendBinaryBids;
 
 
     /** Ensures that we can set the config and send it atomically. Prevents a
@@ -286,7 +399,10 @@ private:
      */
     std::mutex configLock;
     std::string config; // The agent's configuration.
-    AgentConfig agent_config;
+
+    /// Read by doBid() on any thread; always accessed with std::atomic_load
+    /// and std::atomic_store.
+    std::shared_ptr<const AgentConfig> agent_config;
 
     void sendConfig(const std::string& newConfig = "");
 
@@ -303,6 +419,7 @@ private:
             const std::vector<std::string>& msg, ResultCbFn& callback);
     void handleResult(
             const std::vector<std::string>& msg, ResultCbFn& callback);
+    void handleResultBatch(const std::vector<std::string>& msg);
     void handleDelivery(
             const std::vector<std::string>& msg, DeliveryCbFn& callback);
     void handlePing(const std::string & fromRouter,
@@ -8,3 +8,11 @@ LIBRTB_ROUTER_PROXY_LINK := \
 	ACE arch utils jsoncpp boost_thread zmq opstats bid_request services
 
 $(eval $(call library,bidding_agent,$(LIBRTB_ROUTER_PROXY_SOURCES),$(LIBRTB_ROUTER_PROXY_LINK)))
+
+LIBBID_REQUEST_SCORER_SOURCES := \
+	bid_request_scorer.cc
+
+LIBBID_REQUEST_SCORER_LINK := \
+	arch utils jsoncpp bid_request boosting
+
+$(eval $(call library,bid_request_scorer,$(LIBBID_REQUEST_SCORER_SOURCES),$(LIBBID_REQUEST_SCORER_LINK)))
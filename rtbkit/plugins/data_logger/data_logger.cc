@@ -49,6 +49,8 @@ init()
         s.reserve(msg.size());
         for (auto & m: msg)
             s.push_back(m.toString());
+        if (!s.empty())
+            ZmqNamedPublisher::parseSampledChannel(s[0]);
         this->logMessageNoTimestamp(s);
     };
     loopMonitor_.init();
@@ -82,9 +84,22 @@ shutdown()
 
 void
 DataLogger::
-connectAllServiceProviders(const string & serviceClass, const string & epName)
+connectAllServiceProviders(const string & serviceClass, const string & epName,
+                           const vector<string> & prefixes, unsigned keepOneIn)
 {
-    multipleSubscriber.connectAllServiceProviders(serviceClass, epName);
+    if (keepOneIn <= 1) {
+        multipleSubscriber.connectAllServiceProviders(serviceClass, epName,
+                                                      prefixes);
+        return;
+    }
+
+    vector<string> topics;
+    for (const auto & prefix: prefixes)
+        topics.push_back(ZmqNamedPublisher::sampledTopic(prefix, keepOneIn));
+    if (topics.empty())
+        topics.push_back(ZmqNamedPublisher::sampledTopic("", keepOneIn));
+
+    multipleSubscriber.connectAllServiceProviders(serviceClass, epName, topics);
 }
 
 /** MonitorProvider interface */
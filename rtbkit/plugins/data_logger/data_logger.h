@@ -35,8 +35,16 @@ struct DataLogger : public Datacratic::ServiceBase,
 
     void start(std::function<void ()> onStop = 0);
 
+    /** Log what the services of the class publish on their epName
+        endpoint.  Only the channels that start with one of the prefixes
+        are sent by the services, all of them if there are none, and only
+        one in every keepOneIn messages of those.
+    */
     void connectAllServiceProviders(const std::string & serviceClass,
-                                    const std::string & epName);
+                                    const std::string & epName,
+                                    const std::vector<std::string> & prefixes
+                                    = std::vector<std::string>(),
+                                    unsigned keepOneIn = 1);
 
     void unsafeDisableMonitor() {
         monitorProviderClient.disable();
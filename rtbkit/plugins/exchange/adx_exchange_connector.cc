@@ -21,6 +21,7 @@
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "rtbkit/openrtb/openrtb_parsing.h"
 #include "soa/types/json_printing.h"
+#include "jml/arch/thread_specific.h"
 
 using namespace std;
 using namespace Datacratic;
@@ -196,6 +197,26 @@ typedef ::BidResponse GoogleBidResponse ;
 
 namespace {
 
+/** The protobuf messages are large and allocate a lot of sub-messages and
+    strings when they're parsed or built.  Each thread keeps one of each and
+    Clear()s it before use, so that the memory allocated by the previous
+    request gets reused instead of freed and allocated again.
+*/
+ML::Thread_Specific<GoogleBidRequest> threadBidRequest;
+ML::Thread_Specific<GoogleBidResponse> threadBidResponse;
+
+std::string binaryToHexStr(const std::string & str)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result(str.size() * 2, '0');
+    for (size_t i = 0; i < str.size(); ++i) {
+        unsigned char c = str[i];
+        result[i * 2] = digits[c >> 4];
+        result[i * 2 + 1] = digits[c & 0xf];
+    }
+    return result;
+}
+
 /**
  *    void ParseGbrMobile ()
  *
@@ -516,8 +537,9 @@ parseBidRequest(HttpAuctionHandler & connection,
     }
 
     // Try and parse the protocol buffer payload
-    GoogleBidRequest gbr;
-    if (!gbr.ParseFromString (payload))
+    GoogleBidRequest & gbr = *threadBidRequest;
+    gbr.Clear();
+    if (!gbr.ParseFromArray(payload.data(), payload.size()))
     {
         connection.sendErrorResponse("couldn't decode BidRequest message");
         return std::shared_ptr<BidRequest> ();
@@ -538,18 +560,8 @@ parseBidRequest(HttpAuctionHandler & connection,
 
     auto& br = *res ;
 
-    // TODO: check reuse
-    auto binary_to_hexstr = [] (const std::string& str)
-    {
-        std::ostringstream os;
-        os << std::hex << std::setfill('0');
-        const unsigned char* pc = reinterpret_cast<const unsigned char*>(str.c_str()) ;
-        for (auto i=0 ; i<str.size(); i++,pc++) os << std::setw(2) << int(*pc) ;
-        return os.str() ;
-    };
-
     // TODO couldn't get Id() to represent correctly [required bytes id = 2;]
-    br.auctionId = Id (binary_to_hexstr(gbr.id()));
+    br.auctionId = Id (binaryToHexStr(gbr.id()));
     // AdX is a second price auction type.
 
     br.timestamp = Date::now();
@@ -642,7 +654,7 @@ parseBidRequest(HttpAuctionHandler & connection,
 
     if (gbr.has_hosted_match_data())
     {
-        br.user->buyeruid = Id(binary_to_hexstr(gbr.hosted_match_data()));
+        br.user->buyeruid = Id(binaryToHexStr(gbr.hosted_match_data()));
         // Provider ID is needed to map different bid requests to the same user
         br.userIds.add(br.user->buyeruid, ID_PROVIDER);
     }
@@ -654,7 +666,10 @@ parseBidRequest(HttpAuctionHandler & connection,
         }
         else if (gbr.has_ip() && has_user_agent){
             // Use a hashing function of IP + User Agent concatenation
-            br.userAgentIPHash = Id(CityHash64((gbr.ip() + gbr.user_agent()).c_str(),(gbr.ip() + gbr.user_agent()).length()));
+            std::string ipUa;
+            ipUa.reserve(gbr.ip().size() + gbr.user_agent().size());
+            ipUa.append(gbr.ip()).append(gbr.user_agent());
+            br.userAgentIPHash = Id(CityHash64(ipUa.data(), ipUa.size()));
             br.userIds.add(br.userAgentIPHash, ID_PROVIDER);
         }
         else {
@@ -742,7 +757,8 @@ getResponse(const HttpAuctionHandler & connection,
     if (current->hasError())
         return getErrorResponse(connection,current->error + ": " + current->details);
 
-    GoogleBidResponse gresp ;
+    GoogleBidResponse & gresp = *threadBidResponse;
+    gresp.Clear();
     gresp.set_processing_time_ms(static_cast<uint32_t>(auction.timeUsed()*1000));
 
     auto en = exchangeName();
@@ -837,13 +853,16 @@ AdXExchangeConnector::
 getDroppedAuctionResponse(const HttpAuctionHandler & connection,
                           const std::string & reason) const
 {
-    //
-    GoogleBidResponse resp ;
     // AdX requires us to set the processing time on an empty BidResponse
     // however we do not have this time here, for there is no auction available.
     // Arbitrary chose to set the processing time to 0 millisecond
-    resp.set_processing_time_ms(0);
-    return HttpResponse(200, "application/octet-stream", resp.SerializeAsString());
+    // The message never changes so it's only serialized once.
+    static const std::string emptyResponse = [] {
+        GoogleBidResponse resp;
+        resp.set_processing_time_ms(0);
+        return resp.SerializeAsString();
+    }();
+    return HttpResponse(200, "application/octet-stream", emptyResponse);
 }
 
 HttpResponse
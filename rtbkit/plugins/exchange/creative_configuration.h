@@ -128,38 +128,70 @@ const std::string TypedCreativeConfiguration<CreativeData>::VARIABLE_MARKER_BEGI
 template<typename CreativeData>
 const std::string TypedCreativeConfiguration<CreativeData>::VARIABLE_MARKER_END = "}";
 
+/** Compiled form of a snippet template.  The template is split once, when
+    the creative is configured, into the literal spans between variables and
+    the callables that produce each variable, so that expanding it for a bid
+    is a single pass appending into one preallocated string.
+*/
 template<typename CreativeData>
 struct TypedCreativeConfiguration<CreativeData>::Expander
 {
-    typedef std::vector<std::pair<ExpandVariable, ExpanderCallable>> FunctorCollection;
+    struct Fragment {
+        size_t literalBegin;    ///< Literal text before the variable...
+        size_t literalEnd;      ///< ... as offsets into the template
+        ExpanderCallable fn;    ///< Variable to expand; empty for the tail
+    };
 
-    void addFunctor(const ExpandVariable& var, ExpanderCallable fn)
+    Expander()
+        : literalSize(0), nextLiteral(0)
     {
-        collection.push_back(std::make_pair(var, fn));
     }
 
-    void finalize()
+    /** Add the next variable of the template.  Variables must be added in
+        the order in which they appear. */
+    void addFunctor(const ExpandVariable& var, ExpanderCallable fn)
     {
-        std::reverse(collection.begin(), collection.end());
+        auto const& location = var.getReplaceLocation();
+        addFragment(location.first, std::move(fn));
+        nextLiteral = location.second;
     }
 
-    std::string expand(std::string toExpand, const Context& ctx) const
+    /** Add the literal text after the last variable. */
+    void finalize(size_t templateSize)
     {
-        for (auto& element : collection) {
-            auto const& var = element.first;
-            auto const& fn = element.second;
-
-            auto const& location = var.getReplaceLocation();
+        addFragment(templateSize, ExpanderCallable());
+    }
 
-            toExpand.replace(
-                location.first, location.second - location.first, fn(ctx));
+    std::string expand(const std::string & toExpand, const Context& ctx) const
+    {
+        if (fragments.empty())
+            return toExpand;
+
+        std::string result;
+        result.reserve(literalSize + 64 * (fragments.size() - 1));
+
+        const char * templ = toExpand.data();
+        for (auto const& fragment : fragments) {
+            result.append(templ + fragment.literalBegin,
+                          templ + fragment.literalEnd);
+            if (fragment.fn)
+                result += fragment.fn(ctx);
         }
 
-        return toExpand;
+        return result;
     }
 
-    FunctorCollection collection;
+    std::vector<Fragment> fragments;
+    size_t literalSize;     ///< Total length of the literal text
+
+private:
+    void addFragment(size_t literalEnd, ExpanderCallable fn)
+    {
+        fragments.push_back({ nextLiteral, literalEnd, std::move(fn) });
+        literalSize += literalEnd - nextLiteral;
+    }
 
+    size_t nextLiteral;
 };
 
 
@@ -226,6 +258,7 @@ TypedCreativeConfiguration<CreativeData>::handleCreativeCompatibility(
                 // assume string
                 auto const& snippet = value.asString();
                 auto expander = generateExpander(extractVariables(snippet));
+                expander.finalize(snippet.size());
                 boost::unique_lock<boost::shared_mutex> lock(mutex_);
                 expanders_[snippet] = expander;
             }
@@ -365,7 +398,6 @@ TypedCreativeConfiguration<CreativeData>::generateExpander(
         }
     }
 
-    expander.finalize();
     return expander;
 }
 
@@ -399,8 +431,10 @@ TypedCreativeConfiguration<CreativeData>::expand(const std::string& templateStri
                                             const Context& context) const
 {
     boost::shared_lock<boost::shared_mutex> lock(mutex_);
-    auto const& expander = expanders_[templateString];
-    return expander.expand(templateString, context);
+    auto it = expanders_.find(templateString);
+    if (it == expanders_.end())
+        return templateString;
+    return it->second.expand(templateString, context);
 }
 
 
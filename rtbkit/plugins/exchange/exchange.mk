@@ -3,6 +3,10 @@
 LIBRTB_EXCHANGE_SOURCES := \
 	http_exchange_connector.cc \
 	http_auction_handler.cc \
+	raw_bid_request_filter.cc \
+	request_capture.cc \
+	exchange_latencies.cc \
+	recent_auctions.cc \
 	creative_configuration.cc
 
 LIBRTB_EXCHANGE_LINK := \
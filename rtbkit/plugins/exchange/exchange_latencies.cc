@@ -0,0 +1,108 @@
+/* exchange_latencies.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Histograms of how long an exchange connector takes to answer requests.
+*/
+
+#include "exchange_latencies.h"
+
+using namespace std;
+
+namespace RTBKIT {
+
+namespace {
+
+uint64_t toMicros(double ms)
+{
+    return ms > 0 ? ms * 1000.0 : 0;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* EXCHANGE LATENCIES                                                        */
+/*****************************************************************************/
+
+void
+ExchangeLatencies::Host::
+record(double totalMs, double slackMs,
+       double parseMs, double routeMs, double respondMs)
+{
+    total.record(toMicros(totalMs));
+    slack.record(toMicros(slackMs));
+    parse.record(toMicros(parseMs));
+    route.record(toMicros(routeMs));
+    respond.record(toMicros(respondMs));
+
+    if (slackMs < 0)
+        late.fetch_add(1, std::memory_order_relaxed);
+}
+
+Json::Value
+ExchangeLatencies::Host::
+toJson() const
+{
+    Json::Value result;
+    result["total"] = total.snapshot().toJson();
+    result["slack"] = slack.snapshot().toJson();
+    result["parse"] = parse.snapshot().toJson();
+    result["route"] = route.snapshot().toJson();
+    result["respond"] = respond.snapshot().toJson();
+    result["late"] = late.load();
+    return result;
+}
+
+ExchangeLatencies::
+ExchangeLatencies()
+    : numSlots(0)
+{
+}
+
+ExchangeLatencies::Host &
+ExchangeLatencies::
+forHost(const std::string & host)
+{
+    unsigned n = numSlots.load(std::memory_order_acquire);
+    for (unsigned i = 0;  i < n;  ++i)
+        if (slots[i].name == host)
+            return *slots[i].host;
+    if (n > MaxHosts)
+        return *slots[MaxHosts].host;
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    // Another thread may have added it in the meantime
+    n = numSlots.load(std::memory_order_relaxed);
+    for (unsigned i = 0;  i < n;  ++i)
+        if (slots[i].name == host)
+            return *slots[i].host;
+
+    if (n == MaxHosts) {
+        slots[n].name = "other";
+        slots[n].host.reset(new Host());
+        numSlots.store(n + 1, std::memory_order_release);
+    }
+    if (n >= MaxHosts)
+        return *slots[MaxHosts].host;
+
+    slots[n].name = host;
+    slots[n].host.reset(new Host());
+    numSlots.store(n + 1, std::memory_order_release);
+    return *slots[n].host;
+}
+
+Json::Value
+ExchangeLatencies::
+toJson() const
+{
+    Json::Value result(Json::objectValue);
+
+    unsigned n = numSlots.load(std::memory_order_acquire);
+    for (unsigned i = 0;  i < n;  ++i)
+        result[slots[i].name] = slots[i].host->toJson();
+
+    return result;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,78 @@
+/* exchange_latencies.h                                            -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Histograms of how long an exchange connector takes to answer requests.
+*/
+
+#pragma once
+
+#include "rtbkit/common/latency_histogram.h"
+#include "soa/jsoncpp/value.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* EXCHANGE LATENCIES                                                        */
+/*****************************************************************************/
+
+/** Latency histograms of the auctions answered by an exchange connector,
+    kept separately for each host that sends requests.  Exchanges throttle
+    bidders that answer too close to the deadline, and these show which
+    ones we are close to the limit with and where the time goes.
+
+    Looking the histograms of a host up doesn't take a lock once they
+    exist: hosts are only ever added, in slots that are published with a
+    release store of their count.  Past MaxHosts, every new host shares the
+    histograms named "other".
+*/
+struct ExchangeLatencies {
+
+    enum { MaxHosts = 16 };
+
+    struct Host {
+        Host() : late(0) {}
+
+        LatencyHistogram total;     ///< First byte to the response sent
+        LatencyHistogram slack;     ///< Time left once the response is sent
+        LatencyHistogram parse;     ///< Reading and parsing the request
+        LatencyHistogram route;     ///< Filtering, augmenting and bidding
+        LatencyHistogram respond;   ///< Building and sending the response
+
+        /// Responses sent after the deadline, which count as no slack
+        std::atomic<uint64_t> late;
+
+        /** Record a request answered at the given time; all in ms. */
+        void record(double totalMs, double slackMs,
+                    double parseMs, double routeMs, double respondMs);
+
+        Json::Value toJson() const;
+    };
+
+    ExchangeLatencies();
+
+    ExchangeLatencies(const ExchangeLatencies &) = delete;
+    ExchangeLatencies & operator = (const ExchangeLatencies &) = delete;
+
+    /** Histograms of the given host, created on first use. */
+    Host & forHost(const std::string & host);
+
+    /** Count and percentiles of each histogram, by host, since the start. */
+    Json::Value toJson() const;
+
+private:
+    struct Slot {
+        std::string name;
+        std::unique_ptr<Host> host;
+    };
+
+    Slot slots[MaxHosts + 1];       ///< The last one is "other"
+    std::atomic<unsigned> numSlots;
+    std::mutex lock;                ///< Held to add a slot
+};
+
+} // namespace RTBKIT
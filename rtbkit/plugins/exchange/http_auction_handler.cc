@@ -153,6 +153,25 @@ HttpAuctionHandler::
         throw Exception("deleted auction handler with timer");
 }
 
+void
+HttpAuctionHandler::
+reset()
+{
+    if (hasTimer)
+        throw Exception("recycled auction handler with timer");
+
+    if (servingRequest) {
+        ML::atomic_add(endpoint->numServingRequest, -1);
+        servingRequest = false;
+    }
+
+    HttpConnectionHandler::reset();
+
+    auction.reset();
+    logger.reset();
+    disconnected = false;
+}
+
 void
 HttpAuctionHandler::
 onGotTransport()
@@ -297,6 +316,8 @@ handleHttpPayload(const HttpHeader & header,
         logger->recordRequest(header, payload);
     }
 
+    endpoint->requestCapture.capture(header, payload);
+
     ML::atomic_add(endpoint->numRequests, 1);
 
     doEvent("auctionReceived");
@@ -386,8 +407,20 @@ handleHttpPayload(const HttpHeader & header,
     Date expiry = firstData.plusSeconds
         (max(5.0, (timeAvailableMs - networkTimeMs)) / 1000.0);
 
+    std::shared_ptr<AuctionUsage> usage;
+    if (endpoint->sampleUsage())
+        usage = std::make_shared<AuctionUsage>();
+    AuctionUsage::Meter parseMeter(usage.get(), AuctionUsage::PARSE);
+
     try {
 
+        const char * rejection = endpoint->rejectBeforeParsing(header, payload);
+        if (rejection) {
+            doEvent(ML::format("auctionEarlyDrop.%s", rejection).c_str());
+            dropAuction(rejection);
+            return;
+        }
+
         auto preStatus = endpoint->preBidRequest(header, payload);
         if (preStatus == PipelineStatus::Stop) {
             dropAuction("pre bid request pipeline");
@@ -403,6 +436,26 @@ handleHttpPayload(const HttpHeader & header,
             return;
         }
 
+        std::shared_ptr<const HttpResponse> previous;
+        auto seen = endpoint->recentAuctions.start(bidRequest->auctionId,
+                                                   now, &previous);
+        if (seen == RecentAuctions::IN_FLIGHT) {
+            doEvent("auctionEarlyDrop.duplicateInFlight");
+            dropAuction("duplicate of an auction in flight");
+            return;
+        }
+        if (seen == RecentAuctions::FINISHED) {
+            if (previous) {
+                doEvent("auctionDuplicateReplayed");
+                replayResponse(*previous);
+            }
+            else {
+                doEvent("auctionEarlyDrop.duplicateFinished");
+                dropAuction("duplicate of a finished auction");
+            }
+            return;
+        }
+
         auction.reset(new Auction(endpoint,
                                   handleAuction, bidRequest,
                                   bidRequest->toJsonStr(),
@@ -410,6 +463,8 @@ handleHttpPayload(const HttpHeader & header,
                                   firstData, expiry));
 
         auction->requestOriginal = payload;
+        auction->budget.reset(firstData, expiry, networkTimeMs);
+        auction->usage = usage;
         endpoint->adjustAuction(auction);
 
         auto postStatus = endpoint->postBidRequest(auction);
@@ -480,6 +535,8 @@ handleHttpPayload(const HttpHeader & header,
                 expiry.print(4).c_str());
 
     auction->doneParsing = Date::now();
+    auction->budget.endStage(LatencyBudget::PARSE, auction->doneParsing);
+    parseMeter.stop();
 
     ML::atomic_add(endpoint->numAuctions, 1);
     endpoint->onNewAuction(auction);
@@ -525,15 +582,38 @@ sendResponse()
     //     << disconnected << endl;
 
     if (disconnected) {
+        endpoint->recentAuctions.finish(auction->id);
         closeWhenHandlerFinished();
         return;
     }
     
+    LatencyBudget & budget = auction->budget;
+    budget.endStage(LatencyBudget::BID, before);
+
     HttpResponse response = getResponse();
+
+    budget.endStage(LatencyBudget::RESPONSE);
+    for (int i = 0;  i < LatencyBudget::NUM_STAGES;  ++i) {
+        auto stage = LatencyBudget::Stage(i);
+        doEvent(ML::format("auctionBudget.%sMs",
+                           LatencyBudget::stageName(stage)).c_str(),
+                ET_OUTCOME, budget.chargedMs(stage), "ms");
+    }
+    doEvent("auctionBudget.remainingMs", ET_OUTCOME,
+            budget.remainingMs(), "ms");
     
     Date startTime = auction->start;
     Date beforeSend = Date::now();
 
+    double parseMs = budget.chargedMs(LatencyBudget::PARSE);
+    double routeMs = budget.chargedMs(LatencyBudget::FILTER)
+        + budget.chargedMs(LatencyBudget::AUGMENT)
+        + budget.chargedMs(LatencyBudget::BID);
+    double responseMs = budget.chargedMs(LatencyBudget::RESPONSE);
+    Date deadline = budget.deadline();
+    ExchangeLatencies::Host * latencies
+        = &endpoint->latencies.forHost(transport().getPeerName());
+
     auto onSendFinished = [=] ()
         {
             //static int n = 0;
@@ -547,6 +627,12 @@ sendResponse()
                      << (auction ? auction->id.toString() : "NO AUCTION")
                      << endl;
 
+            Date sent = Date::now();
+            latencies->record(sent.secondsSince(this->firstData) * 1000.0,
+                              sent.secondsUntil(deadline) * 1000.0,
+                              parseMs, routeMs,
+                              responseMs + sendTime * 1000.0);
+
             this->doEvent("auctionResponseSent");
             this->doEvent("auctionTotalTimeMs",
                           ET_OUTCOME,
@@ -570,6 +656,11 @@ sendResponse()
     response.extraHeaders
         .push_back({"X-Processing-Time-Ms", to_string(timeTaken)});
 
+    if (endpoint->recentAuctions.replaying())
+        endpoint->recentAuctions.finish
+            (auction->id, std::make_shared<const HttpResponse>(response));
+    else endpoint->recentAuctions.finish(auction->id);
+
     putResponseOnWire(response, onSendFinished);
 }
 
@@ -592,6 +683,19 @@ dropAuction(const std::string & reason)
                       onSendFinished);
 }
 
+void
+HttpAuctionHandler::
+replayResponse(const HttpResponse & response)
+{
+    auto onSendFinished = [=] ()
+        {
+            this->transport().associateWhenHandlerFinished
+                (this->makeNewHandlerShared(), "sendFinished");
+        };
+
+    putResponseOnWire(response, onSendFinished);
+}
+
 void
 HttpAuctionHandler::
 sendErrorResponse(const std::string & error,
@@ -63,6 +63,9 @@ struct HttpAuctionHandler
     /** We got our transport. */
     void onGotTransport();
 
+    /** Clear the per-connection state so the handler can be recycled. */
+    virtual void reset();
+
     HttpExchangeConnector * endpoint;
 
     std::shared_ptr<Auction> auction;
@@ -89,6 +92,10 @@ struct HttpAuctionHandler
         do anything useful. */
     virtual void dropAuction(const std::string & reason = "");
 
+    /** Send again the response given to an earlier request for the same
+        auction, when the exchange retries it. */
+    virtual void replayResponse(const HttpResponse & response);
+
     virtual void handleTimeout(Date date, size_t cookie);
 
     virtual void onDisassociate();
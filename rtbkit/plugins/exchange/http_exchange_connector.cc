@@ -55,6 +55,7 @@ postConstructorInit()
 {
     numThreads = 2;
     realTimePriority = -1;
+    numAcceptors = 1;
     bindHost = "*";
     performNameLookup = true;
     backlog = DEF_BACKLOG;
@@ -64,6 +65,8 @@ postConstructorInit()
     absoluteTimeMax = 50.0;
     disableAcceptProbability = false;
     disableExceptionPrinting = false;
+    handlerPoolSize = 256;
+    timerResolution = 0.001;
 
     numServingRequest = 0;
 
@@ -99,6 +102,9 @@ configure(const Json::Value & parameters)
 
     getParam(parameters, numThreads, "numThreads");
     getParam(parameters, realTimePriority, "realTimePriority");
+    getParam(parameters, numAcceptors, "numAcceptors");
+    getParam(parameters, acceptorCpus, "acceptorCpus");
+    getParam(parameters, eventThreadCpus, "eventThreadCpus");
     getParam(parameters, listenPort, "listenPort");
     getParam(parameters, bindHost, "bindHost");
     getParam(parameters, performNameLookup, "performNameLookup");
@@ -110,6 +116,17 @@ configure(const Json::Value & parameters)
     getParam(parameters, absoluteTimeMax, "absoluteTimeMax");
     getParam(parameters, disableAcceptProbability, "disableAcceptProbability");
     getParam(parameters, disableExceptionPrinting, "disableExceptionPrinting");
+    getParam(parameters, handlerPoolSize, "handlerPoolSize");
+    getParam(parameters, timerResolution, "timerResolution");
+
+    if (parameters.isMember("rawRequestFilter"))
+        rawRequestFilter.configure(parameters["rawRequestFilter"]);
+
+    if (parameters.isMember("requestCapture"))
+        requestCapture.configure(parameters["requestCapture"]);
+
+    if (parameters.isMember("recentAuctions"))
+        recentAuctions.configure(parameters["recentAuctions"]);
 
     if (parameters.isMember("realTimePolling"))
         realTimePolling(parameters["realTimePolling"].asBool());
@@ -161,11 +178,17 @@ void
 HttpExchangeConnector::
 start()
 {
+    // Auction timeouts are armed and cancelled for every request, so they
+    // share a timer wheel rather than each setting a timerfd
+    if (timerResolution > 0)
+        PassiveEndpoint::useTimerWheel(timerResolution);
+    PassiveEndpoint::setReusePortAcceptors(numAcceptors, acceptorCpus);
     PassiveEndpoint::init(listenPort, bindHost, numThreads, true,
                           performNameLookup, backlog);
     if (realTimePriority > -1) {
         PassiveEndpoint::makeRealTime(realTimePriority);
     }
+    PassiveEndpoint::pinThreads(eventThreadCpus);
 }
 
 void
@@ -173,20 +196,21 @@ HttpExchangeConnector::
 shutdown()
 {
     HttpEndpoint::shutdown();
+    requestCapture.shutdown();
     ExchangeConnector::shutdown();
 }
 
 void
 HttpExchangeConnector::
 startRequestLogging(std::string const & filename, int count) {
-    Guard guard(handlersLock);
+    Guard guard(loggerLock);
     logger = std::make_shared<HttpAuctionLogger>(filename, count);
 }
 
 void
 HttpExchangeConnector::
 stopRequestLogging() {
-    Guard guard(handlersLock);
+    Guard guard(loggerLock);
     if(logger) {
         logger->close();
     }
@@ -194,6 +218,20 @@ stopRequestLogging() {
     logger.reset();
 }
 
+void
+HttpExchangeConnector::
+configureRequestCapture(const Json::Value & config)
+{
+    requestCapture.configure(config);
+}
+
+Json::Value
+HttpExchangeConnector::
+getRequestCaptureStatus() const
+{
+    return requestCapture.getStatus();
+}
+
 std::shared_ptr<ConnectionHandler>
 HttpExchangeConnector::
 makeNewHandler()
@@ -205,22 +243,37 @@ std::shared_ptr<HttpAuctionHandler>
 HttpExchangeConnector::
 makeNewHandlerShared()
 {
-    if (!handlerFactory)
-        throw ML::Exception("need to initialize handler factory");
+    HttpAuctionHandler * handler = 0;
 
-    HttpAuctionHandler * handler = handlerFactory();
-    if (!handler)
-        throw ML::Exception("failed to create handler");
+    auto & pool = handlerPools.get()->handlers;
+    if (!pool.empty()) {
+        handler = pool.back();
+        pool.pop_back();
+    }
+    else {
+        if (!handlerFactory)
+            throw ML::Exception("need to initialize handler factory");
 
-    std::shared_ptr<HttpAuctionHandler> handlerSp(handler);
+        handler = handlerFactory();
+        if (!handler)
+            throw ML::Exception("failed to create handler");
+    }
+
+    std::shared_ptr<HttpAuctionHandler> handlerSp
+        (handler,
+         [=] (HttpAuctionHandler * handler) { this->recycleHandler(handler); });
 
     {
-        Guard guard(handlersLock);
+        Guard guard(loggerLock);
         if (logger) {
             handler->logger = logger;
         }
+    }
 
-        handlers.insert(handlerSp);
+    {
+        HandlerShard & shard = handlerShard(handler);
+        Guard guard(shard.lock);
+        shard.handlers.insert(handlerSp);
     }
 
     return handlerSp;
@@ -230,8 +283,37 @@ void
 HttpExchangeConnector::
 finishedWithHandler(std::shared_ptr<HttpAuctionHandler> handler)
 {
-    Guard guard(handlersLock);
-    handlers.erase(handler);
+    HandlerShard & shard = handlerShard(handler.get());
+    Guard guard(shard.lock);
+    shard.handlers.erase(handler);
+}
+
+void
+HttpExchangeConnector::
+recycleHandler(HttpAuctionHandler * handler)
+{
+    auto & pool = handlerPools.get()->handlers;
+    if ((int)pool.size() >= handlerPoolSize) {
+        delete handler;
+        return;
+    }
+
+    try {
+        handler->reset();
+    } catch (const std::exception & exc) {
+        cerr << "couldn't recycle auction handler: " << exc.what() << endl;
+        delete handler;
+        return;
+    }
+
+    pool.push_back(handler);
+}
+
+HttpExchangeConnector::HandlerPool::
+~HandlerPool()
+{
+    for (auto handler: handlers)
+        delete handler;
 }
 
 Json::Value
@@ -251,6 +333,9 @@ getServiceStatus() const
     BOOST_FOREACH(auto cnt, peerCounts)
         result["hostConnections"][cnt.first] = cnt.second;
 
+    result["latencies"] = latencies.toJson();
+    result["recentAuctions"] = (unsigned)recentAuctions.size();
+
     return result;
 }
 
@@ -357,6 +442,17 @@ periodicCallback(uint64_t numWakeups) const
     recordLevel(numConnections(), "httpConnections");
 }
 
+const char *
+HttpExchangeConnector::
+rejectBeforeParsing(const HttpHeader& header,
+                    const std::string& payload) const
+{
+    if (getNumBiddableAgents() == 0)
+        return "noBiddableAgents";
+
+    return rawRequestFilter.check(payload);
+}
+
 PipelineStatus
 HttpExchangeConnector::
 preBidRequest(const HttpHeader& header, const std::string& payload) {
@@ -10,12 +10,17 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include "jml/arch/atomic_ops.h"
+#include "jml/arch/thread_specific.h"
 #include "soa/service/json_endpoint.h"
 #include "soa/service/stats_events.h"
 #include "rtbkit/common/auction.h"
 #include <limits>
 #include "rtbkit/common/exchange_connector.h"
 #include "rtbkit/common/bid_request_pipeline.h"
+#include "rtbkit/plugins/exchange/raw_bid_request_filter.h"
+#include "rtbkit/plugins/exchange/request_capture.h"
+#include "rtbkit/plugins/exchange/exchange_latencies.h"
+#include "rtbkit/plugins/exchange/recent_auctions.h"
 #include <boost/algorithm/string.hpp>
 
 
@@ -51,6 +56,10 @@ struct HttpExchangeConnector
     /** Stop logging */
     void stopRequestLogging();
 
+    /** Sampled capture of the requests; see RequestCapture. */
+    virtual void configureRequestCapture(const Json::Value & config);
+    virtual Json::Value getRequestCaptureStatus() const;
+
     /*************************************************************************/
     /* METHODS CALLED BY THE ROUTER TO CONTROL THE EXCHANGE CONNECTOR        */
     /*************************************************************************/
@@ -266,6 +275,15 @@ struct HttpExchangeConnector
     /** Method invoked every second for accounting */
     virtual void periodicCallback(uint64_t numWakeups) const;
 
+    /** Cheap checks done on the raw request before anything else, to
+        drop traffic that no agent can bid on without parsing it.  Returns
+        null if the request should be processed, or else the reason why it
+        should be dropped.
+    */
+    const char *
+    rejectBeforeParsing(const HttpHeader& header,
+                        const std::string& payload) const;
+
     /** Invokes the pre bid-request pipeline operation */
     PipelineStatus
     preBidRequest(const HttpHeader& header, const std::string& payload);
@@ -302,6 +320,9 @@ protected:
     /// Configuration parameters
     int numThreads;
     int realTimePriority;
+    int numAcceptors;               ///< SO_REUSEPORT accept sockets
+    std::vector<int> acceptorCpus;  ///< Cpus to pin accept threads to
+    std::vector<int> eventThreadCpus; ///< Cpus to pin event threads to
     PortRange listenPort;
     std::string bindHost;
     bool performNameLookup;
@@ -311,6 +332,20 @@ protected:
     double absoluteTimeMax;
     bool disableAcceptProbability;
     bool disableExceptionPrinting;
+    int handlerPoolSize;    ///< Max recycled handlers kept per thread
+    double timerResolution; ///< Seconds per auction timeout tick; 0 for none
+
+    /// Checks on the raw payload done before the bid request is parsed
+    RawBidRequestFilter rawRequestFilter;
+
+    /// Always-on sampled capture of the incoming requests
+    RequestCapture requestCapture;
+
+    /// Time taken to answer the requests of each host
+    ExchangeLatencies latencies;
+
+    /// Auction ids seen lately, to answer retried requests straight away
+    RecentAuctions recentAuctions;
 
     /// The ping time to known hosts in milliseconds
     std::unordered_map<std::string, float> pingTimesByHostMs;
@@ -324,8 +359,40 @@ private:
     std::shared_ptr<HttpAuctionLogger> logger;
     std::shared_ptr<BidRequestPipeline> pipeline;
 
-    Lock handlersLock;
-    std::set<std::shared_ptr<HttpAuctionHandler> > handlers;
+    Lock loggerLock;
+
+    /** Live handlers, sharded by handler address so that the event threads
+        don't all contend on a single lock when connections come and go.
+    */
+    enum { NumHandlerShards = 16 };
+    struct HandlerShard {
+        Lock lock;
+        std::set<std::shared_ptr<HttpAuctionHandler> > handlers;
+    };
+    HandlerShard handlerShards[NumHandlerShards];
+
+    HandlerShard & handlerShard(const HttpAuctionHandler * handler)
+    {
+        size_t h = reinterpret_cast<size_t>(handler);
+        return handlerShards[(h >> 6) % NumHandlerShards];
+    }
+
+    /** Handlers that have been released and reset, ready to be reused for
+        a new connection.  Kept per thread so that recycling a handler
+        takes no lock.
+    */
+    struct HandlerPool {
+        ~HandlerPool();
+        std::vector<HttpAuctionHandler *> handlers;
+    };
+    ML::ThreadSpecificInstanceInfo<HandlerPool, HttpExchangeConnector>
+        handlerPools;
+
+    /** Called when the last reference to a handler goes away.  Resets it
+        and puts it back into this thread's pool, or deletes it if the pool
+        is full.
+    */
+    void recycleHandler(HttpAuctionHandler * handler);
     void finishedWithHandler(std::shared_ptr<HttpAuctionHandler> handler);
 
     /** Common code from all constructors. */
@@ -13,6 +13,7 @@
 #include "rtbkit/openrtb/openrtb_parsing.h"
 #include "soa/types/json_printing.h"
 #include <boost/any.hpp>
+#include <typeinfo>
 #include <boost/lexical_cast.hpp>
 #include "jml/utils/file_functions.h"
 #include "jml/arch/info.h"
@@ -209,6 +210,9 @@ getResponse(const HttpAuctionHandler & connection,
         return getErrorResponse(connection,
                                 current->error + ": " + current->details);
 
+    if (streamsResponse())
+        return streamResponse(connection, auction);
+
     OpenRTB::BidResponse response;
     response.id = auction.id;
 
@@ -233,6 +237,60 @@ getResponse(const HttpAuctionHandler & connection,
     return HttpResponse(200, "application/json", stream.str());
 }
 
+HttpResponse
+OpenRTBExchangeConnector::
+streamResponse(const HttpAuctionHandler & connection,
+               const Auction & auction) const
+{
+    const Auction::Data * current = auction.getCurrentData();
+
+    int numBids = 0;
+    for (unsigned spotNum = 0; spotNum < current->responses.size(); ++spotNum)
+        if (current->hasValidResponse(spotNum))
+            ++numBids;
+
+    if (numBids == 0)
+        return HttpResponse(204, "none", "");
+
+    std::ostringstream stream;
+    StreamJsonPrintingContext context(stream);
+
+    context.startObject();
+    context.startMember("id");
+    context.writeStringUtf8(Utf8String(auction.id.toString()));
+
+    context.startMember("seatbid");
+    context.startArray(1);
+    context.newArrayElement();
+    context.startObject();
+    context.startMember("bid");
+    context.startArray(numBids);
+
+    for (unsigned spotNum = 0; spotNum < current->responses.size(); ++spotNum) {
+        if (!current->hasValidResponse(spotNum))
+            continue;
+
+        context.newArrayElement();
+        context.startObject();
+        writeBid(auction, spotNum, context);
+        context.endObject();
+    }
+
+    context.endArray();
+    context.endObject();
+    context.endArray();
+
+    Json::Value ext = getResponseExt(connection, auction);
+    if (!ext.isNull()) {
+        context.startMember("ext");
+        context.writeJson(ext);
+    }
+
+    context.endObject();
+
+    return HttpResponse(200, "application/json", stream.str());
+}
+
 Json::Value
 OpenRTBExchangeConnector::
 getResponseExt(const HttpAuctionHandler & connection,
@@ -298,6 +356,39 @@ setSeatBid(Auction const & auction,
     b.price.val = getAmountIn<CPM>(resp.price.maxPrice);
 }
 
+bool
+OpenRTBExchangeConnector::
+streamsResponse() const
+{
+    return typeid(*this) == typeid(OpenRTBExchangeConnector);
+}
+
+void
+OpenRTBExchangeConnector::
+writeBid(Auction const & auction,
+         int spotNum,
+         JsonPrintingContext & context) const
+{
+    const Auction::Data * data = auction.getCurrentData();
+    auto & resp = data->winningResponse(spotNum);
+
+    // Same members, in the same order, as setSeatBid() fills in
+    context.startMember("id");
+    context.writeStringUtf8
+        (Utf8String(Id(auction.id, auction.request->imp[0].id).toString()));
+    context.startMember("impid");
+    context.writeStringUtf8
+        (Utf8String(auction.request->imp[spotNum].id.toString()));
+    context.startMember("price");
+    context.writeDouble(getAmountIn<CPM>(resp.price.maxPrice));
+    context.startMember("cid");
+    context.writeStringUtf8
+        (Utf8String(Id(resp.agentConfig->externalId).toString()));
+    context.startMember("crid");
+    context.writeStringUtf8
+        (Utf8String(Id(std::to_string(resp.creativeId)).toString()));
+}
+
 } // namespace RTBKIT
 
 namespace {
@@ -68,6 +68,28 @@ protected:
     virtual void setSeatBid(Auction const & auction,
                             int spotNum,
                             OpenRTB::BidResponse & response) const;
+
+    /** Whether getResponse() writes the bids straight into the response
+        body with writeBid(), instead of building an OpenRTB::BidResponse
+        with setSeatBid() and printing it.  Only the generic connector
+        does so by default, since subclasses customize setSeatBid();
+        a subclass that overrides writeBid() should return true.
+    */
+    virtual bool streamsResponse() const;
+
+    /** Write the members of the bid object for the given spot.  This is
+        the extension point for exchange specific members such as adm or
+        ext when streaming the response.
+    */
+    virtual void writeBid(Auction const & auction,
+                          int spotNum,
+                          JsonPrintingContext & context) const;
+
+private:
+    /** Write the whole response for the auction without building any
+        intermediate structure. */
+    HttpResponse streamResponse(const HttpAuctionHandler & connection,
+                                const Auction & auction) const;
 };
 
 } // namespace RTBKIT
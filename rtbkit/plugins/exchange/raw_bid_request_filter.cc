@@ -0,0 +1,90 @@
+/* raw_bid_request_filter.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Implementation of the raw bid request filter.
+*/
+
+#include "raw_bid_request_filter.h"
+#include "jml/arch/exception.h"
+#include <string.h>
+
+namespace RTBKIT {
+
+namespace {
+
+std::vector<std::string>
+quotedKeys(const Json::Value & keys, const char * name)
+{
+    std::vector<std::string> result;
+    if (keys.isNull())
+        return result;
+
+    if (!keys.isArray())
+        throw ML::Exception("rawRequestFilter: %s must be an array", name);
+
+    for (auto & key: keys)
+        result.push_back("\"" + key.asString() + "\"");
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* RAW BID REQUEST FILTER                                                    */
+/*****************************************************************************/
+
+void
+RawBidRequestFilter::
+configure(const Json::Value & config)
+{
+    requireAnyKey = quotedKeys(config["requireAnyKey"], "requireAnyKey");
+    rejectAnyKey = quotedKeys(config["rejectAnyKey"], "rejectAnyKey");
+}
+
+const char *
+RawBidRequestFilter::
+check(const std::string & payload) const
+{
+    for (auto & key: rejectAnyKey)
+        if (hasKey(payload, key))
+            return "rejectedKey";
+
+    if (requireAnyKey.empty())
+        return nullptr;
+
+    for (auto & key: requireAnyKey)
+        if (hasKey(payload, key))
+            return nullptr;
+
+    return "missingRequiredKey";
+}
+
+bool
+RawBidRequestFilter::
+hasKey(const std::string & payload, const std::string & quotedKey)
+{
+    const char * current = payload.data();
+    const char * end = current + payload.size();
+
+    while (current < end) {
+        const char * found
+            = (const char *)memmem(current, end - current,
+                                   quotedKey.data(), quotedKey.size());
+        if (!found)
+            return false;
+
+        const char * p = found + quotedKey.size();
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            ++p;
+        if (p < end && *p == ':')
+            return true;
+
+        current = found + 1;
+    }
+
+    return false;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,60 @@
+/* raw_bid_request_filter.h                                        -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Cheap checks on the raw bytes of a bid request, done before parsing it.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "soa/jsoncpp/value.h"
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* RAW BID REQUEST FILTER                                                    */
+/*****************************************************************************/
+
+/** Rejects bid requests that no agent can bid on by looking for JSON keys
+    in the raw payload, before any object is built from it.  For example,
+    a connector whose agents only buy site inventory can reject every
+    request containing an "app" object.
+
+    The checks look for the quoted key followed by a colon.  They don't
+    know about nesting, so they should only be used with keys that can't
+    appear anywhere else in the request.
+
+    Configured with a JSON object:
+
+        { "requireAnyKey": [ "site" ], "rejectAnyKey": [ "app" ] }
+*/
+struct RawBidRequestFilter {
+
+    void configure(const Json::Value & config);
+
+    /** Returns null if the request should be parsed, or else the reason
+        why it should be dropped.
+    */
+    const char * check(const std::string & payload) const;
+
+    bool empty() const
+    {
+        return requireAnyKey.empty() && rejectAnyKey.empty();
+    }
+
+    /** Does the payload contain the given key (already surrounded with
+        quotes) followed by a colon?  Uses memmem, which is vectorized in
+        glibc, to skip over the bulk of the payload.
+    */
+    static bool hasKey(const std::string & payload,
+                       const std::string & quotedKey);
+
+    /// Drop the request unless one of these keys is present
+    std::vector<std::string> requireAnyKey;
+
+    /// Drop the request if any of these keys is present
+    std::vector<std::string> rejectAnyKey;
+};
+
+} // namespace RTBKIT
@@ -0,0 +1,133 @@
+/* recent_auctions.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Auction ids recently seen by an exchange connector.
+*/
+
+#include "recent_auctions.h"
+#include "jml/arch/exception.h"
+
+#include <mutex>
+
+using namespace std;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* RECENT AUCTIONS                                                           */
+/*****************************************************************************/
+
+RecentAuctions::
+RecentAuctions()
+    : ttl(0), maxSize(100000), replayResponses(false)
+{
+}
+
+void
+RecentAuctions::
+configure(const Json::Value & config)
+{
+    if (config.isMember("ttl")) {
+        double seconds = config["ttl"].asDouble();
+        if (seconds < 0)
+            throw ML::Exception("recent auctions ttl can't be negative");
+        ttl = seconds;
+    }
+    if (config.isMember("maxSize")) {
+        size_t size = config["maxSize"].asUInt();
+        if (size < NumShards)
+            throw ML::Exception("recent auctions maxSize must be at least %d",
+                                (int)NumShards);
+        maxSize = size;
+    }
+    if (config.isMember("replayResponses"))
+        replayResponses = config["replayResponses"].asBool();
+}
+
+RecentAuctions::Shard &
+RecentAuctions::
+shardFor(const Id & id)
+{
+    return shards[Datacratic::IdHash()(id) % NumShards];
+}
+
+void
+RecentAuctions::
+expire(Shard & shard, Date now, size_t maxEntries)
+{
+    while (!shard.order.empty()) {
+        const auto & oldest = shard.order.front();
+        if (oldest.first > now && shard.entries.size() < maxEntries)
+            break;
+
+        // An id that expired and came back has a later entry in the queue
+        auto it = shard.entries.find(oldest.second);
+        if (it != shard.entries.end() && it->second.expiry == oldest.first)
+            shard.entries.erase(it);
+        shard.order.pop_front();
+    }
+}
+
+RecentAuctions::Status
+RecentAuctions::
+start(const Id & id, Date now, std::shared_ptr<const HttpResponse> * response)
+{
+    double seconds = ttl.load(std::memory_order_relaxed);
+    if (seconds <= 0)
+        return NEW;
+
+    size_t maxEntries = maxSize.load(std::memory_order_relaxed) / NumShards;
+
+    Shard & shard = shardFor(id);
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    expire(shard, now, maxEntries);
+
+    auto res = shard.entries.insert({ id, Entry() });
+    Entry & entry = res.first->second;
+    if (!res.second) {
+        if (!entry.finished)
+            return IN_FLIGHT;
+        if (response)
+            *response = entry.response;
+        return FINISHED;
+    }
+
+    entry.expiry = now.plusSeconds(seconds);
+    entry.finished = false;
+    shard.order.emplace_back(entry.expiry, id);
+    return NEW;
+}
+
+void
+RecentAuctions::
+finish(const Id & id, std::shared_ptr<const HttpResponse> response)
+{
+    if (!enabled())
+        return;
+
+    Shard & shard = shardFor(id);
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+    auto it = shard.entries.find(id);
+    if (it == shard.entries.end())
+        return;  // expired or evicted while in flight
+
+    it->second.finished = true;
+    if (replaying())
+        it->second.response = std::move(response);
+}
+
+size_t
+RecentAuctions::
+size() const
+{
+    size_t result = 0;
+    for (const Shard & shard: shards) {
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        result += shard.entries.size();
+    }
+    return result;
+}
+
+} // namespace RTBKIT
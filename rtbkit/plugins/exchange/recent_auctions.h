@@ -0,0 +1,127 @@
+/* recent_auctions.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Auction ids recently seen by an exchange connector.
+*/
+
+#pragma once
+
+#include "soa/types/id.h"
+#include "soa/types/date.h"
+#include "soa/jsoncpp/value.h"
+#include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+namespace Datacratic {
+struct HttpResponse;
+} // namespace Datacratic
+
+namespace RTBKIT {
+
+using Datacratic::Id;
+using Datacratic::Date;
+using Datacratic::HttpResponse;
+
+/*****************************************************************************/
+/* RECENT AUCTIONS                                                           */
+/*****************************************************************************/
+
+/** Ids of the auctions received in the last few seconds, so that a request
+    that an exchange retries or sends through several of our endpoints is
+    answered straight away instead of being parsed, filtered and routed a
+    second time only for the router to reject it as already in flight.
+
+    A duplicate of an auction that is still running gets a no-bid: only the
+    connection that carries the original may carry a bid, otherwise we could
+    win and pay for the same impression twice.  A duplicate of an auction
+    that was answered gets the same response again when replayResponses is
+    set, and a no-bid otherwise.
+
+    The ids are spread over shards that each have their own lock, and expire
+    from each shard in the order they were added.
+
+    Configuration:
+
+        {
+            "ttl": 5,                   // seconds; 0 turns the check off
+            "maxSize": 100000,          // ids kept at most
+            "replayResponses": false    // resend the response of a duplicate
+        }
+*/
+struct RecentAuctions {
+
+    enum { NumShards = 16 };
+
+    enum Status {
+        NEW,            ///< Not seen in the last ttl seconds
+        IN_FLIGHT,      ///< Seen and not answered yet
+        FINISHED        ///< Seen and answered
+    };
+
+    RecentAuctions();
+
+    RecentAuctions(const RecentAuctions &) = delete;
+    RecentAuctions & operator = (const RecentAuctions &) = delete;
+
+    void configure(const Json::Value & config);
+
+    bool enabled() const
+    {
+        return ttl.load(std::memory_order_relaxed) > 0;
+    }
+
+    /** Record that the auction with the given id starts now, unless it was
+        seen in the last ttl seconds.  For a duplicate of an auction that was
+        answered, the response is returned in response when responses are
+        replayed and left null otherwise.
+    */
+    Status start(const Id & id, Date now,
+                 std::shared_ptr<const HttpResponse> * response = nullptr);
+
+    /** Record that the auction was answered with the given response, or
+        without one if it is null.
+    */
+    void finish(const Id & id,
+                std::shared_ptr<const HttpResponse> response = nullptr);
+
+    /** Whether the responses of finished auctions are kept for replay. */
+    bool replaying() const
+    {
+        return replayResponses.load(std::memory_order_relaxed);
+    }
+
+    /** Number of ids currently kept. */
+    size_t size() const;
+
+private:
+    struct Entry {
+        Date expiry;
+        bool finished;
+        std::shared_ptr<const HttpResponse> response;
+    };
+
+    struct Shard {
+        mutable ML::Spinlock lock;
+        std::unordered_map<Id, Entry, Datacratic::IdHash> entries;
+        std::deque<std::pair<Date, Id> > order;   ///< By expiry
+    } JML_ALIGNED(64);
+
+    Shard & shardFor(const Id & id);
+
+    /** Remove the entries of the shard that expired, and the oldest ones
+        until the shard has room for one more.  Called with its lock held. */
+    void expire(Shard & shard, Date now, size_t maxEntries);
+
+    std::atomic<double> ttl;
+    std::atomic<size_t> maxSize;
+    std::atomic<bool> replayResponses;
+
+    Shard shards[NumShards];
+};
+
+} // namespace RTBKIT
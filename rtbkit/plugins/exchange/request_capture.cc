@@ -0,0 +1,322 @@
+/* request_capture.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Sampled capture of raw bid requests.
+*/
+
+#include "request_capture.h"
+#include "soa/types/date.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* RING                                                                      */
+/*****************************************************************************/
+
+RequestCapture::Ring::
+Ring(size_t size, uint64_t seed)
+    : entries(size), head(0), tail(0), dropped(0),
+      randomState(seed ? seed : 88172645463325252ULL)
+{
+}
+
+bool
+RequestCapture::Ring::
+tryPush(const HttpHeader & header, const std::string & payload)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= entries.size()) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Entry & entry = entries[h % entries.size()];
+    entry.header = header;
+    entry.payload.assign(payload);
+
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+bool
+RequestCapture::Ring::
+tryPop(Entry & entry)
+{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+        return false;
+
+    // Swap so that the memory of the entry goes back to the producer
+    Entry & slot = entries[t % entries.size()];
+    entry.header.swap(slot.header);
+    entry.payload.swap(slot.payload);
+
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t
+RequestCapture::Ring::
+nextRandom()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState >> 32;
+}
+
+
+/*****************************************************************************/
+/* REQUEST CAPTURE                                                           */
+/*****************************************************************************/
+
+RequestCapture::
+RequestCapture()
+    : sampleThreshold(0), sampled(0), written(0), filesWritten(0),
+      ringSize(1024), requestsPerFile(100000), secondsPerFile(3600),
+      writerShutdown(false)
+{
+}
+
+RequestCapture::
+~RequestCapture()
+{
+    shutdown();
+}
+
+void
+RequestCapture::
+configure(const Json::Value & config)
+{
+    double rate = -1;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (config.isMember("filePrefix"))
+            filePrefix = config["filePrefix"].asString();
+        if (config.isMember("ringSize"))
+            ringSize = config["ringSize"].asUInt();
+        if (config.isMember("requestsPerFile"))
+            requestsPerFile = config["requestsPerFile"].asUInt();
+        if (config.isMember("secondsPerFile"))
+            secondsPerFile = config["secondsPerFile"].asDouble();
+
+        if (config.isMember("filter")) {
+            RawBidRequestFilter newFilter;
+            newFilter.configure(config["filter"]);
+            std::lock_guard<ML::Spinlock> guard(filterLock);
+            filter = std::move(newFilter);
+        }
+
+        if (config.isMember("sampleRate")) {
+            rate = config["sampleRate"].asDouble();
+            if (rate < 0 || rate > 1)
+                throw ML::Exception("sampleRate must be between 0 and 1");
+            if (rate > 0 && filePrefix.empty())
+                throw ML::Exception("request capture needs a filePrefix");
+        }
+
+        if (ringSize == 0 || requestsPerFile == 0)
+            throw ML::Exception("ringSize and requestsPerFile can't be 0");
+    }
+
+    if (rate == 0) {
+        stopWriter();
+    }
+    else if (rate > 0) {
+        startWriter();
+        uint64_t threshold = rate * 4294967296.0;
+        sampleThreshold = std::max<uint64_t>(threshold, 1);
+    }
+}
+
+void
+RequestCapture::
+setPredicate(Predicate newPredicate)
+{
+    std::lock_guard<ML::Spinlock> guard(filterLock);
+    predicate = std::move(newPredicate);
+}
+
+void
+RequestCapture::
+shutdown()
+{
+    stopWriter();
+}
+
+RequestCapture::Ring &
+RequestCapture::
+threadRing()
+{
+    ThreadRing & threadRing = *threadRings.get();
+    if (!threadRing.ring) {
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t seed = std::hash<std::thread::id>()(std::this_thread::get_id());
+        threadRing.ring = std::make_shared<Ring>(ringSize, seed);
+        rings.push_back(threadRing.ring);
+    }
+    return *threadRing.ring;
+}
+
+void
+RequestCapture::
+captureSampled(const HttpHeader & header, const std::string & payload)
+{
+    Ring & ring = threadRing();
+    if (ring.nextRandom() >= sampleThreshold.load(std::memory_order_relaxed))
+        return;
+
+    {
+        std::lock_guard<ML::Spinlock> guard(filterLock);
+        if (!filter.empty() && filter.check(payload))
+            return;
+        if (predicate && !predicate(header, payload))
+            return;
+    }
+
+    if (ring.tryPush(header, payload))
+        sampled.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+RequestCapture::
+startWriter()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (writerThread) return;
+
+    writerShutdown = false;
+    writerThread.reset(new std::thread([=] () { this->runWriter(); }));
+}
+
+void
+RequestCapture::
+stopWriter()
+{
+    sampleThreshold = 0;
+
+    std::unique_ptr<std::thread> thread;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        thread = std::move(writerThread);
+    }
+
+    if (thread) {
+        writerShutdown = true;
+        thread->join();
+    }
+}
+
+void
+RequestCapture::
+runWriter()
+{
+    ML::filter_ostream stream;
+    bool fileOpen = false;
+    size_t requestsInFile = 0;
+    Date fileOpened;
+
+    auto closeFile = [&] ()
+        {
+            if (!fileOpen) return;
+            stream.close();
+            fileOpen = false;
+            filesWritten.fetch_add(1, std::memory_order_relaxed);
+            requestsInFile = 0;
+        };
+
+    Entry entry;
+    std::vector<std::shared_ptr<Ring> > toDrain;
+
+    for (;;) {
+        // Read the flag before draining so that the requests pushed before
+        // the shutdown are all written.
+        bool lastPass = writerShutdown;
+
+        std::string prefix;
+        size_t maxRequests;
+        double maxSeconds;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            toDrain = rings;
+            prefix = filePrefix;
+            maxRequests = requestsPerFile;
+            maxSeconds = secondsPerFile;
+        }
+
+        size_t numWritten = 0;
+        for (auto & ring : toDrain) {
+            while (ring->tryPop(entry)) {
+                if (fileOpen && (requestsInFile >= maxRequests
+                               || fileOpened.secondsUntil(Date::now()) > maxSeconds))
+                    closeFile();
+
+                if (!fileOpen) {
+                    // The sequence number keeps files rotated within the
+                    // same second apart.
+                    fileOpened = Date::now();
+                    std::string filename = ML::format("%s-%s-%llu.log.lz4",
+                            prefix.c_str(),
+                            fileOpened.print("%Y%m%d-%H%M%S").c_str(),
+                            (unsigned long long) filesWritten.load());
+                    stream.open(filename);
+                    fileOpen = true;
+                    std::lock_guard<std::mutex> guard(lock);
+                    currentFile = filename;
+                }
+
+                stream << entry.header << entry.payload << std::endl;
+                ++requestsInFile;
+                ++numWritten;
+            }
+        }
+
+        written.fetch_add(numWritten, std::memory_order_relaxed);
+
+        if (lastPass) break;
+        if (numWritten == 0) ML::sleep(0.01);
+    }
+
+    closeFile();
+}
+
+Json::Value
+RequestCapture::
+getStatus() const
+{
+    Json::Value result;
+
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto & ring : rings)
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+
+        result["filePrefix"] = filePrefix;
+        result["currentFile"] = currentFile;
+        result["ringSize"] = (Json::UInt64) ringSize;
+        result["requestsPerFile"] = (Json::UInt64) requestsPerFile;
+        result["secondsPerFile"] = secondsPerFile;
+        result["threads"] = (Json::UInt64) rings.size();
+    }
+
+    result["enabled"] = enabled();
+    result["sampleRate"] = sampleThreshold.load() / 4294967296.0;
+    result["sampled"] = (Json::UInt64) sampled.load();
+    result["dropped"] = (Json::UInt64) dropped;
+    result["written"] = (Json::UInt64) written.load();
+    result["filesWritten"] = (Json::UInt64) filesWritten.load();
+    return result;
+}
+
+} // namespace RTBKIT
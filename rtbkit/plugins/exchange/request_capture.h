@@ -0,0 +1,151 @@
+/* request_capture.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Sampled capture of raw bid requests, cheap enough to leave on.
+*/
+
+#pragma once
+
+#include "rtbkit/plugins/exchange/raw_bid_request_filter.h"
+#include "soa/service/http_header.h"
+#include "soa/jsoncpp/value.h"
+#include "jml/arch/thread_specific.h"
+#include "jml/arch/spinlock.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* REQUEST CAPTURE                                                           */
+/*****************************************************************************/
+
+/** Captures a sample of the bid requests received by an exchange connector
+    into files that can be replayed with HttpAuctionLogger::parse().
+
+    Unlike HttpAuctionLogger, nothing is written from the exchange threads:
+    a sampled request is copied into a ring buffer owned by the calling
+    thread (the copy reuses the memory of the entry it overwrites) and a
+    background thread drains the rings into lz4 compressed files, rotated
+    by number of requests or by age.  When a ring is full the request is
+    counted as dropped rather than waiting for the writer.
+
+    Configured with a JSON object, which can be changed while running:
+
+        {
+          "sampleRate": 0.001,          // fraction of requests captured
+          "filePrefix": "captures/adx", // files are <prefix>-<date>-<n>.log.lz4
+          "ringSize": 1024,             // entries per exchange thread
+          "requestsPerFile": 100000,    // rotate after that many requests
+          "secondsPerFile": 3600,       // or after that many seconds
+          "filter": { "requireAnyKey": [ "app" ] }  // see RawBidRequestFilter
+        }
+
+    A sampleRate of 0 stops the capture.
+*/
+struct RequestCapture {
+
+    typedef std::function<bool (const HttpHeader & header,
+                                const std::string & payload)> Predicate;
+
+    RequestCapture();
+    ~RequestCapture();
+
+    /** Apply the given configuration, starting or stopping the writer
+        thread as needed.  Options that are missing keep their value.
+    */
+    void configure(const Json::Value & config);
+
+    /** Only capture the sampled requests for which the predicate returns
+        true.  It's called from the exchange threads.
+    */
+    void setPredicate(Predicate predicate);
+
+    /** Stop sampling and wait for the captured requests to be written. */
+    void shutdown();
+
+    bool enabled() const
+    {
+        return sampleThreshold.load(std::memory_order_relaxed) != 0;
+    }
+
+    /** Called from the exchange threads for every request. */
+    void capture(const HttpHeader & header, const std::string & payload)
+    {
+        if (!enabled()) return;
+        captureSampled(header, payload);
+    }
+
+    Json::Value getStatus() const;
+
+private:
+    struct Entry {
+        HttpHeader header;
+        std::string payload;
+    };
+
+    /** Single producer, single consumer ring.  The producer is the exchange
+        thread that owns it and the consumer is the writer thread.
+    */
+    struct Ring {
+        Ring(size_t size, uint64_t seed);
+
+        bool tryPush(const HttpHeader & header, const std::string & payload);
+        bool tryPop(Entry & entry);
+
+        /** xorshift generator for the sampling decisions of the producer,
+            so that sampling doesn't contend on a shared random state.
+        */
+        uint32_t nextRandom();
+
+        std::vector<Entry> entries;
+        std::atomic<uint64_t> head;   ///< Next entry written by the producer
+        std::atomic<uint64_t> tail;   ///< Next entry read by the consumer
+        std::atomic<uint64_t> dropped;
+        uint64_t randomState;
+    };
+
+    struct ThreadRing {
+        std::shared_ptr<Ring> ring;
+    };
+
+    void captureSampled(const HttpHeader & header, const std::string & payload);
+    Ring & threadRing();
+
+    void startWriter();
+    void stopWriter();
+    void runWriter();
+
+    /// Requests are captured when a 32 bit random number is below this
+    std::atomic<uint64_t> sampleThreshold;
+    std::atomic<uint64_t> sampled;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> filesWritten;
+
+    ML::ThreadSpecificInstanceInfo<ThreadRing, RequestCapture> threadRings;
+
+    /// Protects the fields below
+    mutable std::mutex lock;
+    std::vector<std::shared_ptr<Ring> > rings;
+    std::string filePrefix;
+    size_t ringSize;
+    size_t requestsPerFile;
+    double secondsPerFile;
+    std::string currentFile;
+
+    /// Read from the exchange threads once a request has been sampled
+    mutable ML::Spinlock filterLock;
+    RawBidRequestFilter filter;
+    Predicate predicate;
+
+    std::atomic<bool> writerShutdown;
+    std::unique_ptr<std::thread> writerThread;
+};
+
+} // namespace RTBKIT
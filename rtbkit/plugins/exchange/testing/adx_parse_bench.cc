@@ -0,0 +1,188 @@
+/** adx_parse_bench.cc                                              -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Bid request decoding bench for the AdX exchange connector.
+
+    Replays the serialized bid requests of a capture file (each one prefixed
+    by its length on 4 bytes, as in adx-bidrequests.dat) from a number of
+    threads and reports the requests/sec of:
+
+    - fresh: a new protobuf message is parsed for every request;
+    - reused: a single message per thread is Clear()ed and parsed again;
+    - connector: the full AdXExchangeConnector::parseBidRequest().
+
+    Ping and unhandled requests are skipped since they need a live
+    connection to be dropped.
+
+*/
+
+#include "rtbkit/plugins/exchange/adx_exchange_connector.h"
+#include "rtbkit/plugins/exchange/http_auction_handler.h"
+#include "rtbkit/plugins/exchange/realtime-bidding.pb.h"
+#include "jml/arch/exception.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() :
+        file("rtbkit/plugins/exchange/testing/adx-bidrequests.dat"),
+        threads(1), iterations(100000)
+    {}
+
+    string file;
+    size_t threads;
+    size_t iterations;
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt("Bench options");
+    opt.add_options()
+        ("file,f", value<string>(&config.file),
+         "length prefixed AdX bid requests")
+        ("threads,t", value<size_t>(&config.threads),
+         "number of decoding threads")
+        ("iterations,i", value<size_t>(&config.iterations),
+         "requests decoded by each thread")
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* LOAD                                                                       */
+/******************************************************************************/
+
+vector<string> loadRequests(const string & filename)
+{
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    if (!ifs.is_open())
+        throw ML::Exception("couldn't open " + filename);
+
+    vector<string> requests;
+    for (;;) {
+        uint32_t len = 0;
+        if (!ifs.read((char *)&len, 4)) break;
+
+        string request(len, '\0');
+        if (!ifs.read(&request[0], len))
+            throw ML::Exception("truncated request in " + filename);
+
+        ::BidRequest gbr;
+        if (!gbr.ParseFromString(request))
+            throw ML::Exception("invalid request in " + filename);
+
+        if (gbr.is_ping() || gbr.has_video()) continue;
+        if (gbr.has_mobile()) {
+            const auto & mob = gbr.mobile();
+            if ((mob.is_app() && !mob.has_app_id())
+                    || !(gbr.has_url() || gbr.has_anonymous_id()))
+                continue;
+        }
+
+        requests.push_back(std::move(request));
+    }
+
+    if (requests.empty())
+        throw ML::Exception("no usable requests in " + filename);
+    return requests;
+}
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+template<typename Fn>
+void bench(const string & name, const Config & config,
+           const vector<string> & requests, Fn fn)
+{
+    atomic<size_t> failures(0);
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for (size_t th = 0; th < config.threads; ++th) {
+        threads.emplace_back([&, th] {
+                    for (size_t i = 0; i < config.iterations; ++i) {
+                        const auto & request =
+                            requests[(i + th) % requests.size()];
+                        if (!fn(request)) failures++;
+                    }
+                });
+    }
+    for (auto & th : threads) th.join();
+
+    double elapsed = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+    double total = config.threads * config.iterations;
+
+    printf("%-10s %12.0f req/s %8.3f us/req %6zu failures\n",
+            name.c_str(), total / elapsed,
+            elapsed * 1e6 / config.iterations, failures.load());
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+    auto requests = loadRequests(config.file);
+    printf("%zu requests loaded from %s\n", requests.size(), config.file.c_str());
+
+    bench("fresh", config, requests, [] (const string & request) {
+                ::BidRequest gbr;
+                return gbr.ParseFromArray(request.data(), request.size());
+            });
+
+    bench("reused", config, requests, [] (const string & request) {
+                static __thread ::BidRequest * gbr = nullptr;
+                if (!gbr) gbr = new ::BidRequest;
+                gbr->Clear();
+                return gbr->ParseFromArray(request.data(), request.size());
+            });
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    AdXExchangeConnector connector("adx-bench", proxies);
+
+    HttpHeader header;
+    header.contentType = "application/octet-stream";
+
+    bench("connector", config, requests, [&] (const string & request) {
+                HttpAuctionHandler handler;
+                return !!connector.parseBidRequest(handler, header, request);
+            });
+}
@@ -0,0 +1,104 @@
+/** exchange_bench.cc                                               -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Replays the sample bid requests of each exchange connector through
+    parseBidRequest, the default filters and getResponse, and reports the
+    time spent in each step along with the allocations made per request.
+
+    --write-baseline saves the allocation counts that exchange_bench_test
+    checks against.
+
+*/
+
+#include "exchange_bench_utils.h"
+#include "soa/jsoncpp/json.h"
+#include "jml/utils/filter_streams.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <iostream>
+#include <set>
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    Config() : iterations(10000) {}
+
+    size_t iterations;
+    vector<string> exchanges;
+    string baseline;
+};
+
+Config getConfig(int argc, char** argv)
+{
+    using namespace boost::program_options;
+
+    Config config;
+
+    options_description opt("Bench options");
+    opt.add_options()
+        ("iterations,i", value<size_t>(&config.iterations),
+         "requests replayed per corpus")
+        ("exchange,e", value<vector<string> >(&config.exchanges),
+         "only bench the given exchanges")
+        ("write-baseline,w", value<string>(&config.baseline),
+         "write the allocation counts to the given file")
+        ("help,h","print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(opt).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << opt << endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = getConfig(argc, argv);
+    set<string> exchanges(config.exchanges.begin(), config.exchanges.end());
+
+    Json::Value baseline(Json::objectValue);
+
+    printf("%-30s %10s %10s %10s %10s %10s %6s\n",
+            "corpus", "parse ns", "filter ns", "resp ns",
+            "allocs", "bytes", "errors");
+
+    for (const auto & corpus : defaultExchangeCorpora()) {
+        if (!exchanges.empty() && !exchanges.count(corpus.exchange))
+            continue;
+
+        auto result = runExchangeBench(corpus, config.iterations);
+
+        printf("%-30s %10.0f %10.0f %10.0f %10.1f %10.0f %6zu\n",
+                result.corpus.c_str(),
+                result.parseNs, result.filterNs, result.responseNs,
+                result.allocationsPerRequest, result.bytesPerRequest,
+                result.errors);
+
+        baseline[result.corpus] = result.toJson();
+    }
+
+    if (!config.baseline.empty()) {
+        filter_ostream stream(config.baseline);
+        stream << baseline.toStyledString();
+    }
+}
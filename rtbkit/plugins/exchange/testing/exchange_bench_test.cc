@@ -0,0 +1,70 @@
+/* exchange_bench_test.cc
+
+   Checks that the exchange connectors don't allocate more per request than
+   recorded in exchange_bench_baseline.json.  After an intended change, the
+   baseline is regenerated with:
+
+       exchange_bench --write-baseline rtbkit/plugins/exchange/testing/exchange_bench_baseline.json
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/plugins/exchange/testing/exchange_bench_utils.h"
+#include "soa/jsoncpp/json.h"
+#include "jml/utils/filter_streams.h"
+
+#include <boost/filesystem.hpp>
+#include <cmath>
+
+using namespace RTBKIT;
+
+const std::string baselineFile =
+    "rtbkit/plugins/exchange/testing/exchange_bench_baseline.json";
+
+BOOST_AUTO_TEST_CASE( test_allocation_count )
+{
+    AllocationCount before = threadAllocationCount();
+    std::unique_ptr<int> ptr(new int(1));
+    AllocationCount used = threadAllocationCount() - before;
+
+    BOOST_CHECK_EQUAL(used.allocations, 1U);
+    BOOST_CHECK_EQUAL(used.bytes, sizeof(int));
+}
+
+BOOST_AUTO_TEST_CASE( test_exchange_allocations )
+{
+    if (!boost::filesystem::exists(baselineFile)) {
+        BOOST_WARN_MESSAGE(false, "no baseline in " + baselineFile);
+        return;
+    }
+
+    ML::filter_istream stream(baselineFile);
+    std::string text((std::istreambuf_iterator<char>(stream)),
+                     std::istreambuf_iterator<char>());
+    Json::Value baseline = Json::parse(text);
+
+    for (const auto & corpus : defaultExchangeCorpora()) {
+        std::string name = corpus.name();
+        if (!baseline.isMember(name)) {
+            BOOST_WARN_MESSAGE(false, name + " has no baseline");
+            continue;
+        }
+
+        auto result = runExchangeBench(corpus, 100);
+        const Json::Value & expected = baseline[name];
+
+        BOOST_CHECK_EQUAL(result.errors, expected["errors"].asUInt());
+
+        // Allocations are deterministic for a given corpus so any increase
+        // is a regression.
+        double maxAllocations =
+            std::ceil(expected["allocationsPerRequest"].asDouble());
+        BOOST_CHECK_MESSAGE(result.allocationsPerRequest <= maxAllocations,
+                            name << ": " << result.allocationsPerRequest
+                            << " allocations per request, baseline is "
+                            << maxAllocations);
+    }
+}
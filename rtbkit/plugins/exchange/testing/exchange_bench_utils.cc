@@ -0,0 +1,327 @@
+/** exchange_bench_utils.cc                                         -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Exchange connector hot path bench.
+
+*/
+
+#include "exchange_bench_utils.h"
+#include "rtbkit/plugins/exchange/http_exchange_connector.h"
+#include "rtbkit/plugins/exchange/http_auction_handler.h"
+#include "rtbkit/core/router/filter_pool.h"
+#include "rtbkit/core/router/router_types.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/common/auction.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+/******************************************************************************/
+/* OPERATOR NEW                                                               */
+/******************************************************************************/
+
+namespace {
+
+__thread uint64_t threadAllocations = 0;
+__thread uint64_t threadBytes = 0;
+
+void * countedAlloc(size_t size)
+{
+    ++threadAllocations;
+    threadBytes += size;
+
+    void * ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+} // namespace anonymous
+
+void * operator new (size_t size) { return countedAlloc(size); }
+void * operator new[] (size_t size) { return countedAlloc(size); }
+void operator delete (void * ptr) noexcept { free(ptr); }
+void operator delete[] (void * ptr) noexcept { free(ptr); }
+
+
+namespace RTBKIT {
+
+AllocationCount threadAllocationCount()
+{
+    AllocationCount count;
+    count.allocations = threadAllocations;
+    count.bytes = threadBytes;
+    return count;
+}
+
+
+/******************************************************************************/
+/* EXCHANGE CORPUS                                                            */
+/******************************************************************************/
+
+namespace {
+
+HttpHeader makeRequest(const ExchangeCorpus & corpus, const string & body)
+{
+    string request = ML::format(
+            "POST /auctions HTTP/1.1\r\n"
+            "Content-Length: %zd\r\n"
+            "Content-Type: %s\r\n",
+            body.size(), corpus.contentType.c_str());
+
+    if (!corpus.openRtbVersion.empty())
+        request += "x-openrtb-version: " + corpus.openRtbVersion + "\r\n";
+    request += "\r\n" + body;
+
+    HttpHeader header;
+    header.parse(request);
+    return header;
+}
+
+} // namespace anonymous
+
+std::string
+ExchangeCorpus::
+name() const
+{
+    auto pos = filename.rfind('/');
+    return pos == string::npos ? filename : filename.substr(pos + 1);
+}
+
+std::vector<HttpHeader>
+ExchangeCorpus::
+load() const
+{
+    vector<HttpHeader> requests;
+
+    switch (format) {
+
+    case LENGTH_PREFIXED: {
+        filter_istream stream(filename);
+        for (;;) {
+            uint32_t len = 0;
+            if (!stream.read((char *)&len, 4)) break;
+
+            string body(len, '\0');
+            if (!stream.read(&body[0], len))
+                throw ML::Exception("truncated request in " + filename);
+            requests.push_back(makeRequest(*this, body));
+        }
+        break;
+    }
+
+    case AUCTION_LOG:
+        HttpAuctionLogger::parse(filename, [&] (const string & request) {
+                    HttpHeader header;
+                    header.parse(request);
+                    requests.push_back(std::move(header));
+                });
+        break;
+
+    case JSON_LINES: {
+        filter_istream stream(filename);
+        string line;
+        while (getline(stream, line)) {
+            if (line.empty()) continue;
+            requests.push_back(makeRequest(*this, line));
+        }
+        break;
+    }
+
+    case JSON_FILE: {
+        filter_istream stream(filename);
+        string body((istreambuf_iterator<char>(stream)),
+                    istreambuf_iterator<char>());
+        requests.push_back(makeRequest(*this, body));
+        break;
+    }
+
+    }
+
+    if (requests.empty())
+        throw ML::Exception("no requests in " + filename);
+    return requests;
+}
+
+std::vector<ExchangeCorpus>
+defaultExchangeCorpora()
+{
+    const string dir = "rtbkit/plugins/exchange/testing/";
+    const string json = "application/json";
+
+    return {
+        { "adx", dir + "adx-bidrequests.dat", ExchangeCorpus::LENGTH_PREFIXED,
+          "application/octet-stream", "" },
+        { "rubicon", dir + "rubicon-samples.txt.gz", ExchangeCorpus::AUCTION_LOG,
+          "", "" },
+        { "bidswitch", dir + "BidSwitchSimpleBannerAd.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+        { "bidswitch", dir + "BidSwitchVideoAd.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+        { "bidswitch", dir + "BidSwitchPrivateDeal.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+        { "bidswitch", dir + "BidSwitchAdX.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+        { "casale", dir + "casale_bid_request.json",
+          ExchangeCorpus::JSON_LINES, json, "2.0" },
+        { "gumgum", dir + "gumgum_bid_request.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+        { "mopub", dir + "mopub_bid_request.json",
+          ExchangeCorpus::JSON_FILE, json, "2.1" },
+        { "nexage", dir + "nexage_bid_request.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+        { "smaato", dir + "smaato_bid_request.json",
+          ExchangeCorpus::JSON_FILE, json, "2.0" },
+    };
+}
+
+
+/******************************************************************************/
+/* EXCHANGE BENCH                                                             */
+/******************************************************************************/
+
+namespace {
+
+/** Swallows the responses the connector would send on the wire when it
+    rejects a request; there's no transport behind the handler.
+*/
+struct BenchAuctionHandler : public HttpAuctionHandler
+{
+    BenchAuctionHandler() : rejected(false) {}
+
+    virtual void sendErrorResponse(const std::string &, const std::string &)
+    {
+        rejected = true;
+    }
+
+    virtual void dropAuction(const std::string &)
+    {
+        rejected = true;
+    }
+
+    bool rejected;
+};
+
+ServiceBase & benchOwner()
+{
+    static ServiceBase owner("exchange_bench", std::make_shared<ServiceProxies>());
+    return owner;
+}
+
+std::shared_ptr<AgentConfig> makeAgentConfig()
+{
+    auto config = std::make_shared<AgentConfig>();
+    config->account = { "bench", "agent" };
+    config->creatives.push_back(Creative::sampleLB);
+    config->creatives.push_back(Creative::sampleBB);
+    config->creatives.push_back(Creative::sampleWS);
+    return config;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+} // namespace anonymous
+
+Json::Value
+ExchangeBenchResult::
+toJson() const
+{
+    Json::Value result;
+    result["exchange"] = exchange;
+    result["requests"] = (Json::UInt64) requests;
+    result["errors"] = (Json::UInt64) errors;
+    result["parseNs"] = parseNs;
+    result["filterNs"] = filterNs;
+    result["responseNs"] = responseNs;
+    result["allocationsPerRequest"] = allocationsPerRequest;
+    result["bytesPerRequest"] = bytesPerRequest;
+    return result;
+}
+
+ExchangeBenchResult
+runExchangeBench(const ExchangeCorpus & corpus, size_t iterations)
+{
+    auto requests = corpus.load();
+
+    std::shared_ptr<ExchangeConnector> base(
+            ExchangeConnector::create(corpus.exchange, benchOwner(), corpus.exchange));
+    auto connector = std::dynamic_pointer_cast<HttpExchangeConnector>(base);
+    if (!connector)
+        throw ML::Exception("%s is not an http exchange connector",
+                            corpus.exchange.c_str());
+
+    FilterPool filters;
+    filters.init();
+    filters.initWithDefaultFilters();
+
+    AgentInfo info;
+    info.config = makeAgentConfig();
+    filters.addConfig("bench", info);
+
+    ExchangeBenchResult result;
+    result.corpus = corpus.name();
+    result.exchange = corpus.exchange;
+
+    AllocationCount allocations;
+
+    for (size_t i = 0; i < iterations; ++i) {
+        const HttpHeader & header = requests[i % requests.size()];
+        BenchAuctionHandler handler;
+
+        AllocationCount before = threadAllocationCount();
+        auto start = Clock::now();
+
+        auto br = connector->parseBidRequest(handler, header, header.knownData);
+
+        auto parsed = Clock::now();
+        result.parseNs += elapsedNs(start, parsed);
+        ++result.requests;
+
+        if (!br || handler.rejected) {
+            ++result.errors;
+            continue;
+        }
+
+        filters.filter(*br, nullptr);
+        auto filtered = Clock::now();
+        result.filterNs += elapsedNs(parsed, filtered);
+
+        Date now = Date::now();
+        Auction auction(connector.get(), Auction::HandleAuction(), br,
+                        header.knownData, "datacratic",
+                        now, now.plusSeconds(0.1));
+        auto response = connector->getResponse(handler, header, auction);
+
+        result.responseNs += elapsedNs(filtered, Clock::now());
+
+        AllocationCount used = threadAllocationCount() - before;
+        allocations.allocations += used.allocations;
+        allocations.bytes += used.bytes;
+    }
+
+    size_t handled = result.requests - result.errors;
+    if (result.requests) result.parseNs /= result.requests;
+    if (handled) {
+        result.filterNs /= handled;
+        result.responseNs /= handled;
+        result.allocationsPerRequest = double(allocations.allocations) / handled;
+        result.bytesPerRequest = double(allocations.bytes) / handled;
+    }
+
+    return result;
+}
+
+} // namespace RTBKIT
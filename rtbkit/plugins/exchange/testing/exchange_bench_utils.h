@@ -0,0 +1,119 @@
+/** exchange_bench_utils.h                                          -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Replays the sample bid requests of the exchange connector tests through
+    the hot path of a connector (parseBidRequest, the default router filters
+    and getResponse) and measures its cost.
+
+    Linking this library replaces the global operator new so that the
+    allocations made by each thread can be counted.
+
+*/
+
+#pragma once
+
+#include "soa/service/http_header.h"
+#include "soa/jsoncpp/value.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* ALLOCATION COUNTER                                                         */
+/******************************************************************************/
+
+/** Number of allocations made and bytes allocated through operator new by the
+    calling thread since it started.
+*/
+struct AllocationCount
+{
+    AllocationCount() : allocations(0), bytes(0) {}
+
+    uint64_t allocations;
+    uint64_t bytes;
+
+    AllocationCount operator - (const AllocationCount & other) const
+    {
+        AllocationCount result;
+        result.allocations = allocations - other.allocations;
+        result.bytes = bytes - other.bytes;
+        return result;
+    }
+};
+
+AllocationCount threadAllocationCount();
+
+
+/******************************************************************************/
+/* EXCHANGE CORPUS                                                            */
+/******************************************************************************/
+
+/** A file of sample bid requests for one exchange connector. */
+struct ExchangeCorpus
+{
+    enum Format {
+        LENGTH_PREFIXED,  ///< Binary requests prefixed by a 4 byte length
+        AUCTION_LOG,      ///< HTTP requests written by HttpAuctionLogger
+        JSON_LINES,       ///< One JSON request per line
+        JSON_FILE         ///< The whole file is a single JSON request
+    };
+
+    std::string exchange;
+    std::string filename;
+    Format format;
+    std::string contentType;
+    std::string openRtbVersion;
+
+    /** Name of the corpus in reports and baselines: the file name without
+        its directory.
+    */
+    std::string name() const;
+
+    /** Loads the requests of the file as parsed HTTP headers, with the body
+        of each request in the knownData field.
+    */
+    std::vector<HttpHeader> load() const;
+};
+
+/** The corpora found in rtbkit/plugins/exchange/testing. */
+std::vector<ExchangeCorpus> defaultExchangeCorpora();
+
+
+/******************************************************************************/
+/* EXCHANGE BENCH                                                             */
+/******************************************************************************/
+
+struct ExchangeBenchResult
+{
+    ExchangeBenchResult() :
+        requests(0), errors(0),
+        parseNs(0), filterNs(0), responseNs(0),
+        allocationsPerRequest(0), bytesPerRequest(0)
+    {}
+
+    std::string corpus;
+    std::string exchange;
+    size_t requests;   ///< Number of requests replayed
+    size_t errors;     ///< Requests that couldn't be parsed
+
+    double parseNs;    ///< Average time spent in parseBidRequest
+    double filterNs;   ///< Average time spent in the filter pool
+    double responseNs; ///< Average time spent in getResponse
+
+    double allocationsPerRequest;
+    double bytesPerRequest;
+
+    Json::Value toJson() const;
+};
+
+/** Replays the requests of the corpus iterations times through a freshly
+    created connector of the corpus' exchange type.
+*/
+ExchangeBenchResult
+runExchangeBench(const ExchangeCorpus & corpus, size_t iterations);
+
+} // namespace RTBKIT
@@ -0,0 +1,55 @@
+/* exchange_latencies_test.cc
+
+   Tests for the latency histograms of the exchange connectors.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/plugins/exchange/exchange_latencies.h"
+#include "jml/arch/format.h"
+
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_record )
+{
+    ExchangeLatencies latencies;
+
+    auto & host = latencies.forHost("10.0.0.1");
+    BOOST_CHECK_EQUAL(&host, &latencies.forHost("10.0.0.1"));
+
+    for (int i = 0;  i < 100;  ++i)
+        host.record(20.0, 30.0, 1.0, 15.0, 4.0);
+    host.record(60.0, -10.0, 1.0, 55.0, 4.0);
+
+    Json::Value json = latencies.toJson();
+    BOOST_CHECK_EQUAL(json.size(), 1);
+
+    const Json::Value & h = json["10.0.0.1"];
+    BOOST_CHECK_EQUAL(h["late"].asInt(), 1);
+    BOOST_CHECK_EQUAL(h["total"]["count"].asInt(), 101);
+    BOOST_CHECK_CLOSE(h["total"]["p50Ms"].asDouble(), 20.0, 10.0);
+    BOOST_CHECK_CLOSE(h["slack"]["p90Ms"].asDouble(), 30.0, 10.0);
+    BOOST_CHECK_CLOSE(h["route"]["p50Ms"].asDouble(), 15.0, 10.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_max_hosts )
+{
+    ExchangeLatencies latencies;
+
+    for (int i = 0;  i < ExchangeLatencies::MaxHosts;  ++i)
+        latencies.forHost(ML::format("host%d", i)).record(1, 1, 1, 1, 1);
+
+    // Past the limit every host shares the same histograms
+    auto & other = latencies.forHost("extra1");
+    BOOST_CHECK_EQUAL(&other, &latencies.forHost("extra2"));
+    BOOST_CHECK_EQUAL(&latencies.forHost("host3"),
+                      &latencies.forHost("host3"));
+    BOOST_CHECK(&latencies.forHost("host3") != &other);
+
+    Json::Value json = latencies.toJson();
+    BOOST_CHECK_EQUAL(json.size(), ExchangeLatencies::MaxHosts + 1);
+    BOOST_CHECK(json.isMember("other"));
+}
@@ -9,6 +9,7 @@ $(eval $(call test,bidswitch_exchange_connector_adx_test,bidswitch_exchange bid_
 $(eval $(call test,bidswitch_filters_test,static_filters bidswitch_exchange,boost))
 $(eval $(call test,nexage_exchange_connector_test,nexage_exchange bid_test_utils bidding_agent rtb_router agents_bidder,boost))
 $(eval $(call test,adx_exchange_connector_test,adx_exchange bid_test_utils bidding_agent rtb_router agents_bidder,boost))
+$(eval $(call program,adx_parse_bench,adx_exchange exchange boost_program_options protobuf))
 $(eval $(call test,openrtb_exchange_connector_test,openrtb_exchange bid_test_utils bidding_agent rtb_router agents_bidder,boost))
 $(eval $(call test,rtbkit_exchange_connector_test,rtbkit_exchange bid_test_utils bidding_agent rtb_router agents_bidder,boost))
 $(eval $(call test,casale_exchange_connector_test,casale_exchange bid_test_utils bidding_agent rtb_router agents_bidder,boost))
@@ -16,3 +17,11 @@ $(eval $(call test,creative_ids_exchange_filter_test,static_filters rtbkit_excha
 $(eval $(call test,spotx_exchange_connector_test,spotx_exchange bid_test_utils bidding_agent rtb_router agents_bidder,boost))
 
 $(eval $(call test,creative_configuration_test,exchange agent_configuration bid_request jsoncpp types,boost))
+$(eval $(call test,raw_bid_request_filter_test,exchange jsoncpp,boost))
+$(eval $(call test,request_capture_test,exchange boost_filesystem,boost))
+$(eval $(call test,exchange_latencies_test,exchange,boost))
+$(eval $(call test,recent_auctions_test,exchange,boost))
+
+$(eval $(call library,exchange_bench_utils,exchange_bench_utils.cc,exchange rtb_router utils adx_exchange rubicon_exchange bidswitch_exchange casale_exchange gumgum_exchange mopub_exchange nexage_exchange smaato_exchange))
+$(eval $(call program,exchange_bench,exchange_bench_utils boost_program_options))
+$(eval $(call test,exchange_bench_test,exchange_bench_utils boost_filesystem,boost))
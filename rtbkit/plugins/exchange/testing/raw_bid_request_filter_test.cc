@@ -0,0 +1,43 @@
+/* raw_bid_request_filter_test.cc
+
+   Tests for the raw bid request filter.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/plugins/exchange/raw_bid_request_filter.h"
+#include "soa/jsoncpp/json.h"
+
+using namespace RTBKIT;
+
+BOOST_AUTO_TEST_CASE( test_has_key )
+{
+    std::string payload = R"({"id":"1", "app" : {"id":"a"}, "note":"site"})";
+
+    BOOST_CHECK(RawBidRequestFilter::hasKey(payload, "\"app\""));
+    BOOST_CHECK(RawBidRequestFilter::hasKey(payload, "\"id\""));
+
+    // Present as a value, not as a key
+    BOOST_CHECK(!RawBidRequestFilter::hasKey(payload, "\"site\""));
+    BOOST_CHECK(!RawBidRequestFilter::hasKey(payload, "\"device\""));
+}
+
+BOOST_AUTO_TEST_CASE( test_check )
+{
+    RawBidRequestFilter filter;
+    BOOST_CHECK(filter.empty());
+    BOOST_CHECK(!filter.check("{}"));
+
+    filter.configure(Json::parse(
+        R"({ "requireAnyKey": [ "site" ], "rejectAnyKey": [ "pmp" ] })"));
+    BOOST_CHECK(!filter.empty());
+
+    BOOST_CHECK(!filter.check(R"({"site":{"id":"s"}})"));
+    BOOST_CHECK_EQUAL(filter.check(R"({"app":{"id":"a"}})"),
+                      std::string("missingRequiredKey"));
+    BOOST_CHECK_EQUAL(filter.check(R"({"site":{}, "pmp":{"deals":[]}})"),
+                      std::string("rejectedKey"));
+}
@@ -0,0 +1,96 @@
+/* recent_auctions_test.cc
+
+   Tests for the detection of duplicate auctions in the exchange connectors.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/plugins/exchange/recent_auctions.h"
+#include "soa/service/http_endpoint.h"
+
+using namespace RTBKIT;
+
+namespace {
+
+RecentAuctions & configured(RecentAuctions & recent, double ttl,
+                            bool replay = false)
+{
+    Json::Value config;
+    config["ttl"] = ttl;
+    config["maxSize"] = 160;
+    config["replayResponses"] = replay;
+    recent.configure(config);
+    return recent;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_disabled )
+{
+    RecentAuctions recent;
+    Date now = Date::now();
+
+    BOOST_CHECK(!recent.enabled());
+    BOOST_CHECK_EQUAL(recent.start(Id(1), now), RecentAuctions::NEW);
+    BOOST_CHECK_EQUAL(recent.start(Id(1), now), RecentAuctions::NEW);
+    BOOST_CHECK_EQUAL(recent.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_duplicates )
+{
+    RecentAuctions recent;
+    configured(recent, 5.0);
+    Date now = Date::now();
+
+    BOOST_CHECK_EQUAL(recent.start(Id(1), now), RecentAuctions::NEW);
+    BOOST_CHECK_EQUAL(recent.start(Id(2), now), RecentAuctions::NEW);
+    BOOST_CHECK_EQUAL(recent.start(Id(1), now), RecentAuctions::IN_FLIGHT);
+
+    std::shared_ptr<const HttpResponse> response;
+    recent.finish(Id(1), std::make_shared<HttpResponse>(200, "text", "bid"));
+    BOOST_CHECK_EQUAL(recent.start(Id(1), now, &response),
+                      RecentAuctions::FINISHED);
+    BOOST_CHECK(!response);     // responses are only kept when replaying
+
+    // Past the ttl the id is new again
+    Date later = now.plusSeconds(6.0);
+    BOOST_CHECK_EQUAL(recent.start(Id(1), later), RecentAuctions::NEW);
+    BOOST_CHECK_EQUAL(recent.start(Id(2), later), RecentAuctions::NEW);
+    BOOST_CHECK_EQUAL(recent.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_replay )
+{
+    RecentAuctions recent;
+    configured(recent, 5.0, true);
+    Date now = Date::now();
+
+    BOOST_CHECK_EQUAL(recent.start(Id("abc"), now), RecentAuctions::NEW);
+    recent.finish(Id("abc"), std::make_shared<HttpResponse>(200, "text", "bid"));
+
+    std::shared_ptr<const HttpResponse> response;
+    BOOST_CHECK_EQUAL(recent.start(Id("abc"), now, &response),
+                      RecentAuctions::FINISHED);
+    BOOST_REQUIRE(response);
+    BOOST_CHECK_EQUAL(response->body, "bid");
+}
+
+BOOST_AUTO_TEST_CASE( test_max_size )
+{
+    RecentAuctions recent;
+    configured(recent, 5.0);
+    Date now = Date::now();
+
+    for (unsigned i = 1;  i <= 1000;  ++i)
+        BOOST_CHECK_EQUAL(recent.start(Id(i), now), RecentAuctions::NEW);
+
+    // Each of the 16 shards keeps at most 160 / 16 ids
+    BOOST_CHECK_LE(recent.size(), 160);
+
+    // The newest ones are kept and the oldest ones were evicted
+    BOOST_CHECK_EQUAL(recent.start(Id(1000), now), RecentAuctions::IN_FLIGHT);
+    BOOST_CHECK_EQUAL(recent.start(Id(1), now), RecentAuctions::NEW);
+}
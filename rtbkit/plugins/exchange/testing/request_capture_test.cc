@@ -0,0 +1,146 @@
+/* request_capture_test.cc
+
+   Tests for the sampled request capture.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "rtbkit/plugins/exchange/request_capture.h"
+#include "rtbkit/plugins/exchange/http_auction_handler.h"
+#include "soa/jsoncpp/json.h"
+#include "jml/arch/format.h"
+
+#include <boost/filesystem.hpp>
+#include <thread>
+
+using namespace RTBKIT;
+
+namespace {
+
+std::string makeDirectory()
+{
+    auto dir = boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("request-capture-%%%%%%");
+    boost::filesystem::create_directories(dir);
+    return dir.string();
+}
+
+/** Replays every capture file in the directory and returns the payloads. */
+std::vector<std::string> readCaptures(const std::string & dir)
+{
+    std::vector<std::string> payloads;
+    for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it) {
+        HttpAuctionLogger::parse(it->path().string(),
+                                 [&] (const std::string & request) {
+                                     HttpHeader header;
+                                     header.parse(request);
+                                     payloads.push_back(header.knownData);
+                                 });
+    }
+    return payloads;
+}
+
+HttpHeader makeHeader(const std::string & payload)
+{
+    HttpHeader header;
+    header.verb = "POST";
+    header.resource = "/auctions";
+    header.contentType = "application/json";
+    header.contentLength = payload.size();
+    return header;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_capture_all )
+{
+    std::string dir = makeDirectory();
+
+    RequestCapture capture;
+    BOOST_CHECK(!capture.enabled());
+
+    Json::Value config;
+    config["sampleRate"] = 1.0;
+    config["filePrefix"] = dir + "/capture";
+    config["ringSize"] = 100000;
+    capture.configure(config);
+    BOOST_CHECK(capture.enabled());
+
+    const int numThreads = 4;
+    const int numRequests = 1000;
+
+    std::vector<std::thread> threads;
+    for (int th = 0; th < numThreads; ++th) {
+        threads.emplace_back([&, th] {
+                for (int i = 0; i < numRequests; ++i) {
+                    std::string payload = ML::format("{\"id\":\"%d-%d\"}", th, i);
+                    capture.capture(makeHeader(payload), payload);
+                }
+            });
+    }
+    for (auto & th : threads) th.join();
+
+    capture.shutdown();
+    BOOST_CHECK(!capture.enabled());
+
+    auto status = capture.getStatus();
+    BOOST_CHECK_EQUAL(status["sampled"].asInt(), numThreads * numRequests);
+    BOOST_CHECK_EQUAL(status["written"].asInt(), numThreads * numRequests);
+    BOOST_CHECK_EQUAL(status["dropped"].asInt(), 0);
+
+    auto payloads = readCaptures(dir);
+    BOOST_CHECK_EQUAL(payloads.size(), (size_t)(numThreads * numRequests));
+
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE( test_capture_filter )
+{
+    std::string dir = makeDirectory();
+
+    RequestCapture capture;
+
+    Json::Value config = Json::parse(
+            "{ \"sampleRate\": 1.0, \"filter\": { \"requireAnyKey\": [ \"app\" ] } }");
+    config["filePrefix"] = dir + "/capture";
+    capture.configure(config);
+
+    std::string app = "{\"id\":\"1\",\"app\":{}}";
+    std::string site = "{\"id\":\"2\",\"site\":{}}";
+    capture.capture(makeHeader(app), app);
+    capture.capture(makeHeader(site), site);
+
+    // The predicate is checked on top of the filter
+    capture.setPredicate([] (const HttpHeader &, const std::string & payload)
+                         {
+                             return payload.find("\"3\"") == std::string::npos;
+                         });
+    std::string app3 = "{\"id\":\"3\",\"app\":{}}";
+    capture.capture(makeHeader(app3), app3);
+
+    capture.shutdown();
+
+    auto payloads = readCaptures(dir);
+    BOOST_REQUIRE_EQUAL(payloads.size(), 1U);
+    BOOST_CHECK_EQUAL(payloads[0], app);
+
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE( test_capture_disabled )
+{
+    RequestCapture capture;
+
+    // Sampling without a place to write to is a configuration error
+    Json::Value config;
+    config["sampleRate"] = 0.5;
+    BOOST_CHECK_THROW(capture.configure(config), std::exception);
+    BOOST_CHECK(!capture.enabled());
+
+    std::string payload = "{}";
+    capture.capture(makeHeader(payload), payload);
+    BOOST_CHECK_EQUAL(capture.getStatus()["sampled"].asInt(), 0);
+}
@@ -71,7 +71,7 @@ struct YourFilter : public FilterBaseT<YourFilter>
 
     void filter(FilterState& state) const
     {
-        state.narrowConfigs(impl.filter(state.request.url.toString()));
+        state.narrowConfigs(impl.filter(state.request.url.spec()));
     }
 
 private:
@@ -0,0 +1,576 @@
+/** expression_filter.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Compiler and evaluator of the expressions of the expression filter.
+*/
+
+#include "expression_filter.h"
+#include "jml/utils/parse_context.h"
+#include "jml/arch/format.h"
+
+#include <boost/regex.hpp>
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+using namespace ML;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* FIELDS                                                                     */
+/******************************************************************************/
+
+namespace {
+
+struct Field
+{
+    enum Type { String, Number, Segments };
+
+    Type type;
+    std::function<std::string(const BidRequest&)> str;
+    std::function<double(const BidRequest&)> num;
+    std::string source;
+};
+
+Field stringField(std::function<std::string(const BidRequest&)> get)
+{
+    return Field{ Field::String, std::move(get), nullptr, "" };
+}
+
+Field numberField(std::function<double(const BidRequest&)> get)
+{
+    return Field{ Field::Number, nullptr, std::move(get), "" };
+}
+
+bool startsWith(const std::string& str, const std::string& prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0
+        && str.size() > prefix.size();
+}
+
+/** Resolves the field to its accessor; returns false if there is no such
+    field.
+ */
+bool resolveField(const std::string& name, Field& field)
+{
+    typedef const BidRequest& Req;
+
+    static const std::unordered_map<std::string, Field> fields = {
+        { "exchange",
+          stringField([] (Req r) { return r.exchange; }) },
+        { "provider",
+          stringField([] (Req r) { return r.provider; }) },
+        { "protocolVersion",
+          stringField([] (Req r) { return r.protocolVersion; }) },
+        { "ipAddress",
+          stringField([] (Req r) { return r.ipAddress; }) },
+        { "language",
+          stringField([] (Req r) { return r.language.rawString(); }) },
+        { "userAgent",
+          stringField([] (Req r) { return r.userAgent.rawString(); }) },
+        { "url",
+          stringField([] (Req r) { return r.url.spec(); }) },
+        { "host",
+          stringField([] (Req r) {
+                  auto host = r.url.hostRange();
+                  return std::string(host.first, host.second);
+              }) },
+        { "location.countryCode",
+          stringField([] (Req r) { return r.location.countryCode; }) },
+        { "location.regionCode",
+          stringField([] (Req r) { return r.location.regionCode; }) },
+        { "location.cityName",
+          stringField([] (Req r) { return r.location.cityName.rawString(); }) },
+        { "location.postalCode",
+          stringField([] (Req r) { return r.location.postalCode.rawString(); }) },
+
+        { "timeAvailableMs",
+          numberField([] (Req r) { return r.timeAvailableMs; }) },
+        { "isTest",
+          numberField([] (Req r) { return r.isTest; }) },
+        { "location.dma",
+          numberField([] (Req r) { return r.location.dma; }) },
+        { "location.metro",
+          numberField([] (Req r) { return r.location.metro; }) },
+        { "location.timezoneOffsetMinutes",
+          numberField([] (Req r) {
+                  return r.location.timezoneOffsetMinutes;
+              }) },
+        { "imp.count",
+          numberField([] (Req r) { return r.imp.size(); }) },
+    };
+
+    auto it = fields.find(name);
+    if (it != fields.end()) {
+        field = it->second;
+        return true;
+    }
+
+    if (startsWith(name, "userIds.")) {
+        std::string domain = name.substr(8);
+        field = stringField([=] (Req r) {
+                auto it = r.userIds.find(domain);
+                return it == r.userIds.end() ? "" : it->second.toString();
+            });
+        return true;
+    }
+
+    if (startsWith(name, "segments.")) {
+        field = Field{ Field::Segments, nullptr, nullptr, name.substr(9) };
+        return true;
+    }
+
+    return false;
+}
+
+/** Literal of a comparison, which is either a string or a number. */
+struct Literal
+{
+    bool isString;
+    std::string str;
+    double num;
+
+    std::string key() const
+    {
+        return isString ? format("s%zd:%s", str.size(), str.c_str())
+                        : format("n%.17g", num);
+    }
+};
+
+} // file scope
+
+
+/******************************************************************************/
+/* EXPRESSION PARSER                                                          */
+/******************************************************************************/
+
+/** Recursive descent parser which compiles the expression into the nodes of
+    the program as it goes.
+ */
+struct ExpressionParser
+{
+    typedef ExpressionProgram::NodeId NodeId;
+
+    ExpressionParser(ExpressionProgram& program, Parse_Context& context) :
+        program(program), context(context)
+    {}
+
+    NodeId parseOr()
+    {
+        NodeId lhs = parseAnd();
+
+        while (context.skip_whitespace(), context.match_literal("||")) {
+            NodeId rhs = parseAnd();
+            lhs = program.node(format("|%d,%d", lhs, rhs),
+                    ExpressionProgram::Or, lhs, rhs);
+        }
+
+        return lhs;
+    }
+
+    NodeId parseAnd()
+    {
+        NodeId lhs = parseUnary();
+
+        while (context.skip_whitespace(), context.match_literal("&&")) {
+            NodeId rhs = parseUnary();
+            lhs = program.node(format("&%d,%d", lhs, rhs),
+                    ExpressionProgram::And, lhs, rhs);
+        }
+
+        return lhs;
+    }
+
+    NodeId parseUnary()
+    {
+        context.skip_whitespace();
+
+        if (context.match_literal('!')) {
+            NodeId expr = parseUnary();
+            return program.node(format("!%d", expr),
+                    ExpressionProgram::Not, expr, expr);
+        }
+
+        if (context.match_literal('(')) {
+            NodeId expr = parseOr();
+            context.skip_whitespace();
+            context.expect_literal(')');
+            return expr;
+        }
+
+        return parseComparison();
+    }
+
+    NodeId parseComparison()
+    {
+        std::string name = parseIdentifier();
+
+        Field field;
+        if (!resolveField(name, field))
+            context.exception("unknown field '" + name + "'");
+
+        context.skip_whitespace();
+
+        std::string op;
+        static const char* ops[] =
+            { "==", "!=", "<=", ">=", "=~", "<", ">", "in", "has" };
+        for (const char* candidate : ops) {
+            if (context.match_literal(candidate)) {
+                op = candidate;
+                break;
+            }
+        }
+
+        std::vector<Literal> literals;
+        if (op == "in") literals = parseList();
+        else if (!op.empty()) literals.push_back(parseLiteral());
+
+        std::string key = name + " " + op;
+        for (const auto& literal : literals)
+            key += " " + literal.key();
+
+        return program.node(key, ExpressionProgram::Test, 0, 0,
+                makeTest(field, op, literals));
+    }
+
+private:
+
+    std::function<bool(const BidRequest&)>
+    makeTest(const Field& field, const std::string& op,
+             const std::vector<Literal>& literals)
+    {
+        if (field.type == Field::Segments)
+            return makeSegmentsTest(field.source, op, literals);
+
+        if (field.type == Field::String)
+            return makeStringTest(field.str, op, literals);
+
+        return makeNumberTest(field.num, op, literals);
+    }
+
+    std::function<bool(const BidRequest&)>
+    makeStringTest(std::function<std::string(const BidRequest&)> get,
+                   const std::string& op, const std::vector<Literal>& literals)
+    {
+        for (const auto& literal : literals) {
+            if (!literal.isString)
+                context.exception("string field compared to a number");
+        }
+
+        if (op.empty())
+            return [=] (const BidRequest& r) { return !get(r).empty(); };
+
+        if (op == "in") {
+            std::unordered_set<std::string> values;
+            for (const auto& literal : literals) values.insert(literal.str);
+            return [=] (const BidRequest& r) { return values.count(get(r)); };
+        }
+
+        const std::string value = literals.front().str;
+
+        if (op == "==")
+            return [=] (const BidRequest& r) { return get(r) == value; };
+        if (op == "!=")
+            return [=] (const BidRequest& r) { return get(r) != value; };
+
+        if (op == "=~") {
+            boost::regex rex;
+            try {
+                rex = boost::regex(value);
+            } catch (const std::exception& exc) {
+                context.exception("invalid regex: " + std::string(exc.what()));
+            }
+            return [=] (const BidRequest& r) {
+                return boost::regex_search(get(r), rex);
+            };
+        }
+
+        context.exception("operator '" + op + "' can't be used on strings");
+    }
+
+    std::function<bool(const BidRequest&)>
+    makeNumberTest(std::function<double(const BidRequest&)> get,
+                   const std::string& op, const std::vector<Literal>& literals)
+    {
+        for (const auto& literal : literals) {
+            if (literal.isString)
+                context.exception("number field compared to a string");
+        }
+
+        if (op.empty())
+            return [=] (const BidRequest& r) { return get(r) != 0; };
+
+        if (op == "in") {
+            std::vector<double> values;
+            for (const auto& literal : literals) values.push_back(literal.num);
+            return [=] (const BidRequest& r) {
+                return std::find(values.begin(), values.end(), get(r))
+                    != values.end();
+            };
+        }
+
+        const double value = literals.front().num;
+
+        if (op == "==")
+            return [=] (const BidRequest& r) { return get(r) == value; };
+        if (op == "!=")
+            return [=] (const BidRequest& r) { return get(r) != value; };
+        if (op == "<")
+            return [=] (const BidRequest& r) { return get(r) < value; };
+        if (op == "<=")
+            return [=] (const BidRequest& r) { return get(r) <= value; };
+        if (op == ">")
+            return [=] (const BidRequest& r) { return get(r) > value; };
+        if (op == ">=")
+            return [=] (const BidRequest& r) { return get(r) >= value; };
+
+        context.exception("operator '" + op + "' can't be used on numbers");
+    }
+
+    std::function<bool(const BidRequest&)>
+    makeSegmentsTest(const std::string& source, const std::string& op,
+                     const std::vector<Literal>& literals)
+    {
+        if (op.empty()) {
+            return [=] (const BidRequest& r) {
+                return !r.segments.get(source).empty();
+            };
+        }
+
+        if (op != "has")
+            context.exception("segments can only be tested with 'has'");
+
+        const Literal value = literals.front();
+        if (value.isString) {
+            return [=] (const BidRequest& r) {
+                return r.segments.get(source).contains(value.str);
+            };
+        }
+
+        if (value.num != int(value.num))
+            context.exception("segment ids are integers");
+
+        int id = value.num;
+        return [=] (const BidRequest& r) {
+            return r.segments.get(source).contains(id);
+        };
+    }
+
+    std::string parseIdentifier()
+    {
+        std::string name;
+        while (!context.eof()) {
+            char c = *context;
+            if (!isalnum(c) && c != '_' && c != '.' && c != '-') break;
+            name += c;
+            ++context;
+        }
+
+        if (name.empty()) context.exception("expected a field name");
+        return name;
+    }
+
+    std::vector<Literal> parseList()
+    {
+        std::vector<Literal> literals;
+
+        context.skip_whitespace();
+        context.expect_literal('[');
+        context.skip_whitespace();
+
+        if (context.match_literal(']'))
+            context.exception("empty list");
+
+        do {
+            literals.push_back(parseLiteral());
+            context.skip_whitespace();
+        } while (context.match_literal(','));
+
+        context.expect_literal(']');
+        return literals;
+    }
+
+    Literal parseLiteral()
+    {
+        context.skip_whitespace();
+
+        Literal literal{ false, "", 0.0 };
+
+        if (context.match_literal("true")) {
+            literal.num = 1;
+            return literal;
+        }
+        if (context.match_literal("false"))
+            return literal;
+
+        if (context.match_double(literal.num))
+            return literal;
+
+        char quote = context.eof() ? 0 : *context;
+        if (quote != '\'' && quote != '"')
+            context.exception("expected a string or a number");
+        ++context;
+
+        literal.isString = true;
+        while (!context.match_literal(quote)) {
+            if (context.eof()) context.exception("unterminated string");
+            if (context.match_literal('\\') && context.eof())
+                context.exception("unterminated string");
+            literal.str += *context;
+            ++context;
+        }
+
+        return literal;
+    }
+
+    ExpressionProgram& program;
+    Parse_Context& context;
+};
+
+
+/******************************************************************************/
+/* EXPRESSION PROGRAM                                                         */
+/******************************************************************************/
+
+ExpressionProgram::NodeId
+ExpressionProgram::
+compile(const std::string& expression)
+{
+    Parse_Context context(
+            "expression",
+            expression.c_str(), expression.c_str() + expression.size());
+
+    ExpressionParser parser(*this, context);
+    NodeId root = parser.parseOr();
+
+    context.skip_whitespace();
+    context.expect_eof("unexpected text after the expression");
+
+    return root;
+}
+
+ExpressionProgram::NodeId
+ExpressionProgram::
+node(const std::string& key, Op op, NodeId lhs, NodeId rhs,
+     std::function<bool(const BidRequest&)> test)
+{
+    auto it = index.find(key);
+    if (it != index.end()) return it->second;
+
+    NodeId id = nodes.size();
+    nodes.push_back(Node{ op, lhs, rhs, std::move(test) });
+    index[key] = id;
+    return id;
+}
+
+ExpressionProgram::Evaluation::
+Evaluation(const ExpressionProgram& program, const BidRequest& request) :
+    program(program), request(request), results(program.nodes.size(), -1)
+{}
+
+bool
+ExpressionProgram::Evaluation::
+operator() (NodeId id)
+{
+    if (results[id] >= 0) return results[id];
+
+    const Node& node = program.nodes[id];
+
+    bool result;
+    switch (node.op) {
+    case Test: result = node.test(request); break;
+    case Not: result = !(*this)(node.lhs); break;
+    case And: result = (*this)(node.lhs) && (*this)(node.rhs); break;
+    case Or: result = (*this)(node.lhs) || (*this)(node.rhs); break;
+    default: throw ML::Exception("unknown expression node");
+    }
+
+    results[id] = result;
+    return result;
+}
+
+
+/******************************************************************************/
+/* EXPRESSION FILTER EXTENSION                                                */
+/******************************************************************************/
+
+void
+ExpressionFilterExtension::
+parse(const Json::Value& value)
+{
+    if (!value.isString())
+        throw ML::Exception("expressionFilter must be a string");
+
+    expression = value.asString();
+
+    // Reports the syntax errors with the rest of the configuration.
+    ExpressionProgram().compile(expression);
+}
+
+Json::Value
+ExpressionFilterExtension::
+toJson() const
+{
+    return expression;
+}
+
+
+/******************************************************************************/
+/* EXPRESSION FILTER                                                          */
+/******************************************************************************/
+
+void
+ExpressionFilter::
+setConfig(unsigned cfgIndex, const AgentConfig& config, bool value)
+{
+    auto ext = config.extensions.tryGet<ExpressionFilterExtension>();
+    if (!ext) {
+        matchAll.set(cfgIndex, value);
+        return;
+    }
+
+    // Compiling the same expression again yields the same node.
+    auto root = program.compile(ext->expression);
+
+    auto& configs = roots[root];
+    configs.set(cfgIndex, value);
+    if (configs.empty()) roots.erase(root);
+}
+
+void
+ExpressionFilter::
+filter(FilterState& state) const
+{
+    ConfigSet configs = matchAll;
+    ExpressionProgram::Evaluation evaluate(program, state.request);
+
+    for (const auto& root : roots) {
+        if ((root.second & state.configs()).empty()) continue;
+        if (evaluate(root.first)) configs |= root.second;
+    }
+
+    state.narrowConfigs(configs);
+}
+
+} // namespace RTBKIT
+
+
+/******************************************************************************/
+/* INIT FILTERS                                                               */
+/******************************************************************************/
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        RTBKIT::FilterBase::registerFactory<RTBKIT::ExpressionFilter>();
+        RTBKIT::ExtensionRegistry::registerFactory<
+            RTBKIT::ExpressionFilterExtension>();
+    }
+
+} AtInit;
+
+} // namespace anonymous
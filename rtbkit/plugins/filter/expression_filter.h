@@ -0,0 +1,139 @@
+/** expression_filter.h                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Filter on a boolean expression over the fields of the bid request, given
+    in the agent configuration:
+
+        "expressionFilter": "exchange == 'adx'
+                             && location.countryCode in ['CA', 'US']
+                             && !(segments.iab has 'IAB7')"
+
+    Comparisons:
+
+        field == value, field != value, field in [value, ...]
+        field < number, field <= number, field > number, field >= number
+        field =~ 'regex'
+        segments.<source> has value
+        field                  (non-empty, non-zero or present)
+
+    combined with !, && and ||.  Fields are listed in expression_filter.cc.
+*/
+
+#pragma once
+
+#include "rtbkit/core/router/filters/generic_filters.h"
+#include "rtbkit/core/router/filters/priority.h"
+#include "rtbkit/common/extension.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* EXPRESSION FILTER EXTENSION                                                */
+/******************************************************************************/
+
+/** Agent configuration extension which holds the expression. The expression
+    is compiled when the configuration is parsed so that syntax errors are
+    reported to the agent rather than by the router.
+ */
+struct ExpressionFilterExtension : public Extension
+{
+    NAME("expressionFilter");
+
+    void parse(const Json::Value& value);
+    Json::Value toJson() const;
+
+    std::string expression;
+};
+
+
+/******************************************************************************/
+/* EXPRESSION PROGRAM                                                         */
+/******************************************************************************/
+
+/** The expressions of all the configs compiled into a single graph of nodes.
+
+    Identical sub-expressions, down to the individual comparisons, are
+    compiled into the same node no matter which config they come from, so a
+    comparison used by a thousand configs is evaluated once per request. The
+    fields are resolved to accessors at compile time.
+
+    Nodes are never removed; a node that no config refers to anymore is
+    simply never evaluated.
+ */
+struct ExpressionProgram
+{
+    typedef unsigned NodeId;
+
+    /** Returns the node of the expression, compiling whatever part of it
+        isn't in the program yet. Throws on invalid expressions.
+     */
+    NodeId compile(const std::string& expression);
+
+    size_t size() const { return nodes.size(); }
+
+    /** Evaluation of the program on a request, which evaluates each node at
+        most once and only when asked for it.
+     */
+    struct Evaluation
+    {
+        Evaluation(const ExpressionProgram& program, const BidRequest& request);
+
+        bool operator() (NodeId node);
+
+    private:
+        const ExpressionProgram& program;
+        const BidRequest& request;
+        std::vector<signed char> results;
+    };
+
+private:
+    friend struct ExpressionParser;
+
+    enum Op { Test, Not, And, Or };
+
+    struct Node
+    {
+        Op op;
+        NodeId lhs, rhs;
+        std::function<bool(const BidRequest&)> test;
+    };
+
+    /** Returns the node with the given key, creating it if needed. */
+    NodeId node(const std::string& key, Op op, NodeId lhs, NodeId rhs,
+                std::function<bool(const BidRequest&)> test = nullptr);
+
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, NodeId> index;
+};
+
+
+/******************************************************************************/
+/* EXPRESSION FILTER                                                          */
+/******************************************************************************/
+
+struct ExpressionFilter : public FilterBaseT<ExpressionFilter>
+{
+    static constexpr const char* name = "Expression";
+    unsigned priority() const { return Priority::Expression; }
+
+    void setConfig(unsigned configIndex, const AgentConfig& config, bool value);
+    void filter(FilterState& state) const;
+
+private:
+    ExpressionProgram program;
+
+    /** Configs without an expression. */
+    ConfigSet matchAll;
+
+    /** Configs by the node of their expression. */
+    std::map<ExpressionProgram::NodeId, ConfigSet> roots;
+};
+
+} // namespace RTBKIT
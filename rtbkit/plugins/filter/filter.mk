@@ -4,5 +4,6 @@ LIB_FILTERS_LINK := \
 	arch utils filter_registry agent_configuration rtb
 
 $(eval $(call library,custom_filter,custom_filter.cc,$(LIB_FILTERS_LINK)))
+$(eval $(call library,expression_filter,expression_filter.cc,$(LIB_FILTERS_LINK) boost_regex))
 
 $(eval $(call include_sub_make,filter_testing,testing,filter_testing.mk))
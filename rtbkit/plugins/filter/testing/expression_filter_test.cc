@@ -0,0 +1,115 @@
+/** expression_filter_test.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Tests for the expression filter.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rtbkit/core/router/filters/testing/utils.h"
+#include "rtbkit/plugins/filter/expression_filter.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace RTBKIT;
+using namespace RTBKIT::Test;
+
+bool evaluate(const string& expression, const BidRequest& request)
+{
+    ExpressionProgram program;
+    auto root = program.compile(expression);
+    return ExpressionProgram::Evaluation(program, request)(root);
+}
+
+void setExpression(AgentConfig& config, const string& expression)
+{
+    auto ext = make_shared<ExpressionFilterExtension>();
+    ext->parse(expression);
+    config.extensions.add(ext);
+}
+
+BOOST_AUTO_TEST_CASE( expressionEvaluation )
+{
+    BidRequest r;
+    r.exchange = "adx";
+    r.location.countryCode = "CA";
+    r.location.dma = 12;
+    r.url = Url("http://www.example.com/page?a=1");
+    r.userIds.add(Id("abc"), "prov");
+    addSegment(r, "iab", segment("IAB1", 7));
+
+    BOOST_CHECK(evaluate("exchange == 'adx'", r));
+    BOOST_CHECK(!evaluate("exchange != \"adx\"", r));
+    BOOST_CHECK(evaluate("location.countryCode in ['US', 'CA']", r));
+    BOOST_CHECK(evaluate("location.dma >= 12 && location.dma < 13", r));
+    BOOST_CHECK(evaluate("location.dma in [1, 12]", r));
+    BOOST_CHECK(evaluate("host =~ 'example\\\\.com$'", r));
+    BOOST_CHECK(evaluate("userIds.prov == 'abc' && !userIds.xchg", r));
+    BOOST_CHECK(evaluate("segments.iab has 'IAB1' && segments.iab has 7", r));
+    BOOST_CHECK(!evaluate("segments.iab has 'IAB2' || segments.other", r));
+    BOOST_CHECK(evaluate("!(exchange == 'rubicon' || isTest) && imp.count == 0",
+                         r));
+
+    BOOST_CHECK_THROW(evaluate("nosuchfield == 1", r), std::exception);
+    BOOST_CHECK_THROW(evaluate("exchange == 1", r), std::exception);
+    BOOST_CHECK_THROW(evaluate("location.dma =~ 'a'", r), std::exception);
+    BOOST_CHECK_THROW(evaluate("exchange == 'adx' &&", r), std::exception);
+    BOOST_CHECK_THROW(evaluate("(exchange == 'adx'", r), std::exception);
+    BOOST_CHECK_THROW(evaluate("exchange == 'adx", r), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( expressionSharing )
+{
+    ExpressionProgram program;
+
+    auto a = program.compile("exchange == 'adx' && location.dma > 3");
+    size_t size = program.size();
+
+    BOOST_CHECK_EQUAL(program.compile(" exchange=='adx'&&location.dma>3"), a);
+    BOOST_CHECK_EQUAL(program.size(), size);
+
+    // Only the new comparison and the new conjunction are added.
+    program.compile("location.dma > 3 && exchange == 'rubicon'");
+    BOOST_CHECK_EQUAL(program.size(), size + 2);
+}
+
+BOOST_AUTO_TEST_CASE( expressionFilter )
+{
+    ExpressionFilter filter;
+    ConfigSet mask;
+
+    AgentConfig c0;
+    setExpression(c0, "exchange == 'ex0'");
+
+    AgentConfig c1;
+    setExpression(c1, "exchange == 'ex0' || segments.seg has 1");
+
+    AgentConfig c2;
+
+    AgentConfig c3;
+    setExpression(c3, "exchange == 'ex0'");
+
+    BidRequest r0;
+
+    BidRequest r1;
+    addSegment(r1, "seg", segment(1));
+
+    title("expression-1");
+    addConfig(filter, 0, c0); mask.set(0);
+    addConfig(filter, 1, c1); mask.set(1);
+    addConfig(filter, 2, c2); mask.set(2);
+    addConfig(filter, 3, c3); mask.set(3);
+
+    check(filter, r0, "ex0", mask, { 0, 1, 2, 3 });
+    check(filter, r0, "ex1", mask, { 2 });
+    check(filter, r1, "ex1", mask, { 1, 2 });
+
+    title("expression-2");
+    removeConfig(filter, 0, c0); mask.reset(0);
+    removeConfig(filter, 2, c2); mask.reset(2);
+
+    check(filter, r0, "ex0", mask, { 1, 3 });
+    check(filter, r1, "ex1", mask, { 1 });
+}
@@ -1,3 +1,4 @@
 # filter_testing.mk
 
 $(eval $(call test,dynamic_filter_loading_test,rtb rtb_router,boost))
+$(eval $(call test,expression_filter_test,expression_filter static_filters,boost))
@@ -0,0 +1,139 @@
+/* multi_pipeline.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Implementation of the Multi Pipeline
+*/
+
+#include "multi_pipeline.h"
+#include "jml/arch/exception.h"
+
+#include <chrono>
+
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+MultiBidRequestPipeline::MultiBidRequestPipeline(
+        std::shared_ptr<ServiceProxies> proxies, std::string serviceName,
+        const Json::Value& json)
+    : BidRequestPipeline(std::move(proxies), std::move(serviceName))
+{
+    const Json::Value& stages = json["stages"];
+    if (!stages.isArray())
+        throw ML::Exception("multi pipeline needs an array of stages");
+
+    for (const auto& entry : stages) {
+        Group group;
+        if (entry.isArray()) {
+            for (const auto& stage : entry)
+                group.push_back(makeStage(stage));
+        }
+        else group.push_back(makeStage(entry));
+
+        if (group.empty())
+            throw ML::Exception("multi pipeline has an empty stage group");
+        groups.push_back(std::move(group));
+    }
+}
+
+MultiBidRequestPipeline::Stage
+MultiBidRequestPipeline::makeStage(const Json::Value& json)
+{
+    Stage stage;
+    stage.name = json.get("serviceName", json.get("type", "null")).asString();
+    stage.timeout = json.get("timeoutMs", 0).asDouble() / 1000.0;
+    stage.pipeline = BidRequestPipeline::create(
+            serviceName() + "." + stage.name, getServices(), json);
+    return stage;
+}
+
+template<typename Start>
+PipelineStatus
+MultiBidRequestPipeline::runGroup(
+        const Group& group, const char* phase, const Start& start)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    auto started = Clock::now();
+
+    std::vector<std::future<PipelineStatus> > results;
+    results.reserve(group.size());
+    for (const auto& stage : group)
+        results.push_back(start(*stage.pipeline));
+
+    for (size_t i = 0;  i < group.size();  ++i) {
+        const Stage& stage = group[i];
+
+        if (stage.timeout > 0.0) {
+            auto deadline = started + std::chrono::microseconds(
+                    int64_t(stage.timeout * 1000000));
+            if (results[i].wait_until(deadline) == std::future_status::timeout) {
+                recordHit("%s.%s.timeout", stage.name.c_str(), phase);
+                continue;
+            }
+        }
+
+        auto status = results[i].get();
+
+        std::chrono::duration<double, std::milli> latency
+            = Clock::now() - started;
+        recordOutcome(latency.count(), "%s.%s.latencyMs",
+                      stage.name.c_str(), phase);
+
+        // The other stages of the group are left behind.
+        if (status == PipelineStatus::Stop) {
+            recordHit("%s.%s.stop", stage.name.c_str(), phase);
+            return status;
+        }
+    }
+
+    return PipelineStatus::Continue;
+}
+
+PipelineStatus
+MultiBidRequestPipeline::preBidRequest(
+        const ExchangeConnector* exchange,
+        const HttpHeader& header,
+        const std::string& payload) {
+    for (const auto& group : groups) {
+        auto status = runGroup(group, "pre", [&](BidRequestPipeline& stage) {
+            return stage.preBidRequestAsync(exchange, header, payload);
+        });
+        if (status == PipelineStatus::Stop)
+            return status;
+    }
+    return PipelineStatus::Continue;
+}
+
+PipelineStatus
+MultiBidRequestPipeline::postBidRequest(
+        const ExchangeConnector* exchange,
+        const std::shared_ptr<Auction>& auction) {
+    for (const auto& group : groups) {
+        auto status = runGroup(group, "post", [&](BidRequestPipeline& stage) {
+            return stage.postBidRequestAsync(exchange, auction);
+        });
+        if (status == PipelineStatus::Stop)
+            return status;
+    }
+    return PipelineStatus::Continue;
+}
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+      PluginInterface<BidRequestPipeline>::registerPlugin("multi",
+          [](std::string serviceName,
+             std::shared_ptr<ServiceProxies> proxies,
+             Json::Value const &json)
+          {
+              return new MultiBidRequestPipeline(std::move(proxies), std::move(serviceName), json);
+          });
+    }
+} atInit;
+
+}
+
+} // namespace RTBKIT
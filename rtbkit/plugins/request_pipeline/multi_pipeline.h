@@ -0,0 +1,75 @@
+/* multi_pipeline.h
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   A Bid Request Pipeline made of several stages
+*/
+
+#pragma once
+
+#include "rtbkit/common/bid_request_pipeline.h"
+
+#include <vector>
+
+namespace RTBKIT {
+
+/** Runs a list of pipelines one after the other.  An entry of the "stages"
+    array is either the configuration of a pipeline or an array of them,
+    which are independent and run in parallel:
+
+        { "type": "multi",
+          "stages": [
+              { "type": "blacklist" },
+              [ { "type": "cookieSync", "timeoutMs": 5 },
+                { "type": "fraudScore", "timeoutMs": 3 } ]
+          ] }
+
+    The stages of a group are all started through their asynchronous entry
+    points before any of them is waited on, so that a synchronous stage runs
+    while the lookups of the asynchronous ones are in flight.  The request
+    stops as soon as a stage says so.  A stage that doesn't answer within its
+    timeoutMs is left behind and counted as Continue; without a timeoutMs it
+    is waited on for as long as it takes.
+
+    The latency of every stage and its timeouts are recorded under
+    "<stage>.pre" and "<stage>.post", where the stage is named after the
+    serviceName of its configuration, or its type.
+*/
+class MultiBidRequestPipeline : public BidRequestPipeline {
+public:
+
+    MultiBidRequestPipeline(
+            std::shared_ptr<Datacratic::ServiceProxies> proxies, std::string serviceName,
+            const Json::Value& json);
+
+    PipelineStatus
+    preBidRequest(
+            const ExchangeConnector* exchange,
+            const HttpHeader& header,
+            const std::string& payload);
+
+    PipelineStatus
+    postBidRequest(
+            const ExchangeConnector* exchange,
+            const std::shared_ptr<Auction>& auction);
+
+private:
+
+    struct Stage {
+        std::string name;
+        double timeout;         ///< Seconds; 0 is no timeout
+        std::shared_ptr<BidRequestPipeline> pipeline;
+    };
+
+    typedef std::vector<Stage> Group;
+    std::vector<Group> groups;
+
+    Stage makeStage(const Json::Value& json);
+
+    /** Start every stage of the group with start, then wait for them.
+        phase is "pre" or "post" for the metrics. */
+    template<typename Start>
+    PipelineStatus runGroup(const Group& group, const char* phase,
+                            const Start& start);
+};
+
+} // namespace RTBKIT
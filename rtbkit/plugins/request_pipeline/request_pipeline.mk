@@ -1 +1,2 @@
 $(eval $(call library,null_pipeline,null_pipeline.cc,rtb))
+$(eval $(call library,multi_pipeline,multi_pipeline.cc,rtb))
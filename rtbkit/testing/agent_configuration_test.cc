@@ -63,6 +63,15 @@ BOOST_AUTO_TEST_CASE( test_agent_configuration )
 
         };
 
+    // Changes after the first configuration are sent as deltas
+    int currentSections = 0;
+    listener.onConfigDelta = [&] (std::string agent,
+                                  std::shared_ptr<const AgentConfig> config,
+                                  int changedSections)
+        {
+            currentSections = changedSections;
+        };
+
     listener.init(proxies->config);
     listener.start();
 
@@ -76,6 +85,7 @@ BOOST_AUTO_TEST_CASE( test_agent_configuration )
     
     BOOST_CHECK_EQUAL(numConfigurations, 1);
     BOOST_CHECK_EQUAL(currentConfig->toJson(), agent.config.toJson());
+    BOOST_CHECK_EQUAL(currentSections, AgentConfig::ALL_SECTIONS);
 
     BOOST_CHECK_EQUAL(listener.getAgentEntry("bidding_agent").config,
                       currentConfig);
@@ -99,6 +109,7 @@ BOOST_AUTO_TEST_CASE( test_agent_configuration )
 
     BOOST_CHECK_EQUAL(numConfigurations, 2);
     BOOST_CHECK_EQUAL(currentConfig->toJson(), agent.config.toJson());
+    BOOST_CHECK_EQUAL(currentSections, AgentConfig::BID_CONTROL);
 
     BOOST_CHECK_EQUAL(listener.getAgentEntry("bidding_agent").config,
                       currentConfig);
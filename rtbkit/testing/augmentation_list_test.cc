@@ -186,3 +186,51 @@ BOOST_FIXTURE_TEST_CASE( test_merge, AugmentationFixture )
 
 }
 
+
+
+BOOST_FIXTURE_TEST_CASE( test_index, AugmentationFixture )
+{
+    unordered_map<string, AugmentationList> augmentations;
+
+    AugmentationList& list = augmentations["zeta"];
+    list[AccountKey()] = { {tag0}, data0 };
+    list[accA] = { {tag1}, data1 };
+    list[accBB] = { {tag2}, data2 };
+    list[accBC];
+    list[accBBA] = { {tag1}, data1 };
+
+    augmentations["alpha"][accBB] = { {tag1}, data1 };
+
+    AugmentationIndex index(augmentations);
+
+    auto all = [] (const string&) { return true; };
+
+    for (const AccountKey& account :
+            { AccountKey(), accA, accBB, accBC, accBBA,
+              AccountKey({ "A", "B" }), AccountKey({ "C" }) })
+    {
+        Json::Value expected;
+        for (const auto& aug : augmentations)
+            expected[aug.first] = aug.second.filterForAccount(account).toJson();
+
+        BOOST_CHECK_EQUAL(index.serializeForAccount(account, all),
+                          expected.toStringNoNewLine());
+
+        for (const auto& aug : augmentations) {
+            auto tags = index.tagsForAccount(aug.first, account);
+            BOOST_REQUIRE(tags);
+            BOOST_CHECK(*tags == aug.second.tagsForAccount(account));
+        }
+    }
+
+    BOOST_CHECK(!index.tagsForAccount("unknown", accA));
+
+    auto onlyZeta = [] (const string& name) { return name == "zeta"; };
+    Json::Value expected;
+    expected["zeta"] = list.filterForAccount(accBB).toJson();
+    BOOST_CHECK_EQUAL(index.serializeForAccount(accBB, onlyZeta),
+                      expected.toStringNoNewLine());
+
+    auto none = [] (const string&) { return false; };
+    BOOST_CHECK_EQUAL(index.serializeForAccount(accBB, none), "null");
+}
@@ -12,12 +12,99 @@
 #include "jml/utils/smart_ptr_utils.h"
 
 #include <array>
+#include <cmath>
+#include <thread>
 
 using namespace std;
 using namespace ML;
 
 namespace RTBKIT {
 
+/******************************************************************************/
+/* LOAD PROFILE                                                               */
+/******************************************************************************/
+
+LoadProfile::
+LoadProfile(Json::Value const & json) {
+    for (auto i = json.begin(), end = json.end(); i != end; ++i) {
+        Stage stage;
+        stage.rate = (*i)["rate"].asDouble();
+        stage.toRate = i->get("toRate", stage.rate).asDouble();
+        stage.duration = i->isMember("duration")
+            ? (*i)["duration"].asDouble()
+            : INFINITY;
+
+        if (stage.rate < 0 || stage.toRate < 0 || !(stage.duration > 0))
+            throw ML::Exception("invalid load profile stage: " + i->toString());
+
+        stages.push_back(stage);
+    }
+}
+
+double
+LoadProfile::
+duration() const {
+    double result = 0;
+    for (auto & stage : stages)
+        result += stage.duration;
+    return result;
+}
+
+double
+LoadProfile::
+rate(double elapsed) const {
+    for (auto & stage : stages) {
+        if (elapsed < stage.duration) {
+            if (stage.rate == stage.toRate) return stage.rate;
+            return stage.rate
+                + (stage.toRate - stage.rate) * elapsed / stage.duration;
+        }
+        elapsed -= stage.duration;
+    }
+    return 0;
+}
+
+double
+LoadProfile::
+next(double elapsed, double share) const {
+    // Find when the integral of our share of the rate since elapsed reaches
+    // one request.  The rate is linear within a stage, so it's a quadratic.
+    double needed = 1.0;
+    double stageStart = 0;
+
+    for (auto & stage : stages) {
+        double stageEnd = stageStart + stage.duration;
+        if (elapsed >= stageEnd) {
+            stageStart = stageEnd;
+            continue;
+        }
+
+        double t = elapsed - stageStart;
+        double slope = std::isinf(stage.duration) ? 0.0
+            : (stage.toRate - stage.rate) / stage.duration;
+        double current = (stage.rate + slope * t) * share;
+        slope *= share;
+
+        double left = stage.duration - t;
+        double inStage = std::isinf(left) ? INFINITY
+            : current * left + 0.5 * slope * left * left;
+
+        if (inStage >= needed) {
+            if (slope == 0) return elapsed + needed / current;
+            double dt = (std::sqrt(std::max(0.0, current * current
+                                            + 2 * slope * needed))
+                         - current) / slope;
+            return elapsed + dt;
+        }
+
+        needed -= inStage;
+        elapsed = stageStart = stageEnd;
+    }
+
+    return INFINITY;
+}
+
+
 /******************************************************************************/
 /* MOCK EXCHANGE                                                              */
 /******************************************************************************/
@@ -50,6 +137,11 @@ start(Json::Value const & configuration) {
     for(auto i = workers.begin(), end = workers.end(); i != end; ++i) {
         auto json = *i;
         auto count = json.get("threads", 1).asInt();
+        LoadProfile load(json["load"]);
+
+        // Each thread has its own connection and sends an equal share of
+        // the group's requests, staggered so that they don't go in bursts:
+        // thread j starts once the group as a whole has sent j / count.
 
         for(auto j = 0; j != count; ++j) {
             std::cerr << "starting worker " << running << std::endl;
@@ -57,6 +149,9 @@ start(Json::Value const & configuration) {
 
             threads.create_thread([=]() {
                 Worker worker(this, json["bids"], json["wins"], json["events"]);
+                worker.load = load;
+                worker.loadShare = 1.0 / count;
+                worker.loadOffset = j ? load.next(0, double(count) / j) : 0;
                 worker.run();
 
                 ML::atomic_dec(running);
@@ -89,7 +184,9 @@ Worker(MockExchange * exchange, BidSource *bid, WinSource *win, EventSource *eve
     events(event),
     rng(random()),
     winsDelay(0),
-    eventsDelay(0) {
+    eventsDelay(0),
+    loadShare(1.0),
+    loadOffset(0.0) {
 }
 
 
@@ -99,7 +196,9 @@ Worker(MockExchange * exchange, Json::Value bid, Json::Value win, Json::Value ev
     bids(BidSource::createBidSource(std::move(bid))),
     wins(WinSource::createWinSource(std::move(win))),
     events(EventSource::createEventSource(std::move(event))),
-    rng(random()) {
+    rng(random()),
+    loadShare(1.0),
+    loadOffset(0.0) {
 
     winsDelay = win.get("delay", 0).asInt();
     eventsDelay = event.get("delay", 0).asInt();
@@ -109,21 +208,56 @@ Worker(MockExchange * exchange, Json::Value bid, Json::Value win, Json::Value ev
 void
 MockExchange::Worker::
 run() {
-    while(bid()) {
+    if (!load.empty()) {
+        runOpenLoop();
+        return;
+    }
+
+    while(bid(Clock::now())) {
+        processWinsQueue();
+        processEventsQueue();
+    }
+}
+
+void
+MockExchange::Worker::
+runOpenLoop() {
+    auto start = Clock::now();
+
+    for (double due = loadOffset; due != INFINITY;
+         due = load.next(due, loadShare)) {
+
+        auto dueTime = start + std::chrono::duration_cast<Clock::duration>
+            (std::chrono::duration<double>(due));
+
+        // When we're behind, the request is sent straight away rather than
+        // skipped, and its latency includes the time that it waited.
+        auto now = Clock::now();
+        if (now < dueTime)
+            std::this_thread::sleep_until(dueTime);
+        else if (now - dueTime > std::chrono::milliseconds(1))
+            exchange->recordHit("behindSchedule");
+
+        if (!bid(dueTime)) break;
+
         processWinsQueue();
         processEventsQueue();
     }
 }
 
 bool
-MockExchange::Worker::bid() {
+MockExchange::Worker::bid(Clock::time_point due) {
 
     for (;;) {
         auto br = bids->sendBidRequest();
         exchange->recordHit("requests");
-                auto response = bids->receiveBid();
+        auto response = bids->receiveBid();
         exchange->recordHit("responses");
 
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>
+            (Clock::now() - due).count();
+        exchange->latency.record(micros);
+
         vector<ExchangeSource::Bid> items = response.second;
 
         if (!response.first || items.empty()) {
@@ -4,6 +4,15 @@
 
     Mock exchanges used for testing various types of bid request behaviours.
 
+    By default each worker is closed-loop: it sends a bid request, waits for
+    the response and sends the next one.  When the router slows down the
+    workers slow down with it, so the requests that would have been sent in
+    the meantime are never measured and the latencies are under-reported.
+    Giving a worker group a load profile makes it open-loop instead: the
+    requests are scheduled at the profile's rate and their latency is
+    measured from when they were due to be sent, whether or not the worker
+    was still waiting on an earlier response at the time.
+
     \todo This a work in progress that needs to be generic-ified.
 
 */
@@ -19,12 +28,60 @@
 #include "soa/types/id.h"
 #include "soa/types/date.h"
 #include "jml/utils/rng.h"
+#include "rtbkit/common/latency_histogram.h"
 
 #include <netdb.h>
+#include <chrono>
 #include <vector>
 
 namespace RTBKIT {
 
+/******************************************************************************/
+/* LOAD PROFILE                                                               */
+/******************************************************************************/
+
+/** Rate at which an open-loop worker group sends its bid requests over time.
+
+    The profile is a sequence of stages that each last for a duration and go
+    linearly from one rate to another, so that a stage is a step when the
+    two rates are the same and a ramp when they aren't.  It's configured as
+
+        "load": [ { "rate": 1000, "duration": 60 },
+                  { "rate": 1000, "toRate": 20000, "duration": 600 } ]
+
+    with the rates in requests per second for the whole group.  A stage
+    without a duration lasts forever.  The workers stop once the last stage
+    is over.
+*/
+struct LoadProfile
+{
+    LoadProfile() {}
+    LoadProfile(Json::Value const & json);
+
+    struct Stage {
+        double rate;
+        double toRate;
+        double duration;
+    };
+
+    std::vector<Stage> stages;
+
+    bool empty() const { return stages.empty(); }
+
+    /** Total duration in seconds. */
+    double duration() const;
+
+    /** Rate in requests per second at the given number of seconds since the
+        start, or zero once the profile is over. */
+    double rate(double elapsed) const;
+
+    /** Time since the start at which the request after one due at elapsed
+        is due, for a worker that sends the given share of the requests.
+        Returns infinity once the profile is over. */
+    double next(double elapsed, double share) const;
+};
+
+
 /******************************************************************************/
 /* MOCK EXCHANGE                                                              */
 /******************************************************************************/
@@ -46,8 +103,17 @@ struct MockExchange : public Datacratic::ServiceBase
 
     void add(BidSource * bids, WinSource * wins, EventSource * events);
 
+    /** Latencies of the bid requests in microseconds, from when they were
+        due to be sent until the response was received. */
+    LatencyHistogram::Snapshot latencies() const {
+        return latency.snapshot();
+    }
+
 private:
+    typedef std::chrono::steady_clock Clock;
+
     int running;
+    LatencyHistogram latency;
 
     struct Worker {
         Worker(MockExchange * exchange, BidSource *bid, WinSource *win, EventSource *event);
@@ -69,7 +135,8 @@ private:
         };
 
         void run();
-        bool bid();
+        void runOpenLoop();
+        bool bid(Clock::time_point due);
 
         std::pair<bool, Amount>
         isWin(const BidRequest&, const ExchangeSource::Bid& bid);
@@ -87,6 +154,11 @@ private:
         int winsDelay;
         int eventsDelay;
 
+        /// Open-loop schedule; closed-loop when empty
+        LoadProfile load;
+        double loadShare;   ///< Share of the group's requests sent by us
+        double loadOffset;  ///< Seconds to stagger our first request by
+
         std::deque<Win> winsQueue;
         std::deque<Event> eventsQueue;
 
@@ -46,8 +46,15 @@ int main(int argc, char ** argv)
     RTBKIT::MockExchange exchange(args);
     exchange.start(result);
 
+    // Latency percentiles of the requests over the last period
+    auto last = exchange.latencies();
     for(;;) {
         this_thread::sleep_for(chrono::seconds(10));
+
+        auto current = exchange.latencies();
+        cerr << "latency: " << (current - last).toJson().toStringNoNewLine()
+             << endl;
+        last = current;
     }
 
     return 0;
@@ -86,3 +86,78 @@ BOOST_AUTO_TEST_CASE( win_cost_model_test )
     BOOST_CHECK_EQUAL(events["router.cummulatedAuthorizedPrice"], count * 505);
 }
 
+
+namespace {
+
+struct LinearWinCostModel : public WinCostModel::Compiled {
+    LinearWinCostModel(Json::Value const & data) :
+        m(data["m"].asDouble()),
+        b(Amount::fromJson(data["b"]))
+    {
+    }
+
+    Amount evaluate(Bid const & bid,
+                    Amount const & price,
+                    Json::Value const & win) const
+    {
+        return price * m + b;
+    }
+
+    double m;
+    Amount b;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( compiled_win_cost_model_test )
+{
+    WinCostModel::registerModel("test", linearWinCostModel);
+    WinCostModel::registerCompiledModel(
+            "testCompiled",
+            [] (Json::Value const & data) {
+                return std::make_shared<LinearWinCostModel>(data);
+            });
+
+    Json::Value data;
+    data["m"] = 0.5;
+    data["b"] = MicroUSD(5.0).toJson();
+
+    Bid bid;
+    Amount price = MicroUSD(1000.0);
+
+    WinCostModel function("test", data);
+    WinCostModel compiled("testCompiled", data);
+    BOOST_CHECK_EQUAL(function.evaluate(bid, price), MicroUSD(505.0));
+    BOOST_CHECK_EQUAL(compiled.evaluate(bid, price), MicroUSD(505.0));
+
+    compiled.precompile();
+    BOOST_CHECK(compiled.compiled);
+    BOOST_CHECK_EQUAL(compiled.evaluate(bid, price), MicroUSD(505.0));
+
+    // Unknown models only fail when they're compiled
+    WinCostModel unknown("doesNotExist", data);
+    BOOST_CHECK_THROW(unknown.compile(), ML::Exception);
+
+    // Function models see the win metadata in their data
+    WinCostModel::registerModel(
+            "testWin",
+            [] (WinCostModel const & model, Bid const &, Amount const & price) {
+                return model.data["win"].isNull() ? price : price * 2.0;
+            });
+    WinCostModel withWin("testWin", Json::Value());
+    BOOST_CHECK_EQUAL(withWin.evaluate(bid, price), price);
+    BOOST_CHECK_EQUAL(withWin.evaluate(bid, price, Json::Value("meta")),
+                      MicroUSD(2000.0));
+
+    std::vector<WinCostModel::Compiled::Evaluation> batch(3);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i].bid = &bid;
+        batch[i].price = MicroUSD(1000.0 * (i + 1));
+        batch[i].win = nullptr;
+    }
+    compiled.evaluate(batch);
+
+    BOOST_CHECK_EQUAL(batch[0].cost, MicroUSD(505.0));
+    BOOST_CHECK_EQUAL(batch[1].cost, MicroUSD(1005.0));
+    BOOST_CHECK_EQUAL(batch[2].cost, MicroUSD(1505.0));
+}
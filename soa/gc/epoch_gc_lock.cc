@@ -0,0 +1,270 @@
+/* epoch_gc_lock.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Epoch based reclamation with a read side that doesn't share any cache line
+   between threads.
+*/
+
+#include "soa/gc/epoch_gc_lock.h"
+#include "jml/utils/guard.h"
+
+#include <boost/bind.hpp>
+#include <sched.h>
+#include <iostream>
+#include <limits>
+#include <new>
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* EPOCH GC LOCK                                                             */
+/*****************************************************************************/
+
+EpochGcLock::ThreadEntry::
+~ThreadEntry()
+{
+    if (owner) owner->releaseSlot(*this);
+}
+
+EpochGcLock::
+EpochGcLock()
+    : epoch_(1), pending_(0), running(0)
+{
+}
+
+EpochGcLock::
+~EpochGcLock()
+{
+    // Nobody can be reading anything protected by a lock that's going away.
+    runBatches(batches);
+}
+
+void
+EpochGcLock::
+acquireSlot(ThreadEntry & entry)
+{
+    std::lock_guard<std::mutex> guard(slotsLock);
+
+    Slot * slot = nullptr;
+    for (auto & other : slots) {
+        if (other->inUse) continue;
+        slot = other.get();
+        break;
+    }
+
+    if (!slot) {
+        void * mem;
+        if (posix_memalign(&mem, CacheLineSize, sizeof(Slot)))
+            throw std::bad_alloc();
+        slot = new (mem) Slot();
+        slot->epoch.store(0);
+        slots.emplace_back(slot);
+    }
+
+    slot->inUse = true;
+    entry.owner = this;
+    entry.slot = slot;
+}
+
+void
+EpochGcLock::
+releaseSlot(ThreadEntry & entry)
+{
+    std::lock_guard<std::mutex> guard(slotsLock);
+
+    // A thread that exits within a critical section can't be reading
+    // anything anymore.
+    entry.slot->epoch.store(0, std::memory_order_release);
+    entry.slot->inUse = false;
+    entry.slot = nullptr;
+    entry.owner = nullptr;
+}
+
+uint64_t
+EpochGcLock::
+oldestActiveEpoch()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+
+    std::lock_guard<std::mutex> guard(slotsLock);
+    for (auto & slot : slots) {
+        uint64_t epoch = slot->epoch.load(std::memory_order_acquire);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+
+    return oldest;
+}
+
+void
+EpochGcLock::
+runBatches(std::deque<Batch> & batches)
+{
+    for (Batch & batch : batches) {
+        for (auto & work : batch.work)
+            work();
+    }
+    batches.clear();
+}
+
+void
+EpochGcLock::
+reclaim()
+{
+    std::deque<Batch> ready;
+
+    {
+        std::unique_lock<std::mutex> guard(deferLock, std::try_to_lock);
+        if (!guard || batches.empty()) return;
+
+        // Threads have to enter in an epoch newer than the last batch before
+        // it can be run.
+        uint64_t current = epoch_.load();
+        if (batches.back().epoch >= current)
+            epoch_.compare_exchange_strong(current, current + 1);
+
+        uint64_t oldest = oldestActiveEpoch();
+
+        while (!batches.empty() && batches.front().epoch < oldest) {
+            pending_.fetch_sub(batches.front().work.size());
+            ready.push_back(std::move(batches.front()));
+            batches.pop_front();
+        }
+
+        if (ready.empty()) return;
+        running.fetch_add(1);
+    }
+
+    ML::Call_Guard guard([&] { running.fetch_sub(1); });
+    runBatches(ready);
+}
+
+void
+EpochGcLock::
+visibleBarrier()
+{
+    if (isLockedShared())
+        throw ML::Exception("visibleBarrier called in a critical section");
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t target = epoch_.fetch_add(1) + 1;
+
+    // Slots are only freed with the lock so they can be waited on without
+    // holding slotsLock, which would keep new threads from entering.
+    std::vector<Slot *> toWait;
+    {
+        std::lock_guard<std::mutex> guard(slotsLock);
+        for (auto & slot : slots)
+            toWait.push_back(slot.get());
+    }
+
+    for (Slot * slot : toWait) {
+        for (;;) {
+            uint64_t epoch = slot->epoch.load(std::memory_order_acquire);
+            if (!epoch || epoch >= target) break;
+            sched_yield();
+        }
+    }
+}
+
+void
+EpochGcLock::
+deferBarrier()
+{
+    if (isLockedShared())
+        throw ML::Exception("deferBarrier called in a critical section");
+
+    std::deque<Batch> toRun;
+    {
+        std::lock_guard<std::mutex> guard(deferLock);
+        toRun.swap(batches);
+        pending_.store(0);
+        running.fetch_add(1);
+    }
+
+    {
+        ML::Call_Guard guard([&] { running.fetch_sub(1); });
+        visibleBarrier();
+        runBatches(toRun);
+    }
+
+    // Batches popped by other threads before ours have to finish too.
+    while (running.load())
+        sched_yield();
+}
+
+void
+EpochGcLock::
+defer(boost::function<void ()> work)
+{
+    // Pairs with the fence in lockShared(); see there.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    {
+        std::lock_guard<std::mutex> guard(deferLock);
+
+        uint64_t epoch = epoch_.load();
+        if (batches.empty() || batches.back().epoch != epoch)
+            batches.push_back(Batch { epoch, {} });
+
+        batches.back().work.push_back(std::move(work));
+        pending_.fetch_add(1);
+    }
+
+    reclaim();
+}
+
+void
+EpochGcLock::
+defer(void (work) (void *), void * arg)
+{
+    defer(boost::bind(work, arg));
+}
+
+void
+EpochGcLock::
+defer(void (work) (void *, void *), void * arg1, void * arg2)
+{
+    defer(boost::bind(work, arg1, arg2));
+}
+
+void
+EpochGcLock::
+defer(void (work) (void *, void *, void *), void * arg1, void * arg2, void * arg3)
+{
+    defer(boost::bind(work, arg1, arg2, arg3));
+}
+
+void
+EpochGcLock::
+dump()
+{
+    size_t active = 0, used = 0, total = 0;
+    {
+        std::lock_guard<std::mutex> guard(slotsLock);
+        total = slots.size();
+        for (auto & slot : slots) {
+            if (slot->inUse) ++used;
+            if (slot->epoch.load()) ++active;
+        }
+    }
+
+    size_t numBatches;
+    {
+        std::lock_guard<std::mutex> guard(deferLock);
+        numBatches = batches.size();
+    }
+
+    cerr << "epoch " << epoch_.load()
+         << " slots " << active << "/" << used << "/" << total
+         << " (active/used/allocated)"
+         << " deferred " << pending_.load() << " in " << numBatches
+         << " batches, " << running.load() << " running" << endl;
+}
+
+} // namespace Datacratic
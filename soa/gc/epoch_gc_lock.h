@@ -0,0 +1,280 @@
+/* epoch_gc_lock.h                                                 -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Epoch based reclamation with a read side that doesn't share any cache line
+   between threads.
+*/
+
+#ifndef __mmap__epoch_gc_lock_h__
+#define __mmap__epoch_gc_lock_h__
+
+#include "jml/arch/exception.h"
+#include "jml/arch/thread_specific.h"
+#include "jml/compiler/compiler.h"
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** Alternative to GcLock for read heavy workloads on many cores.
+
+    Every shared critical section of a GcLock does two atomic operations on
+    the lock's single Data word so readers on different cores keep stealing
+    that cache line from each other. Here each thread instead publishes the
+    epoch it entered in into its own cache line sized slot and only reads the
+    global epoch, which is written to when deferred work is queued, so the
+    read side costs a store and a fence on lines that never move.
+
+    Deferred work is tagged with the global epoch and queued in a batch per
+    epoch. A batch is run once no slot holds an epoch at or below its tag,
+    which is checked by scanning the slots on defer and, while work is
+    pending, every few unlocks.
+
+    The interface is a subset of GcLockBase's (shared critical sections,
+    SharedGuard, defer and the barriers) so RcuProtected and the other users
+    of shared sections can pick either lock. There are no exclusive or
+    speculative critical sections and the lock can't be shared between
+    processes.
+*/
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* EPOCH GC LOCK                                                             */
+/*****************************************************************************/
+
+struct EpochGcLock : public boost::noncopyable {
+
+    enum RunDefer {
+        RD_NO = 0,      ///< Don't run deferred work on this call
+        RD_YES = 1      ///< Potentially run deferred work on this call
+    };
+
+    enum DoLock {
+        DONT_LOCK = 0,
+        DO_LOCK = 1
+    };
+
+    enum {
+        CacheLineSize = 64,
+
+        /** Number of unlocks between scans of the slots made by a thread
+            while there's deferred work pending.
+        */
+        ReclaimInterval = 64
+    };
+
+    /** Epoch published by a thread; 0 when it's not in a critical section.
+        Each slot has a cache line to itself.
+    */
+    struct Slot {
+        std::atomic<uint64_t> epoch;
+        bool inUse;
+    } JML_ALIGNED(CacheLineSize);
+
+    /// A thread's bookkeeping info about each lock
+    struct ThreadEntry {
+        ThreadEntry()
+            : owner(nullptr), slot(nullptr), nesting(0), unlocks(0)
+        {
+        }
+
+        ~ThreadEntry();
+
+        EpochGcLock * owner;
+        Slot * slot;
+        int nesting;            ///< Depth of nested shared sections
+        unsigned unlocks;       ///< Outermost unlocks done by the thread
+    };
+
+    EpochGcLock();
+    ~EpochGcLock();
+
+    uint64_t currentEpoch() const
+    {
+        return epoch_.load(std::memory_order_relaxed);
+    }
+
+    JML_ALWAYS_INLINE ThreadEntry & getEntry() const
+    {
+        Info::PerThreadInfo * info = nullptr;
+        ThreadEntry * entry = threadInfo.get(info);
+        if (JML_UNLIKELY(!entry->slot))
+            const_cast<EpochGcLock *>(this)->acquireSlot(*entry);
+        return *entry;
+    }
+
+    void lockShared(RunDefer runDefer = RD_YES)
+    {
+        ThreadEntry & entry = getEntry();
+        if (entry.nesting++) return;
+
+        // A stale epoch only delays reclamation. The fence pairs with the
+        // one in defer(): either the slot is seen by the scan or the
+        // critical section sees the value that replaced the deferred one.
+        entry.slot->epoch.store(
+                epoch_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void unlockShared(RunDefer runDefer = RD_YES)
+    {
+        ThreadEntry & entry = getEntry();
+        if (entry.nesting <= 0)
+            throw ML::Exception("unlockShared without lockShared");
+        if (--entry.nesting) return;
+
+        entry.slot->epoch.store(0, std::memory_order_release);
+
+        if (runDefer
+                && JML_UNLIKELY(pending_.load(std::memory_order_relaxed))
+                && ++entry.unlocks % ReclaimInterval == 0)
+            reclaim();
+    }
+
+    bool isLockedShared() const
+    {
+        return getEntry().nesting > 0;
+    }
+
+    struct SharedGuard {
+        SharedGuard(EpochGcLock & lock,
+                    RunDefer runDefer = RD_YES,
+                    DoLock doLock = DO_LOCK)
+            : lock_(lock),
+              runDefer_(runDefer),
+              doLock_(doLock)
+        {
+            if (doLock_)
+                lock_.lockShared(runDefer_);
+        }
+
+        ~SharedGuard()
+        {
+            if (doLock_)
+                lock_.unlockShared(runDefer_);
+        }
+
+        void lock()
+        {
+            if (doLock_)
+                return;
+            lock_.lockShared(runDefer_);
+            doLock_ = DO_LOCK;
+        }
+
+        void unlock()
+        {
+            if (!doLock_)
+                return;
+            lock_.unlockShared(runDefer_);
+            doLock_ = DONT_LOCK;
+        }
+
+        EpochGcLock & lock_;
+        const RunDefer runDefer_;  ///< Can this do deferred work?
+        DoLock doLock_;      ///< Do we really lock?
+    };
+
+    /** Wait until everything that's currently visible is no longer
+        accessible.
+
+        Throws if called from within a critical section as it would wait for
+        itself.
+    */
+    void visibleBarrier();
+
+    /** Wait until all defer functions that have been registered have been
+        run.
+
+        Throws if called from within a critical section as it would wait for
+        itself.
+    */
+    void deferBarrier();
+
+    void defer(boost::function<void ()> work);
+
+    typedef void (WorkFn1) (void *);
+    typedef void (WorkFn2) (void *, void *);
+    typedef void (WorkFn3) (void *, void *, void *);
+
+    void defer(void (work) (void *), void * arg);
+    void defer(void (work) (void *, void *), void * arg1, void * arg2);
+    void defer(void (work) (void *, void *, void *), void * arg1, void * arg2, void * arg3);
+
+    template<typename T>
+    void defer(void (*work) (T *), T * arg)
+    {
+        defer((WorkFn1 *)work, (void *)arg);
+    }
+
+    template<typename T>
+    static void doDelete(T * arg)
+    {
+        delete arg;
+    }
+
+    template<typename T>
+    void deferDelete(T * toDelete)
+    {
+        if (!toDelete) return;
+        defer(doDelete<T>, toDelete);
+    }
+
+    void dump();
+
+private:
+
+    /** Work deferred while the global epoch had a given value. */
+    struct Batch {
+        uint64_t epoch;
+        std::vector< boost::function<void ()> > work;
+    };
+
+    void acquireSlot(ThreadEntry & entry);
+    void releaseSlot(ThreadEntry & entry);
+
+    /** Lowest epoch published in a slot or uint64_t(-1) if no thread is in a
+        critical section.
+    */
+    uint64_t oldestActiveEpoch();
+
+    /** Runs the batches that no thread can still be reading. Returns
+        immediately if another thread is already queuing or reclaiming.
+    */
+    void reclaim();
+
+    static void runBatches(std::deque<Batch> & batches);
+
+    // Read by every critical section so it gets its own line, shared with
+    // nothing that's written to more often.
+    std::atomic<uint64_t> epoch_;
+    std::atomic<uint64_t> pending_;    ///< Number of deferred calls queued
+    char padding_[CacheLineSize - 2 * sizeof(uint64_t)];
+
+    struct FreeSlot {
+        void operator () (Slot * slot) const { free(slot); }
+    };
+
+    std::mutex slotsLock;
+    std::vector< std::unique_ptr<Slot, FreeSlot> > slots;
+
+    std::mutex deferLock;
+    std::deque<Batch> batches;
+    std::atomic<int> running;          ///< Threads running popped batches
+
+    // Declared last so that the entries release their slots before the
+    // slots go away.
+    typedef ML::ThreadSpecificInstanceInfo<ThreadEntry, EpochGcLock> Info;
+    mutable Info threadInfo;
+};
+
+} // namespace Datacratic
+
+#endif /* __mmap__epoch_gc_lock_h__ */
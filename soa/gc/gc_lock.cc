@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <iostream>
+#include <atomic>
 
 using namespace std;
 using namespace ML;
@@ -36,6 +37,11 @@ int32_t gcLockStartingEpoch = 0;
 
 int32_t SpeculativeThreshold = 5;
 
+/** Bytes of the entries of every DeferredList.  Relaxed, as it's only ever
+    sampled for monitoring.
+*/
+static std::atomic<uint64_t> deferredEntryBytes(0);
+
 /** A safe comparaison of epochs that deals with potential overflows.
     \todo So many possible bit twiddling hacks... Must resist...
 */
@@ -163,6 +169,8 @@ struct GcLockBase::DeferredList {
     {
         //boost::lock_guard<ML::Spinlock> guard(lock);
         deferred1.push_back(DeferredEntry1(fn, data));
+        deferredEntryBytes.fetch_add(sizeof(DeferredEntry1),
+                                     std::memory_order_relaxed);
         return true;
     }
 
@@ -171,6 +179,8 @@ struct GcLockBase::DeferredList {
     {
         //boost::lock_guard<ML::Spinlock> guard(lock);
         deferred2.push_back(DeferredEntry2(fn, data1, data2));
+        deferredEntryBytes.fetch_add(sizeof(DeferredEntry2),
+                                     std::memory_order_relaxed);
         return true;
     }
 
@@ -179,6 +189,8 @@ struct GcLockBase::DeferredList {
     {
         //boost::lock_guard<ML::Spinlock> guard(lock);
         deferred3.push_back(DeferredEntry3(fn, data1, data2, data3));
+        deferredEntryBytes.fetch_add(sizeof(DeferredEntry3),
+                                     std::memory_order_relaxed);
         return true;
     }
         
@@ -190,6 +202,11 @@ struct GcLockBase::DeferredList {
 
     void runAll()
     {
+        deferredEntryBytes.fetch_sub(deferred1.size() * sizeof(DeferredEntry1)
+                                     + deferred2.size() * sizeof(DeferredEntry2)
+                                     + deferred3.size() * sizeof(DeferredEntry3),
+                                     std::memory_order_relaxed);
+
         // Spinlock should be unnecessary...
         //boost::lock_guard<ML::Spinlock> guard(lock);
 
@@ -815,6 +832,13 @@ doDefer(void (fn) (Args...), Args... args)
     return;
 }
 
+uint64_t
+GcLockBase::
+deferredBytes()
+{
+    return deferredEntryBytes.load(std::memory_order_relaxed);
+}
+
 void
 GcLockBase::
 defer(void (work) (void *), void * arg)
@@ -556,6 +556,11 @@ public:
 
     void dump();
 
+    /** Bytes of deferred work waiting to be run, over every GcLock of the
+        process.  Only the entries are counted, not what they will free.
+    */
+    static uint64_t deferredBytes();
+
 protected:
     Data* data;
 
@@ -14,9 +14,13 @@
 
 namespace Datacratic {
 
-template<typename T>
+/** The lock type can be any lock with GcLock's shared critical sections and
+    defer functions, such as EpochGcLock.
+*/
+
+template<typename T, typename Lock = GcLock>
 struct RcuLocked {
-    RcuLocked(T * ptr = nullptr, GcLock * lock = nullptr)
+    RcuLocked(T * ptr = nullptr, Lock * lock = nullptr)
         : ptr(ptr), lock(lock)
     {
         if (lock)
@@ -25,7 +29,7 @@ struct RcuLocked {
 
     /// Transfer from another lock
     template<typename T2>
-    RcuLocked(T * ptr, RcuLocked<T2> && other)
+    RcuLocked(T * ptr, RcuLocked<T2, Lock> && other)
         : ptr(ptr), lock(other.lock)
     {
         other.lock = nullptr;
@@ -34,7 +38,7 @@ struct RcuLocked {
 
     /// Copy from another lock
     template<typename T2>
-    RcuLocked(T * ptr, const RcuLocked<T2> & other)
+    RcuLocked(T * ptr, const RcuLocked<T2, Lock> & other)
         : ptr(ptr), lock(other.lock)
     {
         if (lock)
@@ -42,7 +46,7 @@ struct RcuLocked {
     }
 
     template<typename T2>
-    RcuLocked(RcuLocked<T2> && other)
+    RcuLocked(RcuLocked<T2, Lock> && other)
         : ptr(other.ptr), lock(other.lock)
     {
         other.lock = nullptr;
@@ -61,7 +65,7 @@ struct RcuLocked {
     }
 
     template<typename T2>
-    RcuLocked & operator = (RcuLocked<T2> && other)
+    RcuLocked & operator = (RcuLocked<T2, Lock> && other)
     {
         unlock();
         lock = other.lock;
@@ -85,7 +89,7 @@ struct RcuLocked {
     }
 
     T * ptr;
-    GcLock * lock;
+    Lock * lock;
 
     operator T * () const
     {
@@ -107,19 +111,19 @@ struct RcuLocked {
     }
 };
 
-template<typename T>
+template<typename T, typename Lock = GcLock>
 struct RcuProtected {
     T * val;
-    GcLock * lock;
+    Lock * lock;
 
     template<typename... Args>
-    RcuProtected(GcLock & lock, Args&&... args)
+    RcuProtected(Lock & lock, Args&&... args)
         : val(new T(std::forward<Args>(args)...)), lock(&lock)
     {
         //ExcAssert(this->lock);
     }
 
-    RcuProtected(T * val, GcLock & lock)
+    RcuProtected(T * val, Lock & lock)
         : val(val), lock(&lock)
     {
         //ExcAssert(this->lock);
@@ -151,22 +155,22 @@ struct RcuProtected {
 
     JML_IMPLEMENT_OPERATOR_BOOL(val);
 
-    RcuLocked<T> operator () ()
+    RcuLocked<T, Lock> operator () ()
     {
         //ExcAssert(lock);
-        return RcuLocked<T>(val, lock);
+        return RcuLocked<T, Lock>(val, lock);
     }
 
-    RcuLocked<const T> operator () () const
+    RcuLocked<const T, Lock> operator () () const
     {
         //ExcAssert(lock);
-        return RcuLocked<const T>(val, lock);
+        return RcuLocked<const T, Lock>(val, lock);
     }
 
-    RcuLocked<const T> getImmutable() const
+    RcuLocked<const T, Lock> getImmutable() const
     {
         //ExcAssert(lock);
-        return RcuLocked<const T>(val, lock);
+        return RcuLocked<const T, Lock>(val, lock);
     }
 
     T * unsafePtr() const
@@ -192,9 +196,9 @@ struct RcuProtected {
         return std::unique_ptr<T>(ML::atomic_xchg(val, newVal));
     }
     
-    bool cmp_xchg(RcuLocked<T> & current, std::auto_ptr<T> & newValue,
+    bool cmp_xchg(RcuLocked<T, Lock> & current, std::auto_ptr<T> & newValue,
                   bool defer = true,
-                  void (*cleanup) (T *) = GcLock::doDelete<T>)
+                  void (*cleanup) (T *) = Lock::template doDelete<T>)
     {
         // Make sure everything written behind newValue is visible before
         // the update.  This may not be necessary as cmp_xchg may assure
@@ -229,27 +233,29 @@ private:
     void operator = (const RcuProtected & other);
 };
 
-template<typename T>
-struct RcuProtectedCopyable : public RcuProtected<T> {
+template<typename T, typename Lock = GcLock>
+struct RcuProtectedCopyable : public RcuProtected<T, Lock> {
+
+    typedef RcuProtected<T, Lock> Base;
 
-    using RcuProtected<T>::val;
-    using RcuProtected<T>::lock;
-    using RcuProtected<T>::operator ();
-    using RcuProtected<T>::replace;
+    using Base::val;
+    using Base::lock;
+    using Base::operator ();
+    using Base::replace;
 
     template<typename... Args>
-    RcuProtectedCopyable(GcLock & lock, Args&&... args)
-        : RcuProtected<T>(lock, std::forward<Args>(args)...)
+    RcuProtectedCopyable(Lock & lock, Args&&... args)
+        : Base(lock, std::forward<Args>(args)...)
     {
     }
 
     RcuProtectedCopyable(const RcuProtectedCopyable & other)
-        : RcuProtected<T>(new T(*other()), *other.lock)
+        : Base(new T(*other()), *other.lock)
     {
     }
 
     RcuProtectedCopyable(RcuProtectedCopyable && other)
-        : RcuProtected<T>(static_cast<RcuProtected<T> &&>(other))
+        : Base(static_cast<Base &&>(other))
     {
     }
 
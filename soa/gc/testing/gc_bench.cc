@@ -0,0 +1,102 @@
+/** gc_bench.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Times shared critical sections of GcLock and EpochGcLock under contention
+    from 1 to 64 reader threads while a writer keeps replacing the value they
+    read and deferring the deletion of the old one.
+
+    Prints the number of critical sections per second for each lock so that
+    the two can be compared on a given machine.
+
+*/
+
+#include "soa/gc/gc_lock.h"
+#include "soa/gc/epoch_gc_lock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace Datacratic;
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+struct Value
+{
+    Value(uint64_t x) : x(x) {}
+    uint64_t x;
+};
+
+template<typename Lock>
+void bench(const char* name, size_t numThreads, size_t ms, size_t writeUs)
+{
+    Lock lock;
+    atomic<Value*> value(new Value(0));
+    atomic<bool> done(false);
+    atomic<uint64_t> checksum(0);
+
+    vector<uint64_t> sections(numThreads, 0);
+    vector<thread> readers;
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        readers.emplace_back([&, i] {
+                    uint64_t n = 0, sink = 0;
+                    while (!done.load(memory_order_relaxed)) {
+                        typename Lock::SharedGuard guard(lock);
+                        sink += value.load(memory_order_acquire)->x;
+                        ++n;
+                    }
+                    sections[i] = n;
+                    checksum += sink;
+                });
+    }
+
+    uint64_t writes = 0;
+    auto start = chrono::steady_clock::now();
+    auto end = start + chrono::milliseconds(ms);
+
+    while (chrono::steady_clock::now() < end) {
+        Value* old = value.exchange(new Value(++writes));
+        lock.deferDelete(old);
+        if (writeUs) this_thread::sleep_for(chrono::microseconds(writeUs));
+    }
+
+    done = true;
+    for (auto& reader : readers) reader.join();
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    double secs = chrono::duration_cast<chrono::microseconds>(elapsed).count() / 1e6;
+
+    lock.deferBarrier();
+    delete value.load();
+
+    uint64_t total = 0;
+    for (uint64_t n : sections) total += n;
+    if (!checksum) fprintf(stderr, "nothing was read\n");
+
+    printf("%-12s %3zu threads %10.2f M sections/s %8.2f M/s/thread %10.0f writes/s\n",
+            name, numThreads, total / secs / 1e6,
+            total / secs / 1e6 / numThreads, writes / secs);
+}
+
+int main(int argc, char** argv)
+{
+    size_t ms = argc > 1 ? atoi(argv[1]) : 1000;
+    size_t writeUs = argc > 2 ? atoi(argv[2]) : 100;
+    size_t maxThreads = argc > 3 ? atoi(argv[3]) : 64;
+
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        bench<GcLock>("GcLock", threads, ms, writeUs);
+        bench<EpochGcLock>("EpochGcLock", threads, ms, writeUs);
+    }
+
+    return 0;
+}
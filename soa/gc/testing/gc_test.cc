@@ -9,6 +9,7 @@
 #define BOOST_TEST_DYN_LINK
 
 #include "soa/gc/gc_lock.h"
+#include "soa/gc/epoch_gc_lock.h"
 #include "jml/utils/string_functions.h"
 #include "jml/utils/exc_assert.h"
 #include "jml/utils/guard.h"
@@ -64,6 +65,39 @@ BOOST_AUTO_TEST_CASE ( test_gc )
     BOOST_CHECK(deferred);
 }
 
+BOOST_AUTO_TEST_CASE ( test_epoch_gc_lock )
+{
+    EpochGcLock gc;
+
+    gc.lockShared();
+    gc.lockShared();
+    BOOST_CHECK(gc.isLockedShared());
+
+    bool deferred = false;
+    gc.defer([&] () { deferred = true; });
+
+    gc.unlockShared();
+    BOOST_CHECK(gc.isLockedShared());
+    BOOST_CHECK(!deferred);
+
+    BOOST_CHECK_THROW(gc.visibleBarrier(), ML::Exception);
+    BOOST_CHECK_THROW(gc.deferBarrier(), ML::Exception);
+
+    gc.unlockShared();
+    BOOST_CHECK(!gc.isLockedShared());
+    BOOST_CHECK_THROW(gc.unlockShared(), ML::Exception);
+
+    gc.deferBarrier();
+    BOOST_CHECK(deferred);
+
+    // Outside of any critical section deferred work can run right away.
+    deferred = false;
+    gc.defer([&] () { deferred = true; });
+    BOOST_CHECK(deferred);
+
+    gc.dump();
+}
+
 BOOST_AUTO_TEST_CASE(test_mutual_exclusion)
 {
     cerr << "testing mutual exclusion" << endl;
@@ -647,6 +681,28 @@ BOOST_AUTO_TEST_CASE ( test_gc_deferred )
     test.run(boost::bind(&TestBase<GcLock>::allocThreadDefer, &test, _1));
 }
 
+BOOST_AUTO_TEST_CASE ( test_epoch_gc_lock_sync )
+{
+    cerr << "testing synchronized EpochGcLock with many threads" << endl;
+
+    int nthreads = 8;
+    int nblocks = 2;
+
+    TestBase<EpochGcLock> test(nthreads, nblocks);
+    test.run(boost::bind(&TestBase<EpochGcLock>::allocThreadSync, &test, _1));
+}
+
+BOOST_AUTO_TEST_CASE ( test_epoch_gc_lock_deferred )
+{
+    cerr << "testing deferred EpochGcLock with many threads" << endl;
+
+    int nthreads = 8;
+    int nblocks = 2;
+
+    TestBase<EpochGcLock> test(nthreads, nblocks);
+    test.run(boost::bind(&TestBase<EpochGcLock>::allocThreadDefer, &test, _1));
+}
+
 
 struct SharedGcLockProxy : public SharedGcLock {
     static const char* name;
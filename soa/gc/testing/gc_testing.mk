@@ -9,3 +9,4 @@
 $(eval $(call test,gc_test,gc,boost))
 $(eval $(call test,rcu_protected_test,gc,boost timed))
 
+$(eval $(call program,gc_bench,gc))
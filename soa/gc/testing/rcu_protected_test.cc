@@ -5,6 +5,7 @@
 */
 
 #include "soa/gc/rcu_protected.h"
+#include "soa/gc/epoch_gc_lock.h"
 #include "jml/utils/vector_utils.h"
 #include <thread>
 
@@ -18,6 +19,7 @@ using namespace std;
 using namespace Datacratic;
 
 
+template<typename Lock = GcLock>
 struct Collection1 {
     Collection1()
         : entries(entriesLock)
@@ -29,7 +31,7 @@ struct Collection1 {
                   std::shared_ptr<std::string> value,
                   bool mustAdd)
     {
-        GcLock::SharedGuard guard(entriesLock);
+        typename Lock::SharedGuard guard(entriesLock);
 
         for (;;) {
             auto oldEntries = entries();
@@ -52,7 +54,7 @@ struct Collection1 {
 
     void recycleEntries()
     {
-        GcLock::SharedGuard guard(entriesLock);
+        typename Lock::SharedGuard guard(entriesLock);
 
         for (;;) {
             auto oldEntries = entries();
@@ -72,7 +74,7 @@ struct Collection1 {
 
     bool deleteEntry(const std::string & key)
     {
-        GcLock::SharedGuard guard(entriesLock);
+        typename Lock::SharedGuard guard(entriesLock);
 
         for (;;) {
             auto oldEntries = entries();
@@ -100,7 +102,7 @@ struct Collection1 {
 
     bool forEachEntry(const std::function<bool (std::string, std::string)> & fn)
     {
-        GcLock::SharedGuard guard(entriesLock);
+        typename Lock::SharedGuard guard(entriesLock);
 
         auto es = entries();
 
@@ -115,13 +117,13 @@ struct Collection1 {
     }
 
     typedef std::map<std::string, std::string> Entries;
-    GcLock entriesLock;
-    RcuProtected<Entries> entries;
+    Lock entriesLock;
+    RcuProtected<Entries, Lock> entries;
 };
 
 BOOST_AUTO_TEST_CASE( test_one_writer_one_reader )
 {
-    Collection1 collection;
+    Collection1<> collection;
     
     volatile bool shutdown = false;
 
@@ -185,9 +187,10 @@ BOOST_AUTO_TEST_CASE( test_one_writer_one_reader )
 }
 
 #if 1
-BOOST_AUTO_TEST_CASE( test_multithreaded_access )
+template<typename Lock>
+void testMultithreadedAccess()
 {
-    Collection1 collection;
+    Collection1<Lock> collection;
     
     volatile bool shutdown = false;
 
@@ -237,4 +240,14 @@ BOOST_AUTO_TEST_CASE( test_multithreaded_access )
     for (auto & t: threads)
         t.join();
 }
+
+BOOST_AUTO_TEST_CASE( test_multithreaded_access )
+{
+    testMultithreadedAccess<GcLock>();
+}
+
+BOOST_AUTO_TEST_CASE( test_multithreaded_access_epoch_lock )
+{
+    testMultithreadedAccess<EpochGcLock>();
+}
 #endif
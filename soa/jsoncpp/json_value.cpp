@@ -7,6 +7,10 @@
 #include "soa/jsoncpp/writer.h"
 #include <utility>
 #include <cstring>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <stdint.h>
 #include <cmath>
 # include "soa/types/string.h"
 #ifdef JSON_USE_CPPTL
@@ -83,7 +87,7 @@ public:
 
       if ( length == unknown )
          length = (unsigned int)strlen(value);
-      char *newString = static_cast<char *>( malloc( length + 1 ) );
+      char *newString = static_cast<char *>( allocateValueMemory( length + 1 ) );
       memcpy( newString, value, length );
       newString[length] = 0;
       return newString;
@@ -92,10 +96,162 @@ public:
    virtual void releaseStringValue( char *value )
    {
       if ( value )
-         free( value );
+         releaseValueMemory( value );
    }
 };
 
+// //////////////////////////////////////////////////////////////////
+// class ValueArena
+// //////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Every block of memory handed out for Values is preceded by a word that
+// says where it comes from, so that it can be released from anywhere.
+enum MemoryOrigin
+{
+   heapMemory = 0,
+   arenaMemory = 1
+};
+
+const size_t memoryHeaderSize = sizeof(uint64_t);
+
+__thread ValueArena *currentArena = 0;
+
+} // file scope
+
+ValueArena::ValueArena( size_t blockSize )
+   : blockSize_( blockSize )
+   , current_( 0 )
+   , end_( 0 )
+   , bytesAllocated_( 0 )
+{
+}
+
+ValueArena::~ValueArena()
+{
+   for ( auto block: blocks_ )
+      free( block );
+}
+
+ValueArena *ValueArena::current()
+{
+   return currentArena;
+}
+
+void *ValueArena::allocate( size_t size )
+{
+   // Keep the next allocation aligned like malloc does
+   size = (size + 15) & ~size_t(15);
+   bytesAllocated_ += size;
+
+   if ( size > size_t(end_ - current_) )
+   {
+      // Large allocations get a block of their own
+      size_t toAllocate = std::max( size, blockSize_ );
+      char *block = static_cast<char *>( malloc( toAllocate ) );
+      if ( !block )
+         throw std::bad_alloc();
+      blocks_.push_back( block );
+
+      if ( toAllocate > blockSize_ )
+         return block;
+
+      current_ = block;
+      end_ = block + toAllocate;
+   }
+
+   void *result = current_;
+   current_ += size;
+   return result;
+}
+
+void ValueArena::reset()
+{
+   // Keep one block for the next request
+   char *kept = 0;
+   for ( auto block: blocks_ )
+   {
+      if ( !kept && current_ >= block && current_ <= block + blockSize_ )
+         kept = block;
+      else
+         free( block );
+   }
+
+   blocks_.clear();
+   if ( kept )
+      blocks_.push_back( kept );
+   current_ = kept;
+   end_ = kept ? kept + blockSize_ : 0;
+   bytesAllocated_ = 0;
+}
+
+ValueArena::Scope::Scope( ValueArena &arena )
+   : previous_( currentArena )
+{
+   currentArena = &arena;
+}
+
+ValueArena::Scope::~Scope()
+{
+   currentArena = previous_;
+}
+
+void *allocateValueMemory( size_t size )
+{
+   char *memory;
+   uint64_t origin;
+   if ( currentArena )
+   {
+      memory = static_cast<char *>( currentArena->allocate( size + memoryHeaderSize ) );
+      origin = arenaMemory;
+   }
+   else
+   {
+      memory = static_cast<char *>( malloc( size + memoryHeaderSize ) );
+      if ( !memory )
+         throw std::bad_alloc();
+      origin = heapMemory;
+   }
+
+   *reinterpret_cast<uint64_t *>( memory ) = origin;
+   return memory + memoryHeaderSize;
+}
+
+void releaseValueMemory( void *memory )
+{
+   if ( !memory )
+      return;
+
+   char *block = static_cast<char *>( memory ) - memoryHeaderSize;
+   if ( *reinterpret_cast<uint64_t *>( block ) == heapMemory )
+      free( block );
+}
+
+static Value::ObjectValues *newObjectValues()
+{
+   void *memory = allocateValueMemory( sizeof(Value::ObjectValues) );
+   return new (memory) Value::ObjectValues();
+}
+
+static Value::ObjectValues *newObjectValues( const Value::ObjectValues &other )
+{
+   void *memory = allocateValueMemory( sizeof(Value::ObjectValues) );
+   try {
+      return new (memory) Value::ObjectValues( other );
+   } catch (...) {
+      releaseValueMemory( memory );
+      throw;
+   }
+}
+
+static void deleteObjectValues( Value::ObjectValues *values )
+{
+   typedef Value::ObjectValues ObjectValues;
+   values->~ObjectValues();
+   releaseValueMemory( values );
+}
+
 static ValueAllocator *&valueAllocator()
 {
    static DefaultValueAllocator defaultAllocator;
@@ -304,7 +460,7 @@ Value::Value( ValueType type )
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
    case arrayValue:
    case objectValue:
-      value_.map_ = new ObjectValues();
+      value_.map_ = newObjectValues();
       break;
 #else
    case arrayValue:
@@ -455,7 +611,7 @@ Value::Value( const Value &other )
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
    case arrayValue:
    case objectValue:
-      value_.map_ = new ObjectValues( *other.value_.map_ );
+      value_.map_ = newObjectValues( *other.value_.map_ );
       break;
 #else
    case arrayValue:
@@ -489,7 +645,7 @@ Value::Value( const std::initializer_list<Json::Value> & vals )
 #endif
 {
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
-    value_.map_ = new ObjectValues();
+    value_.map_ = newObjectValues();
 #else
     value_.array_ = arrayAllocator()->newArray();
 #endif
@@ -534,7 +690,7 @@ Value::~Value()
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
    case arrayValue:
    case objectValue:
-      delete value_.map_;
+      deleteObjectValues( value_.map_ );
       break;
 #else
    case arrayValue:
@@ -3,6 +3,7 @@
 // recognized in your jurisdiction.
 // See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
 #include "soa/jsoncpp/writer.h"
+#include "soa/types/dtoa.h"
 #include <utility>
 #include <stdio.h>
 #include <string.h>
@@ -267,6 +268,183 @@ FastWriter::writeValue( const Value &value )
 }
 
 
+// Class BufferedWriter
+// //////////////////////////////////////////////////////////////////
+
+static void appendQuotedString( std::string &out, const char *value )
+{
+   out += '"';
+   const char *run = value;
+   for ( const char *c = value; *c; ++c )
+   {
+      const char *escape;
+      switch ( *c )
+      {
+         case '\"': escape = "\\\""; break;
+         case '\\': escape = "\\\\"; break;
+         case '\b': escape = "\\b"; break;
+         case '\f': escape = "\\f"; break;
+         case '\n': escape = "\\n"; break;
+         case '\r': escape = "\\r"; break;
+         case '\t': escape = "\\t"; break;
+         default:
+            if ( !isControlCharacter( *c ) )
+               continue;
+            escape = 0;
+      }
+
+      out.append( run, c - run );
+      run = c + 1;
+      if ( escape )
+         out += escape;
+      else
+      {
+         static const char hex[] = "0123456789ABCDEF";
+         out += "\\u00";
+         out += hex[(*c >> 4) & 0xf];
+         out += hex[*c & 0xf];
+      }
+   }
+   out.append( run );
+   out += '"';
+}
+
+static void appendUInt( std::string &out, unsigned long long value )
+{
+   char buffer[32];
+   char *current = buffer + sizeof(buffer);
+   uintToString( value, current );
+   out += current;
+}
+
+static void appendInt( std::string &out, long long value )
+{
+   if ( value < 0 )
+   {
+      out += '-';
+      appendUInt( out, -(unsigned long long)value );
+   }
+   else
+      appendUInt( out, value );
+}
+
+static void appendReal( std::string &out, double value )
+{
+   int decpt;
+   int sign;
+   char *end;
+   char *digits = soa_dtoa( value, 0 /* shortest */, 0, &decpt, &sign, &end );
+   int numDigits = end - digits;
+
+   if ( sign )
+      out += '-';
+
+   if ( decpt == 9999 )
+   {
+      // Infinity or NaN, printed like soa does elsewhere
+      out.append( digits, numDigits );
+   }
+   else if ( decpt >= numDigits && decpt <= 21 )
+   {
+      out.append( digits, numDigits );
+      out.append( decpt - numDigits, '0' );
+      out += ".0";
+   }
+   else if ( decpt > 0 && decpt <= 21 )
+   {
+      out.append( digits, decpt );
+      out += '.';
+      out.append( digits + decpt, numDigits - decpt );
+   }
+   else if ( decpt <= 0 && decpt > -6 )
+   {
+      out += "0.";
+      out.append( -decpt, '0' );
+      out.append( digits, numDigits );
+   }
+   else
+   {
+      out += digits[0];
+      if ( numDigits > 1 )
+      {
+         out += '.';
+         out.append( digits + 1, numDigits - 1 );
+      }
+      out += 'e';
+      appendInt( out, decpt - 1 );
+   }
+
+   soa_freedtoa( digits );
+}
+
+BufferedWriter::BufferedWriter()
+{
+}
+
+
+const std::string &
+BufferedWriter::write( const Value &root )
+{
+   document_.clear();
+   writeTo( document_, root );
+   return document_;
+}
+
+
+void
+BufferedWriter::writeTo( std::string &out, const Value &value )
+{
+   switch ( value.type() )
+   {
+   case nullValue:
+      out += "null";
+      break;
+   case intValue:
+      appendInt( out, value.asInt() );
+      break;
+   case uintValue:
+      appendUInt( out, value.asUInt() );
+      break;
+   case realValue:
+      appendReal( out, value.asDouble() );
+      break;
+   case stringValue:
+      appendQuotedString( out, value.asCString() );
+      break;
+   case booleanValue:
+      out += value.asBool() ? "true" : "false";
+      break;
+   case arrayValue:
+      {
+         out += '[';
+         int size = value.size();
+         for ( int index = 0; index < size; ++index )
+         {
+            if ( index > 0 )
+               out += ',';
+            writeTo( out, value[index] );
+         }
+         out += ']';
+      }
+      break;
+   case objectValue:
+      {
+         out += '{';
+         for ( Value::const_iterator it = value.begin(); it != value.end(); ++it )
+         {
+            if ( it != value.begin() )
+               out += ',';
+            appendQuotedString( out, it.memberNameC() );
+            out += ':';
+            writeTo( out, *it );
+         }
+         out += '}';
+      }
+      break;
+   }
+}
+
+
 // Class StyledWriter
 // //////////////////////////////////////////////////////////////////
 
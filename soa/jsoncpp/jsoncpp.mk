@@ -7,7 +7,8 @@
 LIBRECOSET_JSONCPP_SOURCES := \
 	json_reader.cpp \
 	json_writer.cpp \
-	json_value.cpp
+	json_value.cpp \
+	dtoa.c
 
 LIBRECOSET_JSONCPP_LINK := 
 
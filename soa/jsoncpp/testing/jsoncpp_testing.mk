@@ -1,2 +1,3 @@
 
 $(eval $(call test,reader_test,jsoncpp arch,boost))
+$(eval $(call test,value_arena_test,jsoncpp arch,boost))
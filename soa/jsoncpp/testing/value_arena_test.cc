@@ -0,0 +1,71 @@
+/* value_arena_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the Value arena and the buffered writer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "soa/jsoncpp/json.h"
+
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_buffered_writer )
+{
+    Json::Value x;
+    x["a"] = 0.1;
+    x["b"] = 3.0;
+    x["c"] = 1e23;
+    x["d"] = -1.5e-7;
+    x["e"] = "x\"y\n\001";
+    x["f"] = -5;
+    x["g"].append(1);
+    x["g"].append(true);
+    x["h"] = Json::Value(Json::objectValue);
+
+    Json::BufferedWriter writer;
+    string out = writer.write(x);
+    BOOST_CHECK_EQUAL(out,
+                      "{\"a\":0.1,\"b\":3.0,\"c\":1e23,\"d\":-1.5e-7,"
+                      "\"e\":\"x\\\"y\\n\\u0001\",\"f\":-5,\"g\":[1,true],"
+                      "\"h\":{}}");
+
+    Json::Value y = Json::parse(out);
+    BOOST_CHECK_EQUAL(y, x);
+
+    // The buffer is reused from one call to the next
+    BOOST_CHECK_EQUAL(writer.write(Json::Value(1)), "1");
+}
+
+BOOST_AUTO_TEST_CASE( test_value_arena )
+{
+    Json::ValueArena arena(4096);
+    BOOST_CHECK(!Json::ValueArena::current());
+
+    {
+        Json::ValueArena::Scope scope(arena);
+        BOOST_CHECK_EQUAL(Json::ValueArena::current(), &arena);
+
+        for (unsigned i = 0;  i < 10;  ++i) {
+            Json::Value x;
+            for (unsigned j = 0;  j < 100;  ++j)
+                x["field" + to_string(j)] = "value " + to_string(j);
+            BOOST_CHECK_EQUAL(x.size(), 100);
+            BOOST_CHECK_EQUAL(x["field42"].asString(), "value 42");
+        }
+    }
+
+    BOOST_CHECK(!Json::ValueArena::current());
+    size_t allocated = arena.bytesAllocated();
+    BOOST_CHECK_GT(allocated, 0);
+
+    // Values created outside of the scope use the heap
+    Json::Value z;
+    z["a"] = 1;
+    BOOST_CHECK_EQUAL(arena.bytesAllocated(), allocated);
+
+    arena.reset();
+    BOOST_CHECK_LE(arena.bytesAllocated(), allocated);
+}
@@ -8,6 +8,7 @@
 # include "forwards.h"
 # include <string>
 # include <vector>
+# include <memory>
 # include <boost/type_traits/is_integral.hpp>
 # include <boost/type_traits/is_signed.hpp>
 # include <boost/type_traits/is_unsigned.hpp>
@@ -96,6 +97,99 @@ namespace Json {
       const char *str_;
    };
 
+   /** \brief Arena for the strings and containers of the Values built
+    * within a scope, typically the handling of a single request.
+    *
+    * While a ValueArena::Scope is alive on a thread, the strings, member
+    * names and object or array nodes allocated by Values on that thread are
+    * carved out of the arena instead of the heap, and releasing them is
+    * free.  Everything is given back at once by reset() or the destructor,
+    * so Values created within the scope must be destroyed (or never used
+    * again) before then; copy them outside of any scope to keep them.
+    * Memory allocated outside of a scope is always released to the heap,
+    * even from within one.
+    */
+   class JSON_API ValueArena
+   {
+   public:
+      ValueArena( size_t blockSize = 65536 );
+      ~ValueArena();
+
+      /// Makes the arena the current one of the thread for its lifetime.
+      class Scope
+      {
+      public:
+         Scope( ValueArena &arena );
+         ~Scope();
+
+      private:
+         Scope( const Scope & );
+         void operator =( const Scope & );
+
+         ValueArena *previous_;
+      };
+
+      /// Arena of the innermost scope of the thread, or null.
+      static ValueArena *current();
+
+      void *allocate( size_t size );
+
+      /// Frees everything that was allocated, keeping the first block.
+      void reset();
+
+      /// Bytes handed out since the last reset.
+      size_t bytesAllocated() const
+      {
+         return bytesAllocated_;
+      }
+
+   private:
+      ValueArena( const ValueArena & );
+      void operator =( const ValueArena & );
+
+      size_t blockSize_;
+      std::vector<char *> blocks_;
+      char *current_;
+      char *end_;
+      size_t bytesAllocated_;
+   };
+
+   /// Allocates from the current arena, if any, or else from the heap.
+   JSON_API void *allocateValueMemory( size_t size );
+
+   /// Frees memory from allocateValueMemory(); a no-op for arena memory.
+   JSON_API void releaseValueMemory( void *memory );
+
+   /// STL allocator for the nodes of objects and arrays.
+   template<typename T>
+   struct ValueMemoryAllocator : public std::allocator<T>
+   {
+      template<typename U>
+      struct rebind
+      {
+         typedef ValueMemoryAllocator<U> other;
+      };
+
+      ValueMemoryAllocator()
+      {
+      }
+
+      template<typename U>
+      ValueMemoryAllocator( const ValueMemoryAllocator<U> & )
+      {
+      }
+
+      T *allocate( size_t n, const void * = 0 )
+      {
+         return static_cast<T *>( allocateValueMemory( n * sizeof(T) ) );
+      }
+
+      void deallocate( T *p, size_t )
+      {
+         releaseValueMemory( p );
+      }
+   };
+
    /** \brief Represents a <a HREF="http://www.json.org">JSON</a> value.
     *
     * This class is a discriminated union wrapper that can represents a:
@@ -175,7 +269,9 @@ namespace Json {
 
    public:
 #  ifndef JSON_USE_CPPTL_SMALLMAP
-      typedef std::map<CZString, Value> ObjectValues;
+      typedef std::map<CZString, Value, std::less<CZString>,
+                       ValueMemoryAllocator<std::pair<const CZString, Value> > >
+          ObjectValues;
 #  else
       typedef CppTL::SmallMap<CZString, Value> ObjectValues;
 #  endif // ifndef JSON_USE_CPPTL_SMALLMAP
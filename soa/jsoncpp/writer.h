@@ -48,6 +48,31 @@ namespace Json {
       bool yamlCompatiblityEnabled_;
    };
 
+   /** \brief Outputs a Value in the format of FastWriter, without the final
+    * line break, into a buffer that is reused from one call to the next.
+    *
+    * Objects are walked in place rather than through getMemberNames(), and
+    * reals are written with the shortest representation that reads back to
+    * the same double, with ".0" added to integral ones so that they stay
+    * reals.
+    */
+   class JSON_API BufferedWriter
+   {
+   public:
+      BufferedWriter();
+
+      /** \brief Serialize a Value into the buffer of the writer.
+       * \return The buffer, which stays valid until the next call.
+       */
+      const std::string &write( const Value &root );
+
+      /// Append the serialization of a Value to the given string.
+      static void writeTo( std::string &out, const Value &root );
+
+   private:
+      std::string document_;
+   };
+
    /** \brief Writes a Value in <a HREF="http://www.json.org">JSON</a> format in a human friendly way.
     *
     * The rules for line break and indent are as follow:
@@ -9,15 +9,19 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <sched.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
+#include <linux/mempolicy.h>
 
 #include "jml/arch/exception.h"
 #include "jml/arch/timers.h"
@@ -35,9 +39,64 @@ Logging::Category launcherError("LaunchError", launcherTrace);
 
 struct Launcher
 {
+    /** Parse a list of cpus or NUMA nodes in the kernel's format, such as
+        "0-7,16-23".
+    */
+    static std::vector<int> parseCpuList(std::string const & list) {
+        std::vector<int> result;
+        std::istringstream stream(list);
+        std::string range;
+        while(std::getline(stream, range, ',')) {
+            if(range.find_first_not_of(" \n") == std::string::npos) {
+                continue;
+            }
+
+            int first = 0, last = 0;
+            int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+            if(n < 1 || first < 0 || (n == 2 && last < first)) {
+                THROW(launcherError) << "invalid cpu list '" << list << "'" << std::endl;
+            }
+
+            if(n == 1) {
+                last = first;
+            }
+
+            for(int i = first; i <= last; ++i) {
+                result.push_back(i);
+            }
+        }
+
+        return result;
+    }
+
+    static std::string readSysFile(std::string const & filename) {
+        std::ifstream file(filename);
+        if(!file) {
+            THROW(launcherError) << "cannot read '" << filename << "'" << std::endl;
+        }
+
+        std::string result;
+        std::getline(file, result);
+        return result;
+    }
+
+    /** A task is a process started and restarted by the launcher.
+
+        Besides its command line, a task can be placed on the machine with:
+        - "cpus": cpus the process may run on, as an array or a string
+          such as "0-7,16-23";
+        - "numaNode": NUMA node to run on, which defaults the cpus to the
+          ones of that node;
+        - "memoryPolicy": "preferred" (the default with a NUMA node),
+          "bind", "interleave" (over all nodes without a NUMA node) or
+          "local";
+        - "irqs": interrupts, typically the queues of the NIC the process
+          serves, to steer to the same cpus.  This requires root, so a
+          failure is only logged.
+    */
     struct Task
     {
-        Task() : pid(-1), log(false), delay(45.0), once(false) {
+        Task() : pid(-1), log(false), delay(45.0), once(false), numaNode(-1) {
         }
 
         std::string const & getName() const {
@@ -155,6 +214,36 @@ struct Launcher
                 else if(i.memberName() == "once") {
                     result.once = i->asBool();
                 }
+                else if(i.memberName() == "cpus") {
+                    auto & json = *i;
+                    if(json.isString()) {
+                        result.cpus = parseCpuList(json.asString());
+                    }
+                    else if(json.isArray()) {
+                        for(auto j = json.begin(), end = json.end(); j != end; ++j) {
+                            result.cpus.push_back(j->asInt());
+                        }
+                    }
+                    else if(!json.isNull()) {
+                        THROW(launcherError) << "'cpus' is not an array or a string" << std::endl;
+                    }
+                }
+                else if(i.memberName() == "numaNode") {
+                    result.numaNode = i->asInt();
+                }
+                else if(i.memberName() == "memoryPolicy") {
+                    result.memoryPolicy = i->asString();
+                }
+                else if(i.memberName() == "irqs") {
+                    auto & json = *i;
+                    if(!json.empty() && !json.isArray()) {
+                        THROW(launcherError) << "'irqs' is not an array" << std::endl;
+                    }
+
+                    for(auto j = json.begin(), end = json.end(); j != end; ++j) {
+                        result.irqs.push_back(j->asInt());
+                    }
+                }
                 else if(i.memberName() == "arg") {
                     auto & json = *i;
                     if(!json.empty() && !json.isArray()) {
@@ -210,8 +299,116 @@ struct Launcher
             return result;
         }
 
+        /** Placement of the process, computed before forking so that the
+            child only has system calls to make.
+        */
+        struct Placement {
+            Placement() : hasCpus(false), policy(-1), maxNode(0) {
+                CPU_ZERO(&cpus);
+                memset(nodes, 0, sizeof(nodes));
+            }
+
+            bool hasCpus;
+            cpu_set_t cpus;
+            int policy;
+            unsigned long nodes[16];
+            unsigned long maxNode;
+        };
+
+        Placement makePlacement() const {
+            Placement result;
+
+            std::vector<int> taskCpus = cpus;
+            if(taskCpus.empty() && numaNode != -1) {
+                taskCpus = parseCpuList(readSysFile(ML::format("/sys/devices/system/node/node%d/cpulist", numaNode)));
+            }
+
+            for(int cpu : taskCpus) {
+                if(cpu >= CPU_SETSIZE) {
+                    THROW(launcherError) << "cpu " << cpu << " out of range for " << name << std::endl;
+                }
+                CPU_SET(cpu, &result.cpus);
+                result.hasCpus = true;
+            }
+
+            std::string policy = memoryPolicy;
+            if(policy.empty() && numaNode != -1) {
+                policy = "preferred";
+            }
+
+            if(policy.empty()) {
+                return result;
+            }
+
+            std::vector<int> nodes;
+            if(numaNode != -1) {
+                nodes.push_back(numaNode);
+            }
+
+            if(policy == "preferred") {
+                result.policy = MPOL_PREFERRED;
+            }
+            else if(policy == "bind") {
+                result.policy = MPOL_BIND;
+            }
+            else if(policy == "interleave") {
+                result.policy = MPOL_INTERLEAVE;
+                if(nodes.empty()) {
+                    nodes = parseCpuList(readSysFile("/sys/devices/system/node/online"));
+                }
+            }
+            else if(policy == "local") {
+                result.policy = MPOL_LOCAL;
+                return result;
+            }
+            else {
+                THROW(launcherError) << "unknown memory policy '" << policy << "' for " << name << std::endl;
+            }
+
+            if(nodes.empty()) {
+                THROW(launcherError) << "memory policy '" << policy << "' requires a 'numaNode' for " << name << std::endl;
+            }
+
+            const int bitsPerWord = 8 * sizeof(unsigned long);
+            for(int node : nodes) {
+                if(node >= bitsPerWord * 16) {
+                    THROW(launcherError) << "NUMA node " << node << " out of range for " << name << std::endl;
+                }
+                result.nodes[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+            }
+            result.maxNode = bitsPerWord * 16;
+
+            return result;
+        }
+
+        /* Steer the interrupts to the cpus of the task. */
+        void setIrqAffinity(Placement const & placement) const {
+            if(irqs.empty() || !placement.hasCpus) {
+                return;
+            }
+
+            std::string list;
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if(CPU_ISSET(cpu, &placement.cpus)) {
+                    list += (list.empty() ? "" : ",") + std::to_string(cpu);
+                }
+            }
+
+            for(int irq : irqs) {
+                std::string filename = ML::format("/proc/irq/%d/smp_affinity_list", irq);
+                std::ofstream file(filename);
+                file << list << std::endl;
+                if(!file) {
+                    LOG(launcherError) << "cannot set affinity of irq " << irq << " for " << name << " errno=" << errno << std::endl;
+                }
+            }
+        }
+
         void spawn(std::string const & node) {
             LOG(launcherTrace) << "launch " << name << std::endl;
+            Placement placement = makePlacement();
+            setIrqAffinity(placement);
+
             pid = fork();
 
             if(pid == -1) {
@@ -227,6 +424,23 @@ struct Launcher
                     THROW(launcherError) << "prctl failed errno=" << errno << std::endl;
                 }
 
+                // both are inherited through execvp
+                if(placement.hasCpus) {
+                    res = sched_setaffinity(0, sizeof(placement.cpus), &placement.cpus);
+                    if(res == -1) {
+                        THROW(launcherError) << "sched_setaffinity failed errno=" << errno << std::endl;
+                    }
+                }
+
+                if(placement.policy != -1) {
+                    res = syscall(SYS_set_mempolicy, placement.policy,
+                                  placement.maxNode ? placement.nodes : nullptr,
+                                  placement.maxNode);
+                    if(res == -1) {
+                        THROW(launcherError) << "set_mempolicy failed errno=" << errno << std::endl;
+                    }
+                }
+
                 if(log) {
                     redirect();
                 }
@@ -281,6 +495,10 @@ struct Launcher
         bool log;
         double delay;
         bool once;
+        std::vector<int> cpus;
+        int numaNode;
+        std::string memoryPolicy;
+        std::vector<int> irqs;
     };
 
     struct Node
@@ -0,0 +1,485 @@
+/* block_log.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Log file made of independently compressed blocks with a time index.
+*/
+
+#include "block_log.h"
+#include "compressor.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+namespace {
+
+const char Magic[] = "RTBBLK1\n";
+enum {
+    MagicSize = 8,
+    IndexEntrySize = 48,
+    TrailerSize = 16 + MagicSize,
+    RecordHeaderSize = 12
+};
+
+void appendLE(string & out, uint64_t value, int bytes = 8)
+{
+    for (int i = 0;  i < bytes;  ++i)
+        out += char((value >> (8 * i)) & 0xff);
+}
+
+void appendLE(string & out, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    appendLE(out, bits);
+}
+
+uint64_t readLE(const char * p, int bytes = 8)
+{
+    uint64_t result = 0;
+    for (int i = 0;  i < bytes;  ++i)
+        result |= uint64_t((unsigned char)p[i]) << (8 * i);
+    return result;
+}
+
+double readDouble(const char * p)
+{
+    uint64_t bits = readLE(p);
+    double result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+} // namespace anonymous
+
+
+/*****************************************************************************/
+/* BLOCK LOG WRITER                                                          */
+/*****************************************************************************/
+
+BlockLogWriter::
+BlockLogWriter(const std::string & filename,
+               const std::string & compression,
+               int level,
+               size_t blockSize)
+    : compression(compression), level(level), blockSize(blockSize),
+      offset(0), closed(false)
+{
+    if (compression.find('\n') != string::npos)
+        throw ML::Exception("invalid block log compression");
+
+    // Fail now rather than on the first block
+    std::unique_ptr<Compressor> check(Compressor::create(compression, level));
+
+    current = BlockInfo();
+    block.reserve(blockSize + blockSize / 8);
+
+    stream.open(filename, ios::out, "none");
+    writeData(string(Magic, MagicSize) + compression + "\n");
+}
+
+BlockLogWriter::
+~BlockLogWriter()
+{
+    close();
+}
+
+void
+BlockLogWriter::
+write(Date timestamp, const char * data, size_t size)
+{
+    if (closed)
+        throw ML::Exception("write to a closed block log");
+    if (size > std::numeric_limits<uint32_t>::max())
+        throw ML::Exception("block log record too large");
+
+    double seconds = timestamp.secondsSinceEpoch();
+
+    if (!current.records) {
+        current.earliest = current.latest = seconds;
+    }
+    else {
+        current.earliest = std::min(current.earliest, seconds);
+        current.latest = std::max(current.latest, seconds);
+    }
+
+    appendLE(block, seconds);
+    appendLE(block, size, 4);
+    block.append(data, size);
+    ++current.records;
+    ++stats_.records;
+
+    if (block.size() >= blockSize)
+        flush();
+}
+
+void
+BlockLogWriter::
+flush()
+{
+    if (!current.records) return;
+
+    string compressed = Compressor::compressAll(compression, level,
+                                                block.data(), block.size());
+
+    current.offset = offset;
+    current.size = compressed.size();
+    current.rawSize = block.size();
+    index.push_back(current);
+
+    ++stats_.blocks;
+    stats_.rawBytes += block.size();
+
+    writeData(compressed);
+
+    block.clear();
+    current = BlockInfo();
+}
+
+void
+BlockLogWriter::
+close()
+{
+    if (closed) return;
+
+    flush();
+    closed = true;
+
+    string data;
+    for (auto & entry: index) {
+        appendLE(data, entry.offset);
+        appendLE(data, entry.size);
+        appendLE(data, entry.rawSize);
+        appendLE(data, entry.records);
+        appendLE(data, entry.earliest);
+        appendLE(data, entry.latest);
+    }
+
+    appendLE(data, offset);
+    appendLE(data, index.size());
+    data.append(Magic, MagicSize);
+    writeData(data);
+
+    stream.close();
+}
+
+void
+BlockLogWriter::
+writeData(const std::string & data)
+{
+    stream.write(data.data(), data.size());
+    if (!stream)
+        throw ML::Exception("error writing block log");
+
+    offset += data.size();
+    stats_.bytesWritten += data.size();
+}
+
+
+/*****************************************************************************/
+/* BLOCK LOG OUTPUT                                                          */
+/*****************************************************************************/
+
+BlockLogOutput::
+BlockLogOutput(const std::string & filename,
+               const std::string & compression,
+               int level,
+               size_t blockSize)
+    : writer(filename, compression, level, blockSize)
+{
+}
+
+BlockLogOutput::
+~BlockLogOutput()
+{
+    close();
+}
+
+void
+BlockLogOutput::
+logMessage(const std::string & channel,
+           const std::string & message)
+{
+    line.clear();
+    line.reserve(channel.size() + message.size() + 2);
+    line += channel;
+    line += '\t';
+    line += message;
+    line += '\n';
+
+    writer.write(Date::now(), line);
+}
+
+void
+BlockLogOutput::
+close()
+{
+    writer.close();
+}
+
+Json::Value
+BlockLogOutput::
+stats() const
+{
+    const BlockLogWriter::Stats & stats = writer.stats();
+
+    Json::Value result;
+    result["records"] = (Json::UInt)stats.records;
+    result["blocks"] = (Json::UInt)stats.blocks;
+    result["rawBytes"] = (Json::UInt)stats.rawBytes;
+    result["bytesWritten"] = (Json::UInt)stats.bytesWritten;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* BLOCK LOG READER                                                          */
+/*****************************************************************************/
+
+BlockLogReader::
+BlockLogReader(const std::string & filename)
+    : file(filename)
+{
+    const char * start = file.start();
+    size_t size = file.size();
+
+    if (size < MagicSize + TrailerSize
+        || memcmp(start, Magic, MagicSize) != 0
+        || memcmp(file.end() - MagicSize, Magic, MagicSize) != 0)
+        throw ML::Exception("%s is not a block log", filename.c_str());
+
+    // The compression name follows the magic up to a newline
+    const char * header
+        = (const char *)memchr(start + MagicSize, '\n',
+                               size - MagicSize - TrailerSize);
+    if (!header)
+        throw ML::Exception("%s has no compression", filename.c_str());
+
+    compression_.assign(start + MagicSize, header);
+
+    const char * trailer = file.end() - TrailerSize;
+    uint64_t indexOffset = readLE(trailer);
+    uint64_t numBlocks = readLE(trailer + 8);
+
+    if (indexOffset > size - TrailerSize
+        || numBlocks * IndexEntrySize != size - TrailerSize - indexOffset)
+        throw ML::Exception("%s has a corrupt block index", filename.c_str());
+
+    for (const char * p = start + indexOffset;  p < trailer;
+         p += IndexEntrySize) {
+        BlockInfo info;
+        info.offset = readLE(p);
+        info.size = readLE(p + 8);
+        info.rawSize = readLE(p + 16);
+        info.records = readLE(p + 24);
+        info.earliest = readDouble(p + 32);
+        info.latest = readDouble(p + 40);
+
+        if (info.offset + info.size > indexOffset)
+            throw ML::Exception("%s has a block past its index",
+                                filename.c_str());
+        index.push_back(info);
+    }
+}
+
+std::string
+BlockLogReader::
+decompress(size_t block) const
+{
+    const BlockInfo & info = index.at(block);
+    string result = Compressor::decompressAll(compression_,
+                                              file.start() + info.offset,
+                                              info.size);
+    if (result.size() != info.rawSize)
+        throw ML::Exception("block %zd decompressed to %zd bytes instead "
+                            "of %zd", block, result.size(),
+                            (size_t)info.rawSize);
+    return result;
+}
+
+bool
+BlockLogReader::
+forEachRecord(const std::string & data,
+              const std::function<bool (Date, const char *, size_t)>
+                  & onRecord) const
+{
+    const char * p = data.data();
+    const char * end = p + data.size();
+
+    while (p < end) {
+        if (end - p < RecordHeaderSize)
+            throw ML::Exception("truncated block log record");
+
+        double seconds = readDouble(p);
+        uint64_t size = readLE(p + 8, 4);
+        p += RecordHeaderSize;
+
+        if (size > uint64_t(end - p))
+            throw ML::Exception("truncated block log record");
+
+        if (!onRecord(Date::fromSecondsSinceEpoch(seconds), p, size))
+            return false;
+        p += size;
+    }
+
+    return true;
+}
+
+void
+BlockLogReader::
+readBlock(size_t block,
+          const std::function<bool (Date, const char *, size_t)>
+              & onRecord) const
+{
+    forEachRecord(decompress(block), onRecord);
+}
+
+size_t
+BlockLogReader::
+replay(Date start, Date end,
+       const std::function<bool (Date, const char *, size_t)> & onRecord,
+       int numThreads) const
+{
+    double startSeconds = start.secondsSinceEpoch();
+    double endSeconds = end.secondsSinceEpoch();
+
+    vector<size_t> blocks;
+    for (size_t i = 0;  i < index.size();  ++i) {
+        if (index[i].latest >= startSeconds && index[i].earliest < endSeconds)
+            blocks.push_back(i);
+    }
+
+    size_t done = 0;
+    bool more = true;
+
+    auto onBlock = [&] (const string & data)
+        {
+            more = forEachRecord(data, [&] (Date ts, const char * p, size_t n)
+                {
+                    double seconds = ts.secondsSinceEpoch();
+                    if (seconds < startSeconds || seconds >= endSeconds)
+                        return true;
+                    ++done;
+                    return onRecord(ts, p, n);
+                });
+        };
+
+    if (numThreads <= 1 || blocks.size() <= 1) {
+        for (size_t i = 0;  i < blocks.size() && more;  ++i)
+            onBlock(decompress(blocks[i]));
+        return done;
+    }
+
+    // The blocks are taken in order by the threads and decompressed into
+    // a window of slots that starts at the one being replayed.
+    struct Slot {
+        Slot() : done(false) {}
+        bool done;
+        string data;
+    };
+
+    std::mutex lock;
+    std::condition_variable changed;
+    vector<Slot> window(2 * numThreads);
+    size_t next = 0, reading = 0;
+    bool shutdown = false;
+    std::exception_ptr exc;
+
+    auto runThread = [&] ()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+
+            for (;;) {
+                changed.wait(guard, [&] {
+                        return shutdown || exc || next >= blocks.size()
+                            || next < reading + window.size();
+                    });
+                if (shutdown || exc || next >= blocks.size())
+                    return;
+
+                size_t current = next++;
+
+                string data;
+                guard.unlock();
+                try {
+                    data = decompress(blocks[current]);
+                }
+                catch (...) {
+                    guard.lock();
+                    exc = std::current_exception();
+                    changed.notify_all();
+                    return;
+                }
+                guard.lock();
+
+                Slot & slot = window[current % window.size()];
+                slot.data.swap(data);
+                slot.done = true;
+                changed.notify_all();
+            }
+        };
+
+    vector<std::thread> threads;
+    numThreads = std::min<size_t>(numThreads, blocks.size());
+    for (int i = 0;  i < numThreads;  ++i)
+        threads.emplace_back(runThread);
+
+    auto stop = [&] ()
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                shutdown = true;
+                changed.notify_all();
+            }
+            for (auto & thread: threads)
+                thread.join();
+        };
+
+    try {
+        for (;  reading < blocks.size() && more;) {
+            string data;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                Slot & slot = window[reading % window.size()];
+                changed.wait(guard, [&] { return slot.done || exc; });
+                if (!slot.done)
+                    std::rethrow_exception(exc);
+
+                data.swap(slot.data);
+                slot.done = false;
+                ++reading;
+                changed.notify_all();
+            }
+
+            onBlock(data);
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+
+    stop();
+    return done;
+}
+
+size_t
+BlockLogReader::
+replay(const std::function<bool (Date, const char *, size_t)> & onRecord,
+       int numThreads) const
+{
+    return replay(Date::negativeInfinity(), Date::positiveInfinity(),
+                  onRecord, numThreads);
+}
+
+} // namespace Datacratic
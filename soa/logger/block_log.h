@@ -0,0 +1,191 @@
+/* block_log.h                                                     -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Log file made of independently compressed blocks with a time index, so
+   that a replay can start anywhere in it.
+*/
+
+#pragma once
+
+#include "logger.h"
+#include "jml/utils/file_functions.h"
+#include "jml/utils/filter_streams.h"
+#include "soa/types/date.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* BLOCK LOG WRITER                                                          */
+/*****************************************************************************/
+
+/** Writes a block log.  The file is:
+
+        "RTBBLK1\n" <compression name> '\n' <blocks...> <index> <trailer>
+
+    Records are a timestamp (a double of seconds since the epoch), a 32 bit
+    length and the data, all little endian.  They are gathered into blocks
+    of about blockSize bytes that are each a complete stream of the given
+    compression, so that they can be decompressed on their own.
+
+    The index has an entry per block with its offset and size in the file,
+    its size once decompressed, its number of records and the earliest
+    and latest timestamp of its records.  The trailer is the offset of the
+    index, its number of entries and the magic again.
+*/
+
+struct BlockLogWriter {
+
+    BlockLogWriter(const std::string & filename,
+                   const std::string & compression = "lz4",
+                   int level = -1,
+                   size_t blockSize = DefaultBlockSize);
+
+    ~BlockLogWriter();
+
+    enum { DefaultBlockSize = 1024 * 1024 };
+
+    void write(Date timestamp, const char * data, size_t size);
+
+    void write(Date timestamp, const std::string & data)
+    {
+        write(timestamp, data.data(), data.size());
+    }
+
+    /** Writes the current block. */
+    void flush();
+
+    /** Writes the current block and the index. */
+    void close();
+
+    struct Stats {
+        Stats() : records(0), blocks(0), rawBytes(0), bytesWritten(0) {}
+
+        uint64_t records;
+        uint64_t blocks;
+        uint64_t rawBytes;
+        uint64_t bytesWritten;
+    };
+
+    const Stats & stats() const { return stats_; }
+
+    /** What's stored in the index for a block. */
+    struct BlockInfo {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t rawSize;
+        uint64_t records;
+        double earliest;
+        double latest;
+    };
+
+private:
+    void writeData(const std::string & data);
+
+    std::string compression;
+    int level;
+    size_t blockSize;
+
+    ML::filter_ostream stream;
+    uint64_t offset;
+    bool closed;
+
+    std::string block;
+    BlockInfo current;
+    std::vector<BlockInfo> index;
+
+    Stats stats_;
+};
+
+
+/*****************************************************************************/
+/* BLOCK LOG OUTPUT                                                          */
+/*****************************************************************************/
+
+/** Logger output that writes each message as the line the file outputs
+    would write (channel, tab, message and newline) into a block log,
+    timestamped with the time at which it reaches the output.
+*/
+
+struct BlockLogOutput : public LogOutput {
+
+    BlockLogOutput(const std::string & filename,
+                   const std::string & compression = "lz4",
+                   int level = -1,
+                   size_t blockSize = BlockLogWriter::DefaultBlockSize);
+
+    virtual ~BlockLogOutput();
+
+    virtual void logMessage(const std::string & channel,
+                            const std::string & message);
+
+    virtual void close();
+
+    virtual Json::Value stats() const;
+
+private:
+    BlockLogWriter writer;
+    std::string line;
+};
+
+
+/*****************************************************************************/
+/* BLOCK LOG READER                                                          */
+/*****************************************************************************/
+
+/** Reads a block log.  The file is mapped in memory, so seeking to a time
+    only touches the index and the blocks that are read.
+*/
+
+struct BlockLogReader {
+
+    typedef BlockLogWriter::BlockInfo BlockInfo;
+
+    BlockLogReader(const std::string & filename);
+
+    const std::string & compression() const { return compression_; }
+
+    const std::vector<BlockInfo> & blocks() const { return index; }
+
+    /** Records of a block in file order. */
+    void readBlock(size_t block,
+                   const std::function<bool (Date, const char *, size_t)>
+                       & onRecord) const;
+
+    /** Calls onRecord, in file order, for each record whose timestamp is
+        in [start, end), until it returns false.  Only the blocks whose
+        time range overlaps it are read, and they're decompressed ahead of
+        onRecord on numThreads threads.  Returns the number of records
+        passed to onRecord.
+    */
+    size_t replay(Date start, Date end,
+                  const std::function<bool (Date, const char *, size_t)>
+                      & onRecord,
+                  int numThreads = 4) const;
+
+    /** Same over the whole file. */
+    size_t replay(const std::function<bool (Date, const char *, size_t)>
+                      & onRecord,
+                  int numThreads = 4) const;
+
+private:
+    std::string decompress(size_t block) const;
+
+    /** Calls onRecord for each record of a decompressed block until it
+        returns false, in which case false is returned.
+    */
+    bool forEachRecord(const std::string & data,
+                       const std::function<bool (Date, const char *, size_t)>
+                           & onRecord) const;
+
+    ML::File_Read_Buffer file;
+    std::string compression_;
+    std::vector<BlockInfo> index;
+};
+
+} // namespace Datacratic
@@ -19,9 +19,11 @@ std::vector<boost::filesystem::path> CloudOutput::filesToUpload_;
 CloudSink::
 CloudSink(const std::string & uri, bool append, bool disambiguate,
           std::string backupDir, std::string bucket, string accessKeyId, 
-          string accessKey, unsigned int numThreads):
+          string accessKey, unsigned int numThreads,
+          size_t partSize, unsigned maxPartsInFlight):
     backupDir_(backupDir),bucket_(bucket), 
-    accessKeyId_(accessKeyId), accessKey_(accessKey),numThreads_(numThreads)
+    accessKeyId_(accessKeyId), accessKey_(accessKey),numThreads_(numThreads),
+    partSize_(partSize), maxPartsInFlight_(maxPartsInFlight)
 {
     if (uri != "")
     {
@@ -122,6 +124,18 @@ open(const std::string & uri, bool append, bool disambiguate)
 
     currentUri = disambUri;
 
+    if (partSize_) {
+        std::map<std::string, std::string> options;
+        options["mode"] = append ? "app,out" : "out";
+        options["num-threads"] = to_string(numThreads_);
+        options["part-size"] = to_string(partSize_);
+        options["max-parts-in-flight"] = to_string(maxPartsInFlight_);
+        options["max-bandwidth-mbps"]
+            = to_string(S3Api::defaultBandwidthToServiceMbps);
+        cloudStream.open(disambUri, options);
+        return;
+    }
+
     string compression = "";
     int level = -1;
     cloudStream.open(disambUri, std::ios_base::out |
@@ -145,6 +159,8 @@ CloudSink::
 close()
 {
     cloudStream.close();
+    if (partSize_) return;
+
     fileStream.close();
     fs::path filePath(backupDir_ + currentUri.substr(5));
     cerr << "Erasing local backup file " << filePath.string() << endl;
@@ -155,7 +171,8 @@ size_t
 CloudSink::
 write(const char * data, size_t size)
 {
-    fileStream.write(data, size);
+    if (!partSize_)
+        fileStream.write(data, size);
     cloudStream.write(data, size);
     return size ;
 }
@@ -337,7 +354,21 @@ std::shared_ptr<CompressingOutput::Sink>
 CloudOutput::createSink(const string & uri, bool append)
 {
     return make_shared<CloudSink>(uri, append, true, backupDir_, bucket_, 
-                                  accessKeyId_, accessKey_, numThreads_);
+                                  accessKeyId_, accessKey_, numThreads_,
+                                  partSize_, maxPartsInFlight_);
+}
+
+void
+CloudOutput::
+setStreamingUpload(size_t partSize, unsigned maxPartsInFlight)
+{
+    if (partSize < 5 * 1024 * 1024)
+        throw ML::Exception("S3 upload parts must be at least 5MB");
+    if (!maxPartsInFlight)
+        throw ML::Exception("streaming upload needs parts in flight");
+
+    partSize_ = partSize;
+    maxPartsInFlight_ = maxPartsInFlight;
 }
 
 RotatingCloudOutput::RotatingCloudOutput(std::string backupDir, 
@@ -349,7 +380,8 @@ RotatingCloudOutput::RotatingCloudOutput(std::string backupDir,
                                       this,
                                   std::placeholders::_1)),
         backupDir_(backupDir),bucket_(bucket), accessKeyId_(accessKeyId), 
-        accessKey_(accessKey),numThreads_(numThreads)
+        accessKey_(accessKey),numThreads_(numThreads),
+        partSize_(0), maxPartsInFlight_(0)
 {
 }
 
@@ -368,6 +400,19 @@ open(const std::string & filenamePattern,
     RotatingOutputAdaptor::open(filenamePattern, periodPattern);
 }
 
+void
+RotatingCloudOutput::
+setStreamingUpload(size_t partSize, unsigned maxPartsInFlight)
+{
+    if (partSize < 5 * 1024 * 1024)
+        throw ML::Exception("S3 upload parts must be at least 5MB");
+    if (!maxPartsInFlight)
+        throw ML::Exception("streaming upload needs parts in flight");
+
+    partSize_ = partSize;
+    maxPartsInFlight_ = maxPartsInFlight;
+}
+
 RotatingCloudOutput::
 ~RotatingCloudOutput()
 {
@@ -381,6 +426,8 @@ createFile(const string & filename)
     std::unique_ptr<CloudOutput> result(new CloudOutput(backupDir_, bucket_,
                                                         accessKeyId_,accessKey_,
                                                         numThreads_));
+    if (partSize_)
+        result->setStreamingUpload(partSize_, maxPartsInFlight_);
 
     result->onPreFileOpen = [=] (const string & fn)
     {
@@ -417,7 +464,8 @@ CloudOutput::
                 std::string accessKeyId, std::string accessKey, 
                 unsigned int numThreads, size_t ringBufferSize)
     : NamedOutput(ringBufferSize),backupDir_(backupDir),bucket_(bucket),
-      accessKeyId_(accessKeyId),accessKey_(accessKey),numThreads_(numThreads)
+      accessKeyId_(accessKeyId),accessKey_(accessKey),numThreads_(numThreads),
+      partSize_(0), maxPartsInFlight_(0)
 {
 
     if( !fs::exists(backupDir))
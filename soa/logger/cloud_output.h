@@ -53,13 +53,19 @@ namespace Datacratic {
 /* CLOUD SINK                                                                 */
 /*****************************************************************************/
 
-/** Class that writes to a cloud. */
+/** Class that writes to a cloud.
+
+    With a partSize, the data is only streamed to the cloud in parts of that
+    size, with at most maxPartsInFlight of them in memory and an upload rate
+    limited to the default bandwidth of S3Api; there is no local backup.
+*/
 
 struct CloudSink : public CompressingOutput::Sink {
     CloudSink(const std::string & uri ,
               bool append, bool disambiguate, std::string backupDir,
               std::string bucket, std::string accessKeyId, std::string accessKey,
-              unsigned int numThreads);
+              unsigned int numThreads,
+              size_t partSize = 0, unsigned maxPartsInFlight = 0);
 
     virtual ~CloudSink();
 
@@ -80,6 +86,8 @@ struct CloudSink : public CompressingOutput::Sink {
     std::string accessKeyId_;
     std::string accessKey_;
     unsigned int numThreads_;
+    size_t partSize_;
+    unsigned maxPartsInFlight_;
     /// Current stream to the cloud (TM)
     ML::filter_ostream cloudStream;
     // we write to a temporary file on local disk which we delete when
@@ -121,6 +129,13 @@ struct CloudOutput : public NamedOutput {
     virtual std::shared_ptr<Sink>
     createSink(const std::string & uri, bool append);
 
+    /** Streams the files opened from now on to the cloud in parts of
+        partSize bytes as soon as they fill, with at most maxPartsInFlight
+        parts in memory per file, instead of also writing them to the backup
+        directory.  Parts must be at least 5MB.
+    */
+    void setStreamingUpload(size_t partSize, unsigned maxPartsInFlight);
+
     void getFilesToUpload() ;
     void uploadLocalFiles() ;
 
@@ -129,6 +144,8 @@ struct CloudOutput : public NamedOutput {
     std::string accessKeyId_;
     std::string accessKey_;
     unsigned numThreads_;
+    size_t partSize_;
+    unsigned maxPartsInFlight_;
     // note that this structure is only filled in a function that is guaranteed
     // to be called once
     static std::vector<boost::filesystem::path> filesToUpload_;
@@ -170,6 +187,13 @@ struct RotatingCloudOutput : public RotatingOutputAdaptor {
               const std::string & compression = "",
               int level = -1);
 
+    /** Streams the files to the cloud without local staging, which keeps
+        the memory flat and spreads the upload over the period instead of
+        having it all at rotation.  See CloudOutput::setStreamingUpload.
+    */
+    void setStreamingUpload(size_t partSize = 8 * 1024 * 1024,
+                            unsigned maxPartsInFlight = 4);
+
 private:
     CloudOutput * createFile(const std::string & filename);
 
@@ -180,6 +204,8 @@ private:
     std::string accessKeyId_;
     std::string accessKey_;
     unsigned int numThreads_;//number of threads to use for s3 upload per file
+    size_t partSize_;
+    unsigned maxPartsInFlight_;
 };
 
 } // namespace Datacratic
@@ -0,0 +1,404 @@
+/* columnar_output.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Output that writes log messages into a compressed columnar file.
+*/
+
+#include "columnar_output.h"
+#include "compressor.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+namespace {
+
+const char Magic[] = "RTBCOL1\n";
+enum { MagicSize = 8, LengthSize = 8 };
+
+/** A column is dictionary encoded when it has at most this many distinct
+    values and they're at most a quarter of its rows.
+*/
+enum { MaxDictionarySize = 65536 };
+
+void appendVarint(string & out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+uint64_t readVarint(const char * & p, const char * end)
+{
+    uint64_t result = 0;
+    for (int shift = 0;  shift < 64;  shift += 7) {
+        if (p == end)
+            throw ML::Exception("columnar file: truncated varint");
+        unsigned char c = *p++;
+        result |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return result;
+    }
+    throw ML::Exception("columnar file: varint too long");
+}
+
+void appendString(string & out, const string & value)
+{
+    appendVarint(out, value.size());
+    out += value;
+}
+
+string readString(const char * & p, const char * end)
+{
+    uint64_t length = readVarint(p, end);
+    if (length > uint64_t(end - p))
+        throw ML::Exception("columnar file: truncated value");
+    string result(p, length);
+    p += length;
+    return result;
+}
+
+string columnName(const vector<string> & names, size_t index)
+{
+    if (index < names.size())
+        return names[index];
+    return "c" + to_string(index);
+}
+
+} // namespace anonymous
+
+
+/*****************************************************************************/
+/* COLUMNAR OUTPUT                                                           */
+/*****************************************************************************/
+
+ColumnarOutput::
+ColumnarOutput(const std::string & filename,
+               const std::string & compression,
+               int level,
+               size_t rowGroupSize)
+    : compression(compression), level(level),
+      rowGroupSize(rowGroupSize),
+      offset(0), closed(false),
+      rowGroups(Json::arrayValue),
+      rowsWritten(0), rawBytes(0), bytesWritten(0)
+{
+    if (!rowGroupSize)
+        throw ML::Exception("columnar output needs rows in its row groups");
+
+    // Fail now rather than on the first row group
+    std::unique_ptr<Compressor> check(Compressor::create(compression, level));
+
+    stream.open(filename, ios::out, "none");
+    write(string(Magic, MagicSize));
+}
+
+ColumnarOutput::
+~ColumnarOutput()
+{
+    close();
+}
+
+void
+ColumnarOutput::
+setColumnNames(const std::string & channel,
+               const std::vector<std::string> & names)
+{
+    tables[channel].names = names;
+}
+
+void
+ColumnarOutput::
+logMessage(const std::string & channel,
+           const std::string & message)
+{
+    if (closed)
+        throw ML::Exception("log message to a closed columnar output");
+
+    Table & table = tables[channel];
+
+    size_t column = 0;
+    for (size_t start = 0;;  ++column) {
+        size_t end = message.find('\t', start);
+        if (end == string::npos)
+            end = message.size();
+
+        // A new column has been empty in all of the previous rows
+        if (column == table.columns.size())
+            table.columns.emplace_back(table.rows);
+
+        table.columns[column].emplace_back(message, start, end - start);
+
+        if (end == message.size()) break;
+        start = end + 1;
+    }
+
+    for (++column;  column < table.columns.size();  ++column)
+        table.columns[column].emplace_back();
+
+    if (++table.rows >= rowGroupSize)
+        writeRowGroup(channel, table);
+}
+
+void
+ColumnarOutput::
+close()
+{
+    if (closed) return;
+    closed = true;
+
+    for (auto & entry: tables) {
+        if (entry.second.rows)
+            writeRowGroup(entry.first, entry.second);
+    }
+
+    Json::Value footer;
+    footer["version"] = 1;
+    footer["compression"] = compression;
+    footer["rowGroups"] = rowGroups;
+
+    string data = footer.toStringNoNewLine();
+    uint64_t length = data.size();
+    for (int i = 0;  i < LengthSize;  ++i)
+        data += char((length >> (8 * i)) & 0xff);
+    data.append(Magic, MagicSize);
+    write(data);
+
+    stream.close();
+}
+
+Json::Value
+ColumnarOutput::
+stats() const
+{
+    Json::Value result;
+    result["rows"] = (Json::UInt)rowsWritten;
+    result["rawBytes"] = (Json::UInt)rawBytes;
+    result["bytesWritten"] = (Json::UInt)bytesWritten;
+    return result;
+}
+
+void
+ColumnarOutput::
+clearStats()
+{
+    rowsWritten = rawBytes = bytesWritten = 0;
+}
+
+void
+ColumnarOutput::
+writeRowGroup(const std::string & channel, Table & table)
+{
+    Json::Value rowGroup;
+    rowGroup["channel"] = channel;
+    rowGroup["rows"] = (Json::UInt)table.rows;
+    rowGroup["columns"] = Json::Value(Json::arrayValue);
+
+    for (size_t i = 0;  i < table.columns.size();  ++i)
+        writeColumn(columnName(table.names, i), table.columns[i], rowGroup);
+
+    rowGroups.append(rowGroup);
+    rowsWritten += table.rows;
+
+    table.columns.clear();
+    table.rows = 0;
+}
+
+void
+ColumnarOutput::
+writeColumn(const std::string & name,
+            const std::vector<std::string> & values,
+            Json::Value & rowGroup)
+{
+    Json::Value column;
+    column["name"] = name;
+
+    unordered_map<string, uint64_t> dictionary;
+    size_t maxDictionary = std::min<size_t>(MaxDictionarySize,
+                                            values.size() / 4);
+    uint64_t empty = 0;
+    const string * min = nullptr;
+    const string * max = nullptr;
+
+    for (auto & value: values) {
+        if (value.empty()) ++empty;
+        if (!min || value < *min) min = &value;
+        if (!max || *max < value) max = &value;
+        if (dictionary.size() <= maxDictionary)
+            dictionary.insert(make_pair(value, dictionary.size()));
+    }
+
+    string encoded;
+    if (dictionary.size() <= maxDictionary) {
+        vector<const string *> entries(dictionary.size());
+        for (auto & entry: dictionary)
+            entries[entry.second] = &entry.first;
+
+        appendVarint(encoded, entries.size());
+        for (auto entry: entries)
+            appendString(encoded, *entry);
+        for (auto & value: values)
+            appendVarint(encoded, dictionary[value]);
+
+        column["encoding"] = "dict";
+        column["distinct"] = (Json::UInt)entries.size();
+    }
+    else {
+        for (auto & value: values)
+            appendString(encoded, value);
+        column["encoding"] = "plain";
+    }
+
+    string compressed = Compressor::compressAll(compression, level,
+                                                encoded.data(),
+                                                encoded.size());
+
+    column["offset"] = (Json::UInt)offset;
+    column["size"] = (Json::UInt)compressed.size();
+    column["rawSize"] = (Json::UInt)encoded.size();
+    column["empty"] = (Json::UInt)empty;
+    if (min) {
+        column["min"] = *min;
+        column["max"] = *max;
+    }
+
+    rawBytes += encoded.size();
+    write(compressed);
+
+    rowGroup["columns"].append(column);
+}
+
+void
+ColumnarOutput::
+write(const std::string & data)
+{
+    stream.write(data.data(), data.size());
+    if (!stream)
+        throw ML::Exception("error writing columnar output");
+
+    offset += data.size();
+    bytesWritten += data.size();
+}
+
+
+/*****************************************************************************/
+/* COLUMNAR READER                                                           */
+/*****************************************************************************/
+
+ColumnarReader::
+ColumnarReader(const std::string & filename)
+    : file(filename)
+{
+    size_t size = file.size();
+    const char * end = file.end();
+
+    if (size < 2 * MagicSize + LengthSize
+        || memcmp(file.start(), Magic, MagicSize) != 0
+        || memcmp(end - MagicSize, Magic, MagicSize) != 0)
+        throw ML::Exception("%s is not a columnar file", filename.c_str());
+
+    uint64_t length = 0;
+    const char * lengthStart = end - MagicSize - LengthSize;
+    for (int i = 0;  i < LengthSize;  ++i)
+        length |= uint64_t((unsigned char)lengthStart[i]) << (8 * i);
+
+    if (length > size - 2 * MagicSize - LengthSize)
+        throw ML::Exception("%s has a truncated footer", filename.c_str());
+
+    footer_ = Json::parse(string(lengthStart - length, length));
+}
+
+std::vector<std::string>
+ColumnarReader::
+readColumn(size_t rowGroupIndex, const std::string & name) const
+{
+    const Json::Value & group = rowGroup(rowGroupIndex);
+    size_t rows = group["rows"].asUInt();
+
+    const Json::Value * column = nullptr;
+    for (auto & c: group["columns"]) {
+        if (c["name"].asString() == name) {
+            column = &c;
+            break;
+        }
+    }
+
+    if (!column)
+        return vector<string>(rows);
+
+    uint64_t offset = (*column)["offset"].asUInt();
+    uint64_t size = (*column)["size"].asUInt();
+    if (offset + size > file.size())
+        throw ML::Exception("column %s is past the end of the file",
+                            name.c_str());
+
+    string encoded
+        = Compressor::decompressAll(footer_["compression"].asString(),
+                                    file.start() + offset, size);
+
+    const char * p = encoded.data();
+    const char * end = p + encoded.size();
+
+    vector<string> result;
+    result.reserve(rows);
+
+    string encoding = (*column)["encoding"].asString();
+    if (encoding == "dict") {
+        vector<string> entries(readVarint(p, end));
+        for (auto & entry: entries)
+            entry = readString(p, end);
+        for (size_t i = 0;  i < rows;  ++i) {
+            uint64_t index = readVarint(p, end);
+            if (index >= entries.size())
+                throw ML::Exception("column %s has a bad dictionary index",
+                                    name.c_str());
+            result.push_back(entries[index]);
+        }
+    }
+    else if (encoding == "plain") {
+        for (size_t i = 0;  i < rows;  ++i)
+            result.push_back(readString(p, end));
+    }
+    else throw ML::Exception("column %s has unknown encoding %s",
+                             name.c_str(), encoding.c_str());
+
+    return result;
+}
+
+void
+ColumnarReader::
+forEachRow(const std::string & channel,
+           const std::vector<std::string> & columns,
+           const std::function<void (const std::vector<std::string> &)>
+               & onRow) const
+{
+    vector<string> row(columns.size());
+
+    for (size_t i = 0;  i < numRowGroups();  ++i) {
+        if (rowGroup(i)["channel"].asString() != channel)
+            continue;
+
+        vector<vector<string> > values;
+        for (auto & column: columns)
+            values.push_back(readColumn(i, column));
+
+        size_t rows = rowGroup(i)["rows"].asUInt();
+        for (size_t j = 0;  j < rows;  ++j) {
+            for (size_t k = 0;  k < columns.size();  ++k)
+                row[k].swap(values[k][j]);
+            onRow(row);
+        }
+    }
+}
+
+} // namespace Datacratic
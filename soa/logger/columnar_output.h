@@ -0,0 +1,154 @@
+/* columnar_output.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Output that writes log messages into a compressed columnar file.
+*/
+
+#pragma once
+
+#include "logger.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/utils/file_functions.h"
+#include "soa/jsoncpp/json.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* COLUMNAR OUTPUT                                                           */
+/*****************************************************************************/
+
+/** Log output that stores the messages of each channel as a table whose
+    columns are the tab separated fields of the messages, so that offline
+    jobs can read only the fields they need instead of parsing whole lines.
+
+    Messages are buffered per channel and written as a row group every
+    rowGroupSize messages and on close.  Each column of a row group is
+    encoded on its own:
+    - "dict" when it has few distinct values (exchanges, accounts, agents):
+      the distinct values followed by the index of each row's value;
+    - "plain" otherwise: each row's value.
+    Lengths and indexes are varints.  The encoded column is then compressed
+    on its own with the given compression.
+
+    The file is self describing:
+
+        "RTBCOL1\n" <column chunks...> <footer> <footer length> "RTBCOL1\n"
+
+    where the footer is a JSON object giving the compression and, for each
+    row group, its channel, number of rows and for each column its name,
+    encoding, offset and size in the file, and statistics (min, max, number
+    of empty values and of distinct values for dict columns).  The footer
+    length is 8 bytes, little endian.  ColumnarReader reads it back.
+*/
+
+struct ColumnarOutput : public LogOutput {
+
+    ColumnarOutput(const std::string & filename,
+                   const std::string & compression = "lz4",
+                   int level = -1,
+                   size_t rowGroupSize = 65536);
+
+    virtual ~ColumnarOutput();
+
+    /** Names the columns of a channel; the ones past the end of the list,
+        and those of channels without names, are called c<index>.
+    */
+    void setColumnNames(const std::string & channel,
+                        const std::vector<std::string> & names);
+
+    virtual void logMessage(const std::string & channel,
+                            const std::string & message);
+
+    /** Writes what's buffered and the footer. */
+    virtual void close();
+
+    virtual Json::Value stats() const;
+    virtual void clearStats();
+
+private:
+    struct Table {
+        Table() : rows(0) {}
+
+        std::vector<std::string> names;
+        std::vector<std::vector<std::string> > columns;
+        size_t rows;
+    };
+
+    void writeRowGroup(const std::string & channel, Table & table);
+
+    /** Encodes and compresses a column and adds its description to
+        the row group.
+    */
+    void writeColumn(const std::string & name,
+                     const std::vector<std::string> & values,
+                     Json::Value & rowGroup);
+
+    void write(const std::string & data);
+
+    std::string compression;
+    int level;
+    size_t rowGroupSize;
+
+    ML::filter_ostream stream;
+    uint64_t offset;
+    bool closed;
+
+    std::map<std::string, Table> tables;
+    Json::Value rowGroups;
+
+    uint64_t rowsWritten;
+    uint64_t rawBytes;
+    uint64_t bytesWritten;
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR READER                                                           */
+/*****************************************************************************/
+
+/** Reads the files written by ColumnarOutput.  The file is mapped in
+    memory so only the columns that are read are loaded from disk.
+*/
+
+struct ColumnarReader {
+
+    ColumnarReader(const std::string & filename);
+
+    /** Footer of the file, as described in ColumnarOutput. */
+    const Json::Value & footer() const { return footer_; }
+
+    size_t numRowGroups() const { return footer_["rowGroups"].size(); }
+
+    const Json::Value & rowGroup(size_t index) const
+    {
+        return footer_["rowGroups"][(Json::Value::ArrayIndex)index];
+    }
+
+    /** Values of the named column of a row group; a column that the row
+        group doesn't have is all empty.
+    */
+    std::vector<std::string>
+    readColumn(size_t rowGroup, const std::string & name) const;
+
+    /** Calls onRow with the values of the given columns of every row of
+        every row group of the channel.
+    */
+    void forEachRow(const std::string & channel,
+                    const std::vector<std::string> & columns,
+                    const std::function<void (const std::vector<std::string> &)>
+                        & onRow) const;
+
+private:
+    ML::File_Read_Buffer file;
+    Json::Value footer_;
+};
+
+} // namespace Datacratic
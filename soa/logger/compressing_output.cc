@@ -187,7 +187,9 @@ CompressingOutput::
 CompressingOutput(size_t ringBufferSize,
                   Compressor::FlushLevel flushLevel)
     : WorkerThreadOutput(ringBufferSize),
-      compressorFlushLevel(flushLevel)
+      compressorFlushLevel(flushLevel),
+      compressionThreads(0),
+      compressionBlockSize(ParallelCompressor::DefaultBlockSize)
 {
 }
 
@@ -205,7 +207,17 @@ open(std::shared_ptr<Sink> sink,
     if (compressor)
         throw ML::Exception("can't open compressor without closing the "
                             "previous one");
-    compressor.reset(Compressor::create(compression, compressionLevel));
+
+    if (compressionThreads
+        && compression != "" && compression != "none") {
+        auto factory = [=] ()
+            {
+                return Compressor::create(compression, compressionLevel);
+            };
+        compressor.reset(new ParallelCompressor(factory, compressionThreads,
+                                                compressionBlockSize));
+    }
+    else compressor.reset(Compressor::create(compression, compressionLevel));
 
     this->sink = sink;
 
@@ -215,6 +227,14 @@ open(std::shared_ptr<Sink> sink,
                        std::placeholders::_2);
 }
 
+void
+CompressingOutput::
+setParallelCompression(unsigned numThreads, size_t blockSize)
+{
+    compressionThreads = numThreads;
+    compressionBlockSize = blockSize;
+}
+
 void
 CompressingOutput::
 closeCompressor()
@@ -130,10 +130,22 @@ struct CompressingOutput : public WorkerThreadOutput {
 
     void closeCompressor();
 
+    /** Compress the files opened from now on in blocks of blockSize bytes
+        on numThreads threads of their own rather than in the worker thread,
+        for when a single thread can't keep up with the log.  A numThreads of
+        0 goes back to compressing in the worker thread.  See
+        ParallelCompressor for how that changes flushing.
+    */
+    void setParallelCompression(unsigned numThreads,
+                                size_t blockSize
+                                    = ParallelCompressor::DefaultBlockSize);
+
     boost::function<void (std::string, std::size_t)> onFileWrite;
 
 protected:
     Compressor::FlushLevel compressorFlushLevel;
+    unsigned compressionThreads;
+    size_t compressionBlockSize;
     std::shared_ptr<Sink> sink;
     std::shared_ptr<Compressor> compressor;
     std::function<size_t (const char *, size_t)> onData;
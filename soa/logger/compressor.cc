@@ -7,8 +7,16 @@
 
 #include "compressor.h"
 #include "jml/utils/exc_assert.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/utils/lz4_filter.h"
 #include <zlib.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 using namespace std;
 
@@ -33,6 +41,18 @@ bool ends_with(const std::string & str, const std::string & what)
         && result == str.size() - what.size();
 }
 
+/** Passes all of the data to onData, which may take it in several goes. */
+size_t writeAll(const char * data, size_t len,
+                const Compressor::OnData & onData)
+{
+    size_t done = 0;
+
+    while (done < len)
+        done += onData(data + done, len - done);
+
+    return done;
+}
+
 } // file scope
 
 std::string
@@ -45,6 +65,8 @@ filenameToCompression(const std::string & filename)
         return "bzip2";
     if (ends_with(filename, ".xz") || ends_with(filename, ".xz~"))
         return "lzma";
+    if (ends_with(filename, ".lz4") || ends_with(filename, ".lz4~"))
+        return "lz4";
     return "none";
 }
 
@@ -55,12 +77,44 @@ create(const std::string & compression,
 {
     if (compression == "gzip" || compression == "gz")
         return new GzipCompressor(level);
+    else if (compression == "lz4")
+        return new Lz4Compressor(level);
     else if (compression == "" || compression == "none")
         return new NullCompressor();
     else throw ML::Exception("unknown compression %s:%d", compression.c_str(),
                              level);
 }
 
+std::string
+Compressor::
+compressAll(const std::string & compression, int level,
+            const char * data, size_t len)
+{
+    string result;
+    auto onData = [&] (const char * data, size_t len)
+        {
+            result.append(data, len);
+            return len;
+        };
+
+    std::unique_ptr<Compressor> compressor(create(compression, level));
+    compressor->compress(data, len, onData);
+    compressor->finish(onData);
+
+    return result;
+}
+
+std::string
+Compressor::
+decompressAll(const std::string & compression,
+              const char * data, size_t len)
+{
+    ML::filter_istream stream;
+    stream.openFromStreambuf(new std::stringbuf(string(data, len)),
+                             true, "", compression);
+    return stream.readAll();
+}
+
 
 /*****************************************************************************/
 /* NULL COMPRESSOR                                                           */
@@ -242,6 +296,343 @@ finish(const OnData & onData)
 }
 
 
+/*****************************************************************************/
+/* LZ4 COMPRESSOR                                                            */
+/*****************************************************************************/
+
+struct Lz4Compressor::Itl {
+
+    Itl(int level, int blockSizeId)
+        : head(blockSizeId, true, true, false),
+          headerWritten(false),
+          compressFn(level < 3 ? LZ4_compress : LZ4_compressHC)
+    {
+    }
+
+    size_t writeHeader(const OnData & onData)
+    {
+        if (headerWritten) return 0;
+        headerWritten = true;
+        return writeAll((const char *)&head, sizeof(head), onData);
+    }
+
+    /** Writes what's buffered as a block: its size, the data (compressed
+        unless that made it bigger) and its checksum.
+    */
+    size_t writeBlock(const OnData & onData)
+    {
+        size_t result = writeHeader(onData);
+        if (buffer.empty()) return result;
+
+        compressed.resize(LZ4_compressBound(buffer.size()));
+        int compressedSize = compressFn(buffer.data(), &compressed[0],
+                                        buffer.size());
+
+        const char * data = compressed.data();
+        uint32_t size = compressedSize;
+        uint32_t marker = size;
+
+        if (compressedSize <= 0 || size >= buffer.size()) {
+            data = buffer.data();
+            size = buffer.size();
+            marker = size | ML::lz4::NotCompressedMask;
+        }
+
+        uint32_t checksum = XXH32(data, size, ML::lz4::ChecksumSeed);
+
+        result += writeAll((const char *)&marker, sizeof(marker), onData);
+        result += writeAll(data, size, onData);
+        result += writeAll((const char *)&checksum, sizeof(checksum), onData);
+
+        buffer.clear();
+        return result;
+    }
+
+    size_t compress(const char * data, size_t len, const OnData & onData)
+    {
+        size_t result = 0;
+
+        while (len) {
+            size_t toCopy = std::min(len, head.blockSize() - buffer.size());
+            buffer.append(data, toCopy);
+            data += toCopy;
+            len -= toCopy;
+
+            if (buffer.size() == head.blockSize())
+                result += writeBlock(onData);
+        }
+
+        return result;
+    }
+
+    size_t flush(FlushLevel flushLevel, const OnData & onData)
+    {
+        if (flushLevel == FLUSH_NONE) return 0;
+        return writeBlock(onData);
+    }
+
+    size_t finish(const OnData & onData)
+    {
+        size_t result = writeBlock(onData);
+
+        const uint32_t eos = 0;
+        result += writeAll((const char *)&eos, sizeof(eos), onData);
+        return result;
+    }
+
+    ML::lz4::Header head;
+    bool headerWritten;
+    int (*compressFn)(const char *, char *, int);
+
+    std::string buffer;      ///< Data of the block being filled
+    std::string compressed;  ///< Reused output buffer for the blocks
+};
+
+Lz4Compressor::
+Lz4Compressor(int level, int blockSizeId)
+    : itl(new Itl(level, blockSizeId))
+{
+}
+
+Lz4Compressor::
+~Lz4Compressor()
+{
+}
+
+size_t
+Lz4Compressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    return itl->compress(data, len, onData);
+}
+    
+size_t
+Lz4Compressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    return itl->flush(flushLevel, onData);
+}
+
+size_t
+Lz4Compressor::
+finish(const OnData & onData)
+{
+    return itl->finish(onData);
+}
+
+
+/*****************************************************************************/
+/* PARALLEL COMPRESSOR                                                       */
+/*****************************************************************************/
+
+struct ParallelCompressor::Itl {
+
+    /** A block and, once a worker is done with it, its compressed stream. */
+    struct Frame {
+        Frame() : done(false) {}
+
+        std::string input;
+        std::string output;
+        std::exception_ptr error;
+        bool done;
+    };
+
+    Itl(Factory factory, unsigned numThreads, size_t blockSize)
+        : factory(std::move(factory)), blockSize(blockSize),
+          maxFrames(2 * numThreads), framesWritten(0), shutdown(false)
+    {
+        if (!numThreads)
+            throw ML::Exception("parallel compressor needs threads");
+
+        // Catch an unknown compression here rather than in the workers.
+        std::unique_ptr<Compressor> check(this->factory());
+
+        for (unsigned i = 0;  i < numThreads;  ++i)
+            workers.emplace_back([=] () { this->runWorker(); });
+    }
+
+    ~Itl()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        toCompress.notify_all();
+
+        for (auto & worker : workers)
+            worker.join();
+    }
+
+    void runWorker()
+    {
+        for (;;) {
+            std::shared_ptr<Frame> frame;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                toCompress.wait(guard, [&] { return shutdown || !queue.empty(); });
+                if (shutdown) return;
+                frame = queue.front();
+                queue.pop_front();
+            }
+
+            std::string output;
+            std::exception_ptr error;
+
+            try {
+                auto append = [&] (const char * data, size_t len)
+                    {
+                        output.append(data, len);
+                        return len;
+                    };
+
+                std::unique_ptr<Compressor> compressor(factory());
+                compressor->compress(frame->input.data(), frame->input.size(),
+                                     append);
+                compressor->finish(append);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                frame->output.swap(output);
+                frame->error = error;
+                frame->input.clear();
+                frame->done = true;
+            }
+            frameDone.notify_all();
+        }
+    }
+
+    /** Queues the block being filled for the workers. */
+    void submit()
+    {
+        auto frame = std::make_shared<Frame>();
+        frame->input.swap(current);
+        current.reserve(blockSize);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queue.push_back(frame);
+        }
+        toCompress.notify_one();
+
+        frames.push_back(frame);
+    }
+
+    /** Writes out the frames that are done, in order, first waiting for
+        the oldest ones until there are no more than maxPending left.
+    */
+    size_t write(const OnData & onData, size_t maxPending)
+    {
+        size_t result = 0;
+
+        while (!frames.empty()) {
+            std::shared_ptr<Frame> frame = frames.front();
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (frames.size() > maxPending)
+                    frameDone.wait(guard, [&] { return frame->done; });
+                else if (!frame->done)
+                    break;
+            }
+
+            frames.pop_front();
+            if (frame->error)
+                std::rethrow_exception(frame->error);
+
+            result += writeAll(frame->output.data(), frame->output.size(),
+                               onData);
+            ++framesWritten;
+        }
+
+        return result;
+    }
+
+    size_t compress(const char * data, size_t len, const OnData & onData)
+    {
+        while (len) {
+            size_t toCopy = std::min(len, blockSize - current.size());
+            current.append(data, toCopy);
+            data += toCopy;
+            len -= toCopy;
+
+            if (current.size() == blockSize)
+                submit();
+        }
+
+        return write(onData, maxFrames);
+    }
+
+    size_t flush(FlushLevel flushLevel, const OnData & onData)
+    {
+        if (flushLevel <= FLUSH_AVAILABLE)
+            return write(onData, maxFrames);
+
+        if (!current.empty()) submit();
+        return write(onData, 0);
+    }
+
+    size_t finish(const OnData & onData)
+    {
+        // An empty file still needs a stream to be a valid one.
+        if (!current.empty() || (frames.empty() && !framesWritten))
+            submit();
+        return write(onData, 0);
+    }
+
+    Factory factory;
+    size_t blockSize;
+    size_t maxFrames;
+
+    std::string current;  ///< Block being filled
+
+    /// Frames that were submitted but not written yet, in order
+    std::deque<std::shared_ptr<Frame> > frames;
+    size_t framesWritten;
+
+    std::mutex lock;
+    std::condition_variable toCompress;
+    std::condition_variable frameDone;
+    std::deque<std::shared_ptr<Frame> > queue;  ///< Guarded by lock
+    bool shutdown;                              ///< Guarded by lock
+
+    std::vector<std::thread> workers;
+};
+
+ParallelCompressor::
+ParallelCompressor(Factory factory, unsigned numThreads, size_t blockSize)
+    : itl(new Itl(std::move(factory), numThreads, blockSize))
+{
+}
+
+ParallelCompressor::
+~ParallelCompressor()
+{
+}
+
+size_t
+ParallelCompressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    return itl->compress(data, len, onData);
+}
+    
+size_t
+ParallelCompressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    return itl->flush(flushLevel, onData);
+}
+
+size_t
+ParallelCompressor::
+finish(const OnData & onData)
+{
+    return itl->finish(onData);
+}
+
+
 /*****************************************************************************/
 /* LZMA COMPRESSOR                                                           */
 /*****************************************************************************/
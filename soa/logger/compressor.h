@@ -68,6 +68,17 @@ struct Compressor {
     /** Create a compressor with the given scheme. */
     static Compressor * create(const std::string & compression,
                                int level);
+
+    /** Compress a whole buffer into a finished stream of the given
+        scheme.
+    */
+    static std::string compressAll(const std::string & compression,
+                                   int level,
+                                   const char * data, size_t len);
+
+    /** Decompress a whole stream written with the given scheme. */
+    static std::string decompressAll(const std::string & compression,
+                                     const char * data, size_t len);
 };
 
 
@@ -135,6 +146,83 @@ private:
     std::unique_ptr<Itl> itl;
 };
 
+
+/*****************************************************************************/
+/* LZ4 COMPRESSOR                                                            */
+/*****************************************************************************/
+
+/** Writes the lz4 frame format of ML::lz4_compressor (jml/utils/lz4_filter.h)
+    so that the output can be read back with filter_streams.  Levels of 3 and
+    up use the slower high compression mode.  Flushing writes out a short
+    block with what's been buffered.
+*/
+
+struct Lz4Compressor : public Compressor {
+
+    Lz4Compressor(int level, int blockSizeId = 7);
+
+    virtual ~Lz4Compressor();
+
+    virtual size_t compress(const char * data, size_t len,
+                            const OnData & onData);
+    
+    virtual size_t flush(FlushLevel flushLevel, const OnData & onData);
+
+    virtual size_t finish(const OnData & onData);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* PARALLEL COMPRESSOR                                                       */
+/*****************************************************************************/
+
+/** Cuts the data into blocks that are each compressed into an independent
+    stream by a pool of threads, and written out in order.  Gzip, lzma and
+    lz4 all read concatenated streams back as a single one, so the output is
+    a valid file of the underlying compression.
+
+    Compressing a block finishes its stream, so the data is only available
+    on decompression at block boundaries.  Flushing at FLUSH_AVAILABLE or
+    less only writes out the blocks that are done, without waiting;
+    FLUSH_SYNC and FLUSH_RESTART cut the current block short and wait for
+    all of them to be written.
+*/
+
+struct ParallelCompressor : public Compressor {
+
+    typedef std::function<Compressor * ()> Factory;
+
+    enum {
+        DefaultBlockSize = 4 * 1024 * 1024
+    };
+
+    /** Creates the compressor of each block with the factory, which is
+        called from the worker threads.  At most twice as many blocks as
+        there are threads are buffered before compress() waits for the
+        first of them to be done.
+    */
+    ParallelCompressor(Factory factory,
+                       unsigned numThreads,
+                       size_t blockSize = DefaultBlockSize);
+
+    virtual ~ParallelCompressor();
+
+    virtual size_t compress(const char * data, size_t len,
+                            const OnData & onData);
+    
+    virtual size_t flush(FlushLevel flushLevel, const OnData & onData);
+
+    virtual size_t finish(const OnData & onData);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
 } // namespace Datacratic
 
 #endif /* __logger__compressor_h__ */
@@ -11,6 +11,8 @@
 #define BOOST_SYSTEM_NO_DEPRECATED
 
 #include <boost/filesystem.hpp>
+#include <fcntl.h>
+#include <stdlib.h>
 
 
 using namespace std;
@@ -257,10 +259,180 @@ flush(FileFlushLevel flushLevel)
 }
 
 
+/*****************************************************************************/
+/* URING FILE SINK                                                           */
+/*****************************************************************************/
+
+UringFileSink::
+UringFileSink(const std::string & filename, bool append, bool disambiguate)
+    : ring(2 * NumBuffers), current(0), inFlight(0), offset(0)
+{
+    iovec iovs[NumBuffers];
+    for (unsigned i = 0;  i < NumBuffers;  ++i) {
+        void * mem;
+        if (posix_memalign(&mem, 4096, BufferSize))
+            throw ML::Exception("can't allocate UringFileSink buffers");
+        buffers[i] = Buffer { (char *)mem, 0, 0, false, { mem, BufferSize } };
+        iovs[i] = buffers[i].iov;
+    }
+
+    fixedBuffers = ring.registerBuffers(iovs, NumBuffers);
+
+    if (filename != "")
+        open(filename, append, disambiguate);
+}
+
+UringFileSink::
+~UringFileSink()
+{
+    close();
+    for (Buffer & buffer : buffers)
+        free(buffer.data);
+}
+
+void
+UringFileSink::
+open(const std::string & filename, bool append, bool disambiguate)
+{
+    close();
+    FileSink::open(filename, append, disambiguate);
+
+    // The writes go to explicit offsets, which O_APPEND would override.
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_APPEND) == -1)
+        throw ML::Exception(errno, "fcntl for " + currentUri);
+
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (end == -1)
+        throw ML::Exception(errno, "lseek for " + currentUri);
+    offset = end;
+}
+
+void
+UringFileSink::
+close()
+{
+    if (fd != -1)
+        flush(FLUSH_TO_OS);
+    FileSink::close();
+}
+
+size_t
+UringFileSink::
+write(const char * data, size_t size)
+{
+    reapCompletions(0);
+
+    size_t done = 0;
+    while (done < size) {
+        Buffer & buffer = buffers[current];
+        while (buffer.busy)
+            reapCompletions(1);
+
+        size_t toCopy = std::min<size_t>(size - done,
+                                         BufferSize - buffer.used);
+        memcpy(buffer.data + buffer.used, data + done, toCopy);
+        buffer.used += toCopy;
+        done += toCopy;
+
+        if (buffer.used == BufferSize)
+            submitCurrent();
+    }
+
+    if (!inFlight && buffers[current].used)
+        submitCurrent();
+
+    return done;
+}
+
+size_t
+UringFileSink::
+flush(FileFlushLevel flushLevel)
+{
+    if (flushLevel == FLUSH_NONE)
+        return 0;
+
+    if (buffers[current].used)
+        submitCurrent();
+    while (inFlight)
+        reapCompletions(1);
+
+    return FileSink::flush(flushLevel);
+}
+
+void
+UringFileSink::
+submitCurrent()
+{
+    Buffer & buffer = buffers[current];
+    buffer.offset = offset;
+    buffer.iov.iov_len = buffer.used;
+
+    // There are more submission entries than buffers so there's always room.
+    bool queued = fixedBuffers
+        ? ring.writeFixed(fd, buffer.data, buffer.used, buffer.offset,
+                          current, current)
+        : ring.write(fd, &buffer.iov, buffer.offset, current);
+    ExcAssert(queued);
+
+    offset += buffer.used;
+    buffer.busy = true;
+    ++inFlight;
+    ring.submit();
+
+    current = (current + 1) % NumBuffers;
+}
+
+void
+UringFileSink::
+reapCompletions(unsigned minComplete)
+{
+    if (minComplete)
+        ring.submit(minComplete);
+
+    uint64_t index;
+    int res;
+    while (ring.reap(index, res)) {
+        Buffer & buffer = buffers[index];
+        size_t size = buffer.used;
+        buffer.used = 0;
+        buffer.busy = false;
+        --inFlight;
+
+        if (res < 0)
+            throw ML::Exception(-res, "io_uring write to FileSink for "
+                                + currentUri);
+
+        // Short writes are finished off synchronously.
+        for (size_t done = res;  done < size;) {
+            ssize_t written = ::pwrite(fd, buffer.data + done, size - done,
+                                       buffer.offset + done);
+            if (written == -1)
+                throw ML::Exception(errno, "write to FileSink for "
+                                    + currentUri);
+            done += written;
+        }
+    }
+}
+
+
 /*****************************************************************************/
 /* FILE OUTPUT                                                               */
 /*****************************************************************************/
 
+namespace {
+
+std::string fileOutputBackend = "posix";
+
+} // file scope
+
+void setFileOutputBackend(const std::string & backend)
+{
+    if (backend != "posix" && backend != "uring")
+        throw ML::Exception("unknown file output backend " + backend);
+    fileOutputBackend = backend;
+}
+
 FileOutput::
 FileOutput(const std::string & filename, size_t ringBufferSize)
     : NamedOutput(ringBufferSize)
@@ -279,6 +451,18 @@ std::shared_ptr<CompressingOutput::Sink>
 FileOutput::
 createSink(const std::string & filename, bool append)
 {
+    if (fileOutputBackend == "uring") {
+        if (IoUring::available())
+            return std::make_shared<UringFileSink>(filename, append);
+
+        static bool warned = false;
+        if (!warned) {
+            cerr << "io_uring isn't available; writing files with write()"
+                 << endl;
+            warned = true;
+        }
+    }
+
     return std::make_shared<FileSink>(filename, append);
 }
 
@@ -12,6 +12,7 @@
 #include "rotating_output.h"
 #include "compressing_output.h"
 #include "soa/service/s3.h"
+#include "soa/service/uring.h"
 
 
 namespace Datacratic {
@@ -96,6 +97,72 @@ struct FileSink : public CompressingOutput::Sink {
 };
 
 
+/*****************************************************************************/
+/* URING FILE SINK                                                           */
+/*****************************************************************************/
+
+/** FileSink that appends through io_uring.  write() copies the data into
+    one of NumBuffers buffers, registered with the kernel when it allows it,
+    and a buffer is only submitted once it's full or when no write is in
+    flight.  A busy writer thus gets many log lines per system call and
+    never blocks on the disk until all the buffers are in flight.
+
+    Data held behind a write in flight goes out with the next write(),
+    flush() or close().
+*/
+
+struct UringFileSink : public FileSink {
+    enum {
+        NumBuffers = 8,
+        BufferSize = 256 * 1024
+    };
+
+    UringFileSink(const std::string & filename = "",
+                  bool append = true,
+                  bool disambiguate = true);
+
+    virtual ~UringFileSink();
+
+    void open(const std::string & filename,
+              bool append,
+              bool disambiguate);
+
+    virtual void close();
+
+    virtual size_t write(const char * data, size_t size);
+
+    virtual size_t flush(FileFlushLevel flushLevel);
+
+private:
+    struct Buffer {
+        char * data;
+        size_t used;
+        uint64_t offset;        ///< Where it's being written in the file
+        bool busy;              ///< Submitted and not completed yet
+        iovec iov;
+    };
+
+    void submitCurrent();
+
+    /** Process the completed writes, waiting for at least minComplete. */
+    void reapCompletions(unsigned minComplete);
+
+    IoUring ring;
+    bool fixedBuffers;
+    Buffer buffers[NumBuffers];
+    unsigned current;
+    unsigned inFlight;
+    uint64_t offset;            ///< End of the file, including what's queued
+};
+
+
+/** Which system calls FileOutput writes its files with: "posix" (the
+    default) for a plain write() per block, or "uring" for a UringFileSink,
+    which falls back to write() on the kernels without io_uring.
+*/
+void setFileOutputBackend(const std::string & backend);
+
+
 /*****************************************************************************/
 /* FILE OUTPUT                                                               */
 /*****************************************************************************/
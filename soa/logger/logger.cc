@@ -14,7 +14,9 @@
 #include "file_output.h"
 #include "publish_output.h"
 #include "callback_output.h"
+#include "jml/arch/wakeup_fd.h"
 #include <boost/make_shared.hpp>
+#include <sched.h>
 
 
 using namespace std;
@@ -46,11 +48,37 @@ clearStats()
 /* LOGGER                                                                    */
 /*****************************************************************************/
 
+/** Wakes up the log thread to drain the thread buffers. */
+struct Logger::BufferWakeup : public AsyncEventSource {
+    BufferWakeup(Logger * logger)
+        : logger(logger), wakeup(EFD_NONBLOCK)
+    {
+    }
+
+    virtual int selectFd() const
+    {
+        return wakeup.fd();
+    }
+
+    virtual bool processOne()
+    {
+        wakeup.tryRead();
+        logger->drainBuffers();
+        return false;
+    }
+
+    Logger * logger;
+    ML::Wakeup_Fd wakeup;
+};
+
 Logger::
 Logger(size_t bufferSize)
     : context(std::make_shared<zmq::context_t>(1)),
       messages(bufferSize),
       outputs(0),
+      retiredSent(0), sentAtStart(0),
+      bufferSize(bufferSize),
+      bufferWakeup(std::make_shared<BufferWakeup>(this)),
       messagesSent(0), messagesDone(0)
 {
     doShutdown = false;
@@ -61,6 +89,9 @@ Logger(zmq::context_t & contextRef, size_t bufferSize)
     : context(ML::make_unowned_std_sp(contextRef)),
       messages(bufferSize),
       outputs(0),
+      retiredSent(0), sentAtStart(0),
+      bufferSize(bufferSize),
+      bufferWakeup(std::make_shared<BufferWakeup>(this)),
       messagesSent(0), messagesDone(0)
 {
     doShutdown = false;
@@ -71,6 +102,9 @@ Logger(std::shared_ptr<zmq::context_t> & context, size_t bufferSize)
     : context(context),
       messages(bufferSize),
       outputs(0),
+      retiredSent(0), sentAtStart(0),
+      bufferSize(bufferSize),
+      bufferWakeup(std::make_shared<BufferWakeup>(this)),
       messagesSent(0), messagesDone(0)
 {
     doShutdown = false;
@@ -93,6 +127,9 @@ init()
     };
 
     messageLoop.addSource("Logger::messages", messages);
+    messageLoop.addSource("Logger::buffers", bufferWakeup);
+    messageLoop.addPeriodic("Logger::drain", 0.01,
+                            [=] (uint64_t) { this->drainBuffers(); });
 }
 
 void
@@ -300,6 +337,7 @@ Logger::
 start(std::function<void ()> onStop)
 {
     messagesSent = messagesDone = 0;
+    sentAtStart = bufferedSent();
     doShutdown = false;
 
     messageLoop.start(onStop);
@@ -321,7 +359,7 @@ void
 Logger::
 waitUntilFinished()
 {
-    while (messagesDone < messagesSent) {
+    while (numMessagesDone() < numMessagesSent()) {
         //cerr << "sent " << messagesSent << " done "
         //     << messagesDone << endl;
         ML::sleep(0.01);
@@ -337,6 +375,9 @@ shutdown()
 {
     messageLoop.shutdown();
 
+    // Whatever was logged since the last drain still goes out.
+    drainBuffers();
+
     doShutdown = true;
 
     delete outputs;  outputs = 0;
@@ -400,6 +441,166 @@ replayDirect(const std::string & filename, ssize_t maxEvents) const
          << messagesDone << endl;
 }
 
+uint64_t
+Logger::
+bufferedSent() const
+{
+    std::lock_guard<std::mutex> guard(buffersLock);
+
+    uint64_t sent = retiredSent;
+    for (auto & buffer: buffers)
+        sent += buffer->sent.load(std::memory_order_relaxed);
+    return sent;
+}
+
+uint64_t
+Logger::
+numMessagesSent() const
+{
+    return messagesSent + bufferedSent() - sentAtStart;
+}
+
+std::shared_ptr<Logger::ThreadBuffer>
+Logger::
+newThreadBuffer()
+{
+    auto buffer = std::make_shared<ThreadBuffer>();
+
+    std::lock_guard<std::mutex> guard(buffersLock);
+    buffers.push_back(buffer);
+    return buffer;
+}
+
+void
+Logger::
+bufferFilled(ThreadBuffer & buffer, size_t pending)
+{
+    if (pending == DrainThreshold)
+        bufferWakeup->wakeup.signal();
+
+    if (pending < bufferSize) return;
+
+    // Same back pressure as when the message ring is full: the thread waits
+    // until the log thread catches up.
+    bufferWakeup->wakeup.signal();
+
+    for (;;) {
+        {
+            std::lock_guard<ML::Spinlock> guard(buffer.lock);
+            if (buffer.pending < bufferSize) return;
+        }
+        sched_yield();
+    }
+}
+
+void
+Logger::
+drainBuffers()
+{
+    std::vector<std::shared_ptr<ThreadBuffer> > toDrain;
+    {
+        std::lock_guard<std::mutex> guard(buffersLock);
+        toDrain = buffers;
+    }
+
+    for (auto & buffer: toDrain) {
+        {
+            std::lock_guard<ML::Spinlock> guard(buffer->lock);
+            if (!buffer->pending) continue;
+            drained.swap(buffer->data);
+            buffer->pending = 0;
+        }
+
+        atomic_add(messagesDone, logEncoded(drained));
+        drained.clear();
+    }
+
+    toDrain.clear();
+
+    // Buffers of threads that exited are only referenced from here.
+    std::lock_guard<std::mutex> guard(buffersLock);
+
+    for (auto it = buffers.begin(); it != buffers.end();) {
+        if (it->use_count() == 1 && !(*it)->pending) {
+            retiredSent += (*it)->sent;
+            it = buffers.erase(it);
+        }
+        else ++it;
+    }
+}
+
+size_t
+Logger::
+logEncoded(const std::string & data)
+{
+    Outputs * current = outputs;
+
+    if (current && current->empty()) {
+        current = 0;
+    }
+    else if (current && current->old) {
+        delete current->old;
+        current->old = 0;
+    }
+
+    const char * pos = data.data();
+    const char * end = pos + data.size();
+
+    auto read = [&] (void * value, size_t size)
+        {
+            memcpy(value, pos, size);
+            pos += size;
+        };
+
+    size_t count = 0;
+    string channel, toLog;
+    toLog.reserve(1024);
+
+    while (pos < end) {
+        uint32_t numParts;
+        read(&numParts, sizeof(numParts));
+
+        bool hasTimestamp = *pos++;
+        toLog.clear();
+
+        if (hasTimestamp) {
+            double seconds;
+            read(&seconds, sizeof(seconds));
+
+            char buffer[Date::PRINT_BUFFER_SIZE];
+            Date date = Date::fromSecondsSinceEpoch(seconds);
+            toLog.append(buffer, date.print(buffer, sizeof(buffer), 5));
+        }
+
+        for (uint32_t i = 0;  i < numParts;  ++i) {
+            uint32_t size;
+            read(&size, sizeof(size));
+            const char * part = pos;
+            pos += size;
+
+            if (i == 0) {
+                channel.assign(part, size);
+                continue;
+            }
+
+            if (memchr(part, '\n', size) || memchr(part, '\t', size)) {
+                cerr << "warning: part " << i + hasTimestamp
+                     << " of message " << channel << " has illegal char: '"
+                     << string(part, size) << "'" << endl;
+            }
+
+            if (hasTimestamp || i > 1) toLog += '\t';
+            toLog.append(part, size);
+        }
+
+        ++count;
+
+        if (current) current->logMessage(channel, toLog);
+    }
+
+    return count;
+}
+
 void
 Logger::
 handleListenerMessage(std::vector<std::string> const & message)
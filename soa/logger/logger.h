@@ -15,11 +15,17 @@
 #include "jml/utils/smart_ptr_utils.h"
 #include "jml/utils/vector_utils.h"
 #include "jml/arch/atomic_ops.h"
+#include "jml/arch/spinlock.h"
+#include "jml/arch/thread_specific.h"
+#include "soa/types/date.h"
 #include "ace/Synch.h"
 #include <boost/function.hpp>
 #include <boost/regex.hpp>
 #include <boost/shared_ptr.hpp>
 #include "soa/jsoncpp/json.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
 
 
 namespace Datacratic {
@@ -76,6 +82,14 @@ struct LogOutput {
     Everything is entirely thread-safe and in normal operation, logging a
     message will not block.  This allows it to be used in contexts where
     logging happens in a time-critical loop, for example.
+
+    Messages are appended in binary form to a buffer owned by the thread that
+    logs them, whose lock is only ever taken by someone else when the log
+    thread swaps the buffer out. The log thread drains the buffers every few milliseconds or
+    as soon as one of them fills up, and does the timestamp formatting and
+    the joining of the parts there. Messages from a given thread keep their
+    order but messages from different threads can be interleaved
+    differently than they were logged.
 */
 
 struct Logger {
@@ -152,19 +166,24 @@ struct Logger {
     void logMessage(const std::string & channel, Args&&... args)
     {
         if (!outputs) return;
-        ML::atomic_add(messagesSent, 1);
-        messages.push(
-           std::vector<std::string>{ channel, Date::now().print(5),
-                         std::forward<Args>(args)... });
+
+        ThreadBuffer & buffer = threadBuffer();
+        std::unique_lock<ML::Spinlock> guard(buffer.lock);
+        buffer.beginMessage(sizeof...(Args) + 1, Date::now());
+        buffer.appendParts(channel, args...);
+        endMessage(buffer, guard);
     }
 
     template<typename... Args>
     void logMessageNoTimestamp(const std::string & channel, Args&&... args)
     {
         if (!outputs) return;
-        ML::atomic_add(messagesSent, 1);
-        messages.push(
-             std::vector<std::string>{ channel, std::forward<Args>(args)... });
+
+        ThreadBuffer & buffer = threadBuffer();
+        std::unique_lock<ML::Spinlock> guard(buffer.lock);
+        buffer.beginMessage(sizeof...(Args) + 1);
+        buffer.appendParts(channel, args...);
+        endMessage(buffer, guard);
     }
 
     void logMessageNoTimestamp(const std::vector<std::string> & message)
@@ -174,8 +193,12 @@ struct Logger {
         if (message.empty())
             throw ML::Exception("can't log empty message");
 
-        ML::atomic_add(messagesSent, 1);
-        messages.push(message);
+        ThreadBuffer & buffer = threadBuffer();
+        std::unique_lock<ML::Spinlock> guard(buffer.lock);
+        buffer.beginMessage(message.size());
+        for (const std::string & part : message)
+            buffer.appendPart(part);
+        endMessage(buffer, guard);
     }
 
     template<typename GetEl>
@@ -185,15 +208,16 @@ struct Logger {
     {
         if (!outputs) return;
 
-        std::vector<std::string> message;
-        message.push_back(channel);
-        message.push_back(Date::now().print(5));
+        ThreadBuffer & buffer = threadBuffer();
+        std::unique_lock<ML::Spinlock> guard(buffer.lock);
+        buffer.beginMessage(numElements + 1, Date::now());
+        buffer.appendPart(channel);
 
         for (unsigned i = 0;  i < numElements;  ++i) {
-            message.push_back(getElement(i));
+            buffer.appendPart(getElement(i));
         }
 
-        messages.push(message);
+        endMessage(buffer, guard);
     }
 
     void start(std::function<void ()> onStop = 0);
@@ -214,7 +238,7 @@ struct Logger {
     void replayDirect(const std::string & filename,
                       ssize_t maxEvents = -1) const;
     
-    uint64_t numMessagesSent() const { return messagesSent; }
+    uint64_t numMessagesSent() const;
     uint64_t numMessagesDone() const { return messagesDone; }
 
     void handleListenerMessage(std::vector<std::string> const & message);
@@ -247,6 +271,146 @@ private:
     /// Current list of outputs.  Must be swapped atomically.
     Outputs * outputs;
 
+    /** Messages logged by a thread, each encoded as the number of parts, a
+        flag followed by the timestamp if it has one and then the size and
+        bytes of each part, the first of which is the channel.
+    */
+    struct ThreadBuffer {
+        ThreadBuffer()
+            : pending(0), sent(0)
+        {
+        }
+
+        void beginMessage(uint32_t numParts)
+        {
+            append(&numParts, sizeof(numParts));
+            data += char(0);
+        }
+
+        void beginMessage(uint32_t numParts, Date timestamp)
+        {
+            append(&numParts, sizeof(numParts));
+            data += char(1);
+            double seconds = timestamp.secondsSinceEpoch();
+            append(&seconds, sizeof(seconds));
+        }
+
+        void appendPart(const char * str, size_t size)
+        {
+            uint32_t size32 = size;
+            append(&size32, sizeof(size32));
+            data.append(str, size);
+        }
+
+        void appendPart(const std::string & str)
+        {
+            appendPart(str.data(), str.size());
+        }
+
+        void appendPart(const char * str)
+        {
+            appendPart(str, strlen(str));
+        }
+
+        template<typename T>
+        void appendPart(const T & value)
+        {
+            appendPart(std::string(value));
+        }
+
+        void appendParts()
+        {
+        }
+
+        template<typename First, typename... Rest>
+        void appendParts(const First & first, const Rest &... rest)
+        {
+            appendPart(first);
+            appendParts(rest...);
+        }
+
+        void append(const void * bytes, size_t size)
+        {
+            data.append(static_cast<const char *>(bytes), size);
+        }
+
+        ML::Spinlock lock;
+        std::string data;              ///< Encoded messages; under lock
+        size_t pending;                ///< Messages in data; under lock
+
+        /// Messages ever logged; only written by the owning thread
+        std::atomic<uint64_t> sent;
+    };
+
+    enum {
+        /** Number of messages in a buffer that wakes up the log thread to
+            drain it before the next periodic drain.
+        */
+        DrainThreshold = 1024
+    };
+
+    ThreadBuffer & threadBuffer()
+    {
+        ThreadBuffers::PerThreadInfo * info = nullptr;
+        std::shared_ptr<ThreadBuffer> & buffer = *threadBuffers.get(info);
+        if (JML_UNLIKELY(!buffer)) buffer = newThreadBuffer();
+        return *buffer;
+    }
+
+    void endMessage(ThreadBuffer & buffer,
+                    std::unique_lock<ML::Spinlock> & guard)
+    {
+        size_t pending = ++buffer.pending;
+        guard.unlock();
+
+        buffer.sent.store(buffer.sent.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+
+        if (JML_UNLIKELY(pending >= DrainThreshold || pending >= bufferSize))
+            bufferFilled(buffer, pending);
+    }
+
+    std::shared_ptr<ThreadBuffer> newThreadBuffer();
+
+    /** Wakes up the log thread when a buffer reaches DrainThreshold and
+        waits for it to be drained when it holds bufferSize messages.
+    */
+    void bufferFilled(ThreadBuffer & buffer, size_t pending);
+
+    /** Swaps out every thread's buffer and logs its messages. Only called
+        from the log thread or once it's stopped.
+    */
+    void drainBuffers();
+
+    /// Logs the messages encoded in data; returns how many there were
+    size_t logEncoded(const std::string & data);
+
+    /// Messages logged by every thread since the logger was created
+    uint64_t bufferedSent() const;
+
+    typedef ML::ThreadSpecificInstanceInfo<std::shared_ptr<ThreadBuffer>,
+                                           Logger> ThreadBuffers;
+    ThreadBuffers threadBuffers;
+
+    /// Buffers of every thread that logged, including ones that exited
+    std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+    mutable std::mutex buffersLock;
+
+    /// Buffer swapped with a thread's so that both keep their capacity
+    std::string drained;
+
+    /// Messages logged by threads whose buffers have been dropped
+    uint64_t retiredSent;
+
+    /// Value of the buffers' sent counts when start() was called
+    uint64_t sentAtStart;
+
+    /// Messages a thread can buffer before it waits for the log thread
+    size_t bufferSize;
+
+    struct BufferWakeup;
+    std::shared_ptr<BufferWakeup> bufferWakeup;
+
     /// Thing we get subscription messages from
     std::vector<std::shared_ptr<zmq::socket_t> > subscriptions;
 
@@ -0,0 +1,178 @@
+/* block_log_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests that block logs can be replayed whole or from any time.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/logger/block_log.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+using namespace Datacratic;
+using namespace std;
+
+
+namespace {
+
+string tmpFile(const string & name)
+{
+    return "build/x86_64/tmp/block_log_test_" + name;
+}
+
+const Date Start = Date::fromSecondsSinceEpoch(1400000000);
+
+/** Writes numRecords records, one every 10ms. */
+void writeLog(const string & filename, const string & compression,
+              unsigned numRecords, size_t blockSize)
+{
+    BlockLogWriter writer(filename, compression, -1, blockSize);
+    for (unsigned i = 0;  i < numRecords;  ++i)
+        writer.write(Start.plusSeconds(i * 0.01),
+                     "record " + to_string(i) + "\n");
+    writer.close();
+
+    BOOST_CHECK_EQUAL(writer.stats().records, numRecords);
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_block_log_replay )
+{
+    enum { NumRecords = 100000 };
+    string filename = tmpFile("replay.blk");
+
+    writeLog(filename, "lz4", NumRecords, 64 * 1024);
+
+    BlockLogReader reader(filename);
+    BOOST_CHECK_EQUAL(reader.compression(), "lz4");
+    BOOST_CHECK_GT(reader.blocks().size(), 10);
+
+    uint64_t records = 0;
+    for (auto & block: reader.blocks()) {
+        BOOST_CHECK_LE(block.earliest, block.latest);
+        records += block.records;
+    }
+    BOOST_CHECK_EQUAL(records, NumRecords);
+
+    for (int threads: { 1, 4 }) {
+        BOOST_TEST_CHECKPOINT("whole file with " << threads << " threads");
+
+        unsigned i = 0;
+        size_t n = reader.replay([&] (Date ts, const char * data, size_t size)
+            {
+                BOOST_REQUIRE_EQUAL(string(data, size),
+                                    "record " + to_string(i) + "\n");
+                BOOST_REQUIRE_EQUAL(ts, Start.plusSeconds(i * 0.01));
+                ++i;
+                return true;
+            }, threads);
+
+        BOOST_CHECK_EQUAL(n, NumRecords);
+        BOOST_CHECK_EQUAL(i, NumRecords);
+    }
+
+    for (int threads: { 1, 3 }) {
+        BOOST_TEST_CHECKPOINT("time window with " << threads << " threads");
+
+        // Records 50000 to 59999
+        unsigned i = 50000;
+        size_t n = reader.replay(Start.plusSeconds(499.995),
+                                 Start.plusSeconds(599.995),
+                                 [&] (Date ts, const char * data, size_t size)
+            {
+                BOOST_REQUIRE_EQUAL(string(data, size),
+                                    "record " + to_string(i) + "\n");
+                ++i;
+                return true;
+            }, threads);
+
+        BOOST_CHECK_EQUAL(n, 10000);
+        BOOST_CHECK_EQUAL(i, 60000);
+    }
+
+    // Stopping part of the way through
+    unsigned seen = 0;
+    reader.replay([&] (Date, const char *, size_t)
+                  {
+                      return ++seen < 1234;
+                  }, 4);
+    BOOST_CHECK_EQUAL(seen, 1234);
+
+    remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_block_log_compressions )
+{
+    for (string compression: { "gzip", "none" }) {
+        string filename = tmpFile("compression." + compression);
+        writeLog(filename, compression, 1000, 4096);
+
+        BlockLogReader reader(filename);
+        BOOST_CHECK_EQUAL(reader.compression(), compression);
+
+        unsigned i = 0;
+        reader.readBlock(1, [&] (Date ts, const char * data, size_t size)
+                         {
+                             ++i;
+                             return true;
+                         });
+        BOOST_CHECK_EQUAL(i, reader.blocks()[1].records);
+        BOOST_CHECK_EQUAL(reader.replay([] (Date, const char *, size_t)
+                                        { return true; }), 1000);
+
+        remove(filename.c_str());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_block_log_output )
+{
+    string filename = tmpFile("output.blk");
+
+    Date before = Date::now();
+    {
+        BlockLogOutput output(filename);
+        output.logMessage("AUCTION", "a\tb");
+        output.logMessage("WIN", "c");
+    }
+    Date after = Date::now();
+
+    vector<string> lines;
+    BlockLogReader reader(filename);
+    reader.replay([&] (Date ts, const char * data, size_t size)
+                  {
+                      BOOST_CHECK_GE(ts, before);
+                      BOOST_CHECK_LE(ts, after);
+                      lines.emplace_back(data, size);
+                      return true;
+                  });
+
+    BOOST_CHECK_EQUAL(lines, vector<string>({ "AUCTION\ta\tb\n", "WIN\tc\n" }));
+
+    remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_block_log_empty_and_bad )
+{
+    string filename = tmpFile("empty.blk");
+    writeLog(filename, "lz4", 0, 4096);
+
+    BlockLogReader reader(filename);
+    BOOST_CHECK_EQUAL(reader.blocks().size(), 0);
+    BOOST_CHECK_EQUAL(reader.replay([] (Date, const char *, size_t)
+                                    { return true; }), 0);
+
+    {
+        ML::filter_ostream stream(filename);
+        stream << "this is not a block log but it's long enough to be one";
+    }
+
+    BOOST_CHECK_THROW(BlockLogReader reader(filename), ML::Exception);
+    remove(filename.c_str());
+}
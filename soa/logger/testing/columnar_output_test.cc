@@ -0,0 +1,145 @@
+/* columnar_output_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests that what's written by the columnar output can be read back.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/logger/columnar_output.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+using namespace Datacratic;
+using namespace std;
+
+
+namespace {
+
+string tmpFile(const string & name)
+{
+    return "build/x86_64/tmp/columnar_output_test_" + name;
+}
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE( test_columnar_round_trip )
+{
+    string filename = tmpFile("round_trip.rtbcol");
+    enum { NumAuctions = 2500, NumWins = 300 };
+
+    vector<string> exchanges = { "adx", "rubicon", "openx" };
+
+    {
+        ColumnarOutput output(filename, "lz4", -1, 1000);
+        output.setColumnNames("AUCTION",
+                              { "timestamp", "auctionId", "exchange" });
+
+        for (unsigned i = 0;  i < NumAuctions;  ++i) {
+            output.logMessage("AUCTION",
+                              to_string(1000000 + i) + "\tauction" + to_string(i)
+                              + "\t" + exchanges[i % exchanges.size()]);
+            if (i < NumWins) {
+                // A field that only some of the messages have
+                string message = "win" + to_string(i) + "\t" + to_string(i * 0.5);
+                if (i % 2) message += "\textra";
+                output.logMessage("WIN", message);
+            }
+        }
+
+        output.close();
+
+        Json::Value stats = output.stats();
+        BOOST_CHECK_EQUAL(stats["rows"].asUInt(), NumAuctions + NumWins);
+    }
+
+    ColumnarReader reader(filename);
+
+    // Two full and one partial row group of auctions and one of wins
+    BOOST_CHECK_EQUAL(reader.numRowGroups(), 4);
+    BOOST_CHECK_EQUAL(reader.footer()["compression"].asString(), "lz4");
+
+    const Json::Value & first = reader.rowGroup(0);
+    BOOST_CHECK_EQUAL(first["channel"].asString(), "AUCTION");
+    BOOST_CHECK_EQUAL(first["rows"].asUInt(), 1000);
+    BOOST_CHECK_EQUAL(first["columns"][1]["encoding"].asString(), "plain");
+    BOOST_CHECK_EQUAL(first["columns"][2]["name"].asString(), "exchange");
+    BOOST_CHECK_EQUAL(first["columns"][2]["encoding"].asString(), "dict");
+    BOOST_CHECK_EQUAL(first["columns"][2]["distinct"].asUInt(), 3);
+    BOOST_CHECK_EQUAL(first["columns"][2]["min"].asString(), "adx");
+    BOOST_CHECK_EQUAL(first["columns"][2]["max"].asString(), "rubicon");
+
+    unsigned i = 0;
+    reader.forEachRow("AUCTION", { "exchange", "auctionId" },
+                      [&] (const vector<string> & row)
+                      {
+                          BOOST_REQUIRE_EQUAL(row.size(), 2);
+                          BOOST_CHECK_EQUAL(row[0], exchanges[i % exchanges.size()]);
+                          BOOST_CHECK_EQUAL(row[1], "auction" + to_string(i));
+                          ++i;
+                      });
+    BOOST_CHECK_EQUAL(i, NumAuctions);
+
+    i = 0;
+    reader.forEachRow("WIN", { "c0", "c2", "missing" },
+                      [&] (const vector<string> & row)
+                      {
+                          BOOST_CHECK_EQUAL(row[0], "win" + to_string(i));
+                          BOOST_CHECK_EQUAL(row[1], i % 2 ? "extra" : "");
+                          BOOST_CHECK_EQUAL(row[2], "");
+                          ++i;
+                      });
+    BOOST_CHECK_EQUAL(i, NumWins);
+
+    const Json::Value & wins = reader.rowGroup(3);
+    BOOST_CHECK_EQUAL(wins["channel"].asString(), "WIN");
+    BOOST_CHECK_EQUAL(wins["columns"][2]["empty"].asUInt(), NumWins / 2);
+
+    remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_compressions )
+{
+    for (string compression: { "gzip", "none" }) {
+        string filename = tmpFile("compression." + compression);
+
+        {
+            ColumnarOutput output(filename, compression);
+            for (unsigned i = 0;  i < 100;  ++i)
+                output.logMessage("BID", "agent" + to_string(i % 2)
+                                  + "\t" + to_string(i));
+        }
+
+        ColumnarReader reader(filename);
+        BOOST_REQUIRE_EQUAL(reader.numRowGroups(), 1);
+        vector<string> agents = reader.readColumn(0, "c0");
+        vector<string> prices = reader.readColumn(0, "c1");
+        BOOST_REQUIRE_EQUAL(agents.size(), 100);
+        for (unsigned i = 0;  i < 100;  ++i) {
+            BOOST_CHECK_EQUAL(agents[i], "agent" + to_string(i % 2));
+            BOOST_CHECK_EQUAL(prices[i], to_string(i));
+        }
+
+        remove(filename.c_str());
+    }
+
+    BOOST_CHECK_THROW(ColumnarOutput(tmpFile("bad"), "unknown"),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_bad_file )
+{
+    string filename = tmpFile("bad_file");
+    {
+        ML::filter_ostream stream(filename);
+        stream << "this is not a columnar file at all";
+    }
+
+    BOOST_CHECK_THROW(ColumnarReader reader(filename), ML::Exception);
+    remove(filename.c_str());
+}
@@ -0,0 +1,165 @@
+/* compressor_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests that what the compressors write decompresses back to the input,
+   including when blocks are compressed in parallel.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/logger/compressor.h"
+#include "jml/utils/lz4_filter.h"
+#include "jml/arch/exception.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <zlib.h>
+#include <memory>
+#include <sstream>
+#include <string>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+/** Decompresses gzip data that may be made of several concatenated
+    streams.
+*/
+string gunzip(const string & data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 16) != Z_OK)
+        throw ML::Exception("inflateInit2 failed");
+
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+
+    string result;
+    char buf[65536];
+
+    while (stream.avail_in) {
+        stream.next_out = (Bytef *)buf;
+        stream.avail_out = sizeof(buf);
+
+        int res = inflate(&stream, Z_NO_FLUSH);
+        result.append(buf, sizeof(buf) - stream.avail_out);
+
+        if (res == Z_STREAM_END) inflateReset(&stream);
+        else if (res != Z_OK) {
+            inflateEnd(&stream);
+            throw ML::Exception("inflate failed");
+        }
+    }
+
+    inflateEnd(&stream);
+    return result;
+}
+
+string unlz4(const string & data)
+{
+    boost::iostreams::filtering_istream stream;
+    stream.push(ML::lz4_decompressor());
+    stream.push(boost::iostreams::array_source(data.data(), data.size()));
+
+    ostringstream result;
+    result << stream.rdbuf();
+    return result.str();
+}
+
+string decompress(const string & compression, const string & data)
+{
+    if (compression == "gzip") return gunzip(data);
+    if (compression == "lz4") return unlz4(data);
+    return data;
+}
+
+/** Log lines with enough repetition to compress, written in pieces with a
+    flush every so often like CompressingOutput does.
+*/
+string compressLog(Compressor & compressor, string & input)
+{
+    string output;
+    auto onData = [&] (const char * data, size_t len)
+        {
+            output.append(data, len);
+            return len;
+        };
+
+    for (unsigned i = 0;  i < 100000;  ++i) {
+        string line = "channel\tauction " + to_string(i * 7919 % 100003)
+            + " bid " + to_string(i % 97) + "\n";
+        input += line;
+        compressor.compress(line.data(), line.size(), onData);
+
+        if (i % 1000 == 0)
+            compressor.flush(Compressor::FLUSH_AVAILABLE, onData);
+        if (i % 30000 == 0)
+            compressor.flush(Compressor::FLUSH_SYNC, onData);
+    }
+
+    compressor.finish(onData);
+    return output;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_compressors )
+{
+    for (string compression : { "none", "gzip", "lz4" }) {
+        for (int level : { 1, 9 }) {
+            std::unique_ptr<Compressor> compressor
+                (Compressor::create(compression, level));
+
+            string input;
+            string output = compressLog(*compressor, input);
+
+            if (compression != "none")
+                BOOST_CHECK_LT(output.size(), input.size() / 2);
+            BOOST_CHECK(decompress(compression, output) == input);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_compressor )
+{
+    for (string compression : { "gzip", "lz4" }) {
+        auto factory = [=] () { return Compressor::create(compression, 1); };
+
+        for (size_t blockSize : { 4096, 65536, 1 << 22 }) {
+            ParallelCompressor compressor(factory, 3, blockSize);
+
+            string input;
+            string output = compressLog(compressor, input);
+
+            BOOST_CHECK(decompress(compression, output) == input);
+        }
+
+        // Nothing written still gives a valid stream.
+        ParallelCompressor compressor(factory, 2);
+        string output;
+        compressor.finish([&] (const char * data, size_t len)
+                          {
+                              output.append(data, len);
+                              return len;
+                          });
+        BOOST_CHECK(!output.empty());
+        BOOST_CHECK_EQUAL(decompress(compression, output), "");
+    }
+
+    auto unknown = [] () { return Compressor::create("unknown", 1); };
+    BOOST_CHECK_THROW(ParallelCompressor(unknown, 2), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_filename_to_compression )
+{
+    BOOST_CHECK_EQUAL(Compressor::filenameToCompression("log.gz"), "gzip");
+    BOOST_CHECK_EQUAL(Compressor::filenameToCompression("log.lz4"), "lz4");
+    BOOST_CHECK_EQUAL(Compressor::filenameToCompression("log.lz4~"), "lz4");
+    BOOST_CHECK_EQUAL(Compressor::filenameToCompression("log"), "none");
+}
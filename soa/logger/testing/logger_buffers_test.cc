@@ -0,0 +1,79 @@
+/* logger_buffers_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests that messages logged from many threads through their own buffers
+   all make it to the outputs, in order for each thread.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "soa/logger/logger.h"
+
+#include <boost/test/unit_test.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace Datacratic;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_thread_buffers )
+{
+    enum { NumThreads = 4, NumMessages = 20000 };
+
+    Logger logger(1000);
+
+    std::mutex lock;
+    vector<vector<string> > received(NumThreads);
+    size_t errors = 0;
+
+    logger.addCallback([&] (string channel, string message) {
+                std::lock_guard<std::mutex> guard(lock);
+
+                // Channels are T<thread>; messages are <timestamp>\t<index>
+                // or just <index> when there's no timestamp.
+                unsigned thread = stoi(channel.substr(1));
+                if (thread >= NumThreads) { ++errors; return; }
+
+                auto tab = message.find('\t');
+                if (thread % 2 == 0 && tab == string::npos) ++errors;
+                if (thread % 2 == 1 && tab != string::npos) ++errors;
+
+                received[thread].push_back(
+                        tab == string::npos ? message : message.substr(tab + 1));
+            });
+
+    logger.init();
+    logger.start();
+
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < NumThreads;  ++i) {
+        threads.emplace_back([&, i] {
+                    string channel = "T" + to_string(i);
+                    for (unsigned j = 0;  j < NumMessages;  ++j) {
+                        if (i % 2 == 0)
+                            logger.logMessage(channel, to_string(j));
+                        else logger.logMessageNoTimestamp(channel, to_string(j));
+                    }
+                });
+    }
+
+    for (auto & thread: threads)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(logger.numMessagesSent(), NumThreads * NumMessages);
+
+    logger.waitUntilFinished();
+    logger.shutdown();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    for (unsigned i = 0;  i < NumThreads;  ++i) {
+        BOOST_REQUIRE_EQUAL(received[i].size(), NumMessages);
+        for (unsigned j = 0;  j < NumMessages;  ++j)
+            BOOST_REQUIRE_EQUAL(received[i][j], to_string(j));
+    }
+}
@@ -5,7 +5,12 @@ $(eval $(call vowscoffee_test,logger_fs_test,logger))
 $(eval $(call test,logger_deadlock_test,logger,boost manual))
 
 $(eval $(call test,multi_output_logger_test,logger,boost))
+$(eval $(call test,logger_buffers_test,logger,boost))
+$(eval $(call test,compressor_test,logger boost_iostreams,boost))
+$(eval $(call test,columnar_output_test,logger,boost))
+$(eval $(call test,block_log_test,logger,boost))
 $(eval $(call test,rotating_file_logger_test,logger,manual boost))
+$(eval $(call test,uring_file_sink_test,logger,boost))
 
 ifeq ($(NODEJS_ENABLED),1)
 $(eval $(call nodejs_test,filter_js_test,logger sync))
@@ -0,0 +1,61 @@
+/* uring_file_sink_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the io_uring file sink.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/file_output.h"
+#include "jml/utils/guard.h"
+#include "jml/arch/format.h"
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+namespace {
+
+string readFile(const string & filename)
+{
+    ifstream stream(filename);
+    ostringstream contents;
+    contents << stream.rdbuf();
+    return contents.str();
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_uring_file_sink )
+{
+    if (!IoUring::available()) {
+        cerr << "io_uring isn't available; skipping" << endl;
+        return;
+    }
+
+    string filename = ML::format("build/x86_64/tmp/uring_file_sink_test-%d.log",
+                                 getpid());
+    ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+    // Enough lines to go around the buffers a few times, with lines that
+    // straddle two buffers.
+    string expected;
+    {
+        UringFileSink sink(filename, true, false);
+        for (unsigned i = 0;  i < 200000;  ++i) {
+            string line = ML::format("line %d of the uring file sink test\n", i);
+            BOOST_CHECK_EQUAL(sink.write(line.c_str(), line.size()),
+                              line.size());
+            expected += line;
+
+            if (i % 50000 == 0)
+                sink.flush(FLUSH_TO_OS);
+        }
+    }
+
+    BOOST_CHECK(readFile(filename) == expected);
+}
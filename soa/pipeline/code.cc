@@ -18,6 +18,7 @@ using namespace Datacratic;
 #include "file_reader_block.cc"
 #include "file_writer_block.cc"
 #include "importer_block.cc"
+#include "parallel_pipeline.cc"
 #include "pin.cc"
 #include "pipeline.cc"
 
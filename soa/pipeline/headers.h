@@ -6,7 +6,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <set>
 
@@ -19,12 +26,15 @@ namespace Datacratic
     struct Connector;
 }
 
+#include "jml/arch/spinlock.h"
+#include "jml/utils/ring_buffer.h"
 #include "soa/types/basic_value_descriptions.h"
 #include "soa/service/logs.h"
 #include "soa/pipeline/pin.h"
 #include "soa/pipeline/block.h"
 #include "soa/pipeline/pipeline.h"
 #include "soa/pipeline/default_pipeline.h"
+#include "soa/pipeline/parallel_pipeline.h"
 #include "soa/pipeline/file_reader_block.h"
 #include "soa/pipeline/file_writer_block.h"
 #include "soa/pipeline/importer_block.h"
@@ -0,0 +1,128 @@
+/* parallel_pipeline.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+*/
+
+ParallelPipeline::ParallelPipeline(int threads) :
+    threads(std::max(threads, 1)),
+    running(0) {
+}
+
+void ParallelPipeline::run() {
+    states.clear();
+    ready.clear();
+    runTimes.clear();
+    exception = nullptr;
+    running = 0;
+
+    for(auto item : getBlocks()) {
+        State state;
+        state.block = item.get();
+        state.count = 0;
+        for(auto pin : item->getIncomingPins()) {
+            if(pin->isConnected()) {
+                state.count++;
+            }
+        }
+
+        if(state.count == 0) {
+            LOG(debug) << "block ready to run name='" << state.block->getPath() << "'" << std::endl;
+            ready.push_back(state.block);
+        }
+
+        states[state.block] = state;
+    }
+
+    for(auto & item : connectors) {
+        auto block = item->getIncomingPin()->getBlock();
+        item->state = &states[block];
+    }
+
+    std::vector<std::thread> workers;
+    for(int i = 0; i != threads; ++i) {
+        workers.emplace_back([&]() { runBlocks(); });
+    }
+
+    for(auto & item : workers) {
+        item.join();
+    }
+
+    if(exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void ParallelPipeline::runBlocks() {
+    std::unique_lock<std::mutex> guard(lock);
+    for(;;) {
+        // nothing left to run once nothing is ready nor running
+        changed.wait(guard, [&]() {
+            return !ready.empty() || running == 0 || exception;
+        });
+
+        if(ready.empty() || exception) {
+            changed.notify_all();
+            return;
+        }
+
+        auto item = ready.back();
+        ready.pop_back();
+        ++running;
+        guard.unlock();
+
+        LOG(debug) << "running block='" << item->getPath() << "'" << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+        try {
+            item->run();
+        }
+        catch(...) {
+            error = std::current_exception();
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        LOG(trace) << "ran block='" << item->getPath() << "' in " << elapsed.count() << "s" << std::endl;
+
+        guard.lock();
+        --running;
+        runTimes[item->getPath()] += elapsed.count();
+        if(error && !exception) {
+            exception = error;
+        }
+
+        changed.notify_all();
+    }
+}
+
+Connector * ParallelPipeline::createConnector(IncomingPin * incoming, OutgoingPin * outgoing) {
+    auto item = std::make_shared<ParallelConnector>(this, incoming, outgoing);
+    connectors.insert(item);
+    return item.get();
+}
+
+std::map<std::string, double> ParallelPipeline::getRunTimes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return runTimes;
+}
+
+ParallelPipeline::
+ParallelConnector::ParallelConnector(ParallelPipeline * pipeline, IncomingPin * incoming, OutgoingPin * outgoing) :
+    Connector(incoming, outgoing),
+    pipeline(pipeline),
+    state(nullptr) {
+}
+
+void ParallelPipeline::ParallelConnector::push() {
+    auto incoming = getIncomingPin();
+    auto outgoing = getOutgoingPin();
+    LOG(pipeline->debug) << "push from '" << outgoing->getPath() << "'" << std::endl;
+
+    std::lock_guard<std::mutex> guard(pipeline->lock);
+    incoming->readFrom(outgoing);
+    --state->count;
+    if(state->count == 0) {
+        LOG(pipeline->debug) << "block ready to run name='" << state->block->getPath() << "'" << std::endl;
+        pipeline->ready.push_back(state->block);
+        pipeline->changed.notify_one();
+    }
+}
@@ -0,0 +1,53 @@
+/* parallel_pipeline.h
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+*/
+
+namespace Datacratic
+{
+    // runs the blocks that are ready on a pool of threads
+    struct ParallelPipeline :
+        public Pipeline
+    {
+        ParallelPipeline(int threads = std::thread::hardware_concurrency());
+
+        void run();
+
+        Connector * createConnector(IncomingPin * incoming, OutgoingPin * outgoing);
+
+        // seconds spent running each block, by path
+        std::map<std::string, double> getRunTimes() const;
+
+    private:
+        struct State {
+            int count;
+            Block * block;
+        };
+
+        struct ParallelConnector :
+            public Connector
+        {
+            ParallelConnector(ParallelPipeline * pipeline, IncomingPin * incoming, OutgoingPin * outgoing);
+
+            void push();
+
+            ParallelPipeline * pipeline;
+            State * state;
+        };
+
+        void runBlocks();
+
+        int threads;
+        std::set<std::shared_ptr<ParallelConnector>> connectors;
+        std::map<Block *, State> states;
+
+        mutable std::mutex lock;
+        std::condition_variable changed;
+        std::vector<Block *> ready;
+        int running;
+        std::exception_ptr exception;
+        std::map<std::string, double> runTimes;
+
+        friend struct ParallelConnector;
+    };
+}
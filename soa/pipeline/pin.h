@@ -294,16 +294,236 @@ namespace Datacratic
         }
     };
 
+    // metrics of a stream consumed through a queue
+    struct StreamMetrics {
+        StreamMetrics() :
+            itemsPushed(0),
+            itemsProcessed(0),
+            batches(0),
+            maxQueueDepth(0),
+            secondsBlocked(0.0) {
+        }
+
+        uint64_t itemsPushed;
+        uint64_t itemsProcessed;
+        uint64_t batches;
+        size_t maxQueueDepth;
+        double secondsBlocked; // producers waiting on a full queue
+    };
+
+    // runs the handlers of a stream on threads of their own, fed with
+    // batches of items through a bounded lock-free queue
+    template<typename T>
+    struct StreamQueue {
+        StreamQueue(Stream<T> handlers, int threads, size_t queueSize, size_t batchSize, int producers) :
+            handlers(std::move(handlers)),
+            queue(queueSize),
+            batchSize(std::max<size_t>(batchSize, 1)),
+            producers(producers),
+            finished(false),
+            failed(false),
+            processed(0) {
+            batch.reserve(this->batchSize);
+            for(int i = 0; i != threads; ++i) {
+                workers.emplace_back([=]() { work(); });
+            }
+        }
+
+        ~StreamQueue() {
+            stop();
+        }
+
+        void push(T const & value) {
+            std::lock_guard<ML::Spinlock> guard(lock);
+            batch.push_back(value);
+            ++metrics.itemsPushed;
+            if(batch.size() >= batchSize) {
+                flush();
+            }
+        }
+
+        // returns true once the last producer is done and all items have
+        // been processed; rethrows the first exception of the handlers
+        bool done() {
+            {
+                std::lock_guard<ML::Spinlock> guard(lock);
+                if(!batch.empty()) {
+                    flush();
+                }
+
+                if(--producers > 0) {
+                    return false;
+                }
+            }
+
+            stop();
+            if(exception) {
+                std::rethrow_exception(exception);
+            }
+
+            return true;
+        }
+
+        StreamMetrics getMetrics() const {
+            std::lock_guard<ML::Spinlock> guard(lock);
+            StreamMetrics result = metrics;
+            result.itemsProcessed = processed;
+            return result;
+        }
+
+    private:
+        static void backoff(int & spins) {
+            if(++spins < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+        void flush() {
+            ++metrics.batches;
+
+            // the batch is left untouched when the push fails
+            if(!queue.tryPush(std::move(batch))) {
+                auto start = std::chrono::steady_clock::now();
+                int spins = 0;
+                do {
+                    backoff(spins);
+                } while(!queue.tryPush(std::move(batch)));
+
+                std::chrono::duration<double> blocked = std::chrono::steady_clock::now() - start;
+                metrics.secondsBlocked += blocked.count();
+            }
+
+            metrics.maxQueueDepth = std::max(metrics.maxQueueDepth, queue.size());
+
+            batch = std::vector<T>();
+            batch.reserve(batchSize);
+        }
+
+        void work() {
+            std::vector<T> items;
+            int spins = 0;
+            for(;;) {
+                // everything was queued before finished was set
+                bool isFinished = finished.load(std::memory_order_acquire);
+                if(queue.tryPop(items)) {
+                    if(!failed) {
+                        try {
+                            for(auto & item : items) {
+                                handlers.pushHandler(item);
+                            }
+                        }
+                        catch(...) {
+                            std::lock_guard<ML::Spinlock> guard(lock);
+                            if(!exception) {
+                                exception = std::current_exception();
+                            }
+                            failed = true;
+                        }
+                    }
+
+                    processed += items.size();
+                    spins = 0;
+                    continue;
+                }
+
+                if(isFinished) {
+                    break;
+                }
+
+                backoff(spins);
+            }
+        }
+
+        void stop() {
+            finished.store(true, std::memory_order_release);
+            for(auto & item : workers) {
+                item.join();
+            }
+
+            workers.clear();
+        }
+
+        Stream<T> handlers;
+        ML::RingBufferMPMC<std::vector<T>> queue;
+        size_t batchSize;
+
+        mutable ML::Spinlock lock;
+        std::vector<T> batch;
+        int producers;
+        StreamMetrics metrics;
+        std::exception_ptr exception;
+
+        std::vector<std::thread> workers;
+        std::atomic<bool> finished;
+        std::atomic<bool> failed;
+        std::atomic<uint64_t> processed;
+    };
+
     // pin for consuming streaming data
     template<typename T>
     struct PullingPin :
         public WritingPin<Stream<T>>
     {
         PullingPin(Block * block, std::string name) :
-            WritingPin<Stream<T>>(block, std::move(name)) {
+            WritingPin<Stream<T>>(block, std::move(name)),
+            threads(0),
+            queueSize(1024),
+            batchSize(64) {
+            auto stream = std::make_shared<Stream<T>>();
+            this->set(stream);
+        }
+
+        // runs the push handler on the given number of threads instead of
+        // the thread of the producer, which only blocks when the queue of
+        // batches is full; the handler must be thread safe if there is more
+        // than one thread and the done handler is called once all the items
+        // were processed
+        void setParallelism(int threads, size_t queueSize = 1024, size_t batchSize = 64) {
+            this->threads = threads;
+            this->queueSize = queueSize;
+            this->batchSize = batchSize;
+        }
+
+        void push() {
+            if(threads <= 0 || !this->isConnected()) {
+                WritingPin<Stream<T>>::push();
+                return;
+            }
+
+            auto handlers = this->get();
+            auto item = std::make_shared<StreamQueue<T>>(*handlers, threads, queueSize, batchSize,
+                                                         this->getConnectors().size());
+            queue = item;
+
             auto stream = std::make_shared<Stream<T>>();
+            stream->pushHandler = [=](T const & value) {
+                item->push(value);
+            };
+
+            stream->doneHandler = [=]() {
+                if(item->done() && handlers->doneHandler) {
+                    handlers->doneHandler();
+                }
+            };
+
+            // producers keep the queued stream, the block keeps its handlers
             this->set(stream);
+            WritingPin<Stream<T>>::push();
+            this->set(handlers);
         }
+
+        StreamMetrics getMetrics() const {
+            return queue ? queue->getMetrics() : StreamMetrics();
+        }
+
+    private:
+        int threads;
+        size_t queueSize;
+        size_t batchSize;
+        std::shared_ptr<StreamQueue<T>> queue;
     };
 }
 
@@ -164,3 +164,85 @@ BOOST_AUTO_TEST_CASE( test_blocks )
     }
 }
 
+
+struct MyBlockThatCountsLines :
+    public Block
+{
+    MyBlockThatCountsLines() :
+        lines(this, "lines"), count(0), total(0), finished(false) {
+    }
+
+    void run() {
+        lines->pushHandler = [&](std::string const & line) {
+            ++count;
+            total += std::stoi(line);
+        };
+
+        lines->doneHandler = [&]() {
+            finished = true;
+        };
+
+        lines.push();
+    }
+
+    PullingPin<std::string> lines;
+    std::atomic<int> count;
+    std::atomic<long> total;
+    bool finished;
+};
+
+struct MyBlockThatProducesNumbers :
+    public Block
+{
+    MyBlockThatProducesNumbers() :
+        lines(this, "lines"), n(0) {
+    }
+
+    void run() {
+        for(int i = 0; i != n; ++i) {
+            lines.push(std::to_string(i));
+        }
+
+        lines.done();
+    }
+
+    PushingPin<std::string> lines;
+    int n;
+};
+
+BOOST_AUTO_TEST_CASE( test_parallel_pipeline )
+{
+    ParallelPipeline pipeline(4);
+
+    auto p = pipeline.create<MyBlockThatProducesNumbers>("p");
+    p->n = 100000;
+
+    auto c = pipeline.create<MyBlockThatCountsLines>("c");
+    c->lines.setParallelism(4, 16, 100);
+    c->lines.connectWith(p->lines);
+
+    auto a = pipeline.create<MyBlock>("a");
+    a->text = "ipsum";
+    a->readingPin.set("Lorem");
+
+    auto b = pipeline.create<MyBlock>("b");
+    b->text = "dolor";
+    b->readingPin.connectWith(a->writingPin);
+
+    pipeline.run();
+
+    BOOST_CHECK(c->finished);
+    BOOST_CHECK_EQUAL(c->count.load(), 100000);
+    BOOST_CHECK_EQUAL(c->total.load(), 100000L * 99999 / 2);
+    BOOST_CHECK(*(b->writingPin) == "Lorem ipsum dolor");
+
+    auto metrics = c->lines.getMetrics();
+    BOOST_CHECK_EQUAL(metrics.itemsPushed, 100000u);
+    BOOST_CHECK_EQUAL(metrics.itemsProcessed, 100000u);
+    BOOST_CHECK_EQUAL(metrics.batches, 1000u);
+    BOOST_CHECK(metrics.maxQueueDepth <= 16);
+
+    auto times = pipeline.getRunTimes();
+    BOOST_CHECK_EQUAL(times.size(), 4u);
+    BOOST_CHECK(times.count("/p"));
+}
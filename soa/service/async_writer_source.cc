@@ -6,7 +6,9 @@
 */
 
 #include <fcntl.h>
+#include <limits.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <poll.h>
 #include <unistd.h>
 
@@ -107,6 +109,27 @@ write(string data, const OnWriteResult & onWriteResult)
     return result;
 }
 
+bool
+AsyncWriterSource::
+writeNoCopy(const char * data, size_t size,
+            const OnWriteResult & onWriteResult)
+{
+    ExcAssert(!closing_);
+    ExcAssert(queueEnabled_);
+
+    bool result(true);
+
+    if (queueEnabled()) {
+        ExcCheck(size > 0, "attempting to write empty data");
+        result = queue_.push_back(AsyncWrite(data, size, onWriteResult));
+    }
+    else {
+        throw ML::Exception("cannot write while queue is disabled");
+    }
+
+    return result;
+}
+
 void
 AsyncWriterSource::
 handleReadReady()
@@ -163,16 +186,13 @@ handleWriteReady()
 
 void
 AsyncWriterSource::
-handleWriteResult(int error, AsyncWrite && currentWrite)
+handleWriteResult(int error, AsyncWrite && write)
 {
-    if (currentWrite.onWriteResult) {
-        currentWrite.onWriteResult(
-            AsyncWriteResult(error,
-                             move(currentWrite.message),
-                             currentWrite.sent)
+    if (write.onWriteResult) {
+        write.onWriteResult(
+            AsyncWriteResult(error, move(write.message), write.sent)
         );
     }
-    currentWrite.clear();
 }
 
 void
@@ -230,50 +250,56 @@ flush()
         return;
     }
 
-    auto popWrite = [&] () {
-        if (queue_.size() == 0) {
-            return false;
-        }
-        auto writes = queue_.pop_front(1);
-        ExcAssert(writes.size() > 0);
-        currentWrite_ = move(writes[0]);
-        return true;
-    };
+    /* All the pending messages are sent with a single writev, up to
+       IOV_MAX of them at a time. */
+    struct iovec iov[IOV_MAX];
+
+    errno = 0;
 
-    if (currentWrite_.message.empty()) {
-        if (!popWrite()) {
-            return;
+    while (true) {
+        if (writes_.size() < IOV_MAX && queue_.size() > 0) {
+            auto writes = queue_.pop_front(IOV_MAX - writes_.size());
+            for (auto & write: writes) {
+                writes_.emplace_back(move(write));
+            }
+        }
+        if (writes_.empty()) {
+            break;
         }
-        if (currentWrite_.message.empty()) {
+        if (writes_.front().size == 0) {
             ExcAssert(closing_);
             handleClosing(false, true);
-            return;
+            break;
         }
-    }
-
-    ssize_t remaining(currentWrite_.message.size() - currentWrite_.sent);
 
-    errno = 0;
+        int iovcnt(0);
+        for (const AsyncWrite & write: writes_) {
+            if (iovcnt == IOV_MAX || write.size == 0) {
+                break;
+            }
+            iov[iovcnt].iov_base = (void *) (write.bytes() + write.sent);
+            iov[iovcnt].iov_len = write.size - write.sent;
+            iovcnt++;
+        }
 
-    while (true) {
-        const char * data = currentWrite_.message.c_str() + currentWrite_.sent;
-        ssize_t len = ::write(fd_, data, remaining);
+        ssize_t len = ::writev(fd_, iov, iovcnt);
         if (len > 0) {
-            currentWrite_.sent += len;
-            remaining -= len;
             bytesSent_ += len;
-            if (remaining == 0) {
-                msgsSent_++;
-                handleWriteResult(0, move(currentWrite_));
-                if (!popWrite()) {
-                    break;
-                }
-                if (currentWrite_.message.empty()) {
-                    ExcAssert(closing_);
-                    handleClosing(false, true);
-                    break;
+            /* a callback may close the fd, which empties "writes_" */
+            while (len > 0 && !writes_.empty()) {
+                AsyncWrite & write = writes_.front();
+                size_t sent = min<size_t>(len, write.size - write.sent);
+                write.sent += sent;
+                len -= sent;
+                if (write.sent == write.size) {
+                    msgsSent_++;
+                    AsyncWrite done(move(write));
+                    writes_.pop_front();
+                    handleWriteResult(0, move(done));
                 }
-                remaining = currentWrite_.message.size();
+            }
+            if (fd_ == -1) {
+                break;
             }
         }
         else if (len < 0) {
@@ -281,8 +307,11 @@ flush()
             if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 break;
             }
-            handleWriteResult(errno, move(currentWrite_));
-            if (errno == EPIPE || errno == EBADF) {
+            int error = errno;
+            AsyncWrite failed(move(writes_.front()));
+            writes_.pop_front();
+            handleWriteResult(error, move(failed));
+            if (error == EPIPE || error == EBADF) {
                 handleClosing(true, true);
                 break;
             }
@@ -290,7 +319,7 @@ flush()
                 /* This exception indicates a lack of code in the handling of
                    errno. In a perfect world, it should never ever be
                    thrown. */
-                throw ML::Exception(errno, "unhandled write error");
+                throw ML::Exception(error, "unhandled write error");
             }
         }
     }
@@ -349,9 +378,27 @@ emptyMessageQueue()
 {
     std::vector<std::string> messages;
 
+    /* the caller's bytes are copied and released through the callback */
+    auto loseWrite = [&] (AsyncWrite & write) {
+        if (write.data) {
+            messages.emplace_back(write.data, write.size);
+            if (write.onWriteResult) {
+                write.onWriteResult(AsyncWriteResult(EPIPE, "", write.sent));
+            }
+        }
+        else {
+            messages.emplace_back(move(write.message));
+        }
+    };
+
+    for (auto & write: writes_) {
+        loseWrite(write);
+    }
+    writes_.clear();
+
     auto writes = queue_.pop_front(0);
     for (auto & write: writes) {
-        messages.emplace_back(move(write.message));
+        loseWrite(write);
     }
 
     return messages;
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -24,7 +25,7 @@ namespace Datacratic {
 /* invoked when a write operation has been performed, where "written" is the
    string that was sent, "writtenSize" is the amount of bytes from it that was
    sent; the latter is always equal to the length of the string when error is
-   0 */
+   0. "written" is empty for the messages enqueued with "writeNoCopy". */
 
 struct AsyncWriteResult {
     AsyncWriteResult(int newError,
@@ -82,6 +83,13 @@ struct AsyncWriterSource : public EpollLoop
         return write(std::string(data, size), onWriteResult);
     }
 
+    /* enqueue "size" bytes at "data" for writing without copying them. The
+     * bytes must remain valid until "onWriteResult" is invoked, which
+     * happens exactly once, including when the message is lost because the
+     * file descriptor was closed (with EPIPE as error). */
+    bool writeNoCopy(const char * data, size_t size,
+                     const OnWriteResult & onWriteResult);
+
     /* returns whether we are ready to accept messages for sending */
     bool queueEnabled()
         const
@@ -143,28 +151,39 @@ protected:
     std::vector<std::string> emptyMessageQueue();
 
 private:
-    /* Structure holding a write operation */
+    /* Structure holding a write operation, either of a message it owns or
+       of bytes owned by the caller when "data" is set. A write of 0 bytes
+       marks a close request. */
     struct AsyncWrite {
         AsyncWrite()
-            : sent(0)
+            : data(nullptr), size(0), sent(0)
         {
         }
 
         AsyncWrite(std::string && newMessage,
                    const OnWriteResult & newOnWriteResult)
-            : message(std::move(newMessage)), sent(0),
+            : message(std::move(newMessage)),
+              data(nullptr), size(message.size()), sent(0),
+              onWriteResult(newOnWriteResult)
+        {
+        }
+
+        AsyncWrite(const char * newData, size_t newSize,
+                   const OnWriteResult & newOnWriteResult)
+            : data(newData), size(newSize), sent(0),
               onWriteResult(newOnWriteResult)
         {
         }
 
-        void clear()
+        const char * bytes()
+            const
         {
-            message.clear();
-            sent = 0;
-            onWriteResult = nullptr;
+            return data ? data : message.c_str();
         }
 
         std::string message;
+        const char * data;
+        size_t size;
         size_t sent;
         OnWriteResult onWriteResult;
     };
@@ -175,7 +194,7 @@ private:
     void handleFdEvent(const ::epoll_event & event);
     void handleReadReady();
     void handleWriteReady();
-    void handleWriteResult(int error, AsyncWrite && currentWrite);
+    void handleWriteResult(int error, AsyncWrite && write);
     void handleClosing(bool fromPeer, bool delayedUnregistration);
 
     /* wakeup operations */
@@ -189,7 +208,9 @@ private:
 
     bool queueEnabled_;
     TypedMessageQueue<AsyncWrite> queue_;
-    AsyncWrite currentWrite_;
+    /* writes taken from the queue and not sent yet, the first of which may
+       have been partially sent */
+    std::deque<AsyncWrite> writes_;
 
     uint64_t bytesSent_;
     uint64_t bytesReceived_;
@@ -153,28 +153,28 @@ void
 MultiAggregator::
 recordHit(const std::string & stat)
 {
-    getAggregator(stat, createNewCounter).record(1.0);
+    getAggregator(stat, createNewCounter)->record(1.0);
 }
 
 void
 MultiAggregator::
 recordCount(const std::string & stat, float quantity)
 {
-    getAggregator(stat, createNewCounter).record(quantity);
+    getAggregator(stat, createNewCounter)->record(quantity);
 }
 
 void
 MultiAggregator::
 recordStableLevel(const std::string & stat, float value)
 {
-    getAggregator(stat, createNewStableLevel).record(value);
+    getAggregator(stat, createNewStableLevel)->record(value);
 }
 
 void
 MultiAggregator::
 recordLevel(const std::string & stat, float value)
 {
-    getAggregator(stat, createNewLevel).record(value);
+    getAggregator(stat, createNewLevel)->record(value);
 }
     
 void
@@ -182,9 +182,29 @@ MultiAggregator::
 recordOutcome(const std::string & stat, float value,
               const std::vector<int>& percentiles)
 {
-    getAggregator(stat, createNewOutcome, percentiles).record(value);
+    getAggregator(stat, createNewOutcome, percentiles)->record(value);
 }
 
+StatHandle
+MultiAggregator::
+getHandle(const std::string & stat,
+          StatEventType type,
+          const std::vector<int> & percentiles)
+{
+    switch (type) {
+    case ET_HIT:
+    case ET_COUNT:
+        return getAggregator(stat, createNewCounter);
+    case ET_STABLE_LEVEL:
+        return getAggregator(stat, createNewStableLevel);
+    case ET_LEVEL:
+        return getAggregator(stat, createNewLevel);
+    case ET_OUTCOME:
+        return getAggregator(stat, createNewOutcome, percentiles);
+    default:
+        throw ML::Exception("unknown stat type %d for %s", type, stat.c_str());
+    }
+}
 
 void
 MultiAggregator::
@@ -101,6 +101,16 @@ struct MultiAggregator {
     void recordOutcome(const std::string & stat, float value,
             const std::vector<int>& percentiles = DefaultOutcomePercentiles);
 
+    /** Resolve the stat once into a handle that records into it directly,
+        for stats recorded often enough that building their name for each
+        event shows up.  The handle records like the record*() function for
+        the given type and stays valid for as long as it's held.
+    */
+    StatHandle getHandle(const std::string & stat,
+                         StatEventType type = ET_COUNT,
+                         const std::vector<int> & percentiles
+                             = DefaultOutcomePercentiles);
+
     /** Dump synchronously (taking the lock).  This should only be used in
         testing or debugging, not when connected to Carbon.
     */
@@ -150,16 +160,17 @@ private:
         then initialize it from the given function.
     */
     template<typename... Args>
-    StatAggregator & getAggregator(const std::string & stat,
-                                   StatAggregator * (*createFn) (Args...),
-                                   Args&&... args)
+    const std::shared_ptr<StatAggregator> &
+    getAggregator(const std::string & stat,
+                  StatAggregator * (*createFn) (Args...),
+                  Args&&... args)
     {
         if (!lookupCache.get())
             lookupCache.reset(new LookupCache());
 
         auto found = lookupCache->find(stat);
         if (found != lookupCache->end())
-            return *found->second->second;
+            return found->second->second;
 
         // Get the read lock to look for the aggregator
         std::unique_lock<Lock> guard(lock);
@@ -171,7 +182,7 @@ private:
 
             (*lookupCache)[stat] = found2;
 
-            return *found2->second;
+            return found2->second;
         }
 
         guard.unlock();
@@ -185,7 +196,7 @@ private:
 
         guard2.unlock();
         (*lookupCache)[stat] = found2;
-        return *found2->second;
+        return found2->second;
     }
     
     std::unique_ptr<std::thread> dumpingThread;
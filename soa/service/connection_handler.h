@@ -52,6 +52,14 @@ struct ConnectionHandler {
     {
     }
 
+    /** Forget the transport so that the handler can be associated with a
+        new one.  Only valid once the handler has been disassociated.
+    */
+    void clearTransport()
+    {
+        transport_ = 0;
+    }
+
     /** Function called when a handler throws an exception. */
     virtual void onHandlerException(const std::string & handler,
                                     const std::exception & exc)
@@ -105,6 +105,21 @@ addPeriodic(double timePeriodSeconds, OnTimer toRun)
     startPolling(timerData);
 }
 
+void
+EndpointBase::
+useTimerWheel(double resolution)
+{
+    if (timerWheel_)
+        throw ML::Exception("endpoint already has a timer wheel");
+    if (numTransports)
+        throw ML::Exception("timer wheel must be set up before transports "
+                            "are created");
+
+    timerWheel_.reset(new TimerWheel(resolution));
+    addPeriodic(resolution,
+                [=] (uint64_t) { this->timerWheel_->advance(); });
+}
+
 void
 EndpointBase::
 spinup(int num_threads, bool synchronous)
@@ -149,6 +164,20 @@ makeRealTime(int priority)
         makeThreadRealTime(*eventThreadList[i], priority);
 }
 
+void
+EndpointBase::
+pinThreads(const std::vector<int> & cpus)
+{
+    if (cpus.empty()) return;
+
+    for (unsigned i = 0;  i < eventThreadList.size();  ++i) {
+        int cpu = cpus[i % cpus.size()];
+        if (!pinThreadToCpu(*eventThreadList[i], cpu))
+            cerr << "warning: " << name() << ": can't pin event thread "
+                 << i << " to cpu " << cpu << endl;
+    }
+}
+
 void
 EndpointBase::
 shutdown()
@@ -81,6 +81,16 @@ struct EndpointBase : public Epoller {
     typedef std::function<void (uint64_t)> OnTimer;
     void addPeriodic(double timePeriodSeconds, OnTimer toRun);
 
+    /** Arm the timeouts of the transports in a timer wheel with ticks of the
+        given number of seconds, driven by a single periodic timer, instead
+        of setting a timerfd of their own each time.  Timeouts then fire up
+        to one tick late.  Must be called before any transport is created.
+    */
+    void useTimerWheel(double resolution);
+
+    /** The timer wheel of the endpoint, or null if it has none. */
+    TimerWheel * timerWheel() const { return timerWheel_.get(); }
+
     /** What host are we connected to? */
     virtual std::string hostname() const = 0;
 
@@ -126,6 +136,10 @@ struct EndpointBase : public Epoller {
     /** Set this endpoint up to handle events in realtime. */
     void makeRealTime(int priority = 1);
 
+    /** Pin the event threads to the given cpus, one cpu per thread in
+        turn. */
+    void pinThreads(const std::vector<int> & cpus);
+
     /** Set the polling mode to the given value. */
     void setPollingMode(enum PollingMode mode);
 
@@ -287,6 +301,8 @@ private:
 
     std::map<std::string, int> numTransportsByHost;
 
+    std::unique_ptr<TimerWheel> timerWheel_;
+
     std::vector<double> totalSleepTime;
     std::vector<rusage> resourceUsage;
     mutable std::mutex usageLock;
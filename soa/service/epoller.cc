@@ -19,8 +19,16 @@ using namespace ML;
 
 namespace Datacratic {
 
-// Maximum number of events that we can handle
-static constexpr int MaxEvents = 1024;
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+static_assert(EPOLLONESHOT == (1u << 30), "unexpected EPOLLONESHOT value");
+static_assert(EPOLLET == (1u << 31), "unexpected EPOLLET value");
+static_assert(EPOLLEXCLUSIVE == (1u << 28), "unexpected EPOLLEXCLUSIVE value");
+
+// Default maximum number of events that we can handle
+static constexpr int DefaultMaxEvents = 1024;
 
 
 /*****************************************************************************/
@@ -29,7 +37,7 @@ static constexpr int MaxEvents = 1024;
 
 Epoller::
 Epoller()
-    : epoll_fd(-1), timeout_(0), numFds_(0)
+    : epoll_fd(-1), timeout_(0), numFds_(0), maxEvents_(DefaultMaxEvents)
 {
 }
 
@@ -66,6 +74,15 @@ close()
     epoll_fd = -2;
 }
 
+void
+Epoller::
+setMaxEvents(int newMaxEvents)
+{
+    if (newMaxEvents <= 0)
+        throw ML::Exception("maximum number of events must be positive");
+    maxEvents_ = newMaxEvents;
+}
+
 void
 Epoller::
 removeFd(int fd)
@@ -109,8 +126,8 @@ handleEvents(int usToWait, int nEvents,
     if (nEvents <= 0)
         throw ML::Exception("can't wait for no events");
 
-    if (nEvents > MaxEvents)
-        nEvents = MaxEvents;
+    if (nEvents > maxEvents_)
+        nEvents = maxEvents_;
 
     for (;;) {
         epoll_event events[nEvents];
@@ -186,20 +203,17 @@ poll() const
 
 void
 Epoller::
-performAddFd(int fd, void * data, bool oneshot, bool restart)
+performAddFd(int fd, void * data, uint32_t flags, bool restart)
 {
     // cerr << (Date::now().print(4)
     //          + " performAddFd: epoll_fd=" + to_string(epoll_fd)
     //          + " fd=" + to_string(fd)
-    //          + " one-shot=" + to_string(oneshot)
+    //          + " flags=" + to_string(flags)
     //          + " restart=" + to_string(restart)
     //          + "\n");
 
     struct epoll_event event;
-    event.events = EPOLLIN;
-    if (oneshot) {
-        event.events |= EPOLLONESHOT;
-    }
+    event.events = EPOLLIN | flags;
     event.data.ptr = data;
 
     if (!restart) {
@@ -210,9 +224,9 @@ performAddFd(int fd, void * data, bool oneshot, bool restart)
     int res = epoll_ctl(epoll_fd, action, fd, &event);
 
     if (res == -1)
-        throw ML::Exception("epoll_ctl: %s (fd=%d, epollfd=%d, oneshot=%d,"
+        throw ML::Exception("epoll_ctl: %s (fd=%d, epollfd=%d, flags=%x,"
                             " restart=%d)",
-                            strerror(errno), fd, epoll_fd, oneshot, restart);
+                            strerror(errno), fd, epoll_fd, flags, restart);
 }
 
 bool
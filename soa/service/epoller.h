@@ -9,6 +9,7 @@
 #define __endpoint__epoller_h__
 
 #include <functional>
+#include <stdint.h>
 #include "soa/service/async_event_source.h"
 
 struct epoll_event;
@@ -39,12 +40,18 @@ struct Epoller: public AsyncEventSource {
         timeout_ = newTimeout;
     }
     
+    /** Set the maximum number of events returned by a single call to
+        epoll_wait.  The events are held on the stack of the calling
+        thread.
+    */
+    void setMaxEvents(int newMaxEvents);
+
     /** Add the given fd to multiplex fd.  It will repeatedly wake up the
         loop without being restarted.
     */
     void addFd(int fd, void * data = 0)
     {
-        performAddFd(fd, data, false, false);
+        performAddFd(fd, data, 0, false);
     }
     
     /** Add the given fd to wake up one a one-shot basis.  It will need to
@@ -52,13 +59,33 @@ struct Epoller: public AsyncEventSource {
     */
     void addFdOneShot(int fd, void * data = 0)
     {
-        performAddFd(fd, data, true, false);
+        performAddFd(fd, data, EPOLLONESHOT_FLAG, false);
     }
 
     /** Restart a woken up one-shot fd. */
     void restartFdOneShot(int fd, void * data = 0)
     {
-        performAddFd(fd, data, true, true);
+        performAddFd(fd, data, EPOLLONESHOT_FLAG, true);
+    }
+
+    /** Add the given fd in edge-triggered mode.  It will only wake up the
+        loop, and a single thread waiting on it, when new data arrives;
+        the handler must therefore consume everything available, until
+        EAGAIN, before returning.
+    */
+    void addFdEdgeTriggered(int fd, void * data = 0)
+    {
+        performAddFd(fd, data, EPOLLET_FLAG, false);
+    }
+
+    /** Add the given fd with EPOLLEXCLUSIVE, for an fd such as a listening
+        socket that is also registered in other epoll sets: only one of
+        them will be woken up per event instead of all of them.  Requires
+        Linux 4.5 or later; the fd can't be modified or made one-shot.
+    */
+    void addFdExclusive(int fd, void * data = 0)
+    {
+        performAddFd(fd, data, EPOLLEXCLUSIVE_FLAG, false);
     }
 
     /** Remove the given fd from the multiplexer set. */
@@ -104,8 +131,13 @@ struct Epoller: public AsyncEventSource {
     virtual bool processOne();
 
 private:
+    /* Values of the epoll flags, so that <sys/epoll.h> isn't needed here */
+    static constexpr uint32_t EPOLLONESHOT_FLAG = 1u << 30;
+    static constexpr uint32_t EPOLLET_FLAG = 1u << 31;
+    static constexpr uint32_t EPOLLEXCLUSIVE_FLAG = 1u << 28;
+
     /* Perform the fd addition and modification */
-    void performAddFd(int fd, void * data, bool oneShot, bool restart);
+    void performAddFd(int fd, void * data, uint32_t flags, bool restart);
 
     /* Fd for the epoll mechanism. */
     int epoll_fd;
@@ -115,6 +147,9 @@ private:
 
     /* Number of registered file descriptors */
     size_t numFds_;
+
+    /* Maximum number of events handled per call to epoll_wait */
+    int maxEvents_;
 };
 
 } // namespace Datacratic
@@ -0,0 +1,198 @@
+/* event_scheduler.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Discrete-event scheduler that runs a simulation on a time of its own.
+*/
+
+#include "event_scheduler.h"
+#include "jml/arch/exception.h"
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+namespace {
+
+std::atomic<EventScheduler *> installedScheduler(nullptr);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* EVENT SCHEDULER                                                           */
+/*****************************************************************************/
+
+EventScheduler::
+EventScheduler(Date start)
+    : nextId(1), now_(start.secondsSinceEpoch())
+{
+}
+
+EventScheduler::
+~EventScheduler()
+{
+    if (current() == this)
+        uninstall();
+}
+
+Date
+EventScheduler::
+now() const
+{
+    return Date::fromSecondsSinceEpoch(now_.load(std::memory_order_relaxed));
+}
+
+void
+EventScheduler::
+install()
+{
+    EventScheduler * expected = nullptr;
+    if (!installedScheduler.compare_exchange_strong(expected, this))
+        throw ML::Exception("EventScheduler: another scheduler is installed");
+    Date::setClock(this);
+}
+
+void
+EventScheduler::
+uninstall()
+{
+    EventScheduler * expected = this;
+    if (!installedScheduler.compare_exchange_strong(expected, nullptr))
+        throw ML::Exception("EventScheduler: not installed");
+    Date::setClock(nullptr);
+}
+
+EventScheduler *
+EventScheduler::
+current()
+{
+    return installedScheduler.load(std::memory_order_relaxed);
+}
+
+EventScheduler::EventId
+EventScheduler::
+schedule(Date when, std::function<void ()> toRun)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    double time = std::max(when.secondsSinceEpoch(), now_.load());
+    EventId id = nextId++;
+    events[Key(time, id)] = { 0.0, [=] (uint64_t) { toRun(); } };
+    eventTimes[id] = time;
+    return id;
+}
+
+EventScheduler::EventId
+EventScheduler::
+schedulePeriodic(double period, std::function<void (uint64_t)> toRun)
+{
+    if (!(period > 0))
+        throw ML::Exception("EventScheduler: period must be positive");
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    double time = now_.load() + period;
+    EventId id = nextId++;
+    events[Key(time, id)] = { period, std::move(toRun) };
+    eventTimes[id] = time;
+    return id;
+}
+
+bool
+EventScheduler::
+cancel(EventId event)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    auto it = eventTimes.find(event);
+    if (it == eventTimes.end())
+        return false;
+
+    events.erase(Key(it->second, event));
+    eventTimes.erase(it);
+    return true;
+}
+
+bool
+EventScheduler::
+popNext(double end, Key & key, Event & event)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    if (events.empty() || events.begin()->first.first > end)
+        return false;
+
+    auto it = events.begin();
+    key = it->first;
+    event = std::move(it->second);
+    events.erase(it);
+
+    // A periodic event goes straight back in so that the time of its next
+    // run doesn't depend on how long this one takes, and so it can be
+    // cancelled from within itself.
+    if (event.period > 0) {
+        double next = key.first + event.period;
+        events[Key(next, key.second)] = event;
+        eventTimes[key.second] = next;
+    }
+    else eventTimes.erase(key.second);
+
+    now_ = key.first;
+    return true;
+}
+
+bool
+EventScheduler::
+runNext()
+{
+    Key key;
+    Event event;
+    if (!popNext(INFINITY, key, event))
+        return false;
+
+    event.toRun(1);
+    return true;
+}
+
+size_t
+EventScheduler::
+runUntil(Date end)
+{
+    double endTime = end.secondsSinceEpoch();
+
+    size_t result = 0;
+    Key key;
+    Event event;
+    while (popNext(endTime, key, event)) {
+        event.toRun(1);
+        ++result;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    if (endTime > now_)
+        now_ = endTime;
+
+    return result;
+}
+
+Date
+EventScheduler::
+nextEventTime() const
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if (events.empty())
+        return Date::positiveInfinity();
+    return Date::fromSecondsSinceEpoch(events.begin()->first.first);
+}
+
+size_t
+EventScheduler::
+numPending() const
+{
+    std::unique_lock<std::mutex> guard(lock);
+    return events.size();
+}
+
+} // namespace Datacratic
@@ -0,0 +1,118 @@
+/* event_scheduler.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Discrete-event scheduler that runs a simulation on a time of its own.
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* EVENT SCHEDULER                                                           */
+/*****************************************************************************/
+
+/** Queue of events to run at given times, with a simulated clock that jumps
+    straight from each event to the next rather than waiting for it.  Once
+    install()ed, it is the clock that Date::now() reads and MessageLoop
+    timers are scheduled on it instead of on the real time clock, so that
+    services built on MessageLoop can be run much faster than real time.
+
+    Events due at the same time run in the order in which they were first
+    scheduled, so a simulation driven from a single thread always runs the
+    same way.  The events run on the thread that calls runNext() or
+    runUntil(); in a simulation the message loops of the services are not
+    started, and that thread drives all of them.
+
+    The scheduler must outlive the message loops that scheduled timers on
+    it.
+*/
+
+struct EventScheduler : public Date::Clock {
+
+    typedef uint64_t EventId;
+
+    EventScheduler(Date start = Date::fromSecondsSinceEpoch(0));
+
+    /** Uninstalls the scheduler if it is installed. */
+    ~EventScheduler();
+
+    EventScheduler(const EventScheduler &) = delete;
+    EventScheduler & operator = (const EventScheduler &) = delete;
+
+    /** Current simulated time. */
+    virtual Date now() const;
+
+    /** Make this the clock that Date::now() returns and the scheduler that
+        MessageLoop timers go to.  Only one can be installed at a time.
+    */
+    void install();
+    void uninstall();
+
+    /** The installed scheduler, or null when there is none. */
+    static EventScheduler * current();
+
+    /** Run the given function once the simulated time reaches when, or at
+        the current time if it has already passed.
+    */
+    EventId schedule(Date when, std::function<void ()> toRun);
+
+    /** Run the given function every period seconds from now on.  It is
+        passed the number of periods since it last ran, which is always 1,
+        like the callbacks of MessageLoop::addPeriodic().
+    */
+    EventId schedulePeriodic(double period,
+                             std::function<void (uint64_t)> toRun);
+
+    /** Stop the given event from running.  Returns false if it has already
+        run or was cancelled.
+    */
+    bool cancel(EventId event);
+
+    /** Advance the time to the next event and run it.  Returns false if
+        there are no events left.
+    */
+    bool runNext();
+
+    /** Run all of the events due up to the given time, and advance the
+        time to it.  Returns the number of events that ran.
+    */
+    size_t runUntil(Date end);
+
+    /** Time of the next event, or positive infinity if there is none. */
+    Date nextEventTime() const;
+
+    size_t numPending() const;
+
+private:
+    struct Event {
+        double period;       ///< Seconds between runs or 0 if only once
+        std::function<void (uint64_t)> toRun;
+    };
+
+    /** Key that orders the events by time and then by id. */
+    typedef std::pair<double, EventId> Key;
+
+    /** Remove the next event due by end, and advance the time to it. */
+    bool popNext(double end, Key & key, Event & event);
+
+    mutable std::mutex lock;
+    std::map<Key, Event> events;
+    std::unordered_map<EventId, double> eventTimes;
+    EventId nextId;
+
+    std::atomic<double> now_;
+};
+
+} // namespace Datacratic
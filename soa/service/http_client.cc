@@ -3,6 +3,8 @@
    Copyright (c) 2014 Datacratic.  All rights reserved.
 */
 
+#include <math.h>
+
 #include "http_client.h"
 #include "http_client_v1.h"
 #include "http_client_v2.h"
@@ -41,6 +43,42 @@ struct AtInit {
 } // file scope
 
 
+/****************************************************************************/
+/* HTTP CLIENT IMPL                                                         */
+/****************************************************************************/
+
+bool
+HttpClientImpl::
+enqueueRequest(const string & verb, const string & resource,
+               const shared_ptr<HttpClientCallbacks> & callbacks,
+               const HttpRequest::Content & content,
+               const RestParams & queryParams, const RestParams & headers,
+               Date deadline)
+{
+    int timeout(-1);
+    if (deadline.isADate()) {
+        /* a timeout of 0 would mean no timeout at all */
+        double secondsLeft = Date::now().secondsUntil(deadline);
+        timeout = max(int(::ceil(secondsLeft)), 1);
+    }
+
+    return enqueueRequest(verb, resource, callbacks, content,
+                          queryParams, headers, timeout);
+}
+
+bool
+HttpClientImpl::
+enqueueRequest(const shared_ptr<const HttpRequestHead> & head,
+               const shared_ptr<HttpClientCallbacks> & callbacks,
+               string && body, Date deadline)
+{
+    HttpRequest::Content content(move(body), head->contentType);
+
+    return enqueueRequest(head->verb, head->resource, callbacks, content,
+                          head->queryParams, head->headers, deadline);
+}
+
+
 /****************************************************************************/
 /* HTTP CLIENT ERROR                                                        */
 /****************************************************************************/
@@ -192,6 +230,44 @@ onDone(const HttpRequest & rq, HttpClientError errorCode)
 /* HTTP CLIENT SIMPLE CALLBACKS                                             */
 /****************************************************************************/
 
+namespace {
+
+/* Response buffers left over by completed requests. Callbacks run on the
+ * thread of the client, so the pool needs no locking. */
+struct ResponseBuffers {
+    enum {
+        MaxBuffers = 64,
+        MinCapacity = 256,
+        MaxCapacity = 1024 * 1024
+    };
+
+    /* gives an empty "str" the capacity of a pooled buffer */
+    void acquire(string & str)
+    {
+        if (str.empty() && str.capacity() < MinCapacity && !free.empty()) {
+            str.swap(free.back());
+            free.pop_back();
+        }
+    }
+
+    /* empties "str", keeping its memory for the next responses */
+    void release(string & str)
+    {
+        str.clear();
+        if (str.capacity() >= MinCapacity && str.capacity() <= MaxCapacity
+            && free.size() < MaxBuffers) {
+            free.emplace_back();
+            free.back().swap(str);
+        }
+    }
+
+    vector<string> free;
+};
+
+thread_local ResponseBuffers responseBuffers;
+
+} // file scope
+
 HttpClientSimpleCallbacks::
 HttpClientSimpleCallbacks(const OnResponse & onResponse)
     : onResponse_(onResponse)
@@ -204,6 +280,8 @@ onResponseStart(const HttpRequest & rq,
                 const string & httpVersion, int code)
 {
     statusCode_ = code;
+    responseBuffers.acquire(headers_);
+    responseBuffers.acquire(body_);
 }
 
 void
@@ -226,8 +304,8 @@ onDone(const HttpRequest & rq, HttpClientError error)
 {
     onResponse(rq, error, statusCode_, move(headers_), move(body_));
     statusCode_ = 0;
-    headers_ = "";
-    body_ = "";
+    responseBuffers.release(headers_);
+    responseBuffers.release(body_);
 }
 
 void
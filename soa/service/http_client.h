@@ -25,6 +25,7 @@
 #include <string>
 
 #include "soa/jsoncpp/value.h"
+#include "soa/types/date.h"
 #include "soa/service/async_event_source.h"
 #include "soa/service/http_header.h"
 
@@ -36,6 +37,30 @@ namespace Datacratic {
 struct HttpClientCallbacks;
 
 
+/****************************************************************************/
+/* HTTP REQUEST HEAD                                                        */
+/****************************************************************************/
+
+/* Request line and headers shared by the requests sent repeatedly to the
+ * same resource. It is built once with HttpClient::prepareRequest and the
+ * requests enqueued with it only carry their body. */
+
+struct HttpRequestHead {
+    std::string verb;
+    std::string resource;
+    RestParams queryParams;
+    RestParams headers;
+    std::string contentType;
+
+    /* full url of the requests */
+    std::string url;
+
+    /* request line and headers, minus "Content-Length" and the terminating
+     * empty line, for implementations that write them out as is */
+    std::string serialized;
+};
+
+
 /****************************************************************************/
 /* HTTP REQUEST                                                             */
 /****************************************************************************/
@@ -53,6 +78,12 @@ struct HttpRequest {
         {
         }
 
+        Content(std::string && str,
+                const std::string & contentType = "")
+            : str(std::move(str)), contentType(contentType)
+        {
+        }
+
         Content(const char * data, uint64_t size,
                 const std::string & contentType = "")
             : str(data, size), contentType(contentType)
@@ -70,7 +101,7 @@ struct HttpRequest {
     };
 
     HttpRequest()
-        : timeout_(-1)
+        : timeout_(-1), deadline_(Date::notADate())
     {
     }
 
@@ -81,7 +112,7 @@ struct HttpRequest {
         noexcept
         : verb_(verb), url_(url), callbacks_(callbacks),
           content_(content), headers_(headers),
-          timeout_(timeout)
+          timeout_(timeout), deadline_(Date::notADate())
     {
     }
 
@@ -93,6 +124,19 @@ struct HttpRequest {
         content_ = Content();
         headers_ = RestParams();
         timeout_ = -1;
+        deadline_ = Date::notADate();
+        head_.reset();
+    }
+
+    /* "url_" is left empty in requests built from a head */
+    const std::string & url() const
+    {
+        return head_ ? head_->url : url_;
+    }
+
+    bool hasExpired(Date now = Date::now()) const
+    {
+        return deadline_.isADate() && deadline_ <= now;
     }
 
     std::string verb_;
@@ -101,6 +145,13 @@ struct HttpRequest {
     Content content_;
     RestParams headers_;
     int timeout_;
+
+    /* absolute time by which the response must have been received, if any */
+    Date deadline_;
+
+    /* prepared request line and headers, in which case "url_", "headers_"
+     * and the content type are left empty */
+    std::shared_ptr<const HttpRequestHead> head_;
 };
 
 
@@ -141,6 +192,40 @@ struct HttpClientImpl : public AsyncEventSource {
                                 const RestParams & headers,
                                 int timeout = -1) = 0;
 
+    /** Enqueue (or perform) the specified request, which fails with
+     *  HttpClientError::Timeout if no response is received by "deadline".
+     *  This default rounds the deadline up to the timeout in seconds of
+     *  the overload above. */
+    virtual bool enqueueRequest(const std::string & verb,
+                                const std::string & resource,
+                                const std::shared_ptr<HttpClientCallbacks> & callbacks,
+                                const HttpRequest::Content & content,
+                                const RestParams & queryParams,
+                                const RestParams & headers,
+                                Date deadline);
+
+    /** Build the head shared by requests with the given parameters */
+    virtual std::shared_ptr<const HttpRequestHead>
+    prepareRequest(const std::string & verb,
+                   const std::string & resource,
+                   const RestParams & queryParams,
+                   const RestParams & headers,
+                   const std::string & contentType) = 0;
+
+    /** Enqueue a request made of the given head and body. This default
+     *  passes the fields of the head to the overloads above. */
+    virtual bool enqueueRequest(const std::shared_ptr<const HttpRequestHead> & head,
+                                const std::shared_ptr<HttpClientCallbacks> & callbacks,
+                                std::string && body,
+                                Date deadline);
+
+    /** Allow the number of connections to grow up to "maxParallel" while
+     *  requests are waiting in the queue. Ignored by implementations with a
+     *  fixed pool. */
+    virtual void setMaxParallel(int maxParallel)
+    {
+    }
+
     /* Returns the number of requests in the queue */
     virtual size_t queuedRequests() const = 0;
 };
@@ -262,6 +347,23 @@ struct HttpClient : public AsyncEventSource {
                               queryParams, headers, timeout);
     }
 
+    /** Performs a POST request that fails with HttpClientError::Timeout
+     *  when no response was received by "deadline", including when it is
+     *  still waiting in the queue at that time.
+     *
+     *  Returns "true" when the request could successfully be enqueued.
+     */
+    bool post(const std::string & resource,
+              const std::shared_ptr<HttpClientCallbacks> & callbacks,
+              const HttpRequest::Content & content,
+              const RestParams & queryParams,
+              const RestParams & headers,
+              Date deadline)
+    {
+        return impl->enqueueRequest("POST", resource, callbacks, content,
+                                    queryParams, headers, deadline);
+    }
+
     /** Performs a PUT request in a similar fashion to "post" above.
      *
      *  Returns "true" when the request could successfully be enqueued.
@@ -306,6 +408,44 @@ struct HttpClient : public AsyncEventSource {
                                     queryParams, headers, timeout);
     }
 
+    /** Serialize the request line and headers of requests that are sent
+     *  repeatedly, so that each of them only costs its body. The head can
+     *  be kept for the lifetime of the client and used from any thread.
+     */
+    std::shared_ptr<const HttpRequestHead>
+    prepareRequest(const std::string & verb,
+                   const std::string & resource,
+                   const RestParams & queryParams = RestParams(),
+                   const RestParams & headers = RestParams(),
+                   const std::string & contentType = "")
+    {
+        return impl->prepareRequest(verb, resource, queryParams, headers,
+                                    contentType);
+    }
+
+    /** Enqueue a request built from a head returned by "prepareRequest",
+     *  taking ownership of the body. With a "deadline", the request fails
+     *  with HttpClientError::Timeout when no response was received by
+     *  then.
+     *
+     *  Returns "true" when the request could successfully be enqueued.
+     */
+    bool enqueueRequest(const std::shared_ptr<const HttpRequestHead> & head,
+                        const std::shared_ptr<HttpClientCallbacks> & callbacks,
+                        std::string && body = std::string(),
+                        Date deadline = Date::notADate())
+    {
+        return impl->enqueueRequest(head, callbacks, std::move(body),
+                                    deadline);
+    }
+
+    /** Allow the pool of "numParallel" connections to grow up to
+     *  "maxParallel" when requests have to wait for a connection. */
+    void setMaxParallel(int maxParallel)
+    {
+        impl->setMaxParallel(maxParallel);
+    }
+
     size_t queuedRequests()
         const
     {
@@ -386,7 +526,11 @@ private:
 /****************************************************************************/
 
 /* This class is a child of HttpClientCallbacks and offers a simplified
- * interface when support for progressive responses is not necessary. */
+ * interface when support for progressive responses is not necessary.
+ *
+ * The headers and body are accumulated in buffers taken from a per-thread
+ * pool. Buffers that "onResponse" leaves in place rather than moving them
+ * away go back to the pool for the next responses. */
 
 struct HttpClientSimpleCallbacks : public HttpClientCallbacks
 {
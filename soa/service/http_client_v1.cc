@@ -215,6 +215,23 @@ enqueueRequest(const string & verb, const string & resource,
     return true;
 }
 
+shared_ptr<const HttpRequestHead>
+HttpClientV1::
+prepareRequest(const string & verb, const string & resource,
+               const RestParams & queryParams, const RestParams & headers,
+               const string & contentType)
+{
+    auto head = make_shared<HttpRequestHead>();
+    head->verb = verb;
+    head->resource = resource;
+    head->queryParams = queryParams;
+    head->headers = headers;
+    head->contentType = contentType;
+    head->url = baseUrl_ + resource + queryParams.uriEscaped();
+
+    return head;
+}
+
 std::vector<std::shared_ptr<HttpRequest>>
 HttpClientV1::
 popRequests(size_t number)
@@ -46,6 +46,7 @@ struct HttpClientV1 : public HttpClientImpl {
     void enableTcpNoDelay(bool value);
     void enablePipelining(bool value);
 
+    using HttpClientImpl::enqueueRequest;
     bool enqueueRequest(const std::string & verb,
                         const std::string & resource,
                         const std::shared_ptr<HttpClientCallbacks> & callbacks,
@@ -54,6 +55,13 @@ struct HttpClientV1 : public HttpClientImpl {
                         const RestParams & headers,
                         int timeout = -1);
 
+    std::shared_ptr<const HttpRequestHead>
+    prepareRequest(const std::string & verb,
+                   const std::string & resource,
+                   const RestParams & queryParams,
+                   const RestParams & headers,
+                   const std::string & contentType);
+
     size_t queuedRequests() const;
 
 private:
@@ -4,6 +4,7 @@
 */
 
 #include <errno.h>
+#include <math.h>
 #include <sys/timerfd.h>
 
 #include "jml/arch/exception.h"
@@ -57,28 +58,38 @@ bool getExpectResponseBody(const HttpRequest & request)
     return (request.verb_ != "HEAD");
 }
 
+/* request line and headers up to, and excluding, the content headers */
 string
-makeRequestStr(const HttpRequest & request)
+makeHeadStr(const string & verb, const string & urlStr,
+            const RestParams & headers)
 {
-    string requestStr;
-    requestStr.reserve(10000);
+    string headStr;
 
-    Url url(request.url_);
-    requestStr = request.verb_ + " " + url.path();
+    Url url(urlStr);
+    headStr = verb + " " + url.path();
     string query = url.query();
     if (query.size() > 0) {
-        requestStr += "?" + query;
+        headStr += "?" + query;
     }
-    requestStr += " HTTP/1.1\r\n";
-    requestStr += "Host: "+ url.host();
+    headStr += " HTTP/1.1\r\n";
+    headStr += "Host: "+ url.host();
     int port = url.port();
     if (port > 0) {
-        requestStr += ":" + to_string(port);
+        headStr += ":" + to_string(port);
     }
-    requestStr += "\r\nAccept: */*\r\n";
-    for (const auto & header: request.headers_) {
-        requestStr += header.first + ":" + header.second + "\r\n";
+    headStr += "\r\nAccept: */*\r\n";
+    for (const auto & header: headers) {
+        headStr += header.first + ":" + header.second + "\r\n";
     }
+
+    return headStr;
+}
+
+string
+makeRequestStr(const HttpRequest & request)
+{
+    string requestStr = makeHeadStr(request.verb_, request.url_,
+                                    request.headers_);
     const auto & content = request.content_;
     if (!content.str.empty()) {
         requestStr += ("Content-Length: "
@@ -90,6 +101,28 @@ makeRequestStr(const HttpRequest & request)
     return requestStr;
 }
 
+/* "bodySize" is the size of the body that will be appended to the result,
+ * so that the request is written in a single allocation */
+string
+makePreparedRequestStr(const HttpRequest & request, size_t bodySize)
+{
+    const string & head = request.head_->serialized;
+    size_t contentLength = request.content_.str.size();
+
+    string requestStr;
+    requestStr.reserve(head.size() + 40 + bodySize);
+    requestStr.append(head);
+    if (contentLength > 0) {
+        char lengthStr[40];
+        int len = ::snprintf(lengthStr, sizeof(lengthStr),
+                             "Content-Length: %zu\r\n", contentLength);
+        requestStr.append(lengthStr, len);
+    }
+    requestStr.append("\r\n");
+
+    return requestStr;
+}
+
 } // file scope
 
 
@@ -159,6 +192,7 @@ perform(HttpRequest && request)
     }
 
     request_ = move(request);
+    requestStart_ = Date::now();
 
     if (queueEnabled()) {
         startSendingRequest();
@@ -188,18 +222,20 @@ startSendingRequest()
     static constexpr size_t TwoStepsThreshold(65536);
 
     parser_.setExpectBody(getExpectResponseBody(request_));
-    string rqData = makeRequestStr(request_);
-
-    bool twoSteps(false);
 
     const HttpRequest::Content & content = request_.content_;
-    if (content.str.size() > 0) {
-        if (content.str.size() < TwoStepsThreshold) {
-            rqData.append(content.str);
-        }
-        else {
-            twoSteps = true;
-        }
+    bool twoSteps(content.str.size() >= TwoStepsThreshold);
+
+    string rqData;
+    if (request_.head_) {
+        rqData = makePreparedRequestStr(request_,
+                                        twoSteps ? 0 : content.str.size());
+    }
+    else {
+        rqData = makeRequestStr(request_);
+    }
+    if (!twoSteps) {
+        rqData.append(content.str);
     }
     responseState_ = PENDING;
 
@@ -333,7 +369,18 @@ void
 HttpConnection::
 armRequestTimer()
 {
+    double seconds(-1);
     if (request_.timeout_ > 0) {
+        seconds = request_.timeout_;
+    }
+    if (request_.deadline_.isADate()) {
+        double secondsLeft = Date::now().secondsUntil(request_.deadline_);
+        /* a zero delay would disarm the timer */
+        secondsLeft = max(secondsLeft, 0.000001);
+        seconds = (seconds > 0) ? min(seconds, secondsLeft) : secondsLeft;
+    }
+
+    if (seconds > 0) {
         if (timeoutFd_ == -1) {
             timeoutFd_ = timerfd_create(CLOCK_MONOTONIC,
                                         TFD_NONBLOCK | TFD_CLOEXEC);
@@ -357,7 +404,8 @@ armRequestTimer()
         ::memset(&spec, 0, sizeof(itimerspec));
 
         spec.it_interval.tv_sec = 0;
-        spec.it_value.tv_sec = request_.timeout_;
+        spec.it_value.tv_sec = seconds;
+        spec.it_value.tv_nsec = (seconds - spec.it_value.tv_sec) * 1000000000;
         int res = timerfd_settime(timeoutFd_, 0, &spec, nullptr);
         if (res == -1) {
             throw ML::Exception(errno, "timerfd_settime");
@@ -416,22 +464,21 @@ HttpClientV2(const string & baseUrl, int numParallel, size_t queueSize)
     : HttpClientImpl(baseUrl, numParallel, queueSize),
       loop_(1, 0, -1),
       baseUrl_(baseUrl),
-      avlConnections_(numParallel),
       nextAvail_(0),
+      maxParallel_(numParallel),
+      numEnqueued_(0),
+      lastNumEnqueued_(0),
+      lastRateUpdate_(Date::now()),
+      requestRate_(0),
+      responseTime_(0),
       queue_([&]() { this->handleQueueEvent(); return false; }, queueSize)
 {
     ExcAssert(baseUrl.compare(0, 8, "https://") != 0);
 
     /* available connections */
+    avlConnections_.reserve(numParallel);
     for (size_t i = 0; i < numParallel; i++) {
-        HttpConnection * connPtr = new HttpConnection();
-        shared_ptr<HttpConnection> connection(connPtr);
-        connection->init(baseUrl);
-        connection->onDone = [&, connPtr] (TcpConnectionCode result) {
-            handleHttpConnectionDone(connPtr, result);
-        };
-        loop_.addSource("connection" + to_string(i), connection);
-        avlConnections_[i] = connPtr;
+        addConnection();
     }
     loop_.addSource("queue", queue_);
 }
@@ -485,6 +532,13 @@ enablePipelining(bool value)
     }
 }
 
+void
+HttpClientV2::
+setMaxParallel(int maxParallel)
+{
+    maxParallel_ = max<size_t>(maxParallel, avlConnections_.size());
+}
+
 bool
 HttpClientV2::
 enqueueRequest(const string & verb, const string & resource,
@@ -496,18 +550,99 @@ enqueueRequest(const string & verb, const string & resource,
     string url = baseUrl_ + resource + queryParams.uriEscaped();
     HttpRequest request(verb, url, callbacks, content, headers, timeout);
 
-    return queue_.push_back(std::move(request));
+    if (!queue_.push_back(std::move(request))) {
+        return false;
+    }
+    numEnqueued_++;
+
+    return true;
+}
+
+shared_ptr<const HttpRequestHead>
+HttpClientV2::
+prepareRequest(const string & verb, const string & resource,
+               const RestParams & queryParams, const RestParams & headers,
+               const string & contentType)
+{
+    auto head = make_shared<HttpRequestHead>();
+    head->verb = verb;
+    head->resource = resource;
+    head->queryParams = queryParams;
+    head->headers = headers;
+    head->contentType = contentType;
+    head->url = baseUrl_ + resource + queryParams.uriEscaped();
+
+    head->serialized = makeHeadStr(verb, head->url, headers);
+    if (!contentType.empty()) {
+        head->serialized += "Content-Type: " + contentType + "\r\n";
+    }
+
+    return head;
+}
+
+bool
+HttpClientV2::
+enqueueRequest(const shared_ptr<const HttpRequestHead> & head,
+               const shared_ptr<HttpClientCallbacks> & callbacks,
+               string && body, Date deadline)
+{
+    HttpRequest request;
+    request.verb_ = head->verb;
+    request.callbacks_ = callbacks;
+    request.content_.str = move(body);
+    request.deadline_ = deadline;
+    request.head_ = head;
+
+    if (!queue_.push_back(std::move(request))) {
+        return false;
+    }
+    numEnqueued_++;
+
+    return true;
+}
+
+bool
+HttpClientV2::
+enqueueRequest(const string & verb, const string & resource,
+               const shared_ptr<HttpClientCallbacks> & callbacks,
+               const HttpRequest::Content & content,
+               const RestParams & queryParams, const RestParams & headers,
+               Date deadline)
+{
+    string url = baseUrl_ + resource + queryParams.uriEscaped();
+    HttpRequest request(verb, url, callbacks, content, headers);
+    request.deadline_ = deadline;
+
+    if (!queue_.push_back(std::move(request))) {
+        return false;
+    }
+    numEnqueued_++;
+
+    return true;
 }
 
 void
 HttpClientV2::
 handleQueueEvent()
 {
+    Date now = Date::now();
+    updateRequestRate(now);
+
     size_t numConnections = avlConnections_.size() - nextAvail_;
+    size_t numQueued = queue_.size();
+    if (numQueued > numConnections) {
+        growConnections(numQueued - numConnections);
+        numConnections = avlConnections_.size() - nextAvail_;
+    }
+
     if (numConnections > 0) {
         /* "0" has a special meaning for pop_front and must be avoided here */
         auto requests = queue_.pop_front(numConnections);
-        for (auto request: requests) {
+        for (auto & request: requests) {
+            if (request.hasExpired(now)) {
+                expireRequest(request);
+                continue;
+            }
             HttpConnection * conn = getConnection();
             if (!conn) {
                 cerr << ("nextAvail_: "  + to_string(nextAvail_)
@@ -527,13 +662,73 @@ HttpClientV2::
 handleHttpConnectionDone(HttpConnection * connection,
                          TcpConnectionCode result)
 {
-    auto requests = queue_.pop_front(1);
-    if (requests.size() > 0) {
-        // cerr << "emptying queue...\n";
-        connection->perform(move(requests[0]));
+    if (result == Success) {
+        double responseTime = Date::now().secondsSince(connection->requestStart());
+        responseTime_ = (responseTime_ == 0
+                         ? responseTime
+                         : 0.9 * responseTime_ + 0.1 * responseTime);
     }
-    else {
-        releaseConnection(connection);
+
+    /* The queue only notifies when it stops being empty, so the requests
+       waiting for a connection are handed out from here. */
+    releaseConnection(connection);
+    handleQueueEvent();
+}
+
+void
+HttpClientV2::
+addConnection()
+{
+    size_t i = avlConnections_.size();
+
+    HttpConnection * connPtr = new HttpConnection();
+    shared_ptr<HttpConnection> connection(connPtr);
+    connection->init(baseUrl_);
+    connection->onDone = [&, connPtr] (TcpConnectionCode result) {
+        handleHttpConnectionDone(connPtr, result);
+    };
+    loop_.addSource("connection" + to_string(i), connection);
+
+    /* connections past "nextAvail_" are the available ones */
+    avlConnections_.push_back(connPtr);
+}
+
+void
+HttpClientV2::
+growConnections(size_t numWaiting)
+{
+    size_t wanted = nextAvail_ + numWaiting;
+    size_t estimate = ::ceil(requestRate_ * responseTime_);
+    wanted = min(max(wanted, estimate), maxParallel_);
+
+    while (avlConnections_.size() < wanted) {
+        addConnection();
+    }
+}
+
+void
+HttpClientV2::
+updateRequestRate(Date now)
+{
+    double elapsed = now.secondsSince(lastRateUpdate_);
+    if (elapsed < 0.1) {
+        return;
+    }
+
+    uint64_t numEnqueued = numEnqueued_;
+    double rate = (numEnqueued - lastNumEnqueued_) / elapsed;
+    requestRate_ = 0.8 * requestRate_ + 0.2 * rate;
+
+    lastNumEnqueued_ = numEnqueued;
+    lastRateUpdate_ = now;
+}
+
+void
+HttpClientV2::
+expireRequest(HttpRequest & request)
+{
+    if (request.callbacks_) {
+        request.callbacks_->onDone(request, HttpClientError::Timeout);
     }
 }
 
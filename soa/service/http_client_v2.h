@@ -21,6 +21,7 @@
    - pipelining
  */
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -61,6 +62,12 @@ struct HttpConnection : TcpClient {
         return request_;
     }
 
+    /* time at which the last request was handed to this connection */
+    Date requestStart() const
+    {
+        return requestStart_;
+    }
+
     OnDone onDone;
 
 private:
@@ -85,6 +92,7 @@ private:
     HttpState responseState_;
     HttpRequest request_;
     bool requestEnded_;
+    Date requestStart_;
 
     /* Connection: close */
     TcpConnectionCode lastCode_;
@@ -126,6 +134,36 @@ struct HttpClientV2 : public HttpClientImpl {
                         const RestParams & headers,
                         int timeout = -1);
 
+    /* Requests whose deadline passes while they are queued are failed
+       without using a connection. */
+    bool enqueueRequest(const std::string & verb,
+                        const std::string & resource,
+                        const std::shared_ptr<HttpClientCallbacks> & callbacks,
+                        const HttpRequest::Content & content,
+                        const RestParams & queryParams,
+                        const RestParams & headers,
+                        Date deadline);
+
+    /* The head is serialized here and requests made from it are written
+       with a single allocation. */
+    std::shared_ptr<const HttpRequestHead>
+    prepareRequest(const std::string & verb,
+                   const std::string & resource,
+                   const RestParams & queryParams,
+                   const RestParams & headers,
+                   const std::string & contentType);
+
+    bool enqueueRequest(const std::shared_ptr<const HttpRequestHead> & head,
+                        const std::shared_ptr<HttpClientCallbacks> & callbacks,
+                        std::string && body,
+                        Date deadline);
+
+    /* The pool grows when requests wait for a connection, to the larger of
+       the number of busy and waiting requests and of the request rate times
+       the average response time (Little's law). Idle connections are kept
+       open for later requests. */
+    void setMaxParallel(int maxParallel);
+
     size_t queuedRequests()
         const
     {
@@ -144,12 +182,25 @@ private:
     HttpConnection * getConnection();
     void releaseConnection(HttpConnection * connection);
 
+    void addConnection();
+    void growConnections(size_t numWaiting);
+    void updateRequestRate(Date now);
+    void expireRequest(HttpRequest & request);
+
     MessageLoop loop_;
 
     std::string baseUrl_;
 
     std::vector<HttpConnection *> avlConnections_;
     size_t nextAvail_;
+    size_t maxParallel_;
+
+    /* pool sizing */
+    std::atomic<uint64_t> numEnqueued_;
+    uint64_t lastNumEnqueued_;
+    Date lastRateUpdate_;
+    double requestRate_;    /* requests per second */
+    double responseTime_;   /* seconds */
 
     TypedMessageQueue<HttpRequest> queue_; /* queued requests */
 
@@ -41,6 +41,22 @@ onGotTransport()
     startReading();
 }
 
+void
+HttpConnectionHandler::
+reset()
+{
+    clearTransport();
+    readState = INVALID;
+    headerText.clear();
+    header.clear();
+    payload.clear();
+    chunkHeader.clear();
+    chunkSize = 0;
+    chunkBody.clear();
+    firstData = Date();
+    httpEndpoint = 0;
+}
+
 std::shared_ptr<ConnectionHandler>
 HttpConnectionHandler::
 makeNewHandlerShared()
@@ -90,10 +106,16 @@ handleData(const std::string & data)
                         readState, data.c_str(), this);
     }
     
+    // Only look for the end of the header in the newly arrived data (and
+    // the last few characters before it) rather than rescanning from the
+    // start on every packet.
+    string::size_type searchFrom
+        = headerText.length() < 3 ? 0 : headerText.length() - 3;
+
     headerText += data;
     // The first time that we see that character sequence, it's the break
     // between the header and the data.
-    string::size_type breakPos = headerText.find("\r\n\r\n");
+    string::size_type breakPos = headerText.find("\r\n\r\n", searchFrom);
     
 
     if (breakPos == string::npos)
@@ -104,9 +126,13 @@ handleData(const std::string & data)
         //cerr << "did not find break pos " << endl;
         return;
     }
-    // We got a header
+
+    // We got a header.  Parse it in place; the body that came in with it
+    // stays in the receive buffer.
+    size_t bodyStart;
     try {
-        header.parse(headerText);
+        bodyStart = header.parseHeader(headerText.c_str(),
+                                       headerText.c_str() + breakPos + 4);
     } catch (...) {
         cerr << "problem parsing in state: " << status() << endl;
         throw;
@@ -124,13 +150,25 @@ handleData(const std::string & data)
 
     handleHttpHeader(header);
 
-    payload = "";
-
-    if (header.isChunked)
+    if (header.isChunked) {
         readState = CHUNK_HEADER;
-    else readState = PAYLOAD;
+        string knownData(headerText, bodyStart);
+        headerText.clear();
+        handleHttpData(knownData);
+        return;
+    }
+
+    // Turn the receive buffer into the payload by moving the start of the
+    // body to the front, instead of copying it out into a new string.
+    readState = PAYLOAD;
+    payload.swap(headerText);
+    payload.erase(0, bodyStart);
+    headerText.clear();
+
+    if ((size_t)header.contentLength > payload.capacity())
+        payload.reserve(header.contentLength);
 
-    handleHttpData(header.knownData);
+    handlePayloadData();
 }
 
 void
@@ -173,24 +211,7 @@ handleHttpData(const std::string & data)
             throw Exception("invalid state: expected payload");
 
         payload += data;
-#if 0
-        cerr << "payload = " << payload << endl;
-        cerr << "payload.length() = " << payload.length() << endl;
-        cerr << "header.contentLength = " << header.contentLength << endl;
-#endif
-        if (payload.length() > header.contentLength) {
-            doError("extra data");
-        }
-    
-
-        if (payload.length() == header.contentLength) {
-            addActivityS("got HTTP payload");
-            handleHttpPayload(header, payload);
-
-            //cerr << this << " switching to DONE" << endl;
-
-            readState = DONE;
-        }
+        handlePayloadData();
     }
     if (readState == CHUNK_HEADER || readState == CHUNK_BODY) {
         const char * current = data.c_str();
@@ -280,6 +301,29 @@ handleHttpData(const std::string & data)
     }
 }
 
+void
+HttpConnectionHandler::
+handlePayloadData()
+{
+#if 0
+    cerr << "payload = " << payload << endl;
+    cerr << "payload.length() = " << payload.length() << endl;
+    cerr << "header.contentLength = " << header.contentLength << endl;
+#endif
+    if (payload.length() > header.contentLength) {
+        doError("extra data");
+    }
+
+    if (payload.length() == header.contentLength) {
+        addActivityS("got HTTP payload");
+        handleHttpPayload(header, payload);
+
+        //cerr << this << " switching to DONE" << endl;
+
+        readState = DONE;
+    }
+}
+
 void
 HttpConnectionHandler::
 handleHttpChunk(const HttpHeader & header,
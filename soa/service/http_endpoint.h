@@ -124,6 +124,12 @@ struct HttpConnectionHandler : public PassiveConnectionHandler {
 
     virtual void onGotTransport();
 
+    /** Put the handler back into its freshly constructed state so that it
+        can be associated with a new transport.  The buffers keep their
+        memory so that a recycled handler doesn't need to allocate.
+    */
+    virtual void reset();
+
     /** Create a new connection handler.  Delegates to the endpoint.  This
         is used after a response is sent to set the connection up for a
         new request.
@@ -146,6 +152,11 @@ struct HttpConnectionHandler : public PassiveConnectionHandler {
     */
     virtual void handleHttpData(const std::string & data);
 
+    /** Called once more of the payload is in the payload buffer.  Calls
+        handleHttpPayload once it's complete.
+    */
+    void handlePayloadData();
+
     /** Called once the entire payload has come through.  Default will
         throw.  Will be called multiple times for chunked encoding.
     */
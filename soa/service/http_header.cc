@@ -118,11 +118,27 @@ swap(HttpHeader & other)
     contentType.swap(other.contentType);
     std::swap(contentLength, other.contentLength);
     headers.swap(other.headers);
+    queryParams.swap(other.queryParams);
     knownData.swap(other.knownData);
     std::swap(isChunked, other.isChunked);
     std::swap(version, other.version);
 }
 
+void
+HttpHeader::
+clear()
+{
+    verb.clear();
+    resource.clear();
+    version.clear();
+    queryParams.clear();
+    contentType.clear();
+    contentLength = -1;
+    isChunked = false;
+    headers.clear();
+    knownData.clear();
+}
+
 namespace {
 
 std::string
@@ -174,6 +190,58 @@ expectUrlEncodedString(ML::Parse_Context & context,
     return result;
 }
 
+/** Parse the request line and header fields, up to and including the
+    blank line that terminates them, into the given header.
+*/
+void parseHeaderFields(HttpHeader & parsed, ML::Parse_Context & context)
+{
+    parsed.verb = context.expect_text(" \n");
+    context.expect_literal(' ');
+    parsed.resource = context.expect_text(" ?");
+    if (context.match_literal('?')) {
+        do {
+            string key = expectUrlEncodedString(context, "=& ");
+            if (context.match_literal('=')) {
+                string value = expectUrlEncodedString(context, "& ");
+                parsed.queryParams.push_back(make_pair(key, value));
+            } else {
+                parsed.queryParams.push_back(make_pair(key, ""));
+            }
+        } while (context.match_literal('&'));
+    }
+    context.expect_literal(' ');
+    parsed.version = context.expect_text('\r');
+    context.expect_eol();
+
+    while (!context.match_literal("\r\n")) {
+        string name = context.expect_text("\r\n:");
+        for (char & c: name)
+            c = tolower(c);
+        //cerr << "name = " << name << endl;
+        context.expect_literal(':');
+        context.match_whitespace();
+        if (name == "content-length") {
+            parsed.contentLength = context.expect_long_long();
+            //cerr << "******* set cntentLength " << parsed.contentLength
+            //     << endl;
+        }
+        else if (name == "content-type")
+            parsed.contentType = context.expect_text('\r');
+        else if (name == "transfer-encoding") {
+            string transferEncoding = lowercase(context.expect_text('\r'));
+                
+            if (transferEncoding != "chunked")
+                throw ML::Exception("unknown transfer-encoding");
+            parsed.isChunked = true;
+        }
+        else {
+            string & value = parsed.headers[name];
+            value = context.expect_text('\r');
+        }
+        context.expect_eol();
+    }
+}
+
 } // file scope
 
 void
@@ -189,49 +257,7 @@ parse(const std::string & headerAndData, bool checkBodyLength)
                                   headerAndData.c_str()
                                       + headerAndData.length());
 
-        parsed.verb = context.expect_text(" \n");
-        context.expect_literal(' ');
-        parsed.resource = context.expect_text(" ?");
-        if (context.match_literal('?')) {
-            do {
-                string key = expectUrlEncodedString(context, "=& ");
-                if (context.match_literal('=')) {
-                    string value = expectUrlEncodedString(context, "& ");
-                    queryParams.push_back(make_pair(key, value));
-                } else {
-                    queryParams.push_back(make_pair(key, ""));
-                }
-            } while (context.match_literal('&'));
-        }
-        context.expect_literal(' ');
-        parsed.version = context.expect_text('\r');
-        context.expect_eol();
-
-        while (!context.match_literal("\r\n")) {
-            string name = lowercase(context.expect_text("\r\n:"));
-            //cerr << "name = " << name << endl;
-            context.expect_literal(':');
-            context.match_whitespace();
-            if (name == "content-length") {
-                parsed.contentLength = context.expect_long_long();
-                //cerr << "******* set cntentLength " << parsed.contentLength
-                //     << endl;
-            }
-            else if (name == "content-type")
-                parsed.contentType = context.expect_text('\r');
-            else if (name == "transfer-encoding") {
-                string transferEncoding = lowercase(context.expect_text('\r'));
-                
-                if (transferEncoding != "chunked")
-                    throw ML::Exception("unknown transfer-encoding");
-                parsed.isChunked = true;
-            }
-            else {
-                string value = context.expect_text('\r');
-                parsed.headers[name] = value;
-            }
-            context.expect_eol();
-        }
+        parseHeaderFields(parsed, context);
 
         // The rest of the data is the body
         const char * content_start
@@ -264,6 +290,26 @@ parse(const std::string & headerAndData, bool checkBodyLength)
     }
 }
 
+size_t
+HttpHeader::
+parseHeader(const char * start, const char * end)
+{
+    try {
+        HttpHeader parsed;
+
+        ML::Parse_Context context("request header", start, end);
+        parseHeaderFields(parsed, context);
+
+        swap(parsed);
+        return context.get_offset();
+    }
+    catch (const std::exception & exc) {
+        cerr << "error parsing http header: " << exc.what() << endl;
+        cerr << string(start, end) << endl;
+        throw;
+    }
+}
+
 int HttpHeader::responseCode() const
 {
     return boost::lexical_cast<int>(resource);
@@ -59,8 +59,19 @@ struct HttpHeader {
 
     void swap(HttpHeader & other);
 
+    /** Return to the freshly constructed state, keeping the memory that
+        was allocated for the strings. */
+    void clear();
+
     void parse(const std::string & headerAndData, bool checkBodyLength = true);
 
+    /** Parse only the request line and header fields found at the start of
+        the given buffer, leaving knownData empty.  Returns the offset of
+        the first byte of the body, which can then be used in place without
+        being copied out.
+    */
+    size_t parseHeader(const char * start, const char * end);
+
     std::string verb;       // GET, PUT, etc
     std::string resource;   // after the get
     std::string version;    // after the get
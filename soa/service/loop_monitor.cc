@@ -76,9 +76,11 @@ addMessageLoop(const string& name, const MessageLoop* loop)
     // acts as a private member variable for sampleFn.
     rusage lastSample;
     auto lastTime = Date();
+    double lastSpin = 0.0;
 
     auto sampleFn = [=] (double elapsedTime) mutable {
         auto sample = loop->getResourceUsage();
+        double spin = loop->totalSpinSeconds();
 
         // get how much time elapsed since last time
         auto now = Date::now();
@@ -87,6 +89,7 @@ addMessageLoop(const string& name, const MessageLoop* loop)
         // first time?
         if (lastTime == Date()) {
             lastSample = sample;
+            lastSpin = spin;
         }
 
         lastTime = now;
@@ -95,7 +98,14 @@ addMessageLoop(const string& name, const MessageLoop* loop)
         auto usec = double(sample.ru_utime.tv_usec - lastSample.ru_utime.tv_usec)
                   + double(sample.ru_stime.tv_usec - lastSample.ru_stime.tv_usec);
 
-        auto load = sec + usec * 0.000001;
+        // Time spent busy polling is CPU time but the loop could have been
+        // sleeping instead so it doesn't count towards the load.
+        double spun = std::max(spin - lastSpin, 0.0);
+        lastSpin = spin;
+        if (spin > 0)
+            recordLevel(dt > 0 ? std::min(spun / dt, 1.0) : 0.0, name + ".spin");
+
+        auto load = std::max(sec + usec * 0.000001 - spun, 0.0);
         if (load >= dt) {
             load = 1.0;
         } else {
@@ -45,7 +45,8 @@ struct LoopMonitor : public ServiceBase, public MessageLoop
     typedef std::function<double(double elapsedTime)> SampleLoadFn;
 
     /** Adds a sampling function for a MessageLoop which will be called every
-        updatePeriod. Thread-safe.
+        updatePeriod. The time the loop spent busy polling isn't counted as
+        load and is recorded on its own as <name>.spin. Thread-safe.
      */
     void addMessageLoop(const std::string& name, const MessageLoop* loop);
 
@@ -7,6 +7,9 @@
 #include <thread>
 #include <time.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <sys/epoll.h>
 
 #include "jml/arch/exception.h"
@@ -20,6 +23,7 @@
 #include "soa/service/logs.h"
 
 #include "message_loop.h"
+#include "event_scheduler.h"
 
 using namespace std;
 
@@ -33,6 +37,20 @@ Logging::Category MessageLoopLogs::trace("Message Loop Trace", print);
 
 typedef MessageLoopLogs Logs;
 
+namespace {
+
+/** Tells the CPU that we're spinning so it can go easy on the sibling
+    hyperthread and on the memory bus.
+*/
+inline void cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+} // file scope
+
 /*****************************************************************************/
 /* MESSAGE LOOP                                                              */
 /*****************************************************************************/
@@ -40,9 +58,19 @@ typedef MessageLoopLogs Logs;
 MessageLoop::
 MessageLoop(int numThreads, double maxAddedLatency, int epollTimeout)
     : sourceActions_([&] () { handleSourceActions(); }),
+      sourceActionsMemory_("messageLoop.sourceActions",
+                           [&] () {
+                               return sourceActions_.size()
+                                   * sizeof(SourceAction);
+                           }),
       numThreadsCreated(0),
       shutdown_(true),
-      totalSleepTime_(0.0)
+      totalSleepTime_(0.0),
+      busyPollSeconds_(0.0),
+      totalSpinTime_(0.0),
+      coarseNow_(Date::now().secondsSinceEpoch()),
+      deferEvents_(false),
+      scheduler_(nullptr)
 {
     init(numThreads, maxAddedLatency, epollTimeout);
 }
@@ -121,6 +149,13 @@ void
 MessageLoop::
 shutdown()
 {
+    if (scheduler_) {
+        for (auto id: scheduledPeriodics_)
+            scheduler_->cancel(id);
+        scheduledPeriodics_.clear();
+        scheduler_ = nullptr;
+    }
+
     if (shutdown_)
         return;
 
@@ -178,6 +213,14 @@ addPeriodic(const std::string & name,
             std::function<void (uint64_t)> toRun,
             int priority)
 {
+    if (auto scheduler = EventScheduler::current()) {
+        ExcAssert(!scheduler_ || scheduler_ == scheduler);
+        scheduler_ = scheduler;
+        scheduledPeriodics_.push_back
+            (scheduler->schedulePeriodic(timePeriodSeconds, toRun));
+        return true;
+    }
+
     auto newPeriodic
         = make_shared<PeriodicEventSource>(timePeriodSeconds, toRun);
     return addSource(name, newPeriodic, priority);
@@ -243,6 +286,9 @@ runWorkerThread()
 
     ML::Duty_Cycle_Timer duty;
 
+    if (!cpuAffinity_.empty())
+        applyCpuAffinity();
+
     while (!shutdown_) {
         Date start = Date::now();
 
@@ -260,12 +306,13 @@ runWorkerThread()
             auto beforeSleep = [&] ()
                 {
                     duty.notifyBeforeSleep();
-                    beforeSleepTime = Date::now();
+                    beforeSleepTime = Date::nowFast();
                 };
 
             auto afterSleep = [&] ()
                 {
-                    double delta  = Date::now().secondsSince(beforeSleepTime);
+                    updateCoarseNow();
+                    double delta  = coarseNow().secondsSince(beforeSleepTime);
                     totalSleepTime_ += delta;
                     duty.notifyAfterSleep();
                 };
@@ -273,6 +320,11 @@ runWorkerThread()
             // Maximum number of events to handle in handleEvents.
             int maxEventsToHandle = 512;
 
+            if (busyPollSeconds_ > 0) {
+                spinForEvents();
+                deferEvents_ = true;
+            }
+
             // First time, we sleep for up to one second waiting for events to come
             // in to the event loop, and handle as many as we can until we hit the
             // limit or we're idle.
@@ -280,6 +332,11 @@ runWorkerThread()
                                               nullptr, beforeSleep, afterSleep);
             //cerr << "handleEvents returned " << res << endl;
 
+            if (deferEvents_) {
+                deferEvents_ = false;
+                processReadySources();
+            }
+
 #if 0
             while (res != 0) {
                 if (shutdown_)
@@ -320,7 +377,7 @@ runWorkerThread()
         Date end = Date::now();
 
         double elapsed = end.secondsSince(start);
-        double sleepTime = maxAddedLatency_ - elapsed;
+        double sleepTime = busyPollSeconds_ > 0 ? 0 : maxAddedLatency_ - elapsed;
 
         duty.notifyBeforeSleep();
         if (sleepTime > 0) {
@@ -339,6 +396,75 @@ runWorkerThread()
     }
 }
 
+void
+MessageLoop::
+applyCpuAffinity()
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu: cpuAffinity_)
+        CPU_SET(cpu, &cpus);
+
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (res != 0)
+        LOG(Logs::warning)
+            << "couldn't set the cpu affinity of the message loop: "
+            << strerror(res) << endl;
+}
+
+/** Waits for one of the fds to be ready without giving up the CPU, for up
+    to busyPollSeconds_.  The events themselves are then picked up by
+    handleEvents() which won't block since they're already there.
+*/
+void
+MessageLoop::
+spinForEvents()
+{
+    Date start = Date::nowFast();
+
+    while (!shutdown_ && !Epoller::poll()) {
+        if (Date::nowFast().secondsSince(start) >= busyPollSeconds_)
+            break;
+        cpuRelax();
+    }
+
+    updateCoarseNow();
+    totalSpinTime_ += coarseNow().secondsSince(start);
+}
+
+/** Processes the sources that handleEvents() found ready in order of
+    priority.  The source actions come first so that sources which were just
+    removed are skipped.
+*/
+void
+MessageLoop::
+processReadySources()
+{
+    auto isReady = [&] (const AsyncEventSource * source) {
+        return find(readySources_.begin(), readySources_.end(), source)
+            != readySources_.end();
+    };
+
+    if (isReady(&sourceActions_))
+        sourceActions_.processOne();
+
+    for (unsigned i = 0;  i < sources.size();  ++i) {
+        if (!isReady(sources[i].source.get()))
+            continue;
+
+        try {
+            sources[i].source->processOne();
+        } catch (...) {
+            cerr << "exception processing source " << sources[i].name
+                 << endl;
+            readySources_.clear();
+            throw;
+        }
+    }
+
+    readySources_.clear();
+}
+
 Epoller::HandleEventResult
 MessageLoop::
 handleEpollEvent(epoll_event & event)
@@ -361,6 +487,11 @@ handleEpollEvent(epoll_event & event)
     
     AsyncEventSource * source
         = reinterpret_cast<AsyncEventSource *>(event.data.ptr);
+
+    if (deferEvents_) {
+        readySources_.push_back(source);
+        return Epoller::DONE;
+    }
     
     if (debug) {
         ExcAssert(source->poll());
@@ -420,7 +551,14 @@ processAddSource(const SourceEntry & entry)
     }
 
     if (debug_) entry.source->debug(true);
-    sources.push_back(entry);
+
+    // Kept sorted by decreasing priority, in the order they were added for
+    // the same priority.
+    auto it = find_if(sources.begin(), sources.end(),
+                      [&] (const SourceEntry & other) {
+                          return other.priority < entry.priority;
+                      });
+    sources.insert(it, entry);
 
     if (needsPoll) {
         string pollingSources;
@@ -513,6 +651,8 @@ processOne()
 {
     bool more = false;
 
+    updateCoarseNow();
+
     // NOTE: this is required for some buggy sources that don't have a reliable FD to
     // sleep on.  It shouldn't be substantially less efficient.
     if (needsPoll || true) {
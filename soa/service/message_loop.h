@@ -7,20 +7,27 @@
 
 #pragma once
 
+#include <atomic>
 #include <thread>
 #include <functional>
+#include <vector>
 
 #include "jml/arch/wakeup_fd.h"
 #include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
+#include "soa/types/date.h"
 
 #include "epoller.h"
 #include "async_event_source.h"
 #include "typed_message_channel.h"
+#include "process_stats.h"
 #include "logs.h"
 #include "rusage.h"
 
 namespace Datacratic {
 
+struct EventScheduler;
+
 /******************************************************************************/
 /* LOGS                                                                       */
 /******************************************************************************/
@@ -59,6 +66,8 @@ struct MessageLoop : public Epoller {
         Note that this function call will not take effect immediately. All work
         is deferred to the main message loop thread.
 
+        Sources with a higher priority are processed first.
+
         Returns true if the request was successfully enqueued, false otherwise.
     */
     bool addSource(const std::string & name,
@@ -71,6 +80,8 @@ struct MessageLoop : public Epoller {
         Note that this function call will not take effect immediately. All work
         is deferred to the main message loop thread.
 
+        Sources with a higher priority are processed first.
+
         Returns true if the request was successfully enqueued, false otherwise.
     */
     bool addSource(const std::string & name,
@@ -86,6 +97,10 @@ struct MessageLoop : public Epoller {
         is deferred to the main message loop thread.
 
         Returns true if the request was successfully enqueued, false otherwise.
+
+        When an EventScheduler is installed, the job is scheduled on it and
+        follows its simulated time instead, and runs on the thread that
+        drives the scheduler.
     */
     bool addPeriodic(const std::string & name,
                      double timePeriodSeconds,
@@ -139,6 +154,40 @@ struct MessageLoop : public Epoller {
     double totalSleepSeconds() const { return totalSleepTime_; }
     rusage getResourceUsage() const { return resourceUsage; }
 
+    /** Low latency mode for the loops that sit on the path of a request.
+        Before blocking in epoll, the loop spins for up to spinSeconds
+        waiting for an event and it no longer sleeps to batch up work. The
+        sources that are ready after each epoll_wait are then processed in
+        order of priority. 0, the default, turns it off.
+
+        Must be called before the loop is started.
+    */
+    void setBusyPoll(double spinSeconds) { busyPollSeconds_ = spinSeconds; }
+
+    /** Pins the thread that runs the loop to the given CPUs.
+
+        Must be called before the loop is started.
+    */
+    void setCpuAffinity(std::vector<int> cpus) { cpuAffinity_ = std::move(cpus); }
+
+    /** Total number of seconds spent spinning in busy poll mode.  This time
+        is also part of the CPU time in getResourceUsage().
+    */
+    double totalSpinSeconds() const { return totalSpinTime_; }
+
+    /** Time at which the loop last woke up or went through its sources, for
+        the sources that need to timestamp what they do but not to the
+        microsecond.  Costs a load instead of a clock read.
+    */
+    Date coarseNow() const
+    {
+        // A simulation doesn't run the loop, so read its clock
+        if (JML_UNLIKELY(Date::clock() != nullptr))
+            return Date::now();
+        return Date::fromSecondsSinceEpoch(
+                coarseNow_.load(std::memory_order_relaxed));
+    }
+
     void debug(bool debugOn);
     
 private:
@@ -146,6 +195,10 @@ private:
     
     void wakeupMainThread();
 
+    void applyCpuAffinity();
+    void spinForEvents();
+    void processReadySources();
+
     typedef ML::Spinlock Lock;
     typedef std::lock_guard<Lock> Guard;
 
@@ -191,6 +244,9 @@ private:
 
     /* Queue of source actions to perform */
     TypedMessageQueue<SourceAction> sourceActions_;
+
+    /* Memory held by the queue of source actions */
+    MemoryGauge sourceActionsMemory_;
     // ML::Wakeup_Fd queueFd;
 
     Lock threadsLock;
@@ -212,6 +268,28 @@ private:
     */
     double maxAddedLatency_;
 
+    /** Seconds to spin for before blocking in epoll or 0 if off. */
+    double busyPollSeconds_;
+    std::vector<int> cpuAffinity_;
+    double totalSpinTime_;
+
+    std::atomic<double> coarseNow_;
+    void updateCoarseNow()
+    {
+        coarseNow_.store(Date::nowFast().secondsSinceEpoch(),
+                         std::memory_order_relaxed);
+    }
+
+    /** When set, handleEpollEvent queues the sources in readySources_ for
+        processReadySources() instead of processing them.
+    */
+    bool deferEvents_;
+    std::vector<AsyncEventSource *> readySources_;
+
+    /** Periodic jobs that were scheduled on an EventScheduler. */
+    EventScheduler * scheduler_;
+    std::vector<uint64_t> scheduledPeriodics_;
+
     Epoller::HandleEventResult handleEpollEvent(epoll_event & event);
     void handleSourceActions();
     void processAddSource(const SourceEntry & entry);
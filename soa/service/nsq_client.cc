@@ -4,7 +4,11 @@
 */
 
 #include <endian.h>
+#include <string.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include <iostream>
 #include <mutex>
@@ -42,9 +46,66 @@ NsqIdentifyPayloadDescription()
 
 /* NSQ CLIENT */
 
+NsqClient::
+~NsqClient()
+{
+    if (batchTimerFd_ != -1) {
+        removeFd(batchTimerFd_);
+        unregisterFdCallback(batchTimerFd_, true);
+        ::close(batchTimerFd_);
+    }
+}
+
 void
 NsqClient::
 onReceivedData(const char * bufferData, size_t bufferSize)
+{
+    {
+        unique_lock<mutex> guard(commandsLock_);
+        inReceive_ = true;
+    }
+    try {
+        parseReceivedData(bufferData, bufferSize);
+    }
+    catch (...) {
+        flushCommands();
+        throw;
+    }
+    flushCommands();
+}
+
+void
+NsqClient::
+flushCommands()
+{
+    string commands;
+    {
+        unique_lock<mutex> guard(commandsLock_);
+        inReceive_ = false;
+        commands.swap(pendingCommands_);
+    }
+    if (!commands.empty()) {
+        forceWrite(move(commands));
+    }
+}
+
+void
+NsqClient::
+writeCommand(const string & command)
+{
+    {
+        unique_lock<mutex> guard(commandsLock_);
+        if (inReceive_) {
+            pendingCommands_.append(command);
+            return;
+        }
+    }
+    forceWrite(command);
+}
+
+void
+NsqClient::
+parseReceivedData(const char * bufferData, size_t bufferSize)
 {
     const char * data;
     size_t dataSize;
@@ -77,7 +138,6 @@ onReceivedData(const char * bufferData, size_t bufferSize)
         return true;
     };
 
-    int responseHandled(0);
     while (dataSize > 0) {
         if (parserStep_ == 0) {
             if (!parseUInt32(parserRemaining_)) {
@@ -101,7 +161,6 @@ onReceivedData(const char * bufferData, size_t bufferSize)
             parserRemaining_ -= chunkSize;
             if (parserRemaining_ == 0) {
                 handleFrame();
-                responseHandled++;
                 parserStep_ = 0;
             }
             data += chunkSize;
@@ -118,18 +177,22 @@ onReceivedData(const char * bufferData, size_t bufferSize)
             }
         }
     }
-    cerr << "response handled: " + to_string(responseHandled) + "\n";
 }
 
 void
 NsqClient::
 forceWrite(string data)
 {
+    /* the frame is handed to the writer without copying it again; the
+       callback keeps it alive until it has been written */
+    auto buffer = make_shared<string>(move(data));
+    auto onWritten = [buffer] (AsyncWriteResult result) {};
+
     bool paused(false);
-    while (!write(move(data), nullptr)) {
+    while (!writeNoCopy(buffer->c_str(), buffer->size(), onWritten)) {
         if (!paused) {
             paused = true;
-            ::fprintf(stderr, "queue is full (%s)...\n", data.c_str());
+            ::fprintf(stderr, "queue is full (%s)...\n", buffer->c_str());
         }
         ML::sleep(0.1);
     }
@@ -198,8 +261,10 @@ handleNsqMessage()
 
     onMessage(ts, attempts, messageId, message);
 
+    /* RDY is renewed before it runs out so that the server never has
+       to wait for it */
     remainingRdy_--;
-    if (remainingRdy_ == 0) {
+    if (remainingRdy_ <= maxRdy_ / 4) {
         resetRdy();
     }
 }
@@ -247,7 +312,7 @@ void
 NsqClient::
 nop()
 {
-    forceWrite("NOP\n");
+    writeCommand("NOP\n");
 }
 
 void
@@ -292,24 +357,185 @@ pub(const string & topic, const string & message,
     const OnFrame & onFrame)
 {
     unique_lock<mutex> guard(callbacksLock_);
-    callbacks_.emplace(onFrame);
-    string pubMsg = "PUB " + topic + "\n";
+
     uint32_t dataSize = htonl(message.size());
+
+    if (maxBatchMessages_ > 1) {
+        PubBatch & batch = pubBatches_[topic];
+        if (batch.numMessages == 0) {
+            batch.frame.reserve(6 + topic.size() + 8 + 4 + message.size());
+            batch.frame.append("MPUB ");
+            batch.frame.append(topic);
+            batch.frame.append("\n");
+            batch.frame.append(8, '\0'); /* body size and message count */
+        }
+        batch.frame.append((char *) &dataSize, sizeof(dataSize));
+        batch.frame.append(message);
+        batch.numMessages++;
+        batch.callbacks.emplace_back(onFrame);
+
+        if (batch.numMessages >= maxBatchMessages_
+            || batch.frame.size() >= maxBatchBytes_) {
+            sendPubBatch(batch);
+        }
+        else if (!batchTimerArmed_) {
+            itimerspec spec;
+            ::memset(&spec, 0, sizeof(itimerspec));
+            spec.it_value.tv_sec = maxBatchDelay_;
+            spec.it_value.tv_nsec
+                = (maxBatchDelay_ - spec.it_value.tv_sec) * 1000000000;
+            int res = timerfd_settime(batchTimerFd_, 0, &spec, nullptr);
+            if (res == -1) {
+                throw ML::Exception(errno, "timerfd_settime");
+            }
+            batchTimerArmed_ = true;
+        }
+        return;
+    }
+
+    callbacks_.emplace(onFrame);
+    string pubMsg;
+    pubMsg.reserve(5 + topic.size() + 1 + sizeof(dataSize) + message.size());
+    pubMsg.append("PUB ");
+    pubMsg.append(topic);
+    pubMsg.append("\n");
     pubMsg.append((char *) &dataSize, sizeof(dataSize));
     pubMsg.append(message);
     forceWrite(move(pubMsg));
 }
 
+void
+NsqClient::
+mpub(const string & topic, const vector<string> & messages,
+     const OnFrame & onFrame)
+{
+    ExcAssert(messages.size() > 0);
+
+    size_t bodySize(4);
+    for (const string & message: messages) {
+        bodySize += 4 + message.size();
+    }
+
+    string mpubMsg;
+    mpubMsg.reserve(6 + topic.size() + 4 + bodySize);
+    mpubMsg.append("MPUB ");
+    mpubMsg.append(topic);
+    mpubMsg.append("\n");
+    uint32_t value = htonl(bodySize);
+    mpubMsg.append((char *) &value, sizeof(value));
+    value = htonl(messages.size());
+    mpubMsg.append((char *) &value, sizeof(value));
+    for (const string & message: messages) {
+        value = htonl(message.size());
+        mpubMsg.append((char *) &value, sizeof(value));
+        mpubMsg.append(message);
+    }
+
+    unique_lock<mutex> guard(callbacksLock_);
+    callbacks_.emplace(onFrame);
+    forceWrite(move(mpubMsg));
+}
+
+void
+NsqClient::
+setPubBatching(size_t maxMessages, size_t maxBytes, double maxDelay)
+{
+    ExcAssert(maxMessages > 0);
+    ExcAssert(maxDelay > 0);
+
+    if (maxMessages > 1 && batchTimerFd_ == -1) {
+        batchTimerFd_ = timerfd_create(CLOCK_MONOTONIC,
+                                       TFD_NONBLOCK | TFD_CLOEXEC);
+        if (batchTimerFd_ == -1) {
+            throw ML::Exception(errno, "timerfd_create");
+        }
+        auto handleBatchTimerEventCb = [&] (const ::epoll_event & event) {
+            this->handleBatchTimerEvent(event);
+        };
+        registerFdCallback(batchTimerFd_, handleBatchTimerEventCb);
+        addFd(batchTimerFd_, true, false);
+    }
+
+    unique_lock<mutex> guard(callbacksLock_);
+    maxBatchMessages_ = maxMessages;
+    maxBatchBytes_ = maxBytes;
+    maxBatchDelay_ = maxDelay;
+}
+
+void
+NsqClient::
+flushPub()
+{
+    unique_lock<mutex> guard(callbacksLock_);
+    for (auto & it: pubBatches_) {
+        if (it.second.numMessages > 0) {
+            sendPubBatch(it.second);
+        }
+    }
+}
+
+void
+NsqClient::
+sendPubBatch(PubBatch & batch)
+{
+    /* the body size covers the message count and the messages */
+    size_t headerSize = batch.frame.find('\n') + 1;
+    uint32_t value = htonl(batch.frame.size() - headerSize - 4);
+    batch.frame.replace(headerSize, sizeof(value),
+                        (char *) &value, sizeof(value));
+    value = htonl(batch.numMessages);
+    batch.frame.replace(headerSize + 4, sizeof(value),
+                        (char *) &value, sizeof(value));
+
+    auto callbacks = make_shared<vector<OnFrame> >(move(batch.callbacks));
+    callbacks_.emplace([callbacks] (const NsqFrame & frame) {
+        for (const OnFrame & onFrame: *callbacks) {
+            if (onFrame) {
+                onFrame(frame);
+            }
+        }
+    });
+    forceWrite(move(batch.frame));
+
+    batch.frame.clear();
+    batch.numMessages = 0;
+    batch.callbacks.clear();
+}
+
+void
+NsqClient::
+handleBatchTimerEvent(const ::epoll_event & event)
+{
+    if ((event.events & EPOLLIN) != 0) {
+        while (true) {
+            uint64_t expiries;
+            int res = ::read(batchTimerFd_, &expiries, sizeof(expiries));
+            if (res == -1) {
+                if (errno == EAGAIN) {
+                    break;
+                }
+
+                throw ML::Exception(errno, "read");
+            }
+        }
+        {
+            unique_lock<mutex> guard(callbacksLock_);
+            batchTimerArmed_ = false;
+        }
+        flushPub();
+    }
+}
+
 void
 NsqClient::
 fin(const string & messageId)
 {
-    forceWrite("FIN " + messageId + "\n");
+    writeCommand("FIN " + messageId + "\n");
 }
 
 void
 NsqClient::
 rdy(int count)
 {
-    forceWrite("RDY " + to_string(count) + "\n");
+    writeCommand("RDY " + to_string(count) + "\n");
 }
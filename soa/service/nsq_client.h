@@ -9,7 +9,9 @@
 
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 
 #include "soa/types/date.h"
 #include "soa/types/value_description.h"
@@ -74,11 +76,16 @@ struct NsqClient : public TcpClient {
               const OnMessage & onMessage = nullptr)
         : TcpClient(onClosed, nullptr, nullptr, 0),
           parserStep_(0), parserRemaining_(0),
-          onMessage_(onMessage), remainingRdy_(0)
+          inReceive_(false),
+          onMessage_(onMessage), maxRdy_(1000), remainingRdy_(0),
+          maxBatchMessages_(1), maxBatchBytes_(0), maxBatchDelay_(0),
+          batchTimerFd_(-1), batchTimerArmed_(false)
     {
         setUseNagle(true);
     }
 
+    ~NsqClient();
+
     TcpConnectionResult connectSync();
 
     void nop();
@@ -93,38 +100,100 @@ struct NsqClient : public TcpClient {
     void pub(const std::string & topic, const std::string & message,
              const OnFrame & onFrame = nullptr);
 
+    /* publish several messages with a single MPUB command */
+    void mpub(const std::string & topic,
+              const std::vector<std::string> & messages,
+              const OnFrame & onFrame = nullptr);
+
+    /* have "pub" gather the messages of each topic into MPUB commands,
+       sent when they hold "maxMessages" messages or "maxBytes" bytes, or
+       "maxDelay" seconds after their first message. The callbacks of the
+       messages of a batch all receive the response to its MPUB. Must be
+       called before the client is added to its loop. */
+    void setPubBatching(size_t maxMessages, size_t maxBytes = 1 << 20,
+                        double maxDelay = 0.005);
+
+    /* send the pending batches of "pub" now */
+    void flushPub();
+
+    /* FIN and RDY commands issued while received messages are being
+       handled are sent together once they all have been */
     void fin(const std::string & messageId);
 
+    /* number of messages the server may have in flight to us; RDY is
+       renewed once three quarters of it have been received */
+    void setMaxRdy(int maxRdy)
+    {
+        maxRdy_ = maxRdy;
+    }
+
     virtual void onMessage(Date ts, uint16_t attempts,
                            const std::string & messageId,
                            const std::string & message);
 
 private:
     void onReceivedData(const char * buffer, size_t bufferSize);
+    void parseReceivedData(const char * buffer, size_t bufferSize);
+    void flushCommands();
 
     void forceWrite(std::string data);
 
+    /* write a command without response, gathering those issued while
+       received data is being handled */
+    void writeCommand(const std::string & command);
+
     void handleFrame();
     void handleCommandFrame();
     void handleNsqMessage();
 
     void resetRdy()
     {
-        remainingRdy_ = 1000;
-        rdy(1000);
+        remainingRdy_ = maxRdy_;
+        rdy(maxRdy_);
     }
 
+    /* messages of a topic waiting to be published with MPUB */
+    struct PubBatch {
+        PubBatch()
+            : numMessages(0)
+        {
+        }
+
+        /* the MPUB frame, whose body size and message count are filled
+           in when it is sent */
+        std::string frame;
+        uint32_t numMessages;
+        std::vector<OnFrame> callbacks;
+    };
+
+    void sendPubBatch(PubBatch & batch);
+    void handleBatchTimerEvent(const ::epoll_event & event);
+
     /* response parsing */
     int parserStep_; /* 0 = size; 1 = type; 2 = message */
     uint32_t parserRemaining_; /* size missing from message */
     std::string parserBuffer_;
     NsqFrame parserFrame_;
 
+    /* commands without response issued during onReceivedData */
+    std::mutex commandsLock_;
+    bool inReceive_;
+    std::string pendingCommands_;
+
     std::mutex callbacksLock_;
     std::queue<OnFrame> callbacks_;
 
     OnMessage onMessage_;
+    int maxRdy_;
     int remainingRdy_;
+
+    /* batching of "pub", protected by callbacksLock_ */
+    size_t maxBatchMessages_;
+    size_t maxBatchBytes_;
+    double maxBatchDelay_;
+    std::map<std::string, PubBatch> pubBatches_;
+    int batchTimerFd_;
+    bool batchTimerArmed_;
 };
 
 } // namespace Datacratic
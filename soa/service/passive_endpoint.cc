@@ -8,10 +8,15 @@
 #include <unordered_map>
 
 #include "jml/arch/futex.h"
+#include "jml/arch/rt.h"
 #include "soa/service//passive_endpoint.h"
 #include <poll.h>
 #include <boost/date_time/gregorian/gregorian.hpp>
 
+#ifndef SO_REUSEPORT
+#  define SO_REUSEPORT 15
+#endif
+
 using namespace std;
 using namespace ML;
 using namespace boost::posix_time;
@@ -25,7 +30,7 @@ namespace Datacratic {
 
 PassiveEndpoint::
 PassiveEndpoint(const std::string & name)
-    : EndpointBase(name)
+    : EndpointBase(name), numAcceptors_(1)
 {
 }
 
@@ -57,7 +62,7 @@ init(PortRange const & portRange, const std::string & hostname, int num_threads,
 
 AcceptorT<SocketTransport>::
 AcceptorT()
-    : fd(-1), endpoint(0), listening_(false)
+    : endpoint(0), listening_(false)
 {
 }
 
@@ -67,6 +72,46 @@ AcceptorT<SocketTransport>::
     closePeer();
 }
 
+int
+AcceptorT<SocketTransport>::
+bindSocket(const ACE_INET_Addr & addr, bool reusePort)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    // Avoid already bound messages for the minute after a server has exited
+    int tr = 1;
+    int res = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &tr, sizeof(int));
+
+    if (res == -1) {
+        close(fd);
+        throw Exception("error setsockopt SO_REUSEADDR: %s", strerror(errno));
+    }
+
+    // Allow several sockets to listen on the same port and have the kernel
+    // balance incoming connections between them
+    if (reusePort) {
+        res = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &tr, sizeof(int));
+        if (res == -1) {
+            close(fd);
+            throw Exception("error setsockopt SO_REUSEPORT: %s",
+                            strerror(errno));
+        }
+    }
+
+    res = ::bind(fd,
+                 reinterpret_cast<sockaddr *>(addr.get_addr()),
+                 addr.get_addr_size());
+    if (res == -1) {
+        int error = errno;
+        close(fd);
+        if (error != EADDRINUSE)
+            throw Exception("listen: bind returned %s", strerror(error));
+        return -1;
+    }
+
+    return fd;
+}
+
 int
 AcceptorT<SocketTransport>::
 listen(PortRange const & portRange,
@@ -80,17 +125,8 @@ listen(PortRange const & portRange,
     this->endpoint = endpoint;
     this->nameLookup = nameLookup;
 
-    fd = socket(AF_INET, SOCK_STREAM, 0);
-
-    // Avoid already bound messages for the minute after a server has exited
-    int tr = 1;
-    int res = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &tr, sizeof(int));
-
-    if (res == -1) {
-        close(fd);
-        fd = -1;
-        throw Exception("error setsockopt SO_REUSEADDR: %s", strerror(errno));
-    }
+    int numAcceptors = endpoint->numAcceptors_;
+    bool reusePort = numAcceptors > 1;
 
     const char * hostNameToUse
         = (hostname == "*" ? "0.0.0.0" : hostname.c_str());
@@ -106,12 +142,11 @@ listen(PortRange const & portRange,
              //     << addr.get_host_addr() << " "
              //     << addr.get_ip_address() << endl;
 
-             int res = ::bind(fd,
-                              reinterpret_cast<sockaddr *>(addr.get_addr()),
-                              addr.get_addr_size());
-             if (res == -1 && errno != EADDRINUSE)
-                 throw Exception("listen: bind returned %s", strerror(errno));
-             return res == 0;
+             int fd = bindSocket(addr, reusePort);
+             if (fd == -1)
+                 return false;
+             fds.push_back(fd);
+             return true;
          });
     
     if (port == -1) {
@@ -119,37 +154,62 @@ listen(PortRange const & portRange,
                                                             portRange.last);
     }
 
-    // Avoid already bound messages for the minute after a server has exited
-    res = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &tr, sizeof(int));
-
-    if (res == -1) {
-        close(fd);
-        fd = -1;
-        throw Exception("error setsockopt SO_REUSEADDR: %s", strerror(errno));
-    }
-
-    res = ::listen(fd, backlog);
-
-    if (res == -1) {
-        close(fd);
-        fd = -1;
-        throw Exception("error on listen: %s", strerror(errno));
-    }
-
     if (port == 0) {
         sockaddr_in inAddr;
         socklen_t inAddrLen = sizeof(inAddr);
-        res = ::getsockname(fd, (sockaddr *) &inAddr, &inAddrLen);
+        ::getsockname(fds[0], (sockaddr *) &inAddr, &inAddrLen);
         port = ntohs(inAddr.sin_port);
         addr.set(&inAddr, inAddrLen);
     }
 
+    // The other acceptors share the port that the first one got
+    while (fds.size() < (size_t)numAcceptors) {
+        int fd = bindSocket(addr, reusePort);
+        if (fd == -1) {
+            size_t numBound = fds.size();
+            for (int fd: fds)
+                close(fd);
+            fds.clear();
+            throw Exception("couldn't bind acceptor %zd to port %d",
+                            numBound, port);
+        }
+        fds.push_back(fd);
+    }
+
+    for (int fd: fds) {
+        int res = ::listen(fd, backlog);
+
+        if (res == -1) {
+            int error = errno;
+            for (int fd: fds)
+                close(fd);
+            fds.clear();
+            throw Exception("error on listen: %s", strerror(error));
+        }
+    }
+
     listening_ = true;
     ML::futex_wake(listening_);
 
     shutdown = false;
 
-    acceptThread.reset(new boost::thread([=] () { this->runAcceptThread(); }));
+    const vector<int> & cpus = endpoint->acceptorCpus_;
+
+    for (unsigned i = 0;  i < fds.size();  ++i) {
+        int fd = fds[i];
+        std::shared_ptr<boost::thread> thread
+            (new boost::thread([=] () { this->runAcceptThread(fd); }));
+
+        if (!cpus.empty()) {
+            int cpu = cpus[i % cpus.size()];
+            if (!pinThreadToCpu(*thread, cpu))
+                cerr << "warning: can't pin accept thread " << i
+                     << " to cpu " << cpu << endl;
+        }
+
+        acceptThreads.push_back(thread);
+    }
+
     return port;
 }
 
@@ -157,18 +217,26 @@ void
 AcceptorT<SocketTransport>::
 closePeer()
 {
-    if (!acceptThread) return;
+    if (acceptThreads.empty()) {
+        for (int fd: fds)
+            close(fd);
+        fds.clear();
+        return;
+    }
+
     shutdown = true;
 
     ML::memory_barrier();
 
     wakeup.signal();
 
-    close(fd);
-    fd = -1;
+    for (int fd: fds)
+        close(fd);
+    fds.clear();
 
-    acceptThread->join();
-    acceptThread.reset();
+    for (auto & thread: acceptThreads)
+        thread->join();
+    acceptThreads.clear();
 }
 
 std::string
@@ -200,7 +268,7 @@ struct NameEntry {
 
 void
 AcceptorT<SocketTransport>::
-runAcceptThread()
+runAcceptThread(int fd)
 {
     //static const char *fName = "AcceptorT<SocketTransport>::runAcceptThread:";
     unordered_map<string,NameEntry> addr2Name;
@@ -242,58 +310,65 @@ runAcceptThread()
         if (!fds[0].revents)
             continue;
 
-        res = accept(fd, (sockaddr *)&addr, &addr_len);
+        // Drain the whole backlog before polling again
+        while (!shutdown) {
+            addr_len = sizeof(addr);
+            res = accept(fd, (sockaddr *)&addr, &addr_len);
 
-        //cerr << "accept returned " << res << endl;
+            //cerr << "accept returned " << res << endl;
 
-        if (res == -1 && errno == EWOULDBLOCK)
-            continue;
+            if (res == -1 && errno == EWOULDBLOCK)
+                break;
 
-        if (res == -1 && errno == EINTR) continue;
+            if (res == -1 && errno == EINTR) continue;
 
-        if (res == -1)
-            endpoint->acceptError(format("accept: %s", strerror(errno)));
+            if (res == -1) {
+                // Go back to polling rather than spinning on eg EMFILE
+                endpoint->acceptError(format("accept: %s", strerror(errno)));
+                break;
+            }
 
 #if 0
-        union {
-            char octets[4];
-            uint32_t addr;
-        } a;
-        a.addr = addr.sin_addr;
+            union {
+                char octets[4];
+                uint32_t addr;
+            } a;
+            a.addr = addr.sin_addr;
 #endif
 
-        ACE_INET_Addr addr2(&addr, addr_len);
+            ACE_INET_Addr addr2(&addr, addr_len);
 
 #if 0
-        ptime now = second_clock::universal_time();
+            ptime now = second_clock::universal_time();
 
-        cerr << boost::this_thread::get_id() << ":"<<to_iso_extended_string(now) << ":accept succeeded from "
-             << addr2.get_host_addr() << ":" << addr2.get_port_number()
-             << " (" << addr2.get_host_name() << ")"
-             << " for endpoint " << endpoint->name() << " res = " << res
-             << " pointer " << endpoint << endl;
+            cerr << boost::this_thread::get_id() << ":"<<to_iso_extended_string(now) << ":accept succeeded from "
+                 << addr2.get_host_addr() << ":" << addr2.get_port_number()
+                 << " (" << addr2.get_host_name() << ")"
+                 << " for endpoint " << endpoint->name() << " res = " << res
+                 << " pointer " << endpoint << endl;
 #endif
-        std::shared_ptr<SocketTransport> newTransport
-            (new SocketTransport(this->endpoint));
-
-        newTransport->peer_ = ACE_SOCK_Stream(res);
-        string peerName = addr2.get_host_addr();
-        if (nameLookup) {
-            auto it = addr2Name.find(peerName);
-            if (it == addr2Name.end()) {
-                string addr = peerName;
-                peerName = addr2.get_host_name();
-                addr2Name.insert({addr, NameEntry(peerName)});
+            std::shared_ptr<SocketTransport> newTransport
+                (new SocketTransport(this->endpoint));
+
+            newTransport->peer_ = ACE_SOCK_Stream(res);
+            string peerName = addr2.get_host_addr();
+            if (nameLookup) {
+                auto it = addr2Name.find(peerName);
+                if (it == addr2Name.end()) {
+                    string addr = peerName;
+                    peerName = addr2.get_host_name();
+                    addr2Name.insert({addr, NameEntry(peerName)});
+                }
+                else {
+                    peerName = it->second.name_;
+                }
             }
-            else {
-                peerName = it->second.name_;
-            }
-        }
 
-        if (peerName == "<unknown>")
-            peerName = addr2.get_host_addr();
-        newTransport->peerName_ = peerName;
-        endpoint->associateHandler(newTransport);
+            if (peerName == "<unknown>")
+                peerName = addr2.get_host_addr();
+            newTransport->peerName_ = peerName;
+            endpoint->associateHandler(newTransport);
+        }
 
         /* cleanup name entries older than 5 seconds */
         Date now = Date::now();
@@ -77,6 +77,24 @@ struct PassiveEndpoint: public EndpointBase {
              int threads = 1, bool synchronous = true, bool nameLookup=true,
              int backlog = DEF_BACKLOG);
 
+    /** Accept connections on numAcceptors sockets bound to the same port
+        with SO_REUSEPORT, each one served by its own accept thread, so
+        that the kernel spreads incoming connections over them instead of
+        having a single thread accept everything.  If cpus is not empty,
+        the accept threads are pinned to those cpus in turn.
+
+        Must be called before init() or listen().
+    */
+    void setReusePortAcceptors(int numAcceptors,
+                               const std::vector<int> & cpus
+                                   = std::vector<int>())
+    {
+        if (numAcceptors < 1)
+            throw ML::Exception("need at least one acceptor");
+        numAcceptors_ = numAcceptors;
+        acceptorCpus_ = cpus;
+    }
+
     /** Listen on the given port.  If port is -1, then it should scan
         for a port and return that.  Returns the port number.
     */
@@ -168,6 +186,9 @@ protected:
     template<typename Transport> friend struct AcceptorT;
     // whether or not to perform a host name look up
     bool nameLookup_;// whether or not to perform a host name look up
+
+    int numAcceptors_;              ///< Number of SO_REUSEPORT sockets
+    std::vector<int> acceptorCpus_; ///< Cpus to pin accept threads to
 };
 
 
@@ -205,19 +226,23 @@ struct AcceptorT<SocketTransport> : public Acceptor {
     /** What port are we listening on? */
     virtual int port() const;
 
-    /** Special thread to deal with accepting connections all by itself to
-        avoid multiplexing them on the router.
+    /** Special thread to deal with accepting connections on the given
+        listening socket all by itself to avoid multiplexing them on the
+        router.
     */
-    void runAcceptThread();
+    void runAcceptThread(int fd);
 
     /** Wait until we are ready to accept connections */
     void waitListening() const;
 
 protected:
-    std::shared_ptr<boost::thread> acceptThread;
+    /** Create a listening socket bound to the given address. */
+    int bindSocket(const ACE_INET_Addr & addr, bool reusePort);
+
+    std::vector<std::shared_ptr<boost::thread> > acceptThreads;
     ML::Wakeup_Fd wakeup;
     ACE_INET_Addr addr;
-    int fd;
+    std::vector<int> fds;           ///< One listening socket per thread
     PassiveEndpoint * endpoint;
     int listening_; // whether the socket is listening
     bool nameLookup;
@@ -10,7 +10,14 @@
 
 #include "timeout_map.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 #include "jml/utils/guard.h"
+#include "jml/utils/exc_check.h"
+#include <condition_variable>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
 
 namespace Datacratic {
 
@@ -38,6 +45,16 @@ struct PendingPersistence {
 struct LeveldbPendingPersistence : public PendingPersistence {
     std::shared_ptr<leveldb::DB> db;
 
+    ~LeveldbPendingPersistence()
+    {
+        try {
+            stopBatching();
+        } catch (const std::exception & exc) {
+            std::cerr << "error flushing pending persistence: "
+                      << exc.what() << std::endl;
+        }
+    }
+
     void open(const std::string & filename)
     {
         leveldb::DB* db;
@@ -100,8 +117,44 @@ struct LeveldbPendingPersistence : public PendingPersistence {
         return size;
     }
 
+    /** Group commit.  Instead of being written one at a time from the
+        caller's thread, puts and erases are accumulated into a WriteBatch
+        that a background thread writes every flushInterval seconds, or as
+        soon as it holds maxEntries entries.  Until then they are kept in
+        memory so that get() and pop() see them; with sync, every batch is
+        synced to disk before it is dropped from memory.
+
+        A failed write is thrown from the next put(), erase() or flush().
+    */
+    void startBatching(double flushInterval = 0.01, size_t maxEntries = 1000,
+                       bool sync = false)
+    {
+        ExcCheck(db, "startBatching called before open");
+        stopBatching();
+        batcher.reset(new Batcher(db, flushInterval, maxEntries, sync));
+    }
+
+    /** Write whatever is pending and go back to synchronous writes. */
+    void stopBatching()
+    {
+        if (!batcher) return;
+        std::unique_ptr<Batcher> toStop(std::move(batcher));
+        toStop->shutdown();
+    }
+
+    /** Wait until everything put or erased so far is written. */
+    void flush() const
+    {
+        if (batcher) batcher->flush();
+    }
+
     virtual void put(const std::string & key, const std::string & value)
     {
+        if (batcher) {
+            batcher->put(key, value);
+            return;
+        }
+
         leveldb::WriteOptions options;
         leveldb::Status status = db->Put(options, key, value);
         if (!status.ok()) {
@@ -119,8 +172,15 @@ struct LeveldbPendingPersistence : public PendingPersistence {
     virtual std::string
     get(const std::string & key) const
     {
-        leveldb::ReadOptions options;
         std::string value;
+        if (batcher) {
+            int found = batcher->get(key, value);
+            if (found > 0) return value;
+            if (found < 0)
+                throw ML::Exception("Reading from leveldb: NotFound: " + key);
+        }
+
+        leveldb::ReadOptions options;
         leveldb::Status status = db->Get(options, key, &value);
         if (!status.ok()) {
             throw ML::Exception("Writing to leveldb: " + status.ToString());
@@ -130,6 +190,11 @@ struct LeveldbPendingPersistence : public PendingPersistence {
 
     virtual void erase(const std::string & key)
     {
+        if (batcher) {
+            batcher->erase(key);
+            return;
+        }
+
         leveldb::WriteOptions options;
         leveldb::Status status = db->Delete(options, key);
         if (!status.ok()) {
@@ -145,6 +210,9 @@ struct LeveldbPendingPersistence : public PendingPersistence {
         //db->CompactRange(0, 0);
         //cerr << "done compacting" << endl;
 
+        // The database has to see the pending writes too.
+        flush();
+
         leveldb::ReadOptions options;
         options.verify_checksums = true;
 
@@ -176,6 +244,166 @@ struct LeveldbPendingPersistence : public PendingPersistence {
         using namespace std;
         cerr << "scanned " << numScanned << " entries" << endl;
     }
+
+private:
+
+    /** Writes the batches for startBatching().  The entries that aren't
+        written yet are in the overlay, tagged with a sequence number so that
+        a write only drops the ones that weren't overwritten since.
+    */
+    struct Batcher {
+        Batcher(std::shared_ptr<leveldb::DB> db, double flushInterval,
+                size_t maxEntries, bool sync)
+            : db(std::move(db)), flushInterval(flushInterval),
+              maxEntries(maxEntries), sync(sync),
+              batchEntries(0), seq(0), written(0),
+              flushRequested(false), shutdownRequested(false)
+        {
+            thread = std::thread([this] () { this->run(); });
+        }
+
+        ~Batcher()
+        {
+            if (thread.joinable()) stop();
+        }
+
+        struct Entry {
+            uint64_t seq;
+            bool erased;
+            std::string value;
+        };
+
+        void put(const std::string & key, const std::string & value)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            checkError();
+            batch.Put(key, value);
+            overlay[key] = Entry{ ++seq, false, value };
+            if (++batchEntries >= maxEntries) wakeup.notify_one();
+        }
+
+        void erase(const std::string & key)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            checkError();
+            batch.Delete(key);
+            overlay[key] = Entry{ ++seq, true, std::string() };
+            if (++batchEntries >= maxEntries) wakeup.notify_one();
+        }
+
+        /** 1 if the key has a pending put, -1 if it has a pending erase and
+            0 if it has to be looked up in the database.
+        */
+        int get(const std::string & key, std::string & value) const
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = overlay.find(key);
+            if (it == overlay.end()) return 0;
+            if (it->second.erased) return -1;
+            value = it->second.value;
+            return 1;
+        }
+
+        void flush()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            uint64_t target = seq;
+            flushRequested = true;
+            wakeup.notify_one();
+            done.wait(guard, [&] () { return written >= target || !error.ok(); });
+            checkError();
+        }
+
+        void shutdown()
+        {
+            stop();
+            std::lock_guard<std::mutex> guard(lock);
+            checkError();
+        }
+
+    private:
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                shutdownRequested = true;
+                wakeup.notify_one();
+            }
+            thread.join();
+        }
+
+        void checkError() const
+        {
+            if (!error.ok())
+                throw ML::Exception("Writing to leveldb: " + error.ToString());
+        }
+
+        void run()
+        {
+            auto interval = std::chrono::microseconds(
+                    int64_t(flushInterval * 1000000));
+
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                wakeup.wait_for(guard, interval, [&] () {
+                        return shutdownRequested || flushRequested
+                            || batchEntries >= maxEntries;
+                    });
+                flushRequested = false;
+
+                if (batchEntries && error.ok()) {
+                    leveldb::WriteBatch toWrite;
+                    std::swap(toWrite, batch);
+                    batchEntries = 0;
+                    uint64_t upTo = seq;
+
+                    guard.unlock();
+                    leveldb::WriteOptions options;
+                    options.sync = sync;
+                    leveldb::Status status = db->Write(options, &toWrite);
+                    guard.lock();
+
+                    if (status.ok()) {
+                        written = upTo;
+                        for (auto it = overlay.begin();  it != overlay.end();) {
+                            if (it->second.seq <= upTo)
+                                it = overlay.erase(it);
+                            else ++it;
+                        }
+                    }
+                    else error = status;
+                }
+                else if (!batchEntries) written = seq;
+
+                done.notify_all();
+
+                if (shutdownRequested && (!batchEntries || !error.ok()))
+                    break;
+            }
+        }
+
+        std::shared_ptr<leveldb::DB> db;
+        double flushInterval;
+        size_t maxEntries;
+        bool sync;
+
+        mutable std::mutex lock;
+        std::condition_variable wakeup;   ///< For the writer thread
+        std::condition_variable done;     ///< For flush()
+
+        leveldb::WriteBatch batch;
+        size_t batchEntries;
+        std::map<std::string, Entry> overlay;
+        uint64_t seq;                     ///< Of the last put or erase
+        uint64_t written;                 ///< Up to which seq is written
+        leveldb::Status error;
+        bool flushRequested;
+        bool shutdownRequested;
+
+        std::thread thread;
+    };
+
+    std::unique_ptr<Batcher> batcher;
 };
 
 template<typename Key, typename Value>
@@ -7,6 +7,7 @@
 
 
 #include "soa/service/process_stats.h"
+#include "soa/gc/gc_lock.h"
 #include "jml/arch/exception.h"
 
 #include <boost/algorithm/string/split.hpp>
@@ -17,6 +18,8 @@
 #include <functional>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <unistd.h>
 #include <sys/resource.h>
 
@@ -28,6 +31,23 @@ using namespace boost;
 
 namespace {
 
+/** Every live MemoryGauge.  Never destroyed, as gauges with static storage
+    can be destroyed after it would be.
+*/
+struct MemoryGauges {
+    std::mutex lock;
+    std::set<const MemoryGauge *> gauges;
+};
+
+MemoryGauges & memoryGauges()
+{
+    static MemoryGauges * gauges = new MemoryGauges();
+    return *gauges;
+}
+
+/// Work waiting on a GcLock to be run
+MemoryGauge gcDeferredGauge("gcDeferred", &GcLockBase::deferredBytes);
+
 static const string ProcStatFile = "/proc/self/stat";
 enum ProcStatFields {
     STAT_MINFLT = 9,
@@ -128,6 +148,65 @@ void ProcessStats::sampleRUsage () {
 }
 
 
+/*****************************************************************************/
+/* MEMORY GAUGE                                                              */
+/*****************************************************************************/
+
+MemoryGauge::
+MemoryGauge(const std::string & name)
+    : name_(name), bytes_(0)
+{
+    auto & all = memoryGauges();
+    std::unique_lock<std::mutex> guard(all.lock);
+    all.gauges.insert(this);
+}
+
+MemoryGauge::
+MemoryGauge(const std::string & name, const Compute & compute)
+    : name_(name), compute_(compute), bytes_(0)
+{
+    auto & all = memoryGauges();
+    std::unique_lock<std::mutex> guard(all.lock);
+    all.gauges.insert(this);
+}
+
+MemoryGauge::
+~MemoryGauge()
+{
+    auto & all = memoryGauges();
+    std::unique_lock<std::mutex> guard(all.lock);
+    all.gauges.erase(this);
+}
+
+uint64_t
+MemoryGauge::
+get() const
+{
+    if (compute_)
+        return compute_();
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+std::map<std::string, uint64_t>
+MemoryGauge::
+sampleAll()
+{
+    std::map<std::string, uint64_t> result;
+
+    // Held whilst computing so that no gauge is destroyed under us
+    auto & all = memoryGauges();
+    std::unique_lock<std::mutex> guard(all.lock);
+    for (const MemoryGauge * gauge : all.gauges)
+        result[gauge->name()] += gauge->get();
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* PROCESS STATS                                                             */
+/*****************************************************************************/
+
 void ProcessStats::logToCallback (
         LogCallback cb, 
         const ProcessStats& last,
@@ -146,6 +225,9 @@ void ProcessStats::logToCallback (
     cb(p + "memResident", cur.residentMem);
     cb(p + "memShared", cur.sharedMem);
 
+    for (const auto & gauge : cur.memory)
+        cb(p + "memory." + gauge.first, gauge.second);
+
     cb(p + "contextSwitchesVoluntary",
             cur.voluntaryContextSwitches - last.voluntaryContextSwitches);
     cb(p + "contextSwitchesInvoluntary",
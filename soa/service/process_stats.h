@@ -12,11 +12,62 @@
 #include "soa/jsoncpp/json.h"
 
 #include <boost/function.hpp>
+#include <atomic>
+#include <functional>
+#include <map>
 #include <string>
 
 
 namespace Datacratic {
 
+/*****************************************************************************/
+/* MEMORY GAUGE                                                              */
+/*****************************************************************************/
+
+/** Estimate of the bytes used by one of the structures of the process, which
+    ProcessStats samples along with the process wide figures and reports as
+    "memory.<name>".  The gauges exist as long as the object, and the values
+    of the gauges that share a name are added together so that, for example,
+    every shard of a service can have its own.
+
+    A gauge either has its value set by the owner of the structure, from the
+    thread that owns it, or is computed when sampled.  A computed gauge is
+    called from whichever thread samples the ProcessStats, so it must be
+    thread safe and cheap.
+*/
+struct MemoryGauge {
+    typedef std::function<uint64_t ()> Compute;
+
+    /** Gauge whose value is given with set(). */
+    MemoryGauge(const std::string & name);
+
+    /** Gauge whose value is given by calling compute. */
+    MemoryGauge(const std::string & name, const Compute & compute);
+
+    ~MemoryGauge();
+
+    MemoryGauge(const MemoryGauge &) = delete;
+    MemoryGauge & operator = (const MemoryGauge &) = delete;
+
+    void set(uint64_t bytes)
+    {
+        bytes_.store(bytes, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const;
+
+    const std::string & name() const { return name_; }
+
+    /** Value of every gauge in the process, summed by name. */
+    static std::map<std::string, uint64_t> sampleAll();
+
+private:
+    std::string name_;
+    Compute compute_;
+    std::atomic<uint64_t> bytes_;
+};
+
+
 /*
 Reccords statistics related to a process and the system.
 The stats should preferably be formatted and dumped via the logToCallback()
@@ -33,6 +84,7 @@ struct ProcessStats {
         sampleLoadAverage();
         sampleStatm();
         sampleRUsage();
+        memory = MemoryGauge::sampleAll();
     }
 
 
@@ -59,6 +111,9 @@ struct ProcessStats {
     uint64_t residentMem;
     uint64_t sharedMem;
 
+    /** Value of each MemoryGauge, by name. */
+    std::map<std::string, uint64_t> memory;
+
     bool doLoadAverage;
     float loadAverage1;
     float loadAverage5;
@@ -0,0 +1,248 @@
+/* quantile_sketch.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Fixed size summary of a set of values that quantiles can be read from.
+*/
+
+#include "soa/service/quantile_sketch.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* STORE                                                                     */
+/*****************************************************************************/
+
+namespace {
+
+/** Buckets added past the end of the range when it grows so that values
+    that wander around don't reallocate it each time.
+*/
+enum { GrowthSlack = 32 };
+
+} // namespace anonymous
+
+void
+QuantileSketch::Store::
+add(int index, uint64_t n, size_t maxBuckets)
+{
+    int size = counts.size();
+
+    if (!size || index < offset || index >= offset + size) {
+        int low = size ? std::min(index, offset) : index;
+        int high = size ? std::max(index, offset + size - 1) : index;
+        int span = high - low + 1;
+
+        // Past the maximum the smallest magnitudes are merged together,
+        // otherwise the range grows towards the new index with some slack.
+        if (span > int(maxBuckets))
+            low = high - int(maxBuckets) + 1;
+        else {
+            int slack = std::min<int>(GrowthSlack, maxBuckets - span);
+            if (index == high) high += slack;
+            else low -= slack;
+        }
+
+        rebase(low, high);
+    }
+
+    index = std::max(index, offset);
+    counts[index - offset] += n;
+}
+
+void
+QuantileSketch::Store::
+rebase(int low, int high)
+{
+    vector<uint64_t> newCounts(high - low + 1, 0);
+
+    for (size_t i = 0;  i < counts.size();  ++i) {
+        if (!counts[i]) continue;
+        int index = std::max(offset + int(i), low);
+        newCounts[index - low] += counts[i];
+    }
+
+    counts.swap(newCounts);
+    offset = low;
+}
+
+void
+QuantileSketch::Store::
+clear()
+{
+    std::fill(counts.begin(), counts.end(), 0);
+}
+
+
+/*****************************************************************************/
+/* QUANTILE SKETCH                                                           */
+/*****************************************************************************/
+
+QuantileSketch::
+QuantileSketch(double relativeAccuracy, size_t maxBuckets)
+    : accuracy(relativeAccuracy),
+      gamma((1.0 + relativeAccuracy) / (1.0 - relativeAccuracy)),
+      logGamma(std::log(gamma)),
+      maxBuckets(maxBuckets),
+      zeros(0),
+      count_(0), sum_(0.0), sumSquares(0.0),
+      min_(std::numeric_limits<double>::infinity()),
+      max_(-std::numeric_limits<double>::infinity())
+{
+    if (relativeAccuracy <= 0.0 || relativeAccuracy >= 1.0)
+        throw ML::Exception("quantile sketch accuracy must be in (0, 1)");
+}
+
+int
+QuantileSketch::
+bucketIndex(double magnitude) const
+{
+    return std::ceil(std::log(magnitude) / logGamma);
+}
+
+double
+QuantileSketch::
+bucketValue(int index) const
+{
+    return 2.0 * std::pow(gamma, index) / (gamma + 1.0);
+}
+
+void
+QuantileSketch::
+add(double value)
+{
+    if (!std::isfinite(value)) return;
+
+    ++count_;
+    sum_ += value;
+    sumSquares += value * value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+
+    if (!maxBuckets) return;
+
+    double magnitude = std::abs(value);
+    if (magnitude < std::numeric_limits<double>::min())
+        ++zeros;
+    else if (value > 0)
+        positive.add(bucketIndex(magnitude), 1, maxBuckets);
+    else negative.add(bucketIndex(magnitude), 1, maxBuckets);
+}
+
+void
+QuantileSketch::
+merge(const QuantileSketch & other)
+{
+    if (other.accuracy != accuracy)
+        throw ML::Exception("can't merge quantile sketches of accuracy %f "
+                            "and %f", accuracy, other.accuracy);
+
+    if (other.empty()) return;
+
+    count_ += other.count_;
+    sum_ += other.sum_;
+    sumSquares += other.sumSquares;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+
+    if (!maxBuckets) return;
+
+    zeros += other.zeros;
+
+    auto mergeStore = [&] (Store & store, const Store & from)
+        {
+            for (size_t i = 0;  i < from.counts.size();  ++i) {
+                if (from.counts[i])
+                    store.add(from.offset + int(i), from.counts[i], maxBuckets);
+            }
+        };
+
+    mergeStore(positive, other.positive);
+    mergeStore(negative, other.negative);
+}
+
+void
+QuantileSketch::
+clear()
+{
+    positive.clear();
+    negative.clear();
+    zeros = 0;
+
+    count_ = 0;
+    sum_ = sumSquares = 0.0;
+    min_ = std::numeric_limits<double>::infinity();
+    max_ = -std::numeric_limits<double>::infinity();
+}
+
+double
+QuantileSketch::
+mean() const
+{
+    return count_ ? sum_ / count_ : 0.0;
+}
+
+double
+QuantileSketch::
+std() const
+{
+    if (!count_) return 0.0;
+
+    double m = mean();
+    return std::sqrt(std::max(0.0, sumSquares / count_ - m * m));
+}
+
+double
+QuantileSketch::
+valueAtRank(uint64_t rank) const
+{
+    if (!count_)
+        throw ML::Exception("quantile of an empty sketch");
+    if (!maxBuckets)
+        throw ML::Exception("quantile of a sketch without buckets");
+
+    auto clamp = [&] (double value)
+        {
+            return std::min(max_, std::max(min_, value));
+        };
+
+    uint64_t seen = 0;
+
+    // Ascending order of value is descending order of magnitude for the
+    // negative values.
+    for (size_t i = negative.counts.size();  i > 0;  --i) {
+        seen += negative.counts[i - 1];
+        if (seen > rank)
+            return clamp(-bucketValue(negative.offset + int(i - 1)));
+    }
+
+    seen += zeros;
+    if (seen > rank) return clamp(0.0);
+
+    for (size_t i = 0;  i < positive.counts.size();  ++i) {
+        seen += positive.counts[i];
+        if (seen > rank)
+            return clamp(bucketValue(positive.offset + int(i)));
+    }
+
+    return max_;
+}
+
+double
+QuantileSketch::
+quantile(double q) const
+{
+    double rank = std::floor(q * count_);
+    return valueAtRank(std::min<double>(std::max(rank, 0.0), count_ - 1));
+}
+
+} // namespace Datacratic
@@ -0,0 +1,109 @@
+/* quantile_sketch.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Fixed size summary of a set of values that quantiles can be read from.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* QUANTILE SKETCH                                                           */
+/*****************************************************************************/
+
+/** Sketch of a distribution from which any quantile can be read to within a
+    relative error of the true value, whatever the number of values added.
+
+    Values are counted in buckets whose bounds grow geometrically (this is
+    DDSketch), so a bucket covers every value within relativeAccuracy of its
+    midpoint. The buckets of each sign are kept as a dense range that only
+    spans the magnitudes seen; when it would span more than maxBuckets, the
+    buckets of the smallest magnitudes are merged together.
+
+    The count, sum, min and max are exact. With maxBuckets of 0 only those
+    are kept, which is all that's needed for a mean.
+
+    Sketches with the same accuracy can be merged, which gives the same
+    result as adding all of the values to a single sketch. That makes it
+    possible to record from many threads or processes and combine on read.
+
+    NaNs and infinities are ignored.
+*/
+
+struct QuantileSketch {
+
+    QuantileSketch(double relativeAccuracy = 0.01, size_t maxBuckets = 2048);
+
+    void add(double value);
+
+    /** Adds the values of the other sketch, which must have been created
+        with the same accuracy.
+    */
+    void merge(const QuantileSketch & other);
+
+    /** Forgets all of the values but keeps the memory of the buckets. */
+    void clear();
+
+    bool empty() const { return count_ == 0; }
+    uint64_t count() const { return count_; }
+    double sum() const { return sum_; }
+    double min() const { return min_; }
+    double max() const { return max_; }
+    double mean() const;
+
+    /** Population standard deviation. */
+    double std() const;
+
+    /** Value that would be at the given 0 based position if the values were
+        sorted, within the relative accuracy and clamped to [min, max].
+    */
+    double valueAtRank(uint64_t rank) const;
+
+    /** Value below which a fraction q of the values lie. */
+    double quantile(double q) const;
+
+    double relativeAccuracy() const { return accuracy; }
+
+private:
+
+    /** Counts of a contiguous range of bucket indexes. */
+    struct Store {
+        Store() : offset(0) {}
+
+        void add(int index, uint64_t n, size_t maxBuckets);
+        void clear();
+
+        int offset;
+        std::vector<uint64_t> counts;
+
+    private:
+        void rebase(int low, int high);
+    };
+
+    int bucketIndex(double magnitude) const;
+    double bucketValue(int index) const;
+
+    double accuracy;
+    double gamma;
+    double logGamma;
+    size_t maxBuckets;
+
+    Store positive;
+    Store negative;        ///< Indexed by the magnitude of the values
+    uint64_t zeros;
+
+    uint64_t count_;
+    double sum_;
+    double sumSquares;
+    double min_;
+    double max_;
+};
+
+} // namespace Datacratic
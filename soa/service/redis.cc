@@ -15,6 +15,8 @@
 #include "jml/arch/backtrace.h"
 #include "jml/arch/futex.h"
 #include "jml/utils/vector_utils.h"
+#include "jml/utils/xxhash.h"
+#include <algorithm>
 
 
 using namespace std;
@@ -1108,4 +1110,268 @@ expireTimeouts(Date now)
     else earliestTimeout = timeouts.begin()->first;
 }
 
+
+/*****************************************************************************/
+/* CONNECTION POOL                                                           */
+/*****************************************************************************/
+
+namespace {
+
+/** Number of points that each node has on the hash ring.  More points even
+    out the share of the keys that each node gets.
+*/
+enum { RING_POINTS_PER_NODE = 160 };
+
+} // file scope
+
+ConnectionPool::
+ConnectionPool()
+    : connectionsPerNode(0)
+{
+}
+
+ConnectionPool::
+ConnectionPool(const std::vector<Address> & nodes, int connectionsPerNode)
+    : connectionsPerNode(0)
+{
+    connect(nodes, connectionsPerNode);
+}
+
+ConnectionPool::
+~ConnectionPool()
+{
+    close();
+}
+
+void
+ConnectionPool::
+connect(const std::vector<Address> & nodes, int connectionsPerNode)
+{
+    if (nodes.empty())
+        throw ML::Exception("can't connect a Redis pool without nodes");
+    if (connectionsPerNode < 1)
+        throw ML::Exception("a Redis pool needs at least one connection "
+                            "per node");
+
+    close();
+
+    this->nodes = nodes;
+    this->connectionsPerNode = connectionsPerNode;
+
+    for (unsigned i = 0;  i < nodes.size();  ++i) {
+        for (int j = 0;  j < connectionsPerNode;  ++j)
+            connections.push_back
+                (std::make_shared<AsyncConnection>(nodes[i]));
+
+        // The points depend on the address rather than on the position of
+        // the node so that reordering the nodes doesn't move the keys.
+        for (unsigned j = 0;  j < RING_POINTS_PER_NODE;  ++j) {
+            string point = nodes[i].uri() + "#" + to_string(j);
+            ring.emplace_back(XXH32(point.c_str(), point.size(), 0), i);
+        }
+    }
+
+    std::sort(ring.begin(), ring.end());
+}
+
+void
+ConnectionPool::
+test()
+{
+    for (auto & c: connections)
+        c->test();
+}
+
+void
+ConnectionPool::
+auth(const std::string & password)
+{
+    for (auto & c: connections)
+        c->auth(password);
+}
+
+void
+ConnectionPool::
+select(int database)
+{
+    for (auto & c: connections)
+        c->select(database);
+}
+
+void
+ConnectionPool::
+close()
+{
+    connections.clear();
+    ring.clear();
+    nodes.clear();
+}
+
+uint32_t
+ConnectionPool::
+hashKey(const std::string & key)
+{
+    // Only hash the "{...}" section if there is a non-empty one
+    auto start = key.find('{');
+    if (start != string::npos) {
+        auto end = key.find('}', start + 1);
+        if (end != string::npos && end != start + 1)
+            return XXH32(key.c_str() + start + 1, end - start - 1, 0);
+    }
+
+    return XXH32(key.c_str(), key.size(), 0);
+}
+
+int
+ConnectionPool::
+nodeForKey(const std::string & key) const
+{
+    ExcAssert(!ring.empty());
+
+    uint32_t hash = hashKey(key);
+    auto it = std::lower_bound(ring.begin(), ring.end(),
+                               std::make_pair(hash, 0));
+    if (it == ring.end())
+        it = ring.begin();
+    return it->second;
+}
+
+int
+ConnectionPool::
+connectionIndex(const Command & command) const
+{
+    if (connections.empty())
+        throw ML::Exception("no connection to Redis");
+
+    if (command.args.empty())
+        return 0;
+
+    const string & key = command.args[0];
+    return nodeForKey(key) * connectionsPerNode
+        + hashKey(key) % connectionsPerNode;
+}
+
+AsyncConnection &
+ConnectionPool::
+connectionForKey(const std::string & key)
+{
+    if (connections.empty())
+        throw ML::Exception("no connection to Redis");
+
+    return *connections[nodeForKey(key) * connectionsPerNode
+                        + hashKey(key) % connectionsPerNode];
+}
+
+int64_t
+ConnectionPool::
+queue(const Command & command,
+      const OnResult & onResult,
+      Timeout timeout)
+{
+    return connections[connectionIndex(command)]
+        ->queue(command, onResult, timeout);
+}
+
+Result
+ConnectionPool::
+exec(const Command & command, Timeout timeout)
+{
+    return connections[connectionIndex(command)]->exec(command, timeout);
+}
+
+struct ConnectionPool::MultiAggregator
+    : public Results {
+
+    MultiAggregator(int size, int numParts,
+                    const OnResults & onResults)
+        : numLeft(numParts), onResults(onResults)
+    {
+        resize(size);
+    }
+
+    // One connection has returned the results for its commands, which are
+    // at the given indexes
+    void results(const std::vector<int> & indexes, const Results & results)
+    {
+        for (unsigned i = 0;  i < indexes.size();  ++i)
+            at(indexes[i]) = results[i];
+
+        if (__sync_add_and_fetch(&numLeft, -1) != 0)
+            return;
+        onResults(*this);
+    }
+
+    int numLeft;
+    OnResults onResults;
+};
+
+void
+ConnectionPool::
+queueMulti(const std::vector<Command> & commands,
+           const OnResults & onResults,
+           Timeout timeout)
+{
+    if (commands.empty())
+        throw ML::Exception("can't call queueMulti with an empty list "
+                            "of commands");
+
+    // Split the commands by connection, remembering where each goes back
+    std::map<int, std::pair<std::vector<Command>, std::vector<int> > > parts;
+    for (unsigned i = 0;  i < commands.size();  ++i) {
+        auto & part = parts[connectionIndex(commands[i])];
+        part.first.push_back(commands[i]);
+        part.second.push_back(i);
+    }
+
+    if (parts.size() == 1) {
+        connections[parts.begin()->first]
+            ->queueMulti(commands, onResults, timeout);
+        return;
+    }
+
+    auto results = std::make_shared<MultiAggregator>
+        (commands.size(), parts.size(), onResults);
+
+    for (auto & part: parts) {
+        connections[part.first]->queueMulti
+            (part.second.first,
+             std::bind(&MultiAggregator::results, results,
+                       std::move(part.second.second),
+                       std::placeholders::_1),
+             timeout);
+    }
+}
+
+Results
+ConnectionPool::
+execMulti(const std::vector<Command> & commands, Timeout timeout)
+{
+    Results results;
+    int done = 0;
+
+    auto onResponse = [&] (const Redis::Results & redisResults)
+        {
+            results = redisResults;
+            done = 1;
+            futex_wake(done);
+        };
+
+    queueMulti(commands, onResponse, timeout);
+
+    while (!done)
+        futex_wait(done, 0);
+
+    return results;
+}
+
+size_t
+ConnectionPool::
+numRequestsPending() const
+{
+    size_t result = 0;
+    for (auto & c: connections)
+        result += c->numRequestsPending();
+    return result;
+}
+
 } // namespace Redis
@@ -482,6 +482,108 @@ private:
     struct MultiAggregator;
 };
 
+
+/*****************************************************************************/
+/* CONNECTION POOL                                                           */
+/*****************************************************************************/
+
+/** A set of asynchronous connections to one or more Redis nodes, over which
+    the keys are sharded.
+
+    The nodes are placed on a consistent hash ring so that adding or
+    removing a node only moves the keys of its neighbours.  As with Redis
+    Cluster, when a key contains a non-empty "{...}" section only that
+    section is hashed, which allows related keys to be kept on the same
+    node.
+
+    Each node has connectionsPerNode connections.  A given key always goes
+    through the same connection so that the commands on a key are executed
+    in the order in which they were queued; each connection pipelines the
+    commands queued by all of its callers.
+
+    Commands are routed on their first argument, which is the key for all
+    of the commands above; commands without arguments go to the first
+    node.  Commands taking several keys (MGET, MSET, ...) must only be
+    given keys that live on the same node.
+*/
+
+struct ConnectionPool {
+    typedef AsyncConnection::Timeout Timeout;
+    typedef AsyncConnection::OnResult OnResult;
+    typedef AsyncConnection::OnResults OnResults;
+
+    ConnectionPool();
+
+    ConnectionPool(const std::vector<Address> & nodes,
+                   int connectionsPerNode = 1);
+
+    ~ConnectionPool();
+
+    void connect(const std::vector<Address> & nodes,
+                 int connectionsPerNode = 1);
+
+    /** Test, authenticate or select the database on every connection.
+        These are synchronous.
+    */
+    void test();
+    void auth(const std::string & password);
+    void select(int database);
+
+    void close();
+
+    size_t numNodes() const
+    {
+        return nodes.size();
+    }
+
+    /** Return the index of the node on which the given key lives. */
+    int nodeForKey(const std::string & key) const;
+
+    /** Return the connection through which the given key is accessed. */
+    AsyncConnection & connectionForKey(const std::string & key);
+
+    /** Queue an asynchronous command on the connection of its key. */
+    int64_t queue(const Command & command,
+                  const OnResult & onResult = OnResult(),
+                  Timeout timeout = Timeout());
+
+    /** Execute synchronously. */
+    Result exec(const Command & command, Timeout timeout = Timeout());
+
+    /** Queue a list of asynchronous commands with a timeout.  The commands
+        are split by connection and queued as a block on each of them; the
+        results are returned in the order of the commands once they have
+        all arrived.
+    */
+    void queueMulti(const std::vector<Command> & commands,
+                    const OnResults & onResults = OnResults(),
+                    Timeout timeout = Timeout());
+
+    /** Execute multiple commands synchronously. */
+    Results execMulti(const std::vector<Command> & commands,
+                      Timeout timeout = Timeout());
+
+    size_t numRequestsPending() const;
+
+private:
+    std::vector<Address> nodes;
+    int connectionsPerNode;
+
+    /** Connections of each node, connectionsPerNode at a time. */
+    std::vector<std::shared_ptr<AsyncConnection> > connections;
+
+    /** Points of the consistent hash ring, sorted by hash, with the node
+        that owns the part of the ring that ends at each of them.
+    */
+    std::vector<std::pair<uint32_t, int> > ring;
+
+    static uint32_t hashKey(const std::string & key);
+
+    int connectionIndex(const Command & command) const;
+
+    struct MultiAggregator;
+};
+
 } // namespace Datacratic
 
 #endif /* __redis__redis_h__ */
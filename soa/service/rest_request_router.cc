@@ -147,7 +147,8 @@ processRequest(const RestServiceEndpoint::ConnectionId & connection,
     if (rootHandler && (!terminal || context.remaining.empty()))
         return rootHandler(connection, request, context);
 
-    for (auto & sr: subRoutes) {
+    for (unsigned i: index.candidates(context.remaining)) {
+        auto & sr = subRoutes[i];
         if (debug)
             cerr << "  trying subroute " << sr.router->description << endl;
         try {
@@ -187,23 +188,22 @@ matchPath(const RestRequest & request,
 {
     switch (path.type) {
     case PathSpec::STRING: {
-        std::string::size_type pos = context.remaining.find(path.path);
-        if (pos == 0) {
-            using namespace std;
-            //cerr << "context string " << pos << endl;
+        if (context.remaining.compare(0, path.path.size(), path.path) == 0) {
             context.resources.push_back(path.path);
-            context.remaining = string(context.remaining, path.path.size());
+            context.remaining.erase(0, path.path.size());
             break;
         }
         else return false;
     }
     case PathSpec::REGEX: {
+        // match_continuous anchors the match at the start rather than
+        // searching the whole path and then rejecting a non-empty prefix.
         boost::smatch results;
         bool found
             = boost::regex_search(context.remaining,
                                   results,
-                                  path.rex)
-            && !results.prefix().matched;  // matches from the start
+                                  path.rex,
+                                  boost::match_continuous);
         
         //cerr << "matching regex " << path.path << " against "
         //     << context.remaining << " with found " << found << endl;
@@ -211,8 +211,7 @@ matchPath(const RestRequest & request,
             return false;
         for (unsigned i = 0;  i < results.size();  ++i)
             context.resources.push_back(results[i]);
-        context.remaining = std::string(context.remaining,
-                                        results[0].length());
+        context.remaining.erase(0, results[0].length());
         break;
     }
     case PathSpec::NONE:
@@ -295,6 +294,7 @@ addRoute(PathSpec path, RequestFilter filter,
     route.router = handler;
     route.extractObject = extractObject;
 
+    index.add(route.path, subRoutes.size());
     subRoutes.emplace_back(std::move(route));
 }
 
@@ -368,10 +368,82 @@ addSubRouter(PathSpec path, const std::string & description, ExtractObject extra
     route.router->description = description;
     route.extractObject = extractObject;
 
+    index.add(route.path, subRoutes.size());
     subRoutes.push_back(route);
     return *route.router;
 }
 
+
+/*****************************************************************************/
+/* ROUTE INDEX                                                               */
+/*****************************************************************************/
+
+RestRequestRouter::RouteIndex::
+RouteIndex()
+    : nodes(1)
+{
+}
+
+void
+RestRequestRouter::RouteIndex::
+add(const PathSpec & path, unsigned route)
+{
+    if (path.type != PathSpec::STRING) {
+        unindexed.push_back(route);
+        return;
+    }
+
+    unsigned node = 0;
+    for (char c: path.path) {
+        auto & children = nodes[node].children;
+        auto it = std::find_if(children.begin(), children.end(),
+                               [=] (const std::pair<char, unsigned> & child)
+                               {
+                                   return child.first == c;
+                               });
+        if (it != children.end()) {
+            node = it->second;
+            continue;
+        }
+
+        // Careful: this invalidates the children reference.
+        unsigned child = nodes.size();
+        nodes.emplace_back();
+        nodes[node].children.emplace_back(c, child);
+        node = child;
+    }
+
+    nodes[node].routes.push_back(route);
+}
+
+RestRequestRouter::RouteIndex::Candidates
+RestRequestRouter::RouteIndex::
+candidates(const std::string & remaining) const
+{
+    Candidates result(unindexed.begin(), unindexed.end());
+
+    unsigned node = 0;
+    for (size_t i = 0;  ;  ++i) {
+        const Node & current = nodes[node];
+        result.insert(result.end(),
+                      current.routes.begin(), current.routes.end());
+
+        if (i == remaining.size()) break;
+
+        auto it = std::find_if(current.children.begin(), current.children.end(),
+                               [&] (const std::pair<char, unsigned> & child)
+                               {
+                                   return child.first == remaining[i];
+                               });
+        if (it == current.children.end()) break;
+        node = it->second;
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+
 RestRequestRouter::OnProcessRequest
 RestRequestRouter::
 getStaticRouteHandler(const string dir) const {
@@ -10,6 +10,7 @@
 #include "soa/service/message_loop.h"
 #include "soa/service/rest_service_endpoint.h"
 #include "jml/utils/vector_utils.h"
+#include "jml/utils/compact_vector.h"
 #include "jml/utils/positioned_types.h"
 #include "jml/arch/rtti_utils.h"
 #include "jml/arch/demangle.h"
@@ -535,12 +536,46 @@ struct RestRequestRouter {
         route.router = res;
         route.router->description = description;
         route.extractObject = getExtractObject(res.get());
+        index.add(route.path, subRoutes.size());
         subRoutes.push_back(route);
         return *res;
     }
+
+    /** Index over the paths of the subroutes used to skip the subroutes
+        that can't match the remaining part of a request's path.  The
+        string paths are compiled into a prefix trie so that a single walk
+        over the remaining path finds all of them that match; the regex
+        paths can't be indexed and are always candidates.
+
+        The index is only modified when routes are added which is expected
+        to happen before the requests start to come in so lookups, which
+        are const, can run concurrently without locking.
+    */
+    struct RouteIndex {
+        RouteIndex();
+
+        void add(const PathSpec & path, unsigned route);
+
+        typedef ML::compact_vector<unsigned, 16> Candidates;
+
+        /** Returns the index of the subroutes that can match the given path
+            in the order in which they were added.
+        */
+        Candidates candidates(const std::string & remaining) const;
+
+    private:
+        struct Node {
+            std::vector<std::pair<char, unsigned> > children;
+            std::vector<unsigned> routes;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<unsigned> unindexed;
+    };
     
     OnProcessRequest rootHandler;
     std::vector<Route> subRoutes;
+    RouteIndex index;
     std::string description;
     bool terminal;
     Json::Value argHelp;
@@ -8,6 +8,7 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -529,54 +530,37 @@ doRunImpl(const vector<string> & command,
         tie(task_.stdErrFd, childFds.stdErr) = CreateStdPipe(false);
     }
 
-    ::flockfile(stdout);
-    ::flockfile(stderr);
-    ::fflush_unlocked(NULL);
-    task_.wrapperPid = fork();
-    int savedErrno = errno;
-    ::funlockfile(stderr);
-    ::funlockfile(stdout);
-    if (task_.wrapperPid == -1) {
-        throw ML::Exception(savedErrno, "Runner::run fork");
+    try {
+        task_.wrapperPid = task_.spawnWrapper(command, childFds);
     }
-    else if (task_.wrapperPid == 0) {
-        try {
-            task_.runWrapper(command, childFds);
-        }
-        catch (...) {
-            ProcessStatus status;
-            status.state = ProcessState::STOPPED;
-            status.setErrorCodes(errno, LaunchError::SUBTASK_LAUNCH);
-            childFds.writeStatus(status);
-
-            exit(-1);
-        }
+    catch (...) {
+        childFds.close();
+        throw;
     }
-    else {
-        task_.statusState = ProcessState::LAUNCHING;
 
-        ML::set_file_flag(task_.statusFd, O_NONBLOCK);
-        auto statusCb = [&] (const epoll_event & event) {
-            handleChildStatus(event);
-        };
-        addFd(task_.statusFd, true, false, statusCb);
-        if (stdOutSink) {
-            ML::set_file_flag(task_.stdOutFd, O_NONBLOCK);
-            auto outputCb = [=] (const epoll_event & event) {
-                handleOutputStatus(event, task_.stdOutFd, stdOutSink_);
-            };
-            addFd(task_.stdOutFd, true, false, outputCb);
-        }
-        if (stdErrSink) {
-            ML::set_file_flag(task_.stdErrFd, O_NONBLOCK);
-            auto outputCb = [=] (const epoll_event & event) {
-                handleOutputStatus(event, task_.stdErrFd, stdErrSink_);
-            };
-            addFd(task_.stdErrFd, true, false, outputCb);
-        }
+    task_.statusState = ProcessState::LAUNCHING;
 
-        childFds.close();
+    ML::set_file_flag(task_.statusFd, O_NONBLOCK);
+    auto statusCb = [&] (const epoll_event & event) {
+        handleChildStatus(event);
+    };
+    addFd(task_.statusFd, true, false, statusCb);
+    if (stdOutSink) {
+        ML::set_file_flag(task_.stdOutFd, O_NONBLOCK);
+        auto outputCb = [=] (const epoll_event & event) {
+            handleOutputStatus(event, task_.stdOutFd, stdOutSink_);
+        };
+        addFd(task_.stdOutFd, true, false, outputCb);
     }
+    if (stdErrSink) {
+        ML::set_file_flag(task_.stdErrFd, O_NONBLOCK);
+        auto outputCb = [=] (const epoll_event & event) {
+            handleOutputStatus(event, task_.stdErrFd, stdErrSink_);
+        };
+        addFd(task_.stdErrFd, true, false, outputCb);
+    }
+
+    childFds.close();
 }
 
 bool
@@ -688,57 +672,48 @@ Task()
       statusState(ProcessState::UNKNOWN)
 {}
 
-void
+pid_t
 Runner::Task::
-runWrapper(const vector<string> & command, ProcessFds & fds)
+spawnWrapper(const vector<string> & command, const ProcessFds & fds)
 {
     // Find runner_helper path
     string runnerHelper = findRunnerHelper();
 
-    vector<string> preArgs = { /*"gdb", "--tty", "/dev/pts/48", "--args"*/ /*"../strace-code/strace", "-b", "execve", "-ftttT", "-o", "runner_helper.strace"*/ };
-
-
-    // Set up the arguments before we fork, as we don't want to call malloc()
-    // from the fork, and it can be called from c_str() in theory.
-    auto len = command.size();
-    char * argv[len + 3 + preArgs.size()];
-
-    for (unsigned i = 0;  i < preArgs.size();  ++i)
-        argv[i] = (char *)preArgs[i].c_str();
-
-    int idx = preArgs.size();
-
-    argv[idx++] = (char *) runnerHelper.c_str();
-
     size_t channelsSize = 4*2*4+3+1;
     char channels[channelsSize];
     fds.encodeToBuffer(channels, channelsSize);
-    argv[idx++] = channels;
 
-    for (int i = 0; i < len; i++) {
-        argv[idx++] = (char *) command[i].c_str();
+    vector<char *> argv;
+    argv.reserve(command.size() + 3);
+    argv.push_back((char *) runnerHelper.c_str());
+    argv.push_back(channels);
+    for (const string & arg: command) {
+        argv.push_back((char *) arg.c_str());
     }
-    argv[idx++] = nullptr;
+    argv.push_back(nullptr);
 
-    std::vector<char *> env;
-
-    char * const * p = environ;
-
-    while (*p) {
-        env.push_back(*p);
-        ++p;
+    /* The helper sets up the standard streams from the fds passed in its
+       arguments and closes all the others, so the only thing to undo here
+       is the signal mask of the calling thread. */
+    posix_spawnattr_t attr;
+    int res = ::posix_spawnattr_init(&attr);
+    if (res != 0) {
+        throw ML::Exception(res, "posix_spawnattr_init");
     }
+    ML::Call_Guard guard([&] () { ::posix_spawnattr_destroy(&attr); });
 
-    env.push_back(nullptr);
-
-    char * const * envp = &env[0];
+    sigset_t mask;
+    ::sigemptyset(&mask);
+    ::posix_spawnattr_setsigmask(&attr, &mask);
+    ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
 
-    int res = execve(argv[0], argv, envp);
-    if (res == -1) {
-        throw ML::Exception(errno, "launching runner helper");
+    pid_t pid;
+    res = ::posix_spawn(&pid, argv[0], nullptr, &attr, &argv[0], environ);
+    if (res != 0) {
+        throw ML::Exception(res, "launching runner helper");
     }
 
-    throw ML::Exception("You are the King of Time!");
+    return pid;
 }
 
 string
@@ -209,8 +209,12 @@ private:
         void setupInSink();
         void flushInSink();
         void flushStdInBuffer();
-        void runWrapper(const std::vector<std::string> & command,
-                        ProcessFds & fds);
+        /** Launch the runner helper with posix_spawn, which does not
+            duplicate the address space of the calling process, and return
+            its pid.
+        */
+        pid_t spawnWrapper(const std::vector<std::string> & command,
+                           const ProcessFds & fds);
         std::string findRunnerHelper();
 
         void postTerminate(Runner & runner);
@@ -27,6 +27,7 @@
 #include "xml_helpers.h"
 
 #include <boost/iostreams/stream_buffer.hpp>
+#include <condition_variable>
 #include <exception>
 #include <thread>
 #include <unordered_map>
@@ -1626,23 +1627,51 @@ size_t getTotalSystemMemory()
     return pages * page_size;
 }
 
+/** Options of a streaming download, which can be given as options of the
+    filter_istream:
+    - num-threads: number of ranges downloaded at once (0 picks from 1 to 5
+      depending on the size of the object)
+    - chunk-size: size of the ranges (0 starts at 1MB and doubles every two
+      ranges up to what can be downloaded in 3 seconds)
+    - read-ahead: number of ranges downloaded or being downloaded ahead of
+      the reader (0 is twice the number of threads)
+    - range-retries: number of times a range that fails is downloaded again
+      before the error is returned to the reader
+*/
+struct StreamingDownloadOptions {
+    StreamingDownloadOptions()
+        : numThreads(0), chunkSize(0), readAhead(0), rangeRetries(3)
+    {
+    }
+
+    unsigned numThreads;
+    size_t chunkSize;
+    unsigned readAhead;
+    unsigned rangeRetries;
+};
+
 struct StreamingDownloadSource {
-    StreamingDownloadSource(const std::string & urlStr)
+    StreamingDownloadSource(const std::string & urlStr,
+                            const StreamingDownloadOptions & options
+                                = StreamingDownloadOptions())
     {
         impl.reset(new Impl());
         impl->owner = getS3ApiForUri(urlStr);
         std::tie(impl->bucket, impl->object) = S3Api::parseUri(urlStr);
         impl->info = impl->owner->getObjectInfo(urlStr);
-        impl->baseChunkSize = 1024 * 1024;  // start with 1MB and ramp up
-
-        int numThreads = 1;
-        if (impl->info.size > 1024 * 1024)
-            numThreads = 2;
-        if (impl->info.size > 16 * 1024 * 1024)
-            numThreads = 3;
-        if (impl->info.size > 256 * 1024 * 1024)
-            numThreads = 5;
-        
+        impl->options = options;
+
+        int numThreads = options.numThreads;
+        if (!numThreads) {
+            numThreads = 1;
+            if (impl->info.size > 1024 * 1024)
+                numThreads = 2;
+            if (impl->info.size > 16 * 1024 * 1024)
+                numThreads = 3;
+            if (impl->info.size > 256 * 1024 * 1024)
+                numThreads = 5;
+        }
+
         impl->start(numThreads);
     }
 
@@ -1654,11 +1683,16 @@ struct StreamingDownloadSource {
         boost::iostreams::closable_tag
     { };
 
+    /** The object is cut into ranges that the http threads take in order
+        and download into the slot of a window of readAhead ranges that
+        starts at the one being read, so that they're given to the reader in
+        order however they complete.
+    */
     struct Impl {
         Impl()
-            : baseChunkSize(0)
+            : shutdown(false), readOffset(0), readPartOffset(-1),
+              nextRange(0), readRange(0)
         {
-            reset();
         }
 
         ~Impl()
@@ -1671,12 +1705,12 @@ struct StreamingDownloadSource {
         std::string bucket;
         std::string object;
         S3Api::ObjectInfo info;
-        size_t baseChunkSize;
+        StreamingDownloadOptions options;
 
-        /* variables set during or after "start" has been called */
-        size_t maxChunkSize;
+        /* ranges of the object, set by "start" */
+        std::vector<S3Api::Range> ranges;
 
-        atomic<bool> shutdown;
+        bool shutdown;
         exception_ptr lastExc;
 
         /* read thread */
@@ -1688,78 +1722,74 @@ struct StreamingDownloadSource {
         ssize_t readPartOffset; /* number of bytes from "readPart" that have
                                  * been returned to the caller, or -1 when
                                  * awaiting a new part */
-        int readPartDone; /* the number of the chunk representing "readPart" */
 
-        /* http threads */
-        typedef RingBufferSRMW<string> ThreadData;
+        /* window of ranges, guarded by lock */
+        std::mutex lock;
+        std::condition_variable changed;
+        size_t nextRange; /* next range to be taken by an http thread */
+        size_t readRange; /* range that the reader is waiting for or reading */
+
+        struct Slot {
+            Slot() : done(false) {}
+            bool done;
+            string data;
+        };
+        std::vector<Slot> window; /* indexed by range % readAhead */
 
-        int numThreads; /* number of http threads */
         vector<thread> threads; /* thread pool */
-        vector<ThreadData> threadQueues; /* per-thread queue of chunk data */
 
-        /* cleanup all the variables that are used during reading, the
-           "static" ones are left untouched */
-        void reset()
+        void start(int numThreads)
         {
-            shutdown = false;
+            size_t chunkSize = options.chunkSize;
+            size_t maxChunkSize = chunkSize;
+
+            if (!chunkSize) {
+                // Maximum chunk size is what we can do in 3 seconds
+                maxChunkSize = (owner->bandwidthToServiceMbps
+                                * 3.0 * 1000000);
+                size_t sysMemory = getTotalSystemMemory();
+
+                // Limit each chunk to 1% of system memory
+                maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
+                chunkSize = 1024 * 1024;  // start with 1MB and ramp up
+            }
 
-            readOffset = 0;
+            for (uint64_t offset = 0;  offset < info.size;) {
+                size_t size = std::min<uint64_t>(chunkSize, info.size - offset);
+                ranges.emplace_back(offset, size);
+                offset += size;
 
-            readPart = "";
-            readPartOffset = -1;
-            readPartDone = 0;
+                if (ranges.size() % 2 == 0)
+                    chunkSize = std::min(chunkSize * 2, maxChunkSize);
+            }
 
-            threadQueues.clear();
-            threads.clear();
-            numThreads = 0;
-        }
+            unsigned readAhead = options.readAhead;
+            if (!readAhead)
+                readAhead = 2 * numThreads;
+            window.resize(readAhead);
 
-        void start(int nThreads)
-        {
-            // Maximum chunk size is what we can do in 3 seconds
-            maxChunkSize = (owner->bandwidthToServiceMbps
-                            * 3.0 * 1000000);
-            size_t sysMemory = getTotalSystemMemory();
-
-            //cerr << "sysMemory = " << sysMemory << endl;
-            // Limit each chunk to 1% of system memory
-            maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
-            //cerr << "maxChunkSize = " << maxChunkSize << endl;
-            numThreads = nThreads;
-
-            for (int i = 0; i < numThreads; i++) {
-                threadQueues.emplace_back(2);
-            }
-            
-            /* ensure that the queues are ready before the threads are
-               launched */
-            ML::memory_barrier();
-
-            for (int i = 0; i < numThreads; i++) {
-                auto threadFn = [&] (int threadNum) {
-                    this->runThread(threadNum);
-                };
-                threads.emplace_back(threadFn, i);
-            }
+            numThreads = std::min<size_t>(numThreads, ranges.size());
+            for (int i = 0; i < numThreads; i++)
+                threads.emplace_back(&Impl::runThread, this);
         }
 
         void stop()
         {
-            shutdown = true;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                shutdown = true;
+                changed.notify_all();
+            }
+
             for (thread & th: threads) {
                 th.join();
             }
-
-            reset();
+            threads.clear();
         }
 
         /* reader thread */
         std::streamsize read(char_type* s, std::streamsize n)
         {
-            if (lastExc) {
-                rethrow_exception(lastExc);
-            }
-
             if (readOffset == info.size)
                 return -1;
 
@@ -1767,10 +1797,6 @@ struct StreamingDownloadSource {
                 waitNextPart();
             }
 
-            if (lastExc) {
-                rethrow_exception(lastExc);
-            }
-
             size_t toDo = min<size_t>(readPart.size() - readPartOffset,
                                       n);
             const char_type * start = readPart.c_str() + readPartOffset;
@@ -1788,95 +1814,102 @@ struct StreamingDownloadSource {
 
         void waitNextPart()
         {
-            int partThread = readPartDone % numThreads;
-            ThreadData & threadQueue = threadQueues[partThread];
+            std::unique_lock<std::mutex> guard(lock);
 
-            /* We set a timeout to avoid dead locking when http threads have
-             * exited after an exception. */
-            while (!lastExc) {
-                if (threadQueue.tryPop(readPart, 1.0)) {
-                    break;
-                }
-            }
+            Slot & slot = window[readRange % window.size()];
+            changed.wait(guard, [&] { return slot.done || lastExc; });
 
+            // Data that was downloaded before the error is still returned
+            if (!slot.done)
+                rethrow_exception(lastExc);
+
+            readPart.swap(slot.data);
+            slot.data = string();
+            slot.done = false;
             readPartOffset = 0;
-            readPartDone++;
+            ++readRange;
+
+            // The slot can now take the range readAhead further
+            changed.notify_all();
         }
 
         /* download threads */
-        void runThread(int threadNum)
+        void runThread()
         {
-            ThreadData & threadQueue = threadQueues[threadNum];
+            std::unique_lock<std::mutex> guard(lock);
 
-            uint64_t start = 0;
-            unsigned int prevChunkNbr = 0;
+            for (;;) {
+                changed.wait(guard, [&] {
+                        return shutdown || lastExc
+                            || nextRange >= ranges.size()
+                            || nextRange < readRange + window.size();
+                    });
+                if (shutdown || lastExc || nextRange >= ranges.size())
+                    return;
 
-            try {
-                for (int loop = 0;; loop++) {
-                    /* number of the chunk that we need to process */
-                    unsigned int chunkNbr = loop * numThreads + threadNum;
-
-                    /* we adjust the offset by adding the chunk sizes of all
-                       the chunks downloaded between our previous loop until
-                       now */
-                    for (unsigned int i = prevChunkNbr; i < chunkNbr; i++) {
-                        start += getChunkSize(i);
-                    }
+                size_t range = nextRange++;
 
-                    if (start >= info.size) {
-                        /* we are done */
-                        return;
-                    }
-                    prevChunkNbr = chunkNbr;
+                string data;
+                guard.unlock();
+                try {
+                    data = getRange(ranges[range]);
+                }
+                catch (...) {
+                    guard.lock();
+                    lastExc = current_exception();
+                    changed.notify_all();
+                    return;
+                }
+                guard.lock();
 
-                    size_t chunkSize = getChunkSize(chunkNbr);
-                    uint64_t end = start + chunkSize;
-                    if (end > info.size) {
-                        end = info.size;
-                        chunkSize = end - start;
-                    }
+                Slot & slot = window[range % window.size()];
+                slot.data.swap(data);
+                slot.done = true;
+                changed.notify_all();
+            }
+        }
 
-                    auto partResult
-                        = owner->get(bucket, "/" + object,
-                                     S3Api::Range(start, chunkSize));
-                    if (!(partResult.code_ == 206 || partResult.code_ == 200)) {
-                        throw ML::Exception("http error "
-                                            + to_string(partResult.code_)
-                                            + " while getting part "
-                                            + partResult.bodyXmlStr());
-                    }
-                    // it can sometimes happen that a file changes during download
-                    // i.e it is being overwritten. Make sure we check for this condition
-                    // and throw an appropriate exception
+        /** Downloads a range, trying again up to rangeRetries times when the
+            answer isn't what's expected.  A change of etag means the object
+            was overwritten during the download, which retrying won't fix.
+        */
+        string getRange(const S3Api::Range & range)
+        {
+            for (unsigned attempt = 0;;  ++attempt) {
+                auto partResult = owner->get(bucket, "/" + object, range);
+
+                string error;
+                if (!(partResult.code_ == 206 || partResult.code_ == 200)) {
+                    error = "http error " + to_string(partResult.code_)
+                        + " while getting part " + partResult.bodyXmlStr();
+                }
+                else {
+                    // it can sometimes happen that a file changes during
+                    // download i.e it is being overwritten.
                     string chunkEtag = partResult.getHeader("etag") ;
                     if(chunkEtag != info.etag)
                         throw ML::Exception("chunk etag %s not equal to file etag %s: file <%s> has changed during download!!", chunkEtag.c_str(), info.etag.c_str(), object.c_str());
-                    ExcAssert(partResult.body().size() == chunkSize);
 
-                    while (true) {
-                        if (shutdown || lastExc) {
-                            return;
-                        }
-                        if (threadQueue.tryPush(partResult.body())) {
-                            break;
-                        }
-                        else {
-                            ML::sleep(0.1);
-                        }
-                    }
+                    if (partResult.body().size() == range.size)
+                        return partResult.body();
+
+                    error = ML::format("got %zd bytes instead of %zd",
+                                       partResult.body().size(),
+                                       (size_t)range.size);
                 }
-            }
-            catch (...) {
-                lastExc = current_exception();
-            }
-        }
 
-        size_t getChunkSize(unsigned int chunkNbr)
-            const
-        {
-            size_t chunkSize = std::min(baseChunkSize * (1 << (chunkNbr / 2)),
-                                        maxChunkSize);
-            return chunkSize;
+                if (attempt >= options.rangeRetries)
+                    throw ML::Exception(error);
+
+                ::fprintf(stderr, "retrying range %zd-%zd of %s: %s\n",
+                          (size_t)range.offset, (size_t)range.endPos(),
+                          object.c_str(), error.c_str());
+
+                std::unique_lock<std::mutex> guard(lock);
+                if (shutdown)
+                    throw ML::Exception("download of %s stopped",
+                                        object.c_str());
+            }
         }
     };
 
@@ -1899,11 +1932,13 @@ struct StreamingDownloadSource {
 };
 
 std::unique_ptr<std::streambuf>
-makeStreamingDownload(const std::string & uri)
+makeStreamingDownload(const std::string & uri,
+                      const StreamingDownloadOptions & options
+                          = StreamingDownloadOptions())
 {
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<StreamingDownloadSource>
-                 (StreamingDownloadSource(uri),
+                 (StreamingDownloadSource(uri, options),
                   131072));
     return result;
 }
@@ -1928,6 +1963,13 @@ struct StreamingUploadSource {
         impl->onException = excCallback;
         impl->chunkSize = 8 * 1024 * 1024;  // start with 8MB and ramp up
 
+        // S3 refuses parts under 5MB other than the last one
+        if (metadata.partSize) {
+            if (metadata.partSize < 5 * 1024 * 1024)
+                throw ML::Exception("S3 upload parts must be at least 5MB");
+            impl->chunkSize = metadata.partSize;
+        }
+
         impl->start();
     }
 
@@ -1942,7 +1984,7 @@ struct StreamingUploadSource {
     struct Impl {
         Impl()
             : offset(0), chunkIndex(0), shutdown(false),
-              chunks(16)
+              chunks(16), partsInFlight(0)
         {
         }
 
@@ -2040,8 +2082,18 @@ struct StreamingUploadSource {
         std::exception_ptr exc;
         ML::OnUriHandlerException onException;
 
+        /// Parts pushed whose upload isn't done, and the time at which the
+        /// next one can be sent when the bandwidth is limited
+        std::mutex partsLock;
+        std::condition_variable partDone;
+        size_t partsInFlight;
+        Date nextSendDate;
+
         void start()
         {
+            if (metadata.maxPartsInFlight)
+                chunks.init(metadata.maxPartsInFlight + 1);
+
             S3Api::MultiPartUpload upload;
             try {
                 upload = owner->obtainMultiPartUpload(bucket, "/" + object,
@@ -2093,11 +2145,12 @@ struct StreamingUploadSource {
         void flush()
         {
             if (current.size == 0) return;
-            chunks.push(std::move(current));
+            push(std::move(current));
             ++chunkIndex;
 
             // Get bigger for bigger files
-            if (chunkIndex % 5 == 0 && chunkSize < 64 * 1024 * 1024)
+            if (!metadata.partSize
+                && chunkIndex % 5 == 0 && chunkSize < 64 * 1024 * 1024)
                 chunkSize *= 2;
 
             current.init(offset, chunkSize, chunkIndex);
@@ -2111,7 +2164,7 @@ struct StreamingUploadSource {
             flush();
 
             if (!chunkIndex) {
-                chunks.push(std::move(current));
+                push(std::move(current));
                 ++chunkIndex;
             }
 
@@ -2149,14 +2202,66 @@ struct StreamingUploadSource {
             //      << "MB/s" << " to " << etag << endl;
         }
 
+        /** Queues a part, waiting first for one to be done if there are
+            already maxPartsInFlight.
+        */
+        void push(Chunk && chunk)
+        {
+            if (metadata.maxPartsInFlight) {
+                std::unique_lock<std::mutex> guard(partsLock);
+                partDone.wait(guard, [&] {
+                        return exc
+                            || partsInFlight < metadata.maxPartsInFlight;
+                    });
+                if (exc)
+                    std::rethrow_exception(exc);
+                ++partsInFlight;
+            }
+
+            chunks.push(std::move(chunk));
+        }
+
+        void onPartDone()
+        {
+            if (!metadata.maxPartsInFlight) return;
+
+            std::unique_lock<std::mutex> guard(partsLock);
+            --partsInFlight;
+            partDone.notify_all();
+        }
+
+        /** Waits until a part of the given size can be sent without going
+            over maxBandwidthMbps on average.
+        */
+        void throttle(size_t size)
+        {
+            if (metadata.maxBandwidthMbps <= 0.0) return;
+
+            Date sendDate;
+            {
+                std::unique_lock<std::mutex> guard(partsLock);
+                sendDate = std::max(Date::now(), nextSendDate);
+                nextSendDate = sendDate.plusSeconds(
+                        size / 1000000.0 / metadata.maxBandwidthMbps);
+            }
+
+            double wait = sendDate.secondsSince(Date::now());
+            if (wait > 0)
+                ML::sleep(wait);
+        }
+
         void runThread()
         {
             while (!shutdown) {
                 Chunk chunk;
                 if (chunks.tryPop(chunk, 0.01)) {
-                    if (exc)
+                    if (exc) {
+                        onPartDone();
                         return;
+                    }
                     try {
+                        throttle(chunk.size);
+
                         //cerr << "got chunk " << chunk.index
                         //     << " with " << chunk.size << " bytes at index "
                         //     << chunk.index << endl;
@@ -2186,9 +2291,13 @@ struct StreamingUploadSource {
                         etags[chunk.index] = etag;
                     } catch (...) {
                         // Capture exception to be thrown later
+                        std::unique_lock<std::mutex> guard(partsLock);
                         exc = std::current_exception();
+                        guard.unlock();
                         onException();
                     }
+
+                    onPartDone();
                 }
             }
         }
@@ -2479,7 +2588,22 @@ struct RegisterS3Handler {
         string bucket(resource, 0, pos);
 
         if (mode == ios::in) {
-            return make_pair(makeStreamingDownload("s3://" + resource)
+            StreamingDownloadOptions downloadOptions;
+            for (auto & opt: options) {
+                const string & name = opt.first;
+                const string & value = opt.second;
+                if (name == "num-threads")
+                    downloadOptions.numThreads = std::stoi(value);
+                else if (name == "chunk-size")
+                    downloadOptions.chunkSize = std::stoull(value);
+                else if (name == "read-ahead")
+                    downloadOptions.readAhead = std::stoi(value);
+                else if (name == "range-retries")
+                    downloadOptions.rangeRetries = std::stoi(value);
+            }
+
+            return make_pair(makeStreamingDownload("s3://" + resource,
+                                                   downloadOptions)
                              .release(),
                              true);
         }
@@ -2518,6 +2642,15 @@ struct RegisterS3Handler {
                 {
                     md.numThreads = std::stoi(value);
                 }
+                else if (name == "part-size") {
+                    md.partSize = std::stoull(value);
+                }
+                else if (name == "max-parts-in-flight") {
+                    md.maxPartsInFlight = std::stoi(value);
+                }
+                else if (name == "max-bandwidth-mbps") {
+                    md.maxBandwidthMbps = std::stod(value);
+                }
                 else {
                     cerr << "warning: skipping unknown S3 option "
                          << name << "=" << value << endl;
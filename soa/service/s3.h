@@ -244,14 +244,16 @@ struct S3Api : public AwsApi {
         ObjectMetadata()
             : redundancy(REDUNDANCY_DEFAULT),
               serverSideEncryption(SSE_NONE),
-              numThreads(8)
+              numThreads(8), partSize(0), maxPartsInFlight(0),
+              maxBandwidthMbps(0.0)
         {
         }
 
         ObjectMetadata(const Redundancy & redundancy)
             : redundancy(redundancy),
               serverSideEncryption(SSE_NONE),
-              numThreads(8)
+              numThreads(8), partSize(0), maxPartsInFlight(0),
+              maxBandwidthMbps(0.0)
         {
         }
 
@@ -265,6 +267,17 @@ struct S3Api : public AwsApi {
         std::map<std::string, std::string> metadata;
         std::string acl;
         unsigned int numThreads;
+
+        /** Options of streaming uploads.  With a partSize of 0 the parts
+            start at 8MB and double every 5 parts up to 64MB.  With a
+            maxPartsInFlight of 0, 15 parts can be waiting for a thread on
+            top of those being uploaded; otherwise writes block while that
+            many parts are waiting or being uploaded.  Parts are sent no
+            faster than maxBandwidthMbps (in MB/s) unless it's 0.
+        */
+        size_t partSize;
+        unsigned int maxPartsInFlight;
+        double maxBandwidthMbps;
     };
 
     /** Signed request that can be executed. */
@@ -0,0 +1,469 @@
+/* sampling_profiler.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Sampling CPU profiler that can be started and stopped while a service is
+   running.
+*/
+
+#include "sampling_profiler.h"
+#include "rest_request_router.h"
+#include "jml/arch/backtrace.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+
+#include <errno.h>
+#include <string.h>
+#include <execinfo.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+namespace {
+
+/// Upper limit on maxSamples * maxDepth, to bound the memory used
+const size_t MAX_FRAMES = 1 << 24;
+
+/** Nanoseconds on the monotonic clock.  Async signal safe. */
+uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Address of the instruction that was interrupted by the signal, or null
+    if it can't be found on this platform.
+*/
+void * interruptedPc(void * context)
+{
+#if defined(__x86_64__)
+    ucontext_t * uc = reinterpret_cast<ucontext_t *>(context);
+    return reinterpret_cast<void *>(uc->uc_mcontext.gregs[REG_RIP]);
+#else
+    return nullptr;
+#endif
+}
+
+/// Number of signal handlers being run, so that start() doesn't replace
+/// the buffers under one of them
+std::atomic<int> inHandler(0);
+
+/// The interrupted instruction of the sample being taken; see onSignal()
+thread_local void * samplePc = nullptr;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER CONFIG                                                  */
+/*****************************************************************************/
+
+SamplingProfiler::Config
+SamplingProfiler::Config::
+fromJson(const Json::Value & json)
+{
+    Config result;
+    if (json.isNull())
+        return result;
+    if (!json.isObject())
+        throw ML::Exception("profiler configuration must be an object");
+
+    for (auto it = json.begin(), end = json.end();  it != end;  ++it) {
+        string key = it.memberName();
+        if (key == "frequency")
+            result.frequency = it->asDouble();
+        else if (key == "maxSeconds")
+            result.maxSeconds = it->asDouble();
+        else if (key == "maxSamples")
+            result.maxSamples = it->asInt();
+        else if (key == "maxDepth")
+            result.maxDepth = it->asInt();
+        else if (key == "maxOverhead")
+            result.maxOverhead = it->asDouble();
+        else throw ML::Exception("unknown profiler configuration key "
+                                 + key);
+    }
+
+    return result;
+}
+
+Json::Value
+SamplingProfiler::Config::
+toJson() const
+{
+    Json::Value result;
+    result["frequency"] = frequency;
+    result["maxSeconds"] = maxSeconds;
+    result["maxSamples"] = maxSamples;
+    result["maxDepth"] = maxDepth;
+    result["maxOverhead"] = maxOverhead;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER                                                         */
+/*****************************************************************************/
+
+SamplingProfiler::
+SamplingProfiler()
+    : running_(false), armed(false), nextSample(0), handlerNs(0),
+      stopReason(nullptr), startNs(0), endNs(0)
+{
+}
+
+SamplingProfiler &
+SamplingProfiler::
+instance()
+{
+    static SamplingProfiler profiler;
+    return profiler;
+}
+
+void
+SamplingProfiler::
+start(const Config & newConfig)
+{
+    if (!(newConfig.frequency >= 1
+          && newConfig.frequency <= MAX_FREQUENCY))
+        throw ML::Exception("profiler frequency must be between 1 and %d",
+                            (int)MAX_FREQUENCY);
+    if (!(newConfig.maxSeconds > 0))
+        throw ML::Exception("profiler maxSeconds must be positive");
+    if (newConfig.maxDepth < 1 || newConfig.maxDepth > MAX_DEPTH)
+        throw ML::Exception("profiler maxDepth must be between 1 and %d",
+                            (int)MAX_DEPTH);
+    if (newConfig.maxSamples < 1
+        || newConfig.maxSamples > MAX_FRAMES / newConfig.maxDepth)
+        throw ML::Exception("profiler maxSamples must be between 1 and %zd",
+                            MAX_FRAMES / newConfig.maxDepth);
+    if (!(newConfig.maxOverhead > 0 && newConfig.maxOverhead <= 1))
+        throw ML::Exception("profiler maxOverhead must be in (0, 1]");
+
+    Guard guard(lock);
+
+    if (armed)
+        throw ML::Exception("the profiler is already running");
+
+    if (running_) {
+        // Stopped itself from the signal handler, which can't restore the
+        // previous handler
+        sigaction(SIGPROF, &oldAction, nullptr);
+        running_ = false;
+    }
+
+    while (inHandler.load())
+        std::this_thread::yield();
+
+    // The first call of backtrace() loads libgcc, which is not something
+    // to do from a signal handler
+    void * dummy[1];
+    ::backtrace(dummy, 1);
+
+    config = newConfig;
+    frames.reset(new void * [config.maxSamples * config.maxDepth]);
+    depths.reset(new std::atomic<int>[config.maxSamples]);
+    for (size_t i = 0;  i < config.maxSamples;  ++i)
+        depths[i] = 0;
+    nextSample = 0;
+    handlerNs = 0;
+    stopReason = nullptr;
+    startNs = monotonicNs();
+    endNs = 0;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &SamplingProfiler::onSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &oldAction) == -1)
+        throw ML::Exception(errno, "sigaction");
+
+    armed = true;
+    running_ = true;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / config.frequency;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) == -1) {
+        int error = errno;
+        armed = false;
+        running_ = false;
+        sigaction(SIGPROF, &oldAction, nullptr);
+        throw ML::Exception(error, "setitimer");
+    }
+}
+
+void
+SamplingProfiler::
+stop()
+{
+    Guard guard(lock);
+
+    if (!running_)
+        return;
+
+    disarm("stopped");
+    sigaction(SIGPROF, &oldAction, nullptr);
+    running_ = false;
+}
+
+bool
+SamplingProfiler::
+running() const
+{
+    return armed;
+}
+
+void
+SamplingProfiler::
+disarm(const char * reason)
+{
+    if (!armed.exchange(false))
+        return;
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    endNs = monotonicNs();
+    stopReason = reason;
+}
+
+void
+SamplingProfiler::
+onSignal(int signum, siginfo_t * info, void * context)
+{
+    int savedErrno = errno;
+    ++inHandler;
+
+    samplePc = interruptedPc(context);
+    instance().takeSample();
+
+    --inHandler;
+    errno = savedErrno;
+}
+
+void
+SamplingProfiler::
+takeSample()
+{
+    if (!armed.load(std::memory_order_relaxed))
+        return;
+
+    uint64_t before = monotonicNs();
+
+    size_t sample = nextSample.fetch_add(1);
+    if (sample >= config.maxSamples) {
+        disarm("maxSamples");
+        return;
+    }
+
+    void ** out = &frames[sample * config.maxDepth];
+    int depth = ::backtrace(out, config.maxDepth);
+
+    // Drop the frames of the signal handler, which are the ones before
+    // the interrupted instruction
+    int skip = 0;
+    for (int i = 0;  i < depth;  ++i) {
+        if (out[i] == samplePc) {
+            skip = i;
+            break;
+        }
+    }
+    for (int i = skip;  i < depth;  ++i)
+        out[i - skip] = out[i];
+    depth -= skip;
+
+    depths[sample].store(depth > 0 ? depth : -1, std::memory_order_release);
+
+    uint64_t after = monotonicNs();
+    uint64_t used = handlerNs.fetch_add(after - before) + (after - before);
+    uint64_t elapsed = after - startNs;
+
+    if (sample + 1 == config.maxSamples)
+        disarm("maxSamples");
+    else if (elapsed > config.maxSeconds * 1000000000.0)
+        disarm("maxSeconds");
+    else if (elapsed > 1000000000ULL && used > config.maxOverhead * elapsed)
+        disarm("maxOverhead");
+}
+
+std::string
+SamplingProfiler::
+folded() const
+{
+    Guard guard(lock);
+
+    if (!depths)
+        return "";
+
+    unordered_map<const void *, string> names;
+
+    // Name of the function containing the given address.  All frames but
+    // the innermost are return addresses, which can be just past the end
+    // of the function that made the call, so they are looked up one byte
+    // earlier.
+    auto getName = [&] (const void * address, bool returnAddress)
+        -> const string &
+        {
+            auto it = names.find(address);
+            if (it != names.end())
+                return it->second;
+
+            const char * lookup = (const char *)address - returnAddress;
+            ML::BacktraceFrame frame(0, lookup);
+
+            string name;
+            if (!frame.function.empty())
+                name = frame.function;
+            else if (!frame.object.empty()) {
+                string object = frame.object;
+                auto slash = object.rfind('/');
+                if (slash != string::npos)
+                    object = string(object, slash + 1);
+                name = ML::format("%s+0x%zx", object.c_str(),
+                                  (size_t)(lookup
+                                           - (const char *)frame.object_start));
+            }
+            else name = ML::format("%p", address);
+
+            // Semicolons separate the frames
+            for (char & c : name)
+                if (c == ';')
+                    c = ':';
+
+            return names[address] = name;
+        };
+
+    map<string, uint64_t> stacks;
+    size_t numSamples = std::min(nextSample.load(), config.maxSamples);
+    for (size_t sample = 0;  sample < numSamples;  ++sample) {
+        int depth = depths[sample].load(std::memory_order_acquire);
+        if (depth <= 0)
+            continue;
+
+        void * const * stack = &frames[sample * config.maxDepth];
+        string key;
+        for (int i = depth - 1;  i >= 0;  --i) {
+            if (!key.empty())
+                key += ';';
+            key += getName(stack[i], i != 0);
+        }
+        stacks[key] += 1;
+    }
+
+    string result;
+    for (const auto & entry : stacks)
+        result += entry.first + " " + to_string(entry.second) + "\n";
+    return result;
+}
+
+Json::Value
+SamplingProfiler::
+getStatus() const
+{
+    Guard guard(lock);
+
+    Json::Value result;
+    result["running"] = armed.load();
+    result["config"] = config.toJson();
+
+    if (depths) {
+        uint64_t now = armed ? monotonicNs() : endNs;
+        double seconds = (now - startNs) / 1000000000.0;
+        result["seconds"] = seconds;
+        result["samples"] = std::min(nextSample.load(), config.maxSamples);
+        result["overhead"] = seconds > 0
+            ? handlerNs / 1000000000.0 / seconds : 0.0;
+        if (stopReason)
+            result["stopReason"] = stopReason.load();
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* REST ROUTES                                                               */
+/*****************************************************************************/
+
+void addProfilerRoutes(RestRequestRouter & router)
+{
+    typedef RestRequestRouter::MatchResult MatchResult;
+    typedef RestServiceEndpoint::ConnectionId ConnectionId;
+
+    router.addRoute("/profiler", "GET", "Status of the sampling profiler",
+                    [] (const ConnectionId & connection,
+                        const RestRequest & request,
+                        const RestRequestParsingContext & context)
+                    {
+                        connection.sendResponse
+                            (200, SamplingProfiler::instance().getStatus());
+                        return RestRequestRouter::MR_YES;
+                    },
+                    Json::Value());
+
+    Json::Value startHelp;
+    startHelp["body"] = SamplingProfiler::Config().toJson();
+
+    router.addRoute("/profiler/start", "POST",
+                    "Start the sampling profiler",
+                    [] (const ConnectionId & connection,
+                        const RestRequest & request,
+                        const RestRequestParsingContext & context)
+                    -> MatchResult
+                    {
+                        SamplingProfiler::Config config;
+                        if (!request.payload.empty())
+                            config = SamplingProfiler::Config::fromJson
+                                (Json::parse(request.payload));
+
+                        auto & profiler = SamplingProfiler::instance();
+                        profiler.start(config);
+                        connection.sendResponse(200, profiler.getStatus());
+                        return RestRequestRouter::MR_YES;
+                    },
+                    startHelp);
+
+    router.addRoute("/profiler/stop", "POST",
+                    "Stop the sampling profiler",
+                    [] (const ConnectionId & connection,
+                        const RestRequest & request,
+                        const RestRequestParsingContext & context)
+                    {
+                        auto & profiler = SamplingProfiler::instance();
+                        profiler.stop();
+                        connection.sendResponse(200, profiler.getStatus());
+                        return RestRequestRouter::MR_YES;
+                    },
+                    Json::Value());
+
+    router.addRoute("/profiler/folded", "GET",
+                    "Samples of the profiler as folded stacks for "
+                    "flamegraph.pl",
+                    [] (const ConnectionId & connection,
+                        const RestRequest & request,
+                        const RestRequestParsingContext & context)
+                    {
+                        connection.sendResponse
+                            (200, SamplingProfiler::instance().folded(),
+                             "text/plain");
+                        return RestRequestRouter::MR_YES;
+                    },
+                    Json::Value());
+}
+
+} // namespace Datacratic
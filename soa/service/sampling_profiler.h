@@ -0,0 +1,125 @@
+/* sampling_profiler.h                                             -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Sampling CPU profiler that can be started and stopped while a service is
+   running.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/value.h"
+
+#include <signal.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+namespace Datacratic {
+
+struct RestRequestRouter;
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER                                                         */
+/*****************************************************************************/
+
+/** Profiler that records the stack of the running thread a given number of
+    times per second of CPU time used by the process, from a SIGPROF
+    handler.  The samples are symbolized in-process and returned as folded
+    stacks, which is the input of flamegraph.pl.
+
+    As SIGPROF goes to the whole process there is a single profiler, and a
+    single profile can be taken at a time.  It stops by itself once it has
+    run for maxSeconds, has taken maxSamples samples, or its handler has used
+    more than maxOverhead of the time since it started, so that it can be
+    left running on a production service without harm.
+*/
+struct SamplingProfiler {
+
+    enum {
+        MAX_FREQUENCY = 1000,   ///< Upper limit on samples per CPU second
+        MAX_DEPTH = 128         ///< Upper limit on frames per sample
+    };
+
+    struct Config {
+        Config()
+            : frequency(99), maxSeconds(30), maxSamples(100000),
+              maxDepth(64), maxOverhead(0.02)
+        {
+        }
+
+        double frequency;       ///< Samples per second of CPU time
+        double maxSeconds;      ///< Wall time after which it stops
+        size_t maxSamples;      ///< Number of samples after which it stops
+        int maxDepth;           ///< Frames kept in each sample
+        double maxOverhead;     ///< Fraction of the wall time it can use
+
+        /** Read the fields that are present and check the values. */
+        static Config fromJson(const Json::Value & json);
+        Json::Value toJson() const;
+    };
+
+    static SamplingProfiler & instance();
+
+    /** Start taking samples.  Throws if it's already running. */
+    void start(const Config & config = Config());
+
+    /** Stop taking samples.  The samples are kept until the next start. */
+    void stop();
+
+    bool running() const;
+
+    /** The samples taken so far as one line per distinct stack, with the
+        frames from the outermost to the innermost separated by semicolons
+        and followed by the number of samples.
+    */
+    std::string folded() const;
+
+    /** Configuration, state, number of samples and overhead. */
+    Json::Value getStatus() const;
+
+private:
+    SamplingProfiler();
+
+    static void onSignal(int signum, siginfo_t * info, void * context);
+    void takeSample();
+
+    /** Stop the timer from the signal handler.  Async signal safe. */
+    void disarm(const char * reason);
+
+    typedef std::mutex Lock;
+    typedef std::unique_lock<Lock> Guard;
+    mutable Lock lock;
+
+    Config config;
+    struct sigaction oldAction;
+
+    /// maxSamples * maxDepth frames, written by the signal handler
+    std::unique_ptr<void * []> frames;
+
+    /// Depth of each sample, set once its frames are written; 0 if not
+    std::unique_ptr<std::atomic<int> []> depths;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> armed;
+    std::atomic<size_t> nextSample;
+    std::atomic<uint64_t> handlerNs;
+    std::atomic<const char *> stopReason;
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+
+/** Add the routes that control the profiler to the given router:
+
+    GET  /profiler          status of the profiler
+    POST /profiler/start    start it, with an optional Config as JSON body
+    POST /profiler/stop     stop it
+    GET  /profiler/folded   the samples as folded stacks, in plain text
+*/
+void addProfilerRoutes(RestRequestRouter & router);
+
+} // namespace Datacratic
@@ -3,7 +3,8 @@
 
 
 LIBOPSTATS_SOURCES := \
-	statsd_connector.cc carbon_connector.cc stat_aggregator.cc process_stats.cc
+	statsd_connector.cc carbon_connector.cc stat_aggregator.cc process_stats.cc \
+	quantile_sketch.cc
 
 LIBOPSTATS_LINK := \
 	ACE arch utils boost_thread types
@@ -46,11 +47,17 @@ LIBSERVICES_SOURCES := \
 	port_range_service.cc \
 	service_base.cc \
 	message_loop.cc \
+	event_scheduler.cc \
+	timer_wheel.cc \
+	uring.cc \
+	zmq_compression.cc \
+	sampling_profiler.cc \
 	loop_monitor.cc \
 	named_endpoint.cc \
 	zookeeper_configuration_service.cc \
 	zmq_endpoint.cc \
 	async_event_source.cc \
+	shm_message_ring.cc \
 	async_writer_source.cc \
 	tcp_client.cc \
 	rest_service_endpoint.cc \
@@ -76,7 +83,7 @@ LIBSERVICES_SOURCES := \
 	event_subscriber.cc \
 	nsq_client.cc 
 
-LIBSERVICES_LINK := opstats curl boost_regex runner_common zeromq zookeeper_mt ACE arch utils jsoncpp boost_thread zmq types tinyxml2 boost_system value_description crypto
+LIBSERVICES_LINK := opstats gc curl boost_regex runner_common zeromq zookeeper_mt ACE arch utils jsoncpp boost_thread zmq types tinyxml2 boost_system value_description crypto
 
 $(eval $(call library,services,$(LIBSERVICES_SOURCES),$(LIBSERVICES_LINK)))
 $(eval $(call set_compile_option,runner.cc,-DBIN=\"$(BIN)\"))
@@ -120,6 +127,7 @@ $(eval $(call program,s3tee,cloud boost_program_options utils))
 $(eval $(call program,s3cp,cloud boost_program_options utils))
 $(eval $(call program,s3_multipart_cmd,cloud boost_program_options utils))
 $(eval $(call program,syslog_trace,services))
+$(eval $(call program,zmq_compression_dict,services boost_program_options utils))
 $(eval $(call program,s3cat,cloud boost_program_options utils))
 $(eval $(call program,sns_send,cloud boost_program_options utils))
 
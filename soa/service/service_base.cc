@@ -60,6 +60,20 @@ get(std::ostream & output) const {
     return result;
 }
 
+StatHandle
+EventService::
+getHandle(const std::string & name,
+          const char * event,
+          StatEventType type,
+          std::initializer_list<int>)
+{
+    std::string eventName = event;
+    return StatHandle([=] (float value)
+                      {
+                          this->onEvent(name, eventName.c_str(), type, value);
+                      });
+}
+
 /*****************************************************************************/
 /* NULL EVENT SERVICE                                                        */
 /*****************************************************************************/
@@ -86,6 +100,16 @@ onEvent(const std::string & name,
     stats->record(name + "." + event, type, value);
 }
 
+StatHandle
+NullEventService::
+getHandle(const std::string & name,
+          const char * event,
+          StatEventType type,
+          std::initializer_list<int> extra)
+{
+    return stats->getHandle(name + "." + event, type, extra);
+}
+
 void
 NullEventService::
 dump(std::ostream & stream) const
@@ -142,6 +166,17 @@ onEvent(const std::string & name,
     connector->record(stat, type, value, extra);
 }
 
+StatHandle
+CarbonEventService::
+getHandle(const std::string & name,
+          const char * event,
+          StatEventType type,
+          std::initializer_list<int> extra)
+{
+    std::string stat = name.empty() ? event : name + "." + event;
+    return connector->getHandle(stat, type, extra);
+}
+
 
 /*****************************************************************************/
 /* CONFIGURATION SERVICE                                                     */
@@ -711,6 +746,41 @@ recordEventFmt(StatEventType type,
     }
 }
 
+StatHandle
+EventRecorder::
+getStatHandle(StatEventType type,
+              const std::string & event,
+              std::initializer_list<int> extra) const
+{
+    EventService * es = events_.get();
+    if (!es && services_)
+        es = services_->events.get();
+    if (!es)
+        return StatHandle();
+
+    return es->getHandle(eventPrefix_, event.c_str(), type, extra);
+}
+
+StatHandle
+EventRecorder::
+getStatHandleFmt(StatEventType type, const char * fmt, ...) const
+{
+    std::string event;
+
+    va_list ap;
+    va_start(ap, fmt);
+    try {
+        event = ML::vformat(fmt, ap);
+    }
+    catch (...) {
+        va_end(ap);
+        throw;
+    }
+    va_end(ap);
+
+    return getStatHandle(type, event);
+}
+
 /*****************************************************************************/
 /* SERVICE BASE                                                              */
 /*****************************************************************************/
@@ -9,6 +9,7 @@
 
 #include "port_range_service.h"
 #include "soa/service/stats_events.h"
+#include "soa/service/stat_aggregator.h"
 #include "stdarg.h"
 #include "jml/compiler/compiler.h"
 #include <string>
@@ -52,6 +53,15 @@ struct EventService {
                          float value,
                          std::initializer_list<int> extra = DefaultOutcomePercentiles) = 0;
 
+    /** Resolve the stat for the event once into a handle that can record
+        it without building its name.  The default records through
+        onEvent(), with the default percentiles for outcomes.
+    */
+    virtual StatHandle getHandle(const std::string & name,
+                                 const char * event,
+                                 StatEventType type,
+                                 std::initializer_list<int> extra = DefaultOutcomePercentiles);
+
     virtual void dump(std::ostream & stream) const
     {
     }
@@ -76,6 +86,11 @@ struct NullEventService : public EventService {
                          float value,
                          std::initializer_list<int> extra = DefaultOutcomePercentiles);
 
+    virtual StatHandle getHandle(const std::string & name,
+                                 const char * event,
+                                 StatEventType type,
+                                 std::initializer_list<int> extra = DefaultOutcomePercentiles);
+
     virtual void dump(std::ostream & stream) const;
 
     std::unique_ptr<MultiAggregator> stats;
@@ -102,6 +117,11 @@ struct CarbonEventService : public EventService {
                          float value,
                          std::initializer_list<int> extra = std::initializer_list<int>());
 
+    virtual StatHandle getHandle(const std::string & name,
+                                 const char * event,
+                                 StatEventType type,
+                                 std::initializer_list<int> extra = DefaultOutcomePercentiles);
+
     std::shared_ptr<CarbonConnector> connector;
 };
 
@@ -493,6 +513,24 @@ struct EventRecorder {
                         std::initializer_list<int> extra,
                         const char * fmt, ...) const JML_FORMAT_STRING(5, 6);
 
+    /** Resolve an event once into a handle for code that records it often,
+        eg per bid.  Recording into the handle is the same as recordEvent()
+        with the given type and event name, without the name being built and
+        looked up each time.  Returns a handle that records nothing if there
+        is no event service.
+    */
+    StatHandle getStatHandle(StatEventType type,
+                             const std::string & event,
+                             std::initializer_list<int> extra
+                                 = DefaultOutcomePercentiles) const;
+
+    /** Same as getStatHandle() with the event name formatted printf style,
+        eg getStatHandleFmt(ET_HIT, "accounts.%s.bids", account.c_str()).
+    */
+    StatHandle getStatHandleFmt(StatEventType type,
+                                const char * fmt, ...) const
+        JML_FORMAT_STRING(3, 4);
+
     template<typename... Args>
     void recordHit(const std::string & event, Args... args) const
     {
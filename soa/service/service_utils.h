@@ -9,6 +9,7 @@
 #pragma once
 
 #include "service_base.h"
+#include "zmq_compression.h"
 
 #include <boost/program_options/options_description.hpp>
 #include <vector>
@@ -153,7 +154,14 @@ struct ServiceProxyArguments
             ("location,L", value(&location),
              "Name of the current location")
             ("preload,P", value(&preload),
-             "Comma separated list of libraries to preload and/or json files");
+             "Comma separated list of libraries to preload and/or json files")
+            ("zmq-compression", bool_switch(&zmqCompression),
+             "negotiate LZ4 compression on the zmq client bus links")
+            ("zmq-compression-dictionary", value(&zmqCompressionDictionary),
+             "dictionary for --zmq-compression, trained on sample messages")
+            ("zmq-compression-threshold",
+             value(&zmqCompressionThreshold)->default_value(256),
+             "zmq frames smaller than this many bytes are sent raw");
 
         if (opt == WITH_ZOOKEEPER) {
             options.add_options()
@@ -174,6 +182,15 @@ struct ServiceProxyArguments
     {
         preloadDynamicLibs();
 
+        if (zmqCompression || !zmqCompressionDictionary.empty()) {
+            ZmqCompression::setDefault(
+                    zmqCompressionDictionary.empty()
+                    ? std::make_shared<ZmqCompression>(
+                            "", zmqCompressionThreshold)
+                    : ZmqCompression::load(
+                            zmqCompressionDictionary, zmqCompressionThreshold));
+        }
+
         auto services = std::make_shared<ServiceProxies>();
 
         if (!bootstrap.empty())
@@ -207,6 +224,9 @@ struct ServiceProxyArguments
     std::string installation;
     std::string location;
     std::string preload;
+    bool zmqCompression = false;
+    std::string zmqCompressionDictionary;
+    size_t zmqCompressionThreshold = 256;
 
 private:
 
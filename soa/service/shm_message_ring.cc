@@ -0,0 +1,380 @@
+/* shm_message_ring.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Ring of multi-part messages in shared memory.
+*/
+
+#include "shm_message_ring.h"
+#include "jml/arch/exception.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+namespace {
+
+const uint64_t Magic = 0x52494e474d534731ULL; // RINGMSG1
+const uint32_t WrapMarker = uint32_t(-1);
+
+size_t align8(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+std::string fifoPath(const std::string & path)
+{
+    return path + ".fifo";
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SHM MESSAGE RING                                                          */
+/*****************************************************************************/
+
+/** Lives at the start of the mapping.  The positions are byte offsets that
+    only ever grow; they're taken modulo the capacity to index the data.
+
+    Each message is a 32 bit size followed by that many bytes: the number of
+    frames and then the size and bytes of each frame.  Messages are padded to
+    8 bytes.  A message that doesn't fit before the end of the data is
+    preceded by WrapMarker and written at its start instead.
+*/
+struct ShmMessageRing::Header {
+    uint64_t magic;
+    uint64_t capacity;
+    std::atomic<int> consumerOpen;
+
+    alignas(64) std::atomic<uint64_t> writePos;
+    alignas(64) std::atomic<uint64_t> readPos;
+    alignas(64) std::atomic<int> consumerWaiting;
+};
+
+ShmMessageRing::
+ShmMessageRing()
+    : consumer(false), header(nullptr), data(nullptr), mappedSize(0),
+      fifoFd(-1), fifoWriteFd(-1)
+{
+}
+
+ShmMessageRing::
+~ShmMessageRing()
+{
+    close();
+}
+
+void
+ShmMessageRing::
+map(int fd, bool create, size_t capacity)
+{
+    size_t headerSize = align8(sizeof(Header));
+
+    if (create) {
+        mappedSize = headerSize + capacity;
+        if (ftruncate(fd, mappedSize) == -1)
+            throw ML::Exception(errno, "ftruncate");
+    }
+    else {
+        struct stat st;
+        if (fstat(fd, &st) == -1)
+            throw ML::Exception(errno, "fstat");
+        mappedSize = st.st_size;
+        if (mappedSize < headerSize)
+            throw ML::Exception("shm ring %s is too small", path_.c_str());
+    }
+
+    void * addr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        throw ML::Exception(errno, "mmap");
+
+    header = reinterpret_cast<Header *>(addr);
+    data = reinterpret_cast<char *>(addr) + headerSize;
+
+    if (create) {
+        new (header) Header();
+        header->magic = Magic;
+        header->capacity = capacity;
+        header->writePos = 0;
+        header->readPos = 0;
+        header->consumerWaiting = 1;
+        header->consumerOpen = 1;
+    }
+    else if (header->magic != Magic
+             || header->capacity + headerSize != mappedSize) {
+        throw ML::Exception("%s is not a shm ring", path_.c_str());
+    }
+}
+
+void
+ShmMessageRing::
+create(const std::string & path, size_t capacity)
+{
+    ExcCheck(!isOpen(), "shm ring is already open");
+    ExcCheckGreaterEqual(capacity, 4096, "shm ring capacity is too small");
+
+    path_ = path;
+    consumer = true;
+
+    ::unlink(path.c_str());
+    ::unlink(fifoPath(path).c_str());
+
+    if (mkfifo(fifoPath(path).c_str(), 0600) == -1)
+        throw ML::Exception(errno, "mkfifo");
+
+    // Keeping a writer of our own means that the fifo never hangs up when
+    // the producer goes away.
+    fifoFd = ::open(fifoPath(path).c_str(), O_RDONLY | O_NONBLOCK);
+    if (fifoFd == -1)
+        throw ML::Exception(errno, "open fifo");
+    fifoWriteFd = ::open(fifoPath(path).c_str(), O_WRONLY | O_NONBLOCK);
+    if (fifoWriteFd == -1)
+        throw ML::Exception(errno, "open fifo");
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+        throw ML::Exception(errno, "open " + path);
+
+    try {
+        map(fd, true, align8(capacity));
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+bool
+ShmMessageRing::
+open(const std::string & path)
+{
+    ExcCheck(!isOpen(), "shm ring is already open");
+
+    path_ = path;
+    consumer = false;
+
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd == -1) {
+        if (errno == ENOENT) return false;
+        throw ML::Exception(errno, "open " + path);
+    }
+
+    try {
+        map(fd, false, 0);
+    } catch (...) {
+        ::close(fd);
+        close();
+        throw;
+    }
+    ::close(fd);
+
+    fifoFd = ::open(fifoPath(path).c_str(), O_WRONLY | O_NONBLOCK);
+    if (fifoFd == -1 || !header->consumerOpen) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void
+ShmMessageRing::
+close()
+{
+    if (header) {
+        if (consumer) {
+            header->consumerOpen = 0;
+            ::unlink(path_.c_str());
+            ::unlink(fifoPath(path_).c_str());
+        }
+        munmap(header, mappedSize);
+    }
+
+    if (fifoFd != -1) ::close(fifoFd);
+    if (fifoWriteFd != -1) ::close(fifoWriteFd);
+
+    header = nullptr;
+    data = nullptr;
+    mappedSize = 0;
+    fifoFd = fifoWriteFd = -1;
+}
+
+bool
+ShmMessageRing::
+isConnected() const
+{
+    return header && header->consumerOpen.load(std::memory_order_relaxed);
+}
+
+bool
+ShmMessageRing::
+tryPush(const Frame * frames, size_t numFrames)
+{
+    ExcAssert(isOpen() && !consumer);
+
+    if (!header->consumerOpen.load(std::memory_order_relaxed))
+        return false;
+
+    size_t body = 4;
+    for (size_t i = 0;  i < numFrames;  ++i)
+        body += 4 + frames[i].size;
+    size_t total = align8(4 + body);
+
+    uint64_t capacity = header->capacity;
+    if (total > capacity) return false;
+
+    uint64_t writePos = header->writePos.load(std::memory_order_relaxed);
+    uint64_t readPos = header->readPos.load(std::memory_order_acquire);
+
+    size_t offset = writePos % capacity;
+    size_t toEnd = capacity - offset;
+    size_t needed = total > toEnd ? total + toEnd : total;
+    if (writePos + needed - readPos > capacity)
+        return false;
+
+    if (total > toEnd) {
+        *reinterpret_cast<uint32_t *>(data + offset) = WrapMarker;
+        writePos += toEnd;
+        offset = 0;
+    }
+
+    char * p = data + offset;
+    auto write32 = [&] (uint32_t val)
+        {
+            std::memcpy(p, &val, 4);
+            p += 4;
+        };
+
+    write32(body);
+    write32(numFrames);
+    for (size_t i = 0;  i < numFrames;  ++i) {
+        write32(frames[i].size);
+        std::memcpy(p, frames[i].data, frames[i].size);
+        p += frames[i].size;
+    }
+
+    header->writePos.store(writePos + total);
+
+    if (header->consumerWaiting.load() && header->consumerWaiting.exchange(0)) {
+        // A full fifo already has a wakeup pending, so errors don't matter
+        char c = 0;
+        ssize_t res = ::write(fifoFd, &c, 1);
+        (void) res;
+    }
+
+    return true;
+}
+
+bool
+ShmMessageRing::
+tryPush(const std::vector<std::string> & message)
+{
+    Frame frames[message.size()];
+    for (size_t i = 0;  i < message.size();  ++i)
+        frames[i] = { message[i].data(), message[i].size() };
+    return tryPush(frames, message.size());
+}
+
+bool
+ShmMessageRing::
+couldPop() const
+{
+    // Sequentially consistent so that prepareWait can't miss a push
+    return header
+        && header->readPos.load(std::memory_order_relaxed)
+            != header->writePos.load();
+}
+
+bool
+ShmMessageRing::
+tryPop(std::vector<std::string> & message)
+{
+    ExcAssert(isOpen() && consumer);
+
+    uint64_t readPos = header->readPos.load(std::memory_order_relaxed);
+    uint64_t writePos = header->writePos.load(std::memory_order_acquire);
+    if (readPos == writePos) return false;
+
+    uint64_t capacity = header->capacity;
+    size_t offset = readPos % capacity;
+
+    uint32_t body;
+    std::memcpy(&body, data + offset, 4);
+    if (body == WrapMarker) {
+        readPos += capacity - offset;
+        offset = 0;
+        std::memcpy(&body, data, 4);
+    }
+
+    const char * p = data + offset + 4;
+    auto read32 = [&] ()
+        {
+            uint32_t val;
+            std::memcpy(&val, p, 4);
+            p += 4;
+            return val;
+        };
+
+    uint32_t numFrames = read32();
+    message.resize(numFrames);
+    for (uint32_t i = 0;  i < numFrames;  ++i) {
+        uint32_t size = read32();
+        message[i].assign(p, size);
+        p += size;
+    }
+
+    header->readPos.store(readPos + align8(4 + body),
+                          std::memory_order_release);
+    return true;
+}
+
+bool
+ShmMessageRing::
+prepareWait()
+{
+    ExcAssert(isOpen() && consumer);
+
+    char buf[64];
+    while (::read(fifoFd, buf, sizeof(buf)) > 0)
+        ;
+
+    header->consumerWaiting.store(1);
+    return !couldPop();
+}
+
+
+/*****************************************************************************/
+/* SHM MESSAGE SOURCE                                                        */
+/*****************************************************************************/
+
+ShmMessageSource::
+ShmMessageSource(const std::string & path, size_t capacity,
+                 OnMessage onMessage)
+    : onMessage(std::move(onMessage))
+{
+    ring.create(path, capacity);
+}
+
+bool
+ShmMessageSource::
+processOne()
+{
+    std::vector<std::string> message;
+    if (ring.tryPop(message)) {
+        if (onMessage) onMessage(std::move(message));
+        if (ring.couldPop()) return true;
+    }
+
+    return !ring.prepareWait();
+}
+
+} // namespace Datacratic
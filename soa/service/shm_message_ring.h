@@ -0,0 +1,201 @@
+/* shm_message_ring.h                                              -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Ring of multi-part messages in shared memory, for a single producer and a
+   single consumer living in two processes of the same host.
+*/
+
+#pragma once
+
+#include "soa/service/async_event_source.h"
+#include "soa/service/zmq_utils.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SHM MESSAGE RING                                                          */
+/*****************************************************************************/
+
+/** Single producer, single consumer ring of messages made of several frames,
+    mapped from a file (normally under /dev/shm) so that the producer writes
+    each frame straight into memory the consumer reads from.
+
+    The consumer creates the ring and the producer opens it by path, which
+    fails when the consumer isn't on the same host.  The consumer waits on
+    selectFd(), a fifo next to the ring which the producer only writes to
+    when the consumer said it was going to sleep (see prepareWait()).
+
+    Neither side ever blocks: tryPush fails when the ring is full or the
+    consumer is gone, and the producer is expected to fall back to another
+    transport.
+*/
+
+struct ShmMessageRing {
+
+    ShmMessageRing();
+    ~ShmMessageRing();
+
+    ShmMessageRing(const ShmMessageRing &) = delete;
+    void operator = (const ShmMessageRing &) = delete;
+
+    /** Create the ring at the given path, replacing any existing one, and
+        open it as its consumer.  The capacity is in bytes.
+    */
+    void create(const std::string & path, size_t capacity);
+
+    /** Open the ring at the given path as its producer.  Returns false if
+        there is no such ring, which normally means that the consumer isn't
+        on this host.
+    */
+    bool open(const std::string & path);
+
+    /** Unmap the ring.  The consumer also removes its files, after which
+        pushes from the producer fail.
+    */
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+    const std::string & path() const { return path_; }
+
+    /** Whether the consumer still has the ring open. */
+    bool isConnected() const;
+
+    /** Pointer and length of one of the frames of a message. */
+    struct Frame {
+        const char * data;
+        size_t size;
+    };
+
+    /** Frames of a message, which either point to existing buffers or to
+        encoded copies of the arguments (see encodeFrame()) held here.
+    */
+    struct Frames {
+        void add(const std::string & str)
+        {
+            frames.push_back({ str.data(), str.size() });
+        }
+
+        void add(const zmq::message_t & msg)
+        {
+            auto & m = const_cast<zmq::message_t &>(msg);
+            frames.push_back({ (const char *)m.data(), m.size() });
+        }
+
+        void add(const std::vector<std::string> & strs)
+        {
+            for (auto & str : strs) add(str);
+        }
+
+        template<typename T>
+        void add(const T & value)
+        {
+            zmq::message_t msg = encodeFrame(value);
+            owned.emplace_back((const char *)msg.data(), msg.size());
+            add(owned.back());
+        }
+
+        template<typename T, typename... Args>
+        void add(const T & value, const Args &... args)
+        {
+            add(value);
+            add(args...);
+        }
+
+        std::vector<Frame> frames;
+        std::deque<std::string> owned;
+    };
+
+    /** Producer: append a message to the ring.  Returns false if it didn't
+        fit or if the consumer closed the ring.
+    */
+    bool tryPush(const Frame * frames, size_t numFrames);
+
+    bool tryPush(const Frames & frames)
+    {
+        return tryPush(frames.frames.data(), frames.frames.size());
+    }
+
+    bool tryPush(const std::vector<std::string> & message);
+
+    template<typename... Args>
+    bool tryPushMessage(const Args &... args)
+    {
+        Frames frames;
+        frames.add(args...);
+        return tryPush(frames);
+    }
+
+    /** Consumer: pop the oldest message into message.  Returns false if the
+        ring is empty.
+    */
+    bool tryPop(std::vector<std::string> & message);
+
+    /** Consumer: whether there is a message to pop. */
+    bool couldPop() const;
+
+    /** Consumer: file descriptor that becomes readable when the producer
+        pushes after prepareWait().
+    */
+    int selectFd() const { return fifoFd; }
+
+    /** Consumer: tell the producer to signal selectFd() on its next push
+        and clear previous signals.  Returns false if there are already
+        messages to pop, in which case the caller shouldn't wait.
+    */
+    bool prepareWait();
+
+private:
+    struct Header;
+
+    void map(int fd, bool create, size_t capacity);
+
+    std::string path_;
+    bool consumer;
+    Header * header;
+    char * data;
+    size_t mappedSize;
+    int fifoFd;
+    int fifoWriteFd;
+};
+
+
+/*****************************************************************************/
+/* SHM MESSAGE SOURCE                                                        */
+/*****************************************************************************/
+
+/** Consumer side of a ShmMessageRing, which hands the messages to onMessage
+    from within a MessageLoop.
+*/
+
+struct ShmMessageSource : public AsyncEventSource {
+
+    typedef std::function<void (std::vector<std::string> && message)>
+        OnMessage;
+
+    ShmMessageSource(const std::string & path, size_t capacity,
+                     OnMessage onMessage = OnMessage());
+
+    ShmMessageRing ring;
+    OnMessage onMessage;
+
+    virtual int selectFd() const
+    {
+        return ring.selectFd();
+    }
+
+    virtual bool poll() const
+    {
+        return ring.couldPop();
+    }
+
+    virtual bool processOne();
+};
+
+} // namespace Datacratic
@@ -307,12 +307,14 @@ sendMessage(const std::string & queueUri,
                        "SendMessageResponse/SendMessageResult/MD5OfMessageBody");
 }
 
-void
+vector<SqsApi::BatchResultError>
 SqsApi::
 sendMessageBatch(const string & queueUri,
                  const vector<string> & messages,
                  int delaySeconds)
 {
+    ExcAssertLessEqual(messages.size(), 10u);
+
     RestParams queryParams;
     queryParams.push_back({"Action", "SendMessageBatch"});
     queryParams.push_back({"Version", "2012-11-05"});
@@ -329,7 +331,25 @@ sendMessageBatch(const string & queueUri,
         counter++;
     }
 
-    performPost(std::move(queryParams), getQueueResource(queueUri));
+    auto xml = performPost(std::move(queryParams),
+                           getQueueResource(queueUri));
+
+    vector<BatchResultError> errors;
+
+    auto result = extractNode(xml->RootElement(), "SendMessageBatchResult");
+    auto entry = result->FirstChildElement("BatchResultErrorEntry");
+    while (entry) {
+        BatchResultError error;
+        string id = extract<string>(entry, "Id");
+        error.index = stoi(id.substr(3)) - 1;
+        error.code = extract<string>(entry, "Code");
+        error.message = extractDef<string>(entry, "Message", "");
+        error.senderFault = extract<string>(entry, "SenderFault") == "true";
+        errors.emplace_back(std::move(error));
+        entry = entry->NextSiblingElement("BatchResultErrorEntry");
+    }
+
+    return errors;
 }
 
 SqsApi::Message
@@ -585,4 +605,176 @@ SqsSnsMessageBodyDescription()
              "URI to unsubscrive from topic");
 }
 
+
+
+/*****************************************************************************/
+/* SQS PRODUCER                                                              */
+/*****************************************************************************/
+
+namespace {
+
+const size_t MaxBatchMessages = 10;
+const size_t MaxBatchBytes = 256 * 1024;
+
+} // file scope
+
+SqsProducer::
+SqsProducer(SqsApi & api, const std::string & queueUri,
+            int numThreads, size_t maxQueued, int maxAttempts,
+            const OnError & onError)
+    : api(api), queueUri(queueUri),
+      maxQueued(maxQueued), maxAttempts(maxAttempts), onError(onError),
+      numInFlight(0), shutdown(false), numSent_(0), numFailed_(0)
+{
+    ExcAssertGreater(numThreads, 0);
+    ExcAssertGreater(maxAttempts, 0);
+
+    for (int i = 0;  i < numThreads;  ++i)
+        threads.emplace_back(&SqsProducer::runWorkerThread, this);
+}
+
+SqsProducer::
+~SqsProducer()
+{
+    flush();
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        shutdown = true;
+    }
+    cond.notify_all();
+
+    for (auto & thread: threads)
+        thread.join();
+}
+
+bool
+SqsProducer::
+send(std::string message)
+{
+    if (message.size() > MaxBatchBytes)
+        throw ML::Exception("SQS message of %zd bytes is too large",
+                            message.size());
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (queue.size() >= maxQueued)
+            return false;
+        queue.push_back({ std::move(message), 0 });
+    }
+    cond.notify_one();
+
+    return true;
+}
+
+void
+SqsProducer::
+flush()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [&] { return queue.empty() && numInFlight == 0; });
+}
+
+size_t
+SqsProducer::
+numPending()
+    const
+{
+    std::unique_lock<std::mutex> guard(lock);
+    return queue.size() + numInFlight;
+}
+
+void
+SqsProducer::
+runWorkerThread()
+{
+    std::vector<Entry> batch;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&] { return shutdown || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            // Take whatever is there, up to a full batch
+            size_t batchBytes = 0;
+            while (!queue.empty() && batch.size() < MaxBatchMessages) {
+                size_t size = queue.front().message.size();
+                if (!batch.empty() && batchBytes + size > MaxBatchBytes)
+                    break;
+                batchBytes += size;
+                batch.emplace_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            numInFlight += batch.size();
+        }
+
+        size_t batchSize = batch.size();
+        sendBatch(batch);
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (auto & entry: batch)
+                queue.push_front(std::move(entry));
+            numInFlight -= batchSize;
+        }
+        batch.clear();
+
+        // Wakes up flush() as well as the workers for the retries
+        cond.notify_all();
+    }
+}
+
+void
+SqsProducer::
+sendBatch(std::vector<Entry> & batch)
+{
+    auto giveUp = [&] (const Entry & entry, const std::string & error) {
+        ++numFailed_;
+        if (onError) {
+            try {
+                onError(entry.message, error);
+            } catch (const std::exception & exc) {
+                cerr << "SqsProducer: error callback threw: " << exc.what()
+                     << endl;
+            }
+        }
+    };
+
+    vector<string> messages;
+    messages.reserve(batch.size());
+    for (auto & entry: batch) {
+        messages.push_back(entry.message);
+        entry.attempts++;
+    }
+
+    vector<SqsApi::BatchResultError> errors;
+    try {
+        errors = api.sendMessageBatch(queueUri, messages);
+    } catch (const std::exception & exc) {
+        // The whole batch failed; retry what can be
+        std::vector<Entry> retries;
+        for (auto & entry: batch) {
+            if (entry.attempts < maxAttempts)
+                retries.emplace_back(std::move(entry));
+            else giveUp(entry, exc.what());
+        }
+        batch.swap(retries);
+        return;
+    }
+
+    numSent_ += batch.size() - errors.size();
+
+    // Keep the entries that failed and are worth retrying in "batch"
+    std::vector<Entry> retries;
+    for (auto & error: errors) {
+        Entry & entry = batch.at(error.index);
+        if (!error.senderFault && entry.attempts < maxAttempts)
+            retries.emplace_back(std::move(entry));
+        else giveUp(entry, error.code + ": " + error.message);
+    }
+    batch.swap(retries);
+}
+
 } // namespace Datacratic
@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include "aws.h"
 #include "http_rest_proxy.h"
 #include "jml/utils/unnamed_bool.h"
@@ -105,10 +110,21 @@ struct SqsApi : public AwsBasicApi {
                 int timeoutSeconds = 10,
                 int delaySeconds = -1);
 
-    /** Send multiple messages at once (10 at most). */
-    void sendMessageBatch(const std::string & queueUri,
-                          const std::vector<std::string> & messages,
-                          int delaySeconds = -1);
+    /** Entry of a batch that could not be sent. */
+    struct BatchResultError {
+        int index;           ///< Index of the entry in the batch
+        std::string code;
+        std::string message;
+        bool senderFault;    ///< Whether retrying the entry is pointless
+    };
+
+    /** Send multiple messages at once (10 at most).  Returns the messages
+        that failed, the others having been sent.
+    */
+    std::vector<BatchResultError>
+    sendMessageBatch(const std::string & queueUri,
+                     const std::vector<std::string> & messages,
+                     int delaySeconds = -1);
 
     // The body of a message is actually in this format when it comes from
     // SNS.
@@ -255,4 +271,77 @@ struct SqsApi : public AwsBasicApi {
 
 CREATE_STRUCTURE_DESCRIPTION_NAMED(SqsSnsMessageBodyDescription, SqsApi::SnsMessageBody);
 
+
+/*****************************************************************************/
+/* SQS PRODUCER                                                              */
+/*****************************************************************************/
+
+/** Sends messages to a queue asynchronously.  The messages are gathered
+    into batches of up to 10 messages and 256 KB, which are sent by
+    numThreads threads in parallel over the pooled connections of the API.
+
+    Messages of a batch that fail for reasons other than their contents are
+    retried up to maxAttempts times in total; those that can't be sent are
+    passed to onError.
+*/
+
+struct SqsProducer {
+    typedef std::function<void (const std::string & message,
+                                const std::string & error)> OnError;
+
+    SqsProducer(SqsApi & api, const std::string & queueUri,
+                int numThreads = 4,
+                size_t maxQueued = 100000,
+                int maxAttempts = 3,
+                const OnError & onError = nullptr);
+
+    /** Sends the remaining messages before returning. */
+    ~SqsProducer();
+
+    /** Queue a message for sending.  Returns false if there are already
+        maxQueued messages waiting to be sent.
+    */
+    bool send(std::string message);
+
+    /** Wait until all the queued messages have been sent or given up
+        on.
+    */
+    void flush();
+
+    /** Number of messages waiting to be sent or being sent. */
+    size_t numPending() const;
+
+    uint64_t numSent() const
+    { return numSent_; }
+
+    uint64_t numFailed() const
+    { return numFailed_; }
+
+private:
+    struct Entry {
+        std::string message;
+        int attempts;
+    };
+
+    void runWorkerThread();
+    void sendBatch(std::vector<Entry> & batch);
+
+    SqsApi & api;
+    std::string queueUri;
+    size_t maxQueued;
+    int maxAttempts;
+    OnError onError;
+
+    mutable std::mutex lock;
+    std::condition_variable cond;
+    std::deque<Entry> queue;
+    size_t numInFlight;
+    bool shutdown;
+
+    std::atomic<uint64_t> numSent_;
+    std::atomic<uint64_t> numFailed_;
+
+    std::vector<std::thread> threads;
+};
+
 } // namespace Datacratic
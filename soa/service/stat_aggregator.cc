@@ -91,63 +91,84 @@ read(const std::string & prefix)
 
 GaugeAggregator::
 GaugeAggregator(Verbosity verbosity, const std::vector<int>& extra)
-    : verbosity(verbosity), values(new ML::distribution<float>())
-    , extra(extra)
+    : verbosity(verbosity), extra(extra)
 {
     if (verbosity == Outcome)
         ExcCheck(this->extra.size() > 0, "Can not construct with empty percentiles");
-
-    values->reserve(100);
 }
 
 GaugeAggregator::
 ~GaugeAggregator()
 {
-    delete values;
+}
+
+QuantileSketch
+GaugeAggregator::
+newSketch() const
+{
+    // Only the mean, min and max are needed below Outcome and those are
+    // kept exactly without any buckets.
+    return QuantileSketch(0.01, verbosity == Outcome ? 2048 : 0);
+}
+
+std::shared_ptr<GaugeAggregator::Shard>
+GaugeAggregator::
+newShard()
+{
+    auto shard = std::make_shared<Shard>(newSketch());
+
+    std::lock_guard<std::mutex> guard(shardsLock);
+    shards.push_back(shard);
+    return shard;
 }
 
 void
 GaugeAggregator::
 record(float value)
 {
-    ML::distribution<float> * current = values;
-    while ((current = values) == 0 || !cmp_xchg(values, current,
-                                     (ML::distribution<float>*)0));
-    
-    current->push_back(value);
+    Shard & shard = threadShard();
 
-    memory_barrier();
-
-    values = current;
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+    shard.sketch.add(value);
 }
 
-std::pair<ML::distribution<float> *, Date>
+std::pair<QuantileSketch *, Date>
 GaugeAggregator::
 reset()
 {
-    ML::distribution<float> * current = values;
-    ML::distribution<float> * new_current = new ML::distribution<float>();
+    std::unique_ptr<QuantileSketch> result(new QuantileSketch(newSketch()));
+
+    std::lock_guard<std::mutex> guard(shardsLock);
 
-    // TODO: reserve memory for new_current
+    for (auto it = shards.begin();  it != shards.end();) {
+        Shard & shard = **it;
+        {
+            std::lock_guard<ML::Spinlock> guard(shard.lock);
+            result->merge(shard.sketch);
+            shard.sketch.clear();
+        }
 
-    while ((current = values) == 0 || !cmp_xchg(values, current, new_current));
+        // Only we hold on to the shards of threads that exited.
+        if (it->use_count() == 1)
+            it = shards.erase(it);
+        else ++it;
+    }
 
-    // Date oldStart = start;
     start = Date::now();
 
-    return make_pair(current, start);
+    return make_pair(result.release(), start);
 }
 
 std::vector<StatReading>
 GaugeAggregator::
 read(const std::string & prefix)
 {
-    ML::distribution<float> * values;
+    QuantileSketch * values;
     Date oldStart;
 
     boost::tie(values, oldStart) = reset();
 
-    std::auto_ptr<ML::distribution<float> > vptr(values);
+    std::unique_ptr<QuantileSketch> vptr(values);
 
     if (values->empty())
         return vector<StatReading>();
@@ -164,24 +185,21 @@ read(const std::string & prefix)
         {
             int element
                 = std::max(0,
-                           std::min<int>(values->size() - 1,
-                                         outOf100 / 100.0 * values->size()));
-            return (*values)[element];
+                           std::min<int>(values->count() - 1,
+                                         outOf100 / 100.0 * values->count()));
+            return values->valueAtRank(element);
         };
     
-    std::sort(values->begin(), values->end(),
-              ML::safe_less<float>());
-
     if (verbosity == StableLevel)
         result.push_back(StatReading(prefix, values->mean(), start));
     
     else {
         addMetric("mean", values->mean());
-        addMetric("upper", values->back());
-        addMetric("lower", values->front());
+        addMetric("upper", values->max());
+        addMetric("lower", values->min());
 
         if (verbosity == Outcome) {
-            addMetric("count", values->size());
+            addMetric("count", values->count());
             for (int pct: extra) {
                 addMetric(ML::format("upper_%d", pct).c_str(), percentile(pct));
             }
@@ -9,12 +9,18 @@
 
 #include "ace/SOCK_Dgram.h"
 #include "jml/stats/distribution.h"
+#include "jml/arch/spinlock.h"
+#include "jml/arch/thread_specific.h"
 #include <boost/thread.hpp>
 #include "soa/types/date.h"
+#include "soa/service/quantile_sketch.h"
 #include "stats_events.h"
 #include <unordered_map>
 #include <map>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <boost/scoped_ptr.hpp>
 
 
@@ -55,6 +61,54 @@ struct StatAggregator {
 };
 
 
+/*****************************************************************************/
+/* STAT HANDLE                                                               */
+/*****************************************************************************/
+
+/** Stat whose name was resolved once so that recording a value doesn't need
+    to build the name or look it up again.  Recording into a handle is just
+    the record() of its aggregator.
+
+    A default constructed handle records nothing.  Handles keep recording
+    into the aggregator they were resolved to, so they need to be resolved
+    again if the stats are moved somewhere else.
+*/
+
+struct StatHandle {
+    StatHandle()
+    {
+    }
+
+    StatHandle(std::shared_ptr<StatAggregator> aggregator)
+        : aggregator(std::move(aggregator))
+    {
+    }
+
+    /** Handle that records through a function, for stats that aren't kept
+        in an aggregator of our own.
+    */
+    StatHandle(std::function<void (float)> recordFn)
+        : recordFn(std::move(recordFn))
+    {
+    }
+
+    void record(float value = 1.0) const
+    {
+        if (aggregator) aggregator->record(value);
+        else if (recordFn) recordFn(value);
+    }
+
+    bool valid() const
+    {
+        return aggregator || recordFn;
+    }
+
+private:
+    std::shared_ptr<StatAggregator> aggregator;
+    std::function<void (float)> recordFn;
+};
+
+
 /*****************************************************************************/
 /* COUNTER AGGREGATOR                                                        */
 /*****************************************************************************/
@@ -87,7 +141,12 @@ private:
 /* GAUGE AGGREGATOR                                                          */
 /*****************************************************************************/
 
-/** Class that aggregates a gauge over a period of time. */
+/** Class that aggregates a gauge over a period of time.
+
+    Each recording thread adds to a quantile sketch of its own, which are
+    merged together on read. The memory used doesn't depend on how many
+    values are recorded and percentiles are within 1% of the exact value.
+*/
 
 struct GaugeAggregator : public StatAggregator {
 
@@ -103,11 +162,15 @@ struct GaugeAggregator : public StatAggregator {
 
     virtual ~GaugeAggregator();
 
-    /** Record a new value of the stat.  Lock-free but may spin briefly. */
+    /** Record a new value of the stat.  Only takes a lock that is private to
+        the calling thread unless a read is in progress.
+    */
     virtual void record(float value);
 
-    /** Obtain a the current statistics and replace with a new version. */
-    std::pair<ML::distribution<float> *, Date> reset();
+    /** Obtain the statistics since the last reset and start over.  The
+        caller owns the returned sketch.
+    */
+    std::pair<QuantileSketch *, Date> reset();
 
     /** Read and reset the counter, providing output in Graphite's preferred
         format.
@@ -115,10 +178,43 @@ struct GaugeAggregator : public StatAggregator {
     virtual std::vector<StatReading> read(const std::string & prefix);
 
 private:
+    /** Values recorded by one thread since the last reset. */
+    struct Shard {
+        Shard(const QuantileSketch & sketch)
+            : sketch(sketch)
+        {
+        }
+
+        ML::Spinlock lock;
+        QuantileSketch sketch;
+    };
+
+    Shard & threadShard()
+    {
+        ThreadShards::PerThreadInfo * info = nullptr;
+        std::shared_ptr<Shard> & shard = *threadShards.get(info);
+        if (JML_UNLIKELY(!shard)) shard = newShard();
+        return *shard;
+    }
+
+    std::shared_ptr<Shard> newShard();
+
+    /** Sketch with the right number of buckets for the verbosity; only the
+        Outcome verbosity reads percentiles.
+    */
+    QuantileSketch newSketch() const;
+
     Verbosity verbosity;
     Date start;  //< Date at which we last cleared the counter
-    ML::distribution<float> * volatile values;  //< List of added values
     std::vector<int> extra;
+
+    /// Shards of every thread that recorded, including ones that exited
+    std::vector<std::shared_ptr<Shard> > shards;
+    std::mutex shardsLock;
+
+    typedef ML::ThreadSpecificInstanceInfo<std::shared_ptr<Shard>,
+                                           GaugeAggregator> ThreadShards;
+    ThreadShards threadShards;
 };
 
 
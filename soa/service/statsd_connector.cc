@@ -8,6 +8,8 @@
 #include "ace/INET_Addr.h"
 #include "jml/arch/exception.h"
 #include "jml/arch/format.h"
+#include <sys/socket.h>
+#include <string.h>
 #include <iostream>
 
 
@@ -21,34 +23,85 @@ namespace Datacratic {
 /* STATSD CONNECTOR                                                          */
 /*****************************************************************************/
 
+namespace {
+
+/** Largest payload of a packet; multi-metric packets are cut at line
+    boundaries before reaching it to avoid IP fragmentation.
+*/
+enum { MaxPacketSize = 1432 };
+
+/** Number of datagrams sent per sendmmsg() call. */
+enum { MaxPacketsPerCall = 64 };
+
+} // file scope
+
 StatsdConnector::
 StatsdConnector()
+    : flushInterval(0.1), shutdown(false)
 {
 }
 
 StatsdConnector::
-StatsdConnector(const string& statsdAddr)
+StatsdConnector(const string& statsdAddr, double flushInterval)
+    : flushInterval(flushInterval), shutdown(false)
 {
-    open(statsdAddr);
+    open(statsdAddr, flushInterval);
 }
 
 StatsdConnector::
 ~StatsdConnector()
 {
-    sckt.close();
+    close();
 }
 
 void
 StatsdConnector::
-open(const string& statsdAddr)
+open(const string& statsdAddr, double flushInterval)
 {
-    sckt.close();
+    close();
+
     addr = ACE_INET_Addr(statsdAddr.c_str());
 
     if(sckt.open(addr) == -1)
         throw Exception("could not create statsd udp socket");
+
+    this->flushInterval = flushInterval;
+    shutdown = false;
+    flushingThread.reset
+        (new std::thread(std::bind(&StatsdConnector::runFlushingThread,
+                                   this)));
 }
-    
+
+void
+StatsdConnector::
+close()
+{
+    if (flushingThread) {
+        {
+            std::lock_guard<std::mutex> guard(shutdownLock);
+            shutdown = true;
+        }
+        shutdownCond.notify_all();
+        flushingThread->join();
+        flushingThread.reset();
+
+        flush();
+    }
+
+    sckt.close();
+}
+
+std::shared_ptr<StatsdConnector::Shard>
+StatsdConnector::
+newShard()
+{
+    auto shard = std::make_shared<Shard>();
+
+    std::lock_guard<std::mutex> guard(shardsLock);
+    shards.push_back(shard);
+    return shard;
+}
+
 void
 StatsdConnector::
 incrementCounter(const char* counterName, float sampleRate, int value)
@@ -56,19 +109,17 @@ incrementCounter(const char* counterName, float sampleRate, int value)
     if (sampleRate < 1.0 && ((random() % 10000) / 10000.0) >= sampleRate)
         return;
 
-    char msgBuf[1024];
-    int res = snprintf(msgBuf, 1024, "%s:%d|c|@%.2f", counterName, value,
-                       sampleRate);
-    if (res >= 1024) {
-        cerr << "invalid statsd counter name: " << counterName << endl;
-        return;
-    }
-    
-    int sendRes = sckt.send(msgBuf, res, addr, MSG_DONTWAIT);
-    if (sendRes == -1) {
-        cerr << "statsd message failure: " << strerror(errno)
-             << endl;
+    Shard & shard = threadShard();
+
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+    auto & sums = shard.counters[counterName];
+    for (auto & sum: sums) {
+        if (sum.first == sampleRate) {
+            sum.second += value;
+            return;
+        }
     }
+    sums.emplace_back(sampleRate, value);
 }
 
 void
@@ -78,18 +129,155 @@ recordGauge(const char* counterName, float sampleRate, float value)
     if (sampleRate < 1.0 && ((random() % 10000) / 10000.0) >= sampleRate)
         return;
 
+    Shard & shard = threadShard();
+
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+    shard.gauges.emplace_back(counterName, value);
+}
+
+void
+StatsdConnector::
+flush()
+{
+    std::lock_guard<std::mutex> flushGuard(flushLock);
+
+    // Take the metrics of every shard, merging the counters
+    std::unordered_map<std::string, std::vector<std::pair<float, long long> > >
+        counters;
+    std::vector<std::pair<std::string, float> > gauges;
+
+    {
+        std::lock_guard<std::mutex> guard(shardsLock);
+
+        for (auto it = shards.begin();  it != shards.end();) {
+            Shard & shard = **it;
+            {
+                std::lock_guard<ML::Spinlock> guard(shard.lock);
+                for (auto & counter: shard.counters) {
+                    for (auto & sum: counter.second) {
+                        if (sum.second == 0)
+                            continue;
+                        auto & sums = counters[counter.first];
+                        bool found = false;
+                        for (auto & s: sums) {
+                            if (s.first == sum.first) {
+                                s.second += sum.second;
+                                found = true;
+                                break;
+                            }
+                        }
+                        if (!found)
+                            sums.push_back(sum);
+                        sum.second = 0;
+                    }
+                }
+                if (gauges.empty())
+                    gauges.swap(shard.gauges);
+                else {
+                    gauges.insert(gauges.end(),
+                                  shard.gauges.begin(), shard.gauges.end());
+                    shard.gauges.clear();
+                }
+            }
+
+            // Only we hold on to the shards of threads that exited.
+            if (it->use_count() == 1)
+                it = shards.erase(it);
+            else ++it;
+        }
+    }
+
+    // Pack the lines into packets
+    std::vector<std::string> packets;
+    std::string packet;
+
+    auto addLine = [&] (const char * line, int size) {
+        if (size >= 1024) {
+            cerr << "invalid statsd counter name: " << line << endl;
+            return;
+        }
+        if (!packet.empty() && packet.size() + 1 + size > MaxPacketSize) {
+            packets.push_back(std::move(packet));
+            packet.clear();
+        }
+        if (!packet.empty())
+            packet += '\n';
+        packet.append(line, size);
+    };
+
     char msgBuf[1024];
-    int res = snprintf(msgBuf, 1024, "%s:%f|ms", counterName, value);
+    for (auto & counter: counters) {
+        for (auto & sum: counter.second) {
+            int res = snprintf(msgBuf, 1024, "%s:%lld|c|@%.2f",
+                               counter.first.c_str(), sum.second, sum.first);
+            addLine(msgBuf, res);
+        }
+    }
+    for (auto & gauge: gauges) {
+        int res = snprintf(msgBuf, 1024, "%s:%f|ms",
+                           gauge.first.c_str(), gauge.second);
+        addLine(msgBuf, res);
+    }
+    if (!packet.empty())
+        packets.push_back(std::move(packet));
 
-    if (res >= 1024) {
-        cerr << "invalid statsd counter name: " << counterName << endl;
-        return;
+    sendPackets(packets);
+}
+
+void
+StatsdConnector::
+sendPackets(const std::vector<std::string> & packets)
+{
+    mmsghdr msgs[MaxPacketsPerCall];
+    iovec iovs[MaxPacketsPerCall];
+
+    for (size_t start = 0;  start < packets.size();) {
+        unsigned n = std::min<size_t>(packets.size() - start,
+                                      MaxPacketsPerCall);
+        for (unsigned i = 0;  i < n;  ++i) {
+            const std::string & packet = packets[start + i];
+            iovs[i].iov_base = (void *)packet.c_str();
+            iovs[i].iov_len = packet.size();
+
+            msghdr & hdr = msgs[i].msg_hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = addr.get_addr();
+            hdr.msg_namelen = addr.get_size();
+            hdr.msg_iov = &iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+
+        int sendRes = sendmmsg(sckt.get_handle(), msgs, n, MSG_DONTWAIT);
+        if (sendRes == -1) {
+            cerr << "statsd message failure: " << strerror(errno)
+                 << endl;
+            return;
+        }
+
+        // A partial send means the next one would fail; skip the datagram
+        // that failed rather than retrying it.
+        start += unsigned(sendRes) < n ? sendRes + 1 : n;
     }
-    
-    int sendRes = sckt.send(msgBuf, res, addr, MSG_DONTWAIT);
-    if (sendRes == -1) {
-        cerr << "statsd message failure: " << strerror(errno)
-             << endl;
+}
+
+void
+StatsdConnector::
+runFlushingThread()
+{
+    std::unique_lock<std::mutex> lock(shutdownLock);
+
+    for (;;) {
+        auto interval = std::chrono::duration<double>(flushInterval);
+        if (shutdownCond.wait_for(lock, interval, [&] { return shutdown; }))
+            break;
+
+        lock.unlock();
+        try {
+            flush();
+        } catch (const std::exception & exc) {
+            cerr << "error flushing statsd metrics: " << exc.what() << endl;
+        }
+        lock.lock();
     }
 }
 
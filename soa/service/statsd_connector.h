@@ -5,7 +5,15 @@
 #pragma once
 
 #include "ace/SOCK_Dgram.h"
+#include "jml/arch/spinlock.h"
+#include "jml/arch/thread_specific.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace Datacratic {
 
@@ -15,6 +23,11 @@ namespace Datacratic {
 /*****************************************************************************/
 
 /** Class that sends UDP packets to statsd for monitoring purposes.
+
+    The metrics are not sent from the calling thread.  Each thread adds them
+    to its own shard, where the counters are summed, and a background thread
+    sends them every flushInterval seconds packed into as few packets as
+    possible.  The sample rate is still applied when a metric is recorded.
 */
 
 class StatsdConnector {
@@ -23,13 +36,67 @@ class StatsdConnector {
 
 public:
     StatsdConnector();
-    StatsdConnector(const std::string & statsdAddr);
+    StatsdConnector(const std::string & statsdAddr,
+                    double flushInterval = 0.1);
     ~StatsdConnector();
 
-    void open(const std::string & statsdAddr);
+    void open(const std::string & statsdAddr, double flushInterval = 0.1);
+
+    /** Send the pending metrics and stop the background thread. */
+    void close();
 
     void incrementCounter(const char* counterName, float sampleRate, int value=1 );
     void recordGauge(const char* counterName, float sampleRate, float gauge );
+
+    /** Send all the pending metrics now. */
+    void flush();
+
+private:
+    /** Metrics recorded by one thread since the last flush. */
+    struct Shard {
+        ML::Spinlock lock;
+
+        /* Sum of each counter for each sample rate it was incremented with.
+           Sums are zeroed rather than removed on flush so that a counter
+           only allocates the first time it is used. */
+        std::unordered_map<std::string,
+                           std::vector<std::pair<float, long long> > >
+            counters;
+
+        std::vector<std::pair<std::string, float> > gauges;
+    };
+
+    Shard & threadShard()
+    {
+        ThreadShards::PerThreadInfo * info = nullptr;
+        std::shared_ptr<Shard> & shard = *threadShards.get(info);
+        if (JML_UNLIKELY(!shard)) shard = newShard();
+        return *shard;
+    }
+
+    std::shared_ptr<Shard> newShard();
+
+    /** Send the datagrams, several at a time where possible. */
+    void sendPackets(const std::vector<std::string> & packets);
+
+    void runFlushingThread();
+
+    /// Shards of every thread that recorded, including ones that exited
+    std::vector<std::shared_ptr<Shard> > shards;
+    std::mutex shardsLock;
+
+    typedef ML::ThreadSpecificInstanceInfo<std::shared_ptr<Shard>,
+                                           StatsdConnector> ThreadShards;
+    ThreadShards threadShards;
+
+    /// Serializes flushes between the background thread and flush()
+    std::mutex flushLock;
+
+    double flushInterval;
+    std::unique_ptr<std::thread> flushingThread;
+    std::mutex shutdownLock;
+    std::condition_variable shutdownCond;
+    bool shutdown;
 };
 
 
@@ -1,4 +1,8 @@
-/* async_writer_bench */
+/* async_writer_bench
+
+   Throughput of AsyncWriterSource over pipes, unix sockets and TCP sockets,
+   for different message sizes.  Accepts the options of BenchmarkRunner.
+*/
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -14,6 +18,8 @@
 #include "jml/utils/file_functions.h"
 #include "soa/service/message_loop.h"
 #include "soa/service/async_writer_source.h"
+#include "soa/utils/benchmarks.h"
+#include "soa/utils/count_allocations.h"
 #include "soa/utils/print_utils.h"
 
 using namespace std;
@@ -116,27 +122,21 @@ pair<int, int> makeTcpSocketPair()
     return {writer, reader};
 }
 
-void doBench(const string & label,
-             int writerFd, int readerFd,
-             int numMessages, size_t msgSize)
+void doBench(int writerFd, int readerFd, int numMessages, size_t msgSize)
 {
     string message = randomString(msgSize);
     MessageLoop writerLoop, readerLoop;
 
     /* writer setup */
     writerLoop.start();
-    Date lastWrite;
-    Date lastWriteResult;
     int numWriteResults(0);
     int numWritten(0);
-    int numMissed(0);
     auto onWriteResult = [&] (AsyncWriteResult result) {
         if (result.error != 0) {
             throw ML::Exception("write error");
         }
         numWriteResults++;
         if (numWriteResults == numMessages) {
-            lastWriteResult = Date::now();
             ML::futex_wake(numWriteResults);
         }
     };
@@ -146,14 +146,10 @@ void doBench(const string & label,
 
     /* reader setup */
     readerLoop.start();
-    Date lastRead;
     size_t totalBytes = msgSize * numMessages;
     size_t bytesRead(0);
     auto onReaderData = [&] (const char * data, size_t size) {
         bytesRead += size;
-        if (bytesRead == totalBytes) {
-            lastRead = Date::now();
-        }
     };
     auto reader = make_shared<ReaderSource>(readerFd, onReaderData, 262144);
     readerLoop.addSource("reader", reader);
@@ -161,18 +157,11 @@ void doBench(const string & label,
     writer->waitConnectionState(AsyncEventSource::CONNECTED);
     reader->waitConnectionState(AsyncEventSource::CONNECTED);
 
-    Date start = Date::now();
-    ML::memory_barrier();
     for (numWritten = 0 ; numWritten < numMessages;) {
         if (writer->write(message, onWriteResult)) {
             numWritten++;
         }
-        else {
-            numMissed++;
-        }
     }
-    ML::memory_barrier();
-    lastWrite = Date::now();
 
     while (numWriteResults < numMessages) {
         int old = numWriteResults;
@@ -180,44 +169,41 @@ void doBench(const string & label,
     }
 
     while (bytesRead < totalBytes) {
-        ML::sleep(1.0);
+        ML::sleep(0.001);
     }
 
-    double totalTime = lastRead - start;
-    ::printf("%s,%d,%lu,%lu,%d,%f,%f,%f,%f,%f\n",
-             label.c_str(),
-             numMessages, msgSize, bytesRead, numMissed,
-             (lastWrite - start),
-             (lastWriteResult - start),
-             totalTime,
-             (double(numMessages) / totalTime),
-             (double(totalBytes) / totalTime));
-
     readerLoop.shutdown();
     writerLoop.shutdown();
 }
 
-void benchFunction(const string & label,
+void benchFunction(BenchmarkRunner & runner, const string & label,
                    std::function<pair<int, int> ()> f)
 {
     int multiplier(1);
     for (int i = 0; i < 4; i++) {
         multiplier *= 10;
-        auto fds = f();
-        doBench(label, fds.first, fds.second,
-                10000000 / multiplier, 50 * multiplier);
+        int numMessages = 10000000 / multiplier;
+        size_t msgSize = 50 * multiplier;
+        runner.run(label + "/" + to_string(msgSize),
+                   [&] () {
+                       auto fds = f();
+                       doBench(fds.first, fds.second, numMessages, msgSize);
+                       return numMessages;
+                   });
     }
 }
 
-int main()
+int main(int argc, char ** argv)
 {
-    ::printf("label,msgs_count,msg_size,bytes_xfer,miss_count,"
-             "delta_last_write,delta_last_written,delta_last_read,"
-             "msg_rate,byte_rate\n");
+    BenchmarkRunner runner;
+    runner.runs = 5;
+    runner.parseCommandLine(argc, argv);
+
+    benchFunction(runner, "pipe", makePipePair);
+    benchFunction(runner, "unix", makeUnixSocketPair);
+    benchFunction(runner, "tcp4", makeTcpSocketPair);
 
-    benchFunction("pipe", makePipePair);
-    benchFunction("unix", makeUnixSocketPair);
-    benchFunction("tcp4", makeTcpSocketPair);
+    runner.finish();
 
     return 0;
 }
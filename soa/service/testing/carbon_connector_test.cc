@@ -14,6 +14,7 @@
 #include "jml/arch/timers.h"
 #include "soa/service/passive_endpoint.h"
 #include <boost/make_shared.hpp>
+#include <sstream>
 
 
 using namespace std;
@@ -88,12 +89,12 @@ BOOST_AUTO_TEST_CASE( test_gauge_aggregator )
 
     boost::mutex mutex;
 
-    ML::distribution<float> allValues;
+    QuantileSketch allValues(0.01, 0);
 
     for (unsigned i = 0;  i < nthreads;  ++i) {
         auto doThread = [&] ()
             {
-                ML::distribution<float> threadValues;
+                QuantileSketch threadValues(0.01, 0);
 
                 barrier.wait();
 
@@ -101,19 +102,17 @@ BOOST_AUTO_TEST_CASE( test_gauge_aggregator )
                     aggregator.record(1.0 + (i % 2));
 
                     if (random() % 1000 == 0) {
-                        ML::distribution<float> * values
+                        QuantileSketch * values
                             = aggregator.reset().first;
                        
-                        threadValues.insert(threadValues.end(),
-                                            values->begin(), values->end());
+                        threadValues.merge(*values);
 
                         delete values;
                     }
                 }
                 
                 boost::lock_guard<boost::mutex> lock(mutex);
-                allValues.insert(allValues.end(),
-                                 threadValues.begin(), threadValues.end());
+                allValues.merge(threadValues);
             };
         
         tg.create_thread(doThread);
@@ -121,16 +120,40 @@ BOOST_AUTO_TEST_CASE( test_gauge_aggregator )
 
     tg.join_all();
 
-    ML::distribution<float> * values
+    QuantileSketch * values
         = aggregator.reset().first;
     
-    allValues.insert(allValues.end(),
-                     values->begin(), values->end());
-    std::sort(allValues.begin(), allValues.end());
+    allValues.merge(*values);
+    delete values;
 
-    BOOST_CHECK_EQUAL(allValues.size(), iter * nthreads);
+    BOOST_CHECK_EQUAL(allValues.count(), iter * nthreads);
     BOOST_CHECK_EQUAL(allValues.mean(), 1.5);
     BOOST_CHECK_EQUAL(allValues.std(), 0.5);
+    BOOST_CHECK_EQUAL(allValues.min(), 1.0);
+    BOOST_CHECK_EQUAL(allValues.max(), 2.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_gauge_aggregator_percentiles )
+{
+    GaugeAggregator aggregator(GaugeAggregator::Outcome, { 50, 90, 99 });
+
+    for (unsigned i = 1;  i <= 10000;  ++i)
+        aggregator.record(i);
+
+    std::map<std::string, float> readings;
+    for (auto & reading: aggregator.read("gauge"))
+        readings[reading.name] = reading.value;
+
+    BOOST_CHECK_EQUAL(readings["gauge.count"], 10000);
+    BOOST_CHECK_EQUAL(readings["gauge.mean"], 5000.5);
+    BOOST_CHECK_EQUAL(readings["gauge.lower"], 1);
+    BOOST_CHECK_EQUAL(readings["gauge.upper"], 10000);
+    BOOST_CHECK_CLOSE(readings["gauge.upper_50"], 5001, 1.0);
+    BOOST_CHECK_CLOSE(readings["gauge.upper_90"], 9001, 1.0);
+    BOOST_CHECK_CLOSE(readings["gauge.upper_99"], 9901, 1.0);
+
+    // Everything was consumed by the read.
+    BOOST_CHECK(aggregator.read("gauge").empty());
 }
 
 BOOST_AUTO_TEST_CASE( test_multi_aggregator )
@@ -169,6 +192,31 @@ BOOST_AUTO_TEST_CASE( test_multi_aggregator )
     BOOST_CHECK_EQUAL(readings[0].value, 50.0);
 }
 
+BOOST_AUTO_TEST_CASE( test_multi_aggregator_handles )
+{
+    // Handles record into the same aggregator as recording by name.
+
+    MultiAggregator agg;
+
+    StatHandle hits = agg.getHandle("hits", ET_HIT);
+    StatHandle level = agg.getHandle("level", ET_LEVEL);
+    BOOST_CHECK(hits.valid());
+    BOOST_CHECK(!StatHandle().valid());
+
+    for (unsigned i = 0;  i < 10;  ++i) {
+        hits.record();
+        agg.recordHit("hits");
+        level.record(i);
+    }
+
+    std::ostringstream stream;
+    agg.dumpSync(stream);
+
+    cerr << stream.str();
+    BOOST_CHECK_NE(stream.str().find("hits:\t20\n"), string::npos);
+    BOOST_CHECK_NE(stream.str().find("level.upper:\t9\n"), string::npos);
+}
+
 struct FakeCarbon : public PassiveEndpointT<SocketTransport> {
 
     FakeCarbon()
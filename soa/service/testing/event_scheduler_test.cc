@@ -0,0 +1,123 @@
+/* event_scheduler_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the discrete-event scheduler and the simulated clock.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/event_scheduler.h"
+#include "soa/service/message_loop.h"
+#include "soa/service/timeout_map.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_event_order )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000);
+    EventScheduler scheduler(start);
+
+    vector<string> ran;
+    auto add = [&] (const string & name) {
+        return [&ran, name] () { ran.push_back(name); };
+    };
+
+    scheduler.schedule(start.plusSeconds(2), add("c"));
+    scheduler.schedule(start.plusSeconds(1), add("a"));
+    scheduler.schedule(start.plusSeconds(1), add("b"));  // same time, after a
+    auto cancelled = scheduler.schedule(start.plusSeconds(1.5), add("x"));
+    scheduler.schedulePeriodic(0.75, [&] (uint64_t n) {
+            BOOST_CHECK_EQUAL(n, 1);
+            ran.push_back("p");
+        });
+
+    BOOST_CHECK(scheduler.cancel(cancelled));
+    BOOST_CHECK(!scheduler.cancel(cancelled));
+    BOOST_CHECK_EQUAL(scheduler.numPending(), 4);
+
+    // The time jumps straight to the events
+    BOOST_CHECK_EQUAL(scheduler.runUntil(start.plusSeconds(2)), 5);
+    BOOST_CHECK_EQUAL(scheduler.now(), start.plusSeconds(2));
+
+    vector<string> expected = { "p", "a", "b", "p", "c" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(ran.begin(), ran.end(),
+                                  expected.begin(), expected.end());
+
+    BOOST_CHECK(scheduler.runNext());
+    BOOST_CHECK_EQUAL(scheduler.now(), start.plusSeconds(2.25));
+    BOOST_CHECK_EQUAL(scheduler.nextEventTime(), start.plusSeconds(3));
+}
+
+BOOST_AUTO_TEST_CASE( test_simulated_clock )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000);
+    {
+        EventScheduler scheduler(start);
+        scheduler.install();
+        BOOST_CHECK_EQUAL(EventScheduler::current(), &scheduler);
+
+        BOOST_CHECK_EQUAL(Date::now(), start);
+        BOOST_CHECK_EQUAL(Date::nowFast(), start);
+
+        // Only one at a time
+        EventScheduler other;
+        BOOST_CHECK_THROW(other.install(), ML::Exception);
+
+        // Expiry follows the simulated time
+        typedef TimeoutMap<int, string> Timeouts;
+        Timeouts timeouts(10.0);
+        timeouts.insert(1, "one", start.plusSeconds(5));
+        timeouts.insert(2, "two", start.plusSeconds(15));
+
+        vector<int> expired;
+        auto onExpire = [&] (int key, const Timeouts::Node &) {
+            expired.push_back(key);
+            return Date();
+        };
+
+        scheduler.runUntil(start.plusSeconds(10));
+        timeouts.expire(onExpire);
+        BOOST_CHECK(expired == vector<int>({ 1 }));
+
+        scheduler.runUntil(start.plusSeconds(20));
+        timeouts.expire(onExpire);
+        BOOST_CHECK(expired == vector<int>({ 1, 2 }));
+    }
+
+    // Uninstalled on destruction
+    BOOST_CHECK(EventScheduler::current() == nullptr);
+    BOOST_CHECK(Date::now() > start.plusSeconds(1000000));
+}
+
+BOOST_AUTO_TEST_CASE( test_message_loop_periodic )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000);
+    EventScheduler scheduler(start);
+    scheduler.install();
+
+    vector<Date> times;
+    {
+        MessageLoop loop;
+        loop.addPeriodic("test", 60.0, [&] (uint64_t) {
+                times.push_back(Date::now());
+                BOOST_CHECK_EQUAL(loop.coarseNow(), Date::now());
+            });
+
+        // An hour of simulated time without the loop ever running
+        scheduler.runUntil(start.plusSeconds(3600));
+        BOOST_CHECK_EQUAL(times.size(), 60);
+        BOOST_CHECK_EQUAL(times.back(), start.plusSeconds(3600));
+    }
+
+    // Cancelled with the loop
+    BOOST_CHECK_EQUAL(scheduler.numPending(), 0);
+    scheduler.uninstall();
+}
@@ -19,6 +19,8 @@
 #include "soa/service/rest_proxy.h"
 #include "soa/service/rest_service_endpoint.h"
 #include "soa/service/runner.h"
+#include "soa/utils/benchmarks.h"
+#include "soa/utils/count_allocations.h"
 
 #include "test_http_services.h"
 
@@ -181,6 +183,11 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    BenchmarkRunner runner;
+    runner.warmupRuns = 0;
+    runner.runs = 1;
+    runner.parseCommandLine(argc, argv);
+
     variables_map vm;
     store(command_line_parser(argc, argv)
           .options(all_opt)
@@ -243,8 +250,6 @@ int main(int argc, char *argv[])
             baseUrl = "http://" + clientiface;
         }
 
-        ::printf("model\tconc.\treqs\tsize\ttime_secs\tBps\tqps\n");
-
         HttpMethod httpMethod;
         if (method == "GET") {
             httpMethod = GET;
@@ -259,20 +264,26 @@ int main(int argc, char *argv[])
             throw ML::Exception("unknown method: "  + method);
         }
 
-        double delta;
+        string name = (method + "/c" + to_string(concurrency)
+                       + "/s" + to_string(payloadSize));
         if (model == 1) {
-            delta = AsyncModelBench(httpMethod, baseUrl, payload, maxReqs, concurrency);
+            runner.run("async/" + name, [&] () {
+                    AsyncModelBench(httpMethod, baseUrl, payload,
+                                    maxReqs, concurrency);
+                    return maxReqs;
+                });
         }
         else if (model == 2) {
-            delta = ThreadedModelBench(httpMethod, baseUrl, payload, maxReqs, concurrency);
+            runner.run("threaded/" + name, [&] () {
+                    ThreadedModelBench(httpMethod, baseUrl, payload,
+                                       maxReqs, concurrency);
+                    return maxReqs;
+                });
         }
         else {
             throw ML::Exception("invalid 'model'");
         }
-        double qps = maxReqs / delta;
-        double bps = double(maxReqs * payload.size()) / delta;
-        ::printf("%d\t%u\t%u\t%u\t%f\t%f\t%f\n",
-                 model, concurrency, maxReqs, payloadSize, delta, bps, qps);
+        runner.finish();
     }
     else {
         while (1) {
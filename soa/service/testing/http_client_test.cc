@@ -283,6 +283,63 @@ BOOST_AUTO_TEST_CASE( test_http_client_post )
 }
 #endif
 
+#if 1
+/* Test requests built from a prepared head, which is reused across requests
+ * with different bodies. */
+BOOST_AUTO_TEST_CASE( test_http_client_prepared_request )
+{
+    ML::Watchdog watchdog(10);
+    auto proxies = make_shared<ServiceProxies>();
+    HttpUploadService service(proxies);
+    service.start();
+
+    MessageLoop loop;
+    loop.start();
+
+    string baseUrl("http://127.0.0.1:" + to_string(service.port()));
+    auto client = make_shared<HttpClient>(baseUrl, 4);
+    loop.addSource("client", client);
+    client->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    auto head = client->prepareRequest("POST", "/post-test", {},
+                                       { { "x-custom", "value" } },
+                                       "application/x-nothing");
+
+    for (int i = 0; i < 3; i++) {
+        int done(false);
+        ClientResponse response;
+        string url;
+        auto onResponse = [&] (const HttpRequest & rq,
+                               HttpClientError error, int status,
+                               string && headers, string && body) {
+            response = make_tuple(error, status, move(body));
+            url = rq.url();
+            done = true;
+            ML::futex_wake(done);
+        };
+        auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
+        client->enqueueRequest(head, cbs, "body " + to_string(i));
+
+        while (!done) {
+            ML::futex_wait(done, false);
+        }
+
+        BOOST_CHECK_EQUAL(get<0>(response), HttpClientError::None);
+        BOOST_CHECK_EQUAL(get<1>(response), 200);
+        BOOST_CHECK_EQUAL(url, baseUrl + "/post-test");
+        Json::Value jsonBody = Json::parse(get<2>(response));
+        BOOST_CHECK_EQUAL(jsonBody["verb"], "POST");
+        BOOST_CHECK_EQUAL(jsonBody["payload"], "body " + to_string(i));
+        BOOST_CHECK_EQUAL(jsonBody["type"], "application/x-nothing");
+        BOOST_CHECK_EQUAL(jsonBody["headers"]["x-custom"], "value");
+    }
+
+    loop.removeSourceSync(client.get());
+    loop.shutdown();
+    service.shutdown();
+}
+#endif
+
 #if 1
 BOOST_AUTO_TEST_CASE( test_http_client_put )
 {
@@ -643,6 +700,57 @@ BOOST_AUTO_TEST_CASE( test_http_client_connection_timeout )
 }
 #endif
 
+#if 1
+/* Test that requests with a deadline fail when it passes, including the
+ * ones still waiting for a connection. */
+BOOST_AUTO_TEST_CASE( test_http_client_deadline )
+{
+    ML::Watchdog watchdog(30);
+    auto proxies = make_shared<ServiceProxies>();
+
+    HttpGetService service(proxies);
+    service.addResponse("POST", "/", 200, "coucou");
+    service.start();
+    service.waitListening();
+
+    MessageLoop loop;
+    loop.start();
+
+    string baseUrl("http://127.0.0.1:" + to_string(service.port()));
+
+    auto client = make_shared<HttpClient>(baseUrl, 1);
+    loop.addSource("client", client);
+    client->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    int done(0);
+    vector<HttpClientError> errors;
+    auto onDone = [&] (const HttpRequest & rq,
+                       HttpClientError errorCode, int status,
+                       string && headers, string && body) {
+        errors.push_back(errorCode);
+        done++;
+        ML::futex_wake(done);
+    };
+    auto cbs = make_shared<HttpClientSimpleCallbacks>(onDone);
+
+    Date start = Date::now();
+    Date deadline = start.plusSeconds(0.2);
+    client->post("/timeout", cbs, HttpRequest::Content(), {}, {}, deadline);
+    client->post("/", cbs, HttpRequest::Content(), {}, {}, deadline);
+
+    while (done < 2) {
+        ML::futex_wait(done, done);
+    }
+
+    BOOST_CHECK_EQUAL(errors[0], HttpClientError::Timeout);
+    BOOST_CHECK_EQUAL(errors[1], HttpClientError::Timeout);
+    BOOST_CHECK_LT(Date::now().secondsSince(start), 2.5);
+
+    loop.shutdown();
+    service.shutdown();
+}
+#endif
+
 #if 1
 /* Test connection restoration after the server closes the connection, under
  * various circumstances. */
@@ -0,0 +1,468 @@
+/* http_endpoint_bench.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Request throughput and latency of HttpEndpoint under many concurrent
+   connections.  Accepts the options of BenchmarkRunner.
+
+   The load client is written directly against non-blocking sockets and
+   epoll, with a few threads that each drive a share of the connections, so
+   that it costs much less than the endpoint that it measures.  Each
+   connection has one request in flight at a time: HttpConnectionHandler
+   treats data past the end of the current request as an error, so
+   pipelined requests aren't supported and the concurrency comes from the
+   number of connections.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include "soa/types/date.h"
+#include "soa/service/quantile_sketch.h"
+#include "soa/utils/benchmarks.h"
+#include "soa/utils/print_utils.h"
+
+#include "test_http_services.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+/****************************************************************************/
+/* LOAD STATS                                                               */
+/****************************************************************************/
+
+struct LoadStats {
+    LoadStats()
+        : requests(0), errors(0), latencyUs(0.01, 4096)
+    {}
+
+    void merge(const LoadStats & other)
+    {
+        requests += other.requests;
+        errors += other.errors;
+        latencyUs.merge(other.latencyUs);
+    }
+
+    uint64_t requests;
+    uint64_t errors;            ///< Failed connections and non 200 responses
+    QuantileSketch latencyUs;   ///< First byte sent to last byte received
+};
+
+
+/****************************************************************************/
+/* CONNECTION                                                               */
+/****************************************************************************/
+
+struct Connection {
+    Connection()
+        : fd(-1), written(0), headerEnd(string::npos), bodyLength(0)
+    {}
+
+    ~Connection()
+    {
+        if (fd != -1)
+            ::close(fd);
+    }
+
+    int fd;
+    string out;
+    size_t written;
+    string in;
+    size_t headerEnd;
+    size_t bodyLength;
+    Date sent;
+
+    /** Whether "in" holds a whole response, of which the status is then
+        returned in "code". */
+    bool responseComplete(int & code)
+    {
+        if (headerEnd == string::npos) {
+            headerEnd = in.find("\r\n\r\n");
+            if (headerEnd == string::npos)
+                return false;
+
+            bodyLength = 0;
+            static const string lengthHeader = "\r\nContent-Length:";
+            auto pos = in.find(lengthHeader);
+            if (pos != string::npos && pos < headerEnd)
+                bodyLength = strtoul(in.c_str() + pos + lengthHeader.size(),
+                                     nullptr, 10);
+        }
+
+        if (in.size() < headerEnd + 4 + bodyLength)
+            return false;
+
+        // "HTTP/1.1 200 OK"
+        code = in.size() > 12 ? atoi(in.c_str() + 9) : 0;
+        return true;
+    }
+};
+
+
+/****************************************************************************/
+/* LOAD CLIENT                                                              */
+/****************************************************************************/
+
+/* Drives an HTTP server with a fixed number of connections spread over a
+   number of threads.  Each thread has its own epoll set, so the threads
+   share nothing but the count of requests left to send. */
+
+struct LoadClient {
+    LoadClient(int port, const string & request,
+               int numThreads, int numConnections, bool keepAlive)
+        : port(port), request(request), keepAlive(keepAlive),
+          slices(numThreads)
+    {
+        for (int i = 0;  i < numThreads;  ++i) {
+            Slice & slice = slices[i];
+            slice.epollFd = epoll_create(1024);
+            if (slice.epollFd == -1)
+                throw ML::Exception(errno, "epoll_create");
+            int n = numConnections / numThreads
+                + (i < numConnections % numThreads);
+            for (int j = 0;  j < n;  ++j)
+                slice.connections.emplace_back(new Connection());
+        }
+    }
+
+    ~LoadClient()
+    {
+        for (Slice & slice: slices)
+            ::close(slice.epollFd);
+    }
+
+    /** Sends numRequests requests over all of the connections, and returns
+        once all of the responses have arrived. */
+    LoadStats run(uint64_t numRequests)
+    {
+        remaining = numRequests;
+
+        vector<thread> threads;
+        for (Slice & slice: slices)
+            threads.emplace_back([&] () { runSlice(slice); });
+        for (thread & th: threads)
+            th.join();
+
+        LoadStats stats;
+        for (Slice & slice: slices) {
+            stats.merge(slice.stats);
+            slice.stats = LoadStats();
+        }
+        return stats;
+    }
+
+private:
+    struct Slice {
+        Slice() : epollFd(-1) {}
+
+        int epollFd;
+        vector<unique_ptr<Connection> > connections;
+        LoadStats stats;
+    };
+
+    int port;
+    string request;
+    bool keepAlive;
+    vector<Slice> slices;
+    std::atomic<int64_t> remaining;
+
+    bool connect(Slice & slice, Connection & conn)
+    {
+        conn.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (conn.fd == -1)
+            throw ML::Exception(errno, "socket");
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int res = ::connect(conn.fd, (struct sockaddr *)&addr, sizeof(addr));
+        if (res == -1) {
+            // Typically a full accept backlog; counts as a failed request
+            disconnect(conn);
+            return false;
+        }
+
+        int flag = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL) | O_NONBLOCK);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &conn;
+        if (epoll_ctl(slice.epollFd, EPOLL_CTL_ADD, conn.fd, &event) == -1)
+            throw ML::Exception(errno, "epoll_ctl");
+
+        return true;
+    }
+
+    void disconnect(Connection & conn)
+    {
+        // Closing the fd also removes it from the epoll set
+        ::close(conn.fd);
+        conn.fd = -1;
+    }
+
+    /** Sends the next request on the connection, if there are any left.
+        Returns whether one was sent. */
+    bool sendNext(Slice & slice, Connection & conn)
+    {
+        if (remaining.fetch_sub(1) <= 0)
+            return false;
+
+        if (conn.fd == -1 && !connect(slice, conn)) {
+            slice.stats.errors++;
+            return false;
+        }
+
+        conn.out = request;
+        conn.written = 0;
+        conn.in.clear();
+        conn.headerEnd = string::npos;
+        conn.sent = Date::now();
+        flush(slice, conn);
+        return true;
+    }
+
+    void flush(Slice & slice, Connection & conn)
+    {
+        while (conn.written < conn.out.size()) {
+            ssize_t res = ::send(conn.fd, conn.out.c_str() + conn.written,
+                                 conn.out.size() - conn.written, MSG_NOSIGNAL);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN) {
+                    // The read that follows sees the end of the connection
+                    // and counts the error
+                    shutdown(conn.fd, SHUT_RDWR);
+                    return;
+                }
+
+                struct epoll_event event;
+                event.events = EPOLLIN | EPOLLOUT;
+                event.data.ptr = &conn;
+                epoll_ctl(slice.epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+                return;
+            }
+            conn.written += res;
+        }
+    }
+
+    /** Reads what's available; returns whether the connection is still
+        waiting for its response. */
+    bool receive(Slice & slice, Connection & conn)
+    {
+        char buffer[65536];
+
+        for (;;) {
+            ssize_t res = ::read(conn.fd, buffer, sizeof(buffer));
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN)
+                    break;
+                res = 0;
+            }
+            if (res == 0) {
+                slice.stats.errors++;
+                disconnect(conn);
+                return false;
+            }
+            conn.in.append(buffer, res);
+        }
+
+        int code;
+        if (!conn.responseComplete(code))
+            return true;
+
+        double us = Date::now().secondsSince(conn.sent) * 1000000.0;
+        slice.stats.latencyUs.add(us);
+        slice.stats.requests++;
+        if (code != 200)
+            slice.stats.errors++;
+
+        if (!keepAlive)
+            disconnect(conn);
+
+        return false;
+    }
+
+    void runSlice(Slice & slice)
+    {
+        int inFlight = 0;
+        for (auto & conn: slice.connections)
+            inFlight += sendNext(slice, *conn);
+
+        struct epoll_event events[256];
+
+        while (inFlight > 0) {
+            int n = epoll_wait(slice.epollFd, events, 256, 1000);
+            if (n == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw ML::Exception(errno, "epoll_wait");
+            }
+
+            for (int i = 0;  i < n;  ++i) {
+                Connection & conn = *(Connection *)events[i].data.ptr;
+
+                if (events[i].events & EPOLLOUT) {
+                    flush(slice, conn);
+                    if (conn.written == conn.out.size()) {
+                        struct epoll_event event;
+                        event.events = EPOLLIN;
+                        event.data.ptr = &conn;
+                        epoll_ctl(slice.epollFd, EPOLL_CTL_MOD, conn.fd,
+                                  &event);
+                    }
+                }
+
+                if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                    continue;
+
+                if (!receive(slice, conn)) {
+                    inFlight--;
+                    inFlight += sendNext(slice, conn);
+                }
+            }
+        }
+    }
+};
+
+
+int main(int argc, char ** argv)
+{
+    using namespace boost::program_options;
+
+    int serverThreads = 1;
+    int acceptors = 1;
+    int clientThreads = 1;
+    vector<int> connections;
+    uint64_t numRequests = 100000;
+    size_t requestSize = 0;
+    size_t responseSize = 100;
+    bool noKeepAlive = false;
+
+    options_description options("Options");
+    options.add_options()
+        ("server-threads,t", value(&serverThreads),
+         "number of threads of the endpoint")
+        ("acceptors,a", value(&acceptors),
+         "number of SO_REUSEPORT accept sockets of the endpoint")
+        ("client-threads,T", value(&clientThreads),
+         "number of threads of the load client")
+        ("connections,c", value(&connections)->composing(),
+         "number of concurrent connections; may be repeated "
+         "(default 1, 10, 100, 1000)")
+        ("requests,r", value(&numRequests),
+         "number of requests of each run")
+        ("request-size", value(&requestSize),
+         "size of the body of the requests; 0 sends GET rather than POST")
+        ("response-size", value(&responseSize),
+         "size of the body of the responses")
+        ("no-keep-alive", bool_switch(&noKeepAlive),
+         "open a new connection for each request")
+        ("help,h", "print this message");
+
+    BenchmarkRunner runner;
+    runner.runs = 5;
+    runner.parseCommandLine(argc, argv);
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(options).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << options << endl;
+        return 1;
+    }
+
+    if (connections.empty())
+        connections = { 1, 10, 100, 1000 };
+
+    // Thousands of connections need as many file descriptors on each side
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    auto proxies = make_shared<ServiceProxies>();
+    HttpGetService service(proxies);
+
+    string body = randomString(requestSize);
+    service.addResponse("GET", "/", 200, randomString(responseSize));
+    service.addResponse("POST", "/", 200, randomString(responseSize));
+    if (acceptors > 1)
+        service.setReusePortAcceptors(acceptors);
+    service.start("127.0.0.1", serverThreads);
+
+    string request;
+    if (requestSize == 0)
+        request = "GET / HTTP/1.1\r\n";
+    else
+        request = ("POST / HTTP/1.1\r\n"
+                   "Content-Type: application/octet-stream\r\n"
+                   "Content-Length: " + to_string(requestSize) + "\r\n");
+    request += "Host: 127.0.0.1\r\n";
+    if (noKeepAlive)
+        request += "Connection: close\r\n";
+    request += "\r\n" + body;
+
+    for (int numConnections: connections) {
+        int threads = min(clientThreads, numConnections);
+        LoadClient client(service.port(), request,
+                          threads, numConnections, !noKeepAlive);
+
+        string name = ML::format("%s/c%d/t%d/a%d/req%zd/resp%zd%s",
+                                 requestSize ? "POST" : "GET",
+                                 numConnections, serverThreads, acceptors,
+                                 requestSize, responseSize,
+                                 noKeepAlive ? "/close" : "");
+
+        LoadStats total;
+        double seconds = 0;
+        runner.run(name, [&] () {
+                Date start = Date::now();
+                LoadStats stats = client.run(numRequests);
+                seconds += Date::now().secondsSince(start);
+                total.merge(stats);
+                return stats.requests;
+            });
+
+        const QuantileSketch & latency = total.latencyUs;
+        cerr << ML::format("%s: %.0f requests/s, %lld errors, latency "
+                           "p50 %.0fus p90 %.0fus p99 %.0fus p99.9 %.0fus "
+                           "max %.0fus\n",
+                           name.c_str(), total.requests / seconds,
+                           (long long)total.errors,
+                           latency.quantile(0.5), latency.quantile(0.9),
+                           latency.quantile(0.99), latency.quantile(0.999),
+                           latency.max());
+    }
+
+    runner.finish();
+
+    return 0;
+}
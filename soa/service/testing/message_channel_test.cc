@@ -209,4 +209,160 @@ BOOST_AUTO_TEST_CASE( test_typed_message_queue )
     }
 }
 
+BOOST_AUTO_TEST_CASE( test_typed_mpsc_message_queue )
+{
+    {
+        size_t numNotifications(0);
+        auto onNotify = [&]() {
+            numNotifications++;
+        };
+        TypedMpscMessageQueue<string> queue(onNotify, 5);
+
+        /* bounded */
+        for (unsigned i = 0;  i < 5;  ++i)
+            BOOST_CHECK(queue.push_back("message " + to_string(i)));
+        BOOST_CHECK(!queue.push_back("one too many"));
+        BOOST_CHECK_EQUAL(queue.size(), 5);
+
+        queue.processOne();
+        BOOST_CHECK_EQUAL(numNotifications, 1);
+
+        /* pop front 1: a single element, in order */
+        auto msgs = queue.pop_front(1);
+        BOOST_CHECK_EQUAL(msgs.size(), 1);
+        BOOST_CHECK_EQUAL(msgs[0], "message 0");
+
+        /* pop front 2: all elements requested */
+        msgs = queue.pop_front(0);
+        BOOST_CHECK_EQUAL(msgs.size(), 4);
+        BOOST_CHECK_EQUAL(msgs.back(), "message 4");
+        BOOST_CHECK_EQUAL(queue.size(), 0);
+        BOOST_CHECK_EQUAL(queue.pop_front(0).size(), 0);
+
+        /* the limit can be lowered below the capacity */
+        queue.setMaxMessages(2);
+        BOOST_CHECK(queue.push_back("a"));
+        BOOST_CHECK(queue.push_back("b"));
+        BOOST_CHECK(!queue.push_back("c"));
+        BOOST_CHECK_EQUAL(queue.pop_front(0).size(), 2);
+    }
+
+    /* multiple producers and a MessageLoop; per-producer order is kept */
+    {
+        const int numThreads(16);
+        const size_t numMessages(100000);
+
+        ML::Watchdog watchdog(120);
+
+        MessageLoop loop;
+        loop.start();
+
+        std::atomic<size_t> numPopped(0);
+        vector<int> lastSeen(numThreads, -1);
+        bool inOrder = true;
+
+        shared_ptr<TypedMpscMessageQueue<pair<int, int> > > queue;
+        auto onNotify = [&]() {
+            auto msgs = queue->pop_front(0);
+            for (auto & msg: msgs) {
+                if (msg.second <= lastSeen[msg.first])
+                    inOrder = false;
+                lastSeen[msg.first] = msg.second;
+            }
+            numPopped += msgs.size();
+        };
+        queue.reset(new TypedMpscMessageQueue<pair<int, int> >(onNotify, 1000));
+        loop.addSource("queue", queue);
+
+        size_t sliceSize = numMessages/numThreads;
+        auto threadFn = [&] (int threadNum) {
+            for (size_t i = 0; i < sliceSize; i++) {
+                while (!queue->push_back(make_pair(threadNum, (int)i))) {
+                    std::this_thread::yield();
+                }
+            }
+        };
+
+        vector<thread> workers;
+        for (int i = 0; i < numThreads; i++) {
+            workers.emplace_back(threadFn, i);
+        }
+        for (thread & worker: workers) {
+            worker.join();
+        }
+
+        while (numPopped < sliceSize * numThreads) {
+            ML::sleep(0.1);
+        };
+
+        BOOST_CHECK(inOrder);
+        BOOST_CHECK_EQUAL(numPopped, sliceSize * numThreads);
+    }
+}
+
+namespace {
+
+/* Push numMessages messages from numProducers threads while the calling
+   thread drains them with the given function; returns messages/second. */
+template<typename Push, typename Drain>
+double benchmarkQueue(int numProducers, size_t numMessages,
+                      const Push & push, const Drain & drain)
+{
+    size_t perProducer = numMessages / numProducers;
+    size_t total = perProducer * numProducers;
+
+    Date start = Date::now();
+
+    vector<thread> producers;
+    for (int i = 0;  i < numProducers;  ++i) {
+        producers.emplace_back([&] () {
+                for (size_t j = 0;  j < perProducer;  ++j)
+                    while (!push(j))
+                        std::this_thread::yield();
+            });
+    }
+
+    size_t received = 0;
+    while (received < total)
+        received += drain();
+
+    for (thread & producer: producers)
+        producer.join();
+
+    return total / Date::now().secondsSince(start);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_message_queues )
+{
+    const size_t numMessages(1000000);
+    const size_t capacity(4096);
+
+    for (int numProducers: { 1, 4, 16 }) {
+        ML::RingBufferSRMW<size_t> ring(capacity);
+        double ringRate = benchmarkQueue
+            (numProducers, numMessages,
+             [&] (size_t i) { return ring.tryPush(i); },
+             [&] () { size_t msg;  return ring.tryPop(msg) ? 1 : 0; });
+
+        TypedMessageQueue<size_t> mutexQueue(nullptr, capacity);
+        double mutexRate = benchmarkQueue
+            (numProducers, numMessages,
+             [&] (size_t i) { return mutexQueue.push_back(i); },
+             [&] () { return mutexQueue.pop_front(0).size(); });
+
+        TypedMpscMessageQueue<size_t> mpscQueue(nullptr, capacity);
+        double mpscRate = benchmarkQueue
+            (numProducers, numMessages,
+             [&] (size_t i) { return mpscQueue.push_back(i); },
+             [&] () { return mpscQueue.pop_front(0).size(); });
+
+        cerr << ML::format("%2d producers: RingBufferSRMW %8.0f/s  "
+                           "TypedMessageQueue %8.0f/s  "
+                           "TypedMpscMessageQueue %8.0f/s\n",
+                           numProducers, ringRate, mutexRate, mpscRate);
+    }
+}
+
 } // namespace Datacratic
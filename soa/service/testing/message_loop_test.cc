@@ -2,6 +2,7 @@
 #define BOOST_TEST_DYN_LINK
 
 #include <iostream>
+#include <mutex>
 
 #include <boost/test/unit_test.hpp>
 
@@ -102,3 +103,64 @@ BOOST_AUTO_TEST_CASE( test_addSource_after_before_start )
         }
     }
 }
+
+/* Ensures that a loop in busy poll mode still processes the messages of each
+ * source in order and keeps track of the time it spent spinning. */
+BOOST_AUTO_TEST_CASE( test_busy_poll )
+{
+    ML::Watchdog wd(10);
+    MessageLoop loop;
+    loop.setBusyPoll(0.001);
+
+    vector<int> processed;
+    std::mutex lock;
+
+    TypedMessageSink<int> low(1000);
+    low.onEvent = [&] (int && value) {
+        std::unique_lock<std::mutex> guard(lock);
+        processed.push_back(value);
+    };
+
+    TypedMessageSink<int> high(1000);
+    high.onEvent = low.onEvent;
+
+    loop.addSource("low", low, 0);
+    loop.addSource("high", high, 10);
+    loop.start();
+
+    low.waitConnectionState(AsyncEventSource::CONNECTED);
+    high.waitConnectionState(AsyncEventSource::CONNECTED);
+
+    ML::sleep(0.1);
+    BOOST_CHECK_GT(loop.totalSpinSeconds(), 0.0);
+
+    for (int i = 0; i < 100; i++) {
+        low.push(i);
+        high.push(1000 + i);
+    }
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (processed.size() == 200) break;
+        }
+        ML::sleep(0.01);
+    }
+
+    loop.removeSourceSync(&low);
+    loop.removeSourceSync(&high);
+    loop.shutdown();
+
+    vector<int> lows, highs;
+    for (int value: processed) {
+        if (value < 1000) lows.push_back(value);
+        else highs.push_back(value - 1000);
+    }
+
+    BOOST_CHECK_EQUAL(lows.size(), 100);
+    BOOST_CHECK_EQUAL(highs.size(), 100);
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK_EQUAL(lows[i], i);
+        BOOST_CHECK_EQUAL(highs[i], i);
+    }
+}
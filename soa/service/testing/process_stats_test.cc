@@ -0,0 +1,78 @@
+/* process_stats_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the process stats and the memory gauges.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/process_stats.h"
+#include "soa/gc/gc_lock.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_memory_gauges )
+{
+    uint64_t computed = 100;
+    {
+        MemoryGauge shard1("test.map");
+        MemoryGauge shard2("test.map");
+        MemoryGauge other("test.computed", [&] () { return computed; });
+
+        shard1.set(1000);
+        shard2.set(234);
+
+        // Gauges with the same name add up
+        auto all = MemoryGauge::sampleAll();
+        BOOST_CHECK_EQUAL(all["test.map"], 1234);
+        BOOST_CHECK_EQUAL(all["test.computed"], 100);
+
+        // Built in
+        BOOST_CHECK(all.count("gcDeferred"));
+
+        computed = 200;
+        ProcessStats last;
+        ProcessStats cur;
+        BOOST_CHECK_EQUAL(cur.memory["test.computed"], 200);
+
+        map<string, double> logged;
+        ProcessStats::logToCallback([&] (string key, double value)
+                                    {
+                                        logged[key] = value;
+                                    },
+                                    last, cur, "process");
+        BOOST_CHECK_EQUAL(logged["process.memory.test.map"], 1234);
+        BOOST_CHECK_EQUAL(logged["process.memory.test.computed"], 200);
+    }
+
+    // Gone with their owner
+    auto all = MemoryGauge::sampleAll();
+    BOOST_CHECK(!all.count("test.map"));
+    BOOST_CHECK(!all.count("test.computed"));
+}
+
+BOOST_AUTO_TEST_CASE( test_gc_deferred_bytes )
+{
+    uint64_t before = GcLockBase::deferredBytes();
+
+    GcLock gc;
+    std::unique_ptr<int> deleted(new int(1));
+    {
+        // Work deferred whilst a reader is in its critical section waits
+        GcLock::SharedGuard guard(gc);
+        gc.deferDelete(deleted.release());
+        BOOST_CHECK_GT(GcLockBase::deferredBytes(), before);
+    }
+
+    gc.deferBarrier();
+    BOOST_CHECK_EQUAL(GcLockBase::deferredBytes(), before);
+}
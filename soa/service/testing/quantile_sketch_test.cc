@@ -0,0 +1,139 @@
+/* quantile_sketch_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test for the quantile sketch.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/quantile_sketch.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+/** Checks every percentile of the sorted values against the sketch. */
+void checkAccuracy(const QuantileSketch & sketch, vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    for (unsigned pct = 0;  pct <= 100;  ++pct) {
+        size_t rank = std::min<size_t>(values.size() - 1,
+                                       pct / 100.0 * values.size());
+        double expected = values[rank];
+        double actual = sketch.valueAtRank(rank);
+
+        double error = std::abs(actual - expected);
+        BOOST_CHECK_LE(error, std::abs(expected) * sketch.relativeAccuracy()
+                       + 1e-12);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_quantile_sketch_accuracy )
+{
+    std::mt19937 rng(1);
+    std::lognormal_distribution<double> latency(0.0, 2.0);
+    std::normal_distribution<double> signedValues(0.0, 10.0);
+
+    QuantileSketch positive, mixed;
+    vector<double> positiveValues, mixedValues;
+
+    for (unsigned i = 0;  i < 100000;  ++i) {
+        double value = latency(rng);
+        positive.add(value);
+        positiveValues.push_back(value);
+
+        value = i % 10 == 0 ? 0.0 : signedValues(rng);
+        mixed.add(value);
+        mixedValues.push_back(value);
+    }
+
+    BOOST_CHECK_EQUAL(positive.count(), 100000);
+    BOOST_CHECK_EQUAL(positive.min(),
+                      *std::min_element(positiveValues.begin(),
+                                        positiveValues.end()));
+    BOOST_CHECK_EQUAL(positive.max(),
+                      *std::max_element(positiveValues.begin(),
+                                        positiveValues.end()));
+
+    checkAccuracy(positive, positiveValues);
+    checkAccuracy(mixed, mixedValues);
+}
+
+BOOST_AUTO_TEST_CASE( test_quantile_sketch_merge )
+{
+    std::mt19937 rng(2);
+    std::exponential_distribution<double> dist(0.01);
+
+    QuantileSketch all;
+    vector<QuantileSketch> parts(8);
+
+    for (unsigned i = 0;  i < 80000;  ++i) {
+        double value = dist(rng);
+        all.add(value);
+        parts[i % parts.size()].add(value);
+    }
+
+    QuantileSketch merged;
+    for (auto & part: parts)
+        merged.merge(part);
+
+    BOOST_CHECK_EQUAL(merged.count(), all.count());
+    BOOST_CHECK_EQUAL(merged.min(), all.min());
+    BOOST_CHECK_EQUAL(merged.max(), all.max());
+    BOOST_CHECK_CLOSE(merged.mean(), all.mean(), 1e-9);
+
+    for (uint64_t rank = 0;  rank < all.count();  rank += 997)
+        BOOST_CHECK_EQUAL(merged.valueAtRank(rank), all.valueAtRank(rank));
+
+    QuantileSketch coarse(0.05);
+    BOOST_CHECK_THROW(merged.merge(coarse), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_quantile_sketch_bounded )
+{
+    // Past maxBuckets the smallest values lose their accuracy but the
+    // largest ones, which are the interesting ones for latencies, don't.
+    QuantileSketch sketch(0.01, 64);
+    for (unsigned i = 1;  i <= 100000;  ++i)
+        sketch.add(i);
+
+    BOOST_CHECK_CLOSE(sketch.quantile(0.99), 99001, 1.0);
+    BOOST_CHECK_CLOSE(sketch.quantile(0.5), 50001, 1.0);
+    BOOST_CHECK_CLOSE(sketch.quantile(1.0), 100000, 1.0);
+    BOOST_CHECK_GE(sketch.quantile(0.0), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_quantile_sketch_moments_only )
+{
+    QuantileSketch sketch(0.01, 0);
+    BOOST_CHECK(sketch.empty());
+    BOOST_CHECK_THROW(sketch.quantile(0.5), ML::Exception);
+
+    sketch.add(1.0);
+    sketch.add(2.0);
+    sketch.add(NAN);
+    sketch.add(INFINITY);
+
+    BOOST_CHECK_EQUAL(sketch.count(), 2);
+    BOOST_CHECK_EQUAL(sketch.mean(), 1.5);
+    BOOST_CHECK_EQUAL(sketch.std(), 0.5);
+    BOOST_CHECK_THROW(sketch.quantile(0.5), ML::Exception);
+
+    sketch.clear();
+    BOOST_CHECK(sketch.empty());
+    BOOST_CHECK_EQUAL(sketch.mean(), 0.0);
+}
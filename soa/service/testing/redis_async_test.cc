@@ -351,3 +351,54 @@ BOOST_AUTO_TEST_CASE( test_redis_timeout )
 
     redis.shutdown();
 }
+
+BOOST_AUTO_TEST_CASE( test_redis_connection_pool )
+{
+    RedisTemporaryServer redis1, redis2;
+
+    vector<Address> nodes = { redis1, redis2 };
+    Redis::ConnectionPool pool(nodes, 2);
+    pool.test();
+
+    BOOST_CHECK_EQUAL(pool.numNodes(), 2);
+
+    enum { NumKeys = 100 };
+
+    vector<Command> sets, gets;
+    for (unsigned i = 0;  i < NumKeys;  ++i) {
+        string key = ML::format("key%d", i);
+        sets.push_back(SET(key, ML::format("value%d", i)));
+        gets.push_back(GET(key));
+    }
+
+    Results results = pool.execMulti(sets);
+    BOOST_CHECK(results.ok());
+
+    results = pool.execMulti(gets);
+    BOOST_REQUIRE(results.ok());
+    BOOST_REQUIRE_EQUAL(results.size(), NumKeys);
+    for (unsigned i = 0;  i < NumKeys;  ++i)
+        BOOST_CHECK_EQUAL(results.reply(i).asString(),
+                          ML::format("value%d", i));
+
+    // Each key is on the node it hashes to and both nodes have some
+    Redis::AsyncConnection connections[2] = { { redis1 }, { redis2 } };
+    int numOnNode[2] = { 0, 0 };
+    for (unsigned i = 0;  i < NumKeys;  ++i) {
+        string key = ML::format("key%d", i);
+        int node = pool.nodeForKey(key);
+        ++numOnNode[node];
+        auto result = connections[node].exec(EXISTS(key));
+        BOOST_CHECK_EQUAL(result.reply().asInt(), 1);
+    }
+    BOOST_CHECK_GT(numOnNode[0], 0);
+    BOOST_CHECK_GT(numOnNode[1], 0);
+
+    // Hash tags keep keys together
+    BOOST_CHECK_EQUAL(pool.nodeForKey("{user1}:segments"),
+                      pool.nodeForKey("{user1}:ids"));
+    BOOST_CHECK_EQUAL(pool.nodeForKey("{user1}:segments"),
+                      pool.nodeForKey("user1"));
+
+    BOOST_CHECK_EQUAL(pool.numRequestsPending(), 0);
+}
@@ -0,0 +1,107 @@
+/* sampling_profiler_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test of the sampling profiler.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <chrono>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/sampling_profiler.h"
+#include "soa/jsoncpp/reader.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+double sink = 0;
+
+/** Use CPU for the given number of seconds or until the profiler stops. */
+void __attribute__((noinline)) burnCpu(double seconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration<double>(seconds);
+    while (SamplingProfiler::instance().running()
+           && std::chrono::steady_clock::now() < end) {
+        for (int i = 0;  i < 100000;  ++i)
+            sink = sink * 0.999 + i;
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( test_folded_stacks )
+{
+    auto & profiler = SamplingProfiler::instance();
+
+    SamplingProfiler::Config config;
+    config.frequency = 500;
+    config.maxOverhead = 1.0;
+    profiler.start(config);
+    BOOST_CHECK(profiler.running());
+    BOOST_CHECK_THROW(profiler.start(config), ML::Exception);
+
+    burnCpu(0.5);
+    profiler.stop();
+    BOOST_CHECK(!profiler.running());
+
+    Json::Value status = profiler.getStatus();
+    BOOST_CHECK_EQUAL(status["stopReason"].asString(), "stopped");
+    BOOST_CHECK_GT(status["samples"].asInt(), 10);
+
+    string folded = profiler.folded();
+    cerr << folded;
+    BOOST_CHECK(folded.find("burnCpu") != string::npos);
+
+    // Each line is a stack then a count
+    size_t total = 0;
+    size_t pos = 0;
+    while (pos < folded.size()) {
+        size_t eol = folded.find('\n', pos);
+        BOOST_REQUIRE(eol != string::npos);
+        string line(folded, pos, eol - pos);
+        size_t space = line.rfind(' ');
+        BOOST_REQUIRE(space != string::npos);
+        total += stoi(line.substr(space + 1));
+        pos = eol + 1;
+    }
+    BOOST_CHECK_EQUAL(total, status["samples"].asInt());
+}
+
+BOOST_AUTO_TEST_CASE( test_limits )
+{
+    auto & profiler = SamplingProfiler::instance();
+
+    SamplingProfiler::Config config;
+    config.frequency = 1000;
+    config.maxSamples = 20;
+    config.maxOverhead = 1.0;
+    profiler.start(config);
+    burnCpu(2.0);
+    BOOST_CHECK(!profiler.running());
+
+    Json::Value status = profiler.getStatus();
+    BOOST_CHECK_EQUAL(status["stopReason"].asString(), "maxSamples");
+    BOOST_CHECK_EQUAL(status["samples"].asInt(), 20);
+
+    config.maxSamples = 100000;
+    config.maxSeconds = 0.2;
+    profiler.start(config);
+    burnCpu(2.0);
+    BOOST_CHECK(!profiler.running());
+    BOOST_CHECK_EQUAL(profiler.getStatus()["stopReason"].asString(),
+                      "maxSeconds");
+    profiler.stop();
+
+    // Bad configurations are refused
+    config.frequency = 100000;
+    BOOST_CHECK_THROW(profiler.start(config), ML::Exception);
+    BOOST_CHECK_THROW(SamplingProfiler::Config::fromJson(
+                              Json::parse("{\"frequenzy\": 10}")),
+                      ML::Exception);
+}
@@ -17,6 +17,7 @@ $(eval $(call test,epoll_wait_test,services,boost manual))
 $(eval $(call test,named_endpoint_test,services,boost manual))
 $(eval $(call test,zmq_named_pub_sub_test,services,boost manual))
 $(eval $(call test,zmq_endpoint_test,services,boost manual))
+$(eval $(call test,zmq_compression_test,services,boost))
 $(eval $(call test,message_channel_test,services,boost))
 $(eval $(call test,rest_service_endpoint_test,services,boost))
 $(eval $(call test,multiple_service_test,services,boost manual))
@@ -31,6 +32,7 @@ $(eval $(call nodejs_test,opstats_js_test,opstats,,,manual))
 
 $(eval $(call test,statsd_connector_test,opstats,boost  manual))
 $(eval $(call test,carbon_connector_test,opstats endpoint,boost manual))
+$(eval $(call test,quantile_sketch_test,opstats,boost))
 
 $(eval $(call test,endpoint_unit_test,endpoint,boost))
 $(eval $(call test,test_active_endpoint_nothing_listening,endpoint,boost manual))
@@ -46,6 +48,11 @@ $(eval $(call test,http_rest_proxy_stress_test,services,boost manual))
 $(eval $(call test,service_proxies_test,endpoint,boost manual))
 
 $(eval $(call test,message_loop_test,services,boost))
+$(eval $(call test,event_scheduler_test,services,boost))
+$(eval $(call test,timer_wheel_test,services,boost))
+$(eval $(call test,sampling_profiler_test,services,boost))
+$(eval $(call test,process_stats_test,services gc,boost))
+$(eval $(call test,shm_message_ring_test,services,boost))
 
 $(eval $(call program,runner_test_helper,utils))
 $(eval $(call test,runner_test,services,boost))
@@ -58,7 +65,7 @@ $(eval $(call test,nprobe_test,services,boost manual))
 
 $(eval $(call library,test_services,test_http_services.cc,services))
 
-$(eval $(call program,async_writer_bench,services))
+$(eval $(call program,async_writer_bench,services test_utils))
 
 # nsq_client_test is "manual" because of dependency on nsqd */
 $(eval $(call test,nsq_client_test,cloud,boost manual))
@@ -66,7 +73,8 @@ $(eval $(call test,nsq_client_test,cloud,boost manual))
 $(eval $(call test,http_client_test_v1,services test_services,boost))
 $(eval $(call test,http_client_test_v2,services test_services,boost manual))
 $(eval $(call test,http_client_online_test,services test_services,boost manual))
-$(eval $(call test,http_client_bench,boost_program_options services test_services,boost manual))
+$(eval $(call test,http_client_bench,boost_program_options services test_services test_utils,boost manual))
+$(eval $(call program,http_endpoint_bench,boost_program_options services test_services test_utils))
 $(eval $(call test,http_parsers_test,services test_services,boost valgrind))
 
 $(eval $(call test,logs_test,services,boost))
@@ -0,0 +1,124 @@
+/* shm_message_ring_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test for the shared memory message ring.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "jml/arch/timers.h"
+#include "jml/utils/testing/watchdog.h"
+
+#include "soa/service/shm_message_ring.h"
+#include "soa/service/message_loop.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+string ringPath(const string & name)
+{
+    return "/tmp/shm_message_ring_test-" + name + "-" + to_string(getpid());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_shm_ring_push_pop )
+{
+    string path = ringPath("pushPop");
+
+    ShmMessageRing producer;
+    BOOST_CHECK(!producer.open(path));
+
+    ShmMessageRing consumer;
+    consumer.create(path, 4096);
+    BOOST_REQUIRE(producer.open(path));
+    BOOST_CHECK(producer.isConnected());
+
+    vector<string> message;
+    BOOST_CHECK(!consumer.tryPop(message));
+
+    BOOST_CHECK(producer.tryPushMessage(string("BID"), 42, string(10, 'x')));
+    BOOST_REQUIRE(consumer.tryPop(message));
+    BOOST_REQUIRE_EQUAL(message.size(), 3);
+    BOOST_CHECK_EQUAL(message[0], "BID");
+    BOOST_CHECK_EQUAL(message[1], "42");
+    BOOST_CHECK_EQUAL(message[2], string(10, 'x'));
+
+    // Too big for the ring
+    BOOST_CHECK(!producer.tryPush(vector<string>{ string(5000, 'a') }));
+
+    // Fills up and then goes through the wrap around
+    int pushed = 0;
+    while (producer.tryPush(vector<string>{ to_string(pushed) }))
+        ++pushed;
+    BOOST_CHECK_GT(pushed, 0);
+
+    for (int i = 0;  i < pushed;  ++i) {
+        BOOST_REQUIRE(consumer.tryPop(message));
+        BOOST_CHECK_EQUAL(message.at(0), to_string(i));
+    }
+    BOOST_CHECK(!consumer.tryPop(message));
+    BOOST_CHECK(producer.tryPush(vector<string>{ "after wrap" }));
+    BOOST_REQUIRE(consumer.tryPop(message));
+    BOOST_CHECK_EQUAL(message.at(0), "after wrap");
+
+    consumer.close();
+    BOOST_CHECK(!producer.isConnected());
+    BOOST_CHECK(!producer.tryPush(vector<string>{ "closed" }));
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_ring_message_loop )
+{
+    ML::Watchdog watchdog(10.0);
+
+    string path = ringPath("loop");
+    const int numMessages = 100000;
+
+    std::atomic<int> received(0);
+    std::atomic<int> errors(0);
+
+    auto source = std::make_shared<ShmMessageSource>(
+            path, 65536,
+            [&] (vector<string> && message)
+            {
+                if (message.size() != 2
+                    || message[0] != to_string(received)
+                    || message[1].size() != received % 300)
+                    ++errors;
+                ++received;
+            });
+
+    MessageLoop loop;
+    loop.addSource("source", source);
+    loop.start();
+
+    ShmMessageRing producer;
+    BOOST_REQUIRE(producer.open(path));
+
+    for (int i = 0;  i < numMessages;  ++i) {
+        vector<string> message{ to_string(i), string(i % 300, 'a') };
+        while (!producer.tryPush(message))
+            std::this_thread::yield();
+
+        // Let the consumer go to sleep now and again
+        if (i % 10000 == 0) ML::sleep(0.01);
+    }
+
+    while (received < numMessages)
+        ML::sleep(0.001);
+
+    loop.shutdown();
+
+    BOOST_CHECK_EQUAL(received, numMessages);
+    BOOST_CHECK_EQUAL(errors, 0);
+}
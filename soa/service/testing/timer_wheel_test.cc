@@ -0,0 +1,107 @@
+/* timer_wheel_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test for the timer wheel.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/timer_wheel.h"
+
+#include <vector>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+struct TestTimer : public TimerWheel::Entry {
+    TestTimer() : fired(0) {}
+
+    int fired;
+
+    virtual void onExpire() { ++fired; }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel_expiry )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000000);
+    TimerWheel wheel(0.001, start);
+
+    TestTimer early, late, past;
+    wheel.arm(early, start.plusSeconds(0.0105));
+    wheel.arm(late, start.plusSeconds(0.050));
+    wheel.arm(past, start.plusSeconds(-1));
+    BOOST_CHECK_EQUAL(wheel.size(), 3);
+
+    // Nothing fires before the end of the tick of its deadline, and a
+    // deadline in the past is in the current tick
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.0005)), 0);
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.0012)), 1);
+    BOOST_CHECK_EQUAL(past.fired, 1);
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.0108)), 0);
+    BOOST_CHECK_EQUAL(early.fired, 0);
+
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.0112)), 1);
+    BOOST_CHECK_EQUAL(early.fired, 1);
+    BOOST_CHECK(!early.isArmed());
+    BOOST_CHECK(late.isArmed());
+
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.060)), 1);
+    BOOST_CHECK_EQUAL(late.fired, 1);
+    BOOST_CHECK_EQUAL(wheel.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel_cancel_and_move )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000000);
+    TimerWheel wheel(0.001, start);
+
+    vector<TestTimer> timers(100);
+    for (unsigned i = 0;  i < timers.size();  ++i)
+        wheel.arm(timers[i], start.plusSeconds(0.010));
+
+    // Cancel every other one and move the rest later
+    for (unsigned i = 0;  i < timers.size();  ++i) {
+        if (i % 2) wheel.cancel(timers[i]);
+        else wheel.arm(timers[i], start.plusSeconds(0.020));
+    }
+    BOOST_CHECK_EQUAL(wheel.size(), 50);
+
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.015)), 0);
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.025)), 50);
+    for (unsigned i = 0;  i < timers.size();  ++i)
+        BOOST_CHECK_EQUAL(timers[i].fired, i % 2 ? 0 : 1);
+
+    // Cancelling a timer that isn't armed does nothing
+    wheel.cancel(timers[0]);
+    BOOST_CHECK_EQUAL(wheel.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel_later_turn )
+{
+    Date start = Date::fromSecondsSinceEpoch(1000000);
+    TimerWheel wheel(0.001, start);
+
+    // Shares its slot with ticks of the first turn of the wheel
+    TestTimer timer;
+    double delay = (TimerWheel::NumSlots + 5) * 0.001;
+    wheel.arm(timer, start.plusSeconds(delay));
+
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(0.010)), 0);
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(delay - 0.002)), 0);
+    BOOST_CHECK_EQUAL(wheel.advance(start.plusSeconds(delay + 0.002)), 1);
+
+    // After a stall of more than a turn, everything due fires at once
+    TestTimer a, b;
+    Date now = start.plusSeconds(delay + 0.002);
+    wheel.arm(a, now.plusSeconds(0.100));
+    wheel.arm(b, now.plusSeconds(1.000));
+    BOOST_CHECK_EQUAL(wheel.advance(now.plusSeconds(100)), 2);
+}
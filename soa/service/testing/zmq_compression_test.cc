@@ -0,0 +1,136 @@
+/* zmq_compression_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the compression of zmq messages.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/zmq_compression.h"
+#include "jml/arch/format.h"
+
+using namespace std;
+using namespace Datacratic;
+
+namespace {
+
+string bidRequest(int i)
+{
+    return ML::format(
+        "{\"id\":\"%d-a1b2c3\",\"imp\":[{\"id\":\"1\",\"banner\":{\"w\":300,"
+        "\"h\":250,\"pos\":1}}],\"site\":{\"id\":\"%d\",\"domain\":"
+        "\"example%d.com\",\"cat\":[\"IAB1\"]},\"device\":{\"ua\":\"Mozilla/5.0 "
+        "(Windows NT 6.1; WOW64) AppleWebKit/537.36\",\"ip\":\"10.0.%d.%d\"},"
+        "\"user\":{\"id\":\"user%d\"},\"at\":2,\"tmax\":100}",
+        i, i % 100, i % 17, i % 256, i % 199, i * 7);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_round_trip )
+{
+    vector<string> samples;
+    for (int i = 0;  i < 1000;  ++i)
+        samples.push_back(bidRequest(i));
+
+    string dictionary = ZmqCompression::trainDictionary(samples);
+    BOOST_CHECK(!dictionary.empty());
+    BOOST_CHECK_LE(dictionary.size(), ZmqCompression::MaxDictionarySize);
+
+    ZmqCompression codec(dictionary, 64);
+    ZmqCompression other;
+
+    BOOST_CHECK_EQUAL(codec.accept(codec.offer()), 1);
+    BOOST_CHECK_EQUAL(codec.accept(other.offer()), 0);
+    BOOST_CHECK_EQUAL(other.accept(codec.offer()), 0);
+    BOOST_CHECK_EQUAL(codec.accept("HEARTBEAT"), -1);
+
+    for (bool useDictionary: { false, true }) {
+        string request = bidRequest(123456);
+        string big(200000, 'x');
+        vector<zmq::message_t> message;
+        message.emplace_back(string("AUCTION"));
+        message.emplace_back(request);
+        message.emplace_back(string("small"));
+        message.emplace_back(big);
+
+        codec.compress(message, 1, useDictionary);
+        BOOST_CHECK_EQUAL(message.size(), 5);
+        BOOST_CHECK(ZmqCompression::isCompressed(message, 1));
+        BOOST_CHECK_LT(message[2].size(), request.size());
+        BOOST_CHECK_LT(message[4].size(), 10000);
+
+        // Decode as strings, as the endpoints do
+        vector<string> strings;
+        for (auto & frame: message)
+            strings.push_back(frame.toString());
+
+        BOOST_CHECK(codec.decompress(message, 1));
+        BOOST_REQUIRE_EQUAL(message.size(), 4);
+        BOOST_CHECK_EQUAL(message[0].toString(), "AUCTION");
+        BOOST_CHECK_EQUAL(message[1].toString(), request);
+        BOOST_CHECK_EQUAL(message[2].toString(), "small");
+        BOOST_CHECK(message[3].toString() == big);
+
+        BOOST_CHECK(codec.decompress(strings, 1));
+        BOOST_CHECK_EQUAL(strings.at(1), request);
+
+        // Without the dictionary only the frames that don't use it decode
+        vector<string> again = { "AUCTION" };
+        vector<zmq::message_t> frames;
+        frames.emplace_back(string("AUCTION"));
+        frames.emplace_back(request);
+        codec.compress(frames, 1, useDictionary);
+        for (unsigned i = 1;  i < frames.size();  ++i)
+            again.push_back(frames[i].toString());
+        if (useDictionary)
+            BOOST_CHECK_THROW(other.decompress(again, 1), ML::Exception);
+        else {
+            BOOST_CHECK(other.decompress(again, 1));
+            BOOST_CHECK_EQUAL(again.at(1), request);
+        }
+    }
+
+    // Uncompressed messages go through untouched
+    vector<string> raw = { "AUCTION", "payload" };
+    BOOST_CHECK(!codec.decompress(raw, 1));
+    BOOST_CHECK_EQUAL(raw.size(), 2);
+
+    auto stats = codec.stats();
+    cerr << "compressed " << stats.rawBytesOut << " bytes to "
+         << stats.wireBytesOut << endl;
+    BOOST_CHECK_LT(stats.wireBytesOut, stats.rawBytesOut);
+}
+
+BOOST_AUTO_TEST_CASE( test_dictionary_ratio )
+{
+    vector<string> samples;
+    for (int i = 0;  i < 1000;  ++i)
+        samples.push_back(bidRequest(i));
+
+    ZmqCompression plain(string(), 0);
+    ZmqCompression primed(ZmqCompression::trainDictionary(samples), 0);
+
+    size_t raw = 0, withoutDict = 0, withDict = 0;
+    for (int i = 5000;  i < 5100;  ++i) {
+        string request = bidRequest(i);
+        raw += request.size();
+
+        vector<zmq::message_t> m1, m2;
+        m1.emplace_back(request);
+        m2.emplace_back(request);
+        plain.compress(m1, 0, true);
+        primed.compress(m2, 0, true);
+        withoutDict += m1[1].size();
+        withDict += m2[1].size();
+    }
+
+    cerr << "raw " << raw << " lz4 " << withoutDict << " lz4+dict "
+         << withDict << endl;
+
+    // Small messages barely compress on their own; the dictionary is what
+    // makes the difference.
+    BOOST_CHECK_LT(withDict * 2, withoutDict);
+}
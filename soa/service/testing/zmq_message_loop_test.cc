@@ -90,3 +90,29 @@ BOOST_AUTO_TEST_CASE( test_plain_message_loop )
     
     BOOST_CHECK_LE(after.secondsSince(before), 0.1);
 }
+
+BOOST_AUTO_TEST_CASE( test_shared_message )
+{
+    zmq::context_t context(1);
+    zmq::socket_t sock1(context, ZMQ_PULL);
+    zmq::socket_t sock2(context, ZMQ_PUSH);
+    sock1.bind("inproc://shared-message");
+    sock2.connect("inproc://shared-message");
+
+    std::string payload(1000, 'x');
+    zmq::message_t shared = sharedMessage(payload);
+    zmq::message_t small = sharedMessage(std::string("small"));
+
+    // Sending a shared frame must leave it intact for the next recipient
+    for (unsigned i = 0;  i < 10;  ++i) {
+        sendMessage(sock2, small, shared, i);
+
+        auto msg = recvAll(sock1);
+        BOOST_REQUIRE_EQUAL(msg.size(), 3);
+        BOOST_CHECK_EQUAL(msg[0], "small");
+        BOOST_CHECK_EQUAL(msg[1], payload);
+        BOOST_CHECK_EQUAL(msg[2], to_string(i));
+    }
+
+    BOOST_CHECK_EQUAL(shared.size(), payload.size());
+}
@@ -254,3 +254,73 @@ BOOST_AUTO_TEST_CASE( test_named_publisher )
     // Check that it got all of the messages
     BOOST_CHECK_EQUAL(numMessages, numIter * 2);
 }
+
+BOOST_AUTO_TEST_CASE( test_named_publisher_filtering_and_sampling )
+{
+    ZooKeeper::TemporaryServer zookeeper;
+    zookeeper.start();
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    proxies->useZookeeper(ML::format("localhost:%d", zookeeper.getPort()));
+
+    Publisher pub("pub", proxies);
+    pub.init();
+    pub.bindTcp();
+    pub.start();
+
+    // Nothing is encoded until someone subscribes
+    BOOST_CHECK(!pub.hasSubscriber("hello"));
+
+    ZmqNamedSubscriber sub(*proxies->zmqContext);
+    sub.init(proxies->config);
+    sub.start();
+
+    vector<vector<string> > subscriberMessages;
+    volatile int numMessages = 0;
+
+    sub.messageHandler = [&] (const std::vector<zmq::message_t> & message)
+        {
+            vector<string> msg2;
+            for (unsigned i = 0;  i < message.size();  ++i)
+                msg2.push_back(message[i].toString());
+            BOOST_CHECK(ZmqNamedPublisher::parseSampledChannel(msg2.at(0)));
+
+            subscriberMessages.push_back(msg2);
+            ++numMessages;
+            futex_wake(numMessages);
+        };
+
+    sub.connectToEndpoint("pub/publish");
+    while (sub.getConnectionState() != ZmqNamedSubscriber::CONNECTED)
+        ML::sleep(0.01);
+
+    sub.subscribe(ZmqNamedPublisher::sampledTopic("hello", 3));
+
+    // Give the subscription message time to percolate through
+    ML::sleep(0.5);
+
+    BOOST_CHECK(pub.hasSubscriber("hello"));
+    BOOST_CHECK(!pub.hasSubscriber("dog"));
+
+    for (int i = 0;  i < 9;  ++i) {
+        pub.publish("hello", to_string(i));
+        pub.publish("dog", "eats", "dog");
+    }
+
+    for (;;) {
+        int nm = numMessages;
+        if (nm == 3) break;
+        ML::futex_wait(numMessages, nm);
+    }
+
+    ML::sleep(0.1);
+
+    // One in every three, with the sampling header removed
+    BOOST_CHECK_EQUAL(subscriberMessages.size(), 3);
+    BOOST_CHECK_EQUAL(subscriberMessages.at(0), vector<string>({ "hello", "0"}) );
+    BOOST_CHECK_EQUAL(subscriberMessages.at(1), vector<string>({ "hello", "3"}) );
+    BOOST_CHECK_EQUAL(subscriberMessages.at(2), vector<string>({ "hello", "6"}) );
+
+    sub.shutdown();
+    pub.shutdown();
+}
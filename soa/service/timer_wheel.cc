@@ -0,0 +1,150 @@
+/* timer_wheel.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Hashed timer wheel shared by the transports of an endpoint.
+*/
+
+#include "timer_wheel.h"
+#include "jml/arch/exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+
+
+namespace Datacratic {
+
+/*****************************************************************************/
+/* TIMER WHEEL                                                               */
+/*****************************************************************************/
+
+TimerWheel::Shard::
+Shard()
+    : nextTick(0), size(0)
+{
+    std::fill(slots, slots + NumSlots, nullptr);
+}
+
+TimerWheel::
+TimerWheel(double resolution, Date now)
+    : resolution_(resolution)
+{
+    if (resolution <= 0)
+        throw ML::Exception("timer wheel resolution must be positive");
+
+    for (Shard & shard: shards)
+        shard.nextTick = tickOf(now);
+}
+
+int64_t
+TimerWheel::
+tickOf(Date date) const
+{
+    return std::floor(date.secondsSinceEpoch() / resolution_);
+}
+
+void
+TimerWheel::
+link(Shard & shard, Entry & entry)
+{
+    Entry * & head = shard.slots[entry.tick % NumSlots];
+    entry.prev = nullptr;
+    entry.next = head;
+    if (head)
+        head->prev = &entry;
+    head = &entry;
+    entry.armed = true;
+    ++shard.size;
+}
+
+void
+TimerWheel::
+unlink(Shard & shard, Entry & entry)
+{
+    if (entry.prev)
+        entry.prev->next = entry.next;
+    else shard.slots[entry.tick % NumSlots] = entry.next;
+    if (entry.next)
+        entry.next->prev = entry.prev;
+    entry.prev = entry.next = nullptr;
+    entry.armed = false;
+    --shard.size;
+}
+
+void
+TimerWheel::
+arm(Entry & entry, Date deadline)
+{
+    if (!deadline.isADate())
+        throw ML::Exception("TimerWheel::arm(): not a date");
+
+    // The shard only depends on the entry, so moving a timer stays in it
+    unsigned shardNum = (reinterpret_cast<uintptr_t>(&entry) >> 6) % NumShards;
+    Shard & shard = shards[shardNum];
+
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+    if (entry.armed)
+        unlink(shard, entry);
+
+    entry.tick = std::max(tickOf(deadline), shard.nextTick);
+    entry.shard = shardNum;
+    link(shard, entry);
+}
+
+void
+TimerWheel::
+cancel(Entry & entry)
+{
+    Shard & shard = shards[entry.shard];
+    std::lock_guard<ML::Spinlock> guard(shard.lock);
+    if (entry.armed)
+        unlink(shard, entry);
+}
+
+size_t
+TimerWheel::
+advance(Date now)
+{
+    int64_t endTick = tickOf(now);
+    size_t result = 0;
+
+    for (Shard & shard: shards) {
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+
+        // After a long stall, one turn visits every slot
+        int64_t tick = std::max(shard.nextTick, endTick - NumSlots);
+
+        for (;  tick < endTick && shard.size;  ++tick) {
+            Entry * entry = shard.slots[tick % NumSlots];
+            while (entry) {
+                Entry * next = entry->next;
+                if (entry->tick < endTick) {
+                    unlink(shard, *entry);
+                    entry->onExpire();
+                    ++result;
+                }
+                entry = next;
+            }
+        }
+
+        shard.nextTick = std::max(shard.nextTick, endTick);
+    }
+
+    return result;
+}
+
+size_t
+TimerWheel::
+size() const
+{
+    size_t result = 0;
+    for (const Shard & shard: shards) {
+        std::lock_guard<ML::Spinlock> guard(shard.lock);
+        result += shard.size;
+    }
+    return result;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,117 @@
+/* timer_wheel.h                                                   -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Hashed timer wheel shared by the transports of an endpoint.
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+#include "jml/arch/spinlock.h"
+#include "jml/compiler/compiler.h"
+
+#include <cstdint>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* TIMER WHEEL                                                               */
+/*****************************************************************************/
+
+/** Hashed timer wheel: time is cut into ticks of a fixed resolution and each
+    timer is linked into the slot of the tick it expires in, so that arming
+    and cancelling a timer are O(1) and don't need a system call.  Something
+    outside the wheel (normally a single periodic timerfd of the endpoint)
+    calls advance() once per tick, which expires the timers of the slots that
+    were passed.
+
+    A timer expires at the end of the tick that contains its deadline, which
+    is never early and at most one tick late.  Slots hold timers of every
+    turn of the wheel; the ones for a later turn are skipped when the slot
+    is visited.
+
+    Timers are spread over shards that each have their own lock, as the
+    transports that arm and cancel them run on every thread of the endpoint.
+*/
+struct TimerWheel {
+
+    enum {
+        NumSlots = 4096,
+        NumShards = 8
+    };
+
+    /** A timer that can be linked into the wheel.  Embedded in the object
+        that owns it, which must cancel it before it goes away, and the
+        wheel must outlive every entry armed in it.
+    */
+    struct Entry {
+        Entry()
+            : prev(nullptr), next(nullptr), tick(0), shard(0), armed(false)
+        {
+        }
+
+        virtual ~Entry()
+        {
+        }
+
+        bool isArmed() const { return armed; }
+
+        /** Called by advance() once the deadline has passed, with the lock
+            of the shard held, so that it can't race with a cancel().  The
+            entry is already unlinked.  Must not arm or cancel any timer.
+        */
+        virtual void onExpire() = 0;
+
+    private:
+        friend struct TimerWheel;
+        Entry * prev;
+        Entry * next;
+        int64_t tick;
+        unsigned shard;
+        bool armed;
+    };
+
+    /** Create a wheel with ticks of the given number of seconds. */
+    TimerWheel(double resolution = 0.001, Date now = Date::now());
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel & operator = (const TimerWheel &) = delete;
+
+    double resolution() const { return resolution_; }
+
+    /** Arm the timer to expire at the given date, moving it if it was
+        already armed.  A date in the past expires with the current tick. */
+    void arm(Entry & entry, Date deadline);
+
+    /** Disarm the timer.  Does nothing if it wasn't armed. */
+    void cancel(Entry & entry);
+
+    /** Expire every timer whose tick ended before now.  Returns the number
+        of timers expired.  Must not be called by two threads at once. */
+    size_t advance(Date now = Date::now());
+
+    /** Number of timers armed. */
+    size_t size() const;
+
+private:
+    struct Shard {
+        Shard();
+
+        mutable ML::Spinlock lock;
+        int64_t nextTick;               ///< First tick not yet expired
+        size_t size;
+        Entry * slots[NumSlots];
+    } JML_ALIGNED(64);
+
+    int64_t tickOf(Date date) const;
+
+    static void link(Shard & shard, Entry & entry);
+    static void unlink(Shard & shard, Entry & entry);
+
+    double resolution_;
+    Shard shards[NumShards];
+};
+
+} // namespace Datacratic
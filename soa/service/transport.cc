@@ -43,6 +43,7 @@ long TransportBase::destroyed = 0;
 
 TransportBase::
 TransportBase()
+    : wheelTimer_(this)
 {
     throw Exception("TransportBase constructor requires an endpoint");
 }
@@ -53,7 +54,7 @@ TransportBase(EndpointBase * endpoint)
       asyncHead_(0),
       endpoint_(endpoint),
       recycle_(0), close_(0), flags_(0),
-      hasConnection_(false), zombie_(false)
+      hasConnection_(false), wheelTimer_(this), zombie_(false)
 {
     atomic_add(created, 1);
 
@@ -94,6 +95,9 @@ TransportBase(EndpointBase * endpoint)
 TransportBase::
 ~TransportBase()
 {
+    if (endpoint_->timerWheel())
+        endpoint_->timerWheel()->cancel(wheelTimer_);
+
     int res = close(epollFd_);
     if (res == -1)
         cerr << "closing epoll fd: " << strerror(errno) << endl;
@@ -662,6 +666,11 @@ handleEvents()
 
             //cerr << "    got timeout" << endl;
         }
+        if (rc != -1 && wheelTimer_.expired.exchange(false)
+            && timeout_.isSet() && timeout_.timeout <= Date::now()) {
+            TransportTimer timer(this, "timeout");
+            rc = handleTimeout();
+        }
         if (rc != -1
             && (items[2].revents & POLLIN)
             && (flags_ & POLLIN)) {
@@ -806,6 +815,12 @@ scheduleTimerAbsolute(Date timeout, size_t cookie,
                       void (*freecookie) (size_t))
 {
     timeout_.set(timeout, cookie, freecookie);
+
+    if (TimerWheel * wheel = endpoint_->timerWheel()) {
+        wheel->arm(wheelTimer_, timeout);
+        return;
+    }
+
     long seconds = timeout.wholeSecondsSinceEpoch();
     long nanoseconds = timeout.fractionalSeconds() * 1000000000.0;
     itimerspec spec = { { 0, 0 }, { seconds, nanoseconds } };
@@ -828,6 +843,12 @@ scheduleTimerRelative(double secondsFromNow,
 
     timeout_.set(Date::now().plusSeconds(secondsFromNow),
                  cookie, freecookie);
+
+    if (TimerWheel * wheel = endpoint_->timerWheel()) {
+        wheel->arm(wheelTimer_, timeout_.timeout);
+        return;
+    }
+
     long seconds = secondsFromNow;
     long nanoseconds = 1000000000.0 * (secondsFromNow - seconds);
     itimerspec spec = { { 0, 0 }, { seconds, nanoseconds } };
@@ -842,12 +863,25 @@ cancelTimer()
 {
     timeout_.cancel();
 
+    if (TimerWheel * wheel = endpoint_->timerWheel()) {
+        wheel->cancel(wheelTimer_);
+        return;
+    }
+
     itimerspec spec = { { 0, 0 }, { 0, 0 } };
     int res = timerfd_settime(timerFd_, 0, &spec, 0);
     if (res == -1)
         throw ML::Exception(errno, "timerfd_settime");
 }
 
+void
+TransportBase::WheelTimer::
+onExpire()
+{
+    expired = true;
+    eventfd_write(owner->eventFd_, 1);
+}
+
 void
 TransportBase::
 doAsync(const boost::function<void ()> & callback, const std::string & name)
@@ -22,8 +22,10 @@
 #include "jml/arch/spinlock.h"
 #include "soa/types/date.h"
 #include "soa/jsoncpp/json.h"
+#include "soa/service/timer_wheel.h"
 #include <boost/type_traits/is_convertible.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <atomic>
 
 namespace Datacratic {
 
@@ -546,6 +548,25 @@ private:
     /** Current timeout. */
     Timeout timeout_;
 
+    /** Entry of the timeout in the timer wheel of the endpoint, when it has
+        one.  Expiring it wakes up the transport, which then checks that the
+        current timeout is due before handling it, as it may have been moved
+        in the meantime.
+    */
+    struct WheelTimer : public TimerWheel::Entry {
+        WheelTimer(TransportBase * owner)
+            : owner(owner), expired(false)
+        {
+        }
+
+        TransportBase * owner;
+        std::atomic<bool> expired;
+
+        virtual void onExpire();
+    };
+
+    WheelTimer wheelTimer_;
+
     /** Magic to check that we're still alive. */
     int magic_;
 
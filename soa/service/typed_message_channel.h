@@ -10,6 +10,9 @@
 
 #include <queue>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 #include "jml/utils/ring_buffer.h"
 #include "jml/arch/wakeup_fd.h"
@@ -191,13 +194,14 @@ struct TypedMessageQueue: public AsyncEventSource
     uint64_t size()
         const
     {
+        Guard guard(queueLock_);
         return queue_.size();
     }
 
 private:
     typedef std::mutex Mutex;
     typedef std::unique_lock<Mutex> Guard;
-    Mutex queueLock_;
+    mutable Mutex queueLock_;
     std::queue<Message> queue_;
     size_t maxMessages_;
 
@@ -210,4 +214,201 @@ private:
     OnNotify onNotify_;
 };
 
+
+/*****************************************************************************
+ * TYPED MPSC MESSAGE QUEUE                                                  *
+ *****************************************************************************/
+
+/* Lock-free alternative to TypedMessageQueue for the common case where any
+ * number of threads push messages and a single thread (normally the one
+ * running the MessageLoop) consumes them.  It has exactly the same interface
+ * so that either can be used as a template parameter, with two differences:
+ *
+ * - the queue is always bounded; a "maxMessages" of 0 selects
+ *   DefaultCapacity, and setMaxMessages() can't go above the capacity
+ *   chosen at construction;
+ * - only one thread at a time may call pop_front().
+ *
+ * Producers claim a slot with a single CAS and never block each other.  The
+ * eventfd is only written by the push that finds no notification pending, so
+ * a burst of messages costs one wakeup and is typically handled with a
+ * single pop_front(0).
+ */
+template<typename Message>
+struct TypedMpscMessageQueue: public AsyncEventSource
+{
+    typedef std::function<void ()> OnNotify;
+
+    enum { DefaultCapacity = 65536 };
+
+    TypedMpscMessageQueue(const OnNotify & onNotify = nullptr,
+                          size_t maxMessages = 0)
+        : wakeup_(EFD_NONBLOCK | EFD_CLOEXEC), onNotify_(onNotify)
+    {
+        size_t capacity = 2;
+        size_t wanted = maxMessages ? maxMessages : DefaultCapacity;
+        while (capacity < wanted)
+            capacity *= 2;
+
+        mask_ = capacity - 1;
+        cells_.reset(new Cell[capacity]);
+        for (size_t i = 0;  i < capacity;  ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+
+        maxMessages_ = wanted;
+        writePos_ = 0;
+        readPos_ = 0;
+        pending_ = false;
+    }
+
+    /* AsyncEventSource interface */
+    virtual int selectFd() const
+    {
+        return wakeup_.fd();
+    }
+
+    virtual bool processOne()
+    {
+        while (wakeup_.tryRead());
+        onNotify();
+
+        return false;
+    }
+
+    virtual void onNotify()
+    {
+        if (onNotify_) {
+            onNotify_();
+        }
+    }
+
+    /* reset the maximum number of messages; 0 means the full capacity */
+    void setMaxMessages(size_t count)
+    {
+        if (count == 0 || count > mask_ + 1)
+            count = mask_ + 1;
+        maxMessages_ = count;
+    }
+
+    /* push message into the queue; returns false if it is full */
+    bool push_back(Message message)
+    {
+        size_t pos = writePos_.load(std::memory_order_relaxed);
+        Cell * cell;
+
+        for (;;) {
+            if (pos - readPos_.load(std::memory_order_acquire)
+                >= maxMessages_)
+                return false;
+
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            ssize_t diff = (ssize_t)seq - (ssize_t)pos;
+
+            if (diff == 0) {
+                if (writePos_.compare_exchange_weak
+                    (pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else pos = writePos_.load(std::memory_order_relaxed);
+        }
+
+        cell->message = std::move(message);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        signalIfIdle();
+        return true;
+    }
+
+    /* returns up to "number" messages from the queue or all of them if 0 */
+    std::vector<Message> pop_front(size_t number)
+    {
+        std::vector<Message> messages;
+
+        size_t pos = readPos_.load(std::memory_order_relaxed);
+        size_t available = writePos_.load(std::memory_order_relaxed) - pos;
+        if (number == 0 || number > available) {
+            number = available;
+        }
+        messages.reserve(number);
+
+        while (messages.size() < number) {
+            Cell & cell = cells_[pos & mask_];
+            // A producer may have claimed the slot but not filled it yet
+            if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+                break;
+            messages.emplace_back(std::move(cell.message));
+            cell.message = Message();
+            cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+            ++pos;
+        }
+        readPos_.store(pos, std::memory_order_release);
+
+        if (couldPop()) {
+            return messages;
+        }
+
+        /* Clear the flag before looking again so that a push racing with us
+           either sees it cleared and signals, or is seen here. */
+        pending_.store(false);
+        if (couldPop()) {
+            signalIfIdle();
+        }
+
+        return messages;
+    }
+
+    /* number of messages present in the queue */
+    uint64_t size()
+        const
+    {
+        return writePos_.load(std::memory_order_relaxed)
+            - readPos_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+
+    bool couldPop() const
+    {
+        size_t pos = readPos_.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].sequence.load(std::memory_order_acquire)
+            == pos + 1;
+    }
+
+    /* The exchange is a full barrier, which orders it after the store that
+       published the message; see the matching store in pop_front(). */
+    void signalIfIdle()
+    {
+        if (!pending_.exchange(true)) {
+            wakeup_.signal();
+        }
+    }
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    size_t maxMessages_;
+
+    /* producers and the consumer each get their own cache line */
+    char pad0_[64];
+    std::atomic<size_t> writePos_;
+    char pad1_[64];
+    std::atomic<size_t> readPos_;
+    char pad2_[64];
+
+    /* notifications are pending */
+    std::atomic<bool> pending_;
+
+    ML::Wakeup_Fd wakeup_;
+
+    /* callback */
+    OnNotify onNotify_;
+};
+
 } // namespace Datacratic
@@ -0,0 +1,305 @@
+/* uring.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Minimal io_uring submission and completion rings.
+*/
+
+#include "uring.h"
+#include "jml/arch/exception.h"
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* IO URING                                                                  */
+/*****************************************************************************/
+
+#ifdef __NR_io_uring_setup
+
+struct IoUring::Sqe : public io_uring_sqe {
+};
+
+namespace {
+
+int sysSetup(unsigned entries, io_uring_params * params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                   nullptr, 0);
+}
+
+int sysRegister(int fd, unsigned opcode, const void * arg, unsigned numArgs)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, numArgs);
+}
+
+void * ringPtr(void * ring, uint32_t offset)
+{
+    return static_cast<char *>(ring) + offset;
+}
+
+} // file scope
+
+bool
+IoUring::
+available()
+{
+    static const bool result = [] () {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = sysSetup(1, &params);
+        if (fd == -1) return false;
+        ::close(fd);
+        return true;
+    } ();
+
+    return result;
+}
+
+IoUring::
+IoUring(unsigned entries)
+    : fd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes(MAP_FAILED),
+      toSubmit(0)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    fd = sysSetup(entries, &params);
+    if (fd == -1)
+        throw ML::Exception(errno, "io_uring_setup");
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    auto mapRing = [&] (size_t size, uint64_t offset) {
+        void * result = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, offset);
+        if (result == MAP_FAILED) {
+            int err = errno;
+            release();
+            throw ML::Exception(err, "io_uring mmap");
+        }
+        return result;
+    };
+
+    sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = singleMmap ? sqRing : mapRing(cqRingSize, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mapRing(sqesSize, IORING_OFF_SQES);
+
+    sqHead = (unsigned *)ringPtr(sqRing, params.sq_off.head);
+    sqTail = (unsigned *)ringPtr(sqRing, params.sq_off.tail);
+    sqMask = *(unsigned *)ringPtr(sqRing, params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqArray = (unsigned *)ringPtr(sqRing, params.sq_off.array);
+
+    cqHead = (unsigned *)ringPtr(cqRing, params.cq_off.head);
+    cqTail = (unsigned *)ringPtr(cqRing, params.cq_off.tail);
+    cqMask = *(unsigned *)ringPtr(cqRing, params.cq_off.ring_mask);
+    cqes = ringPtr(cqRing, params.cq_off.cqes);
+}
+
+IoUring::
+~IoUring()
+{
+    release();
+}
+
+void
+IoUring::
+release()
+{
+    if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    sqes = cqRing = sqRing = MAP_FAILED;
+
+    if (fd != -1) ::close(fd);
+    fd = -1;
+}
+
+bool
+IoUring::
+registerBuffers(const iovec * buffers, unsigned numBuffers)
+{
+    return sysRegister(fd, IORING_REGISTER_BUFFERS, buffers, numBuffers) == 0;
+}
+
+IoUring::Sqe *
+IoUring::
+nextSqe()
+{
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    if (tail - head >= sqEntries) return nullptr;
+
+    unsigned index = tail & sqMask;
+    Sqe * sqe = static_cast<Sqe *>(sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    return sqe;
+}
+
+bool
+IoUring::
+writeFixed(int fileFd, const void * data, size_t size, uint64_t offset,
+           unsigned bufferIndex, uint64_t userData)
+{
+    Sqe * sqe = nextSqe();
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fileFd;
+    sqe->addr = (uint64_t)data;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = bufferIndex;
+    sqe->user_data = userData;
+
+    __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+    ++toSubmit;
+    return true;
+}
+
+bool
+IoUring::
+write(int fileFd, const iovec * iov, uint64_t offset, uint64_t userData)
+{
+    Sqe * sqe = nextSqe();
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fileFd;
+    sqe->addr = (uint64_t)iov;
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = userData;
+
+    __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+    ++toSubmit;
+    return true;
+}
+
+unsigned
+IoUring::
+submit(unsigned minComplete)
+{
+    if (!toSubmit && !minComplete) return 0;
+
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        int res = sysEnter(fd, toSubmit, minComplete, flags);
+        if (res >= 0) {
+            toSubmit -= res;
+            return res;
+        }
+        if (errno != EINTR)
+            throw ML::Exception(errno, "io_uring_enter");
+    }
+}
+
+bool
+IoUring::
+reap(uint64_t & userData, int & res)
+{
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    const io_uring_cqe & cqe
+        = static_cast<const io_uring_cqe *>(cqes)[head & cqMask];
+    userData = cqe.user_data;
+    res = cqe.res;
+
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else // no io_uring in the headers
+
+struct IoUring::Sqe {
+};
+
+bool
+IoUring::
+available()
+{
+    return false;
+}
+
+IoUring::
+IoUring(unsigned entries)
+{
+    throw ML::Exception("io_uring isn't supported by this build");
+}
+
+IoUring::
+~IoUring()
+{
+}
+
+void
+IoUring::
+release()
+{
+}
+
+bool
+IoUring::
+registerBuffers(const iovec * buffers, unsigned numBuffers)
+{
+    return false;
+}
+
+bool
+IoUring::
+writeFixed(int fileFd, const void * data, size_t size, uint64_t offset,
+           unsigned bufferIndex, uint64_t userData)
+{
+    return false;
+}
+
+bool
+IoUring::
+write(int fileFd, const iovec * iov, uint64_t offset, uint64_t userData)
+{
+    return false;
+}
+
+unsigned
+IoUring::
+submit(unsigned minComplete)
+{
+    return 0;
+}
+
+bool
+IoUring::
+reap(uint64_t & userData, int & res)
+{
+    return false;
+}
+
+#endif
+
+} // namespace Datacratic
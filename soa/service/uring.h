@@ -0,0 +1,97 @@
+/* uring.h                                                         -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Minimal io_uring submission and completion rings.
+*/
+
+#pragma once
+
+#include <sys/uio.h>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* IO URING                                                                  */
+/*****************************************************************************/
+
+/** Thin wrapper around the io_uring system calls, without liburing.  Only
+    what the asynchronous writers need is there: queueing writes, submitting
+    them in batches and reaping the completions, which is done straight from
+    the shared completion ring without a system call.
+
+    Kernels or headers without io_uring are detected at runtime by
+    available(); the constructor throws on them.
+
+    Not thread-safe: a ring belongs to the thread that submits to it.
+*/
+
+struct IoUring {
+
+    /** Whether the running kernel supports io_uring. */
+    static bool available();
+
+    explicit IoUring(unsigned entries = 64);
+    ~IoUring();
+
+    /** Register the buffers for writeFixed().  Returns false, leaving the
+        ring usable with write(), if the kernel refuses them (eg. because of
+        RLIMIT_MEMLOCK).
+    */
+    bool registerBuffers(const iovec * buffers, unsigned numBuffers);
+
+    /** Queue a write of the given registered buffer at the given offset of
+        the file.  Returns false if the submission ring is full.
+    */
+    bool writeFixed(int fd, const void * data, size_t size, uint64_t offset,
+                    unsigned bufferIndex, uint64_t userData);
+
+    /** Same as writeFixed() for any buffer.  The iovec has to stay valid
+        until the write is submitted.
+    */
+    bool write(int fd, const iovec * iov, uint64_t offset, uint64_t userData);
+
+    /** Submit the queued writes and wait for at least minComplete
+        completions.  Returns the number of writes submitted.
+    */
+    unsigned submit(unsigned minComplete = 0);
+
+    /** Take the next completion if there is one.  res is the result of the
+        write: a byte count or a negative errno.
+    */
+    bool reap(uint64_t & userData, int & res);
+
+    unsigned queued() const { return toSubmit; }
+
+private:
+    struct Sqe;
+    Sqe * nextSqe();
+    void release();
+
+    int fd;
+
+    void * sqRing;
+    size_t sqRingSize;
+    void * cqRing;
+    size_t cqRingSize;
+    void * sqes;
+    size_t sqesSize;
+
+    unsigned * sqHead;
+    unsigned * sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned * sqArray;
+
+    unsigned * cqHead;
+    unsigned * cqTail;
+    unsigned cqMask;
+    void * cqes;
+
+    unsigned toSubmit;
+};
+
+} // namespace Datacratic
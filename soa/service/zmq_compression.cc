@@ -0,0 +1,428 @@
+/* zmq_compression.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   LZ4 compression of the payload frames of zeromq messages.
+*/
+
+#include "zmq_compression.h"
+#include "jml/utils/lz4.h"
+#include "jml/utils/hash.h"
+#include "jml/utils/file_functions.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <string.h>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* ZMQ COMPRESSION                                                           */
+/*****************************************************************************/
+
+const std::string ZmqCompression::Marker("\0LZ4", 4);
+
+namespace {
+
+std::atomic<uint64_t> numInstances(0);
+
+std::mutex defaultLock;
+std::shared_ptr<const ZmqCompression> defaultCodec;
+
+/** Per-thread LZ4 state, primed with the dictionary of the last codec that
+    used it.  The dictionary sits at the end of a 64kB window so that the
+    data can reference it, and the data goes right after it.
+*/
+struct ThreadState {
+    ThreadState()
+        : instance(0)
+    {
+    }
+
+    void prime(uint64_t codec, const std::string & dictionary)
+    {
+        if (instance == codec)
+            return;
+
+        window.assign(ZmqCompression::MaxDictionarySize, 0);
+        std::copy(dictionary.begin(), dictionary.end(),
+                  window.end() - dictionary.size());
+
+        // The streaming API needs 192kB of input buffer in front of the
+        // data.  Compressing the dictionary as the first block fills its
+        // hash table, which is then copied for each message.
+        input.assign(3 * ZmqCompression::MaxDictionarySize, 0);
+        std::copy(window.begin(), window.end(), input.begin());
+
+        primed.resize(LZ4_sizeofStreamState());
+        if (LZ4_resetStreamState(&primed[0], &input[0]) != 0)
+            throw ML::Exception("LZ4_resetStreamState");
+        std::vector<char> scratch(LZ4_compressBound(window.size()));
+        LZ4_compress_continue(&primed[0], &input[0], &scratch[0],
+                              window.size());
+
+        state.resize(primed.size());
+        instance = codec;
+    }
+
+    uint64_t instance;
+    std::vector<char> window;   ///< Dictionary, right-aligned in 64kB
+    std::vector<char> input;    ///< Window then the data to compress
+    std::vector<char> primed;   ///< Stream state after the window
+    std::vector<char> state;    ///< Working copy of primed
+    std::vector<char> output;
+};
+
+thread_local ThreadState threadState;
+
+} // file scope
+
+ZmqCompression::
+ZmqCompression(std::string dictionary, size_t threshold)
+    : dictionary_(std::move(dictionary)),
+      dictionaryId_(0),
+      threshold(threshold),
+      instance(++numInstances),
+      framesIn(0), framesOut(0), rawBytesOut(0), wireBytesOut(0)
+{
+    if (dictionary_.size() > MaxDictionarySize)
+        dictionary_.erase(0, dictionary_.size() - MaxDictionarySize);
+
+    if (!dictionary_.empty()) {
+        string hash = ML::md5HashToHex(dictionary_);
+        dictionaryId_ = std::stoull(hash.substr(0, 16), 0, 16);
+        if (dictionaryId_ == 0)
+            dictionaryId_ = 1;
+    }
+}
+
+std::string
+ZmqCompression::
+trainDictionary(const std::vector<std::string> & samples, size_t maxSize)
+{
+    enum {
+        WindowSize = 16,        ///< Length of the substrings that are counted
+        SegmentSize = 64        ///< Length of what goes in the dictionary
+    };
+
+    maxSize = std::min<size_t>(maxSize, MaxDictionarySize);
+
+    auto windowHash = [] (const char * p) {
+        return std::hash<std::string>()(std::string(p, WindowSize));
+    };
+
+    // In how many samples each substring appears
+    std::unordered_map<size_t, uint32_t> counts;
+    for (const string & sample : samples) {
+        std::unordered_set<size_t> seen;
+        for (size_t i = 0;  i + WindowSize <= sample.size();  ++i)
+            seen.insert(windowHash(sample.data() + i));
+        for (size_t h : seen)
+            ++counts[h];
+    }
+
+    // Score the segments of each sample by how common their substrings are
+    struct Segment {
+        uint64_t score;
+        const string * sample;
+        size_t offset;
+    };
+
+    std::vector<Segment> segments;
+    for (const string & sample : samples) {
+        for (size_t start = 0;  start + SegmentSize <= sample.size();
+             start += SegmentSize / 2) {
+            uint64_t score = 0;
+            for (size_t i = start;  i + WindowSize <= start + SegmentSize;  ++i) {
+                uint32_t count = counts[windowHash(sample.data() + i)];
+                if (count > 1)
+                    score += count;
+            }
+            if (score)
+                segments.push_back(Segment { score, &sample, start });
+        }
+    }
+
+    std::sort(segments.begin(), segments.end(),
+              [] (const Segment & s1, const Segment & s2)
+              {
+                  return s1.score > s2.score;
+              });
+
+    // Take the best segments, skipping the ones that are already covered
+    std::vector<string> chosen;
+    std::unordered_set<size_t> covered;
+    size_t total = 0;
+    for (const Segment & segment : segments) {
+        if (total + SegmentSize > maxSize)
+            break;
+
+        const char * data = segment.sample->data() + segment.offset;
+        if (covered.count(windowHash(data))
+            && covered.count(windowHash(data + SegmentSize - WindowSize)))
+            continue;
+
+        for (size_t i = 0;  i + WindowSize <= SegmentSize;  ++i)
+            covered.insert(windowHash(data + i));
+
+        chosen.emplace_back(data, SegmentSize);
+        total += SegmentSize;
+    }
+
+    string result;
+    result.reserve(total);
+    for (auto it = chosen.rbegin();  it != chosen.rend();  ++it)
+        result += *it;
+    return result;
+}
+
+std::shared_ptr<ZmqCompression>
+ZmqCompression::
+load(const std::string & dictionaryFile, size_t threshold)
+{
+    ML::File_Read_Buffer file(dictionaryFile);
+    return std::make_shared<ZmqCompression>
+        (string(file.start(), file.end()), threshold);
+}
+
+std::string
+ZmqCompression::
+offer() const
+{
+    return ML::format("lz4 %016llx", (unsigned long long)dictionaryId_);
+}
+
+int
+ZmqCompression::
+accept(const std::string & peerOffer) const
+{
+    unsigned long long peerId;
+    if (sscanf(peerOffer.c_str(), "lz4 %llx", &peerId) != 1)
+        return -1;
+    return peerId != 0 && peerId == dictionaryId_;
+}
+
+bool
+ZmqCompression::
+isCompressed(const std::vector<zmq::message_t> & message, size_t first)
+{
+    return message.size() > first
+        && message[first].size() == Marker.size()
+        && memcmp(message[first].data(), Marker.data(), Marker.size()) == 0;
+}
+
+bool
+ZmqCompression::
+isCompressed(const std::vector<std::string> & message, size_t first)
+{
+    return message.size() > first && message[first] == Marker;
+}
+
+void
+ZmqCompression::
+compress(std::vector<zmq::message_t> & message, size_t first,
+         bool useDictionary) const
+{
+    if (message.size() <= first)
+        return;
+
+    std::vector<zmq::message_t> result;
+    result.reserve(message.size() + 1);
+    for (size_t i = 0;  i < first;  ++i)
+        result.emplace_back(std::move(message[i]));
+
+    result.emplace_back(Marker);
+
+    for (size_t i = first;  i < message.size();  ++i) {
+        string encoded = encode((const char *)message[i].data(),
+                                message[i].size(), useDictionary);
+        result.emplace_back(encoded);
+    }
+
+    message.swap(result);
+}
+
+bool
+ZmqCompression::
+decompress(std::vector<zmq::message_t> & message, size_t first) const
+{
+    if (!isCompressed(message, first))
+        return false;
+
+    std::vector<zmq::message_t> result;
+    result.reserve(message.size() - 1);
+    for (size_t i = 0;  i < first;  ++i)
+        result.emplace_back(std::move(message[i]));
+
+    for (size_t i = first + 1;  i < message.size();  ++i) {
+        string decoded = decode((const char *)message[i].data(),
+                                message[i].size());
+        result.emplace_back(decoded);
+    }
+
+    message.swap(result);
+    return true;
+}
+
+bool
+ZmqCompression::
+decompress(std::vector<std::string> & message, size_t first) const
+{
+    if (!isCompressed(message, first))
+        return false;
+
+    std::vector<std::string> result;
+    result.reserve(message.size() - 1);
+    for (size_t i = 0;  i < first;  ++i)
+        result.emplace_back(std::move(message[i]));
+
+    for (size_t i = first + 1;  i < message.size();  ++i)
+        result.emplace_back(decode(message[i].data(), message[i].size()));
+
+    message.swap(result);
+    return true;
+}
+
+std::string
+ZmqCompression::
+encode(const char * data, size_t size, bool useDictionary) const
+{
+    enum { HeaderSize = 5 };
+
+    if (size >= threshold && size > HeaderSize && size <= MaxFrameSize) {
+        ThreadState & ts = threadState;
+        ts.output.resize(HeaderSize + LZ4_compressBound(size));
+        char * out = &ts.output[HeaderSize];
+        int maxOut = size - HeaderSize;     // must be worth it
+        int compressed = 0;
+
+        if (useDictionary && dictionaryId_)
+            ts.prime(instance, dictionary_);
+
+        if (useDictionary && dictionaryId_
+            && size <= ts.input.size() - MaxDictionarySize) {
+            std::copy(ts.primed.begin(), ts.primed.end(), ts.state.begin());
+            char * in = &ts.input[MaxDictionarySize];
+            memcpy(in, data, size);
+            compressed = LZ4_compress_limitedOutput_continue
+                (&ts.state[0], in, out, size, maxOut);
+            ts.output[0] = LZ4_DICT;
+        }
+        else {
+            compressed = LZ4_compress_limitedOutput(data, out, size, maxOut);
+            ts.output[0] = LZ4;
+        }
+
+        if (compressed > 0) {
+            uint32_t rawSize = size;
+            memcpy(&ts.output[1], &rawSize, 4);
+
+            framesOut += 1;
+            rawBytesOut += size;
+            wireBytesOut += HeaderSize + compressed;
+            return string(&ts.output[0], HeaderSize + compressed);
+        }
+    }
+
+    string result;
+    result.reserve(size + 1);
+    result.push_back(RAW);
+    result.append(data, size);
+    return result;
+}
+
+std::string
+ZmqCompression::
+decode(const char * data, size_t size) const
+{
+    if (size == 0)
+        throw ML::Exception("empty compressed zmq frame");
+
+    if (data[0] == RAW)
+        return string(data + 1, size - 1);
+
+    if (size < 5)
+        throw ML::Exception("truncated compressed zmq frame");
+
+    uint32_t rawSize;
+    memcpy(&rawSize, data + 1, 4);
+    if (rawSize > MaxFrameSize)
+        throw ML::Exception("compressed zmq frame is too large: %d", rawSize);
+
+    ++framesIn;
+
+    string result(rawSize, '\0');
+    int decoded;
+
+    if (data[0] == LZ4) {
+        decoded = LZ4_decompress_safe(data + 5, &result[0], size - 5, rawSize);
+    }
+    else if (data[0] == LZ4_DICT) {
+        if (!dictionaryId_)
+            throw ML::Exception("zmq frame compressed with a dictionary "
+                                "but none is loaded");
+
+        ThreadState & ts = threadState;
+        ts.prime(instance, dictionary_);
+
+        std::vector<char> & out = ts.output;
+        out.resize(MaxDictionarySize + rawSize);
+        std::copy(ts.window.begin(), ts.window.end(), out.begin());
+        decoded = LZ4_decompress_safe_withPrefix64k
+            (data + 5, &out[MaxDictionarySize], size - 5, rawSize);
+        if (decoded > 0)
+            result.assign(&out[MaxDictionarySize], decoded);
+    }
+    else throw ML::Exception("unknown compressed zmq frame type %d", data[0]);
+
+    if (decoded != (int)rawSize)
+        throw ML::Exception("corrupt compressed zmq frame");
+
+    return result;
+}
+
+ZmqCompression::Stats
+ZmqCompression::
+stats() const
+{
+    Stats result;
+    result.framesIn = framesIn;
+    result.framesOut = framesOut;
+    result.rawBytesOut = rawBytesOut;
+    result.wireBytesOut = wireBytesOut;
+    return result;
+}
+
+std::shared_ptr<const ZmqCompression>
+ZmqCompression::
+getDefault()
+{
+    std::lock_guard<std::mutex> guard(defaultLock);
+    return defaultCodec;
+}
+
+void
+ZmqCompression::
+setDefault(std::shared_ptr<const ZmqCompression> codec)
+{
+    std::lock_guard<std::mutex> guard(defaultLock);
+    defaultCodec = std::move(codec);
+}
+
+const ZmqCompression &
+ZmqCompression::
+plain()
+{
+    static const ZmqCompression result;
+    return result;
+}
+
+} // namespace Datacratic
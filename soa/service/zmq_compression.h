@@ -0,0 +1,149 @@
+/* zmq_compression.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   LZ4 compression of the payload frames of zeromq messages.
+*/
+
+#pragma once
+
+#include "soa/service/zmq.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* ZMQ COMPRESSION                                                           */
+/*****************************************************************************/
+
+/** Compresses the frames of zeromq messages with LZ4, optionally primed with
+    a dictionary, for the links that cross datacenters.
+
+    A compressed message keeps its leading frames (address, topic or channel)
+    as they are, followed by a marker frame and then one frame for each of
+    the original payload frames.  Each of those starts with a byte telling
+    whether it's raw (smaller than the threshold or incompressible), LZ4 or
+    LZ4 with the dictionary, so a receiver never needs to know in advance
+    whether a message was compressed.
+
+    The dictionary only helps if both ends have the same one.  The peers
+    exchange offer() strings, which carry its id, and a sender only uses its
+    dictionary for a peer whose offer has the same id.
+
+    Thread-safe; the per-thread compression state is primed with the
+    dictionary once per thread.
+*/
+
+struct ZmqCompression {
+
+    enum {
+        MaxDictionarySize = 64 * 1024,       ///< LZ4 window
+        MaxFrameSize = 64 * 1024 * 1024
+    };
+
+    /** Frames smaller than threshold bytes are sent raw. */
+    explicit ZmqCompression(std::string dictionary = "",
+                            size_t threshold = 256);
+
+    /** Build a dictionary out of sample messages, eg. bid requests.  The
+        substrings that are found in the most samples are kept, the most
+        common last so that they are the closest to the data and thus the
+        cheapest to reference.
+    */
+    static std::string
+    trainDictionary(const std::vector<std::string> & samples,
+                    size_t maxSize = MaxDictionarySize);
+
+    /** Load a dictionary written by trainDictionary(). */
+    static std::shared_ptr<ZmqCompression>
+    load(const std::string & dictionaryFile, size_t threshold = 256);
+
+    const std::string & dictionary() const { return dictionary_; }
+
+    /** Id of the dictionary, which is 0 without one. */
+    uint64_t dictionaryId() const { return dictionaryId_; }
+
+    /** What this end offers to its peers during the negotiation. */
+    std::string offer() const;
+
+    /** How to compress for a peer given its offer.  Returns -1 if it didn't
+        offer compression, 0 if it did but with another dictionary and 1 if
+        the dictionary can be used.
+    */
+    int accept(const std::string & peerOffer) const;
+
+    /** Compress the frames from first onwards.  Frames before first are left
+        as they are.
+    */
+    void compress(std::vector<zmq::message_t> & message, size_t first,
+                  bool useDictionary) const;
+
+    /** Undo compress() if the message was compressed from first onwards.
+        Returns whether it was.  Throws if it's corrupt or uses a dictionary
+        that isn't this one.
+    */
+    bool decompress(std::vector<zmq::message_t> & message,
+                    size_t first) const;
+    bool decompress(std::vector<std::string> & message, size_t first) const;
+
+    /** Whether the message is compressed from first onwards. */
+    static bool isCompressed(const std::vector<zmq::message_t> & message,
+                             size_t first);
+    static bool isCompressed(const std::vector<std::string> & message,
+                             size_t first);
+
+    struct Stats {
+        uint64_t framesIn;      ///< Compressed frames received
+        uint64_t framesOut;     ///< Compressed frames sent
+        uint64_t rawBytesOut;   ///< Before compression
+        uint64_t wireBytesOut;  ///< After compression
+    };
+
+    Stats stats() const;
+
+    /** Codec that the endpoints negotiate compression with, set from the
+        command line by ServiceProxyArguments.  Null, the default, leaves
+        compression off; the endpoints still decompress what they receive.
+    */
+    static std::shared_ptr<const ZmqCompression> getDefault();
+    static void setDefault(std::shared_ptr<const ZmqCompression> codec);
+
+    /** Codec without a dictionary, which can decompress any message that
+        doesn't use one.
+    */
+    static const ZmqCompression & plain();
+
+    /** Marker frame that starts the compressed frames. */
+    static const std::string Marker;
+
+private:
+    enum FrameType {
+        RAW = 0,
+        LZ4 = 1,
+        LZ4_DICT = 2
+    };
+
+    std::string encode(const char * data, size_t size,
+                       bool useDictionary) const;
+    std::string decode(const char * data, size_t size) const;
+
+    std::string dictionary_;
+    uint64_t dictionaryId_;
+    size_t threshold;
+
+    /// Unique per codec so that the per-thread state can tell them apart
+    uint64_t instance;
+
+    mutable std::atomic<uint64_t> framesIn;
+    mutable std::atomic<uint64_t> framesOut;
+    mutable std::atomic<uint64_t> rawBytesOut;
+    mutable std::atomic<uint64_t> wireBytesOut;
+};
+
+} // namespace Datacratic
@@ -0,0 +1,93 @@
+/** zmq_compression_dict.cc
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Train a dictionary for --zmq-compression-dictionary out of sample
+    messages, eg. bid requests, one per line.
+*/
+
+#include "soa/service/zmq_compression.h"
+#include "jml/utils/filter_streams.h"
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+namespace po = boost::program_options;
+
+using namespace std;
+using namespace Datacratic;
+using namespace ML;
+
+int main(int argc, char* argv[])
+{
+    vector<string> inputs;
+    string output;
+    size_t maxSamples = 100000;
+    size_t maxSize = ZmqCompression::MaxDictionarySize;
+
+    po::options_description desc("Main options");
+    desc.add_options()
+        ("input,i", po::value(&inputs), "files of samples, one per line")
+        ("output,o", po::value(&output), "dictionary file to write")
+        ("max-samples,n", po::value(&maxSamples)->default_value(maxSamples),
+         "number of samples to train on")
+        ("max-size,s", po::value(&maxSize)->default_value(maxSize),
+         "maximum size of the dictionary in bytes")
+        ("help,h", "Produce help message");
+
+    po::positional_options_description pos;
+    pos.add("input", -1);
+    po::variables_map vm;
+    bool showHelp = false;
+
+    try{
+        po::parsed_options parsed = po::command_line_parser(argc, argv)
+            .options(desc)
+            .positional(pos)
+            .run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }catch(const std::exception & exc){
+        cerr << "command line parsing error: " << exc.what() << endl;
+        showHelp = true;
+    }
+
+    if (showHelp || vm.count("help") || inputs.empty() || output.empty()) {
+        cout << desc << "\n";
+        return 1;
+    }
+
+    vector<string> samples;
+    for (const string & input: inputs) {
+        filter_istream stream(input);
+        string line;
+        while (samples.size() < maxSamples && getline(stream, line))
+            if (!line.empty())
+                samples.push_back(line);
+    }
+
+    string dictionary = ZmqCompression::trainDictionary(samples, maxSize);
+
+    filter_ostream stream(output);
+    stream << dictionary;
+
+    // Report what it does on the samples themselves
+    ZmqCompression plain, primed(dictionary);
+    size_t raw = 0, withoutDict = 0, withDict = 0;
+    for (size_t i = 0;  i < samples.size();  i += 10) {
+        vector<zmq::message_t> m1, m2;
+        m1.emplace_back(samples[i]);
+        m2.emplace_back(samples[i]);
+        plain.compress(m1, 0, false);
+        primed.compress(m2, 0, true);
+        raw += samples[i].size();
+        withoutDict += m1[1].size();
+        withDict += m2[1].size();
+    }
+
+    cerr << "trained a " << dictionary.size() << " byte dictionary on "
+         << samples.size() << " samples; " << raw << " sample bytes compress to "
+         << withoutDict << " without it and " << withDict << " with it"
+         << endl;
+}
@@ -20,6 +20,7 @@
 #include "jml/arch/timers.h"
 #include "jml/arch/cmp_xchg.h"
 #include "zmq_utils.h"
+#include "zmq_compression.h"
 
 namespace Datacratic {
 
@@ -531,13 +532,18 @@ struct ZmqNamedEndpoint : public NamedEndpoint, public MessageLoop {
             socket_->tryUnbind(addr.first);
     }
 
+    /** Send a multipart message with one frame per argument.  The frames
+        are encoded before taking the lock on the socket; arguments that are
+        already frames (see sharedMessage()) are sent without being copied.
+    */
     template<typename... Args>
     void sendMessage(Args&&... args)
     {
-        using namespace std;
+        auto frames = encodeFrames(std::forward<Args>(args)...);
+
         std::unique_lock<Lock> guard(lock);
         ExcAssert(socket_);
-        Datacratic::sendMessage(*socket_, std::forward<Args>(args)...);
+        Datacratic::sendFrames(*socket_, std::move(frames));
     }
 
     void sendMessage(const std::vector<std::string> & message)
@@ -548,7 +554,7 @@ struct ZmqNamedEndpoint : public NamedEndpoint, public MessageLoop {
         Datacratic::sendAll(*socket_, message);
     }
 
-    /** Send a raw message on. */
+    /** Send a raw message on.  The frames are moved into zmq. */
     void sendMessage(std::vector<zmq::message_t> && message)
     {
         using namespace std;
@@ -699,7 +705,8 @@ struct ZmqNamedClientBus: public ZmqNamedEndpoint {
 
     ZmqNamedClientBus(std::shared_ptr<zmq::context_t> context,
                       double deadClientDelay = 5.0)
-        : ZmqNamedEndpoint(context), deadClientDelay(deadClientDelay)
+        : ZmqNamedEndpoint(context), deadClientDelay(deadClientDelay),
+          compression(ZmqCompression::getDefault())
     {
     }
 
@@ -737,13 +744,40 @@ struct ZmqNamedClientBus: public ZmqNamedEndpoint {
 
 
 
+    /** Codec used with the clients that negotiated compression; null to
+        never compress.  Defaults to ZmqCompression::getDefault() and must
+        be set before init().
+    */
+    std::shared_ptr<const ZmqCompression> compression;
+
     template<typename... Args>
     void sendMessage(const std::string & address,
                      const std::string & topic,
                      Args&&... args)
     {
-        ZmqNamedEndpoint::sendMessage(address, topic,
-                                      std::forward<Args>(args)...);
+        sendMessage(address, topic,
+                    encodeFrames(std::forward<Args>(args)...));
+    }
+
+    /** Send pre-built frames to the given client without copying them,
+        unless they are compressed for it.
+    */
+    void sendMessage(const std::string & address,
+                     const std::string & topic,
+                     std::vector<zmq::message_t> && frames)
+    {
+        std::vector<zmq::message_t> message;
+        message.reserve(frames.size() + 3);
+        message.emplace_back(encodeMessage(address));
+        message.emplace_back(encodeMessage(topic));
+        for (auto & frame: frames)
+            message.emplace_back(std::move(frame));
+
+        int mode = peerCompression(address);
+        if (mode >= 0)
+            compression->compress(message, 2, mode);
+
+        ZmqNamedEndpoint::sendMessage(std::move(message));
     }
 
     virtual void handleMessage(std::vector<std::string> && message)
@@ -763,7 +797,7 @@ struct ZmqNamedClientBus: public ZmqNamedEndpoint {
                 it = clientInfo.insert(make_pair(agent, ClientInfo())).first;
             }
             it->second.lastHeartbeat = Date::now();
-            sendMessage(agent, "HEARTBEAT");
+            sendHeartbeat(agent, message);
         }
 
         else if (topic == "HELLO") {
@@ -785,9 +819,16 @@ struct ZmqNamedClientBus: public ZmqNamedEndpoint {
                     onConnection(agent);
             }
             it->second.lastHeartbeat = Date::now();
-            sendMessage(agent, "HEARTBEAT");
+            sendHeartbeat(agent, message);
         }
         else {
+            // Clients mark what they compress so it doesn't matter whether
+            // they've seen our answer to their offer yet.
+            if (ZmqCompression::isCompressed(message, 2)) {
+                const ZmqCompression & codec
+                    = compression ? *compression : ZmqCompression::plain();
+                codec.decompress(message, 2);
+            }
             handleClientMessage(message);
         }
 
@@ -809,6 +850,45 @@ struct ZmqNamedClientBus: public ZmqNamedEndpoint {
     }
 
 private:
+    /** Answer a HELLO or HEARTBEAT from a client.  A client that wants
+        compression sends its offer with them, which we answer with ours if
+        we have a codec; a client that stops offering gets raw messages
+        again.
+    */
+    void sendHeartbeat(const std::string & agent,
+                       const std::vector<std::string> & message)
+    {
+        int mode = -1;
+        if (compression && message.size() > 2)
+            mode = compression->accept(message[2]);
+
+        {
+            std::unique_lock<std::mutex> guard(peersLock);
+            if (mode >= 0)
+                compressedPeers[agent] = mode;
+            else compressedPeers.erase(agent);
+        }
+
+        // Heartbeats are never compressed so that the offer can be read.
+        if (mode >= 0)
+            ZmqNamedEndpoint::sendMessage(agent, "HEARTBEAT",
+                                          compression->offer());
+        else ZmqNamedEndpoint::sendMessage(agent, "HEARTBEAT");
+    }
+
+    /** -1 to send raw messages to the client, else whether to use the
+        dictionary.
+    */
+    int peerCompression(const std::string & agent) const
+    {
+        if (!compression)
+            return -1;
+
+        std::unique_lock<std::mutex> guard(peersLock);
+        auto it = compressedPeers.find(agent);
+        return it == compressedPeers.end() ? -1 : it->second;
+    }
+
     void onCheckClient(uint64_t numEvents)
     {
         Date now = Date::now();
@@ -824,6 +904,9 @@ private:
             if (onDisconnection)
                 onDisconnection(d);
             clientInfo.erase(d);
+
+            std::unique_lock<std::mutex> guard(peersLock);
+            compressedPeers.erase(d);
         }
     }
 
@@ -837,6 +920,11 @@ private:
     };
 
     std::map<std::string, ClientInfo> clientInfo;
+
+    /// Clients that negotiated compression, and whether with the dictionary.
+    /// Read by the sending threads, hence the lock.
+    mutable std::mutex peersLock;
+    std::map<std::string, int> compressedPeers;
 };
 
 
@@ -953,8 +1041,20 @@ struct ZmqNamedProxy: public MessageLoop {
         return &socketLock_;
     }
 
+    /** Send a multipart message with one frame per argument.  The frames
+        are encoded before taking the lock on the socket; arguments that are
+        already frames (see sharedMessage()) are sent without being copied.
+    */
     template<typename... Args>
     void sendMessage(Args&&... args)
+    {
+        sendMessage(encodeFrames(std::forward<Args>(args)...));
+    }
+
+    /** Send a multipart message made of pre-built frames which are moved
+        into zmq rather than copied.
+    */
+    void sendMessage(std::vector<zmq::message_t> && frames)
     {
         std::lock_guard<ZmqEventSource::SocketLock> guard(socketLock_);
 
@@ -967,7 +1067,7 @@ struct ZmqNamedProxy: public MessageLoop {
             return;
         }
 
-        Datacratic::sendMessage(socket(), std::forward<Args>(args)...);
+        Datacratic::sendFrames(socket(), std::move(frames));
     }
 
     void disconnect()
@@ -1038,12 +1138,16 @@ protected:
 struct ZmqNamedClientBusProxy : public ZmqNamedProxy {
 
     ZmqNamedClientBusProxy()
-        : timeout(2.0)
+        : timeout(2.0),
+          compression(ZmqCompression::getDefault()),
+          peerCompression(-1)
     {
     }
 
     ZmqNamedClientBusProxy(std::shared_ptr<zmq::context_t> context, int shardIndex = -1)
-        : ZmqNamedProxy(context, shardIndex), timeout(2.0)
+        : ZmqNamedProxy(context, shardIndex), timeout(2.0),
+          compression(ZmqCompression::getDefault()),
+          peerCompression(-1)
     {
     }
 
@@ -1060,8 +1164,18 @@ struct ZmqNamedClientBusProxy : public ZmqNamedProxy {
         auto doMessage = [=] (const std::vector<std::string> & message)
             {
                 const std::string & topic = message.at(0);
-                if (topic == "HEARTBEAT")
+                if (topic == "HEARTBEAT") {
                     this->lastHeartbeat = Date::now();
+                    this->peerCompression = compression && message.size() > 1
+                        ? compression->accept(message[1]) : -1;
+                }
+                else if (ZmqCompression::isCompressed(message, 1)) {
+                    std::vector<std::string> decompressed = message;
+                    const ZmqCompression & codec
+                        = compression ? *compression : ZmqCompression::plain();
+                    codec.decompress(decompressed, 1);
+                    handleMessage(decompressed);
+                }
                 else handleMessage(message);
             };
 
@@ -1072,7 +1186,7 @@ struct ZmqNamedClientBusProxy : public ZmqNamedProxy {
             {
                 if (connectionState != CONNECTED) return;
 
-                sendMessage("HEARTBEAT");
+                sendHello("HEARTBEAT");
             };
 
         addPeriodic("ZmqNamedClientBusProxy::doHeartbeat", 1.0, doHeartbeat);
@@ -1087,8 +1201,9 @@ struct ZmqNamedClientBusProxy : public ZmqNamedProxy {
     virtual void onConnect(const std::string & where)
     {
         lastHeartbeat = Date::now();
+        peerCompression = -1;
 
-        sendMessage("HELLO");
+        sendHello("HELLO");
 
         if (connectHandler)
             connectHandler(where);
@@ -1110,8 +1225,44 @@ struct ZmqNamedClientBusProxy : public ZmqNamedProxy {
             THROW(ZmqLogs::error) << "no message handler set" << std::endl;
     }
 
+    /** Send a multipart message, compressing everything after the topic if
+        the bus accepted our offer.
+    */
+    template<typename... Args>
+    void sendMessage(Args&&... args)
+    {
+        sendMessage(encodeFrames(std::forward<Args>(args)...));
+    }
+
+    void sendMessage(std::vector<zmq::message_t> && frames)
+    {
+        int mode = peerCompression;
+        if (mode >= 0)
+            compression->compress(frames, 1, mode);
+        ZmqNamedProxy::sendMessage(std::move(frames));
+    }
+
     Date lastHeartbeat;
     double timeout;
+
+    /** Codec offered to the bus; null to never compress.  Defaults to
+        ZmqCompression::getDefault() and must be set before connecting.
+    */
+    std::shared_ptr<const ZmqCompression> compression;
+
+private:
+    /** HELLO and HEARTBEAT carry our offer, which the bus answers in its
+        heartbeats.
+    */
+    void sendHello(const char * topic)
+    {
+        if (compression)
+            ZmqNamedProxy::sendMessage(topic, compression->offer());
+        else ZmqNamedProxy::sendMessage(topic);
+    }
+
+    /// -1 until the bus accepts our offer, then whether to use the dictionary
+    std::atomic<int> peerCompression;
 };
 
 
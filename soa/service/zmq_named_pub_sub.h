@@ -11,6 +11,10 @@
 #include "typed_message_channel.h"
 #include <sys/utsname.h>
 #include "jml/arch/backtrace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <set>
 
 namespace Datacratic {
 
@@ -21,14 +25,61 @@ namespace Datacratic {
 /*****************************************************************************/
 
 /** Class that publishes messages.  It also knows what is connected to it.
+
+    The publisher keeps track of the prefixes that its subscribers are
+    subscribed to, and doesn't encode the messages that nobody would
+    receive.
+
+    A subscriber can also ask for only one in every N messages of a prefix by
+    subscribing to sampledTopic(prefix, N) instead of the prefix.  Those
+    messages are sent with a channel of sampledTopic(prefix, N) + channel,
+    that parseSampledChannel() turns back into the channel.
  */
 struct ZmqNamedPublisher: public MessageLoop {
 
     ZmqNamedPublisher(std::shared_ptr<zmq::context_t> context,
                       int messageBufferSize = 65536)
         : publishEndpoint(context),
-          publishQueue(messageBufferSize)
+          publishQueue(messageBufferSize),
+          subscriptions(std::make_shared<Subscriptions>())
+    {
+    }
+
+    /** Topic to subscribe to in order to get one in every keepOneIn messages
+        published on a channel that starts with prefix.
+    */
+    static std::string sampledTopic(const std::string & prefix,
+                                    unsigned keepOneIn)
+    {
+        return SampledMarker + std::to_string(keepOneIn) + SampledMarker
+            + prefix;
+    }
+
+    /** Removes the sampling header from the channel of a sampled message.
+        Returns false and leaves the channel alone if it wasn't sampled.
+    */
+    static bool parseSampledChannel(std::string & channel)
+    {
+        if (channel.empty() || channel[0] != SampledMarker)
+            return false;
+        auto end = channel.find(SampledMarker, 1);
+        if (end == std::string::npos)
+            return false;
+        channel.erase(0, end + 1);
+        return true;
+    }
+
+    /** Whether something is subscribed to the given channel, fully or
+        sampled.  Callers can use it to avoid building what they publish.
+    */
+    bool hasSubscriber(const std::string & channel) const
     {
+        auto subs = std::atomic_load(&subscriptions);
+        if (subs->matchesPlain(channel)) return true;
+        for (const auto & sampled: subs->sampled)
+            if (startsWith(channel, sampled->prefix))
+                return true;
+        return false;
     }
 
     virtual ~ZmqNamedPublisher()
@@ -64,6 +115,12 @@ struct ZmqNamedPublisher: public MessageLoop {
                 cerr << "msg[0].size() = " << msg[0].size() << endl;
                 cerr << "msg[0][0] = " << (int)msg[0][0] << endl;
 #endif
+                if (msg.empty() || msg[0].empty()) return;
+                std::string topic = msg[0].substr(1);
+                if (msg[0][0] == 1) topics.insert(topic);
+                else if (msg[0][0] == 0) topics.erase(topic);
+                else return;
+                updateSubscriptions();
             };
 
         publishEndpoint.messageHandler = doPublishMessage;
@@ -117,20 +174,126 @@ struct ZmqNamedPublisher: public MessageLoop {
     template<typename... Args>
     void publish(const std::string & channel, Args&&... args)
     {
+        auto subs = std::atomic_load(&subscriptions);
+
+        // Sampled subscriptions that get this one
+        const Subscriptions::Sampled * sampledFor[MaxSampledCopies];
+        size_t numSampled = 0;
+        for (const auto & sampled: subs->sampled) {
+            if (numSampled == MaxSampledCopies) break;
+            if (startsWith(channel, sampled->prefix)
+                && sampled->seen.fetch_add(1) % sampled->keepOneIn == 0)
+                sampledFor[numSampled++] = sampled.get();
+        }
+
+        bool plain = subs->matchesPlain(channel);
+        if (!plain && !numSampled) return;
+
         std::vector<zmq::message_t> messages;
-        messages.reserve(sizeof...(Args) + 1);
+        messages.reserve(sizeof...(Args) + 2);
         
         encodeAll(messages, channel,
                   std::forward<Args>(args)...);
-        publishQueue.push(messages);
+        if (compression)
+            compression->compress(messages, 1, true);
+
+        for (size_t i = 0;  i < numSampled;  ++i) {
+            std::vector<zmq::message_t> copy;
+            copy.reserve(messages.size());
+            copy.emplace_back(encodeMessage(sampledFor[i]->header + channel));
+            for (size_t j = 1;  j < messages.size();  ++j) {
+                copy.emplace_back();
+                copy.back().copy(&messages[j]);
+            }
+            publishQueue.push(copy);
+        }
+
+        if (plain)
+            publishQueue.push(messages);
     }
 
+    /** Codec to compress everything after the channel with; null, the
+        default, to publish raw messages.  There's no negotiation on a
+        publisher so this is for when every subscriber decompresses, which
+        ZmqNamedSubscriber does, and has the same dictionary as its default
+        codec.
+    */
+    std::shared_ptr<const ZmqCompression> compression;
+
 private:
+    static constexpr char SampledMarker = '\x02';
+
+    enum {
+        MaxSampledCopies = 8   ///< Sampled subscriptions served per message
+    };
+
+    /** Immutable view of the subscriptions that publish() reads without
+        locking.  Only the sampling counters change.
+    */
+    struct Subscriptions {
+        struct Sampled {
+            Sampled(std::string header, std::string prefix, unsigned keepOneIn)
+                : header(std::move(header)), prefix(std::move(prefix)),
+                  keepOneIn(keepOneIn), seen(0)
+            {
+            }
+
+            std::string header;   ///< Goes in front of the channel
+            std::string prefix;
+            unsigned keepOneIn;
+            mutable std::atomic<uint64_t> seen;
+        };
+
+        bool matchesPlain(const std::string & channel) const
+        {
+            for (const auto & prefix: plain)
+                if (startsWith(channel, prefix))
+                    return true;
+            return false;
+        }
+
+        std::vector<std::string> plain;
+        std::vector<std::unique_ptr<Sampled> > sampled;
+    };
+
+    static bool startsWith(const std::string & str, const std::string & prefix)
+    {
+        return str.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    /** Rebuilds the view of the subscriptions from the topics.  Called from
+        the message loop.
+    */
+    void updateSubscriptions()
+    {
+        auto subs = std::make_shared<Subscriptions>();
+        for (const auto & topic: topics) {
+            std::string prefix = topic;
+            if (!parseSampledChannel(prefix)) {
+                subs->plain.push_back(topic);
+                continue;
+            }
+            unsigned keepOneIn = std::strtoul(topic.c_str() + 1, nullptr, 10);
+            std::string header = topic.substr(0, topic.size() - prefix.size());
+            subs->sampled.emplace_back(
+                    new Subscriptions::Sampled(header, prefix,
+                                               std::max(keepOneIn, 1u)));
+        }
+        std::atomic_store(&subscriptions,
+                          std::shared_ptr<const Subscriptions>(std::move(subs)));
+    }
+
     /// Zeromq endpoint on which messages are published
     ZmqNamedEndpoint publishEndpoint;
 
     /// Queue of things to be published
     TypedMessageSink<std::vector<zmq::message_t> > publishQueue;
+
+    /// Topics that the subscribers are subscribed to; message loop only
+    std::set<std::string> topics;
+
+    /// What publish() goes by; replaced whenever the topics change
+    std::shared_ptr<const Subscriptions> subscriptions;
 };
 
 
@@ -441,6 +604,12 @@ struct ZmqNamedSocket: public MessageLoop {
                   std::make_shared<ZmqBinaryEventSource>
                   (*socket, [=] (std::vector<zmq::message_t> && message)
                    {
+                       // Compressed by a ZmqNamedPublisher after the channel
+                       if (ZmqCompression::isCompressed(message, 1)) {
+                           auto codec = ZmqCompression::getDefault();
+                           (codec ? *codec : ZmqCompression::plain())
+                               .decompress(message, 1);
+                       }
                        this->handleMessage(std::move(message));
                    }));
     }
@@ -958,7 +1127,8 @@ struct ZmqNamedMultipleSubscriber: public MessageLoop {
                     return;
 
                 if (created)
-                    connectService(serviceClass, service, endpointName, local);
+                    connectService(serviceClass, service, endpointName, local,
+                                   prefixes);
                 else
                     disconnectService(serviceClass, service, endpointName);
             };
@@ -989,6 +1159,17 @@ struct ZmqNamedMultipleSubscriber: public MessageLoop {
     void connectService(std::string serviceClass, std::string service,
                         std::string endpointName,
                         bool local = true)
+    {
+        connectService(serviceClass, service, endpointName, local, prefixes);
+    }
+
+    /** Connect to the given service, subscribing to the given prefixes or
+        to everything if there are none.
+    */
+    void connectService(std::string serviceClass, std::string service,
+                        std::string endpointName,
+                        bool local,
+                        const std::vector<std::string> & prefixes)
     {
         using namespace std;
 
@@ -214,6 +214,57 @@ inline zmq::message_t encodeMessage(const Json::Value & j)
     return chomp(j.toString());
 }
 
+/** Turn the given string into a message frame without copying its contents.
+    The string is moved onto the heap and freed by zmq once the last
+    reference to the frame is gone.  Copying the resulting message only bumps
+    a reference count, so it can be built once and sent to any number of
+    recipients.
+*/
+inline zmq::message_t sharedMessage(std::string && str)
+{
+    // Small messages are stored inline by zmq and copied anyway
+    if (str.size() <= 32)
+        return encodeMessage(str);
+
+    std::unique_ptr<std::string> owned(new std::string(std::move(str)));
+    auto freeString = [] (void *, void * hint)
+        {
+            delete reinterpret_cast<std::string *>(hint);
+        };
+
+    zmq::message_t result((void *)owned->data(), owned->size(),
+                          freeString, owned.get());
+    owned.release();
+    return result;
+}
+
+inline zmq::message_t sharedMessage(const std::string & str)
+{
+    return sharedMessage(std::string(str));
+}
+
+/** Turn a string that's shared with the rest of the program into a message
+    frame without copying it.  The frame keeps a reference on the string
+    until zmq is done with it.
+*/
+inline zmq::message_t sharedMessage(std::shared_ptr<const std::string> str)
+{
+    if (str->size() <= 32)
+        return encodeMessage(*str);
+
+    typedef std::shared_ptr<const std::string> Holder;
+    std::unique_ptr<Holder> owned(new Holder(std::move(str)));
+    auto releaseString = [] (void *, void * hint)
+        {
+            delete reinterpret_cast<Holder *>(hint);
+        };
+
+    zmq::message_t result((void *)(*owned)->data(), (*owned)->size(),
+                          releaseString, owned.get());
+    owned.release();
+    return result;
+}
+
 inline bool sendMesg(zmq::socket_t & sock,
                      const std::string & msg,
                      int options = 0)
@@ -243,6 +294,17 @@ inline bool sendMesg(zmq::socket_t & sock,
     return sock.send(msg1, options);
 }
 
+/** Send a copy of an already built frame.  The copy shares the contents of
+    the original (see sharedMessage()) so this never touches the payload.
+*/
+inline bool sendMesg(zmq::socket_t & sock,
+                     const zmq::message_t & msg,
+                     int options = 0)
+{
+    zmq::message_t copy(msg);
+    return sock.send(copy, options);
+}
+
 template<typename T>
 inline bool sendMesg(zmq::socket_t & sock,
                      const T & obj,
@@ -314,7 +376,7 @@ inline void sendMessage(zmq::socket_t & socket,
 template<typename Arg1, typename... Args>
 void sendMessage(zmq::socket_t & socket,
                  const Arg1 & arg1,
-                 Args... args)
+                 const Args &... args)
 {
     if (!sendMesg(socket, arg1, ZMQ_SNDMORE | BLOCK_FLAG)) {
         throwSocketError(__FUNCTION__);
@@ -337,7 +399,8 @@ bool trySendMessage(zmq::socket_t & socket, const Arg1 & arg1)
 }
 
 template<typename Arg1, typename... Args>
-bool trySendMessage(zmq::socket_t & socket, const Arg1 & arg1, Args... args)
+bool trySendMessage(zmq::socket_t & socket, const Arg1 & arg1,
+                    const Args &... args)
 {
     if (!sendMesg(socket, arg1, ZMQ_SNDMORE | BLOCK_FLAG)) {
         if (errno == EAGAIN)
@@ -433,6 +496,86 @@ void recvMesg(zmq::socket_t & sock, std::shared_ptr<T> & val)
     return sharedPtrFromMessage<T>(recvMesg(sock));
 }
 
+
+/* Frames are built with the same encodings as sendMesg() but on their own so
+   that the work can be done before taking the lock on a shared socket.
+*/
+inline zmq::message_t encodeFrame(const zmq::message_t & msg)
+{
+    return zmq::message_t(msg);
+}
+
+template<typename T>
+zmq::message_t encodeFrame(const std::shared_ptr<T> & val)
+{
+    return encodeMessage(sharedPtrToMessage(val));
+}
+
+template<typename T>
+zmq::message_t encodeFrame(const T & obj)
+{
+    return encodeMessage(obj);
+}
+
+template<typename T>
+void appendFrame(std::vector<zmq::message_t> & frames, const T & obj)
+{
+    frames.emplace_back(encodeFrame(obj));
+}
+
+inline void appendFrame(std::vector<zmq::message_t> & frames,
+                        zmq::message_t && msg)
+{
+    frames.emplace_back(std::move(msg));
+}
+
+inline void appendFrame(std::vector<zmq::message_t> & frames,
+                        const std::vector<std::string> & strs)
+{
+    for (auto & str: strs)
+        frames.emplace_back(encodeMessage(str));
+}
+
+inline void appendFrames(std::vector<zmq::message_t> & frames)
+{
+}
+
+template<typename Arg1, typename... Args>
+void appendFrames(std::vector<zmq::message_t> & frames,
+                  Arg1 && arg1, Args &&... args)
+{
+    appendFrame(frames, std::forward<Arg1>(arg1));
+    appendFrames(frames, std::forward<Args>(args)...);
+}
+
+/** Encode each argument into a frame of a multipart message. */
+template<typename... Args>
+std::vector<zmq::message_t> encodeFrames(Args &&... args)
+{
+    std::vector<zmq::message_t> frames;
+    frames.reserve(sizeof...(Args));
+    appendFrames(frames, std::forward<Args>(args)...);
+    return frames;
+}
+
+/** Send a multipart message made of already built frames, which are moved
+    into zmq rather than copied.
+*/
+inline void sendFrames(zmq::socket_t & sock,
+                       std::vector<zmq::message_t> && frames,
+                       int lastFlags = 0)
+{
+    if (frames.empty())
+        throw ML::Exception("can't send an empty message vector");
+
+    for (unsigned i = 0;  i < frames.size();  ++i) {
+        int flags = i == frames.size() - 1
+            ? lastFlags : ZMQ_SNDMORE | BLOCK_FLAG;
+        if (!sock.send(frames[i], flags))
+            throwSocketError(__FUNCTION__);
+    }
+}
+
 inline void close(zmq::socket_t & sock)
 {
     zmq_close(sock);
@@ -69,6 +69,21 @@ std::string printChangeType(ConfigurationService::ChangeType change)
 }
     
 
+ConfigurationService::ChangeType
+changeTypeForEvent(int type)
+{
+    ConfigurationService::ChangeType change;
+    if (type == ZOO_CREATED_EVENT)
+        change = ConfigurationService::CREATED;
+    if (type == ZOO_DELETED_EVENT)
+        change = ConfigurationService::DELETED;
+    if (type == ZOO_CHANGED_EVENT)
+        change = ConfigurationService::VALUE_CHANGED;
+    if (type == ZOO_CHILD_EVENT)
+        change = ConfigurationService::NEW_CHILD;
+    return change;
+}
+
 void
 watcherFn(int type, int state, std::string const & path, void * watcherCtx)
 {
@@ -83,15 +98,7 @@ watcherFn(int type, int state, std::string const & path, void * watcherCtx)
 #endif
 
 
-    ConfigurationService::ChangeType change;
-    if (type == ZOO_CREATED_EVENT)
-        change = ConfigurationService::CREATED;
-    if (type == ZOO_DELETED_EVENT)
-        change = ConfigurationService::DELETED;
-    if (type == ZOO_CHANGED_EVENT)
-        change = ConfigurationService::VALUE_CHANGED;
-    if (type == ZOO_CHILD_EVENT)
-        change = ConfigurationService::NEW_CHILD;
+    ConfigurationService::ChangeType change = changeTypeForEvent(type);
 
     auto & item = *data;
     if (item->watchReferences > 0) {
@@ -117,8 +124,53 @@ getWatcherFn(const ConfigurationService::Watch & watch)
 /* ZOOKEEPER CONFIGURATION SERVICE                                           */
 /*****************************************************************************/
 
+/** Context of the Zookeeper watch held by a cached node. */
+struct ZookeeperConfigurationService::CacheWatch {
+    std::weak_ptr<Cache> cache;
+    std::string key;
+    bool children;
+};
+
+void
+ZookeeperConfigurationService::
+cacheWatcherFn(int type, int state, std::string const & path,
+               void * watcherCtx)
+{
+    std::unique_ptr<CacheWatch> watch(reinterpret_cast<CacheWatch *>(watcherCtx));
+
+    auto cache = watch->cache.lock();
+    if (!cache)
+        return;
+
+    std::vector<WatchData> watches;
+    {
+        std::unique_lock<std::mutex> guard(cache->lock);
+        CacheEntry & entry = cache->entries[watch->key];
+        if (watch->children) {
+            entry.hasChildren = false;
+            entry.children.clear();
+            entry.childrenEpoch++;
+            watches.swap(entry.childrenWatches);
+        }
+        else {
+            entry.hasValue = false;
+            entry.value = Json::Value();
+            entry.valueEpoch++;
+            watches.swap(entry.valueWatches);
+        }
+    }
+
+    // Like Zookeeper's, local watches fire once
+    ConfigurationService::ChangeType change = changeTypeForEvent(type);
+    for (auto & data: watches) {
+        if (data->watchReferences > 0)
+            data->onChange(path, change);
+    }
+}
+
 ZookeeperConfigurationService::
 ZookeeperConfigurationService()
+    : cache(new Cache())
 {
 }
 
@@ -127,6 +179,7 @@ ZookeeperConfigurationService(std::string host,
                               std::string prefix,
                               std::string location,
                               int timeout)
+    : cache(new Cache())
 {
     init(std::move(host), std::move(prefix), std::move(location));
 }
@@ -134,6 +187,8 @@ ZookeeperConfigurationService(std::string host,
 ZookeeperConfigurationService::
 ~ZookeeperConfigurationService()
 {
+    // Close the connection while the cache is still there
+    zoo.reset();
 }
 
 void
@@ -166,17 +221,62 @@ ZookeeperConfigurationService::
 getJson(const std::string & key, Watch watch)
 {
     ExcAssert(zoo);
-    auto val = zoo->readNode(prefix + key, getWatcherFn(watch),
-                             watch.get());
-    try {
+
+    uint64_t epoch;
+    {
+        std::unique_lock<std::mutex> guard(cache->lock);
+        CacheEntry & entry = cache->entries[key];
+        if (entry.hasValue) {
+            if (watch)
+                entry.valueWatches.emplace_back(*std::unique_ptr<WatchData>(watch.get()));
+            return entry.value;
+        }
+        epoch = entry.valueEpoch;
+    }
+
+    auto val = zoo->readNode(prefix + key, cacheWatcherFn,
+                             new CacheWatch { cache, key, false });
+
+    if (val == "") {
+        // Missing nodes can't be watched with a read, so they are not
+        // cached and the watch goes straight to Zookeeper.
+        if (watch)
+            val = zoo->readNode(prefix + key, getWatcherFn(watch),
+                                watch.get());
         if (val == "")
             return Json::Value();
-        return Json::parse(val);
+    }
+
+    Json::Value result;
+    try {
+        result = Json::parse(val);
     } catch (...) {
         cerr << "error parsing JSON entry '" << val << "'" << endl;
         throw;
     }
+
+    std::unique_lock<std::mutex> guard(cache->lock);
+    CacheEntry & entry = cache->entries[key];
+    if (entry.valueEpoch == epoch) {
+        entry.hasValue = true;
+        entry.value = result;
+    }
+    if (watch) {
+        // If the node changed during the read, the watch fired already and
+        // the caller needs to hear about it too
+        if (entry.valueEpoch == epoch)
+            entry.valueWatches.emplace_back(*std::unique_ptr<WatchData>(watch.get()));
+        else {
+            guard.unlock();
+            auto data = *std::unique_ptr<WatchData>(watch.get());
+            if (data->watchReferences > 0)
+                data->onChange(prefix + key, VALUE_CHANGED);
+        }
+    }
+
+    return result;
 }
+
     
 void
 ZookeeperConfigurationService::
@@ -184,6 +284,7 @@ set(const std::string & key,
     const Json::Value & value)
 {
     //cerr << "setting " << key << " to " << value << endl;
+    invalidate(key);
     // TODO: race condition
     if (!zoo->createNode(prefix + key, boost::trim_copy(value.toString()),
                          false, false,
@@ -200,6 +301,7 @@ setUnique(const std::string & key,
 {
     //cerr << "setting unique " << key << " to " << value << endl;
     ExcAssert(zoo);
+    invalidate(key);
     return zoo->createNode(prefix + key, boost::trim_copy(value.toString()),
                            true /* ephemeral */,
                            false /* sequential */,
@@ -214,10 +316,79 @@ getChildren(const std::string & key,
             Watch watch)
 {
     //cerr << "getChildren " << key << " watch " << watch << endl;
-    return zoo->getChildren(prefix + key,
-                            false /* fail if not there */,
-                            getWatcherFn(watch),
-                            watch.get());
+
+    uint64_t epoch;
+    {
+        std::unique_lock<std::mutex> guard(cache->lock);
+        CacheEntry & entry = cache->entries[key];
+        if (entry.hasChildren) {
+            if (watch)
+                entry.childrenWatches.emplace_back(*std::unique_ptr<WatchData>(watch.get()));
+            return entry.children;
+        }
+        epoch = entry.childrenEpoch;
+    }
+
+    // A missing node gets an exists watch, so it can be cached as well
+    auto children = zoo->getChildren(prefix + key,
+                                     false /* fail if not there */,
+                                     cacheWatcherFn,
+                                     new CacheWatch { cache, key, true });
+
+    std::unique_lock<std::mutex> guard(cache->lock);
+    CacheEntry & entry = cache->entries[key];
+    if (entry.childrenEpoch == epoch) {
+        entry.hasChildren = true;
+        entry.children = children;
+    }
+    if (watch) {
+        if (entry.childrenEpoch == epoch)
+            entry.childrenWatches.emplace_back(*std::unique_ptr<WatchData>(watch.get()));
+        else {
+            guard.unlock();
+            auto data = *std::unique_ptr<WatchData>(watch.get());
+            if (data->watchReferences > 0)
+                data->onChange(prefix + key, NEW_CHILD);
+        }
+    }
+
+    return children;
+}
+
+void
+ZookeeperConfigurationService::
+invalidate(const std::string & key)
+{
+    std::unique_lock<std::mutex> guard(cache->lock);
+
+    auto dropValue = [&] (const std::string & k) {
+        auto it = cache->entries.find(k);
+        if (it == cache->entries.end())
+            return;
+        it->second.hasValue = false;
+        it->second.value = Json::Value();
+        it->second.valueEpoch++;
+    };
+    auto dropChildren = [&] (const std::string & k) {
+        auto it = cache->entries.find(k);
+        if (it == cache->entries.end())
+            return;
+        it->second.hasChildren = false;
+        it->second.children.clear();
+        it->second.childrenEpoch++;
+    };
+
+    // The watches stay in place; Zookeeper will trigger them for the change
+    dropValue(key);
+    dropChildren(key);
+
+    // Creating the node may also have created its parents
+    for (auto pos = key.rfind('/');  pos != string::npos;
+         pos = pos == 0 ? string::npos : key.rfind('/', pos - 1)) {
+        dropValue(key.substr(0, pos));
+        dropChildren(key.substr(0, pos));
+    }
+    dropChildren("");
 }
 
 bool
@@ -274,6 +445,21 @@ removePath(const std::string & path)
 {
     ExcAssert(zoo);
     zoo->removePath(prefix + path);
+
+    {
+        std::unique_lock<std::mutex> guard(cache->lock);
+        for (auto & entry: cache->entries) {
+            if (entry.first.compare(0, path.size(), path) != 0)
+                continue;
+            entry.second.hasValue = false;
+            entry.second.value = Json::Value();
+            entry.second.valueEpoch++;
+            entry.second.hasChildren = false;
+            entry.second.children.clear();
+            entry.second.childrenEpoch++;
+        }
+    }
+    invalidate(path);
 }
 
 
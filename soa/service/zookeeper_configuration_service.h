@@ -11,6 +11,8 @@
 
 #include "service_base.h"
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 
 namespace Datacratic {
@@ -21,7 +23,14 @@ struct ZookeeperConnection;
 /* ZOOKEEPER CONFIGURATION SERVICE                                           */
 /*****************************************************************************/
 
-/** Configuration service built on top of Zookeeper. */
+/** Configuration service built on top of Zookeeper.
+
+    The values and children read with a watch are cached.  Each cached node
+    holds a single Zookeeper watch, whatever the number of watches set on
+    it locally; when it fires, the node is dropped from the cache and all
+    of the local watches are triggered.  A burst of changes therefore costs
+    one notification and, however many watchers re-read the node, one read.
+*/
 
 struct ZookeeperConfigurationService
     : public ConfigurationService {
@@ -65,6 +74,49 @@ struct ZookeeperConfigurationService
 private:
     std::unique_ptr<ZookeeperConnection> zoo;
     std::string prefix;
+
+    typedef std::shared_ptr<Watch::Data> WatchData;
+
+    /** Cached state of a node, keyed by its path below the prefix. */
+    struct CacheEntry {
+        CacheEntry()
+            : hasValue(false), hasChildren(false),
+              valueEpoch(0), childrenEpoch(0)
+        {
+        }
+
+        bool hasValue;
+        Json::Value value;
+        std::vector<WatchData> valueWatches;
+
+        bool hasChildren;
+        std::vector<std::string> children;
+        std::vector<WatchData> childrenWatches;
+
+        /* Bumped whenever the Zookeeper watch fires, so that a read that
+           raced with a change doesn't fill the cache with a stale value. */
+        uint64_t valueEpoch;
+        uint64_t childrenEpoch;
+    };
+
+    /** The cache outlives the service if Zookeeper still holds watches
+        that refer to it.
+    */
+    struct Cache {
+        std::mutex lock;
+        std::unordered_map<std::string, CacheEntry> entries;
+    };
+
+    std::shared_ptr<Cache> cache;
+
+    struct CacheWatch;
+    static void cacheWatcherFn(int type, int state, std::string const & path,
+                               void * watcherCtx);
+
+    /** Drop the given node from the cache, as well as its parent's list of
+        children, after it was changed through this service.
+    */
+    void invalidate(const std::string & key);
 };
 
 
@@ -7,11 +7,14 @@
 #include "date.h"
 #include <cmath>
 #include <limits>
+#include <atomic>
 #include "jml/arch/format.h"
 #include "soa/jsoncpp/json.h"
 #include <cmath>
 #include "ace/Time_Value.h"
 #include "jml/arch/exception.h"
+#include "jml/arch/tick_counter.h"
+#include "jml/arch/cpuid.h"
 #include "jml/db/persistent.h"
 #include <boost/regex.hpp>
 
@@ -205,6 +208,112 @@ Date
 Date::
 parseIso8601DateTime(const std::string & dateTimeStr)
 {
+    return parseIso8601DateTime(dateTimeStr.c_str(), dateTimeStr.size());
+}
+
+namespace {
+
+const int64_t powersOfTen[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000
+};
+
+/** Days since 1970-01-01 of the given proleptic Gregorian date. */
+int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = y - era * 400;
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+unsigned daysInMonth(int y, unsigned m)
+{
+    static const unsigned days[12]
+        = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return m == 2 && leap ? 29 : days[m - 1];
+}
+
+/** Reads n digits at p into result. */
+bool parseDigits(const char * p, unsigned n, int & result)
+{
+    int val = 0;
+    for (unsigned i = 0;  i < n;  ++i) {
+        unsigned d = p[i] - '0';
+        if (d > 9) return false;
+        val = val * 10 + d;
+    }
+    result = val;
+    return true;
+}
+
+/** Parses YYYY-MM-DD[T ]HH:MM:SS[.f{1,9}][Z] with the same range checks
+    and the same floating point operations as Iso8601Parser so that the
+    result is identical.  Returns false for anything else, including dates
+    that Iso8601Parser would reject, which are left for it to report.
+*/
+bool parseIso8601Fast(const char * p, size_t len, Date & result)
+{
+    if (len < 19
+        || p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != ' ')
+        || p[13] != ':' || p[16] != ':')
+        return false;
+
+    int year, month, day, hours, minutes, seconds;
+    if (!parseDigits(p, 4, year) || !parseDigits(p + 5, 2, month)
+        || !parseDigits(p + 8, 2, day) || !parseDigits(p + 11, 2, hours)
+        || !parseDigits(p + 14, 2, minutes)
+        || !parseDigits(p + 17, 2, seconds))
+        return false;
+
+    if (year < 1400 || month < 1 || month > 12
+        || day < 1 || day > daysInMonth(year, month)
+        || hours > 23 || minutes > 59 || seconds > 60)
+        return false;
+
+    const char * end = p + len;
+    const char * q = p + 19;
+
+    double time = 3600 * hours + 60 * minutes + seconds;
+
+    if (q != end && *q == '.') {
+        ++q;
+        unsigned n = 0;
+        int fraction = 0;
+        while (q + n != end && n < 10 && unsigned(q[n] - '0') <= 9) {
+            if (n < 9) fraction = fraction * 10 + (q[n] - '0');
+            ++n;
+        }
+        if (n == 0 || n > 9)
+            return false;
+        time += double(fraction) / powersOfTen[n];
+        q += n;
+    }
+
+    if (q != end && *q == 'Z')
+        ++q;
+    if (q != end)
+        return false;
+
+    double days = daysFromCivil(year, month, day) * 86400;
+    result = Date::fromSecondsSinceEpoch(days + time);
+    return true;
+}
+
+} // file scope
+
+Date
+Date::
+parseIso8601DateTime(const char * date, size_t len)
+{
+    Date result;
+    if (parseIso8601Fast(date, len, result))
+        return result;
+
+    std::string dateTimeStr(date, len);
     if (dateTimeStr == "NaD" || dateTimeStr == "NaN")
         return notADate();
     else if (dateTimeStr == "Inf")
@@ -242,10 +351,34 @@ negativeInfinity()
     return result;
 }
 
+namespace {
+
+std::atomic<const Date::Clock *> installedClock(nullptr);
+
+} // file scope
+
+void
+Date::
+setClock(const Clock * clock)
+{
+    installedClock.store(clock);
+}
+
+const Date::Clock *
+Date::
+clock()
+{
+    return installedClock.load(std::memory_order_relaxed);
+}
+
 Date
 Date::
 now()
 {
+    const Clock * clock = installedClock.load(std::memory_order_relaxed);
+    if (JML_UNLIKELY(clock != nullptr))
+        return clock->now();
+
     timespec time;
     int res = clock_gettime(CLOCK_REALTIME, &time);
     if (res == -1)
@@ -253,6 +386,84 @@ now()
     return fromSecondsSinceEpoch(time.tv_sec + time.tv_nsec * 0.000000001);
 }
 
+namespace {
+
+/** Calibration of the tick counter against the real time clock, kept per
+    thread so that reading it needs no synchronization.
+*/
+struct TickClock {
+    uint64_t baseTicks;         ///< Ticks at the last resync
+    double baseSeconds;         ///< Real time at the last resync
+    uint64_t anchorTicks;       ///< Ticks at the first resync
+    double anchorSeconds;       ///< Real time at the first resync
+    double secondsPerTick;
+    uint64_t resyncTicks;       ///< Ticks between two resyncs
+};
+
+__thread TickClock tickClock = { 0, 0.0, 0, 0.0, 0.0, 0 };
+
+const double TickResyncSeconds = 0.1;
+
+bool tickClockUsable()
+{
+#if defined(JML_INTEL_ISA) && (JML_BITS == 64)
+    static const bool result
+        = ML::cpu_info().invariant_tsc && ML::seconds_per_tick > 0.0;
+    return result;
+#else
+    return false;
+#endif
+}
+
+void resync(TickClock & clock, uint64_t ticks)
+{
+    double now = Date::now().secondsSinceEpoch();
+
+    if (!clock.anchorTicks) {
+        clock.anchorTicks = ticks;
+        clock.anchorSeconds = now;
+        clock.secondsPerTick = ML::seconds_per_tick;
+    }
+    else if (now - clock.anchorSeconds >= 1.0) {
+        // Measured over a long period the rate beats the one computed at
+        // startup.  If it's way off then the real time clock was stepped and
+        // we measure again from here.
+        double rate = (now - clock.anchorSeconds) / (ticks - clock.anchorTicks);
+        if (std::abs(rate / ML::seconds_per_tick - 1.0) < 0.01)
+            clock.secondsPerTick = rate;
+        else {
+            clock.anchorTicks = ticks;
+            clock.anchorSeconds = now;
+        }
+    }
+
+    clock.baseTicks = ticks;
+    clock.baseSeconds = now;
+    clock.resyncTicks = TickResyncSeconds / clock.secondsPerTick;
+}
+
+} // file scope
+
+Date
+Date::
+nowFast()
+{
+    if (!tickClockUsable() || installedClock.load(std::memory_order_relaxed))
+        return now();
+
+    TickClock & clock = tickClock;
+    uint64_t ticks = ML::ticks();
+    uint64_t elapsed = ticks - clock.baseTicks;
+
+    if (JML_UNLIKELY(elapsed >= clock.resyncTicks)) {
+        resync(clock, ticks);
+        return fromSecondsSinceEpoch(clock.baseSeconds);
+    }
+
+    return fromSecondsSinceEpoch(clock.baseSeconds
+                                 + elapsed * clock.secondsPerTick);
+}
+
 Date
 Date::
 nowOld()
@@ -270,10 +481,136 @@ isADate() const
     return std::isfinite(secondsSinceEpoch_);
 }
 
+namespace {
+
+/** Broken down UTC time of a whole second along with its printed
+    "YYYY-MM-DD HH:MM:SS" form.  The last one is cached per thread since
+    timestamps tend to be printed in order.
+*/
+struct PrintedSecond {
+    int64_t second;
+    unsigned month;
+    char str[19];
+};
+
+__thread PrintedSecond lastPrinted = { -1, 0, { 0 } };
+
+const char monthNames[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+void writeDigits(char * p, unsigned val, unsigned n)
+{
+    for (int i = n - 1;  i >= 0;  --i) {
+        p[i] = '0' + val % 10;
+        val /= 10;
+    }
+}
+
+/** Inverse of daysFromCivil for a positive number of seconds. */
+const PrintedSecond & printedSecond(int64_t second)
+{
+    PrintedSecond & result = lastPrinted;
+    if (result.second == second)
+        return result;
+
+    unsigned secondOfDay = second % 86400;
+    int64_t days = second / 86400 + 719468;
+
+    int64_t era = days / 146097;
+    unsigned doe = days - era * 146097;
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    unsigned year = yoe + era * 400 + (month <= 2);
+
+    char * p = result.str;
+    writeDigits(p, year, 4);
+    p[4] = '-';
+    writeDigits(p + 5, month, 2);
+    p[7] = '-';
+    writeDigits(p + 8, day, 2);
+    p[10] = ' ';
+    writeDigits(p + 11, secondOfDay / 3600, 2);
+    p[13] = ':';
+    writeDigits(p + 14, secondOfDay / 60 % 60, 2);
+    p[16] = ':';
+    writeDigits(p + 17, secondOfDay % 60, 2);
+
+    result.month = month;
+    result.second = second;
+    return result;
+}
+
+/** Dates that the fast path handles: positive and before the year 10000,
+    with no more than 9 digits of fraction.
+*/
+bool canPrintFast(double secondsSinceEpoch, unsigned digits)
+{
+    return secondsSinceEpoch >= 0 && secondsSinceEpoch < 253402300800.0
+        && digits <= 9;
+}
+
+/** Splits the date into whole seconds and the fraction rounded to the
+    given number of digits, carrying into the seconds when it rounds up
+    to 1.  No digits means the seconds are truncated as strftime does.
+*/
+int64_t splitSeconds(double secondsSinceEpoch, unsigned digits,
+                     int64_t & fraction)
+{
+    int64_t second = secondsSinceEpoch;
+    fraction = 0;
+    if (digits) {
+        // Rounds half to even like printf does
+        double scaled = (secondsSinceEpoch - second) * powersOfTen[digits];
+        fraction = nearbyint(scaled);
+        if (fraction >= powersOfTen[digits]) {
+            fraction -= powersOfTen[digits];
+            ++second;
+        }
+    }
+    return second;
+}
+
+size_t writeFraction(char * p, int64_t fraction, unsigned digits)
+{
+    if (!digits)
+        return 0;
+    p[0] = '.';
+    writeDigits(p + 1, fraction, digits);
+    return digits + 1;
+}
+
+size_t copyToBuffer(const std::string & str, char * buffer, size_t size)
+{
+    if (str.size() >= size)
+        throw ML::Exception("date buffer of size %zd is too small for %s",
+                            size, str.c_str());
+    memcpy(buffer, str.c_str(), str.size() + 1);
+    return str.size();
+}
+
+void checkBufferSize(size_t needed, size_t size)
+{
+    if (needed >= size)
+        throw ML::Exception("date buffer of size %zd is too small for "
+                            "%zd characters", size, needed);
+}
+
+} // file scope
+
 std::string
 Date::
 print(unsigned seconds_digits) const
 {
+    char buffer[PRINT_BUFFER_SIZE];
+    if (canPrintFast(secondsSinceEpoch_, seconds_digits))
+        return std::string(buffer,
+                           print(buffer, sizeof(buffer), seconds_digits));
+
     if (!std::isfinite(secondsSinceEpoch_)) {
         if (std::isnan(secondsSinceEpoch_)) {
             return "NaD";
@@ -294,6 +631,30 @@ print(unsigned seconds_digits) const
     return result;
 }
 
+size_t
+Date::
+print(char * buffer, size_t size, unsigned seconds_digits) const
+{
+    if (!canPrintFast(secondsSinceEpoch_, seconds_digits))
+        return copyToBuffer(print(seconds_digits), buffer, size);
+
+    int64_t fraction;
+    int64_t second = splitSeconds(secondsSinceEpoch_, seconds_digits,
+                                  fraction);
+    const PrintedSecond & printed = printedSecond(second);
+
+    // YYYY-Mon-DD HH:MM:SS
+    size_t len = 20 + (seconds_digits ? seconds_digits + 1 : 0);
+    checkBufferSize(len, size);
+
+    memcpy(buffer, printed.str, 5);
+    memcpy(buffer + 5, monthNames[printed.month - 1], 3);
+    memcpy(buffer + 8, printed.str + 7, 12);
+    writeFraction(buffer + 20, fraction, seconds_digits);
+    buffer[len] = 0;
+    return len;
+}
+
 std::string
 Date::
 printRfc2616() const
@@ -315,6 +676,11 @@ std::string
 Date::
 printIso8601(unsigned int fraction) const
 {
+    char buffer[PRINT_BUFFER_SIZE];
+    if (canPrintFast(secondsSinceEpoch_, fraction))
+        return std::string(buffer,
+                           printIso8601(buffer, sizeof(buffer), fraction));
+
     if (!std::isfinite(secondsSinceEpoch_)) {
         if (std::isnan(secondsSinceEpoch_)) {
             return "NaD";
@@ -338,10 +704,38 @@ printIso8601(unsigned int fraction) const
     return result;
 }
 
+size_t
+Date::
+printIso8601(char * buffer, size_t size, unsigned int fraction) const
+{
+    if (!canPrintFast(secondsSinceEpoch_, fraction))
+        return copyToBuffer(printIso8601(fraction), buffer, size);
+
+    int64_t fractionValue;
+    int64_t second = splitSeconds(secondsSinceEpoch_, fraction,
+                                  fractionValue);
+    const PrintedSecond & printed = printedSecond(second);
+
+    // YYYY-MM-DDTHH:MM:SS[.fff]Z
+    size_t len = 20 + (fraction ? fraction + 1 : 0);
+    checkBufferSize(len, size);
+
+    memcpy(buffer, printed.str, 19);
+    buffer[10] = 'T';
+    size_t pos = 19 + writeFraction(buffer + 19, fractionValue, fraction);
+    buffer[pos] = 'Z';
+    buffer[len] = 0;
+    return len;
+}
+
 std::string
 Date::
 printClassic() const
 {
+    char buffer[PRINT_BUFFER_SIZE];
+    if (canPrintFast(secondsSinceEpoch_, 0))
+        return std::string(buffer, printClassic(buffer, sizeof(buffer)));
+
     if (!std::isfinite(secondsSinceEpoch_)) {
         if (std::isnan(secondsSinceEpoch_)) {
             return "NaD";
@@ -355,6 +749,22 @@ printClassic() const
     return print("%Y-%m-%d %H:%M:%S");
 }
 
+size_t
+Date::
+printClassic(char * buffer, size_t size) const
+{
+    if (!canPrintFast(secondsSinceEpoch_, 0))
+        return copyToBuffer(printClassic(), buffer, size);
+
+    const PrintedSecond & printed = printedSecond(secondsSinceEpoch_);
+
+    // YYYY-MM-DD HH:MM:SS
+    checkBufferSize(19, size);
+    memcpy(buffer, printed.str, 19);
+    buffer[19] = 0;
+    return 19;
+}
+
 Date
 Date::
 quantized(double fraction) const
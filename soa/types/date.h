@@ -82,6 +82,12 @@ struct Date {
     static Date parseDefaultUtc(const std::string & date);
     static Date parseIso8601DateTime(const std::string & date);
 
+    /** Same as above.  The common YYYY-MM-DDTHH:MM:SS[.fff][Z] form is
+        parsed with integer arithmetic only; anything else goes through
+        Iso8601Parser.
+    */
+    static Date parseIso8601DateTime(const char * date, size_t len);
+
     // Deprecated
     static Date parseIso8601(const std::string & date);
 
@@ -91,6 +97,33 @@ struct Date {
     static Date now();
     static Date nowOld();
 
+    /** Same as now() but read from the CPU's tick counter, which costs a few
+        nanoseconds instead of a system call.  The counter is resynchronized
+        with the real time clock every 100ms by each thread so the two never
+        differ by more than a few microseconds.  Falls back to now() when the
+        tick counter doesn't run at a constant rate.
+    */
+    static Date nowFast();
+
+    /** Source of the time for now() and nowFast() to return in place of
+        the real time clock, for simulations that run on a time of their
+        own.  See setClock().
+    */
+    struct Clock {
+        virtual ~Clock() {}
+        virtual Date now() const = 0;
+    };
+
+    /** Make now() and nowFast() return the time of the given clock, or of
+        the real time clock again when it's null.  The clock must stay alive
+        while it's installed, and should be installed before the threads
+        that read the time are started.
+    */
+    static void setClock(const Clock * clock);
+
+    /** Clock installed with setClock(), or null for the real time clock. */
+    static const Clock * clock();
+
     bool isADate() const;
 
     double secondsSinceEpoch() const
@@ -104,6 +137,24 @@ struct Date {
     std::string printRfc2616() const;
     std::string printClassic() const;
 
+    /** Versions of print(), printIso8601() and printClassic() which write
+        into a caller provided buffer of the given size instead of
+        allocating.  They return the number of characters written, followed
+        by a nul, and throw if the buffer is too small; PRINT_BUFFER_SIZE is
+        always enough for up to 9 digits of fraction.
+
+        The date part is only formatted once per second and per thread,
+        which makes printing timestamps in order mostly a matter of writing
+        the fraction.
+    */
+    enum { PRINT_BUFFER_SIZE = 40 };
+
+    size_t print(char * buffer, size_t size,
+                 unsigned seconds_digits = 0) const;
+    size_t printIso8601(char * buffer, size_t size,
+                        unsigned int fraction = 3) const;
+    size_t printClassic(char * buffer, size_t size) const;
+
     bool operator == (const Date & other) const
     {
         return secondsSinceEpoch_ == other.secondsSinceEpoch_;
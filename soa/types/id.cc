@@ -13,6 +13,10 @@
 #include "jml/utils/exc_assert.h"
 #include "soa/jsoncpp/value.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace ML;
 using namespace std;
 
@@ -95,6 +99,76 @@ inline int hexToDec2(int c)
     return v;
 }
 
+/** Case of the letters seen by decodeHex16(). */
+enum {
+    HEX_LOWER = 1,
+    HEX_UPPER = 2
+};
+
+/** Decodes exactly 16 hex digits, most significant first, into val and ors
+    the case of the letters into letterCase.  Returns false if any of them is
+    not a hex digit, in which case val is meaningless.
+
+    With SSE2 the 16 characters are classified and converted in a handful of
+    instructions instead of one table lookup and branch per character.
+*/
+JML_ALWAYS_INLINE bool
+decodeHex16(const char * p, uint64_t & val, int & letterCase)
+{
+#ifdef __SSE2__
+    __m128i c = _mm_loadu_si128((const __m128i *)p);
+
+    // Ranges are checked with signed compares, which is fine since
+    // characters over 0x7f are negative and fall outside all of them.
+    auto inRange = [&] (char lo, char hi)
+        {
+            return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                                 _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+        };
+
+    __m128i digit = inRange('0', '9');
+    __m128i lower = inRange('a', 'f');
+    __m128i upper = inRange('A', 'F');
+
+    __m128i valid = _mm_or_si128(digit, _mm_or_si128(lower, upper));
+    if (_mm_movemask_epi8(valid) != 0xffff)
+        return false;
+
+    if (_mm_movemask_epi8(lower)) letterCase |= HEX_LOWER;
+    if (_mm_movemask_epi8(upper)) letterCase |= HEX_UPPER;
+
+    __m128i offset
+        = _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8('0')),
+                       _mm_or_si128(_mm_and_si128(lower, _mm_set1_epi8('a' - 10)),
+                                    _mm_and_si128(upper, _mm_set1_epi8('A' - 10))));
+    __m128i nibbles = _mm_sub_epi8(c, offset);
+
+    // Each 16 bit lane holds the high nibble in its low byte and the low
+    // nibble in its high byte; fold them into one byte per lane and pack
+    // the lanes into the low 8 bytes, first digit pair first.
+    __m128i bytes
+        = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0xff)), 4),
+                       _mm_srli_epi16(nibbles, 8));
+    bytes = _mm_packus_epi16(bytes, bytes);
+
+    val = __builtin_bswap64(_mm_cvtsi128_si64(bytes));
+    return true;
+#else
+    uint64_t result = 0;
+    for (unsigned i = 0;  i < 16;  ++i) {
+        int c = p[i];
+        int v = hexToDec(c);
+        if (v == -1)
+            return false;
+        if (c >= 'a') letterCase |= HEX_LOWER;
+        else if (c >= 'A') letterCase |= HEX_UPPER;
+        result = (result << 4) + v;
+    }
+    val = result;
+    return true;
+#endif
+}
+
 void
 Id::
 parse(const char * value, size_t len, Type type)
@@ -146,60 +220,29 @@ parse(const char * value, size_t len, Type type)
         if (value[18] != '-') break;
         if (value[23] != '-') break;
 
-        unsigned f1;
-        short f2, f3, f4;
-        unsigned long long f5;
-
-        const char * p = value;
-        bool failed = false;
-        int capsType = -1; // -1 = unknown, 0 = no, 1 = yes
-
-        auto scanRange = [&] (int start, int len) -> unsigned long long
-            {
-                unsigned long long val = 0;
-                for (unsigned i = start;  i != start + len;  ++i) {
-                    int c = p[i];
-                    {
-                        // case handling
-                        if (c >= 'a' && c <= 'f') {
-                            if (capsType == -1) {
-                                capsType = 0;
-                            }
-                            else if (capsType != 0) {
-                                failed = true;
-                                return val;
-                            }
-                        }
-                        else if (c >= 'A' && c <= 'F') {
-                            if (capsType == -1) {
-                                capsType = 1;
-                            }
-                            else if (capsType != 1) {
-                                failed = true;
-                                return val;
-                            }
-                        }
-                    }
-                    int v = hexToDec(c);
-                    if (v == -1) {
-                        failed = true;
-                        return val;
-                    }
-                    val = (val << 4) + v;
-                }
-                return val;
-            };
-
-        f1 = scanRange(0, 8);
-        f2 = scanRange(9, 4);
-        f3 = scanRange(14, 4);
-        if (failed) break;
-        f4 = scanRange(19, 4);
-        f5 = scanRange(24, 12);
-        if (failed) break;
+        // Gather the 32 digits without the dashes so that they can be
+        // decoded as two 16 digit blocks.
+        char digits[32];
+        memcpy(digits, value, 8);
+        memcpy(digits + 8, value + 9, 4);
+        memcpy(digits + 12, value + 14, 4);
+        memcpy(digits + 16, value + 19, 4);
+        memcpy(digits + 20, value + 24, 12);
 
-        r.type = capsType == 1 ? UUID_CAPS : UUID;
-        r.f1 = f1;  r.f2 = f2;  r.f3 = f3;  r.f4 = f4;  r.f5 = f5;
+        uint64_t high, low;
+        int letterCase = 0;
+        if (!decodeHex16(digits, high, letterCase)) break;
+        if (!decodeHex16(digits + 16, low, letterCase)) break;
+
+        // Mixed case doesn't round trip so it's kept as a string
+        if (letterCase == (HEX_LOWER | HEX_UPPER)) break;
+
+        r.type = (letterCase & HEX_UPPER) ? UUID_CAPS : UUID;
+        r.f1 = high >> 32;
+        r.f2 = high >> 16;
+        r.f3 = high;
+        r.f4 = low >> 48;
+        r.f5 = low;
         finish();
         return;
     }
@@ -316,37 +359,9 @@ parse(const char * value, size_t len, Type type)
 
     while ((type == UNKNOWN || type == HEX128LC) && len == 32) {
         uint64_t high, low;
-
-        const char * p = value;
-        bool failed = false;
-
-        auto scanRange = [&] (int start, int len) -> unsigned long long
-            {
-                uint64_t val = 0;
-                for (unsigned i = start;  i != start + len;  ++i) {
-                    int c = p[i];
-                    int v = hexToDec(c);
-
-                    //cerr << "c = " << c << " " << p[i] << " v = " << v << endl;
-
-                    if (v == -1) {
-                        failed = true;
-                        return val;
-                    }
-                    val = (val << 4) + v;
-                }
-
-                //cerr << "val = " << val << " failed = " << failed << endl;
-
-                return val;
-            };
-
-        high = scanRange(0, 16);
-        if (failed)
-            break;
-        low = scanRange(16, 16);
-        if (failed)
-            break;
+        int letterCase = 0;
+        if (!decodeHex16(value, high, letterCase)) break;
+        if (!decodeHex16(value + 16, low, letterCase)) break;
 
         r.type = HEX128LC;
         r.val1 = high;
@@ -387,104 +402,122 @@ compoundId2() const
 }
     
     
-std::string
+namespace {
+
+const char lowerHexDigits[] = "0123456789abcdef";
+const char upperHexDigits[] = "0123456789ABCDEF";
+
+// Encoding tables, indexed by the value of the 6 bit group
+const char googBase64Digits[]
+    = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-_";
+const char base64_96Digits[]
+    = "+/0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+JML_ALWAYS_INLINE void
+writeHex(char * out, uint64_t val, int numDigits, const char * digits)
+{
+    for (int i = numDigits - 1;  i >= 0;  --i) {
+        out[i] = digits[val & 15];
+        val >>= 4;
+    }
+}
+
+} // file scope
+
+void
 Id::
-toString() const
+appendTo(std::string & result) const
 {
+    // Long enough for all the fixed size types, the longest being a 128 bit
+    // BIGDEC at 39 digits.
+    char buf[40];
+
     switch (type) {
     case NONE:
-        return "";
+        return;
     case NULLID:
-        return "null";
+        result.append("null", 4);
+        return;
     case UUID:
-        return ML::format(
-            "%08lx-%04x-%04x-%04x-%012llx",
-            (unsigned)f1, (unsigned)f2, (unsigned)f3, (unsigned)f4,
-            (unsigned long long)f5);
-    case UUID_CAPS:
-        return ML::format(
-            "%08lX-%04X-%04X-%04X-%012llX",
-            (unsigned)f1, (unsigned)f2, (unsigned)f3, (unsigned)f4,
-            (unsigned long long)f5);
+    case UUID_CAPS: {
+        const char * digits = type == UUID ? lowerHexDigits : upperHexDigits;
+        writeHex(buf, f1, 8, digits);
+        buf[8] = '-';
+        writeHex(buf + 9, f2, 4, digits);
+        buf[13] = '-';
+        writeHex(buf + 14, f3, 4, digits);
+        buf[18] = '-';
+        writeHex(buf + 19, f4, 4, digits);
+        buf[23] = '-';
+        writeHex(buf + 24, f5, 12, digits);
+        result.append(buf, 36);
+        return;
+    }
     case GOOG128: {
         // Google ID: --> CAESEAYra3NIxLT9C8twKrzqaA
-        string result = "CAESE                     ";
-
-        auto b64Encode = [] (unsigned i) -> int
-            {
-                if (i < 10) return i + '0';
-                if (i < 36) return i - 10 + 'A';
-                if (i < 62) return i - 36 + 'a';
-                if (i == 62) return '-';
-                if (i == 63) return '_';
-                throw ML::Exception("bad goog base64 char");
-            };
-
+        memcpy(buf, "CAESE", 5);
         __uint128_t v = val;
         for (unsigned i = 0;  i < 21;  ++i) {
-            result[25 - i] = b64Encode(v & 63);  v = v >> 6;
+            buf[25 - i] = googBase64Digits[v & 63];  v = v >> 6;
         }
-        return result;
+        result.append(buf, 26);
+        return;
     }
     case BIGDEC: {
-        string result;
+        char * end = buf + sizeof(buf);
+        char * p = end;
         if (val2 == 0) {
-            if (val1 == 0) {
-                return "0";
-            }
-            result.reserve(max64_base10_len);
             uint64_t v = val1;
-            while (v) {
-                int c = v % 10;
+            do {
+                *--p = '0' + v % 10;
                 v /= 10;
-                result += c + '0';
-            }
+            } while (v);
         }
         else {
             __uint128_t v = val;
-            result.reserve(32);
-            while (v) {
-                int c = v % 10;
+            do {
+                *--p = '0' + v % 10;
                 v /= 10;
-                result += c + '0';
-            }
+            } while (v);
         }
-        std::reverse(result.begin(), result.end());
-        return result;
+        result.append(p, end);
+        return;
     }
     case BASE64_96: {
-        string result = "                ";
-
-        auto b64Encode = [] (unsigned i) -> int
-            {
-                if (i == 0) return '+';
-                if (i == 1) return '/';
-                if (i < 12) return '0' + i - 2;
-                if (i < 38) return 'A' + i - 12;
-                if (i < 64) return 'a' + i - 38;
-                throw ML::Exception("bad base64 char");
-            };
-
         __uint128_t v = val;
         for (unsigned i = 0;  i < 16;  ++i) {
-            result[15 - i] = b64Encode(v & 63);  v = v >> 6;
+            buf[15 - i] = base64_96Digits[v & 63];  v = v >> 6;
         }
-        return result;
-    }
-    case HEX128LC: {
-        return ML::format("%016llx%016llx",
-                          (unsigned long long)val1,
-                          (unsigned long long)val2);
+        result.append(buf, 16);
+        return;
     }
+    case HEX128LC:
+        writeHex(buf, val1, 16, lowerHexDigits);
+        writeHex(buf + 16, val2, 16, lowerHexDigits);
+        result.append(buf, 32);
+        return;
     case COMPOUND2:
-        return compoundId1().toString() + ":" + compoundId2().toString();
+        compoundId1().appendTo(result);
+        result += ':';
+        compoundId2().appendTo(result);
+        return;
     case STR:
-        return std::string(str, str + len);
+        result.append(str, len);
+        return;
     default:
         throw ML::Exception("unknown ID type");
     }
 }
 
+std::string
+Id::
+toString() const
+{
+    std::string result;
+    appendTo(result);
+    return result;
+}
+
 bool
 Id::
 complexEqual(const Id & other) const
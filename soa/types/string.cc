@@ -9,12 +9,92 @@
 #include <iostream>
 #include "jml/arch/exception.h"
 #include "jml/db/persistent.h"
+#include "jml/compiler/compiler.h"
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
 
 namespace Datacratic {
 
+namespace {
+
+/** Returns the position of the first byte at or after pos that isn't
+    ASCII, or n if there is none.
+
+    With SSE2 the sign bits of 16 bytes are tested at once, so that the runs
+    of ASCII text that make up most strings cost one compare per 16 bytes.
+*/
+JML_ALWAYS_INLINE size_t
+skipAscii(const char * p, size_t pos, size_t n)
+{
+#ifdef __SSE2__
+    for (;  pos + 16 <= n;  pos += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + pos));
+        int high = _mm_movemask_epi8(c);
+        if (high)
+            return pos + __builtin_ctz(high);
+    }
+#else
+    for (;  pos + 8 <= n;  pos += 8) {
+        uint64_t c;
+        std::memcpy(&c, p + pos, 8);
+        if (c & 0x8080808080808080ULL)
+            break;
+    }
+#endif
+    while (pos < n && !(p[pos] & 0x80))
+        ++pos;
+    return pos;
+}
+
+/** Returns the position of the first invalid utf-8 sequence of the n bytes
+    at p, or n if they are all valid.
+
+    Every byte of a multi-byte sequence has its high bit set, so only the
+    runs of non-ASCII bytes are handed to utf8cpp and a sequence cut short
+    by an ASCII byte is caught as truncated.
+*/
+size_t
+findInvalidUtf8(const char * p, size_t n)
+{
+    size_t pos = 0;
+    while ((pos = skipAscii(p, pos, n)) < n) {
+        size_t end = pos + 1;
+        while (end < n && (p[end] & 0x80))
+            ++end;
+
+        const char * invalid = utf8::find_invalid(p + pos, p + end);
+        if (invalid != p + end)
+            return invalid - p;
+        pos = end;
+    }
+    return n;
+}
+
+/** Number of bytes of the n at p that aren't ASCII. */
+size_t
+countNonAscii(const char * p, size_t n)
+{
+    size_t result = 0;
+    size_t pos = 0;
+#ifdef __SSE2__
+    for (;  pos + 16 <= n;  pos += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + pos));
+        result += __builtin_popcount(_mm_movemask_epi8(c));
+    }
+#endif
+    for (;  pos < n;  ++pos)
+        result += (p[pos] & 0x80) != 0;
+    return result;
+}
+
+} // file scope
+
 
 /*****************************************************************************/
 /* UTF8STRING                                                                */
@@ -23,47 +103,42 @@ namespace Datacratic {
 Utf8String
 Utf8String::fromLatin1(const std::string & lat1Str)
 {
-    size_t bufferSize = lat1Str.size();
-    const char *inBuf = lat1Str.c_str();
-    string utf8Str(bufferSize * 4, '.');
-
-    auto iter = utf8Str.begin();
-    auto start = iter;
-    for (size_t i = 0; i < bufferSize; i++) {
-        uint32_t cp(inBuf[i] & 0xff);
-        iter = utf8::append(cp, iter);
+    const char * in = lat1Str.data();
+    size_t n = lat1Str.size();
+
+    // Each latin-1 character over 0x7f takes two bytes in utf-8
+    string utf8Str(n + countNonAscii(in, n), '\0');
+    char * out = &utf8Str[0];
+
+    size_t pos = 0;
+    while (pos < n) {
+        size_t end = skipAscii(in, pos, n);
+        std::memcpy(out, in + pos, end - pos);
+        out += end - pos;
+        if (end == n)
+            break;
+
+        unsigned char c = in[end];
+        *out++ = 0xc0 | (c >> 6);
+        *out++ = 0x80 | (c & 0x3f);
+        pos = end + 1;
     }
-    utf8Str.resize(iter-start);
 
-    return Utf8String(utf8Str);
+    return Utf8String(std::move(utf8Str), false /* check */);
 }
 
 Utf8String::Utf8String(const string & in, bool check)
     : data_(in)
 {
-    if (check)
-    {
-        // Check if we find an invalid encoding
-        string::const_iterator end_it = utf8::find_invalid(in.begin(), in.end());
-        if (end_it != in.end())
-        {
-            throw ML::Exception("Invalid sequence within utf-8 string");
-        }
-    }
+    if (check && findInvalidUtf8(in.data(), in.size()) != in.size())
+        throw ML::Exception("Invalid sequence within utf-8 string");
 }
 
 Utf8String::Utf8String(string && in, bool check)
     : data_(std::move(in))
 {
-    if (check)
-    {
-        // Check if we find an invalid encoding
-        string::const_iterator end_it = utf8::find_invalid(data_.begin(), data_.end());
-        if (end_it != data_.end())
-        {
-            throw ML::Exception("Invalid sequence within utf-8 string");
-        }
-    }
+    if (check && findInvalidUtf8(data_.data(), data_.size()) != data_.size())
+        throw ML::Exception("Invalid sequence within utf-8 string");
 }
 
 Utf8String::const_iterator
@@ -0,0 +1,121 @@
+/** date_bench.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Times printing timestamps with the std::string versions of Date's print
+    functions against the versions that write into a buffer, as well as
+    parsing them back with parseIso8601DateTime() against Iso8601Parser.
+
+    Timestamps are consecutive and a few microseconds apart, the way a
+    logger sees them.
+
+    Also times reading the clock with now() and nowFast().
+
+*/
+
+#include "soa/types/date.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Datacratic;
+
+
+template<typename Fn>
+void bench(const char* what, size_t passes, size_t n, Fn fn)
+{
+    // Warms up the caches and the allocator.
+    fn();
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t pass = 0; pass < passes; ++pass) fn();
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    double ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+    printf("%-28s %8.1f ns/date\n", what, ns / (passes * n));
+}
+
+int main(int argc, char** argv)
+{
+    size_t numDates = argc > 1 ? atoi(argv[1]) : 10000;
+    size_t passes = argc > 2 ? atoi(argv[2]) : 100;
+
+    vector<Date> dates;
+    Date date = Date::now();
+    for (size_t i = 0; i < numDates; ++i) {
+        dates.push_back(date);
+        date.addSeconds((random() % 1000) / 1e6);
+    }
+
+    vector<string> strs;
+    for (const Date& d : dates)
+        strs.push_back(d.printIso8601(6));
+
+    size_t sink = 0;
+    char buffer[Date::PRINT_BUFFER_SIZE];
+
+    bench("printIso8601", passes, numDates, [&] {
+                for (const Date& d : dates)
+                    sink += d.printIso8601(6).size();
+            });
+
+    bench("printIso8601(buffer)", passes, numDates, [&] {
+                for (const Date& d : dates)
+                    sink += d.printIso8601(buffer, sizeof(buffer), 6);
+            });
+
+    bench("print", passes, numDates, [&] {
+                for (const Date& d : dates)
+                    sink += d.print(3).size();
+            });
+
+    bench("print(buffer)", passes, numDates, [&] {
+                for (const Date& d : dates)
+                    sink += d.print(buffer, sizeof(buffer), 3);
+            });
+
+    bench("printClassic", passes, numDates, [&] {
+                for (const Date& d : dates)
+                    sink += d.printClassic().size();
+            });
+
+    bench("printClassic(buffer)", passes, numDates, [&] {
+                for (const Date& d : dates)
+                    sink += d.printClassic(buffer, sizeof(buffer));
+            });
+
+    bench("Iso8601Parser", passes, numDates, [&] {
+                for (const string& str : strs) {
+                    Date d = Iso8601Parser::parseDateTimeString(str);
+                    sink += d.secondsSinceEpoch();
+                }
+            });
+
+    bench("parseIso8601DateTime", passes, numDates, [&] {
+                for (const string& str : strs) {
+                    Date d = Date::parseIso8601DateTime(str.c_str(), str.size());
+                    sink += d.secondsSinceEpoch();
+                }
+            });
+
+    double seconds = 0.0;
+
+    bench("now", passes, numDates, [&] {
+                for (size_t i = 0; i < numDates; ++i)
+                    seconds += Date::now().secondsSinceEpoch();
+            });
+
+    bench("nowFast", passes, numDates, [&] {
+                for (size_t i = 0; i < numDates; ++i)
+                    seconds += Date::nowFast().secondsSinceEpoch();
+            });
+
+    if (!sink || !seconds) fprintf(stderr, "nothing was done\n");
+
+    return 0;
+}
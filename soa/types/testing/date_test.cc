@@ -589,3 +589,89 @@ BOOST_AUTO_TEST_CASE( test_second )
     }
 
 }
+
+BOOST_AUTO_TEST_CASE( test_print_to_buffer )
+{
+    char buffer[Date::PRINT_BUFFER_SIZE];
+
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        Date d = Date::fromSecondsSinceEpoch(random() + random() / 1e9);
+
+        // The date part has to agree with strftime
+        size_t len = d.printClassic(buffer, sizeof(buffer));
+        BOOST_CHECK_EQUAL(string(buffer, len), d.print("%Y-%m-%d %H:%M:%S"));
+
+        len = d.print(buffer, sizeof(buffer), 0);
+        BOOST_CHECK_EQUAL(string(buffer, len), d.print("%Y-%b-%d %H:%M:%S"));
+        BOOST_CHECK_EQUAL(buffer[len], 0);
+
+        len = d.printIso8601(buffer, sizeof(buffer), 0);
+        BOOST_CHECK_EQUAL(string(buffer, len),
+                          d.print("%Y-%m-%dT%H:%M:%S") + "Z");
+
+        // and the fraction with printf, unless it rounded up to the next
+        // second
+        string fraction = ML::format("%.6f", d.fractionalSeconds());
+        if (fraction[0] == '0') {
+            len = d.printIso8601(buffer, sizeof(buffer), 6);
+            BOOST_CHECK_EQUAL(string(buffer, len),
+                              d.print("%Y-%m-%dT%H:%M:%S")
+                              + fraction.substr(1) + "Z");
+        }
+    }
+
+    // Rounding carries into the seconds
+    Date d = Date::fromSecondsSinceEpoch(59.9996);
+    size_t len = d.printIso8601(buffer, sizeof(buffer), 3);
+    BOOST_CHECK_EQUAL(string(buffer, len), "1970-01-01T00:01:00.000Z");
+
+    // Dates out of the fast path's range go through the slow one
+    len = Date::notADate().printIso8601(buffer, sizeof(buffer));
+    BOOST_CHECK_EQUAL(string(buffer, len), "NaD");
+    len = Date::positiveInfinity().printClassic(buffer, sizeof(buffer));
+    BOOST_CHECK_EQUAL(string(buffer, len), "Inf");
+
+    BOOST_CHECK_THROW(Date::now().printIso8601(buffer, 24, 3), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_fast_iso8601_parse )
+{
+    // The fast path has to give exactly the same dates as Iso8601Parser
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        Date d = Date::fromSecondsSinceEpoch(random());
+        string str = d.print("%Y-%m-%dT%H:%M:%S");
+
+        switch (i % 4) {
+        case 1: str += "Z"; break;
+        case 2: str += ML::format(".%03dZ", i % 1000); break;
+        case 3: str += ML::format(".%09d", i * 7919); break;
+        }
+
+        BOOST_CHECK_EQUAL(Date::parseIso8601DateTime(str).secondsSinceEpoch(),
+                          Iso8601Parser::parseDateTimeString(str)
+                          .secondsSinceEpoch());
+    }
+
+    // Invalid dates are still reported by Iso8601Parser
+    BOOST_CHECK_THROW(Date::parseIso8601DateTime("2013-02-29T00:00:00"),
+                      std::exception);
+    BOOST_CHECK_THROW(Date::parseIso8601DateTime("2013-01-01T24:00:00"),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_now_fast )
+{
+    // Being descheduled between the two calls makes them differ, so only
+    // most of them have to agree.
+    int close = 0;
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        Date before = Date::now();
+        Date fast = Date::nowFast();
+        Date after = Date::now();
+        if (fast.secondsSince(before) > -0.0001
+            && after.secondsSince(fast) > -0.0001)
+            ++close;
+    }
+
+    BOOST_CHECK_GT(close, 9900);
+}
@@ -0,0 +1,182 @@
+/** id_bench.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Times Id::parse() for each of the id forms seen in bid requests and
+    compares printing them with toString() against appendTo() into a reused
+    buffer.
+
+    Prints the time and the number of allocations per id so that changes to
+    Id can be compared against a baseline.
+
+*/
+
+#include "soa/types/id.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Datacratic;
+
+
+/******************************************************************************/
+/* ALLOCATIONS                                                                */
+/******************************************************************************/
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+} // namespace anonymous
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+
+/******************************************************************************/
+/* IDS                                                                        */
+/******************************************************************************/
+
+struct Form
+{
+    string name;
+    function<string(mt19937_64&)> make;
+};
+
+string randomHex(mt19937_64& rng, size_t digits, const char* alphabet)
+{
+    string result;
+    for (size_t i = 0; i < digits; ++i)
+        result += alphabet[rng() % 16];
+    return result;
+}
+
+vector<Form> makeForms()
+{
+    static const char lower[] = "0123456789abcdef";
+    static const char upper[] = "0123456789ABCDEF";
+    static const char goog[] =
+        "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-_";
+
+    auto uuid = [] (mt19937_64& rng, const char* alphabet) {
+        return randomHex(rng, 8, alphabet) + "-"
+            + randomHex(rng, 4, alphabet) + "-"
+            + randomHex(rng, 4, alphabet) + "-"
+            + randomHex(rng, 4, alphabet) + "-"
+            + randomHex(rng, 12, alphabet);
+    };
+
+    return {
+        { "UUID", [=] (mt19937_64& rng) { return uuid(rng, lower); } },
+        { "UUID_CAPS", [=] (mt19937_64& rng) { return uuid(rng, upper); } },
+        { "HEX128LC", [=] (mt19937_64& rng) {
+                return randomHex(rng, 32, lower);
+            }},
+        { "GOOG128", [=] (mt19937_64& rng) {
+                string result = "CAESE";
+                for (size_t i = 0; i < 21; ++i) result += goog[rng() % 64];
+                return result;
+            }},
+        { "BIGDEC", [=] (mt19937_64& rng) {
+                return to_string(rng() | (1ULL << 62));
+            }},
+        { "STR", [=] (mt19937_64& rng) {
+                return "user-" + randomHex(rng, 20, lower);
+            }},
+    };
+}
+
+
+/******************************************************************************/
+/* RUN                                                                        */
+/******************************************************************************/
+
+template<typename Fn>
+void bench(const string& form, const char* what, size_t passes, size_t n, Fn fn)
+{
+    // Warms up the caches and the allocator.
+    fn();
+
+    uint64_t allocStart = allocations.load();
+    auto start = chrono::steady_clock::now();
+
+    for (size_t pass = 0; pass < passes; ++pass) fn();
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    uint64_t allocs = allocations.load() - allocStart;
+
+    double total = passes * n;
+    double ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+    printf("%-10s %-10s %8.1f ns/id %6.2f allocs/id\n",
+            form.c_str(), what, ns / total, allocs / total);
+}
+
+int main(int argc, char** argv)
+{
+    size_t numIds = argc > 1 ? atoi(argv[1]) : 1000;
+    size_t passes = argc > 2 ? atoi(argv[2]) : 1000;
+
+    mt19937_64 rng(0);
+
+    for (const Form& form : makeForms()) {
+        vector<string> strs;
+        for (size_t i = 0; i < numIds; ++i)
+            strs.push_back(form.make(rng));
+
+        vector<Id> ids(strs.size());
+        for (size_t i = 0; i < strs.size(); ++i) {
+            ids[i].parse(strs[i]);
+            if (ids[i].toString() != strs[i]) {
+                fprintf(stderr, "%s doesn't round trip\n", strs[i].c_str());
+                return 1;
+            }
+        }
+
+        size_t sink = 0;
+
+        bench(form.name, "parse", passes, numIds, [&] {
+                    Id id;
+                    for (const auto& str : strs) {
+                        id.parse(str);
+                        sink += id.type;
+                    }
+                });
+
+        bench(form.name, "toString", passes, numIds, [&] {
+                    for (const auto& id : ids)
+                        sink += id.toString().size();
+                });
+
+        string buffer;
+        bench(form.name, "appendTo", passes, numIds, [&] {
+                    for (const auto& id : ids) {
+                        buffer.clear();
+                        id.appendTo(buffer);
+                        sink += buffer.size();
+                    }
+                });
+
+        if (!sink) fprintf(stderr, "nothing was done\n");
+    }
+
+    return 0;
+}
@@ -348,3 +348,58 @@ BOOST_AUTO_TEST_CASE( test_compound_id )
 {
     Id id(Id("hello"), Id("world"));
 }
+
+BOOST_AUTO_TEST_CASE( test_hex_id_decoding )
+{
+    // Every digit position and value has to land in the right place
+    string hex = "0123456789abcdeffedcba9876543210";
+    Id id(hex);
+    BOOST_CHECK_EQUAL(id.type, Id::HEX128LC);
+    BOOST_CHECK_EQUAL(id.val1, 0x0123456789abcdefULL);
+    BOOST_CHECK_EQUAL(id.val2, 0xfedcba9876543210ULL);
+    BOOST_CHECK_EQUAL(id.toString(), hex);
+
+    Id uuid("01234567-89ab-cdef-fedc-ba9876543210");
+    BOOST_CHECK_EQUAL(uuid.type, Id::UUID);
+    BOOST_CHECK_EQUAL(uuid.f1, 0x01234567);
+    BOOST_CHECK_EQUAL(uuid.f2, 0x89ab);
+    BOOST_CHECK_EQUAL(uuid.f3, 0xcdef);
+    BOOST_CHECK_EQUAL(uuid.f4, 0xfedc);
+    BOOST_CHECK_EQUAL(uuid.f5, 0xba9876543210ULL);
+
+    // Characters just outside the hex ranges, and past 0x7f, aren't digits
+    for (const char * bad : { "/", ":", "@", "G", "`", "g", "\xb0" }) {
+        string str = hex;
+        str[20] = bad[0];
+        BOOST_CHECK_EQUAL(Id(str).type, Id::STR);
+
+        str = "0828398c-5965-11e0-84c8-0026b937c8e1";
+        str[30] = bad[0];
+        BOOST_CHECK_EQUAL(Id(str).type, Id::STR);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_id_append_to )
+{
+    vector<Id> ids = {
+        Id(""),
+        Id("null"),
+        Id("0828398c-5965-11e0-84c8-0026b937c8e1"),
+        Id("0828398C-5965-11E0-84C8-0026B937C8E1"),
+        Id("CAESEAYra3NIxLT9C8twKrzqaA"),
+        Id("0"),
+        Id("7394206091425759590"),
+        Id("123456789012345678901234567890123456789"),
+        Id("abcdefgh01234567"),
+        Id("0123456789abcdef0123456789abcdef"),
+        Id("hello"),
+        Id(Id("hello"), Id("1234"))
+    };
+
+    string buffer = "prefix";
+    for (const Id & id : ids) {
+        buffer.resize(6);
+        id.appendTo(buffer);
+        BOOST_CHECK_EQUAL(buffer, "prefix" + id.toString());
+    }
+}
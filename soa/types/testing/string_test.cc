@@ -119,6 +119,43 @@ BOOST_AUTO_TEST_CASE( test_u32_string )
 
 }
 
+BOOST_AUTO_TEST_CASE( test_utf8_validation )
+{
+    // Place the multi-byte sequences at every offset around the 16 byte
+    // blocks that are checked at once
+    string padding(40, 'x');
+    for (size_t i = 0;  i <= 34;  ++i) {
+        string prefix = padding.substr(0, i);
+
+        BOOST_CHECK_NO_THROW(Utf8String(prefix + "jérôme" + prefix));
+        BOOST_CHECK_NO_THROW(Utf8String(prefix + "\xf0\x9f\x98\x80"));
+
+        // Truncated, cut by an ascii byte, overlong and lone continuation
+        for (const char * bad: { "\xc3", "\xe2\x82x", "\xc0\xaf", "\x80" }) {
+            BOOST_CHECK_THROW(Utf8String(prefix + bad + prefix), ML::Exception);
+            BOOST_CHECK_NO_THROW(Utf8String(prefix + bad, false));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_from_latin1 )
+{
+    string latin1;
+    for (int i = 0;  i < 3;  ++i)
+        for (int c = 1;  c < 256;  ++c)
+            latin1 += char(c);
+
+    Utf8String utf8 = Utf8String::fromLatin1(latin1);
+
+    string expected;
+    for (unsigned char c: latin1)
+        utf8::append(c, back_inserter(expected));
+    BOOST_CHECK_EQUAL(utf8.rawString(), expected);
+
+    BOOST_CHECK_EQUAL(Utf8String::fromLatin1("").rawString(), "");
+    BOOST_CHECK_EQUAL(Utf8String::fromLatin1("caf\xe9").rawString(), "café");
+}
+
 BOOST_AUTO_TEST_CASE( test_basic_dtoa )
 {
     double value = 365.0;
@@ -0,0 +1,55 @@
+/* url_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Tests for the Url class.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include "soa/types/url.h"
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace Datacratic;
+
+string str(const pair<const char *, size_t> & range)
+{
+    return string(range.first, range.second);
+}
+
+BOOST_AUTO_TEST_CASE( test_ranges )
+{
+    Url url("http://www.Example.com/some/page.html?a=1&b=2#frag");
+
+    BOOST_CHECK_EQUAL(url.spec(), url.toString());
+    BOOST_CHECK_EQUAL(str(url.hostRange()), url.host());
+    BOOST_CHECK_EQUAL(str(url.hostRange()), "www.example.com");
+    BOOST_CHECK_EQUAL(str(url.pathRange()), url.path());
+    BOOST_CHECK_EQUAL(str(url.pathRange()), "/some/page.html");
+    BOOST_CHECK_EQUAL(str(url.queryRange()), url.query());
+    BOOST_CHECK_EQUAL(str(url.queryRange()), "a=1&b=2");
+
+    // The ranges all point into the same buffer
+    BOOST_CHECK(url.hostRange().first >= url.spec().data());
+    BOOST_CHECK(url.queryRange().first
+                < url.spec().data() + url.spec().size());
+}
+
+BOOST_AUTO_TEST_CASE( test_ranges_missing )
+{
+    Url url("example.com");
+    BOOST_CHECK_EQUAL(url.spec(), "http://example.com/");
+    BOOST_CHECK_EQUAL(str(url.pathRange()), "/");
+    BOOST_CHECK_EQUAL(str(url.queryRange()), "");
+
+    Url empty;
+    BOOST_CHECK_EQUAL(empty.spec(), "");
+    BOOST_CHECK_EQUAL(str(empty.hostRange()), "");
+    BOOST_CHECK_EQUAL(str(empty.pathRange()), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_file_path )
+{
+    Url url("file://some/dir/file.txt");
+    BOOST_CHECK_EQUAL(str(url.pathRange()), url.path());
+}
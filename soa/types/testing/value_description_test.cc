@@ -524,3 +524,68 @@ BOOST_AUTO_TEST_CASE( test_date_value_description_validation )
     BOOST_CHECK_EQUAL(numChildValidations, 1);
     BOOST_CHECK_EQUAL(numParentValidations, 1);
 }
+
+/* Field names sharing their length, first characters or last character with
+   each other so that the field index has to tell them apart. */
+struct ManyFields {
+    int w, h, wmin, wmax, hmin, hmax, ab, ba, abc, acb, cab, tagid, tmax;
+    int bidfloor, bidfloorcur, pos, pmp, id, imp, instl, exp, ext;
+    Json::Value unparseable;
+};
+
+CREATE_STRUCTURE_DESCRIPTION(ManyFields);
+
+ManyFieldsDescription::ManyFieldsDescription()
+{
+    addField("w", &ManyFields::w, "");
+    addField("h", &ManyFields::h, "");
+    addField("wmin", &ManyFields::wmin, "");
+    addField("wmax", &ManyFields::wmax, "");
+    addField("hmin", &ManyFields::hmin, "");
+    addField("hmax", &ManyFields::hmax, "");
+    addField("ab", &ManyFields::ab, "");
+    addField("ba", &ManyFields::ba, "");
+    addField("abc", &ManyFields::abc, "");
+    addField("acb", &ManyFields::acb, "");
+    addField("cab", &ManyFields::cab, "");
+    addField("tagid", &ManyFields::tagid, "");
+    addField("tmax", &ManyFields::tmax, "");
+    addField("bidfloor", &ManyFields::bidfloor, "");
+    addField("bidfloorcur", &ManyFields::bidfloorcur, "");
+    addField("pos", &ManyFields::pos, "");
+    addField("pmp", &ManyFields::pmp, "");
+    addField("id", &ManyFields::id, "");
+    addField("imp", &ManyFields::imp, "");
+    addField("instl", &ManyFields::instl, "");
+    addField("exp", &ManyFields::exp, "");
+    addField("ext", &ManyFields::ext, "");
+    collectUnparseableJson(&ManyFields::unparseable);
+}
+
+BOOST_AUTO_TEST_CASE( test_structure_field_lookup )
+{
+    ManyFieldsDescription desc;
+
+    string json = "{";
+    int i = 0;
+    desc.forEachField(nullptr, [&] (const ValueDescription::FieldDescription & fd)
+        {
+            json += "\"" + fd.fieldName + "\":" + to_string(i++) + ",";
+        });
+    json += "\"wmid\":1,\"x\":2,\"\":3,\"abcd\":4,\"bidfloorcu\":5}";
+
+    ManyFields result;
+    StreamingJsonParsingContext context(json, json.c_str(),
+                                        json.c_str() + json.size());
+    desc.parseJson(&result, context);
+
+    i = 0;
+    desc.forEachField(nullptr, [&] (const ValueDescription::FieldDescription & fd)
+        {
+            BOOST_CHECK_EQUAL(*(int *)fd.getFieldPtr(&result), i++);
+        });
+
+    BOOST_CHECK_EQUAL(result.unparseable.size(), 5);
+    BOOST_CHECK_EQUAL(result.unparseable["wmid"].asInt(), 1);
+    BOOST_CHECK_EQUAL(result.unparseable["bidfloorcu"].asInt(), 5);
+}
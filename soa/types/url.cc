@@ -22,6 +22,15 @@ struct Init {
     }
 } init;
 
+std::pair<const char *, size_t>
+componentRange(const GURL & url, int begin, int len)
+{
+    if (len <= 0)
+        return std::make_pair("", 0);
+    return std::make_pair(url.possibly_invalid_spec().data() + begin,
+                          size_t(len));
+}
+
 }
 
 Url::
@@ -82,9 +91,16 @@ Url::
 std::string
 Url::
 toString() const
+{
+    return spec();
+}
+
+const std::string &
+Url::
+spec() const
 {
     if (valid())
-        return canonical();
+        return url->spec();
     return original;
 }
 
@@ -156,6 +172,14 @@ host() const
     return url->host();
 }
 
+std::pair<const char *, size_t>
+Url::
+hostRange() const
+{
+    const auto & host = url->parsed_for_possibly_invalid_spec().host;
+    return componentRange(*url, host.begin, host.len);
+}
+
 bool
 Url::
 hostIsIpAddress() const
@@ -193,6 +217,30 @@ query() const
     return url->query();
 }
 
+std::pair<const char *, size_t>
+Url::
+pathRange() const
+{
+    const auto & parsed = url->parsed_for_possibly_invalid_spec();
+
+    // As in path(), file urls keep their host as part of the path; the two
+    // are adjacent in the spec.
+    if (url->SchemeIsFile() && parsed.host.len > 0) {
+        int end = parsed.path.len > 0 ? parsed.path.end() : parsed.host.end();
+        return componentRange(*url, parsed.host.begin,
+                              end - parsed.host.begin);
+    }
+    return componentRange(*url, parsed.path.begin, parsed.path.len);
+}
+
+std::pair<const char *, size_t>
+Url::
+queryRange() const
+{
+    const auto & query = url->parsed_for_possibly_invalid_spec().query;
+    return componentRange(*url, query.begin, query.len);
+}
+
 uint64_t
 Url::
 urlHash()
@@ -28,6 +28,11 @@ struct Url {
     Utf8String toUtf8String() const;
     std::string toString() const;  // should be Utf8 by default
 
+    /** Same as toString() but returns a reference to the canonical url
+        held internally instead of a copy.
+    */
+    const std::string & spec() const;
+
     const char * c_str() const;
 
     bool valid() const;
@@ -38,12 +43,23 @@ struct Url {
     std::string username() const;
     std::string password() const;
     std::string host() const;
+
+    /** Same as host() but points into the url instead of copying it; only
+        valid for as long as the url isn't modified.
+    */
+    std::pair<const char *, size_t> hostRange() const;
     bool hostIsIpAddress() const;
     bool domainMatches(const std::string & str) const;
     int port() const;
     std::string path() const;
     std::string query() const;
 
+    /** Non-copying versions of path() and query(); the same caveats as for
+        hostRange() apply.
+    */
+    std::pair<const char *, size_t> pathRange() const;
+    std::pair<const char *, size_t> queryRange() const;
+
     uint64_t urlHash();
     uint64_t hostHash();
 
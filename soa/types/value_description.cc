@@ -108,4 +108,78 @@ convertAndCopy(const void * from,
     parseJson(to, context2);
 }
 
+
+/*****************************************************************************/
+/* STRUCTURE DESCRIPTION BASE                                                */
+/*****************************************************************************/
+
+void
+StructureDescriptionBase::FieldIndex::
+build(const Fields & fields)
+{
+    slots.clear();
+    seed = mask = 0;
+
+    if (fields.empty())
+        return;
+
+    // Seeds tried for each table size before it's doubled.  Tables grow to
+    // at most 8 times their smallest size, after which the best seed found
+    // is kept and collisions are resolved by probing.
+    //
+    // Names are taken from the field descriptions, which don't move once
+    // they are in the map.
+    enum { SEEDS = 256 };
+
+    size_t minSize = 8;
+    while (minSize < 2 * fields.size())
+        minSize *= 2;
+
+    auto countCollisions = [&] (uint32_t seed, size_t size)
+        {
+            std::vector<bool> used(size);
+            int collisions = 0;
+            for (auto & f: fields) {
+                auto & name = f.second.fieldName;
+                uint32_t i = hash(name.c_str(), name.size(), seed) & (size - 1);
+                if (used[i]) ++collisions;
+                used[i] = true;
+            }
+            return collisions;
+        };
+
+    size_t bestSize = minSize;
+    uint32_t bestSeed = 0;
+    int bestCollisions = countCollisions(0, minSize);
+
+    for (size_t size = minSize;
+         bestCollisions && size <= 8 * minSize;  size *= 2) {
+        for (uint32_t s = 0;  s < SEEDS && bestCollisions;  ++s) {
+            int collisions = countCollisions(s, size);
+            if (collisions < bestCollisions) {
+                bestSize = size;
+                bestSeed = s;
+                bestCollisions = collisions;
+            }
+        }
+    }
+
+    seed = bestSeed;
+    mask = bestSize - 1;
+    slots.resize(bestSize, Slot{ nullptr, 0, nullptr });
+
+    for (auto & f: fields) {
+        auto & name = f.second.fieldName;
+        for (uint32_t i = hash(name.c_str(), name.size(), seed);;  ++i) {
+            Slot & slot = slots[i & mask];
+            if (slot.field)
+                continue;
+            slot.name = name.c_str();
+            slot.len = name.size();
+            slot.field = &f.second;
+            break;
+        }
+    }
+}
+
 } // namespace Datacratic
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <cstring>
 #include <string>
 #include <memory>
 #include <unordered_map>
@@ -791,6 +792,71 @@ struct StructureDescriptionBase {
 
     std::vector<Fields::const_iterator> orderedFields;
 
+    /** Hash table from field name to field used to look up the keys of the
+        objects being parsed.  It's rebuilt by indexFields() whenever a field
+        is added, which only happens while the description is set up, so
+        parsing never touches the map.
+
+        The hash mixes the length with the first two and the last character
+        of the name and its seed is searched for one that gives no
+        collisions, which for the few dozen fields of a structure makes the
+        lookup a single probe followed by a memcmp.  Linear probing is kept
+        for when no such seed is found.
+    */
+    struct FieldIndex {
+        FieldIndex()
+            : seed(0), mask(0)
+        {
+        }
+
+        void build(const Fields & fields);
+
+        const FieldDescription * find(const char * name) const
+        {
+            if (slots.empty())
+                return nullptr;
+
+            size_t len = strlen(name);
+            for (uint32_t i = hash(name, len, seed);;  ++i) {
+                const Slot & slot = slots[i & mask];
+                if (!slot.field)
+                    return nullptr;
+                if (slot.len == len && memcmp(slot.name, name, len) == 0)
+                    return slot.field;
+            }
+        }
+
+        static uint32_t hash(const char * name, size_t len, uint32_t seed)
+        {
+            uint32_t h = seed ^ (len * 0x9e3779b1);
+            if (len) {
+                h = (h ^ (unsigned char)name[0]) * 0x01000193;
+                h = (h ^ (unsigned char)name[len > 1]) * 0x01000193;
+                h = (h ^ (unsigned char)name[len - 1]) * 0x01000193;
+            }
+            return h ^ (h >> 15);
+        }
+
+    private:
+        struct Slot {
+            const char * name;
+            size_t len;
+            const FieldDescription * field;
+        };
+
+        std::vector<Slot> slots;
+        uint32_t seed;
+        uint32_t mask;
+    };
+
+    FieldIndex fieldIndex;
+
+    /** Rebuilds fieldIndex; called after fields is modified. */
+    void indexFields()
+    {
+        fieldIndex.build(fields);
+    }
+
     struct Exception: public ML::Exception {
         Exception(JsonParsingContext & context,
                   const std::string & message)
@@ -821,14 +887,13 @@ struct StructureDescriptionBase {
                 {
                     try {
                         auto n = context.fieldNamePtr();
-                        auto it = fields.find(n);
-                        if (it == fields.end()) {
+                        auto fd = fieldIndex.find(n);
+                        if (!fd) {
                             context.onUnknownField(owner);
                         }
                         else {
-                            it->second.description
-                                ->parseJson(addOffset(output,
-                                                      it->second.offset),
+                            fd->description
+                                ->parseJson(addOffset(output, fd->offset),
                                             context);
                         }
                     }
@@ -977,6 +1042,7 @@ struct StructureDescription
         fd.offset = (size_t)&(p->*field);
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
+        indexFields();
         //using namespace std;
         //cerr << "offset = " << fd.offset << endl;
     }
@@ -1119,6 +1185,8 @@ addParent(ValueDescriptionT<V> * description_)
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
     }
+
+    indexFields();
 }
 
 
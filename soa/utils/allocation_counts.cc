@@ -0,0 +1,130 @@
+/** allocation_counts.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+*/
+
+#include <atomic>
+#include <mutex>
+
+#include "allocation_counts.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+/* Counts of a thread.  Only the thread itself writes them, so they are
+   updated with plain loads and stores; they are atomic so that current()
+   can read them from another thread.
+
+   Nothing here may allocate with operator new, as it is called from it. */
+
+struct ThreadCounts {
+    ThreadCounts();
+    ~ThreadCounts();
+
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+
+    ThreadCounts * prev;
+    ThreadCounts * next;
+};
+
+std::mutex threadsLock;
+ThreadCounts * threads(nullptr);
+
+/* Counts of the threads that exited. */
+std::atomic<uint64_t> exitedAllocations(0);
+std::atomic<uint64_t> exitedBytes(0);
+
+std::atomic<bool> counting(false);
+
+ThreadCounts::
+ThreadCounts()
+    : allocations(0), bytes(0), prev(nullptr)
+{
+    std::unique_lock<std::mutex> guard(threadsLock);
+    next = threads;
+    if (next) {
+        next->prev = this;
+    }
+    threads = this;
+}
+
+ThreadCounts::
+~ThreadCounts()
+{
+    std::unique_lock<std::mutex> guard(threadsLock);
+    exitedAllocations += allocations;
+    exitedBytes += bytes;
+    allocations = 0;
+    bytes = 0;
+
+    if (prev) {
+        prev->next = next;
+    }
+    else {
+        threads = next;
+    }
+    if (next) {
+        next->prev = prev;
+    }
+}
+
+thread_local ThreadCounts threadCounts;
+
+} // file scope
+
+
+/* ALLOCATIONCOUNTS */
+
+AllocationCounts
+AllocationCounts::
+current()
+{
+    AllocationCounts result;
+
+    std::unique_lock<std::mutex> guard(threadsLock);
+    result.allocations = exitedAllocations;
+    result.bytes = exitedBytes;
+    for (ThreadCounts * counts = threads; counts; counts = counts->next) {
+        result.allocations += counts->allocations.load(memory_order_relaxed);
+        result.bytes += counts->bytes.load(memory_order_relaxed);
+    }
+
+    return result;
+}
+
+AllocationCounts
+AllocationCounts::
+currentThread()
+{
+    AllocationCounts result;
+    result.allocations = threadCounts.allocations.load(memory_order_relaxed);
+    result.bytes = threadCounts.bytes.load(memory_order_relaxed);
+    return result;
+}
+
+bool
+AllocationCounts::
+enabled()
+{
+    return counting.load(memory_order_relaxed);
+}
+
+void
+AllocationCounts::
+record(size_t bytes)
+    noexcept
+{
+    if (!counting.load(memory_order_relaxed)) {
+        counting.store(true, memory_order_relaxed);
+    }
+
+    ThreadCounts & counts = threadCounts;
+    counts.allocations.store(counts.allocations.load(memory_order_relaxed) + 1,
+                             memory_order_relaxed);
+    counts.bytes.store(counts.bytes.load(memory_order_relaxed) + bytes,
+                       memory_order_relaxed);
+}
@@ -0,0 +1,63 @@
+/** allocation_counts.h                                           -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    Counts of the allocations made by the program and by each thread.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace Datacratic {
+
+
+/****************************************************************************/
+/* ALLOCATION COUNTS                                                        */
+/****************************************************************************/
+
+/* Number and total size of the allocations made through operator new since
+   the program started.  They are only counted in programs that include
+   "soa/utils/count_allocations.h" in one of their source files, as it
+   replaces the global operator new to call record().
+
+   Each thread counts its own allocations without sharing a cache line with
+   the others, so that counting stays cheap in a multithreaded program. */
+
+struct AllocationCounts {
+    AllocationCounts()
+        : allocations(0), bytes(0)
+    {}
+
+    /** Allocations of all of the threads, including those that exited. */
+    static AllocationCounts current();
+
+    /** Allocations of the calling thread. */
+    static AllocationCounts currentThread();
+
+    /** Whether allocations are being counted in this program. */
+    static bool enabled();
+
+    static void record(size_t bytes) noexcept;
+
+    AllocationCounts & operator += (const AllocationCounts & other)
+    {
+        allocations += other.allocations;
+        bytes += other.bytes;
+        return *this;
+    }
+
+    AllocationCounts operator - (const AllocationCounts & other) const
+    {
+        AllocationCounts result;
+        result.allocations = allocations - other.allocations;
+        result.bytes = bytes - other.bytes;
+        return result;
+    }
+
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+} // namespace Datacratic
@@ -1,3 +1,17 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "jml/arch/exception.h"
 #include "benchmarks.h"
 
 using namespace std;
@@ -42,3 +56,346 @@ clear()
     Guard lock(dataLock_);
     data_.clear();
 }
+
+
+/* BENCHMARKSTATS */
+
+BenchmarkStats
+BenchmarkStats::
+summarize(vector<double> samples)
+{
+    BenchmarkStats result;
+    if (samples.empty()) {
+        return result;
+    }
+
+    auto median = [] (vector<double> & values) {
+        size_t n = values.size();
+        std::sort(values.begin(), values.end());
+        return (n % 2
+                ? values[n / 2]
+                : (values[n / 2 - 1] + values[n / 2]) / 2);
+    };
+
+    result.median = median(samples);
+    result.min = samples.front();
+    result.max = samples.back();
+
+    for (double & sample: samples) {
+        sample = std::abs(sample - result.median);
+    }
+    result.mad = median(samples);
+
+    return result;
+}
+
+Json::Value
+BenchmarkStats::
+toJson()
+    const
+{
+    Json::Value result;
+    result["median"] = median;
+    result["mad"] = mad;
+    result["min"] = min;
+    result["max"] = max;
+    return result;
+}
+
+
+/* HARDWARECOUNTERS */
+
+HardwareCounters::
+HardwareCounters()
+    : available_(false), error_(0)
+{
+    std::fill(fds_, fds_ + NUM_COUNTERS, -1);
+}
+
+HardwareCounters::
+~HardwareCounters()
+{
+    close();
+}
+
+void
+HardwareCounters::
+start()
+{
+    static const uint64_t configs[NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    close();
+
+    /* The counters are opened one by one rather than as a group, as a group
+       can't be read once it inherits the counts of other threads. */
+    available_ = true;
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        ::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds_[i] = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds_[i] == -1) {
+            error_ = errno;
+            close();
+            return;
+        }
+    }
+
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        ::ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+HardwareCounters::Counts
+HardwareCounters::
+stop()
+{
+    uint64_t values[NUM_COUNTERS] = { 0, 0, 0 };
+
+    if (available_) {
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            ::ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            if (::read(fds_[i], &values[i], sizeof(values[i]))
+                != sizeof(values[i])) {
+                values[i] = 0;
+            }
+        }
+    }
+
+    Counts result;
+    result.cycles = values[0];
+    result.instructions = values[1];
+    result.cacheMisses = values[2];
+    return result;
+}
+
+void
+HardwareCounters::
+close()
+{
+    for (int & fd: fds_) {
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    available_ = false;
+}
+
+
+/* BENCHMARKRESULT */
+
+Json::Value
+BenchmarkResult::
+toJson()
+    const
+{
+    Json::Value result;
+    result["name"] = name;
+    result["operations"] = operations;
+    result["runs"] = runs;
+    result["seconds"] = seconds.toJson();
+    if (seconds.median > 0) {
+        result["operationsPerSecond"] = operations / seconds.median;
+    }
+    for (const auto & entry: counters) {
+        result["counters"][entry.first] = entry.second.toJson();
+    }
+    return result;
+}
+
+
+/* BENCHMARKRUNNER */
+
+BenchmarkRunner::
+BenchmarkRunner()
+    : warmupRuns(1), runs(10), hardwareCounters(false)
+{
+}
+
+void
+BenchmarkRunner::
+parseCommandLine(int & argc, char ** argv)
+{
+    auto intArg = [&] (int i) {
+        if (i + 1 >= argc) {
+            throw ML::Exception("missing value for option %s", argv[i]);
+        }
+        return std::atoi(argv[i + 1]);
+    };
+
+    int out = 1;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--warmup") {
+            warmupRuns = intArg(i++);
+        }
+        else if (arg == "--runs") {
+            runs = intArg(i++);
+        }
+        else if (arg == "--counters") {
+            hardwareCounters = true;
+        }
+        else if (arg == "--json") {
+            if (i + 1 >= argc) {
+                throw ML::Exception("missing value for option --json");
+            }
+            jsonOutput = argv[++i];
+        }
+        else {
+            argv[out++] = argv[i];
+        }
+    }
+    argc = out;
+    argv[argc] = nullptr;
+
+    if (runs < 1) {
+        throw ML::Exception("at least one measured run is needed");
+    }
+}
+
+const BenchmarkResult &
+BenchmarkRunner::
+run(const string & name, const Function & fn)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    for (int i = 0; i < warmupRuns; i++) {
+        fn();
+    }
+
+    HardwareCounters hwCounters;
+    bool countAllocations = AllocationCounts::enabled();
+
+    uint64_t operations(0);
+    vector<double> seconds;
+    map<string, vector<double> > perOperation;
+
+    for (int i = 0; i < runs; i++) {
+        if (hardwareCounters) {
+            hwCounters.start();
+        }
+        AllocationCounts allocsBefore = AllocationCounts::current();
+        Clock::time_point start = Clock::now();
+
+        operations = fn();
+
+        Clock::time_point end = Clock::now();
+        AllocationCounts allocsAfter = AllocationCounts::current();
+        HardwareCounters::Counts counts;
+        if (hardwareCounters) {
+            counts = hwCounters.stop();
+        }
+
+        double delta = std::chrono::duration<double>(end - start).count();
+        seconds.push_back(delta);
+        totals.collectBenchmark({name}, delta);
+
+        double ops = std::max<uint64_t>(operations, 1);
+        if (countAllocations) {
+            perOperation["allocations"].push_back
+                ((allocsAfter.allocations - allocsBefore.allocations) / ops);
+            perOperation["allocatedBytes"].push_back
+                ((allocsAfter.bytes - allocsBefore.bytes) / ops);
+        }
+        if (hwCounters.available()) {
+            perOperation["cycles"].push_back(counts.cycles / ops);
+            perOperation["instructions"].push_back(counts.instructions / ops);
+            perOperation["cacheMisses"].push_back(counts.cacheMisses / ops);
+        }
+    }
+
+    if (hardwareCounters && !hwCounters.available()) {
+        cerr << ("benchmark " + name + ": hardware counters unavailable: "
+                 + strerror(hwCounters.error()) + "\n");
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.operations = operations;
+    result.runs = runs;
+    result.seconds = BenchmarkStats::summarize(seconds);
+    for (auto & entry: perOperation) {
+        result.counters[entry.first]
+            = BenchmarkStats::summarize(std::move(entry.second));
+    }
+
+    results.emplace_back(std::move(result));
+    return results.back();
+}
+
+void
+BenchmarkRunner::
+dump(ostream & out)
+    const
+{
+    string result;
+    char buf[256];
+
+    for (const BenchmarkResult & bm: results) {
+        const BenchmarkStats & secs = bm.seconds;
+        ::snprintf(buf, sizeof(buf),
+                   "%-40s %12.6f s +/- %5.1f%%  %14.1f ops/s\n",
+                   bm.name.c_str(), secs.median,
+                   secs.median > 0 ? 100.0 * secs.mad / secs.median : 0.0,
+                   secs.median > 0 ? bm.operations / secs.median : 0.0);
+        result += buf;
+
+        for (const auto & entry: bm.counters) {
+            ::snprintf(buf, sizeof(buf),
+                       "    %-36s %12.4g   +/- %5.1f%%  per op\n",
+                       entry.first.c_str(), entry.second.median,
+                       (entry.second.median > 0
+                        ? 100.0 * entry.second.mad / entry.second.median
+                        : 0.0));
+            result += buf;
+        }
+    }
+
+    out << result;
+}
+
+Json::Value
+BenchmarkRunner::
+toJson()
+    const
+{
+    Json::Value result;
+    result["warmupRuns"] = warmupRuns;
+    result["runs"] = runs;
+    result["benchmarks"] = Json::Value(Json::arrayValue);
+    for (const BenchmarkResult & bm: results) {
+        result["benchmarks"].append(bm.toJson());
+    }
+    return result;
+}
+
+void
+BenchmarkRunner::
+finish()
+{
+    dump();
+
+    if (!jsonOutput.empty()) {
+        ofstream stream(jsonOutput);
+        stream << toJson().toStyledString();
+        if (!stream) {
+            throw ML::Exception("could not write benchmark results to "
+                                + jsonOutput);
+        }
+    }
+}
@@ -2,21 +2,23 @@
     Wolfgang Sourdeau, 13 April 2014
     Copyright (c) 2014 Datacratic Inc.  All rights reserved.
 
-    Simple utility class to benchmark operations easily.
-
-    Possible improvements:
-    - statistics
+    Simple utility class to benchmark operations easily, and a runner that
+    repeats a benchmark to report robust statistics about it.
 */
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <mutex>
 #include <string>
 #include <vector>
 
+#include "soa/jsoncpp/value.h"
 #include "soa/types/date.h"
+#include "soa/utils/allocation_counts.h"
 
 
 namespace Datacratic {
@@ -86,4 +88,149 @@ struct Benchmark {
     Date start_;
 };
 
+
+/****************************************************************************/
+/* BENCHMARK STATS                                                          */
+/****************************************************************************/
+
+/* Summary of a measure over the runs of a benchmark.  The median and the
+   median absolute deviation are used rather than the mean and the standard
+   deviation, so that the odd run that was descheduled or that started with
+   cold caches doesn't throw off the figures. */
+
+struct BenchmarkStats {
+    BenchmarkStats()
+        : median(0), mad(0), min(0), max(0)
+    {}
+
+    static BenchmarkStats summarize(std::vector<double> samples);
+
+    Json::Value toJson() const;
+
+    double median;
+    double mad;
+    double min;
+    double max;
+};
+
+
+/****************************************************************************/
+/* HARDWARE COUNTERS                                                        */
+/****************************************************************************/
+
+/* Cycles, instructions and cache misses in user space, read through
+   perf_event_open.  They count the calling thread and the threads that it
+   starts after start(), the latter once they have exited.
+
+   When the kernel doesn't allow it (perf_event_paranoid, containers,
+   virtual machines without a PMU), available() returns false and all of the
+   counts are zero. */
+
+struct HardwareCounters {
+    HardwareCounters();
+    ~HardwareCounters();
+
+    HardwareCounters(const HardwareCounters &) = delete;
+    HardwareCounters & operator = (const HardwareCounters &) = delete;
+
+    struct Counts {
+        Counts()
+            : cycles(0), instructions(0), cacheMisses(0)
+        {}
+
+        uint64_t cycles;
+        uint64_t instructions;
+        uint64_t cacheMisses;
+    };
+
+    /** Whether the counters could be opened the last time start() was
+        called. */
+    bool available() const { return available_; }
+
+    /** errno of the failure to open them when they are not available. */
+    int error() const { return error_; }
+
+    void start();
+    Counts stop();
+
+private:
+    void close();
+
+    enum { NUM_COUNTERS = 3 };
+    int fds_[NUM_COUNTERS];
+    bool available_;
+    int error_;
+};
+
+
+/****************************************************************************/
+/* BENCHMARK RESULT                                                         */
+/****************************************************************************/
+
+struct BenchmarkResult {
+    BenchmarkResult()
+        : operations(0), runs(0)
+    {}
+
+    Json::Value toJson() const;
+
+    std::string name;
+    uint64_t operations;        ///< Operations done by each run
+    int runs;                   ///< Number of runs that were measured
+    BenchmarkStats seconds;     ///< Time taken by each run
+
+    /** Hardware and allocation counts per operation, by name. */
+    std::map<std::string, BenchmarkStats> counters;
+};
+
+
+/****************************************************************************/
+/* BENCHMARK RUNNER                                                         */
+/****************************************************************************/
+
+/* Runs each benchmark a few times to warm up the caches, the allocator and
+   the branch predictors, then measures it over a number of runs and
+   summarizes each measure with its median and MAD.  The time of each
+   measured run is also collected under the name of the benchmark in
+   "totals".
+
+   The results are printed as a table on dump() and written as JSON to
+   "jsonOutput" on finish(), so that the results before and after a change
+   can be compared. */
+
+struct BenchmarkRunner {
+    BenchmarkRunner();
+
+    /** Removes the options of the runner from the command line, so that the
+        rest of it can be given to the parser of the program:
+
+        --warmup N     number of unmeasured runs (default 1)
+        --runs N       number of measured runs (default 10)
+        --counters     read the hardware counters
+        --json FILE    write the results to FILE
+    */
+    void parseCommandLine(int & argc, char ** argv);
+
+    /** A benchmark, which returns the number of operations that it did so
+        that the counters can be reported per operation. */
+    typedef std::function<uint64_t ()> Function;
+
+    const BenchmarkResult & run(const std::string & name,
+                                const Function & fn);
+
+    void dump(std::ostream & stream = std::cerr) const;
+    Json::Value toJson() const;
+
+    /** Dumps the results, and writes them to jsonOutput if it is set. */
+    void finish();
+
+    int warmupRuns;
+    int runs;
+    bool hardwareCounters;
+    std::string jsonOutput;
+
+    Benchmarks totals;
+    std::vector<BenchmarkResult> results;
+};
+
 } // namespace Datacratic
@@ -0,0 +1,61 @@
+/** count_allocations.h                                           -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    Replacement of the global operator new that counts the allocations (see
+    AllocationCounts).  Include it in exactly one source file of a program;
+    it must not be included in a library.
+*/
+
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+#include "soa/utils/allocation_counts.h"
+
+
+void * operator new (std::size_t size)
+{
+    Datacratic::AllocationCounts::record(size);
+    void * result = std::malloc(size ? size : 1);
+    if (!result) {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+void * operator new[] (std::size_t size)
+{
+    return operator new (size);
+}
+
+void * operator new (std::size_t size, const std::nothrow_t &) noexcept
+{
+    Datacratic::AllocationCounts::record(size);
+    return std::malloc(size ? size : 1);
+}
+
+void * operator new[] (std::size_t size, const std::nothrow_t & tag) noexcept
+{
+    return operator new (size, tag);
+}
+
+void operator delete (void * ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[] (void * ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete (void * ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[] (void * ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
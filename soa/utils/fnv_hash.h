@@ -5,6 +5,11 @@
     FNV Hash : Same implementation as Go
 */
 
+#pragma once
+
+#include <cstdint>
+#include <string>
+
 namespace Datacratic {
 
 /******************************************************************************/
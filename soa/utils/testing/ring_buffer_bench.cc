@@ -0,0 +1,134 @@
+/** ring_buffer_bench.cc                                 -*- C++ -*-
+    Copyright (c) 2016 Datacratic.  All rights reserved.
+
+    Times passing messages through the locking ring buffers against the
+    lock-free ones, one at a time and in batches.
+
+    With one producer, all of the buffers are compared; with several, only
+    the ones that support multiple producers.
+
+*/
+
+#include "jml/utils/ring_buffer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace ML;
+
+
+namespace {
+
+typedef uint64_t Message;
+
+/* Adapters so that each buffer can be driven the same way.  The locking
+   buffers only have single element operations, so their batches are done
+   one at a time. */
+
+template<typename Buffer>
+size_t pushBatch(Buffer & buffer, const Message * first, size_t n)
+{
+    size_t i = 0;
+    while (i < n && buffer.tryPush(first[i])) ++i;
+    return i;
+}
+
+template<typename Buffer>
+size_t popBatch(Buffer & buffer, Message * out, size_t n)
+{
+    size_t i = 0;
+    while (i < n && buffer.tryPop(out[i])) ++i;
+    return i;
+}
+
+size_t pushBatch(RingBufferSPSC<Message> & buffer,
+                 const Message * first, size_t n)
+{
+    return buffer.tryPushBatch(first, first + n);
+}
+
+size_t popBatch(RingBufferSPSC<Message> & buffer, Message * out, size_t n)
+{
+    return buffer.tryPopBatch(out, n);
+}
+
+size_t pushBatch(RingBufferMPMC<Message> & buffer,
+                 const Message * first, size_t n)
+{
+    return buffer.tryPushBatch(first, first + n);
+}
+
+size_t popBatch(RingBufferMPMC<Message> & buffer, Message * out, size_t n)
+{
+    return buffer.tryPopBatch(out, n);
+}
+
+template<typename Buffer>
+void bench(const char * what, int producers, size_t n, size_t batchSize)
+{
+    Buffer buffer(1024);
+
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for (int p = 0;  p < producers;  ++p) {
+        threads.emplace_back([&] () {
+                vector<Message> batch(batchSize);
+                for (size_t i = 0;  i < n;) {
+                    size_t todo = std::min(batchSize, n - i);
+                    for (size_t j = 0;  j < todo;  ++j)
+                        batch[j] = i + j;
+                    size_t done = pushBatch(buffer, &batch[0], todo);
+                    if (!done) this_thread::yield();
+                    i += done;
+                }
+            });
+    }
+
+    vector<Message> batch(batchSize);
+    uint64_t total = 0;
+    for (size_t i = 0;  i < n * producers;) {
+        size_t done = popBatch(buffer, &batch[0], batchSize);
+        if (!done) this_thread::yield();
+        for (size_t j = 0;  j < done;  ++j)
+            total += batch[j];
+        i += done;
+    }
+
+    for (auto & t: threads)
+        t.join();
+
+    auto elapsed = chrono::steady_clock::now() - start;
+    double ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+    uint64_t expected = producers * (n * (n - 1) / 2);
+    printf("%-8s %2d producers  batch %3zd  %8.1f ns/message%s\n",
+           what, producers, batchSize, ns / (n * producers),
+           total == expected ? "" : "  WRONG SUM");
+}
+
+} // file scope
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int maxProducers = argc > 2 ? atoi(argv[2]) : 4;
+
+    for (size_t batchSize: { 1, 16 }) {
+        bench<RingBufferSWMR<Message> >("SWMR", 1, n, batchSize);
+        bench<RingBufferSRMW<Message> >("SRMW", 1, n, batchSize);
+        bench<RingBufferSPSC<Message> >("SPSC", 1, n, batchSize);
+        bench<RingBufferMPMC<Message> >("MPMC", 1, n, batchSize);
+    }
+
+    for (int producers = 2;  producers <= maxProducers;  producers *= 2) {
+        for (size_t batchSize: { 1, 16 }) {
+            bench<RingBufferSRMW<Message> >("SRMW", producers, n, batchSize);
+            bench<RingBufferMPMC<Message> >("MPMC", producers, n, batchSize);
+        }
+    }
+}
@@ -12,3 +12,4 @@ $(eval $(call test,variadic_hash_test,variadic_hash,boost))
 $(eval $(call test,fnv_hash_test,,boost))
 $(eval $(call test,type_traits_test,,boost))
 $(eval $(call test,scope_test,arch,boost))
+$(eval $(call program,ring_buffer_bench,arch))
@@ -6,13 +6,15 @@
 # Makefile of soa's misc utilities.
 #------------------------------------------------------------------------------#
 
+$(eval $(call library,allocation_counts,allocation_counts.cc,))
+
 LIB_TEST_UTILS_SOURCES := \
         benchmarks.cc \
         fixtures.cc \
         threaded_test.cc
 
 LIB_TEST_UTILS_LINK := \
-	arch utils boost_filesystem boost_thread
+	arch utils types jsoncpp allocation_counts boost_filesystem boost_thread
 
 $(eval $(call library,test_utils,$(LIB_TEST_UTILS_SOURCES),$(LIB_TEST_UTILS_LINK)))
 